@@ -0,0 +1,159 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2019 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ * 1 tab == 4 spaces!
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/*-----------------------------------------------------------
+ * Host build on the FreeRTOS POSIX port, see host/Makefile.
+ *
+ * The settings follow source/FreeRTOSConfig.h, so that the application modules
+ * see the same priorities, stack sizes, notification indexes and hooks as on
+ * the board. Left out: the trace recorder, the MPU, tickless idle and the
+ * Cortex-M interrupt priorities.
+ *
+ * See http://www.freertos.org/a00110.html.
+ *----------------------------------------------------------*/
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_TICKLESS_IDLE                 0
+#define configCPU_CLOCK_HZ                      (SystemCoreClock)
+#define configTICK_RATE_HZ                      ((TickType_t)200)
+#define configMAX_PRIORITIES                    5
+#define configMINIMAL_STACK_SIZE                ((unsigned short)90)
+#define configMAX_TASK_NAME_LEN                 20
+#define configUSE_16_BIT_TICKS                  0
+#define configIDLE_SHOULD_YIELD                 1
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   4 /* Index 1 aborts retry backoff sleeps, index 2 waits for crypto jobs, index 3 for DMA copies. */
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             1
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configUSE_ALTERNATIVE_API               0 /* Deprecated! */
+#define configQUEUE_REGISTRY_SIZE               8
+#define configUSE_QUEUE_SETS                    0
+#define configUSE_TIME_SLICING                  0
+#define configUSE_NEWLIB_REENTRANT              0
+#define configENABLE_BACKWARD_COMPATIBILITY     0
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
+
+/* heap_4.c, heap_regions.c places the heap in the board RAM banks. */
+#define configFRTOS_MEMORY_SCHEME               4
+
+/* Memory allocation related definitions. The network buffers come from the heap with
+ * BufferAllocation_2 of the Linux network interface, on top of the 98 KB of the board. */
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configTOTAL_HEAP_SIZE                   ((size_t)(128 * 1024))
+#define configAPPLICATION_ALLOCATED_HEAP        0
+#define configAPPLICATION_STATIC_OBJECTS        0
+
+/* Hook function related definitions. */
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+/* Only checked for the tasks whose stack is large enough to be the stack of their thread,
+ * smaller ones run on a default thread stack. */
+#define configCHECK_FOR_STACK_OVERFLOW          2
+#define configUSE_MALLOC_FAILED_HOOK            1
+#define configUSE_DAEMON_TASK_STARTUP_HOOK      0
+
+/* Run time and task stats gathering related definitions. */
+/* The run time counter is the emulated DWT cycle counter extended to 64 bits, see task_stats.c. */
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+#define configUSE_TRACE_FACILITY                1
+#define configUSE_STATS_FORMATTING_FUNCTIONS    0
+
+/* Task aware debugging. */
+#define configRECORD_STACK_HIGH_ADDRESS         1
+
+/* Co-routine related definitions. */
+#define configUSE_CO_ROUTINES                   0
+#define configMAX_CO_ROUTINE_PRIORITIES         2
+
+/* Software timer related definitions. */
+#define configUSE_TIMERS                        1
+#define configTIMER_TASK_PRIORITY               (configMAX_PRIORITIES - 1)
+#define configTIMER_QUEUE_LENGTH                10
+#define configTIMER_TASK_STACK_DEPTH            (configMINIMAL_STACK_SIZE * 2)
+
+/* Prints the location and aborts, for a core dump or the valgrind report. */
+#define configASSERT(x) if(( x) == 0) {vAssertCalled(__FILE__, __LINE__);}
+
+/* Optional functions - most linkers will remove unused functions anyway. */
+#define INCLUDE_vTaskPrioritySet                1
+#define INCLUDE_uxTaskPriorityGet               1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_vTaskDelayUntil                 1
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_xTaskGetIdleTaskHandle          0
+#define INCLUDE_eTaskGetState                   0
+#define INCLUDE_xTimerPendFunctionCall          1
+#define INCLUDE_xTaskAbortDelay                 0
+#define INCLUDE_xTaskGetHandle                  0
+#define INCLUDE_xTaskResumeFromISR              1
+
+/* Index of the pcap interface of the FreeRTOS+TCP Linux network interface, in the list it prints
+ * at start up, and priority of its receive task. Set with NETIF in host/Makefile. */
+#ifndef configNETWORK_INTERFACE_TO_USE
+    #define configNETWORK_INTERFACE_TO_USE      1L
+#endif
+#define configMAC_ISR_SIMULATOR_PRIORITY        (configMAX_PRIORITIES - 1)
+
+#include <stdint.h>
+
+/* Core clock of the emulated DWT cycle counter, see host_board.c. */
+extern uint32_t SystemCoreClock;
+
+extern void vAssertCalled( const char * pcFile, unsigned long ulLine );
+
+/* Run time stats on the DWT cycle counter, see task_stats.c. */
+extern void TaskStats_ConfigureTimer( void );
+extern uint64_t TaskStats_GetRunTimeCounter( void );
+
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()    TaskStats_ConfigureTimer()
+#define portGET_RUN_TIME_COUNTER_VALUE()            TaskStats_GetRunTimeCounter()
+
+/* No trace recorder, the objects of the field profile of trcConfig.h are not marked. */
+#define TRC_FIELD_OBJECTS_BEGIN()
+#define TRC_FIELD_OBJECTS_END()
+
+/* Attribution of the allocations to their call sites, see heap_monitor.h. */
+#if defined( heapmonitorTRACK_CALLERS ) && ( heapmonitorTRACK_CALLERS == 1 )
+    #include <stddef.h>
+    extern void HeapMonitor_TraceMalloc( const void * pvAddress, size_t xSize, const void * pvCaller );
+    extern void HeapMonitor_TraceFree( const void * pvAddress );
+
+    #define traceMALLOC( pvAddress, uiSize )    HeapMonitor_TraceMalloc( ( pvAddress ), ( uiSize ), __builtin_return_address( 0 ) )
+    #define traceFREE( pvAddress, uiSize )      HeapMonitor_TraceFree( ( pvAddress ) )
+#endif
+
+#endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,127 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file fsl_device_registers.h
+ * @brief Core registers of the host build, see host_board.c.
+ *
+ * The DWT cycle counter counts at SystemCoreClock from the host monotonic clock, it is sampled each
+ * time DWT is read. The other registers only take the writes of the bootloader code.
+ * LDREX and STREX are emulated with a compare and swap, the reservation is held by each thread.
+ */
+
+#ifndef FSL_DEVICE_REGISTERS_H
+#define FSL_DEVICE_REGISTERS_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct
+{
+    volatile uint32_t ICER[ 8 ];
+    volatile uint32_t ICPR[ 8 ];
+} NVIC_Type;
+
+typedef struct
+{
+    volatile uint32_t ICSR;
+    volatile uint32_t VTOR;
+} SCB_Type;
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+} SysTick_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk        ( 1UL )
+#define CoreDebug_DEMCR_TRCENA_Msk    ( 1UL << 24 )
+#define SCB_ICSR_PENDSTCLR_Msk        ( 1UL << 25 )
+
+extern uint32_t SystemCoreClock;
+
+extern CoreDebug_Type xHostCoreDebug;
+extern NVIC_Type xHostNvic;
+extern SCB_Type xHostScb;
+extern SysTick_Type xHostSysTick;
+
+/**
+ * @brief Updates the cycle count from the host monotonic clock.
+ *
+ * @return The emulated DWT.
+ */
+DWT_Type * HostBoard_SampleDwt( void );
+
+/**
+ * @brief Restarts the process, as the board resets, see host_board.c.
+ */
+void HostBoard_Reset( void ) __attribute__( ( noreturn ) );
+
+#define DWT          ( HostBoard_SampleDwt() )
+#define CoreDebug    ( &xHostCoreDebug )
+#define NVIC         ( &xHostNvic )
+#define SCB          ( &xHostScb )
+#define SysTick      ( &xHostSysTick )
+
+/**
+ * @brief Value loaded by the last __LDREXW() of the calling thread.
+ */
+extern __thread uint32_t ulHostExclusiveValue;
+
+static inline uint32_t __LDREXW( volatile uint32_t * pulAddress )
+{
+    ulHostExclusiveValue = __atomic_load_n( pulAddress, __ATOMIC_SEQ_CST );
+
+    return ulHostExclusiveValue;
+}
+
+/* Fails, as the store exclusive of the core, when the word changed since the load. */
+static inline uint32_t __STREXW( uint32_t ulValue,
+                                 volatile uint32_t * pulAddress )
+{
+    uint32_t ulExpected = ulHostExclusiveValue;
+
+    return __atomic_compare_exchange_n( pulAddress, &ulExpected, ulValue, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) ? 0U : 1U;
+}
+
+#define __CLREX()
+#define __DMB()                 __atomic_thread_fence( __ATOMIC_SEQ_CST )
+#define __DSB()                 __atomic_thread_fence( __ATOMIC_SEQ_CST )
+#define __ISB()
+#define __enable_irq()
+#define __set_MSP( ulValue )    ( ( void ) ( ulValue ) )
+#define NVIC_SystemReset()      HostBoard_Reset()
+
+#endif /* FSL_DEVICE_REGISTERS_H */
@@ -0,0 +1,58 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file fsl_wwdt.h
+ * @brief Windowed watchdog of the host build, a thread restarting the process once it is not fed
+ * within the timeout, see host_board.c.
+ */
+
+#ifndef FSL_WWDT_H
+#define FSL_WWDT_H
+
+#include "fsl_common.h"
+
+typedef struct
+{
+    uint32_t ulReserved;
+} WWDT_Type;
+
+typedef struct _wwdt_config
+{
+    bool enableWwdt;
+    bool enableWatchdogReset;
+    uint32_t timeoutValue; /* In ticks of the watchdog oscillator divided by 4. */
+} wwdt_config_t;
+
+extern WWDT_Type xHostWwdt;
+
+#define WWDT    ( &xHostWwdt )
+
+void WWDT_GetDefaultConfig( wwdt_config_t * config );
+void WWDT_Init( WWDT_Type * base,
+                const wwdt_config_t * config );
+void WWDT_Refresh( WWDT_Type * base );
+
+#endif /* FSL_WWDT_H */
@@ -0,0 +1,54 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file host_board.h
+ * @brief Board services of the host build: the SRAM window of the boot timing record, the process
+ * restart standing for the device reset and the update control block handling of the bootloader.
+ */
+
+#ifndef HOST_BOARD_H
+#define HOST_BOARD_H
+
+/**
+ * @brief Maps the SRAM window and keeps the command line for the restarts. Called first in main().
+ *
+ * @param[in] argc The argument count of main().
+ * @param[in] argv The arguments of main(), passed again to the restarted process.
+ */
+void HostBoard_Init( int argc,
+                     char ** argv );
+
+/**
+ * @brief Steps the update control block as boot_run() does before it executes the image, once
+ * mflash_drv_init() has mapped the flash file.
+ *
+ * A new update is moved to the pending commit state with the watchdog armed, a pending or
+ * rejected one is rolled back. The images are not installed: the process keeps running the
+ * executable of HOST_RESET_EXE, see host_board.c.
+ */
+void HostBoard_Boot( void );
+
+#endif /* HOST_BOARD_H */
@@ -0,0 +1,65 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file clock_scaling.c
+ * @brief Clock levels of clock_scaling.h on the host build, which always runs at
+ * CLOCK_LEVEL_PLL180M, the rate of the emulated cycle counter.
+ */
+
+#include "FreeRTOS.h"
+
+#include "clock_scaling.h"
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_Init( void )
+{
+}
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_Boost( void )
+{
+}
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_Release( void )
+{
+}
+
+/*-----------------------------------------------------------*/
+
+ClockLevel_t ClockScaling_GetLevel( void )
+{
+    return CLOCK_LEVEL_PLL180M;
+}
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_RestoreAfterDeepSleep( void )
+{
+}
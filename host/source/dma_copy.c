@@ -0,0 +1,100 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file dma_copy.c
+ * @brief Copies of dma_copy.h on the host build, done by the CPU. The asynchronous calls return
+ * pdFALSE, as the firmware does for the copies the DMA does not take.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "dma_copy.h"
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DmaCopy_Init( void )
+{
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+void * DmaCopy_Memcpy( void * pvDst,
+                       const void * pvSrc,
+                       size_t xLength )
+{
+    return memcpy( pvDst, pvSrc, xLength );
+}
+
+/*-----------------------------------------------------------*/
+
+void * DmaCopy_Memset( void * pvDst,
+                       int lValue,
+                       size_t xLength )
+{
+    return memset( pvDst, lValue, xLength );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DmaCopy_MemcpyAsync( void * pvDst,
+                                const void * pvSrc,
+                                size_t xLength,
+                                DmaCopyDone_t xDone,
+                                void * pvContext )
+{
+    ( void ) xDone;
+    ( void ) pvContext;
+
+    ( void ) memcpy( pvDst, pvSrc, xLength );
+
+    return pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DmaCopy_MemsetAsync( void * pvDst,
+                                int lValue,
+                                size_t xLength,
+                                DmaCopyDone_t xDone,
+                                void * pvContext )
+{
+    ( void ) xDone;
+    ( void ) pvContext;
+
+    ( void ) memset( pvDst, lValue, xLength );
+
+    return pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void DmaCopy_IRQHandler( BaseType_t * pxHigherPriorityTaskWoken )
+{
+    ( void ) pxHigherPriorityTaskWoken;
+}
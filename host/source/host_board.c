@@ -0,0 +1,429 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file host_board.c
+ * @brief Board services of the host build, see host_board.h.
+ *
+ * A reset of the board is a restart of the process with execv(), of the executable named by the
+ * HOST_RESET_EXE environment variable, or of the running one. The flash file, see
+ * lib/nxp/mflash/posix/mflash_drv.c, keeps the update control block and the PKCS #11 objects
+ * across the restarts, the SRAM window does not. The watchdog is a thread, which never calls the
+ * FreeRTOS API, restarting the process once it is not fed within its timeout.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fsl_device_registers.h"
+#include "fsl_debug_console.h"
+#include "fsl_power.h"
+#include "fsl_wwdt.h"
+
+#include "spifi_boot.h"
+#include "host_board.h"
+
+/**
+ * @brief SRAM banks of the board, holding the boot timing record of spifi_boot.h.
+ */
+#define hostboardSRAM_ADDR      ( 0x20000000UL )
+#define hostboardSRAM_SIZE      ( 0x28000UL )
+
+/**
+ * @brief Frequency of the watchdog oscillator, the WWDT counts at a quarter of it.
+ */
+#define hostboardWDT_OSC_HZ     ( 500000UL )
+
+/**
+ * @brief Highest file descriptor closed before a restart, the pcap and socket descriptors are not
+ * opened with O_CLOEXEC.
+ */
+#define hostboardMAX_FD         ( 1024 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Core clock of the board, the rate of the emulated cycle counter.
+ */
+uint32_t SystemCoreClock = 180000000UL;
+
+CoreDebug_Type xHostCoreDebug;
+NVIC_Type xHostNvic;
+SCB_Type xHostScb;
+SysTick_Type xHostSysTick;
+WWDT_Type xHostWwdt;
+
+__thread uint32_t ulHostExclusiveValue;
+
+/**
+ * @brief Cycle counter, sampled by HostBoard_SampleDwt().
+ */
+static DWT_Type xDwt;
+
+/**
+ * @brief Host monotonic time of HostBoard_Init(), the cycle counter starts at 0.
+ */
+static uint64_t ullStartNs;
+
+/**
+ * @brief Arguments of main(), for the restarts.
+ */
+static char ** ppcArguments;
+
+/**
+ * @brief Watchdog state, shared with the watchdog thread.
+ */
+static pthread_mutex_t xWwdtMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t xWwdtCondition;
+static bool xWwdtStarted = false;
+static bool xWwdtRunning = false;
+static uint64_t ullWwdtTimeoutNs;
+static uint64_t ullWwdtDeadlineNs;
+
+/*-----------------------------------------------------------*/
+
+static uint64_t prvNowNs( void )
+{
+    struct timespec xNow;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( ( uint64_t ) xNow.tv_sec * 1000000000ULL ) + ( uint64_t ) xNow.tv_nsec;
+}
+
+/*-----------------------------------------------------------*/
+
+void HostBoard_Init( int argc,
+                     char ** argv )
+{
+    void * pvSram;
+
+    ( void ) argc;
+
+    ppcArguments = argv;
+    ullStartNs = prvNowNs();
+
+    /* Line buffered, so that the logs of many instances are not interleaved within a line. */
+    ( void ) setvbuf( stdout, NULL, _IOLBF, 0 );
+
+    pvSram = mmap( ( void * ) hostboardSRAM_ADDR, hostboardSRAM_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0 );
+
+    if( pvSram != ( void * ) hostboardSRAM_ADDR )
+    {
+        ( void ) fprintf( stderr, "SRAM window not mapped at 0x%08lx, build with -m32.\r\n", hostboardSRAM_ADDR );
+        exit( EXIT_FAILURE );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void HostBoard_Boot( void )
+{
+    struct boot_ucb ucb;
+
+    ( void ) boot_ucb_read( &ucb );
+
+    switch( ucb.state )
+    {
+        case BOOT_STATE_NEW:
+            /* The bootloader would install or activate the update, the host keeps its executable. */
+            PRINTF( BOOT_PROMPT_STRING "Update accepted, the image is not installed on the host\r\n" );
+
+            if( ucb.flags == BOOT_FLAGS_AB )
+            {
+                ucb.active_img = ucb.update_img;
+            }
+
+            ucb.state = BOOT_STATE_PENDING_COMMIT;
+            break;
+
+        case BOOT_STATE_PENDING_COMMIT:
+        case BOOT_STATE_INVALID:
+            /* Reset during the self test or rejected image. */
+            PRINTF( BOOT_PROMPT_STRING "Rolling back to previous image\r\n" );
+
+            if( ucb.flags == BOOT_FLAGS_AB )
+            {
+                ucb.active_img = ucb.rollback_img;
+            }
+
+            ucb.state = BOOT_STATE_VOID;
+            break;
+
+        default:
+            /* Nothing to be done. */
+            return;
+    }
+
+    if( boot_ucb_write( &ucb ) != 0 )
+    {
+        PRINTF( BOOT_PROMPT_STRING "ERROR writing update control block\r\n" );
+    }
+
+    if( ucb.state == BOOT_STATE_PENDING_COMMIT )
+    {
+        PRINTF( BOOT_PROMPT_STRING "Enabling watchdog...\r\n" );
+        boot_wdten();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+DWT_Type * HostBoard_SampleDwt( void )
+{
+    uint64_t ullElapsedNs = prvNowNs() - ullStartNs;
+
+    xDwt.CYCCNT = ( uint32_t ) ( ( ullElapsedNs * ( SystemCoreClock / 1000000UL ) ) / 1000ULL );
+
+    return &xDwt;
+}
+
+/*-----------------------------------------------------------*/
+
+void HostBoard_Reset( void )
+{
+    static const struct itimerval xStopped = { 0 };
+    const char * pcExecutable = getenv( "HOST_RESET_EXE" );
+    sigset_t xSignals;
+    int lFd;
+
+    ( void ) fflush( stdout );
+
+    /* The tick timer and the ignored tick signal survive execv(), the new process sets them up
+     * again when its scheduler starts. */
+    ( void ) setitimer( ITIMER_REAL, &xStopped, NULL );
+    ( void ) signal( SIGALRM, SIG_IGN );
+
+    for( lFd = STDERR_FILENO + 1; lFd < hostboardMAX_FD; lFd++ )
+    {
+        ( void ) close( lFd );
+    }
+
+    /* The signal mask of the calling thread is inherited as well. */
+    ( void ) sigemptyset( &xSignals );
+    ( void ) pthread_sigmask( SIG_SETMASK, &xSignals, NULL );
+
+    if( pcExecutable == NULL )
+    {
+        pcExecutable = "/proc/self/exe";
+    }
+
+    ( void ) execv( pcExecutable, ppcArguments );
+
+    perror( "Restart failed" );
+    _exit( EXIT_FAILURE );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Called by ota_pal.c instead of boot_cpureset(), which writes the AIRCR of the core, with
+ * -Wl,--wrap=boot_cpureset.
+ */
+void __wrap_boot_cpureset( void )
+{
+    HostBoard_Reset();
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t CLOCK_GetFreq( clock_name_t clockName )
+{
+    return ( clockName == kCLOCK_WdtOsc ) ? hostboardWDT_OSC_HZ : SystemCoreClock;
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvWwdtThread( void * pvParameters )
+{
+    struct timespec xDeadline;
+
+    ( void ) pvParameters;
+
+    ( void ) pthread_mutex_lock( &xWwdtMutex );
+
+    for( ; ; )
+    {
+        if( xWwdtRunning == false )
+        {
+            ( void ) pthread_cond_wait( &xWwdtCondition, &xWwdtMutex );
+        }
+        else if( prvNowNs() >= ullWwdtDeadlineNs )
+        {
+            ( void ) pthread_mutex_unlock( &xWwdtMutex );
+            ( void ) fprintf( stderr, "Watchdog timeout, resetting.\r\n" );
+            HostBoard_Reset();
+        }
+        else
+        {
+            xDeadline.tv_sec = ( time_t ) ( ullWwdtDeadlineNs / 1000000000ULL );
+            xDeadline.tv_nsec = ( long ) ( ullWwdtDeadlineNs % 1000000000ULL );
+            ( void ) pthread_cond_timedwait( &xWwdtCondition, &xWwdtMutex, &xDeadline );
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void WWDT_GetDefaultConfig( wwdt_config_t * config )
+{
+    config->enableWwdt = true;
+    config->enableWatchdogReset = false;
+    config->timeoutValue = 0xFFFFFFU;
+}
+
+/*-----------------------------------------------------------*/
+
+void WWDT_Init( WWDT_Type * base,
+                const wwdt_config_t * config )
+{
+    pthread_condattr_t xAttributes;
+    sigset_t xSignals, xPrevious;
+    pthread_t xThread;
+
+    ( void ) base;
+
+    ( void ) pthread_mutex_lock( &xWwdtMutex );
+
+    if( xWwdtStarted == false )
+    {
+        ( void ) pthread_condattr_init( &xAttributes );
+        ( void ) pthread_condattr_setclock( &xAttributes, CLOCK_MONOTONIC );
+        ( void ) pthread_cond_init( &xWwdtCondition, &xAttributes );
+
+        /* The thread must not take the signals of the POSIX port. */
+        ( void ) sigfillset( &xSignals );
+        ( void ) pthread_sigmask( SIG_SETMASK, &xSignals, &xPrevious );
+        xWwdtStarted = ( pthread_create( &xThread, NULL, prvWwdtThread, NULL ) == 0 );
+        ( void ) pthread_sigmask( SIG_SETMASK, &xPrevious, NULL );
+    }
+
+    ullWwdtTimeoutNs = ( ( uint64_t ) config->timeoutValue * 4ULL * 1000000000ULL ) / hostboardWDT_OSC_HZ;
+    ullWwdtDeadlineNs = prvNowNs() + ullWwdtTimeoutNs;
+    xWwdtRunning = config->enableWwdt && config->enableWatchdogReset;
+
+    ( void ) pthread_cond_signal( &xWwdtCondition );
+    ( void ) pthread_mutex_unlock( &xWwdtMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+void WWDT_Refresh( WWDT_Type * base )
+{
+    ( void ) base;
+
+    ( void ) pthread_mutex_lock( &xWwdtMutex );
+    ullWwdtDeadlineNs = prvNowNs() + ullWwdtTimeoutNs;
+    ( void ) pthread_mutex_unlock( &xWwdtMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+void POWER_EnablePD( pd_bit_t en )
+{
+    /* Powering the oscillator down stops the watchdog. */
+    if( en == kPDRUNCFG_PD_WDT_OSC )
+    {
+        ( void ) pthread_mutex_lock( &xWwdtMutex );
+        xWwdtRunning = false;
+        ( void ) pthread_mutex_unlock( &xWwdtMutex );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void POWER_DisablePD( pd_bit_t en )
+{
+    ( void ) en;
+}
+
+/*-----------------------------------------------------------*/
+
+int DbgConsole_Printf( const char * formatString,
+                       ... )
+{
+    va_list xArguments;
+    int lLength;
+
+    va_start( xArguments, formatString );
+    lLength = vprintf( formatString, xArguments );
+    va_end( xArguments );
+
+    return lLength;
+}
+
+/*-----------------------------------------------------------*/
+
+int DbgConsole_BlockingPrintf( const char * formatString,
+                               ... )
+{
+    va_list xArguments;
+    int lLength;
+
+    va_start( xArguments, formatString );
+    lLength = vprintf( formatString, xArguments );
+    va_end( xArguments );
+
+    ( void ) fflush( stdout );
+
+    return lLength;
+}
+
+/*-----------------------------------------------------------*/
+
+int DbgConsole_Putchar( int ch )
+{
+    return putchar( ch );
+}
+
+/*-----------------------------------------------------------*/
+
+status_t DbgConsole_Flush( void )
+{
+    return ( fflush( stdout ) == 0 ) ? kStatus_Success : kStatus_Fail;
+}
+
+/*-----------------------------------------------------------*/
+
+void vAssertCalled( const char * pcFile,
+                    unsigned long ulLine )
+{
+    ( void ) fprintf( stderr, "Assertion failed at %s:%lu\r\n", pcFile, ulLine );
+    ( void ) fflush( stdout );
+    abort();
+}
@@ -0,0 +1,85 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file hw_poll.c
+ * @brief Entropy sources of lib/FreeRTOS/platform/pkcs11/hw_poll.c on the host build, the
+ * hardware RNG is replaced by getrandom(). mbed TLS is still served from the DRBG of
+ * entropy_pool.c.
+ */
+
+#include <stddef.h>
+#include <sys/random.h>
+
+#include "fsl_common.h"
+
+#include "entropy_pool.h"
+
+/*-----------------------------------------------------------*/
+
+int CRYPTO_GetHardwareEntropy( unsigned char * output,
+                               size_t len )
+{
+    size_t xOffset = 0;
+    ssize_t xRead;
+
+    while( xOffset < len )
+    {
+        xRead = getrandom( &output[ xOffset ], len - xOffset, 0 );
+
+        if( xRead <= 0 )
+        {
+            return kStatus_Fail;
+        }
+
+        xOffset += ( size_t ) xRead;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+int mbedtls_hardware_poll( void * data,
+                           unsigned char * output,
+                           size_t len,
+                           size_t * olen )
+{
+    ( void ) data;
+
+    if( xEntropyPoolGetBytes( output, len ) != pdTRUE )
+    {
+        return kStatus_Fail;
+    }
+
+    *olen = len;
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void CRYPTO_InitHardware( void )
+{
+}
@@ -0,0 +1,610 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file main.c
+ * @brief Entry point of the host build, the MQTT hello world and OTA demo of source/main.c on the
+ * FreeRTOS POSIX port, with the FreeRTOS+TCP Linux network interface.
+ *
+ * The broker connection, the MQTT agent, the OTA agent and its PAL, the TLS transport and the
+ * PKCS #11 objects are those of the firmware. The modules bound to the board peripherals, the
+ * power management, the trace recorder and the console shell are left out.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/* Board services. */
+#include "fsl_device_registers.h"
+#include "fsl_debug_console.h"
+#include "mflash_drv.h"
+#include "spifi_boot.h"
+#include "host_board.h"
+
+/* FreeRTOS+TCP includes. */
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+
+#include "core_mqtt.h"
+#include "tls_freertos_pkcs11.h"
+#include "freertos_sockets_wrapper.h"
+
+#include "provision_interface.h"
+
+#include "core_pkcs11.h"
+#include "pkcs11.h"
+
+#include "ota_update.h"
+#include "ota_http.h"
+#include "core_mqtt_agent.h"
+#include "watchdog.h"
+#include "retry_utils.h"
+#include "entropy_pool.h"
+#include "connection_manager.h"
+#include "clock_scaling.h"
+#include "monotonic_clock.h"
+#include "crypto_worker.h"
+#include "dma_copy.h"
+#include "log_level.h"
+#include "task_stats.h"
+#include "heap_monitor.h"
+
+/**
+ * @brief MQTT incoming buffer size, as in source/main.c.
+ */
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+    #define MQTT_INCOMING_BUFFER_SIZE    ( 2048 )
+#else
+    #define MQTT_INCOMING_BUFFER_SIZE    ( 4096 + 512 )
+#endif
+
+/**
+ * @brief ROOT CA used for mutual authentication of TLS connection with AWS IoT MQTT broker.
+ * Certificate is available publicly.
+ *  see: https://docs.aws.amazon.com/iot/latest/developerguide/server-authentication.html
+ */
+#define democonfigROOT_CA_PEM                                            \
+    ""                                                                   \
+    "-----BEGIN CERTIFICATE-----\n"                                      \
+    "MIIDQTCCAimgAwIBAgITBmyfz5m/jAo54vB4ikPmljZbyjANBgkqhkiG9w0BAQsF\n" \
+    "ADA5MQswCQYDVQQGEwJVUzEPMA0GA1UEChMGQW1hem9uMRkwFwYDVQQDExBBbWF6\n" \
+    "b24gUm9vdCBDQSAxMB4XDTE1MDUyNjAwMDAwMFoXDTM4MDExNzAwMDAwMFowOTEL\n" \
+    "MAkGA1UEBhMCVVMxDzANBgNVBAoTBkFtYXpvbjEZMBcGA1UEAxMQQW1hem9uIFJv\n" \
+    "b3QgQ0EgMTCCASIwDQYJKoZIhvcNAQEBBQADggEPADCCAQoCggEBALJ4gHHKeNXj\n" \
+    "ca9HgFB0fW7Y14h29Jlo91ghYPl0hAEvrAIthtOgQ3pOsqTQNroBvo3bSMgHFzZM\n" \
+    "9O6II8c+6zf1tRn4SWiw3te5djgdYZ6k/oI2peVKVuRF4fn9tBb6dNqcmzU5L/qw\n" \
+    "IFAGbHrQgLKm+a/sRxmPUDgH3KKHOVj4utWp+UhnMJbulHheb4mjUcAwhmahRWa6\n" \
+    "VOujw5H5SNz/0egwLX0tdHA114gk957EWW67c4cX8jJGKLhD+rcdqsq08p8kDi1L\n" \
+    "93FcXmn/6pUCyziKrlA4b9v7LWIbxcceVOF34GfID5yHI9Y/QCB/IIDEgEw+OyQm\n" \
+    "jgSubJrIqg0CAwEAAaNCMEAwDwYDVR0TAQH/BAUwAwEB/zAOBgNVHQ8BAf8EBAMC\n" \
+    "AYYwHQYDVR0OBBYEFIQYzIU07LwMlJQuCFmcx7IQTgoIMA0GCSqGSIb3DQEBCwUA\n" \
+    "A4IBAQCY8jdaQZChGsV2USggNiMOruYou6r4lK5IpDB/G/wkjUu0yKGX9rbxenDI\n" \
+    "U5PMCCjjmCXPI6T53iHTfIUJrU6adTrCC2qJeHZERxhlbI1Bjjt/msv0tadQ1wUs\n" \
+    "N+gDS63pYaACbvXy8MWy7Vu33PqUXHeeE6V/Uq2V8viTO96LXFvKWlJbYK8U90vv\n" \
+    "o/ufQJVtMVT8QtPHRh8jrdkPSHCa2XV4cdFyQzR1bldZwgJcJmApzyMZFo6IQ6XU\n" \
+    "5MsI+yMRQ+hDKXJioaldXgjUkK642M4UwtBV8ob2xJNDd2ZhwLnoQdeXeGADbkpy\n" \
+    "rqXRfboQnoZsG4q5WTP468SQvvG5\n"                                     \
+    "-----END CERTIFICATE-----\n"
+
+/**
+ * @brief MQTT keep alive interval, as in source/main.c.
+ */
+#define democonfigMQTT_KEEP_ALIVE_SECONDS      ( 60U )
+
+/**
+ * @brief Timeout for a transport receive call to return when no data is available.
+ */
+#define democonfigTRANSPORT_RECV_TIMEOUT_MS    ( 100U )
+
+/**
+ * @brief Task priority of the MQTT Hello World task.
+ */
+#define hello_task_PRIORITY                    ( configMAX_PRIORITIES - 1 )
+
+/**
+ * @brief Stack size of the MQTT Hello World task, in words.
+ */
+#ifndef hello_task_STACK_SIZE
+    #define hello_task_STACK_SIZE    ( 2048 )
+#endif
+
+/**
+ * @brief MQTT hello world demo task, the task of source/main.c without the optional services.
+ *
+ * @param[in] pvParameters The parameters for hello world task.
+ */
+static void hello_task( void * pvParameters );
+
+/**
+ * @brief Timestamp of the MQTT library, in milliseconds since the start of the application.
+ *
+ * @return Time since the start of the application in milliseconds.
+ */
+static uint32_t getTimeStampMs( void );
+
+/**
+ * @brief Callback executed when an MQTT packet is received by the library, handed to the agent.
+ *
+ * @param[in] pContext The context defined by the application passed to MQTT library.
+ * @param[in] pPacketInfo Pointer to the packet info structure containing details of MQTT packet.
+ * @param[in] pDeserializedInfo Pointer to structure contained deserialized publish information.
+ */
+static void eventCallback( MQTTContext_t * pContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo );
+
+/**
+ * @brief Logs the changes of the broker connection state.
+ *
+ * @param[in] xState The new state.
+ * @param[in] bSessionPresent Whether the broker resumed the session.
+ */
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool bSessionPresent );
+
+/**
+ * @brief Reads the MAC address from the HOST_MAC environment variable, "de:ad:00:be:ef:01", so that
+ * several instances can share a network. The address of the firmware is kept otherwise.
+ */
+static void prvReadMacAddress( void );
+
+/**
+ * @brief Vendor provided function to initializes the cryptographic module, see hw_poll.c.
+ */
+extern void CRYPTO_InitHardware( void );
+
+/**
+ * @brief Static buffer used to receive an MQTT payload from broker.
+ */
+static uint8_t ucBuffer[ MQTT_INCOMING_BUFFER_SIZE ];
+
+static uint8_t ucIPAddress[ 4 ] = { 192, 168, 1, 43 };
+static uint8_t ucNetMask[ 4 ] = { 255, 255, 255, 0 };
+static uint8_t ucGatewayAddress[ 4 ] = { 192, 168, 1, 1 };
+static uint8_t ucDNSServerAddress[ 4 ] = { 192, 168, 1, 1 };
+static uint8_t ucMACAddress[ 6 ] = { 0xDE, 0xAD, 0x00, 0xBE, 0xEF, 0x01 };
+
+/**
+ * @brief Start of the application, the MQTT timestamps are relative to it.
+ */
+static uint32_t ulGlobalEntryTimeMs;
+
+/**
+ * @brief MQTT connect parameters, kept to reconnect with the broker from the MQTT agent.
+ */
+static MQTTConnectInfo_t xMQTTConnectInfo = { 0 };
+
+/**
+ * @brief TLS credentials, kept to reconnect with the broker from the MQTT agent.
+ */
+static NetworkCredentials_t xNetworkCredentials = { 0 };
+
+/**
+ * @brief Broker connection parameters, the endpoint is read from the provisioned data.
+ */
+static ConnectionManagerConfig_t xConnectionConfig =
+{
+    .pHostName          = NULL,
+    .port               = 8883,
+    .pCredentials       = &xNetworkCredentials,
+    .pConnectInfo       = &xMQTTConnectInfo,
+    .handshakeTimeoutMs = 4000,
+    .sendTimeoutMs      = 36000,
+    .recvTimeoutMs      = democonfigTRANSPORT_RECV_TIMEOUT_MS,
+    .connackTimeoutMs   = 100
+};
+
+/**
+ * @brief TLS credentials of the OTA file servers.
+ */
+static NetworkCredentials_t xOtaNetworkCredentials = { 0 };
+
+/**
+ * @brief Broker endpoint read from the provisioned data.
+ */
+static char * pcEndpoint = NULL;
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    HostBoard_Init( argc, argv );
+
+    boot_timing_mark( BOOT_PHASE_MAIN );
+
+    CRYPTO_InitHardware();
+
+    /* Start the microsecond clock, on the emulated cycle counter. */
+    MonotonicClock_Init();
+
+    ClockScaling_Init();
+
+    ( void ) DmaCopy_Init();
+
+    /* Maps the flash file before anything reads the update control block or the PKCS #11 objects. */
+    mflash_drv_init();
+
+    /* What the bootloader does before it starts the application. */
+    HostBoard_Boot();
+
+    /* Provision from the environment, a provisioned device carries on at once. */
+    vUartProvisionAtBoot();
+
+    prvReadMacAddress();
+
+    FreeRTOS_IPInit( ucIPAddress, ucNetMask, ucGatewayAddress, ucDNSServerAddress, ucMACAddress );
+
+    Watchdog_Register( WATCHDOG_CLIENT_IP_TASK );
+
+    if( Watchdog_Init() != pdTRUE )
+    {
+        exit( EXIT_FAILURE );
+    }
+
+    /* Run the signature verifications and the handshakes below the periodic work. */
+    if( CryptoWorker_Init() != pdTRUE )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Crypto worker task creation failed, crypto runs on its callers.\r\n" ) );
+    }
+
+    if( xUartProvisionStartWindow() != pdTRUE )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Provisioning window task creation failed.\r\n" ) );
+    }
+
+    if( xTaskCreate( hello_task, "Hello_task", hello_task_STACK_SIZE, NULL, hello_task_PRIORITY, NULL ) != pdPASS )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Hello Task creation failed!.\n" ) );
+        exit( EXIT_FAILURE );
+    }
+
+    vTaskStartScheduler();
+
+    return EXIT_FAILURE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReadMacAddress( void )
+{
+    const char * pcMac = getenv( "HOST_MAC" );
+    unsigned int uxBytes[ 6 ];
+    size_t i;
+
+    if( pcMac != NULL )
+    {
+        if( sscanf( pcMac, "%x:%x:%x:%x:%x:%x", &uxBytes[ 0 ], &uxBytes[ 1 ], &uxBytes[ 2 ],
+                    &uxBytes[ 3 ], &uxBytes[ 4 ], &uxBytes[ 5 ] ) == 6 )
+        {
+            for( i = 0; i < sizeof( ucMACAddress ); i++ )
+            {
+                ucMACAddress[ i ] = ( uint8_t ) uxBytes[ i ];
+            }
+        }
+        else
+        {
+            LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "HOST_MAC is not a MAC address, keeping the default one.\r\n" ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t getTimeStampMs( void )
+{
+    return ( uint32_t ) ( MonotonicClock_GetMs() - ulGlobalEntryTimeMs );
+}
+
+/*-----------------------------------------------------------*/
+
+static void eventCallback( MQTTContext_t * pContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo )
+{
+    /* Handles the ACKs and the incoming publishes for the topic filters registered with the agent. */
+    ( void ) MQTTAgent_ProcessEvent( pContext, pPacketInfo, pDeserializedInfo );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool bSessionPresent )
+{
+    if( xState == CONNECTION_STATE_CONNECTED )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Connected to the broker, session %s.\r\n",
+                                                bSessionPresent ? "resumed" : "new" ) );
+    }
+    else
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Disconnected from the broker.\r\n" ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void hello_task( void * pvParameters )
+{
+    /* Static as the publish state records make the context too large for the task stack. */
+    static MQTTContext_t xMQTTContext = { 0 };
+    TransportInterface_t xTransport = { 0 };
+    MQTTFixedBuffer_t xFixedBuffer = { 0 };
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    bool bSessionPresent = false;
+    MQTTStatus_t xMQTTStatus = MQTTSuccess;
+    char * pcThingName = NULL;
+    uint32_t ulThingNameLength = 0;
+    uint32_t ulEndpointLength = 0;
+    CK_RV xPKCS11Result = CKR_OK;
+    char cPayload[ 32 ] = { 0 };
+    size_t xPayloadLength;
+    int32_t lCounter = 0;
+    BaseType_t xStatus;
+
+    ( void ) pvParameters;
+
+    xNetworkCredentials.pRootCa = ( const unsigned char * ) democonfigROOT_CA_PEM;
+    xNetworkCredentials.rootCaSize = sizeof( democonfigROOT_CA_PEM );
+    xNetworkCredentials.maxFragmentLength = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+
+    /* Downloads get a large receive window, the broker connection only carries control traffic. */
+    xOtaNetworkCredentials = xNetworkCredentials;
+    xOtaNetworkCredentials.socketProfile = SOCKETS_PROFILE_BULK;
+    xNetworkCredentials.socketProfile = SOCKETS_PROFILE_LEAN;
+    xNetworkCredentials.usePsk = pdFALSE;
+
+    while( FreeRTOS_IsNetworkUp() == pdFALSE )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "No Network yet\r\n" ) );
+        vTaskDelay( pdMS_TO_TICKS( 500 ) );
+    }
+
+    /* The connection manager owns the network context of the transport. */
+    ConnectionManager_Init( &xConnectionConfig, &xTransport );
+
+    ulGlobalEntryTimeMs = MonotonicClock_GetMs();
+
+    xFixedBuffer.pBuffer = ucBuffer;
+    xFixedBuffer.size = MQTT_INCOMING_BUFFER_SIZE;
+
+    xMQTTStatus = MQTT_Init( &xMQTTContext, &xTransport, getTimeStampMs, eventCallback, &xFixedBuffer );
+
+    /* Client ID must be unique to broker. This field is required. */
+    xPKCS11Result = ulGetThingName( &pcThingName, &ulThingNameLength );
+
+    if( xPKCS11Result == CKR_OK )
+    {
+        xPKCS11Result = ulGetThingEndpoint( &pcEndpoint, &ulEndpointLength );
+    }
+
+    if( xPKCS11Result == CKR_OK )
+    {
+        /* Resolve the endpoint while the rest of the connection is prepared. */
+        Sockets_ResolveAsync( pcEndpoint );
+    }
+    else
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "No thing name or endpoint, set HOST_THING_NAME and HOST_ENDPOINT.\r\n" ) );
+    }
+
+    if( ( xMQTTStatus == MQTTSuccess ) && ( xPKCS11Result == CKR_OK ) )
+    {
+        xMQTTConnectInfo.pClientIdentifier = pcThingName;
+        xMQTTConnectInfo.clientIdentifierLength = ( uint16_t ) ulThingNameLength;
+
+        /* A persistent session keeps the subscriptions and the QoS1 messages across reconnects. */
+        xMQTTConnectInfo.cleanSession = false;
+        xMQTTConnectInfo.keepAliveSeconds = democonfigMQTT_KEEP_ALIVE_SECONDS;
+
+        xMQTTConnectInfo.pUserName = "";
+        xMQTTConnectInfo.userNameLength = 0;
+        xMQTTConnectInfo.pPassword = "";
+        xMQTTConnectInfo.passwordLength = 0;
+
+        xConnectionConfig.pHostName = pcEndpoint;
+        ( void ) ConnectionManager_AddListener( prvConnectionStateCallback );
+
+        /* Retries with backoff until the broker is reachable, then starts the agent. */
+        if( ConnectionManager_Start( &xMQTTContext, &bSessionPresent ) == pdTRUE )
+        {
+            if( LogLevel_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+            {
+                LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Log levels cannot be set over MQTT.\r\n" ) );
+            }
+
+            ( void ) TaskStats_Init( pcThingName, ulThingNameLength );
+
+            if( HeapMonitor_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+            {
+                LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Heap statistics are not published.\r\n" ) );
+            }
+
+            /* The file servers used for OTA data over HTTP chain to the same root CA. */
+            vOtaHttpSetCredentials( &xOtaNetworkCredentials );
+
+            xStatus = xStartOTAUpdateDemo( NULL );
+            configASSERT( xStatus == pdTRUE );
+
+            for( ; ; )
+            {
+                xPayloadLength = snprintf( cPayload, sizeof( cPayload ), "Hello %ld", ( long ) lCounter++ );
+
+                xPublishInfo.qos = MQTTQoS0;
+                xPublishInfo.dup = false;
+                xPublishInfo.retain = false;
+                xPublishInfo.pTopicName = "Test/Hello";
+                xPublishInfo.topicNameLength = 10;
+                xPublishInfo.pPayload = cPayload;
+                xPublishInfo.payloadLength = xPayloadLength;
+
+                /* The agent copies the message, so there is no need to wait for the publish to complete. */
+                if( MQTTAgent_PublishCopy( NULL, &xPublishInfo, NULL, MQTT_AGENT_PRIORITY_BULK, portMAX_DELAY ) == pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_DEBUG, ( "Queued helloworld.\r\n" ) );
+                }
+
+                /* Share the wake up of the watchdog supervisor. */
+                vTaskDelay( Watchdog_AlignWakeup( pdMS_TO_TICKS( 5000U ) ) );
+            }
+        }
+    }
+
+    for( ; ; )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Demo FAILURE\r\n" ) );
+        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ *  Called by FreeRTOS+TCP when the network connects or disconnects.
+ */
+void vApplicationIPNetworkEventHook( eIPCallbackEvent_t eNetworkEvent )
+{
+    uint32_t ulIPAddress, ulNetMask, ulGatewayAddress, ulDNSServerAddress;
+    char cBuffer[ 16 ];
+
+    if( eNetworkEvent == eNetworkUp )
+    {
+        boot_timing_mark( BOOT_PHASE_NETWORK_UP );
+
+        FreeRTOS_GetAddressConfiguration( &ulIPAddress, &ulNetMask, &ulGatewayAddress, &ulDNSServerAddress );
+        FreeRTOS_inet_ntoa( ulIPAddress, cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "\r\n\r\nIP Address: %s\r\n", cBuffer ) );
+
+        FreeRTOS_inet_ntoa( ulNetMask, cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Subnet Mask: %s\r\n", cBuffer ) );
+
+        FreeRTOS_inet_ntoa( ulGatewayAddress, cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Gateway Address: %s\r\n", cBuffer ) );
+
+        FreeRTOS_inet_ntoa( ulDNSServerAddress, cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "DNS Server Address: %s\r\n\r\n\r\n", cBuffer ) );
+
+        /* Tasks waiting to reconnect after a link flap should not wait out the rest of their backoff. */
+        RetryUtils_AbortSleep();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Random numbers of the TCP/IP stack and of the retry jitter, from the entropy pool.
+ */
+UBaseType_t uxRand( void )
+{
+    uint32_t ulNumber = 0;
+
+    if( xEntropyPoolGetBytes( ( uint8_t * ) &ulNumber, sizeof( ulNumber ) ) != pdTRUE )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Failed to generate a random number from the entropy pool.\r\n" ) );
+    }
+
+    return ( UBaseType_t ) ulNumber;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Callback that provides the inputs necessary to generate a randomized TCP
+ * Initial Sequence Number per RFC 6528, drawn from the entropy pool DRBG.
+ */
+uint32_t ulApplicationGetNextSequenceNumber( uint32_t ulSourceAddress,
+                                             uint16_t usSourcePort,
+                                             uint32_t ulDestinationAddress,
+                                             uint16_t usDestinationPort )
+{
+    ( void ) ulSourceAddress;
+    ( void ) usSourcePort;
+    ( void ) ulDestinationAddress;
+    ( void ) usDestinationPort;
+
+    return ( uint32_t ) uxRand();
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xApplicationGetRandomNumber( uint32_t * pulNumber )
+{
+    return xEntropyPoolGetBytes( ( uint8_t * ) pulNumber, sizeof( uint32_t ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationMallocFailedHook( void )
+{
+    LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "\n\nMALLOC FAIL\n\n" ) );
+
+    HeapMonitor_MallocFailed();
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationStackOverflowHook( TaskHandle_t xTask,
+                                    char * pcTaskName )
+{
+    ( void ) xTask;
+
+    ( void ) fprintf( stderr, "Stack overflow in %s\r\n", pcTaskName );
+    abort();
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetIdleTaskMemory( StaticTask_t ** ppxIdleTaskTCBBuffer,
+                                    StackType_t ** ppxIdleTaskStackBuffer,
+                                    uint32_t * pulIdleTaskStackSize )
+{
+    static StaticTask_t xIdleTaskTCB;
+    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+
+    *ppxIdleTaskTCBBuffer = &xIdleTaskTCB;
+    *ppxIdleTaskStackBuffer = uxIdleTaskStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetTimerTaskMemory( StaticTask_t ** ppxTimerTaskTCBBuffer,
+                                     StackType_t ** ppxTimerTaskStackBuffer,
+                                     uint32_t * pulTimerTaskStackSize )
+{
+    static StaticTask_t xTimerTaskTCB;
+    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+
+    *ppxTimerTaskTCBBuffer = &xTimerTaskTCB;
+    *ppxTimerTaskStackBuffer = uxTimerTaskStack;
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
@@ -0,0 +1,371 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file provision_interface.c
+ * @brief Provisioning of provision_interface.h on the host build, from the environment instead of
+ * the UART of lib/FreeRTOS/platform/provision_interface/nxp_provision_interface.c.
+ *
+ * HOST_THING_NAME and HOST_ENDPOINT give the thing name and the broker endpoint, HOST_OTA_KEY the
+ * path of the PEM public key verifying the OTA images and HOST_CERT the path of the PEM device
+ * certificate. The objects are saved in the flash file as on the device, a restart without the
+ * variables keeps them. Without a certificate, the device key pair is generated and its CSR written
+ * to the file named by HOST_CSR, "device.csr" by default, before the process exits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging_levels.h"
+
+/* Logging configuration for the provisioning interface. */
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME    "PROVISION_INTERFACE"
+#endif
+
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_INFO
+#endif
+
+#include "logging_stack.h"
+
+#include "FreeRTOS.h"
+#include "provision_interface.h"
+#include "provision.h"
+#include "core_pkcs11_config.h"
+#include "core_pkcs11.h"
+#include "core_pkcs11_pal.h"
+
+#define FILENAME_AWS_THING_NAME      "aws_thing_name.dat"
+#define FILENAME_AWS_ENDPOINT        "aws_endpoint.dat"
+
+#define MAX_LENGTH_AWS_ENDPOINT      64
+#define MAX_LENGTH_AWS_THING_NAME    32
+
+/*
+ * @brief Largest PEM file read, as the certificate buffer of the UART provisioning.
+ */
+#define CERTIFICATE_SIZE             5000
+
+static CK_RV prvSaveFile( const char * pcFileName,
+                          CK_ULONG ulFileNameLen,
+                          CK_BYTE_PTR pucData,
+                          CK_ULONG ulSize )
+{
+    CK_RV xResult = CKR_OK;
+    CK_ATTRIBUTE xLabel;
+    CK_OBJECT_HANDLE xHandle = CK_INVALID_HANDLE;
+
+    xLabel.type = CKA_LABEL;
+    xLabel.pValue = ( CK_VOID_PTR ) pcFileName;
+    xLabel.ulValueLen = ulFileNameLen;
+
+    xHandle = PKCS11_PAL_SaveObject( ( CK_ATTRIBUTE_PTR ) &xLabel, pucData, ulSize );
+
+    if( xHandle == CK_INVALID_HANDLE )
+    {
+        xResult = CKR_DEVICE_MEMORY;
+    }
+
+    return xResult;
+}
+
+/*
+ * @brief Reads a PEM file into a NUL terminated buffer, freed with vPortFree().
+ */
+static uint8_t * prvReadFile( const char * pcPath,
+                              uint32_t * pulSize )
+{
+    uint8_t * pucData = NULL;
+    FILE * pxFile = fopen( pcPath, "rb" );
+    size_t xRead = 0;
+
+    if( pxFile == NULL )
+    {
+        LogError( ( "Failed to open %s.", pcPath ) );
+    }
+    else
+    {
+        pucData = pvPortMalloc( CERTIFICATE_SIZE );
+
+        if( pucData != NULL )
+        {
+            memset( pucData, 0x00, CERTIFICATE_SIZE );
+            xRead = fread( pucData, 1, CERTIFICATE_SIZE - 1, pxFile );
+
+            if( ( xRead == 0 ) || ( ferror( pxFile ) != 0 ) || ( feof( pxFile ) == 0 ) )
+            {
+                LogError( ( "Failed to read %s, or larger than %d bytes.", pcPath, CERTIFICATE_SIZE - 1 ) );
+                vPortFree( pucData );
+                pucData = NULL;
+            }
+            else
+            {
+                *pulSize = ( uint32_t ) xRead;
+            }
+        }
+
+        ( void ) fclose( pxFile );
+    }
+
+    return pucData;
+}
+
+static void prvProvisionText( const char * pcVariable,
+                              const char * pcFileName,
+                              CK_ULONG ulFileNameLen,
+                              size_t xMaxLength )
+{
+    const char * pcValue = getenv( pcVariable );
+
+    if( pcValue == NULL )
+    {
+        /* Kept from a previous run. */
+    }
+    else if( ( strlen( pcValue ) == 0 ) || ( strlen( pcValue ) >= xMaxLength ) )
+    {
+        LogError( ( "%s must be 1 to %u characters.", pcVariable, ( unsigned ) ( xMaxLength - 1 ) ) );
+    }
+    else if( prvSaveFile( pcFileName, ulFileNameLen, ( CK_BYTE_PTR ) pcValue, strlen( pcValue ) ) != CKR_OK )
+    {
+        LogError( ( "Failed to save %s. Error storing to flash.", pcVariable ) );
+    }
+    else
+    {
+        LogInfo( ( "Saved %s: %s", pcVariable, pcValue ) );
+    }
+}
+
+static void prvProvisionOtaSigning( void )
+{
+    const char * pcPath = getenv( "HOST_OTA_KEY" );
+    uint8_t * pucKey = NULL;
+    uint32_t ulSize = 0;
+
+    if( pcPath != NULL )
+    {
+        pucKey = prvReadFile( pcPath, &ulSize );
+
+        if( pucKey != NULL )
+        {
+            if( xProvisionPublicKey( pucKey,
+                                     ulSize + 1, /* Increased to add a NULL terminator. */
+                                     CKK_EC,
+                                     ( CK_BYTE_PTR ) pkcs11configLABEL_CODE_VERIFICATION_KEY,
+                                     sizeof( pkcs11configLABEL_CODE_VERIFICATION_KEY ) ) != CKR_OK )
+            {
+                LogError( ( "Failed to save OTA verification key. Could not provision key." ) );
+            }
+
+            vPortFree( pucKey );
+        }
+    }
+}
+
+static void prvWriteCsr( void )
+{
+    const char * pcPath = getenv( "HOST_CSR" );
+    uint8_t * pucCsr = NULL;
+    FILE * pxFile;
+
+    if( pcPath == NULL )
+    {
+        pcPath = "device.csr";
+    }
+
+    LogInfo( ( "Creating CSR" ) );
+
+    if( xPregenerateDeviceKeyPair() != CKR_OK )
+    {
+        LogError( ( "Failed to generate the device key pair." ) );
+    }
+    else
+    {
+        pucCsr = vCreateCsr();
+    }
+
+    if( pucCsr == NULL )
+    {
+        LogError( ( "Failed to retrieve a CSR. Cannot continue with provisioning operation." ) );
+    }
+    else
+    {
+        pxFile = fopen( pcPath, "w" );
+
+        if( ( pxFile != NULL ) && ( fputs( ( const char * ) pucCsr, pxFile ) >= 0 ) && ( fclose( pxFile ) == 0 ) )
+        {
+            LogInfo( ( "CSR written to %s, sign it and start again with HOST_CERT.", pcPath ) );
+        }
+        else
+        {
+            LogError( ( "Failed to write the CSR to %s.", pcPath ) );
+        }
+
+        vPortFree( pucCsr );
+    }
+}
+
+static void prvProvision( void )
+{
+    const char * pcPath = getenv( "HOST_CERT" );
+    uint8_t * pucCert = NULL;
+    uint32_t ulCertSize = 0;
+
+    prvProvisionText( "HOST_THING_NAME", FILENAME_AWS_THING_NAME, sizeof( FILENAME_AWS_THING_NAME ), MAX_LENGTH_AWS_THING_NAME );
+    prvProvisionText( "HOST_ENDPOINT", FILENAME_AWS_ENDPOINT, sizeof( FILENAME_AWS_ENDPOINT ), MAX_LENGTH_AWS_ENDPOINT );
+    prvProvisionOtaSigning();
+
+    if( pcPath != NULL )
+    {
+        pucCert = prvReadFile( pcPath, &ulCertSize );
+
+        if( pucCert != NULL )
+        {
+            LogInfo( ( "Will now try to provision certificate with PKCS #11." ) );
+            xProvisionCert( pucCert, ulCertSize, ( CK_BYTE_PTR ) pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS, sizeof( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) );
+            vPortFree( pucCert );
+        }
+    }
+
+    if( xCheckIfProvisioned() != CKR_OK )
+    {
+        /* The key pair is kept, the certificate of its CSR is given with HOST_CERT on the next run. */
+        prvWriteCsr();
+        ( void ) fflush( stdout );
+        exit( EXIT_SUCCESS );
+    }
+}
+
+void vUartProvision( void )
+{
+    LogInfo( ( "Starting Provisioning process..." ) );
+    prvProvision();
+}
+
+void vUartProvisionAtBoot( void )
+{
+    /* The environment may replace any of the objects, so it is read on every start. */
+    prvProvision();
+}
+
+BaseType_t xUartProvisionStartWindow( void )
+{
+    /* No reprovisioning window, the credentials are replaced from the environment. */
+    return pdTRUE;
+}
+
+CK_RV ulGetThingName( char ** pcThingName,
+                      uint32_t * ulThingNameSize )
+{
+    static char pxThingName[ MAX_LENGTH_AWS_THING_NAME ] = { 0 };
+    static CK_ULONG ulSize = 0;
+
+    CK_BYTE_PTR pxTempBuf = NULL;
+    CK_BBOOL xIsPrivate;
+    CK_OBJECT_HANDLE xHandle = CK_INVALID_HANDLE;
+    CK_RV xResult = CKR_OK;
+
+    if( pxThingName[ 0 ] == 0x00 )
+    {
+        xHandle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) FILENAME_AWS_THING_NAME, sizeof( FILENAME_AWS_THING_NAME ) );
+
+        if( xHandle == CK_INVALID_HANDLE )
+        {
+            xResult = CKR_OBJECT_HANDLE_INVALID;
+        }
+        else
+        {
+            xResult = PKCS11_PAL_GetObjectValue( xHandle, &pxTempBuf, &ulSize, &xIsPrivate );
+
+            if( ( xResult == CKR_OK ) && ( ulSize >= sizeof( pxThingName ) ) )
+            {
+                PKCS11_PAL_GetObjectValueCleanup( pxTempBuf, ulSize );
+                xResult = CKR_DATA_LEN_RANGE;
+            }
+            else if( xResult == CKR_OK )
+            {
+                memcpy( pxThingName, pxTempBuf, ulSize );
+                *pcThingName = pxThingName;
+                *ulThingNameSize = ( uint32_t ) ulSize;
+                PKCS11_PAL_GetObjectValueCleanup( pxTempBuf, ulSize );
+            }
+        }
+    }
+    else
+    {
+        *pcThingName = pxThingName;
+        *ulThingNameSize = ( uint32_t ) ulSize;
+    }
+
+    return xResult;
+}
+
+CK_RV ulGetThingEndpoint( char ** pcThingEndpoint,
+                          uint32_t * ulThingEndpointSize )
+{
+    static char pxThingEndpoint[ MAX_LENGTH_AWS_ENDPOINT ] = { 0 };
+    static CK_ULONG ulSize = 0;
+
+    CK_BYTE_PTR pxTempBuf = NULL;
+    CK_BBOOL xIsPrivate;
+    CK_OBJECT_HANDLE xHandle = CK_INVALID_HANDLE;
+    CK_RV xResult = CKR_OK;
+
+    if( pxThingEndpoint[ 0 ] == 0x00 )
+    {
+        xHandle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) FILENAME_AWS_ENDPOINT, sizeof( FILENAME_AWS_ENDPOINT ) );
+
+        if( xHandle == CK_INVALID_HANDLE )
+        {
+            xResult = CKR_OBJECT_HANDLE_INVALID;
+        }
+        else
+        {
+            xResult = PKCS11_PAL_GetObjectValue( xHandle, &pxTempBuf, &ulSize, &xIsPrivate );
+
+            /* Kept NUL terminated, the endpoint is passed to the resolver as a string. */
+            if( ( xResult == CKR_OK ) && ( ulSize >= sizeof( pxThingEndpoint ) ) )
+            {
+                PKCS11_PAL_GetObjectValueCleanup( pxTempBuf, ulSize );
+                xResult = CKR_DATA_LEN_RANGE;
+            }
+            else if( xResult == CKR_OK )
+            {
+                memcpy( pxThingEndpoint, pxTempBuf, ulSize );
+                *pcThingEndpoint = pxThingEndpoint;
+                *ulThingEndpointSize = ( uint32_t ) ulSize;
+                PKCS11_PAL_GetObjectValueCleanup( pxTempBuf, ulSize );
+            }
+        }
+    }
+    else
+    {
+        *pcThingEndpoint = pxThingEndpoint;
+        *ulThingEndpointSize = ( uint32_t ) ulSize;
+    }
+
+    return xResult;
+}
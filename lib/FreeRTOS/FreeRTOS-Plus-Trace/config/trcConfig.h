@@ -98,8 +98,50 @@ extern "C" {
  * Values:
  * TRC_RECORDER_MODE_SNAPSHOT
  * TRC_RECORDER_MODE_STREAMING
+ *
+ * This project defaults to snapshot mode. Define TRC_CFG_RECORDER_MODE as
+ * TRC_RECORDER_MODE_STREAMING in the build to stream the trace to Tracealyzer
+ * over FreeRTOS+TCP instead (see streamports/FreeRTOS_TCP).
  ******************************************************************************/
+#ifndef TRC_CFG_RECORDER_MODE
 #define TRC_CFG_RECORDER_MODE TRC_RECORDER_MODE_SNAPSHOT
+#endif
+
+/******************************************************************************
+ * TRC_CFG_FIELD_PROFILE
+ *
+ * Macro which should be defined as either zero (0) or one (1).
+ *
+ * One (1) selects the always-on profile of the deployed devices: a snapshot
+ * ring buffer of a few KB instead of 64 KB, holding only the events of the
+ * FreeRTOS+TCP, MQTT agent and OTA tasks and of the objects they create,
+ * see TRC_FIELD_OBJECTS_BEGIN. The buffer is placed by crash_report.c in the
+ * no-init USB_RAM of the crash snapshot, so the events leading to a fault are
+ * kept across the reset and published with the crash report.
+ * Malloc/free, OS tick and stack monitor events are left out.
+ *
+ * Default value is 0.
+ ******************************************************************************/
+#ifndef TRC_CFG_FIELD_PROFILE
+#define TRC_CFG_FIELD_PROFILE 0
+#endif
+
+#if (TRC_CFG_FIELD_PROFILE == 1) && (TRC_CFG_RECORDER_MODE != TRC_RECORDER_MODE_SNAPSHOT)
+#error "TRC_CFG_FIELD_PROFILE requires the snapshot recorder."
+#endif
+
+/* Objects created between TRC_FIELD_OBJECTS_BEGIN() and TRC_FIELD_OBJECTS_END()
+ * are traced by the field profile, the others are filtered out. The filter
+ * group is global, keep these sections short and free of blocking calls. */
+#if (TRC_CFG_FIELD_PROFILE == 1)
+#define TRC_FIELD_GROUP_TRACED FilterGroup0
+#define TRC_FIELD_GROUP_FILTERED FilterGroup1
+#define TRC_FIELD_OBJECTS_BEGIN() vTraceSetFilterGroup(TRC_FIELD_GROUP_TRACED)
+#define TRC_FIELD_OBJECTS_END() vTraceSetFilterGroup(TRC_FIELD_GROUP_FILTERED)
+#else
+#define TRC_FIELD_OBJECTS_BEGIN()
+#define TRC_FIELD_OBJECTS_END()
+#endif
 
 /******************************************************************************
  * TRC_CFG_FREERTOS_VERSION
@@ -150,7 +192,11 @@ extern "C" {
  *
  * Default value is 1.
  *****************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1)
+#define TRC_CFG_INCLUDE_MEMMANG_EVENTS 0
+#else
 #define TRC_CFG_INCLUDE_MEMMANG_EVENTS 1
+#endif
 
  /******************************************************************************
  * TRC_CFG_INCLUDE_USER_EVENTS
@@ -225,7 +271,11 @@ extern "C" {
  *
  * Default value is 1.
  *****************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1)
+#define TRC_CFG_INCLUDE_OSTICK_EVENTS 0
+#else
 #define TRC_CFG_INCLUDE_OSTICK_EVENTS 1
+#endif
 
  /*****************************************************************************
  * TRC_CFG_INCLUDE_EVENT_GROUP_EVENTS
@@ -283,7 +333,11 @@ extern "C" {
  * In snapshot mode, the TzCtrl task is only used for stack monitoring and is
  * not created unless this is enabled.
  *****************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1)
+#define TRC_CFG_ENABLE_STACK_MONITOR 0
+#else
 #define TRC_CFG_ENABLE_STACK_MONITOR 1
+#endif
 
  /******************************************************************************
  * TRC_CFG_STACK_MONITOR_MAX_TASKS
@@ -372,8 +426,16 @@ extern "C" {
  * (static) or in runtime (malloc).
  * The custom mode allows you to control how and where the allocation is made,
  * for details see TRC_ALLOC_CUSTOM_BUFFER and vTraceSetRecorderDataBuffer().
+ *
+ * This project uses the custom mode on the carrier boards fitted with SDRAM,
+ * main.c then places the buffer in the SDRAM, and with TRC_CFG_FIELD_PROFILE,
+ * where crash_report.c provides the buffer.
  ******************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1) || (defined(BOARD_SDRAM_ENABLED) && (BOARD_SDRAM_ENABLED == 1))
+#define TRC_CFG_RECORDER_BUFFER_ALLOCATION TRC_RECORDER_BUFFER_ALLOCATION_CUSTOM
+#else
 #define TRC_CFG_RECORDER_BUFFER_ALLOCATION TRC_RECORDER_BUFFER_ALLOCATION_STATIC
+#endif
 
 /******************************************************************************
  * TRC_CFG_MAX_ISR_NESTING
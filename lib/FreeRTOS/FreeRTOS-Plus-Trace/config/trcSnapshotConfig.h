@@ -82,7 +82,11 @@
  * Default value is 1000, which means that 4000 bytes is allocated for the
  * event buffer.
  ******************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1)
+#define TRC_CFG_EVENT_BUFFER_SIZE 512
+#else
 #define TRC_CFG_EVENT_BUFFER_SIZE 16348
+#endif
 
 /*******************************************************************************
  * TRC_CFG_NTASK, TRC_CFG_NISR, TRC_CFG_NQUEUE, TRC_CFG_NSEMAPHORE...
@@ -106,6 +110,18 @@
  * check the actual usage by selecting View menu -> Trace Details ->
  * Resource Usage -> Object Table.
  ******************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1)
+/* Only the objects of the traced tasks take a slot of the table */
+#define TRC_CFG_NTASK			6
+#define TRC_CFG_NISR			2
+#define TRC_CFG_NQUEUE			6
+#define TRC_CFG_NSEMAPHORE		6
+#define TRC_CFG_NMUTEX			4
+#define TRC_CFG_NTIMER			2
+#define TRC_CFG_NEVENTGROUP		2
+#define TRC_CFG_NSTREAMBUFFER	1
+#define TRC_CFG_NMESSAGEBUFFER	1
+#else
 #define TRC_CFG_NTASK			15
 #define TRC_CFG_NISR			5
 #define TRC_CFG_NQUEUE			10
@@ -115,6 +131,7 @@
 #define TRC_CFG_NEVENTGROUP		5
 #define TRC_CFG_NSTREAMBUFFER	5
 #define TRC_CFG_NMESSAGEBUFFER	5
+#endif
 
 /******************************************************************************
  * TRC_CFG_INCLUDE_FLOAT_SUPPORT
@@ -148,7 +165,11 @@
  *
  * Default value is 800.
  ******************************************************************************/
+#if (TRC_CFG_FIELD_PROFILE == 1)
+#define TRC_CFG_SYMBOL_TABLE_SIZE 128
+#else
 #define TRC_CFG_SYMBOL_TABLE_SIZE 800
+#endif
 
 #if (TRC_CFG_SYMBOL_TABLE_SIZE == 0)
 #error "TRC_CFG_SYMBOL_TABLE_SIZE may not be zero!"
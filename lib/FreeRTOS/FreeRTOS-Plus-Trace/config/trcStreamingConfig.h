@@ -50,6 +50,28 @@
 extern "C" {
 #endif
 
+/*******************************************************************************
+ * Configuration Macro: TRC_CFG_STREAM_PORT
+ *
+ * The stream port the trace is written to, see config/trcStreamingPort.h.
+ *
+ * Values:
+ * TRC_STREAM_PORT_FREERTOS_TCP - TCP server, Tracealyzer connects over the
+ *                                network and starts the recording.
+ * TRC_STREAM_PORT_ARM_ITM      - ITM stimulus port read over SWO by the debug
+ *                                probe, no RAM buffer. Requires the core clock
+ *                                to stay at BOARD_BootClockPLL180M, see
+ *                                streamports/ARM_ITM/include/trcStreamingPort.h.
+ *
+ * Default value is TRC_STREAM_PORT_FREERTOS_TCP.
+ ******************************************************************************/
+#define TRC_STREAM_PORT_FREERTOS_TCP 0
+#define TRC_STREAM_PORT_ARM_ITM 1
+
+#ifndef TRC_CFG_STREAM_PORT
+#define TRC_CFG_STREAM_PORT TRC_STREAM_PORT_FREERTOS_TCP
+#endif
+
 /*******************************************************************************
  * Configuration Macro: TRC_CFG_SYMBOL_TABLE_SLOTS
  *
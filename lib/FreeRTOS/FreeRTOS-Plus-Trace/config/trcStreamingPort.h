@@ -0,0 +1,27 @@
+/*******************************************************************************
+ * Trace Recorder Library for Tracealyzer v4.4.0
+ * Percepio AB, www.percepio.com
+ *
+ * trcStreamingPort.h
+ *
+ * Selects the stream port of TRC_CFG_STREAM_PORT (see trcStreamingConfig.h).
+ * The config directory comes before the stream ports in the include path, so
+ * this file is the one found by trcRecorder.h, and includes the header of the
+ * selected port relative to it. The sources of the ports not selected compile
+ * to nothing.
+ *
+ * Tabs are used for indent in this file (1 tab = 4 spaces)
+ ******************************************************************************/
+
+#ifndef TRC_STREAMING_PORT_SELECT_H
+#define TRC_STREAMING_PORT_SELECT_H
+
+#if (TRC_CFG_STREAM_PORT == TRC_STREAM_PORT_FREERTOS_TCP)
+#include "../streamports/FreeRTOS_TCP/include/trcStreamingPort.h"
+#elif (TRC_CFG_STREAM_PORT == TRC_STREAM_PORT_ARM_ITM)
+#include "../streamports/ARM_ITM/include/trcStreamingPort.h"
+#else
+#error "TRC_CFG_STREAM_PORT selects no supported stream port."
+#endif
+
+#endif /* TRC_STREAMING_PORT_SELECT_H */
@@ -89,6 +89,22 @@
  * www.percepio.com
  ******************************************************************************/
 
+/*
+ * Modified to set up the SWO output of the LPC54018 in TRC_STREAM_PORT_INIT(),
+ * so that any SWO capable probe can record without an IDE macro, and to take
+ * the ITM port and SWO bit rate from the configuration.
+ *
+ * --- SWO clock on the LPC54018 ---
+ * The trace clock is the main clock divided by TRACECLKDIV, set to 1 here, so
+ * it is 180 MHz with BOARD_BootClockPLL180M. The TPIU divides it by
+ * (TPI->ACPR + 1) to get the NRZ (UART) bit rate on SWO, PIO0_10 function 6.
+ * TRC_CFG_ITM_SWO_BAUDRATE must divide 180 MHz evenly and be supported by the
+ * probe, e.g. 6000000 (ACPR 29) for LPC-Link2 and J-Link, or 2000000 (ACPR 89)
+ * for slower probes. Enter the same core clock (180 MHz) and bit rate in the
+ * SWO settings of the debugger. The bit rate follows the main clock, so the
+ * clock scaling of source/clock_scaling.c must stay disabled with this port.
+ */
+
 #ifndef TRC_STREAMING_PORT_H
 #define TRC_STREAMING_PORT_H
 
@@ -111,17 +127,49 @@ int32_t read_from_host(void* ptrData, uint32_t size, int32_t* ptrBytesRead);
  * Default: 1 (0 is typically terminal output and 31 is used by Keil)
  *
  ******************************************************************************/
+#ifndef TRC_CFG_ITM_PORT
 #define TRC_CFG_ITM_PORT 1
+#endif
 
 #if (TRC_CFG_ITM_PORT < 0) || (TRC_CFG_ITM_PORT > 31)
 #error "Bad ITM port selected."
 #endif
 
+/*******************************************************************************
+ * TRC_CFG_ITM_SWO_BAUDRATE
+ *
+ * The SWO bit rate in bit/s, see the SWO clock notes above. Must divide the
+ * 180 MHz trace clock evenly.
+ *
+ * Default: 6000000
+ ******************************************************************************/
+#ifndef TRC_CFG_ITM_SWO_BAUDRATE
+#define TRC_CFG_ITM_SWO_BAUDRATE 6000000
+#endif
+
+/*******************************************************************************
+ * TRC_CFG_ITM_START_AT_BOOT
+ *
+ * 1 starts the recording from main() with vTraceEnable(TRC_START), since the
+ * ITM port is one-way and Tracealyzer cannot start it. Start the Tracealyzer
+ * recording before resetting the target. 0 only initializes the recorder, and
+ * the recording is started and stopped at run time with vTraceEnable(TRC_START)
+ * and vTraceStop(), or by a debugger macro writing the start and stop commands
+ * to tz_host_command_data (see trcStreamingPort.c).
+ *
+ * Default: 1
+ ******************************************************************************/
+#ifndef TRC_CFG_ITM_START_AT_BOOT
+#define TRC_CFG_ITM_START_AT_BOOT 1
+#endif
+
+void prvTraceItmInit(void);
+
 // Not used for ITM - no RAM buffer...
 #define TRC_STREAM_PORT_ALLOCATE_FIELDS()
 
-// Not used for ITM - assume the IDE configures the ITM setup
-#define TRC_STREAM_PORT_INIT()
+// Sets up the SWO pin, the TPIU and the ITM port, see the SWO clock notes above
+#define TRC_STREAM_PORT_INIT() prvTraceItmInit()
 
 /* Important for the ITM port - no RAM buffer, direct writes. In most other ports this can be skipped (default is 1) */
 #define TRC_STREAM_PORT_USE_INTERNAL_BUFFER 0
@@ -92,10 +92,18 @@
  * www.percepio.com
  ******************************************************************************/
 
+/*
+ * Modified to add prvTraceItmInit(), which sets up the SWO output of the
+ * LPC54018, and to only build when TRC_CFG_STREAM_PORT selects this port.
+ */
+
 #include "trcRecorder.h"
 
 #if (TRC_USE_TRACEALYZER_RECORDER == 1)
-#if (TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING)
+#if (TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING) && (TRC_CFG_STREAM_PORT == TRC_STREAM_PORT_ARM_ITM)
+
+#include "fsl_clock.h"
+#include "fsl_iocon.h"
 
 static void itm_write_32(uint32_t data);
 
@@ -134,6 +142,29 @@ int32_t read_from_host(void* ptrData, uint32_t size, int32_t* ptrBytesRead)
 	return 0;
 }
 
+/* Called by vTraceEnable() through TRC_STREAM_PORT_INIT(), before any event is written */
+void prvTraceItmInit(void)
+{
+	/* SWO on PIO0_10, function 6 */
+	CLOCK_EnableClock(kCLOCK_Iocon);
+	IOCON_PinMuxSet(IOCON, 0U, 10U, IOCON_FUNC6 | IOCON_DIGITAL_EN);
+
+	/* Trace clock = main clock */
+	CLOCK_SetClkDiv(kCLOCK_DivArmTrClkDiv, 1U, false);
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+
+	/* Asynchronous NRZ output at TRC_CFG_ITM_SWO_BAUDRATE, formatter bypassed */
+	TPI->SPPR = 2U;
+	TPI->ACPR = (SystemCoreClock / TRC_CFG_ITM_SWO_BAUDRATE) - 1U;
+	TPI->FFCR = 0x100U;
+
+	ITM->LAR = 0xC5ACCE55U;
+	ITM->TCR = (1UL << ITM_TCR_TraceBusID_Pos) | ITM_TCR_SWOENA_Msk | ITM_TCR_SYNCENA_Msk | ITM_TCR_ITMENA_Msk;
+	ITM->TPR = 0U;
+	ITM->TER |= (1UL << TRC_CFG_ITM_PORT);
+}
+
 static void itm_write_32(uint32_t data)
 {	
      if   ((CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk)  &&      // Trace enabled
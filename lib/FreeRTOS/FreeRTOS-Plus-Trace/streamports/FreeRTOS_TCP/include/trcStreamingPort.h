@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * Trace Recorder Library for Tracealyzer v4.4.0
+ * Percepio AB, www.percepio.com
+ *
+ * trcStreamingPort.h
+ *
+ * The interface definitions for trace streaming ("stream ports").
+ * This "stream port" sets up the recorder to use TCP/IP as streaming channel.
+ * This variant is for FreeRTOS+TCP.
+ *
+ * Terms of Use
+ * This file is part of the trace recorder library (RECORDER), which is the 
+ * intellectual property of Percepio AB (PERCEPIO) and provided under a
+ * license as follows.
+ * The RECORDER may be used free of charge for the purpose of recording data
+ * intended for analysis in PERCEPIO products. It may not be used or modified
+ * for other purposes without explicit permission from PERCEPIO.
+ * You may distribute the RECORDER in its original source code form, assuming
+ * this text (terms of use, disclaimer, copyright notice) is unchanged. You are
+ * allowed to distribute the RECORDER with minor modifications intended for
+ * configuration or porting of the RECORDER, e.g., to allow using it on a 
+ * specific processor, processor family or with a specific communication
+ * interface. Any such modifications should be documented directly below
+ * this comment block.  
+ *
+ * Disclaimer
+ * The RECORDER is being delivered to you AS IS and PERCEPIO makes no warranty
+ * as to its use or performance. PERCEPIO does not and cannot warrant the 
+ * performance or results you may obtain by using the RECORDER or documentation.
+ * PERCEPIO make no warranties, express or implied, as to noninfringement of
+ * third party rights, merchantability, or fitness for any particular purpose.
+ * In no event will PERCEPIO, its technology partners, or distributors be liable
+ * to you for any consequential, incidental or special damages, including any
+ * lost profits or lost savings, even if a representative of PERCEPIO has been
+ * advised of the possibility of such damages, or for any claim by any third
+ * party. Some jurisdictions do not allow the exclusion or limitation of
+ * incidental, consequential or special damages, or the exclusion of implied
+ * warranties or limitations on how long an implied warranty may last, so the
+ * above limitations may not apply to you.
+ *
+ * Tabs are used for indent in this file (1 tab = 4 spaces)
+ *
+ * Copyright Percepio AB, 2018.
+ * www.percepio.com
+ ******************************************************************************/
+
+/*
+ * Modified from the TCPIP (lwIP) stream port to use the FreeRTOS+TCP sockets
+ * API, with a configurable port number and bounded socket buffers.
+ */
+
+#ifndef TRC_STREAMING_PORT_H
+#define TRC_STREAMING_PORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * TRC_CFG_STREAM_PORT_TCP_PORT
+ *
+ * The TCP port the target listens on for Tracealyzer. This must match the
+ * port entered under PSF Streaming Settings in Tracealyzer (default 12000).
+ ******************************************************************************/
+#ifndef TRC_CFG_STREAM_PORT_TCP_PORT
+#define TRC_CFG_STREAM_PORT_TCP_PORT 12000
+#endif
+
+/*******************************************************************************
+ * TRC_CFG_STREAM_PORT_TCP_TX_BUFFER_SIZE / TRC_CFG_STREAM_PORT_TCP_RX_BUFFER_SIZE
+ *
+ * Size in bytes of the socket stream buffers for the trace connection. The
+ * transmit buffer only needs to hold about one page of the paged event buffer,
+ * and the receive buffer only carries short Tracealyzer commands, so both are
+ * kept well below the stack defaults to bound the RAM cost of tracing.
+ ******************************************************************************/
+#ifndef TRC_CFG_STREAM_PORT_TCP_TX_BUFFER_SIZE
+#define TRC_CFG_STREAM_PORT_TCP_TX_BUFFER_SIZE 1460
+#endif
+
+#ifndef TRC_CFG_STREAM_PORT_TCP_RX_BUFFER_SIZE
+#define TRC_CFG_STREAM_PORT_TCP_RX_BUFFER_SIZE 536
+#endif
+
+#define TRC_STREAM_PORT_USE_INTERNAL_BUFFER 1
+
+int32_t trcTcpRead(void* data, uint32_t size, int32_t *ptrBytesRead);
+
+int32_t trcTcpWrite(void* data, uint32_t size, int32_t *ptrBytesWritten);
+
+#define TRC_STREAM_PORT_READ_DATA(_ptrData, _size, _ptrBytesRead) trcTcpRead(_ptrData, _size, _ptrBytesRead)
+
+#define TRC_STREAM_PORT_WRITE_DATA(_ptrData, _size, _ptrBytesSent) trcTcpWrite(_ptrData, _size, _ptrBytesSent)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRC_STREAMING_PORT_H */
@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * Trace Recorder Library for Tracealyzer v4.4.0
+ * Percepio AB, www.percepio.com
+ *
+ * trcStreamingPort.c
+ *
+ * Supporting functions for trace streaming, used by the "stream ports" 
+ * for reading and writing data to the interface.
+ * This variant streams the trace over a FreeRTOS+TCP socket.
+ *
+ * Terms of Use
+ * This file is part of the trace recorder library (RECORDER), which is the 
+ * intellectual property of Percepio AB (PERCEPIO) and provided under a
+ * license as follows.
+ * The RECORDER may be used free of charge for the purpose of recording data
+ * intended for analysis in PERCEPIO products. It may not be used or modified
+ * for other purposes without explicit permission from PERCEPIO.
+ * You may distribute the RECORDER in its original source code form, assuming
+ * this text (terms of use, disclaimer, copyright notice) is unchanged. You are
+ * allowed to distribute the RECORDER with minor modifications intended for
+ * configuration or porting of the RECORDER, e.g., to allow using it on a 
+ * specific processor, processor family or with a specific communication
+ * interface. Any such modifications should be documented directly below
+ * this comment block.  
+ *
+ * Disclaimer
+ * The RECORDER is being delivered to you AS IS and PERCEPIO makes no warranty
+ * as to its use or performance. PERCEPIO does not and cannot warrant the 
+ * performance or results you may obtain by using the RECORDER or documentation.
+ * PERCEPIO make no warranties, express or implied, as to noninfringement of
+ * third party rights, merchantability, or fitness for any particular purpose.
+ * In no event will PERCEPIO, its technology partners, or distributors be liable
+ * to you for any consequential, incidental or special damages, including any
+ * lost profits or lost savings, even if a representative of PERCEPIO has been
+ * advised of the possibility of such damages, or for any claim by any third
+ * party. Some jurisdictions do not allow the exclusion or limitation of
+ * incidental, consequential or special damages, or the exclusion of implied
+ * warranties or limitations on how long an implied warranty may last, so the
+ * above limitations may not apply to you.
+ *
+ * Tabs are used for indent in this file (1 tab = 4 spaces)
+ *
+ * Copyright Percepio AB, 2018.
+ * www.percepio.com
+ ******************************************************************************/
+
+/*
+ * Modified from the TCPIP (lwIP) stream port to use the FreeRTOS+TCP sockets
+ * API. All calls are made from the TzCtrl task, which never blocks for long:
+ * accept and receive are non-blocking and sends time out after
+ * TRC_CFG_CTRL_TASK_DELAY ticks, so tracing only uses otherwise idle time.
+ */
+
+#include "trcRecorder.h"
+
+#if (TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING) && (TRC_CFG_STREAM_PORT == TRC_STREAM_PORT_FREERTOS_TCP)
+#if (TRC_USE_TRACEALYZER_RECORDER == 1)
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+
+static Socket_t xListeningSocket = FREERTOS_INVALID_SOCKET;
+static Socket_t xClientSocket = FREERTOS_INVALID_SOCKET;
+
+static void prvTrcSocketClose(Socket_t* pxSocket)
+{
+	(void)FreeRTOS_closesocket(*pxSocket);
+	*pxSocket = FREERTOS_INVALID_SOCKET;
+}
+
+static int32_t prvTrcSocketInitializeListener(void)
+{
+	struct freertos_sockaddr xAddress = { 0 };
+	TickType_t xNoBlock = 0;
+	WinProperties_t xWinProperties = { 0 };
+
+	if (xListeningSocket != FREERTOS_INVALID_SOCKET)
+		return 0;
+
+	/* Sockets can only be bound once the interface has an address. */
+	if (FreeRTOS_IsNetworkUp() == pdFALSE)
+		return -1;
+
+	xListeningSocket = FreeRTOS_socket(FREERTOS_AF_INET, FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP);
+
+	if (xListeningSocket == FREERTOS_INVALID_SOCKET)
+		return -1;
+
+	(void)FreeRTOS_setsockopt(xListeningSocket, 0, FREERTOS_SO_RCVTIMEO, &xNoBlock, sizeof(xNoBlock));
+
+	/* Accepted sockets inherit these, so the trace connection never takes
+	 * the default 3000 byte stream buffers in each direction. */
+	xWinProperties.lTxBufSize = TRC_CFG_STREAM_PORT_TCP_TX_BUFFER_SIZE;
+	xWinProperties.lTxWinSize = 1;
+	xWinProperties.lRxBufSize = TRC_CFG_STREAM_PORT_TCP_RX_BUFFER_SIZE;
+	xWinProperties.lRxWinSize = 1;
+	(void)FreeRTOS_setsockopt(xListeningSocket, 0, FREERTOS_SO_WIN_PROPERTIES, &xWinProperties, sizeof(xWinProperties));
+
+	xAddress.sin_port = FreeRTOS_htons(TRC_CFG_STREAM_PORT_TCP_PORT);
+
+	if ((FreeRTOS_bind(xListeningSocket, &xAddress, sizeof(xAddress)) != 0) ||
+		(FreeRTOS_listen(xListeningSocket, 1) != 0))
+	{
+		prvTrcSocketClose(&xListeningSocket);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int32_t prvTrcSocketAccept(void)
+{
+	struct freertos_sockaddr xRemote;
+	socklen_t xRemoteSize = sizeof(xRemote);
+	TickType_t xNoBlock = 0;
+	TickType_t xSendTimeout = TRC_CFG_CTRL_TASK_DELAY;
+	Socket_t xSocket;
+
+	if (xListeningSocket == FREERTOS_INVALID_SOCKET)
+		return -1;
+
+	if (xClientSocket != FREERTOS_INVALID_SOCKET)
+		return 0;
+
+	xSocket = FreeRTOS_accept(xListeningSocket, &xRemote, &xRemoteSize);
+
+	if (xSocket == NULL)
+	{
+		/* No connection pending. */
+		return -1;
+	}
+
+	if (xSocket == FREERTOS_INVALID_SOCKET)
+	{
+		prvTrcSocketClose(&xListeningSocket);
+		return -1;
+	}
+
+	(void)FreeRTOS_setsockopt(xSocket, 0, FREERTOS_SO_RCVTIMEO, &xNoBlock, sizeof(xNoBlock));
+	(void)FreeRTOS_setsockopt(xSocket, 0, FREERTOS_SO_SNDTIMEO, &xSendTimeout, sizeof(xSendTimeout));
+
+	xClientSocket = xSocket;
+
+	return 0;
+}
+
+int32_t trcTcpWrite(void* data, uint32_t size, int32_t *ptrBytesWritten)
+{
+	BaseType_t xResult;
+
+	if ((xClientSocket == FREERTOS_INVALID_SOCKET) || (ptrBytesWritten == NULL))
+		return -1;
+
+	xResult = FreeRTOS_send(xClientSocket, data, size, 0);
+
+	if (xResult < 0)
+	{
+		/* Connection lost, the recorder stops until Tracealyzer reconnects. */
+		prvTrcSocketClose(&xClientSocket);
+		*ptrBytesWritten = 0;
+		return -1;
+	}
+
+	/* Zero means the send timed out with a full buffer, which the caller
+	 * retries, so the page is kept until the host has caught up. */
+	*ptrBytesWritten = (int32_t)xResult;
+
+	return 0;
+}
+
+int32_t trcTcpRead(void* data, uint32_t size, int32_t *ptrBytesRead)
+{
+	BaseType_t xResult;
+
+	*ptrBytesRead = 0;
+
+	/* Not connected yet is not an error, TzCtrl polls again later. */
+	if ((prvTrcSocketInitializeListener() != 0) || (prvTrcSocketAccept() != 0))
+		return 0;
+
+	xResult = FreeRTOS_recv(xClientSocket, data, size, 0);
+
+	if (xResult < 0)
+	{
+		prvTrcSocketClose(&xClientSocket);
+		return -1;
+	}
+
+	*ptrBytesRead = (int32_t)xResult;
+
+	return 0;
+}
+
+#endif /*(TRC_USE_TRACEALYZER_RECORDER == 1)*/
+#endif /*(TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING)*/
@@ -46,8 +46,16 @@
 #define LOG_METADATA_FORMAT    "[%s:%d] "
 #define LOG_METADATA_ARGS      __FUNCTION__, __LINE__
 
+/* Set to 1 to send the log as binary records, decoded on the host by tools/log_decode.py. */
+#ifndef LOG_BINARY_ENABLE
+    #define LOG_BINARY_ENABLE    0
+#endif
+
 /* Common macro for all logging interface macros. */
-#if !defined( DISABLE_LOGGING )
+#if !defined( DISABLE_LOGGING ) && ( LOG_BINARY_ENABLE == 1 )
+    #include "binary_log.h"
+    #define SdkLog( string )    BinaryLog string
+#elif !defined( DISABLE_LOGGING )
     #define SdkLog( string )    DbgConsole_Printf string
 #else
     #define SdkLog( string )
@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ecp_p256_m4.c
+ * @brief P-256 point doubling and mixed addition for mbed TLS on the Cortex-M4.
+ *
+ * mbed TLS computes each field operation of a point operation with the generic bignum code: an
+ * mbedtls_mpi multiplication, which grows its result on the heap, then the NIST reduction on
+ * bignums. The scalar multiplications of the ECDHE and ECDSA operations spend nearly all their
+ * time in the point doublings and mixed additions of the comb method, which mbed TLS lets a port
+ * replace through MBEDTLS_ECP_INTERNAL_ALT. Here the coordinates are copied once into fixed
+ * arrays of eight 32 bit words, the products are accumulated with UMAAL, which adds two 32 bit
+ * values to a 32x32 bit product in one instruction, and reduced with the word-wise NIST formula.
+ * Other curves, and the remaining operations, are left to mbed TLS.
+ */
+
+/* mbed TLS includes. */
+#include "aws_mbedtls_config.h"
+
+#if defined( MBEDTLS_ECP_INTERNAL_ALT )
+
+    #include <stdint.h>
+    #include <string.h>
+
+    #include "mbedtls/ecp.h"
+    #include "mbedtls/ecp_internal.h"
+
+    #if defined( MBEDTLS_HAVE_INT64 )
+        #error "ecp_p256_m4.c requires 32 bit bignum limbs."
+    #endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of 32 bit words of a P-256 field element.
+ */
+    #define p256WORDS    8
+
+/**
+ * @brief A field element, least significant word first, always reduced below p.
+ */
+    typedef uint32_t p256Element_t[ p256WORDS ];
+
+/**
+ * @brief The prime p = 2^256 - 2^224 + 2^192 + 2^96 - 1.
+ */
+    static const p256Element_t p256Prime =
+    {
+        0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0x00000000U,
+        0x00000000U, 0x00000000U, 0x00000001U, 0xFFFFFFFFU
+    };
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Multiplies two words and adds two more: ( *pHigh, *pLow ) = a * b + *pLow + *pHigh,
+ * which cannot overflow 64 bits.
+ */
+    static inline void p256MultiplyAccumulate( uint32_t * pLow,
+                                               uint32_t * pHigh,
+                                               uint32_t a,
+                                               uint32_t b )
+    {
+        #if defined( __ARM_FEATURE_DSP ) && ( __ARM_FEATURE_DSP == 1 )
+            uint32_t low = *pLow;
+            uint32_t high = *pHigh;
+
+            __asm__ ( "umaal %0, %1, %2, %3" : "+r" ( low ), "+r" ( high ) : "r" ( a ), "r" ( b ) );
+
+            *pLow = low;
+            *pHigh = high;
+        #else
+            uint64_t result = ( ( uint64_t ) a * b ) + *pLow + *pHigh;
+
+            *pLow = ( uint32_t ) result;
+            *pHigh = ( uint32_t ) ( result >> 32 );
+        #endif
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Tells whether a value below 2^256 is at least p.
+ */
+    static int p256IsAtLeastPrime( const uint32_t * pValue )
+    {
+        int i;
+
+        for( i = p256WORDS - 1; i >= 0; i-- )
+        {
+            if( pValue[ i ] != p256Prime[ i ] )
+            {
+                return pValue[ i ] > p256Prime[ i ];
+            }
+        }
+
+        return 1;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Subtracts p from a value below 2^256, or from a value of 2^256 plus the value when
+ * carry is set, keeping the low 256 bits.
+ */
+    static void p256SubtractPrime( uint32_t * pValue )
+    {
+        int64_t accumulator = 0;
+        int i;
+
+        for( i = 0; i < p256WORDS; i++ )
+        {
+            accumulator += ( int64_t ) pValue[ i ] - p256Prime[ i ];
+            pValue[ i ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void p256Add( p256Element_t result,
+                         const p256Element_t a,
+                         const p256Element_t b )
+    {
+        uint64_t accumulator = 0;
+        int i;
+
+        for( i = 0; i < p256WORDS; i++ )
+        {
+            accumulator += ( uint64_t ) a[ i ] + b[ i ];
+            result[ i ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+        }
+
+        if( ( accumulator != 0U ) || p256IsAtLeastPrime( result ) )
+        {
+            p256SubtractPrime( result );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void p256Subtract( p256Element_t result,
+                              const p256Element_t a,
+                              const p256Element_t b )
+    {
+        int64_t accumulator = 0;
+        int i;
+
+        for( i = 0; i < p256WORDS; i++ )
+        {
+            accumulator += ( int64_t ) a[ i ] - b[ i ];
+            result[ i ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+        }
+
+        if( accumulator != 0 )
+        {
+            /* Borrowed, add p back. */
+            accumulator = 0;
+
+            for( i = 0; i < p256WORDS; i++ )
+            {
+                accumulator += ( int64_t ) result[ i ] + p256Prime[ i ];
+                result[ i ] = ( uint32_t ) accumulator;
+                accumulator >>= 32;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reduces a 512 bit product modulo p with the NIST formula of FIPS 186-4 D.2.3, computed
+ * word by word with a signed carry, then folds the carry out of the top word back in with
+ * 2^256 = 2^224 - 2^192 - 2^96 + 1 mod p.
+ */
+    static void p256Reduce( p256Element_t result,
+                            const uint32_t * c )
+    {
+        int64_t accumulator;
+        int64_t carry;
+
+        accumulator = ( int64_t ) c[ 0 ] + c[ 8 ] + c[ 9 ] - c[ 11 ] - c[ 12 ] - c[ 13 ] - c[ 14 ];
+        result[ 0 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 1 ] + c[ 9 ] + c[ 10 ] - c[ 12 ] - c[ 13 ] - c[ 14 ] - c[ 15 ];
+        result[ 1 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 2 ] + c[ 10 ] + c[ 11 ] - c[ 13 ] - c[ 14 ] - c[ 15 ];
+        result[ 2 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 3 ] + ( 2 * ( int64_t ) c[ 11 ] ) + ( 2 * ( int64_t ) c[ 12 ] ) + c[ 13 ] - c[ 15 ] - c[ 8 ] - c[ 9 ];
+        result[ 3 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 4 ] + ( 2 * ( int64_t ) c[ 12 ] ) + ( 2 * ( int64_t ) c[ 13 ] ) + c[ 14 ] - c[ 9 ] - c[ 10 ];
+        result[ 4 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 5 ] + ( 2 * ( int64_t ) c[ 13 ] ) + ( 2 * ( int64_t ) c[ 14 ] ) + c[ 15 ] - c[ 10 ] - c[ 11 ];
+        result[ 5 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 6 ] + ( 3 * ( int64_t ) c[ 14 ] ) + ( 2 * ( int64_t ) c[ 15 ] ) + c[ 13 ] - c[ 8 ] - c[ 9 ];
+        result[ 6 ] = ( uint32_t ) accumulator;
+        accumulator >>= 32;
+        accumulator += ( int64_t ) c[ 7 ] + ( 3 * ( int64_t ) c[ 15 ] ) + c[ 8 ] - c[ 10 ] - c[ 11 ] - c[ 12 ] - c[ 13 ];
+        result[ 7 ] = ( uint32_t ) accumulator;
+        carry = accumulator >> 32;
+
+        /* The carry is between -4 and 6, folding it in leaves at most a carry of -1 or 1. */
+        while( carry != 0 )
+        {
+            accumulator = ( int64_t ) result[ 0 ] + carry;
+            result[ 0 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += result[ 1 ];
+            result[ 1 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += result[ 2 ];
+            result[ 2 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += ( int64_t ) result[ 3 ] - carry;
+            result[ 3 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += result[ 4 ];
+            result[ 4 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += result[ 5 ];
+            result[ 5 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += ( int64_t ) result[ 6 ] - carry;
+            result[ 6 ] = ( uint32_t ) accumulator;
+            accumulator >>= 32;
+            accumulator += ( int64_t ) result[ 7 ] + carry;
+            result[ 7 ] = ( uint32_t ) accumulator;
+            carry = accumulator >> 32;
+        }
+
+        /* Below 2^256, so at most one p too large. */
+        if( p256IsAtLeastPrime( result ) )
+        {
+            p256SubtractPrime( result );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void p256Multiply( p256Element_t result,
+                              const p256Element_t a,
+                              const p256Element_t b )
+    {
+        uint32_t product[ 2 * p256WORDS ] = { 0 };
+        uint32_t high;
+        int i, j;
+
+        for( i = 0; i < p256WORDS; i++ )
+        {
+            high = 0;
+
+            for( j = 0; j < p256WORDS; j++ )
+            {
+                p256MultiplyAccumulate( &product[ i + j ], &high, a[ i ], b[ j ] );
+            }
+
+            product[ i + p256WORDS ] = high;
+        }
+
+        p256Reduce( result, product );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Squares, computing each cross product once and doubling the sum.
+ */
+    static void p256Square( p256Element_t result,
+                            const p256Element_t a )
+    {
+        uint32_t product[ 2 * p256WORDS ] = { 0 };
+        uint32_t high;
+        uint32_t carry;
+        int i, j;
+
+        /* Cross products a[ i ] * a[ j ] with i < j. */
+        for( i = 0; i < p256WORDS - 1; i++ )
+        {
+            high = 0;
+
+            for( j = i + 1; j < p256WORDS; j++ )
+            {
+                p256MultiplyAccumulate( &product[ i + j ], &high, a[ i ], a[ j ] );
+            }
+
+            product[ i + p256WORDS ] = high;
+        }
+
+        /* Double them. */
+        carry = 0;
+
+        for( i = 0; i < 2 * p256WORDS; i++ )
+        {
+            uint32_t word = product[ i ];
+
+            product[ i ] = ( word << 1 ) | carry;
+            carry = word >> 31;
+        }
+
+        /* Add the squares a[ i ] * a[ i ]. */
+        carry = 0;
+
+        for( i = 0; i < p256WORDS; i++ )
+        {
+            uint64_t square = ( uint64_t ) a[ i ] * a[ i ];
+            uint64_t accumulator;
+
+            accumulator = ( uint64_t ) product[ 2 * i ] + ( uint32_t ) square + carry;
+            product[ 2 * i ] = ( uint32_t ) accumulator;
+            accumulator = ( uint64_t ) product[ ( 2 * i ) + 1 ] + ( uint32_t ) ( square >> 32 ) + ( accumulator >> 32 );
+            product[ ( 2 * i ) + 1 ] = ( uint32_t ) accumulator;
+            carry = ( uint32_t ) ( accumulator >> 32 );
+        }
+
+        p256Reduce( result, product );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int p256IsZero( const p256Element_t a )
+    {
+        uint32_t bits = 0;
+        int i;
+
+        for( i = 0; i < p256WORDS; i++ )
+        {
+            bits |= a[ i ];
+        }
+
+        return bits == 0U;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reads a coordinate, reduced below p. An mpi without limbs reads as 0.
+ */
+    static int p256FromMpi( p256Element_t result,
+                            const mbedtls_mpi * pValue )
+    {
+        size_t i;
+
+        if( ( pValue->s < 0 ) && ( mbedtls_mpi_cmp_int( pValue, 0 ) != 0 ) )
+        {
+            return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+        }
+
+        for( i = 0; i < pValue->n; i++ )
+        {
+            if( i < p256WORDS )
+            {
+                result[ i ] = ( uint32_t ) pValue->p[ i ];
+            }
+            else if( pValue->p[ i ] != 0U )
+            {
+                return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+            }
+        }
+
+        for( ; i < p256WORDS; i++ )
+        {
+            result[ i ] = 0;
+        }
+
+        if( p256IsAtLeastPrime( result ) )
+        {
+            p256SubtractPrime( result );
+        }
+
+        return 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int p256ToMpi( mbedtls_mpi * pValue,
+                          const p256Element_t a )
+    {
+        size_t i;
+        int ret;
+
+        ret = mbedtls_mpi_grow( pValue, p256WORDS );
+
+        if( ret == 0 )
+        {
+            for( i = 0; i < pValue->n; i++ )
+            {
+                pValue->p[ i ] = ( i < p256WORDS ) ? a[ i ] : 0U;
+            }
+
+            pValue->s = 1;
+        }
+
+        return ret;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int p256WritePoint( mbedtls_ecp_point * pPoint,
+                               const p256Element_t x,
+                               const p256Element_t y,
+                               const p256Element_t z )
+    {
+        int ret;
+
+        ret = p256ToMpi( &pPoint->X, x );
+
+        if( ret == 0 )
+        {
+            ret = p256ToMpi( &pPoint->Y, y );
+        }
+
+        if( ret == 0 )
+        {
+            ret = p256ToMpi( &pPoint->Z, z );
+        }
+
+        return ret;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Doubles a point in Jacobian coordinates, with a = -3 as mbed TLS does when the group
+ * has no A, and the same special-case free formula:
+ * M = 3 ( X + Z^2 ) ( X - Z^2 ), S = 4 X Y^2, X' = M^2 - 2 S, Y' = M ( S - X' ) - 8 Y^4, Z' = 2 Y Z.
+ * A zero point, Z = 0, stays zero.
+ */
+    static void p256Double( p256Element_t x,
+                            p256Element_t y,
+                            p256Element_t z )
+    {
+        p256Element_t m, s, t1, t2;
+
+        /* M = 3 ( X + Z^2 ) ( X - Z^2 ). */
+        p256Square( t1, z );
+        p256Add( t2, x, t1 );
+        p256Subtract( t1, x, t1 );
+        p256Multiply( m, t1, t2 );
+        p256Add( t1, m, m );
+        p256Add( m, t1, m );
+
+        /* S = 4 X Y^2. */
+        p256Square( t2, y );
+        p256Multiply( s, x, t2 );
+        p256Add( s, s, s );
+        p256Add( s, s, s );
+
+        /* 8 Y^4. */
+        p256Square( t2, t2 );
+        p256Add( t2, t2, t2 );
+        p256Add( t2, t2, t2 );
+        p256Add( t2, t2, t2 );
+
+        /* Z' = 2 Y Z, before Y is replaced. */
+        p256Multiply( t1, y, z );
+        p256Add( z, t1, t1 );
+
+        /* X' = M^2 - 2 S. */
+        p256Square( t1, m );
+        p256Subtract( t1, t1, s );
+        p256Subtract( x, t1, s );
+
+        /* Y' = M ( S - X' ) - 8 Y^4. */
+        p256Subtract( t1, s, x );
+        p256Multiply( t1, t1, m );
+        p256Subtract( y, t1, t2 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    unsigned char mbedtls_internal_ecp_grp_capable( const mbedtls_ecp_group * grp )
+    {
+        return ( grp->id == MBEDTLS_ECP_DP_SECP256R1 ) ? 1U : 0U;
+    }
+
+/*-----------------------------------------------------------*/
+
+    int mbedtls_internal_ecp_init( const mbedtls_ecp_group * grp )
+    {
+        ( void ) grp;
+
+        return 0;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void mbedtls_internal_ecp_free( const mbedtls_ecp_group * grp )
+    {
+        ( void ) grp;
+    }
+
+/*-----------------------------------------------------------*/
+
+    #if defined( MBEDTLS_ECP_DOUBLE_JAC_ALT )
+
+        int mbedtls_internal_ecp_double_jac( const mbedtls_ecp_group * grp,
+                                             mbedtls_ecp_point * R,
+                                             const mbedtls_ecp_point * P )
+        {
+            p256Element_t x, y, z;
+            int ret;
+
+            ( void ) grp;
+
+            ret = p256FromMpi( x, &P->X );
+
+            if( ret == 0 )
+            {
+                ret = p256FromMpi( y, &P->Y );
+            }
+
+            if( ret == 0 )
+            {
+                ret = p256FromMpi( z, &P->Z );
+            }
+
+            if( ret == 0 )
+            {
+                p256Double( x, y, z );
+                ret = p256WritePoint( R, x, y, z );
+            }
+
+            return ret;
+        }
+
+    #endif /* MBEDTLS_ECP_DOUBLE_JAC_ALT */
+
+/*-----------------------------------------------------------*/
+
+    #if defined( MBEDTLS_ECP_ADD_MIXED_ALT )
+
+/**
+ * @brief R = P + Q with P in Jacobian coordinates and Q affine, the same operations and special
+ * cases as ecp_add_mixed() of mbed TLS. R may be P.
+ */
+        int mbedtls_internal_ecp_add_mixed( const mbedtls_ecp_group * grp,
+                                            mbedtls_ecp_point * R,
+                                            const mbedtls_ecp_point * P,
+                                            const mbedtls_ecp_point * Q )
+        {
+            p256Element_t x1, y1, z1, x2, y2;
+            p256Element_t t1, t2, t3, t4;
+            int ret;
+
+            ( void ) grp;
+
+            /* Trivial cases, P or Q is zero. */
+            if( mbedtls_mpi_cmp_int( &P->Z, 0 ) == 0 )
+            {
+                return mbedtls_ecp_copy( R, Q );
+            }
+
+            if( ( Q->Z.p != NULL ) && ( mbedtls_mpi_cmp_int( &Q->Z, 0 ) == 0 ) )
+            {
+                return mbedtls_ecp_copy( R, P );
+            }
+
+            /* Q must be normalized. */
+            if( ( Q->Z.p != NULL ) && ( mbedtls_mpi_cmp_int( &Q->Z, 1 ) != 0 ) )
+            {
+                return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+            }
+
+            ret = p256FromMpi( x1, &P->X );
+
+            if( ret == 0 )
+            {
+                ret = p256FromMpi( y1, &P->Y );
+            }
+
+            if( ret == 0 )
+            {
+                ret = p256FromMpi( z1, &P->Z );
+            }
+
+            if( ret == 0 )
+            {
+                ret = p256FromMpi( x2, &Q->X );
+            }
+
+            if( ret == 0 )
+            {
+                ret = p256FromMpi( y2, &Q->Y );
+            }
+
+            if( ret != 0 )
+            {
+                return ret;
+            }
+
+            /* T1 = Z1^2 X2 - X1, T2 = Z1^3 Y2 - Y1. */
+            p256Square( t1, z1 );
+            p256Multiply( t2, t1, z1 );
+            p256Multiply( t1, t1, x2 );
+            p256Multiply( t2, t2, y2 );
+            p256Subtract( t1, t1, x1 );
+            p256Subtract( t2, t2, y1 );
+
+            if( p256IsZero( t1 ) )
+            {
+                if( p256IsZero( t2 ) )
+                {
+                    /* P = Q. */
+                    p256Double( x1, y1, z1 );
+
+                    return p256WritePoint( R, x1, y1, z1 );
+                }
+
+                /* P = -Q. */
+                return mbedtls_ecp_set_zero( R );
+            }
+
+            /* Z = Z1 T1. */
+            p256Multiply( z1, z1, t1 );
+
+            /* X = T2^2 - 2 X1 T1^2 - T1^3. */
+            p256Square( t3, t1 );
+            p256Multiply( t4, t3, t1 );
+            p256Multiply( t3, t3, x1 );
+            p256Add( t1, t3, t3 );
+            p256Square( x1, t2 );
+            p256Subtract( x1, x1, t1 );
+            p256Subtract( x1, x1, t4 );
+
+            /* Y = T2 ( X1 T1^2 - X ) - Y1 T1^3. */
+            p256Subtract( t3, t3, x1 );
+            p256Multiply( t3, t3, t2 );
+            p256Multiply( t4, t4, y1 );
+            p256Subtract( y1, t3, t4 );
+
+            return p256WritePoint( R, x1, y1, z1 );
+        }
+
+    #endif /* MBEDTLS_ECP_ADD_MIXED_ALT */
+
+#endif /* MBEDTLS_ECP_INTERNAL_ALT */
@@ -27,6 +27,9 @@
 
 #include "mbedtls_error.h"
 
+/* The strings are only compiled in when the errors are logged as text. */
+#if ( MBEDTLS_ERROR_COMPACT == 0 )
+
 #if !defined( MBEDTLS_CONFIG_FILE )
     #include "mbedtls/config.h"
 #else
@@ -873,7 +876,7 @@ const char * mbedtls_strerror_lowlevel( int32_t errnum )
         use_ret = ( uint32_t ) errnum;
     }
 
-    use_ret &= 0xFF80;
+    use_ret &= ~0xFF80;
 
     /* Low level error codes */
     /* */
@@ -1338,3 +1341,5 @@ const char * mbedtls_strerror_lowlevel( int32_t errnum )
 
     return rc;
 }
+
+#endif /* MBEDTLS_ERROR_COMPACT == 0 */
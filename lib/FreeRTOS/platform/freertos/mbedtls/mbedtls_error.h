@@ -34,6 +34,17 @@
         extern "C" {
     #endif
 
+/**
+ * @brief Set to 1 to log mbed TLS errors as their numeric code, decoded on the host by
+ * tools/mbedtls_error_decode.py, instead of the strings of this file, which are then left out of the
+ * image. It goes with LOG_BINARY_ENABLE, the code is then a single varint of the record.
+ */
+    #ifndef MBEDTLS_ERROR_COMPACT
+        #define MBEDTLS_ERROR_COMPACT    0
+    #endif
+
+    #if ( MBEDTLS_ERROR_COMPACT == 0 )
+
 /**
  * @brief Translate an mbed TLS high level code into its string representation.
  *        Result includes a terminating null byte.
@@ -43,7 +54,7 @@
  *
  * @warning The string returned by this function must never be modified.
  */
-    const char * mbedtls_strerror_highlevel( int32_t errnum );
+        const char * mbedtls_strerror_highlevel( int32_t errnum );
 
 /**
  * @brief Translate an mbed TLS low level code into its string representation,
@@ -54,7 +65,9 @@
  *
  * @warning The string returned by this function must never be modified.
  */
-    const char * mbedtls_strerror_lowlevel( int32_t errnum );
+        const char * mbedtls_strerror_lowlevel( int32_t errnum );
+
+    #endif /* MBEDTLS_ERROR_COMPACT == 0 */
 
     #ifdef __cplusplus
 }
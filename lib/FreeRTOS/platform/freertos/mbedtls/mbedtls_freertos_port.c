@@ -27,18 +27,301 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
 #include "FreeRTOS_Sockets.h"
 
 /* mbed TLS includes. */
 #include "aws_mbedtls_config.h"
 #include "threading_alt.h"
+#include "mbedtls_freertos_port.h"
 #include "mbedtls/entropy.h"
+#include "mbedtls/threading.h"
+
+/* Fills the large allocations with the DMA. */
+#include "dma_copy.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the smallest blocks of the pool, the block size doubles in each class.
+ */
+#define mbedtlspoolMIN_BLOCK_SIZE    32U
+
+/**
+ * @brief Size of the static region holding the blocks of all the classes.
+ */
+#define mbedtlspoolREGION_SIZE                   \
+    ( ( 32U * mbedtlsconfigPOOL_BLOCKS_32 ) +    \
+      ( 64U * mbedtlsconfigPOOL_BLOCKS_64 ) +    \
+      ( 128U * mbedtlsconfigPOOL_BLOCKS_128 ) +  \
+      ( 256U * mbedtlsconfigPOOL_BLOCKS_256 ) +  \
+      ( 512U * mbedtlsconfigPOOL_BLOCKS_512 ) +  \
+      ( 1024U * mbedtlsconfigPOOL_BLOCKS_1024 ) )
+
+/**
+ * @brief Free block of the pool, linked through its first bytes.
+ */
+typedef struct PoolBlock
+{
+    struct PoolBlock * pNext;
+} PoolBlock_t;
+
+/**
+ * @brief Region holding the pool blocks, ordered by class. 64-bit elements keep every
+ * block aligned for the structures of mbed TLS.
+ */
+static uint64_t poolRegion[ mbedtlspoolREGION_SIZE / sizeof( uint64_t ) ];
+
+/**
+ * @brief First byte of each class in poolRegion, the last entry is the end of the region.
+ */
+static uint8_t * pClassStart[ mbedtlspoolCLASS_COUNT + 1 ];
+
+/**
+ * @brief Free blocks of each class.
+ */
+static PoolBlock_t * pFreeBlocks[ mbedtlspoolCLASS_COUNT ];
+
+/**
+ * @brief Usage of the pool, also holding the size and count of the blocks of each class.
+ */
+static MbedtlsPoolStats_t poolStats;
+
+/**
+ * @brief Highest poolStats.bytesInUse since the last mbedtls_platform_take_peak_bytes().
+ */
+static uint32_t peakBytesSinceTake = 0U;
+
+/**
+ * @brief Header of the allocations from the FreeRTOS heap, holding their size for the byte count.
+ * 8 bytes keep the allocation aligned like the pool blocks.
+ */
+#define mbedtlspoolHEAP_HEADER_SIZE    8U
+
+/**
+ * @brief pdTRUE once the free lists are built.
+ */
+static BaseType_t poolInitDone = pdFALSE;
+
+#if ( mbedtlsconfigRECORD_BUFFERS > 32 )
+    #error "mbedtlsconfigRECORD_BUFFERS must not exceed 32."
+#endif
+
+#if ( mbedtlsconfigRECORD_BUFFERS > 0 )
+
+/**
+ * @brief The record buffers, 64-bit elements keep them aligned like the pool blocks.
+ */
+    static uint64_t recordBuffers[ mbedtlsconfigRECORD_BUFFERS ][ ( mbedtlsconfigRECORD_BUFFER_SIZE + 7U ) / 8U ] mbedtlsconfigRECORD_BUFFER_ATTRIBUTE;
+
+/**
+ * @brief Bit n is set while recordBuffers[ n ] is allocated.
+ */
+    static uint32_t recordBuffersUsedMask = 0U;
+
+#endif /* mbedtlsconfigRECORD_BUFFERS > 0 */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Builds the free list of each class. Called in a critical section.
+ */
+static void poolInit( void )
+{
+    static const uint16_t blockCounts[ mbedtlspoolCLASS_COUNT ] =
+    {
+        mbedtlsconfigPOOL_BLOCKS_32,  mbedtlsconfigPOOL_BLOCKS_64,  mbedtlsconfigPOOL_BLOCKS_128,
+        mbedtlsconfigPOOL_BLOCKS_256, mbedtlsconfigPOOL_BLOCKS_512, mbedtlsconfigPOOL_BLOCKS_1024
+    };
+    uint8_t * pBlock = ( uint8_t * ) poolRegion;
+    size_t classIndex;
+    size_t blockIndex;
+    size_t blockSize;
+
+    for( classIndex = 0; classIndex < mbedtlspoolCLASS_COUNT; classIndex++ )
+    {
+        blockSize = ( size_t ) mbedtlspoolMIN_BLOCK_SIZE << classIndex;
+        poolStats.classes[ classIndex ].blockSize = ( uint16_t ) blockSize;
+        poolStats.classes[ classIndex ].blockCount = blockCounts[ classIndex ];
+        pClassStart[ classIndex ] = pBlock;
+        pFreeBlocks[ classIndex ] = NULL;
+
+        /* Link the blocks in reverse so the lowest addresses are used first. */
+        for( blockIndex = blockCounts[ classIndex ]; blockIndex > 0U; blockIndex-- )
+        {
+            PoolBlock_t * pFree = ( PoolBlock_t * ) &( pBlock[ ( blockIndex - 1U ) * blockSize ] );
+
+            pFree->pNext = pFreeBlocks[ classIndex ];
+            pFreeBlocks[ classIndex ] = pFree;
+        }
+
+        pBlock += blockCounts[ classIndex ] * blockSize;
+    }
+
+    pClassStart[ mbedtlspoolCLASS_COUNT ] = pBlock;
+    poolInitDone = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Counts bytes taken by mbed TLS. Called in a critical section.
+ *
+ * @param[in] size Number of bytes reserved for the allocation.
+ */
+static void usageAdd( size_t size )
+{
+    poolStats.bytesInUse += ( uint32_t ) size;
+
+    if( poolStats.bytesInUse > poolStats.maxBytesInUse )
+    {
+        poolStats.maxBytesInUse = poolStats.bytesInUse;
+    }
+
+    if( poolStats.bytesInUse > peakBytesSinceTake )
+    {
+        peakBytesSinceTake = poolStats.bytesInUse;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Takes the smallest free block of the pool that holds size bytes.
+ *
+ * @param[in] size Number of bytes needed.
+ *
+ * @return The block, or NULL if the size exceeds the largest class or all the classes
+ * large enough are exhausted.
+ */
+static void * poolAlloc( size_t size )
+{
+    PoolBlock_t * pBlock = NULL;
+    MbedtlsPoolClassStats_t * pClass;
+    size_t classIndex;
+
+    taskENTER_CRITICAL();
+    {
+        if( poolInitDone == pdFALSE )
+        {
+            poolInit();
+        }
+
+        for( classIndex = 0; ( classIndex < mbedtlspoolCLASS_COUNT ) && ( pBlock == NULL ); classIndex++ )
+        {
+            pClass = &( poolStats.classes[ classIndex ] );
+
+            if( ( size <= pClass->blockSize ) && ( pFreeBlocks[ classIndex ] != NULL ) )
+            {
+                pBlock = pFreeBlocks[ classIndex ];
+                pFreeBlocks[ classIndex ] = pBlock->pNext;
+
+                pClass->blocksUsed++;
+
+                if( pClass->blocksUsed > pClass->maxBlocksUsed )
+                {
+                    pClass->maxBlocksUsed = pClass->blocksUsed;
+                }
+
+                usageAdd( pClass->blockSize );
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return pBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( mbedtlsconfigRECORD_BUFFERS > 0 )
+
+/**
+ * @brief Takes a free record buffer for an allocation too large for the pool.
+ *
+ * @param[in] size Number of bytes needed.
+ *
+ * @return The buffer, or NULL if the size exceeds mbedtlsconfigRECORD_BUFFER_SIZE or all the
+ * record buffers are in use.
+ */
+    static void * recordAlloc( size_t size )
+    {
+        void * pBuffer = NULL;
+        uint32_t index;
+
+        if( size <= mbedtlsconfigRECORD_BUFFER_SIZE )
+        {
+            taskENTER_CRITICAL();
+            {
+                for( index = 0U; ( index < mbedtlsconfigRECORD_BUFFERS ) && ( pBuffer == NULL ); index++ )
+                {
+                    if( ( recordBuffersUsedMask & ( 1UL << index ) ) == 0U )
+                    {
+                        recordBuffersUsedMask |= ( 1UL << index );
+                        pBuffer = recordBuffers[ index ];
+
+                        poolStats.recordBuffersUsed++;
+
+                        if( poolStats.recordBuffersUsed > poolStats.maxRecordBuffersUsed )
+                        {
+                            poolStats.maxRecordBuffersUsed = poolStats.recordBuffersUsed;
+                        }
+
+                        usageAdd( mbedtlsconfigRECORD_BUFFER_SIZE );
+                    }
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+
+        return pBuffer;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns a record buffer.
+ *
+ * @param[in] ptr The freed memory.
+ *
+ * @return pdTRUE if ptr is a record buffer, pdFALSE if it comes from elsewhere.
+ */
+    static BaseType_t recordFree( void * ptr )
+    {
+        uint8_t * pByte = ( uint8_t * ) ptr;
+        BaseType_t isRecord = pdFALSE;
+        uint32_t index;
+
+        if( ( pByte >= ( uint8_t * ) recordBuffers ) && ( pByte < &( ( ( uint8_t * ) recordBuffers )[ sizeof( recordBuffers ) ] ) ) )
+        {
+            index = ( uint32_t ) ( ( pByte - ( uint8_t * ) recordBuffers ) / sizeof( recordBuffers[ 0 ] ) );
+
+            taskENTER_CRITICAL();
+            {
+                recordBuffersUsedMask &= ~( 1UL << index );
+                poolStats.recordBuffersUsed--;
+                poolStats.bytesInUse -= ( uint32_t ) mbedtlsconfigRECORD_BUFFER_SIZE;
+            }
+            taskEXIT_CRITICAL();
+
+            isRecord = pdTRUE;
+        }
+
+        return isRecord;
+    }
+
+#endif /* mbedtlsconfigRECORD_BUFFERS > 0 */
 
 /*-----------------------------------------------------------*/
 
 /**
  * @brief Allocates memory for an array of members.
  *
+ * Handshakes make hundreds of short-lived small allocations, they are served from the
+ * static pool so that they do not fragment the FreeRTOS heap shared with the network
+ * buffers and tasks. The record buffers take one of the mbedtlsconfigRECORD_BUFFERS when
+ * they are configured, the other large blocks come from the heap.
+ *
  * @param[in] nmemb Number of members that need to be allocated.
  * @param[in] size Size of each member.
  *
@@ -56,11 +339,43 @@ void * mbedtls_platform_calloc( size_t nmemb,
         /* Overflow check. */
         if( ( totalSize / size ) == nmemb )
         {
-            pBuffer = pvPortMalloc( totalSize );
+            pBuffer = poolAlloc( totalSize );
+
+            #if ( mbedtlsconfigRECORD_BUFFERS > 0 )
+                if( pBuffer == NULL )
+                {
+                    pBuffer = recordAlloc( totalSize );
+                }
+            #endif
+
+            if( ( pBuffer == NULL ) && ( totalSize <= ( SIZE_MAX - mbedtlspoolHEAP_HEADER_SIZE ) ) )
+            {
+                pBuffer = pvPortMalloc( totalSize + mbedtlspoolHEAP_HEADER_SIZE );
+
+                taskENTER_CRITICAL();
+                {
+                    if( pBuffer != NULL )
+                    {
+                        poolStats.heapAllocations++;
+                        usageAdd( totalSize );
+                    }
+                    else
+                    {
+                        poolStats.failedAllocations++;
+                    }
+                }
+                taskEXIT_CRITICAL();
+
+                if( pBuffer != NULL )
+                {
+                    *( ( size_t * ) pBuffer ) = totalSize;
+                    pBuffer = &( ( ( uint8_t * ) pBuffer )[ mbedtlspoolHEAP_HEADER_SIZE ] );
+                }
+            }
 
             if( pBuffer != NULL )
             {
-                ( void ) memset( pBuffer, 0x00, totalSize );
+                ( void ) DmaCopy_Memset( pBuffer, 0x00, totalSize );
             }
         }
     }
@@ -77,7 +392,85 @@ void * mbedtls_platform_calloc( size_t nmemb,
  */
 void mbedtls_platform_free( void * ptr )
 {
-    vPortFree( ptr );
+    uint8_t * pByte = ( uint8_t * ) ptr;
+    PoolBlock_t * pBlock = ( PoolBlock_t * ) ptr;
+    size_t classIndex;
+
+    if( ( pByte >= ( uint8_t * ) poolRegion ) && ( pByte < &( ( ( uint8_t * ) poolRegion )[ sizeof( poolRegion ) ] ) ) )
+    {
+        taskENTER_CRITICAL();
+        {
+            for( classIndex = mbedtlspoolCLASS_COUNT; classIndex > 0U; classIndex-- )
+            {
+                if( pByte >= pClassStart[ classIndex - 1U ] )
+                {
+                    pBlock->pNext = pFreeBlocks[ classIndex - 1U ];
+                    pFreeBlocks[ classIndex - 1U ] = pBlock;
+                    poolStats.classes[ classIndex - 1U ].blocksUsed--;
+                    poolStats.bytesInUse -= poolStats.classes[ classIndex - 1U ].blockSize;
+                    break;
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    #if ( mbedtlsconfigRECORD_BUFFERS > 0 )
+        else if( recordFree( ptr ) == pdTRUE )
+        {
+            /* Returned to the record buffers. */
+        }
+    #endif
+    else if( ptr != NULL )
+    {
+        pByte -= mbedtlspoolHEAP_HEADER_SIZE;
+
+        taskENTER_CRITICAL();
+        {
+            poolStats.bytesInUse -= ( uint32_t ) *( ( size_t * ) pByte );
+        }
+        taskEXIT_CRITICAL();
+
+        vPortFree( pByte );
+    }
+    else
+    {
+        /* Freeing NULL does nothing. */
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_platform_get_pool_stats( MbedtlsPoolStats_t * pStats )
+{
+    configASSERT( pStats != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( poolInitDone == pdFALSE )
+        {
+            poolInit();
+        }
+
+        *pStats = poolStats;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t mbedtls_platform_take_peak_bytes( void )
+{
+    uint32_t peakBytes;
+
+    taskENTER_CRITICAL();
+    {
+        peakBytes = peakBytesSinceTake;
+        peakBytesSinceTake = poolStats.bytesInUse;
+    }
+    taskEXIT_CRITICAL();
+
+    return peakBytes;
 }
 
 /*-----------------------------------------------------------*/
@@ -89,6 +482,9 @@ void mbedtls_platform_free( void * ptr )
  * @param[in] buf Buffer containing the bytes to send.
  * @param[in] len Number of bytes to send from the buffer.
  *
+ * @note buf is the record encrypted in place by mbed TLS, the copy to the socket stream
+ * buffer is the only one, a FREERTOS_ZERO_COPY send would need the same copy.
+ *
  * @return Number of bytes sent on success; else a negative value.
  */
 int mbedtls_platform_send( void * ctx,
@@ -114,6 +510,9 @@ int mbedtls_platform_send( void * ctx,
  * @param[out] buf Buffer to receive bytes into.
  * @param[in] len Number of bytes to receive from the network.
  *
+ * @note mbed TLS decrypts records in place in buf, so the copy out of the socket stream
+ * buffer is needed, a FREERTOS_ZERO_COPY receive would replace it with a memcpy().
+ *
  * @return Number of bytes received if successful; Negative value on error.
  */
 int mbedtls_platform_recv( void * ctx,
@@ -214,4 +613,35 @@ int mbedtls_platform_mutex_unlock( mbedtls_threading_mutex_t * pMutex )
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Sets the mutex functions of mbed TLS, once for all users of mbed TLS.
+ *
+ * mbedtls_threading_set_alt() initializes the global mutexes of mbed TLS, so calling it
+ * again, or mbedtls_threading_free_alt(), while another task uses mbed TLS is not safe.
+ * The functions are therefore installed once and never removed.
+ */
+void mbedtls_platform_threading_init( void )
+{
+    static BaseType_t xThreadingInitDone = pdFALSE;
+    BaseType_t xInit = pdFALSE;
+
+    taskENTER_CRITICAL();
+    {
+        if( xThreadingInitDone == pdFALSE )
+        {
+            xThreadingInitDone = pdTRUE;
+            xInit = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
 
+    if( xInit == pdTRUE )
+    {
+        mbedtls_threading_set_alt( mbedtls_platform_mutex_init,
+                                   mbedtls_platform_mutex_free,
+                                   mbedtls_platform_mutex_lock,
+                                   mbedtls_platform_mutex_unlock );
+    }
+}
+
+/*-----------------------------------------------------------*/
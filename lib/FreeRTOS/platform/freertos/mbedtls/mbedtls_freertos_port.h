@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mbedtls_freertos_port.h
+ * @brief Memory pool of the mbed TLS platform functions for FreeRTOS.
+ */
+
+#ifndef MBEDTLS_FREERTOS_PORT_H_
+#define MBEDTLS_FREERTOS_PORT_H_
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Number of block sizes of the mbed TLS pool, from 32 bytes doubling up to 1024 bytes.
+ */
+#define mbedtlspoolCLASS_COUNT    6
+
+/**
+ * @brief Number of blocks of each size in the mbed TLS pool. Allocations larger than the
+ * largest block, or made when all the blocks large enough are in use, come from the FreeRTOS heap.
+ */
+#ifndef mbedtlsconfigPOOL_BLOCKS_32
+    #define mbedtlsconfigPOOL_BLOCKS_32      128
+#endif
+#ifndef mbedtlsconfigPOOL_BLOCKS_64
+    #define mbedtlsconfigPOOL_BLOCKS_64      64
+#endif
+#ifndef mbedtlsconfigPOOL_BLOCKS_128
+    #define mbedtlsconfigPOOL_BLOCKS_128     32
+#endif
+#ifndef mbedtlsconfigPOOL_BLOCKS_256
+    #define mbedtlsconfigPOOL_BLOCKS_256     16
+#endif
+#ifndef mbedtlsconfigPOOL_BLOCKS_512
+    #define mbedtlsconfigPOOL_BLOCKS_512     8
+#endif
+#ifndef mbedtlsconfigPOOL_BLOCKS_1024
+    #define mbedtlsconfigPOOL_BLOCKS_1024    4
+#endif
+
+/**
+ * @brief Number of buffers reserved for the TLS records. An allocation larger than the largest
+ * pool block and up to mbedtlsconfigRECORD_BUFFER_SIZE bytes takes one before falling back to
+ * the FreeRTOS heap, up to 32 buffers, 0 disables them.
+ */
+#ifndef mbedtlsconfigRECORD_BUFFERS
+    #define mbedtlsconfigRECORD_BUFFERS    0
+#endif
+
+/**
+ * @brief Size of the record buffers, enough for the input record buffer of mbed TLS.
+ */
+#ifndef mbedtlsconfigRECORD_BUFFER_SIZE
+    #define mbedtlsconfigRECORD_BUFFER_SIZE    ( MBEDTLS_SSL_IN_CONTENT_LEN + 512U )
+#endif
+
+/**
+ * @brief Attribute of the record buffers, to place them in a dedicated memory such as an
+ * external SDRAM.
+ */
+#ifndef mbedtlsconfigRECORD_BUFFER_ATTRIBUTE
+    #define mbedtlsconfigRECORD_BUFFER_ATTRIBUTE
+#endif
+
+/**
+ * @brief Usage of the blocks of one size of the mbed TLS pool.
+ */
+typedef struct MbedtlsPoolClassStats
+{
+    uint16_t blockSize;      /**< @brief Size of the blocks in bytes. */
+    uint16_t blockCount;     /**< @brief Number of blocks of this size. */
+    uint16_t blocksUsed;     /**< @brief Number of blocks allocated. */
+    uint16_t maxBlocksUsed;  /**< @brief Highest number of blocks allocated at the same time. */
+} MbedtlsPoolClassStats_t;
+
+/**
+ * @brief Usage of the mbed TLS pool since boot.
+ */
+typedef struct MbedtlsPoolStats
+{
+    MbedtlsPoolClassStats_t classes[ mbedtlspoolCLASS_COUNT ]; /**< @brief Usage of each block size. */
+    uint16_t recordBuffersUsed;                                /**< @brief Number of record buffers allocated. */
+    uint16_t maxRecordBuffersUsed;                             /**< @brief Highest number of record buffers allocated at the same time. */
+    uint32_t heapAllocations;                                  /**< @brief Allocations made from the FreeRTOS heap. */
+    uint32_t failedAllocations;                                /**< @brief Allocations that failed in the pool and the heap. */
+    uint32_t bytesInUse;                                       /**< @brief Bytes held by mbed TLS in the pool, the record buffers and the heap. */
+    uint32_t maxBytesInUse;                                    /**< @brief Highest number of bytes held at the same time. */
+} MbedtlsPoolStats_t;
+
+/**
+ * @brief Reads the usage of the mbed TLS pool.
+ *
+ * @param[out] pStats Receives a consistent copy of the statistics.
+ */
+void mbedtls_platform_get_pool_stats( MbedtlsPoolStats_t * pStats );
+
+/**
+ * @brief Reads the highest number of bytes held by mbed TLS since the previous call and restarts
+ * the measurement from the bytes held now, to find the peak of each part of a handshake. The bytes
+ * are counted in whole pool blocks and record buffers, and are shared by all the connections.
+ *
+ * @return The peak bytes held since the previous call, or since boot for the first call.
+ */
+uint32_t mbedtls_platform_take_peak_bytes( void );
+
+#endif /* ifndef MBEDTLS_FREERTOS_PORT_H_ */
@@ -51,4 +51,7 @@ void mbedtls_platform_mutex_free( mbedtls_threading_mutex_t * pMutex );
 int mbedtls_platform_mutex_lock( mbedtls_threading_mutex_t * pMutex );
 int mbedtls_platform_mutex_unlock( mbedtls_threading_mutex_t * pMutex );
 
+/* Installs the mutex functions in mbed TLS, only the first call has an effect. */
+void mbedtls_platform_threading_init( void );
+
 #endif /* ifndef MBEDTLS_THREADING_ALT_H_ */
@@ -33,10 +33,105 @@
 
 #include "retry_utils.h"
 
-#define MILLISECONDS_PER_SECOND    ( 1000U )                                                         /**< @brief Milliseconds per second. */
+/**
+ * @brief Task notification index used to abort a backoff sleep.
+ *
+ * Index 0 is left to the application, the MQTT agent uses it for its own
+ * wake ups which must not cut a backoff short.
+ */
+#ifndef RETRY_UTILS_NOTIFY_INDEX
+    #define RETRY_UTILS_NOTIFY_INDEX    ( 1U )
+#endif
+
+/**
+ * @brief Max number of tasks which can be in a backoff sleep at the same time.
+ * Further tasks still sleep but cannot be woken by RetryUtils_AbortSleep().
+ */
+#ifndef RETRY_UTILS_MAX_SLEEPERS
+    #define RETRY_UTILS_MAX_SLEEPERS    ( 2U )
+#endif
+
+#if ( RETRY_UTILS_NOTIFY_INDEX >= configTASK_NOTIFICATION_ARRAY_ENTRIES )
+    #error "RETRY_UTILS_NOTIFY_INDEX requires a larger configTASK_NOTIFICATION_ARRAY_ENTRIES."
+#endif
 
 extern UBaseType_t uxRand( void );
 
+/**
+ * @brief Tasks currently sleeping in RetryUtils_BackoffAndSleep().
+ */
+static TaskHandle_t xSleepingTasks[ RETRY_UTILS_MAX_SLEEPERS ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Get the first backoff window, capped at the max backoff value.
+ */
+static uint32_t initialJitterMax( void )
+{
+    uint32_t jitterMax = RETRY_BACKOFF_BASE_MS * 3U;
+
+    if( jitterMax > RETRY_BACKOFF_MAX_MS )
+    {
+        jitterMax = RETRY_BACKOFF_MAX_MS;
+    }
+
+    return jitterMax;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sleep for the given time, returning early when RetryUtils_AbortSleep()
+ * is called.
+ *
+ * @return pdTRUE if the sleep was aborted, pdFALSE if it ran to completion.
+ */
+static BaseType_t abortableSleep( uint32_t delayMs )
+{
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    TickType_t delayTicks = pdMS_TO_TICKS( delayMs );
+    UBaseType_t slot = RETRY_UTILS_MAX_SLEEPERS;
+    UBaseType_t i;
+    uint32_t notified;
+
+    if( delayTicks == 0U )
+    {
+        delayTicks = 1U;
+    }
+
+    /* Drop an abort which was meant for an earlier sleep. */
+    ( void ) xTaskNotifyStateClearIndexed( xTask, RETRY_UTILS_NOTIFY_INDEX );
+    ( void ) ulTaskNotifyValueClearIndexed( xTask, RETRY_UTILS_NOTIFY_INDEX, UINT32_MAX );
+
+    taskENTER_CRITICAL();
+    {
+        for( i = 0; i < RETRY_UTILS_MAX_SLEEPERS; i++ )
+        {
+            if( xSleepingTasks[ i ] == NULL )
+            {
+                xSleepingTasks[ i ] = xTask;
+                slot = i;
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    notified = ulTaskNotifyTakeIndexed( RETRY_UTILS_NOTIFY_INDEX, pdTRUE, delayTicks );
+
+    if( slot < RETRY_UTILS_MAX_SLEEPERS )
+    {
+        taskENTER_CRITICAL();
+        {
+            xSleepingTasks[ slot ] = NULL;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    return ( notified != 0U ) ? pdTRUE : pdFALSE;
+}
+
 /*-----------------------------------------------------------*/
 
 RetryUtilsStatus_t RetryUtils_BackoffAndSleep( RetryUtilsParams_t * pRetryParams )
@@ -48,24 +143,28 @@ RetryUtilsStatus_t RetryUtils_BackoffAndSleep( RetryUtilsParams_t * pRetryParams
     if( ( pRetryParams->attemptsDone < pRetryParams->maxRetryAttempts ) ||
         ( 0U == pRetryParams->maxRetryAttempts ) )
     {
-        /* Choose a random value for back-off time between 0 and the max jitter value. */
-        backOffDelayMs = uxRand() % pRetryParams->nextJitterMax;
-
-        /*  Wait for backoff time to expire for the next retry. */
-        vTaskDelay( pdMS_TO_TICKS( backOffDelayMs * MILLISECONDS_PER_SECOND ) );
+        /* Choose a random back-off time between the base and the max jitter value. */
+        backOffDelayMs = RETRY_BACKOFF_BASE_MS +
+                         ( ( uint32_t ) uxRand() % ( pRetryParams->nextJitterMax - RETRY_BACKOFF_BASE_MS + 1U ) );
 
         /* Increment backoff counts. */
         pRetryParams->attemptsDone++;
 
-        /* Double the max jitter value for the next retry attempt, only
-         * if the new value will be less than the max backoff time value. */
-        if( pRetryParams->nextJitterMax < ( MAX_RETRY_BACKOFF_SECONDS / 2U ) )
+        /*  Wait for backoff time to expire for the next retry. */
+        if( abortableSleep( backOffDelayMs ) == pdTRUE )
+        {
+            /* The condition which made the previous attempts fail is likely
+             * gone, start again from the smallest backoff window. */
+            pRetryParams->nextJitterMax = initialJitterMax();
+        }
+        else if( backOffDelayMs < ( RETRY_BACKOFF_MAX_MS / 3U ) )
         {
-            pRetryParams->nextJitterMax += pRetryParams->nextJitterMax;
+            /* The next sleep is at most three times this one. */
+            pRetryParams->nextJitterMax = backOffDelayMs * 3U;
         }
         else
         {
-            pRetryParams->nextJitterMax = MAX_RETRY_BACKOFF_SECONDS;
+            pRetryParams->nextJitterMax = RETRY_BACKOFF_MAX_MS;
         }
 
         status = RetryUtilsSuccess;
@@ -86,16 +185,36 @@ RetryUtilsStatus_t RetryUtils_BackoffAndSleep( RetryUtilsParams_t * pRetryParams
 
 void RetryUtils_ParamsReset( RetryUtilsParams_t * pRetryParams )
 {
-    uint32_t jitter = 0;
-
     /* Reset attempts done to zero so that the next retry cycle can start. */
     pRetryParams->attemptsDone = 0;
 
-    /* Calculate jitter value using picking a random number. */
-    jitter = ( uxRand() % MAX_JITTER_VALUE_SECONDS );
+    /* Reset the backoff window, the randomness comes from each sleep. */
+    pRetryParams->nextJitterMax = initialJitterMax();
+}
+
+/*-----------------------------------------------------------*/
+
+void RetryUtils_AbortSleep( void )
+{
+    TaskHandle_t xTasks[ RETRY_UTILS_MAX_SLEEPERS ];
+    UBaseType_t i;
+
+    taskENTER_CRITICAL();
+    {
+        for( i = 0; i < RETRY_UTILS_MAX_SLEEPERS; i++ )
+        {
+            xTasks[ i ] = xSleepingTasks[ i ];
+        }
+    }
+    taskEXIT_CRITICAL();
 
-    /* Reset the backoff value to the initial time out value plus jitter. */
-    pRetryParams->nextJitterMax = INITIAL_RETRY_BACKOFF_SECONDS + jitter;
+    for( i = 0; i < RETRY_UTILS_MAX_SLEEPERS; i++ )
+    {
+        if( xTasks[ i ] != NULL )
+        {
+            ( void ) xTaskNotifyGiveIndexed( xTasks[ i ], RETRY_UTILS_NOTIFY_INDEX );
+        }
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -57,6 +57,84 @@
 
 /************ End of logging configuration ****************/
 
+/* Buffer sizes of the selected performance profile. */
+#include "perf_profile.h"
+
+/**
+ * @brief Number of servers whose last connected address is kept across reconnects.
+ */
+#ifndef socketsconfigENDPOINT_CACHE_ENTRIES
+    #define socketsconfigENDPOINT_CACHE_ENTRIES    2
+#endif
+
+/**
+ * @brief Time allowed to the DNS requests started in the background, in milliseconds.
+ */
+#ifndef socketsconfigASYNC_DNS_TIMEOUT_MS
+    #define socketsconfigASYNC_DNS_TIMEOUT_MS    5000U
+#endif
+
+/**
+ * @brief Maximum number of addresses of a server connected to in parallel.
+ */
+#ifndef socketsconfigCONNECT_ADDRESSES
+    #define socketsconfigCONNECT_ADDRESSES    3
+#endif
+
+/**
+ * @brief Delay before connecting to the next address of a server while the previous
+ * connections are still pending, in milliseconds.
+ */
+#ifndef socketsconfigCONNECT_STAGGER_MS
+    #define socketsconfigCONNECT_STAGGER_MS    250U
+#endif
+
+/**
+ * @brief Time allowed to a connection to complete once started, in milliseconds.
+ */
+#ifndef socketsconfigCONNECT_TIMEOUT_MS
+    #define socketsconfigCONNECT_TIMEOUT_MS    10000U
+#endif
+
+/**
+ * @brief Receive and send windows of the #SOCKETS_PROFILE_LEAN sockets, in segments.
+ * The stream buffers are sized to hold one window.
+ */
+#ifndef socketsconfigLEAN_RX_SEGMENTS
+    #define socketsconfigLEAN_RX_SEGMENTS    2
+#endif
+#ifndef socketsconfigLEAN_TX_SEGMENTS
+    #define socketsconfigLEAN_TX_SEGMENTS    2
+#endif
+
+/**
+ * @brief Receive and send windows of the #SOCKETS_PROFILE_BULK sockets, in segments.
+ * The stream buffers are sized to hold one window. The receive window defaults to
+ * the one of democonfigPERF_PROFILE.
+ */
+#ifndef socketsconfigBULK_RX_SEGMENTS
+    #define socketsconfigBULK_RX_SEGMENTS    perfprofileBULK_RX_SEGMENTS
+#endif
+#ifndef socketsconfigBULK_TX_SEGMENTS
+    #define socketsconfigBULK_TX_SEGMENTS    2
+#endif
+
+/* A full receive window must leave the network buffers kept for the control traffic. */
+#if defined( democonfigNETWORK_CONTROL_BUFFERS ) && \
+    ( ( socketsconfigBULK_RX_SEGMENTS + democonfigNETWORK_CONTROL_BUFFERS ) > ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS )
+    #error "socketsconfigBULK_RX_SEGMENTS leaves fewer than democonfigNETWORK_CONTROL_BUFFERS network buffers."
+#endif
+
+/**
+ * @brief Buffer and window sizing of a connection.
+ */
+typedef enum SocketsProfile
+{
+    SOCKETS_PROFILE_DEFAULT = 0, /**< @brief ipconfigTCP_RX_BUFFER_LENGTH and ipconfigTCP_TX_BUFFER_LENGTH. */
+    SOCKETS_PROFILE_LEAN,        /**< @brief Small buffers for control traffic, such as MQTT. */
+    SOCKETS_PROFILE_BULK         /**< @brief A large receive window for downloads, such as OTA over HTTP. */
+} SocketsProfile_t;
+
 /**
  * @brief Establish a connection to server.
  *
@@ -68,6 +146,12 @@
  *
  * @note A timeout of 0 means infinite timeout.
  *
+ * @note A server connected before is first tried at its last known good address while
+ * its name is resolved again in the background, so a lossy link does not add a DNS
+ * timeout to the reconnect. The fresh address is tried next if the old one fails.
+ * The other addresses found in the DNS cache are connected to in parallel,
+ * socketsconfigCONNECT_STAGGER_MS apart, and the first connection to complete is kept.
+ *
  * @return Non-zero value on error, 0 on success.
  */
 BaseType_t Sockets_Connect( Socket_t * pTcpSocket,
@@ -76,18 +160,53 @@ BaseType_t Sockets_Connect( Socket_t * pTcpSocket,
                             uint32_t receiveTimeoutMs,
                             uint32_t sendTimeoutMs );
 
+/**
+ * @brief Establish a connection to server with the buffer and window sizes of a profile.
+ *
+ * Same as Sockets_Connect(), which uses #SOCKETS_PROFILE_DEFAULT.
+ *
+ * @param[in] profile Buffer and window sizing of the connection.
+ */
+BaseType_t Sockets_ConnectWithProfile( Socket_t * pTcpSocket,
+                                       const char * pHostName,
+                                       uint16_t port,
+                                       uint32_t receiveTimeoutMs,
+                                       uint32_t sendTimeoutMs,
+                                       SocketsProfile_t profile );
+
 /**
  * @brief End connection to server.
  *
+ * The shutdown is started and the function returns, the socket is closed from the timer
+ * task once the server acknowledged it or after FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_TIMEOUT_MS.
+ * The socket must not be used after the call.
+ *
  * @param[in] tcpSocket The socket descriptor.
  */
 void Sockets_Disconnect( Socket_t tcpSocket );
 
 
+/**
+ * @brief Starts resolving a server name in the background, so that the first
+ * Sockets_Connect() to it does not wait for DNS.
+ *
+ * @param[in] pHostName Server hostname.
+ */
+void Sockets_ResolveAsync( const char * pHostName );
+
 /**
  * @brief Set receive timeout for the socket.
  * @param[in] tcpSocket The socket descriptor.
  */
 void Sockets_SetReceiveTimeout( Socket_t tcpSocket, uint32_t timeoutMS );
 
+/**
+ * @brief Set the callback invoked from the IP task when the socket receives data
+ * or changes state.
+ * @param[in] tcpSocket The socket descriptor.
+ * @param[in] callback The callback to be invoked, or NULL to remove it.
+ */
+void Sockets_SetWakeupCallback( Socket_t tcpSocket,
+                                SocketWakeupCallback_t callback );
+
 #endif /* ifndef FREERTOS_SOCKETS_WRAPPER_H_ */
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file tls_freertos_common.h
+ * @brief Parts of the TLS transport that do not depend on the TLS library, shared by
+ * tls_freertos_pkcs11.c (mbed TLS) and tls_freertos_wolfssl.c (wolfSSL).
+ *
+ * tls_freertos_common.c implements the connection, send, flush and disconnect functions of
+ * tls_freertos_pkcs11.h, the transmit buffer, the PKCS #11 client key and the bookkeeping of
+ * the session and root CA caches. The TLS library glue is the TlsBackend_ functions below,
+ * implemented by the one backend file selected with tlsconfigUSE_WOLFSSL.
+ */
+
+#ifndef TLS_FREERTOS_COMMON_H_
+#define TLS_FREERTOS_COMMON_H_
+
+/* TLS transport header. */
+#include "tls_freertos_pkcs11.h"
+
+/* PKCS #11 includes. */
+#include "core_pkcs11_config.h"
+#include "core_pkcs11.h"
+#include "pkcs11.h"
+
+/**
+ * @brief Offset at which PKCS #11 writes a raw P-256 signature in the signature buffer of
+ * the TLS library, leaving room for the ASN.1 headers so that the DER encoding is done in place.
+ */
+#define tlsECDSA_RAW_SIGNATURE_OFFSET    8U
+
+/**
+ * @brief Size of a signature buffer receiving a P-256 signature from TlsCommon_SignEcdsa().
+ */
+#define tlsECDSA_SIGNATURE_BUFFER_SIZE    ( tlsECDSA_RAW_SIGNATURE_OFFSET + pkcs11ECDSA_P256_SIGNATURE_LENGTH )
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+    /* Implemented by the PKCS #11 PAL. */
+    extern mbedtls_x509_crt * PKCS11_PAL_GetCachedCertificate( void );
+    extern BaseType_t PKCS11_PAL_GetCachedKeyType( CK_KEY_TYPE * pxKeyType );
+    extern int PKCS11_PAL_SignWithCachedKey( mbedtls_md_type_t xMdAlg,
+                                             const unsigned char * pucHash,
+                                             size_t xHashLen,
+                                             unsigned char * pucSig,
+                                             size_t * pxSigLen,
+                                             int ( * piRng )( void *,
+                                                              unsigned char *,
+                                                              size_t ),
+                                             void * pvRng );
+#endif
+
+/**
+ * @brief Pre-shared key and identity read from the PKCS #11 PAL by TlsCommon_ReadPsk().
+ */
+typedef struct TlsPsk
+{
+    CK_BYTE_PTR pucKey;      /**< @brief The key. */
+    CK_ULONG ulKeySize;      /**< @brief Length of the key. */
+    CK_BYTE_PTR pucIdentity; /**< @brief The identity, not terminated. */
+    CK_ULONG ulIdentitySize; /**< @brief Length of the identity. */
+} TlsPsk_t;
+
+/*-----------------------------------------------------------*/
+
+/* Implemented by the backend. */
+
+/**
+ * @brief Initializes the TLS library once for all connections.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS, or #TLS_TRANSPORT_INTERNAL_ERROR.
+ */
+TlsTransportStatus_t TlsBackend_Init( void );
+
+/**
+ * @brief Sets up TLS on the connected socket of a network context, starting with
+ * TlsCommon_ContextInit().
+ *
+ * @param[in] pNetworkContext Network context.
+ * @param[in] pHostName Remote host name, used for server name indication.
+ * @param[in] pNetworkCredentials TLS setup parameters.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS, #TLS_TRANSPORT_INSUFFICIENT_MEMORY, #TLS_TRANSPORT_INVALID_CREDENTIALS,
+ * or #TLS_TRANSPORT_INTERNAL_ERROR, in which case the TLS objects are freed.
+ */
+TlsTransportStatus_t TlsBackend_Setup( NetworkContext_t * pNetworkContext,
+                                       const char * pHostName,
+                                       const NetworkCredentials_t * pNetworkCredentials );
+
+/**
+ * @brief Performs the TLS handshake of a connection set up by TlsBackend_Setup().
+ *
+ * @param[in] pNetworkContext Network context.
+ * @param[in] xSingleStep pdTRUE to process one step, pdFALSE to block until the handshake completes.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS, #TLS_TRANSPORT_IN_PROGRESS or #TLS_TRANSPORT_WANT_READ if
+ * a single step left the handshake incomplete, or #TLS_TRANSPORT_HANDSHAKE_FAILED, in which
+ * case the TLS objects are freed.
+ */
+TlsTransportStatus_t TlsBackend_Handshake( NetworkContext_t * pNetworkContext,
+                                           BaseType_t xSingleStep );
+
+/**
+ * @brief Switches the receive callbacks of the TLS library for an incremental handshake,
+ * on a socket without receive timeout.
+ *
+ * @param[in] pNetworkContext Network context.
+ * @param[in] xNonBlocking pdTRUE when the handshake starts, pdFALSE once it completes.
+ */
+void TlsBackend_SetNonBlocking( NetworkContext_t * pNetworkContext,
+                                BaseType_t xNonBlocking );
+
+/**
+ * @brief Writes bytes to the TLS connection in a single call to the TLS library.
+ *
+ * Called again with the same bytes after a timeout, as mbed TLS requires after a WANT_WRITE.
+ * Counts the timeouts with TlsCommon_CountSendTimeout().
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ * @param[in] pBuffer Buffer containing the bytes to send.
+ * @param[in] bytesToSend Number of bytes to send from the buffer.
+ *
+ * @return Number of bytes (> 0) sent, 0 if the socket timed out, or a negative error.
+ */
+int32_t TlsBackend_Write( SSLContext_t * pSslContext,
+                          const void * pBuffer,
+                          size_t bytesToSend );
+
+/**
+ * @brief Reads application data from the TLS connection.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ * @param[out] pBuffer Buffer to receive bytes into.
+ * @param[in] bytesToRecv Number of bytes to receive.
+ *
+ * @return Number of bytes (> 0) received, 0 if the socket timed out, or a negative error.
+ */
+int32_t TlsBackend_Read( SSLContext_t * pSslContext,
+                         void * pBuffer,
+                         size_t bytesToRecv );
+
+/**
+ * @brief Sends the close-notify of an established connection.
+ *
+ * @param[in] pNetworkContext Network context.
+ */
+void TlsBackend_Shutdown( NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Frees the TLS objects of a connection, once its socket is closed.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ */
+void TlsBackend_Free( SSLContext_t * pSslContext );
+
+#if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Offers the session of an entry of the session cache to the handshake about to start.
+ *
+ * @param[in] pSslContext The SSL context set up for the connection.
+ * @param[in] xEntry Index of the entry, holding a session saved by TlsBackend_SessionSave().
+ */
+    void TlsBackend_SessionLoad( SSLContext_t * pSslContext,
+                                 size_t xEntry );
+
+/**
+ * @brief Saves the session negotiated by a connection into an entry of the session cache,
+ * replacing the session the entry holds.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ * @param[in] xEntry Index of the entry.
+ *
+ * @return pdTRUE if saved, pdFALSE if the entry is left empty.
+ */
+    BaseType_t TlsBackend_SessionSave( SSLContext_t * pSslContext,
+                                       size_t xEntry );
+
+/**
+ * @brief Frees the session held by an entry of the session cache.
+ *
+ * @param[in] xEntry Index of the entry.
+ */
+    void TlsBackend_SessionFree( size_t xEntry );
+#endif /* if ( tlsconfigSESSION_CACHE_ENTRIES > 0 ) */
+
+#if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Loads a root CA into an entry of the root CA cache, replacing what the entry holds.
+ *
+ * @param[in] pSslContext The SSL context of the connection being set up.
+ * @param[in] pNetworkCredentials The credentials of the connection.
+ * @param[in] usePsk pdTRUE if the connection authenticates with the pre-shared key.
+ * @param[in] xEntry Index of the entry, no connection uses it.
+ *
+ * @return 0, or a negative error of the TLS library, in which case the entry is left empty.
+ */
+    int32_t TlsBackend_RootCaLoad( SSLContext_t * pSslContext,
+                                   const NetworkCredentials_t * pNetworkCredentials,
+                                   BaseType_t usePsk,
+                                   size_t xEntry );
+#endif /* if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+/* Implemented by tls_freertos_common.c. */
+
+/**
+ * @brief Initializes the fields of an SSL context that do not belong to the TLS library.
+ *
+ * @param[in] pSslContext The SSL context to initialize.
+ */
+void TlsCommon_ContextInit( SSLContext_t * pSslContext );
+
+/**
+ * @brief Counts a send that timed out, see TLS_FreeRTOS_GetSendTimeouts().
+ */
+void TlsCommon_CountSendTimeout( void );
+
+/**
+ * @brief Looks up the handle and the type of the device private key, RSA or EC.
+ *
+ * @param[in] pSslContext Caller TLS context.
+ *
+ * @return CKR_OK on success.
+ */
+CK_RV TlsCommon_InitClientKey( SSLContext_t * pSslContext );
+
+/**
+ * @brief Gets the device certificate, the one parsed by the PAL if
+ * pkcs11configPAL_CACHE_PARSED_OBJECTS is set, else the one read from PKCS #11 into pxStorage.
+ *
+ * @param[in] pSslContext Caller TLS context.
+ * @param[in] pxStorage Certificate context, initialized by the caller, which frees it.
+ * @param[out] ppxCertificate The certificate.
+ *
+ * @return CKR_OK on success.
+ */
+CK_RV TlsCommon_GetClientCertificate( SSLContext_t * pSslContext,
+                                      mbedtls_x509_crt * pxStorage,
+                                      mbedtls_x509_crt ** ppxCertificate );
+
+/**
+ * @brief Signs with the device private key through PKCS #11.
+ *
+ * @param[in] pSslContext Caller TLS context, set up by TlsCommon_InitClientKey().
+ * @param[in] xMechanism CKM_ECDSA or CKM_RSA_PKCS.
+ * @param[in] pucToBeSigned Hash, or DigestInfo for RSA.
+ * @param[in] xToBeSignedLen Length of pucToBeSigned.
+ * @param[out] pucSignature Receives the signature.
+ * @param[in,out] pxSignatureLen Size of pucSignature, then length of the signature.
+ *
+ * @return CKR_OK on success.
+ */
+CK_RV TlsCommon_Sign( SSLContext_t * pSslContext,
+                      CK_MECHANISM_TYPE xMechanism,
+                      const uint8_t * pucToBeSigned,
+                      size_t xToBeSignedLen,
+                      uint8_t * pucSignature,
+                      CK_ULONG * pxSignatureLen );
+
+/**
+ * @brief Signs a hash with the device P-256 key through PKCS #11, as the ASN.1 DER sequence
+ * of R and S expected by the TLS libraries.
+ *
+ * @param[in] pSslContext Caller TLS context, set up by TlsCommon_InitClientKey().
+ * @param[in] pucHash The hash.
+ * @param[in] xHashLen Length of the hash.
+ * @param[out] pucSig Signature buffer of at least tlsECDSA_SIGNATURE_BUFFER_SIZE bytes.
+ * @param[out] pxSigLen Length of the DER signature.
+ *
+ * @return CKR_OK on success.
+ */
+CK_RV TlsCommon_SignEcdsa( SSLContext_t * pSslContext,
+                           const uint8_t * pucHash,
+                           size_t xHashLen,
+                           uint8_t * pucSig,
+                           size_t * pxSigLen );
+
+/**
+ * @brief Reads the pre-shared key and its identity stored by the PKCS #11 PAL.
+ *
+ * @param[out] pxPsk Receives the key and the identity, to free with TlsCommon_FreePsk().
+ *
+ * @return CKR_OK on success, else nothing is left to free.
+ */
+CK_RV TlsCommon_ReadPsk( TlsPsk_t * pxPsk );
+
+/**
+ * @brief Frees the key and the identity read by TlsCommon_ReadPsk().
+ *
+ * @param[in] pxPsk The key and the identity.
+ */
+void TlsCommon_FreePsk( TlsPsk_t * pxPsk );
+
+#if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Offers the session cached for a server to the handshake about to start, through
+ * TlsBackend_SessionLoad().
+ *
+ * @param[in] pSslContext The SSL context set up for the connection.
+ * @param[in] pHostName Remote host name.
+ */
+    void TlsCommon_SessionCacheLoad( SSLContext_t * pSslContext,
+                                     const char * pHostName );
+
+/**
+ * @brief Keeps the session negotiated with a server, or drops it if the handshake failed.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ * @param[in] pHostName Remote host name.
+ * @param[in] xHandshakeDone pdTRUE if the handshake succeeded.
+ */
+    void TlsCommon_SessionCacheStore( SSLContext_t * pSslContext,
+                                      const char * pHostName,
+                                      BaseType_t xHandshakeDone );
+#endif /* if ( tlsconfigSESSION_CACHE_ENTRIES > 0 ) */
+
+#if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Gets the entry of the root CA cache holding the root CA of the credentials, loading
+ * it with TlsBackend_RootCaLoad() on the first use, and sets #SSLContext.rootCaEntry.
+ *
+ * @param[in] pSslContext The SSL context of the connection being set up.
+ * @param[in] pNetworkCredentials The credentials of the connection.
+ * @param[in] usePsk pdTRUE if the connection authenticates with the pre-shared key.
+ *
+ * @return 0, or the error of TlsBackend_RootCaLoad(). #SSLContext.rootCaEntry is left at
+ * tlsROOT_CA_CACHE_NONE if every entry is used by another root CA.
+ */
+    int32_t TlsCommon_RootCaCacheAcquire( SSLContext_t * pSslContext,
+                                          const NetworkCredentials_t * pNetworkCredentials,
+                                          BaseType_t usePsk );
+
+/**
+ * @brief Releases the entry got by TlsCommon_RootCaCacheAcquire(), which stays loaded.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ */
+    void TlsCommon_RootCaCacheRelease( SSLContext_t * pSslContext );
+#endif /* if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 ) */
+
+#endif /* ifndef TLS_FREERTOS_COMMON_H_ */
@@ -57,10 +57,22 @@
 
 /* FreeRTOS+TCP include. */
 #include "FreeRTOS_Sockets.h"
+#include "freertos_sockets_wrapper.h"
 
 /* Transport interface include. */
 #include "transport_interface.h"
 
+/**
+ * @brief Set to 1 to implement the transport with wolfSSL instead of mbed TLS, see
+ * tls_freertos_wolfssl.c and source/user_settings.h. mbed TLS stays in the image for
+ * PKCS #11, the OTA signature verification and the types of #NetworkCredentials_t.
+ * Experimental: the wolfSSL backend has not been built against lib/wolfssl, and no build
+ * configuration selects it.
+ */
+#ifndef tlsconfigUSE_WOLFSSL
+    #define tlsconfigUSE_WOLFSSL    0
+#endif
+
 /* mbed TLS includes. */
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/entropy.h"
@@ -70,9 +82,135 @@
 #include "mbedtls/pk.h"
 #include "mbedtls/pk_internal.h"
 
+#if ( tlsconfigUSE_WOLFSSL == 1 )
+    /* wolfSSL includes. */
+    #include "wolfssl/wolfcrypt/settings.h"
+    #include "wolfssl/ssl.h"
+#endif
+
 /* PKCS #11 includes. */
 #include "core_pkcs11.h"
 
+/**
+ * @brief Name of the TLS library implementing the transport, reported by the benchmarks.
+ */
+#if ( tlsconfigUSE_WOLFSSL == 1 )
+    #define TLS_FREERTOS_BACKEND    "wolfssl"
+#else
+    #define TLS_FREERTOS_BACKEND    "mbedtls"
+#endif
+
+/**
+ * @brief Number of servers whose last TLS session is kept in RAM and offered on reconnect.
+ * Set to 0 to always perform a full handshake.
+ */
+#ifndef tlsconfigSESSION_CACHE_ENTRIES
+    #define tlsconfigSESSION_CACHE_ENTRIES    2
+#endif
+
+/**
+ * @brief Number of root CA chains parsed once and shared by the connections that use the same
+ * #NetworkCredentials.pRootCa buffer. A chain no longer used by any connection stays parsed for the
+ * next connect until its entry is needed for another root CA. Set to 0 to parse the root CA into
+ * each connection.
+ */
+#ifndef tlsconfigROOT_CA_CACHE_ENTRIES
+    #define tlsconfigROOT_CA_CACHE_ENTRIES    2
+#endif
+
+/**
+ * @brief Value of #SSLContext.rootCaEntry for a connection holding its own root CA.
+ */
+#define tlsROOT_CA_CACHE_NONE    ( ( size_t ) tlsconfigROOT_CA_CACHE_ENTRIES )
+
+/**
+ * @brief Size of the buffer combining consecutive sends of a connection into one TLS record.
+ * The buffer is written out when full, before receiving and by TLS_FreeRTOS_flush().
+ * Set to 0 to encrypt each send in its own record.
+ */
+#ifndef tlsconfigTX_COALESCE_BUFFER_SIZE
+    #define tlsconfigTX_COALESCE_BUFFER_SIZE    512
+#endif
+
+/**
+ * @brief Set to 1 to profile each handshake by phase and print one record per connection:
+ * TLS_HS,host,result,total_ms,sign_us, then cpu_us,wait_us,peak_bytes of each phase, hello,
+ * cert, ecdhe, sign and finished. cpu_us is the time spent in mbed TLS, wait_us the time spent
+ * waiting for the server and for the crypto worker, peak_bytes the most memory held by mbed TLS,
+ * and sign_us the time spent in the PKCS #11 signature of the client certificate verify.
+ */
+#ifndef tlsconfigHANDSHAKE_PROFILE
+    #define tlsconfigHANDSHAKE_PROFILE    0
+#endif
+
+#if ( tlsconfigHANDSHAKE_PROFILE == 1 ) && ( tlsconfigUSE_WOLFSSL == 1 )
+    #error "tlsconfigHANDSHAKE_PROFILE follows the states of mbed TLS, it is not available with wolfSSL."
+#endif
+
+#if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+
+/**
+ * @brief Phases of the handshake profile, each a group of mbed TLS client states.
+ */
+    typedef enum TlsHandshakePhase
+    {
+        TLS_PHASE_HELLO = 0, /**< @brief ClientHello and ServerHello. */
+        TLS_PHASE_CERT,      /**< @brief Parsing and verification of the server certificate chain. */
+        TLS_PHASE_ECDHE,     /**< @brief Server key exchange signature, ECDHE key pair and shared secret. */
+        TLS_PHASE_SIGN,      /**< @brief Client certificate verify, signed with the PKCS #11 key. */
+        TLS_PHASE_FINISHED,  /**< @brief Change cipher spec, Finished messages and session tickets. */
+        TLS_PHASE_COUNT
+    } TlsHandshakePhase_t;
+
+/**
+ * @brief Handshake profile of a connection.
+ */
+    typedef struct TlsHandshakeProfile
+    {
+        uint32_t cpuCycles[ TLS_PHASE_COUNT ]; /**< @brief DWT cycles in mbedtls_ssl_handshake_step(), receive wait excluded. */
+        uint32_t waitUs[ TLS_PHASE_COUNT ];    /**< @brief Microseconds waiting for records or for a handshake step to start. */
+        uint32_t peakBytes[ TLS_PHASE_COUNT ]; /**< @brief Most bytes held by mbed TLS during the phase. */
+        uint32_t signCycles;                   /**< @brief DWT cycles in the signing callback. */
+        uint32_t recvCycles;                   /**< @brief DWT cycles blocked in the receive callback during the current step. */
+        uint32_t lastCycles;                   /**< @brief DWT cycle count when the previous step returned. */
+        int ( * pRecv )( void * ctx,
+                         unsigned char * buf,
+                         size_t len );         /**< @brief Receive function called with the socket. */
+    } TlsHandshakeProfile_t;
+
+#endif /* tlsconfigHANDSHAKE_PROFILE == 1 */
+
+#if ( tlsconfigUSE_WOLFSSL == 1 )
+
+/**
+ * @brief Secured connection context.
+ */
+    typedef struct SSLContext
+    {
+        WOLFSSL_CTX * pCtx;             /**< @brief Root CA, client certificate and callbacks of the connection. */
+        WOLFSSL * pSsl;                 /**< @brief SSL connection. */
+        #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+            size_t rootCaEntry;         /**< @brief Entry of the root CA cache holding pCtx, or tlsROOT_CA_CACHE_NONE if pCtx is owned. */
+        #endif
+
+        /* PKCS#11. */
+        CK_FUNCTION_LIST_PTR pxP11FunctionList;
+        CK_OBJECT_HANDLE xP11PrivateKey; /**< @brief Handle valid in the sessions of pkcs11_session_pool.h. */
+        CK_KEY_TYPE xKeyType;
+
+        /* Handshake in progress. */
+        const char * pHostName;     /**< @brief Server name, for the log once the handshake completes. */
+        TickType_t handshakeStart;  /**< @brief Tick count when the handshake started. */
+        uint32_t receiveTimeoutMs;  /**< @brief Receive timeout restored once an incremental handshake completes. */
+
+        #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+            uint8_t txBuffer[ tlsconfigTX_COALESCE_BUFFER_SIZE ]; /**< @brief Bytes sent but not yet written to wolfSSL. */
+            size_t txLength;                                      /**< @brief Number of bytes in txBuffer. */
+        #endif
+    } SSLContext_t;
+
+#else /* if ( tlsconfigUSE_WOLFSSL == 1 ) */
+
 /**
  * @brief Secured connection context.
  */
@@ -82,17 +220,35 @@ typedef struct SSLContext
     mbedtls_ssl_context context;          /**< @brief SSL connection context */
     mbedtls_x509_crt_profile certProfile; /**< @brief Certificate security profile for this connection. */
     mbedtls_x509_crt rootCa;              /**< @brief Root CA certificate context. */
+    #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+        size_t rootCaEntry;               /**< @brief Entry of the root CA cache used instead of rootCa, or tlsROOT_CA_CACHE_NONE. */
+    #endif
     mbedtls_x509_crt clientCert;          /**< @brief Client certificate context. */
     mbedtls_pk_context privKey;           /**< @brief Client private key context. */
     mbedtls_pk_info_t privKeyInfo;        /**< @brief Client private key info. */
 
     /* PKCS#11. */
     CK_FUNCTION_LIST_PTR pxP11FunctionList;
-    CK_SESSION_HANDLE xP11Session;
-    CK_OBJECT_HANDLE xP11PrivateKey;
+    CK_OBJECT_HANDLE xP11PrivateKey; /**< @brief Handle valid in the sessions of pkcs11_session_pool.h. */
     CK_KEY_TYPE xKeyType;
+
+    /* Handshake in progress. */
+    const char * pHostName;     /**< @brief Server name, to store the session once the handshake completes. */
+    TickType_t handshakeStart;  /**< @brief Tick count when the handshake started. */
+    uint32_t receiveTimeoutMs;  /**< @brief Receive timeout restored once an incremental handshake completes. */
+
+    #if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+        TlsHandshakeProfile_t profile; /**< @brief Time and memory of each phase of the handshake. */
+    #endif
+
+    #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+        uint8_t txBuffer[ tlsconfigTX_COALESCE_BUFFER_SIZE ]; /**< @brief Bytes sent but not yet written to mbed TLS. */
+        size_t txLength;                                      /**< @brief Number of bytes in txBuffer. */
+    #endif
 } SSLContext_t;
 
+#endif /* if ( tlsconfigUSE_WOLFSSL == 1 ) */
+
 /**
  * @brief Definition of the network context for the transport interface
  * implementation that uses mbedTLS and FreeRTOS+TLS sockets.
@@ -123,7 +279,56 @@ typedef struct NetworkCredentials
      */
     BaseType_t disableSni;
 
-    const unsigned char * pRootCa;   /**< @brief String representing a trusted server root certificate. */
+    /**
+     * @brief Set to pdTRUE to not offer the session cached for the server, the handshake is then
+     * always a full one. The session negotiated is still cached for the next connections.
+     */
+    BaseType_t disableSessionResumption;
+
+    /**
+     * @brief Maximum fragment length to negotiate, MBEDTLS_SSL_MAX_FRAG_LEN_512 to
+     * MBEDTLS_SSL_MAX_FRAG_LEN_4096, or MBEDTLS_SSL_MAX_FRAG_LEN_NONE to not negotiate.
+     * Servers not supporting the extension ignore it, the records received are then only
+     * bounded by MBEDTLS_SSL_IN_CONTENT_LEN.
+     */
+    uint8_t maxFragmentLength;
+
+    /**
+     * @brief Cipher suites to offer in decreasing order of preference, terminated by 0, or NULL
+     * for all the suites enabled in the mbed TLS configuration. The list must stay valid while
+     * connected. With wolfSSL, the IANA identifiers are offered by their wolfSSL names.
+     */
+    const int * pCipherSuites;
+
+    /**
+     * @brief Elliptic curves to offer in decreasing order of preference, terminated by
+     * MBEDTLS_ECP_DP_NONE, or NULL for all the curves enabled in the mbed TLS configuration.
+     * The list must stay valid while connected. With wolfSSL, the curves without a wolfSSL
+     * equivalent are skipped.
+     */
+    const mbedtls_ecp_group_id * pCurves;
+
+    /**
+     * @brief Set to pdTRUE to authenticate with the pre-shared key provisioned under
+     * pkcs11configLABEL_TLS_PSK and pkcs11configLABEL_TLS_PSK_IDENTITY instead of the device
+     * certificate and the server certificate chain, for brokers on a local network. Needs
+     * mbedtlsconfigTLS_PSK, #NetworkCredentials.pRootCa may then be NULL. Without
+     * #NetworkCredentials.pCipherSuites, ECDHE-PSK and then plain PSK suites are offered.
+     */
+    BaseType_t usePsk;
+
+    /**
+     * @brief Buffer and window sizing of the TCP connection, #SOCKETS_PROFILE_DEFAULT
+     * for the FreeRTOS+TCP defaults.
+     */
+    SocketsProfile_t socketProfile;
+
+    /**
+     * @brief Trusted server root certificates, PEM including the terminating NULL, or a single DER
+     * certificate, which also skips the base64 decoding. The buffer identifies the chain in the root
+     * CA cache, see tlsconfigROOT_CA_CACHE_ENTRIES, so it must not be modified once used to connect.
+     */
+    const unsigned char * pRootCa;
     size_t rootCaSize;               /**< @brief Size associated with #NetworkCredentials.pRootCa. */
     const unsigned char * pUserName; /**< @brief String representing the username for MQTT. */
     size_t userNameSize;             /**< @brief Size associated with #NetworkCredentials.pUserName. */
@@ -142,7 +347,9 @@ typedef enum TlsTransportStatus
     TLS_TRANSPORT_INVALID_CREDENTIALS, /**< Provided credentials were invalid. */
     TLS_TRANSPORT_HANDSHAKE_FAILED,    /**< Performing TLS handshake with server failed. */
     TLS_TRANSPORT_INTERNAL_ERROR,      /**< A call to a system API resulted in an internal error. */
-    TLS_TRANSPORT_CONNECT_FAILURE      /**< Initial connection to the server failed. */
+    TLS_TRANSPORT_CONNECT_FAILURE,     /**< Initial connection to the server failed. */
+    TLS_TRANSPORT_IN_PROGRESS,         /**< The incremental handshake can take its next step. */
+    TLS_TRANSPORT_WANT_READ            /**< The incremental handshake waits for data from the server. */
 } TlsTransportStatus_t;
 
 /**
@@ -166,6 +373,46 @@ TlsTransportStatus_t TLS_FreeRTOS_Connect( NetworkContext_t * pNetworkContext,
                                            uint32_t receiveTimeoutMs,
                                            uint32_t sendTimeoutMs );
 
+/**
+ * @brief Connects to the server over TCP and prepares a TLS handshake driven by TLS_FreeRTOS_ConnectStep().
+ *
+ * The host name lookup and the TCP connection block with the given timeouts as in
+ * TLS_FreeRTOS_Connect(), the socket then reads without blocking until the handshake completes.
+ *
+ * @param[out] pNetworkContext Pointer to a network context to contain the
+ * initialized socket handle.
+ * @param[in] pHostName The hostname of the remote endpoint, valid until the handshake completes.
+ * @param[in] port The destination port.
+ * @param[in] pNetworkCredentials Credentials for the TLS connection.
+ * @param[in] receiveTimeoutMs Receive socket timeout once connected.
+ * @param[in] sendTimeoutMs Send socket timeout.
+ *
+ * @return #TLS_TRANSPORT_IN_PROGRESS once the handshake can be stepped, else an error status of
+ * TLS_FreeRTOS_Connect(), in which case the socket is closed.
+ */
+TlsTransportStatus_t TLS_FreeRTOS_ConnectStart( NetworkContext_t * pNetworkContext,
+                                                const char * pHostName,
+                                                uint16_t port,
+                                                const NetworkCredentials_t * pNetworkCredentials,
+                                                uint32_t receiveTimeoutMs,
+                                                uint32_t sendTimeoutMs );
+
+/**
+ * @brief Advances the handshake of a connection started by TLS_FreeRTOS_ConnectStart() by one step.
+ *
+ * Each call processes one state of the handshake, such as a key exchange computation, so a
+ * task can interleave the handshakes of several connections with other work.
+ *
+ * @param[in] pNetworkContext The network context passed to TLS_FreeRTOS_ConnectStart().
+ *
+ * @return #TLS_TRANSPORT_IN_PROGRESS if the next step can be taken right away,
+ * #TLS_TRANSPORT_WANT_READ if the next step needs data from the server, to call again once
+ * FreeRTOS_select() reports the socket of the network context readable,
+ * #TLS_TRANSPORT_SUCCESS once the connection is established, or
+ * #TLS_TRANSPORT_HANDSHAKE_FAILED, in which case the socket is closed.
+ */
+TlsTransportStatus_t TLS_FreeRTOS_ConnectStep( NetworkContext_t * pNetworkContext );
+
 /**
  * @brief Gracefully disconnect an established TLS connection.
  *
@@ -201,7 +448,10 @@ int32_t TLS_FreeRTOS_recv( const NetworkContext_t * pNetworkContext,
  * @param[in] pBuffer Buffer containing the bytes to send.
  * @param[in] bytesToSend Number of bytes to send from the buffer.
  *
- * @return Number of bytes (> 0) sent on success;
+ * The bytes may be kept in the transmit buffer until it fills, the next receive, or
+ * TLS_FreeRTOS_flush().
+ *
+ * @return Number of bytes (> 0) sent or buffered on success;
  * 0 if the socket times out without sending any bytes;
  * else a negative value to represent error.
  */
@@ -209,6 +459,48 @@ int32_t TLS_FreeRTOS_send( const NetworkContext_t * pNetworkContext,
                            const void * pBuffer,
                            size_t bytesToSend );
 
+/**
+ * @brief Writes the bytes kept in the transmit buffer over an established TLS connection.
+ *
+ * This is the TLS version of the transport interface's
+ * #TransportFlush_t function.
+ *
+ * @param[in] pNetworkContext The network context.
+ *
+ * @return 0 if the transmit buffer is empty;
+ * the number of bytes still buffered if the socket times out;
+ * else a negative value to represent error.
+ */
+int32_t TLS_FreeRTOS_flush( const NetworkContext_t * pNetworkContext );
+
 void TLS_FreeRTOS_SetRecvTimeout( NetworkContext_t * pNetworkContext, uint32_t timeoutMS );
 
+/**
+ * @brief Sets the callback invoked from the IP task when the underlying socket
+ * receives data.
+ *
+ * @param[in] pNetworkContext The network context of an established connection.
+ * @param[in] callback The socket wake up callback, or NULL to remove it.
+ */
+void TLS_FreeRTOS_SetWakeupCallback( NetworkContext_t * pNetworkContext,
+                                     SocketWakeupCallback_t callback );
+
+/**
+ * @brief Checks if there is received data yet to be read from the TLS connection,
+ * either buffered by the TLS library or in the socket receive stream.
+ *
+ * @param[in] pNetworkContext The network context of an established connection.
+ *
+ * @return pdTRUE if data is available to be read, pdFALSE otherwise.
+ */
+BaseType_t TLS_FreeRTOS_HasPendingData( NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Gets the number of sends that timed out since boot, on any connection,
+ * a sign of a congested link.
+ *
+ * @return The number of timeouts, wrapping around.
+ */
+uint32_t TLS_FreeRTOS_GetSendTimeouts( void );
+
 #endif /* ifndef TLS_FREERTOS_H_ */
@@ -29,6 +29,8 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
 
 #include "freertos_sockets_wrapper.h"
 
@@ -47,9 +49,19 @@
 
 /*-----------------------------------------------------------*/
 
-/* Maximum number of times to call FreeRTOS_recv when initiating a graceful shutdown. */
-#ifndef FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_LOOPS
-    #define FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_LOOPS    ( 3 )
+/* Time given to the server to acknowledge a graceful shutdown before the socket is closed. */
+#ifndef FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_TIMEOUT_MS
+    #define FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_TIMEOUT_MS    ( 2000U )
+#endif
+
+/* Interval at which the sockets shutting down are checked. */
+#ifndef FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_POLL_MS
+    #define FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_POLL_MS    ( 100U )
+#endif
+
+/* Maximum number of sockets shutting down at the same time, others are closed at once. */
+#ifndef FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS
+    #define FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS    ( 4 )
 #endif
 
 /* A negative error code indicating a network failure. */
@@ -57,62 +69,528 @@
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Addresses of a server kept across reconnects, in network byte order.
+ */
+typedef struct EndpointCacheEntry
+{
+    char hostName[ ipconfigDNS_CACHE_NAME_LENGTH ]; /**< Empty when the entry is free. */
+    uint32_t lastGoodAddress;                       /**< Address of the last successful connection. */
+    uint32_t resolvedAddress;                       /**< Address of the last DNS answer. */
+    TickType_t lastUsed;                            /**< Tick count of the last lookup. */
+} EndpointCacheEntry_t;
+
+/* Written by the connecting tasks and by the DNS callback in the IP task. */
+static EndpointCacheEntry_t endpointCache[ socketsconfigENDPOINT_CACHE_ENTRIES ];
+
+/**
+ * @brief Socket waiting for the server to acknowledge its shutdown.
+ */
+typedef struct ShutdownSocket
+{
+    Socket_t tcpSocket;  /**< FREERTOS_INVALID_SOCKET when the slot is free. */
+    TickType_t deadline; /**< Tick count at which the socket is closed anyway. */
+} ShutdownSocket_t;
+
+/* Written by the disconnecting tasks and by the shutdown timer. */
+static ShutdownSocket_t shutdownSockets[ FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS ];
+static TimerHandle_t shutdownTimer = NULL;
+static StaticTimer_t shutdownTimerBuffer;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Finds the cache entry of a server, taking over the least recently used entry
+ * if the server is not cached. Called in a critical section.
+ *
+ * @param[in] pHostName Server hostname.
+ *
+ * @return The entry, or NULL if the name does not fit in an entry.
+ */
+static EndpointCacheEntry_t * endpointCacheLookup( const char * pHostName )
+{
+    EndpointCacheEntry_t * pEntry = NULL;
+    size_t i;
+
+    if( strlen( pHostName ) < sizeof( endpointCache[ 0 ].hostName ) )
+    {
+        for( i = 0; i < socketsconfigENDPOINT_CACHE_ENTRIES; i++ )
+        {
+            if( strcmp( endpointCache[ i ].hostName, pHostName ) == 0 )
+            {
+                pEntry = &endpointCache[ i ];
+                break;
+            }
+
+            if( ( pEntry == NULL ) ||
+                ( ( TickType_t ) ( pEntry->lastUsed - endpointCache[ i ].lastUsed ) < ( portMAX_DELAY / 2U ) ) )
+            {
+                pEntry = &endpointCache[ i ];
+            }
+        }
+
+        if( strcmp( pEntry->hostName, pHostName ) != 0 )
+        {
+            ( void ) strcpy( pEntry->hostName, pHostName );
+            pEntry->lastGoodAddress = 0U;
+            pEntry->resolvedAddress = 0U;
+        }
+
+        pEntry->lastUsed = xTaskGetTickCount();
+    }
+
+    return pEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Stores the answer of a background DNS request, called from the IP task.
+ *
+ * @param[in] pcName The name that was looked up.
+ * @param[in] pvSearchID The cache entry of the server.
+ * @param[in] ulIPAddress The address found, 0 if the request timed out.
+ */
+static void endpointDnsCallback( const char * pcName,
+                                 void * pvSearchID,
+                                 uint32_t ulIPAddress )
+{
+    EndpointCacheEntry_t * pEntry = ( EndpointCacheEntry_t * ) pvSearchID;
+
+    taskENTER_CRITICAL();
+    {
+        /* The entry may have been taken over by another server meanwhile. */
+        if( ( ulIPAddress != 0U ) && ( strcmp( pEntry->hostName, pcName ) == 0 ) )
+        {
+            pEntry->resolvedAddress = ulIPAddress;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Starts resolving the name of a cache entry in the background. An answer
+ * already in the DNS cache of FreeRTOS+TCP is stored right away.
+ *
+ * @param[in] pEntry The cache entry of the server.
+ * @param[in] pHostName Server hostname.
+ */
+static void endpointResolve( EndpointCacheEntry_t * pEntry,
+                             const char * pHostName )
+{
+    uint32_t address;
+
+    address = FreeRTOS_gethostbyname_a( pHostName,
+                                        endpointDnsCallback,
+                                        ( void * ) pEntry,
+                                        pdMS_TO_TICKS( socketsconfigASYNC_DNS_TIMEOUT_MS ) );
+
+    if( address != 0U )
+    {
+        endpointDnsCallback( pHostName, ( void * ) pEntry, address );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Adds an address to the list of addresses to connect to, unless it is already listed.
+ *
+ * @param[in,out] pAddresses The list of addresses.
+ * @param[in,out] pAddressCount Number of addresses in the list.
+ * @param[in] maxAddresses Number of addresses the list may hold.
+ * @param[in] address Address to add, 0 is ignored.
+ */
+static void addAddress( uint32_t * pAddresses,
+                        size_t * pAddressCount,
+                        size_t maxAddresses,
+                        uint32_t address )
+{
+    size_t i;
+
+    for( i = 0; ( i < *pAddressCount ) && ( pAddresses[ i ] != address ); i++ )
+    {
+    }
+
+    if( ( address != 0U ) && ( i == *pAddressCount ) && ( *pAddressCount < maxAddresses ) )
+    {
+        pAddresses[ ( *pAddressCount )++ ] = address;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Adds the addresses of a server held in the DNS cache of FreeRTOS+TCP, which
+ * returns the addresses of an entry in turn, without sending a DNS request.
+ *
+ * @param[in] pHostName Server hostname.
+ * @param[in,out] pAddresses The list of addresses.
+ * @param[in,out] pAddressCount Number of addresses in the list.
+ * @param[in] maxAddresses Number of addresses the list may hold.
+ */
+static void addCachedAddresses( const char * pHostName,
+                                uint32_t * pAddresses,
+                                size_t * pAddressCount,
+                                size_t maxAddresses )
+{
+    size_t i;
+
+    for( i = 0; i < socketsconfigCONNECT_ADDRESSES; i++ )
+    {
+        addAddress( pAddresses, pAddressCount, maxAddresses, FreeRTOS_dnslookup( pHostName ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Connects to the first reachable address of a list. A connection is started to the
+ * next address every socketsconfigCONNECT_STAGGER_MS, or as soon as the pending ones failed,
+ * the first to complete is kept and the others are closed.
+ *
+ * @param[out] pTcpSocket The connected socket.
+ * @param[in] pAddresses Server addresses in network byte order, in order of preference.
+ * @param[in] addressCount Number of addresses, at most socketsconfigCONNECT_ADDRESSES.
+ * @param[in] port Server port.
+ * @param[in] pWinProperties Buffer and window sizes of the sockets, or NULL for the
+ * FreeRTOS+TCP defaults.
+ * @param[out] pConnectedAddress The address of the connected socket.
+ *
+ * @return 0 on success, else a negative value.
+ */
+static BaseType_t connectToAddresses( Socket_t * pTcpSocket,
+                                      const uint32_t * pAddresses,
+                                      size_t addressCount,
+                                      uint16_t port,
+                                      const WinProperties_t * pWinProperties,
+                                      uint32_t * pConnectedAddress )
+{
+    Socket_t sockets[ socketsconfigCONNECT_ADDRESSES ];
+    Socket_t tcpSocket = FREERTOS_INVALID_SOCKET;
+    SocketSet_t socketSet;
+    struct freertos_sockaddr serverAddress = { 0 };
+    const TickType_t noBlockTime = 0;
+    TickType_t now;
+    TickType_t nextStart;
+    TickType_t deadline;
+    TickType_t waitTicks;
+    size_t started = 0;
+    size_t pending = 0;
+    size_t i;
+    BaseType_t result;
+
+    configASSERT( addressCount <= socketsconfigCONNECT_ADDRESSES );
+
+    socketSet = FreeRTOS_CreateSocketSet();
+
+    if( socketSet == NULL )
+    {
+        LogError( ( "Failed to create socket set." ) );
+        return FREERTOS_SOCKETS_WRAPPER_NETWORK_ERROR;
+    }
+
+    serverAddress.sin_family = FREERTOS_AF_INET;
+    serverAddress.sin_port = FreeRTOS_htons( port );
+    serverAddress.sin_len = ( uint8_t ) sizeof( serverAddress );
+
+    nextStart = xTaskGetTickCount();
+    deadline = nextStart + pdMS_TO_TICKS( socketsconfigCONNECT_TIMEOUT_MS +
+                                          ( socketsconfigCONNECT_STAGGER_MS * ( addressCount - 1U ) ) );
+
+    while( ( tcpSocket == FREERTOS_INVALID_SOCKET ) && ( ( started < addressCount ) || ( pending > 0U ) ) )
+    {
+        now = xTaskGetTickCount();
+
+        if( ( TickType_t ) ( now - deadline ) < ( portMAX_DELAY / 2U ) )
+        {
+            LogError( ( "Timed out connecting to %u address(es).", ( unsigned ) started ) );
+            break;
+        }
+
+        if( ( started < addressCount ) &&
+            ( ( pending == 0U ) || ( ( TickType_t ) ( now - nextStart ) < ( portMAX_DELAY / 2U ) ) ) )
+        {
+            /* Start the connection without blocking, completion is reported by select. */
+            sockets[ started ] = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP );
+
+            if( sockets[ started ] == FREERTOS_INVALID_SOCKET )
+            {
+                LogError( ( "Failed to create new socket." ) );
+            }
+            else
+            {
+                ( void ) FreeRTOS_setsockopt( sockets[ started ], 0, FREERTOS_SO_RCVTIMEO, &noBlockTime, sizeof( TickType_t ) );
+
+                /* The stream buffers are allocated on connection, so the sizes must be set before. */
+                if( ( pWinProperties != NULL ) &&
+                    ( FreeRTOS_setsockopt( sockets[ started ], 0, FREERTOS_SO_WIN_PROPERTIES,
+                                           pWinProperties, sizeof( WinProperties_t ) ) != 0 ) )
+                {
+                    LogWarn( ( "Failed to set the socket window properties, using the defaults." ) );
+                }
+
+                serverAddress.sin_addr = pAddresses[ started ];
+                result = FreeRTOS_connect( sockets[ started ], &serverAddress, sizeof( serverAddress ) );
+
+                if( ( result == 0 ) || ( result == -pdFREERTOS_ERRNO_EWOULDBLOCK ) || ( result == -pdFREERTOS_ERRNO_EINPROGRESS ) )
+                {
+                    FreeRTOS_FD_SET( sockets[ started ], socketSet, eSELECT_WRITE | eSELECT_EXCEPT );
+                    pending++;
+                }
+                else
+                {
+                    LogWarn( ( "FreeRTOS_connect failed: ReturnCode=%d.", ( int ) result ) );
+                    ( void ) FreeRTOS_closesocket( sockets[ started ] );
+                    sockets[ started ] = FREERTOS_INVALID_SOCKET;
+                }
+            }
+
+            started++;
+            nextStart = now + pdMS_TO_TICKS( socketsconfigCONNECT_STAGGER_MS );
+        }
+
+        if( pending > 0U )
+        {
+            waitTicks = deadline - now;
+
+            if( ( started < addressCount ) && ( ( TickType_t ) ( nextStart - now ) < waitTicks ) )
+            {
+                waitTicks = nextStart - now;
+            }
+
+            ( void ) FreeRTOS_select( socketSet, waitTicks );
+
+            for( i = 0; ( i < started ) && ( tcpSocket == FREERTOS_INVALID_SOCKET ); i++ )
+            {
+                if( sockets[ i ] == FREERTOS_INVALID_SOCKET )
+                {
+                    continue;
+                }
+
+                if( FreeRTOS_issocketconnected( sockets[ i ] ) == pdTRUE )
+                {
+                    tcpSocket = sockets[ i ];
+                    *pConnectedAddress = pAddresses[ i ];
+                }
+                else if( ( FreeRTOS_FD_ISSET( sockets[ i ], socketSet ) & eSELECT_EXCEPT ) != 0 )
+                {
+                    LogWarn( ( "Connection to address %u of %u failed.", ( unsigned ) ( i + 1U ), ( unsigned ) addressCount ) );
+                }
+                else
+                {
+                    continue;
+                }
+
+                FreeRTOS_FD_CLR( sockets[ i ], socketSet, eSELECT_ALL );
+
+                if( tcpSocket == FREERTOS_INVALID_SOCKET )
+                {
+                    ( void ) FreeRTOS_closesocket( sockets[ i ] );
+                }
+
+                sockets[ i ] = FREERTOS_INVALID_SOCKET;
+                pending--;
+            }
+        }
+    }
+
+    /* Close the connections still pending. */
+    for( i = 0; i < started; i++ )
+    {
+        if( sockets[ i ] != FREERTOS_INVALID_SOCKET )
+        {
+            FreeRTOS_FD_CLR( sockets[ i ], socketSet, eSELECT_ALL );
+            ( void ) FreeRTOS_closesocket( sockets[ i ] );
+        }
+    }
+
+    FreeRTOS_DeleteSocketSet( socketSet );
+
+    *pTcpSocket = tcpSocket;
+
+    return ( tcpSocket != FREERTOS_INVALID_SOCKET ) ? 0 : FREERTOS_SOCKETS_WRAPPER_NETWORK_ERROR;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Get the buffer and window sizes of a socket profile.
+ *
+ * @param[in] profile The socket profile.
+ * @param[out] pWinProperties The sizes to apply to the socket.
+ *
+ * @return pdTRUE if the profile has its own sizes, pdFALSE for the FreeRTOS+TCP defaults.
+ */
+static BaseType_t getWinProperties( SocketsProfile_t profile,
+                                    WinProperties_t * pWinProperties )
+{
+    BaseType_t hasProperties = pdTRUE;
+
+    switch( profile )
+    {
+        case SOCKETS_PROFILE_LEAN:
+            pWinProperties->lRxWinSize = socketsconfigLEAN_RX_SEGMENTS;
+            pWinProperties->lTxWinSize = socketsconfigLEAN_TX_SEGMENTS;
+            break;
+
+        case SOCKETS_PROFILE_BULK:
+            pWinProperties->lRxWinSize = socketsconfigBULK_RX_SEGMENTS;
+            pWinProperties->lTxWinSize = socketsconfigBULK_TX_SEGMENTS;
+            break;
+
+        default:
+            hasProperties = pdFALSE;
+            break;
+    }
+
+    /* The windows are in segments, the buffers hold exactly one window. */
+    pWinProperties->lRxBufSize = pWinProperties->lRxWinSize * ( int32_t ) ipconfigTCP_MSS;
+    pWinProperties->lTxBufSize = pWinProperties->lTxWinSize * ( int32_t ) ipconfigTCP_MSS;
+
+    return hasProperties;
+}
+
+/*-----------------------------------------------------------*/
+
 BaseType_t Sockets_Connect( Socket_t * pTcpSocket,
                             const char * pHostName,
                             uint16_t port,
                             uint32_t receiveTimeoutMs,
                             uint32_t sendTimeoutMs )
+{
+    return Sockets_ConnectWithProfile( pTcpSocket,
+                                       pHostName,
+                                       port,
+                                       receiveTimeoutMs,
+                                       sendTimeoutMs,
+                                       SOCKETS_PROFILE_DEFAULT );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Sockets_ConnectWithProfile( Socket_t * pTcpSocket,
+                                       const char * pHostName,
+                                       uint16_t port,
+                                       uint32_t receiveTimeoutMs,
+                                       uint32_t sendTimeoutMs,
+                                       SocketsProfile_t profile )
 {
     Socket_t tcpSocket = FREERTOS_INVALID_SOCKET;
-    BaseType_t socketStatus = 0;
-    struct freertos_sockaddr serverAddress = { 0 };
+    BaseType_t socketStatus = FREERTOS_SOCKETS_WRAPPER_NETWORK_ERROR;
+    EndpointCacheEntry_t * pEntry;
+    uint32_t addresses[ 2 * socketsconfigCONNECT_ADDRESSES ];
+    size_t addressCount = 0;
+    size_t triedCount = 0;
+    uint32_t lastGoodAddress = 0U;
+    uint32_t resolvedAddress = 0U;
+    uint32_t address = 0U;
     TickType_t transportTimeout = 0;
+    WinProperties_t winProperties = { 0 };
+    const WinProperties_t * pWinProperties = NULL;
 
-    /* Create a new TCP socket. */
-    tcpSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP );
-
-    if( tcpSocket == FREERTOS_INVALID_SOCKET )
+    if( getWinProperties( profile, &winProperties ) == pdTRUE )
     {
-        LogError( ( "Failed to create new socket." ) );
-        socketStatus = FREERTOS_SOCKETS_WRAPPER_NETWORK_ERROR;
+        pWinProperties = &winProperties;
     }
-    else
-    {
-        LogDebug( ( "Created new TCP socket." ) );
 
-        /* Connection parameters. */
-        serverAddress.sin_family = FREERTOS_AF_INET;
-        serverAddress.sin_port = FreeRTOS_htons( port );
-        serverAddress.sin_addr = ( uint32_t ) FreeRTOS_gethostbyname( pHostName );
-        serverAddress.sin_len = ( uint8_t ) sizeof( serverAddress );
+    taskENTER_CRITICAL();
+    {
+        pEntry = endpointCacheLookup( pHostName );
 
-        /* Check for errors from DNS lookup. */
-        if( serverAddress.sin_addr == 0U )
+        if( pEntry != NULL )
         {
-            LogError( ( "Failed to connect to server: DNS resolution failed: Hostname=%s.",
-                        pHostName ) );
-            socketStatus = FREERTOS_SOCKETS_WRAPPER_NETWORK_ERROR;
+            lastGoodAddress = pEntry->lastGoodAddress;
+            resolvedAddress = pEntry->resolvedAddress;
         }
     }
+    taskEXIT_CRITICAL();
 
-    if( socketStatus == 0 )
+    LogDebug( ( "Creating TCP Connection to %s.", pHostName ) );
+
+    if( lastGoodAddress != 0U )
+    {
+        /* Refresh the addresses while trying the one that worked last time. */
+        endpointResolve( pEntry, pHostName );
+    }
+
+    addAddress( addresses, &addressCount, socketsconfigCONNECT_ADDRESSES, lastGoodAddress );
+    addAddress( addresses, &addressCount, socketsconfigCONNECT_ADDRESSES, resolvedAddress );
+    addCachedAddresses( pHostName, addresses, &addressCount, socketsconfigCONNECT_ADDRESSES );
+
+    if( addressCount > 0U )
     {
-        /* Establish connection. */
-        LogDebug( ( "Creating TCP Connection to %s.", pHostName ) );
-        socketStatus = FreeRTOS_connect( tcpSocket, &serverAddress, sizeof( serverAddress ) );
+        socketStatus = connectToAddresses( &tcpSocket, addresses, addressCount, port, pWinProperties, &address );
+        triedCount = addressCount;
+    }
+
+    if( socketStatus != 0 )
+    {
+        if( triedCount > 0U )
+        {
+            LogWarn( ( "Known addresses of %s failed, trying the addresses from DNS.", pHostName ) );
+        }
+
+        if( pEntry != NULL )
+        {
+            taskENTER_CRITICAL();
+            {
+                resolvedAddress = pEntry->resolvedAddress;
+            }
+            taskEXIT_CRITICAL();
+        }
+
+        addAddress( addresses, &addressCount, triedCount + socketsconfigCONNECT_ADDRESSES, resolvedAddress );
+
+        /* Without a fresh answer yet, wait for DNS as before. */
+        if( addressCount == triedCount )
+        {
+            addAddress( addresses, &addressCount, triedCount + socketsconfigCONNECT_ADDRESSES,
+                        ( uint32_t ) FreeRTOS_gethostbyname( pHostName ) );
+        }
+
+        addCachedAddresses( pHostName, addresses, &addressCount, triedCount + socketsconfigCONNECT_ADDRESSES );
 
-        if( socketStatus != 0 )
+        if( addressCount == triedCount )
         {
-            LogError( ( "Failed to connect to server: FreeRTOS_Connect failed: ReturnCode=%d,"
-                        " Hostname=%s, Port=%u.",
-                        socketStatus,
+            LogError( ( "Failed to connect to server: no %saddress found by DNS: Hostname=%s, Port=%u.",
+                        ( triedCount > 0U ) ? "other " : "",
                         pHostName,
                         port ) );
         }
+        else
+        {
+            socketStatus = connectToAddresses( &tcpSocket, &addresses[ triedCount ], addressCount - triedCount, port,
+                                               pWinProperties, &address );
+
+            if( socketStatus != 0 )
+            {
+                LogError( ( "Failed to connect to server: FreeRTOS_Connect failed: ReturnCode=%d,"
+                            " Hostname=%s, Port=%u.",
+                            socketStatus,
+                            pHostName,
+                            port ) );
+            }
+        }
     }
 
     if( socketStatus == 0 )
     {
+        if( pEntry != NULL )
+        {
+            taskENTER_CRITICAL();
+            {
+                /* Unless the entry was taken over by another server meanwhile. */
+                if( strcmp( pEntry->hostName, pHostName ) == 0 )
+                {
+                    pEntry->lastGoodAddress = address;
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+
         /* Set socket receive timeout. */
         transportTimeout = pdMS_TO_TICKS( receiveTimeoutMs );
         /* Setting the receive block time cannot fail. */
@@ -130,65 +608,169 @@ BaseType_t Sockets_Connect( Socket_t * pTcpSocket,
                                       FREERTOS_SO_SNDTIMEO,
                                       &transportTimeout,
                                       sizeof( TickType_t ) );
+
+        /* Set the socket. */
+        *pTcpSocket = tcpSocket;
+        LogInfo( ( "Established TCP connection with %s.", pHostName ) );
     }
 
-    /* Clean up on failure. */
-    if( socketStatus != 0 )
+    return socketStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void Sockets_ResolveAsync( const char * pHostName )
+{
+    EndpointCacheEntry_t * pEntry;
+
+    taskENTER_CRITICAL();
+    {
+        pEntry = endpointCacheLookup( pHostName );
+    }
+    taskEXIT_CRITICAL();
+
+    if( pEntry != NULL )
+    {
+        endpointResolve( pEntry, pHostName );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Closes the sockets whose shutdown completed or timed out, stopping the timer
+ * once none is left. Runs in the timer task.
+ *
+ * @param[in] timer The shutdown timer.
+ */
+static void shutdownTimerCallback( TimerHandle_t timer )
+{
+    Socket_t closeSockets[ FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS ];
+    uint8_t pDummyBuffer[ 2 ];
+    TickType_t now = xTaskGetTickCount();
+    size_t closeCount = 0;
+    size_t activeCount = 0;
+    size_t i;
+
+    for( i = 0; i < FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS; i++ )
     {
-        if( tcpSocket != FREERTOS_INVALID_SOCKET )
+        Socket_t tcpSocket;
+        TickType_t deadline;
+
+        taskENTER_CRITICAL();
+        {
+            tcpSocket = shutdownSockets[ i ].tcpSocket;
+            deadline = shutdownSockets[ i ].deadline;
+        }
+        taskEXIT_CRITICAL();
+
+        if( tcpSocket == FREERTOS_INVALID_SOCKET )
+        {
+            continue;
+        }
+
+        /* The socket does not block, FreeRTOS_recv() returns an error once the
+         * server has acknowledged the shutdown. */
+        if( ( FreeRTOS_recv( tcpSocket, pDummyBuffer, sizeof( pDummyBuffer ), 0 ) < 0 ) ||
+            ( ( TickType_t ) ( now - deadline ) < ( portMAX_DELAY / 2U ) ) )
+        {
+            taskENTER_CRITICAL();
+            {
+                shutdownSockets[ i ].tcpSocket = FREERTOS_INVALID_SOCKET;
+            }
+            taskEXIT_CRITICAL();
+
+            closeSockets[ closeCount++ ] = tcpSocket;
+        }
+        else
         {
-            ( void ) FreeRTOS_closesocket( tcpSocket );
+            activeCount++;
         }
     }
-    else
+
+    for( i = 0; i < closeCount; i++ )
     {
-        /* Set the socket. */
-        *pTcpSocket = tcpSocket;
-        LogInfo( ( "Established TCP connection with %s.", pHostName ) );
+        ( void ) FreeRTOS_closesocket( closeSockets[ i ] );
     }
 
-    return socketStatus;
+    if( activeCount == 0U )
+    {
+        /* Sockets_Disconnect() restarts the timer for the next socket. */
+        ( void ) xTimerStop( timer, 0 );
+    }
 }
 
 /*-----------------------------------------------------------*/
 
 void Sockets_Disconnect( Socket_t tcpSocket )
 {
-    BaseType_t waitForShutdownLoopCount = 0;
-    uint8_t pDummyBuffer[ 2 ];
+    const TickType_t noBlockTime = 0;
+    BaseType_t queued = pdFALSE;
+    size_t i;
 
     if( tcpSocket != FREERTOS_INVALID_SOCKET )
     {
         /* Initiate graceful shutdown. */
         ( void ) FreeRTOS_shutdown( tcpSocket, FREERTOS_SHUT_RDWR );
+        ( void ) FreeRTOS_setsockopt( tcpSocket, 0, FREERTOS_SO_RCVTIMEO, &noBlockTime, sizeof( TickType_t ) );
 
-        /* Wait for the socket to disconnect gracefully (indicated by FreeRTOS_recv()
-         * returning a FREERTOS_EINVAL error) before closing the socket. */
-        while( FreeRTOS_recv( tcpSocket, pDummyBuffer, sizeof( pDummyBuffer ), 0 ) >= 0 )
+        /* Wait for the server to acknowledge the shutdown in the timer task rather than
+         * blocking the caller for up to a receive timeout per attempt. */
+        taskENTER_CRITICAL();
         {
-            /* We don't need to delay since FreeRTOS_recv should already have a timeout. */
+            if( shutdownTimer == NULL )
+            {
+                for( i = 0; i < FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS; i++ )
+                {
+                    shutdownSockets[ i ].tcpSocket = FREERTOS_INVALID_SOCKET;
+                }
+
+                shutdownTimer = xTimerCreateStatic( "SockShutdown",
+                                                    pdMS_TO_TICKS( FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_POLL_MS ),
+                                                    pdTRUE,
+                                                    NULL,
+                                                    shutdownTimerCallback,
+                                                    &shutdownTimerBuffer );
+            }
 
-            if( ++waitForShutdownLoopCount >= FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_LOOPS )
+            for( i = 0; ( i < FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_SOCKETS ) && ( queued == pdFALSE ); i++ )
             {
-                break;
+                if( shutdownSockets[ i ].tcpSocket == FREERTOS_INVALID_SOCKET )
+                {
+                    shutdownSockets[ i ].tcpSocket = tcpSocket;
+                    shutdownSockets[ i ].deadline = xTaskGetTickCount() +
+                                                    pdMS_TO_TICKS( FREERTOS_SOCKETS_WRAPPER_SHUTDOWN_TIMEOUT_MS );
+                    queued = pdTRUE;
+                }
             }
         }
+        taskEXIT_CRITICAL();
 
-        ( void ) FreeRTOS_closesocket( tcpSocket );
+        if( ( queued == pdFALSE ) || ( xTimerStart( shutdownTimer, 0 ) != pdPASS ) )
+        {
+            if( queued == pdTRUE )
+            {
+                /* Left in its slot, the socket is closed by a later run of the timer. */
+                LogWarn( ( "Failed to start the socket shutdown timer." ) );
+            }
+            else
+            {
+                LogWarn( ( "Too many sockets shutting down, closing the socket at once." ) );
+                ( void ) FreeRTOS_closesocket( tcpSocket );
+            }
+        }
     }
 }
 
-void Sockets_SetReceiveTimeout( Socket_t tcpSocket, uint32_t timeoutMS )
-{
-	 TickType_t timeoutTicks = pdMS_TO_TICKS( timeoutMS );
-
-	 /* Setting the receive block time cannot fail. */
-	  ( void ) FreeRTOS_setsockopt( tcpSocket,
-	                                 0,
-	                                 FREERTOS_SO_RCVTIMEO,
-	                                 &timeoutTicks,
-	                                 sizeof( TickType_t ) );
+/*-----------------------------------------------------------*/
 
+void Sockets_SetWakeupCallback( Socket_t tcpSocket,
+                                SocketWakeupCallback_t callback )
+{
+    /* Setting the wake up callback cannot fail for a valid TCP socket. */
+    ( void ) FreeRTOS_setsockopt( tcpSocket,
+                                  0,
+                                  FREERTOS_SO_WAKEUP_CALLBACK,
+                                  ( void * ) callback,
+                                  sizeof( callback ) );
 }
-
-/*-----------------------------------------------------------*/
@@ -46,6 +46,16 @@
 
 /*-----------------------------------------------------------*/
 
+#if ( MBEDTLS_ERROR_COMPACT == 1 )
+
+/**
+ * @brief Format of an mbedTLS error in the logs: the negated code, of which
+ * tools/mbedtls_error_decode.py gives the high-level and low-level strings.
+ */
+    #define mbedtlsERROR_FORMAT                "-0x%04x"
+    #define mbedtlsErrorArgs( mbedTlsCode )    ( unsigned int ) ( -( mbedTlsCode ) )
+#else
+
 /**
  * @brief Represents string to be logged when mbedTLS returned error
  * does not contain a high-level code.
@@ -62,7 +72,7 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Code>";
  * @brief Utility for converting the high-level code in an mbedTLS error to string,
  * if the code-contains a high-level code; otherwise, using a default string.
  */
-#define mbedtlsHighLevelCodeOrDefault( mbedTlsCode )        \
+    #define mbedtlsHighLevelCodeOrDefault( mbedTlsCode )        \
     ( mbedtls_strerror_highlevel( mbedTlsCode ) != NULL ) ? \
     mbedtls_strerror_highlevel( mbedTlsCode ) : pNoHighLevelMbedTlsCodeStr
 
@@ -70,10 +80,18 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Code>";
  * @brief Utility for converting the level-level code in an mbedTLS error to string,
  * if the code-contains a level-level code; otherwise, using a default string.
  */
-#define mbedtlsLowLevelCodeOrDefault( mbedTlsCode )        \
+    #define mbedtlsLowLevelCodeOrDefault( mbedTlsCode )        \
     ( mbedtls_strerror_lowlevel( mbedTlsCode ) != NULL ) ? \
     mbedtls_strerror_lowlevel( mbedTlsCode ) : pNoLowLevelMbedTlsCodeStr
 
+/**
+ * @brief Format of an mbedTLS error in the logs: its high-level and low-level strings.
+ */
+    #define mbedtlsERROR_FORMAT    "%s : %s"
+    #define mbedtlsErrorArgs( mbedTlsCode ) \
+    mbedtlsHighLevelCodeOrDefault( mbedTlsCode ), mbedtlsLowLevelCodeOrDefault( mbedTlsCode )
+#endif /* MBEDTLS_ERROR_COMPACT == 1 */
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -241,9 +259,8 @@ static int32_t setRootCa( SSLContext_t * pSslContext,
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to parse server root CA certificate: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to parse server root CA certificate: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
     }
     else
     {
@@ -272,9 +289,8 @@ static int32_t setClientCertificate( SSLContext_t * pSslContext,
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to parse the client certificate: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to parse the client certificate: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
     }
 
     return mbedtlsError;
@@ -299,9 +315,8 @@ static int32_t setPrivateKey( SSLContext_t * pSslContext,
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to parse the client key: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to parse the client key: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
     }
 
     return mbedtlsError;
@@ -383,9 +398,8 @@ static void setOptionalConfigurations( SSLContext_t * pSslContext,
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to configure ALPN protocol in mbed TLS: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to configure ALPN protocol in mbed TLS: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
         }
     }
 
@@ -397,9 +411,8 @@ static void setOptionalConfigurations( SSLContext_t * pSslContext,
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to set server name: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to set server name: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
         }
     }
 }
@@ -427,9 +440,8 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to set default SSL configuration: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to set default SSL configuration: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
 
         /* Per mbed TLS docs, mbedtls_ssl_config_defaults only fails on memory allocation. */
         returnStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
@@ -472,9 +484,8 @@ static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pNetworkContext,
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to set up mbed TLS SSL context: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to set up mbed TLS SSL context: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
 
         returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
     }
@@ -505,9 +516,8 @@ static TlsTransportStatus_t tlsHandshake( NetworkContext_t * pNetworkContext,
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to perform TLS handshake: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to perform TLS handshake: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
 
             returnStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
         }
@@ -547,9 +557,8 @@ static TlsTransportStatus_t initMbedtls( mbedtls_entropy_context * pEntropyConte
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to add entropy source: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to add entropy source: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
         returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
     }
 
@@ -564,9 +573,8 @@ static TlsTransportStatus_t initMbedtls( mbedtls_entropy_context * pEntropyConte
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to seed PRNG: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to seed PRNG: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
             returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
         }
     }
@@ -688,10 +696,9 @@ void TLS_FreeRTOS_Disconnect( NetworkContext_t * pNetworkContext )
         }
         else
         {
-            LogError( ( "(Network connection %p) Failed to send TLS close-notify: mbedTLSError= %s : %s.",
+            LogError( ( "(Network connection %p) Failed to send TLS close-notify: mbedTLSError= " mbedtlsERROR_FORMAT ".",
                         pNetworkContext,
-                        mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                        mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+                        mbedtlsErrorArgs( tlsStatus ) ) );
         }
     }
     else
@@ -729,9 +736,8 @@ int32_t TLS_FreeRTOS_recv( NetworkContext_t * pNetworkContext,
         ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
     {
         LogDebug( ( "Failed to read data. However, a read can be retried on this error. "
-                    "mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+                    "mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
 
         /* Mark these set of errors as a timeout. The libraries may retry read
          * on these errors. */
@@ -739,9 +745,8 @@ int32_t TLS_FreeRTOS_recv( NetworkContext_t * pNetworkContext,
     }
     else if( tlsStatus < 0 )
     {
-        LogError( ( "Failed to read data: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+        LogError( ( "Failed to read data: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
     }
     else
     {
@@ -767,9 +772,8 @@ int32_t TLS_FreeRTOS_send( NetworkContext_t * pNetworkContext,
         ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
     {
         LogDebug( ( "Failed to send data. However, send can be retried on this error. "
-                    "mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+                    "mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
 
         /* Mark these set of errors as a timeout. The libraries may retry send
          * on these errors. */
@@ -777,9 +781,8 @@ int32_t TLS_FreeRTOS_send( NetworkContext_t * pNetworkContext,
     }
     else if( tlsStatus < 0 )
     {
-        LogError( ( "Failed to send data:  mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+        LogError( ( "Failed to send data:  mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
     }
     else
     {
@@ -0,0 +1,1098 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file tls_freertos_common.c
+ * @brief Parts of the TLS transport interface that do not depend on the TLS library: the
+ * connection, the transmit buffer, the PKCS #11 client key and the caches. The TLS library
+ * is called through the TlsBackend_ functions of tls_freertos_common.h.
+ */
+
+#include "logging_levels.h"
+
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME    "TLS_COMMON"
+#endif
+
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_DEBUG
+#endif
+
+#include "logging_stack.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/* FreeRTOS+TCP includes. */
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+
+/* TLS transport header. */
+#include "tls_freertos_common.h"
+
+/* FreeRTOS Socket wrapper include. */
+#include "freertos_sockets_wrapper.h"
+
+/* PKCS #11 includes. */
+#include "core_pki_utils.h"
+#include "pkcs11_session_pool.h"
+#include "core_pkcs11_pal.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of sends that timed out on any connection, see TLS_FreeRTOS_GetSendTimeouts().
+ */
+static volatile uint32_t sendTimeouts = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Connects to the server over TCP and sets up TLS for the handshake, closing
+ * the socket on failure.
+ *
+ * @param[out] pNetworkContext Network context.
+ * @param[in] pHostName The hostname of the remote endpoint.
+ * @param[in] port The destination port.
+ * @param[in] pNetworkCredentials Credentials for the TLS connection.
+ * @param[in] receiveTimeoutMs Receive socket timeout.
+ * @param[in] sendTimeoutMs Send socket timeout.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS or an error status of TLS_FreeRTOS_Connect().
+ */
+static TlsTransportStatus_t tlsConnectAndSetup( NetworkContext_t * pNetworkContext,
+                                                const char * pHostName,
+                                                uint16_t port,
+                                                const NetworkCredentials_t * pNetworkCredentials,
+                                                uint32_t receiveTimeoutMs,
+                                                uint32_t sendTimeoutMs );
+
+/**
+ * @brief Encodes the raw P-256 signature found at pucSig[ tlsECDSA_RAW_SIGNATURE_OFFSET ]
+ * as the ASN.1 DER sequence of R and S, at the start of pucSig.
+ *
+ * @param[in,out] pucSig Signature buffer of at least 72 bytes.
+ *
+ * @return Length of the DER signature.
+ */
+static size_t ecdsaRawToDer( unsigned char * pucSig );
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 0 )
+
+/**
+ * @brief Helper for reading the specified certificate object, if present,
+ * out of storage, into RAM, and then into an mbedTLS certificate context
+ * object.
+ *
+ * @param[in] pSslContext Caller TLS context.
+ * @param[in] pcLabelName PKCS #11 certificate object label.
+ * @param[in] xClass PKCS #11 certificate object class.
+ * @param[out] pxCertificateContext Certificate context.
+ *
+ * @return Zero on success.
+ */
+    static CK_RV readCertificateIntoContext( SSLContext_t * pSslContext,
+                                             char * pcLabelName,
+                                             CK_OBJECT_CLASS xClass,
+                                             mbedtls_x509_crt * pxCertificateContext );
+#endif
+
+#if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+
+/**
+ * @brief Writes the transmit buffer of a connection to the TLS library as one record.
+ *
+ * The bytes not sent when the socket times out are moved to the start of the buffer,
+ * so retrying passes the TLS library the same data as mbed TLS requires after a WANT_WRITE.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ *
+ * @return 0 if the buffer is empty, the number of bytes still buffered if the socket
+ * timed out, or a negative error, in which case the buffer is discarded.
+ */
+    static int32_t flushTxBuffer( SSLContext_t * pSslContext );
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Server of a session held by the backend, replayed by session ticket or session ID.
+ */
+    typedef struct SessionCacheEntry
+    {
+        uint32_t ulHostHash; /* 0 when the entry is free. */
+        TickType_t xLastUsed;
+    } SessionCacheEntry_t;
+
+    static SessionCacheEntry_t sessionCache[ tlsconfigSESSION_CACHE_ENTRIES ];
+
+/* Connections are set up from several tasks. */
+    static SemaphoreHandle_t xSessionCacheMutex = NULL;
+    static StaticSemaphore_t xSessionCacheMutexBuffer;
+
+/* FNV-1a hash of a host name, a session offered to another server after a collision is
+ * simply refused by that server. */
+    static uint32_t sessionCacheHash( const char * pHostName )
+    {
+        uint32_t ulHash = 2166136261UL;
+
+        while( *pHostName != '\0' )
+        {
+            ulHash = ( ulHash ^ ( uint8_t ) *pHostName++ ) * 16777619UL;
+        }
+
+        return ( ulHash != 0U ) ? ulHash : 1U;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t sessionCacheLock( void )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( xSessionCacheMutex == NULL )
+            {
+                xSessionCacheMutex = xSemaphoreCreateMutexStatic( &xSessionCacheMutexBuffer );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        return xSemaphoreTake( xSessionCacheMutex, portMAX_DELAY );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void TlsCommon_SessionCacheLoad( SSLContext_t * pSslContext,
+                                     const char * pHostName )
+    {
+        uint32_t ulHostHash = sessionCacheHash( pHostName );
+        size_t i;
+
+        if( sessionCacheLock() == pdTRUE )
+        {
+            for( i = 0; i < tlsconfigSESSION_CACHE_ENTRIES; i++ )
+            {
+                if( sessionCache[ i ].ulHostHash == ulHostHash )
+                {
+                    /* The server falls back to a full handshake if it no longer knows the session. */
+                    TlsBackend_SessionLoad( pSslContext, i );
+                    LogDebug( ( "Offering cached TLS session to %s.", pHostName ) );
+                    break;
+                }
+            }
+
+            ( void ) xSemaphoreGive( xSessionCacheMutex );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void TlsCommon_SessionCacheStore( SSLContext_t * pSslContext,
+                                      const char * pHostName,
+                                      BaseType_t xHandshakeDone )
+    {
+        uint32_t ulHostHash = sessionCacheHash( pHostName );
+        SessionCacheEntry_t * pEntry = NULL;
+        size_t xEntry = 0;
+        size_t i;
+
+        if( sessionCacheLock() == pdTRUE )
+        {
+            /* Entry of the server, else a free entry, else the least recently used one. */
+            for( i = 0; i < tlsconfigSESSION_CACHE_ENTRIES; i++ )
+            {
+                if( sessionCache[ i ].ulHostHash == ulHostHash )
+                {
+                    pEntry = &sessionCache[ i ];
+                    xEntry = i;
+                    break;
+                }
+
+                if( ( pEntry == NULL ) ||
+                    ( ( pEntry->ulHostHash != 0U ) &&
+                      ( ( sessionCache[ i ].ulHostHash == 0U ) ||
+                        ( ( TickType_t ) ( pEntry->xLastUsed - sessionCache[ i ].xLastUsed ) < ( portMAX_DELAY / 2U ) ) ) ) )
+                {
+                    pEntry = &sessionCache[ i ];
+                    xEntry = i;
+                }
+            }
+
+            if( ( xHandshakeDone == pdTRUE ) &&
+                ( TlsBackend_SessionSave( pSslContext, xEntry ) == pdTRUE ) )
+            {
+                pEntry->ulHostHash = ulHostHash;
+                pEntry->xLastUsed = xTaskGetTickCount();
+            }
+            else if( pEntry->ulHostHash == ulHostHash )
+            {
+                /* A session that does not resume is not offered again. */
+                TlsBackend_SessionFree( xEntry );
+                pEntry->ulHostHash = 0U;
+            }
+            else if( xHandshakeDone == pdTRUE )
+            {
+                /* The entry replaced was emptied by the save that failed. */
+                pEntry->ulHostHash = 0U;
+            }
+            else
+            {
+                /* Empty else for MISRA 15.7 compliance. */
+            }
+
+            ( void ) xSemaphoreGive( xSessionCacheMutex );
+        }
+    }
+#endif /* if ( tlsconfigSESSION_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+
+/**
+ * @brief Root CA loaded once by the backend, identified by the buffer it was loaded from.
+ */
+    typedef struct RootCaCacheEntry
+    {
+        const unsigned char * pucRootCa; /* May be NULL for the pre-shared key. */
+        size_t xRootCaSize;
+        BaseType_t xUsePsk;
+        BaseType_t xLoaded;
+        UBaseType_t uxUsers;
+        TickType_t xLastUsed;
+    } RootCaCacheEntry_t;
+
+    static RootCaCacheEntry_t rootCaCache[ tlsconfigROOT_CA_CACHE_ENTRIES ];
+
+/* Connections are set up from several tasks, a root CA is loaded once even when they connect together. */
+    static SemaphoreHandle_t xRootCaCacheMutex = NULL;
+    static StaticSemaphore_t xRootCaCacheMutexBuffer;
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t rootCaCacheLock( void )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( xRootCaCacheMutex == NULL )
+            {
+                xRootCaCacheMutex = xSemaphoreCreateMutexStatic( &xRootCaCacheMutexBuffer );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        return xSemaphoreTake( xRootCaCacheMutex, portMAX_DELAY );
+    }
+
+/*-----------------------------------------------------------*/
+
+    int32_t TlsCommon_RootCaCacheAcquire( SSLContext_t * pSslContext,
+                                          const NetworkCredentials_t * pNetworkCredentials,
+                                          BaseType_t usePsk )
+    {
+        RootCaCacheEntry_t * pEntry = NULL;
+        size_t xEntry = tlsROOT_CA_CACHE_NONE;
+        int32_t lError = 0;
+        size_t i;
+
+        pSslContext->rootCaEntry = tlsROOT_CA_CACHE_NONE;
+
+        if( rootCaCacheLock() == pdTRUE )
+        {
+            /* Entry of the buffer, else a free entry, else the least recently used one no
+             * connection uses. */
+            for( i = 0; i < tlsconfigROOT_CA_CACHE_ENTRIES; i++ )
+            {
+                if( ( rootCaCache[ i ].xLoaded == pdTRUE ) &&
+                    ( rootCaCache[ i ].pucRootCa == pNetworkCredentials->pRootCa ) &&
+                    ( rootCaCache[ i ].xRootCaSize == pNetworkCredentials->rootCaSize ) &&
+                    ( rootCaCache[ i ].xUsePsk == usePsk ) )
+                {
+                    pEntry = &rootCaCache[ i ];
+                    xEntry = i;
+                    break;
+                }
+
+                if( ( rootCaCache[ i ].uxUsers == 0U ) &&
+                    ( ( pEntry == NULL ) ||
+                      ( ( pEntry->xLoaded == pdTRUE ) &&
+                        ( ( rootCaCache[ i ].xLoaded == pdFALSE ) ||
+                          ( ( TickType_t ) ( pEntry->xLastUsed - rootCaCache[ i ].xLastUsed ) < ( portMAX_DELAY / 2U ) ) ) ) ) )
+                {
+                    pEntry = &rootCaCache[ i ];
+                    xEntry = i;
+                }
+            }
+
+            if( ( pEntry != NULL ) &&
+                ( ( pEntry->xLoaded == pdFALSE ) ||
+                  ( pEntry->pucRootCa != pNetworkCredentials->pRootCa ) ||
+                  ( pEntry->xRootCaSize != pNetworkCredentials->rootCaSize ) ||
+                  ( pEntry->xUsePsk != usePsk ) ) )
+            {
+                pEntry->xLoaded = pdFALSE;
+
+                lError = TlsBackend_RootCaLoad( pSslContext, pNetworkCredentials, usePsk, xEntry );
+
+                if( lError == 0 )
+                {
+                    pEntry->pucRootCa = pNetworkCredentials->pRootCa;
+                    pEntry->xRootCaSize = pNetworkCredentials->rootCaSize;
+                    pEntry->xUsePsk = usePsk;
+                    pEntry->xLoaded = pdTRUE;
+                    LogDebug( ( "Loaded root CA %p into the root CA cache.", pNetworkCredentials->pRootCa ) );
+                }
+                else
+                {
+                    pEntry = NULL;
+                }
+            }
+
+            if( pEntry != NULL )
+            {
+                pEntry->uxUsers++;
+                pEntry->xLastUsed = xTaskGetTickCount();
+                pSslContext->rootCaEntry = xEntry;
+            }
+
+            ( void ) xSemaphoreGive( xRootCaCacheMutex );
+        }
+
+        return lError;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void TlsCommon_RootCaCacheRelease( SSLContext_t * pSslContext )
+    {
+        if( ( pSslContext->rootCaEntry != tlsROOT_CA_CACHE_NONE ) && ( rootCaCacheLock() == pdTRUE ) )
+        {
+            configASSERT( rootCaCache[ pSslContext->rootCaEntry ].uxUsers > 0U );
+            rootCaCache[ pSslContext->rootCaEntry ].uxUsers--;
+            pSslContext->rootCaEntry = tlsROOT_CA_CACHE_NONE;
+
+            ( void ) xSemaphoreGive( xRootCaCacheMutex );
+        }
+    }
+#endif /* if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+void TlsCommon_ContextInit( SSLContext_t * pSslContext )
+{
+    configASSERT( pSslContext != NULL );
+
+    #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+        pSslContext->rootCaEntry = tlsROOT_CA_CACHE_NONE;
+    #endif
+
+    #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+        pSslContext->txLength = 0;
+    #endif
+
+    /* PKCS #11 sessions are leased from the pool for each operation. */
+    C_GetFunctionList( &( pSslContext->pxP11FunctionList ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void TlsCommon_CountSendTimeout( void )
+{
+    sendTimeouts++;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 0 )
+
+    static CK_RV readCertificateIntoContext( SSLContext_t * pSslContext,
+                                             char * pcLabelName,
+                                             CK_OBJECT_CLASS xClass,
+                                             mbedtls_x509_crt * pxCertificateContext )
+    {
+        CK_RV xResult = CKR_OK;
+        CK_ATTRIBUTE xTemplate = { 0 };
+        CK_OBJECT_HANDLE xCertObj = 0;
+        Pkcs11Lease_t xLease;
+
+        xResult = xPkcs11PoolAcquire( &xLease, portMAX_DELAY );
+
+        if( CKR_OK != xResult )
+        {
+            return xResult;
+        }
+
+        /* Get the handle of the certificate. */
+        xResult = xFindObjectWithLabelAndClass( xLease.xSession,
+                                                pcLabelName,
+                                                xClass,
+                                                &xCertObj );
+
+        if( ( CKR_OK == xResult ) && ( xCertObj == CK_INVALID_HANDLE ) )
+        {
+            xResult = CKR_OBJECT_HANDLE_INVALID;
+        }
+
+        /* Query the certificate size. */
+        if( CKR_OK == xResult )
+        {
+            xTemplate.type = CKA_VALUE;
+            xTemplate.ulValueLen = 0;
+            xTemplate.pValue = NULL;
+            xResult = pSslContext->pxP11FunctionList->C_GetAttributeValue( xLease.xSession,
+                                                                           xCertObj,
+                                                                           &xTemplate,
+                                                                           1 );
+        }
+
+        /* Create a buffer for the certificate. */
+        if( CKR_OK == xResult )
+        {
+            xTemplate.pValue = pvPortMalloc( xTemplate.ulValueLen );
+
+            if( NULL == xTemplate.pValue )
+            {
+                xResult = CKR_HOST_MEMORY;
+            }
+        }
+
+        /* Export the certificate. */
+        if( CKR_OK == xResult )
+        {
+            xResult = pSslContext->pxP11FunctionList->C_GetAttributeValue( xLease.xSession,
+                                                                           xCertObj,
+                                                                           &xTemplate,
+                                                                           1 );
+        }
+
+        vPkcs11PoolRelease( &xLease, xResult );
+
+        /* Decode the certificate. */
+        if( CKR_OK == xResult )
+        {
+            xResult = mbedtls_x509_crt_parse( pxCertificateContext,
+                                              ( const unsigned char * ) xTemplate.pValue,
+                                              xTemplate.ulValueLen );
+        }
+
+        /* Free memory. */
+        vPortFree( xTemplate.pValue );
+
+        return xResult;
+    }
+
+#endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 0 ) */
+
+/*-----------------------------------------------------------*/
+
+CK_RV TlsCommon_GetClientCertificate( SSLContext_t * pSslContext,
+                                      mbedtls_x509_crt * pxStorage,
+                                      mbedtls_x509_crt ** ppxCertificate )
+{
+    CK_RV xResult;
+
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        /* The certificate parsed by the PAL stays resident, the storage is left empty. */
+        ( void ) pSslContext;
+        ( void ) pxStorage;
+        *ppxCertificate = PKCS11_PAL_GetCachedCertificate();
+        xResult = ( *ppxCertificate != NULL ) ? CKR_OK : CKR_OBJECT_HANDLE_INVALID;
+    #else
+        *ppxCertificate = pxStorage;
+        xResult = readCertificateIntoContext( pSslContext,
+                                              pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                              CKO_CERTIFICATE,
+                                              pxStorage );
+    #endif
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV TlsCommon_InitClientKey( SSLContext_t * pSslContext )
+{
+    CK_RV xResult = CKR_OK;
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 0 )
+        CK_ATTRIBUTE xTemplate[ 2 ];
+    #endif
+    Pkcs11Lease_t xLease;
+
+    /* The pool sessions are already logged in and hold the handle of the device private key. */
+    xResult = xPkcs11PoolAcquire( &xLease, portMAX_DELAY );
+
+    if( CKR_OK != xResult )
+    {
+        return xResult;
+    }
+
+    pSslContext->xP11PrivateKey = xLease.xObjects[ ePkcs11PoolDevicePrivateKey ];
+
+    if( pSslContext->xP11PrivateKey == CK_INVALID_HANDLE )
+    {
+        xResult = CKR_OBJECT_HANDLE_INVALID;
+        LogError( ( "Could not find private key." ) );
+    }
+
+    /* Query the device private key type. */
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        /* Known from the key parsed by the PAL, which also signs. */
+        if( ( xResult == CKR_OK ) && ( PKCS11_PAL_GetCachedKeyType( &pSslContext->xKeyType ) == pdFALSE ) )
+        {
+            xResult = CKR_KEY_HANDLE_INVALID;
+        }
+    #else
+        if( xResult == CKR_OK )
+        {
+            xTemplate[ 0 ].type = CKA_KEY_TYPE;
+            xTemplate[ 0 ].pValue = &pSslContext->xKeyType;
+            xTemplate[ 0 ].ulValueLen = sizeof( CK_KEY_TYPE );
+            xResult = pSslContext->pxP11FunctionList->C_GetAttributeValue( xLease.xSession,
+                                                                           pSslContext->xP11PrivateKey,
+                                                                           xTemplate,
+                                                                           1 );
+        }
+    #endif
+
+    vPkcs11PoolRelease( &xLease, xResult );
+
+    if( ( xResult == CKR_OK ) && ( pSslContext->xKeyType != CKK_RSA ) && ( pSslContext->xKeyType != CKK_EC ) )
+    {
+        xResult = CKR_ATTRIBUTE_VALUE_INVALID;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t ecdsaRawToDer( unsigned char * pucSig )
+{
+    const unsigned char * pucInteger;
+    size_t xIntegerLen;
+    size_t xOut = 2;
+    size_t i;
+
+    /* Moving R down to offset 4 or 5 ends before S at offset 40, and the headers of S
+     * end before its first byte, so no byte is overwritten before it is read. */
+    for( i = 0; i < 2U; i++ )
+    {
+        pucInteger = &pucSig[ tlsECDSA_RAW_SIGNATURE_OFFSET + ( i * ( pkcs11ECDSA_P256_SIGNATURE_LENGTH / 2U ) ) ];
+        xIntegerLen = pkcs11ECDSA_P256_SIGNATURE_LENGTH / 2U;
+
+        /* DER integers are minimal and positive. */
+        while( ( xIntegerLen > 1U ) && ( *pucInteger == 0U ) )
+        {
+            pucInteger++;
+            xIntegerLen--;
+        }
+
+        pucSig[ xOut++ ] = 0x02;
+        pucSig[ xOut++ ] = ( unsigned char ) ( xIntegerLen + ( ( ( *pucInteger & 0x80U ) != 0U ) ? 1U : 0U ) );
+
+        if( ( *pucInteger & 0x80U ) != 0U )
+        {
+            pucSig[ xOut++ ] = 0x00;
+        }
+
+        memmove( &pucSig[ xOut ], pucInteger, xIntegerLen );
+        xOut += xIntegerLen;
+    }
+
+    pucSig[ 0 ] = 0x30;
+    pucSig[ 1 ] = ( unsigned char ) ( xOut - 2U );
+
+    return xOut;
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV TlsCommon_Sign( SSLContext_t * pSslContext,
+                      CK_MECHANISM_TYPE xMechanism,
+                      const uint8_t * pucToBeSigned,
+                      size_t xToBeSignedLen,
+                      uint8_t * pucSignature,
+                      CK_ULONG * pxSignatureLen )
+{
+    CK_MECHANISM xMech = { 0 };
+    Pkcs11Lease_t xLease;
+    CK_RV xResult;
+
+    xMech.mechanism = xMechanism;
+
+    xResult = xPkcs11PoolAcquire( &xLease, portMAX_DELAY );
+
+    if( CKR_OK == xResult )
+    {
+        /* Use the PKCS#11 module to sign. */
+        xResult = pSslContext->pxP11FunctionList->C_SignInit( xLease.xSession,
+                                                              &xMech,
+                                                              pSslContext->xP11PrivateKey );
+
+        if( CKR_OK == xResult )
+        {
+            xResult = pSslContext->pxP11FunctionList->C_Sign( xLease.xSession,
+                                                              ( CK_BYTE_PTR ) pucToBeSigned,
+                                                              xToBeSignedLen,
+                                                              pucSignature,
+                                                              pxSignatureLen );
+        }
+
+        vPkcs11PoolRelease( &xLease, xResult );
+    }
+
+    if( xResult != CKR_OK )
+    {
+        LogError( ( "Failed to sign message using PKCS #11 with error code %02X.", xResult ) );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV TlsCommon_SignEcdsa( SSLContext_t * pSslContext,
+                           const uint8_t * pucHash,
+                           size_t xHashLen,
+                           uint8_t * pucSig,
+                           size_t * pxSigLen )
+{
+    CK_ULONG xSignatureLen = pkcs11ECDSA_P256_SIGNATURE_LENGTH;
+    CK_RV xResult;
+
+    /* The hash is signed where the TLS library holds it, and the raw signature is written
+     * into its output buffer, past the room needed by the DER headers. */
+    xResult = TlsCommon_Sign( pSslContext, CKM_ECDSA, pucHash, xHashLen,
+                              &pucSig[ tlsECDSA_RAW_SIGNATURE_OFFSET ], &xSignatureLen );
+
+    /* PKCS #11 for P256 returns a 64-byte signature with 32 bytes for R and 32 bytes for S.
+     * This must be converted to an ASN.1 encoded array. */
+    if( ( xResult == CKR_OK ) && ( xSignatureLen != pkcs11ECDSA_P256_SIGNATURE_LENGTH ) )
+    {
+        xResult = CKR_FUNCTION_FAILED;
+    }
+
+    if( xResult == CKR_OK )
+    {
+        *pxSigLen = ecdsaRawToDer( pucSig );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV TlsCommon_ReadPsk( TlsPsk_t * pxPsk )
+{
+    CK_RV xResult = CKR_OK;
+    CK_OBJECT_HANDLE xKeyHandle;
+    CK_OBJECT_HANDLE xIdentityHandle;
+    CK_BBOOL xIsPrivate;
+
+    ( void ) memset( pxPsk, 0, sizeof( TlsPsk_t ) );
+
+    /* Read from the PAL as the thing name is, C_GetAttributeValue does not release the
+     * value of a private object. */
+    xKeyHandle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pkcs11configLABEL_TLS_PSK,
+                                        sizeof( pkcs11configLABEL_TLS_PSK ) );
+    xIdentityHandle = PKCS11_PAL_FindObject( ( CK_BYTE_PTR ) pkcs11configLABEL_TLS_PSK_IDENTITY,
+                                             sizeof( pkcs11configLABEL_TLS_PSK_IDENTITY ) );
+
+    if( ( xKeyHandle == CK_INVALID_HANDLE ) || ( xIdentityHandle == CK_INVALID_HANDLE ) )
+    {
+        LogError( ( "The TLS pre-shared key or its identity is not provisioned." ) );
+        xResult = CKR_OBJECT_HANDLE_INVALID;
+    }
+
+    if( xResult == CKR_OK )
+    {
+        xResult = PKCS11_PAL_GetObjectValue( xKeyHandle, &pxPsk->pucKey, &pxPsk->ulKeySize, &xIsPrivate );
+    }
+
+    if( xResult == CKR_OK )
+    {
+        xResult = PKCS11_PAL_GetObjectValue( xIdentityHandle, &pxPsk->pucIdentity, &pxPsk->ulIdentitySize, &xIsPrivate );
+    }
+
+    if( xResult != CKR_OK )
+    {
+        TlsCommon_FreePsk( pxPsk );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void TlsCommon_FreePsk( TlsPsk_t * pxPsk )
+{
+    if( pxPsk->pucIdentity != NULL )
+    {
+        PKCS11_PAL_GetObjectValueCleanup( pxPsk->pucIdentity, pxPsk->ulIdentitySize );
+        pxPsk->pucIdentity = NULL;
+    }
+
+    if( pxPsk->pucKey != NULL )
+    {
+        PKCS11_PAL_GetObjectValueCleanup( pxPsk->pucKey, pxPsk->ulKeySize );
+        pxPsk->pucKey = NULL;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t tlsConnectAndSetup( NetworkContext_t * pNetworkContext,
+                                                const char * pHostName,
+                                                uint16_t port,
+                                                const NetworkCredentials_t * pNetworkCredentials,
+                                                uint32_t receiveTimeoutMs,
+                                                uint32_t sendTimeoutMs )
+{
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+    BaseType_t socketStatus = 0;
+
+    if( ( pNetworkContext == NULL ) ||
+        ( pHostName == NULL ) ||
+        ( pNetworkCredentials == NULL ) )
+    {
+        LogError( ( "Invalid input parameter(s): Arguments cannot be NULL. pNetworkContext=%p, "
+                    "pHostName=%p, pNetworkCredentials=%p.",
+                    pNetworkContext,
+                    pHostName,
+                    pNetworkCredentials ) );
+        returnStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else if( ( pNetworkCredentials->pRootCa == NULL ) && ( pNetworkCredentials->usePsk == pdFALSE ) )
+    {
+        LogError( ( "pRootCa cannot be NULL." ) );
+        returnStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Empty else for MISRA 15.7 compliance. */
+    }
+
+    /* Establish a TCP connection with the server. */
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        socketStatus = Sockets_ConnectWithProfile( &( pNetworkContext->tcpSocket ),
+                                                   pHostName,
+                                                   port,
+                                                   receiveTimeoutMs,
+                                                   sendTimeoutMs,
+                                                   pNetworkCredentials->socketProfile );
+
+        if( socketStatus != 0 )
+        {
+            LogError( ( "Failed to connect to %s with error %d.",
+                        pHostName,
+                        socketStatus ) );
+            returnStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+        }
+    }
+
+    /* Initialize the TLS library. */
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        returnStatus = TlsBackend_Init();
+    }
+
+    /* Configure TLS for the handshake. */
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        returnStatus = TlsBackend_Setup( pNetworkContext, pHostName, pNetworkCredentials );
+    }
+
+    /* Clean up on failure. */
+    if( returnStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        if( ( pNetworkContext != NULL ) &&
+            ( pNetworkContext->tcpSocket != FREERTOS_INVALID_SOCKET ) )
+        {
+            ( void ) FreeRTOS_closesocket( pNetworkContext->tcpSocket );
+        }
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TLS_FreeRTOS_Connect( NetworkContext_t * pNetworkContext,
+                                           const char * pHostName,
+                                           uint16_t port,
+                                           const NetworkCredentials_t * pNetworkCredentials,
+                                           uint32_t receiveTimeoutMs,
+                                           uint32_t sendTimeoutMs )
+{
+    TlsTransportStatus_t returnStatus;
+
+    returnStatus = tlsConnectAndSetup( pNetworkContext, pHostName, port, pNetworkCredentials,
+                                       receiveTimeoutMs, sendTimeoutMs );
+
+    /* Perform TLS handshake. */
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        returnStatus = TlsBackend_Handshake( pNetworkContext, pdFALSE );
+
+        if( returnStatus != TLS_TRANSPORT_SUCCESS )
+        {
+            ( void ) FreeRTOS_closesocket( pNetworkContext->tcpSocket );
+        }
+    }
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        LogInfo( ( "(Network connection %p) Connection to %s established.",
+                   pNetworkContext,
+                   pHostName ) );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TLS_FreeRTOS_ConnectStart( NetworkContext_t * pNetworkContext,
+                                                const char * pHostName,
+                                                uint16_t port,
+                                                const NetworkCredentials_t * pNetworkCredentials,
+                                                uint32_t receiveTimeoutMs,
+                                                uint32_t sendTimeoutMs )
+{
+    TlsTransportStatus_t returnStatus;
+
+    returnStatus = tlsConnectAndSetup( pNetworkContext, pHostName, port, pNetworkCredentials,
+                                       receiveTimeoutMs, sendTimeoutMs );
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        /* Read without blocking during the handshake, readiness comes from FreeRTOS_select(). */
+        pNetworkContext->sslContext.receiveTimeoutMs = receiveTimeoutMs;
+        Sockets_SetReceiveTimeout( pNetworkContext->tcpSocket, 0 );
+
+        TlsBackend_SetNonBlocking( pNetworkContext, pdTRUE );
+
+        returnStatus = TLS_TRANSPORT_IN_PROGRESS;
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TLS_FreeRTOS_ConnectStep( NetworkContext_t * pNetworkContext )
+{
+    TlsTransportStatus_t returnStatus;
+
+    configASSERT( pNetworkContext != NULL );
+
+    returnStatus = TlsBackend_Handshake( pNetworkContext, pdTRUE );
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        /* Back to the blocking reads expected by the users of the transport interface. */
+        Sockets_SetReceiveTimeout( pNetworkContext->tcpSocket, pNetworkContext->sslContext.receiveTimeoutMs );
+
+        TlsBackend_SetNonBlocking( pNetworkContext, pdFALSE );
+
+        LogInfo( ( "(Network connection %p) Connection to %s established.",
+                   pNetworkContext,
+                   pNetworkContext->sslContext.pHostName ) );
+    }
+    else if( returnStatus == TLS_TRANSPORT_HANDSHAKE_FAILED )
+    {
+        ( void ) FreeRTOS_closesocket( pNetworkContext->tcpSocket );
+    }
+    else
+    {
+        /* Empty else for MISRA 15.7 compliance. */
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_Disconnect( NetworkContext_t * pNetworkContext )
+{
+    #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+        /* Send what is left of the application data before the close-notify. */
+        ( void ) flushTxBuffer( &( pNetworkContext->sslContext ) );
+    #endif
+
+    TlsBackend_Shutdown( pNetworkContext );
+
+    /* Call socket shutdown function to close connection. */
+    Sockets_Disconnect( pNetworkContext->tcpSocket );
+
+    /* Free the TLS objects, the TLS library stays initialized for the other connections. */
+    TlsBackend_Free( &( pNetworkContext->sslContext ) );
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TLS_FreeRTOS_recv( const NetworkContext_t * pNetworkContext,
+                           void * pBuffer,
+                           size_t bytesToRecv )
+{
+    int32_t tlsStatus = 0;
+
+    #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+        /* A response is only expected once the buffered request has been sent. If the
+         * socket times out, still read so that the peer is not blocked on this side. */
+        tlsStatus = flushTxBuffer( ( SSLContext_t * ) &( pNetworkContext->sslContext ) );
+    #endif
+
+    if( tlsStatus >= 0 )
+    {
+        tlsStatus = TlsBackend_Read( ( SSLContext_t * ) &( pNetworkContext->sslContext ),
+                                     pBuffer,
+                                     bytesToRecv );
+    }
+
+    return tlsStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+    static int32_t flushTxBuffer( SSLContext_t * pSslContext )
+    {
+        int32_t tlsStatus = 0;
+        size_t bytesSent = 0;
+
+        while( ( bytesSent < pSslContext->txLength ) && ( tlsStatus >= 0 ) )
+        {
+            tlsStatus = TlsBackend_Write( pSslContext,
+                                          &( pSslContext->txBuffer[ bytesSent ] ),
+                                          pSslContext->txLength - bytesSent );
+
+            if( tlsStatus == 0 )
+            {
+                break;
+            }
+
+            if( tlsStatus > 0 )
+            {
+                bytesSent += ( size_t ) tlsStatus;
+            }
+        }
+
+        if( tlsStatus < 0 )
+        {
+            /* The record layer is in an unknown state, the connection is lost. */
+            pSslContext->txLength = 0;
+        }
+        else
+        {
+            pSslContext->txLength -= bytesSent;
+
+            if( pSslContext->txLength > 0 )
+            {
+                memmove( pSslContext->txBuffer, &( pSslContext->txBuffer[ bytesSent ] ), pSslContext->txLength );
+            }
+
+            tlsStatus = ( int32_t ) pSslContext->txLength;
+        }
+
+        return tlsStatus;
+    }
+#endif /* if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 ) */
+/*-----------------------------------------------------------*/
+
+int32_t TLS_FreeRTOS_send( const NetworkContext_t * pNetworkContext,
+                           const void * pBuffer,
+                           size_t bytesToSend )
+{
+    SSLContext_t * pSslContext = ( SSLContext_t * ) &( pNetworkContext->sslContext );
+    int32_t tlsStatus = 0;
+
+    #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+        /* coreMQTT sends the fixed header, the topic and the payload of a packet
+         * separately, copy them so that they go out in one record and one segment. */
+        if( ( pSslContext->txLength + bytesToSend ) > sizeof( pSslContext->txBuffer ) )
+        {
+            tlsStatus = flushTxBuffer( pSslContext );
+        }
+
+        if( tlsStatus != 0 )
+        {
+            /* Nothing of this buffer was sent, a timeout lets the caller retry. */
+            tlsStatus = ( tlsStatus > 0 ) ? 0 : tlsStatus;
+        }
+        else if( bytesToSend > sizeof( pSslContext->txBuffer ) )
+        {
+            tlsStatus = TlsBackend_Write( pSslContext, pBuffer, bytesToSend );
+        }
+        else
+        {
+            memcpy( &( pSslContext->txBuffer[ pSslContext->txLength ] ), pBuffer, bytesToSend );
+            pSslContext->txLength += bytesToSend;
+            tlsStatus = ( int32_t ) bytesToSend;
+        }
+    #else /* if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 ) */
+        tlsStatus = TlsBackend_Write( pSslContext, pBuffer, bytesToSend );
+    #endif /* if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 ) */
+
+    return tlsStatus;
+}
+/*-----------------------------------------------------------*/
+
+int32_t TLS_FreeRTOS_flush( const NetworkContext_t * pNetworkContext )
+{
+    int32_t tlsStatus = 0;
+
+    #if ( tlsconfigTX_COALESCE_BUFFER_SIZE > 0 )
+        tlsStatus = flushTxBuffer( ( SSLContext_t * ) &( pNetworkContext->sslContext ) );
+    #else
+        ( void ) pNetworkContext;
+    #endif
+
+    return tlsStatus;
+}
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_SetRecvTimeout( NetworkContext_t * pNetworkContext,
+                                  uint32_t timeoutMS )
+{
+    Sockets_SetReceiveTimeout( pNetworkContext->tcpSocket, timeoutMS );
+}
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_SetWakeupCallback( NetworkContext_t * pNetworkContext,
+                                     SocketWakeupCallback_t callback )
+{
+    Sockets_SetWakeupCallback( pNetworkContext->tcpSocket, callback );
+}
+/*-----------------------------------------------------------*/
+
+uint32_t TLS_FreeRTOS_GetSendTimeouts( void )
+{
+    return sendTimeouts;
+}
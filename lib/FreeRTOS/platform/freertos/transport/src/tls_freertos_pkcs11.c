@@ -22,7 +22,7 @@
 /**
  * @file tls_freertos_pkcs11.c
  * @brief TLS transport interface implementations. This implementation uses
- * mbedTLS.
+ * mbedTLS, the parts independent of the TLS library are in tls_freertos_common.c.
  * @note This file is derived from the tls_freertos.c source file found in the mqtt
  * section of IoT Libraries source code. The file has been modified to support using
  * PKCS #11 when using TLS.
@@ -42,16 +42,23 @@
 
 /* Standard includes. */
 #include <string.h>
+#include <stdio.h>
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 
 /* FreeRTOS+TCP includes. */
 #include "FreeRTOS_IP.h"
 #include "FreeRTOS_Sockets.h"
 
-/* TLS transport header. */
+/* TLS transport headers. */
 #include "tls_freertos_pkcs11.h"
+#include "tls_freertos_common.h"
+
+/* The wolfSSL build implements the transport in tls_freertos_wolfssl.c. */
+#if ( tlsconfigUSE_WOLFSSL == 0 )
 
 /* FreeRTOS Socket wrapper include. */
 #include "freertos_sockets_wrapper.h"
@@ -60,16 +67,35 @@
 #include "mbedtls_error.h"
 
 /* PKCS #11 includes. */
-#include "core_pkcs11_config.h"
-#include "core_pkcs11.h"
-#include "pkcs11.h"
 #include "core_pki_utils.h"
+#include "pkcs11_session_pool.h"
 
 /* NXP Console Logging. */
 #include "fsl_debug_console.h"
 
+/* Latency probes include, times the record layer calls. */
+#include "latency_probe.h"
+
+/* Crypto worker include, runs the handshake steps below the periodic work. */
+#include "crypto_worker.h"
+
+#if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+    /* Peak memory held by mbed TLS in each handshake phase. */
+    #include "mbedtls_freertos_port.h"
+#endif
+
 /*-----------------------------------------------------------*/
 
+#if ( MBEDTLS_ERROR_COMPACT == 1 )
+
+/**
+ * @brief Format of an mbedTLS error in the logs: the negated code, of which
+ * tools/mbedtls_error_decode.py gives the high-level and low-level strings.
+ */
+    #define mbedtlsERROR_FORMAT                "-0x%04x"
+    #define mbedtlsErrorArgs( mbedTlsCode )    ( unsigned int ) ( -( mbedTlsCode ) )
+#else
+
 /**
  * @brief Represents string to be logged when mbedTLS returned error
  * does not contain a high-level code.
@@ -86,7 +112,7 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Error-Code>";
  * @brief Utility for converting the high-level code in an mbedTLS error to string,
  * if the code-contains a high-level code; otherwise, using a default string.
  */
-#define mbedtlsHighLevelCodeOrDefault( mbedTlsCode )        \
+    #define mbedtlsHighLevelCodeOrDefault( mbedTlsCode )        \
     ( mbedtls_strerror_highlevel( mbedTlsCode ) != NULL ) ? \
     mbedtls_strerror_highlevel( mbedTlsCode ) : pNoHighLevelMbedTlsCodeStr
 
@@ -94,10 +120,18 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Error-Code>";
  * @brief Utility for converting the level-level code in an mbedTLS error to string,
  * if the code-contains a level-level code; otherwise, using a default string.
  */
-#define mbedtlsLowLevelCodeOrDefault( mbedTlsCode )        \
+    #define mbedtlsLowLevelCodeOrDefault( mbedTlsCode )        \
     ( mbedtls_strerror_lowlevel( mbedTlsCode ) != NULL ) ? \
     mbedtls_strerror_lowlevel( mbedTlsCode ) : pNoLowLevelMbedTlsCodeStr
 
+/**
+ * @brief Format of an mbedTLS error in the logs: its high-level and low-level strings.
+ */
+    #define mbedtlsERROR_FORMAT    "%s : %s"
+    #define mbedtlsErrorArgs( mbedTlsCode ) \
+    mbedtlsHighLevelCodeOrDefault( mbedTlsCode ), mbedtlsLowLevelCodeOrDefault( mbedTlsCode )
+#endif /* MBEDTLS_ERROR_COMPACT == 1 */
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -108,34 +142,29 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Error-Code>";
 static void sslContextInit( SSLContext_t * pSslContext );
 
 /**
- * @brief Free the mbed TLS structures in a network connection.
+ * @brief Processes one handshake state, run by the crypto worker so that the ECDHE and the
+ * signatures of the handshake do not hold the CPU at the priority of the connecting task.
  *
- * @param[in] pSslContext The SSL context to free.
- */
-static void sslContextFree( SSLContext_t * pSslContext );
-
-/**
- * @brief Set up TLS on a TCP connection.
- *
- * @param[in] pNetworkContext Network context.
- * @param[in] pHostName Remote host name, used for server name indication.
- * @param[in] pNetworkCredentials TLS setup parameters.
+ * @param[in] pvContext The SSLContext_t of the connection.
  *
- * @return #TLS_TRANSPORT_SUCCESS, #TLS_TRANSPORT_INSUFFICIENT_MEMORY, #TLS_TRANSPORT_INVALID_CREDENTIALS,
- * #TLS_TRANSPORT_HANDSHAKE_FAILED, or #TLS_TRANSPORT_INTERNAL_ERROR.
+ * @return The result of mbedtls_ssl_handshake_step().
  */
-static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
-                                      const char * pHostName,
-                                      const NetworkCredentials_t * pNetworkCredentials );
+static int32_t tlsHandshakeStepJob( void * pvContext );
 
 /**
- * @brief Initialize mbedTLS.
+ * @brief Receive callback of mbed TLS for the incremental handshake, on a socket without
+ * receive timeout.
+ *
+ * @param[in] ctx The socket handle.
+ * @param[out] buf Buffer to receive bytes into.
+ * @param[in] len Number of bytes to receive from the network.
  *
- * @return #TLS_TRANSPORT_SUCCESS, or #TLS_TRANSPORT_INTERNAL_ERROR.
+ * @return Number of bytes received, MBEDTLS_ERR_SSL_WANT_READ if none are available yet,
+ * or a negative value on error.
  */
-static TlsTransportStatus_t initMbedtls( void );
-
-/*-----------------------------------------------------------*/
+static int tlsRecvNonBlocking( void * ctx,
+                               unsigned char * buf,
+                               size_t len );
 
 /**
  * @brief Callback that wraps PKCS#11 for pseudo-random number generation.
@@ -151,30 +180,25 @@ static int generateRandomBytes( void * pvCtx,
                                     size_t xRandomLength );
 
 /**
- * @brief Helper for reading the specified certificate object, if present,
- * out of storage, into RAM, and then into an mbedTLS certificate context
- * object.
+ * @brief Helper for setting up potentially hardware-based cryptographic context.
  *
- * @param[in] pSslContext Caller TLS context.
- * @param[in] pcLabelName PKCS #11 certificate object label.
- * @param[in] xClass PKCS #11 certificate object class.
- * @param[out] pxCertificateContext Certificate context.
+ * @param Caller context.
  *
  * @return Zero on success.
  */
-static CK_RV readCertificateIntoContext( SSLContext_t * pSslContext,
-                                         char * pcLabelName,
-                                         CK_OBJECT_CLASS xClass,
-                                         mbedtls_x509_crt * pxCertificateContext );
+static CK_RV initializeClientKeys( SSLContext_t * pxCtx );
+
+#if defined( MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED )
 
 /**
- * @brief Helper for setting up potentially hardware-based cryptographic context.
+ * @brief Configures the pre-shared key and its identity stored by the PKCS #11 PAL.
  *
- * @param Caller context.
+ * @param[in] pSslContext Caller context.
  *
- * @return Zero on success.
+ * @return CKR_OK on success.
  */
-static CK_RV initializeClientKeys( SSLContext_t * pxCtx );
+    static CK_RV configurePsk( SSLContext_t * pSslContext );
+#endif
 
 /**
  * @brief Sign a cryptographic hash with the private key.
@@ -202,6 +226,108 @@ static int privateKeySigningCallback( void * pvContext,
                                           void * pvRng );
 
 
+/**
+ * @brief Sets the send and receive callbacks of mbed TLS for the socket of a connection.
+ *
+ * @param[in] pNetworkContext Network context.
+ * @param[in] pRecv Receive function, called with the socket.
+ */
+static void tlsSetBio( NetworkContext_t * pNetworkContext,
+                       int ( * pRecv )( void * ctx,
+                                        unsigned char * buf,
+                                        size_t len ) );
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+
+/**
+ * @brief Signs with the private key parsed by the PAL, see privateKeySigningCallback().
+ */
+    static int cachedKeySigningCallback( void * pvContext,
+                                         mbedtls_md_type_t xMdAlg,
+                                         const unsigned char * pucHash,
+                                         size_t xHashLen,
+                                         unsigned char * pucSig,
+                                         size_t * pxSigLen,
+                                         int ( * piRng )( void *,
+                                                          unsigned char *,
+                                                          size_t ),
+                                         void * pvRng );
+
+/**
+ * @brief Signing callback of the client key.
+ */
+    #define tlsSIGNING_CALLBACK    cachedKeySigningCallback
+#else
+    #define tlsSIGNING_CALLBACK    privateKeySigningCallback
+#endif
+
+#if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+
+/**
+ * @brief Send callback of mbed TLS with the network context, while the handshake is profiled.
+ *
+ * @param[in] ctx The network context.
+ * @param[in] buf Bytes to send.
+ * @param[in] len Number of bytes to send.
+ *
+ * @return The result of mbedtls_platform_send() on the socket.
+ */
+    static int tlsProfiledSend( void * ctx,
+                                const unsigned char * buf,
+                                size_t len );
+
+/**
+ * @brief Receive callback of mbed TLS with the network context, counting the cycles blocked in
+ * the receive function of the profile during a handshake step.
+ *
+ * @param[in] ctx The network context.
+ * @param[out] buf Buffer to receive bytes into.
+ * @param[in] len Number of bytes to receive from the network.
+ *
+ * @return The result of the receive function of the profile.
+ */
+    static int tlsProfiledRecv( void * ctx,
+                                unsigned char * buf,
+                                size_t len );
+
+/**
+ * @brief Times the signing callback of the client key.
+ */
+    static int profiledSigningCallback( void * pvContext,
+                                        mbedtls_md_type_t xMdAlg,
+                                        const unsigned char * pucHash,
+                                        size_t xHashLen,
+                                        unsigned char * pucSig,
+                                        size_t * pxSigLen,
+                                        int ( * piRng )( void *,
+                                                         unsigned char *,
+                                                         size_t ),
+                                        void * pvRng );
+
+/**
+ * @brief Maps a client handshake state of mbed TLS to its phase in the profile.
+ *
+ * @param[in] state The state about to be processed.
+ *
+ * @return The phase.
+ */
+    static TlsHandshakePhase_t profilePhase( int state );
+
+/**
+ * @brief Prints the TLS_HS record of a completed or failed handshake.
+ *
+ * @param[in] pSslContext The SSL context of the connection.
+ * @param[in] mbedtlsError The result of the handshake.
+ */
+    static void profilePrint( const SSLContext_t * pSslContext,
+                              int32_t mbedtlsError );
+
+/**
+ * @brief Converts DWT cycles to microseconds at the current core clock.
+ */
+    #define tlsCYCLES_TO_US( cycles )    ( ( uint32_t ) ( ( uint64_t ) ( cycles ) * 1000000ULL / SystemCoreClock ) )
+#endif /* tlsconfigHANDSHAKE_PROFILE == 1 */
+
 /*-----------------------------------------------------------*/
 
 #ifdef MBEDTLS_DEBUG_C
@@ -221,46 +347,133 @@ static int privateKeySigningCallback( void * pvContext,
     }
 #endif /* ifdef MBEDTLS_DEBUG_C */
 
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+
+/* Sessions of the entries of the session cache of tls_freertos_common.c. */
+    static mbedtls_ssl_session sessions[ tlsconfigSESSION_CACHE_ENTRIES ];
+
+/*-----------------------------------------------------------*/
+
+    void TlsBackend_SessionLoad( SSLContext_t * pSslContext,
+                                 size_t xEntry )
+    {
+        ( void ) mbedtls_ssl_set_session( &( pSslContext->context ), &( sessions[ xEntry ] ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t TlsBackend_SessionSave( SSLContext_t * pSslContext,
+                                       size_t xEntry )
+    {
+        BaseType_t xSaved = pdTRUE;
+
+        /* The copy made by mbedtls_ssl_get_session() frees the previous session of the entry. */
+        if( mbedtls_ssl_get_session( &( pSslContext->context ), &( sessions[ xEntry ] ) ) != 0 )
+        {
+            mbedtls_ssl_session_free( &( sessions[ xEntry ] ) );
+            xSaved = pdFALSE;
+        }
+
+        return xSaved;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void TlsBackend_SessionFree( size_t xEntry )
+    {
+        mbedtls_ssl_session_free( &( sessions[ xEntry ] ) );
+    }
+#endif /* if ( tlsconfigSESSION_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+
+/* Chains of the entries of the root CA cache of tls_freertos_common.c. */
+    static mbedtls_x509_crt rootCaChains[ tlsconfigROOT_CA_CACHE_ENTRIES ];
+
+/*-----------------------------------------------------------*/
+
+    int32_t TlsBackend_RootCaLoad( SSLContext_t * pSslContext,
+                                   const NetworkCredentials_t * pNetworkCredentials,
+                                   BaseType_t usePsk,
+                                   size_t xEntry )
+    {
+        int32_t mbedtlsError;
+
+        ( void ) pSslContext;
+        ( void ) usePsk;
+
+        mbedtls_x509_crt_free( &( rootCaChains[ xEntry ] ) );
+        mbedtls_x509_crt_init( &( rootCaChains[ xEntry ] ) );
+
+        mbedtlsError = mbedtls_x509_crt_parse( &( rootCaChains[ xEntry ] ),
+                                               pNetworkCredentials->pRootCa,
+                                               pNetworkCredentials->rootCaSize );
+
+        if( mbedtlsError != 0 )
+        {
+            mbedtls_x509_crt_free( &( rootCaChains[ xEntry ] ) );
+        }
+
+        return mbedtlsError;
+    }
+#endif /* if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
 static void sslContextInit( SSLContext_t * pSslContext )
 {
-    configASSERT( pSslContext != NULL );
+    TlsCommon_ContextInit( pSslContext );
 
     mbedtls_ssl_config_init( &( pSslContext->config ) );
     mbedtls_x509_crt_init( &( pSslContext->rootCa ) );
     mbedtls_x509_crt_init( &( pSslContext->clientCert ) );
     mbedtls_ssl_init( &( pSslContext->context ) );
-
-    xInitializePkcs11Session( &( pSslContext->xP11Session ) );
-    C_GetFunctionList( &( pSslContext->pxP11FunctionList ) );
 }
 /*-----------------------------------------------------------*/
 
-static void sslContextFree( SSLContext_t * pSslContext )
+void TlsBackend_Free( SSLContext_t * pSslContext )
 {
     configASSERT( pSslContext != NULL );
 
     mbedtls_ssl_free( &( pSslContext->context ) );
     mbedtls_x509_crt_free( &( pSslContext->rootCa ) );
+
+    #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+        /* The configuration referencing the shared chain is freed below, the chain stays parsed. */
+        TlsCommon_RootCaCacheRelease( pSslContext );
+    #endif
     mbedtls_x509_crt_free( &( pSslContext->clientCert ) );
     mbedtls_ssl_config_free( &( pSslContext->config ) );
 
-    pSslContext->pxP11FunctionList->C_CloseSession( pSslContext->xP11Session );
+    /* The mutex functions of mbed TLS are left installed, other connections and PKCS #11 use them. */
 }
 
 /*-----------------------------------------------------------*/
 
-static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
-                                      const char * pHostName,
-                                      const NetworkCredentials_t * pNetworkCredentials )
+TlsTransportStatus_t TlsBackend_Setup( NetworkContext_t * pNetworkContext,
+                                       const char * pHostName,
+                                       const NetworkCredentials_t * pNetworkCredentials )
 {
     TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
     int32_t mbedtlsError = 0;
     CK_RV xResult = CKR_OK;
+    BaseType_t usePsk = pdFALSE;
 
     configASSERT( pNetworkContext != NULL );
     configASSERT( pHostName != NULL );
     configASSERT( pNetworkCredentials != NULL );
-    configASSERT( pNetworkCredentials->pRootCa != NULL );
+
+    #if defined( MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED )
+        usePsk = pNetworkCredentials->usePsk;
+    #else
+        configASSERT( pNetworkCredentials->usePsk == pdFALSE );
+    #endif
+
+    configASSERT( ( pNetworkCredentials->pRootCa != NULL ) || ( usePsk == pdTRUE ) );
 
     /* Initialize the mbed TLS context structures. */
     sslContextInit( &( pNetworkContext->sslContext ) );
@@ -272,9 +485,8 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
     if( mbedtlsError != 0 )
     {
-        LogError( ( "Failed to set default SSL configuration: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                    mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        LogError( ( "Failed to set default SSL configuration: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( mbedtlsError ) ) );
 
         /* Per mbed TLS docs, mbedtls_ssl_config_defaults only fails on memory allocation. */
         returnStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
@@ -303,28 +515,75 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
         mbedtls_ssl_conf_cert_profile( &( pNetworkContext->sslContext.config ),
                                        &( pNetworkContext->sslContext.certProfile ) );
 
-        /* Parse the server root CA certificate into the SSL context. */
-        mbedtlsError = mbedtls_x509_crt_parse( &( pNetworkContext->sslContext.rootCa ),
-                                               pNetworkCredentials->pRootCa,
-                                               pNetworkCredentials->rootCaSize );
-
-        if( mbedtlsError != 0 )
+        /* Parse the server root CA certificate into the SSL context, unless the chain parsed for
+         * an earlier connection is shared. The PSK suites have no server certificate. */
+        if( usePsk == pdFALSE )
         {
-            LogError( ( "Failed to parse server root CA certificate: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            mbedtls_x509_crt * pxRootCa = NULL;
 
-            returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+            #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+                mbedtlsError = TlsCommon_RootCaCacheAcquire( &( pNetworkContext->sslContext ),
+                                                             pNetworkCredentials,
+                                                             usePsk );
+
+                if( pNetworkContext->sslContext.rootCaEntry != tlsROOT_CA_CACHE_NONE )
+                {
+                    pxRootCa = &( rootCaChains[ pNetworkContext->sslContext.rootCaEntry ] );
+                }
+            #endif
+
+            if( ( mbedtlsError == 0 ) && ( pxRootCa == NULL ) )
+            {
+                /* Every cache entry is used by another root CA. */
+                pxRootCa = &( pNetworkContext->sslContext.rootCa );
+                mbedtlsError = mbedtls_x509_crt_parse( pxRootCa,
+                                                       pNetworkCredentials->pRootCa,
+                                                       pNetworkCredentials->rootCaSize );
+            }
+
+            if( mbedtlsError != 0 )
+            {
+                LogError( ( "Failed to parse server root CA certificate: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                            mbedtlsErrorArgs( mbedtlsError ) ) );
+
+                returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+            }
+            else
+            {
+                mbedtls_ssl_conf_ca_chain( &( pNetworkContext->sslContext.config ),
+                                           pxRootCa,
+                                           NULL );
+            }
         }
-        else
+    }
+
+    #if defined( MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED )
+        if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( usePsk == pdTRUE ) )
         {
-            mbedtls_ssl_conf_ca_chain( &( pNetworkContext->sslContext.config ),
-                                       &( pNetworkContext->sslContext.rootCa ),
-                                       NULL );
+            static const int pskCipherSuites[] =
+            {
+                #if defined( MBEDTLS_KEY_EXCHANGE_ECDHE_PSK_ENABLED )
+                    MBEDTLS_TLS_ECDHE_PSK_WITH_AES_128_CBC_SHA256,
+                #endif
+                #if defined( MBEDTLS_KEY_EXCHANGE_PSK_ENABLED )
+                    MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256,
+                #endif
+                0
+            };
+
+            if( configurePsk( &( pNetworkContext->sslContext ) ) != CKR_OK )
+            {
+                returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+            }
+            else if( pNetworkCredentials->pCipherSuites == NULL )
+            {
+                /* Only the PSK suites, a certificate suite would fail without a client key. */
+                mbedtls_ssl_conf_ciphersuites( &( pNetworkContext->sslContext.config ), pskCipherSuites );
+            }
         }
-    }
+    #endif /* if defined( MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED ) */
 
-    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( usePsk == pdFALSE ) )
     {
         /* Setup the client private key. */
         xResult = initializeClientKeys( &( pNetworkContext->sslContext ) );
@@ -337,11 +596,12 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
         }
         else
         {
+            mbedtls_x509_crt * pxClientCert = NULL;
+
             /* Setup the client certificate. */
-            xResult = readCertificateIntoContext( &( pNetworkContext->sslContext ),
-                                                  pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
-                                                  CKO_CERTIFICATE,
-                                                  &( pNetworkContext->sslContext.clientCert ) );
+            xResult = TlsCommon_GetClientCertificate( &( pNetworkContext->sslContext ),
+                                                      &( pNetworkContext->sslContext.clientCert ),
+                                                      &pxClientCert );
 
             if( xResult != CKR_OK )
             {
@@ -352,7 +612,7 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
             else
             {
                 ( void ) mbedtls_ssl_conf_own_cert( &( pNetworkContext->sslContext.config ),
-                                                    &( pNetworkContext->sslContext.clientCert ),
+                                                    pxClientCert,
                                                     &( pNetworkContext->sslContext.privKey ) );
             }
         }
@@ -367,14 +627,47 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to configure ALPN protocol in mbed TLS: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to configure ALPN protocol in mbed TLS: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
 
             returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
         }
     }
 
+    #if defined( MBEDTLS_SSL_MAX_FRAGMENT_LENGTH )
+        if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) &&
+            ( pNetworkCredentials->maxFragmentLength != MBEDTLS_SSL_MAX_FRAG_LEN_NONE ) )
+        {
+            /* Ask the server for records no larger than the fragment length. */
+            mbedtlsError = mbedtls_ssl_conf_max_frag_len( &( pNetworkContext->sslContext.config ),
+                                                          pNetworkCredentials->maxFragmentLength );
+
+            if( mbedtlsError != 0 )
+            {
+                LogError( ( "Failed to configure maximum fragment length in mbed TLS: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                            mbedtlsErrorArgs( mbedtlsError ) ) );
+
+                returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+            }
+        }
+    #endif /* if defined( MBEDTLS_SSL_MAX_FRAGMENT_LENGTH ) */
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( pNetworkCredentials->pCipherSuites != NULL ) )
+    {
+        /* Restrict the ClientHello to the given suites, so that the server cannot pick a
+         * more expensive key exchange. */
+        mbedtls_ssl_conf_ciphersuites( &( pNetworkContext->sslContext.config ),
+                                       pNetworkCredentials->pCipherSuites );
+    }
+
+    #if defined( MBEDTLS_ECP_C )
+        if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( pNetworkCredentials->pCurves != NULL ) )
+        {
+            mbedtls_ssl_conf_curves( &( pNetworkContext->sslContext.config ),
+                                     pNetworkCredentials->pCurves );
+        }
+    #endif
+
     if( returnStatus == TLS_TRANSPORT_SUCCESS )
     {
         /* Initialize the mbed TLS secured connection context. */
@@ -383,26 +676,15 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to set up mbed TLS SSL context: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to set up mbed TLS SSL context: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
 
             returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
         }
         else
         {
             /* Set the underlying IO for the TLS connection. */
-
-            /* MISRA Rule 11.2 flags the following line for casting the second
-             * parameter to void *. This rule is suppressed because
-             * #mbedtls_ssl_set_bio requires the second parameter as void *.
-             */
-            /* coverity[misra_c_2012_rule_11_2_violation] */
-            mbedtls_ssl_set_bio( &( pNetworkContext->sslContext.context ),
-                                 ( void * ) pNetworkContext->tcpSocket,
-                                 mbedtls_platform_send,
-                                 mbedtls_platform_recv,
-                                 NULL );
+            tlsSetBio( pNetworkContext, mbedtls_platform_recv );
         }
     }
 
@@ -416,9 +698,8 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
             if( mbedtlsError != 0 )
             {
-                LogError( ( "Failed to set server name: mbedTLSError= %s : %s.",
-                            mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                            mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+                LogError( ( "Failed to set server name: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                            mbedtlsErrorArgs( mbedtlsError ) ) );
 
                 returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
             }
@@ -435,31 +716,98 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
     if( returnStatus == TLS_TRANSPORT_SUCCESS )
     {
-        /* Perform the TLS handshake. */
+        #if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+            /* Resume the previous session to the server, without ECDHE and certificate verification. */
+            if( pNetworkCredentials->disableSessionResumption == pdFALSE )
+            {
+                TlsCommon_SessionCacheLoad( &( pNetworkContext->sslContext ), pHostName );
+            }
+        #endif
+
+        pNetworkContext->sslContext.pHostName = pHostName;
+        pNetworkContext->sslContext.handshakeStart = xTaskGetTickCount();
+
+        #if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+            /* The peak of the first phase starts from the memory held once the contexts are set up. */
+            ( void ) memset( pNetworkContext->sslContext.profile.cpuCycles, 0, sizeof( pNetworkContext->sslContext.profile.cpuCycles ) );
+            ( void ) memset( pNetworkContext->sslContext.profile.waitUs, 0, sizeof( pNetworkContext->sslContext.profile.waitUs ) );
+            ( void ) memset( pNetworkContext->sslContext.profile.peakBytes, 0, sizeof( pNetworkContext->sslContext.profile.peakBytes ) );
+            pNetworkContext->sslContext.profile.signCycles = 0U;
+            pNetworkContext->sslContext.profile.recvCycles = 0U;
+            ( void ) mbedtls_platform_take_peak_bytes();
+            pNetworkContext->sslContext.profile.lastCycles = DWT->CYCCNT;
+        #endif
+    }
+
+    if( returnStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        TlsBackend_Free( &( pNetworkContext->sslContext ) );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TlsBackend_Handshake( NetworkContext_t * pNetworkContext,
+                                           BaseType_t xSingleStep )
+{
+    SSLContext_t * pSslContext = &( pNetworkContext->sslContext );
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+    int32_t mbedtlsError = 0;
+
+    if( xSingleStep == pdTRUE )
+    {
+        mbedtlsError = CryptoWorker_Run( tlsHandshakeStepJob, pSslContext );
+
+        if( mbedtlsError == MBEDTLS_ERR_SSL_WANT_READ )
+        {
+            returnStatus = TLS_TRANSPORT_WANT_READ;
+        }
+        else if( ( mbedtlsError == MBEDTLS_ERR_SSL_WANT_WRITE ) ||
+                 ( ( mbedtlsError == 0 ) && ( pSslContext->context.state != MBEDTLS_SSL_HANDSHAKE_OVER ) ) )
+        {
+            returnStatus = TLS_TRANSPORT_IN_PROGRESS;
+        }
+        else
+        {
+            /* Empty else for MISRA 15.7 compliance. */
+        }
+    }
+    else
+    {
+        /* The states of mbedtls_ssl_handshake(), one job each. */
         do
         {
-            mbedtlsError = mbedtls_ssl_handshake( &( pNetworkContext->sslContext.context ) );
+            mbedtlsError = CryptoWorker_Run( tlsHandshakeStepJob, pSslContext );
         } while( ( mbedtlsError == MBEDTLS_ERR_SSL_WANT_READ ) ||
-                 ( mbedtlsError == MBEDTLS_ERR_SSL_WANT_WRITE ) );
+                 ( mbedtlsError == MBEDTLS_ERR_SSL_WANT_WRITE ) ||
+                 ( ( mbedtlsError == 0 ) && ( pSslContext->context.state != MBEDTLS_SSL_HANDSHAKE_OVER ) ) );
+    }
+
+    if( ( returnStatus != TLS_TRANSPORT_IN_PROGRESS ) && ( returnStatus != TLS_TRANSPORT_WANT_READ ) )
+    {
+        #if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+            TlsCommon_SessionCacheStore( pSslContext, pSslContext->pHostName, ( mbedtlsError == 0 ) ? pdTRUE : pdFALSE );
+        #endif
+
+        #if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+            profilePrint( pSslContext, mbedtlsError );
+        #endif
 
         if( mbedtlsError != 0 )
         {
-            LogError( ( "Failed to perform TLS handshake: mbedTLSError= %s : %s.",
-                        mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
-                        mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+            LogError( ( "Failed to perform TLS handshake: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( mbedtlsError ) ) );
 
+            TlsBackend_Free( pSslContext );
             returnStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
         }
-    }
-
-    if( returnStatus != TLS_TRANSPORT_SUCCESS )
-    {
-        sslContextFree( &( pNetworkContext->sslContext ) );
-    }
-    else
-    {
-        LogInfo( ( "(Network connection %p) TLS handshake successful.",
-                   pNetworkContext ) );
+        else
+        {
+            LogInfo( ( "(Network connection %p) TLS handshake successful in %lu ms.",
+                       pNetworkContext,
+                       ( unsigned long ) ( ( xTaskGetTickCount() - pSslContext->handshakeStart ) * portTICK_PERIOD_MS ) ) );
+        }
     }
 
     return returnStatus;
@@ -467,112 +815,272 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
 /*-----------------------------------------------------------*/
 
-static TlsTransportStatus_t initMbedtls( void )
+static int32_t tlsHandshakeStepJob( void * pvContext )
 {
-    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+    SSLContext_t * pSslContext = ( SSLContext_t * ) pvContext;
 
-    /* Set the mutex functions for mbed TLS thread safety. */
-    mbedtls_threading_set_alt( mbedtls_platform_mutex_init,
-                               mbedtls_platform_mutex_free,
-                               mbedtls_platform_mutex_lock,
-                               mbedtls_platform_mutex_unlock );
+    #if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+        TlsHandshakeProfile_t * pProfile = &( pSslContext->profile );
+        TlsHandshakePhase_t phase = profilePhase( pSslContext->context.state );
+        uint32_t startCycles = DWT->CYCCNT;
+        uint32_t peakBytes;
+        int32_t mbedtlsError;
 
-    if( returnStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        LogDebug( ( "Successfully initialized mbedTLS." ) );
-    }
+        /* Since the previous step, the state waited for its record or for the crypto worker. */
+        pProfile->waitUs[ phase ] += tlsCYCLES_TO_US( startCycles - pProfile->lastCycles );
+        pProfile->recvCycles = 0U;
 
-    return returnStatus;
+        mbedtlsError = mbedtls_ssl_handshake_step( &( pSslContext->context ) );
+
+        pProfile->lastCycles = DWT->CYCCNT;
+        pProfile->cpuCycles[ phase ] += ( pProfile->lastCycles - startCycles ) - pProfile->recvCycles;
+        pProfile->waitUs[ phase ] += tlsCYCLES_TO_US( pProfile->recvCycles );
+
+        peakBytes = mbedtls_platform_take_peak_bytes();
+
+        if( peakBytes > pProfile->peakBytes[ phase ] )
+        {
+            pProfile->peakBytes[ phase ] = peakBytes;
+        }
+
+        return mbedtlsError;
+    #else /* if ( tlsconfigHANDSHAKE_PROFILE == 1 ) */
+        return mbedtls_ssl_handshake_step( &( pSslContext->context ) );
+    #endif /* if ( tlsconfigHANDSHAKE_PROFILE == 1 ) */
 }
 
 /*-----------------------------------------------------------*/
 
-static int generateRandomBytes( void * pvCtx,
-                                    unsigned char * pucRandom,
-                                    size_t xRandomLength )
+static void tlsSetBio( NetworkContext_t * pNetworkContext,
+                       int ( * pRecv )( void * ctx,
+                                        unsigned char * buf,
+                                        size_t len ) )
 {
-    /* Must cast from void pointer to conform to mbed TLS API. */
-    SSLContext_t * pxCtx = ( SSLContext_t * ) pvCtx;
-    CK_RV xResult;
+    #if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+        pNetworkContext->sslContext.profile.pRecv = pRecv;
+
+        mbedtls_ssl_set_bio( &( pNetworkContext->sslContext.context ),
+                             ( void * ) pNetworkContext,
+                             tlsProfiledSend,
+                             tlsProfiledRecv,
+                             NULL );
+    #else
+
+        /* MISRA Rule 11.2 flags the following line for casting the second
+         * parameter to void *. This rule is suppressed because
+         * #mbedtls_ssl_set_bio requires the second parameter as void *.
+         */
+        /* coverity[misra_c_2012_rule_11_2_violation] */
+        mbedtls_ssl_set_bio( &( pNetworkContext->sslContext.context ),
+                             ( void * ) pNetworkContext->tcpSocket,
+                             mbedtls_platform_send,
+                             pRecv,
+                             NULL );
+    #endif /* if ( tlsconfigHANDSHAKE_PROFILE == 1 ) */
+}
 
-    xResult = pxCtx->pxP11FunctionList->C_GenerateRandom( pxCtx->xP11Session, pucRandom, xRandomLength );
+/*-----------------------------------------------------------*/
 
-    if( xResult != CKR_OK )
+#if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+
+    static int tlsProfiledSend( void * ctx,
+                                const unsigned char * buf,
+                                size_t len )
     {
-        LogError( ( "Failed to generate random bytes from the PKCS #11 module." ) );
-    }
+        NetworkContext_t * pNetworkContext = ( NetworkContext_t * ) ctx;
 
-    return xResult;
-}
+        /* coverity[misra_c_2012_rule_11_2_violation] */
+        return mbedtls_platform_send( ( void * ) pNetworkContext->tcpSocket, buf, len );
+    }
 
 /*-----------------------------------------------------------*/
 
-static CK_RV readCertificateIntoContext( SSLContext_t * pSslContext,
-                                         char * pcLabelName,
-                                         CK_OBJECT_CLASS xClass,
-                                         mbedtls_x509_crt * pxCertificateContext )
-{
-    CK_RV xResult = CKR_OK;
-    CK_ATTRIBUTE xTemplate = { 0 };
-    CK_OBJECT_HANDLE xCertObj = 0;
+    static int tlsProfiledRecv( void * ctx,
+                                unsigned char * buf,
+                                size_t len )
+    {
+        NetworkContext_t * pNetworkContext = ( NetworkContext_t * ) ctx;
+        TlsHandshakeProfile_t * pProfile = &( pNetworkContext->sslContext.profile );
+        uint32_t startCycles = DWT->CYCCNT;
+        int result;
+
+        /* coverity[misra_c_2012_rule_11_2_violation] */
+        result = pProfile->pRecv( ( void * ) pNetworkContext->tcpSocket, buf, len );
 
-    /* Get the handle of the certificate. */
-    xResult = xFindObjectWithLabelAndClass( pSslContext->xP11Session,
-                                            pcLabelName,
-                                            xClass,
-                                            &xCertObj );
+        /* Only read by the handshake steps, which clear it first. */
+        pProfile->recvCycles += DWT->CYCCNT - startCycles;
 
-    if( ( CKR_OK == xResult ) && ( xCertObj == CK_INVALID_HANDLE ) )
+        return result;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int profiledSigningCallback( void * pvContext,
+                                        mbedtls_md_type_t xMdAlg,
+                                        const unsigned char * pucHash,
+                                        size_t xHashLen,
+                                        unsigned char * pucSig,
+                                        size_t * pxSigLen,
+                                        int ( * piRng )( void *,
+                                                         unsigned char *,
+                                                         size_t ),
+                                        void * pvRng )
     {
-        xResult = CKR_OBJECT_HANDLE_INVALID;
+        SSLContext_t * pSslContext = ( SSLContext_t * ) pvContext;
+        uint32_t startCycles = DWT->CYCCNT;
+        int result;
+
+        result = tlsSIGNING_CALLBACK( pvContext, xMdAlg, pucHash, xHashLen, pucSig, pxSigLen, piRng, pvRng );
+
+        pSslContext->profile.signCycles += DWT->CYCCNT - startCycles;
+
+        return result;
     }
 
-    /* Query the certificate size. */
-    if( CKR_OK == xResult )
+/*-----------------------------------------------------------*/
+
+    static TlsHandshakePhase_t profilePhase( int state )
     {
-        xTemplate.type = CKA_VALUE;
-        xTemplate.ulValueLen = 0;
-        xTemplate.pValue = NULL;
-        xResult = pSslContext->pxP11FunctionList->C_GetAttributeValue( pSslContext->xP11Session,
-                                                                       xCertObj,
-                                                                       &xTemplate,
-                                                                       1 );
+        TlsHandshakePhase_t phase;
+
+        switch( state )
+        {
+            case MBEDTLS_SSL_HELLO_REQUEST:
+            case MBEDTLS_SSL_CLIENT_HELLO:
+            case MBEDTLS_SSL_SERVER_HELLO:
+                phase = TLS_PHASE_HELLO;
+                break;
+
+            case MBEDTLS_SSL_SERVER_CERTIFICATE:
+                phase = TLS_PHASE_CERT;
+                break;
+
+            case MBEDTLS_SSL_SERVER_KEY_EXCHANGE:
+            case MBEDTLS_SSL_CERTIFICATE_REQUEST:
+            case MBEDTLS_SSL_SERVER_HELLO_DONE:
+            case MBEDTLS_SSL_CLIENT_CERTIFICATE:
+            case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+                phase = TLS_PHASE_ECDHE;
+                break;
+
+            case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+                phase = TLS_PHASE_SIGN;
+                break;
+
+            default:
+                phase = TLS_PHASE_FINISHED;
+                break;
+        }
+
+        return phase;
     }
 
-    /* Create a buffer for the certificate. */
-    if( CKR_OK == xResult )
+/*-----------------------------------------------------------*/
+
+    static void profilePrint( const SSLContext_t * pSslContext,
+                              int32_t mbedtlsError )
     {
-        xTemplate.pValue = pvPortMalloc( xTemplate.ulValueLen );
+        const TlsHandshakeProfile_t * pProfile = &( pSslContext->profile );
+        char line[ 48 * TLS_PHASE_COUNT ];
+        size_t length = 0U;
+        size_t phase;
+        int written;
+
+        line[ 0 ] = '\0';
 
-        if( NULL == xTemplate.pValue )
+        for( phase = 0U; phase < ( size_t ) TLS_PHASE_COUNT; phase++ )
         {
-            xResult = CKR_HOST_MEMORY;
+            written = snprintf( &( line[ length ] ), sizeof( line ) - length, ",%lu,%lu,%lu",
+                                ( unsigned long ) tlsCYCLES_TO_US( pProfile->cpuCycles[ phase ] ),
+                                ( unsigned long ) pProfile->waitUs[ phase ],
+                                ( unsigned long ) pProfile->peakBytes[ phase ] );
+
+            if( ( written > 0 ) && ( ( size_t ) written < ( sizeof( line ) - length ) ) )
+            {
+                length += ( size_t ) written;
+            }
         }
+
+        PRINTF( "TLS_HS,%s,%ld,%lu,%lu%s\r\n",
+                ( pSslContext->pHostName != NULL ) ? pSslContext->pHostName : "",
+                ( long ) mbedtlsError,
+                ( unsigned long ) ( ( xTaskGetTickCount() - pSslContext->handshakeStart ) * portTICK_PERIOD_MS ),
+                ( unsigned long ) tlsCYCLES_TO_US( pProfile->signCycles ),
+                line );
     }
 
-    /* Export the certificate. */
-    if( CKR_OK == xResult )
+#endif /* tlsconfigHANDSHAKE_PROFILE == 1 */
+
+/*-----------------------------------------------------------*/
+
+static int tlsRecvNonBlocking( void * ctx,
+                               unsigned char * buf,
+                               size_t len )
+{
+    int result = mbedtls_platform_recv( ctx, buf, len );
+
+    /* Without receive timeout, FreeRTOS_recv() returns 0 when no data is available
+     * and a negative error once the connection is closed. */
+    if( result == 0 )
     {
-        xResult = pSslContext->pxP11FunctionList->C_GetAttributeValue( pSslContext->xP11Session,
-                                                                       xCertObj,
-                                                                       &xTemplate,
-                                                                       1 );
+        result = MBEDTLS_ERR_SSL_WANT_READ;
     }
 
-    /* Decode the certificate. */
-    if( CKR_OK == xResult )
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+void TlsBackend_SetNonBlocking( NetworkContext_t * pNetworkContext,
+                                BaseType_t xNonBlocking )
+{
+    tlsSetBio( pNetworkContext, ( xNonBlocking == pdTRUE ) ? tlsRecvNonBlocking : mbedtls_platform_recv );
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TlsBackend_Init( void )
+{
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+
+    /* Set the mutex functions for mbed TLS thread safety, once for all connections and PKCS #11.
+     * Random bytes come from the DRBG of the PKCS #11 module, seeded once, see generateRandomBytes(). */
+    mbedtls_platform_threading_init();
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
     {
-        xResult = mbedtls_x509_crt_parse( pxCertificateContext,
-                                          ( const unsigned char * ) xTemplate.pValue,
-                                          xTemplate.ulValueLen );
+        LogDebug( ( "Successfully initialized mbedTLS." ) );
     }
 
-    /* Free memory. */
-    vPortFree( xTemplate.pValue );
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static int generateRandomBytes( void * pvCtx,
+                                    unsigned char * pucRandom,
+                                    size_t xRandomLength )
+{
+    /* Must cast from void pointer to conform to mbed TLS API. */
+    SSLContext_t * pxCtx = ( SSLContext_t * ) pvCtx;
+    Pkcs11Lease_t xLease;
+    CK_RV xResult;
+
+    xResult = xPkcs11PoolAcquire( &xLease, portMAX_DELAY );
+
+    if( xResult == CKR_OK )
+    {
+        xResult = pxCtx->pxP11FunctionList->C_GenerateRandom( xLease.xSession, pucRandom, xRandomLength );
+        vPkcs11PoolRelease( &xLease, xResult );
+    }
+
+    if( xResult != CKR_OK )
+    {
+        LogError( ( "Failed to generate random bytes from the PKCS #11 module." ) );
+    }
 
     return xResult;
 }
-
 /*-----------------------------------------------------------*/
 
 /**
@@ -585,109 +1093,65 @@ static CK_RV readCertificateIntoContext( SSLContext_t * pSslContext,
  */
 static CK_RV initializeClientKeys( SSLContext_t * pxCtx )
 {
-    CK_RV xResult = CKR_OK;
-    CK_SLOT_ID * pxSlotIds = NULL;
-    CK_ULONG xCount = 0;
-    CK_ATTRIBUTE xTemplate[ 2 ];
-    mbedtls_pk_type_t xKeyAlgo = ( mbedtls_pk_type_t ) ~0;
+    CK_RV xResult;
+    mbedtls_pk_type_t xKeyAlgo;
 
-    /* Get the PKCS #11 module/token slot count. */
-    if( CKR_OK == xResult )
-    {
-        xResult = ( BaseType_t ) pxCtx->pxP11FunctionList->C_GetSlotList( CK_TRUE,
-                                                                          NULL,
-                                                                          &xCount );
-    }
+    xResult = TlsCommon_InitClientKey( pxCtx );
 
-    /* Allocate memory to store the token slots. */
-    if( CKR_OK == xResult )
+    /* Map the mbedTLS algorithm to its internal metadata. */
+    if( xResult == CKR_OK )
     {
-        pxSlotIds = ( CK_SLOT_ID * ) pvPortMalloc( sizeof( CK_SLOT_ID ) * xCount );
+        /* Map the PKCS #11 key type to an mbedTLS algorithm. */
+        xKeyAlgo = ( pxCtx->xKeyType == CKK_RSA ) ? MBEDTLS_PK_RSA : MBEDTLS_PK_ECKEY;
 
-        if( NULL == pxSlotIds )
-        {
-            xResult = CKR_HOST_MEMORY;
-        }
-    }
+        memcpy( &pxCtx->privKeyInfo, mbedtls_pk_info_from_type( xKeyAlgo ), sizeof( mbedtls_pk_info_t ) );
 
-    /* Get all of the available private key slot identities. */
-    if( CKR_OK == xResult )
-    {
-        xResult = ( BaseType_t ) pxCtx->pxP11FunctionList->C_GetSlotList( CK_TRUE,
-                                                                          pxSlotIds,
-                                                                          &xCount );
+        #if ( tlsconfigHANDSHAKE_PROFILE == 1 )
+            pxCtx->privKeyInfo.sign_func = profiledSigningCallback;
+        #else
+            pxCtx->privKeyInfo.sign_func = tlsSIGNING_CALLBACK;
+        #endif
+        pxCtx->privKey.pk_info = &pxCtx->privKeyInfo;
+        pxCtx->privKey.pk_ctx = pxCtx;
     }
 
-    /* Put the module in authenticated mode. */
-    if( CKR_OK == xResult )
-    {
-        xResult = ( BaseType_t ) pxCtx->pxP11FunctionList->C_Login( pxCtx->xP11Session,
-                                                                    CKU_USER,
-                                                                    ( CK_UTF8CHAR_PTR ) configPKCS11_DEFAULT_USER_PIN,
-                                                                    sizeof( configPKCS11_DEFAULT_USER_PIN ) - 1 );
-    }
+    return xResult;
+}
 
-    if( CKR_OK == xResult )
-    {
-        /* Get the handle of the device private key. */
-        xResult = xFindObjectWithLabelAndClass( pxCtx->xP11Session,
-                                                pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
-                                                CKO_PRIVATE_KEY,
-                                                &pxCtx->xP11PrivateKey );
-    }
+/*-----------------------------------------------------------*/
 
-    if( ( CKR_OK == xResult ) && ( pxCtx->xP11PrivateKey == CK_INVALID_HANDLE ) )
-    {
-        xResult = CK_INVALID_HANDLE;
-        LogError( ( "Could not find private key." ) );
-    }
+#if defined( MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED )
 
-    /* Query the device private key type. */
-    if( xResult == CKR_OK )
+    static CK_RV configurePsk( SSLContext_t * pSslContext )
     {
-        xTemplate[ 0 ].type = CKA_KEY_TYPE;
-        xTemplate[ 0 ].pValue = &pxCtx->xKeyType;
-        xTemplate[ 0 ].ulValueLen = sizeof( CK_KEY_TYPE );
-        xResult = pxCtx->pxP11FunctionList->C_GetAttributeValue( pxCtx->xP11Session,
-                                                                 pxCtx->xP11PrivateKey,
-                                                                 xTemplate,
-                                                                 1 );
-    }
+        CK_RV xResult;
+        TlsPsk_t xPsk;
+        int32_t mbedtlsError;
 
-    /* Map the PKCS #11 key type to an mbedTLS algorithm. */
-    if( xResult == CKR_OK )
-    {
-        switch( pxCtx->xKeyType )
+        xResult = TlsCommon_ReadPsk( &xPsk );
+
+        if( xResult == CKR_OK )
         {
-            case CKK_RSA:
-                xKeyAlgo = MBEDTLS_PK_RSA;
-                break;
+            /* mbed TLS keeps copies of both in the configuration, freed with it. */
+            mbedtlsError = mbedtls_ssl_conf_psk( &( pSslContext->config ),
+                                                 xPsk.pucKey, xPsk.ulKeySize,
+                                                 xPsk.pucIdentity, xPsk.ulIdentitySize );
 
-            case CKK_EC:
-                xKeyAlgo = MBEDTLS_PK_ECKEY;
-                break;
+            if( mbedtlsError != 0 )
+            {
+                LogError( ( "Failed to configure the pre-shared key: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                            mbedtlsErrorArgs( mbedtlsError ) ) );
 
-            default:
-                xResult = CKR_ATTRIBUTE_VALUE_INVALID;
-                break;
-        }
-    }
+                xResult = CKR_FUNCTION_FAILED;
+            }
 
-    /* Map the mbedTLS algorithm to its internal metadata. */
-    if( xResult == CKR_OK )
-    {
-        memcpy( &pxCtx->privKeyInfo, mbedtls_pk_info_from_type( xKeyAlgo ), sizeof( mbedtls_pk_info_t ) );
+            TlsCommon_FreePsk( &xPsk );
+        }
 
-        pxCtx->privKeyInfo.sign_func = privateKeySigningCallback;
-        pxCtx->privKey.pk_info = &pxCtx->privKeyInfo;
-        pxCtx->privKey.pk_ctx = pxCtx;
+        return xResult;
     }
 
-    /* Free memory. */
-    vPortFree( pxSlotIds );
-
-    return xResult;
-}
+#endif /* if defined( MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED ) */
 
 /*-----------------------------------------------------------*/
 
@@ -703,177 +1167,94 @@ static int privateKeySigningCallback( void * pvContext,
                                           void * pvRng )
 {
     CK_RV xResult = CKR_OK;
-    int32_t lFinalResult = 0;
     SSLContext_t * pxTLSContext = ( SSLContext_t * ) pvContext;
-    CK_MECHANISM xMech = { 0 };
-    CK_BYTE xToBeSigned[ 256 ];
-    CK_ULONG xToBeSignedLen = sizeof( xToBeSigned );
+    CK_BYTE xRsaToBeSigned[ pkcs11RSA_SIGNATURE_INPUT_LENGTH ];
+    CK_ULONG xSignatureLen = MBEDTLS_MPI_MAX_SIZE;
 
     /* Unreferenced parameters. */
     ( void ) ( piRng );
     ( void ) ( pvRng );
     ( void ) ( xMdAlg );
 
-    /* Sanity check buffer length. */
-    if( xHashLen > sizeof( xToBeSigned ) )
-    {
-        xResult = CKR_ARGUMENTS_BAD;
-    }
-
-    /* Format the hash data to be signed. */
     if( CKK_RSA == pxTLSContext->xKeyType )
     {
-        xMech.mechanism = CKM_RSA_PKCS;
-
         /* mbedTLS expects hashed data without padding, but PKCS #11 C_Sign function performs a hash
          * & sign if hash algorithm is specified.  This helper function applies padding
          * indicating data was hashed with SHA-256 while still allowing pre-hashed data to
          * be provided. */
-        xResult = vAppendSHA256AlgorithmIdentifierSequence( ( uint8_t * ) pucHash, xToBeSigned );
-        xToBeSignedLen = pkcs11RSA_SIGNATURE_INPUT_LENGTH;
-    }
-    else if( CKK_EC == pxTLSContext->xKeyType )
-    {
-        xMech.mechanism = CKM_ECDSA;
-        memcpy( xToBeSigned, pucHash, xHashLen );
-        xToBeSignedLen = xHashLen;
-    }
-    else
-    {
-        xResult = CKR_ARGUMENTS_BAD;
-    }
-
-    if( CKR_OK == xResult )
-    {
-        /* Use the PKCS#11 module to sign. */
-        xResult = pxTLSContext->pxP11FunctionList->C_SignInit( pxTLSContext->xP11Session,
-                                                               &xMech,
-                                                               pxTLSContext->xP11PrivateKey );
-    }
-
-    if( CKR_OK == xResult )
-    {
-        *pxSigLen = sizeof( xToBeSigned );
-        xResult = pxTLSContext->pxP11FunctionList->C_Sign( ( CK_SESSION_HANDLE ) pxTLSContext->xP11Session,
-                                                           xToBeSigned,
-                                                           xToBeSignedLen,
-                                                           pucSig,
-                                                           ( CK_ULONG_PTR ) pxSigLen );
-    }
+        if( xHashLen != pkcs11SHA256_DIGEST_LENGTH )
+        {
+            xResult = CKR_ARGUMENTS_BAD;
+        }
+        else
+        {
+            xResult = vAppendSHA256AlgorithmIdentifierSequence( ( uint8_t * ) pucHash, xRsaToBeSigned );
+        }
 
-    if( ( xResult == CKR_OK ) && ( CKK_EC == pxTLSContext->xKeyType ) )
-    {
-        /* PKCS #11 for P256 returns a 64-byte signature with 32 bytes for R and 32 bytes for S.
-         * This must be converted to an ASN.1 encoded array. */
-        if( *pxSigLen != pkcs11ECDSA_P256_SIGNATURE_LENGTH )
+        if( xResult == CKR_OK )
         {
-            xResult = CKR_FUNCTION_FAILED;
+            xResult = TlsCommon_Sign( pxTLSContext, CKM_RSA_PKCS, xRsaToBeSigned, pkcs11RSA_SIGNATURE_INPUT_LENGTH,
+                                      pucSig, &xSignatureLen );
         }
 
         if( xResult == CKR_OK )
         {
-            PKI_pkcs11SignatureTombedTLSSignature( pucSig, pxSigLen );
+            *pxSigLen = ( size_t ) xSignatureLen;
         }
     }
-
-    if( xResult != CKR_OK )
+    else
     {
-        LogError( ( "Failed to sign message using PKCS #11 with error code %02X.", xResult ) );
-        lFinalResult = -1;
+        /* The output buffer of mbed TLS holds MBEDTLS_ECDSA_MAX_LEN bytes. */
+        xResult = TlsCommon_SignEcdsa( pxTLSContext, pucHash, xHashLen, pucSig, pxSigLen );
     }
 
-    return lFinalResult;
+    return ( xResult == CKR_OK ) ? 0 : -1;
 }
 
 /*-----------------------------------------------------------*/
 
-TlsTransportStatus_t TLS_FreeRTOS_Connect( NetworkContext_t * pNetworkContext,
-                                           const char * pHostName,
-                                           uint16_t port,
-                                           const NetworkCredentials_t * pNetworkCredentials,
-                                           uint32_t receiveTimeoutMs,
-                                           uint32_t sendTimeoutMs )
-{
-    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
-    BaseType_t socketStatus = 0;
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
 
-    if( ( pNetworkContext == NULL ) ||
-        ( pHostName == NULL ) ||
-        ( pNetworkCredentials == NULL ) )
-    {
-        LogError( ( "Invalid input parameter(s): Arguments cannot be NULL. pNetworkContext=%p, "
-                    "pHostName=%p, pNetworkCredentials=%p.",
-                    pNetworkContext,
-                    pHostName,
-                    pNetworkCredentials ) );
-        returnStatus = TLS_TRANSPORT_INVALID_PARAMETER;
-    }
-    else if( ( pNetworkCredentials->pRootCa == NULL ) )
-    {
-        LogError( ( "pRootCa cannot be NULL." ) );
-        returnStatus = TLS_TRANSPORT_INVALID_PARAMETER;
-    }
-    else
+/**
+ * @brief Signs with the private key parsed by the PAL, straight into the buffer of mbed TLS.
+ * Falls back to C_Sign, which reports the error, if the key cannot be parsed any more.
+ */
+    static int cachedKeySigningCallback( void * pvContext,
+                                         mbedtls_md_type_t xMdAlg,
+                                         const unsigned char * pucHash,
+                                         size_t xHashLen,
+                                         unsigned char * pucSig,
+                                         size_t * pxSigLen,
+                                         int ( * piRng )( void *,
+                                                          unsigned char *,
+                                                          size_t ),
+                                         void * pvRng )
     {
-        /* Empty else for MISRA 15.7 compliance. */
-    }
+        int lResult;
 
-    /* Establish a TCP connection with the server. */
-    if( returnStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        socketStatus = Sockets_Connect( &( pNetworkContext->tcpSocket ),
-                                        pHostName,
-                                        port,
-										receiveTimeoutMs,
-										sendTimeoutMs );
+        lResult = PKCS11_PAL_SignWithCachedKey( xMdAlg, pucHash, xHashLen, pucSig, pxSigLen, piRng, pvRng );
 
-        if( socketStatus != 0 )
+        if( lResult == MBEDTLS_ERR_PK_KEY_INVALID_FORMAT )
         {
-            LogError( ( "Failed to connect to %s with error %d.",
-                        pHostName,
-                        socketStatus ) );
-            returnStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+            lResult = privateKeySigningCallback( pvContext, xMdAlg, pucHash, xHashLen, pucSig, pxSigLen, piRng, pvRng );
         }
-    }
-
-    /* Initialize mbedtls. */
-    if( returnStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        returnStatus = initMbedtls();
-    }
-
-    /* Perform TLS handshake. */
-    if( returnStatus == TLS_TRANSPORT_SUCCESS )
-    {
-        returnStatus = tlsSetup( pNetworkContext, pHostName, pNetworkCredentials );
-    }
-
-    /* Clean up on failure. */
-    if( returnStatus != TLS_TRANSPORT_SUCCESS )
-    {
-        if( ( pNetworkContext != NULL ) &&
-            ( pNetworkContext->tcpSocket != FREERTOS_INVALID_SOCKET ) )
+        else if( lResult != 0 )
         {
-            ( void ) FreeRTOS_closesocket( pNetworkContext->tcpSocket );
+            LogError( ( "Failed to sign message with the cached key: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                        mbedtlsErrorArgs( lResult ) ) );
         }
-    }
-    else
-    {
-        LogInfo( ( "(Network connection %p) Connection to %s established.",
-                   pNetworkContext,
-                   pHostName ) );
+
+        return lResult;
     }
 
-    return returnStatus;
-}
+#endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 ) */
 
 /*-----------------------------------------------------------*/
 
-void TLS_FreeRTOS_Disconnect( NetworkContext_t * pNetworkContext )
+void TlsBackend_Shutdown( NetworkContext_t * pNetworkContext )
 {
     BaseType_t tlsStatus = 0;
 
-    /* Attempting to terminate TLS connection. */
     tlsStatus = ( BaseType_t ) mbedtls_ssl_close_notify( &( pNetworkContext->sslContext.context ) );
 
     /* Ignore the WANT_READ and WANT_WRITE return values. */
@@ -887,10 +1268,9 @@ void TLS_FreeRTOS_Disconnect( NetworkContext_t * pNetworkContext )
         }
         else
         {
-            LogError( ( "(Network connection %p) Failed to send TLS close-notify: mbedTLSError= %s : %s.",
+            LogError( ( "(Network connection %p) Failed to send TLS close-notify: mbedTLSError= " mbedtlsERROR_FORMAT ".",
                         pNetworkContext,
-                        mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                        mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+                        mbedtlsErrorArgs( tlsStatus ) ) );
         }
     }
     else
@@ -899,37 +1279,29 @@ void TLS_FreeRTOS_Disconnect( NetworkContext_t * pNetworkContext )
         LogInfo( ( "TLS close-notify sent received %s as the TLS status can be ignored for close-notify.",
                    ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ? "WANT_READ" : "WANT_WRITE" ) );
     }
-
-    /* Call socket shutdown function to close connection. */
-    Sockets_Disconnect( pNetworkContext->tcpSocket );
-
-    /* Free mbed TLS contexts. */
-    sslContextFree( &( pNetworkContext->sslContext ) );
-
-    /* Clear the mutex functions for mbed TLS thread safety. */
-    mbedtls_threading_free_alt();
 }
 
 /*-----------------------------------------------------------*/
 
-int32_t TLS_FreeRTOS_recv( const NetworkContext_t * pNetworkContext,
-                           void * pBuffer,
-                           size_t bytesToRecv )
+int32_t TlsBackend_Read( SSLContext_t * pSslContext,
+                         void * pBuffer,
+                         size_t bytesToRecv )
 {
     int32_t tlsStatus = 0;
 
-    tlsStatus = ( int32_t ) mbedtls_ssl_read( ( mbedtls_ssl_context * ) &( pNetworkContext->sslContext.context ),
+    PROBE_BEGIN( PROBE_TLS_RECV );
+    tlsStatus = ( int32_t ) mbedtls_ssl_read( &( pSslContext->context ),
                                               pBuffer,
                                               bytesToRecv );
+    PROBE_END( PROBE_TLS_RECV );
 
     if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
         ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
         ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
     {
         LogDebug( ( "Failed to read data. However, a read can be retried on this error. "
-                    "mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+                    "mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
 
         /* Mark these set of errors as a timeout. The libraries may retry read
          * on these errors. */
@@ -937,9 +1309,8 @@ int32_t TLS_FreeRTOS_recv( const NetworkContext_t * pNetworkContext,
     }
     else if( tlsStatus < 0 )
     {
-        LogError( ( "Failed to read data: mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+        LogError( ( "Failed to read data: mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
     }
     else
     {
@@ -951,34 +1322,35 @@ int32_t TLS_FreeRTOS_recv( const NetworkContext_t * pNetworkContext,
 
 /*-----------------------------------------------------------*/
 
-int32_t TLS_FreeRTOS_send( const NetworkContext_t * pNetworkContext,
-                           const void * pBuffer,
-                           size_t bytesToSend )
+int32_t TlsBackend_Write( SSLContext_t * pSslContext,
+                          const void * pBuffer,
+                          size_t bytesToSend )
 {
     int32_t tlsStatus = 0;
 
-    tlsStatus = ( int32_t ) mbedtls_ssl_write( ( mbedtls_ssl_context * ) &( pNetworkContext->sslContext.context ),
+    PROBE_BEGIN( PROBE_TLS_SEND );
+    tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pSslContext->context ),
                                                pBuffer,
                                                bytesToSend );
+    PROBE_END( PROBE_TLS_SEND );
 
     if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
         ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
         ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
     {
         LogDebug( ( "Failed to send data. However, send can be retried on this error. "
-                    "mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+                    "mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
 
         /* Mark these set of errors as a timeout. The libraries may retry send
          * on these errors. */
         tlsStatus = 0;
+        TlsCommon_CountSendTimeout();
     }
     else if( tlsStatus < 0 )
     {
-        LogError( ( "Failed to send data:  mbedTLSError= %s : %s.",
-                    mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                    mbedtlsLowLevelCodeOrDefault( tlsStatus ) ) );
+        LogError( ( "Failed to send data:  mbedTLSError= " mbedtlsERROR_FORMAT ".",
+                    mbedtlsErrorArgs( tlsStatus ) ) );
     }
     else
     {
@@ -989,7 +1361,23 @@ int32_t TLS_FreeRTOS_send( const NetworkContext_t * pNetworkContext,
 }
 /*-----------------------------------------------------------*/
 
-void TLS_FreeRTOS_SetRecvTimeout( NetworkContext_t * pNetworkContext, uint32_t timeoutMS )
+BaseType_t TLS_FreeRTOS_HasPendingData( NetworkContext_t * pNetworkContext )
 {
-	Sockets_SetReceiveTimeout( pNetworkContext->tcpSocket, timeoutMS );
+    BaseType_t xPending = pdFALSE;
+
+    if( pNetworkContext != NULL )
+    {
+        /* Decrypted data buffered in the SSL context, a partially read record, or
+         * received bytes in the socket stream not yet passed to mbed TLS. */
+        if( ( mbedtls_ssl_get_bytes_avail( &( pNetworkContext->sslContext.context ) ) > 0U ) ||
+            ( mbedtls_ssl_check_pending( &( pNetworkContext->sslContext.context ) ) != 0 ) ||
+            ( FreeRTOS_recvcount( pNetworkContext->tcpSocket ) > 0 ) )
+        {
+            xPending = pdTRUE;
+        }
+    }
+
+    return xPending;
 }
+
+#endif /* if ( tlsconfigUSE_WOLFSSL == 0 ) */
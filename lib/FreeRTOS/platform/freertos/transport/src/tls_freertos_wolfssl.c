@@ -0,0 +1,1392 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file tls_freertos_wolfssl.c
+ * @brief TLS transport interface implementations. This implementation uses
+ * wolfSSL, selected with tlsconfigUSE_WOLFSSL, see tls_freertos_pkcs11.c for the
+ * mbed TLS one. The parts independent of the TLS library are in tls_freertos_common.c.
+ * @note The device key stays in PKCS #11 as with mbed TLS: wolfSSL signs the
+ * certificate verify through the PK callbacks of HAVE_PK_CALLBACKS, see
+ * docs/wolfSSL-migration-guide/migrating_to_wolfssl.md.
+ */
+
+#include "logging_levels.h"
+
+#ifndef LIBRARY_LOG_NAME
+    #define LIBRARY_LOG_NAME    "TLS_WOLFSSL"
+#endif
+
+#ifndef LIBRARY_LOG_LEVEL
+    #define LIBRARY_LOG_LEVEL    LOG_DEBUG
+#endif
+
+#include "logging_stack.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/* FreeRTOS+TCP includes. */
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+
+/* TLS transport headers. */
+#include "tls_freertos_pkcs11.h"
+#include "tls_freertos_common.h"
+
+/* The mbed TLS build implements the transport in tls_freertos_pkcs11.c. */
+#if ( tlsconfigUSE_WOLFSSL == 1 )
+
+/* FreeRTOS Socket wrapper include. */
+#include "freertos_sockets_wrapper.h"
+
+/* wolfSSL includes. */
+#include "wolfssl/wolfcrypt/error-crypt.h"
+
+/* PKCS #11 includes. */
+#include "core_pkcs11_config.h"
+#include "core_pkcs11.h"
+#include "pkcs11.h"
+#include "core_pki_utils.h"
+
+/* Latency probes include, times the record layer calls. */
+#include "latency_probe.h"
+
+/* Crypto worker include, runs the handshakes below the periodic work. */
+#include "crypto_worker.h"
+
+/* Random bytes of wolfSSL and of the cached key signatures. */
+#include "entropy_pool.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Largest DER public key of the device key, as mbed TLS sizes it.
+ */
+#define tlsPUBLIC_KEY_DER_LENGTH    ( 38U + ( 2U * MBEDTLS_MPI_MAX_SIZE ) )
+
+/**
+ * @brief Size of the wolfSSL cipher list built from #NetworkCredentials.pCipherSuites.
+ */
+#define tlsCIPHER_LIST_LENGTH       256U
+
+/**
+ * @brief Size of the wolfSSL ALPN list built from #NetworkCredentials.pAlpnProtos.
+ */
+#define tlsALPN_LIST_LENGTH         64U
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Initialize the fields of the SSL context of a network connection.
+ *
+ * @param[in] pSslContext The SSL context to initialize.
+ */
+static void sslContextInit( SSLContext_t * pSslContext );
+
+/**
+ * @brief Crypto worker job running wolfSSL_connect() until it completes or waits for the socket.
+ *
+ * @param[in] pvContext The SSL context.
+ *
+ * @return 0 once connected, else the code of wolfSSL_get_error().
+ */
+static int32_t tlsConnectJob( void * pvContext );
+
+/**
+ * @brief Create the wolfSSL context holding the root CA, the client certificate and the
+ * callbacks of the connections to a server.
+ *
+ * @param[in] pSslContext SSL context of the connection, for its PKCS #11 function list.
+ * @param[in] pNetworkCredentials TLS setup parameters.
+ * @param[in] usePsk pdTRUE for a context authenticating with the pre-shared key.
+ * @param[out] ppCtx Receives the context.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS, #TLS_TRANSPORT_INSUFFICIENT_MEMORY or #TLS_TRANSPORT_INVALID_CREDENTIALS.
+ */
+static TlsTransportStatus_t ctxCreate( SSLContext_t * pSslContext,
+                                       const NetworkCredentials_t * pNetworkCredentials,
+                                       BaseType_t usePsk,
+                                       WOLFSSL_CTX ** ppCtx );
+
+/**
+ * @brief Loads the device certificate into a wolfSSL context, with its public key in place
+ * of the private key, which wolfSSL accepts once the PK callbacks are set.
+ *
+ * @param[in] pSslContext SSL context of the connection, for its PKCS #11 function list.
+ * @param[in] pCtx The wolfSSL context.
+ *
+ * @return CKR_OK on success.
+ */
+static CK_RV loadClientCertificate( SSLContext_t * pSslContext,
+                                    WOLFSSL_CTX * pCtx );
+
+#ifndef NO_PSK
+
+/**
+ * @brief Gives wolfSSL the pre-shared key and its identity provisioned in PKCS #11.
+ *
+ * @return Length of the key, 0 if it cannot be read.
+ */
+    static unsigned int pskClientCallback( WOLFSSL * pSsl,
+                                           const char * pcHint,
+                                           char * pcIdentity,
+                                           unsigned int uxIdentityMaxLength,
+                                           unsigned char * pucKey,
+                                           unsigned int uxKeyMaxLength );
+#endif
+
+/**
+ * @brief ECDSA signing callback of wolfSSL, signs the certificate verify hash.
+ */
+static int eccSignCallback( WOLFSSL * pSsl,
+                            const unsigned char * pucIn,
+                            unsigned int uxInSz,
+                            unsigned char * pucOut,
+                            word32 * pulOutSz,
+                            const unsigned char * pucKeyDer,
+                            unsigned int uxKeySz,
+                            void * pvCtx );
+
+/**
+ * @brief RSA signing callback of wolfSSL, signs the DigestInfo of the certificate verify.
+ */
+static int rsaSignCallback( WOLFSSL * pSsl,
+                            const unsigned char * pucIn,
+                            unsigned int uxInSz,
+                            unsigned char * pucOut,
+                            word32 * pulOutSz,
+                            const unsigned char * pucKeyDer,
+                            unsigned int uxKeySz,
+                            void * pvCtx );
+
+/**
+ * @brief Receive callback of wolfSSL, reads the socket of the network context.
+ */
+static int tlsIoRecv( WOLFSSL * pSsl,
+                      char * pcBuf,
+                      int lSz,
+                      void * pvCtx );
+
+/**
+ * @brief Send callback of wolfSSL, writes to the socket of the network context.
+ */
+static int tlsIoSend( WOLFSSL * pSsl,
+                      char * pcBuf,
+                      int lSz,
+                      void * pvCtx );
+
+/*-----------------------------------------------------------*/
+
+/* Allocated blocks start with their size, for XREALLOC(). A 64-bit member keeps the
+ * blocks aligned for the structures of wolfSSL. */
+typedef union AllocHeader
+{
+    size_t xSize;
+    uint64_t ullAlign;
+} AllocHeader_t;
+
+/*-----------------------------------------------------------*/
+
+/* wolfSSL allocates from the mbed TLS pool and its record buffers, see XMALLOC_USER in
+ * user_settings.h. The blocks are zeroed as they are for mbed TLS. */
+void * XMALLOC( size_t n,
+                void * heap,
+                int type )
+{
+    AllocHeader_t * pHeader;
+
+    ( void ) heap;
+    ( void ) type;
+
+    pHeader = ( AllocHeader_t * ) mbedtls_platform_calloc( 1, sizeof( AllocHeader_t ) + n );
+
+    if( pHeader != NULL )
+    {
+        pHeader->xSize = n;
+        pHeader++;
+    }
+
+    return pHeader;
+}
+
+/*-----------------------------------------------------------*/
+
+void XFREE( void * p,
+            void * heap,
+            int type )
+{
+    ( void ) heap;
+    ( void ) type;
+
+    if( p != NULL )
+    {
+        mbedtls_platform_free( ( AllocHeader_t * ) p - 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void * XREALLOC( void * p,
+                 size_t n,
+                 void * heap,
+                 int type )
+{
+    void * pNew = NULL;
+    size_t xOldSize;
+
+    if( n > 0U )
+    {
+        pNew = XMALLOC( n, heap, type );
+    }
+
+    if( ( pNew != NULL ) && ( p != NULL ) )
+    {
+        xOldSize = ( ( AllocHeader_t * ) p - 1 )->xSize;
+        ( void ) memcpy( pNew, p, ( xOldSize < n ) ? xOldSize : n );
+    }
+
+    /* As realloc(), the block is kept if the new one cannot be allocated. */
+    if( ( pNew != NULL ) || ( n == 0U ) )
+    {
+        XFREE( p, heap, type );
+    }
+
+    return pNew;
+}
+
+/*-----------------------------------------------------------*/
+
+int wolfssl_platform_random_block( unsigned char * output,
+                                   unsigned int sz )
+{
+    return ( xEntropyPoolGetBytes( output, sz ) == pdTRUE ) ? 0 : RNG_FAILURE_E;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Random bytes of the mbed TLS signatures made with the key cached by the PAL. */
+static int tlsRandomBytes( void * pvCtx,
+                           unsigned char * pucRandom,
+                           size_t xRandomLength )
+{
+    ( void ) pvCtx;
+
+    return ( xEntropyPoolGetBytes( pucRandom, xRandomLength ) == pdTRUE ) ? 0 : MBEDTLS_ERR_ENTROPY_SOURCE_FAILED;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Connections are set up from several tasks, wolfSSL is initialized once. */
+static SemaphoreHandle_t xWolfsslMutex = NULL;
+static StaticSemaphore_t xWolfsslMutexBuffer;
+
+static BaseType_t wolfsslLock( void )
+{
+    taskENTER_CRITICAL();
+    {
+        if( xWolfsslMutex == NULL )
+        {
+            xWolfsslMutex = xSemaphoreCreateMutexStatic( &xWolfsslMutexBuffer );
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return xSemaphoreTake( xWolfsslMutex, portMAX_DELAY );
+}
+
+/*-----------------------------------------------------------*/
+
+#ifdef DEBUG_WOLFSSL
+    static void prvTlsDebugPrint( const int lLevel,
+                                  const char * const pcStr )
+    {
+        /* Send the debug string to the portable logger. */
+        LogDebug( ( "wolfSSL: |%d| %s", lLevel, pcStr ) );
+    }
+#endif /* ifdef DEBUG_WOLFSSL */
+
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+
+/* Sessions of the entries of the session cache of tls_freertos_common.c. */
+    static WOLFSSL_SESSION * sessions[ tlsconfigSESSION_CACHE_ENTRIES ];
+
+/*-----------------------------------------------------------*/
+
+    void TlsBackend_SessionLoad( SSLContext_t * pSslContext,
+                                 size_t xEntry )
+    {
+        ( void ) wolfSSL_set_session( pSslContext->pSsl, sessions[ xEntry ] );
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t TlsBackend_SessionSave( SSLContext_t * pSslContext,
+                                       size_t xEntry )
+    {
+        /* A copy owned by the entry, which the client cache of wolfSSL may evict otherwise. */
+        WOLFSSL_SESSION * pSession = wolfSSL_get1_session( pSslContext->pSsl );
+
+        if( sessions[ xEntry ] != NULL )
+        {
+            wolfSSL_SESSION_free( sessions[ xEntry ] );
+        }
+
+        sessions[ xEntry ] = pSession;
+
+        return ( pSession != NULL ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void TlsBackend_SessionFree( size_t xEntry )
+    {
+        if( sessions[ xEntry ] != NULL )
+        {
+            wolfSSL_SESSION_free( sessions[ xEntry ] );
+            sessions[ xEntry ] = NULL;
+        }
+    }
+#endif /* if ( tlsconfigSESSION_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+#if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+
+/* Contexts of the entries of the root CA cache of tls_freertos_common.c, with the client
+ * certificate and the callbacks of the connections to the servers of each root CA. */
+    static WOLFSSL_CTX * ctxCache[ tlsconfigROOT_CA_CACHE_ENTRIES ];
+
+/*-----------------------------------------------------------*/
+
+    int32_t TlsBackend_RootCaLoad( SSLContext_t * pSslContext,
+                                   const NetworkCredentials_t * pNetworkCredentials,
+                                   BaseType_t usePsk,
+                                   size_t xEntry )
+    {
+        TlsTransportStatus_t returnStatus;
+
+        /* No connection uses the context of the entry. */
+        if( ctxCache[ xEntry ] != NULL )
+        {
+            wolfSSL_CTX_free( ctxCache[ xEntry ] );
+            ctxCache[ xEntry ] = NULL;
+        }
+
+        returnStatus = ctxCreate( pSslContext, pNetworkCredentials, usePsk, &( ctxCache[ xEntry ] ) );
+
+        /* The negated status, which TlsBackend_Setup() reports. */
+        return -( int32_t ) returnStatus;
+    }
+#endif /* if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+static TlsTransportStatus_t ctxCreate( SSLContext_t * pSslContext,
+                                       const NetworkCredentials_t * pNetworkCredentials,
+                                       BaseType_t usePsk,
+                                       WOLFSSL_CTX ** ppCtx )
+{
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+    WOLFSSL_CTX * pCtx;
+    int lFormat;
+    int wolfsslError;
+
+    pCtx = wolfSSL_CTX_new( wolfTLSv1_2_client_method() );
+
+    if( pCtx == NULL )
+    {
+        LogError( ( "Failed to allocate the wolfSSL context." ) );
+        returnStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+    }
+    else
+    {
+        wolfSSL_CTX_SetIORecv( pCtx, tlsIoRecv );
+        wolfSSL_CTX_SetIOSend( pCtx, tlsIoSend );
+
+        /* The minimum of the default certificate profile of mbed TLS. */
+        ( void ) wolfSSL_CTX_SetMinRsaKey_Sz( pCtx, 2048 );
+    }
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( usePsk == pdFALSE ) )
+    {
+        /* Load the server root CA certificates, a single DER certificate starts with a SEQUENCE. */
+        lFormat = ( pNetworkCredentials->pRootCa[ 0 ] == 0x30U ) ? WOLFSSL_FILETYPE_ASN1 : WOLFSSL_FILETYPE_PEM;
+        wolfsslError = wolfSSL_CTX_load_verify_buffer( pCtx,
+                                                       pNetworkCredentials->pRootCa,
+                                                       ( long ) pNetworkCredentials->rootCaSize,
+                                                       lFormat );
+
+        if( wolfsslError != WOLFSSL_SUCCESS )
+        {
+            LogError( ( "Failed to parse server root CA certificate: wolfSSLError= %d.", wolfsslError ) );
+            returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+        }
+        else
+        {
+            wolfSSL_CTX_set_verify( pCtx, WOLFSSL_VERIFY_PEER, NULL );
+
+            /* The callbacks must be set before the key is loaded, see loadClientCertificate(). */
+            wolfSSL_CTX_SetEccSignCb( pCtx, eccSignCallback );
+            wolfSSL_CTX_SetRsaSignCb( pCtx, rsaSignCallback );
+
+            if( loadClientCertificate( pSslContext, pCtx ) != CKR_OK )
+            {
+                LogError( ( "Failed to get certificate from PKCS #11 module." ) );
+                returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+            }
+        }
+    }
+
+    #ifndef NO_PSK
+        if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( usePsk == pdTRUE ) )
+        {
+            /* The PSK suites have no server certificate. */
+            wolfSSL_CTX_set_verify( pCtx, WOLFSSL_VERIFY_NONE, NULL );
+            wolfSSL_CTX_set_psk_client_callback( pCtx, pskClientCallback );
+
+            /* Only the PSK suites, a certificate suite would fail without a client key. */
+            if( wolfSSL_CTX_set_cipher_list( pCtx, "ECDHE-PSK-AES128-CBC-SHA256:PSK-AES128-GCM-SHA256" ) != WOLFSSL_SUCCESS )
+            {
+                returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+            }
+        }
+    #endif /* ifndef NO_PSK */
+
+    if( ( returnStatus != TLS_TRANSPORT_SUCCESS ) && ( pCtx != NULL ) )
+    {
+        wolfSSL_CTX_free( pCtx );
+        pCtx = NULL;
+    }
+
+    *ppCtx = pCtx;
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void sslContextInit( SSLContext_t * pSslContext )
+{
+    TlsCommon_ContextInit( pSslContext );
+
+    pSslContext->pCtx = NULL;
+    pSslContext->pSsl = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void TlsBackend_Free( SSLContext_t * pSslContext )
+{
+    configASSERT( pSslContext != NULL );
+
+    if( pSslContext->pSsl != NULL )
+    {
+        wolfSSL_free( pSslContext->pSsl );
+        pSslContext->pSsl = NULL;
+    }
+
+    #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+        /* The cache keeps its reference to a shared context. */
+        if( pSslContext->rootCaEntry != tlsROOT_CA_CACHE_NONE )
+        {
+            pSslContext->pCtx = NULL;
+            TlsCommon_RootCaCacheRelease( pSslContext );
+        }
+    #endif
+
+    if( pSslContext->pCtx != NULL )
+    {
+        wolfSSL_CTX_free( pSslContext->pCtx );
+        pSslContext->pCtx = NULL;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Joins the protocols with commas, as wolfSSL_UseALPN() takes them. */
+static int32_t alpnList( const char ** ppAlpnProtos,
+                         char * pcList,
+                         size_t xListSize )
+{
+    size_t xLength = 0;
+    size_t xProtoLength;
+    int32_t lResult = 0;
+
+    while( ( *ppAlpnProtos != NULL ) && ( lResult == 0 ) )
+    {
+        xProtoLength = strlen( *ppAlpnProtos );
+
+        if( ( xLength + xProtoLength + 2U ) > xListSize )
+        {
+            lResult = -1;
+        }
+        else
+        {
+            if( xLength > 0U )
+            {
+                pcList[ xLength++ ] = ',';
+            }
+
+            ( void ) memcpy( &pcList[ xLength ], *ppAlpnProtos, xProtoLength );
+            xLength += xProtoLength;
+            ppAlpnProtos++;
+        }
+    }
+
+    pcList[ xLength ] = '\0';
+
+    return ( lResult == 0 ) ? ( int32_t ) xLength : lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Joins the wolfSSL names of IANA cipher suite identifiers with colons, the suites unknown
+ * to wolfSSL are left out as mbed TLS leaves out the suites it does not implement. */
+static size_t cipherList( const int * pCipherSuites,
+                          char * pcList,
+                          size_t xListSize )
+{
+    const char * pcName;
+    size_t xLength = 0;
+    size_t xNameLength;
+
+    for( ; *pCipherSuites != 0; pCipherSuites++ )
+    {
+        pcName = wolfSSL_get_cipher_name_from_suite( ( unsigned char ) ( ( *pCipherSuites >> 8 ) & 0xFF ),
+                                                     ( unsigned char ) ( *pCipherSuites & 0xFF ) );
+
+        if( ( pcName == NULL ) || ( strcmp( pcName, "None" ) == 0 ) )
+        {
+            LogWarn( ( "Cipher suite 0x%04X is not available in wolfSSL.", ( unsigned int ) *pCipherSuites ) );
+            continue;
+        }
+
+        xNameLength = strlen( pcName );
+
+        if( ( xLength + xNameLength + 2U ) > xListSize )
+        {
+            LogWarn( ( "Cipher list full, suite %s left out.", pcName ) );
+            break;
+        }
+
+        if( xLength > 0U )
+        {
+            pcList[ xLength++ ] = ':';
+        }
+
+        ( void ) memcpy( &pcList[ xLength ], pcName, xNameLength );
+        xLength += xNameLength;
+    }
+
+    pcList[ xLength ] = '\0';
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Offers the curves of an mbed TLS list, in the same order. */
+static int32_t useCurves( WOLFSSL * pSsl,
+                          const mbedtls_ecp_group_id * pCurves )
+{
+    int32_t wolfsslError = WOLFSSL_SUCCESS;
+    word16 usName;
+
+    for( ; ( *pCurves != MBEDTLS_ECP_DP_NONE ) && ( wolfsslError == WOLFSSL_SUCCESS ); pCurves++ )
+    {
+        switch( *pCurves )
+        {
+            case MBEDTLS_ECP_DP_SECP256R1:
+                usName = WOLFSSL_ECC_SECP256R1;
+                break;
+
+            case MBEDTLS_ECP_DP_SECP384R1:
+                usName = WOLFSSL_ECC_SECP384R1;
+                break;
+
+            case MBEDTLS_ECP_DP_SECP521R1:
+                usName = WOLFSSL_ECC_SECP521R1;
+                break;
+
+            case MBEDTLS_ECP_DP_BP256R1:
+                usName = WOLFSSL_ECC_BRAINPOOLP256R1;
+                break;
+
+            case MBEDTLS_ECP_DP_CURVE25519:
+                usName = WOLFSSL_ECC_X25519;
+                break;
+
+            default:
+                usName = 0U;
+                break;
+        }
+
+        if( usName != 0U )
+        {
+            wolfsslError = wolfSSL_UseSupportedCurve( pSsl, usName );
+        }
+    }
+
+    return wolfsslError;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TlsBackend_Setup( NetworkContext_t * pNetworkContext,
+                                       const char * pHostName,
+                                       const NetworkCredentials_t * pNetworkCredentials )
+{
+    SSLContext_t * pSslContext = &( pNetworkContext->sslContext );
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+    int32_t wolfsslError = WOLFSSL_SUCCESS;
+    BaseType_t usePsk = pdFALSE;
+    char cList[ tlsCIPHER_LIST_LENGTH ];
+    int32_t lLength;
+
+    #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+        int32_t lCacheError;
+    #endif
+
+    configASSERT( pNetworkContext != NULL );
+    configASSERT( pHostName != NULL );
+    configASSERT( pNetworkCredentials != NULL );
+
+    #ifndef NO_PSK
+        usePsk = pNetworkCredentials->usePsk;
+    #else
+        configASSERT( pNetworkCredentials->usePsk == pdFALSE );
+    #endif
+
+    configASSERT( ( pNetworkCredentials->pRootCa != NULL ) || ( usePsk == pdTRUE ) );
+
+    sslContextInit( pSslContext );
+
+    /* Setup the client private key. */
+    if( usePsk == pdFALSE )
+    {
+        if( TlsCommon_InitClientKey( pSslContext ) != CKR_OK )
+        {
+            LogError( ( "Failed to setup key handling by PKCS #11." ) );
+
+            returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+        }
+    }
+
+    /* The root CA, the client certificate and the callbacks, shared by the connections to the
+     * servers of the same root CA. */
+    #if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 )
+        if( returnStatus == TLS_TRANSPORT_SUCCESS )
+        {
+            lCacheError = TlsCommon_RootCaCacheAcquire( pSslContext, pNetworkCredentials, usePsk );
+
+            if( lCacheError != 0 )
+            {
+                returnStatus = ( TlsTransportStatus_t ) -lCacheError;
+            }
+            else if( pSslContext->rootCaEntry != tlsROOT_CA_CACHE_NONE )
+            {
+                pSslContext->pCtx = ctxCache[ pSslContext->rootCaEntry ];
+            }
+            else
+            {
+                /* Empty else for MISRA 15.7 compliance. */
+            }
+        }
+    #endif /* if ( tlsconfigROOT_CA_CACHE_ENTRIES > 0 ) */
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( pSslContext->pCtx == NULL ) )
+    {
+        /* Every cache entry is used by another root CA, the connection owns its context. */
+        returnStatus = ctxCreate( pSslContext, pNetworkCredentials, usePsk, &( pSslContext->pCtx ) );
+    }
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        pSslContext->pSsl = wolfSSL_new( pSslContext->pCtx );
+
+        if( pSslContext->pSsl == NULL )
+        {
+            LogError( ( "Failed to allocate the wolfSSL connection." ) );
+            returnStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+        }
+        else
+        {
+            /* Set the underlying IO and the context of the signing callbacks. */
+            wolfSSL_SetIOReadCtx( pSslContext->pSsl, pNetworkContext );
+            wolfSSL_SetIOWriteCtx( pSslContext->pSsl, pNetworkContext );
+            wolfSSL_SetEccSignCtx( pSslContext->pSsl, pSslContext );
+            wolfSSL_SetRsaSignCtx( pSslContext->pSsl, pSslContext );
+
+            /* test.mosquitto.org only provides a 1024-bit RSA certificate, which is
+             * not acceptable by the default mbed TLS certificate security profile.
+             * For the purposes of this demo, allow the use of 1024-bit RSA certificates.
+             * This block should be removed otherwise. */
+            if( strncmp( pHostName, "test.mosquitto.org", strlen( pHostName ) ) == 0 )
+            {
+                ( void ) wolfSSL_SetMinRsaKey_Sz( pSslContext->pSsl, 1024 );
+            }
+        }
+    }
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( pNetworkCredentials->pAlpnProtos != NULL ) )
+    {
+        /* Include an application protocol list in the TLS ClientHello
+         * message. */
+        lLength = alpnList( pNetworkCredentials->pAlpnProtos, cList, tlsALPN_LIST_LENGTH );
+        wolfsslError = ( lLength < 0 ) ? BUFFER_E :
+                       wolfSSL_UseALPN( pSslContext->pSsl, cList, ( unsigned int ) lLength,
+                                        WOLFSSL_ALPN_CONTINUE_ON_MISMATCH );
+
+        if( wolfsslError != WOLFSSL_SUCCESS )
+        {
+            LogError( ( "Failed to configure ALPN protocol in wolfSSL: wolfSSLError= %d.", wolfsslError ) );
+
+            returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+        }
+    }
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pNetworkCredentials->maxFragmentLength != MBEDTLS_SSL_MAX_FRAG_LEN_NONE ) )
+    {
+        /* Ask the server for records no larger than the fragment length. WOLFSSL_MFL_2_9 to
+         * WOLFSSL_MFL_2_12 have the values of MBEDTLS_SSL_MAX_FRAG_LEN_512 to 4096. */
+        wolfsslError = wolfSSL_UseMaxFragment( pSslContext->pSsl, pNetworkCredentials->maxFragmentLength );
+
+        if( wolfsslError != WOLFSSL_SUCCESS )
+        {
+            LogError( ( "Failed to configure maximum fragment length in wolfSSL: wolfSSLError= %d.", wolfsslError ) );
+
+            returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+        }
+    }
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( pNetworkCredentials->pCipherSuites != NULL ) )
+    {
+        /* Restrict the ClientHello to the given suites, so that the server cannot pick a
+         * more expensive key exchange. */
+        if( ( cipherList( pNetworkCredentials->pCipherSuites, cList, sizeof( cList ) ) == 0U ) ||
+            ( wolfSSL_set_cipher_list( pSslContext->pSsl, cList ) != WOLFSSL_SUCCESS ) )
+        {
+            LogError( ( "None of the cipher suites of the credentials is available in wolfSSL." ) );
+
+            returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+        }
+    }
+
+    if( ( returnStatus == TLS_TRANSPORT_SUCCESS ) && ( pNetworkCredentials->pCurves != NULL ) )
+    {
+        wolfsslError = useCurves( pSslContext->pSsl, pNetworkCredentials->pCurves );
+
+        if( wolfsslError != WOLFSSL_SUCCESS )
+        {
+            LogError( ( "Failed to configure the curves in wolfSSL: wolfSSLError= %d.", wolfsslError ) );
+
+            returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+        }
+    }
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        /* Enable SNI if requested. */
+        if( pNetworkCredentials->disableSni == pdFALSE )
+        {
+            wolfsslError = wolfSSL_UseSNI( pSslContext->pSsl, WOLFSSL_SNI_HOST_NAME,
+                                           pHostName, ( unsigned short ) strlen( pHostName ) );
+
+            if( wolfsslError != WOLFSSL_SUCCESS )
+            {
+                LogError( ( "Failed to set server name: wolfSSLError= %d.", wolfsslError ) );
+
+                returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+            }
+        }
+    }
+
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        #if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+            /* Resume the previous session to the server, without ECDHE and certificate verification.
+             * The sessions are kept by the session cache of tls_freertos_common.c. */
+            ( void ) wolfSSL_UseSessionTicket( pSslContext->pSsl );
+
+            if( pNetworkCredentials->disableSessionResumption == pdFALSE )
+            {
+                TlsCommon_SessionCacheLoad( pSslContext, pHostName );
+            }
+        #endif
+
+        pSslContext->pHostName = pHostName;
+        pSslContext->handshakeStart = xTaskGetTickCount();
+    }
+
+    if( returnStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        TlsBackend_Free( pSslContext );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TlsBackend_Handshake( NetworkContext_t * pNetworkContext,
+                                           BaseType_t xSingleStep )
+{
+    SSLContext_t * pSslContext = &( pNetworkContext->sslContext );
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+    int32_t wolfsslError = 0;
+
+    if( xSingleStep == pdTRUE )
+    {
+        /* wolfSSL_connect() goes through all the states it has the records for, so a step
+         * covers one flight of the server rather than one state. */
+        wolfsslError = CryptoWorker_Run( tlsConnectJob, pSslContext );
+
+        if( wolfsslError == WOLFSSL_ERROR_WANT_READ )
+        {
+            returnStatus = TLS_TRANSPORT_WANT_READ;
+        }
+        else if( wolfsslError == WOLFSSL_ERROR_WANT_WRITE )
+        {
+            returnStatus = TLS_TRANSPORT_IN_PROGRESS;
+        }
+        else
+        {
+            /* Empty else for MISRA 15.7 compliance. */
+        }
+    }
+    else
+    {
+        /* The socket blocks with the receive timeout, WANT_READ means the server did not
+         * answer in time. */
+        do
+        {
+            wolfsslError = CryptoWorker_Run( tlsConnectJob, pSslContext );
+        } while( wolfsslError == WOLFSSL_ERROR_WANT_WRITE );
+    }
+
+    if( ( returnStatus != TLS_TRANSPORT_IN_PROGRESS ) && ( returnStatus != TLS_TRANSPORT_WANT_READ ) )
+    {
+        #if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+            TlsCommon_SessionCacheStore( pSslContext, pSslContext->pHostName, ( wolfsslError == 0 ) ? pdTRUE : pdFALSE );
+        #endif
+
+        if( wolfsslError != 0 )
+        {
+            LogError( ( "Failed to perform TLS handshake: wolfSSLError= %d.", wolfsslError ) );
+
+            TlsBackend_Free( pSslContext );
+            returnStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
+        }
+        else
+        {
+            LogInfo( ( "(Network connection %p) TLS handshake successful in %lu ms%s.",
+                       pNetworkContext,
+                       ( unsigned long ) ( ( xTaskGetTickCount() - pSslContext->handshakeStart ) * portTICK_PERIOD_MS ),
+                       ( wolfSSL_session_reused( pSslContext->pSsl ) != 0 ) ? ", session resumed" : "" ) );
+        }
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t tlsConnectJob( void * pvContext )
+{
+    SSLContext_t * pSslContext = ( SSLContext_t * ) pvContext;
+    int32_t wolfsslError = 0;
+
+    if( wolfSSL_connect( pSslContext->pSsl ) != WOLFSSL_SUCCESS )
+    {
+        wolfsslError = ( int32_t ) wolfSSL_get_error( pSslContext->pSsl, 0 );
+    }
+
+    return wolfsslError;
+}
+
+/*-----------------------------------------------------------*/
+
+static int tlsIoRecv( WOLFSSL * pSsl,
+                      char * pcBuf,
+                      int lSz,
+                      void * pvCtx )
+{
+    NetworkContext_t * pNetworkContext = ( NetworkContext_t * ) pvCtx;
+    BaseType_t xResult;
+    int lResult;
+
+    ( void ) pSsl;
+
+    xResult = FreeRTOS_recv( pNetworkContext->tcpSocket, pcBuf, ( size_t ) lSz, 0 );
+
+    /* FreeRTOS_recv() returns 0 once the receive timeout expires, or at once without
+     * timeout during an incremental handshake. */
+    if( xResult > 0 )
+    {
+        lResult = ( int ) xResult;
+    }
+    else if( xResult == 0 )
+    {
+        lResult = WOLFSSL_CBIO_ERR_WANT_READ;
+    }
+    else if( xResult == -pdFREERTOS_ERRNO_ENOTCONN )
+    {
+        lResult = WOLFSSL_CBIO_ERR_CONN_CLOSE;
+    }
+    else
+    {
+        lResult = WOLFSSL_CBIO_ERR_GENERAL;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static int tlsIoSend( WOLFSSL * pSsl,
+                      char * pcBuf,
+                      int lSz,
+                      void * pvCtx )
+{
+    NetworkContext_t * pNetworkContext = ( NetworkContext_t * ) pvCtx;
+    BaseType_t xResult;
+    int lResult;
+
+    ( void ) pSsl;
+
+    xResult = FreeRTOS_send( pNetworkContext->tcpSocket, pcBuf, ( size_t ) lSz, 0 );
+
+    /* A full send window until the send timeout is retried by the caller of the transport. */
+    if( xResult > 0 )
+    {
+        lResult = ( int ) xResult;
+    }
+    else if( ( xResult == 0 ) || ( xResult == -pdFREERTOS_ERRNO_ENOSPC ) )
+    {
+        lResult = WOLFSSL_CBIO_ERR_WANT_WRITE;
+    }
+    else if( xResult == -pdFREERTOS_ERRNO_ENOTCONN )
+    {
+        lResult = WOLFSSL_CBIO_ERR_CONN_CLOSE;
+    }
+    else
+    {
+        lResult = WOLFSSL_CBIO_ERR_GENERAL;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void TlsBackend_SetNonBlocking( NetworkContext_t * pNetworkContext,
+                                BaseType_t xNonBlocking )
+{
+    /* tlsIoRecv() already reports an empty socket as WANT_READ, whatever its timeout. */
+    ( void ) pNetworkContext;
+    ( void ) xNonBlocking;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t TlsBackend_Init( void )
+{
+    static BaseType_t xInitialized = pdFALSE;
+    TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
+
+    if( wolfsslLock() == pdTRUE )
+    {
+        if( xInitialized == pdFALSE )
+        {
+            if( wolfSSL_Init() == WOLFSSL_SUCCESS )
+            {
+                xInitialized = pdTRUE;
+
+                #ifdef DEBUG_WOLFSSL
+                    ( void ) wolfSSL_SetLoggingCb( prvTlsDebugPrint );
+                    ( void ) wolfSSL_Debugging_ON();
+                #endif
+
+                LogDebug( ( "Successfully initialized wolfSSL." ) );
+            }
+            else
+            {
+                LogError( ( "Failed to initialize wolfSSL." ) );
+                returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+            }
+        }
+
+        ( void ) xSemaphoreGive( xWolfsslMutex );
+    }
+    else
+    {
+        returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static CK_RV loadClientCertificate( SSLContext_t * pSslContext,
+                                    WOLFSSL_CTX * pCtx )
+{
+    CK_RV xResult = CKR_OK;
+    mbedtls_x509_crt xCert;
+    mbedtls_x509_crt * pxCert = NULL;
+    unsigned char * pucPublicKey = NULL;
+    int lLength = 0;
+
+    /* Only used when the certificate is read from PKCS #11, freed once loaded into wolfSSL. */
+    mbedtls_x509_crt_init( &xCert );
+
+    xResult = TlsCommon_GetClientCertificate( pSslContext, &xCert, &pxCert );
+
+    if( ( xResult == CKR_OK ) &&
+        ( wolfSSL_CTX_use_certificate_buffer( pCtx, pxCert->raw.p, ( long ) pxCert->raw.len,
+                                              WOLFSSL_FILETYPE_ASN1 ) != WOLFSSL_SUCCESS ) )
+    {
+        xResult = CKR_CERTIFICATE_INVALID;
+    }
+
+    /* wolfSSL needs the key type and size of the certificate verify, the signature itself is
+     * made by the PK callbacks. mbed TLS writes the DER key at the end of the buffer. */
+    if( xResult == CKR_OK )
+    {
+        pucPublicKey = pvPortMalloc( tlsPUBLIC_KEY_DER_LENGTH );
+        xResult = ( pucPublicKey != NULL ) ? CKR_OK : CKR_HOST_MEMORY;
+    }
+
+    if( xResult == CKR_OK )
+    {
+        lLength = mbedtls_pk_write_pubkey_der( &( pxCert->pk ), pucPublicKey, tlsPUBLIC_KEY_DER_LENGTH );
+
+        if( ( lLength <= 0 ) ||
+            ( wolfSSL_CTX_use_PrivateKey_buffer( pCtx, &pucPublicKey[ tlsPUBLIC_KEY_DER_LENGTH - ( size_t ) lLength ],
+                                                 lLength, WOLFSSL_FILETYPE_ASN1 ) != WOLFSSL_SUCCESS ) )
+        {
+            LogError( ( "Failed to load the public key of the device certificate." ) );
+            xResult = CKR_KEY_HANDLE_INVALID;
+        }
+    }
+
+    vPortFree( pucPublicKey );
+    mbedtls_x509_crt_free( &xCert );
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+#ifndef NO_PSK
+
+    static unsigned int pskClientCallback( WOLFSSL * pSsl,
+                                           const char * pcHint,
+                                           char * pcIdentity,
+                                           unsigned int uxIdentityMaxLength,
+                                           unsigned char * pucKey,
+                                           unsigned int uxKeyMaxLength )
+    {
+        CK_RV xResult = CKR_OK;
+        TlsPsk_t xPsk;
+        unsigned int uxKeyLength = 0;
+
+        ( void ) pSsl;
+        ( void ) pcHint;
+
+        xResult = TlsCommon_ReadPsk( &xPsk );
+
+        /* wolfSSL takes the identity as a string. */
+        if( ( xResult == CKR_OK ) &&
+            ( ( xPsk.ulKeySize > uxKeyMaxLength ) || ( xPsk.ulIdentitySize >= uxIdentityMaxLength ) ) )
+        {
+            LogError( ( "The TLS pre-shared key or its identity is too long for wolfSSL." ) );
+            xResult = CKR_DATA_LEN_RANGE;
+        }
+
+        if( xResult == CKR_OK )
+        {
+            ( void ) memcpy( pucKey, xPsk.pucKey, xPsk.ulKeySize );
+            ( void ) memcpy( pcIdentity, xPsk.pucIdentity, xPsk.ulIdentitySize );
+            pcIdentity[ xPsk.ulIdentitySize ] = '\0';
+            uxKeyLength = ( unsigned int ) xPsk.ulKeySize;
+        }
+
+        TlsCommon_FreePsk( &xPsk );
+
+        return uxKeyLength;
+    }
+
+#endif /* ifndef NO_PSK */
+
+/*-----------------------------------------------------------*/
+
+static int eccSignCallback( WOLFSSL * pSsl,
+                            const unsigned char * pucIn,
+                            unsigned int uxInSz,
+                            unsigned char * pucOut,
+                            word32 * pulOutSz,
+                            const unsigned char * pucKeyDer,
+                            unsigned int uxKeySz,
+                            void * pvCtx )
+{
+    SSLContext_t * pxCtx = ( SSLContext_t * ) pvCtx;
+    size_t xSigLen = 0;
+    int lResult = WC_HW_E;
+
+    /* The public key loaded in its place, unused. */
+    ( void ) pSsl;
+    ( void ) pucKeyDer;
+    ( void ) uxKeySz;
+
+    if( *pulOutSz < tlsECDSA_SIGNATURE_BUFFER_SIZE )
+    {
+        lResult = BUFFER_E;
+    }
+    else
+    {
+        #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+            /* Signs with the key parsed by the PAL, straight into the buffer of wolfSSL. */
+            lResult = PKCS11_PAL_SignWithCachedKey( MBEDTLS_MD_SHA256, pucIn, uxInSz, pucOut, &xSigLen,
+                                                    tlsRandomBytes, NULL );
+
+            if( lResult == 0 )
+            {
+                *pulOutSz = ( word32 ) xSigLen;
+            }
+            else if( lResult != MBEDTLS_ERR_PK_KEY_INVALID_FORMAT )
+            {
+                LogError( ( "Failed to sign message with the cached key: mbedTLSError= -0x%04x.",
+                            ( unsigned int ) -lResult ) );
+                lResult = WC_HW_E;
+            }
+            else
+        #endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 ) */
+        {
+            /* The DER signature is encoded in place in the output buffer of wolfSSL. */
+            if( TlsCommon_SignEcdsa( pxCtx, pucIn, uxInSz, pucOut, &xSigLen ) == CKR_OK )
+            {
+                *pulOutSz = ( word32 ) xSigLen;
+                lResult = 0;
+            }
+            else
+            {
+                lResult = WC_HW_E;
+            }
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static int rsaSignCallback( WOLFSSL * pSsl,
+                            const unsigned char * pucIn,
+                            unsigned int uxInSz,
+                            unsigned char * pucOut,
+                            word32 * pulOutSz,
+                            const unsigned char * pucKeyDer,
+                            unsigned int uxKeySz,
+                            void * pvCtx )
+{
+    SSLContext_t * pxCtx = ( SSLContext_t * ) pvCtx;
+    CK_ULONG xSignatureLen = *pulOutSz;
+    int lResult = WC_HW_E;
+
+    /* The public key loaded in its place, unused. */
+    ( void ) pSsl;
+    ( void ) pucKeyDer;
+    ( void ) uxKeySz;
+
+    /* wolfSSL passes the DigestInfo, only padded by CKM_RSA_PKCS, unlike mbed TLS which
+     * passes the hash, see vAppendSHA256AlgorithmIdentifierSequence(). */
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        size_t xSigLen = 0;
+
+        lResult = PKCS11_PAL_SignWithCachedKey( MBEDTLS_MD_NONE, pucIn, uxInSz, pucOut, &xSigLen,
+                                                tlsRandomBytes, NULL );
+
+        if( lResult == 0 )
+        {
+            *pulOutSz = ( word32 ) xSigLen;
+        }
+        else if( lResult != MBEDTLS_ERR_PK_KEY_INVALID_FORMAT )
+        {
+            LogError( ( "Failed to sign message with the cached key: mbedTLSError= -0x%04x.",
+                        ( unsigned int ) -lResult ) );
+            lResult = WC_HW_E;
+        }
+        else
+    #endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 ) */
+    {
+        if( TlsCommon_Sign( pxCtx, CKM_RSA_PKCS, pucIn, uxInSz, pucOut, &xSignatureLen ) == CKR_OK )
+        {
+            *pulOutSz = ( word32 ) xSignatureLen;
+            lResult = 0;
+        }
+        else
+        {
+            lResult = WC_HW_E;
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void TlsBackend_Shutdown( NetworkContext_t * pNetworkContext )
+{
+    int32_t tlsStatus;
+
+    if( pNetworkContext->sslContext.pSsl != NULL )
+    {
+        /* Attempting to terminate TLS connection, without waiting for the close-notify of the
+         * server, which WOLFSSL_SHUTDOWN_NOT_DONE reports. */
+        tlsStatus = ( int32_t ) wolfSSL_shutdown( pNetworkContext->sslContext.pSsl );
+
+        if( ( tlsStatus == WOLFSSL_SUCCESS ) || ( tlsStatus == WOLFSSL_SHUTDOWN_NOT_DONE ) )
+        {
+            LogInfo( ( "(Network connection %p) TLS close-notify sent.",
+                       pNetworkContext ) );
+        }
+        else
+        {
+            LogError( ( "(Network connection %p) Failed to send TLS close-notify: wolfSSLError= %d.",
+                        pNetworkContext,
+                        wolfSSL_get_error( pNetworkContext->sslContext.pSsl, tlsStatus ) ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TlsBackend_Read( SSLContext_t * pSslContext,
+                         void * pBuffer,
+                         size_t bytesToRecv )
+{
+    WOLFSSL * pSsl = pSslContext->pSsl;
+    int32_t tlsStatus = 0;
+    int32_t wolfsslError;
+
+    PROBE_BEGIN( PROBE_TLS_RECV );
+    tlsStatus = ( int32_t ) wolfSSL_read( pSsl, pBuffer, ( int ) bytesToRecv );
+    PROBE_END( PROBE_TLS_RECV );
+
+    if( tlsStatus <= 0 )
+    {
+        wolfsslError = ( int32_t ) wolfSSL_get_error( pSsl, tlsStatus );
+
+        if( ( wolfsslError == WOLFSSL_ERROR_WANT_READ ) ||
+            ( wolfsslError == WOLFSSL_ERROR_WANT_WRITE ) )
+        {
+            LogDebug( ( "Failed to read data. However, a read can be retried on this error. "
+                        "wolfSSLError= %d.", wolfsslError ) );
+
+            /* Mark these set of errors as a timeout. The libraries may retry read
+             * on these errors. */
+            tlsStatus = 0;
+        }
+        else
+        {
+            LogError( ( "Failed to read data: wolfSSLError= %d.", wolfsslError ) );
+
+            /* Negative, also for the close-notify of the server. */
+            tlsStatus = ( wolfsslError < 0 ) ? wolfsslError : -wolfsslError;
+        }
+    }
+
+    return tlsStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t TlsBackend_Write( SSLContext_t * pSslContext,
+                          const void * pBuffer,
+                          size_t bytesToSend )
+{
+    int32_t tlsStatus = 0;
+    int32_t wolfsslError;
+
+    /* After a timeout, wolfSSL sends the rest of the record it encrypted when called again with
+     * the same bytes, which both the transmit buffer and coreMQTT do. */
+    PROBE_BEGIN( PROBE_TLS_SEND );
+    tlsStatus = ( int32_t ) wolfSSL_write( pSslContext->pSsl, pBuffer, ( int ) bytesToSend );
+    PROBE_END( PROBE_TLS_SEND );
+
+    if( tlsStatus <= 0 )
+    {
+        wolfsslError = ( int32_t ) wolfSSL_get_error( pSslContext->pSsl, tlsStatus );
+
+        if( ( wolfsslError == WOLFSSL_ERROR_WANT_READ ) ||
+            ( wolfsslError == WOLFSSL_ERROR_WANT_WRITE ) )
+        {
+            LogDebug( ( "Failed to send data. However, send can be retried on this error. "
+                        "wolfSSLError= %d.", wolfsslError ) );
+
+            /* Mark these set of errors as a timeout. The libraries may retry send
+             * on these errors. */
+            tlsStatus = 0;
+            TlsCommon_CountSendTimeout();
+        }
+        else
+        {
+            LogError( ( "Failed to send data:  wolfSSLError= %d.", wolfsslError ) );
+
+            tlsStatus = ( wolfsslError < 0 ) ? wolfsslError : -wolfsslError;
+        }
+    }
+
+    return tlsStatus;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t TLS_FreeRTOS_HasPendingData( NetworkContext_t * pNetworkContext )
+{
+    BaseType_t xPending = pdFALSE;
+
+    if( ( pNetworkContext != NULL ) && ( pNetworkContext->sslContext.pSsl != NULL ) )
+    {
+        /* Decrypted data buffered by wolfSSL, or received bytes in the socket stream. wolfSSL
+         * reads the socket a record header and a record body at a time, so it holds no
+         * complete record that is not yet decrypted. */
+        if( ( wolfSSL_pending( pNetworkContext->sslContext.pSsl ) > 0 ) ||
+            ( FreeRTOS_recvcount( pNetworkContext->tcpSocket ) > 0 ) )
+        {
+            xPending = pdTRUE;
+        }
+    }
+
+    return xPending;
+}
+
+#endif /* if ( tlsconfigUSE_WOLFSSL == 1 ) */
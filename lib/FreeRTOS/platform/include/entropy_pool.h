@@ -0,0 +1,67 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file entropy_pool.h
+ * @brief Random numbers shared by the IP stack, the retry jitter and mbed TLS, from a CTR_DRBG
+ * seeded with the hardware RNG.
+ */
+
+#ifndef ENTROPY_POOL_H
+#define ENTROPY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Period of the reseeding of the DRBG from the hardware RNG, done from the timer task.
+ */
+#ifndef entropypoolRESEED_INTERVAL_MS
+    #define entropypoolRESEED_INTERVAL_MS    ( 60000U )
+#endif
+
+/**
+ * @brief Fills a buffer with random bytes, seeding the DRBG from the hardware RNG on first use.
+ * Must be called from task context, or before the scheduler is started.
+ *
+ * @param[out] pucOutput Buffer receiving the bytes.
+ * @param[in] xLength Number of bytes.
+ *
+ * @return pdTRUE on success, pdFALSE if the hardware RNG could not seed the DRBG.
+ */
+BaseType_t xEntropyPoolGetBytes( uint8_t * pucOutput,
+                                 size_t xLength );
+
+/**
+ * @brief Reads the hardware RNG directly, slowly, for seeding. Implemented in hw_poll.c.
+ *
+ * @return 0 on success.
+ */
+int CRYPTO_GetHardwareEntropy( unsigned char * output,
+                               size_t len );
+
+#endif /* ENTROPY_POOL_H */
@@ -0,0 +1,88 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file pkcs11_session_pool.h
+ * @brief Long-lived, logged in PKCS #11 sessions leased to the TLS transport and to the OTA signature check.
+ */
+
+#ifndef PKCS11_SESSION_POOL_H
+#define PKCS11_SESSION_POOL_H
+
+#include "FreeRTOS.h"
+
+#include "core_pkcs11.h"
+
+/**
+ * @brief Number of sessions kept open, one per task running PKCS #11 operations at the same time.
+ */
+#ifndef pkcs11poolSESSION_COUNT
+    #define pkcs11poolSESSION_COUNT    2
+#endif
+
+/**
+ * @brief Objects whose handles are looked up once and kept by the pool.
+ */
+typedef enum Pkcs11PoolObject
+{
+    ePkcs11PoolDevicePrivateKey = 0, /**< Device private key used for TLS client authentication. */
+    ePkcs11PoolCodeSignKey,          /**< Public key verifying the signature of OTA images. */
+    ePkcs11PoolObjectCount
+} Pkcs11PoolObject_t;
+
+/**
+ * @brief Session and object handles handed out for the duration of a lease.
+ */
+typedef struct Pkcs11Lease
+{
+    CK_SESSION_HANDLE xSession;                           /**< Session used exclusively by the holder. */
+    CK_OBJECT_HANDLE xObjects[ ePkcs11PoolObjectCount ]; /**< CK_INVALID_HANDLE if the object is not provisioned. */
+    size_t xIndex;                                        /**< Pool entry, internal. */
+} Pkcs11Lease_t;
+
+/**
+ * @brief Takes a session of the pool, opening and logging it in on first use.
+ * A lease is meant to cover one operation (sign, verify, random bytes), so that the pool is
+ * shared by all connections.
+ *
+ * @param[out] pxLease The leased session.
+ * @param[in] xTicksToWait Time to wait for a free session.
+ *
+ * @return CKR_OK if the session is leased, vPkcs11PoolRelease() must then be called.
+ */
+CK_RV xPkcs11PoolAcquire( Pkcs11Lease_t * pxLease,
+                          TickType_t xTicksToWait );
+
+/**
+ * @brief Gives a session back to the pool.
+ *
+ * @param[in] pxLease The lease from xPkcs11PoolAcquire().
+ * @param[in] xResult Result of the last operation, the session is closed and opened again on next
+ * use when it is invalid, the object handles are looked up again when they are.
+ */
+void vPkcs11PoolRelease( Pkcs11Lease_t * pxLease,
+                         CK_RV xResult );
+
+#endif /* PKCS11_SESSION_POOL_H */
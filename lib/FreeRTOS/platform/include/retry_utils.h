@@ -50,12 +50,16 @@
  * unlikely to succeed.
  *
  * Before retrying the failed communication to the server there is a quiet period.
- * In this quiet period, the task that is retrying must sleep for some random
- * amount of seconds between 0 and the lesser of a base value and a predefined
- * maximum. The base is doubled with each retry attempt until the maximum is
- * reached.<br>
+ * This implementation uses "decorrelated jitter": in this quiet period the task
+ * that is retrying sleeps for a random number of milliseconds between a base
+ * value and three times the previous sleep, never exceeding a predefined
+ * maximum.<br>
  *
- * > sleep_seconds = random_between( 0, min( 2<sup>attempts_count</sup> * base_seconds, maximum_seconds ) )
+ * > sleep_ms = min( maximum_ms, random_between( base_ms, previous_sleep_ms * 3 ) )
+ *
+ * The sleep can be cut short with @ref RetryUtils_AbortSleep, for example when
+ * the network interface comes back up, so that the next attempt is made
+ * immediately instead of after the remaining backoff time.
  *
  * @section retryutils_implementation Implementing Retry Utils
  *
@@ -77,18 +81,15 @@
  *<br>
  * This function initializes @ref RetryUtilsParams_t. It is expected to set
  * @ref RetryUtilsParams_t.attemptsDone to zero. It is also expected to set
- * @ref RetryUtilsParams_t.nextJitterMax to @ref INITIAL_RETRY_BACKOFF_SECONDS
- * plus some random amount of seconds, jitter. This jitter is a random number
- * between 0 and @ref MAX_JITTER_VALUE_SECONDS. This function must be called
- * before entering the exponential backoff with jitter loop using
+ * @ref RetryUtilsParams_t.nextJitterMax to three times @ref RETRY_BACKOFF_BASE_MS,
+ * capped at @ref RETRY_BACKOFF_MAX_MS. This function must be called before
+ * entering the exponential backoff with jitter loop using
  * @ref RetryUtils_BackoffAndSleep.<br><br>
  * Please follow the example below to implement your own @ref RetryUtils_ParamsReset.
  * The lines with FIXME comments should be updated.
  * @code{c}
  * void RetryUtils_ParamsReset( RetryUtilsParams_t * pRetryParams )
  * {
- *     uint32_t jitter = 0;
- *
  *     // Reset attempts done to zero so that the next retry cycle can start.
  *     pRetryParams->attemptsDone = 0;
  *
@@ -97,11 +98,13 @@
  *     // pseudo random number generator.
  *     srand( time( NULL ) );
  *
- *     // Calculate jitter value using picking a random number.
- *     jitter = ( rand() % MAX_JITTER_VALUE_SECONDS );
+ *     // The first sleep is picked between the base and three times the base.
+ *     pRetryParams->nextJitterMax = RETRY_BACKOFF_BASE_MS * 3U;
  *
- *     // Reset the backoff value to the initial time out value plus jitter.
- *     pRetryParams->nextJitterMax = INITIAL_RETRY_BACKOFF_SECONDS + jitter;
+ *     if( pRetryParams->nextJitterMax > RETRY_BACKOFF_MAX_MS )
+ *     {
+ *         pRetryParams->nextJitterMax = RETRY_BACKOFF_MAX_MS;
+ *     }
  * }
  * @endcode<br>
  *
@@ -109,9 +112,10 @@
  * @snippet this define_retryutils_backoffandsleep
  * <br>
  * When this function is invoked, the calling task is expected to sleep a random
- * number of seconds between 0 and @ref RetryUtilsParams_t.nextJitterMax. After
- * sleeping this function must double @ref RetryUtilsParams_t.nextJitterMax, but
- * not exceeding @ref MAX_RETRY_BACKOFF_SECONDS. When @ref RetryUtilsParams_t.maxRetryAttempts
+ * number of milliseconds between @ref RETRY_BACKOFF_BASE_MS and
+ * @ref RetryUtilsParams_t.nextJitterMax. After sleeping this function must set
+ * @ref RetryUtilsParams_t.nextJitterMax to three times the sleep, but not
+ * exceeding @ref RETRY_BACKOFF_MAX_MS. When @ref RetryUtilsParams_t.maxRetryAttempts
  * are reached this function should return @ref RetryUtilsRetriesExhausted, unless
  * @ref RetryUtilsParams_t.maxRetryAttempts is set to zero.
  * When @ref RetryUtilsRetriesExhausted is returned the calling application can
@@ -123,31 +127,31 @@
  * RetryUtilsStatus_t RetryUtils_BackoffAndSleep( RetryUtilsParams_t * pRetryParams )
  * {
  *     RetryUtilsStatus_t status = RetryUtilsRetriesExhausted;
- *     // The quiet period delay in seconds.
- *     int backOffDelay = 0;
+ *     // The quiet period delay in milliseconds.
+ *     uint32_t backOffDelayMs = 0;
  *
  *     // If pRetryParams->maxRetryAttempts is set to 0, try forever.
  *     if( ( pRetryParams->attemptsDone < pRetryParams->maxRetryAttempts ) ||
  *         ( 0U == pRetryParams->maxRetryAttempts ) )
  *     {
- *         // Choose a random value for back-off time between 0 and the max jitter value.
- *         backOffDelay = rand() % pRetryParams->nextJitterMax;
+ *         // Choose a random back-off time between the base and the max jitter value.
+ *         backOffDelayMs = RETRY_BACKOFF_BASE_MS +
+ *                          ( rand() % ( pRetryParams->nextJitterMax - RETRY_BACKOFF_BASE_MS + 1U ) );
  *
  *         //  Wait for backoff time to expire for the next retry.
- *         ( void ) myThreadSleepFunction( backOffDelay ); // FIXME: Replace with your system's thread sleep function.
+ *         ( void ) myThreadSleepFunction( backOffDelayMs ); // FIXME: Replace with your system's thread sleep function.
  *
  *         // Increment backoff counts.
  *         pRetryParams->attemptsDone++;
  *
- *         // Double the max jitter value for the next retry attempt, only
- *         // if the new value will be less than the max backoff time value.
- *         if( pRetryParams->nextJitterMax < ( MAX_RETRY_BACKOFF_SECONDS / 2U ) )
+ *         // The next sleep is at most three times this one, capped at the maximum.
+ *         if( backOffDelayMs < ( RETRY_BACKOFF_MAX_MS / 3U ) )
  *         {
- *             pRetryParams->nextJitterMax += pRetryParams->nextJitterMax;
+ *             pRetryParams->nextJitterMax = backOffDelayMs * 3U;
  *         }
  *         else
  *         {
- *             pRetryParams->nextJitterMax = MAX_RETRY_BACKOFF_SECONDS;
+ *             pRetryParams->nextJitterMax = RETRY_BACKOFF_MAX_MS;
  *         }
  *
  *         status = RetryUtilsSuccess;
@@ -173,20 +177,18 @@
 #define MAX_RETRY_ATTEMPTS               4U
 
 /**
- * @brief Initial fixed backoff value in seconds between two successive
- * retries. A random jitter value is added to every backoff value.
+ * @brief Lower bound in milliseconds of every backoff sleep.
  */
-#define INITIAL_RETRY_BACKOFF_SECONDS    1U
+#ifndef RETRY_BACKOFF_BASE_MS
+    #define RETRY_BACKOFF_BASE_MS    500U
+#endif
 
 /**
- * @brief Max backoff value in seconds.
+ * @brief Max backoff value in milliseconds.
  */
-#define MAX_RETRY_BACKOFF_SECONDS        128U
-
-/**
- * @brief Max jitter value in seconds.
- */
-#define MAX_JITTER_VALUE_SECONDS         5U
+#ifndef RETRY_BACKOFF_MAX_MS
+    #define RETRY_BACKOFF_MAX_MS     128000U
+#endif
 
 /**
  * @brief Status for @ref RetryUtils_BackoffAndSleep.
@@ -215,7 +217,7 @@ typedef struct RetryUtilsParams
     uint32_t attemptsDone;
 
     /**
-     * @brief The max jitter value for backoff time in retry attempt.
+     * @brief The max backoff time in milliseconds for the next retry attempt.
      */
     uint32_t nextJitterMax;
 } RetryUtilsParams_t;
@@ -242,4 +244,13 @@ void RetryUtils_ParamsReset( RetryUtilsParams_t * pRetryParams );
  */
 RetryUtilsStatus_t RetryUtils_BackoffAndSleep( RetryUtilsParams_t * pRetryParams );
 
+/**
+ * @brief Wake up every task sleeping in @ref RetryUtils_BackoffAndSleep so
+ * that it retries immediately.
+ *
+ * Intended for events that make an immediate retry likely to succeed, such as
+ * the network interface coming back up. Must be called from task context.
+ */
+void RetryUtils_AbortSleep( void );
+
 #endif /* ifndef RETRY_UTILS_H_ */
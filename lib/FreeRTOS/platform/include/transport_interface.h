@@ -186,6 +186,19 @@ typedef int32_t ( * TransportSend_t )( const NetworkContext_t * pNetworkContext,
                                        size_t bytesToSend );
 /* @[define_transportsend] */
 
+/**
+ * @transportcallback
+ * @brief Transport interface for writing out the bytes a transport has buffered from previous sends.
+ *
+ * @param[in] pNetworkContext Implementation-defined network context.
+ *
+ * @return 0 once all the buffered bytes are sent, the number of bytes still buffered if
+ * the network timed out, or a negative error code.
+ */
+/* @[define_transportflush] */
+typedef int32_t ( * TransportFlush_t )( const NetworkContext_t * pNetworkContext );
+/* @[define_transportflush] */
+
 /**
  * @transportstruct
  * @brief The transport layer interface.
@@ -195,6 +208,7 @@ typedef struct TransportInterface
 {
     TransportRecv_t recv;               /**< Transport receive interface. */
     TransportSend_t send;               /**< Transport send interface. */
+    TransportFlush_t flush;             /**< Transport flush interface, NULL if the transport does not buffer sends. */
     NetworkContext_t * pNetworkContext; /**< Implementation-defined network context. */
 } TransportInterface_t;
 /* @[define_transportinterface] */
@@ -0,0 +1,169 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file entropy_pool.c
+ * @brief CTR_DRBG seeded from the hardware RNG, see entropy_pool.h.
+ *
+ * Reading the hardware RNG is slow since most of its output is discarded to let entropy
+ * accumulate between words. It is therefore only read to seed the DRBG, and to reseed it from
+ * the timer task, while the callers get DRBG output at the speed of AES.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/threading.h"
+
+#include "entropy_pool.h"
+
+/*-----------------------------------------------------------*/
+
+/* Personalization string, distinguishes this DRBG from the one of the PKCS #11 module. */
+static const unsigned char ucPersonalization[] = "entropy_pool";
+
+static mbedtls_ctr_drbg_context xDrbg;
+static BaseType_t xSeeded = pdFALSE;
+
+/* Serializes the DRBG, mbedtls_ctr_drbg_reseed() does not lock the context. */
+static SemaphoreHandle_t xPoolMutex = NULL;
+static StaticSemaphore_t xPoolMutexBuffer;
+
+static TimerHandle_t xReseedTimer = NULL;
+static StaticTimer_t xReseedTimerBuffer;
+
+/*-----------------------------------------------------------*/
+
+/* Entropy callback of the DRBG. */
+static int prvHardwareEntropy( void * pvContext,
+                               unsigned char * pucOutput,
+                               size_t xLength )
+{
+    ( void ) pvContext;
+
+    return CRYPTO_GetHardwareEntropy( pucOutput, xLength );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reseeds the DRBG in the background, skipped when the DRBG is busy, the next period retries. */
+static void prvReseedTimerCallback( TimerHandle_t xTimer )
+{
+    ( void ) xTimer;
+
+    if( xSemaphoreTake( xPoolMutex, 0 ) == pdTRUE )
+    {
+        /* On failure the current state is kept, it is still unpredictable. */
+        ( void ) mbedtls_ctr_drbg_reseed( &xDrbg, NULL, 0 );
+
+        ( void ) xSemaphoreGive( xPoolMutex );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Seeds the DRBG and starts the reseed timer, called with the mutex held. */
+static BaseType_t prvSeed( void )
+{
+    /* The DRBG context has a mbed TLS mutex, which is set up by the threading functions. */
+    mbedtls_platform_threading_init();
+    mbedtls_ctr_drbg_init( &xDrbg );
+
+    if( mbedtls_ctr_drbg_seed( &xDrbg,
+                               prvHardwareEntropy,
+                               NULL,
+                               ucPersonalization,
+                               sizeof( ucPersonalization ) - 1U ) == 0 )
+    {
+        /* Reseeding is scheduled by the timer rather than when the mbed TLS interval elapses,
+         * which would block the caller on the hardware RNG. */
+        mbedtls_ctr_drbg_set_reseed_interval( &xDrbg, INT32_MAX );
+        xSeeded = pdTRUE;
+
+        xReseedTimer = xTimerCreateStatic( "EntropyReseed",
+                                           pdMS_TO_TICKS( entropypoolRESEED_INTERVAL_MS ),
+                                           pdTRUE,
+                                           NULL,
+                                           prvReseedTimerCallback,
+                                           &xReseedTimerBuffer );
+        configASSERT( xReseedTimer != NULL );
+        ( void ) xTimerStart( xReseedTimer, 0 );
+    }
+    else
+    {
+        mbedtls_ctr_drbg_free( &xDrbg );
+    }
+
+    return xSeeded;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xEntropyPoolGetBytes( uint8_t * pucOutput,
+                                 size_t xLength )
+{
+    BaseType_t xResult = pdTRUE;
+    size_t xChunk;
+
+    configASSERT( pucOutput != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( xPoolMutex == NULL )
+        {
+            xPoolMutex = xSemaphoreCreateMutexStatic( &xPoolMutexBuffer );
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    ( void ) xSemaphoreTake( xPoolMutex, portMAX_DELAY );
+
+    if( xSeeded == pdFALSE )
+    {
+        xResult = prvSeed();
+    }
+
+    while( ( xResult == pdTRUE ) && ( xLength > 0U ) )
+    {
+        xChunk = ( xLength < MBEDTLS_CTR_DRBG_MAX_REQUEST ) ? xLength : MBEDTLS_CTR_DRBG_MAX_REQUEST;
+
+        if( mbedtls_ctr_drbg_random_with_add( &xDrbg, pucOutput, xChunk, NULL, 0 ) != 0 )
+        {
+            xResult = pdFALSE;
+        }
+
+        pucOutput += xChunk;
+        xLength -= xChunk;
+    }
+
+    ( void ) xSemaphoreGive( xPoolMutex );
+
+    return xResult;
+}
@@ -25,6 +25,8 @@
 
 #include "fsl_common.h"
 
+#include "entropy_pool.h"
+
 
 #if defined(FSL_FEATURE_SOC_LTC_COUNT) && (FSL_FEATURE_SOC_LTC_COUNT > 0)
 #include "fsl_ltc.h"
@@ -38,6 +40,9 @@
 #if defined(FSL_FEATURE_SOC_DCP_COUNT) && (FSL_FEATURE_SOC_DCP_COUNT > 0)
 #include "fsl_dcp.h"
 #endif
+#if defined(FSL_FEATURE_SOC_SHA_COUNT) && (FSL_FEATURE_SOC_SHA_COUNT > 0)
+#include "fsl_sha.h"
+#endif
 #if defined(FSL_FEATURE_SOC_TRNG_COUNT) && (FSL_FEATURE_SOC_TRNG_COUNT > 0)
 #include "fsl_trng.h"
 #elif defined(FSL_FEATURE_SOC_RNG_COUNT) && (FSL_FEATURE_SOC_RNG_COUNT > 0)
@@ -47,7 +52,7 @@
 #endif
 
 
-int mbedtls_hardware_poll(void *data, unsigned char *output, size_t len, size_t *olen)
+int CRYPTO_GetHardwareEntropy(unsigned char *output, size_t len)
 {
     status_t result = kStatus_Success;
 
@@ -82,7 +87,7 @@ int mbedtls_hardware_poll(void *data, unsigned char *output, size_t len, size_t
         {
             memcpy(output, &rn, length);
             output += length;
-            len = 0U;
+            length = 0U;
         }
 
         /* Discard next 32 random words for better entropy */
@@ -94,15 +99,21 @@ int mbedtls_hardware_poll(void *data, unsigned char *output, size_t len, size_t
 
     result = kStatus_Success;
 #endif
-    if (result == kStatus_Success)
-    {
-        *olen = len;
-        return 0;
-    }
-    else
+    return (result == kStatus_Success) ? 0 : result;
+}
+
+/* Served from the DRBG of entropy_pool.c, which only reads the hardware RNG to (re)seed. */
+int mbedtls_hardware_poll(void *data, unsigned char *output, size_t len, size_t *olen)
+{
+    (void)data;
+
+    if (xEntropyPoolGetBytes(output, len) != pdTRUE)
     {
-        return result;
+        return kStatus_Fail;
     }
+
+    *olen = len;
+    return 0;
 }
 
 
@@ -132,6 +143,10 @@ void CRYPTO_InitHardware(void)
 
     DCP_GetDefaultConfig(&dcpConfig);
     DCP_Init(DCP, &dcpConfig);
+#endif
+#if defined(FSL_FEATURE_SOC_SHA_COUNT) && (FSL_FEATURE_SOC_SHA_COUNT > 0)
+    /* Clock the SHA engine, used for the digest of OTA images */
+    SHA_Enable(SHA0);
 #endif
     { /* Init RNG module.*/
 #if defined(FSL_FEATURE_SOC_TRNG_COUNT) && (FSL_FEATURE_SOC_TRNG_COUNT > 0)
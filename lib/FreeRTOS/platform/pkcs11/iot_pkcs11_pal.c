@@ -37,6 +37,7 @@
 #include "FreeRTOS.h"
 #include "FreeRTOSIPConfig.h"
 #include "task.h"
+#include "semphr.h"
 #include "core_pkcs11.h"
 #include "core_pkcs11_config.h"
 #include "tls_freertos_pkcs11.h"
@@ -51,12 +52,65 @@
 #define pkcs11palFILE_NAME_CLIENT_CERTIFICATE    "FreeRTOS_P11_Certificate.dat"
 #define pkcs11palFILE_NAME_KEY                   "FreeRTOS_P11_Key.dat"
 #define pkcs11palFILE_CODE_SIGN_PUBLIC_KEY       "FreeRTOS_P11_CodeSignKey.dat"
+#define pkcs11palFILE_TLS_PSK                    "FreeRTOS_P11_TlsPsk.dat"
+#define pkcs11palFILE_TLS_PSK_IDENTITY           "FreeRTOS_P11_TlsPskIdentity.dat"
 #define FILENAME_AWS_THING_NAME "aws_thing_name.dat"
 #define FILENAME_AWS_ENDPOINT   "aws_endpoint.dat"
+/* Download checkpoint of the OTA PAL, see OTA_PAL_CHECKPOINT_FILE in ota_pal.c */
+#define FILENAME_OTA_CHECKPOINT "ota_checkpoint.dat"
+/* Last DHCP lease, see dhcpleaseFILE in dhcp_lease.c */
+#define FILENAME_DHCP_LEASE     "dhcp_lease.dat"
+/* Committed and trial application modules, see appmoduleFILE in app_module.c */
+#define FILENAME_APP_MODULE     "app_module.dat"
 
 #define MAX_LENGTH_AWS_ENDPOINT   64
 #define MAX_LENGTH_AWS_THING_NAME 32
 
+#ifndef pkcs11configPAL_CACHE_PARSED_OBJECTS
+    #define pkcs11configPAL_CACHE_PARSED_OBJECTS    0
+#endif
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+    #include "mbedtls/x509_crt.h"
+    #include "mbedtls/pk.h"
+
+    /* Device certificate parsed on first use, the public key is part of it. */
+    static mbedtls_x509_crt xCachedCertificate;
+    static BaseType_t xCachedCertificateValid = pdFALSE;
+
+    /* Device private key parsed on first use. Only signatures are handed out, the key stays in
+     * this file and is zeroized by mbedtls_pk_free() when the cache is invalidated. */
+    static mbedtls_pk_context xCachedPrivateKey;
+    static BaseType_t xCachedPrivateKeyValid = pdFALSE;
+
+    /* Code signing public key, parsed when an OTA job starts so that closing the image only
+     * verifies the signature. */
+    static mbedtls_pk_context xCachedCodeSignKey;
+    static BaseType_t xCachedCodeSignKeyValid = pdFALSE;
+
+    /* Serializes parsing and invalidation, connections may be set up from several tasks. */
+    static SemaphoreHandle_t xCacheMutex = NULL;
+    static StaticSemaphore_t xCacheMutexBuffer;
+
+    mbedtls_x509_crt * PKCS11_PAL_GetCachedCertificate( void );
+    BaseType_t PKCS11_PAL_GetCachedKeyType( CK_KEY_TYPE * pxKeyType );
+    int PKCS11_PAL_SignWithCachedKey( mbedtls_md_type_t xMdAlg,
+                                      const unsigned char * pucHash,
+                                      size_t xHashLen,
+                                      unsigned char * pucSig,
+                                      size_t * pxSigLen,
+                                      int ( * piRng )( void *,
+                                                       unsigned char *,
+                                                       size_t ),
+                                      void * pvRng );
+    BaseType_t PKCS11_PAL_PreloadCodeSignKey( void );
+    int PKCS11_PAL_VerifyWithCachedCodeSignKey( const uint8_t * pucHash,
+                                                size_t xHashLen,
+                                                const uint8_t * pucSignature,
+                                                size_t xSignatureLen );
+    void PKCS11_PAL_InvalidateCache( void );
+#endif
+
 enum eObjectHandles
 {
     eInvalidHandle = 0, /* According to PKCS #11 spec, 0 is never a valid object handle. */
@@ -65,7 +119,9 @@ enum eObjectHandles
     eAwsDeviceCertificate,
     eAwsCodeSigningKey, 
     eAwsThing,
-    eAwsThingEndpoint
+    eAwsThingEndpoint,
+    eTlsPsk,
+    eTlsPskIdentity
 };
 
 /* Flash structure */
@@ -86,10 +142,84 @@ mflash_file_t g_cert_files[] =
     {.path       = FILENAME_AWS_ENDPOINT,
      .flash_addr = MFLASH_FILE_BASEADDR + 4 * MFLASH_FILE_SIZE,
      .max_size   = MFLASH_FILE_SIZE},
+    { .path = pkcs11palFILE_TLS_PSK,
+      .flash_addr = MFLASH_FILE_BASEADDR + ( 5 * MFLASH_FILE_SIZE ),
+      .max_size = MFLASH_FILE_SIZE },
+    { .path = pkcs11palFILE_TLS_PSK_IDENTITY,
+      .flash_addr = MFLASH_FILE_BASEADDR + ( 6 * MFLASH_FILE_SIZE ),
+      .max_size = MFLASH_FILE_SIZE },
+    { .path = FILENAME_OTA_CHECKPOINT,
+      .flash_addr = MFLASH_FILE_BASEADDR + ( 7 * MFLASH_FILE_SIZE ),
+      .max_size = MFLASH_FILE_SIZE },
+    { .path = FILENAME_DHCP_LEASE,
+      .flash_addr = MFLASH_FILE_BASEADDR + ( 8 * MFLASH_FILE_SIZE ),
+      .max_size = MFLASH_FILE_SIZE },
+    { .path = FILENAME_APP_MODULE,
+      .flash_addr = MFLASH_FILE_BASEADDR + ( 9 * MFLASH_FILE_SIZE ),
+      .max_size = MFLASH_FILE_SIZE },
     { 0 }
 };
 
 
+/*-----------------------------------------------------------*/
+
+/* Label of each object and the file it is stored in. */
+typedef struct LabelFile
+{
+    const char * pcLabel;
+    size_t xLabelSize; /* Including the terminating NULL. */
+    char * pcFileName;
+    CK_OBJECT_HANDLE xHandle;
+} LabelFile_t;
+
+#define pkcs11palLABEL_FILE( label, file, handle )    { label, sizeof( label ), file, handle }
+
+static const LabelFile_t xLabelFiles[] =
+{
+    pkcs11palLABEL_FILE( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS, pkcs11palFILE_NAME_CLIENT_CERTIFICATE, eAwsDeviceCertificate ),
+    pkcs11palLABEL_FILE( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS, pkcs11palFILE_NAME_KEY,                eAwsDevicePrivateKey  ),
+    pkcs11palLABEL_FILE( pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,  pkcs11palFILE_NAME_KEY,                eAwsDevicePublicKey   ),
+    pkcs11palLABEL_FILE( pkcs11configLABEL_CODE_VERIFICATION_KEY,      pkcs11palFILE_CODE_SIGN_PUBLIC_KEY,    eAwsCodeSigningKey    ),
+    pkcs11palLABEL_FILE( FILENAME_AWS_THING_NAME,                      FILENAME_AWS_THING_NAME,               eAwsThing             ),
+    pkcs11palLABEL_FILE( FILENAME_AWS_ENDPOINT,                        FILENAME_AWS_ENDPOINT,                 eAwsThingEndpoint     ),
+    pkcs11palLABEL_FILE( pkcs11configLABEL_TLS_PSK,                    pkcs11palFILE_TLS_PSK,                 eTlsPsk               ),
+    pkcs11palLABEL_FILE( pkcs11configLABEL_TLS_PSK_IDENTITY,           pkcs11palFILE_TLS_PSK_IDENTITY,        eTlsPskIdentity       ),
+};
+
+#define pkcs11palLABEL_FILE_COUNT    ( sizeof( xLabelFiles ) / sizeof( xLabelFiles[ 0 ] ) )
+
+/* Hash of each label, computed once so a lookup compares a single label. */
+static uint32_t ulLabelHashes[ pkcs11palLABEL_FILE_COUNT ];
+static BaseType_t xLabelHashesReady = pdFALSE;
+
+/* Bit ( 1 << handle ) is set when the object is stored, built by PKCS11_PAL_Initialize. */
+static uint32_t ulObjectPresence = 0;
+
+/*-----------------------------------------------------------*/
+
+/* Updates the presence of the objects stored in pcFileName, or of all objects if NULL. */
+static void prvUpdateObjectPresence( const char * pcFileName )
+{
+    uint8_t * pucData = NULL;
+    uint32_t ulDataSize = 0;
+    size_t i;
+
+    for( i = 0; i < pkcs11palLABEL_FILE_COUNT; i++ )
+    {
+        if( ( pcFileName == NULL ) || ( pcFileName == xLabelFiles[ i ].pcFileName ) )
+        {
+            if( pdTRUE == mflash_read_file( xLabelFiles[ i ].pcFileName, &pucData, &ulDataSize ) )
+            {
+                ulObjectPresence |= ( 1UL << xLabelFiles[ i ].xHandle );
+            }
+            else
+            {
+                ulObjectPresence &= ~( 1UL << xLabelFiles[ i ].xHandle );
+            }
+        }
+    }
+}
+
 /*-----------------------------------------------------------*/
 
 /* Converts a label to its respective filename and handle. */
@@ -97,55 +227,36 @@ void prvLabelToFilenameHandle( uint8_t * pcLabel,
                                char ** pcFileName,
                                CK_OBJECT_HANDLE_PTR pHandle )
 {
+    uint32_t ulHash;
+    size_t i;
+
     if( pcLabel != NULL )
     {
-        /* Translate from the PKCS#11 label to local storage file name. */
-        if( 0 == memcmp( pcLabel,
-                         &pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
-                         sizeof( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_CLIENT_CERTIFICATE;
-            *pHandle = eAwsDeviceCertificate;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
-                              sizeof( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_KEY;
-            *pHandle = eAwsDevicePrivateKey;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,
-                              sizeof( pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_KEY;
-            *pHandle = eAwsDevicePublicKey;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &pkcs11configLABEL_CODE_VERIFICATION_KEY,
-                              sizeof( pkcs11configLABEL_CODE_VERIFICATION_KEY ) ) )
+        if( xLabelHashesReady == pdFALSE )
         {
-            *pcFileName = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY;
-            *pHandle = eAwsCodeSigningKey;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &FILENAME_AWS_THING_NAME,
-                              sizeof( FILENAME_AWS_THING_NAME ) ) )
-        {
-            *pcFileName = FILENAME_AWS_THING_NAME;
-            *pHandle = eAwsThing;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &FILENAME_AWS_ENDPOINT,
-                              sizeof( FILENAME_AWS_ENDPOINT ) ) )
-        {
-            *pcFileName = FILENAME_AWS_ENDPOINT;
-            *pHandle = eAwsThingEndpoint;
+            for( i = 0; i < pkcs11palLABEL_FILE_COUNT; i++ )
+            {
+                ulLabelHashes[ i ] = mflash_path_hash( xLabelFiles[ i ].pcLabel );
+            }
+
+            xLabelHashesReady = pdTRUE;
         }
-        else
+
+        *pcFileName = NULL;
+        *pHandle = eInvalidHandle;
+
+        /* Translate from the PKCS#11 label to local storage file name. */
+        ulHash = mflash_path_hash( ( const char * ) pcLabel );
+
+        for( i = 0; i < pkcs11palLABEL_FILE_COUNT; i++ )
         {
-            *pcFileName = NULL;
-            *pHandle = eInvalidHandle;
+            if( ( ulLabelHashes[ i ] == ulHash ) &&
+                ( 0 == memcmp( pcLabel, xLabelFiles[ i ].pcLabel, xLabelFiles[ i ].xLabelSize ) ) )
+            {
+                *pcFileName = xLabelFiles[ i ].pcFileName;
+                *pHandle = xLabelFiles[ i ].xHandle;
+                break;
+            }
         }
     }
 }
@@ -175,10 +286,21 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 
     if( xHandle != eInvalidHandle )
     {
+        #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+            if( ( xHandle == eAwsDeviceCertificate ) || ( xHandle == eAwsDevicePrivateKey ) ||
+                ( xHandle == eAwsDevicePublicKey ) || ( xHandle == eAwsCodeSigningKey ) )
+            {
+                PKCS11_PAL_InvalidateCache();
+            }
+        #endif
+
         if( pdFALSE == mflash_save_file( pcFileName, pucData, ulDataSize ) )
         {
             xHandle = eInvalidHandle;
         }
+
+        /* A failed save may have kept the previous object or may have lost it. */
+        prvUpdateObjectPresence( pcFileName );
     }
 
     return xHandle;
@@ -186,6 +308,292 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 
 /*-----------------------------------------------------------*/
 
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+
+/**
+ * @brief Gets the device certificate parsed from storage, parsing it on first use.
+ *
+ * The certificate stays valid until the certificate or the key is saved. It is only needed
+ * during the TLS handshake, saves happen while provisioning, before any connection.
+ *
+ * @return The parsed certificate or NULL if it is not provisioned or does not parse.
+ */
+    mbedtls_x509_crt * PKCS11_PAL_GetCachedCertificate( void )
+    {
+        mbedtls_x509_crt * pxCertificate = NULL;
+        uint8_t * pucData = NULL;
+        uint32_t ulDataSize = 0;
+
+        if( ( xCacheMutex != NULL ) && ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+        {
+            if( xCachedCertificateValid == pdFALSE )
+            {
+                mbedtls_x509_crt_init( &xCachedCertificate );
+
+                /* Parsed straight from flash, without an intermediate copy. */
+                if( ( pdTRUE == mflash_read_file( pkcs11palFILE_NAME_CLIENT_CERTIFICATE, &pucData, &ulDataSize ) ) &&
+                    ( 0 == mbedtls_x509_crt_parse( &xCachedCertificate, pucData, ulDataSize ) ) )
+                {
+                    xCachedCertificateValid = pdTRUE;
+                }
+                else
+                {
+                    mbedtls_x509_crt_free( &xCachedCertificate );
+                }
+            }
+
+            if( xCachedCertificateValid == pdTRUE )
+            {
+                pxCertificate = &xCachedCertificate;
+            }
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+
+        return pxCertificate;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Parses the device private key if it is not cached yet, with the cache mutex held. */
+    static BaseType_t prvLoadPrivateKey( void )
+    {
+        uint8_t * pucData = NULL;
+        uint32_t ulDataSize = 0;
+
+        if( xCachedPrivateKeyValid == pdFALSE )
+        {
+            mbedtls_pk_init( &xCachedPrivateKey );
+
+            /* Stored in DER by corePKCS11, parsed straight from flash. */
+            if( ( pdTRUE == mflash_read_file( pkcs11palFILE_NAME_KEY, &pucData, &ulDataSize ) ) &&
+                ( 0 == mbedtls_pk_parse_key( &xCachedPrivateKey, pucData, ulDataSize, NULL, 0 ) ) )
+            {
+                xCachedPrivateKeyValid = pdTRUE;
+            }
+            else
+            {
+                mbedtls_pk_free( &xCachedPrivateKey );
+            }
+        }
+
+        return xCachedPrivateKeyValid;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Gets the type of the device private key, parsing the key on first use.
+ *
+ * @param[out] pxKeyType CKK_EC or CKK_RSA.
+ *
+ * @return pdTRUE if the key is provisioned and of a known type.
+ */
+    BaseType_t PKCS11_PAL_GetCachedKeyType( CK_KEY_TYPE * pxKeyType )
+    {
+        BaseType_t xReturn = pdFALSE;
+
+        if( ( xCacheMutex != NULL ) && ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+        {
+            if( prvLoadPrivateKey() == pdTRUE )
+            {
+                if( mbedtls_pk_can_do( &xCachedPrivateKey, MBEDTLS_PK_ECKEY ) )
+                {
+                    *pxKeyType = CKK_EC;
+                    xReturn = pdTRUE;
+                }
+                else if( mbedtls_pk_can_do( &xCachedPrivateKey, MBEDTLS_PK_RSA ) )
+                {
+                    *pxKeyType = CKK_RSA;
+                    xReturn = pdTRUE;
+                }
+            }
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+
+        return xReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Signs a hash with the device private key, parsing the key on first use, as the
+ * sign function of an mbed TLS pk context.
+ *
+ * The signature is written as mbed TLS expects it, DER encoded for ECDSA. Signatures are
+ * serialized by the cache mutex: the key context is not safe for concurrent use, the first
+ * ECDSA signature stores the comb table of the generator in the group of the key.
+ *
+ * @return 0 on success, MBEDTLS_ERR_PK_KEY_INVALID_FORMAT if the key is not provisioned or
+ * does not parse, or the error of mbedtls_pk_sign().
+ */
+    int PKCS11_PAL_SignWithCachedKey( mbedtls_md_type_t xMdAlg,
+                                      const unsigned char * pucHash,
+                                      size_t xHashLen,
+                                      unsigned char * pucSig,
+                                      size_t * pxSigLen,
+                                      int ( * piRng )( void *,
+                                                       unsigned char *,
+                                                       size_t ),
+                                      void * pvRng )
+    {
+        int lResult = MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+
+        if( ( xCacheMutex != NULL ) && ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+        {
+            if( prvLoadPrivateKey() == pdTRUE )
+            {
+                lResult = mbedtls_pk_sign( &xCachedPrivateKey, xMdAlg, pucHash, xHashLen,
+                                           pucSig, pxSigLen, piRng, pvRng );
+            }
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+
+        return lResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Parses the code signing key if it is not cached yet, with the cache mutex held. */
+    static BaseType_t prvLoadCodeSignKey( void )
+    {
+        uint8_t * pucData = NULL;
+        uint32_t ulDataSize = 0;
+
+        if( xCachedCodeSignKeyValid == pdFALSE )
+        {
+            mbedtls_pk_init( &xCachedCodeSignKey );
+
+            if( ( pdTRUE == mflash_read_file( pkcs11palFILE_CODE_SIGN_PUBLIC_KEY, &pucData, &ulDataSize ) ) &&
+                ( 0 == mbedtls_pk_parse_public_key( &xCachedCodeSignKey, pucData, ulDataSize ) ) &&
+                mbedtls_pk_can_do( &xCachedCodeSignKey, MBEDTLS_PK_ECDSA ) )
+            {
+                xCachedCodeSignKeyValid = pdTRUE;
+            }
+            else
+            {
+                mbedtls_pk_free( &xCachedCodeSignKey );
+            }
+        }
+
+        return xCachedCodeSignKeyValid;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Parses the code signing key ahead of the signature check of an OTA image, and
+ * computes the comb table of the generator that the first verification would otherwise
+ * build, when MBEDTLS_ECP_FIXED_POINT_OPTIM keeps it in the group.
+ *
+ * @return pdTRUE if the key is provisioned and parses.
+ */
+    BaseType_t PKCS11_PAL_PreloadCodeSignKey( void )
+    {
+        BaseType_t xReturn = pdFALSE;
+        mbedtls_ecp_keypair * pxKeyPair;
+        mbedtls_ecp_point xPoint;
+        mbedtls_mpi xOne;
+
+        if( ( xCacheMutex != NULL ) && ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+        {
+            if( ( xCachedCodeSignKeyValid == pdFALSE ) && ( prvLoadCodeSignKey() == pdTRUE ) )
+            {
+                pxKeyPair = mbedtls_pk_ec( xCachedCodeSignKey );
+                mbedtls_ecp_point_init( &xPoint );
+                mbedtls_mpi_init( &xOne );
+
+                /* 1 * G stores the table of G, no blinding is needed for a public scalar. */
+                if( 0 == mbedtls_mpi_lset( &xOne, 1 ) )
+                {
+                    ( void ) mbedtls_ecp_mul( &pxKeyPair->grp, &xPoint, &xOne, &pxKeyPair->grp.G, NULL, NULL );
+                }
+
+                mbedtls_mpi_free( &xOne );
+                mbedtls_ecp_point_free( &xPoint );
+            }
+
+            xReturn = xCachedCodeSignKeyValid;
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+
+        return xReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Verifies an ECDSA signature with the code signing key, parsing the key if it was
+ * not preloaded. Verifications are serialized by the cache mutex, as the group of the key
+ * holds the comb table of the generator.
+ *
+ * @param[in] pucHash SHA-256 digest of the image.
+ * @param[in] xHashLen Length of the digest.
+ * @param[in] pucSignature DER encoded signature, as received in the OTA job document.
+ * @param[in] xSignatureLen Length of the signature.
+ *
+ * @return 0 if the signature is valid, MBEDTLS_ERR_PK_KEY_INVALID_FORMAT if the key is not
+ * provisioned or does not parse, or the error of mbedtls_pk_verify().
+ */
+    int PKCS11_PAL_VerifyWithCachedCodeSignKey( const uint8_t * pucHash,
+                                                size_t xHashLen,
+                                                const uint8_t * pucSignature,
+                                                size_t xSignatureLen )
+    {
+        int lResult = MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+
+        if( ( xCacheMutex != NULL ) && ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+        {
+            if( prvLoadCodeSignKey() == pdTRUE )
+            {
+                lResult = mbedtls_pk_verify( &xCachedCodeSignKey, MBEDTLS_MD_SHA256, pucHash, xHashLen,
+                                             pucSignature, xSignatureLen );
+            }
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+
+        return lResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Frees the parsed objects, they are parsed again on next use.
+ */
+    void PKCS11_PAL_InvalidateCache( void )
+    {
+        if( ( xCacheMutex != NULL ) && ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+        {
+            if( xCachedCertificateValid == pdTRUE )
+            {
+                mbedtls_x509_crt_free( &xCachedCertificate );
+                xCachedCertificateValid = pdFALSE;
+            }
+
+            if( xCachedPrivateKeyValid == pdTRUE )
+            {
+                mbedtls_pk_free( &xCachedPrivateKey );
+                xCachedPrivateKeyValid = pdFALSE;
+            }
+
+            if( xCachedCodeSignKeyValid == pdTRUE )
+            {
+                mbedtls_pk_free( &xCachedCodeSignKey );
+                xCachedCodeSignKeyValid = pdFALSE;
+            }
+
+            ( void ) xSemaphoreGive( xCacheMutex );
+        }
+    }
+
+#endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 ) */
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Translates a PKCS #11 label into an object handle.
  *
@@ -208,8 +616,11 @@ CK_OBJECT_HANDLE PKCS11_PAL_FindObject( uint8_t * pLabel,
     /* Translate from the PKCS#11 label to local storage file name. */
     prvLabelToFilenameHandle( pLabel, &pcFileName, &xHandle );
 
-    /*TODO: check if file actually there.
-     * Note: g_cert_files only seems to check if the entry in the array is present */
+    /* Only objects actually stored are found. */
+    if( 0 == ( ulObjectPresence & ( 1UL << xHandle ) ) )
+    {
+        xHandle = eInvalidHandle;
+    }
 
     return xHandle;
 }
@@ -279,6 +690,16 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
         pcFileName = FILENAME_AWS_ENDPOINT;
         *pIsPrivate = CK_FALSE;
     }
+    else if( xHandle == eTlsPsk )
+    {
+        pcFileName = pkcs11palFILE_TLS_PSK;
+        *pIsPrivate = CK_TRUE;
+    }
+    else if( xHandle == eTlsPskIdentity )
+    {
+        pcFileName = pkcs11palFILE_TLS_PSK_IDENTITY;
+        *pIsPrivate = CK_FALSE;
+    }
     else
     {
         ulReturn = CKR_KEY_HANDLE_INVALID;
@@ -320,10 +741,16 @@ void PKCS11_PAL_GetObjectValueCleanup( uint8_t * pucData,
 CK_RV PKCS11_PAL_Initialize( void )
 {
     CK_RV xResult = CKR_OK;
-    mbedtls_threading_set_alt( mbedtls_platform_mutex_init,
-                               mbedtls_platform_mutex_free,
-                               mbedtls_platform_mutex_lock,
-                               mbedtls_platform_mutex_unlock );
+
+    /* Shared with the TLS transport. */
+    mbedtls_platform_threading_init();
+
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        if( xCacheMutex == NULL )
+        {
+            xCacheMutex = xSemaphoreCreateMutexStatic( &xCacheMutexBuffer );
+        }
+    #endif
 
     if( !mflash_is_initialized() )
     {
@@ -334,5 +761,10 @@ CK_RV PKCS11_PAL_Initialize( void )
         }
     }
 
+    if( xResult == CKR_OK )
+    {
+        prvUpdateObjectPresence( NULL );
+    }
+
     return xResult;
 }
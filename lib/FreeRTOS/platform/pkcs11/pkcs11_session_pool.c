@@ -0,0 +1,205 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file pkcs11_session_pool.c
+ * @brief Pool of long-lived PKCS #11 sessions, see pkcs11_session_pool.h.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "core_pkcs11_config.h"
+#include "core_pkcs11.h"
+#include "pkcs11_session_pool.h"
+
+/*-----------------------------------------------------------*/
+
+typedef struct PoolEntry
+{
+    CK_SESSION_HANDLE xSession; /* CK_INVALID_HANDLE until opened. */
+    BaseType_t xInUse;
+} PoolEntry_t;
+
+static PoolEntry_t xPool[ pkcs11poolSESSION_COUNT ];
+
+/* Handles of objects are valid in all sessions of the token, looked up again once reported invalid. */
+static CK_OBJECT_HANDLE xObjects[ ePkcs11PoolObjectCount ];
+static BaseType_t xObjectsFound = pdFALSE;
+
+/* Counts the free entries. */
+static SemaphoreHandle_t xPoolSemaphore = NULL;
+static StaticSemaphore_t xPoolSemaphoreBuffer;
+
+/*-----------------------------------------------------------*/
+
+/* Looks up the handles of the objects, missing objects are left to CK_INVALID_HANDLE. */
+static void prvFindObjects( CK_SESSION_HANDLE xSession )
+{
+    static const char * const pcLabels[ ePkcs11PoolObjectCount ] =
+    {
+        pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
+        pkcs11configLABEL_CODE_VERIFICATION_KEY
+    };
+    static const CK_OBJECT_CLASS xClasses[ ePkcs11PoolObjectCount ] =
+    {
+        CKO_PRIVATE_KEY,
+        CKO_PUBLIC_KEY
+    };
+    CK_OBJECT_HANDLE xObject;
+    size_t i;
+
+    for( i = 0; i < ePkcs11PoolObjectCount; i++ )
+    {
+        xObject = CK_INVALID_HANDLE;
+
+        if( CKR_OK != xFindObjectWithLabelAndClass( xSession, ( char * ) pcLabels[ i ], xClasses[ i ], &xObject ) )
+        {
+            xObject = CK_INVALID_HANDLE;
+        }
+
+        xObjects[ i ] = xObject;
+    }
+
+    xObjectsFound = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV xPkcs11PoolAcquire( Pkcs11Lease_t * pxLease,
+                          TickType_t xTicksToWait )
+{
+    CK_RV xResult = CKR_OK;
+    PoolEntry_t * pxEntry = NULL;
+    size_t i;
+
+    configASSERT( pxLease != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( xPoolSemaphore == NULL )
+        {
+            for( i = 0; i < pkcs11poolSESSION_COUNT; i++ )
+            {
+                xPool[ i ].xSession = CK_INVALID_HANDLE;
+            }
+
+            for( i = 0; i < ePkcs11PoolObjectCount; i++ )
+            {
+                xObjects[ i ] = CK_INVALID_HANDLE;
+            }
+
+            xPoolSemaphore = xSemaphoreCreateCountingStatic( pkcs11poolSESSION_COUNT,
+                                                             pkcs11poolSESSION_COUNT,
+                                                             &xPoolSemaphoreBuffer );
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xSemaphoreTake( xPoolSemaphore, xTicksToWait ) != pdTRUE )
+    {
+        xResult = CKR_SESSION_COUNT;
+    }
+
+    if( xResult == CKR_OK )
+    {
+        /* A free entry exists since the semaphore was taken. */
+        taskENTER_CRITICAL();
+        {
+            for( i = 0; ( i < pkcs11poolSESSION_COUNT ) && ( pxEntry == NULL ); i++ )
+            {
+                if( xPool[ i ].xInUse == pdFALSE )
+                {
+                    pxEntry = &xPool[ i ];
+                    pxEntry->xInUse = pdTRUE;
+                    pxLease->xIndex = i;
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        /* Opens the session and logs in with the default PIN. */
+        if( pxEntry->xSession == CK_INVALID_HANDLE )
+        {
+            xResult = xInitializePkcs11Session( &pxEntry->xSession );
+
+            if( xResult != CKR_OK )
+            {
+                pxEntry->xSession = CK_INVALID_HANDLE;
+                vPkcs11PoolRelease( pxLease, CKR_OK );
+            }
+        }
+    }
+
+    if( xResult == CKR_OK )
+    {
+        if( xObjectsFound == pdFALSE )
+        {
+            prvFindObjects( pxEntry->xSession );
+        }
+
+        pxLease->xSession = pxEntry->xSession;
+        memcpy( pxLease->xObjects, xObjects, sizeof( xObjects ) );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vPkcs11PoolRelease( Pkcs11Lease_t * pxLease,
+                         CK_RV xResult )
+{
+    PoolEntry_t * pxEntry = &xPool[ pxLease->xIndex ];
+    CK_FUNCTION_LIST_PTR pxFunctionList;
+
+    if( ( xResult == CKR_SESSION_HANDLE_INVALID ) || ( xResult == CKR_SESSION_CLOSED ) ||
+        ( xResult == CKR_USER_NOT_LOGGED_IN ) || ( xResult == CKR_CRYPTOKI_NOT_INITIALIZED ) )
+    {
+        if( ( pxEntry->xSession != CK_INVALID_HANDLE ) && ( CKR_OK == C_GetFunctionList( &pxFunctionList ) ) )
+        {
+            ( void ) pxFunctionList->C_CloseSession( pxEntry->xSession );
+        }
+
+        pxEntry->xSession = CK_INVALID_HANDLE;
+    }
+    else if( ( xResult == CKR_OBJECT_HANDLE_INVALID ) || ( xResult == CKR_KEY_HANDLE_INVALID ) )
+    {
+        xObjectsFound = pdFALSE;
+    }
+
+    pxLease->xSession = CK_INVALID_HANDLE;
+
+    taskENTER_CRITICAL();
+    {
+        pxEntry->xInUse = pdFALSE;
+    }
+    taskEXIT_CRITICAL();
+
+    ( void ) xSemaphoreGive( xPoolSemaphore );
+}
@@ -33,9 +33,28 @@
 #ifndef _PROVISION_INTERFACE_H_
 #define _PROVISION_INTERFACE_H_
 
+#include "FreeRTOS.h"
 #include "core_pkcs11.h"
 
 void vUartProvision( void );
+
+/*
+ * @brief Boot time provisioning, called before the scheduler starts.
+ *
+ * @note Runs the interactive provisioning when the device is not provisioned,
+ * or when the reprovisioning window or the strap pin asked for the credentials
+ * to be removed. Returns immediately on a provisioned device.
+ */
+void vUartProvisionAtBoot( void );
+
+/*
+ * @brief Creates the task offering to remove the credentials of a provisioned
+ * device for provisionREPROVISION_WINDOW_MS, in parallel with the network bring-up.
+ * A "y" resets the device, which then provisions it from vUartProvisionAtBoot().
+ *
+ * @return pdTRUE if the task is created or not needed.
+ */
+BaseType_t xUartProvisionStartWindow( void );
 CK_RV ulGetThingName( char ** pcThingName, uint32_t * ulThingNameSize );
 CK_RV ulGetThingEndpoint( char ** pcThingEndpoint, uint32_t * ulThingEndpointSize );
 #endif
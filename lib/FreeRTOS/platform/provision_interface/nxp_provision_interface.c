@@ -42,6 +42,11 @@
 #include "core_pkcs11_config.h"
 #include "core_pkcs11.h"
 #include "core_pkcs11_pal.h"
+#include "board.h"
+
+#if defined( provisionSTRAP_GPIO_PORT ) && defined( provisionSTRAP_GPIO_PIN )
+    #include "fsl_gpio.h"
+#endif
 
 #define FILENAME_AWS_THING_NAME      "aws_thing_name.dat"
 #define FILENAME_AWS_ENDPOINT        "aws_endpoint.dat"
@@ -57,8 +62,75 @@
  */
 #define CERTIFICATE_SIZE             5000
 
+/*
+ * @brief Time a provisioned device waits for a request to remove its
+ * credentials, while the network comes up. 0 skips the prompt.
+ *
+ * @note With provisionSTRAP_GPIO_PORT and provisionSTRAP_GPIO_PIN defined the
+ * window is not opened, the device is only provisioned again when the strap
+ * is at provisionSTRAP_ACTIVE_LEVEL during reset.
+ */
+#ifndef provisionREPROVISION_WINDOW_MS
+    #define provisionREPROVISION_WINDOW_MS    5000U
+#endif
+
+#ifndef provisionSTRAP_ACTIVE_LEVEL
+    #define provisionSTRAP_ACTIVE_LEVEL       0U
+#endif
+
+#define provisionWINDOW_TASK_PRIORITY         ( tskIDLE_PRIORITY + 1U )
+#define provisionWINDOW_TASK_STACK_SIZE       ( configMINIMAL_STACK_SIZE * 4U )
+
+/*
+ * @brief Value of ulReprovisionRequest when the window task asked for the
+ * credentials to be removed before resetting the device.
+ */
+#define REPROVISION_REQUEST_MAGIC             0x50524F56UL
+
+/*
+ * @brief Binary provisioning frame: start byte, type, 16-bit little endian
+ * payload length, payload and a CRC-16/CCITT of the type, length and payload.
+ *
+ * @note The host starts the binary protocol by answering the provisioning
+ * prompt with a HELLO frame instead of "y". Every frame from the host is
+ * answered with an ACK or a NAK, or with a CSR frame for a CSR request.
+ */
+#define FRAME_START                  0xA5U
+#define FRAME_HEADER_SIZE            3U
+#define FRAME_CRC_SIZE               2U
+#define FRAME_MAX_PAYLOAD            CERTIFICATE_SIZE
+
+#define FRAME_TYPE_HELLO             0x01U /* Payload: requested baud rate, 32-bit little endian. */
+#define FRAME_TYPE_PING              0x02U
+#define FRAME_TYPE_THING_NAME        0x10U
+#define FRAME_TYPE_ENDPOINT          0x11U
+#define FRAME_TYPE_OTA_KEY           0x12U /* Payload: DER SubjectPublicKeyInfo. */
+#define FRAME_TYPE_CSR_REQUEST       0x13U
+#define FRAME_TYPE_CSR               0x14U /* Payload: DER CSR. */
+#define FRAME_TYPE_CERTIFICATE       0x15U /* Payload: DER certificate. */
+#define FRAME_TYPE_DONE              0x16U
+#define FRAME_TYPE_KEY_PAIR          0x17U /* Generate the key pair after the ACK, ahead of the CSR request. */
+#define FRAME_TYPE_TLS_PSK           0x18U /* Payload: identity length, identity, pre-shared key. */
+#define FRAME_TYPE_ACK               0x7EU /* Payload: acknowledged type. */
+#define FRAME_TYPE_NAK               0x7FU /* Payload: rejected type and reason. */
+
+#define FRAME_NAK_BAD_FRAME          0x01U
+#define FRAME_NAK_UNSUPPORTED        0x02U
+#define FRAME_NAK_FAILED             0x03U
+
+/*
+ * @brief Baud rates the host may request for the binary protocol. All of them
+ * are within 0.2% of the rate generated from the 12 MHz FLEXCOMM0 clock.
+ */
+static const uint32_t ulFrameBaudRates[] = { 230400U, 460800U, 921600U };
+
 const char pucTerminaterString[] = ">>>>>>";
 
+/*
+ * @brief Survives the reset of a reprovisioning request, not cleared by the startup code.
+ */
+static uint32_t ulReprovisionRequest __attribute__( ( section( ".noinit" ) ) );
+
 static void prvUploadCsr( void )
 {
     uint8_t * pucCsr = NULL;
@@ -188,6 +260,10 @@ static CK_RV prvProvisionOtaSigning( void )
     {
         LogInfo( ( "Ready to read OTA verification key." ) );
 
+        /* The host creates the OTA signing key before sending it, which leaves
+         * time to generate the device key pair. The key is buffered meanwhile. */
+        ( void ) xPregenerateDeviceKeyPair();
+
         memset( pxOtaKey, 0x00, CERTIFICATE_SIZE );
         ulSize = xReadInput( pxOtaKey, CERTIFICATE_SIZE, pucTerminaterString, sizeof( pucTerminaterString ) );
 
@@ -255,17 +331,378 @@ static CK_RV prvProvisionThingName( void )
     return xResult;
 }
 
+static uint16_t prvFrameCrc( uint16_t usCrc,
+                             const uint8_t * pucData,
+                             uint32_t ulLength )
+{
+    uint32_t i = 0;
+    uint32_t ulBit = 0;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        usCrc ^= ( uint16_t ) ( ( uint16_t ) pucData[ i ] << 8 );
+
+        for( ulBit = 0; ulBit < 8U; ulBit++ )
+        {
+            if( ( usCrc & 0x8000U ) != 0U )
+            {
+                usCrc = ( uint16_t ) ( ( usCrc << 1 ) ^ 0x1021U );
+            }
+            else
+            {
+                usCrc = ( uint16_t ) ( usCrc << 1 );
+            }
+        }
+    }
+
+    return usCrc;
+}
+
+static void prvReadBytes( uint8_t * pucBuffer,
+                          uint32_t ulLength )
+{
+    uint32_t i = 0;
+
+    for( i = 0; i < ulLength; i++ )
+    {
+        pucBuffer[ i ] = ( uint8_t ) DbgConsole_Getchar();
+    }
+}
+
+static BaseType_t prvReadFrame( BaseType_t xStartRead,
+                                uint8_t * pucType,
+                                uint8_t * pucPayload,
+                                uint32_t * pulLength )
+{
+    BaseType_t xResult = pdFAIL;
+    uint8_t ucHeader[ FRAME_HEADER_SIZE ] = { 0 };
+    uint8_t ucCrc[ FRAME_CRC_SIZE ] = { 0 };
+    uint16_t usCrc = 0xFFFFU;
+
+    /* Anything before the start byte is skipped to resynchronize after an error. */
+    if( xStartRead == pdFALSE )
+    {
+        while( ( uint8_t ) DbgConsole_Getchar() != FRAME_START )
+        {
+        }
+    }
+
+    prvReadBytes( ucHeader, sizeof( ucHeader ) );
+    *pucType = ucHeader[ 0 ];
+    *pulLength = ( uint32_t ) ucHeader[ 1 ] | ( ( uint32_t ) ucHeader[ 2 ] << 8 );
+
+    if( *pulLength <= FRAME_MAX_PAYLOAD )
+    {
+        prvReadBytes( pucPayload, *pulLength );
+        prvReadBytes( ucCrc, sizeof( ucCrc ) );
+
+        usCrc = prvFrameCrc( usCrc, ucHeader, sizeof( ucHeader ) );
+        usCrc = prvFrameCrc( usCrc, pucPayload, *pulLength );
+
+        if( usCrc == ( uint16_t ) ( ( uint16_t ) ucCrc[ 0 ] | ( ( uint16_t ) ucCrc[ 1 ] << 8 ) ) )
+        {
+            xResult = pdPASS;
+        }
+    }
+
+    return xResult;
+}
+
+static void prvSendFrame( uint8_t ucType,
+                          const uint8_t * pucPayload,
+                          uint32_t ulLength )
+{
+    uint8_t ucHeader[ 1 + FRAME_HEADER_SIZE ] = { FRAME_START, ucType, ( uint8_t ) ulLength, ( uint8_t ) ( ulLength >> 8 ) };
+    uint8_t ucCrc[ FRAME_CRC_SIZE ] = { 0 };
+    uint16_t usCrc = 0xFFFFU;
+
+    usCrc = prvFrameCrc( usCrc, &ucHeader[ 1 ], FRAME_HEADER_SIZE );
+    usCrc = prvFrameCrc( usCrc, pucPayload, ulLength );
+    ucCrc[ 0 ] = ( uint8_t ) usCrc;
+    ucCrc[ 1 ] = ( uint8_t ) ( usCrc >> 8 );
+
+    ( void ) DbgConsole_SendDeferredLog( ucHeader, sizeof( ucHeader ) );
+
+    if( ulLength > 0U )
+    {
+        ( void ) DbgConsole_SendDeferredLog( ( uint8_t * ) pucPayload, ulLength );
+    }
+
+    ( void ) DbgConsole_SendDeferredLog( ucCrc, sizeof( ucCrc ) );
+}
+
+static void prvSendAck( uint8_t ucType )
+{
+    prvSendFrame( FRAME_TYPE_ACK, &ucType, 1U );
+}
+
+static void prvSendNak( uint8_t ucType,
+                        uint8_t ucReason )
+{
+    uint8_t ucPayload[ 2 ] = { ucType, ucReason };
+
+    prvSendFrame( FRAME_TYPE_NAK, ucPayload, sizeof( ucPayload ) );
+}
+
+static void prvSetBaudRate( uint32_t ulBaudRate )
+{
+    /* Let the last frame leave the shift register before the USART is reconfigured. */
+    ( void ) DbgConsole_Flush();
+
+    while( ( ( ( USART_Type * ) BOARD_DEBUG_UART_BASEADDR )->STAT & USART_STAT_TXIDLE_MASK ) == 0U )
+    {
+    }
+
+    ( void ) DbgConsole_Deinit();
+    ( void ) DbgConsole_Init( BOARD_DEBUG_UART_INSTANCE, ulBaudRate, BOARD_DEBUG_UART_TYPE, BOARD_DEBUG_UART_CLK_FREQ );
+}
+
+static CK_RV prvSaveFile( const char * pcFileName,
+                          CK_ULONG ulFileNameLen,
+                          CK_BYTE_PTR pucData,
+                          CK_ULONG ulSize )
+{
+    CK_RV xResult = CKR_OK;
+    CK_ATTRIBUTE xLabel;
+    CK_OBJECT_HANDLE xHandle = CK_INVALID_HANDLE;
+
+    xLabel.type = CKA_LABEL;
+    xLabel.pValue = ( CK_VOID_PTR ) pcFileName;
+    xLabel.ulValueLen = ulFileNameLen;
+
+    xHandle = PKCS11_PAL_SaveObject( ( CK_ATTRIBUTE_PTR ) &xLabel, pucData, ulSize );
+
+    if( xHandle == CK_INVALID_HANDLE )
+    {
+        xResult = CKR_DEVICE_MEMORY;
+    }
+
+    return xResult;
+}
+
+static CK_RV prvHandleFrame( uint8_t ucType,
+                             uint8_t * pucPayload,
+                             uint32_t ulLength )
+{
+    CK_RV xResult = CKR_OK;
+    uint8_t * pucCsr = NULL;
+    size_t xCsrLength = 0;
+
+    switch( ucType )
+    {
+        case FRAME_TYPE_THING_NAME:
+
+            /* Leave room for the terminator ulGetThingName() relies on. */
+            if( ( ulLength > 0U ) && ( ulLength < MAX_LENGTH_AWS_THING_NAME ) )
+            {
+                LogInfo( ( "Saving thing name: %.*s", ( int ) ulLength, pucPayload ) );
+                xResult = prvSaveFile( FILENAME_AWS_THING_NAME, sizeof( FILENAME_AWS_THING_NAME ), pucPayload, ulLength );
+            }
+            else
+            {
+                xResult = CKR_ARGUMENTS_BAD;
+            }
+
+            break;
+
+        case FRAME_TYPE_ENDPOINT:
+
+            if( ( ulLength > 0U ) && ( ulLength < MAX_LENGTH_AWS_ENDPOINT ) )
+            {
+                LogInfo( ( "Saving thing endpoint: %.*s", ( int ) ulLength, pucPayload ) );
+                xResult = prvSaveFile( FILENAME_AWS_ENDPOINT, sizeof( FILENAME_AWS_ENDPOINT ), pucPayload, ulLength );
+            }
+            else
+            {
+                xResult = CKR_ARGUMENTS_BAD;
+            }
+
+            break;
+
+        case FRAME_TYPE_OTA_KEY:
+            xResult = xProvisionPublicKey( pucPayload,
+                                           ulLength,
+                                           CKK_EC,
+                                           ( CK_BYTE_PTR ) pkcs11configLABEL_CODE_VERIFICATION_KEY,
+                                           sizeof( pkcs11configLABEL_CODE_VERIFICATION_KEY ) );
+            break;
+
+        case FRAME_TYPE_TLS_PSK:
+
+            /* At least one byte of identity and of key. */
+            if( ( ulLength >= 3U ) && ( pucPayload[ 0 ] > 0U ) && ( ( uint32_t ) pucPayload[ 0 ] + 2U <= ulLength ) )
+            {
+                LogInfo( ( "Saving TLS pre-shared key for identity: %.*s", ( int ) pucPayload[ 0 ], &pucPayload[ 1 ] ) );
+                xResult = prvSaveFile( pkcs11configLABEL_TLS_PSK_IDENTITY, sizeof( pkcs11configLABEL_TLS_PSK_IDENTITY ),
+                                       &pucPayload[ 1 ], pucPayload[ 0 ] );
+
+                if( xResult == CKR_OK )
+                {
+                    xResult = prvSaveFile( pkcs11configLABEL_TLS_PSK, sizeof( pkcs11configLABEL_TLS_PSK ),
+                                           &pucPayload[ 1U + pucPayload[ 0 ] ], ulLength - 1U - pucPayload[ 0 ] );
+                }
+            }
+            else
+            {
+                xResult = CKR_ARGUMENTS_BAD;
+            }
+
+            break;
+
+        case FRAME_TYPE_CSR_REQUEST:
+            LogInfo( ( "Creating CSR" ) );
+            pucCsr = vCreateCsrDer( &xCsrLength );
+
+            if( pucCsr != NULL )
+            {
+                prvSendFrame( FRAME_TYPE_CSR, pucCsr, ( uint32_t ) xCsrLength );
+                vPortFree( pucCsr );
+            }
+            else
+            {
+                xResult = CKR_FUNCTION_FAILED;
+            }
+
+            break;
+
+        case FRAME_TYPE_CERTIFICATE:
+            xResult = xProvisionCert( pucPayload,
+                                      ulLength,
+                                      ( CK_BYTE_PTR ) pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                      sizeof( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) );
+            break;
+
+        default:
+            xResult = CKR_FUNCTION_NOT_SUPPORTED;
+            break;
+    }
+
+    return xResult;
+}
+
+static void prvProvisionBinary( void )
+{
+    uint8_t * pucPayload = pvPortMalloc( FRAME_MAX_PAYLOAD );
+    BaseType_t xStartRead = pdTRUE;
+    BaseType_t xDone = pdFALSE;
+    uint8_t ucType = 0;
+    uint32_t ulLength = 0;
+    uint32_t ulRequested = 0;
+    uint32_t ulBaudRate = 0;
+    uint32_t i = 0;
+    CK_RV xResult = CKR_OK;
+
+    if( pucPayload == NULL )
+    {
+        LogError( ( "Failed to allocate buffer to hold provisioning frames." ) );
+        xDone = pdTRUE;
+    }
+
+    while( xDone == pdFALSE )
+    {
+        if( prvReadFrame( xStartRead, &ucType, pucPayload, &ulLength ) != pdPASS )
+        {
+            prvSendNak( ucType, FRAME_NAK_BAD_FRAME );
+        }
+        else if( ucType == FRAME_TYPE_HELLO )
+        {
+            ulBaudRate = 0U;
+
+            if( ulLength == sizeof( uint32_t ) )
+            {
+                ulRequested = ( uint32_t ) pucPayload[ 0 ] | ( ( uint32_t ) pucPayload[ 1 ] << 8 ) |
+                              ( ( uint32_t ) pucPayload[ 2 ] << 16 ) | ( ( uint32_t ) pucPayload[ 3 ] << 24 );
+
+                for( i = 0; i < ( sizeof( ulFrameBaudRates ) / sizeof( ulFrameBaudRates[ 0 ] ) ); i++ )
+                {
+                    if( ulFrameBaudRates[ i ] == ulRequested )
+                    {
+                        ulBaudRate = ulRequested;
+                    }
+                }
+            }
+
+            if( ulBaudRate != 0U )
+            {
+                /* The host switches once it has the ACK and pings to check the new rate. */
+                prvSendAck( ucType );
+                prvSetBaudRate( ulBaudRate );
+            }
+            else
+            {
+                prvSendNak( ucType, FRAME_NAK_UNSUPPORTED );
+            }
+        }
+        else if( ucType == FRAME_TYPE_KEY_PAIR )
+        {
+            /* The host carries on with its own work while the key pair is
+             * generated. A failure is retried by the CSR request. */
+            prvSendAck( ucType );
+            ( void ) xPregenerateDeviceKeyPair();
+        }
+        else if( ucType == FRAME_TYPE_PING )
+        {
+            prvSendAck( ucType );
+        }
+        else if( ucType == FRAME_TYPE_DONE )
+        {
+            prvSendAck( ucType );
+            prvSetBaudRate( BOARD_DEBUG_UART_BAUDRATE );
+            xDone = pdTRUE;
+        }
+        else
+        {
+            xResult = prvHandleFrame( ucType, pucPayload, ulLength );
+
+            if( xResult == CKR_OK )
+            {
+                /* The CSR frame itself answers a CSR request. */
+                if( ucType != FRAME_TYPE_CSR_REQUEST )
+                {
+                    prvSendAck( ucType );
+                }
+            }
+            else if( xResult == CKR_FUNCTION_NOT_SUPPORTED )
+            {
+                prvSendNak( ucType, FRAME_NAK_UNSUPPORTED );
+            }
+            else
+            {
+                LogError( ( "Failed to handle provisioning frame %02x, error code: %0x.", ucType, xResult ) );
+                prvSendNak( ucType, FRAME_NAK_FAILED );
+            }
+        }
+
+        xStartRead = pdFALSE;
+    }
+
+    vPortFree( pucPayload );
+}
+
 static void prvProvision( void )
 {
     uint8_t ucInput = 0x00;
+    uint8_t ucDiscard = 0x00;
     uint8_t * pucCert = NULL;
     uint32_t ulCertSize = 0;
 
     LogInfo( ( "Do you want to provision the device? y/n" ) );
 
-    ( void ) xReadInput( &ucInput, sizeof( char ), pucTerminaterString, sizeof( pucTerminaterString ) );
+    /* A frame start instead of a text answer selects the binary protocol. */
+    ucInput = ( uint8_t ) DbgConsole_Getchar();
 
-    if( ucInput == ( uint8_t ) 'y' )
+    if( ucInput != FRAME_START )
+    {
+        /* Consume the rest of the text answer up to the terminator. */
+        ( void ) xReadInput( &ucDiscard, sizeof( char ), pucTerminaterString, sizeof( pucTerminaterString ) );
+    }
+
+    if( ucInput == FRAME_START )
+    {
+        LogInfo( ( "Received a frame, will provision the device with the binary protocol." ) );
+        prvProvisionBinary();
+    }
+    else if( ucInput == ( uint8_t ) 'y' )
     {
         LogInfo( ( "Received y, will provision the device." ) );
         prvProvisionThingName();
@@ -318,6 +755,114 @@ void vUartProvision( void )
     }
 }
 
+static BaseType_t prvStrapAsserted( void )
+{
+    BaseType_t xAsserted = pdFALSE;
+
+    #if defined( provisionSTRAP_GPIO_PORT ) && defined( provisionSTRAP_GPIO_PIN )
+        const gpio_pin_config_t xPinConfig = { kGPIO_DigitalInput, 0 };
+
+        GPIO_PortInit( GPIO, provisionSTRAP_GPIO_PORT );
+        GPIO_PinInit( GPIO, provisionSTRAP_GPIO_PORT, provisionSTRAP_GPIO_PIN, &xPinConfig );
+
+        if( GPIO_PinRead( GPIO, provisionSTRAP_GPIO_PORT, provisionSTRAP_GPIO_PIN ) == provisionSTRAP_ACTIVE_LEVEL )
+        {
+            xAsserted = pdTRUE;
+        }
+    #endif
+
+    return xAsserted;
+}
+
+static void prvReprovisionWindowTask( void * pvParameters )
+{
+    const TickType_t xWindow = pdMS_TO_TICKS( provisionREPROVISION_WINDOW_MS );
+    const TickType_t xStart = xTaskGetTickCount();
+    uint8_t ucInput = 0x00;
+
+    ( void ) pvParameters;
+
+    LogInfo( ( "Device was already provisioned, should the current credentials be removed? y/n" ) );
+
+    /* Polled, the answer is short enough to wait in the receive FIFO. */
+    while( ( xTaskGetTickCount() - xStart ) < xWindow )
+    {
+        if( ( ( ( USART_Type * ) BOARD_DEBUG_UART_BASEADDR )->FIFOSTAT & USART_FIFOSTAT_RXNOTEMPTY_MASK ) != 0U )
+        {
+            ucInput = ( uint8_t ) DbgConsole_Getchar();
+
+            if( ucInput == ( uint8_t ) 'y' )
+            {
+                break;
+            }
+        }
+        else
+        {
+            vTaskDelay( 1 );
+        }
+    }
+
+    if( ucInput == ( uint8_t ) 'y' )
+    {
+        /* The interactive provisioning needs the UART to itself, it runs before the scheduler. */
+        LogInfo( ( "Received y, resetting to remove the credentials." ) );
+        ( void ) DbgConsole_Flush();
+        vTaskDelay( pdMS_TO_TICKS( 100 ) );
+        ulReprovisionRequest = REPROVISION_REQUEST_MAGIC;
+        NVIC_SystemReset();
+    }
+
+    vTaskDelete( NULL );
+}
+
+void vUartProvisionAtBoot( void )
+{
+    CK_RV xResult = CKR_OK;
+    BaseType_t xRequested = ( ulReprovisionRequest == REPROVISION_REQUEST_MAGIC ) ? pdTRUE : pdFALSE;
+
+    ulReprovisionRequest = 0;
+
+    if( xCheckIfProvisioned() != CKR_OK )
+    {
+        LogInfo( ( "Starting Provisioning process..." ) );
+        prvProvision();
+    }
+    else if( ( xRequested == pdTRUE ) || ( prvStrapAsserted() == pdTRUE ) )
+    {
+        LogInfo( ( "Removing the credentials for provisioning." ) );
+        xResult = xDestroyCertKeys();
+
+        if( xResult == CKR_OK )
+        {
+            LogInfo( ( "Successfully removed old objects." ) );
+            prvProvision();
+        }
+    }
+    else
+    {
+        /* Provisioned, carry on booting. */
+    }
+}
+
+BaseType_t xUartProvisionStartWindow( void )
+{
+    BaseType_t xResult = pdTRUE;
+
+    #if !defined( provisionSTRAP_GPIO_PORT ) || !defined( provisionSTRAP_GPIO_PIN )
+        if( ( provisionREPROVISION_WINDOW_MS > 0U ) && ( xCheckIfProvisioned() == CKR_OK ) )
+        {
+            xResult = xTaskCreate( prvReprovisionWindowTask,
+                                   "Provision_window",
+                                   provisionWINDOW_TASK_STACK_SIZE,
+                                   NULL,
+                                   provisionWINDOW_TASK_PRIORITY | portPRIVILEGE_BIT,
+                                   NULL );
+        }
+    #endif
+
+    return xResult;
+}
+
 CK_RV ulGetThingName( char ** pcThingName,
                       uint32_t * ulThingNameSize )
 {
@@ -28,8 +28,18 @@
 
 #include "core_pkcs11.h"
 
+/**
+ * @brief Generate and store the device key pair unless one is already stored.
+ *
+ * vCreateCsr() and vCreateCsrDer() sign the CSR with the stored key pair, so
+ * calling this ahead of them takes the key generation out of the CSR request.
+ */
+CK_RV xPregenerateDeviceKeyPair( void );
+
 uint8_t * vCreateCsr( void );
 
+uint8_t * vCreateCsrDer( size_t * pxCsrLength );
+
 CK_RV xProvisionCert( CK_BYTE_PTR xCert,
                       CK_ULONG xCertLen, 
                       CK_BYTE_PTR xCertLabel,
@@ -58,10 +58,23 @@
 /* Provisioning innclude. */
 #include "provision.h"
 
+/* Runs the CSR signature below the periodic work. */
+#include "crypto_worker.h"
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+    /* Implemented by the PKCS #11 PAL. */
+    extern void PKCS11_PAL_InvalidateCache( void );
+#endif
+
 /**
  * @brief Size of buffer to use for a generated CSR.
  */
-#define CSR_BUF_SIZE    ( 4096UL )
+#define CSR_BUF_SIZE        ( 4096UL )
+
+/**
+ * @brief First byte of a DER encoded certificate, the ASN.1 SEQUENCE tag.
+ */
+#define DER_SEQUENCE_TAG    ( 0x30U )
 
 /**
  * @brief Represents string to be logged when mbedTLS returned error
@@ -426,6 +439,41 @@ static CK_RV prvDestroyProvidedObjects( CK_SESSION_HANDLE xSession,
     return xResult;
 }
 
+static CK_RV prvGetDeviceKeyPair( CK_SESSION_HANDLE xSession,
+                                  CK_OBJECT_HANDLE_PTR pxPrivateKeyHandle,
+                                  CK_OBJECT_HANDLE_PTR pxPublicKeyHandle )
+{
+    CK_RV xResult = CKR_OK;
+    char pcPrivateKeyLabel[] = { pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS };
+    char pcPublicKeyLabel[] = { pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS };
+
+    *pxPrivateKeyHandle = CK_INVALID_HANDLE;
+    *pxPublicKeyHandle = CK_INVALID_HANDLE;
+
+    /* Reuse a key pair generated ahead of the CSR, see xPregenerateDeviceKeyPair(). */
+    xResult = xFindObjectWithLabelAndClass( xSession, pcPrivateKeyLabel, CKO_PRIVATE_KEY, pxPrivateKeyHandle );
+
+    if( ( xResult == CKR_OK ) && ( *pxPrivateKeyHandle != CK_INVALID_HANDLE ) )
+    {
+        xResult = xFindObjectWithLabelAndClass( xSession, pcPublicKeyLabel, CKO_PUBLIC_KEY, pxPublicKeyHandle );
+    }
+
+    if( ( xResult == CKR_OK ) && ( *pxPrivateKeyHandle != CK_INVALID_HANDLE ) && ( *pxPublicKeyHandle != CK_INVALID_HANDLE ) )
+    {
+        LogInfo( ( "Using the stored EC Key Pair." ) );
+    }
+    else
+    {
+        xResult = xCreateDeviceKeyPair( xSession,
+                                        ( uint8_t * ) pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
+                                        ( uint8_t * ) pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,
+                                        pxPrivateKeyHandle,
+                                        pxPublicKeyHandle );
+    }
+
+    return xResult;
+}
+
 static int prvSetupCsrCtx( mbedtls_x509write_csr * pxCtx )
 {
     int lMbedResult = 0;
@@ -445,7 +493,8 @@ static int prvSetupCsrCtx( mbedtls_x509write_csr * pxCtx )
     return lMbedResult;
 }
 
-uint8_t * vCreateCsr( void )
+static uint8_t * prvCreateCsr( BaseType_t xDerFormat,
+                               size_t * pxCsrLength )
 {
     /* PKCS #11 variables. */
     CK_RV xResult = CKR_OK;
@@ -479,11 +528,7 @@ uint8_t * vCreateCsr( void )
     lMbedResult = mbedtls_pk_setup( &privKey, header );
     configASSERT( lMbedResult == 0 );
 
-    xResult = xCreateDeviceKeyPair( xSession,
-                                    ( uint8_t * ) pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
-                                    ( uint8_t * ) pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,
-                                    &xPrivateKey,
-                                    &xPublicKey );
+    xResult = prvGetDeviceKeyPair( xSession, &xPrivateKey, &xPublicKey );
     configASSERT( xResult == CKR_OK );
 
     lMbedResult = prvExtractEcPublicKey( &xEcdsaContext, xPublicKey );
@@ -500,8 +545,23 @@ uint8_t * vCreateCsr( void )
     pucCsrBuf = ( uint8_t * ) pvPortMalloc( CSR_BUF_SIZE );
     configASSERT( lMbedResult == 0 );
 
-    lMbedResult = mbedtls_x509write_csr_pem( &req, ( unsigned char * ) pucCsrBuf, CSR_BUF_SIZE, &prvRandom, &xSession );
-    configASSERT( lMbedResult == 0 );
+    if( xDerFormat == pdTRUE )
+    {
+        /* The DER writer fills the end of the buffer and returns the length written. */
+        lMbedResult = mbedtls_x509write_csr_der( &req, ( unsigned char * ) pucCsrBuf, CSR_BUF_SIZE, &prvRandom, &xSession );
+        configASSERT( lMbedResult > 0 );
+
+        memmove( pucCsrBuf, &pucCsrBuf[ CSR_BUF_SIZE - ( size_t ) lMbedResult ], ( size_t ) lMbedResult );
+        *pxCsrLength = ( size_t ) lMbedResult;
+    }
+    else
+    {
+        lMbedResult = mbedtls_x509write_csr_pem( &req, ( unsigned char * ) pucCsrBuf, CSR_BUF_SIZE, &prvRandom, &xSession );
+        configASSERT( lMbedResult == 0 );
+
+        *pxCsrLength = strlen( ( const char * ) pucCsrBuf );
+    }
+
     mbedtls_x509write_csr_free( &req );
     mbedtls_ecdsa_free( &xEcdsaContext );
     mbedtls_ecp_group_free( &( xEcdsaContext.grp ) );
@@ -512,6 +572,72 @@ uint8_t * vCreateCsr( void )
     return pucCsrBuf;
 }
 
+CK_RV xPregenerateDeviceKeyPair( void )
+{
+    CK_RV xResult = CKR_OK;
+    CK_SESSION_HANDLE xSession = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE xPrivateKey = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE xPublicKey = CK_INVALID_HANDLE;
+    CK_FUNCTION_LIST_PTR pxP11FunctionList;
+
+    xResult = C_GetFunctionList( &pxP11FunctionList );
+
+    if( xResult == CKR_OK )
+    {
+        xResult = xInitializePkcs11Session( &xSession );
+    }
+
+    if( xResult == CKR_OK )
+    {
+        xResult = prvGetDeviceKeyPair( xSession, &xPrivateKey, &xPublicKey );
+    }
+
+    if( xSession != CK_INVALID_HANDLE )
+    {
+        ( void ) pxP11FunctionList->C_CloseSession( xSession );
+    }
+
+    return xResult;
+}
+
+/**
+ * @brief Parameters and result of prvCreateCsr(), passed to the crypto worker.
+ */
+typedef struct CsrJob
+{
+    BaseType_t xDerFormat;
+    size_t * pxCsrLength;
+    uint8_t * pucCsr;
+} CsrJob_t;
+
+static int32_t prvCreateCsrJob( void * pvContext )
+{
+    CsrJob_t * pxJob = ( CsrJob_t * ) pvContext;
+
+    pxJob->pucCsr = prvCreateCsr( pxJob->xDerFormat, pxJob->pxCsrLength );
+
+    return 0;
+}
+
+uint8_t * vCreateCsr( void )
+{
+    size_t xCsrLength = 0;
+    CsrJob_t xJob = { pdFALSE, &xCsrLength, NULL };
+
+    ( void ) CryptoWorker_Run( prvCreateCsrJob, &xJob );
+
+    return xJob.pucCsr;
+}
+
+uint8_t * vCreateCsrDer( size_t * pxCsrLength )
+{
+    CsrJob_t xJob = { pdTRUE, pxCsrLength, NULL };
+
+    ( void ) CryptoWorker_Run( prvCreateCsrJob, &xJob );
+
+    return xJob.pucCsr;
+}
+
 CK_RV xProvisionCert( CK_BYTE_PTR xCert,
                       CK_ULONG xCertLen,
                       CK_BYTE_PTR xCertLabel,
@@ -560,28 +686,36 @@ CK_RV xProvisionCert( CK_BYTE_PTR xCert,
 
     /* Convert the certificate to DER format if it was in PEM. The DER key
      * should be about 3/4 the size of the PEM key, so mallocing the PEM key
-     * size is sufficient. */
-    pucDerObject = pvPortMalloc( xCertificateTemplate.xValue.ulValueLen );
-    xDerLen = xCertificateTemplate.xValue.ulValueLen;
-
-    if( pucDerObject != NULL )
+     * size is sufficient. A DER certificate starts with the ASN.1 SEQUENCE
+     * tag and is stored as is. */
+    if( ( xCertLen > 0UL ) && ( xCert[ 0 ] == DER_SEQUENCE_TAG ) )
     {
-        lConversionReturn = convert_pem_to_der( xCertificateTemplate.xValue.pValue,
-                                                xCertificateTemplate.xValue.ulValueLen,
-                                                pucDerObject,
-                                                &xDerLen );
-
-        if( 0 != lConversionReturn )
-        {
-            xResult = CKR_ARGUMENTS_BAD;
-        }
+        LogInfo( ( "Certificate is already DER encoded." ) );
     }
     else
     {
-        xResult = CKR_HOST_MEMORY;
+        pucDerObject = pvPortMalloc( xCertificateTemplate.xValue.ulValueLen );
+        xDerLen = xCertificateTemplate.xValue.ulValueLen;
+
+        if( pucDerObject != NULL )
+        {
+            lConversionReturn = convert_pem_to_der( xCertificateTemplate.xValue.pValue,
+                                                    xCertificateTemplate.xValue.ulValueLen,
+                                                    pucDerObject,
+                                                    &xDerLen );
+
+            if( 0 != lConversionReturn )
+            {
+                xResult = CKR_ARGUMENTS_BAD;
+            }
+        }
+        else
+        {
+            xResult = CKR_HOST_MEMORY;
+        }
     }
 
-    if( xResult == CKR_OK )
+    if( ( xResult == CKR_OK ) && ( pucDerObject != NULL ) )
     {
         /* Set the template pointers to refer to the DER converted objects. */
         xCertificateTemplate.xValue.pValue = pucDerObject;
@@ -629,7 +763,7 @@ CK_RV xCheckIfProvisioned( void )
     CK_OBJECT_HANDLE xObject;
     CK_FUNCTION_LIST_PTR pxP11FunctionList;
 
-    char pcCertificateLabel[] = { pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS };
+    char pcCertificateLabel[] = { pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS };
     char pcPrivateKeyLabel[] = { pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS };
 
     xResult = C_GetFunctionList( &pxP11FunctionList );
@@ -642,8 +776,8 @@ CK_RV xCheckIfProvisioned( void )
 
     if( ( xResult == CKR_OK ) && ( xObject != CK_INVALID_HANDLE ) )
     {
+        /* A certificate without its key is reported as not provisioned. */
         xResult = xFindObjectWithLabelAndClass( xSession, pcPrivateKeyLabel, CKO_PRIVATE_KEY, &xObject );
-        configASSERT( xObject != CK_INVALID_HANDLE );
     }
 
     if( xObject == CK_INVALID_HANDLE )
@@ -697,6 +831,11 @@ CK_RV xDestroyCryptoObjects( void )
                                          xClass,
                                          sizeof( xClass ) / sizeof( CK_OBJECT_CLASS ) );
 
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        /* The parsed certificate and key must not outlive the destroyed objects. */
+        PKCS11_PAL_InvalidateCache();
+    #endif
+
     if( xSession != CK_INVALID_HANDLE )
     {
         xResult = pxP11FunctionList->C_CloseSession( xSession );
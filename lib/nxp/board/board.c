@@ -138,6 +138,40 @@ void BOARD_InitSDRAM(void)
     /* EMC Dynamc memory configuration. */
     EMC_DynamicMemInit(EMC, &dynTiming, &dynChipConfig, 1);
 }
+
+/* Check the data and address lines of the external memory, the content is lost. */
+status_t BOARD_CheckSDRAM(void)
+{
+    volatile uint32_t *sdram = (volatile uint32_t *)BOARD_SDRAM_BASE;
+    uint32_t offset;
+    uint32_t bit;
+
+    /* Walking one on the data lines. */
+    for (bit = 0U; bit < 32U; bit++)
+    {
+        sdram[0] = 1UL << bit;
+        if (sdram[0] != (1UL << bit))
+        {
+            return kStatus_Fail;
+        }
+    }
+
+    /* Each address line selects a distinct word. */
+    for (offset = 1U; offset < (BOARD_SDRAM_SIZE / sizeof(uint32_t)); offset <<= 1U)
+    {
+        sdram[offset] = offset;
+    }
+    sdram[0] = 0U;
+    for (offset = 1U; offset < (BOARD_SDRAM_SIZE / sizeof(uint32_t)); offset <<= 1U)
+    {
+        if (sdram[offset] != offset)
+        {
+            return kStatus_Fail;
+        }
+    }
+
+    return kStatus_Success;
+}
 #if defined(SDK_I2C_BASED_COMPONENT_USED) && SDK_I2C_BASED_COMPONENT_USED
 void BOARD_I2C_Init(I2C_Type *base, uint32_t clkSrc_Hz)
 {
@@ -52,6 +52,14 @@
 /*! @brief The ENET PHY address. */
 #define BOARD_ENET0_PHY_ADDRESS (0x00U) /* Phy address of enet port 0. */
 
+/*! @brief Set to 1 on the carrier boards fitted with the SDRAM described by the timing in board.c.
+ *  Their pin_mux.c provides BOARD_InitSDRAMPins(), the module itself has no SDRAM. */
+#ifndef BOARD_SDRAM_ENABLED
+#define BOARD_SDRAM_ENABLED 0
+#endif
+#define BOARD_SDRAM_BASE (0xA0000000U) /*!< EMC dynamic chip 0. */
+#define BOARD_SDRAM_SIZE (0x1000000U)  /*!< 128 Mbits. */
+
 #ifndef BOARD_LED1_GPIO
 #define BOARD_LED1_GPIO GPIO
 #endif
@@ -179,6 +187,10 @@ extern "C" {
 
 status_t BOARD_InitDebugConsole(void);
 void BOARD_InitSDRAM(void);
+status_t BOARD_CheckSDRAM(void);
+#if BOARD_SDRAM_ENABLED
+void BOARD_InitSDRAMPins(void);
+#endif /* BOARD_SDRAM_ENABLED */
 #if defined(SDK_I2C_BASED_COMPONENT_USED) && SDK_I2C_BASED_COMPONENT_USED
 void BOARD_I2C_Init(I2C_Type *base, uint32_t clkSrc_Hz);
 status_t BOARD_I2C_Send(I2C_Type *base,
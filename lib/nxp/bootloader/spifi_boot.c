@@ -27,9 +27,12 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "fsl_device_registers.h"
+#include "fsl_crc32.h"
 #include "fsl_debug_console.h"
 #include "fsl_wwdt.h"
 #include "fsl_power.h"
@@ -64,7 +67,8 @@ static struct boot_image_header *boot_get_image_header(const void *addr)
 }
 
 
-static int boot_image_validate(const void *addr)
+/* Validates the image at given address and checks it is built to execute at load_address */
+static int boot_image_validate_at(const void *addr, uint32_t load_address)
 {
     struct boot_image_header *bih;
 
@@ -72,7 +76,7 @@ static int boot_image_validate(const void *addr)
     bih = boot_get_image_header(addr);
 
     /* check load address */
-    if (bih == NULL || bih->load_address != BOOT_EXEC_IMAGE_ADDR)
+    if (bih == NULL || bih->load_address != load_address)
     {
         return -1;
     }
@@ -81,6 +85,12 @@ static int boot_image_validate(const void *addr)
 }
 
 
+static int boot_image_validate(const void *addr)
+{
+    return boot_image_validate_at(addr, BOOT_EXEC_IMAGE_ADDR);
+}
+
+
 /* Validates boot image and copies it to given address of FLASH, returns number of bytes copied upon success */
 static int32_t boot_image_copy(void *flash_dst, const void *img)
 {
@@ -106,6 +116,325 @@ static int32_t boot_image_copy(void *flash_dst, const void *img)
 }
 
 
+/* Returns length of the image at given address including its checksum, 0 if there is no valid image */
+uint32_t boot_image_length(const void *img)
+{
+    struct boot_image_header *boot_image_header = boot_get_image_header(img);
+
+    if (boot_image_header == NULL)
+        return 0;
+
+    return boot_image_header->image_length + 4;
+}
+
+
+
+/* Validates the application module at given address and checks it is built to execute from load_address */
+const struct boot_module_header *boot_module_validate(const void *img, uint32_t load_address)
+{
+    const struct boot_module_header *hdr = (const struct boot_module_header *)img;
+    uint32_t crc_offset = offsetof(struct boot_module_header, crc) + sizeof(hdr->crc);
+    uint32_t code_start = load_address + sizeof(struct boot_module_header);
+
+    if ((hdr->marker != BOOT_MODULE_MARKER) || (hdr->load_address != load_address))
+        return NULL;
+
+    if ((hdr->length < sizeof(struct boot_module_header)) || (hdr->length > BOOT_MODULE_SLOT_SIZE))
+        return NULL;
+
+    /* the entry and the initial values of the data are part of the module */
+    if ((hdr->entry < code_start) || (hdr->entry >= load_address + hdr->length))
+        return NULL;
+
+    if ((hdr->data_start > hdr->data_end) || (hdr->data_end > hdr->bss_end) || (hdr->data_load < code_start) ||
+        (hdr->data_load - load_address > hdr->length) ||
+        (hdr->data_end - hdr->data_start > hdr->length - (hdr->data_load - load_address)))
+        return NULL;
+
+    if (CRC32_Update(0, (const uint8_t *)img + crc_offset, hdr->length - crc_offset) != hdr->crc)
+        return NULL;
+
+    return hdr;
+}
+
+
+/* Computes CRC32 of the image at given address including its checksum, using the CRC engine when it is free */
+static uint32_t boot_image_crc(const void *img)
+{
+#if BOOT_IMAGE_CRC_CHECK
+    uint32_t length = boot_image_length(img);
+
+    if (length == 0)
+        return BOOT_IMAGE_CRC_NONE;
+
+    return CRC32_Update(0, img, length);
+#else
+    (void)img;
+    return BOOT_IMAGE_CRC_NONE;
+#endif
+}
+
+
+/* Checks the image at given address against the reference CRC32 stored in the update control block */
+static bool boot_image_crc_ok(const void *img, uint32_t crc)
+{
+    if (crc == BOOT_IMAGE_CRC_NONE)
+        return true;
+
+    return boot_image_crc(img) == crc;
+}
+
+
+/* Checks whether a swap recorded in given journal has already started */
+static bool boot_swap_started(const uint8_t *journal)
+{
+    for (uint32_t i = 0; i < BOOT_SWAP_JOURNAL_SIZE; i++)
+    {
+        if (journal[i] != BOOT_SWAP_STEP_NONE)
+            return true;
+    }
+    return false;
+}
+
+
+/* Records progress of a sector swap in the journal, only clears bits so the FLASH sector is not erased */
+static int32_t boot_swap_mark(const uint8_t *journal, uint32_t sector, uint8_t step)
+{
+    uint8_t value = step;
+    return mflash_drv_write((void *)&journal[sector], &value, 1);
+}
+
+
+/* Swaps 'length' bytes of two images sector by sector, skipping sectors which are equal.
+ * The swap is resumed from the journal when interrupted by a reset or power loss. */
+static int32_t boot_image_swap(void *exec_img, void *update_img, uint32_t length, const uint8_t *journal)
+{
+    uint32_t sectors = (length + MFLASH_SECTOR_SIZE - 1) / MFLASH_SECTOR_SIZE;
+
+    if (sectors > BOOT_SWAP_JOURNAL_SIZE)
+        return -1;
+
+    for (uint32_t i = 0; i < sectors; i++)
+    {
+        uint8_t *exec_sector = (uint8_t *)exec_img + i * MFLASH_SECTOR_SIZE;
+        uint8_t *update_sector = (uint8_t *)update_img + i * MFLASH_SECTOR_SIZE;
+        uint8_t step = journal[i];
+
+        if (step == BOOT_SWAP_STEP_NONE)
+        {
+            if (memcmp(exec_sector, update_sector, MFLASH_SECTOR_SIZE) == 0)
+                continue;
+
+            if ((mflash_drv_write((void *)BOOT_SWAP_SCRATCH_ADDR, exec_sector, MFLASH_SECTOR_SIZE) != 0) ||
+                (boot_swap_mark(journal, i, BOOT_SWAP_STEP_SAVED) != 0))
+                return -1;
+            step = BOOT_SWAP_STEP_SAVED;
+        }
+
+        if (step == BOOT_SWAP_STEP_SAVED)
+        {
+            if ((mflash_drv_write(exec_sector, update_sector, MFLASH_SECTOR_SIZE) != 0) ||
+                (boot_swap_mark(journal, i, BOOT_SWAP_STEP_INSTALLED) != 0))
+                return -1;
+            step = BOOT_SWAP_STEP_INSTALLED;
+        }
+
+        if (step == BOOT_SWAP_STEP_INSTALLED)
+        {
+            if ((mflash_drv_write(update_sector, (void *)BOOT_SWAP_SCRATCH_ADDR, MFLASH_SECTOR_SIZE) != 0) ||
+                (boot_swap_mark(journal, i, BOOT_SWAP_STEP_DONE) != 0))
+                return -1;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Returns header of the compressed image at given address, NULL if there is no valid compressed image */
+static const struct boot_lz4_header *boot_lz4_header_get(const void *img)
+{
+    const struct boot_lz4_header *header = (const struct boot_lz4_header *)img;
+
+    if ((img == NULL) || (header->marker != BOOT_LZ4_MARKER))
+        return NULL;
+
+    if ((header->image_length == 0) || (header->image_length > BOOT_SWAP_SLOT_SIZE) ||
+        (header->data_length > BOOT_SWAP_SLOT_SIZE))
+        return NULL;
+
+    return header;
+}
+
+
+/* Returns length of the compressed image at given address including its header, 0 if there is no compressed image */
+uint32_t boot_lz4_length(const void *img)
+{
+    const struct boot_lz4_header *header = boot_lz4_header_get(img);
+
+    if (header == NULL)
+        return 0;
+
+    return sizeof(struct boot_lz4_header) + header->data_length;
+}
+
+
+/* Output of the decompression, programmed to FLASH a sector at a time */
+struct boot_lz4_output
+{
+    uint8_t *dst;        /* start of the output in FLASH */
+    uint32_t max_length; /* size of the FLASH region of the output */
+    uint8_t *sector;     /* sector buffer of the caller */
+    uint32_t length;     /* number of bytes programmed */
+    uint32_t fill;       /* number of bytes pending in the sector buffer */
+};
+
+static uint8_t boot_lz4_sector[MFLASH_SECTOR_SIZE];
+
+
+/* Appends bytes to the output, programming the sector buffer once it is full or when flushing.
+ * The bytes may come from the sector buffer itself, as long as they are before the pending ones */
+static int32_t boot_lz4_emit(struct boot_lz4_output *out, const uint8_t *src, uint32_t length, bool flush)
+{
+    uint32_t chunk;
+
+    while ((length > 0) || (flush && (out->fill > 0)))
+    {
+        chunk = MFLASH_SECTOR_SIZE - out->fill;
+        if (chunk > length)
+            chunk = length;
+
+        if (chunk > 0)
+        {
+            memcpy(&out->sector[out->fill], src, chunk);
+            out->fill += chunk;
+            src += chunk;
+            length -= chunk;
+        }
+
+        if ((out->fill == MFLASH_SECTOR_SIZE) || (flush && (length == 0)))
+        {
+            if ((out->length + out->fill > out->max_length) ||
+                (mflash_drv_write(out->dst + out->length, out->sector, out->fill) != 0))
+                return -1;
+            out->length += out->fill;
+            out->fill = 0;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Adds the extension bytes of a literal or match length, returns false if the data ends before the last one */
+static bool boot_lz4_length_ext(const uint8_t *data, uint32_t data_length, uint32_t *pos, uint32_t *value)
+{
+    uint8_t extra;
+
+    do
+    {
+        if (*pos >= data_length)
+            return false;
+        extra = data[(*pos)++];
+        *value += extra;
+    } while (extra == 255);
+
+    return true;
+}
+
+
+/* Decompresses the compressed image at given address to given address of FLASH, returns number of bytes written upon success */
+int32_t boot_lz4_decompress(void *flash_dst, uint32_t max_length, const void *img, uint8_t *sector)
+{
+#if MFLASH_BOOT_API
+    const struct boot_api *api = boot_api_get();
+    if ((api != NULL) && (api->size >= offsetof(struct boot_api, lz4_decompress) + sizeof(api->lz4_decompress)))
+    {
+        return api->lz4_decompress(flash_dst, max_length, img, sector);
+    }
+#endif
+
+    const struct boot_lz4_header *header = boot_lz4_header_get(img);
+    struct boot_lz4_output out = {(uint8_t *)flash_dst, max_length, sector, 0, 0};
+    const uint8_t *data;
+    const uint8_t *src;
+    uint32_t data_length, pos, literals, match, offset, source, chunk;
+    uint8_t token;
+
+    if ((header == NULL) || (sector == NULL))
+        return -1;
+
+    data = (const uint8_t *)img + sizeof(struct boot_lz4_header);
+    data_length = header->data_length;
+
+    for (pos = 0; pos < data_length;)
+    {
+        /* sequence token, literal length in the high nibble and match length in the low nibble */
+        token = data[pos++];
+        literals = token >> 4;
+        if ((literals == 15) && !boot_lz4_length_ext(data, data_length, &pos, &literals))
+            return -1;
+
+        if ((literals > data_length - pos) || (boot_lz4_emit(&out, &data[pos], literals, false) != 0))
+            return -1;
+        pos += literals;
+
+        /* the last sequence of the block only has literals */
+        if (pos == data_length)
+            break;
+
+        if (data_length - pos < 2)
+            return -1;
+        offset = (uint32_t)data[pos] | ((uint32_t)data[pos + 1] << 8);
+        pos += 2;
+
+        match = token & 0x0F;
+        if ((match == 15) && !boot_lz4_length_ext(data, data_length, &pos, &match))
+            return -1;
+        match += BOOT_LZ4_MIN_MATCH;
+
+        if ((offset == 0) || (offset > out.length + out.fill))
+            return -1;
+
+        /* copy the match in chunks no longer than the offset, so that overlapping matches repeat the pattern,
+         * and not crossing the end of the sector buffer, so that a chunk read from it stays valid */
+        for (source = out.length + out.fill - offset; match > 0; source += chunk, match -= chunk)
+        {
+            chunk = (match < offset) ? match : offset;
+            if (chunk > MFLASH_SECTOR_SIZE - out.fill)
+                chunk = MFLASH_SECTOR_SIZE - out.fill;
+
+            if (source < out.length)
+            {
+                /* earlier output already programmed, read it back from the memory mapped FLASH */
+                if (chunk > out.length - source)
+                    chunk = out.length - source;
+                src = out.dst + source;
+            }
+            else
+            {
+                src = &out.sector[source - out.length];
+            }
+
+            if (boot_lz4_emit(&out, src, chunk, false) != 0)
+                return -1;
+        }
+    }
+
+    if ((boot_lz4_emit(&out, NULL, 0, true) != 0) || (out.length != header->image_length))
+        return -1;
+
+    return out.length;
+}
+
+
+/* Computes CRC32 of the update control block up to its own checksum */
+static uint32_t boot_ucb_crc(const struct boot_ucb *ucbp)
+{
+    return CRC32_Update(0, ucbp, offsetof(struct boot_ucb, ucb_crc));
+}
+
+
 /* Reads update control block */
 int32_t boot_ucb_read(struct boot_ucb *ucbp)
 {
@@ -116,7 +445,8 @@ int32_t boot_ucb_read(struct boot_ucb *ucbp)
 
     *ucbp = *(struct boot_ucb *)(BOOT_UCB_ADDR);
 
-    if ((ucbp->signature != BOOT_UCB_SIGNATURE) || (ucbp->version != BOOT_UCB_VERSION))
+    if ((ucbp->signature != BOOT_UCB_SIGNATURE) || (ucbp->version != BOOT_UCB_VERSION) ||
+        ((ucbp->ucb_crc != BOOT_UCB_CRC_NONE) && (ucbp->ucb_crc != boot_ucb_crc(ucbp))))
     {
         /* the update control block is invalid, forge consistent structure with default/undefinded values */
         memset((void *)ucbp, 0xFF, sizeof(struct boot_ucb));
@@ -131,16 +461,35 @@ int32_t boot_ucb_read(struct boot_ucb *ucbp)
 }
 
 
-/* Writes update control block */
+/* Writes update control block with its checksum */
 int32_t boot_ucb_write(const struct boot_ucb *ucbp)
 {
-    return mflash_drv_write((void *)BOOT_UCB_ADDR, (void *)ucbp, sizeof(struct boot_ucb));
+#if MFLASH_BOOT_API
+    const struct boot_api *api = boot_api_get();
+    if (api != NULL)
+    {
+        return api->ucb_write(ucbp);
+    }
+#endif
+
+    struct boot_ucb ucb = *ucbp;
+
+    ucb.ucb_crc = boot_ucb_crc(&ucb);
+    return mflash_drv_write((void *)BOOT_UCB_ADDR, (void *)&ucb, sizeof(struct boot_ucb));
 }
 
 
 /* Erases update control block */
 int32_t boot_ucb_erase(void)
 {
+#if MFLASH_BOOT_API
+    const struct boot_api *api = boot_api_get();
+    if (api != NULL)
+    {
+        return api->ucb_erase();
+    }
+#endif
+
     /* write is used instead of plain erase to preserve rest of the FLASH sector */
     struct boot_ucb ucb;
     memset((void *)&ucb, 0xFF, sizeof(ucb));
@@ -148,6 +497,56 @@ int32_t boot_ucb_erase(void)
 }
 
 
+#if BOOT_API_EXPORT
+
+#if MFLASH_BOOT_API
+#error "The bootloader exporting its flash driver cannot use the driver of another bootloader"
+#endif
+
+extern uint32_t __boot_api_ram_load__[];
+extern uint32_t __boot_api_ram_start__[];
+extern uint32_t __boot_api_ram_data_end__[];
+extern uint32_t __boot_api_ram_end__[];
+
+/* Loads the flash driver in BOOT_API_RAM_ADDR, which the startup code of the application does not initialize,
+ * and initializes the FLASH. Executes in place */
+static int32_t boot_api_init(void)
+{
+    const uint32_t *src = __boot_api_ram_load__;
+    uint32_t *dst = __boot_api_ram_start__;
+
+    while (dst < __boot_api_ram_data_end__)
+    {
+        *dst++ = *src++;
+    }
+    while (dst < __boot_api_ram_end__)
+    {
+        *dst++ = 0;
+    }
+
+    return mflash_drv_init();
+}
+
+/* Placed at BOOT_API_ADDR by the linker script of the bootloader */
+__attribute__((section(".boot_api"), used)) const struct boot_api boot_api_table = {
+    .marker         = BOOT_API_MARKER,
+    .version        = BOOT_API_VERSION,
+    .size           = sizeof(struct boot_api),
+    .init           = boot_api_init,
+    .flash_write    = mflash_drv_write,
+    .flash_writev   = mflash_drv_writev,
+    .flash_erase    = mflash_drv_erase,
+    .flash_read     = mflash_drv_read,
+    .flash_is_busy  = mflash_drv_is_busy,
+    .ucb_read       = boot_ucb_read,
+    .ucb_write      = boot_ucb_write,
+    .ucb_erase      = boot_ucb_erase,
+    .lz4_decompress = boot_lz4_decompress,
+};
+
+#endif /* BOOT_API_EXPORT */
+
+
 #define portAIRCR_REG ( * ( ( volatile uint32_t * ) 0xE000ED0C ) )
 #define VECTKEY_SHIFT 16
 #define VECTKEY_VAL 0x5FA
@@ -164,6 +563,114 @@ void boot_cpureset(void)
 }
 
 
+/* Restarts the cycle counter and clears the boot timing record */
+void boot_timing_start(void)
+{
+    volatile struct boot_timing *timing = BOOT_TIMING;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for (uint32_t i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        timing->cycles[i] = BOOT_TIMING_UNSET;
+    }
+    timing->marker = BOOT_TIMING_MARKER;
+}
+
+
+/* Records the cycle count of the first occurrence of given boot phase */
+void boot_timing_mark(enum boot_phase phase)
+{
+    volatile struct boot_timing *timing = BOOT_TIMING;
+
+    /* no bootloader record or a stale one of a previous boot, start counting at main() */
+    if ((timing->marker != BOOT_TIMING_MARKER) ||
+        ((phase == BOOT_PHASE_MAIN) && (timing->cycles[BOOT_PHASE_MAIN] != BOOT_TIMING_UNSET)))
+    {
+        boot_timing_start();
+    }
+
+    if (timing->cycles[phase] == BOOT_TIMING_UNSET)
+    {
+        timing->cycles[phase] = DWT->CYCCNT;
+    }
+}
+
+
+/* Returns the slot executed by the bootloader */
+void *boot_active_image(void)
+{
+    struct boot_ucb ucb;
+
+    if ((boot_ucb_read(&ucb) == 0) && (ucb.flags == BOOT_FLAGS_AB) &&
+        ((ucb.active_img == (void *)BOOT_AB_SLOT_A_ADDR) || (ucb.active_img == (void *)BOOT_AB_SLOT_B_ADDR)))
+    {
+        return ucb.active_img;
+    }
+
+    return (void *)BOOT_EXEC_IMAGE_ADDR;
+}
+
+
+/* Returns the slot the update image is to be downloaded to */
+void *boot_update_slot(void)
+{
+#if BOOT_AB_MODE
+    return (boot_active_image() == (void *)BOOT_AB_SLOT_A_ADDR) ? (void *)BOOT_AB_SLOT_B_ADDR : (void *)BOOT_AB_SLOT_A_ADDR;
+#else
+    return (void *)(BOOT_EXEC_IMAGE_ADDR + BOOT_SWAP_SLOT_SIZE);
+#endif
+}
+
+
+/* Returns true if the update control block records a backup of the exec image at given address
+ * and the backup still matches the exec image */
+bool boot_backup_ready(const void *backup_storage)
+{
+    struct boot_ucb ucb;
+    uint32_t length = boot_image_length((void *)BOOT_EXEC_IMAGE_ADDR);
+
+    return (backup_storage != NULL) && (length != 0) && (boot_ucb_read(&ucb) == 0) &&
+           ((ucb.state == BOOT_STATE_UNDEF) || (ucb.state == BOOT_STATE_VOID)) && (ucb.flags == BOOT_FLAGS_COPY) &&
+           (ucb.rollback_img == backup_storage) && (ucb.rollback_img_size == length) &&
+           (memcmp(backup_storage, (void *)BOOT_EXEC_IMAGE_ADDR, length) == 0);
+}
+
+
+/* Records in the update control block that the exec image was copied to given address by the
+ * application, so that the copy is skipped when the update is requested */
+int32_t boot_backup_record(void *backup_storage)
+{
+    struct boot_ucb ucb;
+    uint32_t length = boot_image_length((void *)BOOT_EXEC_IMAGE_ADDR);
+
+    /* an update in progress owns the update control block */
+    (void)boot_ucb_read(&ucb);
+    if ((ucb.state != BOOT_STATE_UNDEF) && (ucb.state != BOOT_STATE_VOID))
+    {
+        return -1;
+    }
+
+    if ((backup_storage == NULL) || (length == 0) || (memcmp(backup_storage, (void *)BOOT_EXEC_IMAGE_ADDR, length) != 0))
+    {
+        return -1;
+    }
+
+    memset((void *)&ucb, 0xFF, sizeof(ucb));
+    ucb.signature = BOOT_UCB_SIGNATURE;
+    ucb.version = BOOT_UCB_VERSION;
+    ucb.flags = BOOT_FLAGS_COPY;
+    ucb.state = BOOT_STATE_VOID;
+    ucb.rollback_img = backup_storage;
+    ucb.rollback_img_size = length;
+    ucb.rollback_img_crc = boot_image_crc(backup_storage);
+
+    return boot_ucb_write(&ucb);
+}
+
+
 /* Schedules update for next reboot by filling in the update control block structure */
 int32_t boot_update_request(void *update_img, void *backup_storage)
 {
@@ -172,8 +679,70 @@ int32_t boot_update_request(void *update_img, void *backup_storage)
 
     memset((void *)&ucb, 0xFF, sizeof(ucb));
 
-    /* backup active image to spare area for rollback */
-    if (backup_storage)
+#if BOOT_AB_MODE
+    /* the update image is executed in place, the active image is kept in its slot for rollback */
+    void *active_img = boot_active_image();
+
+    (void)backup_storage;
+    (void)result;
+
+    if ((update_img == active_img) || (0 != boot_image_validate_at(update_img, (uint32_t)update_img)))
+    {
+        return -1;
+    }
+
+    ucb.signature = BOOT_UCB_SIGNATURE;
+    ucb.version = BOOT_UCB_VERSION;
+    ucb.flags = BOOT_FLAGS_AB;
+    ucb.state = BOOT_STATE_NEW;
+    ucb.update_img = update_img;
+    ucb.rollback_img = active_img;
+    ucb.active_img = active_img;
+    ucb.update_img_crc = boot_image_crc(update_img);
+    ucb.rollback_img_crc = boot_image_crc(active_img);
+
+    return boot_ucb_write(&ucb);
+#else
+    const struct boot_lz4_header *lz4_header = boot_lz4_header_get(update_img);
+
+#if BOOT_SWAP_MODE
+    if (lz4_header == NULL)
+    {
+        /* the update slot receives the active image during the swap, no backup copy is needed */
+        static uint8_t journals[2 * BOOT_SWAP_JOURNAL_SIZE];
+        uint32_t update_length = boot_image_length(update_img);
+        uint32_t exec_length = boot_image_length((void *)BOOT_EXEC_IMAGE_ADDR);
+
+        if ((update_length == 0) || (update_length > BOOT_SWAP_SLOT_SIZE) || (exec_length > BOOT_SWAP_SLOT_SIZE))
+        {
+            return -1;
+        }
+
+        ucb.signature = BOOT_UCB_SIGNATURE;
+        ucb.version = BOOT_UCB_VERSION;
+        ucb.flags = BOOT_FLAGS_SWAP;
+        ucb.state = BOOT_STATE_NEW;
+        ucb.update_img = update_img;
+        ucb.update_img_size = (update_length > exec_length) ? update_length : exec_length;
+        ucb.rollback_img = update_img;
+        ucb.update_img_crc = boot_image_crc(update_img);
+        ucb.rollback_img_crc = boot_image_crc((void *)BOOT_EXEC_IMAGE_ADDR);
+        ucb.ucb_crc = boot_ucb_crc(&ucb);
+
+        /* store update control block together with blank journals in a single update of the FLASH sector */
+        memset(journals, BOOT_SWAP_STEP_NONE, sizeof(journals));
+        mflash_drv_segment_t segments[] = {
+            {(void *)BOOT_UCB_ADDR, (const uint8_t *)&ucb, sizeof(ucb)},
+            {(void *)BOOT_SWAP_JOURNAL_INSTALL_ADDR, journals, sizeof(journals)},
+        };
+        return mflash_drv_writev(segments, sizeof(segments) / sizeof(segments[0]));
+    }
+
+    /* a compressed image cannot be swapped, it is installed as in copy mode */
+#endif
+
+    /* backup active image to spare area for rollback, unless the application already made the copy */
+    if (backup_storage && !boot_backup_ready(backup_storage))
     {
         result = boot_image_copy(backup_storage, (void *)BOOT_EXEC_IMAGE_ADDR);
         if (result < 0)
@@ -188,9 +757,21 @@ int32_t boot_update_request(void *update_img, void *backup_storage)
     ucb.state = BOOT_STATE_NEW;
     ucb.update_img = update_img;
     ucb.rollback_img = backup_storage;
+    if (lz4_header != NULL)
+    {
+        /* the image is decompressed by the bootloader, its CRC32 comes with the compressed image */
+        ucb.flags = BOOT_FLAGS_LZ4;
+        ucb.update_img_crc = BOOT_IMAGE_CRC_CHECK ? lz4_header->image_crc : BOOT_IMAGE_CRC_NONE;
+    }
+    else
+    {
+        ucb.update_img_crc = boot_image_crc(update_img);
+    }
+    ucb.rollback_img_crc = backup_storage ? boot_image_crc(backup_storage) : BOOT_IMAGE_CRC_NONE;
 
     /* store update control block in FLASH and return */
     return boot_ucb_write(&ucb);
+#endif
 }
 
 /* Once update image is running and approved, overwrite the rollback image */
@@ -199,9 +780,17 @@ int32_t boot_overwrite_rollback(void)
     struct boot_ucb ucb;
     int32_t result = 0;
 
+    if (boot_ucb_read(&ucb) == 0 && (ucb.flags == BOOT_FLAGS_SWAP || ucb.flags == BOOT_FLAGS_AB))
+    {
+        /* the previous image is already in the update slot */
+        return 0;
+    }
+
     if (boot_ucb_read(&ucb) == 0 && ucb.rollback_img != NULL)
     {
-        result = boot_image_copy(ucb.rollback_img, ucb.update_img);
+        /* a compressed update image was installed decompressed, copy it from the exec slot */
+        result = boot_image_copy(ucb.rollback_img,
+                                 (ucb.flags == BOOT_FLAGS_LZ4) ? (void *)BOOT_EXEC_IMAGE_ADDR : ucb.update_img);
     }
     return result;
 }
@@ -222,6 +811,8 @@ void boot_app_exec(const void *addr)
       return;
     }
 
+    boot_timing_mark(BOOT_PHASE_APP_EXEC);
+
     app_vectors = (const uint32_t *)addr;
     app_sp = app_vectors[0];
     app_entry = (void (*)(void))app_vectors[1];
@@ -249,18 +840,21 @@ void boot_app_exec(const void *addr)
 }
 
 
-void boot_wdten(void)
+/* Arms the watchdog to reset the device after approximately timeout_ms without a feed */
+void boot_wdtinit(uint32_t timeout_ms)
 {
     wwdt_config_t config;
     uint32_t wdtFreq;
+    uint64_t timeout;
 
     POWER_DisablePD(kPDRUNCFG_PD_WDT_OSC);
 
     wdtFreq = CLOCK_GetFreq(kCLOCK_WdtOsc) / 4; /* prescaled by 4 */
     WWDT_GetDefaultConfig(&config);
 
-    /* Set watchdog timeout to approximately 60 s */
-    config.timeoutValue = 60 * wdtFreq;
+    /* the timer constant is 24 bits wide */
+    timeout = ((uint64_t)wdtFreq * timeout_ms) / 1000;
+    config.timeoutValue = (timeout > 0xFFFFFF) ? 0xFFFFFF : (uint32_t)timeout;
     /* Configure WWDT to reset on timeout */
     config.enableWatchdogReset = true;
 
@@ -269,6 +863,19 @@ void boot_wdten(void)
 }
 
 
+void boot_wdtfeed(void)
+{
+    WWDT_Refresh(WWDT);
+}
+
+
+void boot_wdten(void)
+{
+    /* Set watchdog timeout to approximately 60 s */
+    boot_wdtinit(60000);
+}
+
+
 void boot_wdtdis(void)
 {
     POWER_EnablePD(kPDRUNCFG_PD_WDT_OSC);
@@ -281,11 +888,32 @@ int32_t boot_run(void)
     struct boot_ucb ucb;
     void *exec_image = (void *)BOOT_EXEC_IMAGE_ADDR;
 
+    boot_timing_start();
+    boot_timing_mark(BOOT_PHASE_BOOTLOADER);
+
+#if BOOT_FAST_BOOT
+    /* idle update control block, a single word compare decides there is nothing to be done */
+    uint32_t state = ((const struct boot_ucb *)BOOT_UCB_ADDR)->state;
+    if ((state == BOOT_STATE_VOID) || (state == BOOT_STATE_UNDEF))
+    {
+#if BOOT_AB_MODE
+        exec_image = boot_active_image();
+#endif
+        boot_app_exec(exec_image);
+        /* the image is not bootable, fall through to the regular path to report it */
+    }
+#endif
+
     PRINTF("\r\nSPIFI bootloader " BOOT_VERSION_STRING "\r\n");
 
     /* load update control block */
     boot_ucb_read(&ucb);
 
+    if (ucb.flags == BOOT_FLAGS_AB)
+    {
+        exec_image = boot_active_image();
+    }
+
     /* update control block is present, process it */
     switch (ucb.state)
     {
@@ -296,7 +924,48 @@ int32_t boot_run(void)
 
     case BOOT_STATE_NEW:
         /* new update image available, flash it and switch to test mode */
-        if (0 != boot_image_validate(ucb.update_img))
+        if (ucb.flags == BOOT_FLAGS_AB)
+        {
+            /* the update image is executed in place, just switch the active slot */
+            if ((0 != boot_image_validate_at(ucb.update_img, (uint32_t)ucb.update_img)) ||
+                !boot_image_crc_ok(ucb.update_img, ucb.update_img_crc))
+            {
+                PRINTF(BOOT_PROMPT_STRING "Invalid update image!\r\n");
+                ucb.state = BOOT_STATE_VOID;
+            }
+            else
+            {
+                PRINTF(BOOT_PROMPT_STRING "Activating update slot\r\n");
+                exec_image = ucb.update_img;
+                ucb.active_img = ucb.update_img;
+                ucb.state = BOOT_STATE_PENDING_COMMIT;
+            }
+        }
+        else if ((ucb.flags == BOOT_FLAGS_SWAP) && boot_swap_started((const uint8_t *)BOOT_SWAP_JOURNAL_INSTALL_ADDR))
+        {
+            /* the image was validated before the swap started, the headers may be swapped already */
+            PRINTF(BOOT_PROMPT_STRING "Resuming update... ");
+            if (boot_image_swap((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img, ucb.update_img_size,
+                                (const uint8_t *)BOOT_SWAP_JOURNAL_INSTALL_ADDR) <= 0)
+            {
+                /* keep the state so the swap is resumed from the journal upon next boot */
+                PRINTF("ERROR\r\n");
+                exec_image = NULL;
+            }
+            else if (!boot_image_crc_ok((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img_crc))
+            {
+                PRINTF("CRC ERROR\r\n");
+                exec_image = NULL;
+                ucb.state = BOOT_STATE_INVALID;
+            }
+            else
+            {
+                PRINTF("OK\r\n");
+                ucb.state = BOOT_STATE_PENDING_COMMIT;
+            }
+        }
+        else if ((ucb.flags == BOOT_FLAGS_LZ4) ? (boot_lz4_header_get(ucb.update_img) == NULL)
+                                                 : (0 != boot_image_validate(ucb.update_img)))
         {
             /* the update image is invalid, erase the update control block and execute the current image */
             PRINTF(BOOT_PROMPT_STRING "Invalid update image!\r\n");
@@ -305,16 +974,26 @@ int32_t boot_run(void)
         else
         {
             PRINTF(BOOT_PROMPT_STRING "Installing update... ");
-            if (boot_image_copy((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img) > 0)
+            bool installed = (ucb.flags == BOOT_FLAGS_SWAP)
+                    ? (boot_image_swap((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img, ucb.update_img_size,
+                                       (const uint8_t *)BOOT_SWAP_JOURNAL_INSTALL_ADDR) > 0)
+                    : (ucb.flags == BOOT_FLAGS_LZ4)
+                    ? ((boot_lz4_decompress((void *)BOOT_EXEC_IMAGE_ADDR, BOOT_SWAP_SLOT_SIZE, ucb.update_img,
+                                           boot_lz4_sector) > 0) &&
+                       (0 == boot_image_validate((void *)BOOT_EXEC_IMAGE_ADDR)))
+                    : (boot_image_copy((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img) > 0);
+            if (installed && boot_image_crc_ok((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img_crc))
             {
                 PRINTF("OK\r\n");
                 ucb.state = BOOT_STATE_PENDING_COMMIT;
             }
             else
             {
-                PRINTF("ERROR\r\n");
+                PRINTF(installed ? "CRC ERROR\r\n" : "ERROR\r\n");
                 exec_image = NULL; /* the current image might be corrupted */
-                ucb.state = BOOT_STATE_INVALID; /* set state to invalid to got for rollback upon next boot */
+                /* an interrupted swap is resumed from the journal, otherwise go for rollback upon next boot */
+                if (installed || (ucb.flags != BOOT_FLAGS_SWAP))
+                    ucb.state = BOOT_STATE_INVALID;
             }
         }
         if (boot_ucb_write(&ucb) != 0)
@@ -326,7 +1005,42 @@ int32_t boot_run(void)
     /* reboot from test mode or image explicitly rejected, rollback */
     case BOOT_STATE_PENDING_COMMIT:
     case BOOT_STATE_INVALID:
-        if (0 != boot_image_validate(ucb.rollback_img))
+        if (ucb.flags == BOOT_FLAGS_AB)
+        {
+            /* the previous image is still in place, just switch the active slot back */
+            if ((0 != boot_image_validate_at(ucb.rollback_img, (uint32_t)ucb.rollback_img)) ||
+                !boot_image_crc_ok(ucb.rollback_img, ucb.rollback_img_crc))
+            {
+                PRINTF(BOOT_PROMPT_STRING "No rollback image, executing the current one... ");
+            }
+            else
+            {
+                PRINTF(BOOT_PROMPT_STRING "Rolling back to previous slot\r\n");
+                exec_image = ucb.rollback_img;
+                ucb.active_img = ucb.rollback_img;
+            }
+            ucb.state = BOOT_STATE_VOID;
+        }
+        else if ((ucb.flags == BOOT_FLAGS_SWAP) && boot_swap_started((const uint8_t *)BOOT_SWAP_JOURNAL_ROLLBACK_ADDR))
+        {
+            /* rollback was interrupted, finish swapping the images back */
+            PRINTF(BOOT_PROMPT_STRING "Resuming rollback... ");
+            if ((boot_image_swap((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img, ucb.update_img_size,
+                                 (const uint8_t *)BOOT_SWAP_JOURNAL_ROLLBACK_ADDR) > 0) &&
+                boot_image_crc_ok((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img_crc))
+            {
+                PRINTF("OK\r\n");
+                ucb.state = BOOT_STATE_VOID;
+            }
+            else
+            {
+                PRINTF("ERROR\r\n");
+                exec_image = NULL;
+                ucb.state = BOOT_STATE_VOID;
+                break;
+            }
+        }
+        else if (0 != boot_image_validate(ucb.rollback_img))
         {
             /* the rollback image is invalid, just try executing the current one as last resort solution */
             PRINTF(BOOT_PROMPT_STRING "No rollback image, executing the current one... ");
@@ -335,7 +1049,11 @@ int32_t boot_run(void)
         else
         {
             PRINTF(BOOT_PROMPT_STRING "Rolling back to previous image... ");
-            if (boot_image_copy((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img) > 0)
+            if (((ucb.flags == BOOT_FLAGS_SWAP)
+                    ? (boot_image_swap((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img, ucb.update_img_size,
+                                       (const uint8_t *)BOOT_SWAP_JOURNAL_ROLLBACK_ADDR) > 0)
+                    : (boot_image_copy((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img) > 0)) &&
+                boot_image_crc_ok((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img_crc))
             {
                 PRINTF("OK\r\n");
                 ucb.state = BOOT_STATE_VOID;
@@ -381,7 +1099,7 @@ int32_t boot_run(void)
             PRINTF(BOOT_PROMPT_STRING "Enabling watchdog...\r\n");
             boot_wdten();
         }
-        boot_app_exec((void *)BOOT_EXEC_IMAGE_ADDR);
+        boot_app_exec(exec_image);
         PRINTF(BOOT_PROMPT_STRING "Application exec failed.\r\n");
     }
     else
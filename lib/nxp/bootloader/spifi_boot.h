@@ -30,8 +30,12 @@
 #ifndef _SPIFI_BOOT_H_
 #define _SPIFI_BOOT_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "mflash_drv.h"
+
 #define BOOT_VERSION_STRING "0.9"
 #define BOOT_PROMPT_STRING "[BOOT] "
 
@@ -55,17 +59,102 @@
 #define BOOT_STATE_INVALID             0xFF000000
 #define BOOT_STATE_VOID                0x00000000
 
+/* Install updates by swapping the differing sectors of the update and exec images instead of copying,
+ * the update slot then holds the previous image for rollback and no backup copy is needed */
+#ifndef BOOT_SWAP_MODE
+#define BOOT_SWAP_MODE 1
+#endif
+
+/* Flags of the update control block */
+#define BOOT_FLAGS_COPY                0xFFFFFFFF
+#define BOOT_FLAGS_SWAP                0xFFFFFFFE
+
+/* Largest image that can be swapped */
+#ifndef BOOT_SWAP_SLOT_SIZE
+#define BOOT_SWAP_SLOT_SIZE (0x200000)
+#endif
+
+/* Spare sector holding a sector of the exec image while it is being swapped */
+#ifndef BOOT_SWAP_SCRATCH_ADDR
+#define BOOT_SWAP_SCRATCH_ADDR (BOOT_UCB_ADDR - MFLASH_SECTOR_SIZE)
+#endif
+
+/* Swap progress journals in the update control block sector, one byte per sector of the slot,
+ * bits are only cleared so the progress is recorded without erasing the sector.
+ * The install and the rollback use separate journals */
+#define BOOT_SWAP_JOURNAL_SIZE         (BOOT_SWAP_SLOT_SIZE / MFLASH_SECTOR_SIZE)
+#define BOOT_SWAP_JOURNAL_INSTALL_ADDR (BOOT_UCB_ADDR + MFLASH_PAGE_SIZE)
+#define BOOT_SWAP_JOURNAL_ROLLBACK_ADDR (BOOT_SWAP_JOURNAL_INSTALL_ADDR + BOOT_SWAP_JOURNAL_SIZE)
+
+#define BOOT_SWAP_STEP_NONE            0xFF /* sector not touched yet */
+#define BOOT_SWAP_STEP_SAVED           0xFE /* exec sector saved to the scratch sector */
+#define BOOT_SWAP_STEP_INSTALLED       0xFC /* update sector copied to the exec sector */
+#define BOOT_SWAP_STEP_DONE            0xF8 /* scratch sector copied to the update sector */
+
+/* Execute the image in place from either slot (A/B) instead of installing it to the exec slot,
+ * activation and rollback are a single write of the update control block.
+ * Images have to be built for the slot they are downloaded to, i.e. linked at BOOT_AB_SLOT_B_ADDR
+ * when slot A is active and at BOOT_AB_SLOT_A_ADDR otherwise. Takes precedence over BOOT_SWAP_MODE */
+#ifndef BOOT_AB_MODE
+#define BOOT_AB_MODE 0
+#endif
+
+#define BOOT_FLAGS_AB                  0xFFFFFFFC
+
+#define BOOT_AB_SLOT_A_ADDR            (BOOT_EXEC_IMAGE_ADDR)
+#define BOOT_AB_SLOT_B_ADDR            (BOOT_EXEC_IMAGE_ADDR + BOOT_SWAP_SLOT_SIZE)
+
+/* Jump straight to the application when the update control block has nothing to be done,
+ * without printing the banner or parsing the whole update control block */
+#ifndef BOOT_FAST_BOOT
+#define BOOT_FAST_BOOT 1
+#endif
+
+/* Check the CRC32 of the image after it is installed or rolled back, the reference values
+ * are computed by CRC32_Update() when the update is requested and kept in the update control block */
+#ifndef BOOT_IMAGE_CRC_CHECK
+#define BOOT_IMAGE_CRC_CHECK 1
+#endif
+
+#define BOOT_IMAGE_CRC_NONE            0xFFFFFFFF /* no reference value, the check is skipped */
+
+/* Checksum of an update control block written before it had one, which ends before the checksum
+ * and reads it as erased FLASH. Such a block is only checked by its signature and version */
+#define BOOT_UCB_CRC_NONE              0xFFFFFFFF
+
+/* Compressed update image, installed by decompressing it to the exec slot instead of copying it.
+ * The header is followed by the image compressed as a single LZ4 block with match offsets of up to 64 KB,
+ * only a sector of the output is buffered in RAM and earlier output is read back from the exec slot.
+ * A compressed image is never swapped, the exec image is backed up for rollback as in copy mode.
+ * In BOOT_AB_MODE the update slot is executed in place, the application decompresses the image with
+ * boot_lz4_decompress() before requesting the update */
+#define BOOT_FLAGS_LZ4                 0xFFFFFFF8
+#define BOOT_LZ4_MARKER                0x42345A4C /* "LZ4B" */
+#define BOOT_LZ4_MIN_MATCH             4
+
+struct boot_lz4_header
+{
+    uint32_t marker;
+    uint32_t data_length;  /* length of the compressed data following the header */
+    uint32_t image_length; /* length of the decompressed image */
+    uint32_t image_crc;    /* CRC32 of the decompressed image up to its checksum, as computed by CRC32_Update() */
+};
+
 /* Update control block structure */
 struct boot_ucb
 {
   uint32_t signature;
   uint32_t version;
-  uint32_t flags; /* reserved, not used in the current version */
+  uint32_t flags; /* BOOT_FLAGS_COPY, BOOT_FLAGS_SWAP, BOOT_FLAGS_AB or BOOT_FLAGS_LZ4 */
   uint32_t state;
   void *update_img;
-  uint32_t update_img_size; /* reserved, not used in the current version */
+  uint32_t update_img_size; /* length swapped in BOOT_FLAGS_SWAP mode, unused otherwise */
   void *rollback_img;
-  uint32_t rollback_img_size; /* reserved, not used in the current version */
+  uint32_t rollback_img_size; /* length of the backup recorded by boot_backup_record(), unused otherwise */
+  void *active_img; /* slot executed in BOOT_FLAGS_AB mode, unused otherwise */
+  uint32_t update_img_crc; /* CRC32 of the update image or BOOT_IMAGE_CRC_NONE */
+  uint32_t rollback_img_crc; /* CRC32 of the image active before the update or BOOT_IMAGE_CRC_NONE */
+  uint32_t ucb_crc; /* CRC32 of the fields above, set by boot_ucb_write() */
 };
 
 
@@ -100,14 +189,165 @@ struct boot_image_header
 };
 
 
+/* Boot timing record, written by the bootloader and the application using the DWT cycle counter.
+ * The record sits at the end of the unused SRAM bank which is neither initialized nor used by either of them,
+ * so it survives the jump to the application at the same address in both builds */
+#ifndef BOOT_TIMING_ADDR
+#define BOOT_TIMING_ADDR (0x20027FC0)
+#endif
+
+#define BOOT_TIMING_MARKER             0x544D4954 /* "TIMT" */
+#define BOOT_TIMING_UNSET              0xFFFFFFFF
+
+enum boot_phase
+{
+    BOOT_PHASE_BOOTLOADER = 0, /* bootloader entered, the cycle counter starts here */
+    BOOT_PHASE_APP_EXEC,       /* bootloader jumps to the application */
+    BOOT_PHASE_MAIN,           /* application main() entered */
+    BOOT_PHASE_NETWORK_UP,     /* first network up event */
+    BOOT_PHASE_TLS_CONNECTED,  /* first TLS connection to the broker */
+    BOOT_PHASE_MQTT_CONNECTED, /* first CONNACK from the broker */
+    BOOT_PHASE_COUNT
+};
+
+/* Cycle counts are taken at the core clock of each phase and wrap after 2^32 cycles, i.e. about 23 s at 180 MHz */
+struct boot_timing
+{
+    uint32_t marker;
+    uint32_t cycles[BOOT_PHASE_COUNT]; /* cycle count at each phase or BOOT_TIMING_UNSET */
+};
+
+#define BOOT_TIMING ((volatile struct boot_timing *)BOOT_TIMING_ADDR)
+
+
+/* Flash services and LZ4 decoder of the bootloader, exported through a versioned table at a fixed address so
+ * that the application calls them instead of linking its own flash driver, see MFLASH_BOOT_API in mflash_drv.h.
+ * Set BOOT_API_EXPORT to 1 in the bootloader build, whose linker script places:
+ *  - the .boot_api section holding boot_api_table at BOOT_API_ADDR,
+ *  - the code, data and bss of mflash_drv.o and fsl_spifi.o, and the bss of fsl_crc32.o, in a .boot_api_ram section linked at
+ *    BOOT_API_RAM_ADDR and loaded in the bootloader FLASH, with the __boot_api_ram_load__,
+ *    __boot_api_ram_start__, __boot_api_ram_data_end__ and __boot_api_ram_end__ symbols
+ *    (start of the load image, start of the section, end of the initialized part, end of the bss).
+ * The driver has to run from RAM while the FLASH is busy. The application does not clear or use
+ * BOOT_API_RAM_ADDR and calls init(), which loads the driver there again and initializes the FLASH */
+#ifndef BOOT_API_EXPORT
+#define BOOT_API_EXPORT 0
+#endif
+
+/* After the boot image header, which ends at BOOT_HEADER_MAX_OFFSET + sizeof(struct boot_image_header) at most */
+#ifndef BOOT_API_ADDR
+#define BOOT_API_ADDR (BOOT_FLASH_BASE + 0x200)
+#endif
+
+/* RAM holding the flash driver of the bootloader, at the end of SRAM3 below the boot timing record */
+#ifndef BOOT_API_RAM_ADDR
+#define BOOT_API_RAM_ADDR (0x20025000)
+#endif
+#define BOOT_API_RAM_SIZE (BOOT_TIMING_ADDR - BOOT_API_RAM_ADDR)
+
+#define BOOT_API_MARKER                0x49504142 /* "BAPI" */
+
+/* The major version changes when entries are changed or removed, the minor version when entries are appended */
+#define BOOT_API_VERSION_MAJOR         1
+#define BOOT_API_VERSION_MINOR         1
+#define BOOT_API_VERSION               ((BOOT_API_VERSION_MAJOR << 16) | BOOT_API_VERSION_MINOR)
+
+struct boot_api
+{
+    uint32_t marker;
+    uint32_t version; /* BOOT_API_VERSION of the bootloader */
+    uint32_t size;    /* size of the table, entries beyond it are not provided */
+    int32_t (*init)(void);
+    int32_t (*flash_write)(void *any_addr, const uint8_t *data, uint32_t data_len);
+    int32_t (*flash_writev)(const mflash_drv_segment_t *segments, uint32_t count);
+    int32_t (*flash_erase)(void *addr, uint32_t len);
+    int32_t (*flash_read)(const void *any_addr, uint8_t *data, uint32_t data_len);
+    bool (*flash_is_busy)(void);
+    int32_t (*ucb_read)(struct boot_ucb *ucbp);
+    int32_t (*ucb_write)(const struct boot_ucb *ucbp);
+    int32_t (*ucb_erase)(void);
+    /* since version 1.1 */
+    int32_t (*lz4_decompress)(void *flash_dst, uint32_t max_length, const void *img, uint8_t *sector);
+};
+
+/* Returns the table exported by the bootloader, or NULL if the bootloader exports none or an incompatible one.
+ * The table holds at least the entries of version 1.0, the entries appended since are checked against its size */
+static inline const struct boot_api *boot_api_get(void)
+{
+    const struct boot_api *api = (const struct boot_api *)BOOT_API_ADDR;
+
+    if ((api->marker != BOOT_API_MARKER) || ((api->version >> 16) != BOOT_API_VERSION_MAJOR) ||
+        (api->size < offsetof(struct boot_api, lz4_decompress)))
+    {
+        return NULL;
+    }
+
+    return api;
+}
+
+
+/* Application module, linked separately from the base image (kernel, network, crypto) and stored in its own
+ * FLASH region, so that it is updated without updating the base image, see app_module.h.
+ * There are two module slots, the module is executed in place from either of them and has to be built for
+ * the slot it is downloaded to, as the images of BOOT_AB_MODE. The slots are above the file system */
+#ifndef BOOT_MODULE_SLOT_A_ADDR
+#define BOOT_MODULE_SLOT_A_ADDR (0x10900000)
+#endif
+
+#ifndef BOOT_MODULE_SLOT_SIZE
+#define BOOT_MODULE_SLOT_SIZE (0x80000)
+#endif
+
+#define BOOT_MODULE_SLOT_B_ADDR (BOOT_MODULE_SLOT_A_ADDR + BOOT_MODULE_SLOT_SIZE)
+
+#define BOOT_MODULE_MARKER             0x4C444F4D /* "MODL" */
+
+/* Header at the start of a module. The data is copied from data_load to data_start..data_end and the bss
+ * cleared up to bss_end before entry is called, all of them in the RAM reserved for the module */
+struct boot_module_header
+{
+    uint32_t marker;
+    uint32_t crc;          /* CRC32 of the module from the field after this one up to length, as computed by CRC32_Update() */
+    uint32_t length;       /* length of the module including this header */
+    uint32_t load_address; /* slot the module is built for */
+    uint32_t api_version;  /* version of the API of the base image the module is built against */
+    uint32_t version;      /* version of the module, informational */
+    uint32_t entry;        /* address of the entry function, void entry(const void *api) */
+    uint32_t data_load;
+    uint32_t data_start;
+    uint32_t data_end;
+    uint32_t bss_end;
+};
+
+/* Returns the header of the module at given address if it is complete, built for given slot and fits in it,
+ * NULL otherwise. The module may be stored elsewhere than the slot it is built for, e.g. while it is staged */
+extern const struct boot_module_header *boot_module_validate(const void *img, uint32_t load_address);
+
 extern int32_t boot_ucb_read(struct boot_ucb *ucbp);
 extern int32_t boot_ucb_write(const struct boot_ucb *ucbp);
 extern int32_t boot_ucb_erase(void);
 
 extern int32_t boot_update_request(void *update_img, void *backup_storage);
+extern bool boot_backup_ready(const void *backup_storage);
+extern int32_t boot_backup_record(void *backup_storage);
+extern uint32_t boot_image_length(const void *img);
+extern uint32_t boot_lz4_length(const void *img);
+/* Decompresses the compressed image at img to flash_dst, writing at most max_length bytes. Output is buffered in the
+ * MFLASH_SECTOR_SIZE bytes of sector and programmed a sector at a time, earlier output is read back from flash_dst.
+ * Returns the length of the image, -1 if the image is invalid or cannot be written */
+extern int32_t boot_lz4_decompress(void *flash_dst, uint32_t max_length, const void *img, uint8_t *sector);
 extern int32_t boot_overwrite_rollback(void);
 extern void boot_cpureset(void);
 extern void boot_wdtdis(void);
+extern void boot_wdten(void);
+extern void boot_wdtinit(uint32_t timeout_ms);
+extern void boot_wdtfeed(void);
+
+extern void boot_timing_start(void);
+extern void boot_timing_mark(enum boot_phase phase);
+
+extern void *boot_active_image(void);
+extern void *boot_update_slot(void);
 
 extern void boot_app_exec(const void *addr);
 extern int32_t boot_run(void);
@@ -26,8 +26,6 @@
 #endif
 
 #if (defined(SERIAL_MANAGER_NON_BLOCKING_MODE) && (SERIAL_MANAGER_NON_BLOCKING_MODE > 0U))
-#define SERIAL_PORT_UART_RECEIVE_DATA_LENGTH 1U
-
 typedef struct _serial_uart_send_state
 {
     serial_manager_callback_t callback;
@@ -82,10 +80,18 @@ static void Serial_UartCallback(hal_uart_handle_t handle, hal_uart_status_t stat
 
     if ((hal_uart_status_t)kStatus_HAL_UartRxIdle == status)
     {
-        if ((NULL != serialUartHandle->rx.callback))
+        msg.buffer = &serialUartHandle->rx.readBuffer[0];
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+        if ((hal_uart_status_t)kStatus_HAL_UartSuccess !=
+            HAL_UartGetReceiveCount(((hal_uart_handle_t)&serialUartHandle->usartHandleBuffer[0]), &msg.length))
+        {
+            msg.length = 0U;
+        }
+#else
+        msg.length = sizeof(serialUartHandle->rx.readBuffer);
+#endif
+        if ((NULL != serialUartHandle->rx.callback) && (0U != msg.length))
         {
-            msg.buffer = &serialUartHandle->rx.readBuffer[0];
-            msg.length = sizeof(serialUartHandle->rx.readBuffer);
             serialUartHandle->rx.callback(serialUartHandle->rx.callbackParam, &msg, kStatus_SerialManager_Success);
         }
 #if (defined(HAL_UART_TRANSFER_MODE) && (HAL_UART_TRANSFER_MODE > 0U))
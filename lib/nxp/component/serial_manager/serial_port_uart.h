@@ -19,9 +19,18 @@
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+/*! @brief Bytes read by each receive of the port, a burst ended by the idle line with RX DMA */
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+#ifndef SERIAL_PORT_UART_RECEIVE_DATA_LENGTH
+#define SERIAL_PORT_UART_RECEIVE_DATA_LENGTH (64U)
+#endif
+#else
+#define SERIAL_PORT_UART_RECEIVE_DATA_LENGTH (1U)
+#endif
+
 /*! @brief serial port uart handle size*/
 #if (defined(SERIAL_MANAGER_NON_BLOCKING_MODE) && (SERIAL_MANAGER_NON_BLOCKING_MODE > 0U))
-#define SERIAL_PORT_UART_HANDLE_SIZE (76U + HAL_UART_HANDLE_SIZE)
+#define SERIAL_PORT_UART_HANDLE_SIZE (75U + SERIAL_PORT_UART_RECEIVE_DATA_LENGTH + HAL_UART_HANDLE_SIZE)
 #else
 #define SERIAL_PORT_UART_HANDLE_SIZE (HAL_UART_HANDLE_SIZE)
 #endif
@@ -93,6 +93,33 @@
 #define HAL_UART_TRANSFER_MODE (0U)
 #endif
 
+/*! @brief Whether send the non-blocking data with DMA0, one transfer per buffer instead of one interrupt per FIFO
+ * refill. Used by the functional API in non-blocking mode. (0 - disable, 1 - enable) */
+#ifndef HAL_UART_DMA_ENABLE
+#define HAL_UART_DMA_ENABLE (0U)
+#endif
+
+/*! @brief Whether receive the non-blocking data with DMA0, straight into the buffer of HAL_UartReceiveNonBlocking. The
+ * receive also ends once the line is idle for HAL_UART_DMA_RX_IDLE_US with the bytes received so far, reported by
+ * HAL_UartGetReceiveCount, so a burst costs an interrupt per buffer instead of one per byte. Used by the functional
+ * API in non-blocking mode, on one instance. (0 - disable, 1 - enable) */
+#ifndef HAL_UART_DMA_RX_ENABLE
+#define HAL_UART_DMA_RX_ENABLE (0U)
+#endif
+
+/*! @brief Idle time of the RX line ending a DMA receive, in microseconds. */
+#ifndef HAL_UART_DMA_RX_IDLE_US
+#define HAL_UART_DMA_RX_IDLE_US (1000U)
+#endif
+
+/*! @brief Set when the adapter takes the DMA0 interrupt, other users of DMA0 chain DMA0_DriverIRQHandler then. */
+#if ((defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U)) || \
+     (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U)))
+#define HAL_UART_DMA_USED (1U)
+#else
+#define HAL_UART_DMA_USED (0U)
+#endif
+
 /*! @brief The handle of uart adapter. */
 typedef void *hal_uart_handle_t;
 
@@ -444,7 +471,9 @@ hal_uart_status_t HAL_UartSendNonBlocking(hal_uart_handle_t handle, uint8_t *dat
 /*!
  * @brief Gets the number of bytes that have been received.
  *
- * This function gets the number of bytes that have been received.
+ * This function gets the number of bytes that have been received. With HAL_UART_DMA_RX_ENABLE, it gets the number of
+ * bytes of the last receive when none is pending, which is how the kStatus_HAL_UartRxIdle callback of a receive ended
+ * by an idle line learns its length.
  *
  * @param handle UART handle pointer.
  * @param count Receive bytes count.
@@ -22,6 +22,12 @@
 #endif
 #endif
 
+#if (defined(HAL_UART_DMA_USED) && (HAL_UART_DMA_USED > 0U)) && \
+    (!(defined(UART_ADAPTER_NON_BLOCKING_MODE) && (UART_ADAPTER_NON_BLOCKING_MODE > 0U)) || \
+     (defined(HAL_UART_TRANSFER_MODE) && (HAL_UART_TRANSFER_MODE > 0U)))
+#error "HAL_UART_DMA_ENABLE and HAL_UART_DMA_RX_ENABLE need the non-blocking mode and the functional API"
+#endif
+
 #if (defined(UART_ADAPTER_NON_BLOCKING_MODE) && (UART_ADAPTER_NON_BLOCKING_MODE > 0U))
 /*! @brief uart RX state structure. */
 typedef struct _hal_uart_receive_state
@@ -39,6 +45,31 @@ typedef struct _hal_uart_send_state
     volatile uint32_t bufferSofar;
 } hal_uart_send_state_t;
 #endif
+
+#if (defined(HAL_UART_DMA_USED) && (HAL_UART_DMA_USED > 0U))
+/*! @brief Longest DMA transfer, longer buffers are sent in several transfers. */
+#define HAL_UART_DMA_MAX_COUNT (1024U)
+
+/*! @brief DMA channel descriptor, layout defined by the DMA controller. */
+typedef struct _hal_uart_dma_descriptor
+{
+    uint32_t xfercfg;
+    const void *srcEndAddr;
+    void *dstEndAddr;
+    void *linkToNextDesc;
+} hal_uart_dma_descriptor_t;
+#endif
+
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+/*! @brief CTIMER timing the idle RX line, one of CTIMER0 to CTIMER2 as they count the bus clock. */
+#ifndef HAL_UART_DMA_RX_IDLE_TIMER
+#define HAL_UART_DMA_RX_IDLE_TIMER             CTIMER0
+#define HAL_UART_DMA_RX_IDLE_TIMER_CLOCK       kCLOCK_Ct32b0
+#define HAL_UART_DMA_RX_IDLE_TIMER_RESET       kCT32B0_RST_SHIFT_RSTn
+#define HAL_UART_DMA_RX_IDLE_TIMER_IRQ         CTIMER0_IRQn
+#define HAL_UART_DMA_RX_IDLE_TIMER_IRQ_HANDLER CTIMER0_DriverIRQHandler
+#endif
+#endif
 /*! @brief uart state structure. */
 typedef struct _hal_uart_state
 {
@@ -70,6 +101,32 @@ static USART_Type *const s_UsartAdapterBase[] = USART_BASE_PTRS;
 static const IRQn_Type s_UsartIRQ[] = USART_IRQS;
 #endif
 
+#if (defined(HAL_UART_DMA_USED) && (HAL_UART_DMA_USED > 0U))
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+/* DMA channel wired to the TX request of each FLEXCOMM USART. */
+static const uint8_t s_UsartDmaTxChannel[] = {1U, 3U, 5U, 7U, 9U, 11U, 13U, 15U, 21U, 23U};
+#endif
+
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+/* DMA channel wired to the RX request of each FLEXCOMM USART. */
+static const uint8_t s_UsartDmaRxChannel[] = {0U, 2U, 4U, 6U, 8U, 10U, 12U, 14U, 20U, 22U};
+
+/* The instance receiving with DMA, whose idle line the timer watches. */
+static hal_uart_state_t *s_UsartDmaRxHandle;
+
+/* Bytes received at the previous tick of the idle timer. */
+static uint32_t s_UsartDmaRxLastCount;
+
+static void HAL_UartDmaRxWatchIdle(hal_uart_state_t *uartHandle);
+#endif
+
+/* Handle using DMA on each instance. */
+static hal_uart_state_t *s_UsartDmaHandle[ARRAY_SIZE(s_UsartAdapterBase)];
+
+/* Channel descriptor table of DMA0, not used if another driver already set one. */
+SDK_ALIGN(static hal_uart_dma_descriptor_t s_UsartDmaDescriptorTable[FSL_FEATURE_DMA_NUMBER_OF_CHANNELS], 512);
+#endif
+
 #endif
 
 /*******************************************************************************
@@ -166,6 +223,14 @@ static void HAL_UartInterruptHandle(USART_Type *base, void *handle)
 
     status = USART_GetStatusFlags(s_UsartAdapterBase[instance]);
 
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+    /* Start bit on an idle line, the data goes to the RX channel. */
+    if (0U != (s_UsartAdapterBase[instance]->INTSTAT & USART_INTSTAT_START_MASK))
+    {
+        HAL_UartDmaRxWatchIdle(uartHandle);
+    }
+#endif
+
     /* Receive data register full */
     if ((USART_FIFOSTAT_RXNOTEMPTY_MASK & status) &&
         (USART_GetEnabledInterrupts(s_UsartAdapterBase[instance]) & USART_FIFOINTENSET_RXLVL_MASK))
@@ -211,6 +276,277 @@ static void HAL_UartInterruptHandle(USART_Type *base, void *handle)
 }
 #endif
 
+#if (defined(HAL_UART_DMA_USED) && (HAL_UART_DMA_USED > 0U))
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+/* Queue the next part of the TX buffer, at most HAL_UART_DMA_MAX_COUNT bytes, on the TX channel. */
+static void HAL_UartDmaSend(hal_uart_state_t *uartHandle)
+{
+    hal_uart_dma_descriptor_t *table = (hal_uart_dma_descriptor_t *)DMA0->SRAMBASE;
+    uint32_t channel                 = s_UsartDmaTxChannel[uartHandle->instance];
+    uint32_t count                   = uartHandle->tx.bufferLength - uartHandle->tx.bufferSofar;
+
+    if (count > HAL_UART_DMA_MAX_COUNT)
+    {
+        count = HAL_UART_DMA_MAX_COUNT;
+    }
+
+    table[channel].srcEndAddr     = (const void *)&uartHandle->tx.buffer[uartHandle->tx.bufferSofar + count - 1U];
+    table[channel].dstEndAddr     = (void *)&s_UsartAdapterBase[uartHandle->instance]->FIFOWR;
+    table[channel].linkToNextDesc = NULL;
+    uartHandle->tx.bufferSofar += count;
+
+    DMA0->CHANNEL[channel].XFERCFG = DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_SWTRIG_MASK |
+                                     DMA_CHANNEL_XFERCFG_CLRTRIG_MASK | DMA_CHANNEL_XFERCFG_SETINTA_MASK |
+                                     DMA_CHANNEL_XFERCFG_WIDTH(0U) | DMA_CHANNEL_XFERCFG_SRCINC(1U) |
+                                     DMA_CHANNEL_XFERCFG_DSTINC(0U) | DMA_CHANNEL_XFERCFG_XFERCOUNT(count - 1U);
+}
+#endif
+
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+/* Bytes written by the RX channel into the pending receive buffer. */
+static uint32_t HAL_UartDmaRxCount(hal_uart_state_t *uartHandle)
+{
+    uint32_t count = (DMA0->CHANNEL[s_UsartDmaRxChannel[uartHandle->instance]].XFERCFG &
+                      DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK) >>
+                     DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT;
+
+    /* XFERCOUNT is the number of transfers left minus 1, all ones once the transfer is complete. */
+    if ((DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK >> DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT) == count)
+    {
+        return uartHandle->rx.bufferLength;
+    }
+
+    return uartHandle->rx.bufferLength - 1U - count;
+}
+
+/* Queue the RX buffer on the RX channel, it fills at the pace of the RX requests. */
+static void HAL_UartDmaReceive(hal_uart_state_t *uartHandle)
+{
+    hal_uart_dma_descriptor_t *table = (hal_uart_dma_descriptor_t *)DMA0->SRAMBASE;
+    uint32_t channel                 = s_UsartDmaRxChannel[uartHandle->instance];
+
+    table[channel].srcEndAddr     = (const void *)&s_UsartAdapterBase[uartHandle->instance]->FIFORD;
+    table[channel].dstEndAddr     = (void *)&uartHandle->rx.buffer[uartHandle->rx.bufferLength - 1U];
+    table[channel].linkToNextDesc = NULL;
+
+    DMA0->CHANNEL[channel].XFERCFG = DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_SWTRIG_MASK |
+                                     DMA_CHANNEL_XFERCFG_CLRTRIG_MASK | DMA_CHANNEL_XFERCFG_SETINTA_MASK |
+                                     DMA_CHANNEL_XFERCFG_WIDTH(0U) | DMA_CHANNEL_XFERCFG_SRCINC(0U) |
+                                     DMA_CHANNEL_XFERCFG_DSTINC(1U) |
+                                     DMA_CHANNEL_XFERCFG_XFERCOUNT(uartHandle->rx.bufferLength - 1U);
+}
+
+/* Stop the RX channel and return the bytes it received, the ones left in the FIFO wait for the next receive. */
+static uint32_t HAL_UartDmaStopReceive(hal_uart_state_t *uartHandle)
+{
+    uint32_t channelMask = 1U << s_UsartDmaRxChannel[uartHandle->instance];
+    uint32_t count;
+
+    DMA0->COMMON[0].ENABLECLR = channelMask;
+    while (0U != (DMA0->COMMON[0].BUSY & channelMask))
+    {
+    }
+    count                     = HAL_UartDmaRxCount(uartHandle);
+    DMA0->COMMON[0].ABORT     = channelMask;
+    DMA0->COMMON[0].INTA      = channelMask;
+    DMA0->COMMON[0].ENABLESET = channelMask;
+
+    return count;
+}
+
+/* End the receive with the bytes received and report it, the callback queues the next one. */
+static void HAL_UartDmaReceiveDone(hal_uart_state_t *uartHandle, uint32_t count)
+{
+    uartHandle->rx.bufferSofar = count;
+    uartHandle->rx.buffer      = NULL;
+    if (uartHandle->callback)
+    {
+        uartHandle->callback(uartHandle, kStatus_HAL_UartRxIdle, uartHandle->callbackParam);
+    }
+}
+
+/* Watch for the next start bit, the idle timer is stopped. A frame already started is caught by the timer instead. */
+static void HAL_UartDmaRxArmStart(hal_uart_state_t *uartHandle)
+{
+    USART_Type *base = s_UsartAdapterBase[uartHandle->instance];
+
+    base->STAT     = USART_STAT_START_MASK;
+    base->INTENSET = USART_INTENSET_STARTEN_MASK;
+    if ((0U != (base->STAT & USART_STAT_RXIDLE_MASK)) && (0U == HAL_UartDmaRxCount(uartHandle)))
+    {
+        HAL_UART_DMA_RX_IDLE_TIMER->TCR = 0U;
+    }
+}
+
+/* Tick every HAL_UART_DMA_RX_IDLE_US from the start bit of a burst until the line is idle. */
+static void HAL_UartDmaRxStartIdleTimer(hal_uart_state_t *uartHandle)
+{
+    uint32_t prescaler = CLOCK_GetFreq(kCLOCK_BusClk) / 1000000U;
+
+    s_UsartDmaRxLastCount = (NULL != uartHandle->rx.buffer) ? HAL_UartDmaRxCount(uartHandle) : 0U;
+
+    /* Set again at each burst for the current clock_scaling level. */
+    HAL_UART_DMA_RX_IDLE_TIMER->TCR   = CTIMER_TCR_CRST_MASK;
+    HAL_UART_DMA_RX_IDLE_TIMER->PR    = (prescaler > 0U) ? (prescaler - 1U) : 0U;
+    HAL_UART_DMA_RX_IDLE_TIMER->MR[0] = HAL_UART_DMA_RX_IDLE_US - 1U;
+    HAL_UART_DMA_RX_IDLE_TIMER->MCR   = CTIMER_MCR_MR0I_MASK | CTIMER_MCR_MR0R_MASK;
+    HAL_UART_DMA_RX_IDLE_TIMER->TCR   = CTIMER_TCR_CEN_MASK;
+}
+
+/* Time the line from a start bit after an idle line, or from a new receive: one interrupt per burst. */
+static void HAL_UartDmaRxWatchIdle(hal_uart_state_t *uartHandle)
+{
+    USART_Type *base = s_UsartAdapterBase[uartHandle->instance];
+
+    base->INTENCLR = USART_INTENCLR_STARTCLR_MASK;
+    base->STAT     = USART_STAT_START_MASK;
+    HAL_UartDmaRxStartIdleTimer(uartHandle);
+}
+
+void HAL_UART_DMA_RX_IDLE_TIMER_IRQ_HANDLER(void);
+void HAL_UART_DMA_RX_IDLE_TIMER_IRQ_HANDLER(void)
+{
+    hal_uart_state_t *uartHandle = s_UsartDmaRxHandle;
+    uint32_t count;
+
+    HAL_UART_DMA_RX_IDLE_TIMER->IR = CTIMER_IR_MR0INT_MASK;
+
+    if ((NULL == uartHandle) || (NULL == uartHandle->rx.buffer))
+    {
+        HAL_UART_DMA_RX_IDLE_TIMER->TCR = 0U;
+        SDK_ISR_EXIT_BARRIER;
+        return;
+    }
+
+    count = HAL_UartDmaRxCount(uartHandle);
+    if (count != s_UsartDmaRxLastCount)
+    {
+        /* Still receiving. */
+        s_UsartDmaRxLastCount = count;
+    }
+    else if (0U != count)
+    {
+        /* Idle for a whole period with data: the receive queued by the callback restarts the timer. */
+        HAL_UartDmaReceiveDone(uartHandle, HAL_UartDmaStopReceive(uartHandle));
+        if (NULL == uartHandle->rx.buffer)
+        {
+            HAL_UART_DMA_RX_IDLE_TIMER->TCR = 0U;
+        }
+    }
+    else
+    {
+        HAL_UartDmaRxArmStart(uartHandle);
+    }
+    SDK_ISR_EXIT_BARRIER;
+}
+
+/* Set up the idle timer and the RX channel of the instance. */
+static void HAL_UartDmaRxInit(hal_uart_state_t *uartHandle)
+{
+    uint32_t channel = s_UsartDmaRxChannel[uartHandle->instance];
+
+    assert((NULL == s_UsartDmaRxHandle) || (uartHandle == s_UsartDmaRxHandle));
+    s_UsartDmaRxHandle = uartHandle;
+
+    CLOCK_EnableClock(HAL_UART_DMA_RX_IDLE_TIMER_CLOCK);
+    RESET_PeripheralReset(HAL_UART_DMA_RX_IDLE_TIMER_RESET);
+    NVIC_SetPriority(HAL_UART_DMA_RX_IDLE_TIMER_IRQ, HAL_UART_ISR_PRIORITY);
+    EnableIRQ(HAL_UART_DMA_RX_IDLE_TIMER_IRQ);
+
+    DMA0->CHANNEL[channel].CFG = DMA_CHANNEL_CFG_PERIPHREQEN(1U);
+    DMA0->COMMON[0].ENABLESET  = 1U << channel;
+    DMA0->COMMON[0].INTENSET   = 1U << channel;
+    s_UsartAdapterBase[uartHandle->instance]->FIFOCFG |= USART_FIFOCFG_DMARX_MASK;
+}
+#endif
+
+/* Set up the DMA channels of the instance, DMA0 and its descriptor table are shared with the other drivers. */
+static void HAL_UartDmaInit(hal_uart_state_t *uartHandle)
+{
+    CLOCK_EnableClock(kCLOCK_Dma);
+    if (0U == DMA0->SRAMBASE)
+    {
+        DMA0->SRAMBASE = (uint32_t)s_UsartDmaDescriptorTable;
+    }
+    DMA0->CTRL = DMA_CTRL_ENABLE_MASK;
+
+    s_UsartDmaHandle[uartHandle->instance] = uartHandle;
+
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+    DMA0->CHANNEL[s_UsartDmaTxChannel[uartHandle->instance]].CFG = DMA_CHANNEL_CFG_PERIPHREQEN(1U);
+    DMA0->COMMON[0].ENABLESET = 1U << s_UsartDmaTxChannel[uartHandle->instance];
+    DMA0->COMMON[0].INTENSET  = 1U << s_UsartDmaTxChannel[uartHandle->instance];
+    s_UsartAdapterBase[uartHandle->instance]->FIFOCFG |= USART_FIFOCFG_DMATX_MASK;
+#endif
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+    HAL_UartDmaRxInit(uartHandle);
+#endif
+
+    NVIC_SetPriority(DMA0_IRQn, HAL_UART_ISR_PRIORITY);
+    EnableIRQ(DMA0_IRQn);
+}
+
+void DMA0_DriverIRQHandler(void);
+void DMA0_DriverIRQHandler(void)
+{
+    hal_uart_state_t *uartHandle;
+    uint32_t channelMask;
+    uint32_t instance;
+
+    for (instance = 0U; instance < ARRAY_SIZE(s_UsartDmaHandle); instance++)
+    {
+        uartHandle = s_UsartDmaHandle[instance];
+        if (NULL == uartHandle)
+        {
+            continue;
+        }
+
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+        channelMask = 1U << s_UsartDmaRxChannel[instance];
+        if (0U != (DMA0->COMMON[0].INTA & channelMask))
+        {
+            /* The buffer is full, the idle timer goes on for the next one. */
+            DMA0->COMMON[0].INTA = channelMask;
+            if (NULL != uartHandle->rx.buffer)
+            {
+                HAL_UartDmaReceiveDone(uartHandle, uartHandle->rx.bufferLength);
+            }
+        }
+#endif
+
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+        channelMask = 1U << s_UsartDmaTxChannel[instance];
+
+        if (0U == (DMA0->COMMON[0].INTA & channelMask))
+        {
+            continue;
+        }
+
+        DMA0->COMMON[0].INTA = channelMask;
+
+        if (NULL == uartHandle->tx.buffer)
+        {
+            continue;
+        }
+
+        if (uartHandle->tx.bufferSofar < uartHandle->tx.bufferLength)
+        {
+            HAL_UartDmaSend(uartHandle);
+        }
+        else
+        {
+            uartHandle->tx.buffer = NULL;
+            if (uartHandle->callback)
+            {
+                uartHandle->callback(uartHandle, kStatus_HAL_UartTxIdle, uartHandle->callbackParam);
+            }
+        }
+#endif
+    }
+    SDK_ISR_EXIT_BARRIER;
+}
+#endif
+
 #endif
 
 hal_uart_status_t HAL_UartInit(hal_uart_handle_t handle, hal_uart_config_t *config)
@@ -274,6 +610,9 @@ hal_uart_status_t HAL_UartInit(hal_uart_handle_t handle, hal_uart_config_t *conf
                            handle);
     NVIC_SetPriority((IRQn_Type)s_UsartIRQ[config->instance], HAL_UART_ISR_PRIORITY);
     EnableIRQ(s_UsartIRQ[config->instance]);
+#if (defined(HAL_UART_DMA_USED) && (HAL_UART_DMA_USED > 0U))
+    HAL_UartDmaInit(uartHandle);
+#endif
 #endif
 
 #endif
@@ -289,6 +628,20 @@ hal_uart_status_t HAL_UartDeinit(hal_uart_handle_t handle)
 
     uartHandle = (hal_uart_state_t *)handle;
 
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+    (void)HAL_UartAbortSend(handle);
+    DMA0->COMMON[0].INTENCLR = 1U << s_UsartDmaTxChannel[uartHandle->instance];
+#endif
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+    (void)HAL_UartAbortReceive(handle);
+    DMA0->COMMON[0].INTENCLR = 1U << s_UsartDmaRxChannel[uartHandle->instance];
+    DisableIRQ(HAL_UART_DMA_RX_IDLE_TIMER_IRQ);
+    s_UsartDmaRxHandle = NULL;
+#endif
+#if (defined(HAL_UART_DMA_USED) && (HAL_UART_DMA_USED > 0U))
+    s_UsartDmaHandle[uartHandle->instance] = NULL;
+#endif
+
     USART_Deinit(s_UsartAdapterBase[uartHandle->instance]);
 
     return kStatus_HAL_UartSuccess;
@@ -499,7 +852,14 @@ hal_uart_status_t HAL_UartReceiveNonBlocking(hal_uart_handle_t handle, uint8_t *
     uartHandle->rx.bufferLength = length;
     uartHandle->rx.bufferSofar  = 0;
     uartHandle->rx.buffer       = data;
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+    assert(length <= HAL_UART_DMA_MAX_COUNT);
+    HAL_UartDmaReceive(uartHandle);
+    /* Catches the bytes left in the FIFO by the previous receive, then waits for a start bit. */
+    HAL_UartDmaRxWatchIdle(uartHandle);
+#else
     USART_EnableInterrupts(s_UsartAdapterBase[uartHandle->instance], USART_FIFOINTENSET_RXLVL_MASK);
+#endif
     return kStatus_HAL_UartSuccess;
 }
 
@@ -520,7 +880,11 @@ hal_uart_status_t HAL_UartSendNonBlocking(hal_uart_handle_t handle, uint8_t *dat
     uartHandle->tx.bufferLength = length;
     uartHandle->tx.bufferSofar  = 0;
     uartHandle->tx.buffer       = (volatile uint8_t *)data;
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+    HAL_UartDmaSend(uartHandle);
+#else
     USART_EnableInterrupts(s_UsartAdapterBase[uartHandle->instance], USART_FIFOINTENSET_TXLVL_MASK);
+#endif
     return kStatus_HAL_UartSuccess;
 }
 
@@ -535,10 +899,20 @@ hal_uart_status_t HAL_UartGetReceiveCount(hal_uart_handle_t handle, uint32_t *re
 
     if (uartHandle->rx.buffer)
     {
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+        *reCount = HAL_UartDmaRxCount(uartHandle);
+#else
         *reCount = uartHandle->rx.bufferSofar;
+#endif
         return kStatus_HAL_UartSuccess;
     }
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+    /* Length of the last receive, ended by the idle line or a full buffer. */
+    *reCount = uartHandle->rx.bufferSofar;
+    return kStatus_HAL_UartSuccess;
+#else
     return kStatus_HAL_UartError;
+#endif
 }
 
 hal_uart_status_t HAL_UartGetSendCount(hal_uart_handle_t handle, uint32_t *seCount)
@@ -568,8 +942,14 @@ hal_uart_status_t HAL_UartAbortReceive(hal_uart_handle_t handle)
 
     if (uartHandle->rx.buffer)
     {
+#if (defined(HAL_UART_DMA_RX_ENABLE) && (HAL_UART_DMA_RX_ENABLE > 0U))
+        HAL_UART_DMA_RX_IDLE_TIMER->TCR                    = 0U;
+        s_UsartAdapterBase[uartHandle->instance]->INTENCLR = USART_INTENCLR_STARTCLR_MASK;
+        uartHandle->rx.bufferSofar                         = HAL_UartDmaStopReceive(uartHandle);
+#else
         USART_DisableInterrupts(s_UsartAdapterBase[uartHandle->instance],
                                 USART_FIFOINTENCLR_RXLVL_MASK | USART_FIFOINTENCLR_RXERR_MASK);
+#endif
         uartHandle->rx.buffer = NULL;
     }
 
@@ -586,7 +966,19 @@ hal_uart_status_t HAL_UartAbortSend(hal_uart_handle_t handle)
 
     if (uartHandle->tx.buffer)
     {
+#if (defined(HAL_UART_DMA_ENABLE) && (HAL_UART_DMA_ENABLE > 0U))
+        uint32_t channelMask = 1U << s_UsartDmaTxChannel[uartHandle->instance];
+
+        DMA0->COMMON[0].ENABLECLR = channelMask;
+        while (0U != (DMA0->COMMON[0].BUSY & channelMask))
+        {
+        }
+        DMA0->COMMON[0].ABORT     = channelMask;
+        DMA0->COMMON[0].INTA      = channelMask;
+        DMA0->COMMON[0].ENABLESET = channelMask;
+#else
         USART_DisableInterrupts(s_UsartAdapterBase[uartHandle->instance], USART_FIFOINTENCLR_TXLVL_MASK);
+#endif
         uartHandle->tx.buffer = NULL;
     }
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015-2016, Freescale Semiconductor, Inc.
+ * Copyright 2016-2017 NXP
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#include "fsl_crc.h"
+
+#if defined(FSL_FEATURE_SOC_CRC_COUNT) && FSL_FEATURE_SOC_CRC_COUNT
+
+/* Component ID definition, used by tools. */
+#ifndef FSL_COMPONENT_ID
+#define FSL_COMPONENT_ID "platform.drivers.lpc_crc"
+#endif
+
+/*******************************************************************************
+ * Code
+ ******************************************************************************/
+
+void CRC_Init(CRC_Type *base, const crc_config_t *config)
+{
+    /* enable clock to CRC */
+    CLOCK_EnableClock(kCLOCK_Crc);
+
+    /* configure CRC module and write the seed */
+    base->MODE = CRC_MODE_CRC_POLY(config->polynomial) | CRC_MODE_BIT_RVS_WR(config->reverseIn ? 1U : 0U) |
+                 CRC_MODE_CMPL_WR(config->complementIn ? 1U : 0U) |
+                 CRC_MODE_BIT_RVS_SUM(config->reverseOut ? 1U : 0U) |
+                 CRC_MODE_CMPL_SUM(config->complementOut ? 1U : 0U);
+    base->SEED = config->seed;
+}
+
+void CRC_GetDefaultConfig(crc_config_t *config)
+{
+    static const crc_config_t default_config = {CRC_DRIVER_DEFAULT_POLYNOMIAL, true, false, true, true, 0xFFFFFFFFU};
+
+    *config = default_config;
+}
+
+void CRC_Reset(CRC_Type *base)
+{
+    crc_config_t config;
+
+    CRC_GetDefaultConfig(&config);
+    CRC_Init(base, &config);
+}
+
+void CRC_GetConfig(CRC_Type *base, crc_config_t *config)
+{
+    /* extract CRC mode settings */
+    uint32_t mode = base->MODE;
+
+    config->polynomial    = (crc_polynomial_t)((mode & CRC_MODE_CRC_POLY_MASK) >> CRC_MODE_CRC_POLY_SHIFT);
+    config->reverseIn     = (mode & CRC_MODE_BIT_RVS_WR_MASK) != 0U;
+    config->complementIn  = (mode & CRC_MODE_CMPL_WR_MASK) != 0U;
+    config->reverseOut    = (mode & CRC_MODE_BIT_RVS_SUM_MASK) != 0U;
+    config->complementOut = (mode & CRC_MODE_CMPL_SUM_MASK) != 0U;
+
+    /* reset CRC sum bit reverse and 1's complement setting, so its value can be used as a seed */
+    base->MODE = mode & ~(CRC_MODE_BIT_RVS_SUM_MASK | CRC_MODE_CMPL_SUM_MASK);
+
+    /* now we can obtain intermediate raw CRC sum value */
+    config->seed = base->SUM;
+
+    /* restore original CRC sum bit reverse and 1's complement setting */
+    base->MODE = mode;
+}
+
+void CRC_WriteData(CRC_Type *base, const uint8_t *data, size_t dataSize)
+{
+    const uint32_t *data32;
+
+    /* 8-bit reads and writes till source address is aligned 4 bytes */
+    while ((dataSize) && ((uintptr_t)data & 3U))
+    {
+        *((__O uint8_t *)&(base->WR_DATA)) = *data;
+        data++;
+        dataSize--;
+    }
+
+    /* use 32-bit reads and writes as long as possible */
+    data32 = (const uint32_t *)(uintptr_t)data;
+    CRC_WriteData32(base, data32, dataSize / sizeof(uint32_t));
+    data32 += dataSize / sizeof(uint32_t);
+    dataSize &= 3U;
+
+    /* 8-bit reads and writes till end of data buffer */
+    data = (const uint8_t *)data32;
+    while (dataSize)
+    {
+        *((__O uint8_t *)&(base->WR_DATA)) = *data;
+        data++;
+        dataSize--;
+    }
+}
+
+#endif /* FSL_FEATURE_SOC_CRC_COUNT */
@@ -7,6 +7,7 @@
  */
 
 #include "fsl_enet.h"
+#include "irq_latency.h"
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
@@ -126,6 +127,48 @@ uint32_t ENET_GetInstance(ENET_Type *base);
  */
 static uint32_t ENET_IncreaseIndex(uint32_t index, uint32_t max);
 
+/*!
+ * @brief Checks if the next tx frame shall raise the tx interrupt.
+ *
+ * @param handle The ENET handler pointer.
+ * @param channel The tx DMA channel.
+ * @param descNum The number of descriptors used by the frame.
+ * @return True if the interrupt on completion shall be set for the frame.
+ */
+static bool ENET_TxCoalesceIntEnable(enet_handle_t *handle, uint8_t channel, uint8_t descNum);
+
+/*!
+ * @brief Checks if the rx descriptor being updated shall raise the rx interrupt.
+ *
+ * @param handle The ENET handler pointer.
+ * @param channel The rx DMA channel.
+ * @return True if the interrupt on completion shall be set for the descriptor.
+ */
+static bool ENET_RxCoalesceIntEnable(enet_handle_t *handle, uint8_t channel);
+
+/*!
+ * @brief Checks if a received frame is a broadcast frame over the rate limit.
+ *
+ * @param handle The ENET handler pointer.
+ * @param rxDesc The first rx descriptor of the frame.
+ * @return True if the frame shall be dropped.
+ */
+static bool ENET_RxBroadcastLimited(enet_handle_t *handle, enet_rx_bd_struct_t *rxDesc);
+
+/*!
+ * @brief Checks if a received frame shall be dropped, and counts the reason in the statistics.
+ *
+ * @param handle The ENET handler pointer.
+ * @param channel The rx DMA channel.
+ * @param firstDesc The first rx descriptor of the frame.
+ * @param lastDesc The last rx descriptor of the frame, which holds the frame status.
+ * @return True if the frame shall be dropped.
+ */
+static bool ENET_RxFrameDropped(enet_handle_t *handle,
+                                uint8_t channel,
+                                enet_rx_bd_struct_t *firstDesc,
+                                enet_rx_bd_struct_t *lastDesc);
+
 /*!
  * @brief Set ENET system configuration.
  *  This function reset the ethernet module and set the phy selection.
@@ -274,6 +317,12 @@ static enet_isr_t s_enetIsr = (enet_isr_t)DefaultISR;
 #else
 static enet_isr_t s_enetIsr;
 #endif
+
+/* Defer function of the ENET interrupt, NULL when it is handled in place. */
+static enet_irq_defer_t volatile s_enetIrqDefer = NULL;
+
+/* Filter of the received frames, NULL to admit all of them. */
+static enet_rx_filter_t volatile s_enetRxFilter = NULL;
 /*******************************************************************************
  * Code
  ******************************************************************************/
@@ -288,6 +337,112 @@ static uint32_t ENET_IncreaseIndex(uint32_t index, uint32_t max)
     return index;
 }
 
+static bool ENET_TxCoalesceIntEnable(enet_handle_t *handle, uint8_t channel, uint8_t descNum)
+{
+    enet_tx_bd_ring_t *txBdRing = &handle->txBdRing[channel];
+
+    /* Always interrupt for the frame filling the ring, nothing else would reclaim it. */
+    if ((handle->txCoalesceFrameCount[channel] <= 1U) ||
+        (++handle->txCoalesceFrames[channel] >= handle->txCoalesceFrameCount[channel]) ||
+        ((txBdRing->txDescUsed + descNum) >= txBdRing->txRingLen))
+    {
+        handle->txCoalesceFrames[channel] = 0;
+        return true;
+    }
+
+    return false;
+}
+
+static bool ENET_RxCoalesceIntEnable(enet_handle_t *handle, uint8_t channel)
+{
+    if (!handle->rxintEnable)
+    {
+        return false;
+    }
+
+    if ((handle->rxCoalesceFrameCount[channel] <= 1U) ||
+        (++handle->rxCoalesceFrames[channel] >= handle->rxCoalesceFrameCount[channel]))
+    {
+        handle->rxCoalesceFrames[channel] = 0;
+        return true;
+    }
+
+    return false;
+}
+
+static bool ENET_RxBroadcastLimited(enet_handle_t *handle, enet_rx_bd_struct_t *rxDesc)
+{
+    static const uint8_t broadcastAddr[] = {0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU};
+
+    if ((handle->rxBroadcastLimit == 0U) || (memcmp((void *)rxDesc->buff1Addr, broadcastAddr, sizeof(broadcastAddr))))
+    {
+        return false;
+    }
+
+    if (handle->rxBroadcastCount >= handle->rxBroadcastLimit)
+    {
+        return true;
+    }
+
+    handle->rxBroadcastCount++;
+    return false;
+}
+
+static bool ENET_RxFrameDropped(enet_handle_t *handle,
+                                uint8_t channel,
+                                enet_rx_bd_struct_t *firstDesc,
+                                enet_rx_bd_struct_t *lastDesc)
+{
+    enet_channel_stats_t *stats = &handle->stats.channel[channel];
+    uint32_t control            = lastDesc->control;
+    enet_rx_filter_t filter;
+
+    if (control & ENET_RXDESCRIP_WR_ERRSUM_MASK)
+    {
+        if (control & ENET_RXDESCRIP_WR_CE_MASK)
+        {
+            stats->rxCrcErrors++;
+        }
+        else if (control & ENET_RXDESCRIP_WR_OE_MASK)
+        {
+            stats->rxOverflowErrors++;
+        }
+        else if (control & (ENET_RXDESCRIP_WR_RE_MASK | ENET_RXDESCRIP_WR_DE_MASK))
+        {
+            stats->rxReceiveErrors++;
+        }
+        else
+        {
+            stats->rxLengthErrors++;
+        }
+        return true;
+    }
+
+    /* Drop the frame when the checksum engine reports an IP header or payload error. */
+    if ((control & ENET_RXDESCRIP_WR_RS1V_MASK) && (lastDesc->reserved & ENET_RXDESCRIP_WR_ERR_MASK))
+    {
+        stats->rxChecksumErrors++;
+        return true;
+    }
+
+    /* Drop the broadcast frames over the rate limit. */
+    if (ENET_RxBroadcastLimited(handle, firstDesc))
+    {
+        stats->rxBroadcastDrops++;
+        return true;
+    }
+
+    /* Drop the frames the application does not admit, the filter looks at the first buffer. */
+    filter = s_enetRxFilter;
+    if ((filter != NULL) && (!filter((const uint8_t *)firstDesc->buff1Addr, control & ENET_RXDESCRIP_WR_PACKETLEN_MASK)))
+    {
+        stats->rxFilterDrops++;
+        return true;
+    }
+
+    return false;
+}
+
 static void ENET_SetSYSControl(enet_mii_mode_t miiMode)
 {
     /* Reset first. */
@@ -408,7 +563,8 @@ static void ENET_SetMacControl(ENET_Type *base, const enet_config_t *config, uin
     /* Set the speed and duplex. */
     reg = ENET_MAC_CONFIG_ECRSFD_MASK | ENET_MAC_CONFIG_PS_MASK | ENET_MAC_CONFIG_DM(config->miiDuplex) |
           ENET_MAC_CONFIG_FES(config->miiSpeed) |
-          ENET_MAC_CONFIG_S2KP(!!(config->specialControl & kENET_8023AS2KPacket));
+          ENET_MAC_CONFIG_S2KP(!!(config->specialControl & kENET_8023AS2KPacket)) |
+          ENET_MAC_CONFIG_IPC(!!(config->specialControl & kENET_ChecksumOffloadEnable));
     if (config->miiDuplex == kENET_MiiHalfDuplex)
     {
         reg |= ENET_MAC_CONFIG_IPG(ENET_HALFDUPLEX_DEFAULTIPG);
@@ -417,6 +573,16 @@ static void ENET_SetMacControl(ENET_Type *base, const enet_config_t *config, uin
 
     /* Enable channel. */
     base->MAC_RXQ_CTRL[0] = ENET_MAC_RXQ_CTRL_RXQ0EN(1) | ENET_MAC_RXQ_CTRL_RXQ1EN(1);
+
+    /* Set the rx queue steering (set for multiple queues). */
+    if (config->multiqueueCfg)
+    {
+        base->MAC_RXQ_CTRL[1] = ENET_MAC_RXQ_CTRL_UPQ(config->multiqueueCfg->rxUntaggedQueue) |
+                                ENET_MAC_RXQ_CTRL_MCBCQ(config->multiqueueCfg->rxMcBcQueue) |
+                                ENET_MAC_RXQ_CTRL_MCBCQEN(!!config->multiqueueCfg->rxMcBcQueueEnable);
+        base->MAC_RXQ_CTRL[2] = ENET_MAC_RXQ_CTRL_PSRQ0(config->multiqueueCfg->rxqueuePrio[0]) |
+                                ENET_MAC_RXQ_CTRL_PSRQ1(config->multiqueueCfg->rxqueuePrio[1]);
+    }
 }
 
 static status_t ENET_TxDescriptorsInit(ENET_Type *base,
@@ -868,8 +1034,8 @@ void ENET_GetDefaultConfig(enet_config_t *config)
     config->miiSpeed  = kENET_MiiSpeed100M;
     config->miiDuplex = kENET_MiiFullDuplex;
 
-    /* Sets default configuration for other options. */
-    config->specialControl = false;
+    /* Sets default configuration for other options, the checksums are offloaded to the hardware. */
+    config->specialControl = kENET_ChecksumOffloadEnable | kENET_StoreAndForward;
     config->multiqueueCfg  = NULL;
     config->pauseDuration  = 0;
 
@@ -1067,7 +1233,7 @@ void ENET_EnableInterrupts(ENET_Type *base, uint32_t mask)
             base->DMA_CH[index].DMA_CHX_INT_EN = interrupt;
         }
     }
-    interrupt = interrupt >> ENET_MACINT_ENUM_OFFSET;
+    interrupt = mask >> ENET_MACINT_ENUM_OFFSET;
     if (interrupt)
     {
         /* MAC interrupt */
@@ -1145,7 +1311,7 @@ void ENET_DisableInterrupts(ENET_Type *base, uint32_t mask)
             base->DMA_CH[index].DMA_CHX_INT_EN &= ~interrupt;
         }
     }
-    interrupt = interrupt >> ENET_MACINT_ENUM_OFFSET;
+    interrupt = mask >> ENET_MACINT_ENUM_OFFSET;
     if (interrupt)
     {
         /* MAC interrupt */
@@ -1208,6 +1374,10 @@ void ENET_CreateHandler(ENET_Type *base,
     {
         handle->multiQueEnable = true;
     }
+    if (config->specialControl & kENET_ChecksumOffloadEnable)
+    {
+        handle->txOffloadOps = kENET_TxOffloadAll;
+    }
     for (count = 0; count < ringNum; count++)
     {
         handle->rxBdRing[count].rxBdBase        = buffConfig->rxDescStartAddrAlign;
@@ -1262,6 +1432,127 @@ void ENET_CreateHandler(ENET_Type *base,
     EnableIRQ(s_enetIrqId[ENET_GetInstance(base)]);
 }
 
+/*!
+ * brief Sets the interrupt coalescing.
+ *
+ * This function reduces the interrupt rate by raising the tx interrupt once every few frames
+ * and by raising the rx interrupt from the rx interrupt watchdog once every few descriptors.
+ * Transmit buffers are released in batches, so the tx callback is delayed until the interrupt
+ * of the batch. Pending transmit descriptors are also reclaimed on each rx interrupt.
+ * Passing NULL restores one interrupt per frame.
+ *
+ * param base  ENET peripheral base address.
+ * param handle ENET handler.
+ * param config The interrupt coalescing configuration, see "enet_intcoalesce_config_t".
+ *
+ * note This shall be called after ENET_CreateHandler(). The rx setting applies to descriptors
+ * as they are updated, so it is fully active after the rx ring has been used once.
+ */
+void ENET_SetIntCoalesce(ENET_Type *base, enet_handle_t *handle, const enet_intcoalesce_config_t *config)
+{
+    assert(handle);
+
+    uint8_t ringNum = handle->multiQueEnable ? 2 : 1;
+    uint8_t channel;
+
+    for (channel = 0; channel < ringNum; channel++)
+    {
+        handle->txCoalesceFrames[channel] = 0;
+        handle->rxCoalesceFrames[channel] = 0;
+
+        if (config)
+        {
+            handle->txCoalesceFrameCount[channel] = config->txCoalesceFrameCount[channel];
+            /* Without the watchdog a descriptor without interrupt would never be reported. */
+            handle->rxCoalesceFrameCount[channel] =
+                config->rxCoalesceTimeCount[channel] ? config->rxCoalesceFrameCount[channel] : 0;
+            base->DMA_CH[channel].DMA_CHX_RX_INT_WDTIMER =
+                ENET_DMA_CH_DMA_CHX_RX_INT_WDTIMER_RIWT(config->rxCoalesceTimeCount[channel]);
+        }
+        else
+        {
+            handle->txCoalesceFrameCount[channel]        = 0;
+            handle->rxCoalesceFrameCount[channel]        = 0;
+            base->DMA_CH[channel].DMA_CHX_RX_INT_WDTIMER = 0;
+        }
+    }
+}
+
+/*!
+ * brief Sets the receive broadcast rate limit.
+ *
+ * The MAC has a single perfect address filter and no multicast hash table. Unicast frames
+ * for other stations are dropped by the perfect filter set by ENET_SetMacAddr() and multicast
+ * frames are dropped unless ENET_AcceptAllMulticast() is called. Broadcast frames cannot be
+ * dropped selectively in hardware without losing ARP, so this limits them in the receive path
+ * instead. Once the limit is reached, ENET_GetRxFrameSize() and ENET_SwapRxFrameBuffer() report
+ * further broadcast frames as kStatus_ENET_RxFrameError until ENET_ResetRxBroadcastCount() is
+ * called, so a broadcast storm does not consume network buffers.
+ *
+ * param handle ENET handler.
+ * param limit The number of broadcast frames passed in each period. Zero passes all of them.
+ */
+void ENET_SetRxBroadcastLimit(enet_handle_t *handle, uint16_t limit)
+{
+    assert(handle);
+
+    handle->rxBroadcastLimit = limit;
+    handle->rxBroadcastCount = 0;
+}
+
+/*!
+ * brief Sets a filter admitting the received frames into the receive path.
+ *
+ * The filter is called with each frame received without error, before it is handed to the
+ * caller of ENET_GetRxFrameSize() or ENET_SwapRxFrameBuffer(). The frames it rejects are
+ * reported as kStatus_ENET_RxFrameError, so the caller releases their descriptors without
+ * allocating a buffer for them. The frame is only valid while the filter runs, which may be
+ * from the ENET interrupt.
+ *
+ * param filter The filter, NULL to admit all frames.
+ */
+void ENET_SetRxFilter(enet_rx_filter_t filter)
+{
+    s_enetRxFilter = filter;
+}
+
+/*!
+ * brief Gets the driver statistics.
+ *
+ * param handle ENET handler.
+ * param stats The statistics copied from the handle.
+ */
+void ENET_GetStatistics(enet_handle_t *handle, enet_stats_t *stats)
+{
+    assert(handle);
+    assert(stats);
+
+    memcpy(stats, &handle->stats, sizeof(enet_stats_t));
+}
+
+/*!
+ * brief Resets the driver statistics.
+ *
+ * param handle ENET handler.
+ */
+void ENET_ResetStatistics(enet_handle_t *handle)
+{
+    assert(handle);
+
+    memset(&handle->stats, 0, sizeof(enet_stats_t));
+}
+
+/*!
+ * brief Gets the handle registered by ENET_CreateHandler().
+ *
+ * param base  ENET peripheral base address.
+ * return The handle, NULL before ENET_CreateHandler() is called.
+ */
+enet_handle_t *ENET_GetHandle(ENET_Type *base)
+{
+    return s_ENETHandle[ENET_GetInstance(base)];
+}
+
 /*!
  * brief Gets the ENET module Mac address.
  *
@@ -1376,6 +1667,24 @@ void ENET_StartSMIRead(ENET_Type *base, uint32_t phyAddr, uint32_t phyReg)
  *  32-bits configuration.
  */
 void ENET_EnterPowerDown(ENET_Type *base, uint32_t *wakeFilter)
+{
+    ENET_EnterPowerDownWakeup(base, wakeFilter, kENET_WakeupMagicPacket | kENET_WakeupFilter);
+}
+
+/*!
+ * brief Set the MAC to enter into power down mode with the given wake up frames.
+ * This is the same as ENET_EnterPowerDown() but only the frames selected by
+ * wakeSources wake up the ENET. The wake up raises the kENET_WakeUpIntEvent
+ * callback event when the kENET_MacPmt interrupt is enabled.
+ *
+ * param base    ENET peripheral base address.
+ * param wakeFilter  The wakeFilter provided to configure the wake up frame fitlter.
+ *  Set the wakeFilter to NULL is not required. But if you have the filter requirement,
+ *  please make sure the wakeFilter pointer shall be eight continous
+ *  32-bits configuration.
+ * param wakeSources The logical OR of "enet_wakeup_source_t".
+ */
+void ENET_EnterPowerDownWakeup(ENET_Type *base, uint32_t *wakeFilter, uint32_t wakeSources)
 {
     uint8_t index;
     uint32_t *reg = wakeFilter;
@@ -1395,8 +1704,7 @@ void ENET_EnterPowerDown(ENET_Type *base, uint32_t *wakeFilter)
             reg++;
         }
     }
-    base->MAC_PMT_CRTL_STAT = ENET_MAC_PMT_CRTL_STAT_MGKPKTEN_MASK | ENET_MAC_PMT_CRTL_STAT_RWKPKTEN_MASK |
-                              ENET_MAC_PMT_CRTL_STAT_PWRDWN_MASK;
+    base->MAC_PMT_CRTL_STAT = wakeSources | ENET_MAC_PMT_CRTL_STAT_PWRDWN_MASK;
 
     /* Enable the MAC rx. */
     base->MAC_CONFIG |= ENET_MAC_CONFIG_RE_MASK;
@@ -1413,7 +1721,7 @@ void ENET_EnterPowerDown(ENET_Type *base, uint32_t *wakeFilter)
  * param length The length of the valid frame received.
  * param channel The DMAC channel for the rx.
  * retval kStatus_ENET_RxFrameEmpty No frame received. Should not call ENET_ReadFrame to read frame.
- * retval kStatus_ENET_RxFrameError Data error happens. ENET_ReadFrame should be called with NULL data
+ * retval kStatus_ENET_RxFrameError Data or checksum error happens. ENET_ReadFrame should be called with NULL data
  *         and NULL length to update the receive buffers.
  * retval kStatus_Success Receive a frame Successfully then the ENET_ReadFrame
  *         should be called with the right data buffer and the captured data length input.
@@ -1441,7 +1749,7 @@ status_t ENET_GetRxFrameSize(ENET_Type *base, enet_handle_t *handle, uint32_t *l
             /* Application owns the buffer descriptor, get the length. */
             if (rxDesc->control & ENET_RXDESCRIP_WR_LD_MASK)
             {
-                if (rxDesc->control & ENET_RXDESCRIP_WR_ERRSUM_MASK)
+                if (ENET_RxFrameDropped(handle, channel, rxBdRing->rxBdBase + rxBdRing->rxGenIdx, rxDesc))
                 {
                     return kStatus_ENET_RxFrameError;
                 }
@@ -1517,6 +1825,7 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     if (base->DMA_CH[channel].DMA_CHX_STAT & ENET_DMA_CH_DMA_CHX_STAT_RBU_MASK)
     {
         suspend = true;
+        handle->stats.channel[channel].rxBuffUnavailable++;
     }
 
     /* For data-NULL input, only update the buffer descriptor. */
@@ -1529,7 +1838,8 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
             rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
             control            = rxDesc->control;
             /* Updates the receive buffer descriptors. */
-            ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+            ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, ENET_RxCoalesceIntEnable(handle, channel),
+                                    handle->doubleBuffEnable);
 
             /* Find the last buffer descriptor for the frame. */
             if (control & ENET_RXDESCRIP_WR_LD_MASK)
@@ -1598,11 +1908,14 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                         memcpy(data + offset, (void *)rxDesc->buff1Addr, len);
                     }
 
+                    handle->stats.channel[channel].rxFrames++;
+                    handle->stats.channel[channel].rxBytes += length;
                     result = kStatus_Success;
                 }
 
                 /* Updates the receive buffer descriptors. */
-                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, ENET_RxCoalesceIntEnable(handle, channel),
+                                        handle->doubleBuffEnable);
 #ifdef ENET_PTP1588FEATURE_REQUIRED
                 /* Store the rx timestamp which is in the next buffer descriptor of the last
                  * descriptor of a frame. */
@@ -1642,7 +1955,8 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                 if (offset >= length)
                 {
                     /* Updates the receive buffer descriptors. */
-                    ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+                    ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, ENET_RxCoalesceIntEnable(handle, channel),
+                                            handle->doubleBuffEnable);
                     break;
                 }
 
@@ -1655,7 +1969,8 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                 }
 
                 /* Updates the receive buffer descriptors. */
-                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, ENET_RxCoalesceIntEnable(handle, channel),
+                                        handle->doubleBuffEnable);
             }
         }
     }
@@ -1669,6 +1984,133 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     return result;
 }
 
+/*!
+ * brief Receives a frame by swapping the filled DMA buffer for an empty one.
+ * This function is the zero-copy alternative to ENET_GetRxFrameSize() and ENET_ReadFrame().
+ * Instead of copying the frame out of the DMA buffer, the buffer itself is handed to the
+ * caller and the rx descriptor is re-armed with the empty buffer provided by the caller.
+ * The frame must fit in one rx buffer descriptor and the double buffer mode must be disabled,
+ * which is the case when the rx buffer size is at least the maximum frame length.
+ * For example use rx dma channel 0:
+ * code
+ *       uint8_t *frame;
+ *       uint32_t length;
+ *       //The new buffer shall be ENET_BUFF_ALIGNMENT aligned and at least rxBuffSizeAlign bytes.
+ *       uint8_t *newBuffer = memory allocate interface;
+ *       status = ENET_SwapRxFrameBuffer(ENET, &g_handle, newBuffer, (void **)&frame, &length, 0);
+ *       if (status == kStatus_Success)
+ *       {
+ *           //The application owns "frame" now, deliver it to the stack.
+ *       }
+ *       else if (status == kStatus_ENET_RxFrameError)
+ *       {
+ *           //The new buffer is still owned by the application.
+ *           ENET_ReadFrame(ENET, &g_handle, NULL, 0, 0);
+ *       }
+ *       else if (status == kStatus_ENET_RxFrameFail)
+ *       {
+ *           //The frame cannot be swapped, fall back to the copying API.
+ *           status = ENET_GetRxFrameSize(ENET, &g_handle, &length, 0);
+ *       }
+ * endcode
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler structure. This is the same handler pointer used in the ENET_Init.
+ * param newBuffer The empty buffer used to re-arm the rx descriptor.
+ * param buffer The DMA buffer which holds the received frame. It is owned by the caller on success.
+ * param length The length of the received frame.
+ * param channel The rx DMA channel. shall not be larger than 2.
+ * retval kStatus_Success The frame is received and the descriptor holds the new buffer.
+ * retval kStatus_ENET_RxFrameEmpty No frame received.
+ * retval kStatus_ENET_RxFrameError Data error happens. ENET_ReadFrame should be called with NULL data
+ *         to update the receive buffers.
+ * retval kStatus_ENET_RxFrameFail The frame spans several descriptors or the double buffer mode is enabled.
+ *         Nothing is updated, ENET_GetRxFrameSize() and ENET_ReadFrame() should be used instead.
+ */
+status_t ENET_SwapRxFrameBuffer(
+    ENET_Type *base, enet_handle_t *handle, void *newBuffer, void **buffer, uint32_t *length, uint8_t channel)
+{
+    assert(handle);
+    assert(newBuffer);
+    assert(buffer);
+    assert(length);
+    assert(((uint32_t)newBuffer & ENET_ADDR_ALIGNMENT) == 0U);
+
+    enet_rx_bd_ring_t *rxBdRing = (enet_rx_bd_ring_t *)&handle->rxBdRing[channel];
+    enet_rx_bd_struct_t *rxDesc = rxBdRing->rxBdBase + rxBdRing->rxGenIdx;
+    uint32_t control            = rxDesc->control;
+    bool suspend                = false;
+#ifdef ENET_PTP1588FEATURE_REQUIRED
+    enet_ptp_time_data_t ptpTsData;
+    bool ptp1588 = false;
+    uint32_t rxBuffer;
+#endif /* ENET_PTP1588FEATURE_REQUIRED */
+
+    *buffer = NULL;
+    *length = 0;
+
+    if (control & ENET_RXDESCRIP_WR_OWN_MASK)
+    {
+        return kStatus_ENET_RxFrameEmpty;
+    }
+
+    if ((handle->doubleBuffEnable) || ((control & ENET_RXDESCRIP_WR_FD_MASK) == 0U) ||
+        ((control & ENET_RXDESCRIP_WR_LD_MASK) == 0U))
+    {
+        return kStatus_ENET_RxFrameFail;
+    }
+
+    if (ENET_RxFrameDropped(handle, channel, rxDesc, rxDesc))
+    {
+        return kStatus_ENET_RxFrameError;
+    }
+
+    /* Suspend and command for rx. */
+    if (base->DMA_CH[channel].DMA_CHX_STAT & ENET_DMA_CH_DMA_CHX_STAT_RBU_MASK)
+    {
+        suspend = true;
+        handle->stats.channel[channel].rxBuffUnavailable++;
+    }
+
+    /* Hand the filled buffer over and re-arm the descriptor with the new one. */
+    *buffer = (void *)rxDesc->buff1Addr;
+    *length = control & ENET_RXDESCRIP_WR_PACKETLEN_MASK;
+    handle->stats.channel[channel].rxFrames++;
+    handle->stats.channel[channel].rxBytes += *length;
+#ifdef ENET_PTP1588FEATURE_REQUIRED
+    ptp1588                               = ENET_Ptp1588ParseFrame((uint8_t *)*buffer, &ptpTsData, false);
+    handle->rxbuffers[rxBdRing->rxGenIdx] = (uint32_t)newBuffer;
+#endif /* ENET_PTP1588FEATURE_REQUIRED */
+    rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
+    ENET_UpdateRxDescriptor(rxDesc, newBuffer, NULL, ENET_RxCoalesceIntEnable(handle, channel),
+                            handle->doubleBuffEnable);
+
+#ifdef ENET_PTP1588FEATURE_REQUIRED
+    /* Store the rx timestamp which is in the next buffer descriptor of the frame. */
+    rxDesc = rxBdRing->rxBdBase + rxBdRing->rxGenIdx;
+
+    /* Reinit for the context descritor which has been updated by DMA. */
+    if (rxDesc->control & ENET_RXDESCRIP_WR_CTXT_MASK)
+    {
+        if (ptp1588)
+        {
+            ENET_StoreRxFrameTime(base, handle, rxDesc, channel, &ptpTsData);
+        }
+
+        rxBuffer = handle->rxbuffers[rxBdRing->rxGenIdx];
+        ENET_UpdateRxDescriptor(rxDesc, (void *)rxBuffer, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+        rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
+    }
+#endif /* ENET_PTP1588FEATURE_REQUIRED */
+
+    /* Set command for rx when it is suspend. */
+    if (suspend)
+    {
+        base->DMA_CH[channel].DMA_CHX_RXDESC_TAIL_PTR = base->DMA_CH[channel].DMA_CHX_RXDESC_TAIL_PTR;
+    }
+
+    return kStatus_Success;
+}
+
 /*!
  * brief Updates the buffers and the own status for a given rx descriptor.
  *  This function is a low level functional API to Updates the
@@ -1732,6 +2174,7 @@ void ENET_UpdateRxDescriptor(
  * param tsEnable The timestamp enable.
  * param flag The flag of this tx desciriptor, see "enet_desc_flag" .
  * param slotNum The slot num used for AV  only.
+ * param txOffloadOps The tx checksum insertion, only used in the first descriptor of a frame.
  *
  * note This must be called after all the ENET initilization.
  * And should be called when the ENET receive/transmit is required.
@@ -1748,7 +2191,8 @@ void ENET_SetupTxDescriptor(enet_tx_bd_struct_t *txDesc,
                             bool intEnable,
                             bool tsEnable,
                             enet_desc_flag flag,
-                            uint8_t slotNum)
+                            uint8_t slotNum,
+                            enet_tx_offload_t txOffloadOps)
 {
     uint32_t control = ENET_TXDESCRIP_RD_BL1(bytes1) | ENET_TXDESCRIP_RD_BL2(bytes2);
 
@@ -1776,6 +2220,10 @@ void ENET_SetupTxDescriptor(enet_tx_bd_struct_t *txDesc,
     txDesc->buffLen   = control;
 
     control = ENET_TXDESCRIP_RD_FL(framelen) | ENET_TXDESCRIP_RD_LDFD(flag) | ENET_TXDESCRIP_RD_OWN_MASK;
+    if ((flag == kENET_FirstFlagOnly) || (flag == kENET_FirstLastFlag))
+    {
+        control |= ENET_TXDESCRIP_RD_CIC(txOffloadOps);
+    }
 
     txDesc->controlStat = control;
 }
@@ -1833,6 +2281,7 @@ void ENET_ReclaimTxDescriptor(ENET_Type *base, enet_handle_t *handle, uint8_t ch
         }
 
         txBdRing->txDescUsed--;
+        handle->stats.channel[channel].txReclaims++;
 
         /* Update the txConsumIdx/txDesc. */
         txBdRing->txConsumIdx = ENET_IncreaseIndex(txBdRing->txConsumIdx, txBdRing->txRingLen);
@@ -1864,6 +2313,7 @@ status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     enet_tx_bd_struct_t *txDesc;
     uint8_t channel = 0;
     bool ptp1588    = false;
+    bool intEnable;
 
     if (length > 2 * ENET_TXDESCRIP_RD_BL1_MASK)
     {
@@ -1878,6 +2328,7 @@ status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     txDesc   = txBdRing->txBdBase + txBdRing->txGenIdx;
     if (txBdRing->txRingLen == txBdRing->txDescUsed)
     {
+        handle->stats.channel[channel].txBusyRejects++;
         return kStatus_ENET_TxFrameBusy;
     }
 
@@ -1887,15 +2338,19 @@ status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     ptp1588 = ENET_Ptp1588ParseFrame(data, &ptpTsData, true);
 #endif /* ENET_PTP1588FEATURE_REQUIRED */
 
+    intEnable = ENET_TxCoalesceIntEnable(handle, channel, 1);
+
     /* Fill the descriptor. */
     if (length <= ENET_TXDESCRIP_RD_BL1_MASK)
     {
-        ENET_SetupTxDescriptor(txDesc, data, length, NULL, 0, length, true, ptp1588, kENET_FirstLastFlag, 0);
+        ENET_SetupTxDescriptor(txDesc, data, length, NULL, 0, length, intEnable, ptp1588, kENET_FirstLastFlag, 0,
+                               handle->txOffloadOps);
     }
     else
     {
         ENET_SetupTxDescriptor(txDesc, data, ENET_TXDESCRIP_RD_BL1_MASK, data + ENET_TXDESCRIP_RD_BL1_MASK,
-                               (length - ENET_TXDESCRIP_RD_BL1_MASK), length, true, ptp1588, kENET_FirstLastFlag, 0);
+                               (length - ENET_TXDESCRIP_RD_BL1_MASK), length, intEnable, ptp1588, kENET_FirstLastFlag,
+                               0, handle->txOffloadOps);
     }
 
     /* Increase the index. */
@@ -1913,9 +2368,181 @@ status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     }
     base->DMA_CH[channel].DMA_CHX_TXDESC_TAIL_PTR = (uint32_t)txDesc & ~ENET_ADDR_ALIGNMENT;
 
+    handle->stats.channel[channel].txFrames++;
+    handle->stats.channel[channel].txBytes += length;
+
+    return kStatus_Success;
+}
+
+/*!
+ * brief Transmits an ENET frame gathered from several fragments.
+ * Each fragment is placed in its own tx descriptor, so a header and a payload held in
+ * different buffers can be sent without assembling them into one buffer first.
+ * note The CRC is automatically appended to the data. Input the data
+ * to send without the CRC. The fragments are zero-copy buffers, the callback is
+ * invoked with kENET_TxIntEvent once for each fragment after transmission.
+ *
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * param frags The fragments of the frame, in transmit order.
+ * param fragCount The number of fragments, at most the length of the tx descriptor ring.
+ * retval kStatus_Success  Send frame succeed.
+ * retval kStatus_ENET_TxFrameOverLen A fragment or the frame is too long, or there are more
+ *         fragments than tx descriptors.
+ * retval kStatus_ENET_TxFrameBusy  Not enough free transmit buffer descriptors for the fragments.
+ */
+status_t ENET_SendFrameFrags(ENET_Type *base, enet_handle_t *handle, const enet_tx_frag_t *frags, uint8_t fragCount)
+{
+    assert(handle);
+    assert(frags);
+    assert(fragCount);
+
+    enet_tx_bd_ring_t *txBdRing;
+    enet_tx_bd_struct_t *txDesc;
+    enet_desc_flag flag;
+    uint32_t length = 0;
+    uint8_t channel = 0;
+    uint8_t index;
+    bool ptp1588 = false;
+    bool intEnable;
+
+    for (index = 0; index < fragCount; index++)
+    {
+        assert(frags[index].data);
+
+        if (frags[index].length > 2 * ENET_TXDESCRIP_RD_BL1_MASK)
+        {
+            return kStatus_ENET_TxFrameOverLen;
+        }
+        length += frags[index].length;
+    }
+
+    if (length > ENET_TXDESCRIP_RD_FL_MASK)
+    {
+        return kStatus_ENET_TxFrameOverLen;
+    }
+
+    /* Choose the transit queue. */
+    channel = ENET_GetTxRingId(frags[0].data, handle);
+
+    /* Check if there are enough free descriptors for the whole frame. */
+    txBdRing = (enet_tx_bd_ring_t *)&handle->txBdRing[channel];
+    if (fragCount > txBdRing->txRingLen)
+    {
+        return kStatus_ENET_TxFrameOverLen;
+    }
+    if ((txBdRing->txRingLen - txBdRing->txDescUsed) < fragCount)
+    {
+        handle->stats.channel[channel].txBusyRejects++;
+        return kStatus_ENET_TxFrameBusy;
+    }
+
+#ifdef ENET_PTP1588FEATURE_REQUIRED
+    enet_ptp_time_data_t ptpTsData;
+
+    ptp1588 = ENET_Ptp1588ParseFrame(frags[0].data, &ptpTsData, true);
+#endif /* ENET_PTP1588FEATURE_REQUIRED */
+
+    intEnable = ENET_TxCoalesceIntEnable(handle, channel, fragCount);
+
+    /* Fill one descriptor for each fragment, only the last one may raise the tx interrupt. */
+    for (index = 0; index < fragCount; index++)
+    {
+        if (fragCount == 1U)
+        {
+            flag = kENET_FirstLastFlag;
+        }
+        else if (index == 0U)
+        {
+            flag = kENET_FirstFlagOnly;
+        }
+        else if (index == (fragCount - 1U))
+        {
+            flag = kENET_LastFlagOnly;
+        }
+        else
+        {
+            flag = kENET_MiddleFlag;
+        }
+
+        txDesc = txBdRing->txBdBase + txBdRing->txGenIdx;
+        if (frags[index].length <= ENET_TXDESCRIP_RD_BL1_MASK)
+        {
+            ENET_SetupTxDescriptor(txDesc, frags[index].data, frags[index].length, NULL, 0, length,
+                                   (intEnable && (index == (fragCount - 1U))), (ptp1588 && (index == 0U)), flag, 0,
+                                   handle->txOffloadOps);
+        }
+        else
+        {
+            ENET_SetupTxDescriptor(txDesc, frags[index].data, ENET_TXDESCRIP_RD_BL1_MASK,
+                                   frags[index].data + ENET_TXDESCRIP_RD_BL1_MASK,
+                                   (frags[index].length - ENET_TXDESCRIP_RD_BL1_MASK), length,
+                                   (intEnable && (index == (fragCount - 1U))), (ptp1588 && (index == 0U)), flag, 0,
+                                   handle->txOffloadOps);
+        }
+
+        /* Increase the index. */
+        txBdRing->txGenIdx = ENET_IncreaseIndex(txBdRing->txGenIdx, txBdRing->txRingLen);
+    }
+
+    /* Disable interrupt first and then enable interrupt to avoid the race condition. */
+    DisableIRQ(s_enetIrqId[ENET_GetInstance(base)]);
+    txBdRing->txDescUsed += fragCount;
+    EnableIRQ(s_enetIrqId[ENET_GetInstance(base)]);
+
+    /* Update the transmit tail address. */
+    txDesc = txBdRing->txBdBase + txBdRing->txGenIdx;
+    if (!txBdRing->txGenIdx)
+    {
+        txDesc = txBdRing->txBdBase + txBdRing->txRingLen;
+    }
+    base->DMA_CH[channel].DMA_CHX_TXDESC_TAIL_PTR = (uint32_t)txDesc & ~ENET_ADDR_ALIGNMENT;
+
+    handle->stats.channel[channel].txFrames++;
+    handle->stats.channel[channel].txBytes += length;
+
     return kStatus_Success;
 }
 
+/*!
+ * brief Transmits an ENET frame gathered from several fragments, waiting for free descriptors.
+ * This function is the same as ENET_SendFrameFrags() but it keeps retrying while the tx
+ * descriptor ring is full instead of returning kStatus_ENET_TxFrameBusy. The descriptors
+ * are released by the tx interrupt, so the ENET interrupt must be enabled.
+ *
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * param frags The fragments of the frame, in transmit order.
+ * param fragCount The number of fragments, at most the length of the tx descriptor ring.
+ * param retryTimes The number of times to retry while the ring is full. Zero means to keep
+ *         waiting until enough descriptors are free.
+ * retval kStatus_Success  Send frame succeed.
+ * retval kStatus_ENET_TxFrameOverLen A fragment or the frame is too long, or there are more
+ *         fragments than tx descriptors.
+ * retval kStatus_Timeout  The descriptors were still busy after retryTimes retries.
+ */
+status_t ENET_SendFrameFragsBlocking(
+    ENET_Type *base, enet_handle_t *handle, const enet_tx_frag_t *frags, uint8_t fragCount, uint32_t retryTimes)
+{
+    status_t result;
+
+    do
+    {
+        result = ENET_SendFrameFrags(base, handle, frags, fragCount);
+        if (result != kStatus_ENET_TxFrameBusy)
+        {
+            break;
+        }
+
+        if ((retryTimes != 0U) && (--retryTimes == 0U))
+        {
+            result = kStatus_Timeout;
+        }
+    } while (result == kStatus_ENET_TxFrameBusy);
+
+    return result;
+}
+
 #ifdef ENET_PTP1588FEATURE_REQUIRED
 /*!
  * brief Gets the current ENET time from the PTP 1588 timer.
@@ -2078,11 +2705,16 @@ status_t ENET_GetRxFrameTime(enet_handle_t *handle, enet_ptp_time_data_t *ptpTim
  */
 void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
 {
+    uint32_t cycles = DWT->CYCCNT;
+
+    handle->stats.irqCount++;
+
     /* Check for the interrupt source type. */
     /* DMA CHANNEL 0. */
     if (base->DMA_INTR_STAT & ENET_DMA_INTR_STAT_DC0IS_MASK)
     {
         uint32_t flag = base->DMA_CH[0].DMA_CHX_STAT;
+        handle->stats.channel[0].irqCount++;
         if (flag & ENET_DMA_CH_DMA_CHX_STAT_RI_MASK)
         {
             base->DMA_CH[0].DMA_CHX_STAT = ENET_DMA_CH_DMA_CHX_STAT_RI_MASK | ENET_DMA_CH_DMA_CHX_STAT_NIS_MASK;
@@ -2090,6 +2722,11 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
             {
                 handle->callback(base, handle, kENET_RxIntEvent, 0, handle->userData);
             }
+            /* Reclaim the tx descriptors which are waiting for a coalesced tx interrupt. */
+            if (handle->txCoalesceFrameCount[0] > 1U)
+            {
+                ENET_ReclaimTxDescriptor(base, handle, 0);
+            }
         }
         if (flag & ENET_DMA_CH_DMA_CHX_STAT_TI_MASK)
         {
@@ -2102,6 +2739,7 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
     if (base->DMA_INTR_STAT & ENET_DMA_INTR_STAT_DC1IS_MASK)
     {
         uint32_t flag = base->DMA_CH[1].DMA_CHX_STAT;
+        handle->stats.channel[1].irqCount++;
         if (flag & ENET_DMA_CH_DMA_CHX_STAT_RI_MASK)
         {
             base->DMA_CH[1].DMA_CHX_STAT = ENET_DMA_CH_DMA_CHX_STAT_RI_MASK | ENET_DMA_CH_DMA_CHX_STAT_NIS_MASK;
@@ -2109,6 +2747,11 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
             {
                 handle->callback(base, handle, kENET_RxIntEvent, 1, handle->userData);
             }
+            /* Reclaim the tx descriptors which are waiting for a coalesced tx interrupt. */
+            if (handle->txCoalesceFrameCount[1] > 1U)
+            {
+                ENET_ReclaimTxDescriptor(base, handle, 1);
+            }
         }
         if (flag & ENET_DMA_CH_DMA_CHX_STAT_TI_MASK)
         {
@@ -2117,6 +2760,20 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
         }
     }
 
+    /* MAC PMT. */
+    if (base->DMA_INTR_STAT & ENET_DMA_INTR_STAT_MACIS_MASK)
+    {
+        if (base->MAC_INTR_STAT & ENET_MAC_INTR_STAT_PMTIS_MASK)
+        {
+            /* Reading the PMT status clears the wake up frame received flags. */
+            (void)base->MAC_PMT_CRTL_STAT;
+            if (handle->callback)
+            {
+                handle->callback(base, handle, kENET_WakeUpIntEvent, 0, handle->userData);
+            }
+        }
+    }
+
 #ifdef ENET_PTP1588FEATURE_REQUIRED
     /* MAC TIMESTAMP. */
     if (base->DMA_INTR_STAT & ENET_DMA_INTR_STAT_MACIS_MASK)
@@ -2130,11 +2787,37 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
         }
     }
 #endif /* ENET_PTP1588FEATURE_REQUIRED */
+
+    /* Stays unchanged while the DWT cycle counter is stopped. */
+    handle->stats.irqCycles += DWT->CYCCNT - cycles;
     SDK_ISR_EXIT_BARRIER;
 }
 
+void ENET_SetIRQDeferral(enet_irq_defer_t defer)
+{
+    s_enetIrqDefer = defer;
+}
+
+void ENET_DeferredIRQHandler(ENET_Type *base)
+{
+    uint32_t instance = ENET_GetInstance(base);
+
+    s_enetIsr(base, s_ENETHandle[instance]);
+    EnableIRQ(s_enetIrqId[instance]);
+}
+
 void ETHERNET_DriverIRQHandler(void)
 {
-    s_enetIsr(ENET, s_ENETHandle[0]);
+    enet_irq_defer_t defer = s_enetIrqDefer;
+
+    IRQLATENCY_ENTRY(ETHERNET_IRQn);
+
+    /* Masked first, the interrupt stays pending until the deferred handler clears its source. */
+    DisableIRQ(ETHERNET_IRQn);
+    if ((defer == NULL) || (!defer(ENET)))
+    {
+        s_enetIsr(ENET, s_ENETHandle[0]);
+        EnableIRQ(ETHERNET_IRQn);
+    }
     SDK_ISR_EXIT_BARRIER;
 }
@@ -34,7 +34,7 @@
 #define ENET_RXDESCRIP_RD_OWN_MASK        (1U << 31) /*!< Own bit. */
 
 /*! @brief Defines for write back format. */
-#define ENET_RXDESCRIP_WR_ERR_MASK        ((1U << 3) | (1U << 7))
+#define ENET_RXDESCRIP_WR_ERR_MASK        ((1U << 3) | (1U << 7)) /*!< IP header or payload checksum error. */
 #define ENET_RXDESCRIP_WR_PYLOAD_MASK     (0x7U)
 #define ENET_RXDESCRIP_WR_PTPMSGTYPE_MASK (0xF00U)
 #define ENET_RXDESCRIP_WR_PTPTYPE_MASK    (1U << 12)
@@ -46,6 +46,9 @@
 #define ENET_RXDESCRIP_WR_DE_MASK         (1U << 19)
 #define ENET_RXDESCRIP_WR_RE_MASK         (1U << 20)
 #define ENET_RXDESCRIP_WR_OE_MASK         (1U << 21)
+#define ENET_RXDESCRIP_WR_RWT_MASK        (1U << 22)
+#define ENET_RXDESCRIP_WR_GP_MASK         (1U << 23)
+#define ENET_RXDESCRIP_WR_CE_MASK         (1U << 24)
 #define ENET_RXDESCRIP_WR_RS0V_MASK       (1U << 25)
 #define ENET_RXDESCRIP_WR_RS1V_MASK       (1U << 26)
 #define ENET_RXDESCRIP_WR_RS2V_MASK       (1U << 27)
@@ -115,6 +118,18 @@
 #define ENET_RXBUFFSTORE_NUM (6)
 #endif /* ENET_PTP1588FEATURE_REQUIRED */
 
+/*! @brief Places a zero-initialized ENET DMA descriptor ring or buffer pool.
+ * The linker script maps the section to an SRAM bank reserved for the DMA data, so the DMA
+ * does not wait on the core accessing the stacks and the heap in another bank. Without
+ * section support only the alignment is applied. */
+#ifndef ENET_DMA_SECTION_ALIGN
+#if defined(__GNUC__)
+#define ENET_DMA_SECTION_ALIGN(var, alignbytes) __attribute__((section(".bss.$ENET_DMA"))) SDK_ALIGN(var, alignbytes)
+#else
+#define ENET_DMA_SECTION_ALIGN(var, alignbytes) SDK_ALIGN(var, alignbytes)
+#endif
+#endif
+
 /*! @brief Defines the status return codes for transaction. */
 enum _enet_status
 {
@@ -205,6 +220,8 @@ typedef enum _enet_ts_rollover_type
  * @note "kENET_StoreAndForward" is recommended to be set when the
  * ENET_PTP1588FEATURE_REQUIRED is defined or else the timestamp will be mess-up
  * when the overflow happens.
+ * @note "kENET_ChecksumOffloadEnable" needs "kENET_StoreAndForward" for the
+ * tx checksum insertion of frames larger than the tx FIFO.
  */
 typedef enum _enet_special_config
 {
@@ -214,13 +231,23 @@ typedef enum _enet_special_config
     /**************************MTL************************************/
     kENET_StoreAndForward = 0x0002U, /*!< The rx/tx store and forward enable. */
     /***********************MAC****************************************/
-    kENET_PromiscuousEnable  = 0x0004U, /*!< The promiscuous enabled. */
-    kENET_FlowControlEnable  = 0x0008U, /*!< The flow control enabled. */
-    kENET_BroadCastRxDisable = 0x0010U, /*!< The broadcast disabled. */
-    kENET_MulticastAllEnable = 0x0020U, /*!< All multicast are passed. */
-    kENET_8023AS2KPacket     = 0x0040U  /*!< 8023as support for 2K packets. */
+    kENET_PromiscuousEnable     = 0x0004U, /*!< The promiscuous enabled. */
+    kENET_FlowControlEnable     = 0x0008U, /*!< The flow control enabled. */
+    kENET_BroadCastRxDisable    = 0x0010U, /*!< The broadcast disabled. */
+    kENET_MulticastAllEnable    = 0x0020U, /*!< All multicast are passed. */
+    kENET_8023AS2KPacket        = 0x0040U, /*!< 8023as support for 2K packets. */
+    kENET_ChecksumOffloadEnable = 0x0080U  /*!< The rx checksum checking and tx checksum insertion enabled. */
 } enet_special_config_t;
 
+/*! @brief Defines the tx checksum insertion, the CIC field of the tx descriptor. */
+typedef enum _enet_tx_offload
+{
+    kENET_TxOffloadDisable             = 0U, /*!< No checksum insertion. */
+    kENET_TxOffloadIPHeader            = 1U, /*!< Only the IP header checksum is inserted. */
+    kENET_TxOffloadIPHeaderPlusPayload = 2U, /*!< IP header and payload checksums, frame pseudo header. */
+    kENET_TxOffloadAll                 = 3U  /*!< IP header and payload checksums, hardware pseudo header. */
+} enet_tx_offload_t;
+
 /*! @brief List of DMA interrupts supported by the ENET interrupt. This
  * enumeration uses one-bot encoding to allow a logical OR of multiple
  * members.
@@ -249,6 +276,18 @@ typedef enum _enet_mac_interrupt_enable
     kENET_MacTimestamp = (ENET_MAC_INTR_EN_TSIE_MASK << ENET_MACINT_ENUM_OFFSET),
 } enet_mac_interrupt_enable_t;
 
+/*! @brief List of the frames which wake up the MAC from the power down mode. This
+ * enumeration uses one-bot encoding to allow a logical OR of multiple
+ * members.
+ */
+typedef enum _enet_wakeup_source
+{
+    kENET_WakeupMagicPacket   = ENET_MAC_PMT_CRTL_STAT_MGKPKTEN_MASK, /*!< Magic packet. */
+    kENET_WakeupFilter        = ENET_MAC_PMT_CRTL_STAT_RWKPKTEN_MASK, /*!< Frame matching the wake up frame filter. */
+    kENET_WakeupGlobalUnicast = ENET_MAC_PMT_CRTL_STAT_RWKPKTEN_MASK |
+                                ENET_MAC_PMT_CRTL_STAT_GLBLUCAST_MASK, /*!< Any unicast frame for the MAC address. */
+} enet_wakeup_source_t;
+
 /*! @brief Defines the common interrupt event for callback use. */
 typedef enum _enet_event
 {
@@ -399,7 +438,16 @@ typedef struct _enet_buffer_config
 #endif                                 /* ENET_PTP1588FEATURE_REQUIRED */
 } enet_buffer_config_t;
 
-/*! @brief Defines the configuration when multi-queue is used. */
+/*! @brief Defines the configuration when multi-queue is used.
+ *
+ * Notes:
+ * 1. The rx frames are steered to rx queue 0 or 1 by the MAC. A VLAN tagged frame goes to the
+ *    queue whose rxqueuePrio bitmap has the bit of its VLAN priority set. An untagged frame goes
+ *    to rxUntaggedQueue, or to rxMcBcQueue when it is a multicast or broadcast frame and
+ *    rxMcBcQueueEnable is set, which separates ARP requests and DHCP broadcasts from unicast
+ *    data. With kENET_StaticDirctMap rx queue n is delivered on the rx DMA channel n.
+ * 2. The MAC has no L3/L4 filters, so unicast frames cannot be steered by protocol or port.
+ */
 typedef struct enet_multiqueue_config
 {
     /***********************DMA block*******************************/
@@ -411,11 +459,33 @@ typedef struct enet_multiqueue_config
     enet_mtl_multiqueue_rxsche mtlrxSche;    /*!< Receive schedule for multi-queue. */
     uint8_t rxqueweight[ENET_RING_NUM_MAX];  /*!< Refer to the MTL RxQ Control register. */
     uint32_t txqueweight[ENET_RING_NUM_MAX]; /*!< Refer to the MTL TxQ Quantum Weight register. */
-    uint8_t rxqueuePrio[ENET_RING_NUM_MAX];  /*!< Receive queue priority. */
+    uint8_t rxqueuePrio[ENET_RING_NUM_MAX];  /*!< VLAN priorities bitmap steered to each receive queue. */
     uint8_t txqueuePrio[ENET_RING_NUM_MAX];  /*!< Refer to Transmit Queue Priority Mapping register. */
     enet_mtl_rxqueuemap mtlrxQuemap;         /*!< Rx queue DMA Channel mapping. */
+    /***********************MAC block*******************************/
+    uint8_t rxUntaggedQueue; /*!< Receive queue of the untagged frames. */
+    uint8_t rxMcBcQueue;     /*!< Receive queue of the untagged multicast and broadcast frames. */
+    bool rxMcBcQueueEnable;  /*!< Steer the untagged multicast and broadcast frames to rxMcBcQueue. */
 } enet_multiqueue_config_t;
 
+/*! @brief Defines the interrupt coalescing configuration.
+ *
+ * Notes:
+ * 1. The tx interrupt is raised once every txCoalesceFrameCount frames instead of once per frame.
+ *    It is always raised for a frame that takes the last free tx descriptors, so the ring is
+ *    reclaimed before it runs full.
+ * 2. rxCoalesceTimeCount sets the rx interrupt watchdog in units of 256 system clock cycles.
+ *    The watchdog raises the rx interrupt for received frames whose descriptor has no interrupt
+ *    on completion. rxCoalesceFrameCount is only used when the watchdog is enabled.
+ * 3. A count of 0 or 1 keeps one interrupt per frame.
+ */
+typedef struct _enet_intcoalesce_config
+{
+    uint8_t txCoalesceFrameCount[ENET_RING_NUM_MAX]; /*!< Transmit frames per tx interrupt. */
+    uint8_t rxCoalesceFrameCount[ENET_RING_NUM_MAX]; /*!< Receive descriptors per rx interrupt. */
+    uint8_t rxCoalesceTimeCount[ENET_RING_NUM_MAX];  /*!< Receive interrupt watchdog timer count. */
+} enet_intcoalesce_config_t;
+
 /*! @brief Defines the basic configuration structure for the ENET device.
  *
  * Note:
@@ -439,6 +509,41 @@ typedef struct _enet_config
 #endif                            /* ENET_PTP1588FEATURE_REQUIRED */
 } enet_config_t;
 
+/*! @brief Defines a fragment of a frame transmitted by ENET_SendFrameFrags(). */
+typedef struct _enet_tx_frag
+{
+    uint8_t *data;   /*!< Fragment data, it shall remain in memory until it has been transmitted. */
+    uint32_t length; /*!< Fragment length in bytes. */
+} enet_tx_frag_t;
+
+/*! @brief Defines the driver statistics of a DMA channel. */
+typedef struct _enet_channel_stats
+{
+    uint32_t rxFrames;          /*!< Receive frames delivered. */
+    uint32_t rxBytes;           /*!< Receive bytes delivered. */
+    uint32_t rxCrcErrors;       /*!< Receive frames dropped for a CRC error. */
+    uint32_t rxOverflowErrors;  /*!< Receive frames dropped for a receive FIFO overflow. */
+    uint32_t rxReceiveErrors;   /*!< Receive frames dropped for a PHY receive error or dribble bits. */
+    uint32_t rxLengthErrors;    /*!< Receive frames dropped as giant frames or for the receive watchdog. */
+    uint32_t rxChecksumErrors;  /*!< Receive frames dropped for an IP header or payload checksum error. */
+    uint32_t rxBroadcastDrops;  /*!< Receive broadcast frames dropped over the rate limit. */
+    uint32_t rxFilterDrops;     /*!< Receive frames dropped by the filter of ENET_SetRxFilter(). */
+    uint32_t rxBuffUnavailable; /*!< Receive DMA suspends for lack of free rx descriptors (RBU). */
+    uint32_t txFrames;          /*!< Transmit frames queued. */
+    uint32_t txBytes;           /*!< Transmit bytes queued. */
+    uint32_t txBusyRejects;     /*!< Transmit frames rejected with kStatus_ENET_TxFrameBusy. */
+    uint32_t txReclaims;        /*!< Transmit descriptors reclaimed after transmission. */
+    uint32_t irqCount;          /*!< Interrupts of the DMA channel. */
+} enet_channel_stats_t;
+
+/*! @brief Defines the driver statistics, see ENET_GetStatistics(). */
+typedef struct _enet_stats
+{
+    enet_channel_stats_t channel[ENET_RING_NUM_MAX]; /*!< Statistics of each DMA channel. */
+    uint32_t irqCount;                               /*!< Calls of ENET_IRQHandler(). */
+    uint32_t irqCycles;                              /*!< Core cycles spent in ENET_IRQHandler(), see DWT->CYCCNT. */
+} enet_stats_t;
+
 /* Forward declaration of the handle typedef. */
 typedef struct _enet_handle enet_handle_t;
 
@@ -446,6 +551,14 @@ typedef struct _enet_handle enet_handle_t;
 typedef void (*enet_callback_t)(
     ENET_Type *base, enet_handle_t *handle, enet_event_t event, uint8_t channel, void *userData);
 
+/*! @brief Hands the ENET interrupt handling over to a task, see ENET_SetIRQDeferral().
+ *  Returns true if ENET_DeferredIRQHandler() will be called. */
+typedef bool (*enet_irq_defer_t)(ENET_Type *base);
+
+/*! @brief Admits a received frame into the receive path, see ENET_SetRxFilter().
+ *  Returns false to drop the frame. */
+typedef bool (*enet_rx_filter_t)(const uint8_t *frame, uint32_t length);
+
 /*! @brief Defines the ENET transmit buffer descriptor ring/queue structure. */
 typedef struct _enet_tx_bd_ring
 {
@@ -474,11 +587,19 @@ typedef struct _enet_rx_bd_ring
 /*! @brief Defines the ENET handler structure. */
 struct _enet_handle
 {
-    bool multiQueEnable;                           /*!< Enable multi-queue. */
-    bool doubleBuffEnable;                         /*!< The double buffer is used in the descriptor. */
-    bool rxintEnable;                              /*!< Rx interrup enabled. */
-    enet_rx_bd_ring_t rxBdRing[ENET_RING_NUM_MAX]; /*!< Receive buffer descriptor.  */
-    enet_tx_bd_ring_t txBdRing[ENET_RING_NUM_MAX]; /*!< Transmit buffer descriptor.  */
+    bool multiQueEnable;                             /*!< Enable multi-queue. */
+    bool doubleBuffEnable;                           /*!< The double buffer is used in the descriptor. */
+    bool rxintEnable;                                /*!< Rx interrup enabled. */
+    enet_tx_offload_t txOffloadOps;                  /*!< Tx checksum insertion applied to sent frames. */
+    enet_rx_bd_ring_t rxBdRing[ENET_RING_NUM_MAX];   /*!< Receive buffer descriptor.  */
+    enet_tx_bd_ring_t txBdRing[ENET_RING_NUM_MAX];   /*!< Transmit buffer descriptor.  */
+    uint8_t txCoalesceFrameCount[ENET_RING_NUM_MAX]; /*!< Transmit frames per tx interrupt. */
+    uint8_t txCoalesceFrames[ENET_RING_NUM_MAX];     /*!< Transmit frames queued since the last tx interrupt. */
+    uint8_t rxCoalesceFrameCount[ENET_RING_NUM_MAX]; /*!< Receive descriptors per rx interrupt. */
+    uint8_t rxCoalesceFrames[ENET_RING_NUM_MAX];     /*!< Receive descriptors armed since the last rx interrupt. */
+    uint16_t rxBroadcastLimit;                       /*!< Receive broadcast frames allowed per period, 0 for all. */
+    volatile uint16_t rxBroadcastCount;              /*!< Receive broadcast frames passed in this period. */
+    enet_stats_t stats;                              /*!< Driver statistics. */
 #ifdef ENET_PTP1588FEATURE_REQUIRED
     uint32_t rxbuffers[ENET_RXBUFFSTORE_NUM]; /*!< The Initi-rx buffers will be used for reInitialize. */
 #endif
@@ -721,6 +842,21 @@ static inline void ENET_RejectAllMulticast(ENET_Type *base)
  */
 void ENET_EnterPowerDown(ENET_Type *base, uint32_t *wakeFilter);
 
+/*!
+ * @brief Set the MAC to enter into power down mode with the given wake up frames.
+ * This is the same as ENET_EnterPowerDown() but only the frames selected by
+ * wakeSources wake up the ENET. The wake up raises the kENET_WakeUpIntEvent
+ * callback event when the kENET_MacPmt interrupt is enabled.
+ *
+ * @param base    ENET peripheral base address.
+ * @param wakeFilter  The wakeFilter provided to configure the wake up frame fitlter.
+ *  Set the wakeFilter to NULL is not required. But if you have the filter requirement,
+ *  please make sure the wakeFilter pointer shall be eight continous
+ *  32-bits configuration.
+ * @param wakeSources The logical OR of "enet_wakeup_source_t".
+ */
+void ENET_EnterPowerDownWakeup(ENET_Type *base, uint32_t *wakeFilter, uint32_t wakeSources);
+
 /*!
  * @brief Set the MAC to exit power down mode.
  * Eixt from the power down mode and recover to normal work mode.
@@ -868,6 +1004,7 @@ static inline bool ENET_IsTxDescriptorDmaOwn(enet_tx_bd_struct_t *txDesc)
  * @param tsEnable The timestamp enable.
  * @param flag The flag of this tx desciriptor, see "enet_desc_flag" .
  * @param slotNum The slot num used for AV  only.
+ * @param txOffloadOps The tx checksum insertion, only used in the first descriptor of a frame.
  *
  * @note This must be called after all the ENET initilization.
  * And should be called when the ENET receive/transmit is required.
@@ -884,7 +1021,8 @@ void ENET_SetupTxDescriptor(enet_tx_bd_struct_t *txDesc,
                             bool intEnable,
                             bool tsEnable,
                             enet_desc_flag flag,
-                            uint8_t slotNum);
+                            uint8_t slotNum,
+                            enet_tx_offload_t txOffloadOps);
 
 /*!
  * @brief Update the tx descriptor tail pointer.
@@ -992,6 +1130,97 @@ void ENET_CreateHandler(ENET_Type *base,
                         enet_callback_t callback,
                         void *userData);
 
+/*!
+ * @brief Sets the interrupt coalescing.
+ *
+ * This function reduces the interrupt rate by raising the tx interrupt once every few frames
+ * and by raising the rx interrupt from the rx interrupt watchdog once every few descriptors.
+ * Transmit buffers are released in batches, so the tx callback is delayed until the interrupt
+ * of the batch. Pending transmit descriptors are also reclaimed on each rx interrupt.
+ * Passing NULL restores one interrupt per frame.
+ *
+ * @param base  ENET peripheral base address.
+ * @param handle ENET handler.
+ * @param config The interrupt coalescing configuration, see "enet_intcoalesce_config_t".
+ *
+ * @note This shall be called after ENET_CreateHandler(). The rx setting applies to descriptors
+ * as they are updated, so it is fully active after the rx ring has been used once.
+ */
+void ENET_SetIntCoalesce(ENET_Type *base, enet_handle_t *handle, const enet_intcoalesce_config_t *config);
+
+/*!
+ * @brief Sets the receive broadcast rate limit.
+ *
+ * The MAC has a single perfect address filter and no multicast hash table. Unicast frames
+ * for other stations are dropped by the perfect filter set by ENET_SetMacAddr() and multicast
+ * frames are dropped unless ENET_AcceptAllMulticast() is called. Broadcast frames cannot be
+ * dropped selectively in hardware without losing ARP, so this limits them in the receive path
+ * instead. Once the limit is reached, ENET_GetRxFrameSize() and ENET_SwapRxFrameBuffer() report
+ * further broadcast frames as kStatus_ENET_RxFrameError until ENET_ResetRxBroadcastCount() is
+ * called, so a broadcast storm does not consume network buffers.
+ *
+ * @param handle ENET handler.
+ * @param limit The number of broadcast frames passed in each period. Zero passes all of them.
+ */
+void ENET_SetRxBroadcastLimit(enet_handle_t *handle, uint16_t limit);
+
+/*!
+ * @brief Sets a filter admitting the received frames into the receive path.
+ *
+ * The filter is called with each frame received without error, before it is handed to the
+ * caller of ENET_GetRxFrameSize() or ENET_SwapRxFrameBuffer(). The frames it rejects are
+ * reported as kStatus_ENET_RxFrameError, so the caller releases their descriptors without
+ * allocating a buffer for them. The frame is only valid while the filter runs, which may be
+ * from the ENET interrupt.
+ *
+ * @param filter The filter, NULL to admit all frames.
+ */
+void ENET_SetRxFilter(enet_rx_filter_t filter);
+
+/*!
+ * @brief Starts a new receive broadcast rate limit period.
+ *
+ * This shall be called periodically, for example once per second, when a broadcast
+ * limit is set by ENET_SetRxBroadcastLimit().
+ *
+ * @param handle ENET handler.
+ */
+static inline void ENET_ResetRxBroadcastCount(enet_handle_t *handle)
+{
+    handle->rxBroadcastCount = 0;
+}
+
+/*!
+ * @brief Gets the driver statistics.
+ *
+ * The statistics count the frames dropped by the driver, which the MAC MMC counters and the
+ * network stack do not see: receive errors reported in the descriptors, receive DMA suspends
+ * for lack of buffers and transmit rejects on a full ring. The counters wrap around.
+ * A frame is counted as dropped when ENET_GetRxFrameSize() or ENET_SwapRxFrameBuffer()
+ * reports it as kStatus_ENET_RxFrameError, so those shall be called once per frame.
+ *
+ * @param handle ENET handler.
+ * @param stats The statistics copied from the handle. The copy is not atomic with regard to
+ *        the ENET interrupt, counters updated by ENET_IRQHandler() may be one event apart.
+ */
+void ENET_GetStatistics(enet_handle_t *handle, enet_stats_t *stats);
+
+/*!
+ * @brief Resets the driver statistics.
+ *
+ * @param handle ENET handler.
+ */
+void ENET_ResetStatistics(enet_handle_t *handle);
+
+/*!
+ * @brief Gets the handle registered by ENET_CreateHandler().
+ * It lets the application read the statistics of the handle owned by the network interface.
+ *
+ * @param base  ENET peripheral base address.
+ * @return The handle, NULL before ENET_CreateHandler() is called.
+ */
+enet_handle_t *ENET_GetHandle(ENET_Type *base);
+
 /*!
  * @brief Gets the size of the read frame.
  * This function gets a received frame size from the ENET buffer descriptors.
@@ -1004,7 +1233,7 @@ void ENET_CreateHandler(ENET_Type *base,
  * @param length The length of the valid frame received.
  * @param channel The DMAC channel for the rx.
  * @retval kStatus_ENET_RxFrameEmpty No frame received. Should not call ENET_ReadFrame to read frame.
- * @retval kStatus_ENET_RxFrameError Data error happens. ENET_ReadFrame should be called with NULL data
+ * @retval kStatus_ENET_RxFrameError Data or checksum error happens. ENET_ReadFrame should be called with NULL data
  *         and NULL length to update the receive buffers.
  * @retval kStatus_Success Receive a frame Successfully then the ENET_ReadFrame
  *         should be called with the right data buffer and the captured data length input.
@@ -1051,6 +1280,51 @@ status_t ENET_GetRxFrameSize(ENET_Type *base, enet_handle_t *handle, uint32_t *l
  */
 status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length, uint8_t channel);
 
+/*!
+ * @brief Receives a frame by swapping the filled DMA buffer for an empty one.
+ * This function is the zero-copy alternative to ENET_GetRxFrameSize() and ENET_ReadFrame().
+ * Instead of copying the frame out of the DMA buffer, the buffer itself is handed to the
+ * caller and the rx descriptor is re-armed with the empty buffer provided by the caller.
+ * The frame must fit in one rx buffer descriptor and the double buffer mode must be disabled,
+ * which is the case when the rx buffer size is at least the maximum frame length.
+ * For example use rx dma channel 0:
+ * @code
+ *       uint8_t *frame;
+ *       uint32_t length;
+ *       //The new buffer shall be ENET_BUFF_ALIGNMENT aligned and at least rxBuffSizeAlign bytes.
+ *       uint8_t *newBuffer = memory allocate interface;
+ *       status = ENET_SwapRxFrameBuffer(ENET, &g_handle, newBuffer, (void **)&frame, &length, 0);
+ *       if (status == kStatus_Success)
+ *       {
+ *           //The application owns "frame" now, deliver it to the stack.
+ *       }
+ *       else if (status == kStatus_ENET_RxFrameError)
+ *       {
+ *           //The new buffer is still owned by the application.
+ *           ENET_ReadFrame(ENET, &g_handle, NULL, 0, 0);
+ *       }
+ *       else if (status == kStatus_ENET_RxFrameFail)
+ *       {
+ *           //The frame cannot be swapped, fall back to the copying API.
+ *           status = ENET_GetRxFrameSize(ENET, &g_handle, &length, 0);
+ *       }
+ * @endcode
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler structure. This is the same handler pointer used in the ENET_Init.
+ * @param newBuffer The empty buffer used to re-arm the rx descriptor.
+ * @param buffer The DMA buffer which holds the received frame. It is owned by the caller on success.
+ * @param length The length of the received frame.
+ * @param channel The rx DMA channel. shall not be larger than 2.
+ * @retval kStatus_Success The frame is received and the descriptor holds the new buffer.
+ * @retval kStatus_ENET_RxFrameEmpty No frame received.
+ * @retval kStatus_ENET_RxFrameError Data error happens. ENET_ReadFrame should be called with NULL data
+ *         to update the receive buffers.
+ * @retval kStatus_ENET_RxFrameFail The frame spans several descriptors or the double buffer mode is enabled.
+ *         Nothing is updated, ENET_GetRxFrameSize() and ENET_ReadFrame() should be used instead.
+ */
+status_t ENET_SwapRxFrameBuffer(
+    ENET_Type *base, enet_handle_t *handle, void *newBuffer, void **buffer, uint32_t *length, uint8_t channel);
+
 /*!
  * @brief Transmits an ENET frame.
  * @note The CRC is automatically appended to the data. Input the data
@@ -1068,6 +1342,45 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
  */
 status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length);
 
+/*!
+ * @brief Transmits an ENET frame gathered from several fragments.
+ * Each fragment is placed in its own tx descriptor, so a header and a payload held in
+ * different buffers can be sent without assembling them into one buffer first.
+ * @note The CRC is automatically appended to the data. Input the data
+ * to send without the CRC. The fragments are zero-copy buffers, the callback is
+ * invoked with kENET_TxIntEvent once for each fragment after transmission.
+ *
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * @param frags The fragments of the frame, in transmit order.
+ * @param fragCount The number of fragments, at most the length of the tx descriptor ring.
+ * @retval kStatus_Success  Send frame succeed.
+ * @retval kStatus_ENET_TxFrameOverLen A fragment or the frame is too long, or there are more
+ *         fragments than tx descriptors.
+ * @retval kStatus_ENET_TxFrameBusy  Not enough free transmit buffer descriptors for the fragments.
+ */
+status_t ENET_SendFrameFrags(ENET_Type *base, enet_handle_t *handle, const enet_tx_frag_t *frags, uint8_t fragCount);
+
+/*!
+ * @brief Transmits an ENET frame gathered from several fragments, waiting for free descriptors.
+ * This function is the same as ENET_SendFrameFrags() but it keeps retrying while the tx
+ * descriptor ring is full instead of returning kStatus_ENET_TxFrameBusy. The descriptors
+ * are released by the tx interrupt, so the ENET interrupt must be enabled.
+ *
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * @param frags The fragments of the frame, in transmit order.
+ * @param fragCount The number of fragments, at most the length of the tx descriptor ring.
+ * @param retryTimes The number of times to retry while the ring is full. Zero means to keep
+ *         waiting until enough descriptors are free.
+ * @retval kStatus_Success  Send frame succeed.
+ * @retval kStatus_ENET_TxFrameOverLen A fragment or the frame is too long, or there are more
+ *         fragments than tx descriptors.
+ * @retval kStatus_Timeout  The descriptors were still busy after retryTimes retries.
+ */
+status_t ENET_SendFrameFragsBlocking(
+    ENET_Type *base, enet_handle_t *handle, const enet_tx_frag_t *frags, uint8_t fragCount, uint32_t retryTimes);
+
 /*!
  * @brief Reclaim tx descriptors.
  *  This function is used to update the tx descriptor status and
@@ -1098,6 +1411,27 @@ void ENET_PMTIRQHandler(ENET_Type *base, enet_handle_t *handle);
  */
 void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle);
 
+/*!
+ * @brief Moves the ENET interrupt handling out of the interrupt.
+ * The interrupt handler then only masks the ENET interrupt and calls the defer function, which
+ * must arrange for ENET_DeferredIRQHandler() to be called from a task. The descriptor handling and
+ * the callbacks of ENET_IRQHandler() run from there, and the interrupt is unmasked once they are done.
+ * The task must have a higher priority than the tasks calling the transmit functions, which mask the
+ * ENET interrupt to update the tx ring. When the defer function returns false, the interrupt is
+ * handled in place.
+ *
+ * @param defer The defer function, NULL to handle the interrupt in place.
+ */
+void ENET_SetIRQDeferral(enet_irq_defer_t defer);
+
+/*!
+ * @brief Runs ENET_IRQHandler() for an interrupt deferred by ENET_SetIRQDeferral(), then unmasks
+ * the ENET interrupt.
+ *
+ * @param base  ENET peripheral base address.
+ */
+void ENET_DeferredIRQHandler(ENET_Type *base);
+
 /* @} */
 
 #ifdef ENET_PTP1588FEATURE_REQUIRED
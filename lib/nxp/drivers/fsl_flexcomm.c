@@ -8,6 +8,7 @@
 
 #include "fsl_common.h"
 #include "fsl_flexcomm.h"
+#include "irq_latency.h"
 
 /*******************************************************************************
  * Definitions
@@ -175,6 +176,7 @@ void FLEXCOMM_SetIRQHandler(void *base, flexcomm_irq_handler_t handler, void *ha
 #if defined(FLEXCOMM0)
 void FLEXCOMM0_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM0_IRQn);
     assert(s_flexcommIrqHandler[0]);
     s_flexcommIrqHandler[0]((uint32_t *)s_flexcommBaseAddrs[0], s_flexcommHandle[0]);
     SDK_ISR_EXIT_BARRIER;
@@ -184,6 +186,7 @@ void FLEXCOMM0_DriverIRQHandler(void)
 #if defined(FLEXCOMM1)
 void FLEXCOMM1_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM1_IRQn);
     assert(s_flexcommIrqHandler[1]);
     s_flexcommIrqHandler[1]((uint32_t *)s_flexcommBaseAddrs[1], s_flexcommHandle[1]);
     SDK_ISR_EXIT_BARRIER;
@@ -193,6 +196,7 @@ void FLEXCOMM1_DriverIRQHandler(void)
 #if defined(FLEXCOMM2)
 void FLEXCOMM2_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM2_IRQn);
     assert(s_flexcommIrqHandler[2]);
     s_flexcommIrqHandler[2]((uint32_t *)s_flexcommBaseAddrs[2], s_flexcommHandle[2]);
     SDK_ISR_EXIT_BARRIER;
@@ -202,6 +206,7 @@ void FLEXCOMM2_DriverIRQHandler(void)
 #if defined(FLEXCOMM3)
 void FLEXCOMM3_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM3_IRQn);
     assert(s_flexcommIrqHandler[3]);
     s_flexcommIrqHandler[3]((uint32_t *)s_flexcommBaseAddrs[3], s_flexcommHandle[3]);
     SDK_ISR_EXIT_BARRIER;
@@ -211,6 +216,7 @@ void FLEXCOMM3_DriverIRQHandler(void)
 #if defined(FLEXCOMM4)
 void FLEXCOMM4_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM4_IRQn);
     assert(s_flexcommIrqHandler[4]);
     s_flexcommIrqHandler[4]((uint32_t *)s_flexcommBaseAddrs[4], s_flexcommHandle[4]);
     SDK_ISR_EXIT_BARRIER;
@@ -221,6 +227,7 @@ void FLEXCOMM4_DriverIRQHandler(void)
 #if defined(FLEXCOMM5)
 void FLEXCOMM5_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM5_IRQn);
     assert(s_flexcommIrqHandler[5]);
     s_flexcommIrqHandler[5]((uint32_t *)s_flexcommBaseAddrs[5], s_flexcommHandle[5]);
     SDK_ISR_EXIT_BARRIER;
@@ -230,6 +237,7 @@ void FLEXCOMM5_DriverIRQHandler(void)
 #if defined(FLEXCOMM6)
 void FLEXCOMM6_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM6_IRQn);
     assert(s_flexcommIrqHandler[6]);
     s_flexcommIrqHandler[6]((uint32_t *)s_flexcommBaseAddrs[6], s_flexcommHandle[6]);
     SDK_ISR_EXIT_BARRIER;
@@ -239,6 +247,7 @@ void FLEXCOMM6_DriverIRQHandler(void)
 #if defined(FLEXCOMM7)
 void FLEXCOMM7_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM7_IRQn);
     assert(s_flexcommIrqHandler[7]);
     s_flexcommIrqHandler[7]((uint32_t *)s_flexcommBaseAddrs[7], s_flexcommHandle[7]);
     SDK_ISR_EXIT_BARRIER;
@@ -248,6 +257,7 @@ void FLEXCOMM7_DriverIRQHandler(void)
 #if defined(FLEXCOMM8)
 void FLEXCOMM8_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM8_IRQn);
     assert(s_flexcommIrqHandler[8]);
     s_flexcommIrqHandler[8]((uint32_t *)s_flexcommBaseAddrs[8], s_flexcommHandle[8]);
     SDK_ISR_EXIT_BARRIER;
@@ -257,6 +267,7 @@ void FLEXCOMM8_DriverIRQHandler(void)
 #if defined(FLEXCOMM9)
 void FLEXCOMM9_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM9_IRQn);
     assert(s_flexcommIrqHandler[9]);
     s_flexcommIrqHandler[9]((uint32_t *)s_flexcommBaseAddrs[9], s_flexcommHandle[9]);
     SDK_ISR_EXIT_BARRIER;
@@ -266,6 +277,7 @@ void FLEXCOMM9_DriverIRQHandler(void)
 #if defined(FLEXCOMM10)
 void FLEXCOMM10_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM10_IRQn);
     assert(s_flexcommIrqHandler[10]);
     s_flexcommIrqHandler[10]((uint32_t *)s_flexcommBaseAddrs[10], s_flexcommHandle[10]);
     SDK_ISR_EXIT_BARRIER;
@@ -275,6 +287,7 @@ void FLEXCOMM10_DriverIRQHandler(void)
 #if defined(FLEXCOMM11)
 void FLEXCOMM11_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM11_IRQn);
     assert(s_flexcommIrqHandler[11]);
     s_flexcommIrqHandler[11]((uint32_t *)s_flexcommBaseAddrs[11], s_flexcommHandle[11]);
     SDK_ISR_EXIT_BARRIER;
@@ -284,6 +297,7 @@ void FLEXCOMM11_DriverIRQHandler(void)
 #if defined(FLEXCOMM12)
 void FLEXCOMM12_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM12_IRQn);
     assert(s_flexcommIrqHandler[12]);
     s_flexcommIrqHandler[12]((uint32_t *)s_flexcommBaseAddrs[12], s_flexcommHandle[12]);
     SDK_ISR_EXIT_BARRIER;
@@ -293,6 +307,7 @@ void FLEXCOMM12_DriverIRQHandler(void)
 #if defined(FLEXCOMM13)
 void FLEXCOMM13_DriverIRQHandler(void)
 {
+    IRQLATENCY_ENTRY(FLEXCOMM13_IRQn);
     assert(s_flexcommIrqHandler[13]);
     s_flexcommIrqHandler[13]((uint32_t *)s_flexcommBaseAddrs[13], s_flexcommHandle[13]);
     SDK_ISR_EXIT_BARRIER;
@@ -304,6 +319,8 @@ void FLEXCOMM14_DriverIRQHandler(void)
 {
     uint32_t instance;
 
+    IRQLATENCY_ENTRY(FLEXCOMM14_IRQn);
+
     /* Look up instance number */
     instance = FLEXCOMM_GetInstance(FLEXCOMM14);
     assert(s_flexcommIrqHandler[instance]);
@@ -317,6 +334,8 @@ void FLEXCOMM15_DriverIRQHandler(void)
 {
     uint32_t instance;
 
+    IRQLATENCY_ENTRY(FLEXCOMM15_IRQn);
+
     /* Look up instance number */
     instance = FLEXCOMM_GetInstance(FLEXCOMM15);
     assert(s_flexcommIrqHandler[instance]);
@@ -330,6 +349,8 @@ void FLEXCOMM16_DriverIRQHandler(void)
 {
     uint32_t instance;
 
+    IRQLATENCY_ENTRY(FLEXCOMM16_IRQn);
+
     /* Look up instance number */
     instance = FLEXCOMM_GetInstance(FLEXCOMM16);
     assert(s_flexcommIrqHandler[instance]);
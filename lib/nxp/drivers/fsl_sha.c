@@ -0,0 +1,169 @@
+/*
+ * Copyright 2016-2017 NXP
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "fsl_sha.h"
+
+#if defined(FSL_FEATURE_SOC_SHA_COUNT) && FSL_FEATURE_SOC_SHA_COUNT
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+
+/* Component ID definition, used by tools. */
+#ifndef FSL_COMPONENT_ID
+#define FSL_COMPONENT_ID "platform.drivers.sha"
+#endif
+
+/* Offset of the 64-bit message length in the last block */
+#define SHA_LENGTH_OFFSET (SHA_BLOCK_SIZE - 8U)
+
+/*******************************************************************************
+ * Code
+ ******************************************************************************/
+
+/* Loads one block, the engine takes the message as big-endian words */
+static void sha_process_block(SHA_Type *base, sha_ctx_t *ctx, const uint8_t *blk)
+{
+    uint32_t word;
+    uint32_t i;
+
+    if (!ctx->started)
+    {
+        base->CTRL   = SHA_CTRL_MODE(ctx->algo) | SHA_CTRL_NEW(1);
+        ctx->started = true;
+    }
+
+    /* Wait until the previous block is consumed */
+    while (0U == (base->STATUS & SHA_STATUS_WAITING_MASK))
+    {
+    }
+
+    for (i = 0; i < SHA_BLOCK_SIZE; i += sizeof(word))
+    {
+        memcpy(&word, &blk[i], sizeof(word));
+        base->INDATA = __REV(word);
+    }
+}
+
+void SHA_Enable(SHA_Type *base)
+{
+    (void)base;
+#if !(defined(FSL_SDK_DISABLE_DRIVER_CLOCK_CONTROL) && FSL_SDK_DISABLE_DRIVER_CLOCK_CONTROL)
+    CLOCK_EnableClock(kCLOCK_Sha0);
+#endif /* FSL_SDK_DISABLE_DRIVER_CLOCK_CONTROL */
+    RESET_PeripheralReset(kSHA_RST_SHIFT_RSTn);
+}
+
+status_t SHA_Init(SHA_Type *base, sha_ctx_t *ctx, sha_algo_t algo)
+{
+    (void)base;
+
+    if ((ctx == NULL) || ((algo != kSHA_Sha1) && (algo != kSHA_Sha256)))
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->algo = algo;
+    return kStatus_Success;
+}
+
+status_t SHA_Update(SHA_Type *base, sha_ctx_t *ctx, const uint8_t *message, size_t messageSize)
+{
+    uint32_t chunk;
+
+    if ((ctx == NULL) || ((message == NULL) && (messageSize > 0U)))
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    ctx->messageSize += messageSize;
+
+    /* Complete the pending block first */
+    if (ctx->blksz > 0U)
+    {
+        chunk = SHA_BLOCK_SIZE - ctx->blksz;
+        chunk = (messageSize < chunk) ? messageSize : chunk;
+        memcpy(&ctx->blk[ctx->blksz], message, chunk);
+        ctx->blksz += chunk;
+        message += chunk;
+        messageSize -= chunk;
+
+        if (ctx->blksz < SHA_BLOCK_SIZE)
+        {
+            return kStatus_Success;
+        }
+        sha_process_block(base, ctx, ctx->blk);
+        ctx->blksz = 0;
+    }
+
+    /* Full blocks straight from the message */
+    while (messageSize >= SHA_BLOCK_SIZE)
+    {
+        sha_process_block(base, ctx, message);
+        message += SHA_BLOCK_SIZE;
+        messageSize -= SHA_BLOCK_SIZE;
+    }
+
+    memcpy(ctx->blk, message, messageSize);
+    ctx->blksz = messageSize;
+    return kStatus_Success;
+}
+
+status_t SHA_Finish(SHA_Type *base, sha_ctx_t *ctx, uint8_t *output, size_t *outputSize)
+{
+    uint64_t bits;
+    uint32_t digestSize;
+    uint32_t word;
+    uint32_t i;
+
+    if ((ctx == NULL) || (output == NULL) || (outputSize == NULL))
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    digestSize = (ctx->algo == kSHA_Sha1) ? 20U : 32U;
+    if (*outputSize < digestSize)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    /* Padding: 0x80, zeros, and the message length in bits, big-endian */
+    bits                   = ctx->messageSize * 8U;
+    ctx->blk[ctx->blksz++] = 0x80U;
+    if (ctx->blksz > SHA_LENGTH_OFFSET)
+    {
+        memset(&ctx->blk[ctx->blksz], 0, SHA_BLOCK_SIZE - ctx->blksz);
+        sha_process_block(base, ctx, ctx->blk);
+        ctx->blksz = 0;
+    }
+    memset(&ctx->blk[ctx->blksz], 0, SHA_LENGTH_OFFSET - ctx->blksz);
+    for (i = 0; i < 8U; i++)
+    {
+        ctx->blk[SHA_LENGTH_OFFSET + i] = (uint8_t)(bits >> (56U - (8U * i)));
+    }
+    sha_process_block(base, ctx, ctx->blk);
+
+    while (0U == (base->STATUS & (SHA_STATUS_DIGEST_MASK | SHA_STATUS_ERROR_MASK)))
+    {
+    }
+    if (0U != (base->STATUS & SHA_STATUS_ERROR_MASK))
+    {
+        return kStatus_Fail;
+    }
+
+    for (i = 0; i < digestSize / sizeof(word); i++)
+    {
+        word = __REV(base->DIGEST[i]);
+        memcpy(&output[i * sizeof(word)], &word, sizeof(word));
+    }
+    *outputSize  = digestSize;
+    ctx->started = false;
+    return kStatus_Success;
+}
+
+#endif /* FSL_FEATURE_SOC_SHA_COUNT */
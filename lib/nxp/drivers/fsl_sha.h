@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016-2017 NXP
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#ifndef _FSL_SHA_H_
+#define _FSL_SHA_H_
+
+#include "fsl_common.h"
+
+#if defined(FSL_FEATURE_SOC_SHA_COUNT) && FSL_FEATURE_SOC_SHA_COUNT
+
+/*!
+ * @addtogroup sha
+ * @{
+ */
+
+/*******************************************************************************
+ * Definitions
+ *******************************************************************************/
+
+/*! @name Driver version */
+/*@{*/
+/*! @brief SHA driver version 2.0.0.
+ *
+ * Current version: 2.0.0
+ *
+ * Change log:
+ * - Version 2.0.0
+ *   - Initial version.
+ */
+#define FSL_SHA_DRIVER_VERSION (MAKE_VERSION(2, 0, 0))
+/*@}*/
+
+/*! @brief Supported algorithms, values of the CTRL[MODE] field. */
+typedef enum _sha_algo_t
+{
+    kSHA_Sha1   = 1, /*!< SHA-1 */
+    kSHA_Sha256 = 2, /*!< SHA-256 */
+} sha_algo_t;
+
+/*! @brief SHA block size in bytes. */
+#define SHA_BLOCK_SIZE (64U)
+
+/*! @brief Hash context.
+ *
+ * The engine keeps the intermediate digest of a single hash, which cannot be saved or restored.
+ * Only one context may be between SHA_Init() and SHA_Finish() at a time.
+ */
+typedef struct _sha_ctx_t
+{
+    uint8_t blk[SHA_BLOCK_SIZE]; /*!< Bytes not yet loaded to the engine */
+    uint32_t blksz;              /*!< Number of bytes in blk */
+    uint64_t messageSize;        /*!< Number of bytes hashed so far */
+    sha_algo_t algo;             /*!< Selected algorithm */
+    bool started;                /*!< The engine holds the intermediate digest of this context */
+} sha_ctx_t;
+
+/*******************************************************************************
+ * API
+ *******************************************************************************/
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*!
+ * @brief Enables the clock of the SHA engine and resets it.
+ *
+ * @param base SHA peripheral base address
+ */
+void SHA_Enable(SHA_Type *base);
+
+/*!
+ * @brief Initializes a hash context, the engine is started by the first block.
+ *
+ * @param base SHA peripheral base address
+ * @param ctx Hash context
+ * @param algo Algorithm to use
+ * @return kStatus_Success, or kStatus_InvalidArgument
+ */
+status_t SHA_Init(SHA_Type *base, sha_ctx_t *ctx, sha_algo_t algo);
+
+/*!
+ * @brief Adds data to the hash.
+ *
+ * @param base SHA peripheral base address
+ * @param ctx Hash context
+ * @param message Input data, any alignment, memory mapped flash included
+ * @param messageSize Size of the input data in bytes
+ * @return kStatus_Success, or kStatus_InvalidArgument
+ */
+status_t SHA_Update(SHA_Type *base, sha_ctx_t *ctx, const uint8_t *message, size_t messageSize);
+
+/*!
+ * @brief Pads the message and reads the digest.
+ *
+ * @param base SHA peripheral base address
+ * @param ctx Hash context
+ * @param output Digest, big-endian as defined by FIPS 180-4
+ * @param outputSize In: size of output, out: size of the digest (20 or 32)
+ * @return kStatus_Success, kStatus_InvalidArgument, or kStatus_Fail on an engine error
+ */
+status_t SHA_Finish(SHA_Type *base, sha_ctx_t *ctx, uint8_t *output, size_t *outputSize);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/*! @}*/
+
+#endif /* FSL_FEATURE_SOC_SHA_COUNT */
+#endif /* _FSL_SHA_H_ */
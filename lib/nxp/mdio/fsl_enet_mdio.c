@@ -10,6 +10,10 @@
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+/*! @brief Defines the SMI busy polling count before a transfer times out. */
+#ifndef MDIO_TIMEOUT_COUNT
+#define MDIO_TIMEOUT_COUNT 500000U
+#endif
 
 /*******************************************************************************
  * Prototypes
@@ -17,10 +21,28 @@
 
 static void ENET_MDIO_Init(mdio_handle_t *handle);
 
-static status_t ENET_MDIO_Write(mdio_handle_t *handle, uint32_t phyAddr, uint32_t devAddr, uint32_t data);
+static static status_t ENET_MDIO_WaitTransferOver(ENET_Type *base)
+{
+    uint32_t counter;
+
+    /* Bound the wait, a PHY which does not answer must not hang the caller. */
+    for (counter = MDIO_TIMEOUT_COUNT; counter != 0U; counter--)
+    {
+        if (!ENET_IsSMIBusy(base))
+        {
+            return kStatus_Success;
+        }
+    }
+
+    return kStatus_PHY_SMIVisitTimeout;
+}
+
+status_t ENET_MDIO_Write(mdio_handle_t *handle, uint32_t phyAddr, uint32_t devAddr, uint32_t data);
 
 static status_t ENET_MDIO_Read(mdio_handle_t *handle, uint32_t phyAddr, uint32_t devAddr, uint32_t *dataPtr);
 
+static status_t ENET_MDIO_WaitTransferOver(ENET_Type *base);
+
 /*!
  * @brief Get the ENET instance from peripheral base address.
  *
@@ -67,11 +89,8 @@ status_t ENET_MDIO_Write(mdio_handle_t *handle, uint32_t phyAddr, uint32_t devAd
     ENET_Type *base           = (ENET_Type *)resource->base;
 
     ENET_StartSMIWrite(base, phyAddr, devAddr, data);
-    while (ENET_IsSMIBusy(base))
-    {
-    }
 
-    return kStatus_Success;
+    return ENET_MDIO_WaitTransferOver(base);
 }
 
 status_t ENET_MDIO_Read(mdio_handle_t *handle, uint32_t phyAddr, uint32_t devAddr, uint32_t *dataPtr)
@@ -81,11 +100,14 @@ status_t ENET_MDIO_Read(mdio_handle_t *handle, uint32_t phyAddr, uint32_t devAdd
     mdio_resource_t *resource = (mdio_resource_t *)&handle->resource;
     ENET_Type *base           = (ENET_Type *)resource->base;
 
+    status_t result;
+
     ENET_StartSMIRead(base, phyAddr, devAddr);
-    while (ENET_IsSMIBusy(base))
+    result = ENET_MDIO_WaitTransferOver(base);
+    if (result == kStatus_Success)
     {
+        *dataPtr = ENET_ReadSMIData(base);
     }
-    *dataPtr = ENET_ReadSMIData(base);
 
-    return kStatus_Success;
+    return result;
 }
@@ -4,19 +4,88 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
-#include "fsl_spifi.h"
 #include "mflash_drv.h"
-#include "pin_mux.h"
 #include <stdbool.h>
+#include <string.h>
+
+#if MFLASH_BOOT_API
+
+#include "spifi_boot.h"
+
+/* Flash driver of the bootloader, NULL until 'mflash_drv_init' finds a compatible one */
+static const struct boot_api *g_mflash_boot_api;
+
+int32_t mflash_drv_init(void)
+{
+    g_mflash_boot_api = boot_api_get();
+    if (g_mflash_boot_api == NULL)
+    {
+        return -1;
+    }
+
+    return g_mflash_boot_api->init();
+}
+
+int32_t mflash_drv_write(void *any_addr, const uint8_t *data, uint32_t data_len)
+{
+    return (g_mflash_boot_api != NULL) ? g_mflash_boot_api->flash_write(any_addr, data, data_len) : -1;
+}
+
+int32_t mflash_drv_writev(const mflash_drv_segment_t *segments, uint32_t count)
+{
+    return (g_mflash_boot_api != NULL) ? g_mflash_boot_api->flash_writev(segments, count) : -1;
+}
+
+int32_t mflash_drv_erase(void *addr, uint32_t len)
+{
+    return (g_mflash_boot_api != NULL) ? g_mflash_boot_api->flash_erase(addr, len) : -1;
+}
+
+int32_t mflash_drv_read(const void *any_addr, uint8_t *data, uint32_t data_len)
+{
+    return (g_mflash_boot_api != NULL) ? g_mflash_boot_api->flash_read(any_addr, data, data_len) : -1;
+}
+
+bool mflash_drv_is_busy(void)
+{
+    return (g_mflash_boot_api != NULL) ? g_mflash_boot_api->flash_is_busy() : false;
+}
+
+#else /* MFLASH_BOOT_API */
+
+#include "fsl_spifi.h"
+#include "pin_mux.h"
+#include "irq_latency.h"
+
+#if MFLASH_ASYNC_MODE
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#ifndef MFLASH_ASYNC_TASK_STACK_SIZE
+#define MFLASH_ASYNC_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE * 2)
+#endif
+
+#ifndef MFLASH_ASYNC_TASK_PRIORITY
+#define MFLASH_ASYNC_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+#endif
 
 /* Command ID */
-#define COMMAND_NUM (6)
+#define COMMAND_NUM (12)
 #define READ (0)
 #define PROGRAM_PAGE (1)
 #define GET_STATUS (2)
 #define ERASE_SECTOR (3)
 #define WRITE_ENABLE (4)
 #define WRITE_REGISTER (5)
+#define READ_QE_REGISTER (6)
+#define WRITE_QE_REGISTER (7)
+#define SUSPEND (8)
+#define RESUME (9)
+#define ERASE_BLOCK32 (10)
+#define ERASE_BLOCK64 (11)
 
 //#ifdef XIP_IMAGE
 //#warning NOTE: MFLASH driver expects that application runs from XIP
@@ -28,16 +97,62 @@
 #define FLASHDRV_SMART_UPDATE 1
 #endif
 
+#if MFLASH_BENCHMARK
+#include "fsl_debug_console.h"
+#include "latency_probe.h"
+
+/* Longest interval with interrupts disabled by the driver, in core cycles */
+static uint32_t g_mflash_irq_off_start;
+static uint32_t g_mflash_irq_off_max;
+
+#define MFLASH_BENCH_IRQ_OFF() (g_mflash_irq_off_start = DWT->CYCCNT)
+#define MFLASH_BENCH_IRQ_ON()                                     \
+    do                                                            \
+    {                                                             \
+        uint32_t irq_off = DWT->CYCCNT - g_mflash_irq_off_start;  \
+        if (irq_off > g_mflash_irq_off_max)                       \
+            g_mflash_irq_off_max = irq_off;                       \
+    } while (0)
+#else
+#define MFLASH_BENCH_IRQ_OFF()
+#define MFLASH_BENCH_IRQ_ON()
+#endif
+
+/* Mark the intervals with interrupts disabled, right after 'cpsid i' and right before 'cpsie i'.
+ * The marks are inline and keep the driver out of XIP while the flash is busy */
+#define MFLASH_IRQ_OFF()        \
+    do                          \
+    {                           \
+        MFLASH_BENCH_IRQ_OFF(); \
+        IRQMASK_BEGIN();        \
+    } while (0)
+#define MFLASH_IRQ_ON()        \
+    do                         \
+    {                          \
+        IRQMASK_END();         \
+        MFLASH_BENCH_IRQ_ON(); \
+    } while (0)
+
 /* Temporary sector storage. Use uint32_t type to force 4B alignment and
- * improve copy operation */
-static uint32_t g_flashm_sector[MFLASH_SECTOR_SIZE / sizeof(uint32_t)];
+ * improve copy operation. Always filled before it is programmed, so it is
+ * placed in .noinit and not cleared at startup. */
+static uint32_t g_flashm_sector[MFLASH_SECTOR_SIZE / sizeof(uint32_t)] __attribute__((section(".noinit")));
 
 /* Commands definition, taken from SPIFI demo */
 static spifi_command_t command[COMMAND_NUM] = {
+#if MFLASH_QUAD_MODE
+    /* read, quad I/O: 3 intermediate bytes on four lines give the 6 dummy clocks */
+    {MFLASH_PAGE_SIZE, false, kSPIFI_DataInput, 3, kSPIFI_CommandOpcodeSerial, kSPIFI_CommandOpcodeAddrThreeBytes,
+     MFLASH_QUAD_READ_OPCODE},
+    /* program, quad */
+    {MFLASH_PAGE_SIZE, false, kSPIFI_DataOutput, 0, kSPIFI_CommandDataQuad, kSPIFI_CommandOpcodeAddrThreeBytes,
+     MFLASH_QUAD_PROGRAM_OPCODE},
+#else
     /* read */
     {MFLASH_PAGE_SIZE, false, kSPIFI_DataInput, 1, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0x0B},
     /* program */
     {MFLASH_PAGE_SIZE, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0x2},
+#endif
     /* status */
     {1, false, kSPIFI_DataInput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x05},
     /* erase */
@@ -45,21 +160,392 @@ static spifi_command_t command[COMMAND_NUM] = {
     /* write enable */
     {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x06},
     /* write register */
-    {4, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x01}};
+    {4, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x01},
+    /* read quad enable register */
+    {1, false, kSPIFI_DataInput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, MFLASH_QE_READ_OPCODE},
+    /* write quad enable register */
+    {1, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, MFLASH_QE_WRITE_OPCODE},
+    /* erase/program suspend */
+    {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x75},
+    /* erase/program resume */
+    {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x7A},
+    /* erase 32KB block */
+    {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0x52},
+    /* erase 64KB block */
+    {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0xD8}};
+
+/* Features of the flash beyond the command table, the defaults match the W25Q128JV,
+ * with MFLASH_SFDP both are updated at init from the SFDP tables of the flash */
+static bool g_mflash_quad = MFLASH_QUAD_MODE; /* Quad enable bit is set and SPIFI uses IO3:0 */
+#if MFLASH_SFDP || MFLASH_BENCHMARK
+static bool g_mflash_dual; /* Dual read, SPIFI uses IO1:0 */
+#endif
+static uint8_t g_mflash_qe_mask = MFLASH_QE_MASK;
+static bool g_mflash_qe_sr1_first;                     /* The quad enable register is written after status register 1 */
+static uint32_t g_mflash_page_size = MFLASH_PAGE_SIZE; /* Program size, MFLASH_PAGE_SIZE pages are split into it */
+static bool g_mflash_block32 = true;
+static bool g_mflash_block64 = true;
+#if MFLASH_ASYNC_MODE
+static bool g_mflash_suspend = true; /* The flash supports erase/program suspend */
+#endif
+
+#if MFLASH_ASYNC_MODE
+typedef struct
+{
+    void *addr;
+    const uint8_t *data;
+    uint32_t data_len;
+    mflash_drv_callback_t callback;
+    void *arg;
+} mflash_drv_request_t;
+
+/* Serializes flash updates, the flash may be suspended while the owner is preempted */
+static SemaphoreHandle_t g_mflash_lock;
+static StaticSemaphore_t g_mflash_lock_buffer;
+
+/* Pending 'mflash_drv_write_async' requests, served by the mflash task */
+static QueueHandle_t g_mflash_queue;
+static StaticQueue_t g_mflash_queue_buffer;
+static uint8_t g_mflash_queue_storage[MFLASH_ASYNC_QUEUE_LENGTH * sizeof(mflash_drv_request_t)];
+static StaticTask_t g_mflash_task_buffer;
+static StackType_t g_mflash_task_stack[MFLASH_ASYNC_TASK_STACK_SIZE];
+/* Number of queued requests that have not completed yet */
+static volatile uint32_t g_mflash_pending;
+/* An erase/program is suspended while its owner sleeps, the flash must stay clocked until it resumes */
+static volatile bool g_mflash_suspended;
+#endif
+
+#if MFLASH_DMA_MODE
+/* Maximum number of units of a single DMA transfer */
+#define MFLASH_DMA_MAX_COUNT (1024)
+
+/* DMA channel descriptor, layout defined by the DMA controller */
+typedef struct
+{
+    uint32_t xfercfg;
+    const void *src_end;
+    void *dst_end;
+    void *link;
+} mflash_dma_descriptor_t;
+
+/* Channel descriptor table of DMA0, not used if another driver already set one */
+SDK_ALIGN(static mflash_dma_descriptor_t g_mflash_dma_table[FSL_FEATURE_DMA_NUMBER_OF_CHANNELS], 512);
+
+/* Start transfer of 'count' units of 'width' bytes, the channel waits for peripheral requests if 'periph' is set */
+static void mflash_drv_dma_start(
+    uint32_t channel, const void *src, void *dst, uint32_t count, uint32_t width, bool dst_inc, bool periph)
+{
+    uint32_t width_cfg             = (width == 4) ? 2 : ((width == 2) ? 1 : 0);
+    mflash_dma_descriptor_t *table = (mflash_dma_descriptor_t *)DMA0->SRAMBASE;
+
+    table[channel].src_end = (const uint8_t *)src + (count - 1) * width;
+    table[channel].dst_end = dst_inc ? (uint8_t *)dst + (count - 1) * width : dst;
+    table[channel].link    = NULL;
+
+    DMA0->CHANNEL[channel].CFG = DMA_CHANNEL_CFG_PERIPHREQEN(periph);
+    DMA0->COMMON[0].ENABLESET  = 1U << channel;
+    DMA0->CHANNEL[channel].XFERCFG =
+        DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_SWTRIG_MASK | DMA_CHANNEL_XFERCFG_CLRTRIG_MASK |
+        DMA_CHANNEL_XFERCFG_WIDTH(width_cfg) | DMA_CHANNEL_XFERCFG_SRCINC(1) | DMA_CHANNEL_XFERCFG_DSTINC(dst_inc) |
+        DMA_CHANNEL_XFERCFG_XFERCOUNT(count - 1);
+}
+
+static inline bool mflash_drv_dma_busy(uint32_t channel)
+{
+    return (DMA0->COMMON[0].ACTIVE & (1U << channel)) != 0;
+}
+
+/* Copy 'len' bytes of memory mapped flash at 'src' to 'dst' on the read channel, by 4B if all are aligned.
+ * Other tasks of the same priority run meanwhile if 'yield' is set */
+static void mflash_drv_dma_copy(const void *src, void *dst, uint32_t len, bool yield)
+{
+    uint32_t width = (0 == (((uint32_t)src | (uint32_t)dst | len) & 0x3)) ? sizeof(uint32_t) : 1;
+    uint32_t chunk;
+
+    for (uint32_t offset = 0; offset < len; offset += chunk)
+    {
+        chunk = len - offset;
+        if (chunk > MFLASH_DMA_MAX_COUNT * width)
+            chunk = MFLASH_DMA_MAX_COUNT * width;
+
+        mflash_drv_dma_start(MFLASH_DMA_READ_CHANNEL, (const uint8_t *)src + offset, (uint8_t *)dst + offset,
+                             chunk / width, width, true, false);
+        while (mflash_drv_dma_busy(MFLASH_DMA_READ_CHANNEL))
+        {
+#if MFLASH_ASYNC_MODE
+            if (yield)
+                taskYIELD();
+#endif
+        }
+    }
+}
+#endif
+
+/* Read status register */
+static inline uint8_t mflash_drv_read_status(void)
+{
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[GET_STATUS]);
+    while ((MFLASH_SPIFI->STAT & SPIFI_STAT_INTRQ_MASK) == 0U)
+    {
+    }
+    return SPIFI_ReadDataByte(MFLASH_SPIFI);
+}
 
 /* Wait until command finishes */
 static inline void mflash_drv_check_if_finish(void)
 {
-    uint8_t val = 0;
-    do
+    while (mflash_drv_read_status() & 0x1)
+    {
+    }
+}
+
+/* Read a single byte register of the flash */
+static uint8_t mflash_drv_read_register(uint8_t opcode)
+{
+    spifi_command_t read = {1, false, kSPIFI_DataInput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, opcode};
+
+    SPIFI_SetCommand(MFLASH_SPIFI, &read);
+    while ((MFLASH_SPIFI->STAT & SPIFI_STAT_INTRQ_MASK) == 0U)
+    {
+    }
+    return SPIFI_ReadDataByte(MFLASH_SPIFI);
+}
+
+/* Set the quad enable bit of the flash if it is not set yet,
+ * the bit is non-volatile so it is written once in the lifetime of the flash,
+ * unless the register holding it cannot be read back */
+static void mflash_drv_quad_enable(void)
+{
+    uint8_t status = 0;
+    uint8_t status1;
+
+    if (g_mflash_qe_mask == 0)
+        return;
+
+    SPIFI_ResetCommand(MFLASH_SPIFI);
+    if (command[READ_QE_REGISTER].opcode != 0)
+    {
+        status = mflash_drv_read_register(command[READ_QE_REGISTER].opcode);
+        if ((status & g_mflash_qe_mask) != 0)
+            return;
+    }
+
+    if (g_mflash_qe_sr1_first)
+    {
+        status1                            = mflash_drv_read_register(command[GET_STATUS].opcode);
+        command[WRITE_QE_REGISTER].dataLen = 2;
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_ENABLE]);
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_QE_REGISTER]);
+        SPIFI_WriteDataByte(MFLASH_SPIFI, status1);
+    }
+    else
+    {
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_ENABLE]);
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_QE_REGISTER]);
+    }
+    SPIFI_WriteDataByte(MFLASH_SPIFI, status | g_mflash_qe_mask);
+    mflash_drv_check_if_finish();
+}
+
+#if MFLASH_SFDP
+/* "SFDP" signature of the SFDP header */
+#define SFDP_SIGNATURE (0x50444653U)
+/* Words of the basic flash parameter table used by the driver, JESD216B */
+#define SFDP_BFPT_WORDS (16U)
+
+/* Read 'words' 4B words of the SFDP tables at 'addr' */
+static void mflash_drv_sfdp_read(uint32_t addr, uint32_t *data, uint32_t words)
+{
+    /* Serial, 8 dummy clocks */
+    spifi_command_t sfdp = {0, false, kSPIFI_DataInput, 1, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes,
+                            0x5A};
+
+    sfdp.dataLen = words * sizeof(data[0]);
+    SPIFI_SetCommandAddress(MFLASH_SPIFI, addr);
+    SPIFI_SetCommand(MFLASH_SPIFI, &sfdp);
+    for (uint32_t i = 0; i < words; i++)
     {
-        SPIFI_SetCommand(MFLASH_SPIFI, &command[GET_STATUS]);
-        while ((MFLASH_SPIFI->STAT & SPIFI_STAT_INTRQ_MASK) == 0U)
+        data[i] = SPIFI_ReadData(MFLASH_SPIFI);
+    }
+}
+
+/* Set the read command to a fast read of the basic flash parameter table, 'param' holds the opcode in bits 15:8
+ * and the dummy and mode clocks in bits 7:0, the clocks must be a whole number of intermediate bytes */
+static bool mflash_drv_sfdp_read_command(uint32_t param, uint32_t clocks_per_byte, spifi_command_format_t format)
+{
+    uint32_t clocks = (param & 0x1F) + ((param >> 5) & 0x7);
+
+    if ((((param >> 8) & 0xFF) == 0) || ((clocks % clocks_per_byte) != 0))
+        return false;
+
+    command[READ].opcode            = (param >> 8) & 0xFF;
+    command[READ].intermediateBytes = clocks / clocks_per_byte;
+    command[READ].format            = format;
+    return true;
+}
+
+/* Select the commands and geometry described by the SFDP tables of the flash.
+ * Returns -1 and keeps the defaults if the flash has no tables or they lack the 4 KB erase the driver relies on */
+static int32_t mflash_drv_sfdp_probe(void)
+{
+    spifi_command_t read_id = {3, false, kSPIFI_DataInput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x9F};
+    uint32_t header[4];
+    uint32_t bfpt[SFDP_BFPT_WORDS] = {0};
+    uint32_t words;
+    uint32_t qe_method = 7;
+    uint8_t manufacturer;
+    bool quad_read = false;
+
+    SPIFI_ResetCommand(MFLASH_SPIFI);
+
+    /* SFDP header and first parameter header, which is the one of the basic flash parameter table */
+    mflash_drv_sfdp_read(0, header, 4);
+    words = header[2] >> 24;
+    if ((header[0] != SFDP_SIGNATURE) || ((header[2] & 0xFF) != 0) || (words < 9))
+        return -1;
+    if (words > SFDP_BFPT_WORDS)
+        words = SFDP_BFPT_WORDS;
+    mflash_drv_sfdp_read(header[3] & 0xFFFFFF, bfpt, words);
+
+    SPIFI_SetCommand(MFLASH_SPIFI, &read_id);
+    manufacturer = SPIFI_ReadDataByte(MFLASH_SPIFI);
+    (void)SPIFI_ReadDataByte(MFLASH_SPIFI);
+    (void)SPIFI_ReadDataByte(MFLASH_SPIFI);
+
+    /* 4 KB erase */
+    if ((bfpt[0] & 0x3) != 0x1)
+        return -1;
+    command[ERASE_SECTOR].opcode = (bfpt[0] >> 8) & 0xFF;
+
+    /* 32 KB and 64 KB erases among the four erase types, sizes are powers of 2 */
+    g_mflash_block32 = false;
+    g_mflash_block64 = false;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        uint32_t type = (bfpt[7 + i / 2] >> ((i % 2) * 16)) & 0xFFFF;
+
+        if ((type & 0xFF) == 15)
+        {
+            command[ERASE_BLOCK32].opcode = type >> 8;
+            g_mflash_block32              = true;
+        }
+        else if ((type & 0xFF) == 16)
         {
+            command[ERASE_BLOCK64].opcode = type >> 8;
+            g_mflash_block64              = true;
         }
-        val = SPIFI_ReadDataByte(MFLASH_SPIFI);
-    } while (val & 0x1);
+    }
+
+    /* 4B addresses only if the flash has no 3B address mode, the image layout fits into the first 16 MB */
+    if (((bfpt[0] >> 17) & 0x3) == 0x2)
+    {
+        command[READ].type          = kSPIFI_CommandOpcodeAddrFourBytes;
+        command[PROGRAM_PAGE].type  = kSPIFI_CommandOpcodeAddrFourBytes;
+        command[ERASE_SECTOR].type  = kSPIFI_CommandOpcodeAddrFourBytes;
+        command[ERASE_BLOCK32].type = kSPIFI_CommandOpcodeAddrFourBytes;
+        command[ERASE_BLOCK64].type = kSPIFI_CommandOpcodeAddrFourBytes;
+    }
+
+    /* Page size, JESD216A and later, smaller pages than MFLASH_PAGE_SIZE are programmed in parts */
+    if ((words >= 11) && ((1U << ((bfpt[10] >> 4) & 0xF)) < MFLASH_PAGE_SIZE))
+    {
+        g_mflash_page_size = 1U << ((bfpt[10] >> 4) & 0xF);
+        if (g_mflash_page_size < sizeof(uint32_t))
+            g_mflash_page_size = sizeof(uint32_t);
+    }
+    command[PROGRAM_PAGE].dataLen = g_mflash_page_size;
+
+#if MFLASH_ASYNC_MODE
+    /* Erase suspend/resume opcodes, JESD216A and later */
+    if (words >= 13)
+    {
+        g_mflash_suspend = (bfpt[11] & (1U << 31)) == 0;
+        command[SUSPEND].opcode = bfpt[12] >> 24;
+        command[RESUME].opcode  = (bfpt[12] >> 16) & 0xFF;
+    }
+#endif
+
+    /* Quad enable requirements, JESD216A and later. The older tables of the Winbond parts do not tell them but all
+     * of these parts use bit 1 of status register 2, quad I/O is not used by other flashes that do not tell them */
+    if (words >= 15)
+        qe_method = (bfpt[14] >> 20) & 0x7;
+    else if (manufacturer == 0xEF)
+        qe_method = 6;
+    g_mflash_qe_sr1_first = false;
+    switch (qe_method)
+    {
+        case 0: /* No quad enable bit */
+            g_mflash_qe_mask = 0;
+            break;
+        case 1: /* Bit 1 of status register 2, written with status register 1, which cannot be read */
+        case 4:
+            command[READ_QE_REGISTER].opcode  = 0;
+            command[WRITE_QE_REGISTER].opcode = 0x01;
+            g_mflash_qe_mask                  = 0x02;
+            g_mflash_qe_sr1_first             = true;
+            break;
+        case 2: /* Bit 6 of status register 1 */
+            command[READ_QE_REGISTER].opcode  = 0x05;
+            command[WRITE_QE_REGISTER].opcode = 0x01;
+            g_mflash_qe_mask                  = 0x40;
+            break;
+        case 3: /* Bit 7 of status register 2 */
+            command[READ_QE_REGISTER].opcode  = 0x3F;
+            command[WRITE_QE_REGISTER].opcode = 0x3E;
+            g_mflash_qe_mask                  = 0x80;
+            break;
+        case 5: /* Bit 1 of status register 2, written with status register 1 */
+            command[READ_QE_REGISTER].opcode  = 0x35;
+            command[WRITE_QE_REGISTER].opcode = 0x01;
+            g_mflash_qe_mask                  = 0x02;
+            g_mflash_qe_sr1_first             = true;
+            break;
+        case 6: /* Bit 1 of status register 2, written alone */
+            command[READ_QE_REGISTER].opcode  = 0x35;
+            command[WRITE_QE_REGISTER].opcode = 0x31;
+            g_mflash_qe_mask                  = 0x02;
+            break;
+        default:
+            break;
+    }
+
+    /* Fastest read: 1-4-4, 1-1-4, 1-2-2, 1-1-2, then the serial fast read. Intermediate bytes take 2 clocks on
+     * four lines, 4 clocks on two lines and 8 clocks when they are serial */
+    if (MFLASH_QUAD_MODE && (qe_method < 7))
+    {
+        quad_read = ((bfpt[0] & (1U << 21)) && mflash_drv_sfdp_read_command(bfpt[2], 2, kSPIFI_CommandOpcodeSerial)) ||
+                    ((bfpt[0] & (1U << 22)) && mflash_drv_sfdp_read_command(bfpt[2] >> 16, 8, kSPIFI_CommandDataQuad));
+    }
+    g_mflash_quad = quad_read;
+    g_mflash_dual = false;
+    if (!quad_read)
+    {
+        g_mflash_dual =
+            ((bfpt[0] & (1U << 20)) && mflash_drv_sfdp_read_command(bfpt[3] >> 16, 4, kSPIFI_CommandOpcodeSerial)) ||
+            ((bfpt[0] & (1U << 16)) && mflash_drv_sfdp_read_command(bfpt[3], 8, kSPIFI_CommandDataQuad));
+    }
+    if (!quad_read && !g_mflash_dual)
+    {
+        command[READ].opcode            = 0x0B;
+        command[READ].intermediateBytes = 1;
+        command[READ].format            = kSPIFI_CommandAllSerial;
+    }
+
+    /* SFDP has no program commands, quad page program is only used on parts of makers known to have it */
+    if (quad_read && ((manufacturer == 0xEF) || (manufacturer == 0xC8) || (manufacturer == 0x9D)))
+    {
+        command[PROGRAM_PAGE].opcode = MFLASH_QUAD_PROGRAM_OPCODE;
+        command[PROGRAM_PAGE].format = kSPIFI_CommandDataQuad;
+    }
+    else
+    {
+        command[PROGRAM_PAGE].opcode = 0x02;
+        command[PROGRAM_PAGE].format = kSPIFI_CommandAllSerial;
+    }
+
+    return 0;
 }
+#endif
 
 /* return offset from sector */
 static void mflash_drv_read_mode(void)
@@ -69,6 +555,149 @@ static void mflash_drv_read_mode(void)
     SPIFI_SetMemoryCommand(MFLASH_SPIFI, &command[READ]);
 }
 
+#if MFLASH_ASYNC_MODE
+/* Wait until erase/program finishes. Entered and left with interrupts disabled and SPIFI in command mode.
+ * If the caller had interrupts enabled, the operation is suspended as soon as an interrupt is pending,
+ * or every MFLASH_ASYNC_SLICE_US if none is, the flash is switched back to read mode and the interrupt,
+ * the tasks it wakes and, at the end of a slice, the other tasks run from XIP. Each resume lets the operation
+ * run for MFLASH_ASYNC_RESUME_US before the next suspend so that it completes under any interrupt load.
+ * NOTE: Data of the sector being erased/programmed must not be read until the operation completes */
+static void mflash_drv_wait_ready(uint32_t primask)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+    uint32_t slice         = cycles_per_us * MFLASH_ASYNC_SLICE_US;
+    uint32_t min_run       = cycles_per_us * MFLASH_ASYNC_RESUME_US;
+    uint32_t start         = DWT->CYCCNT;
+    uint32_t elapsed;
+    bool irq_pending;
+
+    while (mflash_drv_read_status() & 0x1)
+    {
+        if (primask != 0)
+        {
+            continue;
+        }
+
+        /* Any exception pended while interrupts are disabled, including the tick and PendSV */
+        irq_pending = (SCB->ICSR & SCB_ICSR_VECTPENDING_Msk) != 0;
+        elapsed     = DWT->CYCCNT - start;
+        if (!g_mflash_suspend || (elapsed < min_run) || ((elapsed < slice) && !irq_pending))
+        {
+            continue;
+        }
+
+        /* Suspend, busy flag clears as soon as the flash accepts reads again */
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[SUSPEND]);
+        mflash_drv_check_if_finish();
+        mflash_drv_read_mode();
+
+        g_mflash_suspended = true;
+        MFLASH_IRQ_ON();
+        __asm("cpsie i");
+        /* Flush pipeline to allow pending interrupts take place, a task they woke preempts this one here */
+        __ISB();
+        if (!irq_pending && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING))
+        {
+            vTaskDelay(MFLASH_ASYNC_YIELD_TICKS);
+        }
+        __asm("cpsid i");
+        MFLASH_IRQ_OFF();
+        g_mflash_suspended = false;
+
+        /* Resume is ignored by the flash if the operation completed before the suspend */
+        SPIFI_ResetCommand(MFLASH_SPIFI);
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[RESUME]);
+        start = DWT->CYCCNT;
+    }
+}
+
+int32_t mflash_drv_erase_internal(void *addr, uint32_t len);
+int32_t mflash_drv_write_internal(void *any_addr, const uint8_t *data, uint32_t data_len);
+
+/* Take the flash for a synchronous update once all previously queued requests completed */
+static bool mflash_drv_lock(void)
+{
+    if ((g_mflash_lock == NULL) || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+        return false;
+
+    while (g_mflash_pending != 0)
+    {
+        vTaskDelay(1);
+    }
+    (void)xSemaphoreTake(g_mflash_lock, portMAX_DELAY);
+
+    return true;
+}
+
+static void mflash_drv_unlock(bool locked)
+{
+    if (locked)
+    {
+        (void)xSemaphoreGive(g_mflash_lock);
+    }
+}
+
+/* Pass a request to the mflash task */
+static int32_t mflash_drv_queue_request(const mflash_drv_request_t *request)
+{
+    if (g_mflash_queue == NULL)
+        return -1;
+
+    taskENTER_CRITICAL();
+    g_mflash_pending++;
+    taskEXIT_CRITICAL();
+
+    if (xQueueSend(g_mflash_queue, request, 0) != pdTRUE)
+    {
+        taskENTER_CRITICAL();
+        g_mflash_pending--;
+        taskEXIT_CRITICAL();
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Serve 'mflash_drv_write_async' and 'mflash_drv_erase_async' requests */
+static void mflash_drv_task(void *param)
+{
+    mflash_drv_request_t request;
+    int32_t result;
+
+    (void)param;
+
+    for (;;)
+    {
+        if (xQueueReceive(g_mflash_queue, &request, portMAX_DELAY) == pdTRUE)
+        {
+            (void)xSemaphoreTake(g_mflash_lock, portMAX_DELAY);
+            if (request.data == NULL)
+            {
+                PROBE_BEGIN(PROBE_FLASH_ERASE);
+                result = mflash_drv_erase_internal(request.addr, request.data_len);
+                PROBE_END(PROBE_FLASH_ERASE);
+            }
+            else
+            {
+                PROBE_BEGIN(PROBE_FLASH_WRITE);
+                result = mflash_drv_write_internal(request.addr, request.data, request.data_len);
+                PROBE_END(PROBE_FLASH_WRITE);
+            }
+            (void)xSemaphoreGive(g_mflash_lock);
+
+            taskENTER_CRITICAL();
+            g_mflash_pending--;
+            taskEXIT_CRITICAL();
+
+            if (request.callback != NULL)
+            {
+                request.callback(result, request.arg);
+            }
+        }
+    }
+}
+#endif
+
 /* Initialize SPIFI & flash peripheral,
  * cannot be invoked directly, requires calling wrapper in non XIP memory */
 static int32_t mflash_drv_init_internal(void)
@@ -83,6 +712,10 @@ static int32_t mflash_drv_init_internal(void)
     uint32_t primask = __get_PRIMASK();
 
     __asm("cpsid i");
+    if (primask == 0)
+    {
+        MFLASH_IRQ_OFF();
+    }
 
     spifi_config_t config = {0};
 
@@ -101,7 +734,11 @@ static int32_t mflash_drv_init_internal(void)
 #endif
 
     SPIFI_GetDefaultConfig(&config);
+#if MFLASH_QUAD_MODE
+    config.dualMode = kSPIFI_QuadMode;
+#else
     config.dualMode = kSPIFI_DualMode;
+#endif
 #ifdef XIP_IMAGE
     config.disablePrefetch     = false; // true;
     config.disableCachePrefech = false; // true;
@@ -119,10 +756,30 @@ static int32_t mflash_drv_init_internal(void)
                          SPIFI_CTRL_PRFTCH_DIS(config.disableCachePrefech) | SPIFI_CTRL_DUAL(config.dualMode) |
                          SPIFI_CTRL_RFCLK(config.isReadFullClockCycle) | SPIFI_CTRL_FBCLK(config.isFeedbackClock);
 
+#if MFLASH_SFDP
+    if (mflash_drv_sfdp_probe() == 0)
+    {
+        MFLASH_SPIFI->CTRL = (MFLASH_SPIFI->CTRL & ~SPIFI_CTRL_DUAL_MASK) |
+                             SPIFI_CTRL_DUAL(g_mflash_quad ? kSPIFI_QuadMode : kSPIFI_DualMode);
+    }
+#endif
+
+    if (g_mflash_quad)
+    {
+        mflash_drv_quad_enable();
+    }
+
     mflash_drv_read_mode();
 
+#if MFLASH_ASYNC_MODE
+    /* Cycle counter measures suspend intervals */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
     if (primask == 0)
     {
+        MFLASH_IRQ_ON();
         __asm("cpsie i");
     }
 
@@ -135,15 +792,41 @@ int32_t mflash_drv_init(void)
     volatile int32_t result;
     /* Necessary to have double wrapper call in non_xip memory */
     result = mflash_drv_init_internal();
+
+#if MFLASH_DMA_MODE
+    CLOCK_EnableClock(kCLOCK_Dma);
+    if (DMA0->SRAMBASE == 0)
+    {
+        DMA0->SRAMBASE = (uint32_t)g_mflash_dma_table;
+    }
+    DMA0->CTRL = DMA_CTRL_ENABLE_MASK;
+#endif
+
+#if MFLASH_ASYNC_MODE
+    if (g_mflash_lock == NULL)
+    {
+        g_mflash_lock  = xSemaphoreCreateMutexStatic(&g_mflash_lock_buffer);
+        g_mflash_queue = xQueueCreateStatic(MFLASH_ASYNC_QUEUE_LENGTH, sizeof(mflash_drv_request_t),
+                                            g_mflash_queue_storage, &g_mflash_queue_buffer);
+        (void)xTaskCreateStatic(mflash_drv_task, "mflash", MFLASH_ASYNC_TASK_STACK_SIZE, NULL,
+                                MFLASH_ASYNC_TASK_PRIORITY | portPRIVILEGE_BIT, g_mflash_task_stack,
+                                &g_mflash_task_buffer);
+    }
+#endif
+
     return result;
 }
 
-/* Internal - erase single sector */
-static int32_t mflash_drv_sector_erase(uint32_t sector_addr)
+/* Internal - erase single sector or block using 'erase_cmd' */
+static int32_t mflash_drv_block_erase(uint32_t block_addr, uint32_t erase_cmd)
 {
     uint32_t primask = __get_PRIMASK();
 
     __asm("cpsid i");
+    if (primask == 0)
+    {
+        MFLASH_IRQ_OFF();
+    }
 
     /* Reset the SPIFI to switch to command mode */
     SPIFI_ResetCommand(MFLASH_SPIFI);
@@ -151,16 +834,21 @@ static int32_t mflash_drv_sector_erase(uint32_t sector_addr)
     /* Write enable */
     SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_ENABLE]);
     /* Set address */
-    SPIFI_SetCommandAddress(MFLASH_SPIFI, sector_addr);
-    /* Erase sector */
-    SPIFI_SetCommand(MFLASH_SPIFI, &command[ERASE_SECTOR]);
+    SPIFI_SetCommandAddress(MFLASH_SPIFI, block_addr - FSL_FEATURE_SPIFI_START_ADDR);
+    /* Erase sector/block */
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[erase_cmd]);
     /* Check if finished */
+#if MFLASH_ASYNC_MODE
+    mflash_drv_wait_ready(primask);
+#else
     mflash_drv_check_if_finish();
+#endif
     /* Switch to read mode to enable interrupts as soon ass possible */
     mflash_drv_read_mode();
 
     if (primask == 0)
     {
+        MFLASH_IRQ_ON();
         __asm("cpsie i");
     }
 
@@ -170,36 +858,71 @@ static int32_t mflash_drv_sector_erase(uint32_t sector_addr)
     return 0;
 }
 
-/* Internal - write single page */
-static int32_t mflash_drv_page_program(uint32_t page_addr, const uint32_t *page_data)
+/* Internal - erase single sector */
+static int32_t mflash_drv_sector_erase(uint32_t sector_addr)
+{
+    return mflash_drv_block_erase(sector_addr, ERASE_SECTOR);
+}
+
+/* Internal - program 'g_mflash_page_size' bytes at 'page_addr' */
+static void mflash_drv_program(uint32_t page_addr, const uint32_t *page_data)
 {
     uint32_t primask = __get_PRIMASK();
 
     __asm("cpsid i");
+    if (primask == 0)
+    {
+        MFLASH_IRQ_OFF();
+    }
 
     /* Program page */
     SPIFI_ResetCommand(MFLASH_SPIFI);
     SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_ENABLE]);
-    SPIFI_SetCommandAddress(MFLASH_SPIFI, page_addr);
+    SPIFI_SetCommandAddress(MFLASH_SPIFI, page_addr - FSL_FEATURE_SPIFI_START_ADDR);
     SPIFI_SetCommand(MFLASH_SPIFI, &command[PROGRAM_PAGE]);
 
+#if MFLASH_DMA_MODE
+    /* Let DMA feed the page to SPIFI FIFO by 4B */
+    SPIFI_EnableDMA(MFLASH_SPIFI, true);
+    mflash_drv_dma_start(MFLASH_DMA_CHANNEL, page_data, (void *)&MFLASH_SPIFI->DATA,
+                         g_mflash_page_size / sizeof(page_data[0]), sizeof(page_data[0]), false, true);
+    while (mflash_drv_dma_busy(MFLASH_DMA_CHANNEL))
+    {
+    }
+    SPIFI_EnableDMA(MFLASH_SPIFI, false);
+#else
     /* Store 4B in each loop. Sector has always 4B alignment and size multiple of 4 */
-    for (uint32_t i = 0; i < MFLASH_PAGE_SIZE / sizeof(page_data[0]); i++)
+    for (uint32_t i = 0; i < g_mflash_page_size / sizeof(page_data[0]); i++)
     {
         SPIFI_WriteData(MFLASH_SPIFI, page_data[i]);
     }
+#endif
 
+#if MFLASH_ASYNC_MODE
+    mflash_drv_wait_ready(primask);
+#else
     mflash_drv_check_if_finish();
+#endif
     /* Switch to read mode to enable interrupts as soon ass possible */
     mflash_drv_read_mode();
 
     if (primask == 0)
     {
+        MFLASH_IRQ_ON();
         __asm("cpsie i");
     }
 
     /* Flush pipeline to allow pending interrupts take place */
     __ISB();
+}
+
+/* Internal - write single page, in parts if the flash has smaller pages */
+static int32_t mflash_drv_page_program(uint32_t page_addr, const uint32_t *page_data)
+{
+    for (uint32_t off = 0; off < MFLASH_PAGE_SIZE; off += g_mflash_page_size)
+    {
+        mflash_drv_program(page_addr + off, page_data + off / sizeof(page_data[0]));
+    }
 
     return 0;
 }
@@ -226,56 +949,219 @@ static int32_t mflash_drv_sector_program(uint32_t sector_addr, const uint32_t *s
 }
 #endif
 
-/* Internal - write data of 'data_len' to single sector 'sector_addr', starting from 'sect_off' */
-static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off, const uint8_t *data, uint32_t data_len)
+/* Internal - locate part of 'segment' that falls into sector 'sector_addr', returns false if there is none */
+static bool mflash_drv_segment_in_sector(const mflash_drv_segment_t *segment,
+                                         uint32_t sector_addr,
+                                         uint32_t *sect_off,
+                                         const uint8_t **data,
+                                         uint32_t *data_len)
+{
+    uint32_t start = (uint32_t)segment->addr;
+    uint32_t end   = start + segment->data_len;
+
+    if (start < sector_addr)
+        start = sector_addr;
+    if (end > sector_addr + MFLASH_SECTOR_SIZE)
+        end = sector_addr + MFLASH_SECTOR_SIZE;
+    if (start >= end)
+        return false;
+
+    *sect_off = start - sector_addr;
+    *data     = segment->data + (start - (uint32_t)segment->addr);
+    *data_len = end - start;
+    return true;
+}
+
+#if (MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE <= 32)
+/* Internal - check that 'len' bytes of flash starting at 'addr' are erased, requires read mode */
+static bool mflash_drv_is_blank(uint32_t addr, uint32_t len)
+{
+    const uint8_t *ptr = (const uint8_t *)addr;
+
+    /* Check unaligned head and tail by bytes and the rest by 4B words */
+    for (; (len > 0) && (0 != ((uint32_t)ptr & 0x3)); ptr++, len--)
+    {
+        if (0xFF != *ptr)
+            return false;
+    }
+    for (; len >= sizeof(uint32_t); ptr += sizeof(uint32_t), len -= sizeof(uint32_t))
+    {
+        if (0xFFFFFFFF != *(const uint32_t *)ptr)
+            return false;
+    }
+    for (; len > 0; ptr++, len--)
+    {
+        if (0xFF != *ptr)
+            return false;
+    }
+
+    return true;
+}
+
+/* Internal - program segments into blank areas of sector 'sector_addr'.
+ * Only the pages touched by the data are programmed, the sector is neither read back nor erased */
+static int32_t mflash_drv_sector_append(uint32_t sector_addr, const mflash_drv_segment_t *segments, uint32_t count)
+{
+    const uint32_t page_words = MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0]);
+    uint32_t page_program_map = 0;
+    uint32_t sect_off;
+    const uint8_t *data;
+    uint32_t data_len;
+
+    /* Pad the touched pages with the erased value, programming 0xFF leaves the flash unchanged */
+    for (uint32_t seg = 0; seg < count; seg++)
+    {
+        if (!mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            continue;
+
+        for (uint32_t page_idx = sect_off / MFLASH_PAGE_SIZE; page_idx <= (sect_off + data_len - 1) / MFLASH_PAGE_SIZE;
+             page_idx++)
+        {
+            if (0 == (page_program_map & (1 << page_idx)))
+            {
+                page_program_map |= 1 << page_idx;
+                for (uint32_t i = page_idx * page_words; i < (page_idx + 1) * page_words; i++)
+                {
+                    g_flashm_sector[i] = 0xFFFFFFFF;
+                }
+            }
+        }
+    }
+
+    /* Copy custom data (1B in each loop) to buffer at specific position, in order of segments */
+    for (uint32_t seg = 0; seg < count; seg++)
+    {
+        if (!mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            continue;
+
+        for (uint32_t i = 0; i < data_len; i++)
+        {
+            ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
+        }
+    }
+
+    for (uint32_t page_idx = 0; page_idx < MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE; page_idx++)
+    {
+        if (0 != (page_program_map & (1 << page_idx)))
+        {
+            mflash_drv_page_program(sector_addr + page_idx * MFLASH_PAGE_SIZE, g_flashm_sector + page_idx * page_words);
+        }
+    }
+
+    /* Switch back to read mode */
+    mflash_drv_read_mode();
+    return 0;
+}
+#endif
+
+#if FLASHDRV_SMART_UPDATE
+/* Internal - copy data of 'data_len' to sector buffer at 'sect_off' and evaluate differences to the current data */
+static void mflash_drv_sector_merge(
+    uint32_t sect_off, const uint8_t *data, uint32_t data_len, int *sector_erase_req, uint32_t *page_program_map)
+{
+    /* Copy custom data to buffer at specific position, by 4B where the buffer is word aligned, 1B otherwise */
+    for (uint32_t i = 0; i < data_len;)
+    {
+        uint32_t pos = sect_off + i;
+        uint32_t cur_value;
+        uint32_t new_value;
+
+        if ((0 == (pos & 0x3)) && (data_len - i >= sizeof(uint32_t)))
+        {
+            cur_value = g_flashm_sector[pos / sizeof(uint32_t)];
+            new_value = __UNALIGNED_UINT32_READ(data + i);
+            g_flashm_sector[pos / sizeof(uint32_t)] = new_value;
+            i += sizeof(uint32_t);
+        }
+        else
+        {
+            cur_value = ((uint8_t *)(g_flashm_sector))[pos];
+            new_value = data[i];
+            ((uint8_t *)g_flashm_sector)[pos] = data[i];
+            i++;
+        }
+
+        /* Unless it was already decided to erase the whole sector, evaluate differences between current and new data */
+        if (0 == *sector_erase_req)
+        {
+            /* Check the the bit transitions */
+            if ((cur_value | new_value) != cur_value)
+            {
+                *sector_erase_req = 1; /* A bit needs to be flipped from 0 to 1, the sector has to be erased */
+            }
+            else if (cur_value != new_value)
+            {
+                /* A bit needs to be flipped from 1 to 0, the page has to be programmed,
+                 * a word never crosses page boundary */
+                *page_program_map |= 1 << (pos / MFLASH_PAGE_SIZE);
+            }
+        }
+        else
+        {
+            /* Erase is required anyway, copy the rest without comparing */
+            for (; i < data_len; i++)
+            {
+                ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
+            }
+        }
+    }
+}
+#endif
+
+/* Internal - write all parts of 'count' segments that fall into single sector 'sector_addr', in order of segments */
+static int32_t mflash_drv_sector_update(uint32_t sector_addr, const mflash_drv_segment_t *segments, uint32_t count)
 {
 #if FLASHDRV_SMART_UPDATE
     int sector_erase_req      = 0;
     uint32_t page_program_map = 0; /* Current implementation is limited to 32 pages per sector */
 #endif
+    uint32_t sect_off;
+    const uint8_t *data;
+    uint32_t data_len;
 
     /* Address not aligned to sector boundary */
     if (false == mflash_drv_is_sector_aligned((uint32_t)sector_addr))
         return -1;
-    /* Offset + length exceeed sector size */
-    if (sect_off + data_len > MFLASH_SECTOR_SIZE)
-        return -1;
 
     /* Switch back to read mode */
     mflash_drv_read_mode();
 
+#if (MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE <= 32)
+    /* Fast path for appending to erased area, e.g. sequential writes into a pre-erased slot */
+    bool blank = true;
+    for (uint32_t seg = 0; (seg < count) && blank; seg++)
+    {
+        if (mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            blank = mflash_drv_is_blank(sector_addr + sect_off, data_len);
+    }
+    if (blank)
+    {
+        return mflash_drv_sector_append(sector_addr, segments, count);
+    }
+#endif
+
+#if MFLASH_DMA_MODE
+    /* Let DMA copy old sector data to buffer, the flash is in read mode so other tasks may run from XIP */
+#if MFLASH_ASYNC_MODE
+    mflash_drv_dma_copy((const void *)sector_addr, g_flashm_sector, sizeof(g_flashm_sector),
+                        (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && (__get_PRIMASK() == 0U));
+#else
+    mflash_drv_dma_copy((const void *)sector_addr, g_flashm_sector, sizeof(g_flashm_sector), false);
+#endif
+#else
     /* Copy old sector data by 4B in each loop to buffer */
     for (uint32_t i = 0; i < sizeof(g_flashm_sector) / sizeof(g_flashm_sector[0]); i++)
     {
         g_flashm_sector[i] = *((uint32_t *)(sector_addr) + i);
     }
+#endif
 
 #if FLASHDRV_SMART_UPDATE /* Perform only the erase/program operations that are necessary */
 
-    /* Copy custom data (1B in each loop) to buffer at specific position */
-    for (uint32_t i = 0; i < data_len; i++)
+    for (uint32_t seg = 0; seg < count; seg++)
     {
-        /* Unless it was already decided to erase the whole sector, evaluate differences between current and new data */
-        if (0 == sector_erase_req)
-        {
-            uint8_t cur_value = ((uint8_t *)(g_flashm_sector))[sect_off + i];
-            uint8_t new_value = data[i];
-
-            /* Check the the bit transitions */
-            if ((cur_value | new_value) != cur_value)
-            {
-                sector_erase_req = 1; /* A bit needs to be flipped from 0 to 1, the sector has to be erased */
-            }
-            else if ((cur_value & new_value) != cur_value)
-            {
-                page_program_map |=
-                    1 << ((sect_off + i) /
-                          MFLASH_PAGE_SIZE); /* A bit needs to be flipped from 1 to 0, the page has to be programmed */
-            }
-        }
-
-        /* Copy data over to the buffer */
-        ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
+        if (mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            mflash_drv_sector_merge(sect_off, data, data_len, &sector_erase_req, &page_program_map);
     }
 
     /* Erase the sector if required */
@@ -320,9 +1206,15 @@ static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off,
 #else /* Erase the sector and all the pages unconditionally */
 
     /* Copy custom data (1B in each loop) to buffer at specific position */
-    for (uint32_t i = 0; i < data_len; i++)
+    for (uint32_t seg = 0; seg < count; seg++)
     {
-        ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
+        if (!mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            continue;
+
+        for (uint32_t i = 0; i < data_len; i++)
+        {
+            ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
+        }
     }
 
     /* Erase the sector */
@@ -347,7 +1239,9 @@ static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off,
 /* Erase area of flash, cannot be invoked directly, requires calling wrapper in non XIP memory */
 int32_t mflash_drv_erase_internal(void *addr, uint32_t len)
 {
-    uint32_t sector_addr;
+    uint32_t block_addr;
+    uint32_t block_size;
+    uint32_t erase_cmd;
 
     /* Address not aligned to sector boundary */
     if (false == mflash_drv_is_sector_aligned((uint32_t)addr))
@@ -357,73 +1251,81 @@ int32_t mflash_drv_erase_internal(void *addr, uint32_t len)
     if (0 != len % MFLASH_SECTOR_SIZE)
         return -1;
 
-    sector_addr = (uint32_t)addr;
+    block_addr = (uint32_t)addr;
     while (len)
     {
-        /* Perform blank-check of the sector and erase it if necessary */
-        for (uint32_t i = 0; i < MFLASH_SECTOR_SIZE / sizeof(uint32_t); i++)
+        /* Use the largest erase block that is aligned and fits into the remaining length */
+        if (g_mflash_block64 && (0 == (block_addr & (MFLASH_BLOCK64_SIZE - 1))) && (len >= MFLASH_BLOCK64_SIZE))
         {
-            if (0xFFFFFFFF != *((uint32_t *)(sector_addr) + i))
+            block_size = MFLASH_BLOCK64_SIZE;
+            erase_cmd  = ERASE_BLOCK64;
+        }
+        else if (g_mflash_block32 && (0 == (block_addr & (MFLASH_BLOCK32_SIZE - 1))) && (len >= MFLASH_BLOCK32_SIZE))
+        {
+            block_size = MFLASH_BLOCK32_SIZE;
+            erase_cmd  = ERASE_BLOCK32;
+        }
+        else
+        {
+            block_size = MFLASH_SECTOR_SIZE;
+            erase_cmd  = ERASE_SECTOR;
+        }
+
+        /* Perform blank-check of the block and erase it if necessary */
+        for (uint32_t i = 0; i < block_size / sizeof(uint32_t); i++)
+        {
+            if (0xFFFFFFFF != *((uint32_t *)(block_addr) + i))
             {
-                mflash_drv_sector_erase(sector_addr);
+                mflash_drv_block_erase(block_addr, erase_cmd);
                 break;
             }
         }
-        sector_addr += MFLASH_SECTOR_SIZE;
-        len -= MFLASH_SECTOR_SIZE;
+        block_addr += block_size;
+        len -= block_size;
     }
 
     return 0;
 }
 
-/* Write data to flash, cannot be invoked directly, requires calling wrapper in non XIP memory */
-int32_t mflash_drv_write_internal(void *any_addr, const uint8_t *data, uint32_t data_len)
+/* Write segments to flash, cannot be invoked directly, requires calling wrapper in non XIP memory */
+int32_t mflash_drv_writev_internal(const mflash_drv_segment_t *segments, uint32_t count)
 {
-    uint32_t sect_size = MFLASH_SECTOR_SIZE;
-    /* Interval <0, sector_size) */
-    uint32_t to_write = 0;
-    /* Interval (data_len, 0>  */
-    uint32_t to_remain = data_len;
-    int32_t result     = 0;
-
-    for (
-        /* Calculate address of first sector */
-        uint32_t sect_a = mflash_drv_addr_to_sector_addr((uint32_t)any_addr),
-                 /* and first sector offset */
-        sect_of = mflash_drv_addr_to_sector_of((uint32_t)any_addr),
-                 /* and set first data offset to 0*/
-        data_of = 0;
-        /* Continue until sector address exceed target adddress + data_length */
-        sect_a < ((uint32_t)any_addr) + data_len;
-        /* Move to next sector */
-        sect_a += sect_size,
-                 /* and move pointer to data */
-        data_of += to_write)
-    {
-        /* If remaining data is exceed 'sector_size', write 'sector_size' length */
-        if (to_remain > sect_size - sect_of)
-        {
-            to_write  = sect_size - sect_of;
-            to_remain = to_remain - to_write;
-        }
-        /* else write remaining data length */
-        else
+    uint32_t sect_off;
+    const uint8_t *data;
+    uint32_t data_len;
+
+    for (uint32_t seg = 0; seg < count; seg++)
+    {
+        uint32_t seg_addr = (uint32_t)segments[seg].addr;
+
+        for (uint32_t sect_a = mflash_drv_addr_to_sector_addr(seg_addr); sect_a < seg_addr + segments[seg].data_len;
+             sect_a += MFLASH_SECTOR_SIZE)
         {
-            to_write  = to_remain;
-            to_remain = 0;
-        }
+            /* A sector shared with a later segment is written once, together with the later segment */
+            bool later = false;
+            for (uint32_t next = seg + 1; (next < count) && !later; next++)
+            {
+                later = mflash_drv_segment_in_sector(&segments[next], sect_a, &sect_off, &data, &data_len);
+            }
+            if (later)
+                continue;
 
-        /* Write at 'sect_a' sector, starting at 'sect_of' using '&data[data_of]' of length 'to_write' */
-        result = mflash_drv_sector_update(sect_a, sect_of, data + data_of, to_write);
-        if (0 != result)
-            return -1;
-        /* Only first sector is allowed to have an offset */
-        sect_of = 0;
+            if (0 != mflash_drv_sector_update(sect_a, segments, seg + 1))
+                return -1;
+        }
     }
 
     return 0;
 }
 
+/* Write data to flash, cannot be invoked directly, requires calling wrapper in non XIP memory */
+int32_t mflash_drv_write_internal(void *any_addr, const uint8_t *data, uint32_t data_len)
+{
+    mflash_drv_segment_t segment = {any_addr, data, data_len};
+
+    return mflash_drv_writev_internal(&segment, 1);
+}
+
 /* Calling wrapper for 'mflash_drv_write_internal'.
  * Write 'data' of 'data_len' to 'any_addr' - which doesn't have to be sector aligned.
  * NOTE: Don't try to store constant data that are located in XIP !!
@@ -431,35 +1333,218 @@ int32_t mflash_drv_write_internal(void *any_addr, const uint8_t *data, uint32_t
 int32_t mflash_drv_write(void *any_addr, const uint8_t *data, uint32_t data_len)
 {
     volatile int32_t result;
+#if MFLASH_ASYNC_MODE
+    bool locked = mflash_drv_lock();
+#endif
+    PROBE_BEGIN(PROBE_FLASH_WRITE);
     result = mflash_drv_write_internal(any_addr, data, data_len);
+    PROBE_END(PROBE_FLASH_WRITE);
+#if MFLASH_ASYNC_MODE
+    mflash_drv_unlock(locked);
+#endif
     return result;
 }
 
-#if 0
-/* Dummy test to prove functionality */
-volatile uint32_t lock2 = 1;
-char * tmp_string = "Curabitur sit amet justo ac velit consectetur lobortis. Donec porttitor, eros sed sollicitudin viverra, massa enim placerat sapien, et vestibulum lacus quam et leo. Proin gravida";
+/* Calling wrapper for 'mflash_drv_writev_internal'.
+ * Write 'count' segments, each sector is read-modified-written once even if several segments share it.
+ * Sectors are written in order of the last segment they contain, e.g. a header segment placed last
+ * is programmed after all the data in other sectors.
+ * NOTE: Don't try to store constant data that are located in XIP !!
+ */
+int32_t mflash_drv_writev(const mflash_drv_segment_t *segments, uint32_t count)
+{
+    volatile int32_t result;
+#if MFLASH_ASYNC_MODE
+    bool locked = mflash_drv_lock();
+#endif
+    PROBE_BEGIN(PROBE_FLASH_WRITE);
+    result = mflash_drv_writev_internal(segments, count);
+    PROBE_END(PROBE_FLASH_WRITE);
+#if MFLASH_ASYNC_MODE
+    mflash_drv_unlock(locked);
+#endif
+    return result;
+}
 
-void mflash_drv_do_test(void)
+/* Calling wrapper for 'mflash_drv_erase_internal'.
+ * Erase 'len' bytes at 'addr', both have to be sector aligned. Blank blocks are skipped.
+ */
+int32_t mflash_drv_erase(void *addr, uint32_t len)
 {
-    lock2 = 1;
-    while (lock2);
+    volatile int32_t result;
+#if MFLASH_ASYNC_MODE
+    bool locked = mflash_drv_lock();
+#endif
+    PROBE_BEGIN(PROBE_FLASH_ERASE);
+    result = mflash_drv_erase_internal(addr, len);
+    PROBE_END(PROBE_FLASH_ERASE);
+#if MFLASH_ASYNC_MODE
+    mflash_drv_unlock(locked);
+#endif
+    return result;
+}
 
-    // place to SRAM !!!
-#ifndef XIP_IMAGE
-    BOARD_InitSPIFI();
+/* Read 'data_len' bytes at 'any_addr' of memory mapped flash to 'data'.
+ * Waits for pending asynchronous requests, a DMA copy yields the CPU to other tasks of the same priority.
+ */
+int32_t mflash_drv_read(const void *any_addr, uint8_t *data, uint32_t data_len)
+{
+#if MFLASH_ASYNC_MODE
+    bool locked = mflash_drv_lock();
+#endif
+#if MFLASH_DMA_MODE
+#if MFLASH_ASYNC_MODE
+    mflash_drv_dma_copy(any_addr, data, data_len, locked);
+#else
+    mflash_drv_dma_copy(any_addr, data, data_len, false);
+#endif
+#else
+    memcpy(data, any_addr, data_len);
 #endif
+#if MFLASH_ASYNC_MODE
+    mflash_drv_unlock(locked);
+#endif
+    return 0;
+}
 
-    /* Reset peripheral */
-    lock2 = 1;
-    while (lock2);
-    mflash_drv_init();
+#if MFLASH_ASYNC_MODE
+/* Queue a write of 'data' of 'data_len' to 'any_addr' for the mflash task and return immediately.
+ * 'callback' is invoked with the result of 'mflash_drv_write' once done, 'data' must stay valid until then.
+ * Returns -1 if the driver is not initialized or the queue is full */
+int32_t mflash_drv_write_async(
+    void *any_addr, const uint8_t *data, uint32_t data_len, mflash_drv_callback_t callback, void *arg)
+{
+    mflash_drv_request_t request = {any_addr, data, data_len, callback, arg};
 
-    lock2 = 1;
-    while (lock2)
-    mflash_drv_write((void*)(0x10800010), tmp_string, 30);//TODO force read to recover
+    if (data == NULL)
+        return -1;
 
-    lock2 = 1;
-    while (lock2);
+    return mflash_drv_queue_request(&request);
+}
+
+/* Queue an erase of 'len' bytes at 'addr' for the mflash task and return immediately.
+ * Synchronous writes issued later wait until the erase completes, 'callback' is invoked with its result.
+ * Returns -1 if the driver is not initialized or the queue is full */
+int32_t mflash_drv_erase_async(void *addr, uint32_t len, mflash_drv_callback_t callback, void *arg)
+{
+    mflash_drv_request_t request = {addr, NULL, len, callback, arg};
+
+    return mflash_drv_queue_request(&request);
 }
 #endif
+
+/* API - true while queued requests wait or an erase/program is suspended, safe with interrupts disabled.
+ * Synchronous updates without MFLASH_ASYNC_MODE never leave the flash busy when they return */
+bool mflash_drv_is_busy(void)
+{
+#if MFLASH_ASYNC_MODE
+    return (g_mflash_pending != 0) || g_mflash_suspended;
+#else
+    return false;
+#endif
+}
+
+#if MFLASH_BENCHMARK
+/* Print a single benchmark result, 'cycles' for 'count' operations of 'bytes' each */
+static void mflash_drv_bench_report(const char *op, uint32_t count, uint32_t bytes, uint32_t cycles)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+    uint32_t us            = cycles / cycles_per_us;
+    uint32_t kbps          = (us > 0) ? (uint32_t)(((uint64_t)count * bytes * 1000000U) / ((uint64_t)us * 1024U)) : 0;
+
+    PRINTF("MFLASH_BENCH,%s,%s,%u,%u,%u,%u\r\n", op, g_mflash_quad ? "quad" : (g_mflash_dual ? "dual" : "serial"), count, bytes,
+           us / count, kbps);
+}
+
+/* On-target characterization of the flash, destroys the content of 'scratch_addr',
+ * which must be aligned to and at least MFLASH_BLOCK64_SIZE long.
+ * Prints one line per operation: MFLASH_BENCH,op,mode,count,bytes,us_per_op,KB_per_s
+ * and the longest interrupts disabled window: MFLASH_BENCH,irq_off,mode,1,0,us,0 */
+int32_t mflash_drv_benchmark(void *scratch_addr, uint32_t scratch_len)
+{
+    uint32_t addr = (uint32_t)scratch_addr;
+    uint32_t start;
+    uint32_t page_words = MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0]);
+    uint32_t pages      = MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE;
+    uint8_t patch[16];
+
+    if ((0 != (addr & (MFLASH_BLOCK64_SIZE - 1))) || (scratch_len < MFLASH_BLOCK64_SIZE))
+        return -1;
+
+#if MFLASH_ASYNC_MODE
+    bool locked = mflash_drv_lock();
+#endif
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    g_mflash_irq_off_max = 0;
+
+    PRINTF("MFLASH_BENCH,op,mode,count,bytes,us_per_op,KB_per_s\r\n");
+
+    start = DWT->CYCCNT;
+    mflash_drv_block_erase(addr, ERASE_BLOCK64);
+    mflash_drv_bench_report("erase_64k", 1, MFLASH_BLOCK64_SIZE, DWT->CYCCNT - start);
+
+    start = DWT->CYCCNT;
+    mflash_drv_block_erase(addr, ERASE_BLOCK32);
+    mflash_drv_bench_report("erase_32k", 1, MFLASH_BLOCK32_SIZE, DWT->CYCCNT - start);
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        mflash_drv_sector_erase(addr + i * MFLASH_SECTOR_SIZE);
+    }
+    mflash_drv_bench_report("erase_sector", 4, MFLASH_SECTOR_SIZE, DWT->CYCCNT - start);
+
+    for (uint32_t i = 0; i < sizeof(g_flashm_sector) / sizeof(g_flashm_sector[0]); i++)
+    {
+        g_flashm_sector[i] = 0xA5A50000 | i;
+    }
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        mflash_drv_page_program(addr + i * MFLASH_PAGE_SIZE, g_flashm_sector + i * page_words);
+    }
+    mflash_drv_bench_report("page_program", pages, MFLASH_PAGE_SIZE, DWT->CYCCNT - start);
+
+    /* Flipping bits back to 1 forces read-modify-write of the whole sector */
+    for (uint32_t i = 0; i < sizeof(patch); i++)
+    {
+        patch[i] = 0xFF;
+    }
+    start = DWT->CYCCNT;
+    mflash_drv_write_internal((void *)(addr + MFLASH_SECTOR_SIZE / 2), patch, sizeof(patch));
+    mflash_drv_bench_report("rmw_update", 1, sizeof(patch), DWT->CYCCNT - start);
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < MFLASH_BLOCK64_SIZE / MFLASH_SECTOR_SIZE; i++)
+    {
+        memcpy(g_flashm_sector, (void *)(addr + i * MFLASH_SECTOR_SIZE), MFLASH_SECTOR_SIZE);
+    }
+    mflash_drv_bench_report("read_memcpy", MFLASH_BLOCK64_SIZE / MFLASH_SECTOR_SIZE, MFLASH_SECTOR_SIZE,
+                            DWT->CYCCNT - start);
+
+#if MFLASH_DMA_MODE
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < MFLASH_BLOCK64_SIZE / MFLASH_SECTOR_SIZE; i++)
+    {
+        mflash_drv_dma_start(MFLASH_DMA_READ_CHANNEL, (void *)(addr + i * MFLASH_SECTOR_SIZE), g_flashm_sector,
+                             MFLASH_SECTOR_SIZE / sizeof(uint32_t), sizeof(uint32_t), true, false);
+        while (mflash_drv_dma_busy(MFLASH_DMA_READ_CHANNEL))
+        {
+        }
+    }
+    mflash_drv_bench_report("read_dma", MFLASH_BLOCK64_SIZE / MFLASH_SECTOR_SIZE, MFLASH_SECTOR_SIZE,
+                            DWT->CYCCNT - start);
+#endif
+
+    mflash_drv_bench_report("irq_off", 1, 0, g_mflash_irq_off_max);
+
+#if MFLASH_ASYNC_MODE
+    mflash_drv_unlock(locked);
+#endif
+    return 0;
+}
+#endif
+
+#endif /* MFLASH_BOOT_API */
@@ -31,6 +31,126 @@
 #define MFLASH_BAUDRATE (96000000)
 #endif
 
+/* Use quad I/O for memory mapped reads and page programming, 0 for serial I/O, or dual I/O with MFLASH_SFDP */
+#ifndef MFLASH_QUAD_MODE
+#define MFLASH_QUAD_MODE (1)
+#endif
+
+/* Quad I/O read opcode, address and data on four lines, 6 dummy clocks */
+#ifndef MFLASH_QUAD_READ_OPCODE
+#define MFLASH_QUAD_READ_OPCODE (0xEB)
+#endif
+
+/* Quad page program opcode, serial address and quad data */
+#ifndef MFLASH_QUAD_PROGRAM_OPCODE
+#define MFLASH_QUAD_PROGRAM_OPCODE (0x32)
+#endif
+
+/* Read/write opcodes of the status register holding the quad enable bit,
+ * defaults match the W25Q128JV status register 2 */
+#ifndef MFLASH_QE_READ_OPCODE
+#define MFLASH_QE_READ_OPCODE (0x35)
+#endif
+
+#ifndef MFLASH_QE_WRITE_OPCODE
+#define MFLASH_QE_WRITE_OPCODE (0x31)
+#endif
+
+#ifndef MFLASH_QE_MASK
+#define MFLASH_QE_MASK (0x02)
+#endif
+
+/* Block erase sizes, erase requests are split into the largest aligned blocks */
+#ifndef MFLASH_BLOCK32_SIZE
+#define MFLASH_BLOCK32_SIZE (0x8000)
+#endif
+
+#ifndef MFLASH_BLOCK64_SIZE
+#define MFLASH_BLOCK64_SIZE (0x10000)
+#endif
+
+/* Read the SFDP tables of the flash at init and use the fastest read, the erase and page sizes, the quad enable
+ * method and the suspend commands they describe. Each board then runs at the best throughput of its flash without
+ * a build of its own, the opcodes and the quad enable register below are only used for flashes without SFDP.
+ * The SPIFI clock has no SFDP parameter and stays MFLASH_BAUDRATE */
+#ifndef MFLASH_SFDP
+#define MFLASH_SFDP (1)
+#endif
+
+/* Call the flash driver exported by the bootloader through its API table, see BOOT_API_EXPORT in spifi_boot.h,
+ * instead of building this one, which leaves the driver and fsl_spifi.c out of the image. The driver of the
+ * bootloader is synchronous, it keeps the interrupts disabled for the whole erase or program of a sector */
+#ifndef MFLASH_BOOT_API
+#define MFLASH_BOOT_API (0)
+#endif
+
+/* Suspend erase/program operations when an interrupt is pending and at regular intervals to let
+ * interrupts and other tasks run from XIP while the flash is busy, requires FreeRTOS */
+#ifndef MFLASH_ASYNC_MODE
+#if defined(FSL_RTOS_FREE_RTOS) && !MFLASH_BOOT_API
+#define MFLASH_ASYNC_MODE (1)
+#else
+#define MFLASH_ASYNC_MODE (0)
+#endif
+#endif
+
+/* Longest time the flash is left busy with interrupts disabled before the operation is suspended */
+#ifndef MFLASH_ASYNC_SLICE_US
+#define MFLASH_ASYNC_SLICE_US (1000)
+#endif
+
+/* Time an operation runs after a resume before a pending interrupt suspends it again, bounds the interrupt
+ * latency with the suspend time of the flash (20 us max on the W25Q128JV) and guarantees progress of the
+ * operation. Must be at least the minimum resume to suspend interval of the flash */
+#ifndef MFLASH_ASYNC_RESUME_US
+#define MFLASH_ASYNC_RESUME_US (50)
+#endif
+
+/* Ticks to delay while an operation is suspended, 0 only yields to tasks of the same priority */
+#ifndef MFLASH_ASYNC_YIELD_TICKS
+#define MFLASH_ASYNC_YIELD_TICKS (0)
+#endif
+
+/* Maximum number of pending 'mflash_drv_write_async' requests */
+#ifndef MFLASH_ASYNC_QUEUE_LENGTH
+#define MFLASH_ASYNC_QUEUE_LENGTH (4)
+#endif
+
+/* Feed page program data to the SPIFI and copy 'mflash_drv_read' data with DMA, the driver owns the DMA0 descriptor table */
+#ifndef MFLASH_DMA_MODE
+#define MFLASH_DMA_MODE (0)
+#endif
+
+/* DMA channel wired to the SPIFI request */
+#ifndef MFLASH_DMA_CHANNEL
+#define MFLASH_DMA_CHANNEL (18)
+#endif
+
+/* DMA channel for memory to memory copies out of the memory mapped window */
+#ifndef MFLASH_DMA_READ_CHANNEL
+#define MFLASH_DMA_READ_CHANNEL (29)
+#endif
+
+/* Build 'mflash_drv_benchmark' and track the longest interrupts disabled window */
+#ifndef MFLASH_BENCHMARK
+#define MFLASH_BENCHMARK (0)
+#endif
+
+#if MFLASH_BOOT_API && (MFLASH_ASYNC_MODE || MFLASH_DMA_MODE || MFLASH_BENCHMARK)
+#error "MFLASH_BOOT_API calls the synchronous driver of the bootloader, without MFLASH_ASYNC_MODE, MFLASH_DMA_MODE or MFLASH_BENCHMARK"
+#endif
+
+/* Segment of 'mflash_drv_writev' */
+typedef struct
+{
+    void *addr;
+    const uint8_t *data;
+    uint32_t data_len;
+} mflash_drv_segment_t;
+
+/* Completion callback of 'mflash_drv_write_async' and 'mflash_drv_erase_async', runs in the mflash task */
+typedef void (*mflash_drv_callback_t)(int32_t result, void *arg);
+
 static inline uint32_t mflash_drv_is_sector_aligned(uint32_t addr)
 {
     return ((addr) & (MFLASH_SECTOR_MASK)) == 0 ? true : false;
@@ -48,5 +168,17 @@ static inline uint32_t mflash_drv_addr_to_sector_of(uint32_t addr)
 
 int32_t mflash_drv_init(void);
 int32_t mflash_drv_write(void *any_addr, const uint8_t *data, uint32_t data_len);
+int32_t mflash_drv_writev(const mflash_drv_segment_t *segments, uint32_t count);
+int32_t mflash_drv_erase(void *addr, uint32_t len);
+int32_t mflash_drv_read(const void *any_addr, uint8_t *data, uint32_t data_len);
+#if MFLASH_ASYNC_MODE
+int32_t mflash_drv_write_async(
+    void *any_addr, const uint8_t *data, uint32_t data_len, mflash_drv_callback_t callback, void *arg);
+int32_t mflash_drv_erase_async(void *addr, uint32_t len, mflash_drv_callback_t callback, void *arg);
+#endif
+bool mflash_drv_is_busy(void);
+#if MFLASH_BENCHMARK
+int32_t mflash_drv_benchmark(void *scratch_addr, uint32_t scratch_len);
+#endif
 
 #endif
@@ -10,10 +10,19 @@
 #include "FreeRTOS.h"
 #include "mflash_file.h"
 #include "mflash_drv.h"
+#include "fsl_crc32.h"
 
 static mflash_file_t *g_file_table = NULL;
 static bool g_mflash_initialized   = false;
 
+#if (MFLASH_FILE_INDEX_SIZE & (MFLASH_FILE_INDEX_SIZE - 1)) != 0
+#error "MFLASH_FILE_INDEX_SIZE must be a power of 2"
+#endif
+
+/* Open addressing index of the file table by path hash, slots hold table index + 1, 0 is empty */
+static uint8_t g_file_index[MFLASH_FILE_INDEX_SIZE];
+static uint32_t g_file_hash[MFLASH_FILE_INDEX_SIZE];
+
 #if 0
 /* Example of NULL terminated file table */
 mflash_file_t g_flash_files[] = {
@@ -33,6 +42,48 @@ typedef struct
     uint32_t magic_no;
 } mfile_meta_t;
 
+/* FNV-1a hash of the path */
+uint32_t mflash_path_hash(const char *path)
+{
+    uint32_t hash = 0x811C9DC5;
+
+    for (uint32_t i = 0; (i < MFLASH_FILE_PATH_MAX) && (path[i] != '\0'); i++)
+    {
+        hash ^= (uint8_t)path[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/* Builds the path index of the file table, fails if there are too many files for the index */
+static bool mflash_build_index(mflash_file_t *file_table)
+{
+    uint32_t count = 0;
+
+    memset(g_file_index, 0, sizeof(g_file_index));
+
+    for (mflash_file_t *tmp_file = file_table; (0 != tmp_file->flash_addr) && (0 != tmp_file->max_size);
+         tmp_file += 1, count++)
+    {
+        /* Keep at least one empty slot so that the probing of a missing path ends */
+        if (count >= MFLASH_FILE_INDEX_SIZE - 1)
+            return false;
+
+        uint32_t hash = mflash_path_hash(tmp_file->path);
+        uint32_t slot = hash & (MFLASH_FILE_INDEX_SIZE - 1);
+        while (g_file_index[slot] != 0)
+            slot = (slot + 1) & (MFLASH_FILE_INDEX_SIZE - 1);
+
+        g_file_index[slot] = count + 1;
+        g_file_hash[slot]  = hash;
+    }
+    return true;
+}
+
+#if MFLASH_FILE_LOG
+static int32_t mflash_log_init(void);
+#endif
+
 bool mflash_is_initialized()
 {
     return g_mflash_initialized;
@@ -59,39 +110,327 @@ BaseType_t mflash_init(mflash_file_t *user_file_table, bool init_drv)
         if (!mflash_drv_is_sector_aligned(tmp_file->max_size))
             return pdFALSE;
     }
+    if (!mflash_build_index(user_file_table))
+        return pdFALSE;
     /* Store reference to user*/
     g_file_table = user_file_table;
     /* Init flash driver */
     if (init_drv)
         mflash_drv_init();
 
+#if MFLASH_FILE_LOG
+    if (0 != mflash_log_init())
+        return pdFALSE;
+#endif
+
     g_mflash_initialized = true;
     return pdTRUE;
 }
 
+/* Find index of a file in file_table */
+static int32_t mflash_find_entry(const char *path)
+{
+    /* Check file_table */
+    if (NULL == g_file_table)
+        return -1;
+
+    uint32_t hash = mflash_path_hash(path);
+    for (uint32_t slot = hash & (MFLASH_FILE_INDEX_SIZE - 1); g_file_index[slot] != 0;
+         slot = (slot + 1) & (MFLASH_FILE_INDEX_SIZE - 1))
+    {
+        int32_t entry = g_file_index[slot] - 1;
+
+        /* Found a file by path, the hash only shortcuts the comparison */
+        if ((g_file_hash[slot] == hash) && (0 == strncmp(path, g_file_table[entry].path, MFLASH_FILE_PATH_MAX)))
+            return entry;
+    }
+    return -1;
+}
+
 /* Find a file in file_table */
 int32_t mflash_find_file(char *path, mflash_file_t *file)
 {
-    int32_t status = -1;
+    int32_t entry = mflash_find_entry(path);
 
-    /* Check file_table */
-    if (NULL == g_file_table)
+    if (entry < 0)
         return -1;
 
-    for (mflash_file_t *tmp_file = g_file_table; (0 != tmp_file->flash_addr) && (0 != tmp_file->max_size);
-         tmp_file += 1)
+    *file = g_file_table[entry];
+    return 0;
+}
+
+#if MFLASH_FILE_LOG
+
+/* Log bank header, written last when a bank is compacted */
+#define MFLASH_LOG_BANK_MAGIC (0x474F4C4D)
+/* Record header, written after the record data */
+#define MFLASH_LOG_RECORD_MAGIC (0x43455246)
+#define MFLASH_LOG_ERASED (0xFFFFFFFF)
+
+typedef struct
+{
+    uint32_t magic_no;
+    uint32_t sequence;
+    uint32_t reserved[2];
+} mflash_log_bank_t;
+
+typedef struct
+{
+    uint32_t magic_no;
+    uint32_t path_hash;
+    uint32_t file_size;
+    uint32_t crc; /* CRC32 of the data, see CRC32_Update() */
+} mflash_log_record_t;
+
+#define MFLASH_LOG_BANK_ADDR(bank) (MFLASH_LOG_BASEADDR + (bank)*MFLASH_LOG_BANK_SIZE)
+#define MFLASH_LOG_RECORD_SIZE(file_size) (sizeof(mflash_log_record_t) + (((file_size) + 3) & ~3u))
+
+/* Active bank, its sequence number and the address where the next record is appended */
+static uint32_t g_log_bank;
+static uint32_t g_log_sequence;
+static uint32_t g_log_tail;
+/* Address of the latest record of each file of the table, 0 if there is none */
+static uint32_t g_log_index[MFLASH_FILE_INDEX_SIZE];
+/* Bounce buffer for copies from FLASH to FLASH, the source can not be read while the FLASH is programmed */
+static uint8_t g_log_buffer[MFLASH_PAGE_SIZE];
+
+/* Copies data between FLASH locations through the RAM bounce buffer */
+static int32_t mflash_log_copy(uint32_t dst, uint32_t src, uint32_t len)
+{
+    while (len > 0)
     {
-        /* Found a file by path */
-        if (0 == strncmp(path, tmp_file->path, 64))
+        uint32_t chunk = (len < sizeof(g_log_buffer)) ? len : sizeof(g_log_buffer);
+
+        if ((0 != mflash_drv_read((void *)src, g_log_buffer, chunk)) ||
+            (0 != mflash_drv_write((void *)dst, g_log_buffer, chunk)))
+            return -1;
+        dst += chunk;
+        src += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* Appends a record at the tail of the active bank, the data is written before the header so a record
+ * interrupted by a power cut has no header and is never indexed */
+static int32_t mflash_log_append(int32_t entry, const uint8_t *data, uint32_t data_size, bool data_in_flash)
+{
+    mflash_log_record_t record;
+    uint32_t addr = g_log_tail;
+
+    record.magic_no  = MFLASH_LOG_RECORD_MAGIC;
+    record.path_hash = mflash_path_hash(g_file_table[entry].path);
+    record.file_size = data_size;
+    record.crc       = CRC32_Update(0, data, data_size);
+
+    if (data_in_flash)
+    {
+        if (0 != mflash_log_copy(addr + sizeof(record), (uint32_t)data, data_size))
+            return -1;
+    }
+    else if ((data_size > 0) && (0 != mflash_drv_write((void *)(addr + sizeof(record)), data, data_size)))
+    {
+        return -1;
+    }
+    if (0 != mflash_drv_write((void *)addr, (uint8_t *)&record, sizeof(record)))
+        return -1;
+
+    g_log_index[entry] = addr;
+    g_log_tail         = addr + MFLASH_LOG_RECORD_SIZE(data_size);
+    return 0;
+}
+
+/* Copies the latest record of each file to the spare bank and makes it the active bank.
+ * The old bank stays valid until the header of the new bank is written */
+static int32_t mflash_log_compact(void)
+{
+    uint32_t bank = g_log_bank ^ 1;
+    uint32_t addr = MFLASH_LOG_BANK_ADDR(bank) + sizeof(mflash_log_bank_t);
+    uint32_t index[MFLASH_FILE_INDEX_SIZE] = {0};
+    mflash_log_bank_t header = {MFLASH_LOG_BANK_MAGIC, g_log_sequence + 1, {MFLASH_LOG_ERASED, MFLASH_LOG_ERASED}};
+
+    /* the bank is normally erased in background after the previous compaction */
+    if (0 != mflash_drv_erase((void *)MFLASH_LOG_BANK_ADDR(bank), MFLASH_LOG_BANK_SIZE))
+        return -1;
+
+    for (int32_t entry = 0; (0 != g_file_table[entry].flash_addr) && (0 != g_file_table[entry].max_size); entry++)
+    {
+        mflash_log_record_t *record = (mflash_log_record_t *)g_log_index[entry];
+        uint32_t size;
+
+        if (NULL == record)
+            continue;
+
+        size = MFLASH_LOG_RECORD_SIZE(record->file_size);
+        if (0 != mflash_log_copy(addr, (uint32_t)record, size))
+            return -1;
+        index[entry] = addr;
+        addr += size;
+    }
+
+    if (0 != mflash_drv_write((void *)MFLASH_LOG_BANK_ADDR(bank), (uint8_t *)&header, sizeof(header)))
+        return -1;
+
+    memcpy(g_log_index, index, sizeof(g_log_index));
+    g_log_bank     = bank;
+    g_log_sequence = header.sequence;
+    g_log_tail     = addr;
+
+#if MFLASH_ASYNC_MODE
+    /* prepare the old bank for the next compaction */
+    (void)mflash_drv_erase_async((void *)MFLASH_LOG_BANK_ADDR(bank ^ 1), MFLASH_LOG_BANK_SIZE, NULL, NULL);
+#endif
+    return 0;
+}
+
+/* Builds the RAM index from the records of the active bank */
+static int32_t mflash_log_scan(void)
+{
+    mflash_log_bank_t *banks[2] = {(mflash_log_bank_t *)MFLASH_LOG_BANK_ADDR(0),
+                                   (mflash_log_bank_t *)MFLASH_LOG_BANK_ADDR(1)};
+    uint32_t bank_end;
+    uint32_t addr;
+    bool clean = true;
+
+    memset(g_log_index, 0, sizeof(g_log_index));
+
+    /* pick the bank with the most recent valid header */
+    if ((banks[0]->magic_no != MFLASH_LOG_BANK_MAGIC) && (banks[1]->magic_no != MFLASH_LOG_BANK_MAGIC))
+    {
+        /* empty store, start with the 'compaction' of nothing into bank 0 */
+        g_log_bank     = 1;
+        g_log_sequence = 0;
+        return 1;
+    }
+    if (banks[1]->magic_no != MFLASH_LOG_BANK_MAGIC)
+        g_log_bank = 0;
+    else if (banks[0]->magic_no != MFLASH_LOG_BANK_MAGIC)
+        g_log_bank = 1;
+    else
+        g_log_bank = ((int32_t)(banks[1]->sequence - banks[0]->sequence) > 0) ? 1 : 0;
+    g_log_sequence = banks[g_log_bank]->sequence;
+
+    bank_end = MFLASH_LOG_BANK_ADDR(g_log_bank) + MFLASH_LOG_BANK_SIZE;
+    for (addr = MFLASH_LOG_BANK_ADDR(g_log_bank) + sizeof(mflash_log_bank_t);
+         addr + sizeof(mflash_log_record_t) <= bank_end;)
+    {
+        mflash_log_record_t *record = (mflash_log_record_t *)addr;
+        uint8_t *data               = (uint8_t *)(addr + sizeof(*record));
+
+        if (record->magic_no == MFLASH_LOG_ERASED)
+            break;
+        if ((record->magic_no != MFLASH_LOG_RECORD_MAGIC) ||
+            (addr + MFLASH_LOG_RECORD_SIZE(record->file_size) > bank_end))
         {
-            status = 0;
-            *file  = *tmp_file;
+            /* the rest of the bank can not be parsed */
+            clean = false;
             break;
         }
+        if (record->crc == CRC32_Update(0, data, record->file_size))
+        {
+            /* later records of the same file supersede earlier ones */
+            for (int32_t entry = 0; (0 != g_file_table[entry].flash_addr) && (0 != g_file_table[entry].max_size);
+                 entry++)
+            {
+                if ((record->path_hash == mflash_path_hash(g_file_table[entry].path)) &&
+                    (record->file_size <= g_file_table[entry].max_size))
+                {
+                    g_log_index[entry] = addr;
+                    break;
+                }
+            }
+        }
+        addr += MFLASH_LOG_RECORD_SIZE(record->file_size);
     }
-    return status;
+    g_log_tail = addr;
+
+    /* data of an interrupted append may follow the last record, it must not be programmed over */
+    for (; clean && (addr < bank_end); addr += 4)
+    {
+        if (*(uint32_t *)addr != MFLASH_LOG_ERASED)
+            clean = false;
+    }
+    return clean ? 0 : 1;
 }
 
+/* Builds the index of the log and moves files of the fixed sector layout to the log */
+static int32_t mflash_log_init(void)
+{
+    int32_t result = mflash_log_scan();
+
+    if (result < 0)
+        return -1;
+
+    if (result > 0)
+    {
+        bool empty = (g_log_sequence == 0);
+
+        if (0 != mflash_log_compact())
+            return -1;
+
+        /* import files saved in place by previous versions */
+        for (int32_t entry = 0; empty && (0 != g_file_table[entry].flash_addr) && (0 != g_file_table[entry].max_size);
+             entry++)
+        {
+            mfile_meta_t *meta = (mfile_meta_t *)g_file_table[entry].flash_addr;
+
+            if ((MFLASH_META_MAGIC_NO == meta->magic_no) && (meta->file_size <= g_file_table[entry].max_size) &&
+                (g_log_tail + MFLASH_LOG_RECORD_SIZE(meta->file_size) <= MFLASH_LOG_BANK_ADDR(g_log_bank) + MFLASH_LOG_BANK_SIZE))
+            {
+                if (0 != mflash_log_append(entry, (uint8_t *)(meta + 1), meta->file_size, true))
+                    return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* API, write to file of path 'pcFileName' */
+BaseType_t mflash_save_file(char *pcFileName, uint8_t *pucData, uint32_t ulDataSize)
+{
+    int32_t entry = mflash_find_entry(pcFileName);
+    uint32_t bank_end;
+
+    /* No file was found in file table or trying to write data over file boundary */
+    if ((entry < 0) || (ulDataSize > g_file_table[entry].max_size))
+        return pdFALSE;
+
+    /* compact the log when the record does not fit, the current record of the file is kept until the
+     * new one is written so the update stays atomic */
+    bank_end = MFLASH_LOG_BANK_ADDR(g_log_bank) + MFLASH_LOG_BANK_SIZE;
+    if (g_log_tail + MFLASH_LOG_RECORD_SIZE(ulDataSize) > bank_end)
+    {
+        if (0 != mflash_log_compact())
+            return pdFALSE;
+        bank_end = MFLASH_LOG_BANK_ADDR(g_log_bank) + MFLASH_LOG_BANK_SIZE;
+        if (g_log_tail + MFLASH_LOG_RECORD_SIZE(ulDataSize) > bank_end)
+            return pdFALSE;
+    }
+
+    if (0 != mflash_log_append(entry, pucData, ulDataSize, false))
+        return pdFALSE;
+    return pdTRUE;
+}
+
+/* API, read file of path 'pcFileName' */
+BaseType_t mflash_read_file(char *pcFileName, uint8_t **ppucData, uint32_t *pulDataSize)
+{
+    int32_t entry = mflash_find_entry(pcFileName);
+    mflash_log_record_t *record;
+
+    /* No file was found in file table or it has not been saved yet */
+    if ((entry < 0) || (0 == g_log_index[entry]))
+        return pdFALSE;
+
+    /* Set file size and set data pointer to real_data */
+    record       = (mflash_log_record_t *)g_log_index[entry];
+    *pulDataSize = record->file_size;
+    *ppucData    = (uint8_t *)(record + 1);
+    return pdTRUE;
+}
+
+#else /* MFLASH_FILE_LOG */
+
 /* NOTE: Don't try to store constant data that are located in XIP !! */
 /* API, write to file of path 'pcFileName' */
 BaseType_t mflash_save_file(char *pcFileName, uint8_t *pucData, uint32_t ulDataSize)
@@ -105,13 +444,16 @@ BaseType_t mflash_save_file(char *pcFileName, uint8_t *pucData, uint32_t ulDataS
     /* Trying to write data over file boundary */
     if (ulDataSize > tmp_file.max_size + sizeof(tmp_meta))
         return pdFALSE;
-    /* Write real data after a meta data location */
-    if (0 != mflash_drv_write((void *)(tmp_file.flash_addr + sizeof(tmp_meta)), pucData, ulDataSize))
-        return pdFALSE;
-    /* Set & write meta data before a real data */
+    /* Set meta data */
     tmp_meta.magic_no  = MFLASH_META_MAGIC_NO;
     tmp_meta.file_size = ulDataSize;
-    if (0 != mflash_drv_write((void *)tmp_file.flash_addr, (uint8_t *)&tmp_meta, sizeof(tmp_meta)))
+    /* Write real data after a meta data location and meta data before it, in a single update of the shared sector.
+     * Meta data goes last so that sectors holding only real data are written before it */
+    mflash_drv_segment_t segments[] = {
+        {(void *)(tmp_file.flash_addr + sizeof(tmp_meta)), pucData, ulDataSize},
+        {(void *)tmp_file.flash_addr, (uint8_t *)&tmp_meta, sizeof(tmp_meta)},
+    };
+    if (0 != mflash_drv_writev(segments, sizeof(segments) / sizeof(segments[0])))
         return pdFALSE;
     return pdTRUE;
 }
@@ -137,3 +479,5 @@ BaseType_t mflash_read_file(char *pcFileName, uint8_t **ppucData, uint32_t *pulD
     *ppucData    = (uint8_t *)(tmp_file.flash_addr + sizeof(*tmp_meta));
     return pdTRUE;
 }
+
+#endif /* MFLASH_FILE_LOG */
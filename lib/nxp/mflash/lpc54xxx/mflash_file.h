@@ -19,10 +19,36 @@ typedef struct
 #define MFLASH_FILE_BASEADDR (0x10800000)
 #define MFLASH_FILE_SIZE (MFLASH_SECTOR_SIZE)
 
+/* Store files as append-only records of a log in two banks instead of in place at 'flash_addr',
+ * 'flash_addr' is then only read to import files saved by previous versions */
+#ifndef MFLASH_FILE_LOG
+#define MFLASH_FILE_LOG (1)
+#endif
+
+/* Log area following the fixed file sectors, the log is compacted from one bank to the other when full */
+#ifndef MFLASH_LOG_BASEADDR
+#define MFLASH_LOG_BASEADDR (MFLASH_FILE_BASEADDR + 0x10000)
+#endif
+#ifndef MFLASH_LOG_BANK_SIZE
+#define MFLASH_LOG_BANK_SIZE (8 * MFLASH_SECTOR_SIZE)
+#endif
+
+/* Slots of the hashed path index built by mflash_init, power of 2 larger than the number of files */
+#ifndef MFLASH_FILE_INDEX_SIZE
+#define MFLASH_FILE_INDEX_SIZE (16)
+#endif
+
+/* Maximum path length compared, including the terminating NULL */
+#define MFLASH_FILE_PATH_MAX (sizeof(((mflash_file_t *)0)->path))
+
+uint32_t mflash_path_hash(const char *path);
+
 bool mflash_is_initialized(void);
 
 BaseType_t mflash_init(mflash_file_t *user_file_table, bool init_drv);
 
+int32_t mflash_find_file(char *path, mflash_file_t *file);
+
 BaseType_t mflash_read_file(char *pcFileName, uint8_t **ppucData, uint32_t *pulDataSize);
 
 BaseType_t mflash_save_file(char *pcFileName, uint8_t *pucData, uint32_t ulDataSize);
@@ -0,0 +1,430 @@
+/*
+ * Copyright 2017 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/* Host implementation of the mflash driver for builds on the FreeRTOS POSIX port.
+ * The SPIFI window is a shared mapping of a file at its target address, so the XIP pointers
+ * of the file table, the UCB of spifi_boot.h and the OTA slots keep working unchanged.
+ * The flash is simulated at the level of its commands: 4 KB sector and 32/64 KB block erases
+ * setting bytes to 0xFF, 256 B page programs only clearing bits. Writes are split into these
+ * commands with the same blank fast path and FLASHDRV_SMART_UPDATE diffing as the target
+ * driver, each command is counted and accounted with the latency of mflash_sim.h, so the
+ * OTA write path, the bootloader swap modes and the wear can be compared on the host.
+ * Build for a 32 bit host (-m32): the drivers above cast flash pointers to uint32_t.
+ * Excluded from the MCUXpresso build. */
+
+#define _GNU_SOURCE
+#include "mflash_drv.h"
+#include "mflash_sim.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if MFLASH_ASYNC_MODE || MFLASH_SIM_REALTIME
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#endif
+
+/* Start of the memory mapped flash, FSL_FEATURE_SPIFI_START_ADDR of the LPC54018 */
+#ifndef MFLASH_POSIX_BASE
+#define MFLASH_POSIX_BASE (0x10000000)
+#endif
+
+/* Size of the emulated flash, the 16 MB of the W25Q128JV */
+#ifndef MFLASH_POSIX_SIZE
+#define MFLASH_POSIX_SIZE (0x1000000)
+#endif
+
+/* Backing file, overridden by the MFLASH_FILE environment variable */
+#ifndef MFLASH_POSIX_FILE
+#define MFLASH_POSIX_FILE "mflash.bin"
+#endif
+
+#if !defined(FLASHDRV_SMART_UPDATE)
+#define FLASHDRV_SMART_UPDATE 1
+#endif
+
+#define MFLASH_SECTOR_PAGES (MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE)
+
+static uint8_t *g_mflash_base = NULL;
+
+/* Sector buffer of the read-modify-write, as in the target driver */
+static uint8_t g_flashm_sector[MFLASH_SECTOR_SIZE];
+
+static mflash_sim_stats_t g_mflash_stats;
+static uint32_t g_mflash_wear[MFLASH_POSIX_SIZE / MFLASH_SECTOR_SIZE];
+
+#if MFLASH_ASYNC_MODE
+static SemaphoreHandle_t g_mflash_mutex = NULL;
+static StaticSemaphore_t g_mflash_mutex_storage;
+#endif
+
+static bool mflash_drv_in_range(uint32_t addr, uint32_t len)
+{
+    return (g_mflash_base != NULL) && (addr >= MFLASH_POSIX_BASE) && (len <= MFLASH_POSIX_SIZE) &&
+           (addr - MFLASH_POSIX_BASE <= MFLASH_POSIX_SIZE - len);
+}
+
+static void mflash_drv_lock(void)
+{
+#if MFLASH_ASYNC_MODE
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        xSemaphoreTake(g_mflash_mutex, portMAX_DELAY);
+#endif
+}
+
+static void mflash_drv_unlock(void)
+{
+#if MFLASH_ASYNC_MODE
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        xSemaphoreGive(g_mflash_mutex);
+#endif
+}
+
+/* Internal - account the latency of a flash command */
+static void mflash_sim_busy(uint32_t us)
+{
+    g_mflash_stats.busy_us += us;
+#if MFLASH_SIM_REALTIME
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        vTaskDelay(pdMS_TO_TICKS((us + 999) / 1000));
+    else
+        usleep(us);
+#endif
+}
+
+/* Internal - erase 'block_size' bytes at aligned 'block_addr' with a single command */
+static void mflash_sim_block_erase(uint32_t block_addr, uint32_t block_size)
+{
+    uint32_t sector = (block_addr - MFLASH_POSIX_BASE) / MFLASH_SECTOR_SIZE;
+
+    memset((void *)block_addr, 0xFF, block_size);
+    for (uint32_t i = 0; i < block_size / MFLASH_SECTOR_SIZE; i++)
+    {
+        if (++g_mflash_wear[sector + i] > g_mflash_stats.max_sector_wear)
+            g_mflash_stats.max_sector_wear = g_mflash_wear[sector + i];
+    }
+
+    if (block_size == MFLASH_BLOCK64_SIZE)
+    {
+        g_mflash_stats.block64_erases++;
+        mflash_sim_busy(MFLASH_SIM_BLOCK64_ERASE_US);
+    }
+    else if (block_size == MFLASH_BLOCK32_SIZE)
+    {
+        g_mflash_stats.block32_erases++;
+        mflash_sim_busy(MFLASH_SIM_BLOCK32_ERASE_US);
+    }
+    else
+    {
+        g_mflash_stats.sector_erases++;
+        mflash_sim_busy(MFLASH_SIM_SECTOR_ERASE_US);
+    }
+}
+
+/* Internal - program a page, bits can only be cleared */
+static void mflash_sim_page_program(uint32_t page_addr, const uint8_t *page_data)
+{
+    uint8_t *dst = (uint8_t *)page_addr;
+    bool fail    = false;
+
+    for (uint32_t i = 0; i < MFLASH_PAGE_SIZE; i++)
+    {
+        fail |= ((dst[i] | page_data[i]) != dst[i]);
+        dst[i] &= page_data[i];
+    }
+
+    g_mflash_stats.page_programs++;
+    if (fail)
+        g_mflash_stats.page_program_fails++;
+    mflash_sim_busy(MFLASH_SIM_PAGE_PROGRAM_US);
+}
+
+/* Internal - locate part of 'segment' that falls into sector 'sector_addr', returns false if there is none */
+static bool mflash_drv_segment_in_sector(const mflash_drv_segment_t *segment,
+                                         uint32_t sector_addr,
+                                         uint32_t *sect_off,
+                                         const uint8_t **data,
+                                         uint32_t *data_len)
+{
+    uint32_t start = (uint32_t)segment->addr;
+    uint32_t end   = start + segment->data_len;
+
+    if (start < sector_addr)
+        start = sector_addr;
+    if (end > sector_addr + MFLASH_SECTOR_SIZE)
+        end = sector_addr + MFLASH_SECTOR_SIZE;
+    if (start >= end)
+        return false;
+
+    *sect_off = start - sector_addr;
+    *data     = segment->data + (start - (uint32_t)segment->addr);
+    *data_len = end - start;
+    return true;
+}
+
+/* Internal - check that 'len' bytes at 'ptr' are erased */
+static bool mflash_drv_is_blank(const uint8_t *ptr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (0xFF != ptr[i])
+            return false;
+    }
+    return true;
+}
+
+/* Internal - write all parts of 'count' segments that fall into sector 'sector_addr', issuing the
+ * erase and page program commands the target driver would issue */
+static void mflash_drv_sector_update(uint32_t sector_addr, const mflash_drv_segment_t *segments, uint32_t count)
+{
+    uint32_t page_program_map = 0;
+    bool sector_erase_req     = false;
+    bool blank                = true;
+    uint32_t sect_off;
+    const uint8_t *data;
+    uint32_t data_len;
+
+    /* Fast path for appending to erased area, only the touched pages padded with 0xFF are programmed */
+    for (uint32_t seg = 0; (seg < count) && blank; seg++)
+    {
+        if (mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            blank = mflash_drv_is_blank((const uint8_t *)(sector_addr + sect_off), data_len);
+    }
+
+    if (blank)
+        memset(g_flashm_sector, 0xFF, sizeof(g_flashm_sector));
+    else
+        memcpy(g_flashm_sector, (const void *)sector_addr, sizeof(g_flashm_sector));
+
+    for (uint32_t seg = 0; seg < count; seg++)
+    {
+        if (!mflash_drv_segment_in_sector(&segments[seg], sector_addr, &sect_off, &data, &data_len))
+            continue;
+
+        for (uint32_t i = 0; i < data_len; i++)
+        {
+            uint8_t cur_value = g_flashm_sector[sect_off + i];
+            uint8_t new_value = data[i];
+
+            g_flashm_sector[sect_off + i] = new_value;
+            if (blank || (FLASHDRV_SMART_UPDATE && (cur_value != new_value)))
+                page_program_map |= 1U << ((sect_off + i) / MFLASH_PAGE_SIZE);
+            if (!blank && (!FLASHDRV_SMART_UPDATE || ((cur_value | new_value) != cur_value)))
+                sector_erase_req = true;
+        }
+    }
+
+    if (sector_erase_req)
+    {
+        mflash_sim_block_erase(sector_addr, MFLASH_SECTOR_SIZE);
+
+        /* Program every page left with data, or all of them without the smart update */
+        page_program_map = 0;
+        for (uint32_t page_idx = 0; page_idx < MFLASH_SECTOR_PAGES; page_idx++)
+        {
+            if (!FLASHDRV_SMART_UPDATE ||
+                !mflash_drv_is_blank(g_flashm_sector + page_idx * MFLASH_PAGE_SIZE, MFLASH_PAGE_SIZE))
+                page_program_map |= 1U << page_idx;
+        }
+    }
+
+    for (uint32_t page_idx = 0; page_idx < MFLASH_SECTOR_PAGES; page_idx++)
+    {
+        if (0 != (page_program_map & (1U << page_idx)))
+            mflash_sim_page_program(sector_addr + page_idx * MFLASH_PAGE_SIZE,
+                                    g_flashm_sector + page_idx * MFLASH_PAGE_SIZE);
+    }
+}
+
+/* API - map the backing file, a new file is created blank */
+int32_t mflash_drv_init(void)
+{
+    const char *path = getenv("MFLASH_FILE");
+    struct stat st;
+    void *base;
+    int fd;
+
+    if (g_mflash_base != NULL)
+        return 0;
+
+    if (path == NULL)
+        path = MFLASH_POSIX_FILE;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return -1;
+
+    if ((fstat(fd, &st) != 0) || ((st.st_size == 0) && (ftruncate(fd, MFLASH_POSIX_SIZE) != 0)) ||
+        ((st.st_size != 0) && (st.st_size != MFLASH_POSIX_SIZE)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    base = mmap((void *)MFLASH_POSIX_BASE, MFLASH_POSIX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE,
+                fd, 0);
+    close(fd);
+    if ((base == MAP_FAILED) || (base != (void *)MFLASH_POSIX_BASE))
+        return -1;
+
+    g_mflash_base = base;
+    if (st.st_size == 0)
+        memset(g_mflash_base, 0xFF, MFLASH_POSIX_SIZE);
+
+#if MFLASH_ASYNC_MODE
+    g_mflash_mutex = xSemaphoreCreateMutexStatic(&g_mflash_mutex_storage);
+#endif
+    return 0;
+}
+
+/* API - write 'data' of 'data_len' to 'any_addr', which doesn't have to be sector aligned */
+int32_t mflash_drv_write(void *any_addr, const uint8_t *data, uint32_t data_len)
+{
+    mflash_drv_segment_t segment = {any_addr, data, data_len};
+
+    return mflash_drv_writev(&segment, 1);
+}
+
+/* API - write 'count' segments, each sector is updated once, in order of the last segment it contains */
+int32_t mflash_drv_writev(const mflash_drv_segment_t *segments, uint32_t count)
+{
+    uint32_t sect_off;
+    const uint8_t *data;
+    uint32_t data_len;
+
+    for (uint32_t seg = 0; seg < count; seg++)
+    {
+        if (!mflash_drv_in_range((uint32_t)segments[seg].addr, segments[seg].data_len))
+            return -1;
+    }
+
+    mflash_drv_lock();
+    for (uint32_t seg = 0; seg < count; seg++)
+    {
+        uint32_t seg_addr = (uint32_t)segments[seg].addr;
+
+        for (uint32_t sect_a = mflash_drv_addr_to_sector_addr(seg_addr); sect_a < seg_addr + segments[seg].data_len;
+             sect_a += MFLASH_SECTOR_SIZE)
+        {
+            bool later = false;
+            for (uint32_t next = seg + 1; (next < count) && !later; next++)
+            {
+                later = mflash_drv_segment_in_sector(&segments[next], sect_a, &sect_off, &data, &data_len);
+            }
+            if (!later)
+                mflash_drv_sector_update(sect_a, segments, seg + 1);
+        }
+    }
+    mflash_drv_unlock();
+    return 0;
+}
+
+/* API - erase 'len' bytes at 'addr', both sector aligned, with the largest aligned blocks. Blank blocks are skipped */
+int32_t mflash_drv_erase(void *addr, uint32_t len)
+{
+    uint32_t block_addr = (uint32_t)addr;
+    uint32_t block_size;
+
+    if (!mflash_drv_is_sector_aligned(block_addr) || (0 != len % MFLASH_SECTOR_SIZE) ||
+        !mflash_drv_in_range(block_addr, len))
+        return -1;
+
+    mflash_drv_lock();
+    while (len)
+    {
+        if ((0 == (block_addr & (MFLASH_BLOCK64_SIZE - 1))) && (len >= MFLASH_BLOCK64_SIZE))
+            block_size = MFLASH_BLOCK64_SIZE;
+        else if ((0 == (block_addr & (MFLASH_BLOCK32_SIZE - 1))) && (len >= MFLASH_BLOCK32_SIZE))
+            block_size = MFLASH_BLOCK32_SIZE;
+        else
+            block_size = MFLASH_SECTOR_SIZE;
+
+        if (!mflash_drv_is_blank((const uint8_t *)block_addr, block_size))
+            mflash_sim_block_erase(block_addr, block_size);
+        block_addr += block_size;
+        len -= block_size;
+    }
+    mflash_drv_unlock();
+    return 0;
+}
+
+/* API - copy from the mapped flash */
+int32_t mflash_drv_read(const void *any_addr, uint8_t *data, uint32_t data_len)
+{
+    if (!mflash_drv_in_range((uint32_t)any_addr, data_len))
+        return -1;
+
+    mflash_drv_lock();
+    memcpy(data, any_addr, data_len);
+    mflash_drv_unlock();
+    return 0;
+}
+
+#if MFLASH_ASYNC_MODE
+/* API - done synchronously, the callback runs in the calling task before the function returns */
+int32_t mflash_drv_write_async(
+    void *any_addr, const uint8_t *data, uint32_t data_len, mflash_drv_callback_t callback, void *arg)
+{
+    int32_t result;
+
+    if (data == NULL)
+        return -1;
+
+    result = mflash_drv_write(any_addr, data, data_len);
+    if (callback != NULL)
+        callback(result, arg);
+    return 0;
+}
+
+/* API - done synchronously, the callback runs in the calling task before the function returns */
+int32_t mflash_drv_erase_async(void *addr, uint32_t len, mflash_drv_callback_t callback, void *arg)
+{
+    int32_t result = mflash_drv_erase(addr, len);
+
+    if (callback != NULL)
+        callback(result, arg);
+    return 0;
+}
+#endif
+
+/* API - nothing is ever left pending */
+bool mflash_drv_is_busy(void)
+{
+    return false;
+}
+
+/* API - copy the operation counters */
+void mflash_sim_get_stats(mflash_sim_stats_t *stats)
+{
+    mflash_drv_lock();
+    *stats = g_mflash_stats;
+    mflash_drv_unlock();
+}
+
+/* API - clear the operation counters, the sector wear is kept */
+void mflash_sim_reset_stats(void)
+{
+    mflash_drv_lock();
+    uint32_t max_sector_wear = g_mflash_stats.max_sector_wear;
+    memset(&g_mflash_stats, 0, sizeof(g_mflash_stats));
+    g_mflash_stats.max_sector_wear = max_sector_wear;
+    mflash_drv_unlock();
+}
+
+/* API - number of erases of the sector holding 'addr' since mflash_drv_init */
+uint32_t mflash_sim_sector_wear(const void *addr)
+{
+    if (!mflash_drv_in_range((uint32_t)addr, 1))
+        return 0;
+
+    return g_mflash_wear[((uint32_t)addr - MFLASH_POSIX_BASE) / MFLASH_SECTOR_SIZE];
+}
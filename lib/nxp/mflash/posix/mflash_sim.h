@@ -0,0 +1,50 @@
+/*
+ * Copyright 2017 NXP
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __MFLASH_SIM_H__
+#define __MFLASH_SIM_H__
+
+#include <stdint.h>
+
+/* Latencies of the W25Q128JV operations in microseconds, typical values of the datasheet */
+#ifndef MFLASH_SIM_SECTOR_ERASE_US
+#define MFLASH_SIM_SECTOR_ERASE_US (45000)
+#endif
+
+#ifndef MFLASH_SIM_BLOCK32_ERASE_US
+#define MFLASH_SIM_BLOCK32_ERASE_US (120000)
+#endif
+
+#ifndef MFLASH_SIM_BLOCK64_ERASE_US
+#define MFLASH_SIM_BLOCK64_ERASE_US (150000)
+#endif
+
+#ifndef MFLASH_SIM_PAGE_PROGRAM_US
+#define MFLASH_SIM_PAGE_PROGRAM_US (400)
+#endif
+
+/* 1 delays the calling task by the latency of each operation, 0 only accounts it in 'busy_us' */
+#ifndef MFLASH_SIM_REALTIME
+#define MFLASH_SIM_REALTIME (0)
+#endif
+
+/* Operation counters of the simulated flash */
+typedef struct _mflash_sim_stats
+{
+    uint32_t sector_erases;      /* 4 KB erases */
+    uint32_t block32_erases;     /* 32 KB erases */
+    uint32_t block64_erases;     /* 64 KB erases */
+    uint32_t page_programs;      /* 256 B page programs */
+    uint32_t page_program_fails; /* Page programs asking for a 0 to 1 transition, which the flash ignores */
+    uint32_t max_sector_wear;    /* Highest erase count of a single sector since mflash_drv_init, kept by resets */
+    uint64_t busy_us;            /* Sum of the operation latencies */
+} mflash_sim_stats_t;
+
+void mflash_sim_get_stats(mflash_sim_stats_t *stats);
+void mflash_sim_reset_stats(void);
+uint32_t mflash_sim_sector_wear(const void *addr);
+
+#endif
@@ -170,3 +170,62 @@ status_t PHY_LAN8720A_GetLinkSpeedDuplex(phy_handle_t *handle, phy_speed_t *spee
     }
     return result;
 }
+
+status_t PHY_LAN8720A_EnableEnergyDetectPowerDown(phy_handle_t *handle, bool enable)
+{
+    uint32_t reg;
+    status_t result = kStatus_Success;
+
+    /* Read the mode control/status register. */
+    result = MDIO_Read(handle->mdioHandle, handle->phyAddr, PHY_MODE_CONTROL_REG, &reg);
+    if (result == kStatus_Success)
+    {
+        if (enable)
+        {
+            reg |= PHY_MODECTL_EDPWRDOWN_MASK;
+        }
+        else
+        {
+            reg &= ~PHY_MODECTL_EDPWRDOWN_MASK;
+        }
+        result = MDIO_Write(handle->mdioHandle, handle->phyAddr, PHY_MODE_CONTROL_REG, reg);
+    }
+    return result;
+}
+
+status_t PHY_LAN8720A_GetEnergyOn(phy_handle_t *handle, bool *status)
+{
+    assert(status);
+
+    uint32_t reg;
+    status_t result = kStatus_Success;
+
+    /* Read the mode control/status register. */
+    result = MDIO_Read(handle->mdioHandle, handle->phyAddr, PHY_MODE_CONTROL_REG, &reg);
+    if (result == kStatus_Success)
+    {
+        *status = (reg & PHY_MODECTL_ENERGYON_MASK) ? true : false;
+    }
+    return result;
+}
+
+status_t PHY_LAN8720A_EnableInterrupts(phy_handle_t *handle, uint32_t mask)
+{
+    return MDIO_Write(handle->mdioHandle, handle->phyAddr, PHY_INTR_MASK_REG, mask);
+}
+
+status_t PHY_LAN8720A_GetInterruptStatus(phy_handle_t *handle, uint32_t *status)
+{
+    assert(status);
+
+    uint32_t reg;
+    status_t result = kStatus_Success;
+
+    /* Reading the interrupt source flag register clears it. */
+    result = MDIO_Read(handle->mdioHandle, handle->phyAddr, PHY_INTR_SOURCE_REG, &reg);
+    if (result == kStatus_Success)
+    {
+        *status = reg;
+    }
+    return result;
+}
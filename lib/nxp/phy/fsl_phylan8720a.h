@@ -23,6 +23,9 @@
 
 /*! @brief Defines the PHY registers. */
 #define PHY_SEPCIAL_CONTROL_REG 0x1FU /*!< The PHY control two register. */
+#define PHY_MODE_CONTROL_REG    0x11U /*!< The PHY mode control/status register. */
+#define PHY_INTR_SOURCE_REG     0x1DU /*!< The PHY interrupt source flag register. */
+#define PHY_INTR_MASK_REG       0x1EU /*!< The PHY interrupt mask register. */
 
 #define PHY_CONTROL_ID1 0x07U /*!< The PHY ID1*/
 
@@ -33,6 +36,22 @@
 #define PHY_SPECIALCTL_10SPEED_MASK     0x0004U /*!< The PHY speed mask. */
 #define PHY_SPECIALCTL_SPEEDUPLX_MASK   0x001cU /*!< The PHY speed and duplex mask. */
 
+/*!@brief Defines the mask flag in mode control/status register*/
+#define PHY_MODECTL_EDPWRDOWN_MASK 0x2000U /*!< The PHY energy detect power-down enable mask. */
+#define PHY_MODECTL_ENERGYON_MASK  0x0002U /*!< The PHY energy detected on the line mask. */
+
+/*! @brief Defines the PHY interrupt sources, the bits are the same in the source flag and mask registers. */
+typedef enum _phy_lan8720a_interrupt
+{
+    kPHY_LAN8720A_AutoNegPageRecvInt = 0x0002U, /*!< Auto-negotiation page received. */
+    kPHY_LAN8720A_ParallelFaultInt   = 0x0004U, /*!< Parallel detection fault. */
+    kPHY_LAN8720A_AutoNegLpAckInt    = 0x0008U, /*!< Auto-negotiation link partner acknowledge. */
+    kPHY_LAN8720A_LinkDownInt        = 0x0010U, /*!< Link down. */
+    kPHY_LAN8720A_RemoteFaultInt     = 0x0020U, /*!< Remote fault detected. */
+    kPHY_LAN8720A_AutoNegCompleteInt = 0x0040U, /*!< Auto-negotiation complete, the link is up. */
+    kPHY_LAN8720A_EnergyOnInt        = 0x0080U, /*!< Energy detected on the line. */
+} phy_lan8720a_interrupt_t;
+
 /*! @brief Defines the mask flag in PHY auto-negotiation advertise register. */
 #define PHY_ALL_CAPABLE_MASK 0x1e0U
 
@@ -113,6 +132,50 @@ status_t PHY_LAN8720A_GetLinkStatus(phy_handle_t *handle, bool *status);
  */
 status_t PHY_LAN8720A_GetLinkSpeedDuplex(phy_handle_t *handle, phy_speed_t *speed, phy_duplex_t *duplex);
 
+/*!
+ * @brief Enables or disables the PHY energy detect power-down mode.
+ *  In this mode the PHY powers down its analog blocks while there is no energy on
+ *  the line, and wakes up by itself once the link partner transmits again.
+ * @param handle   PHY device handle.
+ * @param enable   True to enable the energy detect power-down, false to disable it.
+ * @retval kStatus_Success   PHY sets the power-down mode success
+ * @retval kStatus_PHY_SMIVisitTimeout  PHY SMI visit time out
+ */
+status_t PHY_LAN8720A_EnableEnergyDetectPowerDown(phy_handle_t *handle, bool enable);
+
+/*!
+ * @brief Gets whether the PHY detects energy on the line.
+ * @param handle   PHY device handle.
+ * @param status   The energy status of the line.
+ *         - true energy is detected.
+ *         - false the line is quiet, the PHY is powered down if energy detect power-down is enabled.
+ * @retval kStatus_Success   PHY gets energy status success
+ * @retval kStatus_PHY_SMIVisitTimeout  PHY SMI visit time out
+ */
+status_t PHY_LAN8720A_GetEnergyOn(phy_handle_t *handle, bool *status);
+
+/*!
+ * @brief Enables the PHY interrupts which assert the nINT pin.
+ *  The nINT pin shares the REFCLKO function, so the PHY must be strapped for
+ *  nINT (nINTSEL) and the board must route the pin to a GPIO.
+ * @param handle   PHY device handle.
+ * @param mask     The interrupts to enable, a logical OR of @ref phy_lan8720a_interrupt_t,
+ *                 zero disables all of them.
+ * @retval kStatus_Success   PHY sets the interrupt mask success
+ * @retval kStatus_PHY_SMIVisitTimeout  PHY SMI visit time out
+ */
+status_t PHY_LAN8720A_EnableInterrupts(phy_handle_t *handle, uint32_t mask);
+
+/*!
+ * @brief Gets and clears the PHY interrupt source flags.
+ *  Reading the flags releases the nINT pin.
+ * @param handle   PHY device handle.
+ * @param status   The pending interrupts, a logical OR of @ref phy_lan8720a_interrupt_t.
+ * @retval kStatus_Success   PHY gets the interrupt status success
+ * @retval kStatus_PHY_SMIVisitTimeout  PHY SMI visit time out
+ */
+status_t PHY_LAN8720A_GetInterruptStatus(phy_handle_t *handle, uint32_t *status);
+
 /* @} */
 
 #if defined(__cplusplus)
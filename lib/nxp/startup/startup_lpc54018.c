@@ -395,21 +395,65 @@ void (* const g_pfnVectors[])(void) = {
 // are written as separate functions rather than being inlined within the
 // ResetISR() function in order to cope with MCUs with multiple banks of
 // memory.
+//
+// The bulk of each section is copied or cleared 32 bytes at a time with
+// LDM/STM bursts of eight registers, the remaining words one at a time. This
+// keeps the startup time low in the Debug build as well, where the plain word
+// loops are compiled without optimization. r7 is not used as it is the frame
+// pointer of the unoptimized Thumb code. The sections are word aligned and
+// their length a multiple of 4 bytes.
 //*****************************************************************************
 __attribute__ ((section(".after_vectors.init_data")))
 void data_init(unsigned int romstart, unsigned int start, unsigned int len) {
     unsigned int *pulDest = (unsigned int*) start;
     unsigned int *pulSrc = (unsigned int*) romstart;
-    unsigned int loop;
-    for (loop = 0; loop < len; loop = loop + 4)
+    unsigned int *pulBurstEnd = pulDest + ((len / 32U) * 8U);
+    unsigned int *pulEnd = pulDest + (len / 4U);
+
+    // Nothing to copy for a section executed from its load address
+    if (pulDest == pulSrc)
+        return;
+
+    asm volatile ("1:\n\t"
+                  "CMP %[dest], %[end]\n\t"
+                  "BHS 2f\n\t"
+                  "LDMIA %[src]!, {R3-R6, R8-R10, R12}\n\t"
+                  "STMIA %[dest]!, {R3-R6, R8-R10, R12}\n\t"
+                  "B 1b\n\t"
+                  "2:"
+                  : [src] "+r" (pulSrc), [dest] "+r" (pulDest)
+                  : [end] "r" (pulBurstEnd)
+                  : "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory");
+
+    while (pulDest < pulEnd)
         *pulDest++ = *pulSrc++;
 }
 
 __attribute__ ((section(".after_vectors.init_bss")))
 void bss_init(unsigned int start, unsigned int len) {
     unsigned int *pulDest = (unsigned int*) start;
-    unsigned int loop;
-    for (loop = 0; loop < len; loop = loop + 4)
+    unsigned int *pulBurstEnd = pulDest + ((len / 32U) * 8U);
+    unsigned int *pulEnd = pulDest + (len / 4U);
+
+    asm volatile ("MOVS R3, #0\n\t"
+                  "MOVS R4, #0\n\t"
+                  "MOVS R5, #0\n\t"
+                  "MOVS R6, #0\n\t"
+                  "MOV R8, R3\n\t"
+                  "MOV R9, R3\n\t"
+                  "MOV R10, R3\n\t"
+                  "MOV R12, R3\n\t"
+                  "1:\n\t"
+                  "CMP %[dest], %[end]\n\t"
+                  "BHS 2f\n\t"
+                  "STMIA %[dest]!, {R3-R6, R8-R10, R12}\n\t"
+                  "B 1b\n\t"
+                  "2:"
+                  : [dest] "+r" (pulDest)
+                  : [end] "r" (pulBurstEnd)
+                  : "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory");
+
+    while (pulDest < pulEnd)
         *pulDest++ = 0;
 }
 
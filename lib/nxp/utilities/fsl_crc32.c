@@ -0,0 +1,100 @@
+/*
+ * Copyright 2017 NXP
+ * All rights reserved.
+ *
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdbool.h>
+
+#include "fsl_crc32.h"
+
+#if CRC32_USE_ENGINE
+#include "fsl_crc.h"
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+/* Reflected CRC-32 polynomial 0xEDB88320 applied to each value of a nibble */
+static const uint32_t s_crc32Nibble[16] = {
+    0x00000000U, 0x1DB71064U, 0x3B6E20C8U, 0x26D930ACU, 0x76DC4190U, 0x6B6B51F4U, 0x4DB26158U, 0x5005713CU,
+    0xEDB88320U, 0xF00F9344U, 0xD6D6A3E8U, 0xCB61B38CU, 0x9B64C2B0U, 0x86D3D2D4U, 0xA00AE278U, 0xBDBDF21CU};
+
+#if CRC32_USE_ENGINE
+/* Set while a caller owns the engine, which holds a single checksum */
+static volatile uint32_t s_crc32EngineBusy;
+#endif
+
+/*******************************************************************************
+ * Code
+ ******************************************************************************/
+
+static uint32_t CRC32_UpdateSoftware(uint32_t crc, const uint8_t *data, size_t length)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ s_crc32Nibble[crc & 0xFU];
+        crc = (crc >> 4) ^ s_crc32Nibble[crc & 0xFU];
+    }
+    return ~crc;
+}
+
+#if CRC32_USE_ENGINE
+
+/* Takes the engine, fails if another caller owns it or the peripherals are not accessible to the caller */
+static bool CRC32_TakeEngine(void)
+{
+    /* unprivileged threads have no access to the peripherals */
+    if ((__get_IPSR() == 0U) && ((__get_CONTROL() & CONTROL_nPRIV_Msk) != 0U))
+    {
+        return false;
+    }
+
+    do
+    {
+        if (__LDREXW(&s_crc32EngineBusy) != 0U)
+        {
+            __CLREX();
+            return false;
+        }
+    } while (__STREXW(1U, &s_crc32EngineBusy) != 0U);
+    __DMB();
+
+    return true;
+}
+
+static void CRC32_GiveEngine(void)
+{
+    __DMB();
+    s_crc32EngineBusy = 0U;
+}
+
+#endif /* CRC32_USE_ENGINE */
+
+uint32_t CRC32_Update(uint32_t crc, const void *data, size_t length)
+{
+#if CRC32_USE_ENGINE
+    crc_config_t config;
+
+    if ((length >= CRC32_ENGINE_MIN_LENGTH) && CRC32_TakeEngine())
+    {
+        /* the seed is loaded as the raw register, which holds the complemented, bit reversed checksum */
+        CRC_GetDefaultConfig(&config);
+        config.seed = __RBIT(~crc);
+        CRC_Init(CRC_ENGINE, &config);
+        CRC_WriteData(CRC_ENGINE, (const uint8_t *)data, length);
+        crc = CRC_Get32bitResult(CRC_ENGINE);
+        CRC32_GiveEngine();
+
+        return crc;
+    }
+#endif
+
+    return CRC32_UpdateSoftware(crc, (const uint8_t *)data, length);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2017 NXP
+ * All rights reserved.
+ *
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _FSL_CRC32_H
+#define _FSL_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * @addtogroup crc32
+ * @{
+ */
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+
+/*! @brief Set to 1 to compute the checksums with the CRC engine, 0 in software only, as for host builds. */
+#ifndef CRC32_USE_ENGINE
+#if defined(__arm__) || defined(__ICCARM__)
+#define CRC32_USE_ENGINE 1
+#else
+#define CRC32_USE_ENGINE 0
+#endif
+#endif
+
+/*! @brief Shorter data is checksummed in software, which is faster than setting up the engine. */
+#ifndef CRC32_ENGINE_MIN_LENGTH
+#define CRC32_ENGINE_MIN_LENGTH 16U
+#endif
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * @brief Updates the CRC-32 of Ethernet and zlib with data, the checksum of the flash records, the
+ * store-and-forward log and the boot images.
+ *
+ * The CRC engine is used when the caller is privileged and no other caller is using it, the checksum is
+ * computed in software otherwise, with the same result. The function is reentrant and can be called
+ * from interrupts and from the bootloader.
+ *
+ * @param crc Checksum of the preceding data, 0 to start a new checksum.
+ * @param data Data to be checksummed, with no alignment requirement.
+ * @param length Length of the data in bytes.
+ * @return The checksum of the preceding data followed by the data.
+ */
+uint32_t CRC32_Update(uint32_t crc, const void *data, size_t length);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+/*! @} */
+
+#endif /* _FSL_CRC32_H */
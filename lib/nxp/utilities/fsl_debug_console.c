@@ -54,10 +54,30 @@
 #include "serial_manager.h"
 
 #include "fsl_debug_console.h"
+#include "irq_latency.h"
 
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+/* Marks the ring buffer updates as interrupts disabled windows, the outermost one only */
+#define DEBUG_CONSOLE_IRQ_OFF(primask) \
+    do                                 \
+    {                                  \
+        if ((primask) == 0U)           \
+        {                              \
+            IRQMASK_BEGIN();           \
+        }                              \
+    } while (0)
+#define DEBUG_CONSOLE_IRQ_ON(primask) \
+    do                                \
+    {                                 \
+        if ((primask) == 0U)          \
+        {                             \
+            IRQMASK_END();            \
+        }                             \
+        EnableGlobalIRQ(primask);     \
+    } while (0)
+
 #ifndef NDEBUG
 #if (defined(DEBUG_CONSOLE_ASSERT_DISABLE) && (DEBUG_CONSOLE_ASSERT_DISABLE > 0U))
 #undef assert
@@ -228,6 +248,11 @@ static debug_console_state_struct_t s_debugConsoleState;
 #endif
 serial_handle_t g_serialHandle; /*!< serial manager handle */
 
+#if SDK_DEBUGCONSOLE
+/*! @brief Deferred transmission of the formatted log, see DbgConsole_SetDeferredSend(). */
+static dbgconsole_deferred_send_t s_debugConsoleDeferredSend;
+#endif
+
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
@@ -237,12 +262,20 @@ serial_handle_t g_serialHandle; /*!< serial manager handle */
  *
  * @param[in] buf   Buffer to store log.
  * @param[in] indicator Buffer index.
- * @param[in] val Target character to store.
- * @param[in] len length of the character
+ * @param[in] str Run of characters to store.
+ * @param[in] len length of the run
  *
  */
 #if SDK_DEBUGCONSOLE
-static void DbgConsole_PrintCallback(char *buf, int32_t *indicator, char dbgVal, int len);
+static void DbgConsole_PrintCallback(char *buf, int32_t *indicator, const char *str, int len);
+
+/*!
+ * @brief Sends the formatted log, through the deferred send function when one is set.
+ *
+ * @param[in] ch The log data.
+ * @param[in] size The log data length.
+ */
+static int DbgConsole_SendLog(uint8_t *ch, size_t size);
 #endif
 
 status_t DbgConsole_ReadOneCharacter(uint8_t *ch);
@@ -421,6 +454,7 @@ int DbgConsole_SendData(uint8_t *ch, size_t size)
 
 #if defined(DEBUG_CONSOLE_TRANSFER_NON_BLOCKING)
     uint32_t regPrimask = DisableGlobalIRQ();
+    DEBUG_CONSOLE_IRQ_OFF(regPrimask);
     if (s_debugConsoleState.writeRingBuffer.ringHead != s_debugConsoleState.writeRingBuffer.ringTail)
     {
         txBusy = 1;
@@ -436,7 +470,7 @@ int DbgConsole_SendData(uint8_t *ch, size_t size)
     sendDataLength = s_debugConsoleState.writeRingBuffer.ringBufferSize - sendDataLength - 1;
     if (sendDataLength < size)
     {
-        EnableGlobalIRQ(regPrimask);
+        DEBUG_CONSOLE_IRQ_ON(regPrimask);
         return -1;
     }
     for (int i = 0; i < (int)size; i++)
@@ -468,7 +502,7 @@ int DbgConsole_SendData(uint8_t *ch, size_t size)
             &s_debugConsoleState.writeRingBuffer.ringBuffer[s_debugConsoleState.writeRingBuffer.ringTail],
             sendDataLength);
     }
-    EnableGlobalIRQ(regPrimask);
+    DEBUG_CONSOLE_IRQ_ON(regPrimask);
 #else
     status = (status_t)SerialManager_WriteBlocking(
         ((serial_write_handle_t)&s_debugConsoleState.serialWriteHandleBuffer[0]), ch, size);
@@ -503,6 +537,7 @@ int DbgConsole_SendDataReliable(uint8_t *ch, size_t size)
     do
     {
         uint32_t regPrimask = DisableGlobalIRQ();
+        DEBUG_CONSOLE_IRQ_OFF(regPrimask);
         if (s_debugConsoleState.writeRingBuffer.ringHead != s_debugConsoleState.writeRingBuffer.ringTail)
         {
             sendDataLength =
@@ -529,7 +564,7 @@ int DbgConsole_SendDataReliable(uint8_t *ch, size_t size)
                 totalLength = totalLength - (uint32_t)sentLength;
             }
         }
-        EnableGlobalIRQ(regPrimask);
+        DEBUG_CONSOLE_IRQ_ON(regPrimask);
 
         if (totalLength != 0U)
         {
@@ -645,20 +680,40 @@ int DbgConsole_ReadCharacter(uint8_t *ch)
 }
 
 #if SDK_DEBUGCONSOLE
-static void DbgConsole_PrintCallback(char *buf, int32_t *indicator, char dbgVal, int len)
+static int DbgConsole_SendLog(uint8_t *ch, size_t size)
 {
-    int i = 0;
+    dbgconsole_deferred_send_t send = s_debugConsoleDeferredSend;
+
+    if (NULL != send)
+    {
+        return send(ch, size);
+    }
+
+    return DbgConsole_SendDataReliable(ch, size);
+}
+
+static void DbgConsole_PrintCallback(char *buf, int32_t *indicator, const char *str, int len)
+{
+    int chunk;
 
-    for (i = 0; i < len; i++)
+    while (len > 0)
     {
         if (((uint32_t)*indicator + 1UL) >= DEBUG_CONSOLE_PRINTF_MAX_LOG_LEN)
         {
-            (void)DbgConsole_SendDataReliable((uint8_t *)buf, (uint32_t)(*indicator));
+            (void)DbgConsole_SendLog((uint8_t *)buf, (uint32_t)(*indicator));
             *indicator = 0;
         }
 
-        buf[*indicator] = dbgVal;
-        (*indicator)++;
+        /* Copy as much of the run as fits before the buffer is sent. */
+        chunk = (int)DEBUG_CONSOLE_PRINTF_MAX_LOG_LEN - 1 - (int)*indicator;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        (void)memcpy(&buf[*indicator], str, (size_t)chunk);
+        *indicator += chunk;
+        str += chunk;
+        len -= chunk;
     }
 }
 #endif
@@ -884,9 +939,9 @@ int DbgConsole_Printf(const char *formatString, ...)
     {
         va_start(ap, formatString);
         /* format print log first */
-        logLength = StrFormatPrintf(formatString, ap, printBuf, DbgConsole_PrintCallback);
+        logLength = StrFormatPrintfRun(formatString, ap, printBuf, DbgConsole_PrintCallback);
         /* print log */
-        dbgResult = DbgConsole_SendDataReliable((uint8_t *)printBuf, (size_t)logLength);
+        dbgResult = DbgConsole_SendLog((uint8_t *)printBuf, (size_t)logLength);
 
         va_end(ap);
     }
@@ -897,7 +952,19 @@ int DbgConsole_Printf(const char *formatString, ...)
 int DbgConsole_Putchar(int ch)
 {
     /* print char */
-    return DbgConsole_SendDataReliable((uint8_t *)&ch, 1U);
+    return DbgConsole_SendLog((uint8_t *)&ch, 1U);
+}
+
+/* See fsl_debug_console.h for documentation of this function. */
+void DbgConsole_SetDeferredSend(dbgconsole_deferred_send_t send)
+{
+    s_debugConsoleDeferredSend = send;
+}
+
+/* See fsl_debug_console.h for documentation of this function. */
+int DbgConsole_SendDeferredLog(uint8_t *data, size_t size)
+{
+    return DbgConsole_SendDataReliable(data, size);
 }
 
 /* See fsl_debug_console.h for documentation of this function. */
@@ -933,7 +1000,7 @@ int DbgConsole_BlockingPrintf(const char *formatString, ...)
 
     va_start(ap, formatString);
     /* format print log first */
-    logLength = StrFormatPrintf(formatString, ap, printBuf, DbgConsole_PrintCallback);
+    logLength = StrFormatPrintfRun(formatString, ap, printBuf, DbgConsole_PrintCallback);
 
 #if defined(DEBUG_CONSOLE_TRANSFER_NON_BLOCKING)
     SerialManager_CancelWriting(((serial_write_handle_t)&s_debugConsoleState.serialWriteHandleBuffer[0]));
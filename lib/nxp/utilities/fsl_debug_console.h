@@ -36,6 +36,13 @@
 
 extern serial_handle_t g_serialHandle; /*!< serial manager handle */
 
+/*! @brief Deferred log send function, see DbgConsole_SetDeferredSend().
+ *
+ * The function takes a copy of the formatted log and returns the length taken,
+ * or a negative value if the log is dropped.
+ */
+typedef int (*dbgconsole_deferred_send_t)(uint8_t *data, size_t size);
+
 /*! @brief Definition select redirect toolchain printf, scanf to uart or not. */
 #define DEBUGCONSOLE_REDIRECT_TO_TOOLCHAIN 0U /*!< Select toolchain printf and scanf. */
 #define DEBUGCONSOLE_REDIRECT_TO_SDK       1U /*!< Select SDK version printf, scanf. */
@@ -173,6 +180,27 @@ int DbgConsole_Printf(const char *formatString, ...);
  */
 int DbgConsole_Putchar(int ch);
 
+/*!
+ * @brief Defers the transmission of the log.
+ *
+ * Once set, DbgConsole_Printf() and DbgConsole_Putchar() still format the log in the caller, but
+ * hand it to the send function instead of waiting for the UART to transmit it. The send function
+ * shall queue the log and transmit it later with DbgConsole_SendDeferredLog().
+ * DbgConsole_BlockingPrintf() is not deferred.
+ *
+ * @param   send The deferred send function, or NULL to transmit the log in the caller again.
+ */
+void DbgConsole_SetDeferredSend(dbgconsole_deferred_send_t send);
+
+/*!
+ * @brief Transmits log queued by the deferred send function.
+ *
+ * @param   data The log data.
+ * @param   size The log data length.
+ * @return  Returns the number of characters sent or a negative value if an error occurs.
+ */
+int DbgConsole_SendDeferredLog(uint8_t *data, size_t size);
+
 /*!
  * @brief Reads formatted data from the standard input stream.
  *
@@ -64,6 +64,25 @@ enum _debugconsole_scanf_flag
     kSCANF_TypeSinged = 0x2000U,           /*!< TypeSinged Flag. */
 };
 
+/*! @brief Unsigned type of the integer conversions. */
+#if PRINTF_ADVANCED_ENABLE
+typedef uint64_t print_uint_t;
+#else
+typedef uint32_t print_uint_t;
+#endif /* PRINTF_ADVANCED_ENABLE */
+
+/*! @brief Size of the conversion buffer, the binary digits of the widest integer and the terminator. */
+#define PRINT_NUM_BUFFER_SIZE ((sizeof(print_uint_t) * 8U) + 1U)
+
+/*! @brief Destination of the formatted output. */
+typedef struct _print_output
+{
+    printfCb cb;       /*!< Character callback, used when runCb is NULL. */
+    printfRunCb runCb; /*!< Run callback, called once per run of characters. */
+    char *buf;         /*!< Buffer passed to the callback. */
+    int32_t *count;    /*!< Indicator passed to the callback. */
+} print_output_t;
+
 /*! @brief Keil: suppress ellipsis warning in va_arg usage below. */
 #if defined(__CC_ARM)
 #pragma diag_suppress 1256
@@ -81,17 +100,16 @@ enum _debugconsole_scanf_flag
 static uint32_t ScanIgnoreWhiteSpace(const char **s);
 
 /*!
- * @brief Converts a radix number to a string and return its length.
+ * @brief Converts the magnitude of a number to a string ending just before numend.
  *
- * @param[in] numstr    Converted string of the number.
- * @param[in] nump      Pointer to the number.
- * @param[in] neg       Polarity of the number.
- * @param[in] radix     The radix to be converted to.
+ * @param[in] numend    End of the conversion buffer, the terminator is written there.
+ * @param[in] value     Magnitude of the number.
+ * @param[in] radix     The radix to be converted to, 10 or a power of two up to 16.
  * @param[in] use_caps  Used to identify %x/X output format.
 
- * @return Length of the converted string.
+ * @return First character of the converted string.
  */
-static int32_t ConvertRadixNumToString(char *numstr, void *nump, int32_t neg, int32_t radix, bool use_caps);
+static char *ConvertRadixNumToString(char *numend, print_uint_t value, uint32_t radix, bool use_caps);
 
 #if PRINTF_FLOAT_ENABLE
 /*!
@@ -112,7 +130,63 @@ static int32_t ConvertFloatRadixNumToString(char *numstr, void *nump, int32_t ra
 double modf(double input_dbl, double *intpart_ptr);
 #endif /* PRINTF_FLOAT_ENABLE */
 
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+/* Two digit decimal strings, the decimal conversion divides once per two digits. */
+static const char s_decimalPairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+static const char s_hexDigitsLower[] = "0123456789abcdef";
+static const char s_hexDigitsUpper[] = "0123456789ABCDEF";
+
+/* Padding runs, repeated as needed. */
+static const char s_padSpaces[] = "                ";
+static const char s_padZeros[]  = "0000000000000000";
+
 /*************Code for process formatted data*******************************/
+static void PrintOutputRun(print_output_t *out, const char *str, int len)
+{
+    int i;
+
+    if (len <= 0)
+    {
+        return;
+    }
+
+    if (NULL != out->runCb)
+    {
+        out->runCb(out->buf, out->count, str, len);
+    }
+    else
+    {
+        for (i = 0; i < len; i++)
+        {
+            out->cb(out->buf, out->count, str[i], 1);
+        }
+    }
+}
+
+static void PrintOutputFill(print_output_t *out, char c, int len)
+{
+    const char *pad = (c == '0') ? s_padZeros : s_padSpaces;
+    int chunk;
+
+    if (NULL == out->runCb)
+    {
+        out->cb(out->buf, out->count, c, len);
+        return;
+    }
+
+    while (len > 0)
+    {
+        chunk = (len < (int)(sizeof(s_padSpaces) - 1U)) ? len : (int)(sizeof(s_padSpaces) - 1U);
+        PrintOutputRun(out, pad, chunk);
+        len -= chunk;
+    }
+}
+
 #if PRINTF_ADVANCED_ENABLE
 static uint8_t PrintGetSignChar(int32_t ival, uint32_t flags_used, char *schar)
 {
@@ -247,14 +321,8 @@ static uint32_t PrintIsdi(const char c)
     return ret;
 }
 
-static void PrintOutputdifFobpu(uint32_t flags_used,
-                                uint32_t field_width,
-                                uint32_t vlen,
-                                char schar,
-                                char *vstrp,
-                                printfCb cb,
-                                char *buf,
-                                int32_t *count)
+static void PrintOutputdifFobpu(
+    uint32_t flags_used, uint32_t field_width, uint32_t vlen, char schar, const char *vstrp, print_output_t *out)
 {
 #if PRINTF_ADVANCED_ENABLE
     /* Do the ZERO pad. */
@@ -262,52 +330,43 @@ static void PrintOutputdifFobpu(uint32_t flags_used,
     {
         if ('\0' != schar)
         {
-            cb(buf, count, schar, 1);
+            PrintOutputRun(out, &schar, 1);
             schar = '\0';
         }
-        cb(buf, count, '0', (int)field_width - (int)vlen);
+        PrintOutputFill(out, '0', (int)field_width - (int)vlen);
         vlen = field_width;
     }
     else
     {
         if (0U == (flags_used & (uint32_t)kPRINTF_Minus))
         {
-            cb(buf, count, ' ', (int)field_width - (int)vlen);
+            PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
             if ('\0' != schar)
             {
-                cb(buf, count, schar, 1);
+                PrintOutputRun(out, &schar, 1);
                 schar = '\0';
             }
         }
     }
-    /* The string was built in reverse order, now display in correct order. */
+    /* Sign not output before the padding. */
     if ('\0' != schar)
     {
-        cb(buf, count, schar, 1);
+        PrintOutputRun(out, &schar, 1);
     }
 #else
-    cb(buf, count, ' ', (int)field_width - (int)vlen);
+    PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
 #endif /* PRINTF_ADVANCED_ENABLE */
-    while ('\0' != (*vstrp))
-    {
-        cb(buf, count, *vstrp--, 1);
-    }
+    PrintOutputRun(out, vstrp, (int)strlen(vstrp));
 #if PRINTF_ADVANCED_ENABLE
     if (0U != (flags_used & (uint32_t)kPRINTF_Minus))
     {
-        cb(buf, count, ' ', (int)field_width - (int)vlen);
+        PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
     }
 #endif /* PRINTF_ADVANCED_ENABLE */
 }
 
-static void PrintOutputxX(uint32_t flags_used,
-                          uint32_t field_width,
-                          uint32_t vlen,
-                          bool use_caps,
-                          char *vstrp,
-                          printfCb cb,
-                          char *buf,
-                          int32_t *count)
+static void PrintOutputxX(
+    uint32_t flags_used, uint32_t field_width, uint32_t vlen, bool use_caps, const char *vstrp, print_output_t *out)
 {
 #if PRINTF_ADVANCED_ENABLE
     uint8_t dschar = 0;
@@ -315,11 +374,10 @@ static void PrintOutputxX(uint32_t flags_used,
     {
         if (0U != (flags_used & (uint32_t)kPRINTF_Pound))
         {
-            cb(buf, count, '0', 1);
-            cb(buf, count, (use_caps ? 'X' : 'x'), 1);
+            PrintOutputRun(out, (use_caps ? "0X" : "0x"), 2);
             dschar = 1U;
         }
-        cb(buf, count, '0', (int)field_width - (int)vlen);
+        PrintOutputFill(out, '0', (int)field_width - (int)vlen);
         vlen = field_width;
     }
     else
@@ -330,11 +388,10 @@ static void PrintOutputxX(uint32_t flags_used,
             {
                 vlen += 2U;
             }
-            cb(buf, count, ' ', (int)field_width - (int)vlen);
+            PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
             if (0U != (flags_used & (uint32_t)kPRINTF_Pound))
             {
-                cb(buf, count, '0', 1);
-                cb(buf, count, (use_caps ? 'X' : 'x'), 1);
+                PrintOutputRun(out, (use_caps ? "0X" : "0x"), 2);
                 dschar = 1U;
             }
         }
@@ -342,21 +399,17 @@ static void PrintOutputxX(uint32_t flags_used,
 
     if ((0U != (flags_used & (uint32_t)kPRINTF_Pound)) && (0U == dschar))
     {
-        cb(buf, count, '0', 1);
-        cb(buf, count, (use_caps ? 'X' : 'x'), 1);
+        PrintOutputRun(out, (use_caps ? "0X" : "0x"), 2);
         vlen += 2U;
     }
 #else
-    cb(buf, count, ' ', (int)field_width - (int)vlen);
+    PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
 #endif /* PRINTF_ADVANCED_ENABLE */
-    while ('\0' != (*vstrp))
-    {
-        cb(buf, count, *vstrp--, 1);
-    }
+    PrintOutputRun(out, vstrp, (int)strlen(vstrp));
 #if PRINTF_ADVANCED_ENABLE
     if (0U != (flags_used & (uint32_t)kPRINTF_Minus))
     {
-        cb(buf, count, ' ', (int)field_width - (int)vlen);
+        PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
     }
 #endif /* PRINTF_ADVANCED_ENABLE */
 }
@@ -511,115 +564,50 @@ static uint32_t ScanIgnoreWhiteSpace(const char **s)
     return count;
 }
 
-static int32_t ConvertRadixNumToString(char *numstr, void *nump, int32_t neg, int32_t radix, bool use_caps)
+static char *ConvertRadixNumToString(char *numend, print_uint_t value, uint32_t radix, bool use_caps)
 {
-#if PRINTF_ADVANCED_ENABLE
-    int64_t a;
-    int64_t b;
-    int64_t c;
-
-    uint64_t ua;
-    uint64_t ub;
-    uint64_t uc;
-    uint64_t uc_param;
-#else
-    int32_t a;
-    int32_t b;
-    int32_t c;
-
-    uint32_t ua;
-    uint32_t ub;
-    uint32_t uc;
-    uint32_t uc_param;
-#endif /* PRINTF_ADVANCED_ENABLE */
-
-    int32_t nlen;
-    char *nstrp;
+    const char *digits = use_caps ? s_hexDigitsUpper : s_hexDigitsLower;
+    char *nstrp        = numend;
+    print_uint_t quotient;
+    uint32_t pair;
+    uint32_t shift;
 
-    nlen     = 0;
-    nstrp    = numstr;
-    *nstrp++ = '\0';
+    *nstrp = '\0';
 
-    if (0 != neg)
+    if (radix == 10U)
     {
-#if PRINTF_ADVANCED_ENABLE
-        a = *(int64_t *)nump;
-#else
-        a = *(int32_t *)nump;
-#endif /* PRINTF_ADVANCED_ENABLE */
-        if (a == 0)
+        /* Two digits per division, from the pair table. */
+        while (value >= 100U)
         {
-            *nstrp = '0';
-            ++nlen;
-            return nlen;
+            quotient = value / 100U;
+            pair     = (uint32_t)(value - (quotient * 100U)) * 2U;
+            value    = quotient;
+            *--nstrp = s_decimalPairs[pair + 1U];
+            *--nstrp = s_decimalPairs[pair];
         }
-        while (a != 0)
+        if (value >= 10U)
         {
-#if PRINTF_ADVANCED_ENABLE
-            b = (int64_t)a / (int64_t)radix;
-            c = (int64_t)a - ((int64_t)b * (int64_t)radix);
-            if (c < 0)
-            {
-                uc       = (uint64_t)c;
-                uc_param = ~uc;
-                c        = (int64_t)uc_param + 1 + (int64_t)'0';
-            }
-#else
-            b = a / radix;
-            c = a - (b * radix);
-            if (c < 0)
-            {
-                uc       = (uint32_t)c;
-                uc_param = ~uc;
-                c        = (int32_t)uc_param + 1 + (int32_t)'0';
-            }
-#endif /* PRINTF_ADVANCED_ENABLE */
-            else
-            {
-                c = c + (int32_t)'0';
-            }
-            a        = b;
-            *nstrp++ = (char)c;
-            ++nlen;
+            pair     = (uint32_t)value * 2U;
+            *--nstrp = s_decimalPairs[pair + 1U];
+            *--nstrp = s_decimalPairs[pair];
+        }
+        else
+        {
+            *--nstrp = (char)('0' + (uint32_t)value);
         }
     }
     else
     {
-#if PRINTF_ADVANCED_ENABLE
-        ua = *(uint64_t *)nump;
-#else
-        ua = *(uint32_t *)nump;
-#endif /* PRINTF_ADVANCED_ENABLE */
-        if (ua == 0U)
+        /* Power of two radix, one shift per digit. */
+        shift = (radix == 16U) ? 4U : ((radix == 8U) ? 3U : 1U);
+        do
         {
-            *nstrp = '0';
-            ++nlen;
-            return nlen;
-        }
-        while (ua != 0U)
-        {
-#if PRINTF_ADVANCED_ENABLE
-            ub = (uint64_t)ua / (uint64_t)radix;
-            uc = (uint64_t)ua - ((uint64_t)ub * (uint64_t)radix);
-#else
-            ub = ua / (uint32_t)radix;
-            uc = ua - (ub * (uint32_t)radix);
-#endif /* PRINTF_ADVANCED_ENABLE */
-
-            if (uc < 10U)
-            {
-                uc = uc + (uint32_t)'0';
-            }
-            else
-            {
-                uc = uc - 10U + (uint32_t)(use_caps ? 'A' : 'a');
-            }
-            ua       = ub;
-            *nstrp++ = (char)uc;
-            ++nlen;
-        }
+            *--nstrp = digits[(uint32_t)value & (radix - 1U)];
+            value >>= shift;
+        } while (value != 0U);
     }
-    return nlen;
+
+    return nstrp;
 }
 
 #if PRINTF_FLOAT_ENABLE
@@ -719,37 +707,42 @@ static int32_t ConvertFloatRadixNumToString(char *numstr, void *nump, int32_t ra
     }
     return nlen;
 }
+
+/* Reverses the 'nlen' characters built after the terminator at numstr[0], returns the string in order. */
+static char *PrintReverseString(char *numstr, int32_t nlen)
+{
+    char *first = &numstr[1];
+    char *last  = &numstr[nlen];
+    char c;
+
+    while (first < last)
+    {
+        c        = *first;
+        *first++ = *last;
+        *last--  = c;
+    }
+    numstr[nlen + 1] = '\0';
+
+    return &numstr[1];
+}
 #endif /* PRINTF_FLOAT_ENABLE */
 
-/*!
- * brief This function outputs its parameters according to a formatted string.
- *
- * note I/O is performed by calling given function pointer using following
- * (*func_ptr)(c);
- *
- * param[in] fmt_ptr   Format string for printf.
- * param[in] args_ptr  Arguments to printf.
- * param[in] buf  pointer to the buffer
- * param cb print callback function pointer
- *
- * return Number of characters to be print
- */
-int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
+static int StrFormatPrintfOutput(const char *fmt, va_list ap, print_output_t *out)
 {
     /* va_list ap; */
     const char *p;
+    const char *run;
     char c;
 
-    char vstr[33];
+    char vstr[PRINT_NUM_BUFFER_SIZE];
     char *vstrp  = NULL;
     int32_t vlen = 0;
 
-    int32_t count = 0;
-
     uint32_t field_width;
     uint32_t precision_width;
     char *sval;
     int32_t cval;
+    char cchar;
     bool use_caps;
     uint8_t radix = 0;
 
@@ -785,8 +778,13 @@ int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
          */
         if (c != '%')
         {
-            cb(buf, &count, c, 1);
-            p++;
+            /* Output the text up to the next format as one run. */
+            run = p;
+            while (('\0' != *p) && ('%' != *p))
+            {
+                p++;
+            }
+            PrintOutputRun(out, run, (int)(p - run));
             /* By using 'continue', the next iteration of the loop is used, skipping the code that follows. */
             continue;
         }
@@ -829,13 +827,15 @@ int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
                 {
                     ival = (int32_t)va_arg(ap, int32_t);
                 }
-                vlen  = ConvertRadixNumToString(vstr, (void *)&ival, 1, 10, use_caps);
-                vstrp = &vstr[vlen];
+                /* Magnitude of the value, the sign is output separately. */
+                uval  = (ival < 0) ? (0U - (print_uint_t)ival) : (print_uint_t)ival;
+                vstrp = ConvertRadixNumToString(&vstr[sizeof(vstr) - 1U], uval, 10U, use_caps);
+                vlen  = (int32_t)(&vstr[sizeof(vstr) - 1U] - vstrp);
 #if PRINTF_ADVANCED_ENABLE
                 vlen += PrintGetSignChar(ival, flags_used, &schar);
-                PrintOutputdifFobpu(flags_used, field_width, vlen, schar, vstrp, cb, buf, &count);
+                PrintOutputdifFobpu(flags_used, field_width, vlen, schar, vstrp, out);
 #else
-                PrintOutputdifFobpu(0U, field_width, (uint32_t)vlen, '\0', vstrp, cb, buf, &count);
+                PrintOutputdifFobpu(0U, field_width, (uint32_t)vlen, '\0', vstrp, out);
 #endif
             }
             else if (1U == PrintIsfF(c))
@@ -843,13 +843,13 @@ int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
 #if PRINTF_FLOAT_ENABLE
                 fval  = (double)va_arg(ap, double);
                 vlen  = ConvertFloatRadixNumToString(vstr, &fval, 10, precision_width);
-                vstrp = &vstr[vlen];
+                vstrp = PrintReverseString(vstr, vlen);
 
 #if PRINTF_ADVANCED_ENABLE
                 vlen += PrintGetSignChar((int32_t)fval, flags_used, &schar);
-                PrintOutputdifFobpu(flags_used, field_width, vlen, schar, vstrp, cb, buf, &count);
+                PrintOutputdifFobpu(flags_used, field_width, vlen, schar, vstrp, out);
 #else
-                PrintOutputdifFobpu(0, field_width, vlen, '\0', vstrp, cb, buf, &count);
+                PrintOutputdifFobpu(0, field_width, vlen, '\0', vstrp, out);
 #endif
 
 #else
@@ -872,12 +872,12 @@ int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
                 {
                     uval = (uint32_t)va_arg(ap, uint32_t);
                 }
-                vlen  = ConvertRadixNumToString(vstr, &uval, 0, 16, use_caps);
-                vstrp = &vstr[vlen];
+                vstrp = ConvertRadixNumToString(&vstr[sizeof(vstr) - 1U], uval, 16U, use_caps);
+                vlen  = (int32_t)(&vstr[sizeof(vstr) - 1U] - vstrp);
 #if PRINTF_ADVANCED_ENABLE
-                PrintOutputxX(flags_used, field_width, vlen, use_caps, vstrp, cb, buf, &count);
+                PrintOutputxX(flags_used, field_width, vlen, use_caps, vstrp, out);
 #else
-                PrintOutputxX(0U, field_width, (uint32_t)vlen, use_caps, vstrp, cb, buf, &count);
+                PrintOutputxX(0U, field_width, (uint32_t)vlen, use_caps, vstrp, out);
 #endif
             }
             else if (1U == PrintIsobpu(c))
@@ -895,18 +895,19 @@ int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
 
                 radix = PrintGetRadixFromobpu(c);
 
-                vlen  = ConvertRadixNumToString(vstr, &uval, 0, (int32_t)radix, use_caps);
-                vstrp = &vstr[vlen];
+                vstrp = ConvertRadixNumToString(&vstr[sizeof(vstr) - 1U], uval, radix, use_caps);
+                vlen  = (int32_t)(&vstr[sizeof(vstr) - 1U] - vstrp);
 #if PRINTF_ADVANCED_ENABLE
-                PrintOutputdifFobpu(flags_used, field_width, vlen, '\0', vstrp, cb, buf, &count);
+                PrintOutputdifFobpu(flags_used, field_width, vlen, '\0', vstrp, out);
 #else
-                PrintOutputdifFobpu(0U, field_width, (uint32_t)vlen, '\0', vstrp, cb, buf, &count);
+                PrintOutputdifFobpu(0U, field_width, (uint32_t)vlen, '\0', vstrp, out);
 #endif
             }
             else if (c == 'c')
             {
-                cval = (int32_t)va_arg(ap, uint32_t);
-                cb(buf, &count, cval, 1);
+                cval  = (int32_t)va_arg(ap, uint32_t);
+                cchar = (char)cval;
+                PrintOutputRun(out, &cchar, 1);
             }
             else if (c == 's')
             {
@@ -929,48 +930,79 @@ int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
                     if (!(flags_used & kPRINTF_Minus))
 #endif /* PRINTF_ADVANCED_ENABLE */
                     {
-                        cb(buf, &count, ' ', (int)field_width - (int)vlen);
+                        PrintOutputFill(out, ' ', (int)field_width - (int)vlen);
                     }
 
 #if PRINTF_ADVANCED_ENABLE
                     if (valid_precision_width)
                     {
-                        while ((*sval) && (vlen > 0))
-                        {
-                            cb(buf, &count, *sval++, 1);
-                            vlen--;
-                        }
-                        /* In case that vlen sval is shorter than vlen */
-                        vlen = precision_width - vlen;
-                    }
-                    else
-                    {
-#endif /* PRINTF_ADVANCED_ENABLE */
-                        while ('\0' != (*sval))
+                        /* At most the precision, the string may be shorter. */
+                        run = sval;
+                        while ((*run) && ((run - sval) < vlen))
                         {
-                            cb(buf, &count, *sval++, 1);
+                            run++;
                         }
-#if PRINTF_ADVANCED_ENABLE
+                        vlen = run - sval;
                     }
 #endif /* PRINTF_ADVANCED_ENABLE */
+                    PrintOutputRun(out, sval, (int)vlen);
 
 #if PRINTF_ADVANCED_ENABLE
                     if (flags_used & kPRINTF_Minus)
                     {
-                        cb(buf, &count, ' ', field_width - vlen);
+                        PrintOutputFill(out, ' ', field_width - vlen);
                     }
 #endif /* PRINTF_ADVANCED_ENABLE */
                 }
             }
             else
             {
-                cb(buf, &count, c, 1);
+                PrintOutputRun(out, &c, 1);
             }
         }
         p++;
     }
 
-    return count;
+    return *out->count;
+}
+
+/*!
+ * brief This function outputs its parameters according to a formatted string.
+ *
+ * note I/O is performed by calling given function pointer using following
+ * (*func_ptr)(c);
+ *
+ * param[in] fmt_ptr   Format string for printf.
+ * param[in] args_ptr  Arguments to printf.
+ * param[in] buf  pointer to the buffer
+ * param cb print callback function pointer
+ *
+ * return Number of characters to be print
+ */
+int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb)
+{
+    int32_t count      = 0;
+    print_output_t out = {cb, NULL, buf, &count};
+
+    return StrFormatPrintfOutput(fmt, ap, &out);
+}
+
+/*!
+ * brief This function outputs its parameters according to a formatted string, in runs of characters.
+ *
+ * param[in] fmt  Format string for printf.
+ * param[in] ap   Arguments to printf.
+ * param[in] buf  pointer to the buffer
+ * param cb print run callback function pointer
+ *
+ * return Number of characters to be print
+ */
+int StrFormatPrintfRun(const char *fmt, va_list ap, char *buf, printfRunCb cb)
+{
+    int32_t count      = 0;
+    print_output_t out = {NULL, cb, buf, &count};
+
+    return StrFormatPrintfOutput(fmt, ap, &out);
 }
 
 #if SCANF_FLOAT_ENABLE
@@ -29,6 +29,11 @@ extern "C" {
  */
 typedef void (*printfCb)(char *buf, int32_t *indicator, char val, int len);
 
+/*!
+ * @brief A function pointer which is used when format printf log in runs, it outputs the len characters of str.
+ */
+typedef void (*printfRunCb)(char *buf, int32_t *indicator, const char *str, int len);
+
 /*!
  * @brief This function outputs its parameters according to a formatted string.
  *
@@ -44,6 +49,21 @@ typedef void (*printfCb)(char *buf, int32_t *indicator, char val, int len);
  */
 int StrFormatPrintf(const char *fmt, va_list ap, char *buf, printfCb cb);
 
+/*!
+ * @brief This function outputs its parameters according to a formatted string, in runs of characters.
+ *
+ * @note The text between the formats, each converted argument and each padding are output by one call of the
+ * callback, instead of one call per character.
+ *
+ * @param[in] fmt   Format string for printf.
+ * @param[in] ap  Arguments to printf.
+ * @param[in] buf  pointer to the buffer
+ * @param cb print run callback function pointer
+ *
+ * @return Number of characters to be print
+ */
+int StrFormatPrintfRun(const char *fmt, va_list ap, char *buf, printfRunCb cb);
+
 /*!
  * @brief Converts an input line of ASCII characters based upon a provided
  * string format.
@@ -41,7 +41,12 @@
  *----------------------------------------------------------*/
 
 #define configUSE_PREEMPTION                    1
+/* Battery powered deployments set tickless idle to 2, which selects the low power
+implementation of low_power.c, the sleep hooks below then suspend the Ethernet MAC
+for long idle periods. */
+#ifndef configUSE_TICKLESS_IDLE
 #define configUSE_TICKLESS_IDLE                 0
+#endif
 #define configCPU_CLOCK_HZ                      (SystemCoreClock)
 #define configTICK_RATE_HZ                      ((TickType_t)200)
 #define configMAX_PRIORITIES                    5
@@ -50,6 +55,7 @@
 #define configUSE_16_BIT_TICKS                  0
 #define configIDLE_SHOULD_YIELD                 1
 #define configUSE_TASK_NOTIFICATIONS            1
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   4 /* Index 1 aborts retry backoff sleeps, index 2 waits for crypto jobs, index 3 for DMA copies. */
 #define configUSE_MUTEXES                       1
 #define configUSE_RECURSIVE_MUTEXES             1
 #define configUSE_COUNTING_SEMAPHORES           1
@@ -64,8 +70,12 @@
 /* Ensure that system calls can only be made from kernel code. */
 #define configENFORCE_SYSTEM_CALLS_FROM_KERNEL_ONLY             1
 
-/* Used memory allocation (heap_x.c) */
-#define configFRTOS_MEMORY_SCHEME               4
+/* Used memory allocation (heap_x.c). With 5 the heap spans the RAM left free in every bank, see
+ * heap_regions.c, and configTOTAL_HEAP_SIZE is not used. heap_5.c must then be built instead of
+ * heap_4.c: swap them in the excluded resources of the build configuration. */
+#ifndef configFRTOS_MEMORY_SCHEME
+    #define configFRTOS_MEMORY_SCHEME           4
+#endif
 
 /* Tasks.c additions (e.g. Thread Aware Debug capability) */
 #define configINCLUDE_FREERTOS_TASK_C_ADDITIONS_H 1
@@ -76,15 +86,36 @@
 #define configTOTAL_HEAP_SIZE                   ((size_t)(98 * 1024))
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
+/* With 1 the tasks, queues, semaphores, event groups and timers of the MQTT agent, OTA and the demo
+ * tasks are created with the static APIs in storage placed by the linker, the RAM they use is then
+ * known at link time and the heap only holds the protocol data. The storage is taken from .bss, lower
+ * configTOTAL_HEAP_SIZE accordingly when heap_4 is used. */
+#ifndef configAPPLICATION_STATIC_OBJECTS
+    #define configAPPLICATION_STATIC_OBJECTS    0
+#endif
+
+#if ( configAPPLICATION_STATIC_OBJECTS == 1 ) && ( configSUPPORT_STATIC_ALLOCATION != 1 )
+    #error "configAPPLICATION_STATIC_OBJECTS requires configSUPPORT_STATIC_ALLOCATION."
+#endif
+
 /* Hook function related definitions. */
 #define configUSE_IDLE_HOOK                     0
-#define configUSE_TICK_HOOK                     0
-#define configCHECK_FOR_STACK_OVERFLOW          0
+/* The tick hook samples the SysTick entry latency, see irq_latency.h. */
+#if defined( irqlatencyENABLED ) && ( irqlatencyENABLED == 1 )
+    #define configUSE_TICK_HOOK                     1
+#else
+    #define configUSE_TICK_HOOK                     0
+#endif
+/* Method 2 checks the last 16 bytes of the stack on each context switch, see tools/stack_usage.py
+ * for the static worst case of each task. */
+#define configCHECK_FOR_STACK_OVERFLOW          2
 #define configUSE_MALLOC_FAILED_HOOK            1
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+/* The run time counter is the DWT cycle counter extended to 64 bits, see task_stats.c. */
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
@@ -113,8 +144,13 @@
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       1
-#define INCLUDE_uxTaskGetStackHighWaterMark     0
-#define INCLUDE_xTaskGetIdleTaskHandle          0
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+/* The iperf tests read the idle time with ulTaskGetIdleRunTimeCounter(), see iperf.h. */
+#if defined( iperfENABLED ) && ( iperfENABLED == 1 )
+    #define INCLUDE_xTaskGetIdleTaskHandle      1
+#else
+    #define INCLUDE_xTaskGetIdleTaskHandle      0
+#endif
 #define INCLUDE_eTaskGetState                   0
 #define INCLUDE_xTimerPendFunctionCall          1
 #define INCLUDE_xTaskAbortDelay                 0
@@ -127,8 +163,26 @@
     /* Clock manager provides in this variable system core clock frequency */
     #include <stdint.h>
     extern uint32_t SystemCoreClock;
+
+    /* Ethernet link power management, see link_power.c. */
+    extern void LinkPower_PreSleepProcessing( uint32_t ulExpectedIdleTime );
+    extern void LinkPower_PostSleepProcessing( uint32_t ulExpectedIdleTime );
+
+    /* Tickless idle: SysTick sleep or RTC timed deep sleep, see low_power.c. */
+    extern void LowPower_SuppressTicksAndSleep( uint32_t xExpectedIdleTime );
+
+    /* Run time stats on the DWT cycle counter, see task_stats.c. */
+    extern void TaskStats_ConfigureTimer( void );
+    extern uint64_t TaskStats_GetRunTimeCounter( void );
 #endif
 
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()    TaskStats_ConfigureTimer()
+#define portGET_RUN_TIME_COUNTER_VALUE()            TaskStats_GetRunTimeCounter()
+
+#define configPRE_SLEEP_PROCESSING( x )         LinkPower_PreSleepProcessing( x )
+#define configPOST_SLEEP_PROCESSING( x )        LinkPower_PostSleepProcessing( x )
+#define portSUPPRESS_TICKS_AND_SLEEP( x )       LowPower_SuppressTicksAndSleep( x )
+
 /* Interrupt nesting behaviour configuration. Cortex-M specific. */
 #ifdef __NVIC_PRIO_BITS
 /* __BVIC_PRIO_BITS will be specified when CMSIS is being used. */
@@ -163,4 +217,19 @@ standard names. */
 
 #include "trcRecorder.h"
 
+/* Attribution of the allocations to their call sites, see heap_monitor.h. Defined after the
+ * recorder, which would otherwise replace the hooks with its memory events. */
+#if defined( heapmonitorTRACK_CALLERS ) && ( heapmonitorTRACK_CALLERS == 1 )
+    #if defined(__ICCARM__)||defined(__CC_ARM)||defined(__GNUC__)
+        #include <stddef.h>
+        extern void HeapMonitor_TraceMalloc( const void * pvAddress, size_t xSize, const void * pvCaller );
+        extern void HeapMonitor_TraceFree( const void * pvAddress );
+    #endif
+
+    #undef traceMALLOC
+    #define traceMALLOC( pvAddress, uiSize )    HeapMonitor_TraceMalloc( ( pvAddress ), ( uiSize ), __builtin_return_address( 0 ) )
+    #undef traceFREE
+    #define traceFREE( pvAddress, uiSize )      HeapMonitor_TraceFree( ( pvAddress ) )
+#endif
+
 #endif /* FREERTOS_CONFIG_H */
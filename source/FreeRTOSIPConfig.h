@@ -37,6 +37,9 @@
 /* header to bring in the PRINTF */
 #include "fsl_debug_console.h"
 
+/* Buffer sizes of the selected performance profile. */
+#include "perf_profile.h"
+
 /* Set to 1 to print out debug messages.  If ipconfigHAS_DEBUG_PRINTF is set to
  * 1 then FreeRTOS_debug_printf should be defined to the function used to print
  * out the debugging messages. */
@@ -63,6 +66,11 @@
  * stack repeating the checksum calculations. */
 #define ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM     1
 
+/* The ENET driver inserts the IP, TCP, UDP and ICMP checksums of transmitted
+ * frames when kENET_ChecksumOffloadEnable is set, which is part of the default
+ * ENET configuration, so the stack does not calculate them. */
+#define ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM     1
+
 /* Several API's will block until the result is known, or the action has been
  * performed, for example FreeRTOS_send() and FreeRTOS_recv().  The timeouts can be
  * set per socket, using setsockopt().  If not set, the times below will be
@@ -86,8 +94,16 @@
 #define ipconfigUSE_DNS_CACHE                      ( 1 )
 #define ipconfigDNS_CACHE_NAME_LENGTH              ( 64 )
 #define ipconfigDNS_CACHE_ENTRIES                  ( 4 )
+
+/* Keep several A records per name, FreeRTOS_dnslookup() returns them in turn to the
+ * sockets wrapper which connects to them in parallel. */
+#define ipconfigDNS_CACHE_ADDRESSES_PER_ENTRY      ( 3 )
 #define ipconfigDNS_REQUEST_ATTEMPTS               ( 2 )
 
+/* FreeRTOS_gethostbyname_a() refreshes the known server addresses in the background
+ * while the sockets wrapper reconnects to the last address that worked. */
+#define ipconfigDNS_USE_CALLBACKS                  ( 1 )
+
 /* The IP stack executes it its own task (although any application task can make
  * use of its services through the published sockets API). ipconfigUDP_TASK_PRIORITY
  * sets the priority of the task that executes the IP stack.  The priority is a
@@ -99,6 +115,12 @@
  * priority assigned to tasks that use the IP stack. */
 #define ipconfigIP_TASK_PRIORITY                   ( ( configMAX_PRIORITIES - 2 ) | portPRIVILEGE_BIT )
 
+/* Called by the IP task on every iteration of its loop, so the watchdog
+ * supervisor can tell the IP task is alive.  The IP task wakes up at least
+ * every ipconfigMAX_IP_TASK_SLEEP_TIME (10 s by default). */
+#include "watchdog.h"
+#define ipconfigWATCHDOG_TIMER()                   Watchdog_CheckIn( WATCHDOG_CLIENT_IP_TASK )
+
 /* The size, in words (not bytes), of the stack allocated to the FreeRTOS+TCP
  * task.  This setting is less important when the FreeRTOS Win32 simulator is used
  * as the Win32 simulator only stores a fixed amount of information on the task
@@ -153,6 +175,11 @@ extern UBaseType_t uxRand();
  * a DHCP reply being received. */
 #define ipconfigMAXIMUM_DISCOVER_TX_PERIOD                    ( 120000 / portTICK_PERIOD_MS )
 
+/* The DHCP hook of dhcp_lease.c skips the DISCOVER when a lease is stored in
+ * flash: the stored addresses are given to FreeRTOS_IPInit() and confirmed with
+ * an INIT-REBOOT REQUEST, a full DISCOVER is only run if the server refuses them. */
+#define ipconfigUSE_DHCP_HOOK                                 1
+
 /* The ARP cache is a table that maps IP addresses to MAC addresses.  The IP
  * stack can only send a UDP message to a remove IP address if it knowns the MAC
  * address associated with the IP address, or the MAC address of the router used to
@@ -188,11 +215,40 @@ extern UBaseType_t uxRand();
  * not set to 1 then only FreeRTOS_indet_addr_quick() is available. */
 #define ipconfigINCLUDE_FULL_INET_ADDR                        1
 
+/* Set to 1 for full size Ethernet frames: a 1500 byte MTU cuts the number of
+ * segments, and so of interrupts and stack passes, per TLS record.  The network
+ * buffers are allocated statically by BufferAllocation_1, in the otherwise
+ * unused SRAM_0_1_2_3_UNUSED bank (see Demo.ld), so the larger pool does not
+ * come out of the FreeRTOS heap.  Each buffer then takes 1536 bytes, which
+ * leaves room for 16 of them next to the ENET descriptors and receive buffers
+ * in the 32 KB bank.  The default comes from democonfigPERF_PROFILE. */
+#ifndef democonfigNETWORK_MTU_1500
+    #define democonfigNETWORK_MTU_1500                        perfprofileNETWORK_MTU_1500
+#endif
+
 /* ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS defines the total number of network buffer that
  * are available to the IP stack.  The total number of network buffers is limited
  * to ensure the total amount of RAM that can be consumed by the IP stack is capped
  * to a pre-determinable value. */
-#define ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS                15
+#if ( democonfigNETWORK_MTU_1500 == 1 )
+    #define ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS            16
+#else
+    #define ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS            15
+#endif
+
+/* Network buffers kept for the control traffic: once no more are free, the receive
+ * filter of main.c drops the incoming TCP segments carrying data, so that ARP, DHCP,
+ * ICMP and the ACKs sent and received still find a buffer during a download.  The
+ * receive windows of the sockets, see freertos_sockets_wrapper.h, leave them free in
+ * the normal case. */
+#ifndef democonfigNETWORK_CONTROL_BUFFERS
+    #define democonfigNETWORK_CONTROL_BUFFERS                 3
+#endif
+
+/* Each UDP socket holds its received packets in network buffers until they are read,
+ * so the packets queued on a socket are capped to keep a slow reader from taking the
+ * buffers of the others. */
+#define ipconfigUDP_MAX_RX_PACKETS                            ( 2U )
 
 /* A FreeRTOS queue is used to send events from application tasks to the IP
  * stack.  ipconfigEVENT_QUEUE_LENGTH sets the maximum number of events that can
@@ -224,6 +280,10 @@ extern UBaseType_t uxRand();
 /* Use the TCP socket wake context with a callback. */
 #define ipconfigSOCKET_HAS_USER_WAKE_CALLBACK_WITH_CONTEXT    ( 1 )
 
+/* Allow a callback to be invoked from the IP task when a socket receives data,
+ * used to wake up the MQTT agent task. */
+#define ipconfigSOCKET_HAS_USER_WAKE_CALLBACK                 ( 1 )
+
 /* USE_WIN: Let TCP use windowing mechanism. */
 #define ipconfigUSE_TCP_WIN                                   ( 1 )
 
@@ -231,8 +291,13 @@ extern UBaseType_t uxRand();
  * contain.  For normal Ethernet V2 frames the maximum MTU is 1500.  Setting a
  * lower value can save RAM, depending on the buffer management scheme used.  If
  * ipconfigCAN_FRAGMENT_OUTGOING_PACKETS is 1 then (ipconfigNETWORK_MTU - 28) must
- * be divisible by 8. */
-#define ipconfigNETWORK_MTU                                   1200
+ * be divisible by 8.  The ENET receive buffers hold ENET_FRAME_MAX_FRAMELEN
+ * bytes, which is checked against the MTU in main.c. */
+#if ( democonfigNETWORK_MTU_1500 == 1 )
+    #define ipconfigNETWORK_MTU                               1500
+#else
+    #define ipconfigNETWORK_MTU                               1200
+#endif
 
 /* Set ipconfigUSE_DNS to 1 to include a basic DNS client/resolver.  DNS is used
  * through the FreeRTOS_gethostbyname() API function. */
@@ -250,6 +315,11 @@ extern UBaseType_t uxRand();
  * (and associated) API function is available. */
 #define ipconfigSUPPORT_SELECT_FUNCTION                       1
 
+/* If ipconfigSUPPORT_SIGNALS is set to 1 then FreeRTOS_SignalSocket() is
+ * available, used by the network reactor to make its FreeRTOS_select() return
+ * when work is posted from another task, see net_reactor.h. */
+#define ipconfigSUPPORT_SIGNALS                               1
+
 /* If ipconfigFILTER_OUT_NON_ETHERNET_II_FRAMES is set to 1 then Ethernet frames
  * that are not in Ethernet II format will be dropped.  This option is included for
  * potential future IP stack developments. */
@@ -297,8 +367,11 @@ extern UBaseType_t uxRand();
 #define ipconfigTCP_HANG_PROTECTION         ( 1 )
 #define ipconfigTCP_HANG_PROTECTION_TIME    ( 30 )
 
-/* Include support for TCP keep-alive messages. */
-#define ipconfigTCP_KEEP_ALIVE              ( 1 )
+/* TCP keep-alive messages are disabled, FreeRTOS+TCP only has a global setting
+ * for them.  The only long lived connection is the MQTT one, whose PINGREQ
+ * already detects a dead peer and keeps NAT mappings open, while the HTTP
+ * connections are bounded by their receive timeouts. */
+#define ipconfigTCP_KEEP_ALIVE              ( 0 )
 #define ipconfigTCP_KEEP_ALIVE_INTERVAL     ( 20 ) /* in seconds */
 
 #define portINLINE                          __inline
@@ -0,0 +1,529 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file app_module.c
+ * @brief Selection, loading and trial of the application module, and the services the base image
+ * provides to it.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "app_module.h"
+
+#if ( appmoduleENABLED == 1 )
+
+    #include "fsl_debug_console.h"
+
+    #include "spifi_boot.h"
+    #include "mflash_file.h"
+
+    #include "core_mqtt_agent.h"
+    #include "connection_manager.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief File recording the committed module and the module on trial, also listed in the file table
+ * of the PKCS #11 PAL.
+ */
+    #define appmoduleFILE            "app_module.dat"
+
+/**
+ * @brief Marker of the record, "MOD1".
+ */
+    #define appmoduleRECORD_MAGIC    ( 0x31444F4DUL )
+
+    #if ( ( appmoduleRAM_ADDR % 32U ) != 0U ) || ( ( appmoduleRAM_SIZE % 32U ) != 0U )
+        #error "The module RAM window must be aligned to 32 bytes"
+    #endif
+
+/**
+ * @brief State of the module on trial.
+ */
+    typedef enum AppModuleState
+    {
+        appmoduleSTATE_IDLE = 0, /**< No trial, the committed module runs. */
+        appmoduleSTATE_NEW,      /**< Installed, runs on trial from the next reset. */
+        appmoduleSTATE_TRIAL     /**< Running on trial, reverted if the next reset comes before the commit. */
+    } AppModuleState_t;
+
+/**
+ * @brief Record saved to appmoduleFILE.
+ */
+    typedef struct AppModuleRecord
+    {
+        uint32_t ulMagic;
+        uint32_t ulActive; /**< Slot of the committed module, 0 if none was installed by OTA. */
+        uint32_t ulTrial;  /**< Slot of the module on trial, 0 for none. */
+        uint32_t ulState;  /**< AppModuleState_t. */
+    } AppModuleRecord_t;
+
+/**
+ * @brief Subscription of the module, sent again when the session is not resumed.
+ */
+    typedef struct AppModuleSubscription
+    {
+        ConnectionSubscription_t xSubscription;
+        AppModuleIncomingPublish_t xCallback;
+        void * pvContext;
+    } AppModuleSubscription_t;
+
+/**
+ * @brief RAM window reserved by Demo.ld, the symbols are absolute values.
+ */
+    extern uint8_t __app_module_ram_start__[];
+    extern uint8_t __app_module_ram_size__[];
+
+/*-----------------------------------------------------------*/
+
+    static int prvPrintf( const char * pcFormat,
+                          ... );
+    static void prvDeleteTask( TaskHandle_t xTask );
+    static BaseType_t prvCreateTask( TaskFunction_t pxCode,
+                                     const char * pcName,
+                                     configSTACK_DEPTH_TYPE usStackDepth,
+                                     void * pvParameters,
+                                     UBaseType_t uxPriority,
+                                     TaskHandle_t * pxHandle );
+    static BaseType_t prvPublish( const char * pcTopic,
+                                  uint16_t usTopicLength,
+                                  const void * pvPayload,
+                                  size_t xPayloadLength,
+                                  uint8_t ucQoS );
+    static BaseType_t prvSubscribe( const char * pcTopicFilter,
+                                    uint16_t usTopicFilterLength,
+                                    AppModuleIncomingPublish_t xCallback,
+                                    void * pvContext );
+    static const char * prvGetThingName( uint32_t * pulLength );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Services passed to the module.
+ */
+    static const AppModuleApi_t xApi =
+    {
+        .ulVersion      = appmoduleAPI_VERSION,
+        .ulSize         = sizeof( AppModuleApi_t ),
+        .pxPrintf       = prvPrintf,
+        .pxMalloc       = pvPortMalloc,
+        .pxFree         = vPortFree,
+        .pxDelay        = vTaskDelay,
+        .pxGetTickCount = xTaskGetTickCount,
+        .pxCreateTask   = prvCreateTask,
+        .pxDeleteTask   = prvDeleteTask,
+        .pxPublish      = prvPublish,
+        .pxSubscribe    = prvSubscribe,
+        .pxGetThingName = prvGetThingName
+    };
+
+    static AppModuleSubscription_t xSubscriptions[ appmoduleMAX_SUBSCRIPTIONS ];
+    static UBaseType_t uxSubscriptionCount = 0;
+
+    static const char * pcModuleThingName = NULL;
+    static uint32_t ulModuleThingNameLength = 0;
+
+/**
+ * @brief Slot of the running module, 0 for none.
+ */
+    static uint32_t ulRunningSlot = 0;
+
+/*-----------------------------------------------------------*/
+
+    static int prvPrintf( const char * pcFormat,
+                          ... )
+    {
+        char cBuffer[ 128 ];
+        va_list xArgs;
+        int lLength;
+
+        va_start( xArgs, pcFormat );
+        lLength = vsnprintf( cBuffer, sizeof( cBuffer ), pcFormat, xArgs );
+        va_end( xArgs );
+
+        PRINTF( "%s", cBuffer );
+
+        return lLength;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvCreateTask( TaskFunction_t pxCode,
+                                     const char * pcName,
+                                     configSTACK_DEPTH_TYPE usStackDepth,
+                                     void * pvParameters,
+                                     UBaseType_t uxPriority,
+                                     TaskHandle_t * pxHandle )
+    {
+        return xTaskCreate( pxCode, pcName, usStackDepth, pvParameters, uxPriority | portPRIVILEGE_BIT, pxHandle );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvDeleteTask( TaskHandle_t xTask )
+    {
+        vTaskDelete( xTask );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvPublish( const char * pcTopic,
+                                  uint16_t usTopicLength,
+                                  const void * pvPayload,
+                                  size_t xPayloadLength,
+                                  uint8_t ucQoS )
+    {
+        MQTTPublishInfo_t xPublishInfo;
+
+        if( ucQoS > ( uint8_t ) MQTTQoS2 )
+        {
+            return pdFALSE;
+        }
+
+        memset( &xPublishInfo, 0x00, sizeof( xPublishInfo ) );
+        xPublishInfo.qos = ( MQTTQoS_t ) ucQoS;
+        xPublishInfo.pTopicName = pcTopic;
+        xPublishInfo.topicNameLength = usTopicLength;
+        xPublishInfo.pPayload = pvPayload;
+        xPublishInfo.payloadLength = xPayloadLength;
+
+        return MQTTAgent_PublishCopy( NULL, &xPublishInfo, NULL, MQTT_AGENT_PRIORITY_BULK, 0 );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvIncomingPublishCallback( void * pCallbackContext,
+                                            MQTTPublishInfo_t * pPublishInfo )
+    {
+        AppModuleSubscription_t * pxSubscription = ( AppModuleSubscription_t * ) pCallbackContext;
+
+        pxSubscription->xCallback( pxSubscription->pvContext, pPublishInfo->pTopicName, pPublishInfo->topicNameLength,
+                                   pPublishInfo->pPayload, pPublishInfo->payloadLength );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvSubscribe( const char * pcTopicFilter,
+                                    uint16_t usTopicFilterLength,
+                                    AppModuleIncomingPublish_t xCallback,
+                                    void * pvContext )
+    {
+        AppModuleSubscription_t * pxSubscription;
+        UBaseType_t uxIndex;
+
+        if( xCallback == NULL )
+        {
+            return pdFALSE;
+        }
+
+        taskENTER_CRITICAL();
+        {
+            uxIndex = uxSubscriptionCount;
+
+            if( uxIndex < appmoduleMAX_SUBSCRIPTIONS )
+            {
+                uxSubscriptionCount++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( uxIndex >= appmoduleMAX_SUBSCRIPTIONS )
+        {
+            return pdFALSE;
+        }
+
+        pxSubscription = &xSubscriptions[ uxIndex ];
+        pxSubscription->xCallback = xCallback;
+        pxSubscription->pvContext = pvContext;
+
+        return ConnectionManager_Subscribe( &pxSubscription->xSubscription, pcTopicFilter, usTopicFilterLength, MQTTQoS1,
+                                            prvIncomingPublishCallback, NULL, pxSubscription );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static const char * prvGetThingName( uint32_t * pulLength )
+    {
+        *pulLength = ulModuleThingNameLength;
+
+        return pcModuleThingName;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvModuleTask( void * pvParameters )
+    {
+        AppModuleEntry_t xEntry = ( AppModuleEntry_t ) pvParameters;
+
+        xEntry( &xApi );
+
+        PRINTF( "Module returned.\r\n" );
+        vTaskDelete( NULL );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static uint32_t prvOtherSlot( uint32_t ulSlot )
+    {
+        return ( ulSlot == BOOT_MODULE_SLOT_A_ADDR ) ? BOOT_MODULE_SLOT_B_ADDR : BOOT_MODULE_SLOT_A_ADDR;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reads the record, a missing or damaged one reads as no module installed.
+ */
+    static void prvLoadRecord( AppModuleRecord_t * pxRecord )
+    {
+        uint8_t * pucData = NULL;
+        uint32_t ulSize = 0;
+
+        if( ( mflash_read_file( appmoduleFILE, &pucData, &ulSize ) == pdTRUE ) &&
+            ( ulSize == sizeof( AppModuleRecord_t ) ) )
+        {
+            memcpy( pxRecord, pucData, sizeof( AppModuleRecord_t ) );
+
+            if( pxRecord->ulMagic == appmoduleRECORD_MAGIC )
+            {
+                return;
+            }
+        }
+
+        memset( pxRecord, 0x00, sizeof( AppModuleRecord_t ) );
+        pxRecord->ulMagic = appmoduleRECORD_MAGIC;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvSaveRecord( const AppModuleRecord_t * pxRecord )
+    {
+        return mflash_save_file( appmoduleFILE, ( uint8_t * ) pxRecord, sizeof( AppModuleRecord_t ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the header of the module in a slot if it can be run by this base image, NULL otherwise.
+ */
+    static const struct boot_module_header * prvValidate( uint32_t ulSlot )
+    {
+        const struct boot_module_header * pxHeader;
+
+        if( ( ulSlot != BOOT_MODULE_SLOT_A_ADDR ) && ( ulSlot != BOOT_MODULE_SLOT_B_ADDR ) )
+        {
+            return NULL;
+        }
+
+        pxHeader = boot_module_validate( ( const void * ) ulSlot, ulSlot );
+
+        if( pxHeader == NULL )
+        {
+            return NULL;
+        }
+
+        if( ( pxHeader->api_version >> 16 ) != appmoduleAPI_VERSION_MAJOR )
+        {
+            PRINTF( "Module at 0x%08lx is built for API version %lu, not %u.\r\n",
+                    ( unsigned long ) ulSlot, ( unsigned long ) ( pxHeader->api_version >> 16 ), appmoduleAPI_VERSION_MAJOR );
+            return NULL;
+        }
+
+        if( ( pxHeader->data_start < appmoduleRAM_ADDR ) || ( pxHeader->bss_end > appmoduleRAM_ADDR + appmoduleRAM_SIZE ) )
+        {
+            PRINTF( "Module at 0x%08lx does not fit in the RAM window.\r\n", ( unsigned long ) ulSlot );
+            return NULL;
+        }
+
+        return pxHeader;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t AppModule_Init( const char * pcThingName,
+                               uint32_t ulThingNameLength )
+    {
+        AppModuleRecord_t xRecord;
+        const struct boot_module_header * pxHeader = NULL;
+        uint32_t ulSlot = 0;
+
+        configASSERT( ulRunningSlot == 0 );
+
+        pcModuleThingName = pcThingName;
+        ulModuleThingNameLength = ulThingNameLength;
+
+        if( ( ( uint32_t ) __app_module_ram_start__ != appmoduleRAM_ADDR ) ||
+            ( ( uint32_t ) __app_module_ram_size__ != appmoduleRAM_SIZE ) )
+        {
+            PRINTF( "Module RAM window not reserved, link with --defsym=__app_module_ram_size__=0x%x.\r\n",
+                    appmoduleRAM_SIZE );
+            return pdFALSE;
+        }
+
+        prvLoadRecord( &xRecord );
+
+        if( xRecord.ulState == appmoduleSTATE_NEW )
+        {
+            /* The trial counts from here, a reset before the commit reverts the module. */
+            xRecord.ulState = appmoduleSTATE_TRIAL;
+            pxHeader = prvValidate( xRecord.ulTrial );
+
+            if( pxHeader == NULL )
+            {
+                PRINTF( "Installed module not valid, keeping the previous module.\r\n" );
+                xRecord.ulState = appmoduleSTATE_IDLE;
+                xRecord.ulTrial = 0;
+            }
+
+            if( prvSaveRecord( &xRecord ) != pdTRUE )
+            {
+                pxHeader = NULL;
+            }
+
+            ulSlot = ( pxHeader != NULL ) ? xRecord.ulTrial : 0;
+        }
+        else if( xRecord.ulState == appmoduleSTATE_TRIAL )
+        {
+            PRINTF( "Module trial ended before the commit, reverting to the previous module.\r\n" );
+            xRecord.ulState = appmoduleSTATE_IDLE;
+            xRecord.ulTrial = 0;
+            ( void ) prvSaveRecord( &xRecord );
+        }
+
+        if( pxHeader == NULL )
+        {
+            /* Without a module installed by OTA, one programmed with the debugger is run. */
+            ulSlot = ( xRecord.ulActive != 0 ) ? xRecord.ulActive : BOOT_MODULE_SLOT_A_ADDR;
+            pxHeader = prvValidate( ulSlot );
+
+            if( ( pxHeader == NULL ) && ( xRecord.ulActive == 0 ) )
+            {
+                ulSlot = BOOT_MODULE_SLOT_B_ADDR;
+                pxHeader = prvValidate( ulSlot );
+            }
+        }
+
+        if( pxHeader == NULL )
+        {
+            PRINTF( "No application module.\r\n" );
+            return pdFALSE;
+        }
+
+        memcpy( ( void * ) pxHeader->data_start, ( const void * ) pxHeader->data_load,
+                pxHeader->data_end - pxHeader->data_start );
+        memset( ( void * ) pxHeader->data_end, 0x00, pxHeader->bss_end - pxHeader->data_end );
+
+        ulRunningSlot = ulSlot;
+
+        PRINTF( "Starting application module 0x%08lx from 0x%08lx%s.\r\n", ( unsigned long ) pxHeader->version,
+                ( unsigned long ) ulSlot, ( ulSlot == xRecord.ulTrial ) ? " on trial" : "" );
+
+        return ( xTaskCreate( prvModuleTask, "Module", appmoduleTASK_STACK_SIZE, ( void * ) pxHeader->entry,
+                              appmoduleTASK_PRIORITY | portPRIVILEGE_BIT, NULL ) == pdPASS ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    uint32_t AppModule_GetUpdateSlot( void )
+    {
+        AppModuleRecord_t xRecord;
+
+        if( ulRunningSlot != 0 )
+        {
+            return prvOtherSlot( ulRunningSlot );
+        }
+
+        prvLoadRecord( &xRecord );
+
+        return ( xRecord.ulActive != 0 ) ? prvOtherSlot( xRecord.ulActive ) : BOOT_MODULE_SLOT_A_ADDR;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t AppModule_Install( void )
+    {
+        AppModuleRecord_t xRecord;
+        uint32_t ulSlot = AppModule_GetUpdateSlot();
+
+        if( prvValidate( ulSlot ) == NULL )
+        {
+            return pdFALSE;
+        }
+
+        prvLoadRecord( &xRecord );
+
+        if( ulRunningSlot != 0 )
+        {
+            /* The running module is the one reverted to, also when it was programmed with the debugger. */
+            xRecord.ulActive = ulRunningSlot;
+        }
+
+        xRecord.ulTrial = ulSlot;
+        xRecord.ulState = appmoduleSTATE_NEW;
+
+        return prvSaveRecord( &xRecord );
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t AppModule_IsPendingCommit( void )
+    {
+        AppModuleRecord_t xRecord;
+
+        prvLoadRecord( &xRecord );
+
+        return ( ( xRecord.ulState == appmoduleSTATE_TRIAL ) && ( xRecord.ulTrial == ulRunningSlot ) ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t AppModule_EndTrial( BaseType_t xAccept )
+    {
+        AppModuleRecord_t xRecord;
+
+        prvLoadRecord( &xRecord );
+
+        if( xRecord.ulState != appmoduleSTATE_TRIAL )
+        {
+            return pdFALSE;
+        }
+
+        if( xAccept == pdTRUE )
+        {
+            xRecord.ulActive = xRecord.ulTrial;
+        }
+
+        xRecord.ulTrial = 0;
+        xRecord.ulState = appmoduleSTATE_IDLE;
+
+        return prvSaveRecord( &xRecord );
+    }
+
+#endif /* if ( appmoduleENABLED == 1 ) */
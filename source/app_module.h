@@ -0,0 +1,219 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file app_module.h
+ * @brief Application module, an image linked separately from the base image and updated by OTA on its
+ * own, which calls the base image through a versioned table of services. Compiled out unless
+ * appmoduleENABLED is 1.
+ *
+ * The base image holds the kernel, the network stack, TLS, the MQTT and OTA agents, and rarely changes.
+ * The module holds the application logic and is stored in one of the two module slots of spifi_boot.h,
+ * starting with a struct boot_module_header checked by boot_module_validate(). It is linked:
+ * - at the slot it is downloaded to, as the images of BOOT_AB_MODE, see AppModule_GetUpdateSlot(),
+ * - with its data and bss in the RAM window from appmoduleRAM_ADDR of appmoduleRAM_SIZE bytes, the base
+ *   image being linked with --defsym=__app_module_ram_size__=<appmoduleRAM_SIZE> so that its heap ends
+ *   below the window,
+ * - without any library of the base image, which it calls only through the AppModuleApi_t passed to
+ *   its entry.
+ * Its entry runs in a task of its own, privileged as the tasks of the base image.
+ *
+ * An OTA file starting with BOOT_MODULE_MARKER is installed to the module slot not running instead of
+ * updating the base image. The new module runs on trial after the reset and is committed by the self
+ * test of the OTA agent, a reset before the commit reverts to the previous module.
+ */
+
+#ifndef APP_MODULE_H
+#define APP_MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**
+ * @brief Set to 1 to run the application module and to install modules received by OTA.
+ */
+#ifndef appmoduleENABLED
+    #define appmoduleENABLED    ( 0 )
+#endif
+
+/**
+ * @brief Size of the RAM window of the module data and bss, a multiple of 32 bytes.
+ */
+#ifndef appmoduleRAM_SIZE
+    #define appmoduleRAM_SIZE    ( 0x4000U )
+#endif
+
+/**
+ * @brief Start of the RAM window, at the top of SRAM_0_1_2_3 where Demo.ld reserves it.
+ */
+#ifndef appmoduleRAM_ADDR
+    #define appmoduleRAM_ADDR    ( 0x20020000U - appmoduleRAM_SIZE )
+#endif
+
+/**
+ * @brief Stack size of the module task, in words.
+ */
+#ifndef appmoduleTASK_STACK_SIZE
+    #define appmoduleTASK_STACK_SIZE    ( 1024 )
+#endif
+
+/**
+ * @brief Priority of the module task.
+ */
+#ifndef appmoduleTASK_PRIORITY
+    #define appmoduleTASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Number of topic filters the module can subscribe to.
+ */
+#ifndef appmoduleMAX_SUBSCRIPTIONS
+    #define appmoduleMAX_SUBSCRIPTIONS    ( 4U )
+#endif
+
+/**
+ * @brief Version of AppModuleApi_t. The major version changes when entries are changed or removed, the
+ * minor version when entries are appended. A module built against another major version is not started.
+ */
+#define appmoduleAPI_VERSION_MAJOR    ( 1U )
+#define appmoduleAPI_VERSION_MINOR    ( 0U )
+#define appmoduleAPI_VERSION          ( ( appmoduleAPI_VERSION_MAJOR << 16 ) | appmoduleAPI_VERSION_MINOR )
+
+/**
+ * @brief Callback of the incoming publishes matching a topic filter of the module, invoked from the
+ * MQTT agent task. The pointers are valid until it returns.
+ */
+typedef void ( * AppModuleIncomingPublish_t )( void * pvContext,
+                                               const char * pcTopic,
+                                               uint16_t usTopicLength,
+                                               const void * pvPayload,
+                                               size_t xPayloadLength );
+
+/**
+ * @brief Services of the base image, passed to the entry of the module. Entries beyond ulSize are not
+ * provided by the base image.
+ */
+typedef struct AppModuleApi
+{
+    uint32_t ulVersion; /**< appmoduleAPI_VERSION of the base image. */
+    uint32_t ulSize;    /**< Size of the table. */
+
+    int ( * pxPrintf )( const char * pcFormat,
+                        ... );
+    void * ( *pxMalloc )( size_t xSize );
+    void ( * pxFree )( void * pv );
+    void ( * pxDelay )( TickType_t xTicks );
+    TickType_t ( * pxGetTickCount )( void );
+
+    /**
+     * @brief Creates a task, privileged as the module task. The tasks must be deleted before the module
+     * returns from its entry.
+     */
+    BaseType_t ( * pxCreateTask )( TaskFunction_t pxCode,
+                                   const char * pcName,
+                                   configSTACK_DEPTH_TYPE usStackDepth,
+                                   void * pvParameters,
+                                   UBaseType_t uxPriority,
+                                   TaskHandle_t * pxHandle );
+    void ( * pxDeleteTask )( TaskHandle_t xTask );
+
+    /**
+     * @brief Queues a copy of a publish with the MQTT agent, without blocking.
+     */
+    BaseType_t ( * pxPublish )( const char * pcTopic,
+                                uint16_t usTopicLength,
+                                const void * pvPayload,
+                                size_t xPayloadLength,
+                                uint8_t ucQoS );
+
+    /**
+     * @brief Subscribes to a topic filter, again when the session is not resumed after a reconnection.
+     * The filter is not copied.
+     */
+    BaseType_t ( * pxSubscribe )( const char * pcTopicFilter,
+                                  uint16_t usTopicFilterLength,
+                                  AppModuleIncomingPublish_t xCallback,
+                                  void * pvContext );
+
+    /**
+     * @brief Returns the thing name, not terminated, and its length.
+     */
+    const char * ( *pxGetThingName )( uint32_t * pulLength );
+} AppModuleApi_t;
+
+/**
+ * @brief Entry of the module, at the entry address of its header. The module task is deleted when
+ * it returns.
+ */
+typedef void ( * AppModuleEntry_t )( const AppModuleApi_t * pxApi );
+
+#if ( appmoduleENABLED == 1 )
+
+/**
+ * @brief Selects the module to run, starting the trial of a newly installed module or reverting one
+ * whose trial was ended by a reset, loads its data and starts its task. Must be called once, with the
+ * MQTT agent running and before the OTA agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if a module is started, pdFALSE if there is none or it is not valid.
+ */
+    BaseType_t AppModule_Init( const char * pcThingName,
+                               uint32_t ulThingNameLength );
+
+/**
+ * @brief Returns the slot a new module is downloaded to, the one not running.
+ */
+    uint32_t AppModule_GetUpdateSlot( void );
+
+/**
+ * @brief Records the module in the update slot to be run on trial after the next reset.
+ *
+ * @return pdTRUE if the module is valid and recorded.
+ */
+    BaseType_t AppModule_Install( void );
+
+/**
+ * @brief Returns pdTRUE while a new module runs on trial.
+ */
+    BaseType_t AppModule_IsPendingCommit( void );
+
+/**
+ * @brief Ends the trial of the running module, keeping it or reverting to the previous module at the
+ * next reset.
+ *
+ * @param[in] xAccept pdTRUE to keep the module.
+ *
+ * @return pdTRUE if a trial was ended and recorded.
+ */
+    BaseType_t AppModule_EndTrial( BaseType_t xAccept );
+
+#endif /* if ( appmoduleENABLED == 1 ) */
+
+#endif /* APP_MODULE_H */
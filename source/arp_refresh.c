@@ -0,0 +1,112 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file arp_refresh.c
+ * @brief Resolves the gateway and DNS server addresses when the network comes up, and keeps their ARP
+ * cache entries fresh, so that no connection waits for an ARP round trip.
+ *
+ * The ARP requests go out without waiting for a packet to the address: the first TLS connect after a
+ * network up finds the gateway resolved, and the entries answered by the periodic requests never age
+ * out. The DNS server is only resolved when it is on the local subnet, otherwise it is reached
+ * through the gateway.
+ */
+
+#include "FreeRTOS.h"
+#include "timers.h"
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_ARP.h"
+
+#include "arp_refresh.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends the ARP requests of the periods after the network up.
+ */
+static TimerHandle_t xRefreshTimer = NULL;
+static StaticTimer_t xRefreshTimerBuffer;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends an ARP request for the gateway and for the DNS server if it is on the local subnet.
+ * The requests are sent without waiting for a network buffer, a missed one is sent at the next period.
+ */
+static void prvResolve( void )
+{
+    uint32_t ulIPAddress, ulNetMask, ulGatewayAddress, ulDNSServerAddress;
+
+    FreeRTOS_GetAddressConfiguration( &ulIPAddress, &ulNetMask, &ulGatewayAddress, &ulDNSServerAddress );
+
+    if( ulGatewayAddress != 0U )
+    {
+        FreeRTOS_OutputARPRequest( ulGatewayAddress );
+    }
+
+    if( ( ulDNSServerAddress != 0U ) && ( ulDNSServerAddress != ulGatewayAddress ) &&
+        ( ( ulDNSServerAddress & ulNetMask ) == ( ulIPAddress & ulNetMask ) ) )
+    {
+        FreeRTOS_OutputARPRequest( ulDNSServerAddress );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRefreshTimerCallback( TimerHandle_t xTimer )
+{
+    ( void ) xTimer;
+
+    /* The request is only handed to the IP task once a network buffer is taken, its event queue
+     * is sized for an event per buffer so the timer task does not wait on it. */
+    prvResolve();
+}
+
+/*-----------------------------------------------------------*/
+
+void ArpRefresh_NetworkEvent( eIPCallbackEvent_t eNetworkEvent )
+{
+    if( xRefreshTimer == NULL )
+    {
+        xRefreshTimer = xTimerCreateStatic( "ArpRefresh",
+                                            pdMS_TO_TICKS( arprefreshPERIOD_MS ),
+                                            pdTRUE,
+                                            NULL,
+                                            prvRefreshTimerCallback,
+                                            &xRefreshTimerBuffer );
+    }
+
+    if( eNetworkEvent == eNetworkUp )
+    {
+        /* Called from the IP task, the requests are sent at once. */
+        prvResolve();
+        ( void ) xTimerReset( xRefreshTimer, 0 );
+    }
+    else
+    {
+        ( void ) xTimerStop( xRefreshTimer, 0 );
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file arp_refresh.h
+ * @brief Resolves the gateway and DNS server addresses when the network comes up, and keeps their ARP
+ * cache entries fresh, so that no connection waits for an ARP round trip.
+ */
+
+#ifndef ARP_REFRESH_H
+#define ARP_REFRESH_H
+
+#include "FreeRTOS.h"
+#include "FreeRTOS_IP.h"
+
+/**
+ * @brief Period of the ARP requests refreshing the entries. The ARP cache of FreeRTOS+TCP ages its
+ * entries every 10 s for ipconfigMAX_ARP_AGE periods, the default refreshes them at half their age.
+ */
+#ifndef arprefreshPERIOD_MS
+    #define arprefreshPERIOD_MS    ( ( ipconfigMAX_ARP_AGE * 10000UL ) / 2UL )
+#endif
+
+/**
+ * @brief Resolves the addresses on a network up and starts or stops the refresh, to be called from
+ * vApplicationIPNetworkEventHook().
+ *
+ * @param[in] eNetworkEvent The event.
+ */
+void ArpRefresh_NetworkEvent( eIPCallbackEvent_t eNetworkEvent );
+
+#endif /* ARP_REFRESH_H */
@@ -29,8 +29,17 @@
 #include "ota_appversion32.h"
 extern const AppVersion32_t xAppFirmwareVersion;
 
-#define APP_VERSION_MAJOR    0
-#define APP_VERSION_MINOR    9
-#define APP_VERSION_BUILD    2
+/* The host build sets the build number, see host/Makefile. */
+#ifndef APP_VERSION_MAJOR
+    #define APP_VERSION_MAJOR    0
+#endif
+
+#ifndef APP_VERSION_MINOR
+    #define APP_VERSION_MINOR    9
+#endif
+
+#ifndef APP_VERSION_BUILD
+    #define APP_VERSION_BUILD    2
+#endif
 
 #endif
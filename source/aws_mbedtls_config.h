@@ -52,6 +52,9 @@
 /* FreeRTOS include. */
 #include "FreeRTOS.h"
 
+/* Buffer sizes of the selected performance profile. */
+#include "perf_profile.h"
+
 /* Generate errors if deprecated functions are used. */
 #define MBEDTLS_DEPRECATED_REMOVED
 
@@ -73,9 +76,66 @@
 #define MBEDTLS_REMOVE_ARC4_CIPHERSUITES
 #define MBEDTLS_ECP_DP_SECP256R1_ENABLED
 #define MBEDTLS_ECP_NIST_OPTIM
+
+/* Point multiplication profile for P-256, which dominates the ECDHE and server certificate
+ * verification of the TLS handshake and the ECDSA verification of OTA images.
+ * 1 favours speed: mbed TLS uses a comb of window 5 for the generator and 4 for other points,
+ * which MBEDTLS_ECP_WINDOW_SIZE only caps, and keeps the generator table of 16 points,
+ * around 2 KB, in the group until the ECDHE or ECDSA context is freed.
+ * 0 favours RAM: a window of 2 and no cached table, saving most of these 2 KB at the
+ * cost of noticeably slower multiplications.
+ * The table is computed in RAM by the first multiplication of each group, mbed TLS 2 cannot
+ * take it from flash. Compare the handshake durations logged by the transport and the
+ * image verification durations, which include hashing the image, and the pool peaks of
+ * mbedtls_platform_get_pool_stats(), to choose the profile. */
+#ifndef mbedtlsconfigECP_SPEED_PROFILE
+    #define mbedtlsconfigECP_SPEED_PROFILE    1
+#endif
+
+#if ( mbedtlsconfigECP_SPEED_PROFILE == 1 )
+    #define MBEDTLS_ECP_WINDOW_SIZE          6
+    #define MBEDTLS_ECP_FIXED_POINT_OPTIM    1
+#else
+    #define MBEDTLS_ECP_WINDOW_SIZE          2
+    #define MBEDTLS_ECP_FIXED_POINT_OPTIM    0
+#endif
+
+/* 1 computes the P-256 point doublings and mixed additions, the inner loop of every point
+ * multiplication, on fixed 256 bit arrays with the UMAAL multiply-accumulate of the
+ * Cortex-M4, see lib/FreeRTOS/platform/freertos/mbedtls/ecp_p256_m4.c. 0 keeps the generic
+ * bignum code of mbed TLS. MBEDTLS_HAVE_ASM stays off: the ARM assembly of bn_mul.h uses r7,
+ * the frame pointer of the Thumb code in the Debug build. Compare the p256_mul benchmark
+ * with both values. */
+#ifndef mbedtlsconfigP256_M4
+    #define mbedtlsconfigP256_M4    1
+#endif
+
+#if ( mbedtlsconfigP256_M4 == 1 )
+    #define MBEDTLS_ECP_INTERNAL_ALT
+    #define MBEDTLS_ECP_DOUBLE_JAC_ALT
+    #define MBEDTLS_ECP_ADD_MIXED_ALT
+#endif
+
+/* RSA servers, such as those chaining to Amazon Root CA 1, need ECDHE_RSA. Deployments
+ * where every server has an ECC certificate can remove it together with MBEDTLS_RSA_C,
+ * see democonfigTLS_ECC_ONLY in main.c. */
 #define MBEDTLS_KEY_EXCHANGE_ECDHE_RSA_ENABLED
 #define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
 
+/* 1 adds the PSK and ECDHE-PSK key exchanges, for brokers on a plant LAN authenticating the
+ * device with the pre-shared key provisioned under pkcs11configLABEL_TLS_PSK, see
+ * democonfigTLS_PSK in main.c. A PSK handshake has no certificate to parse or verify and
+ * no signature, ECDHE-PSK only adds one ECDHE for forward secrecy. 0 leaves the PSK suites
+ * out of the ClientHello to the other servers. */
+#ifndef mbedtlsconfigTLS_PSK
+    #define mbedtlsconfigTLS_PSK    0
+#endif
+
+#if ( mbedtlsconfigTLS_PSK == 1 )
+    #define MBEDTLS_KEY_EXCHANGE_PSK_ENABLED
+    #define MBEDTLS_KEY_EXCHANGE_ECDHE_PSK_ENABLED
+#endif
+
 /* Enable all SSL alert messages. */
 #define MBEDTLS_SSL_ALL_ALERT_MESSAGES
 
@@ -86,6 +146,7 @@
 #define MBEDTLS_SSL_PROTO_TLS1_2
 #define MBEDTLS_SSL_ALPN
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
+#define MBEDTLS_SSL_SESSION_TICKETS
 
 /* Check certificate key usage. */
 #define MBEDTLS_X509_CHECK_KEY_USAGE
@@ -133,6 +194,27 @@
 //#define MBEDTLS_DEBUG_C
 #define MBEDTLS_SSL_MAX_CONTENT_LEN             6500
 
+/* Size the record buffers separately. Incoming records are as large as the servers send, unless a smaller
+ * maximum fragment length is negotiated through NetworkCredentials_t. Outgoing records only carry MQTT
+ * packets, HTTP requests and the client certificate, larger writes are split by mbedtls_ssl_write(). The
+ * output size comes from democonfigPERF_PROFILE: a larger buffer takes more RAM but splits bulk uploads
+ * into fewer records. */
+#ifndef MBEDTLS_SSL_IN_CONTENT_LEN
+    #define MBEDTLS_SSL_IN_CONTENT_LEN          MBEDTLS_SSL_MAX_CONTENT_LEN
+#endif
+#ifndef MBEDTLS_SSL_OUT_CONTENT_LEN
+    #define MBEDTLS_SSL_OUT_CONTENT_LEN         perfprofileTLS_OUT_CONTENT_LEN
+#endif
+
+/* On the carrier boards fitted with SDRAM, the TLS record buffers live in the SDRAM instead of
+ * the FreeRTOS heap, see mbedtls_freertos_port.h. Three sessions take an input and an output
+ * record buffer each, the dedicated OTA connection of democonfigOTA_DEDICATED_CONNECTION in main.c
+ * is a fourth one and needs 8. */
+#if defined( BOARD_SDRAM_ENABLED ) && ( BOARD_SDRAM_ENABLED == 1 )
+    #define mbedtlsconfigRECORD_BUFFERS             6
+    #define mbedtlsconfigRECORD_BUFFER_ATTRIBUTE    __attribute__( ( section( ".bss.$SDRAM" ) ) )
+#endif
+
 /* Set the memory allocation functions on FreeRTOS. */
 void * mbedtls_platform_calloc( size_t nmemb,
                                 size_t size );
@@ -0,0 +1,860 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file benchmark.c
+ * @brief On-target benchmarks of the TLS transport, the MQTT agent, the image signature
+ * verification and the flash driver, printed as CSV on the debug console.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "benchmark.h"
+
+#if ( BENCHMARK_BUILD == 1 )
+
+    #include "fsl_debug_console.h"
+    #include "fsl_sha.h"
+    #include "mbedtls/sha256.h"
+    #include "mbedtls/ecp.h"
+
+    #include "core_pkcs11_config.h"
+    #include "core_pkcs11.h"
+    #include "pkcs11_session_pool.h"
+
+    #include "core_mqtt_agent.h"
+    #include "tls_freertos_pkcs11.h"
+    #include "mbedtls_freertos_port.h"
+
+    #include "spifi_boot.h"
+    #include "mflash_drv.h"
+
+    #include "monotonic_clock.h"
+    #include "entropy_pool.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of TLS handshakes measured per variant.
+ */
+    #ifndef benchmarkconfigHANDSHAKE_ITERATIONS
+        #define benchmarkconfigHANDSHAKE_ITERATIONS    ( 5U )
+    #endif
+
+/**
+ * @brief Number of bytes of the running image hashed per SHA-256 measurement, read from the
+ * memory mapped flash as the OTA PAL does.
+ */
+    #ifndef benchmarkconfigHASH_BYTES
+        #define benchmarkconfigHASH_BYTES    ( 64U * 1024U )
+    #endif
+
+/**
+ * @brief Number of SHA-256 measurements per variant.
+ */
+    #ifndef benchmarkconfigHASH_ITERATIONS
+        #define benchmarkconfigHASH_ITERATIONS    ( 4U )
+    #endif
+
+/**
+ * @brief Number of ECDSA P-256 verifications measured.
+ */
+    #ifndef benchmarkconfigVERIFY_ITERATIONS
+        #define benchmarkconfigVERIFY_ITERATIONS    ( 10U )
+    #endif
+
+/**
+ * @brief Number of P-256 multiplications of the generator by a random scalar measured.
+ */
+    #ifndef benchmarkconfigP256_MUL_ITERATIONS
+        #define benchmarkconfigP256_MUL_ITERATIONS    ( 10U )
+    #endif
+
+/**
+ * @brief Number of messages published per QoS level.
+ */
+    #ifndef benchmarkconfigMQTT_MESSAGES
+        #define benchmarkconfigMQTT_MESSAGES    ( 100U )
+    #endif
+
+/**
+ * @brief Payload size of the published messages.
+ */
+    #ifndef benchmarkconfigMQTT_PAYLOAD_SIZE
+        #define benchmarkconfigMQTT_PAYLOAD_SIZE    ( 256U )
+    #endif
+
+/**
+ * @brief Number of publishes owned by the agent at the same time. For QoS1 it should not exceed
+ * the number of operations the agent keeps waiting for an ACK.
+ */
+    #ifndef benchmarkconfigMQTT_WINDOW
+        #define benchmarkconfigMQTT_WINDOW    ( 4U )
+    #endif
+
+/**
+ * @brief Time to wait for a publish to complete before the measurement is abandoned.
+ */
+    #ifndef benchmarkconfigMQTT_TIMEOUT_MS
+        #define benchmarkconfigMQTT_TIMEOUT_MS    ( 10000U )
+    #endif
+
+/**
+ * @brief Topic of the published messages, formatted with the thing name.
+ */
+    #define benchmarkMQTT_TOPIC_FORMAT    "device/%.*s/bench"
+
+/**
+ * @brief Size of the buffer holding the topic.
+ */
+    #define benchmarkTOPIC_MAX_SIZE       ( 160U )
+
+/*
+ * The bulk transfer benchmark needs a TLS server on the local network, it runs only when
+ * benchmarkconfigTLS_SERVER_HOST is defined, along with benchmarkconfigTLS_SERVER_ROOT_CA_PEM,
+ * the PEM certificate the server certificate chains to. The data sent is discarded by
+ *     openssl s_server -accept 4433 -cert server.crt -key server.key -quiet > /dev/null
+ * and the data received is served from a directory holding benchmarkconfigTLS_SOURCE_PATH by
+ *     openssl s_server -accept 4434 -cert server.crt -key server.key -WWW
+ */
+    #ifdef benchmarkconfigTLS_SERVER_HOST
+
+        #ifndef benchmarkconfigTLS_SERVER_ROOT_CA_PEM
+            #error "benchmarkconfigTLS_SERVER_ROOT_CA_PEM must be defined with benchmarkconfigTLS_SERVER_HOST."
+        #endif
+
+        #ifndef benchmarkconfigTLS_SINK_PORT
+            #define benchmarkconfigTLS_SINK_PORT    ( 4433U )
+        #endif
+
+        #ifndef benchmarkconfigTLS_SOURCE_PORT
+            #define benchmarkconfigTLS_SOURCE_PORT    ( 4434U )
+        #endif
+
+        #ifndef benchmarkconfigTLS_SOURCE_PATH
+            #define benchmarkconfigTLS_SOURCE_PATH    "bench.bin"
+        #endif
+
+/**
+ * @brief Number of bytes sent, and at most received, per bulk transfer.
+ */
+        #ifndef benchmarkconfigTLS_BULK_BYTES
+            #define benchmarkconfigTLS_BULK_BYTES    ( 256U * 1024U )
+        #endif
+
+/**
+ * @brief Size of the sends and receives of the bulk transfers.
+ */
+        #define benchmarkTLS_CHUNK_SIZE    ( 1024U )
+
+/**
+ * @brief Receive and send timeout of the bulk transfer connections.
+ */
+        #define benchmarkTLS_TIMEOUT_MS    ( 5000U )
+    #endif /* ifdef benchmarkconfigTLS_SERVER_HOST */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Measurements of one test variant.
+ */
+    typedef struct BenchmarkStats
+    {
+        uint32_t ulCount;  /**< Number of measurements. */
+        uint32_t ulMinUs;  /**< Shortest measurement, valid once the count is not 0. */
+        uint32_t ulMaxUs;  /**< Longest measurement. */
+        uint64_t ullSumUs; /**< Sum of the measurements. */
+    } BenchmarkStats_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Connection used by the TLS benchmarks, too large for the stack.
+ */
+    static NetworkContext_t xBenchContext;
+
+/**
+ * @brief Publishes owned by the agent, the slot of a completed operation is found from its address.
+ */
+    static MQTTOperation_t xPublishOperations[ benchmarkconfigMQTT_WINDOW ];
+    static MQTTPublishInfo_t xPublishInfos[ benchmarkconfigMQTT_WINDOW ];
+    static uint64_t ullPublishStartUs[ benchmarkconfigMQTT_WINDOW ];
+    static volatile BaseType_t xPublishBusy[ benchmarkconfigMQTT_WINDOW ];
+
+/**
+ * @brief Counts the free publish slots, given back by the completion callback.
+ */
+    static SemaphoreHandle_t xPublishSlots = NULL;
+    static StaticSemaphore_t xPublishSlotsBuffer;
+
+/**
+ * @brief Latency of the publishes and number of failed ones, updated in the agent task.
+ */
+    static BenchmarkStats_t xPublishStats;
+    static volatile uint32_t ulPublishFailures;
+
+    static char cBenchTopic[ benchmarkTOPIC_MAX_SIZE ];
+    static uint8_t ucBenchPayload[ benchmarkconfigMQTT_PAYLOAD_SIZE ];
+
+    #ifdef benchmarkconfigTLS_SERVER_HOST
+        static uint8_t ucBulkBuffer[ benchmarkTLS_CHUNK_SIZE ];
+    #endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Time since boot, from the monotonic clock, which follows the core clock changes.
+ */
+    static uint64_t prvNowUs( void )
+    {
+        return MonotonicClock_GetUs();
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvStatsAdd( BenchmarkStats_t * pxStats,
+                             uint64_t ullUs )
+    {
+        uint32_t ulUs = ( ullUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) ullUs;
+
+        if( ( pxStats->ulCount == 0U ) || ( ulUs < pxStats->ulMinUs ) )
+        {
+            pxStats->ulMinUs = ulUs;
+        }
+
+        if( ulUs > pxStats->ulMaxUs )
+        {
+            pxStats->ulMaxUs = ulUs;
+        }
+
+        pxStats->ulCount++;
+        pxStats->ullSumUs += ulUs;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Prints the result line of a test variant.
+ *
+ * @param[in] pcTest Name of the test.
+ * @param[in] pcVariant Name of the variant.
+ * @param[in] pxStats Measurements of the variant.
+ * @param[in] ulBytes Bytes moved per measurement, 0 for the tests not moving data.
+ * @param[in] ullElapsedUs Time the rate is computed over, 0 for the sum of the measurements.
+ * The pipelined tests pass the wall time as their measurements overlap.
+ */
+    static void prvReport( const char * pcTest,
+                           const char * pcVariant,
+                           const BenchmarkStats_t * pxStats,
+                           uint32_t ulBytes,
+                           uint64_t ullElapsedUs )
+    {
+        uint64_t ullRate = 0U;
+
+        if( ullElapsedUs == 0U )
+        {
+            ullElapsedUs = pxStats->ullSumUs;
+        }
+
+        if( ullElapsedUs > 0U )
+        {
+            if( ulBytes > 0U )
+            {
+                ullRate = ( ( uint64_t ) pxStats->ulCount * ulBytes * 1000000U ) / ( ullElapsedUs * 1024U );
+            }
+            else
+            {
+                ullRate = ( ( uint64_t ) pxStats->ulCount * 1000000U ) / ullElapsedUs;
+            }
+        }
+
+        if( pxStats->ulCount == 0U )
+        {
+            PRINTF( "BENCH,%s,%s,0,%lu,,,,\r\n", pcTest, pcVariant, ( unsigned long ) ulBytes );
+        }
+        else
+        {
+            PRINTF( "BENCH,%s,%s,%lu,%lu,%lu,%lu,%lu,%lu\r\n", pcTest, pcVariant,
+                    ( unsigned long ) pxStats->ulCount, ( unsigned long ) ulBytes,
+                    ( unsigned long ) pxStats->ulMinUs,
+                    ( unsigned long ) ( pxStats->ullSumUs / pxStats->ulCount ),
+                    ( unsigned long ) pxStats->ulMaxUs, ( unsigned long ) ullRate );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief SHA-256 of the running image with the SHA engine and with mbed TLS, the two digest
+ * back ends of the OTA PAL.
+ *
+ * @param[out] pucDigest The digest, used as the message of the verify benchmark.
+ */
+    static void prvBenchSha256( uint8_t * pucDigest )
+    {
+        const uint8_t * pucImage = ( const uint8_t * ) boot_active_image();
+        BenchmarkStats_t xStats;
+        mbedtls_sha256_context xMbedtlsContext;
+        uint64_t ullStart;
+        uint32_t i;
+
+        #if defined( FSL_FEATURE_SOC_SHA_COUNT ) && ( FSL_FEATURE_SOC_SHA_COUNT > 0 )
+            sha_ctx_t xShaContext;
+            size_t xDigestSize;
+
+            memset( &xStats, 0x00, sizeof( xStats ) );
+
+            for( i = 0; i < benchmarkconfigHASH_ITERATIONS; i++ )
+            {
+                xDigestSize = 32U;
+                ullStart = prvNowUs();
+
+                if( ( SHA_Init( SHA0, &xShaContext, kSHA_Sha256 ) == kStatus_Success ) &&
+                    ( SHA_Update( SHA0, &xShaContext, pucImage, benchmarkconfigHASH_BYTES ) == kStatus_Success ) &&
+                    ( SHA_Finish( SHA0, &xShaContext, pucDigest, &xDigestSize ) == kStatus_Success ) )
+                {
+                    prvStatsAdd( &xStats, prvNowUs() - ullStart );
+                }
+            }
+
+            prvReport( "sha256", "sha_engine", &xStats, benchmarkconfigHASH_BYTES, 0U );
+        #endif /* if defined( FSL_FEATURE_SOC_SHA_COUNT ) && ( FSL_FEATURE_SOC_SHA_COUNT > 0 ) */
+
+        memset( &xStats, 0x00, sizeof( xStats ) );
+
+        for( i = 0; i < benchmarkconfigHASH_ITERATIONS; i++ )
+        {
+            ullStart = prvNowUs();
+            mbedtls_sha256_init( &xMbedtlsContext );
+
+            if( ( mbedtls_sha256_starts_ret( &xMbedtlsContext, 0 ) == 0 ) &&
+                ( mbedtls_sha256_update_ret( &xMbedtlsContext, pucImage, benchmarkconfigHASH_BYTES ) == 0 ) &&
+                ( mbedtls_sha256_finish_ret( &xMbedtlsContext, pucDigest ) == 0 ) )
+            {
+                prvStatsAdd( &xStats, prvNowUs() - ullStart );
+            }
+
+            mbedtls_sha256_free( &xMbedtlsContext );
+        }
+
+        prvReport( "sha256", "mbedtls", &xStats, benchmarkconfigHASH_BYTES, 0U );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief ECDSA P-256 verification with the code signing key, the PKCS #11 calls made by
+ * xVerifyImageSignatureUsingPKCS11() once the image digest is known. The signature
+ * r = s = 1 is in range, so the whole verification runs before it is rejected.
+ *
+ * @param[in] pucDigest The message digest.
+ */
+    static void prvBenchVerify( const uint8_t * pucDigest )
+    {
+        CK_MECHANISM xMechanism = { CKM_ECDSA, NULL, 0 };
+        CK_BYTE ucSignature[ pkcs11ECDSA_P256_SIGNATURE_LENGTH ] = { 0 };
+        CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
+        BenchmarkStats_t xStats = { 0 };
+        Pkcs11Lease_t xLease;
+        CK_RV xResult;
+        uint64_t ullStart;
+        uint32_t i;
+
+        ucSignature[ ( pkcs11ECDSA_P256_SIGNATURE_LENGTH / 2U ) - 1U ] = 1U;
+        ucSignature[ pkcs11ECDSA_P256_SIGNATURE_LENGTH - 1U ] = 1U;
+
+        xResult = C_GetFunctionList( &pxFunctionList );
+
+        if( xResult == CKR_OK )
+        {
+            xResult = xPkcs11PoolAcquire( &xLease, portMAX_DELAY );
+        }
+
+        if( xResult != CKR_OK )
+        {
+            PRINTF( "Verify benchmark skipped, PKCS #11 error = %lu.\r\n", ( unsigned long ) xResult );
+            return;
+        }
+
+        if( xLease.xObjects[ ePkcs11PoolCodeSignKey ] == CK_INVALID_HANDLE )
+        {
+            PRINTF( "Verify benchmark skipped, the code signing key is not provisioned.\r\n" );
+        }
+        else
+        {
+            for( i = 0; i < benchmarkconfigVERIFY_ITERATIONS; i++ )
+            {
+                ullStart = prvNowUs();
+                xResult = pxFunctionList->C_VerifyInit( xLease.xSession, &xMechanism,
+                                                        xLease.xObjects[ ePkcs11PoolCodeSignKey ] );
+
+                if( xResult == CKR_OK )
+                {
+                    xResult = pxFunctionList->C_Verify( xLease.xSession, ( CK_BYTE_PTR ) pucDigest,
+                                                        pkcs11SHA256_DIGEST_LENGTH, ucSignature,
+                                                        sizeof( ucSignature ) );
+                }
+
+                if( xResult != CKR_SIGNATURE_INVALID )
+                {
+                    PRINTF( "Verify benchmark stopped, PKCS #11 error = %lu.\r\n", ( unsigned long ) xResult );
+                    break;
+                }
+
+                prvStatsAdd( &xStats, prvNowUs() - ullStart );
+            }
+
+            /* The expected rejection says nothing about the session. */
+            xResult = ( xResult == CKR_SIGNATURE_INVALID ) ? CKR_OK : xResult;
+        }
+
+        vPkcs11PoolRelease( &xLease, xResult );
+
+        prvReport( "ecdsa_verify", "pkcs11", &xStats, 0U, 0U );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int prvRandom( void * pvContext,
+                          unsigned char * pucOutput,
+                          size_t xLength )
+    {
+        ( void ) pvContext;
+
+        return ( xEntropyPoolGetBytes( pucOutput, xLength ) == pdTRUE ) ? 0 : MBEDTLS_ERR_ECP_RANDOM_FAILED;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief P-256 multiplication of the generator by a random scalar, the multiplication of the
+ * ECDHE key generation, on the group alone, so that the field arithmetic can be compared
+ * with mbedtlsconfigP256_M4 set to 0 and 1. Each multiplication draws a new random
+ * projection of the point, as in the TLS handshake.
+ */
+    static void prvBenchP256Mul( void )
+    {
+        mbedtls_ecp_group xGroup;
+        mbedtls_ecp_point xResult;
+        mbedtls_mpi xScalar;
+        BenchmarkStats_t xStats = { 0 };
+        uint64_t ullStart;
+        uint32_t i;
+        int lResult;
+
+        mbedtls_ecp_group_init( &xGroup );
+        mbedtls_ecp_point_init( &xResult );
+        mbedtls_mpi_init( &xScalar );
+
+        lResult = mbedtls_ecp_group_load( &xGroup, MBEDTLS_ECP_DP_SECP256R1 );
+
+        for( i = 0; ( i < benchmarkconfigP256_MUL_ITERATIONS ) && ( lResult == 0 ); i++ )
+        {
+            lResult = mbedtls_ecp_gen_privkey( &xGroup, &xScalar, prvRandom, NULL );
+
+            if( lResult == 0 )
+            {
+                ullStart = prvNowUs();
+                lResult = mbedtls_ecp_mul( &xGroup, &xResult, &xScalar, &xGroup.G, prvRandom, NULL );
+
+                if( lResult == 0 )
+                {
+                    prvStatsAdd( &xStats, prvNowUs() - ullStart );
+                }
+            }
+        }
+
+        if( lResult != 0 )
+        {
+            PRINTF( "P-256 benchmark stopped, mbed TLS error = -0x%04x.\r\n", ( unsigned int ) -lResult );
+        }
+
+        mbedtls_mpi_free( &xScalar );
+        mbedtls_ecp_point_free( &xResult );
+        mbedtls_ecp_group_free( &xGroup );
+
+        prvReport( "p256_mul", "generator", &xStats, 0U, 0U );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Bytes of the mbed TLS pool and record buffers in use, or at their highest since boot.
+ *
+ * @param[in] pxStats Statistics of the pool.
+ * @param[in] xPeak pdTRUE for the highest usage.
+ */
+    static uint32_t prvTlsPoolBytes( const MbedtlsPoolStats_t * pxStats,
+                                     BaseType_t xPeak )
+    {
+        uint32_t ulBytes = 0U;
+        size_t i;
+
+        for( i = 0; i < mbedtlspoolCLASS_COUNT; i++ )
+        {
+            ulBytes += ( uint32_t ) pxStats->classes[ i ].blockSize *
+                       ( ( xPeak == pdTRUE ) ? pxStats->classes[ i ].maxBlocksUsed : pxStats->classes[ i ].blocksUsed );
+        }
+
+        ulBytes += ( uint32_t ) mbedtlsconfigRECORD_BUFFER_SIZE *
+                   ( ( xPeak == pdTRUE ) ? pxStats->maxRecordBuffersUsed : pxStats->recordBuffersUsed );
+
+        return ulBytes;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Full and resumed handshakes with the broker, with the given credentials. The RAM
+ * line gives the size of the connection context, the most heap and pool bytes a connection
+ * held once established, and the highest pool usage since boot, for comparing TLS back ends.
+ */
+    static void prvBenchHandshake( const ConnectionManagerConfig_t * pxConfig,
+                                   const NetworkCredentials_t * pxCredentials,
+                                   const char * pcVariant )
+    {
+        NetworkCredentials_t xCredentials = *pxCredentials;
+        BenchmarkStats_t xFullStats = { 0 };
+        BenchmarkStats_t xResumedStats = { 0 };
+        BenchmarkStats_t * pxStats;
+        TlsTransportStatus_t xStatus;
+        char cVariant[ 32 ];
+        uint64_t ullStart;
+        uint32_t i, ulPoolBefore, ulHeld, ulMaxHeld = 0U;
+        size_t xHeapBefore, xHeapFree;
+        MbedtlsPoolStats_t xPoolStats;
+
+        for( i = 0; i < ( 2U * benchmarkconfigHANDSHAKE_ITERATIONS ); i++ )
+        {
+            /* The second half offers the session negotiated by the last full handshake. */
+            xCredentials.disableSessionResumption = ( i < benchmarkconfigHANDSHAKE_ITERATIONS ) ? pdTRUE : pdFALSE;
+            pxStats = ( xCredentials.disableSessionResumption == pdTRUE ) ? &xFullStats : &xResumedStats;
+
+            #if ( tlsconfigSESSION_CACHE_ENTRIES == 0 )
+                if( xCredentials.disableSessionResumption == pdFALSE )
+                {
+                    break;
+                }
+            #endif
+
+            mbedtls_platform_get_pool_stats( &xPoolStats );
+            ulPoolBefore = prvTlsPoolBytes( &xPoolStats, pdFALSE );
+            xHeapBefore = xPortGetFreeHeapSize();
+
+            ullStart = prvNowUs();
+            xStatus = TLS_FreeRTOS_Connect( &xBenchContext, pxConfig->pHostName, pxConfig->port, &xCredentials,
+                                            pxConfig->handshakeTimeoutMs, pxConfig->sendTimeoutMs );
+
+            if( xStatus == TLS_TRANSPORT_SUCCESS )
+            {
+                prvStatsAdd( pxStats, prvNowUs() - ullStart );
+
+                /* The other connections of the image may allocate meanwhile, the highest value is kept. */
+                xHeapFree = xPortGetFreeHeapSize();
+                mbedtls_platform_get_pool_stats( &xPoolStats );
+                ulHeld = prvTlsPoolBytes( &xPoolStats, pdFALSE );
+                ulHeld = ( ulHeld > ulPoolBefore ) ? ( ulHeld - ulPoolBefore ) : 0U;
+                ulHeld += ( xHeapBefore > xHeapFree ) ? ( uint32_t ) ( xHeapBefore - xHeapFree ) : 0U;
+                ulMaxHeld = ( ulHeld > ulMaxHeld ) ? ulHeld : ulMaxHeld;
+
+                TLS_FreeRTOS_Disconnect( &xBenchContext );
+            }
+            else
+            {
+                PRINTF( "Handshake %lu of %s failed, status = %d.\r\n", ( unsigned long ) i, pcVariant, xStatus );
+            }
+        }
+
+        ( void ) snprintf( cVariant, sizeof( cVariant ), "%s_full", pcVariant );
+        prvReport( "tls_handshake", cVariant, &xFullStats, 0U, 0U );
+
+        #if ( tlsconfigSESSION_CACHE_ENTRIES > 0 )
+            ( void ) snprintf( cVariant, sizeof( cVariant ), "%s_resumed", pcVariant );
+            prvReport( "tls_handshake", cVariant, &xResumedStats, 0U, 0U );
+        #endif
+
+        mbedtls_platform_get_pool_stats( &xPoolStats );
+        PRINTF( "TLS_RAM,%s,%s,%lu,%lu,%lu\r\n", TLS_FREERTOS_BACKEND, pcVariant,
+                ( unsigned long ) sizeof( NetworkContext_t ), ( unsigned long ) ulMaxHeld,
+                ( unsigned long ) prvTlsPoolBytes( &xPoolStats, pdTRUE ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    #ifdef benchmarkconfigTLS_SERVER_HOST
+
+/**
+ * @brief Bulk transfers through TLS_FreeRTOS_send() and TLS_FreeRTOS_recv(), with the
+ * credentials of the broker connection but the trust anchor of the local server.
+ */
+        static void prvBenchBulk( const NetworkCredentials_t * pxCredentials )
+        {
+            static const char cRequest[] = "GET /" benchmarkconfigTLS_SOURCE_PATH " HTTP/1.0\r\n\r\n";
+            NetworkCredentials_t xCredentials = *pxCredentials;
+            BenchmarkStats_t xStats;
+            uint32_t ulTransferred = 0U;
+            uint64_t ullStart;
+            int32_t lResult = 0;
+
+            xCredentials.pRootCa = ( const unsigned char * ) benchmarkconfigTLS_SERVER_ROOT_CA_PEM;
+            xCredentials.rootCaSize = sizeof( benchmarkconfigTLS_SERVER_ROOT_CA_PEM );
+            xCredentials.pAlpnProtos = NULL;
+            xCredentials.socketProfile = SOCKETS_PROFILE_BULK;
+
+            memset( ucBulkBuffer, 0xA5, sizeof( ucBulkBuffer ) );
+            memset( &xStats, 0x00, sizeof( xStats ) );
+
+            if( TLS_FreeRTOS_Connect( &xBenchContext, benchmarkconfigTLS_SERVER_HOST, benchmarkconfigTLS_SINK_PORT,
+                                      &xCredentials, benchmarkTLS_TIMEOUT_MS, benchmarkTLS_TIMEOUT_MS ) == TLS_TRANSPORT_SUCCESS )
+            {
+                ullStart = prvNowUs();
+
+                while( ( ulTransferred < benchmarkconfigTLS_BULK_BYTES ) && ( lResult >= 0 ) )
+                {
+                    lResult = TLS_FreeRTOS_send( &xBenchContext, ucBulkBuffer,
+                                                 ( ( benchmarkconfigTLS_BULK_BYTES - ulTransferred ) < sizeof( ucBulkBuffer ) ) ?
+                                                 ( benchmarkconfigTLS_BULK_BYTES - ulTransferred ) : sizeof( ucBulkBuffer ) );
+                    ulTransferred += ( lResult > 0 ) ? ( uint32_t ) lResult : 0U;
+                }
+
+                while( lResult > 0 )
+                {
+                    lResult = TLS_FreeRTOS_flush( &xBenchContext );
+                }
+
+                if( lResult == 0 )
+                {
+                    prvStatsAdd( &xStats, prvNowUs() - ullStart );
+                }
+
+                TLS_FreeRTOS_Disconnect( &xBenchContext );
+            }
+
+            prvReport( "tls_bulk", "send", &xStats, ulTransferred, 0U );
+
+            memset( &xStats, 0x00, sizeof( xStats ) );
+            ulTransferred = 0U;
+
+            if( TLS_FreeRTOS_Connect( &xBenchContext, benchmarkconfigTLS_SERVER_HOST, benchmarkconfigTLS_SOURCE_PORT,
+                                      &xCredentials, benchmarkTLS_TIMEOUT_MS, benchmarkTLS_TIMEOUT_MS ) == TLS_TRANSPORT_SUCCESS )
+            {
+                ullStart = prvNowUs();
+                lResult = TLS_FreeRTOS_send( &xBenchContext, cRequest, sizeof( cRequest ) - 1U );
+
+                while( lResult > 0 )
+                {
+                    lResult = TLS_FreeRTOS_flush( &xBenchContext );
+                }
+
+                /* The server closes the connection after the file, the HTTP header is counted. */
+                while( ( lResult == 0 ) && ( ulTransferred < benchmarkconfigTLS_BULK_BYTES ) )
+                {
+                    lResult = TLS_FreeRTOS_recv( &xBenchContext, ucBulkBuffer, sizeof( ucBulkBuffer ) );
+                    ulTransferred += ( lResult > 0 ) ? ( uint32_t ) lResult : 0U;
+                    lResult = ( lResult > 0 ) ? 0 : -1;
+                }
+
+                if( ulTransferred > 0U )
+                {
+                    prvStatsAdd( &xStats, prvNowUs() - ullStart );
+                }
+
+                TLS_FreeRTOS_Disconnect( &xBenchContext );
+            }
+
+            prvReport( "tls_bulk", "recv", &xStats, ulTransferred, 0U );
+        }
+
+    #endif /* ifdef benchmarkconfigTLS_SERVER_HOST */
+
+/*-----------------------------------------------------------*/
+
+    static void prvPublishCallback( struct MQTTOperation * pOperation,
+                                    MQTTStatus_t status )
+    {
+        size_t xSlot = ( size_t ) ( pOperation - xPublishOperations );
+
+        if( status == MQTTSuccess )
+        {
+            prvStatsAdd( &xPublishStats, prvNowUs() - ullPublishStartUs[ xSlot ] );
+        }
+        else
+        {
+            ulPublishFailures++;
+        }
+
+        xPublishBusy[ xSlot ] = pdFALSE;
+        ( void ) xSemaphoreGive( xPublishSlots );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes through MQTTAgent_Enqueue(), keeping benchmarkconfigMQTT_WINDOW messages in
+ * flight. The latency is from the enqueue to the send for QoS0 and to the PUBACK for QoS1.
+ */
+    static void prvBenchPublish( MQTTQoS_t xQoS,
+                                 const char * pcVariant,
+                                 uint16_t usTopicLength )
+    {
+        MQTTOperation_t * pxOperation;
+        uint64_t ullStart;
+        uint32_t ulSent = 0U;
+        uint32_t ulReturned = 0U;
+        uint32_t ulSlot;
+        uint32_t i;
+
+        memset( &xPublishStats, 0x00, sizeof( xPublishStats ) );
+        ulPublishFailures = 0U;
+
+        ullStart = prvNowUs();
+
+        while( ulSent < benchmarkconfigMQTT_MESSAGES )
+        {
+            if( xSemaphoreTake( xPublishSlots, pdMS_TO_TICKS( benchmarkconfigMQTT_TIMEOUT_MS ) ) != pdTRUE )
+            {
+                break;
+            }
+
+            /* Taking the semaphore guarantees a slot is free. */
+            for( ulSlot = 0U; xPublishBusy[ ulSlot ] == pdTRUE; ulSlot++ )
+            {
+            }
+
+            xPublishBusy[ ulSlot ] = pdTRUE;
+            pxOperation = &xPublishOperations[ ulSlot ];
+            memset( pxOperation, 0x00, sizeof( MQTTOperation_t ) );
+            memset( &xPublishInfos[ ulSlot ], 0x00, sizeof( MQTTPublishInfo_t ) );
+
+            xPublishInfos[ ulSlot ].qos = xQoS;
+            xPublishInfos[ ulSlot ].pTopicName = cBenchTopic;
+            xPublishInfos[ ulSlot ].topicNameLength = usTopicLength;
+            xPublishInfos[ ulSlot ].pPayload = ucBenchPayload;
+            xPublishInfos[ ulSlot ].payloadLength = sizeof( ucBenchPayload );
+
+            pxOperation->type = MQTT_OP_PUBLISH;
+            pxOperation->info.pPublishInfo = &xPublishInfos[ ulSlot ];
+            pxOperation->callback = prvPublishCallback;
+            pxOperation->priority = MQTT_AGENT_PRIORITY_BULK;
+            ullPublishStartUs[ ulSlot ] = prvNowUs();
+
+            /* The agent refuses QoS1 publishes while all its ACK slots are taken. */
+            while( MQTTAgent_Enqueue( NULL, pxOperation, 0 ) != pdTRUE )
+            {
+                vTaskDelay( 1 );
+                ullPublishStartUs[ ulSlot ] = prvNowUs();
+            }
+
+            ulSent++;
+        }
+
+        /* Wait for the messages in flight, so their slots can be reused. */
+        for( i = 0; i < benchmarkconfigMQTT_WINDOW; i++ )
+        {
+            if( xSemaphoreTake( xPublishSlots, pdMS_TO_TICKS( benchmarkconfigMQTT_TIMEOUT_MS ) ) == pdTRUE )
+            {
+                ulReturned++;
+            }
+        }
+
+        if( ( ulSent < benchmarkconfigMQTT_MESSAGES ) || ( ulReturned < benchmarkconfigMQTT_WINDOW ) )
+        {
+            /* An operation may still be owned by the agent, its slot must not be reused. */
+            PRINTF( "Publish benchmark timed out, the remaining publish benchmarks are skipped.\r\n" );
+        }
+
+        for( i = 0; i < ulReturned; i++ )
+        {
+            ( void ) xSemaphoreGive( xPublishSlots );
+        }
+
+        if( ulPublishFailures > 0U )
+        {
+            PRINTF( "%lu publishes failed.\r\n", ( unsigned long ) ulPublishFailures );
+        }
+
+        prvReport( "mqtt_publish", pcVariant, &xPublishStats, 0U, prvNowUs() - ullStart );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void Benchmark_Run( const ConnectionManagerConfig_t * pxConfig,
+                        const char * pcThingName,
+                        uint32_t ulThingNameLength )
+    {
+        static const int xEccCipherSuites[] = { MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0 };
+        static const mbedtls_ecp_group_id xEccCurves[] = { MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE };
+        NetworkCredentials_t xEccCredentials = *( pxConfig->pCredentials );
+        uint8_t ucDigest[ pkcs11SHA256_DIGEST_LENGTH ] = { 0 };
+        uint16_t usTopicLength;
+
+        PRINTF( "Benchmarks started, core clock %lu Hz.\r\n", ( unsigned long ) SystemCoreClock );
+        PRINTF( "BENCH,test,variant,count,bytes,min_us,avg_us,max_us,per_s\r\n" );
+        PRINTF( "TLS_RAM,backend,variant,context_bytes,connected_bytes,pool_peak_bytes\r\n" );
+
+        prvBenchSha256( ucDigest );
+        prvBenchVerify( ucDigest );
+        prvBenchP256Mul();
+
+        prvBenchHandshake( pxConfig, pxConfig->pCredentials, "default" );
+        xEccCredentials.pCipherSuites = xEccCipherSuites;
+        xEccCredentials.pCurves = xEccCurves;
+        prvBenchHandshake( pxConfig, &xEccCredentials, "ecdhe_ecdsa" );
+
+        #ifdef benchmarkconfigTLS_SERVER_HOST
+            prvBenchBulk( pxConfig->pCredentials );
+        #endif
+
+        if( xPublishSlots == NULL )
+        {
+            xPublishSlots = xSemaphoreCreateCountingStatic( benchmarkconfigMQTT_WINDOW, benchmarkconfigMQTT_WINDOW,
+                                                            &xPublishSlotsBuffer );
+        }
+
+        memset( ucBenchPayload, 'B', sizeof( ucBenchPayload ) );
+        usTopicLength = ( uint16_t ) snprintf( cBenchTopic, sizeof( cBenchTopic ), benchmarkMQTT_TOPIC_FORMAT,
+                                               ( int ) ulThingNameLength, pcThingName );
+
+        prvBenchPublish( MQTTQoS0, "qos0", usTopicLength );
+
+        if( uxSemaphoreGetCount( xPublishSlots ) == benchmarkconfigMQTT_WINDOW )
+        {
+            prvBenchPublish( MQTTQoS1, "qos1", usTopicLength );
+        }
+
+        /* Last, as it erases the update slot and blocks the other flash users. */
+        #if ( MFLASH_BENCHMARK == 1 )
+            mflash_drv_benchmark( boot_update_slot(), BOOT_SWAP_SLOT_SIZE );
+        #endif
+
+        PRINTF( "Benchmarks done.\r\n" );
+    }
+
+#endif /* if ( BENCHMARK_BUILD == 1 ) */
@@ -0,0 +1,67 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file benchmark.h
+ * @brief On-target benchmarks of the data path, built in the Benchmark configuration (BENCHMARK_BUILD=1).
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "connection_manager.h"
+
+/**
+ * @brief Set to 1 by the Benchmark build configuration, the application then runs the benchmarks
+ * instead of the demo.
+ */
+#ifndef BENCHMARK_BUILD
+    #define BENCHMARK_BUILD    ( 0 )
+#endif
+
+#if ( BENCHMARK_BUILD == 1 )
+
+/**
+ * @brief Runs all the benchmarks once and prints the results on the debug console.
+ * Each result is one line: BENCH,test,variant,count,bytes,min_us,avg_us,max_us,per_s
+ * where per_s is KB/s for the tests moving data and operations per second otherwise.
+ * The flash benchmark prints its own MFLASH_BENCH lines and erases the update slot.
+ * Must be called once the MQTT agent is started on the broker connection.
+ *
+ * @param[in] pxConfig The broker connection, also used for the TLS handshake benchmark.
+ * @param[in] pcThingName The thing name used in the publish benchmark topic.
+ * @param[in] ulThingNameLength Length of the thing name.
+ */
+    void Benchmark_Run( const ConnectionManagerConfig_t * pxConfig,
+                        const char * pcThingName,
+                        uint32_t ulThingNameLength );
+
+#endif /* if ( BENCHMARK_BUILD == 1 ) */
+
+#endif /* BENCHMARK_H */
@@ -0,0 +1,209 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file binary_log.c
+ * @brief Binary log encoder.
+ * A record is a marker byte, the varint offset of the format string in the .log_fmt section, and one
+ * field per conversion of the format: a zigzag varint for %d and %i, a varint for the other integer
+ * conversions, and for %s either the varint offset plus one of a string in flash, or a zero followed
+ * by the string bytes and their terminator. Only the conversions are scanned, nothing is formatted.
+ * tools/log_decode.py formats the records on the host.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "deferred_log.h"
+
+#include "binary_log.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Longest record, larger records lose their last fields.
+ */
+#ifndef binarylogMAX_RECORD_SIZE
+    #define binarylogMAX_RECORD_SIZE    ( 96U )
+#endif
+
+/**
+ * @brief Longest string copied by value, longer strings are truncated.
+ */
+#ifndef binarylogMAX_STRING_LENGTH
+    #define binarylogMAX_STRING_LENGTH    ( 32U )
+#endif
+
+/**
+ * @brief First byte of a record, never part of the text log.
+ */
+#define binarylogRECORD_MARKER    ( 0xFEU )
+
+/**
+ * @brief Longest varint of a 32 bit value.
+ */
+#define binarylogVARINT_MAX_SIZE    ( 5U )
+
+/*-----------------------------------------------------------*/
+
+/* Linker script symbols. */
+extern const char __log_fmt_start__[];
+extern uint32_t __FLASH_segment_start__[];
+extern uint32_t __FLASH_segment_end__[];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Appends a varint, returns the new length or the old one if the record is full.
+ */
+static size_t prvPutVarint( uint8_t * pucRecord,
+                            size_t xLength,
+                            uint32_t ulValue )
+{
+    if( ( xLength + binarylogVARINT_MAX_SIZE ) > binarylogMAX_RECORD_SIZE )
+    {
+        return xLength;
+    }
+
+    while( ulValue >= 0x80U )
+    {
+        pucRecord[ xLength++ ] = ( uint8_t ) ( ulValue | 0x80U );
+        ulValue >>= 7;
+    }
+
+    pucRecord[ xLength++ ] = ( uint8_t ) ulValue;
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Appends a string argument, by address when it is in flash and so in the ELF file.
+ */
+static size_t prvPutString( uint8_t * pucRecord,
+                            size_t xLength,
+                            const char * pcString )
+{
+    size_t xCount = 0;
+
+    if( ( pcString >= ( const char * ) __FLASH_segment_start__ ) &&
+        ( pcString < ( const char * ) __FLASH_segment_end__ ) )
+    {
+        return prvPutVarint( pucRecord, xLength,
+                             ( uint32_t ) ( pcString - ( const char * ) __FLASH_segment_start__ ) + 1U );
+    }
+
+    if( ( xLength + 2U ) > binarylogMAX_RECORD_SIZE )
+    {
+        return xLength;
+    }
+
+    pucRecord[ xLength++ ] = 0U;
+
+    if( pcString != NULL )
+    {
+        while( ( pcString[ xCount ] != '\0' ) && ( xCount < binarylogMAX_STRING_LENGTH ) &&
+               ( ( xLength + 1U ) < binarylogMAX_RECORD_SIZE ) )
+        {
+            pucRecord[ xLength++ ] = ( uint8_t ) pcString[ xCount++ ];
+        }
+    }
+
+    pucRecord[ xLength++ ] = 0U;
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+void BinaryLog_Write( const char * pcFormat,
+                      ... )
+{
+    uint8_t ucRecord[ binarylogMAX_RECORD_SIZE ];
+    size_t xLength = 0;
+    const char * pcNext = pcFormat;
+    int32_t lValue;
+    va_list args;
+
+    ucRecord[ xLength++ ] = binarylogRECORD_MARKER;
+    xLength = prvPutVarint( ucRecord, xLength, ( uint32_t ) ( pcFormat - __log_fmt_start__ ) );
+
+    va_start( args, pcFormat );
+
+    while( *pcNext != '\0' )
+    {
+        if( *pcNext++ != '%' )
+        {
+            continue;
+        }
+
+        /* Skip the flags, width, precision and length of the conversion, '*' takes an argument. */
+        while( ( *pcNext != '\0' ) && ( ( ( *pcNext >= '0' ) && ( *pcNext <= '9' ) ) || ( *pcNext == '-' ) ||
+                                        ( *pcNext == '+' ) || ( *pcNext == ' ' ) || ( *pcNext == '#' ) ||
+                                        ( *pcNext == '.' ) || ( *pcNext == '*' ) || ( *pcNext == 'l' ) ||
+                                        ( *pcNext == 'h' ) ) )
+        {
+            if( *pcNext == '*' )
+            {
+                xLength = prvPutVarint( ucRecord, xLength, va_arg( args, uint32_t ) );
+            }
+
+            pcNext++;
+        }
+
+        switch( *pcNext )
+        {
+            case '\0':
+            case '%':
+                break;
+
+            case 'd':
+            case 'i':
+                lValue = va_arg( args, int32_t );
+                xLength = prvPutVarint( ucRecord, xLength,
+                                        ( ( uint32_t ) lValue << 1 ) ^ ( uint32_t ) ( lValue >> 31 ) );
+                break;
+
+            case 's':
+                xLength = prvPutString( ucRecord, xLength, va_arg( args, const char * ) );
+                break;
+
+            default:
+                xLength = prvPutVarint( ucRecord, xLength, va_arg( args, uint32_t ) );
+                break;
+        }
+
+        if( *pcNext != '\0' )
+        {
+            pcNext++;
+        }
+    }
+
+    va_end( args );
+
+    ( void ) DeferredLog_Write( ucRecord, xLength );
+}
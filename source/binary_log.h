@@ -0,0 +1,62 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file binary_log.h
+ * @brief Binary log records carrying a format string ID and the raw arguments.
+ */
+
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include <stdint.h>
+
+/**
+ * @brief Places the format strings of the binary log in the .log_fmt section, which the host decoder
+ * reads from the ELF file to turn the IDs back into text.
+ */
+#define BINARY_LOG_FORMAT_SECTION    __attribute__( ( section( ".log_fmt" ), used ) )
+
+/**
+ * @brief Logs a binary record, the format must be a string literal.
+ * Arguments are the integers, characters, pointers and strings of the SDK printf, the record holds
+ * them as varints, strings in flash by address and other strings by value.
+ */
+#define BinaryLog( format, ... )                                                      \
+    do                                                                                \
+    {                                                                                 \
+        static const char pcBinaryLogFormat[] BINARY_LOG_FORMAT_SECTION = format;     \
+        BinaryLog_Write( pcBinaryLogFormat, ## __VA_ARGS__ );                         \
+    } while( 0 )
+
+/**
+ * @brief Encodes a binary record and queues it to the deferred log.
+ *
+ * @param[in] pcFormat The format string, placed in the .log_fmt section by BinaryLog().
+ */
+void BinaryLog_Write( const char * pcFormat,
+                      ... );
+
+#endif /* BINARY_LOG_H */
@@ -0,0 +1,278 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file block_pool.c
+ * @brief Pools of fixed size blocks, allocated and freed in constant time from tasks and interrupts.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "fsl_debug_console.h"
+
+#include "block_pool.h"
+
+/*-----------------------------------------------------------*/
+
+#if ( blockpoolGUARD_WORDS == 1 )
+
+/**
+ * @brief Value of the guard words.
+ */
+    #define blockpoolGUARD_VALUE        ( 0xB10C6A7DUL )
+
+/**
+ * @brief Value of the link word of an allocated block. Odd, so it never equals the address of a
+ * free block.
+ */
+    #define blockpoolALLOCATED_VALUE    ( 0xA110CA7FUL )
+
+/**
+ * @brief The guard value copied after the data, which is not always word aligned.
+ */
+    static const uint32_t ulTrailerGuard = blockpoolGUARD_VALUE;
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Builds the free list, the lowest addresses are used first. Called with the interrupts masked.
+ *
+ * @param[in] pxPool The pool.
+ */
+static void prvInit( BlockPool_t * pxPool );
+
+/**
+ * @brief Returns the link word of a block, which holds the next free block while the block is free.
+ *
+ * @param[in] pucBlock The start of the block, header included.
+ *
+ * @return The link word.
+ */
+static void ** prvLink( uint8_t * pucBlock );
+
+/*-----------------------------------------------------------*/
+
+static void ** prvLink( uint8_t * pucBlock )
+{
+    return ( void ** ) &( pucBlock[ blockpoolHEADER_SIZE / 2U ] );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvInit( BlockPool_t * pxPool )
+{
+    uint8_t * pucBlock;
+    uint32_t ulIndex;
+
+    pxPool->pvFreeList = NULL;
+
+    for( ulIndex = pxPool->usCount; ulIndex > 0U; ulIndex-- )
+    {
+        pucBlock = &( pxPool->pucStorage[ ( ulIndex - 1U ) * pxPool->xStride ] );
+
+        #if ( blockpoolGUARD_WORDS == 1 )
+            *( ( uint32_t * ) pucBlock ) = blockpoolGUARD_VALUE;
+            memcpy( &pucBlock[ blockpoolHEADER_SIZE + pxPool->xDataSize ], &ulTrailerGuard, sizeof( ulTrailerGuard ) );
+        #endif
+
+        *prvLink( pucBlock ) = pxPool->pvFreeList;
+        pxPool->pvFreeList = pucBlock;
+    }
+
+    pxPool->xInitDone = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+void * BlockPool_Alloc( BlockPool_t * pxPool )
+{
+    uint8_t * pucBlock;
+    UBaseType_t uxSavedMask;
+
+    configASSERT( pxPool != NULL );
+
+    uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        if( pxPool->xInitDone == pdFALSE )
+        {
+            prvInit( pxPool );
+        }
+
+        pucBlock = ( uint8_t * ) pxPool->pvFreeList;
+
+        if( pucBlock != NULL )
+        {
+            pxPool->pvFreeList = *prvLink( pucBlock );
+            pxPool->usUsed++;
+
+            if( pxPool->usUsed > pxPool->usPeak )
+            {
+                pxPool->usPeak = pxPool->usUsed;
+            }
+
+            #if ( blockpoolGUARD_WORDS == 1 )
+                *prvLink( pucBlock ) = ( void * ) blockpoolALLOCATED_VALUE;
+            #endif
+        }
+        else
+        {
+            pxPool->ulFailures++;
+        }
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+
+    return ( pucBlock != NULL ) ? &( pucBlock[ blockpoolHEADER_SIZE ] ) : NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+void BlockPool_Free( BlockPool_t * pxPool,
+                     void * pvBlock )
+{
+    uint8_t * pucBlock = ( uint8_t * ) pvBlock - blockpoolHEADER_SIZE;
+    UBaseType_t uxSavedMask;
+
+    configASSERT( pxPool != NULL );
+    configASSERT( ( pucBlock >= pxPool->pucStorage ) &&
+                  ( pucBlock < &( pxPool->pucStorage[ pxPool->usCount * pxPool->xStride ] ) ) &&
+                  ( ( ( size_t ) ( pucBlock - pxPool->pucStorage ) % pxPool->xStride ) == 0U ) );
+
+    #if ( blockpoolGUARD_WORDS == 1 )
+    {
+        uint32_t ulTrailer;
+
+        memcpy( &ulTrailer, &pucBlock[ blockpoolHEADER_SIZE + pxPool->xDataSize ], sizeof( ulTrailer ) );
+
+        /* Overwritten guard words, or a block freed twice. */
+        configASSERT( *( ( uint32_t * ) pucBlock ) == blockpoolGUARD_VALUE );
+        configASSERT( ulTrailer == blockpoolGUARD_VALUE );
+        configASSERT( *prvLink( pucBlock ) == ( void * ) blockpoolALLOCATED_VALUE );
+    }
+    #endif
+
+    uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        *prvLink( pucBlock ) = pxPool->pvFreeList;
+        pxPool->pvFreeList = pucBlock;
+        pxPool->usUsed--;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+}
+
+/*-----------------------------------------------------------*/
+
+void BlockPool_Reset( BlockPool_t * pxPool )
+{
+    UBaseType_t uxSavedMask;
+
+    configASSERT( pxPool != NULL );
+
+    uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        prvInit( pxPool );
+        pxPool->usUsed = 0U;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+}
+
+/*-----------------------------------------------------------*/
+
+void BlockPool_GetStats( const BlockPool_t * pxPool,
+                         BlockPoolStats_t * pxStats )
+{
+    UBaseType_t uxSavedMask;
+
+    configASSERT( ( pxPool != NULL ) && ( pxStats != NULL ) );
+
+    uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        pxStats->usCount = pxPool->usCount;
+        pxStats->usUsed = pxPool->usUsed;
+        pxStats->usPeak = pxPool->usPeak;
+        pxStats->ulFailures = pxPool->ulFailures;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+}
+
+/*-----------------------------------------------------------*/
+
+void BlockPool_Print( const BlockPool_t * pxPool )
+{
+    BlockPoolStats_t xStats;
+
+    BlockPool_GetStats( pxPool, &xStats );
+
+    PRINTF( "POOL,%s,%u,%u,%u,%u\r\n",
+            pxPool->pcName,
+            ( unsigned int ) xStats.usCount,
+            ( unsigned int ) xStats.usUsed,
+            ( unsigned int ) xStats.usPeak,
+            ( unsigned int ) xStats.ulFailures );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( blockpoolGUARD_WORDS == 1 )
+
+    BaseType_t BlockPool_Check( BlockPool_t * pxPool )
+    {
+        BaseType_t xResult = pdTRUE;
+        UBaseType_t uxSavedMask;
+        uint8_t * pucBlock;
+        uint32_t ulTrailer;
+        uint32_t ulIndex;
+
+        configASSERT( pxPool != NULL );
+
+        uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+        {
+            if( pxPool->xInitDone == pdFALSE )
+            {
+                prvInit( pxPool );
+            }
+        }
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+
+        /* The guard words are never written after the initialization, no lock is needed. */
+        for( ulIndex = 0U; ulIndex < pxPool->usCount; ulIndex++ )
+        {
+            pucBlock = &( pxPool->pucStorage[ ulIndex * pxPool->xStride ] );
+            memcpy( &ulTrailer, &pucBlock[ blockpoolHEADER_SIZE + pxPool->xDataSize ], sizeof( ulTrailer ) );
+
+            if( ( *( ( uint32_t * ) pucBlock ) != blockpoolGUARD_VALUE ) || ( ulTrailer != blockpoolGUARD_VALUE ) )
+            {
+                PRINTF( "Pool %s: guard words of block %u overwritten.\r\n", pxPool->pcName, ( unsigned int ) ulIndex );
+                xResult = pdFALSE;
+            }
+        }
+
+        return xResult;
+    }
+
+#endif /* blockpoolGUARD_WORDS == 1 */
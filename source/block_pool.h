@@ -0,0 +1,172 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file block_pool.h
+ * @brief Pools of fixed size blocks, allocated and freed in constant time from tasks and interrupts.
+ */
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Set to 1 to surround each block with guard words, checked when the block is freed and by
+ * BlockPool_Check(). A block written out of its bounds or freed twice then fails configASSERT().
+ * Takes 12 more bytes per block.
+ */
+#ifndef blockpoolGUARD_WORDS
+    #define blockpoolGUARD_WORDS    ( 0 )
+#endif
+
+/**
+ * @brief Size of the block header, a guard word and a word linking the free blocks or marking the
+ * block allocated, and of the trailing guard word.
+ */
+#if ( blockpoolGUARD_WORDS == 1 )
+    #define blockpoolHEADER_SIZE    ( 2U * sizeof( void * ) )
+    #define blockpoolTRAILER_SIZE   ( sizeof( uint32_t ) )
+#else
+    #define blockpoolHEADER_SIZE    ( ( size_t ) 0U )
+    #define blockpoolTRAILER_SIZE   ( ( size_t ) 0U )
+#endif
+
+/**
+ * @brief Distance between two blocks holding xDataSize bytes, keeping each block 8-byte aligned.
+ */
+#define blockpoolSTRIDE( xDataSize ) \
+    ( ( ( blockpoolHEADER_SIZE + ( xDataSize ) + blockpoolTRAILER_SIZE ) + 7U ) & ~( ( size_t ) 7U ) )
+
+/**
+ * @brief A pool and its usage. Defined with BLOCK_POOL_DEFINE(), the members are private.
+ */
+typedef struct BlockPool
+{
+    const char * pcName;    /**< Name printed by BlockPool_Print(). */
+    uint8_t * pucStorage;   /**< The blocks. */
+    size_t xDataSize;       /**< Size of the data of a block. */
+    size_t xStride;         /**< Distance between two blocks. */
+    uint16_t usCount;       /**< Number of blocks. */
+    uint16_t usUsed;        /**< Number of blocks allocated. */
+    uint16_t usPeak;        /**< Highest number of blocks allocated at the same time. */
+    uint32_t ulFailures;    /**< Allocations that found the pool empty. */
+    void * pvFreeList;      /**< First free block, each free block links to the next one. */
+    BaseType_t xInitDone;   /**< pdTRUE once the free list is built. */
+} BlockPool_t;
+
+/**
+ * @brief Usage of a pool.
+ */
+typedef struct BlockPoolStats
+{
+    uint16_t usCount;    /**< Number of blocks. */
+    uint16_t usUsed;     /**< Number of blocks allocated. */
+    uint16_t usPeak;     /**< Highest number of blocks allocated at the same time. */
+    uint32_t ulFailures; /**< Allocations that found the pool empty. */
+} BlockPoolStats_t;
+
+/**
+ * @brief Defines a static pool of uxCount blocks of xType, e.g.
+ * BLOCK_POOL_DEFINE( xOperationPool, MQTTOperation_t, 8 );
+ * A pool of byte buffers is defined with a uint8_t array type. The free list is built on the first
+ * allocation, the pool needs no initialization.
+ */
+#define BLOCK_POOL_DEFINE( xName, xType, uxCount )                                                      \
+    static uint64_t xName ## Storage[ ( ( uxCount ) * blockpoolSTRIDE( sizeof( xType ) ) ) / 8U ];      \
+    static BlockPool_t xName =                                                                          \
+    {                                                                                                   \
+        .pcName     = # xName,                                                                          \
+        .pucStorage = ( uint8_t * ) xName ## Storage,                                                   \
+        .xDataSize  = sizeof( xType ),                                                                  \
+        .xStride    = blockpoolSTRIDE( sizeof( xType ) ),                                               \
+        .usCount    = ( uxCount ),                                                                      \
+        .usUsed     = 0U,                                                                               \
+        .usPeak     = 0U,                                                                               \
+        .ulFailures = 0U,                                                                               \
+        .pvFreeList = NULL,                                                                             \
+        .xInitDone  = pdFALSE                                                                           \
+    }
+
+/**
+ * @brief Takes a block of the pool, can be called from a task or an interrupt. The content of the
+ * block is undefined.
+ *
+ * @param[in] pxPool The pool.
+ *
+ * @return The block, NULL if all the blocks are allocated.
+ */
+void * BlockPool_Alloc( BlockPool_t * pxPool );
+
+/**
+ * @brief Returns a block to its pool, can be called from a task or an interrupt.
+ *
+ * @param[in] pxPool The pool the block was taken from.
+ * @param[in] pvBlock The block.
+ */
+void BlockPool_Free( BlockPool_t * pxPool,
+                     void * pvBlock );
+
+/**
+ * @brief Returns every block to the pool, for a user restarting after dropping its blocks. The
+ * blocks still referenced must not be freed afterwards.
+ *
+ * @param[in] pxPool The pool.
+ */
+void BlockPool_Reset( BlockPool_t * pxPool );
+
+/**
+ * @brief Reads the usage of the pool.
+ *
+ * @param[in] pxPool The pool.
+ * @param[out] pxStats Receives a consistent copy of the usage.
+ */
+void BlockPool_GetStats( const BlockPool_t * pxPool,
+                         BlockPoolStats_t * pxStats );
+
+/**
+ * @brief Prints the usage of the pool on the debug console: POOL,name,count,used,peak,failures
+ *
+ * @param[in] pxPool The pool.
+ */
+void BlockPool_Print( const BlockPool_t * pxPool );
+
+#if ( blockpoolGUARD_WORDS == 1 )
+
+/**
+ * @brief Checks the guard words of every block of the pool, allocated or free.
+ *
+ * @param[in] pxPool The pool.
+ *
+ * @return pdTRUE if no guard word is overwritten.
+ */
+    BaseType_t BlockPool_Check( BlockPool_t * pxPool );
+
+#endif /* blockpoolGUARD_WORDS == 1 */
+
+#endif /* BLOCK_POOL_H */
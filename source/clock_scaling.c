@@ -0,0 +1,325 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file clock_scaling.c
+ * @brief Run time performance levels.
+ * The core runs at clockscalingIDLE_LEVEL and is boosted to the PLL at 180 MHz while a TLS handshake,
+ * an image signature verification or an OTA download is in progress, so these finish sooner and the
+ * average power goes down.
+ *
+ * The debug UART runs from the FRO 12 MHz and the SPIFI from the FRO HF at 96 MHz, which stay as they
+ * are at every level, so their baud rate dividers are never touched. The 48 MHz level divides the FRO HF
+ * in the AHB divider rather than retuning the FRO HF, which would halve the SPIFI clock. What depends on
+ * the core clock is rescaled on each change: the SysTick reload, keeping the phase of the current tick,
+ * and the ENET SMI clock divider. Cycle counts of the DWT, used by the run time stats and the latency
+ * probes, are converted with the core clock at the time they are read, the monotonic clock converts
+ * the cycles counted at each level with the rate of that level.
+ */
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_clock.h"
+#include "fsl_power.h"
+#include "fsl_enet.h"
+#include "clock_config.h"
+
+#include "monotonic_clock.h"
+#include "gpio_capture.h"
+#include "clock_scaling.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Switch the core clock at run time, the core otherwise stays at the boot configuration.
+ */
+#ifndef clockscalingENABLED
+    #define clockscalingENABLED    ( 0 )
+#endif
+
+#if ( clockscalingENABLED == 1 ) && ( TRC_USE_TRACEALYZER_RECORDER == 1 ) && \
+    ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING ) && ( TRC_CFG_STREAM_PORT == TRC_STREAM_PORT_ARM_ITM )
+    #error "The SWO bit rate of the ITM trace stream port follows the main clock, disable clockscalingENABLED."
+#endif
+
+/**
+ * @brief Level while no boost is requested.
+ * The ENET needs at least 25 MHz to move frames at 100 Mbit/s, CLOCK_LEVEL_FRO12M only suits a
+ * deployment which is mostly offline.
+ */
+#ifndef clockscalingIDLE_LEVEL
+    #define clockscalingIDLE_LEVEL    CLOCK_LEVEL_FROHF48M
+#endif
+
+/**
+ * @brief Lowest core clock the ENET SMI divider can be set up for, see ENET_SetSMI().
+ * Below it the divider of the previous level is kept, which only makes MDC slower.
+ */
+#define clockscalingSMI_MIN_HZ        ( 20000000U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Current level, the boot clocks run the PLL.
+ */
+static volatile ClockLevel_t xLevel = CLOCK_LEVEL_PLL180M;
+
+/**
+ * @brief PLL configuration of the boot clocks, restored when boosting.
+ */
+static pll_setup_t xPllSetup;
+
+/**
+ * @brief Core clock of the boot configuration.
+ */
+static uint32_t ulHighHz = 0;
+
+#if ( clockscalingENABLED == 1 )
+
+/**
+ * @brief Outstanding ClockScaling_Boost() requests.
+ */
+    static UBaseType_t uxBoosts = 0;
+
+/**
+ * @brief Serialises the level changes, the PLL lock is waited for with interrupts enabled.
+ */
+    static SemaphoreHandle_t xLevelMutex = NULL;
+    static StaticSemaphore_t xLevelMutexBuffer;
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Powers up the PLL with the boot configuration and waits for the lock, the PLL must not be in use.
+ */
+static void prvStartPll( void )
+{
+    POWER_SetVoltageForFreq( ulHighHz );
+    CLOCK_AttachClk( kFRO12M_to_SYS_PLL );
+    ( void ) CLOCK_SetPLLFreq( &xPllSetup );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Selects the main clock and the AHB divider of a level, the PLL must be locked for CLOCK_LEVEL_PLL180M.
+ * The divider is changed on the side which keeps the core at or below the faster of the two levels.
+ */
+static void prvSelectClocks( ClockLevel_t xNewLevel )
+{
+    switch( xNewLevel )
+    {
+        case CLOCK_LEVEL_PLL180M:
+            CLOCK_SetClkDiv( kCLOCK_DivAhbClk, 1U, false );
+            CLOCK_AttachClk( kSYS_PLL_to_MAIN_CLK );
+            break;
+
+        case CLOCK_LEVEL_FROHF48M:
+            CLOCK_SetClkDiv( kCLOCK_DivAhbClk, 2U, false );
+            CLOCK_AttachClk( kFRO_HF_to_MAIN_CLK );
+            break;
+
+        case CLOCK_LEVEL_FRO12M:
+        default:
+            CLOCK_AttachClk( kFRO12M_to_MAIN_CLK );
+            CLOCK_SetClkDiv( kCLOCK_DivAhbClk, 1U, false );
+            break;
+    }
+
+    SystemCoreClock = CLOCK_GetCoreSysClkFreq();
+    MonotonicClock_CoreClockChanged();
+    GpioCapture_CoreClockChanged();
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( clockscalingENABLED == 1 )
+
+/**
+ * @brief Reprograms the SysTick for the new core clock, called in a critical section.
+ * What is left of the current tick is scaled to the new clock, as in the tickless idle restart.
+ */
+    static void prvRescaleSysTick( uint32_t ulOldHz )
+    {
+        uint32_t ulCountsForOneTick = SystemCoreClock / configTICK_RATE_HZ;
+        uint32_t ulLeft;
+
+        if( ( SysTick->CTRL & SysTick_CTRL_ENABLE_Msk ) == 0UL )
+        {
+            /* The scheduler sets up the SysTick from SystemCoreClock when it starts. */
+            return;
+        }
+
+        SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+        ulLeft = ( uint32_t ) ( ( ( uint64_t ) SysTick->VAL * SystemCoreClock ) / ulOldHz );
+
+        if( ulLeft == 0UL )
+        {
+            ulLeft = ulCountsForOneTick - 1UL;
+        }
+
+        SysTick->LOAD = ulLeft;
+        SysTick->VAL = 0UL;
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        SysTick->LOAD = ulCountsForOneTick - 1UL;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Moves to a new level, called with xLevelMutex held.
+ */
+    static void prvSetLevel( ClockLevel_t xNewLevel )
+    {
+        uint32_t ulOldHz = SystemCoreClock;
+
+        if( xNewLevel == xLevel )
+        {
+            return;
+        }
+
+        if( xNewLevel == CLOCK_LEVEL_PLL180M )
+        {
+            /* The PLL is not in use yet, the lock is waited for with interrupts enabled. */
+            prvStartPll();
+        }
+
+        taskENTER_CRITICAL();
+        {
+            prvSelectClocks( xNewLevel );
+            prvRescaleSysTick( ulOldHz );
+
+            /* SMI transfers run with the scheduler suspended, so none is in progress here. */
+            if( ( ( SYSCON->AHBCLKCTRL[ 2 ] & SYSCON_AHBCLKCTRL_ETH_MASK ) != 0UL ) &&
+                ( SystemCoreClock >= clockscalingSMI_MIN_HZ ) )
+            {
+                ENET_SetSMI( ENET );
+            }
+
+            xLevel = xNewLevel;
+        }
+        taskEXIT_CRITICAL();
+
+        if( xNewLevel != CLOCK_LEVEL_PLL180M )
+        {
+            /* The SPIFI keeps running from the FRO HF, the voltage stays high enough for it. */
+            POWER_SetVoltageForFreq( CLOCK_GetFroHfFreq() );
+            POWER_EnablePD( kPDRUNCFG_PD_SYS_PLL0 );
+        }
+    }
+
+#endif /* if ( clockscalingENABLED == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_Init( void )
+{
+    /* Keep the boot PLL configuration, without the latch bits of its dividers. */
+    xPllSetup.pllctrl = SYSCON->SYSPLLCTRL;
+    xPllSetup.pllndec = SYSCON->SYSPLLNDEC & SYSCON_SYSPLLNDEC_NDEC_MASK;
+    xPllSetup.pllpdec = SYSCON->SYSPLLPDEC & SYSCON_SYSPLLPDEC_PDEC_MASK;
+    xPllSetup.pllmdec = SYSCON->SYSPLLMDEC & SYSCON_SYSPLLMDEC_MDEC_MASK;
+    xPllSetup.pllRate = CLOCK_GetPllOutFreq();
+    xPllSetup.flags = PLL_SETUPFLAG_POWERUP | PLL_SETUPFLAG_WAITLOCK;
+    ulHighHz = SystemCoreClock;
+
+    #if ( clockscalingENABLED == 1 )
+        xLevelMutex = xSemaphoreCreateMutexStatic( &xLevelMutexBuffer );
+        configASSERT( xLevelMutex != NULL );
+
+        prvSetLevel( clockscalingIDLE_LEVEL );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_Boost( void )
+{
+    #if ( clockscalingENABLED == 1 )
+        ( void ) xSemaphoreTake( xLevelMutex, portMAX_DELAY );
+
+        if( uxBoosts == 0U )
+        {
+            prvSetLevel( CLOCK_LEVEL_PLL180M );
+        }
+
+        uxBoosts++;
+        ( void ) xSemaphoreGive( xLevelMutex );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_Release( void )
+{
+    #if ( clockscalingENABLED == 1 )
+        ( void ) xSemaphoreTake( xLevelMutex, portMAX_DELAY );
+        configASSERT( uxBoosts > 0U );
+
+        uxBoosts--;
+
+        if( uxBoosts == 0U )
+        {
+            prvSetLevel( clockscalingIDLE_LEVEL );
+        }
+
+        ( void ) xSemaphoreGive( xLevelMutex );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+ClockLevel_t ClockScaling_GetLevel( void )
+{
+    return xLevel;
+}
+
+/*-----------------------------------------------------------*/
+
+void ClockScaling_RestoreAfterDeepSleep( void )
+{
+    if( ulHighHz == 0U )
+    {
+        /* Not initialised, the core runs the boot configuration. */
+        BOARD_InitBootClocks();
+        MonotonicClock_CoreClockChanged();
+        GpioCapture_CoreClockChanged();
+    }
+    else
+    {
+        if( xLevel == CLOCK_LEVEL_PLL180M )
+        {
+            prvStartPll();
+        }
+
+        prvSelectClocks( xLevel );
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file clock_scaling.h
+ * @brief Run time performance levels: the PLL at 180 MHz during bursts of work, the FRO while idle.
+ */
+
+#ifndef CLOCK_SCALING_H
+#define CLOCK_SCALING_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Core clock configurations, from the lowest to the highest power.
+ */
+typedef enum ClockLevel
+{
+    CLOCK_LEVEL_FRO12M = 0, /**< FRO 12 MHz. */
+    CLOCK_LEVEL_FROHF48M,   /**< FRO HF 96 MHz divided by 2, the SPIFI keeps its 96 MHz source. */
+    CLOCK_LEVEL_PLL180M     /**< System PLL at 180 MHz, the boot configuration. */
+} ClockLevel_t;
+
+/**
+ * @brief Records the boot clock configuration as the high level and drops to clockscalingIDLE_LEVEL.
+ * Must be called once the boot clocks are set up and before the scheduler starts.
+ */
+void ClockScaling_Init( void );
+
+/**
+ * @brief Runs at CLOCK_LEVEL_PLL180M until the matching ClockScaling_Release().
+ * Requests nest, the clock drops back once the last one is released. Called from tasks only, the
+ * first request waits for the PLL to lock.
+ */
+void ClockScaling_Boost( void );
+
+/**
+ * @brief Releases a request of ClockScaling_Boost().
+ */
+void ClockScaling_Release( void );
+
+/**
+ * @brief Returns the current level.
+ *
+ * @return The level the core runs at.
+ */
+ClockLevel_t ClockScaling_GetLevel( void );
+
+/**
+ * @brief Sets up the clocks of the current level again after a deep sleep, which stops the PLL.
+ * Called with interrupts disabled and the SysTick stopped, it is not rescaled as the level is unchanged.
+ */
+void ClockScaling_RestoreAfterDeepSleep( void );
+
+#endif /* CLOCK_SCALING_H */
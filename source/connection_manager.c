@@ -0,0 +1,562 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file connection_manager.c
+ * @brief Connection manager, see connection_manager.h.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "fsl_debug_console.h"
+#include "spifi_boot.h"
+
+#include "core_mqtt_agent.h"
+#include "retry_utils.h"
+#include "clock_scaling.h"
+#include "flash_service.h"
+#include "connection_manager.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Event group bit set while the broker connection is established.
+ */
+#define connmgrCONNECTED_BIT    ( 1UL << 0 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A connection to the broker.
+ */
+typedef struct Connection
+{
+    const ConnectionManagerConfig_t * pxConfig; /**< Connection parameters. */
+    MQTTContext_t * pMQTTContext;               /**< MQTT context, set by the first connect. */
+    NetworkContext_t xNetworkContext;           /**< Network context of the connection. */
+    BaseType_t xTransportConnected;             /**< pdTRUE while the TLS connection is open, even if the MQTT connection failed. */
+} Connection_t;
+
+/**
+ * @brief The connections, the first one is the primary connection.
+ */
+static Connection_t xConnections[ connmgrMAX_CONNECTIONS ];
+
+/**
+ * @brief Number of connections added by ConnectionManager_Init().
+ */
+static size_t uxConnectionCount = 0U;
+
+/**
+ * @brief State reported to the listeners.
+ */
+static ConnectionState_t xState = CONNECTION_STATE_DISCONNECTED;
+
+/**
+ * @brief Listeners of the state changes.
+ */
+static ConnectionStateCallback_t xListeners[ connmgrMAX_LISTENERS ];
+
+/**
+ * @brief Mirrors the state for ConnectionManager_WaitForConnection().
+ */
+static EventGroupHandle_t xStateEvents = NULL;
+static StaticEventGroup_t xStateEventsBuffer;
+
+/**
+ * @brief Subscriptions of ConnectionManager_Subscribe(), in the order they were added. Only appended to,
+ * so the list can be walked without a lock.
+ */
+static ConnectionSubscription_t * pxSubscriptions = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Finds the connection of an MQTT context from its network context.
+ *
+ * @return The connection, NULL if the transport of the context is not set by the manager.
+ */
+static Connection_t * prvFindConnection( const MQTTContext_t * pMQTTContext )
+{
+    Connection_t * pxConnection = NULL;
+    size_t i;
+
+    for( i = 0; ( i < uxConnectionCount ) && ( pxConnection == NULL ); i++ )
+    {
+        if( pMQTTContext->transportInterface.pNetworkContext == &xConnections[ i ].xNetworkContext )
+        {
+            pxConnection = &xConnections[ i ];
+        }
+    }
+
+    return pxConnection;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscribeCallback( struct MQTTOperation * pOperation,
+                                  MQTTStatus_t status )
+{
+    ConnectionSubscription_t * pxSubscription = ( ConnectionSubscription_t * ) pOperation;
+
+    if( status != MQTTSuccess )
+    {
+        PRINTF( "Subscribe to %.*s failed, error = %d.\r\n",
+                ( int ) pxSubscription->info.topicFilterLength, pxSubscription->info.pTopicFilter, status );
+    }
+
+    if( pxSubscription->subscribedCallback != NULL )
+    {
+        pxSubscription->subscribedCallback( pxSubscription->pContext, status );
+    }
+
+    pxSubscription->pending = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Queues the subscribe operation of a subscription without blocking, so it can be called from
+ * the agent task.
+ */
+static BaseType_t prvSendSubscribe( ConnectionSubscription_t * pxSubscription )
+{
+    BaseType_t xResult = pdFALSE;
+
+    taskENTER_CRITICAL();
+    {
+        if( pxSubscription->pending == pdFALSE )
+        {
+            pxSubscription->pending = pdTRUE;
+            xResult = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xResult == pdTRUE )
+    {
+        memset( &pxSubscription->operation, 0x00, sizeof( pxSubscription->operation ) );
+        pxSubscription->operation.type = MQTT_OP_SUBSCRIBE;
+        pxSubscription->operation.info.subscriptionInfo.pSubscriptionList = &pxSubscription->info;
+        pxSubscription->operation.info.subscriptionInfo.numSubscriptions = 1;
+        pxSubscription->operation.callback = prvSubscribeCallback;
+        pxSubscription->operation.priority = MQTT_AGENT_PRIORITY_CONTROL;
+
+        if( MQTTAgent_Enqueue( NULL, &pxSubscription->operation, 0 ) != pdTRUE )
+        {
+            pxSubscription->pending = pdFALSE;
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCallback( struct MQTTOperation * pOperation,
+                                MQTTStatus_t status )
+{
+    ConnectionPublish_t * pxPublish = ( ConnectionPublish_t * ) pOperation;
+
+    /* Released first, so that the callback can queue the next publish. */
+    pxPublish->pending = pdFALSE;
+
+    if( pxPublish->publishedCallback != NULL )
+    {
+        pxPublish->publishedCallback( pxPublish->pContext, status );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Updates the state and notifies the listeners if it changed.
+ */
+static void prvSetState( ConnectionState_t xNewState,
+                         bool bSessionPresent )
+{
+    ConnectionStateCallback_t xCallbacks[ connmgrMAX_LISTENERS ];
+    ConnectionSubscription_t * pxSubscription;
+    size_t i;
+
+    if( xNewState != xState )
+    {
+        xState = xNewState;
+
+        if( xNewState == CONNECTION_STATE_CONNECTED )
+        {
+            ( void ) xEventGroupSetBits( xStateEvents, connmgrCONNECTED_BIT );
+        }
+        else
+        {
+            ( void ) xEventGroupClearBits( xStateEvents, connmgrCONNECTED_BIT );
+        }
+
+        /* Subscribed again before the listeners send anything on the new session. */
+        if( ( xNewState == CONNECTION_STATE_CONNECTED ) && ( bSessionPresent == false ) )
+        {
+            for( pxSubscription = pxSubscriptions; pxSubscription != NULL; pxSubscription = pxSubscription->pNext )
+            {
+                if( prvSendSubscribe( pxSubscription ) != pdTRUE )
+                {
+                    PRINTF( "Subscribe to %.*s not queued.\r\n",
+                            ( int ) pxSubscription->info.topicFilterLength, pxSubscription->info.pTopicFilter );
+                }
+            }
+        }
+
+        taskENTER_CRITICAL();
+        {
+            for( i = 0; i < connmgrMAX_LISTENERS; i++ )
+            {
+                xCallbacks[ i ] = xListeners[ i ];
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        for( i = 0; i < connmgrMAX_LISTENERS; i++ )
+        {
+            if( xCallbacks[ i ] != NULL )
+            {
+                xCallbacks[ i ]( xNewState, bSessionPresent );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Wakes up the MQTT agent when the socket receives data.
+ */
+static void prvSocketWakeupCallback( Socket_t xSocket )
+{
+    size_t i;
+
+    for( i = 0; i < uxConnectionCount; i++ )
+    {
+        if( ( xConnections[ i ].xNetworkContext.tcpSocket == xSocket ) &&
+            ( xConnections[ i ].pMQTTContext != NULL ) )
+        {
+            MQTTAgent_Wakeup( MQTTAgent_GetHandle( xConnections[ i ].pMQTTContext ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void ConnectionManager_Init( const ConnectionManagerConfig_t * pConfig,
+                             TransportInterface_t * pTransport )
+{
+    Connection_t * pxConnection;
+
+    configASSERT( pConfig != NULL );
+    configASSERT( pTransport != NULL );
+    configASSERT( uxConnectionCount < connmgrMAX_CONNECTIONS );
+
+    pxConnection = &xConnections[ uxConnectionCount ];
+    pxConnection->pxConfig = pConfig;
+    uxConnectionCount++;
+
+    if( xStateEvents == NULL )
+    {
+        xStateEvents = xEventGroupCreateStatic( &xStateEventsBuffer );
+    }
+
+    pTransport->pNetworkContext = &pxConnection->xNetworkContext;
+    pTransport->send = TLS_FreeRTOS_send;
+    pTransport->recv = TLS_FreeRTOS_recv;
+    pTransport->flush = TLS_FreeRTOS_flush;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_Connect( MQTTContext_t * pMQTTContext,
+                                      bool * pSessionPresent )
+{
+    BaseType_t xStatus = pdFALSE;
+    TlsTransportStatus_t xTransportStatus;
+    MQTTStatus_t xMQTTStatus;
+    Connection_t * pxConnection = prvFindConnection( pMQTTContext );
+    const ConnectionManagerConfig_t * pxConfig;
+    BaseType_t xPrimary;
+
+    configASSERT( pxConnection != NULL );
+
+    pxConfig = pxConnection->pxConfig;
+    pxConnection->pMQTTContext = pMQTTContext;
+    xPrimary = ( pxConnection == &xConnections[ 0 ] ) ? pdTRUE : pdFALSE;
+
+    if( xPrimary == pdTRUE )
+    {
+        prvSetState( CONNECTION_STATE_DISCONNECTED, false );
+    }
+
+    if( pxConnection->xTransportConnected == pdTRUE )
+    {
+        TLS_FreeRTOS_Disconnect( &pxConnection->xNetworkContext );
+        pxConnection->xTransportConnected = pdFALSE;
+    }
+
+    PRINTF( "Connecting to %s:%u.\r\n", pxConfig->pHostName, ( unsigned ) pxConfig->port );
+
+    /* The handshake is bound by the public key operations, run it at full speed, without the
+     * background flash jobs. */
+    ClockScaling_Boost();
+    FlashService_Pause();
+    xTransportStatus = TLS_FreeRTOS_Connect( &pxConnection->xNetworkContext,
+                                             pxConfig->pHostName,
+                                             pxConfig->port,
+                                             pxConfig->pCredentials,
+                                             pxConfig->handshakeTimeoutMs,
+                                             pxConfig->sendTimeoutMs );
+    FlashService_Resume();
+    ClockScaling_Release();
+
+    if( xTransportStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        pxConnection->xTransportConnected = pdTRUE;
+
+        if( xPrimary == pdTRUE )
+        {
+            boot_timing_mark( BOOT_PHASE_TLS_CONNECTED );
+        }
+
+        xMQTTStatus = MQTT_Connect( pMQTTContext,
+                                    pxConfig->pConnectInfo,
+                                    NULL,
+                                    pxConfig->connackTimeoutMs,
+                                    pSessionPresent );
+
+        TLS_FreeRTOS_SetRecvTimeout( &pxConnection->xNetworkContext, pxConfig->recvTimeoutMs );
+
+        if( xMQTTStatus == MQTTSuccess )
+        {
+            if( xPrimary == pdTRUE )
+            {
+                boot_timing_mark( BOOT_PHASE_MQTT_CONNECTED );
+            }
+
+            TLS_FreeRTOS_SetWakeupCallback( &pxConnection->xNetworkContext, prvSocketWakeupCallback );
+            xStatus = pdTRUE;
+        }
+        else
+        {
+            PRINTF( "MQTT connect failed, error = %d.\r\n", ( int ) xMQTTStatus );
+        }
+    }
+    else
+    {
+        PRINTF( "TLS connect failed, status = %d.\r\n", ( int ) xTransportStatus );
+    }
+
+    if( ( xStatus == pdTRUE ) && ( xPrimary == pdTRUE ) )
+    {
+        prvSetState( CONNECTION_STATE_CONNECTED, *pSessionPresent );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_Start( MQTTContext_t * pMQTTContext,
+                                    bool * pSessionPresent )
+{
+    RetryUtilsParams_t xRetryParams;
+    MQTTAgentHandle_t xAgent;
+
+    RetryUtils_ParamsReset( &xRetryParams );
+    xRetryParams.maxRetryAttempts = MAX_RETRY_ATTEMPTS;
+
+    while( ConnectionManager_Connect( pMQTTContext, pSessionPresent ) != pdTRUE )
+    {
+        if( RetryUtils_BackoffAndSleep( &xRetryParams ) == RetryUtilsRetriesExhausted )
+        {
+            /* Keep trying with the maximum back off. */
+            xRetryParams.attemptsDone = 0;
+        }
+    }
+
+    xAgent = MQTTAgent_GetHandle( pMQTTContext );
+    configASSERT( xAgent != NULL );
+
+    MQTTAgent_SetDataPendingCallback( xAgent, TLS_FreeRTOS_HasPendingData );
+    MQTTAgent_SetReconnectCallback( xAgent, ConnectionManager_Connect );
+
+    return MQTTAgent_Init( pMQTTContext );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_AddListener( ConnectionStateCallback_t callback )
+{
+    BaseType_t xResult = pdFALSE;
+    size_t i;
+
+    configASSERT( callback != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        for( i = 0; ( i < connmgrMAX_LISTENERS ) && ( xResult == pdFALSE ); i++ )
+        {
+            if( xListeners[ i ] == NULL )
+            {
+                xListeners[ i ] = callback;
+                xResult = pdTRUE;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+ConnectionState_t ConnectionManager_GetState( void )
+{
+    return xState;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_WaitForConnection( TickType_t xTicksToWait )
+{
+    EventBits_t xBits;
+
+    configASSERT( xStateEvents != NULL );
+
+    xBits = xEventGroupWaitBits( xStateEvents, connmgrCONNECTED_BIT, pdFALSE, pdTRUE, xTicksToWait );
+
+    return ( ( xBits & connmgrCONNECTED_BIT ) != 0U ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_Subscribe( ConnectionSubscription_t * pSubscription,
+                                        const char * pTopicFilter,
+                                        uint16_t topicFilterLength,
+                                        MQTTQoS_t qos,
+                                        MQTTAgentIncomingPublishCallback_t incomingCallback,
+                                        ConnectionSubscribedCallback_t subscribedCallback,
+                                        void * pContext )
+{
+    ConnectionSubscription_t ** ppxLast;
+
+    configASSERT( ( pSubscription != NULL ) && ( incomingCallback != NULL ) );
+
+    if( MQTTAgent_RegisterSubscription( NULL, pTopicFilter, topicFilterLength, incomingCallback, pContext ) != pdTRUE )
+    {
+        return pdFALSE;
+    }
+
+    memset( pSubscription, 0x00, sizeof( *pSubscription ) );
+    pSubscription->info.qos = qos;
+    pSubscription->info.pTopicFilter = pTopicFilter;
+    pSubscription->info.topicFilterLength = topicFilterLength;
+    pSubscription->subscribedCallback = subscribedCallback;
+    pSubscription->pContext = pContext;
+
+    taskENTER_CRITICAL();
+    {
+        ppxLast = &pxSubscriptions;
+
+        while( *ppxLast != NULL )
+        {
+            ppxLast = &( ( *ppxLast )->pNext );
+        }
+
+        *ppxLast = pSubscription;
+    }
+    taskEXIT_CRITICAL();
+
+    return prvSendSubscribe( pSubscription );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_Publish( ConnectionPublish_t * pPublish,
+                                      const char * pTopicName,
+                                      uint16_t topicNameLength,
+                                      MQTTQoS_t qos,
+                                      const void * pPayload,
+                                      size_t payloadLength,
+                                      ConnectionPublishedCallback_t publishedCallback,
+                                      void * pContext,
+                                      TickType_t xTicksToWait )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pPublish != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( pPublish->pending == pdFALSE )
+        {
+            pPublish->pending = pdTRUE;
+            xResult = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xResult == pdTRUE )
+    {
+        memset( &pPublish->info, 0x00, sizeof( pPublish->info ) );
+        pPublish->info.qos = qos;
+        pPublish->info.pTopicName = pTopicName;
+        pPublish->info.topicNameLength = topicNameLength;
+        pPublish->info.pPayload = pPayload;
+        pPublish->info.payloadLength = payloadLength;
+        pPublish->publishedCallback = publishedCallback;
+        pPublish->pContext = pContext;
+
+        memset( &pPublish->operation, 0x00, sizeof( pPublish->operation ) );
+        pPublish->operation.type = MQTT_OP_PUBLISH;
+        pPublish->operation.info.pPublishInfo = &pPublish->info;
+        pPublish->operation.callback = prvPublishCallback;
+        pPublish->operation.priority = MQTT_AGENT_PRIORITY_BULK;
+
+        if( MQTTAgent_Enqueue( NULL, &pPublish->operation, xTicksToWait ) != pdTRUE )
+        {
+            pPublish->pending = pdFALSE;
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConnectionManager_PublishPending( const ConnectionPublish_t * pPublish )
+{
+    return pPublish->pending;
+}
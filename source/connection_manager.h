@@ -0,0 +1,265 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file connection_manager.h
+ * @brief Owner of the TLS connection to the MQTT broker, shared by the MQTT agent, OTA and the application.
+ * The manager connects with backoff until the broker accepts the first connection, then reconnects on
+ * behalf of the MQTT agent, which keeps its task and queue across reconnects.
+ * Each ConnectionManager_Init() adds a connection, served by its own MQTT agent instance. The first one is
+ * the primary connection, the only one reported by the connection state, the listeners and the boot timing.
+ */
+
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "tls_freertos_pkcs11.h"
+
+/**
+ * @brief Maximum number of connection state listeners.
+ */
+#ifndef connmgrMAX_LISTENERS
+    #define connmgrMAX_LISTENERS    ( 8 )
+#endif
+
+/**
+ * @brief Maximum number of connections, one MQTT agent instance each.
+ */
+#ifndef connmgrMAX_CONNECTIONS
+    #define connmgrMAX_CONNECTIONS    MQTT_AGENT_MAX_INSTANCES
+#endif
+
+/**
+ * @brief State of the connection to the broker.
+ */
+typedef enum ConnectionState
+{
+    CONNECTION_STATE_DISCONNECTED = 0, /**< No MQTT connection, the manager connects or reconnects. */
+    CONNECTION_STATE_CONNECTED         /**< The broker accepted the MQTT connection. */
+} ConnectionState_t;
+
+/**
+ * @brief Called on each change of the connection state, from the task connecting, which is the MQTT
+ * agent task for reconnects. Must not block nor call the blocking MQTT agent APIs.
+ *
+ * @param[in] state The new state.
+ * @param[in] sessionPresent For CONNECTION_STATE_CONNECTED, true if the broker resumed the session,
+ * false if the subscriptions are lost.
+ */
+typedef void ( * ConnectionStateCallback_t )( ConnectionState_t state,
+                                              bool sessionPresent );
+
+/**
+ * @brief Called with the result of each subscribe sent for a ConnectionManager_Subscribe() subscription,
+ * from the MQTT agent task. Must not block nor call the blocking MQTT agent APIs.
+ *
+ * @param[in] pContext The context given to ConnectionManager_Subscribe().
+ * @param[in] status MQTTSuccess once the broker accepted the subscribe.
+ */
+typedef void ( * ConnectionSubscribedCallback_t )( void * pContext,
+                                                   MQTTStatus_t status );
+
+/**
+ * @brief Subscription kept by the manager and sent again when the broker does not resume the session.
+ * The storage is provided by the caller, the fields are set by ConnectionManager_Subscribe().
+ */
+typedef struct ConnectionSubscription
+{
+    MQTTOperation_t operation;                         /**< Subscribe operation, first so that its completion finds the subscription. */
+    MQTTSubscribeInfo_t info;                          /**< Topic filter and QoS. */
+    ConnectionSubscribedCallback_t subscribedCallback; /**< Optional callback of the subscribe results. */
+    void * pContext;                                   /**< Context of the callbacks. */
+    volatile BaseType_t pending;                       /**< Set while the subscribe operation is owned by the agent. */
+    struct ConnectionSubscription * pNext;             /**< Next subscription of the manager. */
+} ConnectionSubscription_t;
+
+/**
+ * @brief Called with the result of a ConnectionManager_Publish() publish, from the MQTT agent task, once the
+ * publish is no longer owned by the agent. Must not block nor call the blocking MQTT agent APIs, it may queue
+ * the next publish.
+ *
+ * @param[in] pContext The context given to ConnectionManager_Publish().
+ * @param[in] status MQTTSuccess once the publish is sent, or acknowledged for QoS1.
+ */
+typedef void ( * ConnectionPublishedCallback_t )( void * pContext,
+                                                  MQTTStatus_t status );
+
+/**
+ * @brief Publish of a module that sends one at a time from static buffers, larger than an arena slab.
+ * The storage is provided by the caller, the fields are set by ConnectionManager_Publish().
+ */
+typedef struct ConnectionPublish
+{
+    MQTTOperation_t operation;                       /**< Publish operation, first so that its completion finds the publish. */
+    MQTTPublishInfo_t info;                          /**< Topic, payload and QoS. */
+    ConnectionPublishedCallback_t publishedCallback; /**< Optional callback of the publish result. */
+    void * pContext;                                 /**< Context of the callback. */
+    volatile BaseType_t pending;                     /**< Set while the publish operation is owned by the agent. */
+} ConnectionPublish_t;
+
+/**
+ * @brief Server and timeouts of the connection, must stay valid while the manager is used.
+ */
+typedef struct ConnectionManagerConfig
+{
+    const char * pHostName;                    /**< Broker endpoint. */
+    uint16_t port;                             /**< Broker port. */
+    const NetworkCredentials_t * pCredentials; /**< TLS credentials. */
+    const MQTTConnectInfo_t * pConnectInfo;    /**< MQTT CONNECT parameters. */
+    uint32_t handshakeTimeoutMs;               /**< Transport receive timeout during the TLS handshake. */
+    uint32_t sendTimeoutMs;                    /**< Transport send timeout. */
+    uint32_t recvTimeoutMs;                    /**< Transport receive timeout once connected. */
+    uint32_t connackTimeoutMs;                 /**< Time to wait for the CONNACK. */
+} ConnectionManagerConfig_t;
+
+/**
+ * @brief Adds a connection: sets its parameters and the transport of the MQTT context to a network
+ * context owned by the manager. To be called before MQTT_Init(), at most connmgrMAX_CONNECTIONS times.
+ *
+ * @param[in] pConfig The connection parameters, kept by reference.
+ * @param[out] pTransport The transport interface to pass to MQTT_Init().
+ */
+void ConnectionManager_Init( const ConnectionManagerConfig_t * pConfig,
+                             TransportInterface_t * pTransport );
+
+/**
+ * @brief Connects with backoff until the broker accepts the connection, then starts the MQTT agent
+ * instance bound to the context with the manager as its reconnect callback.
+ *
+ * @param[in] pMQTTContext The initialized MQTT context, its transport set by ConnectionManager_Init().
+ * @param[out] pSessionPresent Set to true if the broker resumed the session.
+ *
+ * @return pdTRUE once the agent runs, pdFALSE if the agent could not be started.
+ */
+BaseType_t ConnectionManager_Start( MQTTContext_t * pMQTTContext,
+                                    bool * pSessionPresent );
+
+/**
+ * @brief Makes one attempt to connect to the broker, closing the previous connection first.
+ * This is the MQTTAgentReconnectCallback_t of the agent, the agent provides the backoff.
+ *
+ * @param[in] pMQTTContext The MQTT context.
+ * @param[out] pSessionPresent Set to true if the broker resumed the session.
+ *
+ * @return pdTRUE if the MQTT connection is established.
+ */
+BaseType_t ConnectionManager_Connect( MQTTContext_t * pMQTTContext,
+                                      bool * pSessionPresent );
+
+/**
+ * @brief Registers a callback for the changes of the state of the primary connection.
+ *
+ * @param[in] callback The callback.
+ *
+ * @return pdTRUE if registered, pdFALSE if connmgrMAX_LISTENERS are already registered.
+ */
+BaseType_t ConnectionManager_AddListener( ConnectionStateCallback_t callback );
+
+/**
+ * @brief Gets the current state of the primary connection.
+ *
+ * @return The state.
+ */
+ConnectionState_t ConnectionManager_GetState( void );
+
+/**
+ * @brief Waits for the primary connection to the broker to be established.
+ *
+ * @param[in] xTicksToWait Time to wait.
+ *
+ * @return pdTRUE if connected.
+ */
+BaseType_t ConnectionManager_WaitForConnection( TickType_t xTicksToWait );
+
+/**
+ * @brief Registers the incoming publish callback of a topic filter with the agent of the primary connection
+ * and subscribes to the filter. The subscribe is queued without blocking, so this can be called from the
+ * agent task, and is sent again each time the primary connection is established without its session.
+ * A subscribe still owned by the agent is not sent twice.
+ *
+ * @param[out] pSubscription Storage of the subscription, kept for the lifetime of the manager.
+ * @param[in] pTopicFilter The topic filter, not copied.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] qos Maximum QoS of the publishes received.
+ * @param[in] incomingCallback Callback of the publishes matching the filter.
+ * @param[in] subscribedCallback Callback of the subscribe results, may be NULL.
+ * @param[in] pContext Context passed to both callbacks.
+ *
+ * @return pdTRUE if the subscribe is queued. pdFALSE if the callback could not be registered, or if the
+ * subscribe could not be queued, in which case it is sent with the next session.
+ */
+BaseType_t ConnectionManager_Subscribe( ConnectionSubscription_t * pSubscription,
+                                        const char * pTopicFilter,
+                                        uint16_t topicFilterLength,
+                                        MQTTQoS_t qos,
+                                        MQTTAgentIncomingPublishCallback_t incomingCallback,
+                                        ConnectionSubscribedCallback_t subscribedCallback,
+                                        void * pContext );
+
+/**
+ * @brief Queues a publish on the bulk lane of the agent of the primary connection, unless the previous
+ * publish of the same storage is still owned by the agent. The topic and the payload are not copied and
+ * must not change until ConnectionManager_PublishPending() returns pdFALSE.
+ *
+ * @param[in] pPublish Storage of the publish, kept until it is no longer pending.
+ * @param[in] pTopicName The topic, not copied.
+ * @param[in] topicNameLength Length of the topic.
+ * @param[in] qos QoS of the publish.
+ * @param[in] pPayload The payload, not copied.
+ * @param[in] payloadLength Length of the payload.
+ * @param[in] publishedCallback Callback of the publish result, may be NULL.
+ * @param[in] pContext Context passed to the callback.
+ * @param[in] xTicksToWait Time to wait for room in the agent queue, 0 from the agent task.
+ *
+ * @return pdTRUE if the publish is queued. pdFALSE if the previous publish is still pending, or if the
+ * publish could not be queued, in which case the storage is free again.
+ */
+BaseType_t ConnectionManager_Publish( ConnectionPublish_t * pPublish,
+                                      const char * pTopicName,
+                                      uint16_t topicNameLength,
+                                      MQTTQoS_t qos,
+                                      const void * pPayload,
+                                      size_t payloadLength,
+                                      ConnectionPublishedCallback_t publishedCallback,
+                                      void * pContext,
+                                      TickType_t xTicksToWait );
+
+/**
+ * @brief Checks if a ConnectionManager_Publish() publish is still owned by the agent.
+ *
+ * @param[in] pPublish Storage of the publish.
+ *
+ * @return pdTRUE while the topic and the payload must not change.
+ */
+BaseType_t ConnectionManager_PublishPending( const ConnectionPublish_t * pPublish );
+
+#endif /* ifndef CONNECTION_MANAGER_H */
@@ -0,0 +1,586 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file console_shell.c
+ * @brief Command shell on the debug console.
+ * The receive FIFO of the debug UART is polled, as by the reprovisioning window, so that the shell
+ * never blocks in the serial manager and the characters wait in the FIFO between two polls. Each
+ * command prints through PRINTF from the shell task, the modules keep their statistics as before.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_debug_console.h"
+#include "board.h"
+#include "fsl_enet.h"
+
+#include "core_mqtt_agent.h"
+#include "ota_update.h"
+#include "log_level.h"
+#include "task_stats.h"
+#include "heap_monitor.h"
+#include "heap_regions.h"
+#include "latency_probe.h"
+#include "irq_latency.h"
+#include "iperf.h"
+#include "time_sync.h"
+
+#include "console_shell.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Delay before the shell reads the console. The reprovisioning window of the provisioning
+ * interface reads it for provisionREPROVISION_WINDOW_MS after boot, 5 s by default.
+ */
+#ifndef consoleshellSTART_DELAY_MS
+    #define consoleshellSTART_DELAY_MS    ( 5000U )
+#endif
+
+/**
+ * @brief Period at which the receive FIFO is polled. The 16 entries of the FIFO hold about 1.4 ms of
+ * input at 115200 bit/s, so a pasted line longer than that loses characters, typed ones do not.
+ */
+#ifndef consoleshellPOLL_PERIOD_MS
+    #define consoleshellPOLL_PERIOD_MS    ( 20U )
+#endif
+
+/**
+ * @brief Window of the "tasks" command without an argument.
+ */
+#ifndef consoleshellTASKS_WINDOW_MS
+    #define consoleshellTASKS_WINDOW_MS    ( 1000U )
+#endif
+
+/**
+ * @brief Longest command line, the characters beyond it are dropped.
+ */
+#define consoleshellLINE_MAX_SIZE         ( 80U )
+
+/**
+ * @brief Priority of the shell task, just above idle as the commands are only diagnostics.
+ */
+#ifndef consoleshellTASK_PRIORITY
+    #define consoleshellTASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Stack size of the shell task, in words, PRINTF needs most of it.
+ */
+#ifndef consoleshellTASK_STACK_SIZE
+    #define consoleshellTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A command of the shell.
+ */
+typedef struct ConsoleShellCommand
+{
+    const char * pcName;                    /**< First word of the line. */
+    const char * pcUsage;                   /**< Arguments printed by "help". */
+    const char * pcHelp;                    /**< Summary printed by "help". */
+    void ( * pxHandler )( char * pcArgs ); /**< Called with the rest of the line, "" without arguments. */
+} ConsoleShellCommand_t;
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandHelp( char * pcArgs );
+static void prvCommandAgent( char * pcArgs );
+static void prvCommandHeap( char * pcArgs );
+static void prvCommandEnet( char * pcArgs );
+static void prvCommandTime( char * pcArgs );
+static void prvCommandLog( char * pcArgs );
+static void prvCommandInterval( char * pcArgs );
+
+#if ( OTA_UPDATE_ENABLED == 1 )
+    static void prvCommandOta( char * pcArgs );
+#endif
+
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+    static void prvCommandTasks( char * pcArgs );
+#endif
+
+#if ( latencyprobeENABLED == 1 )
+    static void prvCommandProbes( char * pcArgs );
+#endif
+
+#if ( irqlatencyENABLED == 1 )
+    static void prvCommandIrq( char * pcArgs );
+#endif
+
+#if ( iperfENABLED == 1 )
+    static void prvCommandIperf( char * pcArgs );
+#endif
+
+/*-----------------------------------------------------------*/
+
+static const ConsoleShellCommand_t xCommands[] =
+{
+    { "help",     "",                       "List the commands.",               prvCommandHelp     },
+    { "agent",    "",                       "MQTT agent statistics.",           prvCommandAgent    },
+    #if ( OTA_UPDATE_ENABLED == 1 )
+        { "ota",      "",                       "OTA statistics.",                  prvCommandOta      },
+    #endif
+    { "heap",     "",                       "Heap statistics.",                 prvCommandHeap     },
+    #if ( configGENERATE_RUN_TIME_STATS == 1 )
+        { "tasks",    "[ms]",                   "CPU load and stack of each task.", prvCommandTasks    },
+    #endif
+    { "enet",     "[reset]",                "ENET driver statistics.",          prvCommandEnet     },
+    #if ( latencyprobeENABLED == 1 )
+        { "probes",   "[reset]",                "Latency probes.",                  prvCommandProbes   },
+    #endif
+    #if ( irqlatencyENABLED == 1 )
+        { "irq",      "[reset]",                "Interrupt masking and latency.",   prvCommandIrq      },
+    #endif
+    #if ( iperfENABLED == 1 )
+        { "iperf",    "<options>|stop",         "Network throughput test.",         prvCommandIperf    },
+    #endif
+    { "time",     "",                       "UTC time and SNTP state.",         prvCommandTime     },
+    { "log",      "[<module>=<level>,...]", "Print or set the log levels.",     prvCommandLog      },
+    { "interval", "<tasks|heap|ota> <ms>",  "Set a statistics interval.",       prvCommandInterval }
+};
+
+/**
+ * @brief Names of the operation types with agent statistics, indexed by MQTTOperationType_t.
+ */
+static const char * const pcOperationNames[ MQTT_AGENT_STATS_OPERATION_TYPES ] =
+{
+    "publish",
+    "subscribe",
+    "unsubscribe",
+    "publish_batch"
+};
+
+/**
+ * @brief Line being typed.
+ */
+static char cLine[ consoleshellLINE_MAX_SIZE ];
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandHelp( char * pcArgs )
+{
+    size_t i;
+
+    ( void ) pcArgs;
+
+    for( i = 0; i < ( sizeof( xCommands ) / sizeof( xCommands[ 0 ] ) ); i++ )
+    {
+        /* Without PRINTF_ADVANCED_ENABLE, PRINTF does not pad the fields. */
+        PRINTF( "%s%s%s  %s\r\n", xCommands[ i ].pcName, ( xCommands[ i ].pcUsage[ 0 ] != '\0' ) ? " " : "",
+                xCommands[ i ].pcUsage, xCommands[ i ].pcHelp );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandAgent( char * pcArgs )
+{
+    /* Static as it is large for the task stack. */
+    static MQTTAgentStats_t xStats;
+    const MQTTAgentOperationStats_t * pxOpStats;
+    uint32_t ulType;
+    uint32_t ulBucket;
+
+    ( void ) pcArgs;
+
+    MQTTAgent_GetStats( NULL, &xStats );
+
+    PRINTF( "Agent: queue %u (max %u), pending ACKs %u (max %u), refused %lu, rx pauses %lu, worker fallbacks %lu, superseded %lu.\r\n",
+            ( unsigned ) xStats.queueDepth, ( unsigned ) xStats.maxQueueDepth,
+            ( unsigned ) xStats.pendingAcks, ( unsigned ) xStats.maxPendingAcks,
+            ( unsigned long ) xStats.refused, ( unsigned long ) xStats.receivePauses,
+            ( unsigned long ) xStats.workerFallbacks, ( unsigned long ) xStats.superseded );
+    PRINTF( "AGENT,op,enq,ok,fail,max_queue_ms,max_ack_ms,ack<10,<20,<50,<100,<200,<500,<1000,>=1000\r\n" );
+
+    for( ulType = 0; ulType < MQTT_AGENT_STATS_OPERATION_TYPES; ulType++ )
+    {
+        pxOpStats = &xStats.operations[ ulType ];
+
+        PRINTF( "AGENT,%s,%lu,%lu,%lu,%lu,%lu", pcOperationNames[ ulType ],
+                ( unsigned long ) pxOpStats->enqueued, ( unsigned long ) pxOpStats->completed,
+                ( unsigned long ) pxOpStats->failed, ( unsigned long ) pxOpStats->maxQueueTimeMs,
+                ( unsigned long ) pxOpStats->maxAckTimeMs );
+
+        for( ulBucket = 0; ulBucket < MQTT_AGENT_STATS_HISTOGRAM_BUCKETS; ulBucket++ )
+        {
+            PRINTF( ",%lu", ( unsigned long ) pxOpStats->ackTimeHistogram[ ulBucket ] );
+        }
+
+        PRINTF( "\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( OTA_UPDATE_ENABLED == 1 )
+
+    static void prvCommandOta( char * pcArgs )
+    {
+        ( void ) pcArgs;
+
+        vOTAPrintStatistics();
+    }
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandHeap( char * pcArgs )
+{
+    ( void ) pcArgs;
+
+    HeapMonitor_Dump();
+
+    #if ( configFRTOS_MEMORY_SCHEME == 5 )
+        HeapRegions_Print();
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+
+    static void prvCommandTasks( char * pcArgs )
+    {
+        uint32_t ulWindowMs = consoleshellTASKS_WINDOW_MS;
+
+        if( *pcArgs != '\0' )
+        {
+            ulWindowMs = ( uint32_t ) strtoul( pcArgs, NULL, 10 );
+        }
+
+        TaskStats_Print( ulWindowMs );
+    }
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandEnet( char * pcArgs )
+{
+    /* Static as it is large for the task stack. */
+    static enet_stats_t xStats;
+    enet_handle_t * pxHandle = ENET_GetHandle( ENET );
+    const enet_channel_stats_t * pxChannel;
+    uint32_t ulChannel;
+
+    if( pxHandle == NULL )
+    {
+        PRINTF( "ENET not initialised.\r\n" );
+        return;
+    }
+
+    if( strcmp( pcArgs, "reset" ) == 0 )
+    {
+        ENET_ResetStatistics( pxHandle );
+        return;
+    }
+
+    ENET_GetStatistics( pxHandle, &xStats );
+
+    PRINTF( "ENET: %lu interrupts, %lu cycles in the handler.\r\n",
+            ( unsigned long ) xStats.irqCount, ( unsigned long ) xStats.irqCycles );
+    PRINTF( "ENET,ch,rx,rx_bytes,crc,overflow,rx_err,length,checksum,bcast_drop,filter_drop,rbu,tx,tx_bytes,tx_busy,tx_reclaim,irq\r\n" );
+
+    for( ulChannel = 0; ulChannel < ENET_RING_NUM_MAX; ulChannel++ )
+    {
+        pxChannel = &xStats.channel[ ulChannel ];
+
+        PRINTF( "ENET,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n", ( unsigned long ) ulChannel,
+                ( unsigned long ) pxChannel->rxFrames, ( unsigned long ) pxChannel->rxBytes,
+                ( unsigned long ) pxChannel->rxCrcErrors, ( unsigned long ) pxChannel->rxOverflowErrors,
+                ( unsigned long ) pxChannel->rxReceiveErrors, ( unsigned long ) pxChannel->rxLengthErrors,
+                ( unsigned long ) pxChannel->rxChecksumErrors, ( unsigned long ) pxChannel->rxBroadcastDrops,
+                ( unsigned long ) pxChannel->rxFilterDrops, ( unsigned long ) pxChannel->rxBuffUnavailable,
+                ( unsigned long ) pxChannel->txFrames, ( unsigned long ) pxChannel->txBytes,
+                ( unsigned long ) pxChannel->txBusyRejects, ( unsigned long ) pxChannel->txReclaims,
+                ( unsigned long ) pxChannel->irqCount );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandTime( char * pcArgs )
+{
+    TimeSyncStatus_t xStatus;
+    uint64_t ullUtcMs;
+
+    ( void ) pcArgs;
+
+    TimeSync_GetStatus( &xStatus );
+
+    /* PRINTF has no 64 bit conversions, the time is printed as seconds and milliseconds. */
+    if( TimeSync_GetUtcMs( &ullUtcMs ) == pdTRUE )
+    {
+        PRINTF( "UTC: %lu s %u ms since 1970, last sync %lu ms ago.\r\n", ( unsigned long ) ( ullUtcMs / 1000U ),
+                ( unsigned ) ( ullUtcMs % 1000U ), ( unsigned long ) xStatus.ulLastSyncAgeMs );
+    }
+    else
+    {
+        PRINTF( "UTC: not synchronized.\r\n" );
+    }
+
+    PRINTF( "SNTP: %lu polls, %lu failed, %lu steps, round trip %lu us, error %ld us, frequency %ld ppb.\r\n",
+            ( unsigned long ) xStatus.ulPolls, ( unsigned long ) xStatus.ulFailedPolls,
+            ( unsigned long ) xStatus.ulSteps, ( unsigned long ) xStatus.ulRoundTripUs,
+            ( long ) xStatus.lLastErrorUs, ( long ) xStatus.lFrequencyPpb );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( latencyprobeENABLED == 1 )
+
+    static void prvCommandProbes( char * pcArgs )
+    {
+        if( strcmp( pcArgs, "reset" ) == 0 )
+        {
+            LatencyProbe_Reset();
+        }
+        else
+        {
+            LatencyProbe_Dump();
+        }
+    }
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if ( irqlatencyENABLED == 1 )
+
+    static void prvCommandIrq( char * pcArgs )
+    {
+        if( strcmp( pcArgs, "reset" ) == 0 )
+        {
+            IrqLatency_Reset();
+        }
+        else
+        {
+            IrqLatency_Print();
+        }
+    }
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if ( iperfENABLED == 1 )
+
+    static void prvCommandIperf( char * pcArgs )
+    {
+        IperfTest_t xTest;
+
+        if( strcmp( pcArgs, "stop" ) == 0 )
+        {
+            Iperf_Stop();
+        }
+        else if( Iperf_ParseArgs( pcArgs, &xTest ) != pdTRUE )
+        {
+            PRINTF( "Usage: iperf [-u|--tls] -s|-c <host> [-p <port>] [-t <s>] [-b <kbit/s>] [-l <bytes>]\r\n" );
+        }
+        else if( Iperf_Start( &xTest ) != pdTRUE )
+        {
+            PRINTF( "A test is running, \"iperf stop\" ends it.\r\n" );
+        }
+    }
+
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandLog( char * pcArgs )
+{
+    if( *pcArgs != '\0' )
+    {
+        ( void ) LogLevel_Apply( pcArgs, strlen( pcArgs ) );
+    }
+
+    LogLevel_Print();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCommandInterval( char * pcArgs )
+{
+    char * pcValue = strchr( pcArgs, ' ' );
+    uint32_t ulPeriodMs = 0;
+    BaseType_t xResult = pdFALSE;
+
+    if( pcValue != NULL )
+    {
+        *pcValue = '\0';
+        ulPeriodMs = ( uint32_t ) strtoul( pcValue + 1, NULL, 10 );
+
+        if( strcmp( pcArgs, "heap" ) == 0 )
+        {
+            xResult = HeapMonitor_SetPublishPeriod( ulPeriodMs );
+        }
+
+        #if ( configGENERATE_RUN_TIME_STATS == 1 )
+            else if( strcmp( pcArgs, "tasks" ) == 0 )
+            {
+                xResult = TaskStats_SetPublishPeriod( ulPeriodMs );
+            }
+        #endif
+
+        #if ( OTA_UPDATE_ENABLED == 1 )
+            else if( strcmp( pcArgs, "ota" ) == 0 )
+            {
+                xResult = xOTASetStatisticsInterval( ulPeriodMs );
+            }
+        #endif
+    }
+
+    if( xResult == pdTRUE )
+    {
+        PRINTF( "Interval of %s set to %lu ms.\r\n", pcArgs, ( unsigned long ) ulPeriodMs );
+    }
+    else
+    {
+        PRINTF( "Usage: interval <tasks|heap|ota> <ms>, not shorter than the sample period.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Runs the command of a line, the first word selects it and the rest are its arguments.
+ */
+static void prvRunCommand( char * pcLine )
+{
+    char * pcArgs = strchr( pcLine, ' ' );
+    size_t i;
+
+    if( pcArgs != NULL )
+    {
+        *pcArgs++ = '\0';
+
+        while( *pcArgs == ' ' )
+        {
+            pcArgs++;
+        }
+    }
+    else
+    {
+        pcArgs = &pcLine[ strlen( pcLine ) ];
+    }
+
+    for( i = 0; i < ( sizeof( xCommands ) / sizeof( xCommands[ 0 ] ) ); i++ )
+    {
+        if( strcmp( pcLine, xCommands[ i ].pcName ) == 0 )
+        {
+            xCommands[ i ].pxHandler( pcArgs );
+            return;
+        }
+    }
+
+    PRINTF( "Unknown command %s, type help.\r\n", pcLine );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvConsoleShellTask( void * pvParameters )
+{
+    size_t xLength = 0;
+    uint8_t ucInput;
+
+    ( void ) pvParameters;
+
+    vTaskDelay( pdMS_TO_TICKS( consoleshellSTART_DELAY_MS ) );
+
+    PRINTF( "Console shell ready, type help.\r\n> " );
+
+    for( ; ; )
+    {
+        if( ( ( ( USART_Type * ) BOARD_DEBUG_UART_BASEADDR )->FIFOSTAT & USART_FIFOSTAT_RXNOTEMPTY_MASK ) == 0U )
+        {
+            vTaskDelay( pdMS_TO_TICKS( consoleshellPOLL_PERIOD_MS ) );
+            continue;
+        }
+
+        ucInput = ( uint8_t ) DbgConsole_Getchar();
+
+        if( ( ucInput == ( uint8_t ) '\r' ) || ( ucInput == ( uint8_t ) '\n' ) )
+        {
+            /* The \n of a \r\n pair ends an empty line. */
+            if( xLength > 0U )
+            {
+                cLine[ xLength ] = '\0';
+                xLength = 0;
+
+                PRINTF( "\r\n" );
+                prvRunCommand( cLine );
+                PRINTF( "> " );
+            }
+        }
+        else if( ( ucInput == ( uint8_t ) '\b' ) || ( ucInput == 0x7FU ) )
+        {
+            if( xLength > 0U )
+            {
+                xLength--;
+                PRINTF( "\b \b" );
+            }
+        }
+        else if( ( ucInput >= ( uint8_t ) ' ' ) && ( xLength < ( sizeof( cLine ) - 1U ) ) )
+        {
+            cLine[ xLength++ ] = ( char ) ucInput;
+            PRINTF( "%c", ( char ) ucInput );
+        }
+        else
+        {
+            /* Control characters and characters beyond the line are dropped. */
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t ConsoleShell_Init( void )
+{
+    BaseType_t result;
+
+    result = xTaskCreate( prvConsoleShellTask,
+                          "Shell_task",
+                          consoleshellTASK_STACK_SIZE,
+                          NULL,
+                          consoleshellTASK_PRIORITY | portPRIVILEGE_BIT,
+                          NULL );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create console shell task.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
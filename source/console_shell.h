@@ -0,0 +1,59 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file console_shell.h
+ * @brief Command shell on the debug console, printing the runtime statistics and changing the log
+ * levels and the statistics intervals without a debugger.
+ */
+
+#ifndef CONSOLE_SHELL_H
+#define CONSOLE_SHELL_H
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Creates the shell task, which reads commands from the debug console once the
+ * reprovisioning window of the provisioning interface is over. Each line is a command followed by
+ * its arguments, "help" lists them:
+ * - agent: MQTT agent queue and ACK statistics, with the ACK time histogram of each operation type.
+ * - ota: OTA agent packet statistics and download progress.
+ * - heap: heap statistics, and the heap regions with heap_5.
+ * - tasks [ms]: CPU load and stack high-water mark of each task over a window, 1 s by default.
+ * - enet [reset]: ENET driver statistics of each DMA channel.
+ * - probes [reset]: latency probes, with latencyprobeENABLED.
+ * - irq [reset]: longest interrupt masking window and interrupt entry latency, with irqlatencyENABLED.
+ * - iperf <options>|stop: iperf 2 compatible TCP and UDP tests and a TLS echo test, with iperfENABLED.
+ * - log [<module>=<level>,...]: prints or sets the log levels, as on the log level topic.
+ * - interval <tasks|heap|ota> <ms>: changes the publish period of the task or heap stats, or the
+ *   report interval of the OTA statistics.
+ * The output goes through PRINTF, so it is interleaved with the log.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t ConsoleShell_Init( void );
+
+#endif /* CONSOLE_SHELL_H */
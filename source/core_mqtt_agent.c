@@ -30,6 +30,13 @@
  * up by the MQTT agent task. MQTT agent task calls the corresponding MQTT library API and adds it to a pending
  * operations list if the operation requires an acknowledgment. It receives MQTT packets from the network, if there
  * are no operations in queue to be processed.
+ *
+ * When MQTT_AGENT_EVENT_DRIVEN is enabled, the agent task does not poll the network. It blocks on its task
+ * notification, which is given either by MQTTAgent_Enqueue() or by MQTTAgent_Wakeup() when the underlying socket
+ * has received data, and then processes all the queued operations and all the buffered incoming packets.
+ *
+ * Up to MQTT_AGENT_MAX_INSTANCES agents run side by side, one task per MQTT connection, each with its own
+ * queues, pending operations and subscription router. The operation arena and the callback worker are shared.
  */
 
 
@@ -46,6 +53,27 @@
 
 #include "core_mqtt_agent.h"
 
+/* Fixed size block pools. */
+#include "block_pool.h"
+
+/* Buffer sizes of the selected performance profile. */
+#include "perf_profile.h"
+
+/* Watchdog supervisor include, the agent loop checks in on every wake up. */
+#include "watchdog.h"
+
+/* Retry utilities include, used to back off between reconnect attempts. */
+#include "retry_utils.h"
+
+/* Latency probes include, times the receive and dispatch of incoming packets. */
+#include "latency_probe.h"
+
+/* Monotonic clock include, timestamps the operations for the statistics. */
+#include "monotonic_clock.h"
+
+/* Interrupt latency include, measures the critical sections around the shared agent state. */
+#include "irq_latency.h"
+
 /**
  * @brief Task priority for MQTT agent is set to higher priority than other tasks.
  */
@@ -58,303 +86,3922 @@
 #define MQTT_AGENT_TASK_STACK_SIZE              ( 2048 )
 
 /**
- * @brief Maximum number of concurrent operations for MQTT agent.
+ * @brief Maximum number of concurrent operations waiting for an ACK from the broker.
+ * MQTTAgent_Enqueue() refuses QoS1/QoS2 publish, subscribe and unsubscribe operations when this
+ * limit is reached. Outgoing QoS1/QoS2 publishes are also limited by MQTT_STATE_ARRAY_MAX_COUNT.
+ * The default comes from democonfigPERF_PROFILE.
  */
-#define MQTT_AGENT_MAX_CONCURRENT_OPERATIONS    ( 5 )
+#ifndef MQTT_AGENT_MAX_CONCURRENT_OPERATIONS
+    #define MQTT_AGENT_MAX_CONCURRENT_OPERATIONS    ( perfprofileAGENT_OPERATIONS )
+#endif
 
 /**
- * @brief Maximum polling interval for the agent. The agent will be listening on incoming messages during
- * this interval.
+ * @brief Number of pending operation slots which can be used only by MQTT_AGENT_PRIORITY_CONTROL operations,
+ * so that control traffic is not refused when bulk traffic fills up the pending operations table.
  */
-#define MQTT_AGENT_MAX_POLLING_INTERVAL_MS      ( 500 )
+#ifndef MQTT_AGENT_CONTROL_RESERVED_OPERATIONS
+    #define MQTT_AGENT_CONTROL_RESERVED_OPERATIONS    ( 4 )
+#endif
 
 /**
- * @brief Function used to add a MQTT operation to the pending list for receiving ACKS from broker.
- *
- * @param[in] pOperation Pointer to the operation pending.
- * @return pdTRUE if the operation was enqueued, pdFALSE if max pending operations are reached.
+ * @brief Length of the queue for MQTT_AGENT_PRIORITY_CONTROL operations.
  */
-static BaseType_t addPendingOperation( MQTTOperation_t * pOperation );
+#ifndef MQTT_AGENT_CONTROL_QUEUE_LENGTH
+    #define MQTT_AGENT_CONTROL_QUEUE_LENGTH    ( 8 )
+#endif
 
 /**
- * @brief Pops pending MQTT operation with the packet identifier.
- *
- * @param[in] packetIndentifier The packet identifier for the pending MQTT operation.
- * @return Pointer to the MQTT operation poped, NULL if there are no operations with that packet identifier.
+ * @brief Maximum number of control operations processed in a row while bulk operations are waiting.
  */
-static MQTTOperation_t * getPendingOperation( uint16_t packetIdentifier );
+#ifndef MQTT_AGENT_CONTROL_BURST_MAX
+    #define MQTT_AGENT_CONTROL_BURST_MAX    ( 4 )
+#endif
 
 /**
- * @brief Main agent task loop.
- * Agent runs in a loop processing MQTT operations from application tasks. It exits loop on explicitly calling
- * MQTTAgent_Stop() from application tasks.
- *
- * @param[in] pParams Paramaters for the agent task.
+ * @brief Maximum number of operations processed on a single wake up in event driven mode, before
+ * incoming packets and keep alive are serviced.
  */
-static void prvMQTTAgentLoop( void * pParams );
+#ifndef MQTT_AGENT_MAX_OPERATIONS_PER_WAKEUP
+    #define MQTT_AGENT_MAX_OPERATIONS_PER_WAKEUP    ( 8 )
+#endif
+
+#if ( MQTT_AGENT_CONTROL_RESERVED_OPERATIONS >= MQTT_AGENT_MAX_CONCURRENT_OPERATIONS )
+    #error "MQTT_AGENT_CONTROL_RESERVED_OPERATIONS must be less than MQTT_AGENT_MAX_CONCURRENT_OPERATIONS."
+#endif
+
+/* Each instance checks in with its own watchdog client and task name. */
+#if ( MQTT_AGENT_MAX_INSTANCES < 1 ) || ( MQTT_AGENT_MAX_INSTANCES > 2 )
+    #error "MQTT_AGENT_MAX_INSTANCES must be 1 or 2."
+#endif
+
+/* A QoS1/QoS2 publish accepted by MQTTAgent_Enqueue() would otherwise be refused by MQTT_Publish()
+ * for lack of a state record, and fail after it waited its turn in the queue. */
+#if ( MQTT_STATE_ARRAY_MAX_COUNT < MQTT_AGENT_MAX_CONCURRENT_OPERATIONS )
+    #error "MQTT_STATE_ARRAY_MAX_COUNT must not be less than MQTT_AGENT_MAX_CONCURRENT_OPERATIONS."
+#endif
 
 /**
- * @brief The default operation used when there are no other operations in queue.
+ * @brief Number of slots in the pending operations table, indexed by packet identifier.
+ * Must be a power of two larger than MQTT_AGENT_MAX_CONCURRENT_OPERATIONS, so that the table
+ * never fills up and lookups terminate on a free slot.
  */
-static MQTTOperation_t receiveOP =
-{
-    .type = MQTT_OP_RECEIVE
-};
+#ifndef MQTT_AGENT_PENDING_TABLE_SIZE
+    #define MQTT_AGENT_PENDING_TABLE_SIZE    ( perfprofileAGENT_PENDING_TABLE )
+#endif
+
+#if ( ( MQTT_AGENT_PENDING_TABLE_SIZE & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1 ) ) != 0 )
+    #error "MQTT_AGENT_PENDING_TABLE_SIZE must be a power of two."
+#endif
+
+#if ( MQTT_AGENT_PENDING_TABLE_SIZE <= MQTT_AGENT_MAX_CONCURRENT_OPERATIONS )
+    #error "MQTT_AGENT_PENDING_TABLE_SIZE must be larger than MQTT_AGENT_MAX_CONCURRENT_OPERATIONS."
+#endif
 
 /**
- * @brief Queue used to receive MQTT operations to be processed by MQTT agent.
+ * @brief Size of the buffer used to serialize the QoS0 messages of a MQTT_OP_PUBLISH_BATCH operation into a
+ * single transport write. Messages larger than the buffer are sent individually.
  */
-static QueueHandle_t xOperationsQueue;
+#ifndef MQTT_AGENT_BATCH_BUFFER_SIZE
+    #define MQTT_AGENT_BATCH_BUFFER_SIZE    ( 1024U )
+#endif
 
 /**
- * @brief Static array used to keep track of pending MQTT operations that require an ACK to be received from broker.
+ * @brief Number of slabs in the arena used by MQTTAgent_PublishCopy(). Each slab holds one publish
+ * operation with a copy of its topic and payload until the publish is complete.
  */
-static MQTTOperation_t * pendingOperations[ MQTT_AGENT_MAX_CONCURRENT_OPERATIONS ];
+#ifndef MQTT_AGENT_ARENA_SLABS
+    #define MQTT_AGENT_ARENA_SLABS    ( perfprofileAGENT_ARENA_SLABS )
+#endif
 
 /**
- * @brief Variable used to check if the agent is running.
+ * @brief Size of the buffer of an arena slab, which holds both the topic and the payload of a publish.
  */
-static BaseType_t isAgentRunning = pdFALSE;
+#ifndef MQTT_AGENT_ARENA_SLAB_SIZE
+    #define MQTT_AGENT_ARENA_SLAB_SIZE    ( 256U )
+#endif
 
+/**
+ * @brief Number of topics which can have a publish flagged with MQTT_AGENT_FLAG_LATEST_VALUE waiting in the
+ * queues at the same time. Once all the entries are used, such publishes are queued as the others. Set to 0 to
+ * queue them all.
+ */
+#ifndef MQTT_AGENT_LATEST_VALUE_ENTRIES
+    #define MQTT_AGENT_LATEST_VALUE_ENTRIES    ( 4U )
+#endif
 
-static BaseType_t addPendingOperation( MQTTOperation_t * pOperation )
-{
-    size_t index = 0;
-    BaseType_t result = pdFALSE;
+/**
+ * @brief Set to 1 to run the operation callbacks, and the callbacks of the subscriptions registered with
+ * MQTTAgent_RegisterSubscriptionDeferred(), from a worker task instead of the agent task. The agent then
+ * goes back to the network as soon as a packet is processed, however long the callbacks take.
+ */
+#ifndef MQTT_AGENT_CALLBACK_WORKER
+    #define MQTT_AGENT_CALLBACK_WORKER    ( 0 )
+#endif
 
-    for( index = 0; index < MQTT_AGENT_MAX_CONCURRENT_OPERATIONS; index++ )
-    {
-        if( pendingOperations[ index ] == NULL )
-        {
-            pendingOperations[ index ] = pOperation;
-            result = pdTRUE;
-            break;
-        }
-    }
+#if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
 
-    return result;
-}
+/**
+ * @brief Priority of the worker task running the deferred callbacks, that of the application tasks
+ * consuming the completions and the incoming publishes.
+ */
+    #ifndef MQTT_AGENT_WORKER_TASK_PRIORITY
+        #define MQTT_AGENT_WORKER_TASK_PRIORITY    ( tskIDLE_PRIORITY + 2 )
+    #endif
 
-static MQTTOperation_t * getPendingOperation( uint16_t packetIdentifier )
-{
-    size_t index = 0;
-    MQTTOperation_t * pOperation = NULL;
+/**
+ * @brief Stack size of the worker task, which runs the application callbacks.
+ */
+    #ifndef MQTT_AGENT_WORKER_TASK_STACK_SIZE
+        #define MQTT_AGENT_WORKER_TASK_STACK_SIZE    ( 1024 )
+    #endif
 
+/**
+ * @brief Number of incoming publishes copied for the deferred subscriptions until their callback returns.
+ */
+    #ifndef MQTT_AGENT_WORKER_SLABS
+        #define MQTT_AGENT_WORKER_SLABS    ( 4U )
+    #endif
 
-    for( index = 0; index < MQTT_AGENT_MAX_CONCURRENT_OPERATIONS; index++ )
-    {
-        if( ( pendingOperations[ index ] != NULL ) &&
-            ( pendingOperations[ index ]->packetIdentifier == packetIdentifier ) )
-        {
-            pOperation = pendingOperations[ index ];
-            pendingOperations[ index ] = NULL;
-            break;
-        }
-    }
+/**
+ * @brief Number of callbacks waiting for the worker. When the queue is full, the agent runs the callback
+ * itself and counts a worker fallback in the statistics.
+ */
+    #ifndef MQTT_AGENT_WORKER_QUEUE_LENGTH
+        #define MQTT_AGENT_WORKER_QUEUE_LENGTH    ( MQTT_AGENT_MAX_CONCURRENT_OPERATIONS + MQTT_AGENT_WORKER_SLABS )
+    #endif
 
-    return pOperation;
-}
+/**
+ * @brief Size of the buffer of a worker slab, which holds both the topic and the payload of an incoming
+ * publish. Larger publishes are delivered from the agent task.
+ */
+    #ifndef MQTT_AGENT_WORKER_SLAB_SIZE
+        #define MQTT_AGENT_WORKER_SLAB_SIZE    ( 256U )
+    #endif
+#endif /* if ( MQTT_AGENT_CALLBACK_WORKER == 1 ) */
 
+/**
+ * @brief Set to 1 to collect the runtime statistics returned by MQTTAgent_GetStats().
+ */
+#ifndef MQTT_AGENT_STATS_ENABLED
+    #define MQTT_AGENT_STATS_ENABLED    ( 1 )
+#endif
 
-static void prvMQTTAgentLoop( void * pParams )
-{
-    BaseType_t status;
-    MQTTOperation_t * pOperation;
-    uint16_t packetIdentifier = 0;
-    MQTTContext_t * pMQTTContext = ( MQTTContext_t * ) pParams;
-    MQTTStatus_t mqttStatus;
+/**
+ * @brief Timestamp of the operations for the statistics, the low bits of the monotonic clock in
+ * microseconds, which wrap after 71 minutes.
+ */
+#define MQTT_AGENT_TIMESTAMP_US()    ( ( uint32_t ) MonotonicClock_GetUs() )
 
-    isAgentRunning = pdTRUE;
+/**
+ * @brief Converts a duration in microseconds to milliseconds for the statistics.
+ */
+#define MQTT_AGENT_US_TO_MS( us )    ( ( uint32_t ) ( us ) / 1000U )
 
-    for( ; ; )
-    {
-        status = xQueueReceive( xOperationsQueue, &pOperation, 1 );
+/**
+ * @brief Critical sections around the agent state shared with the application tasks, recorded as
+ * interrupt masking windows by the interrupt latency measurement.
+ */
+#define agentENTER_CRITICAL() \
+    do {                      \
+        taskENTER_CRITICAL(); \
+        IRQMASK_BEGIN();      \
+    } while( 0 )
+
+#define agentEXIT_CRITICAL() \
+    do {                     \
+        IRQMASK_END();       \
+        taskEXIT_CRITICAL(); \
+    } while( 0 )
 
-        if( status == pdTRUE )
-        {
-            switch( pOperation->type )
-            {
-                case MQTT_OP_RECEIVE:
-                    mqttStatus = MQTT_ProcessLoop( pMQTTContext, MQTT_AGENT_MAX_POLLING_INTERVAL_MS );
-                    configASSERT( mqttStatus == MQTTSuccess );
-                    xQueueSend( xOperationsQueue, &pOperation, 1 );
-                    break;
+/**
+ * @brief Maximum number of nodes in the topic filter trie used to route incoming publishes. Each distinct topic
+ * level of the registered filters uses one node, levels shared by filters are stored once.
+ */
+#ifndef MQTT_AGENT_ROUTER_MAX_NODES
+    #define MQTT_AGENT_ROUTER_MAX_NODES    ( 32U )
+#endif
 
-                case MQTT_OP_PUBLISH:
+/**
+ * @brief Set to 1 to coalesce the MQTT_OP_SUBSCRIBE, or MQTT_OP_UNSUBSCRIBE, operations processed within
+ * MQTT_AGENT_COALESCE_WINDOW_MS of each other into one packet, and to count the subscriptions of each topic
+ * filter so that a filter already subscribed is not subscribed again, and a filter still subscribed by
+ * another operation is not unsubscribed.
+ */
+#ifndef MQTT_AGENT_COALESCE_SUBSCRIPTIONS
+    #define MQTT_AGENT_COALESCE_SUBSCRIPTIONS    ( 1 )
+#endif
 
-                    if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
-                    {
-                        packetIdentifier = MQTT_GetPacketId( pMQTTContext );
-                    }
-                    else
-                    {
-                        packetIdentifier = 0;
-                    }
+#if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
 
-                    mqttStatus = MQTT_Publish( pMQTTContext, pOperation->info.pPublishInfo, packetIdentifier );
+/**
+ * @brief Time a subscribe or unsubscribe operation waits for others to be sent in the same packet. With 0, only
+ * the operations dequeued on the same wake up of the agent are coalesced.
+ */
+    #ifndef MQTT_AGENT_COALESCE_WINDOW_MS
+        #define MQTT_AGENT_COALESCE_WINDOW_MS    ( 20U )
+    #endif
 
-                    if( ( mqttStatus != MQTTSuccess ) || ( pOperation->info.pPublishInfo->qos == MQTTQoS0 ) )
-                    {
-                        pOperation->callback( pOperation, mqttStatus );
-                    }
-                    else
-                    {
-                        pOperation->packetIdentifier = packetIdentifier;
-                        configASSERT( addPendingOperation( pOperation ) == pdTRUE );
-                    }
+/**
+ * @brief Maximum number of operations coalesced into one packet.
+ */
+    #ifndef MQTT_AGENT_COALESCE_MAX_OPERATIONS
+        #define MQTT_AGENT_COALESCE_MAX_OPERATIONS    ( 4U )
+    #endif
 
-                    break;
+/**
+ * @brief Maximum number of topic filters in a coalesced packet. Operations with more filters are sent alone,
+ * without counting their subscriptions.
+ */
+    #ifndef MQTT_AGENT_COALESCE_MAX_FILTERS
+        #define MQTT_AGENT_COALESCE_MAX_FILTERS    ( 8U )
+    #endif
 
-                case MQTT_OP_SUBSCRIBE:
-                    packetIdentifier = MQTT_GetPacketId( pMQTTContext );
-                    mqttStatus = MQTT_Subscribe( pMQTTContext,
-                                                 pOperation->info.subscriptionInfo.pSubscriptionList,
-                                                 pOperation->info.subscriptionInfo.numSubscriptions,
-                                                 packetIdentifier );
+/**
+ * @brief Number of coalesced packets which can wait for their SUBACK or UNSUBACK at the same time. When they
+ * are all in flight, the operations are sent alone.
+ */
+    #ifndef MQTT_AGENT_COALESCE_GROUPS
+        #define MQTT_AGENT_COALESCE_GROUPS    ( 2U )
+    #endif
 
-                    if( mqttStatus != MQTTSuccess )
-                    {
-                        pOperation->callback( pOperation, mqttStatus );
-                    }
-                    else
-                    {
-                        pOperation->packetIdentifier = packetIdentifier;
-                        configASSERT( addPendingOperation( pOperation ) == pdTRUE );
-                    }
+/**
+ * @brief Number of topic filters whose subscriptions are counted. The filters subscribed once the table is
+ * full are subscribed and unsubscribed every time, as without coalescing.
+ */
+    #ifndef MQTT_AGENT_SUBSCRIPTION_REFS
+        #define MQTT_AGENT_SUBSCRIPTION_REFS    ( 8U )
+    #endif
 
-                    break;
+/**
+ * @brief Size of the copy of a topic filter kept for counting its subscriptions. Longer filters are not counted.
+ */
+    #ifndef MQTT_AGENT_SUBSCRIPTION_FILTER_SIZE
+        #define MQTT_AGENT_SUBSCRIPTION_FILTER_SIZE    ( 128U )
+    #endif
 
-                case MQTT_OP_UNSUBSCRIBE:
-                    packetIdentifier = MQTT_GetPacketId( pMQTTContext );
-                    mqttStatus = MQTT_Unsubscribe( pMQTTContext,
-                                                   pOperation->info.subscriptionInfo.pSubscriptionList,
-                                                   pOperation->info.subscriptionInfo.numSubscriptions,
-                                                   packetIdentifier );
+/**
+ * @brief Upper bound of the fixed header and the packet identifier of a SUBSCRIBE or UNSUBSCRIBE packet.
+ */
+    #define MQTT_AGENT_SUBSCRIBE_HEADER_SIZE    ( 7U )
+#endif /* if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 ) */
 
-                    if( mqttStatus != MQTTSuccess )
-                    {
-                        pOperation->callback( pOperation, mqttStatus );
-                    }
-                    else
-                    {
-                        pOperation->packetIdentifier = packetIdentifier;
-                        configASSERT( addPendingOperation( pOperation ) == pdTRUE );
-                    }
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
 
-                    break;
+/**
+ * @brief Size of the buffer the payload of a streamed publish is read into, the size of the chunks passed
+ * to the stream callbacks.
+ */
+    #ifndef MQTT_AGENT_STREAM_CHUNK_SIZE
+        #define MQTT_AGENT_STREAM_CHUNK_SIZE    ( 512U )
+    #endif
 
-                case MQTT_OP_STOP:
-                    /* Reset the operations queue to empty state to stop the agent. */
-                    xQueueReset( xOperationsQueue );
-                    pOperation->callback( pOperation, MQTTSuccess );
-                    break;
+/**
+ * @brief Longest topic of a streamed publish. The fixed header, topic and packet identifier of each incoming
+ * publish are read ahead into a buffer of the agent to match the topic with the stream subscriptions.
+ */
+    #ifndef MQTT_AGENT_STREAM_TOPIC_SIZE
+        #define MQTT_AGENT_STREAM_TOPIC_SIZE    ( 256U )
+    #endif
 
-                default:
-                    break;
-            }
-        }
-        else
-        {
-            break;
-        }
-    }
+/**
+ * @brief Time to wait for the rest of a packet once its first byte is read, before the connection is
+ * considered lost.
+ */
+    #ifndef MQTT_AGENT_STREAM_RECV_TIMEOUT_MS
+        #define MQTT_AGENT_STREAM_RECV_TIMEOUT_MS    ( 5000U )
+    #endif
 
-    vQueueDelete( xOperationsQueue );
+/**
+ * @brief Size of the read ahead buffer: packet type, remaining length of up to 4 bytes, topic length, topic
+ * and packet identifier.
+ */
+    #define MQTT_AGENT_STREAM_HEADER_SIZE    ( 1U + 4U + 2U + MQTT_AGENT_STREAM_TOPIC_SIZE + 2U )
+#endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
 
-    isAgentRunning = pdFALSE;
+/**
+ * @brief Index used to mark the end of a child or sibling list in the topic filter trie. The root node at
+ * index 0 is never a child.
+ */
+#define MQTT_AGENT_ROUTER_NO_NODE    ( 0U )
 
-    vTaskDelete( NULL );
-}
+/**
+ * @brief Maps a packet identifier to its home slot in the pending operations table.
+ * Packet identifiers are allocated sequentially, so the low bits spread them evenly.
+ */
+#define MQTT_AGENT_PENDING_INDEX( packetIdentifier )    ( ( size_t ) ( packetIdentifier ) & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1U ) )
 
-BaseType_t MQTTAgent_Init( MQTTContext_t * pMqttContext )
+/**
+ * @brief Maximum polling interval for the agent. The agent will be listening on incoming messages during
+ * this interval when the connection is idle.
+ */
+#ifndef MQTT_AGENT_MAX_POLLING_INTERVAL_MS
+    #define MQTT_AGENT_MAX_POLLING_INTERVAL_MS    ( 500 )
+#endif
+
+/**
+ * @brief Minimum polling interval for the agent, used while packets are received or operations are queued.
+ * The interval doubles on every poll without traffic, up to MQTT_AGENT_MAX_POLLING_INTERVAL_MS.
+ */
+#ifndef MQTT_AGENT_MIN_POLLING_INTERVAL_MS
+    #define MQTT_AGENT_MIN_POLLING_INTERVAL_MS    ( 10 )
+#endif
+
+/**
+ * @brief Set to 1 to make the agent wait for task notifications from MQTTAgent_Enqueue() and
+ * MQTTAgent_Wakeup() instead of periodically polling the network with an MQTT_OP_RECEIVE operation.
+ */
+#ifndef MQTT_AGENT_EVENT_DRIVEN
+    #define MQTT_AGENT_EVENT_DRIVEN    ( 1 )
+#endif
+
+/**
+ * @brief Maximum time the agent blocks waiting for an event in event driven mode. When idle, the agent
+ * sleeps until the next keep alive deadline, but at least once in this interval.
+ */
+#ifndef MQTT_AGENT_MAX_EVENT_WAIT_MS
+    #define MQTT_AGENT_MAX_EVENT_WAIT_MS    ( 10000 )
+#endif
+
+/**
+ * @brief How early a PINGREQ may be sent before the keep alive interval elapses. The idle waits
+ * of the agent end on the wake ups of the watchdog supervisor, so this must be at least
+ * watchdogCHECK_PERIOD_MS for the PINGREQ to go out on the wake up before the deadline.
+ */
+#ifndef MQTT_AGENT_KEEP_ALIVE_EARLY_MS
+    #define MQTT_AGENT_KEEP_ALIVE_EARLY_MS    ( 1000U )
+#endif
+
+/**
+ * @brief A node of the topic filter trie, holding one topic level of the registered filters.
+ */
+typedef struct MQTTAgentRouterNode
 {
-    BaseType_t result = pdTRUE;
-    MQTTOperation_t * pOperation = &receiveOP;
+    const char * pLevel;                         /**< Topic level, points into the registered filter. */
+    uint16_t levelLength;                        /**< Length of the topic level. */
+    uint16_t firstChild;                         /**< Index of the first node for the next level. */
+    uint16_t nextSibling;                        /**< Index of the next node at the same level. */
+    MQTTAgentIncomingPublishCallback_t callback; /**< Callback if a filter ends at this level. */
+    void * pCallbackContext;                     /**< Context passed to the callback. */
+    BaseType_t deferred;                         /**< pdTRUE to invoke the callback from the worker task. */
+    #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+        MQTTAgentIncomingStreamCallback_t streamCallback; /**< Stream callback if a filter ends at this level. */
+        void * pStreamContext;                            /**< Context passed to the stream callback. */
+    #endif
+} MQTTAgentRouterNode_t;
+
+/**
+ * @brief A slab of the outgoing message arena, holding a publish enqueued with MQTTAgent_PublishCopy().
+ */
+typedef struct MQTTAgentSlab
+{
+    MQTTOperation_t operation; /**< Must be the first member, the slab is found from the operation pointer. */
+    MQTTPublishInfo_t publishInfo;
+    MQTTOperationStatusCallback_t callback;
+    uint8_t buffer[ MQTT_AGENT_ARENA_SLAB_SIZE ];
+} MQTTAgentSlab_t;
 
-    memset( pendingOperations, 0x00, sizeof( pendingOperations ) );
+#if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
 
-    if( result == pdTRUE )
+/**
+ * @brief A topic with a latest value publish waiting in the queues. The marker of the entry is queued in place
+ * of the publish, so that a newer publish of the topic only has to replace the one of the entry.
+ */
+    typedef struct MQTTAgentLatestValue
     {
-        xOperationsQueue = xQueueCreate( MQTT_AGENT_MAX_CONCURRENT_OPERATIONS, sizeof( MQTTOperation_t * ) );
+        MQTTOperation_t marker;       /**< Queued once for the topic, the waiting publish is processed when it is dequeued. */
+        MQTTOperation_t * pOperation; /**< Publish waiting to be sent, NULL when the entry is free. */
+    } MQTTAgentLatestValue_t;
+#endif
 
-        if( xOperationsQueue == NULL )
-        {
-            PRINTF( "MQTT Agent failed to create the queue.\r\n" );
-            result = pdFALSE;
-        }
-    }
+#if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
 
-    if( result == pdTRUE )
+/**
+ * @brief Subscribe or unsubscribe operations coalesced into one packet.
+ */
+    typedef struct MQTTAgentSubscribeGroup
     {
-        result = xQueueSend( xOperationsQueue, &pOperation, 1 );
-    }
+        MQTTOperation_t operation;                                        /**< Operation sent for the whole group. */
+        MQTTSubscribeInfo_t filters[ MQTT_AGENT_COALESCE_MAX_FILTERS ];   /**< Filters sent, pointing into the lists of the members. */
+        MQTTOperation_t * pMembers[ MQTT_AGENT_COALESCE_MAX_OPERATIONS ]; /**< Operations completed with the group. */
+        uint16_t numMembers;                                              /**< Number of members, 0 when the group is free. */
+        size_t packetSize;                                                /**< Upper bound of the size of the packet. */
+    } MQTTAgentSubscribeGroup_t;
 
-    if( result == pdTRUE )
+/**
+ * @brief Number of subscriptions of a topic filter.
+ */
+    typedef struct MQTTAgentSubscriptionRef
     {
-        if( ( result = xTaskCreate( prvMQTTAgentLoop,
-                                    "MQTT_Agent_task",
-                                    MQTT_AGENT_TASK_STACK_SIZE,
-                                    pMqttContext,
-                                    MQTT_AGENT_TASK_PRIORITY | portPRIVILEGE_BIT,
-                                    NULL ) ) != pdTRUE )
-        {
-            PRINTF( "Failed to create MQTT Agent task.\r\n" );
-        }
-    }
+        char filter[ MQTT_AGENT_SUBSCRIPTION_FILTER_SIZE ]; /**< Copy of the filter, the operations do not keep theirs. */
+        uint16_t filterLength;                              /**< Length of the filter, 0 when the entry is free. */
+        MQTTQoS_t qos;                                      /**< Highest QoS the filter is subscribed with. */
+        uint16_t refs;                                      /**< Number of subscriptions not unsubscribed yet. */
+    } MQTTAgentSubscriptionRef_t;
+#endif /* if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 ) */
 
-    return result;
-}
+#if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
 
+/**
+ * @brief A slab holding a copy of an incoming publish for a deferred subscription callback.
+ */
+    typedef struct MQTTAgentWorkerSlab
+    {
+        MQTTPublishInfo_t publishInfo;
+        MQTTAgentIncomingPublishCallback_t callback;
+        void * pCallbackContext;
+        uint8_t buffer[ MQTT_AGENT_WORKER_SLAB_SIZE ];
+    } MQTTAgentWorkerSlab_t;
 
-BaseType_t MQTTAgent_ProcessEvent( MQTTContext_t * pMQTTContext,
-                                   struct MQTTPacketInfo * pPacketInfo,
-                                   struct MQTTDeserializedInfo * pDeserializedInfo )
+/**
+ * @brief A callback posted to the worker task, either an operation completion or an incoming publish.
+ */
+    typedef struct MQTTAgentWorkItem
+    {
+        MQTTOperation_t * pOperation;  /**< Completed operation, NULL for an incoming publish. */
+        MQTTStatus_t status;           /**< Status of the completed operation. */
+        MQTTAgentWorkerSlab_t * pSlab; /**< Copy of the incoming publish, NULL for a completion. */
+    } MQTTAgentWorkItem_t;
+#endif /* if ( MQTT_AGENT_CALLBACK_WORKER == 1 ) */
+
+/**
+ * @brief State of an agent instance, serving one MQTT connection from its own task.
+ */
+typedef struct MQTTAgent
 {
-    BaseType_t result = pdFALSE;
-    MQTTOperation_t * pOperation;
+    MQTTContext_t * pMQTTContext;    /**< MQTT context of the connection, NULL while the instance is free. */
+    WatchdogClient_t watchdogClient; /**< Watchdog client of the agent task. */
+    const char * pcTaskName;         /**< Name of the agent task. */
+
+    /**
+     * @brief Queue used to receive bulk MQTT operations to be processed by MQTT agent.
+     */
+    QueueHandle_t xOperationsQueue;
+
+    /**
+     * @brief Queue used to receive control MQTT operations, processed ahead of the bulk operations.
+     */
+    QueueHandle_t xControlQueue;
+
+    /**
+     * @brief Number of control operations processed in a row, used to bound bulk operation latency.
+     */
+    UBaseType_t uxControlBurst;
+
+    /**
+     * @brief Static open addressing table used to keep track of pending MQTT operations that require an ACK
+     * to be received from broker. Operations are stored at the slot of their packet identifier, or at the next
+     * free slot on collision. Accessed only from the agent task.
+     */
+    MQTTOperation_t * pendingOperations[ MQTT_AGENT_PENDING_TABLE_SIZE ];
+
+    /**
+     * @brief Number of pending operation slots reserved by enqueued or in flight operations.
+     */
+    UBaseType_t uxReservedOperations;
+
+    /**
+     * @brief Statically allocated topic filter trie, node 0 is the root. Nodes are inserted by application tasks
+     * within a critical section and linked only once initialized, so the agent task can walk the trie without locking.
+     */
+    MQTTAgentRouterNode_t routerNodes[ MQTT_AGENT_ROUTER_MAX_NODES ];
+
+    /**
+     * @brief Number of nodes used in the topic filter trie, not counting the root.
+     */
+    uint16_t routerNodeCount;
+
+    #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+
+        /**
+         * @brief Runtime statistics of the agent, updated within critical sections.
+         */
+        MQTTAgentStats_t agentStats;
+    #endif
+
+    /**
+     * @brief Buffer used to serialize batched QoS0 publishes. Accessed only from the agent task.
+     */
+    uint8_t batchBuffer[ MQTT_AGENT_BATCH_BUFFER_SIZE ];
+
+    #if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+
+        /**
+         * @brief Topics with a latest value publish waiting in the queues, updated with the scheduler suspended.
+         */
+        MQTTAgentLatestValue_t latestValues[ MQTT_AGENT_LATEST_VALUE_ENTRIES ];
+    #endif
+
+    /**
+     * @brief Variable used to check if the agent is running.
+     */
+    BaseType_t isAgentRunning;
+
+    /**
+     * @brief Set while the task of a stopped agent waits for MQTTAgent_Init() to resume it.
+     */
+    volatile BaseType_t xStopped;
+
+    /**
+     * @brief Operation enqueued by MQTTAgent_Stop(). It is not on the stack of the caller, as the agent
+     * still refers to it once the caller has returned.
+     */
+    MQTTOperation_t stopOP;
+
+    /**
+     * @brief Given by the agent task once it is stopped, taken by MQTTAgent_Stop().
+     */
+    SemaphoreHandle_t xStoppedSemaphore;
+    StaticSemaphore_t xStoppedSemaphoreBuffer;
+
+    #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+
+        /**
+         * @brief Groups of coalesced subscribe or unsubscribe operations. Accessed only from the agent task.
+         */
+        MQTTAgentSubscribeGroup_t subscribeGroups[ MQTT_AGENT_COALESCE_GROUPS ];
+
+        /**
+         * @brief Group taking the subscribe or unsubscribe operations dequeued in the coalescing window, NULL if none.
+         */
+        MQTTAgentSubscribeGroup_t * pFillingGroup;
+
+        /**
+         * @brief Tick count when the first operation was added to pFillingGroup.
+         */
+        TickType_t fillingStartTicks;
+
+        /**
+         * @brief Subscription counts of the topic filters. Accessed only from the agent task.
+         */
+        MQTTAgentSubscriptionRef_t subscriptionRefs[ MQTT_AGENT_SUBSCRIPTION_REFS ];
+
+        /**
+         * @brief Filters sent by prvResubscribe(), pointing into subscriptionRefs.
+         */
+        MQTTSubscribeInfo_t resubscribeList[ MQTT_AGENT_SUBSCRIPTION_REFS ];
+    #endif /* if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 ) */
+
+    /**
+     * @brief Callback used to reconnect with the broker when the connection is lost.
+     */
+    MQTTAgentReconnectCallback_t xReconnectCallback;
+
+    /**
+     * @brief Set by the agent task when an MQTT library call fails with a transport error.
+     */
+    BaseType_t xConnectionLost;
+
+    /**
+     * @brief Handle of the agent task, used to notify the agent of new events.
+     */
+    TaskHandle_t xAgentTaskHandle;
+
+    #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+
+        /**
+         * @brief Storage of the queues and of the task of the agent, created once and kept across restarts.
+         */
+        StaticQueue_t xOperationsQueueBuffer;
+        StaticQueue_t xControlQueueBuffer;
+        uint8_t operationsQueueStorage[ MQTT_AGENT_MAX_CONCURRENT_OPERATIONS * sizeof( MQTTOperation_t * ) ];
+        uint8_t controlQueueStorage[ MQTT_AGENT_CONTROL_QUEUE_LENGTH * sizeof( MQTTOperation_t * ) ];
+        StaticTask_t xAgentTaskBuffer;
+        StackType_t agentTaskStack[ MQTT_AGENT_TASK_STACK_SIZE ];
+    #endif
+
+    /**
+     * @brief Callback invoked on every wake up, before the queued operations are processed.
+     */
+    MQTTAgentDrainCallback_t xDrainCallback;
+
+    /**
+     * @brief Callback pausing the reception of packets while a consumer has no buffer for them.
+     */
+    MQTTAgentReceiveReadyCallback_t xReceiveReadyCallback;
+
+    /**
+     * @brief Set while the reception of packets is paused by xReceiveReadyCallback.
+     */
+    BaseType_t xReceivePaused;
+
+    /**
+     * @brief Set from the start of a pause until xReceiveReadyCallback lets the agent read again, so that
+     * the statistics count each pause once.
+     */
+    BaseType_t xPauseCounted;
+
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+
+        /**
+         * @brief Callback used to check if the transport has received data yet to be read.
+         */
+        MQTTAgentDataPendingCallback_t xDataPendingCallback;
+    #endif
+
+    /**
+     * @brief Set from MQTTAgent_ProcessEvent() when a packet was received by MQTT_ProcessLoop().
+     */
+    BaseType_t xPacketReceived;
+
+    #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+
+        /**
+         * @brief Receive function of the transport, called by prvStreamRecv() which replaces it in the context.
+         */
+        TransportRecv_t xTransportRecv;
+
+        /**
+         * @brief Bytes of the current packet read ahead from the transport, served to the MQTT library before
+         * the rest of the packet. For a streamed publish, the fixed header is rewritten without the payload.
+         */
+        uint8_t streamHeader[ MQTT_AGENT_STREAM_HEADER_SIZE ];
+        size_t streamHeaderLength; /**< Number of bytes in streamHeader. */
+        size_t streamHeaderOffset; /**< Number of bytes of streamHeader already served. */
+
+        /**
+         * @brief Number of bytes of the current packet not read from the transport yet.
+         */
+        size_t streamRemaining;
+
+        /**
+         * @brief Set while the MQTT library processes a publish whose payload was streamed, so that
+         * MQTTAgent_ProcessEvent() does not route it again.
+         */
+        BaseType_t xStreamedPublish;
+
+        /**
+         * @brief Buffer the payload of a streamed publish is read into.
+         */
+        uint8_t streamChunk[ MQTT_AGENT_STREAM_CHUNK_SIZE ];
+    #endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
+
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 0 )
+
+        /**
+         * @brief Current polling interval, adapted to the traffic on the connection.
+         */
+        uint32_t ulPollingIntervalMs;
+
+        /**
+         * @brief The default operation used when there are no other operations in queue.
+         */
+        MQTTOperation_t receiveOP;
+    #endif
+} MQTTAgent_t;
 
-    if( pDeserializedInfo->deserializationResult == MQTTSuccess )
-    {
-        switch( pPacketInfo->type )
-        {
-            case MQTT_PACKET_TYPE_PUBACK:
-            case MQTT_PACKET_TYPE_SUBACK:
-            case MQTT_PACKET_TYPE_UNSUBACK:
-                pOperation = getPendingOperation( pDeserializedInfo->packetIdentifier );
+/**
+ * @brief Function used to add a MQTT operation to the pending list for receiving ACKS from broker.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the operation pending.
+ * @return pdTRUE if the operation was enqueued, pdFALSE if max pending operations are reached.
+ */
+static BaseType_t addPendingOperation( MQTTAgent_t * pAgent,
+                                       MQTTOperation_t * pOperation );
 
-                if( pOperation != NULL )
-                {
-                    pOperation->callback( pOperation, MQTTSuccess );
-                    result = pdTRUE;
-                }
+/**
+ * @brief Pops pending MQTT operation with the packet identifier.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] packetIndentifier The packet identifier for the pending MQTT operation.
+ * @return Pointer to the MQTT operation poped, NULL if there are no operations with that packet identifier.
+ */
+static MQTTOperation_t * getPendingOperation( MQTTAgent_t * pAgent,
+                                              uint16_t packetIdentifier );
 
-                break;
+/**
+ * @brief Publishes all the messages of a MQTT_OP_PUBLISH_BATCH operation.
+ * Consecutive QoS0 messages are serialized into the batch buffer and sent with one transport write.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the batch publish operation.
+ * @return MQTTSuccess if all messages were sent, status of the first failed message otherwise.
+ */
+static MQTTStatus_t prvPublishBatch( MQTTAgent_t * pAgent,
+                                     MQTTOperation_t * pOperation );
 
-            default:
-                break;
-        }
-    }
+/**
+ * @brief Sends the serialized messages in the batch buffer over the transport.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] length Number of bytes to send from the batch buffer.
+ * @return MQTTSuccess if all bytes were sent, MQTTSendFailed otherwise.
+ */
+static MQTTStatus_t prvSendBatchBuffer( MQTTAgent_t * pAgent,
+                                        size_t length );
 
-    return result;
-}
+/**
+ * @brief Finds the node for a topic filter in the trie, optionally inserting the missing levels.
+ * Must be called within a critical section when inserting.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] insert pdTRUE to insert the missing levels of the filter.
+ * @return Pointer to the node of the last level of the filter, NULL if not found or the trie is full.
+ */
+static MQTTAgentRouterNode_t * prvRouterFindNode( MQTTAgent_t * pAgent,
+                                                  const char * pTopicFilter,
+                                                  uint16_t topicFilterLength,
+                                                  BaseType_t insert );
 
-void MQTTAgent_Stop( void )
-{
-    MQTTOperation_t operation = { 0 };
+/**
+ * @brief Matches a level of an incoming publish topic against the children of a trie node, and recurses
+ * into the next level for the matching children.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pNode The node matched by the previous topic levels.
+ * @param[in] pPublishInfo The incoming publish.
+ * @param[in] levelStart Offset of the topic level to match.
+ * @return Number of callbacks invoked.
+ */
+static UBaseType_t prvRouteLevel( MQTTAgent_t * pAgent,
+                                  const MQTTAgentRouterNode_t * pNode,
+                                  MQTTPublishInfo_t * pPublishInfo,
+                                  uint16_t levelStart );
 
-    operation.type = MQTT_OP_STOP;
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
 
-    xQueueSend( xOperationsQueue, &operation, portMAX_DELAY );
+/**
+ * @brief Finds the first stream subscription matching a topic, walking the topic filter trie as prvRouteLevel().
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pNode Trie node matching the levels before levelStart.
+ * @param[in] pTopic The topic.
+ * @param[in] topicLength Length of the topic.
+ * @param[in] levelStart Offset of the topic level to match against the children of the node.
+ * @return The node holding the stream callback, NULL if no stream subscription matches.
+ */
+    static const MQTTAgentRouterNode_t * prvRouteStream( const MQTTAgent_t * pAgent,
+                                                         const MQTTAgentRouterNode_t * pNode,
+                                                         const char * pTopic,
+                                                         uint16_t topicLength,
+                                                         uint16_t levelStart );
 
-    while( isAgentRunning == pdTRUE )
-    {
-        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
-    }
-}
+/**
+ * @brief Receives exactly the given number of bytes of the current packet from the transport.
+ *
+ * @return The number of bytes received, or -1 if the transport failed or timed out first.
+ */
+    static int32_t prvStreamRecvExact( MQTTAgent_t * pAgent,
+                                       uint8_t * pBuffer,
+                                       size_t bytesToRecv );
 
+/**
+ * @brief Reads the start of the next packet ahead into streamHeader. When the packet is a publish matching
+ * a stream subscription, streams its payload to the callback and rewrites the fixed header without it.
+ *
+ * @return Number of bytes read ahead, 0 if there is no packet, or -1 if the transport failed.
+ */
+    static int32_t prvStreamReadHeader( MQTTAgent_t * pAgent );
 
-BaseType_t MQTTAgent_Enqueue( MQTTOperation_t * pOperation,
-                              TickType_t timeoutTicks )
+/**
+ * @brief Transport receive function of the contexts served by an agent. It serves the bytes read ahead
+ * by prvStreamReadHeader(), then the rest of the packet from the transport, never beyond the packet.
+ */
+    static int32_t prvStreamRecv( NetworkContext_t * pNetworkContext,
+                                  void * pBuffer,
+                                  size_t bytesToRecv );
+
+/**
+ * @brief Forgets the packet being read, once the connection is closed.
+ */
+    static void prvStreamReset( MQTTAgent_t * pAgent );
+#endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
+
+/**
+ * @brief Marks the connection as lost if the status returned by the MQTT library is a transport error.
+ * Without a reconnect callback, a lost connection is fatal as before.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] status Status returned by the MQTT library.
+ */
+static void prvCheckConnectionStatus( MQTTAgent_t * pAgent,
+                                      MQTTStatus_t status );
+
+/**
+ * @brief Checks with xReceiveReadyCallback whether the next packet may be read.
+ * Counts the pauses in the statistics.
+ *
+ * @param[in] pAgent The agent.
+ * @return pdTRUE if the next packet may be read.
+ */
+static BaseType_t prvReceiveReady( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Writes out the bytes the transport combined from the packets sent by the last
+ * operations, before the agent waits for the next one.
+ *
+ * @param[in] pAgent The agent.
+ */
+static void prvFlushTransport( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Reconnects with the broker using the application reconnect callback, backing off between attempts,
+ * and resends all the operations waiting for an ACK.
+ *
+ * @param[in] pAgent The agent.
+ */
+static void prvReconnect( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Resends the operations in the pending table after a reconnect, QoS1/QoS2 publishes with
+ * the DUP flag set and their original packet identifiers.
+ *
+ * @param[in] pAgent The agent.
+ * @return MQTTSuccess if all operations were sent.
+ */
+static MQTTStatus_t prvResendPendingOperations( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Callback of the operations enqueued with MQTTAgent_PublishCopy(). Invokes the application
+ * callback, if any, and recycles the slab.
+ *
+ * @param[in] pOperation Pointer to the completed operation, the first member of a slab.
+ * @param[in] status Status of the operation.
+ */
+static void prvArenaOperationComplete( MQTTOperation_t * pOperation,
+                                       MQTTStatus_t status );
+
+/**
+ * @brief Copies a publish into a slab of the arena and enqueues it, see MQTTAgent_PublishCopy().
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pPublishInfo The publish to be copied.
+ * @param[in] callback Optional callback invoked when the publish is complete.
+ * @param[in] priority Lane to enqueue the publish to.
+ * @param[in] flags MQTT_AGENT_FLAG_ values of the operation.
+ * @param[in] timeoutTicks Timeout in ticks to wait for a free slab and for the enqueue to succeed.
+ * @return pdTRUE if the publish was copied and enqueued.
+ */
+static BaseType_t prvPublishCopy( MQTTAgentHandle_t xAgent,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  MQTTOperationStatusCallback_t callback,
+                                  MQTTAgentPriority_t priority,
+                                  uint8_t flags,
+                                  TickType_t timeoutTicks );
+
+/**
+ * @brief Completes an operation by updating the statistics and invoking its callback.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the completed operation.
+ * @param[in] status Status of the operation.
+ */
+static void prvCompleteOperation( MQTTAgent_t * pAgent,
+                                  MQTTOperation_t * pOperation,
+                                  MQTTStatus_t status );
+
+/**
+ * @brief Invokes the callback of a trie node for an incoming publish, or posts a copy of the publish to
+ * the worker task if the subscription is deferred.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pNode The node of the matching filter, with a callback.
+ * @param[in] pPublishInfo The incoming publish.
+ */
+static void prvInvokeSubscription( MQTTAgent_t * pAgent,
+                                   const MQTTAgentRouterNode_t * pNode,
+                                   MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Sends an MQTT_OP_SUBSCRIBE or MQTT_OP_UNSUBSCRIBE operation and adds it to the pending table.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the operation, or to the operation of a coalesced group.
+ */
+static void prvSendSubscription( MQTTAgent_t * pAgent,
+                                 MQTTOperation_t * pOperation );
+
+/**
+ * @brief Completes an operation, or all the operations coalesced into it.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the completed operation.
+ * @param[in] status Status of the operation.
+ */
+static void prvCompleteAcked( MQTTAgent_t * pAgent,
+                              MQTTOperation_t * pOperation,
+                              MQTTStatus_t status );
+
+#if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+
+/**
+ * @brief Adds a subscribe or unsubscribe operation to the group being filled, skipping the filters which are
+ * already subscribed or still subscribed by other operations. The group is sent first if the operation is of
+ * another type or does not fit.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the dequeued operation.
+ */
+    static void prvCoalesceSubscription( MQTTAgent_t * pAgent,
+                                         MQTTOperation_t * pOperation );
+
+/**
+ * @brief Sends the group being filled, if any.
+ *
+ * @param[in] pAgent The agent.
+ */
+    static void prvFlushSubscribeGroup( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Sends the group being filled once MQTT_AGENT_COALESCE_WINDOW_MS have elapsed since its first operation.
+ *
+ * @param[in] pAgent The agent.
+ */
+    static void prvFlushSubscribeGroupIfDue( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Finds the subscription count of a topic filter.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pFilter The topic filter.
+ * @param[in] create pdTRUE to create an entry with no subscription if the filter is not found.
+ * @return The entry, NULL if not found, or if the table is full or the filter too long to create it.
+ */
+    static MQTTAgentSubscriptionRef_t * prvFindSubscriptionRef( MQTTAgent_t * pAgent,
+                                                                const MQTTSubscribeInfo_t * pFilter,
+                                                                BaseType_t create );
+
+/**
+ * @brief Subscribes again to all the counted filters after the broker lost the session, in as few
+ * SUBSCRIBE packets as the network buffer allows.
+ *
+ * @param[in] pAgent The agent.
+ * @return MQTTSuccess if all the packets were sent.
+ */
+    static MQTTStatus_t prvResubscribe( MQTTAgent_t * pAgent );
+#endif /* if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 ) */
+
+/**
+ * @brief Registers a callback for a topic filter, see MQTTAgent_RegisterSubscription().
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] callback Callback invoked for the matching publishes.
+ * @param[in] pCallbackContext Context passed to the callback.
+ * @param[in] deferred pdTRUE to invoke the callback from the worker task.
+ * @return pdTRUE if the callback was registered.
+ */
+static BaseType_t prvRegisterSubscription( MQTTAgent_t * pAgent,
+                                           const char * pTopicFilter,
+                                           uint16_t topicFilterLength,
+                                           MQTTAgentIncomingPublishCallback_t callback,
+                                           void * pCallbackContext,
+                                           BaseType_t deferred );
+
+#if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+
+/**
+ * @brief Posts a callback to the worker task without blocking the agent.
+ * Counts a worker fallback in the statistics if the queue is full.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pWorkItem The callback to post.
+ * @return pdTRUE if the worker will run the callback, pdFALSE if the caller must run it.
+ */
+    static BaseType_t prvWorkerPost( MQTTAgent_t * pAgent,
+                                     const MQTTAgentWorkItem_t * pWorkItem );
+
+/**
+ * @brief Worker task loop, running the callbacks posted by the agent in order.
+ *
+ * @param[in] pParams Unused.
+ */
+    static void prvWorkerTask( void * pParams );
+#endif
+
+#if ( MQTT_AGENT_STATS_ENABLED == 1 )
+
+/**
+ * @brief Updates the statistics for an enqueue attempt.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the operation.
+ * @param[in] result Result of the enqueue.
+ */
+    static void prvStatsEnqueue( MQTTAgent_t * pAgent,
+                                 const MQTTOperation_t * pOperation,
+                                 BaseType_t result );
+
+/**
+ * @brief Updates the queue time statistics when the agent dequeues an operation.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the dequeued operation.
+ */
+    static void prvStatsDequeue( MQTTAgent_t * pAgent,
+                                 MQTTOperation_t * pOperation );
+#endif
+
+/**
+ * @brief Checks if the operation waits for an ACK from the broker once it is sent.
+ *
+ * @param[in] pOperation Pointer to the MQTT operation.
+ * @return pdTRUE if the operation occupies a pending operation slot.
+ */
+static BaseType_t prvRequiresAck( const MQTTOperation_t * pOperation );
+
+/**
+ * @brief Reserves a pending operation slot for an operation to be enqueued.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] priority Priority of the operation. Bulk operations cannot use the slots reserved for control.
+ * @return pdTRUE if a slot was reserved, pdFALSE if MQTT_AGENT_MAX_CONCURRENT_OPERATIONS are in flight.
+ */
+static BaseType_t prvReservePendingSlot( MQTTAgent_t * pAgent,
+                                         MQTTAgentPriority_t priority );
+
+/**
+ * @brief Receives the next operation to process from the priority lanes.
+ * Control operations are returned first, unless MQTT_AGENT_CONTROL_BURST_MAX of them were returned in a row
+ * and a bulk operation is waiting.
+ *
+ * @param[in] pAgent The agent.
+ * @param[out] ppOperation Pointer to return the operation.
+ * @param[in] timeoutTicks Time to block waiting for a bulk operation if both lanes are empty.
+ * @return pdTRUE if an operation was received.
+ */
+static BaseType_t prvReceiveOperation( MQTTAgent_t * pAgent,
+                                       MQTTOperation_t ** ppOperation,
+                                       TickType_t timeoutTicks );
+
+/**
+ * @brief Releases a pending operation slot reserved by prvReservePendingSlot().
+ *
+ * @param[in] pAgent The agent.
+ */
+static void prvReleasePendingSlot( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Sends an operation to the queue of its lane.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation The operation.
+ * @param[in] timeoutTicks Time to block waiting for space in the queue.
+ * @return pdTRUE if the operation was queued, or replaced a latest value publish waiting for the same topic.
+ */
+static BaseType_t prvQueueOperation( MQTTAgent_t * pAgent,
+                                     MQTTOperation_t * pOperation,
+                                     TickType_t timeoutTicks );
+
+#if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+
+/**
+ * @brief Queues a publish flagged with MQTT_AGENT_FLAG_LATEST_VALUE through a latest value entry. The publish
+ * waiting in the entry of its topic is replaced and completed with MQTT_AGENT_STATUS_SUPERSEDED. Otherwise a free
+ * entry is taken if its marker fits in the queue without blocking.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation The publish.
+ * @param[in] xQueue Queue of the lane of the publish.
+ * @return pdTRUE if the publish was queued, pdFALSE if it has to be queued as the other operations.
+ */
+    static BaseType_t prvQueueLatestValue( MQTTAgent_t * pAgent,
+                                           MQTTOperation_t * pOperation,
+                                           QueueHandle_t xQueue );
+
+/**
+ * @brief Gets the operation to process for an operation dequeued by the agent, the publish waiting in the
+ * entry if it is the marker of a latest value entry, which is then free.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation The dequeued operation.
+ * @return The operation to process.
+ */
+    static MQTTOperation_t * prvTakeLatestValue( MQTTAgent_t * pAgent,
+                                                 MQTTOperation_t * pOperation );
+
+/**
+ * @brief Frees the latest value entries, once the queues holding their markers are reset.
+ *
+ * @param[in] pAgent The agent.
+ */
+    static void prvResetLatestValues( MQTTAgent_t * pAgent );
+#endif /* if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 ) */
+
+/**
+ * @brief Finds the agent instance bound to an MQTT context.
+ *
+ * @param[in] pMqttContext The MQTT context.
+ * @return The instance, NULL if the context is not bound.
+ */
+static MQTTAgent_t * prvFindAgent( const MQTTContext_t * pMqttContext );
+
+/**
+ * @brief Resolves the handle passed to the APIs.
+ *
+ * @param[in] xAgent The handle, NULL for the first instance.
+ * @return The instance.
+ */
+static MQTTAgent_t * prvGetAgent( MQTTAgentHandle_t xAgent );
+
+/**
+ * @brief Runs the agent until an MQTT_OP_STOP operation is processed.
+ *
+ * @param[in] pAgent The agent.
+ */
+static void prvRunAgent( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Main agent task loop.
+ * Agent runs in a loop processing MQTT operations from application tasks. MQTTAgent_Stop() pauses the loop,
+ * the task then waits for MQTTAgent_Init() to resume it instead of deleting itself.
+ *
+ * @param[in] pParams The agent instance.
+ */
+static void prvMQTTAgentLoop( void * pParams );
+
+/**
+ * @brief Executes a single MQTT operation dequeued from the operations queue.
+ *
+ * @param[in] pAgent The agent.
+ * @param[in] pOperation Pointer to the operation to be processed.
+ * @return pdFALSE if the operation requested the agent to stop, pdTRUE otherwise.
+ */
+static BaseType_t prvProcessOperation( MQTTAgent_t * pAgent,
+                                       MQTTOperation_t * pOperation );
+
+#if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+
+/**
+ * @brief Receives and processes all the incoming packets buffered in the transport.
+ * Keep alive PINGREQ is sent from here if the connection has been idle for the keep alive interval.
+ *
+ * @param[in] pAgent The agent.
+ */
+    static void prvProcessIncomingPackets( MQTTAgent_t * pAgent );
+
+/**
+ * @brief Computes how long the agent can block waiting for an event.
+ * The agent does not block if operations are left over, and otherwise sleeps until the next keep alive
+ * or PINGRESP deadline, bounded by MQTT_AGENT_MAX_EVENT_WAIT_MS. Idle waits end on a wake up of the
+ * watchdog supervisor.
+ *
+ * @param[in] pAgent The agent.
+ * @return Ticks to wait for the task notification.
+ */
+    static TickType_t prvGetEventWaitTicks( MQTTAgent_t * pAgent );
+#endif
+
+/**
+ * @brief Agent instances, bound to their MQTT context by MQTTAgent_GetHandle(). The first one bound is
+ * the instance selected by a NULL handle.
+ */
+static MQTTAgent_t agents[ MQTT_AGENT_MAX_INSTANCES ];
+
+/**
+ * @brief Names of the agent tasks, by instance.
+ */
+static const char * const agentTaskNames[ 2 ] = { "MQTT_Agent_task", "MQTT_Agent_task1" };
+
+#if ( MQTT_AGENT_STATS_ENABLED == 1 )
+
+/**
+ * @brief Upper bounds of the latency histogram buckets, in milliseconds.
+ */
+    static const uint32_t statsHistogramBoundsMs[ MQTT_AGENT_STATS_HISTOGRAM_BUCKETS - 1U ] =
+    {
+        10U, 20U, 50U, 100U, 200U, 500U, 1000U
+    };
+#endif
+
+/**
+ * @brief Outgoing message arena used by MQTTAgent_PublishCopy(), shared by the instances.
+ */
+BLOCK_POOL_DEFINE( xArenaPool, MQTTAgentSlab_t, MQTT_AGENT_ARENA_SLABS );
+
+/**
+ * @brief Counting semaphore of the free arena slabs, used to wait for a slab to be recycled.
+ */
+static SemaphoreHandle_t xArenaSemaphore = NULL;
+
+#if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+    static StaticSemaphore_t xArenaSemaphoreBuffer;
+#endif
+
+#if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+
+/**
+ * @brief Queue of the callbacks posted to the worker task, written only by the agent tasks.
+ */
+    static QueueHandle_t xWorkerQueue = NULL;
+
+    #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+
+/**
+ * @brief Storage of the worker queue and task.
+ */
+        static StaticQueue_t xWorkerQueueBuffer;
+        static uint8_t ucWorkerQueueStorage[ MQTT_AGENT_WORKER_QUEUE_LENGTH * sizeof( MQTTAgentWorkItem_t ) ];
+        static StaticTask_t xWorkerTaskBuffer;
+        static StackType_t uxWorkerTaskStack[ MQTT_AGENT_WORKER_TASK_STACK_SIZE ];
+    #endif
+
+/**
+ * @brief Copies of the incoming publishes for the deferred subscriptions, freed by the worker task.
+ */
+    BLOCK_POOL_DEFINE( xWorkerPool, MQTTAgentWorkerSlab_t, MQTT_AGENT_WORKER_SLABS );
+#endif
+
+
+static BaseType_t addPendingOperation( MQTTAgent_t * pAgent,
+                                       MQTTOperation_t * pOperation )
+{
+    size_t index = MQTT_AGENT_PENDING_INDEX( pOperation->packetIdentifier );
+    size_t count = 0;
+    BaseType_t result = pdFALSE;
+
+    for( count = 0; count < MQTT_AGENT_PENDING_TABLE_SIZE; count++ )
+    {
+        if( pAgent->pendingOperations[ index ] == NULL )
+        {
+            pAgent->pendingOperations[ index ] = pOperation;
+            result = pdTRUE;
+            break;
+        }
+
+        index = ( index + 1U ) & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1U );
+    }
+
+    return result;
+}
+
+static MQTTOperation_t * getPendingOperation( MQTTAgent_t * pAgent,
+                                              uint16_t packetIdentifier )
+{
+    size_t index = MQTT_AGENT_PENDING_INDEX( packetIdentifier );
+    size_t next, home;
+    MQTTOperation_t * pOperation = NULL;
+
+    /* Probe until the operation or a free slot is found. The table is never full. */
+    while( pAgent->pendingOperations[ index ] != NULL )
+    {
+        if( pAgent->pendingOperations[ index ]->packetIdentifier == packetIdentifier )
+        {
+            pOperation = pAgent->pendingOperations[ index ];
+            pAgent->pendingOperations[ index ] = NULL;
+            break;
+        }
+
+        index = ( index + 1U ) & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1U );
+    }
+
+    if( pOperation != NULL )
+    {
+        /* Shift back the following entries of the probe sequence into the freed slot, so that
+         * lookups can keep stopping at the first free slot. */
+        next = index;
+
+        for( ; ; )
+        {
+            next = ( next + 1U ) & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1U );
+
+            if( pAgent->pendingOperations[ next ] == NULL )
+            {
+                break;
+            }
+
+            home = MQTT_AGENT_PENDING_INDEX( pAgent->pendingOperations[ next ]->packetIdentifier );
+
+            /* Move the entry only if its home slot is not cyclically between the freed slot and itself. */
+            if( ( ( next - home ) & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1U ) ) >=
+                ( ( next - index ) & ( MQTT_AGENT_PENDING_TABLE_SIZE - 1U ) ) )
+            {
+                pAgent->pendingOperations[ index ] = pAgent->pendingOperations[ next ];
+                pAgent->pendingOperations[ next ] = NULL;
+                index = next;
+            }
+        }
+
+        prvReleasePendingSlot( pAgent );
+    }
+
+    return pOperation;
+}
+
+static MQTTStatus_t prvSendBatchBuffer( MQTTAgent_t * pAgent,
+                                        size_t length )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    size_t bytesSent = 0;
+    int32_t sendResult;
+
+    while( bytesSent < length )
+    {
+        sendResult = pMQTTContext->transportInterface.send( pMQTTContext->transportInterface.pNetworkContext,
+                                                            &pAgent->batchBuffer[ bytesSent ],
+                                                            length - bytesSent );
+
+        if( sendResult <= 0 )
+        {
+            mqttStatus = MQTTSendFailed;
+            break;
+        }
+
+        bytesSent += ( size_t ) sendResult;
+    }
+
+    if( mqttStatus == MQTTSuccess )
+    {
+        /* Sending a control packet resets the keep alive interval. */
+        pMQTTContext->lastPacketTime = pMQTTContext->getTime();
+    }
+
+    return mqttStatus;
+}
+
+static MQTTStatus_t prvPublishBatch( MQTTAgent_t * pAgent,
+                                     MQTTOperation_t * pOperation )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    MQTTPublishInfo_t * pPublishInfo;
+    MQTTStatus_t * pStatusList = pOperation->info.publishBatchInfo.pStatusList;
+    uint16_t numPublishes = pOperation->info.publishBatchInfo.numPublishes;
+    MQTTStatus_t batchStatus = MQTTSuccess;
+    MQTTStatus_t sendStatus = MQTTSuccess;
+    MQTTStatus_t mqttStatus;
+    MQTTFixedBuffer_t fixedBuffer;
+    size_t remainingLength = 0, packetSize = 0;
+    size_t offset = 0;
+    uint16_t index = 0, first = 0, packetIdentifier;
+    BaseType_t buffered;
+
+    /* Iterate one past the last message to flush the buffered messages. */
+    for( index = 0; index <= numPublishes; index++ )
+    {
+        pPublishInfo = ( index < numPublishes ) ? &( pOperation->info.publishBatchInfo.pPublishList[ index ] ) : NULL;
+        mqttStatus = MQTTSuccess;
+        buffered = pdFALSE;
+
+        if( ( pPublishInfo != NULL ) && ( pPublishInfo->qos == MQTTQoS0 ) )
+        {
+            mqttStatus = MQTT_GetPublishPacketSize( pPublishInfo, &remainingLength, &packetSize );
+            buffered = ( ( mqttStatus == MQTTSuccess ) && ( packetSize <= sizeof( pAgent->batchBuffer ) ) ) ? pdTRUE : pdFALSE;
+        }
+
+        /* Send the buffered messages before a message which does not fit after them. */
+        if( ( offset > 0U ) && ( ( buffered == pdFALSE ) || ( ( offset + packetSize ) > sizeof( pAgent->batchBuffer ) ) ) )
+        {
+            sendStatus = prvSendBatchBuffer( pAgent, offset );
+
+            for( ; first < index; first++ )
+            {
+                if( pStatusList != NULL )
+                {
+                    pStatusList[ first ] = sendStatus;
+                }
+            }
+
+            if( ( sendStatus != MQTTSuccess ) && ( batchStatus == MQTTSuccess ) )
+            {
+                batchStatus = sendStatus;
+            }
+
+            offset = 0;
+        }
+
+        if( pPublishInfo == NULL )
+        {
+            break;
+        }
+
+        if( sendStatus != MQTTSuccess )
+        {
+            /* The connection is broken, do not attempt the remaining messages. */
+            mqttStatus = sendStatus;
+        }
+        else if( buffered == pdTRUE )
+        {
+            fixedBuffer.pBuffer = &pAgent->batchBuffer[ offset ];
+            fixedBuffer.size = sizeof( pAgent->batchBuffer ) - offset;
+            mqttStatus = MQTT_SerializePublish( pPublishInfo, 0, remainingLength, &fixedBuffer );
+
+            if( mqttStatus == MQTTSuccess )
+            {
+                /* Status of the message is set when the buffer is sent. */
+                if( offset == 0U )
+                {
+                    first = index;
+                }
+
+                offset += packetSize;
+                continue;
+            }
+        }
+        else if( mqttStatus == MQTTSuccess )
+        {
+            /* QoS1, QoS2 and oversized messages are sent individually by the MQTT library, which
+             * also keeps the state records for publishes waiting for ACKs. */
+            packetIdentifier = ( pPublishInfo->qos != MQTTQoS0 ) ? MQTT_GetPacketId( pMQTTContext ) : 0U;
+            mqttStatus = MQTT_Publish( pMQTTContext, pPublishInfo, packetIdentifier );
+
+            if( mqttStatus == MQTTSendFailed )
+            {
+                sendStatus = mqttStatus;
+            }
+        }
+        else
+        {
+            /* Invalid publish parameters, the status is reported for this message only. */
+        }
+
+        if( pStatusList != NULL )
+        {
+            pStatusList[ index ] = mqttStatus;
+        }
+
+        if( ( mqttStatus != MQTTSuccess ) && ( batchStatus == MQTTSuccess ) )
+        {
+            batchStatus = mqttStatus;
+        }
+    }
+
+    return batchStatus;
+}
+
+static MQTTAgentRouterNode_t * prvRouterFindNode( MQTTAgent_t * pAgent,
+                                                  const char * pTopicFilter,
+                                                  uint16_t topicFilterLength,
+                                                  BaseType_t insert )
+{
+    MQTTAgentRouterNode_t * pNode = &pAgent->routerNodes[ 0 ];
+    MQTTAgentRouterNode_t * pChild;
+    uint16_t child;
+    size_t levelStart = 0, levelEnd;
+
+    while( ( pNode != NULL ) && ( levelStart <= topicFilterLength ) )
+    {
+        for( levelEnd = levelStart; ( levelEnd < topicFilterLength ) && ( pTopicFilter[ levelEnd ] != '/' ); levelEnd++ )
+        {
+        }
+
+        for( child = pNode->firstChild; child != MQTT_AGENT_ROUTER_NO_NODE; child = pAgent->routerNodes[ child ].nextSibling )
+        {
+            pChild = &pAgent->routerNodes[ child ];
+
+            if( ( pChild->levelLength == ( levelEnd - levelStart ) ) &&
+                ( strncmp( pChild->pLevel, &pTopicFilter[ levelStart ], pChild->levelLength ) == 0 ) )
+            {
+                break;
+            }
+        }
+
+        if( ( child == MQTT_AGENT_ROUTER_NO_NODE ) && ( insert == pdTRUE ) &&
+            ( pAgent->routerNodeCount < ( MQTT_AGENT_ROUTER_MAX_NODES - 1U ) ) )
+        {
+            child = ++pAgent->routerNodeCount;
+            pChild = &pAgent->routerNodes[ child ];
+            pChild->pLevel = &pTopicFilter[ levelStart ];
+            pChild->levelLength = ( uint16_t ) ( levelEnd - levelStart );
+            pChild->firstChild = MQTT_AGENT_ROUTER_NO_NODE;
+            pChild->nextSibling = pNode->firstChild;
+            pChild->callback = NULL;
+            pChild->pCallbackContext = NULL;
+            pChild->deferred = pdFALSE;
+            #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+                pChild->streamCallback = NULL;
+                pChild->pStreamContext = NULL;
+            #endif
+
+            /* Link the node only after it is initialized. */
+            pNode->firstChild = child;
+        }
+
+        pNode = ( child != MQTT_AGENT_ROUTER_NO_NODE ) ? &pAgent->routerNodes[ child ] : NULL;
+        levelStart = levelEnd + 1U;
+    }
+
+    return pNode;
+}
+
+static UBaseType_t prvRouteLevel( MQTTAgent_t * pAgent,
+                                  const MQTTAgentRouterNode_t * pNode,
+                                  MQTTPublishInfo_t * pPublishInfo,
+                                  uint16_t levelStart )
+{
+    const char * pTopic = pPublishInfo->pTopicName;
+    uint16_t topicLength = pPublishInfo->topicNameLength;
+    const MQTTAgentRouterNode_t * pChild;
+    const MQTTAgentRouterNode_t * pGrandChild;
+    uint16_t child, grandChild, levelEnd;
+    BaseType_t wildcardAllowed;
+    UBaseType_t matches = 0;
+
+    for( levelEnd = levelStart; ( levelEnd < topicLength ) && ( pTopic[ levelEnd ] != '/' ); levelEnd++ )
+    {
+    }
+
+    /* Wildcards at the first level do not match topics starting with '$'. */
+    wildcardAllowed = ( ( levelStart != 0U ) || ( pTopic[ 0 ] != '$' ) ) ? pdTRUE : pdFALSE;
+
+    for( child = pNode->firstChild; child != MQTT_AGENT_ROUTER_NO_NODE; child = pChild->nextSibling )
+    {
+        pChild = &pAgent->routerNodes[ child ];
+
+        if( ( pChild->levelLength == 1U ) && ( pChild->pLevel[ 0 ] == '#' ) )
+        {
+            /* Multi level wildcard matches this and all the remaining levels. */
+            if( ( wildcardAllowed == pdTRUE ) && ( pChild->callback != NULL ) )
+            {
+                prvInvokeSubscription( pAgent, pChild, pPublishInfo );
+                matches++;
+            }
+        }
+        else if( ( ( wildcardAllowed == pdTRUE ) && ( pChild->levelLength == 1U ) && ( pChild->pLevel[ 0 ] == '+' ) ) ||
+                 ( ( pChild->levelLength == ( levelEnd - levelStart ) ) &&
+                   ( strncmp( pChild->pLevel, &pTopic[ levelStart ], pChild->levelLength ) == 0 ) ) )
+        {
+            if( levelEnd < topicLength )
+            {
+                matches += prvRouteLevel( pAgent, pChild, pPublishInfo, levelEnd + 1U );
+            }
+            else
+            {
+                if( pChild->callback != NULL )
+                {
+                    prvInvokeSubscription( pAgent, pChild, pPublishInfo );
+                    matches++;
+                }
+
+                /* A filter ending with "/#" also matches its parent level. */
+                for( grandChild = pChild->firstChild; grandChild != MQTT_AGENT_ROUTER_NO_NODE; grandChild = pGrandChild->nextSibling )
+                {
+                    pGrandChild = &pAgent->routerNodes[ grandChild ];
+
+                    if( ( pGrandChild->levelLength == 1U ) && ( pGrandChild->pLevel[ 0 ] == '#' ) &&
+                        ( pGrandChild->callback != NULL ) )
+                    {
+                        prvInvokeSubscription( pAgent, pGrandChild, pPublishInfo );
+                        matches++;
+                    }
+                }
+            }
+        }
+        else
+        {
+            /* Level does not match. */
+        }
+    }
+
+    return matches;
+}
+
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+
+    static const MQTTAgentRouterNode_t * prvRouteStream( const MQTTAgent_t * pAgent,
+                                                         const MQTTAgentRouterNode_t * pNode,
+                                                         const char * pTopic,
+                                                         uint16_t topicLength,
+                                                         uint16_t levelStart )
+    {
+        const MQTTAgentRouterNode_t * pChild;
+        const MQTTAgentRouterNode_t * pGrandChild;
+        const MQTTAgentRouterNode_t * pFound = NULL;
+        uint16_t child, grandChild, levelEnd;
+        BaseType_t wildcardAllowed;
+
+        for( levelEnd = levelStart; ( levelEnd < topicLength ) && ( pTopic[ levelEnd ] != '/' ); levelEnd++ )
+        {
+        }
+
+        /* Wildcards at the first level do not match topics starting with '$'. */
+        wildcardAllowed = ( ( levelStart != 0U ) || ( pTopic[ 0 ] != '$' ) ) ? pdTRUE : pdFALSE;
+
+        for( child = pNode->firstChild; ( child != MQTT_AGENT_ROUTER_NO_NODE ) && ( pFound == NULL ); child = pChild->nextSibling )
+        {
+            pChild = &pAgent->routerNodes[ child ];
+
+            if( ( pChild->levelLength == 1U ) && ( pChild->pLevel[ 0 ] == '#' ) )
+            {
+                if( ( wildcardAllowed == pdTRUE ) && ( pChild->streamCallback != NULL ) )
+                {
+                    pFound = pChild;
+                }
+            }
+            else if( ( ( wildcardAllowed == pdTRUE ) && ( pChild->levelLength == 1U ) && ( pChild->pLevel[ 0 ] == '+' ) ) ||
+                     ( ( pChild->levelLength == ( levelEnd - levelStart ) ) &&
+                       ( strncmp( pChild->pLevel, &pTopic[ levelStart ], pChild->levelLength ) == 0 ) ) )
+            {
+                if( levelEnd < topicLength )
+                {
+                    pFound = prvRouteStream( pAgent, pChild, pTopic, topicLength, levelEnd + 1U );
+                }
+                else if( pChild->streamCallback != NULL )
+                {
+                    pFound = pChild;
+                }
+                else
+                {
+                    /* A filter ending with "/#" also matches its parent level. */
+                    for( grandChild = pChild->firstChild; ( grandChild != MQTT_AGENT_ROUTER_NO_NODE ) && ( pFound == NULL );
+                         grandChild = pGrandChild->nextSibling )
+                    {
+                        pGrandChild = &pAgent->routerNodes[ grandChild ];
+
+                        if( ( pGrandChild->levelLength == 1U ) && ( pGrandChild->pLevel[ 0 ] == '#' ) &&
+                            ( pGrandChild->streamCallback != NULL ) )
+                        {
+                            pFound = pGrandChild;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                /* Level does not match. */
+            }
+        }
+
+        return pFound;
+    }
+
+    static int32_t prvStreamRecvExact( MQTTAgent_t * pAgent,
+                                       uint8_t * pBuffer,
+                                       size_t bytesToRecv )
+    {
+        NetworkContext_t * pNetworkContext = pAgent->pMQTTContext->transportInterface.pNetworkContext;
+        TickType_t xLastProgress = xTaskGetTickCount();
+        size_t received = 0;
+        int32_t result = 0;
+
+        while( ( received < bytesToRecv ) && ( result >= 0 ) )
+        {
+            result = pAgent->xTransportRecv( pNetworkContext, &pBuffer[ received ], bytesToRecv - received );
+
+            if( result > 0 )
+            {
+                received += ( size_t ) result;
+                xLastProgress = xTaskGetTickCount();
+            }
+            else if( ( result == 0 ) &&
+                     ( ( xTaskGetTickCount() - xLastProgress ) >= pdMS_TO_TICKS( MQTT_AGENT_STREAM_RECV_TIMEOUT_MS ) ) )
+            {
+                result = -1;
+            }
+            else
+            {
+                /* Wait for more data, or the transport failed. */
+            }
+        }
+
+        if( received < bytesToRecv )
+        {
+            return -1;
+        }
+
+        pAgent->streamRemaining -= received;
+
+        return ( int32_t ) received;
+    }
+
+    static int32_t prvStreamReadHeader( MQTTAgent_t * pAgent )
+    {
+        uint8_t * pHeader = pAgent->streamHeader;
+        const MQTTAgentRouterNode_t * pNode;
+        MQTTPublishInfo_t publishInfo = { 0 };
+        size_t length = 1U, fixedLength, topicOffset, topicLength, idLength, offset, chunk;
+        uint32_t remaining = 0U, multiplier = 1U;
+        uint8_t encoded[ 4 ];
+        int32_t result;
+
+        pAgent->streamHeaderLength = 0U;
+        pAgent->streamHeaderOffset = 0U;
+        pAgent->xStreamedPublish = pdFALSE;
+
+        /* Packet type, nothing else is read until the packet starts. */
+        result = pAgent->xTransportRecv( pAgent->pMQTTContext->transportInterface.pNetworkContext, pHeader, 1U );
+
+        if( result <= 0 )
+        {
+            return result;
+        }
+
+        /* Remaining length, a malformed one is left for the MQTT library to reject. */
+        pAgent->streamRemaining = 4U;
+
+        do
+        {
+            if( prvStreamRecvExact( pAgent, &pHeader[ length ], 1U ) < 0 )
+            {
+                return -1;
+            }
+
+            remaining += ( uint32_t ) ( pHeader[ length ] & 0x7FU ) * multiplier;
+            multiplier *= 128U;
+            length++;
+        } while( ( ( pHeader[ length - 1U ] & 0x80U ) != 0U ) && ( length < 5U ) );
+
+        fixedLength = length;
+        pAgent->streamRemaining = remaining;
+        pAgent->streamHeaderLength = length;
+
+        if( ( ( pHeader[ 0 ] & 0xF0U ) != MQTT_PACKET_TYPE_PUBLISH ) || ( remaining < 2U ) )
+        {
+            return ( int32_t ) length;
+        }
+
+        /* Topic length, topic and packet identifier of a publish. */
+        if( prvStreamRecvExact( pAgent, &pHeader[ length ], 2U ) < 0 )
+        {
+            return -1;
+        }
+
+        topicOffset = length + 2U;
+        topicLength = ( ( size_t ) pHeader[ length ] << 8 ) | pHeader[ length + 1U ];
+        idLength = ( ( pHeader[ 0 ] & 0x06U ) != 0U ) ? 2U : 0U;
+        length = topicOffset;
+        pAgent->streamHeaderLength = length;
+
+        if( ( topicLength == 0U ) || ( topicLength > MQTT_AGENT_STREAM_TOPIC_SIZE ) ||
+            ( ( topicLength + idLength ) > pAgent->streamRemaining ) )
+        {
+            return ( int32_t ) length;
+        }
+
+        if( prvStreamRecvExact( pAgent, &pHeader[ length ], topicLength + idLength ) < 0 )
+        {
+            return -1;
+        }
+
+        length += topicLength + idLength;
+        pAgent->streamHeaderLength = length;
+
+        pNode = prvRouteStream( pAgent, &pAgent->routerNodes[ 0 ], ( const char * ) &pHeader[ topicOffset ],
+                                ( uint16_t ) topicLength, 0U );
+
+        if( pNode == NULL )
+        {
+            return ( int32_t ) length;
+        }
+
+        /* Stream the payload, the publish is acknowledged once the MQTT library processes its header. */
+        publishInfo.qos = ( MQTTQoS_t ) ( ( pHeader[ 0 ] & 0x06U ) >> 1 );
+        publishInfo.retain = ( ( pHeader[ 0 ] & 0x01U ) != 0U ) ? true : false;
+        publishInfo.dup = ( ( pHeader[ 0 ] & 0x08U ) != 0U ) ? true : false;
+        publishInfo.pTopicName = ( const char * ) &pHeader[ topicOffset ];
+        publishInfo.topicNameLength = ( uint16_t ) topicLength;
+        publishInfo.pPayload = NULL;
+        publishInfo.payloadLength = pAgent->streamRemaining;
+
+        offset = 0U;
+
+        do
+        {
+            chunk = publishInfo.payloadLength - offset;
+            chunk = ( chunk > sizeof( pAgent->streamChunk ) ) ? sizeof( pAgent->streamChunk ) : chunk;
+
+            if( prvStreamRecvExact( pAgent, pAgent->streamChunk, chunk ) < 0 )
+            {
+                pNode->streamCallback( pNode->pStreamContext, &publishInfo, offset, NULL, 0U );
+                return -1;
+            }
+
+            pNode->streamCallback( pNode->pStreamContext, &publishInfo, offset, pAgent->streamChunk, chunk );
+            offset += chunk;
+        } while( offset < publishInfo.payloadLength );
+
+        /* Rewrite the fixed header with the remaining length of the publish without its payload,
+         * which takes at most as many bytes as the original one. */
+        remaining = ( uint32_t ) ( 2U + topicLength + idLength );
+        length -= fixedLength;
+        fixedLength = 1U;
+
+        do
+        {
+            encoded[ fixedLength - 1U ] = ( uint8_t ) ( remaining & 0x7FU );
+            remaining >>= 7;
+
+            if( remaining != 0U )
+            {
+                encoded[ fixedLength - 1U ] |= 0x80U;
+            }
+
+            fixedLength++;
+        } while( remaining != 0U );
+
+        memmove( &pHeader[ fixedLength ], &pHeader[ pAgent->streamHeaderLength - length ], length );
+        memcpy( &pHeader[ 1 ], encoded, fixedLength - 1U );
+        pAgent->streamHeaderLength = fixedLength + length;
+        pAgent->xStreamedPublish = pdTRUE;
+
+        return ( int32_t ) pAgent->streamHeaderLength;
+    }
+
+    static int32_t prvStreamRecv( NetworkContext_t * pNetworkContext,
+                                  void * pBuffer,
+                                  size_t bytesToRecv )
+    {
+        MQTTAgent_t * pAgent = NULL;
+        int32_t result = 0;
+        size_t index, length;
+
+        for( index = 0; ( pAgent == NULL ) && ( index < MQTT_AGENT_MAX_INSTANCES ); index++ )
+        {
+            if( ( agents[ index ].pMQTTContext != NULL ) &&
+                ( agents[ index ].pMQTTContext->transportInterface.pNetworkContext == pNetworkContext ) )
+            {
+                pAgent = &agents[ index ];
+            }
+        }
+
+        configASSERT( pAgent != NULL );
+
+        if( ( pAgent->streamHeaderOffset == pAgent->streamHeaderLength ) && ( pAgent->streamRemaining == 0U ) &&
+            ( bytesToRecv > 0U ) )
+        {
+            /* At a packet boundary. */
+            result = prvStreamReadHeader( pAgent );
+        }
+
+        if( result < 0 )
+        {
+            prvStreamReset( pAgent );
+        }
+        else if( pAgent->streamHeaderOffset < pAgent->streamHeaderLength )
+        {
+            length = pAgent->streamHeaderLength - pAgent->streamHeaderOffset;
+            length = ( length < bytesToRecv ) ? length : bytesToRecv;
+            memcpy( pBuffer, &pAgent->streamHeader[ pAgent->streamHeaderOffset ], length );
+            pAgent->streamHeaderOffset += length;
+            result = ( int32_t ) length;
+        }
+        else if( pAgent->streamRemaining > 0U )
+        {
+            length = ( pAgent->streamRemaining < bytesToRecv ) ? pAgent->streamRemaining : bytesToRecv;
+            result = pAgent->xTransportRecv( pNetworkContext, pBuffer, length );
+
+            if( result > 0 )
+            {
+                pAgent->streamRemaining -= ( size_t ) result;
+            }
+            else if( result < 0 )
+            {
+                prvStreamReset( pAgent );
+            }
+            else
+            {
+                /* Nothing received yet. */
+            }
+        }
+        else
+        {
+            /* No packet. */
+        }
+
+        return result;
+    }
+
+    static void prvStreamReset( MQTTAgent_t * pAgent )
+    {
+        pAgent->streamHeaderLength = 0U;
+        pAgent->streamHeaderOffset = 0U;
+        pAgent->streamRemaining = 0U;
+        pAgent->xStreamedPublish = pdFALSE;
+    }
+
+#endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
+
+#if ( MQTT_AGENT_STATS_ENABLED == 1 )
+
+    static void prvStatsEnqueue( MQTTAgent_t * pAgent,
+                                 const MQTTOperation_t * pOperation,
+                                 BaseType_t result )
+    {
+        UBaseType_t uxDepth = uxQueueMessagesWaiting( pAgent->xControlQueue ) + uxQueueMessagesWaiting( pAgent->xOperationsQueue );
+
+        agentENTER_CRITICAL();
+        {
+            if( result != pdTRUE )
+            {
+                pAgent->agentStats.refused++;
+            }
+            else if( pOperation->type < MQTT_AGENT_STATS_OPERATION_TYPES )
+            {
+                pAgent->agentStats.operations[ pOperation->type ].enqueued++;
+            }
+            else
+            {
+                /* No statistics for internal operations. */
+            }
+
+            if( uxDepth > pAgent->agentStats.maxQueueDepth )
+            {
+                pAgent->agentStats.maxQueueDepth = uxDepth;
+            }
+
+            if( pAgent->uxReservedOperations > pAgent->agentStats.maxPendingAcks )
+            {
+                pAgent->agentStats.maxPendingAcks = pAgent->uxReservedOperations;
+            }
+        }
+        agentEXIT_CRITICAL();
+    }
+
+    static void prvStatsDequeue( MQTTAgent_t * pAgent,
+                                 MQTTOperation_t * pOperation )
+    {
+        MQTTAgentOperationStats_t * pStats;
+        uint32_t queueTimeMs;
+
+        pOperation->sendTime = MQTT_AGENT_TIMESTAMP_US();
+
+        if( pOperation->type < MQTT_AGENT_STATS_OPERATION_TYPES )
+        {
+            pStats = &pAgent->agentStats.operations[ pOperation->type ];
+            queueTimeMs = MQTT_AGENT_US_TO_MS( pOperation->sendTime - pOperation->enqueueTime );
+
+            agentENTER_CRITICAL();
+            {
+                pStats->totalQueueTimeMs += queueTimeMs;
+
+                if( queueTimeMs > pStats->maxQueueTimeMs )
+                {
+                    pStats->maxQueueTimeMs = queueTimeMs;
+                }
+            }
+            agentEXIT_CRITICAL();
+        }
+    }
+
+#endif /* if ( MQTT_AGENT_STATS_ENABLED == 1 ) */
+
+static void prvCompleteOperation( MQTTAgent_t * pAgent,
+                                  MQTTOperation_t * pOperation,
+                                  MQTTStatus_t status )
+{
+    BaseType_t deferred = pdFALSE;
+
+    #if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+        MQTTAgentWorkItem_t workItem;
+    #endif
+
+    #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+        MQTTAgentOperationStats_t * pStats;
+        uint32_t ackTimeMs;
+        size_t bucket;
+
+        if( pOperation->type < MQTT_AGENT_STATS_OPERATION_TYPES )
+        {
+            pStats = &pAgent->agentStats.operations[ pOperation->type ];
+
+            agentENTER_CRITICAL();
+            {
+                if( status != MQTTSuccess )
+                {
+                    pStats->failed++;
+                }
+                else
+                {
+                    pStats->completed++;
+
+                    if( prvRequiresAck( pOperation ) == pdTRUE )
+                    {
+                        ackTimeMs = MQTT_AGENT_US_TO_MS( MQTT_AGENT_TIMESTAMP_US() - pOperation->sendTime );
+                        pStats->totalAckTimeMs += ackTimeMs;
+
+                        if( ackTimeMs > pStats->maxAckTimeMs )
+                        {
+                            pStats->maxAckTimeMs = ackTimeMs;
+                        }
+
+                        for( bucket = 0; bucket < ( MQTT_AGENT_STATS_HISTOGRAM_BUCKETS - 1U ); bucket++ )
+                        {
+                            if( ackTimeMs < statsHistogramBoundsMs[ bucket ] )
+                            {
+                                break;
+                            }
+                        }
+
+                        pStats->ackTimeHistogram[ bucket ]++;
+                    }
+                }
+            }
+            agentEXIT_CRITICAL();
+        }
+    #endif /* if ( MQTT_AGENT_STATS_ENABLED == 1 ) */
+
+    if( pOperation->callback != NULL )
+    {
+        #if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+            workItem.pOperation = pOperation;
+            workItem.status = status;
+            workItem.pSlab = NULL;
+            deferred = prvWorkerPost( pAgent, &workItem );
+        #endif
+
+        if( deferred == pdFALSE )
+        {
+            pOperation->callback( pOperation, status );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvInvokeSubscription( MQTTAgent_t * pAgent,
+                                   const MQTTAgentRouterNode_t * pNode,
+                                   MQTTPublishInfo_t * pPublishInfo )
+{
+    BaseType_t deferred = pdFALSE;
+
+    #if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+        MQTTAgentWorkItem_t workItem;
+        MQTTAgentWorkerSlab_t * pSlab = NULL;
+
+        if( ( pNode->deferred == pdTRUE ) &&
+            ( ( ( size_t ) pPublishInfo->topicNameLength + pPublishInfo->payloadLength ) <= MQTT_AGENT_WORKER_SLAB_SIZE ) )
+        {
+            pSlab = ( MQTTAgentWorkerSlab_t * ) BlockPool_Alloc( &xWorkerPool );
+        }
+
+        if( pSlab != NULL )
+        {
+            /* The publish points into the network buffer, which is reused by the next packet. */
+            pSlab->publishInfo = *pPublishInfo;
+            memcpy( pSlab->buffer, pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
+            memcpy( &pSlab->buffer[ pPublishInfo->topicNameLength ], pPublishInfo->pPayload, pPublishInfo->payloadLength );
+            pSlab->publishInfo.pTopicName = ( const char * ) pSlab->buffer;
+            pSlab->publishInfo.pPayload = &pSlab->buffer[ pPublishInfo->topicNameLength ];
+            pSlab->callback = pNode->callback;
+            pSlab->pCallbackContext = pNode->pCallbackContext;
+
+            workItem.pOperation = NULL;
+            workItem.status = MQTTSuccess;
+            workItem.pSlab = pSlab;
+            deferred = prvWorkerPost( pAgent, &workItem );
+
+            if( deferred == pdFALSE )
+            {
+                BlockPool_Free( &xWorkerPool, pSlab );
+            }
+        }
+        else if( pNode->deferred == pdTRUE )
+        {
+            /* The publish is too large or all the slabs are in use, deliver it from the agent task. */
+            #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+                agentENTER_CRITICAL();
+                {
+                    pAgent->agentStats.workerFallbacks++;
+                }
+                agentEXIT_CRITICAL();
+            #endif
+        }
+        else
+        {
+            /* Subscription invoked from the agent task. */
+        }
+    #endif /* if ( MQTT_AGENT_CALLBACK_WORKER == 1 ) */
+
+    if( deferred == pdFALSE )
+    {
+        pNode->callback( pNode->pCallbackContext, pPublishInfo );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+
+    static BaseType_t prvWorkerPost( MQTTAgent_t * pAgent,
+                                     const MQTTAgentWorkItem_t * pWorkItem )
+    {
+        BaseType_t result = pdFALSE;
+
+        if( xWorkerQueue != NULL )
+        {
+            result = xQueueSend( xWorkerQueue, pWorkItem, 0 );
+        }
+
+        #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+            if( result != pdTRUE )
+            {
+                agentENTER_CRITICAL();
+                {
+                    pAgent->agentStats.workerFallbacks++;
+                }
+                agentEXIT_CRITICAL();
+            }
+        #endif
+
+        return result;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvWorkerTask( void * pParams )
+    {
+        MQTTAgentWorkItem_t workItem;
+
+        ( void ) pParams;
+
+        for( ; ; )
+        {
+            if( xQueueReceive( xWorkerQueue, &workItem, portMAX_DELAY ) == pdTRUE )
+            {
+                if( workItem.pSlab != NULL )
+                {
+                    workItem.pSlab->callback( workItem.pSlab->pCallbackContext, &workItem.pSlab->publishInfo );
+                    BlockPool_Free( &xWorkerPool, workItem.pSlab );
+                }
+                else
+                {
+                    workItem.pOperation->callback( workItem.pOperation, workItem.status );
+                }
+            }
+        }
+    }
+
+#endif /* if ( MQTT_AGENT_CALLBACK_WORKER == 1 ) */
+
+static BaseType_t prvRequiresAck( const MQTTOperation_t * pOperation )
+{
+    BaseType_t result = pdFALSE;
+
+    if( ( pOperation->type == MQTT_OP_SUBSCRIBE ) ||
+        ( pOperation->type == MQTT_OP_UNSUBSCRIBE ) ||
+        ( ( pOperation->type == MQTT_OP_PUBLISH ) &&
+          ( pOperation->info.pPublishInfo->qos != MQTTQoS0 ) ) )
+    {
+        result = pdTRUE;
+    }
+
+    return result;
+}
+
+static BaseType_t prvReservePendingSlot( MQTTAgent_t * pAgent,
+                                         MQTTAgentPriority_t priority )
+{
+    BaseType_t result = pdFALSE;
+    UBaseType_t uxLimit = MQTT_AGENT_MAX_CONCURRENT_OPERATIONS;
+
+    if( priority != MQTT_AGENT_PRIORITY_CONTROL )
+    {
+        uxLimit -= MQTT_AGENT_CONTROL_RESERVED_OPERATIONS;
+    }
+
+    agentENTER_CRITICAL();
+    {
+        if( pAgent->uxReservedOperations < uxLimit )
+        {
+            pAgent->uxReservedOperations++;
+            result = pdTRUE;
+        }
+    }
+    agentEXIT_CRITICAL();
+
+    return result;
+}
+
+static BaseType_t prvReceiveOperation( MQTTAgent_t * pAgent,
+                                       MQTTOperation_t ** ppOperation,
+                                       TickType_t timeoutTicks )
+{
+    BaseType_t result = pdFALSE;
+
+    if( ( pAgent->uxControlBurst < MQTT_AGENT_CONTROL_BURST_MAX ) &&
+        ( xQueueReceive( pAgent->xControlQueue, ppOperation, 0 ) == pdTRUE ) )
+    {
+        pAgent->uxControlBurst++;
+        result = pdTRUE;
+    }
+    else if( xQueueReceive( pAgent->xOperationsQueue, ppOperation, timeoutTicks ) == pdTRUE )
+    {
+        pAgent->uxControlBurst = 0;
+        result = pdTRUE;
+    }
+    else if( xQueueReceive( pAgent->xControlQueue, ppOperation, 0 ) == pdTRUE )
+    {
+        /* No bulk operation is waiting, the burst limit does not apply. */
+        result = pdTRUE;
+    }
+    else
+    {
+        /* Both lanes are empty. */
+    }
+
+    return result;
+}
+
+static void prvReleasePendingSlot( MQTTAgent_t * pAgent )
+{
+    agentENTER_CRITICAL();
+    {
+        configASSERT( pAgent->uxReservedOperations > 0U );
+        pAgent->uxReservedOperations--;
+    }
+    agentEXIT_CRITICAL();
+}
+
+static BaseType_t prvQueueOperation( MQTTAgent_t * pAgent,
+                                     MQTTOperation_t * pOperation,
+                                     TickType_t timeoutTicks )
+{
+    QueueHandle_t xQueue = ( pOperation->priority == MQTT_AGENT_PRIORITY_CONTROL ) ? pAgent->xControlQueue : pAgent->xOperationsQueue;
+    BaseType_t result = pdFALSE;
+
+    #if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+        if( ( pOperation->type == MQTT_OP_PUBLISH ) &&
+            ( ( pOperation->flags & MQTT_AGENT_FLAG_LATEST_VALUE ) != 0U ) )
+        {
+            result = prvQueueLatestValue( pAgent, pOperation, xQueue );
+        }
+    #endif
+
+    if( result == pdFALSE )
+    {
+        result = xQueueSend( xQueue, &pOperation, timeoutTicks );
+    }
+
+    return result;
+}
+
+#if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+
+    static BaseType_t prvQueueLatestValue( MQTTAgent_t * pAgent,
+                                           MQTTOperation_t * pOperation,
+                                           QueueHandle_t xQueue )
+    {
+        const MQTTPublishInfo_t * pPublishInfo = pOperation->info.pPublishInfo;
+        const MQTTPublishInfo_t * pWaitingInfo;
+        MQTTAgentLatestValue_t * pEntry;
+        MQTTAgentLatestValue_t * pFree = NULL;
+        MQTTOperation_t * pSuperseded = NULL;
+        MQTTOperation_t * pMarker;
+        BaseType_t result = pdFALSE;
+        size_t index;
+
+        /* The agent task does not run while the scheduler is suspended, and the marker is only sent without
+         * blocking, so the entries change along with the queues. */
+        vTaskSuspendAll();
+        {
+            for( index = 0; ( index < MQTT_AGENT_LATEST_VALUE_ENTRIES ) && ( result == pdFALSE ); index++ )
+            {
+                pEntry = &pAgent->latestValues[ index ];
+
+                if( pEntry->pOperation == NULL )
+                {
+                    if( pFree == NULL )
+                    {
+                        pFree = pEntry;
+                    }
+                }
+                else
+                {
+                    pWaitingInfo = pEntry->pOperation->info.pPublishInfo;
+
+                    if( ( pWaitingInfo->topicNameLength == pPublishInfo->topicNameLength ) &&
+                        ( memcmp( pWaitingInfo->pTopicName, pPublishInfo->pTopicName, pPublishInfo->topicNameLength ) == 0 ) )
+                    {
+                        pSuperseded = pEntry->pOperation;
+                        pEntry->pOperation = pOperation;
+                        result = pdTRUE;
+                    }
+                }
+            }
+
+            if( ( result == pdFALSE ) && ( pFree != NULL ) )
+            {
+                pMarker = &pFree->marker;
+
+                if( xQueueSend( xQueue, &pMarker, 0 ) == pdTRUE )
+                {
+                    pFree->pOperation = pOperation;
+                    result = pdTRUE;
+                }
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        if( pSuperseded != NULL )
+        {
+            if( prvRequiresAck( pSuperseded ) == pdTRUE )
+            {
+                prvReleasePendingSlot( pAgent );
+            }
+
+            #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+                agentENTER_CRITICAL();
+                {
+                    pAgent->agentStats.superseded++;
+                }
+                agentEXIT_CRITICAL();
+            #endif
+
+            if( pSuperseded->callback != NULL )
+            {
+                pSuperseded->callback( pSuperseded, MQTT_AGENT_STATUS_SUPERSEDED );
+            }
+        }
+
+        return result;
+    }
+
+    static MQTTOperation_t * prvTakeLatestValue( MQTTAgent_t * pAgent,
+                                                 MQTTOperation_t * pOperation )
+    {
+        MQTTOperation_t * pTaken = pOperation;
+        size_t index;
+
+        for( index = 0; index < MQTT_AGENT_LATEST_VALUE_ENTRIES; index++ )
+        {
+            if( pOperation == &pAgent->latestValues[ index ].marker )
+            {
+                vTaskSuspendAll();
+                {
+                    pTaken = pAgent->latestValues[ index ].pOperation;
+                    pAgent->latestValues[ index ].pOperation = NULL;
+                }
+                ( void ) xTaskResumeAll();
+
+                configASSERT( pTaken != NULL );
+                break;
+            }
+        }
+
+        return pTaken;
+    }
+
+    static void prvResetLatestValues( MQTTAgent_t * pAgent )
+    {
+        size_t index;
+
+        vTaskSuspendAll();
+        {
+            for( index = 0; index < MQTT_AGENT_LATEST_VALUE_ENTRIES; index++ )
+            {
+                pAgent->latestValues[ index ].pOperation = NULL;
+            }
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+#endif /* if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 ) */
+
+static void prvSendSubscription( MQTTAgent_t * pAgent,
+                                 MQTTOperation_t * pOperation )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    uint16_t packetIdentifier = MQTT_GetPacketId( pMQTTContext );
+    MQTTStatus_t mqttStatus;
+
+    if( pOperation->type == MQTT_OP_SUBSCRIBE )
+    {
+        mqttStatus = MQTT_Subscribe( pMQTTContext,
+                                     pOperation->info.subscriptionInfo.pSubscriptionList,
+                                     pOperation->info.subscriptionInfo.numSubscriptions,
+                                     packetIdentifier );
+    }
+    else
+    {
+        mqttStatus = MQTT_Unsubscribe( pMQTTContext,
+                                       pOperation->info.subscriptionInfo.pSubscriptionList,
+                                       pOperation->info.subscriptionInfo.numSubscriptions,
+                                       packetIdentifier );
+    }
+
+    if( ( mqttStatus != MQTTSuccess ) &&
+        ( ( mqttStatus != MQTTSendFailed ) || ( pAgent->xReconnectCallback == NULL ) ) )
+    {
+        prvReleasePendingSlot( pAgent );
+        prvCompleteAcked( pAgent, pOperation, mqttStatus );
+    }
+    else
+    {
+        pOperation->packetIdentifier = packetIdentifier;
+        ( void ) addPendingOperation( pAgent, pOperation );
+    }
+
+    prvCheckConnectionStatus( pAgent, mqttStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCompleteAcked( MQTTAgent_t * pAgent,
+                              MQTTOperation_t * pOperation,
+                              MQTTStatus_t status )
+{
+    BaseType_t coalesced = pdFALSE;
+
+    #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+        MQTTAgentSubscribeGroup_t * pGroup = NULL;
+        MQTTAgentSubscriptionRef_t * pRef;
+        size_t index;
+
+        for( index = 0; ( pGroup == NULL ) && ( index < MQTT_AGENT_COALESCE_GROUPS ); index++ )
+        {
+            if( pOperation == &pAgent->subscribeGroups[ index ].operation )
+            {
+                pGroup = &pAgent->subscribeGroups[ index ];
+            }
+        }
+
+        if( pGroup != NULL )
+        {
+            coalesced = pdTRUE;
+
+            /* The filters sent by the group are not subscribed, forget them. */
+            for( index = 0; ( status != MQTTSuccess ) && ( pOperation->type == MQTT_OP_SUBSCRIBE ) &&
+                 ( index < pOperation->info.subscriptionInfo.numSubscriptions ); index++ )
+            {
+                pRef = prvFindSubscriptionRef( pAgent, &pGroup->filters[ index ], pdFALSE );
+
+                if( pRef != NULL )
+                {
+                    pRef->filterLength = 0U;
+                    pRef->refs = 0U;
+                }
+            }
+
+            for( index = 0; index < pGroup->numMembers; index++ )
+            {
+                prvCompleteOperation( pAgent, pGroup->pMembers[ index ], status );
+            }
+
+            pGroup->numMembers = 0U;
+        }
+    #endif /* if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 ) */
+
+    if( coalesced == pdFALSE )
+    {
+        prvCompleteOperation( pAgent, pOperation, status );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+
+    static MQTTAgentSubscriptionRef_t * prvFindSubscriptionRef( MQTTAgent_t * pAgent,
+                                                                const MQTTSubscribeInfo_t * pFilter,
+                                                                BaseType_t create )
+    {
+        MQTTAgentSubscriptionRef_t * pRef = NULL;
+        MQTTAgentSubscriptionRef_t * pFree = NULL;
+        size_t index;
+
+        for( index = 0; index < MQTT_AGENT_SUBSCRIPTION_REFS; index++ )
+        {
+            if( pAgent->subscriptionRefs[ index ].filterLength == 0U )
+            {
+                pFree = ( pFree == NULL ) ? &pAgent->subscriptionRefs[ index ] : pFree;
+            }
+            else if( ( pAgent->subscriptionRefs[ index ].filterLength == pFilter->topicFilterLength ) &&
+                     ( memcmp( pAgent->subscriptionRefs[ index ].filter, pFilter->pTopicFilter, pFilter->topicFilterLength ) == 0 ) )
+            {
+                pRef = &pAgent->subscriptionRefs[ index ];
+                break;
+            }
+            else
+            {
+                /* Another filter. */
+            }
+        }
+
+        if( ( pRef == NULL ) && ( create == pdTRUE ) && ( pFree != NULL ) &&
+            ( pFilter->topicFilterLength > 0U ) && ( pFilter->topicFilterLength <= MQTT_AGENT_SUBSCRIPTION_FILTER_SIZE ) )
+        {
+            pRef = pFree;
+            memcpy( pRef->filter, pFilter->pTopicFilter, pFilter->topicFilterLength );
+            pRef->filterLength = pFilter->topicFilterLength;
+            pRef->qos = pFilter->qos;
+            pRef->refs = 0U;
+        }
+
+        return pRef;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvCoalesceSubscription( MQTTAgent_t * pAgent,
+                                         MQTTOperation_t * pOperation )
+    {
+        MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+        const MQTTSubscribeInfo_t * pList = pOperation->info.subscriptionInfo.pSubscriptionList;
+        uint16_t count = pOperation->info.subscriptionInfo.numSubscriptions;
+        MQTTAgentSubscriptionRef_t * pRef;
+        MQTTAgentSubscribeGroup_t * pGroup;
+        size_t packetSize = 0U;
+        size_t index;
+        uint16_t added = 0U;
+
+        for( index = 0; index < count; index++ )
+        {
+            /* Length prefix and filter, and the requested QoS in a SUBSCRIBE. */
+            packetSize += 2U + pList[ index ].topicFilterLength + ( ( pOperation->type == MQTT_OP_SUBSCRIBE ) ? 1U : 0U );
+        }
+
+        /* Send the group first if the operation cannot join it. */
+        if( ( pAgent->pFillingGroup != NULL ) &&
+            ( ( pAgent->pFillingGroup->operation.type != pOperation->type ) ||
+              ( pAgent->pFillingGroup->numMembers >= MQTT_AGENT_COALESCE_MAX_OPERATIONS ) ||
+              ( ( pAgent->pFillingGroup->operation.info.subscriptionInfo.numSubscriptions + count ) > MQTT_AGENT_COALESCE_MAX_FILTERS ) ||
+              ( ( pAgent->pFillingGroup->packetSize + packetSize ) > pMQTTContext->networkBuffer.size ) ) )
+        {
+            prvFlushSubscribeGroup( pAgent );
+        }
+
+        for( index = 0; ( pAgent->pFillingGroup == NULL ) && ( count <= MQTT_AGENT_COALESCE_MAX_FILTERS ) &&
+             ( index < MQTT_AGENT_COALESCE_GROUPS ); index++ )
+        {
+            if( pAgent->subscribeGroups[ index ].numMembers == 0U )
+            {
+                pAgent->pFillingGroup = &pAgent->subscribeGroups[ index ];
+                memset( &pAgent->pFillingGroup->operation, 0x00, sizeof( pAgent->pFillingGroup->operation ) );
+                pAgent->pFillingGroup->operation.type = pOperation->type;
+                pAgent->pFillingGroup->operation.priority = MQTT_AGENT_PRIORITY_CONTROL;
+                pAgent->pFillingGroup->operation.info.subscriptionInfo.pSubscriptionList = pAgent->pFillingGroup->filters;
+                pAgent->pFillingGroup->packetSize = MQTT_AGENT_SUBSCRIBE_HEADER_SIZE;
+                pAgent->fillingStartTicks = xTaskGetTickCount();
+            }
+        }
+
+        if( pAgent->pFillingGroup == NULL )
+        {
+            /* Too many filters, or all the groups wait for their ACK. */
+            prvSendSubscription( pAgent, pOperation );
+        }
+        else
+        {
+            pGroup = pAgent->pFillingGroup;
+
+            for( index = 0; index < count; index++ )
+            {
+                pRef = prvFindSubscriptionRef( pAgent, &pList[ index ], ( pOperation->type == MQTT_OP_SUBSCRIBE ) ? pdTRUE : pdFALSE );
+
+                if( ( pOperation->type == MQTT_OP_SUBSCRIBE ) && ( pRef != NULL ) &&
+                    ( pRef->refs > 0U ) && ( pRef->qos >= pList[ index ].qos ) )
+                {
+                    /* Already subscribed. */
+                    pRef->refs++;
+                }
+                else if( ( pOperation->type == MQTT_OP_UNSUBSCRIBE ) && ( pRef != NULL ) && ( pRef->refs > 1U ) )
+                {
+                    /* Still subscribed by another operation. */
+                    pRef->refs--;
+                }
+                else
+                {
+                    if( pRef == NULL )
+                    {
+                        /* Filter not counted. */
+                    }
+                    else if( pOperation->type == MQTT_OP_SUBSCRIBE )
+                    {
+                        pRef->refs++;
+                        pRef->qos = ( pList[ index ].qos > pRef->qos ) ? pList[ index ].qos : pRef->qos;
+                    }
+                    else
+                    {
+                        pRef->filterLength = 0U;
+                        pRef->refs = 0U;
+                    }
+
+                    pGroup->filters[ pGroup->operation.info.subscriptionInfo.numSubscriptions ] = pList[ index ];
+                    pGroup->operation.info.subscriptionInfo.numSubscriptions++;
+                    added++;
+                }
+            }
+
+            if( added == 0U )
+            {
+                /* Nothing to send for this operation. */
+                prvReleasePendingSlot( pAgent );
+                prvCompleteOperation( pAgent, pOperation, MQTTSuccess );
+            }
+            else
+            {
+                pGroup->pMembers[ pGroup->numMembers ] = pOperation;
+                pGroup->numMembers++;
+                pGroup->packetSize += packetSize;
+            }
+
+            if( pGroup->numMembers == 0U )
+            {
+                pAgent->pFillingGroup = NULL;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvFlushSubscribeGroup( MQTTAgent_t * pAgent )
+    {
+        MQTTAgentSubscribeGroup_t * pGroup = pAgent->pFillingGroup;
+        uint16_t index;
+
+        if( pGroup != NULL )
+        {
+            pAgent->pFillingGroup = NULL;
+
+            /* The group takes the pending slot of one of its members. */
+            for( index = 1U; index < pGroup->numMembers; index++ )
+            {
+                prvReleasePendingSlot( pAgent );
+            }
+
+            prvSendSubscription( pAgent, &pGroup->operation );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvFlushSubscribeGroupIfDue( MQTTAgent_t * pAgent )
+    {
+        if( ( pAgent->pFillingGroup != NULL ) &&
+            ( ( xTaskGetTickCount() - pAgent->fillingStartTicks ) >= pdMS_TO_TICKS( MQTT_AGENT_COALESCE_WINDOW_MS ) ) )
+        {
+            prvFlushSubscribeGroup( pAgent );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static MQTTStatus_t prvResubscribe( MQTTAgent_t * pAgent )
+    {
+        MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+        MQTTStatus_t mqttStatus = MQTTSuccess;
+        uint16_t count = 0U;
+        size_t packetSize = MQTT_AGENT_SUBSCRIBE_HEADER_SIZE;
+        size_t filterSize;
+        size_t index;
+
+        for( index = 0; ( index <= MQTT_AGENT_SUBSCRIPTION_REFS ) && ( mqttStatus == MQTTSuccess ); index++ )
+        {
+            filterSize = ( index < MQTT_AGENT_SUBSCRIPTION_REFS ) ? ( 3U + pAgent->subscriptionRefs[ index ].filterLength ) : 0U;
+
+            /* Send the filters collected so far when the next one does not fit, and after the last one. */
+            if( ( count > 0U ) &&
+                ( ( index == MQTT_AGENT_SUBSCRIPTION_REFS ) || ( ( packetSize + filterSize ) > pMQTTContext->networkBuffer.size ) ) )
+            {
+                /* The SUBACK matches no pending operation and is dropped. */
+                mqttStatus = MQTT_Subscribe( pMQTTContext, pAgent->resubscribeList, count, MQTT_GetPacketId( pMQTTContext ) );
+                count = 0U;
+                packetSize = MQTT_AGENT_SUBSCRIBE_HEADER_SIZE;
+            }
+
+            if( ( index < MQTT_AGENT_SUBSCRIPTION_REFS ) && ( pAgent->subscriptionRefs[ index ].filterLength > 0U ) )
+            {
+                pAgent->resubscribeList[ count ].pTopicFilter = pAgent->subscriptionRefs[ index ].filter;
+                pAgent->resubscribeList[ count ].topicFilterLength = pAgent->subscriptionRefs[ index ].filterLength;
+                pAgent->resubscribeList[ count ].qos = pAgent->subscriptionRefs[ index ].qos;
+                count++;
+                packetSize += filterSize;
+            }
+        }
+
+        return mqttStatus;
+    }
+
+#endif /* if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvProcessOperation( MQTTAgent_t * pAgent,
+                                       MQTTOperation_t * pOperation )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    BaseType_t xContinue = pdTRUE;
+    uint16_t packetIdentifier = 0;
+    MQTTStatus_t mqttStatus;
+
+    #if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+        pOperation = prvTakeLatestValue( pAgent, pOperation );
+    #endif
+
+    #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+        prvStatsDequeue( pAgent, pOperation );
+    #endif
+
+    switch( pOperation->type )
+    {
+        #if ( MQTT_AGENT_EVENT_DRIVEN == 0 )
+            case MQTT_OP_RECEIVE:
+                pAgent->xPacketReceived = pdFALSE;
+
+                if( prvReceiveReady( pAgent ) == pdTRUE )
+                {
+                    PROBE_BEGIN( PROBE_AGENT_RECEIVE );
+                    mqttStatus = MQTT_ProcessLoop( pMQTTContext, pAgent->ulPollingIntervalMs );
+                    PROBE_END( PROBE_AGENT_RECEIVE );
+                    prvCheckConnectionStatus( pAgent, mqttStatus );
+                }
+                else
+                {
+                    /* Wait as long as a poll would have, the consumer is checked again on the next poll. */
+                    vTaskDelay( pdMS_TO_TICKS( MQTT_AGENT_MIN_POLLING_INTERVAL_MS ) );
+                    pAgent->ulPollingIntervalMs = MQTT_AGENT_MIN_POLLING_INTERVAL_MS;
+                }
+
+                /* Poll again shortly while there is traffic, back off while the connection is idle. */
+                if( ( pAgent->xPacketReceived == pdTRUE ) ||
+                    ( uxQueueMessagesWaiting( pAgent->xControlQueue ) > 0U ) ||
+                    ( uxQueueMessagesWaiting( pAgent->xOperationsQueue ) > 0U ) )
+                {
+                    pAgent->ulPollingIntervalMs = MQTT_AGENT_MIN_POLLING_INTERVAL_MS;
+                }
+                else if( pAgent->ulPollingIntervalMs < ( MQTT_AGENT_MAX_POLLING_INTERVAL_MS / 2U ) )
+                {
+                    pAgent->ulPollingIntervalMs *= 2U;
+                }
+                else
+                {
+                    pAgent->ulPollingIntervalMs = MQTT_AGENT_MAX_POLLING_INTERVAL_MS;
+                }
+
+                xQueueSend( pAgent->xOperationsQueue, &pOperation, 1 );
+                break;
+        #endif
+
+        case MQTT_OP_PUBLISH:
+
+            if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
+            {
+                packetIdentifier = MQTT_GetPacketId( pMQTTContext );
+            }
+            else
+            {
+                packetIdentifier = 0;
+            }
+
+            mqttStatus = MQTT_Publish( pMQTTContext, pOperation->info.pPublishInfo, packetIdentifier );
+
+            if( pOperation->info.pPublishInfo->qos == MQTTQoS0 )
+            {
+                prvCompleteOperation( pAgent, pOperation, mqttStatus );
+            }
+            else if( ( mqttStatus != MQTTSuccess ) &&
+                     ( ( mqttStatus != MQTTSendFailed ) || ( pAgent->xReconnectCallback == NULL ) ) )
+            {
+                prvReleasePendingSlot( pAgent );
+                prvCompleteOperation( pAgent, pOperation, mqttStatus );
+            }
+            else
+            {
+                /* Publishes which failed to be sent are resent after reconnecting. */
+                pOperation->packetIdentifier = packetIdentifier;
+                ( void ) addPendingOperation( pAgent, pOperation );
+            }
+
+            prvCheckConnectionStatus( pAgent, mqttStatus );
+            break;
+
+        case MQTT_OP_SUBSCRIBE:
+        case MQTT_OP_UNSUBSCRIBE:
+            #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+                prvCoalesceSubscription( pAgent, pOperation );
+            #else
+                prvSendSubscription( pAgent, pOperation );
+            #endif
+            break;
+
+        case MQTT_OP_PUBLISH_BATCH:
+            mqttStatus = prvPublishBatch( pAgent, pOperation );
+            prvCompleteOperation( pAgent, pOperation, mqttStatus );
+            prvCheckConnectionStatus( pAgent, mqttStatus );
+            break;
+
+        case MQTT_OP_STOP:
+            /* Reset the operations queues to empty state to stop the agent. The queues and the task
+             * are kept for MQTTAgent_Init() to resume the agent. */
+            xQueueReset( pAgent->xControlQueue );
+            xQueueReset( pAgent->xOperationsQueue );
+
+            #if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+                prvResetLatestValues( pAgent );
+            #endif
+
+            if( pOperation->callback != NULL )
+            {
+                pOperation->callback( pOperation, MQTTSuccess );
+            }
+
+            xContinue = pdFALSE;
+            break;
+
+        default:
+            break;
+    }
+
+    return xContinue;
+}
+
+#if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+
+    static void prvProcessIncomingPackets( MQTTAgent_t * pAgent )
+    {
+        MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+        MQTTStatus_t mqttStatus = MQTTSuccess;
+        BaseType_t xDataPending = pdTRUE;
+
+        /* Only a packet left in the socket pauses the reception. */
+        pAgent->xReceivePaused = pdFALSE;
+
+        if( pAgent->xDataPendingCallback != NULL )
+        {
+            xDataPending = pAgent->xDataPendingCallback( pMQTTContext->transportInterface.pNetworkContext );
+        }
+
+        /* Each call to MQTT_ProcessLoop() with zero timeout reads at most one packet, so keep
+         * calling it as long as packets are being received and the transport still has data,
+         * and the consumers can take them. */
+        while( ( xDataPending == pdTRUE ) && ( mqttStatus == MQTTSuccess ) && ( prvReceiveReady( pAgent ) == pdTRUE ) )
+        {
+            pAgent->xPacketReceived = pdFALSE;
+            PROBE_BEGIN( PROBE_AGENT_RECEIVE );
+            mqttStatus = MQTT_ProcessLoop( pMQTTContext, 0 );
+            PROBE_END( PROBE_AGENT_RECEIVE );
+            prvCheckConnectionStatus( pAgent, mqttStatus );
+
+            if( ( pAgent->xDataPendingCallback == NULL ) || ( pAgent->xPacketReceived == pdFALSE ) )
+            {
+                xDataPending = pdFALSE;
+            }
+            else
+            {
+                xDataPending = pAgent->xDataPendingCallback( pMQTTContext->transportInterface.pNetworkContext );
+            }
+        }
+
+        /* MQTT_ProcessLoop() manages keep alive only when it finds no data to read, which would
+         * block the agent on the socket. Send the PINGREQ from here instead when the connection
+         * has been idle for the keep alive interval. The PINGRESP wakes up the agent like any
+         * other incoming packet. A paused reception could not read the PINGRESP. */
+        if( pAgent->xReceivePaused == pdTRUE )
+        {
+            /* Checked again when the consumer wakes up the agent. */
+        }
+        else if( ( pMQTTContext->keepAliveIntervalSec != 0U ) &&
+            ( pMQTTContext->waitingForPingResp == false ) &&
+            ( ( pMQTTContext->getTime() - pMQTTContext->lastPacketTime + MQTT_AGENT_KEEP_ALIVE_EARLY_MS ) >=
+              ( ( uint32_t ) pMQTTContext->keepAliveIntervalSec * 1000U ) ) )
+        {
+            mqttStatus = MQTT_Ping( pMQTTContext );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                PRINTF( "MQTT Agent failed to send PINGREQ, error = %d.\r\n", mqttStatus );
+            }
+
+            prvCheckConnectionStatus( pAgent, mqttStatus );
+        }
+        else if( ( pMQTTContext->waitingForPingResp == true ) &&
+                 ( ( pMQTTContext->getTime() - pMQTTContext->pingReqSendTimeMs ) > MQTT_PINGRESP_TIMEOUT_MS ) )
+        {
+            PRINTF( "MQTT Agent did not receive PINGRESP.\r\n" );
+            prvCheckConnectionStatus( pAgent, MQTTKeepAliveTimeout );
+        }
+        else
+        {
+            /* Connection is alive. */
+        }
+    }
+
+#endif /* if ( MQTT_AGENT_EVENT_DRIVEN == 1 ) */
+
+#if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+
+    static TickType_t prvGetEventWaitTicks( MQTTAgent_t * pAgent )
+    {
+        MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+        uint32_t waitMs = MQTT_AGENT_MAX_EVENT_WAIT_MS;
+        uint32_t elapsedMs, deadlineMs;
+        BaseType_t xAlign = pdTRUE;
+
+        if( ( uxQueueMessagesWaiting( pAgent->xControlQueue ) > 0U ) ||
+            ( uxQueueMessagesWaiting( pAgent->xOperationsQueue ) > 0U ) )
+        {
+            waitMs = 0U;
+        }
+
+        #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+            else if( pAgent->pFillingGroup != NULL )
+            {
+                /* Wake up at the end of the coalescing window, without waiting for the watchdog. */
+                elapsedMs = ( uint32_t ) ( xTaskGetTickCount() - pAgent->fillingStartTicks ) * portTICK_PERIOD_MS;
+                waitMs = ( elapsedMs < MQTT_AGENT_COALESCE_WINDOW_MS ) ? ( MQTT_AGENT_COALESCE_WINDOW_MS - elapsedMs ) : 0U;
+                xAlign = pdFALSE;
+            }
+        #endif
+        else if( pAgent->xReceivePaused == pdTRUE )
+        {
+            /* The consumer wakes up the agent when it can take packets again. */
+        }
+        else if( pMQTTContext->keepAliveIntervalSec != 0U )
+        {
+            if( pMQTTContext->waitingForPingResp == true )
+            {
+                /* Waking up early would only add a wake up before the real deadline. */
+                elapsedMs = pMQTTContext->getTime() - pMQTTContext->pingReqSendTimeMs;
+                deadlineMs = MQTT_PINGRESP_TIMEOUT_MS + 1U;
+                xAlign = pdFALSE;
+            }
+            else
+            {
+                elapsedMs = pMQTTContext->getTime() - pMQTTContext->lastPacketTime;
+                deadlineMs = ( uint32_t ) pMQTTContext->keepAliveIntervalSec * 1000U;
+            }
+
+            if( elapsedMs >= deadlineMs )
+            {
+                waitMs = 0U;
+            }
+            else if( ( deadlineMs - elapsedMs ) < waitMs )
+            {
+                waitMs = deadlineMs - elapsedMs;
+            }
+            else
+            {
+                /* Wait for the maximum interval. */
+            }
+        }
+        else
+        {
+            /* Keep alive is disabled. */
+        }
+
+        return ( xAlign == pdTRUE ) ? Watchdog_AlignWakeup( pdMS_TO_TICKS( waitMs ) ) : pdMS_TO_TICKS( waitMs );
+    }
+
+#endif /* if ( MQTT_AGENT_EVENT_DRIVEN == 1 ) */
+
+static BaseType_t prvReceiveReady( MQTTAgent_t * pAgent )
+{
+    BaseType_t xReady = pdTRUE;
+
+    if( pAgent->xReceiveReadyCallback != NULL )
+    {
+        xReady = pAgent->xReceiveReadyCallback();
+    }
+
+    if( ( xReady == pdFALSE ) && ( pAgent->xPauseCounted == pdFALSE ) )
+    {
+        #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+            agentENTER_CRITICAL();
+            {
+                pAgent->agentStats.receivePauses++;
+            }
+            agentEXIT_CRITICAL();
+        #endif
+    }
+
+    pAgent->xReceivePaused = ( xReady == pdFALSE ) ? pdTRUE : pdFALSE;
+    pAgent->xPauseCounted = pAgent->xReceivePaused;
+
+    return xReady;
+}
+
+static void prvArenaOperationComplete( MQTTOperation_t * pOperation,
+                                       MQTTStatus_t status )
+{
+    MQTTAgentSlab_t * pSlab = ( MQTTAgentSlab_t * ) pOperation;
+
+    if( pSlab->callback != NULL )
+    {
+        pSlab->callback( pOperation, status );
+    }
+
+    BlockPool_Free( &xArenaPool, pSlab );
+
+    ( void ) xSemaphoreGive( xArenaSemaphore );
+}
+
+static void prvCheckConnectionStatus( MQTTAgent_t * pAgent,
+                                      MQTTStatus_t status )
+{
+    if( ( status == MQTTSendFailed ) ||
+        ( status == MQTTRecvFailed ) ||
+        ( status == MQTTBadResponse ) ||
+        ( status == MQTTKeepAliveTimeout ) )
+    {
+        /* Without a way to reconnect, the agent cannot recover from a transport error. */
+        configASSERT( pAgent->xReconnectCallback != NULL );
+        pAgent->xConnectionLost = pdTRUE;
+    }
+}
+
+static void prvFlushTransport( MQTTAgent_t * pAgent )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    TransportFlush_t flush = pMQTTContext->transportInterface.flush;
+
+    if( ( flush != NULL ) && ( flush( pMQTTContext->transportInterface.pNetworkContext ) < 0 ) )
+    {
+        prvCheckConnectionStatus( pAgent, MQTTSendFailed );
+    }
+}
+
+static MQTTStatus_t prvResendPendingOperations( MQTTAgent_t * pAgent )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTOperation_t * pOperation;
+    size_t index;
+
+    for( index = 0; ( index < MQTT_AGENT_PENDING_TABLE_SIZE ) && ( mqttStatus == MQTTSuccess ); index++ )
+    {
+        pOperation = pAgent->pendingOperations[ index ];
+
+        if( pOperation == NULL )
+        {
+            continue;
+        }
+
+        switch( pOperation->type )
+        {
+            case MQTT_OP_PUBLISH:
+                pOperation->info.pPublishInfo->dup = true;
+                mqttStatus = MQTT_Publish( pMQTTContext, pOperation->info.pPublishInfo, pOperation->packetIdentifier );
+                break;
+
+            case MQTT_OP_SUBSCRIBE:
+                mqttStatus = MQTT_Subscribe( pMQTTContext,
+                                             pOperation->info.subscriptionInfo.pSubscriptionList,
+                                             pOperation->info.subscriptionInfo.numSubscriptions,
+                                             pOperation->packetIdentifier );
+                break;
+
+            case MQTT_OP_UNSUBSCRIBE:
+                mqttStatus = MQTT_Unsubscribe( pMQTTContext,
+                                               pOperation->info.subscriptionInfo.pSubscriptionList,
+                                               pOperation->info.subscriptionInfo.numSubscriptions,
+                                               pOperation->packetIdentifier );
+                break;
+
+            default:
+                break;
+        }
+
+        pOperation->sendTime = MQTT_AGENT_TIMESTAMP_US();
+    }
+
+    return mqttStatus;
+}
+
+static void prvReconnect( MQTTAgent_t * pAgent )
+{
+    MQTTContext_t * pMQTTContext = pAgent->pMQTTContext;
+    RetryUtilsParams_t retryParams;
+    BaseType_t result = pdFALSE;
+    bool sessionPresent = false;
+
+    RetryUtils_ParamsReset( &retryParams );
+
+    /* Connection attempts and back off may block longer than the watchdog timeout. */
+    Watchdog_Unregister( pAgent->watchdogClient );
+
+    while( result != pdTRUE )
+    {
+        PRINTF( "MQTT Agent reconnecting with the broker.\r\n" );
+
+        #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+            prvStreamReset( pAgent );
+        #endif
+
+        result = pAgent->xReconnectCallback( pMQTTContext, &sessionPresent );
+
+        if( result == pdTRUE )
+        {
+            if( sessionPresent == false )
+            {
+                #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+                    PRINTF( "MQTT Agent could not resume the session, subscribing again to the counted filters.\r\n" );
+
+                    if( prvResubscribe( pAgent ) != MQTTSuccess )
+                    {
+                        result = pdFALSE;
+                    }
+                #else
+                    PRINTF( "MQTT Agent could not resume the session, subscriptions are lost.\r\n" );
+                #endif
+            }
+
+            if( ( result == pdTRUE ) && ( prvResendPendingOperations( pAgent ) != MQTTSuccess ) )
+            {
+                result = pdFALSE;
+            }
+        }
+
+        if( ( result != pdTRUE ) &&
+            ( RetryUtils_BackoffAndSleep( &retryParams ) == RetryUtilsRetriesExhausted ) )
+        {
+            /* Keep trying with the maximum back off. */
+            retryParams.attemptsDone = 0;
+        }
+    }
+
+    PRINTF( "MQTT Agent reconnected with the broker.\r\n" );
+
+    Watchdog_Register( pAgent->watchdogClient );
+
+    pAgent->xConnectionLost = pdFALSE;
+}
+
+static void prvRunAgent( MQTTAgent_t * pAgent )
+{
+    BaseType_t status = pdTRUE;
+    MQTTOperation_t * pOperation;
+
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+        TickType_t waitTicks = pdMS_TO_TICKS( MQTT_AGENT_MAX_EVENT_WAIT_MS );
+        UBaseType_t uxProcessed;
+
+        while( status == pdTRUE )
+        {
+            /* Block until an operation is enqueued, the socket has received data or the keep
+             * alive interval has to be checked. */
+            ( void ) ulTaskNotifyTake( pdTRUE, waitTicks );
+            Watchdog_CheckIn( pAgent->watchdogClient );
+
+            if( pAgent->xDrainCallback != NULL )
+            {
+                pAgent->xDrainCallback();
+            }
+
+            for( uxProcessed = 0; ( status == pdTRUE ) && ( uxProcessed < MQTT_AGENT_MAX_OPERATIONS_PER_WAKEUP ); uxProcessed++ )
+            {
+                if( prvReceiveOperation( pAgent, &pOperation, 0 ) != pdTRUE )
+                {
+                    break;
+                }
+
+                status = prvProcessOperation( pAgent, pOperation );
+            }
+
+            #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+                if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdFALSE ) )
+                {
+                    prvFlushSubscribeGroupIfDue( pAgent );
+                }
+            #endif
+
+            if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdFALSE ) )
+            {
+                prvProcessIncomingPackets( pAgent );
+            }
+
+            if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdFALSE ) )
+            {
+                prvFlushTransport( pAgent );
+            }
+
+            if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdTRUE ) )
+            {
+                prvReconnect( pAgent );
+            }
+
+            if( status == pdTRUE )
+            {
+                waitTicks = prvGetEventWaitTicks( pAgent );
+            }
+        }
+    #else /* if ( MQTT_AGENT_EVENT_DRIVEN == 1 ) */
+        while( status == pdTRUE )
+        {
+            if( pAgent->xDrainCallback != NULL )
+            {
+                pAgent->xDrainCallback();
+            }
+
+            status = prvReceiveOperation( pAgent, &pOperation, 1 );
+            Watchdog_CheckIn( pAgent->watchdogClient );
+
+            if( status == pdTRUE )
+            {
+                status = prvProcessOperation( pAgent, pOperation );
+
+                #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+                    if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdFALSE ) )
+                    {
+                        prvFlushSubscribeGroupIfDue( pAgent );
+                    }
+                #endif
+
+                if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdFALSE ) )
+                {
+                    prvFlushTransport( pAgent );
+                }
+
+                if( ( status == pdTRUE ) && ( pAgent->xConnectionLost == pdTRUE ) )
+                {
+                    prvReconnect( pAgent );
+                }
+            }
+        }
+    #endif /* if ( MQTT_AGENT_EVENT_DRIVEN == 1 ) */
+}
+
+static void prvMQTTAgentLoop( void * pParams )
+{
+    MQTTAgent_t * pAgent = ( MQTTAgent_t * ) pParams;
+
+    for( ; ; )
+    {
+        pAgent->isAgentRunning = pdTRUE;
+        Watchdog_Register( pAgent->watchdogClient );
+
+        prvRunAgent( pAgent );
+
+        /* Stopped: the task and the queues are kept, so that a restart only resets them. */
+        Watchdog_Unregister( pAgent->watchdogClient );
+        pAgent->xStopped = pdTRUE;
+        pAgent->isAgentRunning = pdFALSE;
+        ( void ) xSemaphoreGive( pAgent->xStoppedSemaphore );
+
+        /* The socket may still wake the task up until the connection is closed. */
+        while( pAgent->xStopped == pdTRUE )
+        {
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+        }
+    }
+}
+
+static MQTTAgent_t * prvFindAgent( const MQTTContext_t * pMqttContext )
+{
+    MQTTAgent_t * pAgent = NULL;
+    size_t index;
+
+    for( index = 0; ( pAgent == NULL ) && ( index < MQTT_AGENT_MAX_INSTANCES ); index++ )
+    {
+        if( agents[ index ].pMQTTContext == pMqttContext )
+        {
+            pAgent = &agents[ index ];
+        }
+    }
+
+    return pAgent;
+}
+
+static MQTTAgent_t * prvGetAgent( MQTTAgentHandle_t xAgent )
+{
+    return ( xAgent != NULL ) ? xAgent : &agents[ 0 ];
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTAgentHandle_t MQTTAgent_GetHandle( MQTTContext_t * pMqttContext )
+{
+    MQTTAgent_t * pAgent;
+    size_t index;
+
+    configASSERT( pMqttContext != NULL );
+
+    agentENTER_CRITICAL();
+    {
+        pAgent = prvFindAgent( pMqttContext );
+
+        for( index = 0; ( pAgent == NULL ) && ( index < MQTT_AGENT_MAX_INSTANCES ); index++ )
+        {
+            if( agents[ index ].pMQTTContext == NULL )
+            {
+                pAgent = &agents[ index ];
+                pAgent->pMQTTContext = pMqttContext;
+                pAgent->watchdogClient = ( WatchdogClient_t ) ( WATCHDOG_CLIENT_MQTT_AGENT + index );
+                pAgent->pcTaskName = agentTaskNames[ index ];
+            }
+        }
+    }
+    agentEXIT_CRITICAL();
+
+    return pAgent;
+}
+
+BaseType_t MQTTAgent_Init( MQTTContext_t * pMqttContext )
+{
+    BaseType_t result = pdTRUE;
+    BaseType_t othersRunning = pdFALSE;
+    MQTTAgent_t * pAgent = MQTTAgent_GetHandle( pMqttContext );
+    size_t index;
+
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 0 )
+        MQTTOperation_t * pOperation = NULL;
+    #endif
+
+    /* The field trace profile records the agent tasks and their queues. */
+    TRC_FIELD_OBJECTS_BEGIN();
+
+    if( pAgent == NULL )
+    {
+        PRINTF( "MQTT Agent has no free instance for the MQTT context.\r\n" );
+        result = pdFALSE;
+    }
+    else if( ( pAgent->xAgentTaskHandle != NULL ) && ( pAgent->xStopped == pdFALSE ) )
+    {
+        PRINTF( "MQTT Agent is already running for the MQTT context.\r\n" );
+        result = pdFALSE;
+    }
+    else
+    {
+        memset( pAgent->pendingOperations, 0x00, sizeof( pAgent->pendingOperations ) );
+        pAgent->uxReservedOperations = 0;
+
+        #if ( MQTT_AGENT_COALESCE_SUBSCRIPTIONS == 1 )
+            memset( pAgent->subscribeGroups, 0x00, sizeof( pAgent->subscribeGroups ) );
+            memset( pAgent->subscriptionRefs, 0x00, sizeof( pAgent->subscriptionRefs ) );
+            pAgent->pFillingGroup = NULL;
+        #endif
+        pAgent->xConnectionLost = pdFALSE;
+        pAgent->uxControlBurst = 0;
+
+        #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+            /* The agent reads the start of each packet ahead, to stream large publishes. */
+            if( pMqttContext->transportInterface.recv != prvStreamRecv )
+            {
+                pAgent->xTransportRecv = pMqttContext->transportInterface.recv;
+                pMqttContext->transportInterface.recv = prvStreamRecv;
+            }
+
+            prvStreamReset( pAgent );
+        #endif
+
+        #if ( MQTT_AGENT_EVENT_DRIVEN == 0 )
+            memset( &pAgent->receiveOP, 0x00, sizeof( pAgent->receiveOP ) );
+            pAgent->receiveOP.type = MQTT_OP_RECEIVE;
+            pAgent->ulPollingIntervalMs = MQTT_AGENT_MIN_POLLING_INTERVAL_MS;
+            pOperation = &pAgent->receiveOP;
+        #endif
+
+        for( index = 0; index < MQTT_AGENT_MAX_INSTANCES; index++ )
+        {
+            if( agents[ index ].isAgentRunning == pdTRUE )
+            {
+                othersRunning = pdTRUE;
+            }
+        }
+    }
+
+    /* Slabs of operations dropped by a previous stop are reclaimed here, unless another agent
+     * is running and may hold slabs of its own. */
+    if( ( result == pdTRUE ) && ( ( othersRunning == pdFALSE ) || ( xArenaSemaphore == NULL ) ) )
+    {
+        BlockPool_Reset( &xArenaPool );
+
+        if( xArenaSemaphore != NULL )
+        {
+            vSemaphoreDelete( xArenaSemaphore );
+        }
+
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            xArenaSemaphore = xSemaphoreCreateCountingStatic( MQTT_AGENT_ARENA_SLABS, MQTT_AGENT_ARENA_SLABS, &xArenaSemaphoreBuffer );
+        #else
+            xArenaSemaphore = xSemaphoreCreateCounting( MQTT_AGENT_ARENA_SLABS, MQTT_AGENT_ARENA_SLABS );
+        #endif
+
+        if( xArenaSemaphore == NULL )
+        {
+            PRINTF( "MQTT Agent failed to create the arena semaphore.\r\n" );
+            result = pdFALSE;
+        }
+    }
+
+    if( ( result == pdTRUE ) && ( pAgent->xStoppedSemaphore == NULL ) )
+    {
+        pAgent->xStoppedSemaphore = xSemaphoreCreateBinaryStatic( &pAgent->xStoppedSemaphoreBuffer );
+    }
+
+    /* A stopped agent keeps its queues, the operations enqueued since the stop are dropped. */
+    if( ( result == pdTRUE ) && ( pAgent->xOperationsQueue != NULL ) )
+    {
+        ( void ) xQueueReset( pAgent->xControlQueue );
+        ( void ) xQueueReset( pAgent->xOperationsQueue );
+
+        #if ( MQTT_AGENT_LATEST_VALUE_ENTRIES > 0 )
+            prvResetLatestValues( pAgent );
+        #endif
+    }
+    else if( result == pdTRUE )
+    {
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            pAgent->xOperationsQueue = xQueueCreateStatic( MQTT_AGENT_MAX_CONCURRENT_OPERATIONS,
+                                                           sizeof( MQTTOperation_t * ),
+                                                           pAgent->operationsQueueStorage,
+                                                           &pAgent->xOperationsQueueBuffer );
+            pAgent->xControlQueue = xQueueCreateStatic( MQTT_AGENT_CONTROL_QUEUE_LENGTH,
+                                                        sizeof( MQTTOperation_t * ),
+                                                        pAgent->controlQueueStorage,
+                                                        &pAgent->xControlQueueBuffer );
+        #else
+            pAgent->xOperationsQueue = xQueueCreate( MQTT_AGENT_MAX_CONCURRENT_OPERATIONS, sizeof( MQTTOperation_t * ) );
+            pAgent->xControlQueue = xQueueCreate( MQTT_AGENT_CONTROL_QUEUE_LENGTH, sizeof( MQTTOperation_t * ) );
+        #endif
+
+        if( ( pAgent->xOperationsQueue == NULL ) || ( pAgent->xControlQueue == NULL ) )
+        {
+            PRINTF( "MQTT Agent failed to create the queues.\r\n" );
+
+            if( pAgent->xOperationsQueue != NULL )
+            {
+                vQueueDelete( pAgent->xOperationsQueue );
+                pAgent->xOperationsQueue = NULL;
+            }
+
+            if( pAgent->xControlQueue != NULL )
+            {
+                vQueueDelete( pAgent->xControlQueue );
+                pAgent->xControlQueue = NULL;
+            }
+
+            result = pdFALSE;
+        }
+    }
+    else
+    {
+        /* Not initialized. */
+    }
+
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 0 )
+        if( result == pdTRUE )
+        {
+            result = xQueueSend( pAgent->xOperationsQueue, &pOperation, 1 );
+        }
+    #endif
+
+    #if ( MQTT_AGENT_CALLBACK_WORKER == 1 )
+
+        /* The worker is shared by the instances and kept across restarts of the agent, it may still
+         * hold callbacks of the previous run. */
+        if( ( result == pdTRUE ) && ( xWorkerQueue == NULL ) )
+        {
+            TaskHandle_t xWorkerTask = NULL;
+
+            #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+                xWorkerQueue = xQueueCreateStatic( MQTT_AGENT_WORKER_QUEUE_LENGTH,
+                                                   sizeof( MQTTAgentWorkItem_t ),
+                                                   ucWorkerQueueStorage,
+                                                   &xWorkerQueueBuffer );
+            #else
+                xWorkerQueue = xQueueCreate( MQTT_AGENT_WORKER_QUEUE_LENGTH, sizeof( MQTTAgentWorkItem_t ) );
+            #endif
+
+            if( xWorkerQueue == NULL )
+            {
+                PRINTF( "MQTT Agent failed to create the worker queue.\r\n" );
+                result = pdFALSE;
+            }
+            else
+            {
+                #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+                    xWorkerTask = xTaskCreateStatic( prvWorkerTask,
+                                                     "MQTT_Worker",
+                                                     MQTT_AGENT_WORKER_TASK_STACK_SIZE,
+                                                     NULL,
+                                                     MQTT_AGENT_WORKER_TASK_PRIORITY | portPRIVILEGE_BIT,
+                                                     uxWorkerTaskStack,
+                                                     &xWorkerTaskBuffer );
+                #else
+                    ( void ) xTaskCreate( prvWorkerTask,
+                                          "MQTT_Worker",
+                                          MQTT_AGENT_WORKER_TASK_STACK_SIZE,
+                                          NULL,
+                                          MQTT_AGENT_WORKER_TASK_PRIORITY | portPRIVILEGE_BIT,
+                                          &xWorkerTask );
+                #endif
+
+                if( xWorkerTask == NULL )
+                {
+                    PRINTF( "Failed to create MQTT Agent worker task.\r\n" );
+                    vQueueDelete( xWorkerQueue );
+                    xWorkerQueue = NULL;
+                    result = pdFALSE;
+                }
+            }
+        }
+    #endif /* if ( MQTT_AGENT_CALLBACK_WORKER == 1 ) */
+
+    if( ( result == pdTRUE ) && ( pAgent->xAgentTaskHandle != NULL ) )
+    {
+        /* Resume the task of the stopped agent. */
+        pAgent->isAgentRunning = pdTRUE;
+        pAgent->xStopped = pdFALSE;
+        ( void ) xTaskNotifyGive( pAgent->xAgentTaskHandle );
+    }
+    else if( result == pdTRUE )
+    {
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            pAgent->xAgentTaskHandle = xTaskCreateStatic( prvMQTTAgentLoop,
+                                                          pAgent->pcTaskName,
+                                                          MQTT_AGENT_TASK_STACK_SIZE,
+                                                          pAgent,
+                                                          MQTT_AGENT_TASK_PRIORITY | portPRIVILEGE_BIT,
+                                                          pAgent->agentTaskStack,
+                                                          &pAgent->xAgentTaskBuffer );
+            result = ( pAgent->xAgentTaskHandle != NULL ) ? pdTRUE : pdFALSE;
+        #else
+            result = xTaskCreate( prvMQTTAgentLoop,
+                                  pAgent->pcTaskName,
+                                  MQTT_AGENT_TASK_STACK_SIZE,
+                                  pAgent,
+                                  MQTT_AGENT_TASK_PRIORITY | portPRIVILEGE_BIT,
+                                  &pAgent->xAgentTaskHandle );
+        #endif
+
+        if( result != pdTRUE )
+        {
+            PRINTF( "Failed to create MQTT Agent task.\r\n" );
+        }
+    }
+    else
+    {
+        /* Not initialized. */
+    }
+
+    TRC_FIELD_OBJECTS_END();
+
+    return result;
+}
+
+
+BaseType_t MQTTAgent_ProcessEvent( MQTTContext_t * pMQTTContext,
+                                   struct MQTTPacketInfo * pPacketInfo,
+                                   struct MQTTDeserializedInfo * pDeserializedInfo )
+{
+    BaseType_t result = pdFALSE;
+    MQTTOperation_t * pOperation;
+    MQTTAgent_t * pAgent = prvFindAgent( pMQTTContext );
+
+    if( pAgent != NULL )
+    {
+        /* Let the agent loop know that the transport may have more packets to read. */
+        pAgent->xPacketReceived = pdTRUE;
+    }
+
+    /* The lower 4 bits of the publish packet type are used for the dup, QoS, and retain flags.
+     * Hence masking out the lower bits to check if the packet is publish. */
+    if( pAgent == NULL )
+    {
+        /* The context is not served by an agent. */
+    }
+
+    #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+        else if( ( pAgent->xStreamedPublish == pdTRUE ) &&
+                 ( ( pPacketInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH ) )
+        {
+            /* The payload was already streamed to the subscriber, the MQTT library acknowledges it. */
+            pAgent->xStreamedPublish = pdFALSE;
+            result = pdTRUE;
+        }
+    #endif
+    else if( ( pDeserializedInfo->deserializationResult == MQTTSuccess ) &&
+             ( ( pPacketInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH ) )
+    {
+        if( ( pDeserializedInfo->pPublishInfo != NULL ) &&
+            ( pDeserializedInfo->pPublishInfo->topicNameLength > 0U ) &&
+            ( prvRouteLevel( pAgent, &pAgent->routerNodes[ 0 ], pDeserializedInfo->pPublishInfo, 0 ) > 0U ) )
+        {
+            result = pdTRUE;
+        }
+    }
+    else if( pDeserializedInfo->deserializationResult == MQTTSuccess )
+    {
+        switch( pPacketInfo->type )
+        {
+            case MQTT_PACKET_TYPE_PUBACK:
+            case MQTT_PACKET_TYPE_SUBACK:
+            case MQTT_PACKET_TYPE_UNSUBACK:
+                pOperation = getPendingOperation( pAgent, pDeserializedInfo->packetIdentifier );
+
+                if( pOperation != NULL )
+                {
+                    prvCompleteAcked( pAgent, pOperation, MQTTSuccess );
+                    result = pdTRUE;
+                }
+
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+void MQTTAgent_Stop( MQTTAgentHandle_t xAgent )
+{
+    MQTTAgent_t * pAgent = prvGetAgent( xAgent );
+
+    if( pAgent->isAgentRunning == pdTRUE )
+    {
+        memset( &pAgent->stopOP, 0x00, sizeof( pAgent->stopOP ) );
+        pAgent->stopOP.type = MQTT_OP_STOP;
+        pAgent->stopOP.priority = MQTT_AGENT_PRIORITY_CONTROL;
+
+        if( MQTTAgent_Enqueue( pAgent, &pAgent->stopOP, portMAX_DELAY ) == pdTRUE )
+        {
+            ( void ) xSemaphoreTake( pAgent->xStoppedSemaphore, portMAX_DELAY );
+        }
+    }
+}
+
+
+BaseType_t MQTTAgent_Enqueue( MQTTAgentHandle_t xAgent,
+                              MQTTOperation_t * pOperation,
+                              TickType_t timeoutTicks )
+{
+    MQTTAgent_t * pAgent = prvGetAgent( xAgent );
+    BaseType_t result = pdTRUE;
+    BaseType_t requiresAck = prvRequiresAck( pOperation );
+
+    /* Refuse the operation if it cannot be tracked until its ACK is received. */
+    if( requiresAck == pdTRUE )
+    {
+        result = prvReservePendingSlot( pAgent, pOperation->priority );
+    }
+
+    pOperation->enqueueTime = MQTT_AGENT_TIMESTAMP_US();
+
+    if( result == pdTRUE )
+    {
+        result = prvQueueOperation( pAgent, pOperation, timeoutTicks );
+
+        if( ( result != pdTRUE ) && ( requiresAck == pdTRUE ) )
+        {
+            prvReleasePendingSlot( pAgent );
+        }
+    }
+
+    #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+        prvStatsEnqueue( pAgent, pOperation, result );
+    #endif
+
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+        if( result == pdTRUE )
+        {
+            MQTTAgent_Wakeup( pAgent );
+        }
+    #endif
+
+    return result;
+}
+
+static BaseType_t prvPublishCopy( MQTTAgentHandle_t xAgent,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  MQTTOperationStatusCallback_t callback,
+                                  MQTTAgentPriority_t priority,
+                                  uint8_t flags,
+                                  TickType_t timeoutTicks )
+{
+    MQTTAgentSlab_t * pSlab = NULL;
+    BaseType_t result = pdFALSE;
+
+    configASSERT( pPublishInfo != NULL );
+
+    if( ( ( size_t ) pPublishInfo->topicNameLength + pPublishInfo->payloadLength ) > MQTT_AGENT_ARENA_SLAB_SIZE )
+    {
+        PRINTF( "Publish does not fit in an MQTT Agent arena slab.\r\n" );
+    }
+    else if( xSemaphoreTake( xArenaSemaphore, timeoutTicks ) == pdTRUE )
+    {
+        /* A successful take guarantees that a slab is free. */
+        pSlab = ( MQTTAgentSlab_t * ) BlockPool_Alloc( &xArenaPool );
+        configASSERT( pSlab != NULL );
+
+        /* Copy the topic and the payload into the slab, the caller buffers are not used after this. */
+        pSlab->publishInfo = *pPublishInfo;
+        memcpy( pSlab->buffer, pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
+        memcpy( &pSlab->buffer[ pPublishInfo->topicNameLength ], pPublishInfo->pPayload, pPublishInfo->payloadLength );
+        pSlab->publishInfo.pTopicName = ( const char * ) pSlab->buffer;
+        pSlab->publishInfo.pPayload = &pSlab->buffer[ pPublishInfo->topicNameLength ];
+
+        memset( &pSlab->operation, 0x00, sizeof( pSlab->operation ) );
+        pSlab->operation.type = MQTT_OP_PUBLISH;
+        pSlab->operation.info.pPublishInfo = &pSlab->publishInfo;
+        pSlab->operation.callback = prvArenaOperationComplete;
+        pSlab->operation.priority = priority;
+        pSlab->operation.flags = flags;
+        pSlab->callback = callback;
+
+        result = MQTTAgent_Enqueue( xAgent, &pSlab->operation, timeoutTicks );
+
+        if( result != pdTRUE )
+        {
+            pSlab->callback = NULL;
+            prvArenaOperationComplete( &pSlab->operation, MQTTIllegalState );
+        }
+    }
+    else
+    {
+        /* No slab was recycled within the timeout. */
+    }
+
+    return result;
+}
+
+BaseType_t MQTTAgent_PublishCopy( MQTTAgentHandle_t xAgent,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  MQTTOperationStatusCallback_t callback,
+                                  MQTTAgentPriority_t priority,
+                                  TickType_t timeoutTicks )
+{
+    return prvPublishCopy( xAgent, pPublishInfo, callback, priority, 0U, timeoutTicks );
+}
+
+BaseType_t MQTTAgent_PublishLatest( MQTTAgentHandle_t xAgent,
+                                    const MQTTPublishInfo_t * pPublishInfo,
+                                    MQTTOperationStatusCallback_t callback,
+                                    MQTTAgentPriority_t priority,
+                                    TickType_t timeoutTicks )
+{
+    return prvPublishCopy( xAgent, pPublishInfo, callback, priority, MQTT_AGENT_FLAG_LATEST_VALUE, timeoutTicks );
+}
+
+static BaseType_t prvRegisterSubscription( MQTTAgent_t * pAgent,
+                                           const char * pTopicFilter,
+                                           uint16_t topicFilterLength,
+                                           MQTTAgentIncomingPublishCallback_t callback,
+                                           void * pCallbackContext,
+                                           BaseType_t deferred )
+{
+    MQTTAgentRouterNode_t * pNode;
+    BaseType_t result = pdFALSE;
+
+    configASSERT( pTopicFilter != NULL );
+    configASSERT( callback != NULL );
+
+    agentENTER_CRITICAL();
+    {
+        pNode = prvRouterFindNode( pAgent, pTopicFilter, topicFilterLength, pdTRUE );
+
+        if( ( pNode != NULL ) && ( pNode->callback == NULL ) )
+        {
+            pNode->pCallbackContext = pCallbackContext;
+            pNode->deferred = deferred;
+            pNode->callback = callback;
+            result = pdTRUE;
+        }
+    }
+    agentEXIT_CRITICAL();
+
+    if( result != pdTRUE )
+    {
+        PRINTF( "MQTT Agent failed to register a topic filter.\r\n" );
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MQTTAgent_RegisterSubscription( MQTTAgentHandle_t xAgent,
+                                           const char * pTopicFilter,
+                                           uint16_t topicFilterLength,
+                                           MQTTAgentIncomingPublishCallback_t callback,
+                                           void * pCallbackContext )
+{
+    return prvRegisterSubscription( prvGetAgent( xAgent ), pTopicFilter, topicFilterLength, callback, pCallbackContext, pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MQTTAgent_RegisterSubscriptionDeferred( MQTTAgentHandle_t xAgent,
+                                                   const char * pTopicFilter,
+                                                   uint16_t topicFilterLength,
+                                                   MQTTAgentIncomingPublishCallback_t callback,
+                                                   void * pCallbackContext )
+{
+    return prvRegisterSubscription( prvGetAgent( xAgent ), pTopicFilter, topicFilterLength, callback, pCallbackContext, pdTRUE );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MQTTAgent_RegisterStreamSubscription( MQTTAgentHandle_t xAgent,
+                                                 const char * pTopicFilter,
+                                                 uint16_t topicFilterLength,
+                                                 MQTTAgentIncomingStreamCallback_t callback,
+                                                 void * pCallbackContext )
+{
+    BaseType_t result = pdFALSE;
+
+    #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+        MQTTAgent_t * pAgent = prvGetAgent( xAgent );
+        MQTTAgentRouterNode_t * pNode;
+
+        configASSERT( pTopicFilter != NULL );
+        configASSERT( callback != NULL );
+
+        agentENTER_CRITICAL();
+        {
+            pNode = prvRouterFindNode( pAgent, pTopicFilter, topicFilterLength, pdTRUE );
+
+            if( ( pNode != NULL ) && ( pNode->streamCallback == NULL ) )
+            {
+                pNode->pStreamContext = pCallbackContext;
+                pNode->streamCallback = callback;
+                result = pdTRUE;
+            }
+        }
+        agentEXIT_CRITICAL();
+    #else
+        ( void ) xAgent;
+        ( void ) pTopicFilter;
+        ( void ) topicFilterLength;
+        ( void ) callback;
+        ( void ) pCallbackContext;
+    #endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
+
+    if( result != pdTRUE )
+    {
+        PRINTF( "MQTT Agent failed to register a topic filter.\r\n" );
+    }
+
+    return result;
+}
+
+BaseType_t MQTTAgent_RemoveSubscription( MQTTAgentHandle_t xAgent,
+                                         const char * pTopicFilter,
+                                         uint16_t topicFilterLength )
+{
+    MQTTAgent_t * pAgent = prvGetAgent( xAgent );
+    MQTTAgentRouterNode_t * pNode;
+    BaseType_t result = pdFALSE;
+
+    agentENTER_CRITICAL();
+    {
+        pNode = prvRouterFindNode( pAgent, pTopicFilter, topicFilterLength, pdFALSE );
+
+        /* The nodes are kept in the trie, to be reused if the filter is registered again. */
+        if( ( pNode != NULL ) && ( pNode->callback != NULL ) )
+        {
+            pNode->callback = NULL;
+            result = pdTRUE;
+        }
+
+        #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+            if( ( pNode != NULL ) && ( pNode->streamCallback != NULL ) )
+            {
+                pNode->streamCallback = NULL;
+                result = pdTRUE;
+            }
+        #endif
+    }
+    agentEXIT_CRITICAL();
+
+    return result;
+}
+
+void MQTTAgent_GetStats( MQTTAgentHandle_t xAgent,
+                         MQTTAgentStats_t * pStats )
+{
+    MQTTAgent_t * pAgent = prvGetAgent( xAgent );
+
+    configASSERT( pStats != NULL );
+
+    #if ( MQTT_AGENT_STATS_ENABLED == 1 )
+        agentENTER_CRITICAL();
+        {
+            *pStats = pAgent->agentStats;
+            pStats->pendingAcks = pAgent->uxReservedOperations;
+        }
+        agentEXIT_CRITICAL();
+
+        if( pAgent->isAgentRunning == pdTRUE )
+        {
+            pStats->queueDepth = uxQueueMessagesWaiting( pAgent->xControlQueue ) + uxQueueMessagesWaiting( pAgent->xOperationsQueue );
+        }
+    #else
+        ( void ) pAgent;
+        memset( pStats, 0x00, sizeof( MQTTAgentStats_t ) );
+    #endif
+}
+
+void MQTTAgent_Wakeup( MQTTAgentHandle_t xAgent )
+{
+    TaskHandle_t xHandle = prvGetAgent( xAgent )->xAgentTaskHandle;
+
+    if( xHandle != NULL )
+    {
+        ( void ) xTaskNotifyGive( xHandle );
+    }
+}
+
+void MQTTAgent_SetReconnectCallback( MQTTAgentHandle_t xAgent,
+                                     MQTTAgentReconnectCallback_t callback )
+{
+    prvGetAgent( xAgent )->xReconnectCallback = callback;
+}
+
+void MQTTAgent_SetDrainCallback( MQTTAgentHandle_t xAgent,
+                                 MQTTAgentDrainCallback_t callback )
+{
+    prvGetAgent( xAgent )->xDrainCallback = callback;
+}
+
+void MQTTAgent_SetReceiveReadyCallback( MQTTAgentHandle_t xAgent,
+                                        MQTTAgentReceiveReadyCallback_t callback )
+{
+    prvGetAgent( xAgent )->xReceiveReadyCallback = callback;
+    MQTTAgent_Wakeup( xAgent );
+}
+
+void MQTTAgent_SetDataPendingCallback( MQTTAgentHandle_t xAgent,
+                                       MQTTAgentDataPendingCallback_t callback )
 {
-    return xQueueSend( xOperationsQueue, &pOperation, timeoutTicks );
+    #if ( MQTT_AGENT_EVENT_DRIVEN == 1 )
+        prvGetAgent( xAgent )->xDataPendingCallback = callback;
+    #else
+        ( void ) xAgent;
+        ( void ) callback;
+    #endif
 }
@@ -39,6 +39,21 @@
 /* MQTT library include */
 #include "core_mqtt.h"
 
+/**
+ * @brief Maximum number of agent instances, each serving one MQTT connection from its own task, such as
+ * a telemetry connection and a dedicated OTA connection. An instance takes about 4 KB of RAM for its
+ * pending operations table, topic filter trie, batch buffer and subscription counts, besides its task.
+ */
+#ifndef MQTT_AGENT_MAX_INSTANCES
+    #define MQTT_AGENT_MAX_INSTANCES    ( 1 )
+#endif
+
+/**
+ * @brief Handle of an agent instance. The APIs taking a handle select the first instance bound, usually
+ * the telemetry connection, when passed NULL.
+ */
+typedef struct MQTTAgent * MQTTAgentHandle_t;
+
 /**
  * @brief Forward declaration of MQTT operation struct.
  * The struct is used by the application to enqueue an MQTT operation to be processed
@@ -49,7 +64,8 @@ struct MQTTOperation;
 /**
  * @brief Callback invoked by MQTT agent to notify the status of MQTT operation.
  * The callback will be invoked on a sucessful sent if its Qos0 publish, or when an ACK packet
- * is received for Qos1,2 publishes, subscribe and unsubscribe.
+ * is received for Qos1,2 publishes, subscribe and unsubscribe. It is invoked from the agent task, or from
+ * its worker task when MQTT_AGENT_CALLBACK_WORKER is 1, in which case it may block.
  *
  * @param[in] pOperation Pointer to the MQTT operation structure passed from application.
  * @param[in] status Status of the MQTT operation.
@@ -57,6 +73,90 @@ struct MQTTOperation;
 typedef void ( * MQTTOperationStatusCallback_t ) ( struct MQTTOperation * pOperation,
                                                    MQTTStatus_t status );
 
+/**
+ * @brief Callback invoked by MQTT agent to check if the transport has received data which is not read yet.
+ * The agent uses it in event driven mode to read all buffered MQTT packets on a single wake up.
+ *
+ * @param[in] pNetworkContext The network context set in the MQTT transport interface.
+ * @return pdTRUE if there is data available to be read from the transport.
+ */
+typedef BaseType_t ( * MQTTAgentDataPendingCallback_t ) ( NetworkContext_t * pNetworkContext );
+
+/**
+ * @brief Callback invoked by MQTT agent for an incoming publish matching a registered topic filter.
+ * The callback is invoked from the agent task. The publish information, topic and payload point directly
+ * into the MQTT network buffer and are valid only until the callback returns, so the callback should copy
+ * what it needs and must not block.
+ *
+ * @param[in] pCallbackContext The context registered with the topic filter.
+ * @param[in] pPublishInfo Deserialized incoming publish.
+ */
+typedef void ( * MQTTAgentIncomingPublishCallback_t ) ( void * pCallbackContext,
+                                                        MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Set to 1 to support the subscriptions registered with MQTTAgent_RegisterStreamSubscription(), which
+ * receive the payload of their publishes in chunks as it is read from the transport. Only the fixed header,
+ * topic and packet identifier of such a publish go through the MQTT network buffer, so the buffer only has to
+ * hold the largest publish of the other subscriptions.
+ */
+#ifndef MQTT_AGENT_STREAM_RECEIVE
+    #define MQTT_AGENT_STREAM_RECEIVE    ( 1 )
+#endif
+
+/**
+ * @brief Callback invoked by MQTT agent for each chunk of the payload of an incoming publish matching a stream
+ * subscription, in order and from the agent task. The publish information holds the topic, QoS and flags, its
+ * payloadLength is the length of the whole payload and its pPayload is NULL. The topic and the chunk are valid
+ * only until the callback returns, so the callback should copy what it needs and must not block.
+ * The payload is complete once offset + chunkLength reaches payloadLength, a publish without payload is
+ * delivered as a single empty chunk. The broker is acknowledged after the last chunk. If the connection is lost
+ * before, the callback is invoked once more with a NULL chunk to drop the partial payload.
+ *
+ * @param[in] pCallbackContext The context registered with the topic filter.
+ * @param[in] pPublishInfo The incoming publish, without its payload.
+ * @param[in] offset Offset of the chunk in the payload.
+ * @param[in] pChunk The chunk, NULL if the publish is dropped.
+ * @param[in] chunkLength Length of the chunk.
+ */
+typedef void ( * MQTTAgentIncomingStreamCallback_t ) ( void * pCallbackContext,
+                                                       const MQTTPublishInfo_t * pPublishInfo,
+                                                       size_t offset,
+                                                       const uint8_t * pChunk,
+                                                       size_t chunkLength );
+
+/**
+ * @brief Callback invoked by MQTT agent to reconnect with the broker after the connection is lost.
+ * The callback should close the broken transport connection, establish a new one and send a CONNECT
+ * packet with cleanSession set to false to resume the session. It is invoked from the agent task,
+ * with a back off between failed attempts, until it succeeds.
+ *
+ * @param[in] pMQTTContext The MQTT context used by the agent.
+ * @param[out] pSessionPresent Set to true if the broker resumed the session.
+ * @return pdTRUE if the MQTT connection is established.
+ */
+typedef BaseType_t ( * MQTTAgentReconnectCallback_t ) ( MQTTContext_t * pMQTTContext,
+                                                        bool * pSessionPresent );
+
+/**
+ * @brief Callback invoked by MQTT agent on every wake up, before it processes the queued operations.
+ * It lets the application hand over work collected outside of the agent queues, such as the
+ * publishes of the restricted tasks, by enqueuing operations with a timeout of 0. It is invoked from
+ * the agent task and must not block.
+ */
+typedef void ( * MQTTAgentDrainCallback_t ) ( void );
+
+/**
+ * @brief Callback invoked by MQTT agent before it reads an incoming packet, to apply backpressure on the
+ * broker instead of dropping the publishes a consumer has no buffer for. While it returns pdFALSE the agent
+ * leaves the packets in the socket, so the TCP window closes, and keeps sending the queued operations.
+ * Call MQTTAgent_Wakeup() once the consumer can take packets again. It is invoked from the agent task
+ * and must not block.
+ *
+ * @return pdTRUE if the agent may read the next packet.
+ */
+typedef BaseType_t ( * MQTTAgentReceiveReadyCallback_t ) ( void );
+
 /**
  * @brief Definitions for all MQTT operation types handled by the MQTT agent.
  */
@@ -65,23 +165,72 @@ typedef enum MQTTOperationType
     MQTT_OP_PUBLISH = 0,
     MQTT_OP_SUBSCRIBE,
     MQTT_OP_UNSUBSCRIBE,
+    MQTT_OP_PUBLISH_BATCH,
     MQTT_OP_RECEIVE,
     MQTT_OP_STOP
 } MQTTOperationType_t;
 
+/**
+ * @brief Priority lanes of the MQTT agent operations queue.
+ * Control operations are processed ahead of bulk operations. To avoid starving bulk traffic, at most
+ * MQTT_AGENT_CONTROL_BURST_MAX control operations are processed in a row while bulk operations are waiting,
+ * so a control operation waits at most for one bulk operation to complete.
+ */
+typedef enum MQTTAgentPriority
+{
+    MQTT_AGENT_PRIORITY_BULK = 0, /**< Default lane, used for application telemetry. */
+    MQTT_AGENT_PRIORITY_CONTROL   /**< Lane for latency sensitive control traffic such as OTA jobs. */
+} MQTTAgentPriority_t;
+
 /**
  * @brief Structure used to hold parameters for MQTT operation enqueued with the agent.
  */
 typedef union MQTTOperationInfo
 {
     MQTTPublishInfo_t * pPublishInfo;
+
+    /**
+     * @brief Parameters for MQTT_OP_SUBSCRIBE and MQTT_OP_UNSUBSCRIBE. With MQTT_AGENT_COALESCE_SUBSCRIPTIONS,
+     * the agent sends the operations of the same type dequeued within MQTT_AGENT_COALESCE_WINDOW_MS in one
+     * packet and invokes their callbacks on its ACK. A filter already subscribed with at least the requested
+     * QoS is not sent again, and a filter is only unsubscribed by the last of the operations which subscribed
+     * it; such operations complete without waiting for the broker. The list must remain valid until the
+     * callback is invoked.
+     */
     struct
     {
         MQTTSubscribeInfo_t * pSubscriptionList;
         uint16_t numSubscriptions;
     } subscriptionInfo;
+
+    /**
+     * @brief Parameters for MQTT_OP_PUBLISH_BATCH. The agent coalesces the publishes into as few
+     * transport writes as possible and invokes the operation callback once, after all the messages
+     * are sent. The send status of each message is written to pStatusList, if not NULL.
+     * QoS1 and QoS2 messages are tracked by the MQTT library but their ACKs are not reported.
+     */
+    struct
+    {
+        MQTTPublishInfo_t * pPublishList;
+        MQTTStatus_t * pStatusList;
+        uint16_t numPublishes;
+    } publishBatchInfo;
 } MQTTOperationInfo_t;
 
+/**
+ * @brief Flag of an MQTT_OP_PUBLISH operation carrying the state of its topic, of which only the latest value
+ * matters. While such a publish waits in the queues, a newer one flagged for the same topic replaces it without
+ * taking another queue entry, and the replaced operation completes with MQTT_AGENT_STATUS_SUPERSEDED. The newer
+ * publish is sent in the place, and the lane, of the one it replaces.
+ */
+#define MQTT_AGENT_FLAG_LATEST_VALUE    ( 1U << 0 )
+
+/**
+ * @brief Status passed to the callback of a publish replaced before it was sent, see MQTT_AGENT_FLAG_LATEST_VALUE.
+ * The callback is invoked from the task enqueuing the newer publish. The value is not used by the coreMQTT library.
+ */
+#define MQTT_AGENT_STATUS_SUPERSEDED    ( ( MQTTStatus_t ) 0x80 )
+
 /**
  * @brief Structure used to hold the MQTT operation enqueued with the MQTT agent.
  */
@@ -91,12 +240,73 @@ typedef struct MQTTOperation
     MQTTOperationInfo_t info;
     MQTTOperationStatusCallback_t callback;
     uint16_t packetIdentifier;
+    MQTTAgentPriority_t priority;
+    uint8_t flags;          /**< MQTT_AGENT_FLAG_ values, 0 for none. */
+    uint32_t enqueueTime;   /**< Set by the agent, monotonic clock in microseconds when the operation was enqueued. */
+    uint32_t sendTime;      /**< Set by the agent, monotonic clock in microseconds when the operation was processed. */
 } MQTTOperation_t;
 
+/**
+ * @brief Number of buckets of the latency histograms in the agent statistics.
+ * Upper bounds of the buckets are 10, 20, 50, 100, 200, 500 and 1000 ms, the last bucket
+ * counts the latencies of 1000 ms or more.
+ */
+#define MQTT_AGENT_STATS_HISTOGRAM_BUCKETS    ( 8U )
+
+/**
+ * @brief Number of operation types with statistics, indexed by MQTTOperationType_t.
+ */
+#define MQTT_AGENT_STATS_OPERATION_TYPES      ( MQTT_OP_PUBLISH_BATCH + 1 )
+
+/**
+ * @brief Statistics for one type of MQTT operation.
+ * Time to ACK is measured from the operation being sent until the ACK is received, only for
+ * QoS1/QoS2 publishes, subscribes and unsubscribes.
+ */
+typedef struct MQTTAgentOperationStats
+{
+    uint32_t enqueued;         /**< Operations successfully enqueued. */
+    uint32_t completed;        /**< Operations completed with success. */
+    uint32_t failed;           /**< Operations completed with an error. */
+    uint32_t totalQueueTimeMs; /**< Sum of the time operations waited in the queue. */
+    uint32_t maxQueueTimeMs;   /**< Maximum time an operation waited in the queue. */
+    uint32_t totalAckTimeMs;   /**< Sum of the time to ACK. */
+    uint32_t maxAckTimeMs;     /**< Maximum time to ACK. */
+    uint32_t ackTimeHistogram[ MQTT_AGENT_STATS_HISTOGRAM_BUCKETS ];
+} MQTTAgentOperationStats_t;
+
+/**
+ * @brief Runtime statistics of the MQTT agent.
+ */
+typedef struct MQTTAgentStats
+{
+    MQTTAgentOperationStats_t operations[ MQTT_AGENT_STATS_OPERATION_TYPES ];
+    uint32_t refused;             /**< Enqueue calls refused because of a full queue or backpressure. */
+    uint32_t receivePauses;       /**< Times the agent stopped reading the socket for MQTTAgentReceiveReadyCallback_t. */
+    uint32_t workerFallbacks;     /**< Deferred callbacks run in the agent task because the worker queue or slabs were full. */
+    uint32_t superseded;          /**< Latest value publishes replaced by a newer one before they were sent. */
+    UBaseType_t queueDepth;       /**< Operations currently waiting in the queues. */
+    UBaseType_t maxQueueDepth;    /**< Maximum number of operations seen waiting in a queue. */
+    UBaseType_t pendingAcks;      /**< Operations currently holding a slot for an ACK. */
+    UBaseType_t maxPendingAcks;   /**< Maximum number of operations holding a slot for an ACK. */
+} MQTTAgentStats_t;
+
+/**
+ * @brief Gets the agent instance serving an MQTT context, binding a free instance to the context the
+ * first time. The callbacks of the instance can be set with the handle before MQTTAgent_Init().
+ *
+ * @param[in] pContext The coreMQTT library MQTT context.
+ * @return The handle, NULL if MQTT_AGENT_MAX_INSTANCES contexts are already bound. NULL must not be
+ * passed to the other APIs, it would select the first instance.
+ */
+MQTTAgentHandle_t MQTTAgent_GetHandle( MQTTContext_t * pContext );
+
 /**
  * @brief Initializes Agent task and creates the queue for MQTT operations.
- * Enqueues an MQTT receive operation by default.
- * The API should be called after an MQTT connection is established.
+ * In polling mode, enqueues an MQTT receive operation by default.
+ * The API should be called after an MQTT connection is established. Each MQTT context gets its own
+ * instance, see MQTTAgent_GetHandle(). After MQTTAgent_Stop() it resumes the kept task and queues
+ * instead of creating them again, and fails if the agent of the context is running.
  *
  * @param[in] pContext The corteMQTT library MQTT context.
  * @return pdTRUE if the initialization was successful.
@@ -107,18 +317,62 @@ BaseType_t MQTTAgent_Init( MQTTContext_t * pContext );
 /*
  * @brief Enqueues an MQTT operation to be executed in agent context.
  * Result of the operation will be available using MQTTOperationStatusCallback_t.
+ * @param[in] xAgent The agent, NULL for the first instance.
  * @param[in] pOperation Pointer to the structure containing operation type and params.
  * @param[in] timeoutTicks Timeout in ticks API blocks for enqueue operation to succeed.
- * @return pdTRUE If the operation was successfully enqueued with the agent.
+ * @return pdTRUE If the operation was successfully enqueued with the agent. pdFALSE if the queue is full or,
+ * for operations which require an ACK, if the maximum number of operations are already waiting for an ACK.
+ * The application should retry the operation later.
  */
-BaseType_t MQTTAgent_Enqueue( MQTTOperation_t * pOperation,
+BaseType_t MQTTAgent_Enqueue( MQTTAgentHandle_t xAgent,
+                              MQTTOperation_t * pOperation,
                               TickType_t timeoutTicks );
 
+/**
+ * @brief Enqueues a publish after copying its topic and payload into a slab of the agent arena.
+ * Unlike MQTTAgent_Enqueue(), the caller does not have to keep the publish information, topic, payload
+ * or operation valid until completion, and does not have to wait for it. The slab is recycled once the
+ * publish is sent for QoS0, or acknowledged for QoS1/QoS2. The arena is shared by the instances.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pPublishInfo The publish to be copied. Topic and payload together must fit in
+ * MQTT_AGENT_ARENA_SLAB_SIZE bytes.
+ * @param[in] callback Optional callback invoked when the publish is complete. The operation passed to it
+ * is owned by the agent and is valid only until the callback returns.
+ * @param[in] priority Lane to enqueue the publish to.
+ * @param[in] timeoutTicks Timeout in ticks to wait for a free slab and for the enqueue to succeed.
+ * @return pdTRUE if the publish was copied and enqueued.
+ */
+BaseType_t MQTTAgent_PublishCopy( MQTTAgentHandle_t xAgent,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  MQTTOperationStatusCallback_t callback,
+                                  MQTTAgentPriority_t priority,
+                                  TickType_t timeoutTicks );
+
+/**
+ * @brief Enqueues a publish like MQTTAgent_PublishCopy(), flagged with MQTT_AGENT_FLAG_LATEST_VALUE. A copy of
+ * the topic still waiting to be sent is replaced and its slab recycled, so a state published periodically takes
+ * a single slab and queue entry while the connection is down.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pPublishInfo The publish to be copied.
+ * @param[in] callback Optional callback invoked when the publish is complete or replaced.
+ * @param[in] priority Lane to enqueue the publish to, unless it replaces a publish waiting in another lane.
+ * @param[in] timeoutTicks Timeout in ticks to wait for a free slab and for the enqueue to succeed.
+ * @return pdTRUE if the publish was copied and enqueued.
+ */
+BaseType_t MQTTAgent_PublishLatest( MQTTAgentHandle_t xAgent,
+                                    const MQTTPublishInfo_t * pPublishInfo,
+                                    MQTTOperationStatusCallback_t callback,
+                                    MQTTAgentPriority_t priority,
+                                    TickType_t timeoutTicks );
+
 /*
  * @brief Handler invoked for incoming MQTT packets to the MQTT agent.
  * The API is invoked from the main MQTT event callback on every packet received on the MQTT
- * connection. The agent should process only ACK packets and invokes the application task callbacks.
- * It should return pdFALSE for all other packets indicating further processing is required.
+ * connection. The agent processes ACK packets and incoming publishes matching a registered topic filter and
+ * invokes the application task callbacks. It returns pdFALSE for all other packets indicating further processing
+ * is required. The packet is handled by the instance serving the MQTT context.
  *
  * @param[in] pMQTTContext Pointer to the context used by the coreMQTT library.
  * @param[in] pPacketInfo Pointer to the MQTT packet information.
@@ -131,9 +385,154 @@ BaseType_t MQTTAgent_ProcessEvent( MQTTContext_t * pMQTTContext,
                                    struct MQTTDeserializedInfo * pDeserializedInfo );
 
 /**
- * @brief Stops the agent task and deletes the queue.
- * Should be called before disconnecting an MQTT connection.
+ * @brief Registers a callback for incoming publishes matching a topic filter.
+ * Filters are stored in a statically allocated trie of topic levels, so an incoming publish is matched against
+ * all the registered filters in a single pass over its topic levels. If several filters match a topic, all
+ * their callbacks are invoked. The API only routes incoming publishes, the application should still subscribe
+ * to the filter with an MQTT_OP_SUBSCRIBE operation. Each instance has its own trie.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pTopicFilter The topic filter, which can contain '+' and '#' wildcards. The filter is not copied
+ * and must remain valid as long as the agent is used.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] callback Callback invoked for the matching publishes.
+ * @param[in] pCallbackContext Context passed to the callback.
+ * @return pdTRUE if the callback was registered, pdFALSE if the filter already has a callback or there is no
+ * space left in the trie.
+ */
+BaseType_t MQTTAgent_RegisterSubscription( MQTTAgentHandle_t xAgent,
+                                           const char * pTopicFilter,
+                                           uint16_t topicFilterLength,
+                                           MQTTAgentIncomingPublishCallback_t callback,
+                                           void * pCallbackContext );
+
+/**
+ * @brief Registers a callback for incoming publishes matching a topic filter, invoked from the worker task
+ * of the agent at MQTT_AGENT_WORKER_TASK_PRIORITY when MQTT_AGENT_CALLBACK_WORKER is 1, see
+ * MQTTAgent_RegisterSubscription(). The agent copies each matching publish of up to MQTT_AGENT_WORKER_SLAB_SIZE
+ * bytes of topic and payload, so the callback may block, and the pointers are valid until it returns. Larger
+ * publishes, and publishes received while all the copies are in use, are delivered from the agent task.
+ * Without the worker, the callback is always invoked from the agent task.
+ * A callback removed with MQTTAgent_RemoveSubscription() may still be invoked for the publishes received before.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pTopicFilter The topic filter, which can contain '+' and '#' wildcards. The filter is not copied
+ * and must remain valid as long as the agent is used.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] callback Callback invoked for the matching publishes.
+ * @param[in] pCallbackContext Context passed to the callback.
+ * @return pdTRUE if the callback was registered, pdFALSE if the filter already has a callback or there is no
+ * space left in the trie.
+ */
+BaseType_t MQTTAgent_RegisterSubscriptionDeferred( MQTTAgentHandle_t xAgent,
+                                                   const char * pTopicFilter,
+                                                   uint16_t topicFilterLength,
+                                                   MQTTAgentIncomingPublishCallback_t callback,
+                                                   void * pCallbackContext );
+
+/**
+ * @brief Registers a callback receiving the payload of the incoming publishes matching a topic filter in chunks,
+ * see MQTTAgentIncomingStreamCallback_t. The payload is read from the transport into a chunk buffer of the agent,
+ * so it does not have to fit in the MQTT network buffer. A publish matching a stream subscription is delivered to
+ * the first one found and not to the callbacks registered with MQTTAgent_RegisterSubscription(). Topics of more
+ * than MQTT_AGENT_STREAM_TOPIC_SIZE bytes are not streamed. Returns pdFALSE if MQTT_AGENT_STREAM_RECEIVE is 0.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pTopicFilter The topic filter, which can contain '+' and '#' wildcards. The filter is not copied
+ * and must remain valid as long as the agent is used.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] callback Callback invoked for the chunks of the matching publishes.
+ * @param[in] pCallbackContext Context passed to the callback.
+ * @return pdTRUE if the callback was registered, pdFALSE if the filter already has a stream callback or there is
+ * no space left in the trie.
+ */
+BaseType_t MQTTAgent_RegisterStreamSubscription( MQTTAgentHandle_t xAgent,
+                                                 const char * pTopicFilter,
+                                                 uint16_t topicFilterLength,
+                                                 MQTTAgentIncomingStreamCallback_t callback,
+                                                 void * pCallbackContext );
+
+/**
+ * @brief Removes the callback registered for a topic filter, and its stream callback.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] pTopicFilter The topic filter used to register the callback.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @return pdTRUE if a callback was removed.
+ */
+BaseType_t MQTTAgent_RemoveSubscription( MQTTAgentHandle_t xAgent,
+                                         const char * pTopicFilter,
+                                         uint16_t topicFilterLength );
+
+/**
+ * @brief Wakes up the agent task to process incoming data.
+ * The API should be invoked when the underlying socket receives data, for example from the
+ * socket wake up callback. It is safe to be called from any task context.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ */
+void MQTTAgent_Wakeup( MQTTAgentHandle_t xAgent );
+
+/**
+ * @brief Sets the callback used by the agent to check if the transport has buffered data.
+ * If no callback is set, the agent reads at most one packet on every wake up.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] callback The callback to check pending data in the transport.
+ */
+void MQTTAgent_SetDataPendingCallback( MQTTAgentHandle_t xAgent,
+                                       MQTTAgentDataPendingCallback_t callback );
+
+/**
+ * @brief Sets the callback invoked by the agent on every wake up, see MQTTAgentDrainCallback_t.
+ * Wake the agent with MQTTAgent_Wakeup() when there is work for the callback.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] callback The callback, or NULL to remove it.
+ */
+void MQTTAgent_SetDrainCallback( MQTTAgentHandle_t xAgent,
+                                 MQTTAgentDrainCallback_t callback );
+
+/**
+ * @brief Sets the callback pausing the reception of packets, see MQTTAgentReceiveReadyCallback_t.
+ * The keep alive of the connection is not checked while the reception is paused, so pauses should stay
+ * well below the keep alive interval.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] callback The callback, or NULL to read packets as they arrive.
+ */
+void MQTTAgent_SetReceiveReadyCallback( MQTTAgentHandle_t xAgent,
+                                        MQTTAgentReceiveReadyCallback_t callback );
+
+/**
+ * @brief Gets a snapshot of the agent runtime statistics.
+ * Statistics are kept across agent restarts. All values are zero if MQTT_AGENT_STATS_ENABLED is 0.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[out] pStats Pointer to the structure to copy the statistics to.
+ */
+void MQTTAgent_GetStats( MQTTAgentHandle_t xAgent,
+                         MQTTAgentStats_t * pStats );
+
+/**
+ * @brief Sets the callback used by the agent to reconnect with the broker.
+ * When set, the agent reconnects on transport errors and resends the operations waiting for an ACK,
+ * so they complete once the broker acknowledges them on the new connection. Without a callback,
+ * transport errors are fatal.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
+ * @param[in] callback The callback to reconnect with the broker.
+ */
+void MQTTAgent_SetReconnectCallback( MQTTAgentHandle_t xAgent,
+                                     MQTTAgentReconnectCallback_t callback );
+
+/**
+ * @brief Stops the agent and waits for the agent task to acknowledge it. The queued operations are
+ * dropped, the task and the queues are kept for MQTTAgent_Init() to resume the agent.
+ * Should be called before disconnecting an MQTT connection, not from the agent task or its callbacks.
+ *
+ * @param[in] xAgent The agent, NULL for the first instance.
  */
-void MQTTAgent_Stop( void );
+void MQTTAgent_Stop( MQTTAgentHandle_t xAgent );
 
 #endif /* ifndef CORE_MQTT_AGENT_H */
@@ -60,6 +60,9 @@
 
 #include "logging_stack.h"
 
+/* Buffer sizes of the selected performance profile. */
+#include "perf_profile.h"
+
 /* The macro definition for MQTT_DO_NOT_USE_CUSTOM_CONFIG is for Doxygen
  * documentation only. */
 
@@ -95,10 +98,13 @@
  *
  * <b>Possible values:</b> Any positive 32 bit integer. <br>
  * <b>Default value:</b> `10`
+ *
+ * This demo keeps as many publishes in flight as the MQTT agent can track,
+ * see MQTT_AGENT_MAX_CONCURRENT_OPERATIONS, which democonfigPERF_PROFILE sets.
  */
 #ifndef MQTT_STATE_ARRAY_MAX_COUNT
     /* Default value for the maximum acknowledgment pending PUBLISH messages. */
-    #define MQTT_STATE_ARRAY_MAX_COUNT    ( 10U )
+    #define MQTT_STATE_ARRAY_MAX_COUNT    ( perfprofileAGENT_OPERATIONS )
 #endif
 
 /**
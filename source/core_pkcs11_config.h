@@ -124,6 +124,18 @@
  */
 #define pkcs11configJITP_CODEVERIFY_ROOT_CERT_SUPPORTED    0
 
+/**
+ * @brief Set to 1 to keep the parsed device certificate, with its public key,
+ * the parsed device private key and the parsed code signing key resident in RAM.
+ *
+ * The TLS transport then configures the cached certificate for each connection
+ * instead of exporting and parsing it from flash, and signs with the cached key
+ * instead of C_Sign, which reads and parses the key for every handshake. The code
+ * signing key is parsed when an OTA job starts, and verifies the image without
+ * C_Verify. The cache is invalidated when an object is saved or destroyed.
+ */
+#define pkcs11configPAL_CACHE_PARSED_OBJECTS               1
+
 /**
  * @brief The PKCS #11 label for device private key.
  *
@@ -153,6 +165,21 @@
  */
 #define pkcs11configLABEL_CODE_VERIFICATION_KEY            "Code Verify Key"
 
+/**
+ * @brief The PKCS #11 label for the TLS pre-shared key.
+ *
+ * Authenticates the device to brokers connected with NetworkCredentials_t.usePsk,
+ * at most MBEDTLS_PSK_MAX_LEN bytes.
+ */
+#define pkcs11configLABEL_TLS_PSK                          "TLS PSK"
+
+/**
+ * @brief The PKCS #11 label for the identity of the TLS pre-shared key.
+ *
+ * Sent in the clear in the ClientKeyExchange, for the broker to find the key.
+ */
+#define pkcs11configLABEL_TLS_PSK_IDENTITY                 "TLS PSK Identity"
+
 /**
  * @brief The PKCS #11 label for Just-In-Time-Provisioning.
  *
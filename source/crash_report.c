@@ -0,0 +1,562 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file crash_report.c
+ * @brief Snapshot of a fault kept in no-init RAM across an immediate reset, published on the next boot.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_debug_console.h"
+
+#include "core_mqtt_agent.h"
+#include "connection_manager.h"
+#include "heap_regions.h"
+
+#include "crash_report.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Topic the snapshot is published on, formatted with the thing name.
+ */
+#define crashreportTOPIC_FORMAT      "device/%.*s/crash"
+
+/**
+ * @brief Size of the buffer holding the topic.
+ */
+#define crashreportTOPIC_MAX_SIZE    ( 160U )
+
+/**
+ * @brief Topic the trace of the field profile is published on after the snapshot, formatted with
+ * the thing name. The payload is the raw RecorderDataType, which Tracealyzer opens as a memory dump.
+ */
+#define crashreportTRACE_TOPIC_FORMAT    "device/%.*s/crash/trace"
+
+/**
+ * @brief Number of words of the stack of the faulting context kept in the snapshot.
+ */
+#ifndef crashreportSTACK_WORDS
+    #define crashreportSTACK_WORDS    ( 16U )
+#endif
+
+/**
+ * @brief Size of the JSON payload buffer, about 14 bytes per stack word.
+ */
+#define crashreportPAYLOAD_MAX_SIZE    ( 384U + ( crashreportSTACK_WORDS * 14U ) )
+
+/**
+ * @brief Marks a snapshot written by CrashReport_Reset(), the RAM holds random data after a power on.
+ */
+#define crashreportMAGIC               ( 0xC4A5F00DUL )
+
+/**
+ * @brief Indexes of the pxStack and pcTaskName offsets in FreeRTOSDebugConfig, the layout of the
+ * TCB published for the debuggers by freertos_tasks_c_additions.h.
+ */
+#define crashreportDEBUG_CONFIG_PXSTACK    ( 9U )
+#define crashreportDEBUG_CONFIG_NAME       ( 10U )
+
+/**
+ * @brief EXC_RETURN bit cleared when the exception frame holds the FPU registers, and xPSR bit set when
+ * the frame was aligned to 8 bytes with a padding word.
+ */
+#define crashreportEXC_RETURN_BASIC_FRAME    ( 1UL << 4 )
+#define crashreportPSR_STACK_ALIGN           ( 1UL << 9 )
+
+/**
+ * @brief Words of the basic and of the FPU exception frames.
+ */
+#define crashreportBASIC_FRAME_WORDS    ( 8U )
+#define crashreportFPU_FRAME_WORDS      ( 26U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Registers stacked by the processor on exception entry, in the order of the frame.
+ */
+typedef enum CrashRegister
+{
+    CRASH_REGISTER_R0 = 0,
+    CRASH_REGISTER_R1,
+    CRASH_REGISTER_R2,
+    CRASH_REGISTER_R3,
+    CRASH_REGISTER_R12,
+    CRASH_REGISTER_LR,
+    CRASH_REGISTER_PC,
+    CRASH_REGISTER_PSR,
+    CRASH_REGISTER_COUNT
+} CrashRegister_t;
+
+/**
+ * @brief Snapshot kept across the reset, the checksum covers all the fields after it.
+ */
+typedef struct CrashSnapshot
+{
+    uint32_t ulMagic;
+    uint32_t ulChecksum;
+    uint32_t ulFault;                                  /**< CrashFault_t. */
+    uint32_t ulRegisters[ CRASH_REGISTER_COUNT ];      /**< Exception frame, 0 when it was not readable. */
+    uint32_t ulExcReturn;                              /**< EXC_RETURN of the handler. */
+    uint32_t ulSp;                                     /**< Stack pointer of the faulting context. */
+    uint32_t ulStackBase;                              /**< pxStack of the task, lowest address of its stack. */
+    uint32_t ulCfsr;                                   /**< MemManage, bus and usage fault status. */
+    uint32_t ulHfsr;                                   /**< HardFault status. */
+    uint32_t ulMmfar;                                  /**< MemManage fault address. */
+    uint32_t ulBfar;                                   /**< Bus fault address. */
+    char cTaskName[ configMAX_TASK_NAME_LEN ];         /**< Task running when the fault was taken. */
+    uint32_t ulStackWords;                             /**< Number of words in ulStack. */
+    uint32_t ulStack[ crashreportSTACK_WORDS ];        /**< Stack above the exception frame. */
+} CrashSnapshot_t;
+
+/**
+ * @brief RAM of the memory map in Demo.ld, the only memory the fault path reads from.
+ */
+typedef struct CrashRamRange
+{
+    uint32_t ulStart;
+    uint32_t ulEnd;
+} CrashRamRange_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Current TCB and TCB layout of the kernel, read without the kernel API which may not be
+ * callable from the fault.
+ */
+extern void * volatile pxCurrentTCB;
+extern const uint8_t FreeRTOSDebugConfig[];
+
+/**
+ * @brief The snapshot, in USB_RAM which no startup code nor the bootloader touches.
+ */
+static CrashSnapshot_t xSnapshot heapregionsUSB_RAM_NOINIT;
+
+static const CrashRamRange_t xRamRanges[] =
+{
+    { 0x00000000UL, 0x00030000UL }, /* SRAMX and SRAMX_FASTCODE. */
+    { 0x20000000UL, 0x20028000UL }, /* SRAM_0_1_2_3 and SRAM_0_1_2_3_UNUSED. */
+    { 0x40100000UL, 0x40102000UL }, /* USB_RAM. */
+    #if ( BOARD_SDRAM_ENABLED == 1 )
+        { 0xA0000000UL, 0xA1000000UL }, /* BOARD_SDRAM. */
+    #endif
+};
+
+static const char * const pcFaultNames[] = { "hard", "memmanage", "stack_overflow" };
+
+/**
+ * @brief Publish owned by the agent until it is acknowledged, the payload is larger than an arena slab.
+ */
+static ConnectionPublish_t xPublish;
+static char cTopic[ crashreportTOPIC_MAX_SIZE ];
+static char cPayload[ crashreportPAYLOAD_MAX_SIZE ];
+static size_t xPayloadLength = 0;
+
+#if ( TRC_CFG_FIELD_PROFILE == 1 )
+
+/**
+ * @brief Trace recorder buffer of the field profile, next to the snapshot so that it survives the reset.
+ */
+    static RecorderDataType xTraceData heapregionsUSB_RAM_NOINIT;
+    static BaseType_t xTraceKept = pdFALSE;
+    static char cTraceTopic[ crashreportTOPIC_MAX_SIZE ];
+#endif
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvChecksum( void )
+{
+    const uint32_t * pulWord = &xSnapshot.ulFault;
+    const uint32_t * pulEnd = ( const uint32_t * ) ( &xSnapshot + 1 );
+    uint32_t ulSum = crashreportMAGIC;
+
+    while( pulWord < pulEnd )
+    {
+        /* Rotated so that swapped words do not cancel out. */
+        ulSum = ( ( ulSum << 5 ) | ( ulSum >> 27 ) ) ^ *pulWord++;
+    }
+
+    return ulSum;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Counts the words readable from an address, up to ulWords, without leaving its RAM range.
+ */
+static uint32_t prvReadableWords( uint32_t ulAddress,
+                                  uint32_t ulWords )
+{
+    uint32_t ulReadable = 0;
+    size_t i;
+
+    if( ( ulAddress & 3UL ) != 0UL )
+    {
+        return 0;
+    }
+
+    for( i = 0; i < ( sizeof( xRamRanges ) / sizeof( xRamRanges[ 0 ] ) ); i++ )
+    {
+        if( ( ulAddress >= xRamRanges[ i ].ulStart ) && ( ulAddress < xRamRanges[ i ].ulEnd ) )
+        {
+            ulReadable = ( xRamRanges[ i ].ulEnd - ulAddress ) / sizeof( uint32_t );
+        }
+    }
+
+    return ( ulReadable < ulWords ) ? ulReadable : ulWords;
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashReport_Reset( CrashFault_t xFault,
+                        const uint32_t * pulFaultStack,
+                        uint32_t ulExcReturn )
+{
+    const uint8_t * pucTCB = ( const uint8_t * ) pxCurrentTCB;
+    const uint32_t * pulStack;
+    uint32_t ulTCBWords = ( FreeRTOSDebugConfig[ crashreportDEBUG_CONFIG_NAME ] + configMAX_TASK_NAME_LEN + 3U ) / 4U;
+    uint32_t ulAddress;
+    uint32_t i;
+
+    /* No library call, the fault may come from the library or leave little stack. */
+    for( i = 0; i < ( sizeof( xSnapshot ) / sizeof( uint32_t ) ); i++ )
+    {
+        ( ( uint32_t * ) &xSnapshot )[ i ] = 0;
+    }
+
+    xSnapshot.ulFault = ( uint32_t ) xFault;
+    xSnapshot.ulCfsr = SCB->CFSR;
+    xSnapshot.ulHfsr = SCB->HFSR;
+    xSnapshot.ulMmfar = SCB->MMFAR;
+    xSnapshot.ulBfar = SCB->BFAR;
+
+    /* A fault on exception entry, such as a stack overflow, leaves no readable frame. */
+    if( ( pulFaultStack != NULL ) &&
+        ( prvReadableWords( ( uint32_t ) pulFaultStack, crashreportBASIC_FRAME_WORDS ) == crashreportBASIC_FRAME_WORDS ) )
+    {
+        for( i = 0; i < CRASH_REGISTER_COUNT; i++ )
+        {
+            xSnapshot.ulRegisters[ i ] = pulFaultStack[ i ];
+        }
+
+        xSnapshot.ulExcReturn = ulExcReturn;
+
+        pulStack = pulFaultStack + ( ( ( ulExcReturn & crashreportEXC_RETURN_BASIC_FRAME ) != 0UL ) ?
+                                     crashreportBASIC_FRAME_WORDS : crashreportFPU_FRAME_WORDS );
+
+        if( ( pulFaultStack[ CRASH_REGISTER_PSR ] & crashreportPSR_STACK_ALIGN ) != 0UL )
+        {
+            pulStack++;
+        }
+
+        xSnapshot.ulSp = ( uint32_t ) pulStack;
+        xSnapshot.ulStackWords = prvReadableWords( xSnapshot.ulSp, crashreportSTACK_WORDS );
+
+        for( i = 0; i < xSnapshot.ulStackWords; i++ )
+        {
+            xSnapshot.ulStack[ i ] = pulStack[ i ];
+        }
+    }
+
+    /* For a fault in an interrupt, this is the task it interrupted. */
+    if( ( pucTCB != NULL ) && ( prvReadableWords( ( uint32_t ) pucTCB, ulTCBWords ) == ulTCBWords ) )
+    {
+        ulAddress = ( uint32_t ) &pucTCB[ FreeRTOSDebugConfig[ crashreportDEBUG_CONFIG_PXSTACK ] ];
+        xSnapshot.ulStackBase = *( const uint32_t * ) ulAddress;
+
+        for( i = 0; i < ( configMAX_TASK_NAME_LEN - 1U ); i++ )
+        {
+            xSnapshot.cTaskName[ i ] = ( char ) pucTCB[ FreeRTOSDebugConfig[ crashreportDEBUG_CONFIG_NAME ] + i ];
+        }
+    }
+
+    xSnapshot.ulMagic = crashreportMAGIC;
+    xSnapshot.ulChecksum = prvChecksum();
+
+    __DSB();
+    NVIC_SystemReset();
+}
+
+/*-----------------------------------------------------------*/
+
+#if defined( __SEMIHOST_HARDFAULT_DISABLE )
+
+/**
+ * @brief HardFault handler when semihost_hardfault.c is left out, which otherwise records the
+ * faults that are not semihosting calls.
+ */
+    __attribute__( ( naked ) ) void HardFault_Handler( void )
+    {
+        __asm volatile
+        (
+            " tst lr, #4                    \n"
+            " ite eq                        \n"
+            " mrseq r0, msp                 \n"
+            " mrsne r0, psp                 \n"
+            " mov r2, lr                    \n"
+            " mov r1, r0                    \n"
+            " movs r0, #0                   \n" /* CRASH_FAULT_HARD */
+            " ldr r3, crash_handler_const   \n"
+            " bx r3                         \n"
+            " .align 2                      \n"
+            " crash_handler_const: .word CrashReport_Reset \n"
+        );
+    }
+
+#endif /* if defined( __SEMIHOST_HARDFAULT_DISABLE ) */
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSnapshotValid( void )
+{
+    return ( ( xSnapshot.ulMagic == crashreportMAGIC ) && ( xSnapshot.ulChecksum == prvChecksum() ) &&
+             ( xSnapshot.ulFault < ( sizeof( pcFaultNames ) / sizeof( pcFaultNames[ 0 ] ) ) ) &&
+             ( xSnapshot.ulStackWords <= crashreportSTACK_WORDS ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Formats the snapshot as JSON in cPayload.
+ *
+ * @return The length of the payload, 0 if it does not fit.
+ */
+static size_t prvFormat( void )
+{
+    size_t xLength;
+    int lWritten;
+    uint32_t i;
+
+    xSnapshot.cTaskName[ configMAX_TASK_NAME_LEN - 1U ] = '\0';
+
+    lWritten = snprintf( cPayload, sizeof( cPayload ),
+                         "{\"fault\":\"%s\",\"task\":\"%s\",\"pc\":\"0x%08lx\",\"lr\":\"0x%08lx\",\"psr\":\"0x%08lx\","
+                         "\"r0\":\"0x%08lx\",\"r1\":\"0x%08lx\",\"r2\":\"0x%08lx\",\"r3\":\"0x%08lx\",\"r12\":\"0x%08lx\","
+                         "\"exc_return\":\"0x%08lx\",\"sp\":\"0x%08lx\",\"stack_base\":\"0x%08lx\","
+                         "\"cfsr\":\"0x%08lx\",\"hfsr\":\"0x%08lx\",\"mmfar\":\"0x%08lx\",\"bfar\":\"0x%08lx\",\"stack\":[",
+                         pcFaultNames[ xSnapshot.ulFault ],
+                         xSnapshot.cTaskName,
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_PC ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_LR ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_PSR ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_R0 ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_R1 ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_R2 ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_R3 ],
+                         ( unsigned long ) xSnapshot.ulRegisters[ CRASH_REGISTER_R12 ],
+                         ( unsigned long ) xSnapshot.ulExcReturn,
+                         ( unsigned long ) xSnapshot.ulSp,
+                         ( unsigned long ) xSnapshot.ulStackBase,
+                         ( unsigned long ) xSnapshot.ulCfsr,
+                         ( unsigned long ) xSnapshot.ulHfsr,
+                         ( unsigned long ) xSnapshot.ulMmfar,
+                         ( unsigned long ) xSnapshot.ulBfar );
+    xLength = ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+    for( i = 0; ( i < xSnapshot.ulStackWords ) && ( xLength < sizeof( cPayload ) ); i++ )
+    {
+        lWritten = snprintf( &cPayload[ xLength ], sizeof( cPayload ) - xLength, "%s\"0x%08lx\"",
+                             ( i == 0U ) ? "" : ",", ( unsigned long ) xSnapshot.ulStack[ i ] );
+        xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+    }
+
+    if( xLength >= ( sizeof( cPayload ) - 2U ) )
+    {
+        return 0;
+    }
+
+    cPayload[ xLength++ ] = ']';
+    cPayload[ xLength++ ] = '}';
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvPublish( void );
+
+static void prvPublishCallback( void * pContext,
+                                MQTTStatus_t status )
+{
+    if( status != MQTTSuccess )
+    {
+        /* Sent again on the next connection. */
+    }
+    else if( pContext == cPayload )
+    {
+        /* Acknowledged, a later reset must not report the same fault again. */
+        xSnapshot.ulMagic = 0;
+        xPayloadLength = 0;
+        PRINTF( "Crash snapshot published.\r\n" );
+    }
+    else
+    {
+        #if ( TRC_CFG_FIELD_PROFILE == 1 )
+            xTraceKept = pdFALSE;
+            PRINTF( "Crash trace published.\r\n" );
+        #endif
+    }
+
+    #if ( TRC_CFG_FIELD_PROFILE == 1 )
+        /* The trace follows the snapshot, one publish at a time. */
+        if( status == MQTTSuccess )
+        {
+            ( void ) prvPublish();
+        }
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Queues the publish of the snapshot unless it is already queued or acknowledged.
+ */
+static BaseType_t prvPublish( void )
+{
+    const char * pcPublishTopic;
+    const void * pvPublishPayload;
+    size_t xPublishLength;
+
+    if( ConnectionManager_PublishPending( &xPublish ) == pdTRUE )
+    {
+        return pdTRUE;
+    }
+
+    if( xPayloadLength != 0U )
+    {
+        pcPublishTopic = cTopic;
+        pvPublishPayload = cPayload;
+        xPublishLength = xPayloadLength;
+    }
+
+    #if ( TRC_CFG_FIELD_PROFILE == 1 )
+        else if( xTraceKept == pdTRUE )
+        {
+            pcPublishTopic = cTraceTopic;
+            pvPublishPayload = &xTraceData;
+            xPublishLength = sizeof( xTraceData );
+        }
+    #endif
+    else
+    {
+        return pdTRUE;
+    }
+
+    /* Not blocking, called from the connection callback. The payload tells the callback what was sent. */
+    if( ConnectionManager_Publish( &xPublish, pcPublishTopic, ( uint16_t ) strlen( pcPublishTopic ), MQTTQoS1,
+                                   pvPublishPayload, xPublishLength, prvPublishCallback,
+                                   ( void * ) pvPublishPayload, 0 ) != pdTRUE )
+    {
+        PRINTF( "Crash report publish not queued.\r\n" );
+
+        return pdFALSE;
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool bSessionPresent )
+{
+    ( void ) bSessionPresent;
+
+    if( xState == CONNECTION_STATE_CONNECTED )
+    {
+        ( void ) prvPublish();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t CrashReport_Init( const char * pcThingName,
+                             uint32_t ulThingNameLength )
+{
+    int lLength;
+
+    if( prvSnapshotValid() != pdTRUE )
+    {
+        return pdTRUE;
+    }
+
+    lLength = snprintf( cTopic, sizeof( cTopic ), crashreportTOPIC_FORMAT, ( int ) ulThingNameLength, pcThingName );
+    xPayloadLength = prvFormat();
+
+    if( ( lLength <= 0 ) || ( ( size_t ) lLength >= sizeof( cTopic ) ) || ( xPayloadLength == 0U ) )
+    {
+        xPayloadLength = 0;
+
+        return pdFALSE;
+    }
+
+    PRINTF( "Reset by a fault: %.*s\r\n", ( int ) xPayloadLength, cPayload );
+
+    #if ( TRC_CFG_FIELD_PROFILE == 1 )
+        lLength = snprintf( cTraceTopic, sizeof( cTraceTopic ), crashreportTRACE_TOPIC_FORMAT,
+                            ( int ) ulThingNameLength, pcThingName );
+
+        if( ( lLength <= 0 ) || ( ( size_t ) lLength >= sizeof( cTraceTopic ) ) )
+        {
+            xTraceKept = pdFALSE;
+        }
+    #endif
+
+    ( void ) ConnectionManager_AddListener( prvConnectionStateCallback );
+
+    return prvPublish();
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( TRC_CFG_FIELD_PROFILE == 1 )
+    void * CrashReport_GetTraceBuffer( void )
+    {
+        void * pvBuffer = NULL;
+
+        /* The checksum of the snapshot does not cover the trace, which may come from another profile. */
+        if( ( prvSnapshotValid() == pdTRUE ) && ( xTraceData.startmarker0 == 1U ) &&
+            ( xTraceData.filesize == sizeof( xTraceData ) ) )
+        {
+            pvBuffer = pvPortMalloc( sizeof( RecorderDataType ) );
+            xTraceKept = ( pvBuffer != NULL ) ? pdTRUE : pdFALSE;
+        }
+
+        if( pvBuffer == NULL )
+        {
+            /* The recorder would carry on with the events and object handles of the last boot. */
+            xTraceData.startmarker0 = 0;
+            pvBuffer = &xTraceData;
+        }
+
+        return pvBuffer;
+    }
+#endif /* if ( TRC_CFG_FIELD_PROFILE == 1 ) */
@@ -0,0 +1,94 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file crash_report.h
+ * @brief Snapshot of a fault kept in no-init RAM across an immediate reset, published on the next boot.
+ */
+
+#ifndef CRASH_REPORT_H
+#define CRASH_REPORT_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Cause of the reset recorded in the snapshot.
+ */
+typedef enum CrashFault
+{
+    CRASH_FAULT_HARD = 0,      /**< HardFault, including the bus and usage faults escalated to it. */
+    CRASH_FAULT_MEMMANAGE,     /**< MemManage fault not expected by the restricted tasks demo. */
+    CRASH_FAULT_STACK_OVERFLOW /**< Stack overflow found by configCHECK_FOR_STACK_OVERFLOW. */
+} CrashFault_t;
+
+/**
+ * @brief Records the snapshot and resets the device at once, called from the fault handlers.
+ * The snapshot holds the exception frame, the fault status registers, the task running when the
+ * fault was taken and the first crashreportSTACK_WORDS words of its stack above the frame.
+ * It uses no kernel API and only reads the RAM of the memory map, so that it works from any fault.
+ *
+ * @param[in] xFault The cause of the reset.
+ * @param[in] pulFaultStack The exception frame stacked on entry of the handler, or NULL if there
+ * is none, as for a stack overflow.
+ * @param[in] ulExcReturn The EXC_RETURN value of the handler, ignored without a frame.
+ */
+void CrashReport_Reset( CrashFault_t xFault,
+                        const uint32_t * pulFaultStack,
+                        uint32_t ulExcReturn ) __attribute__( ( noreturn ) );
+
+/**
+ * @brief Prints the snapshot left by the previous boot, if any, and publishes it as JSON with QoS1 on
+ * "device/<thing name>/crash", e.g.
+ * {"fault":"hard","task":"MQTT_Agent_task","pc":"0x10012a4c","lr":"0x10012a31","psr":"0x61000000",
+ * "cfsr":"0x00008200","hfsr":"0x40000000","bfar":"0x00000004",...,"stack":["0x20001f80",...]}
+ * The snapshot is erased once the broker acknowledges it, and sent again on the next connection
+ * until then. With TRC_CFG_FIELD_PROFILE, the kept trace follows it. Must be called once the MQTT
+ * agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if there is no snapshot or its publish is queued.
+ */
+BaseType_t CrashReport_Init( const char * pcThingName,
+                             uint32_t ulThingNameLength );
+
+#if ( TRC_CFG_FIELD_PROFILE == 1 )
+
+/**
+ * @brief Gets the trace recorder buffer of the field profile, to pass to vTraceSetRecorderDataBuffer()
+ * before vTraceEnable(). The buffer is in the no-init RAM of the snapshot, so that the last events
+ * before a fault survive the reset. When the previous boot left a snapshot, its trace is kept for
+ * CrashReport_Init() to publish on "device/<thing name>/crash/trace" after the snapshot, and this
+ * boot records into a buffer allocated from the heap instead.
+ *
+ * @return The buffer, of sizeof( RecorderDataType ) bytes.
+ */
+    void * CrashReport_GetTraceBuffer( void );
+#endif
+
+#endif /* CRASH_REPORT_H */
@@ -0,0 +1,217 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file crypto_worker.c
+ * @brief Low priority task running the long asymmetric operations.
+ * An ECDSA verification, a CSR signature or the ECDHE of a handshake takes hundreds of milliseconds.
+ * Run on the OTA task or the MQTT agent task, it holds the CPU for as long from the tasks of a lower
+ * priority, such as the keep-alives of the other connection, the watchdog check-ins and the telemetry.
+ * The worker runs the jobs queued by those tasks at a low priority instead, while they are blocked.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "fsl_debug_console.h"
+
+#include "crypto_worker.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Priority of the worker task, below the tasks whose periodic work must keep its timing
+ * during the jobs.
+ */
+#ifndef cryptoworkerTASK_PRIORITY
+    #define cryptoworkerTASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Stack size of the worker task, in words, the mbed TLS operations run on it.
+ */
+#ifndef cryptoworkerTASK_STACK_SIZE
+    #define cryptoworkerTASK_STACK_SIZE    ( 2048 )
+#endif
+
+/**
+ * @brief Number of jobs waiting for the worker.
+ */
+#ifndef cryptoworkerQUEUE_LENGTH
+    #define cryptoworkerQUEUE_LENGTH    ( 4U )
+#endif
+
+/**
+ * @brief Task notification index the callers of CryptoWorker_Run() wait on.
+ */
+#ifndef cryptoworkerNOTIFY_INDEX
+    #define cryptoworkerNOTIFY_INDEX    ( 2U )
+#endif
+
+#if ( cryptoworkerNOTIFY_INDEX >= configTASK_NOTIFICATION_ARRAY_ENTRIES )
+    #error "cryptoworkerNOTIFY_INDEX requires a larger configTASK_NOTIFICATION_ARRAY_ENTRIES."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A queued job. A job of CryptoWorker_Run() has no callback, its result is written to the
+ * stack of the waiting task, which is notified.
+ */
+typedef struct CryptoWorkerItem
+{
+    CryptoWorkerJob_t xJob;
+    void * pvContext;
+    CryptoWorkerDone_t xDone;
+    TaskHandle_t xWaiter;
+    int32_t * plResult;
+} CryptoWorkerItem_t;
+
+/*-----------------------------------------------------------*/
+
+static QueueHandle_t xJobQueue = NULL;
+
+/**
+ * @brief The worker task, NULL until it is created.
+ */
+static TaskHandle_t xWorkerTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+static void prvCryptoWorkerTask( void * pvParameters )
+{
+    CryptoWorkerItem_t xItem;
+    int32_t lResult;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        if( xQueueReceive( xJobQueue, &xItem, portMAX_DELAY ) == pdTRUE )
+        {
+            lResult = xItem.xJob( xItem.pvContext );
+
+            if( xItem.xWaiter != NULL )
+            {
+                *xItem.plResult = lResult;
+                ( void ) xTaskNotifyGiveIndexed( xItem.xWaiter, cryptoworkerNOTIFY_INDEX );
+            }
+            else if( xItem.xDone != NULL )
+            {
+                xItem.xDone( xItem.pvContext, lResult );
+            }
+            else
+            {
+                /* No one waits for the result. */
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t CryptoWorker_Submit( CryptoWorkerJob_t xJob,
+                                void * pvContext,
+                                CryptoWorkerDone_t xDone,
+                                TickType_t xTicksToWait )
+{
+    CryptoWorkerItem_t xItem = { 0 };
+
+    configASSERT( xJob != NULL );
+
+    if( xWorkerTask == NULL )
+    {
+        return pdFAIL;
+    }
+
+    xItem.xJob = xJob;
+    xItem.pvContext = pvContext;
+    xItem.xDone = xDone;
+
+    return xQueueSend( xJobQueue, &xItem, xTicksToWait );
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t CryptoWorker_Run( CryptoWorkerJob_t xJob,
+                          void * pvContext )
+{
+    CryptoWorkerItem_t xItem = { 0 };
+    int32_t lResult = 0;
+
+    configASSERT( xJob != NULL );
+
+    if( ( xWorkerTask == NULL ) ||
+        ( xTaskGetSchedulerState() != taskSCHEDULER_RUNNING ) ||
+        ( xTaskGetCurrentTaskHandle() == xWorkerTask ) ||
+        ( uxTaskPriorityGet( NULL ) <= cryptoworkerTASK_PRIORITY ) )
+    {
+        /* Nothing to gain from the worker. */
+        lResult = xJob( pvContext );
+    }
+    else
+    {
+        xItem.xJob = xJob;
+        xItem.pvContext = pvContext;
+        xItem.xWaiter = xTaskGetCurrentTaskHandle();
+        xItem.plResult = &lResult;
+
+        /* A notification left by an earlier job is not expected, clear it anyway. */
+        ( void ) ulTaskNotifyValueClearIndexed( NULL, cryptoworkerNOTIFY_INDEX, UINT32_MAX );
+
+        ( void ) xQueueSend( xJobQueue, &xItem, portMAX_DELAY );
+        ( void ) ulTaskNotifyTakeIndexed( cryptoworkerNOTIFY_INDEX, pdTRUE, portMAX_DELAY );
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t CryptoWorker_Init( void )
+{
+    BaseType_t result = pdFAIL;
+
+    xJobQueue = xQueueCreate( cryptoworkerQUEUE_LENGTH, sizeof( CryptoWorkerItem_t ) );
+
+    if( xJobQueue != NULL )
+    {
+        /* Privileged, so that it writes the results to the stacks of the waiting tasks. */
+        result = xTaskCreate( prvCryptoWorkerTask,
+                              "Crypto_task",
+                              cryptoworkerTASK_STACK_SIZE,
+                              NULL,
+                              cryptoworkerTASK_PRIORITY | portPRIVILEGE_BIT,
+                              &xWorkerTask );
+    }
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create crypto worker task.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,93 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file crypto_worker.h
+ * @brief Low priority task running the long asymmetric operations of the other tasks.
+ */
+
+#ifndef CRYPTO_WORKER_H
+#define CRYPTO_WORKER_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief A job, e.g. an ECDSA verification or a step of a TLS handshake.
+ *
+ * @param[in] pvContext The context passed with the job.
+ *
+ * @return The result of the job, passed back to its caller.
+ */
+typedef int32_t ( * CryptoWorkerJob_t )( void * pvContext );
+
+/**
+ * @brief Completion callback of a job submitted with CryptoWorker_Submit(), called from the worker task.
+ *
+ * @param[in] pvContext The context passed with the job.
+ * @param[in] lResult The result of the job.
+ */
+typedef void ( * CryptoWorkerDone_t )( void * pvContext,
+                                       int32_t lResult );
+
+/**
+ * @brief Creates the worker task and its job queue. The jobs run before are run by their caller.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t CryptoWorker_Init( void );
+
+/**
+ * @brief Queues a job for the worker task, which runs the jobs in order at cryptoworkerTASK_PRIORITY.
+ *
+ * @param[in] xJob The job.
+ * @param[in] pvContext Context passed to the job and to the callback, which must remain valid until the
+ * callback is called.
+ * @param[in] xDone Callback called once the job is run, NULL if none.
+ * @param[in] xTicksToWait Time to wait for space in the queue.
+ *
+ * @return pdPASS if the job is queued, pdFAIL if the worker is not running or the queue stayed full.
+ */
+BaseType_t CryptoWorker_Submit( CryptoWorkerJob_t xJob,
+                                void * pvContext,
+                                CryptoWorkerDone_t xDone,
+                                TickType_t xTicksToWait );
+
+/**
+ * @brief Runs a job on the worker task and waits for its result, so that the tasks of a priority
+ * between the caller and the worker keep running during the job. The job is run by the caller when
+ * its priority is not above the worker, from the worker itself, or before the worker is started.
+ * The caller waits on task notification index cryptoworkerNOTIFY_INDEX.
+ *
+ * @param[in] xJob The job.
+ * @param[in] pvContext Context passed to the job.
+ *
+ * @return The result of the job.
+ */
+int32_t CryptoWorker_Run( CryptoWorkerJob_t xJob,
+                          void * pvContext );
+
+#endif /* CRYPTO_WORKER_H */
@@ -0,0 +1,293 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file deferred_log.c
+ * @brief Deferred console log.
+ * The debug console formats the log in the caller, which takes microseconds, and hands it over to
+ * this module instead of waiting for the UART to drain at its baud rate, which takes milliseconds.
+ * The log is copied into a ring of records shared by all tasks and interrupts without a lock: a
+ * writer reserves its record by moving the head with an exclusive store, fills it and marks it
+ * committed. The log task, at the lowest priority, transmits the committed records in order.
+ * A record which does not fit is dropped and counted, the callers never wait.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_debug_console.h"
+
+/* CMSIS core include, for the exclusive access intrinsics. */
+#include "fsl_device_registers.h"
+
+#include "deferred_log.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the record ring in bytes, a power of two.
+ * Holds the log written while the UART is busy, 2 KB is about 180 ms of output at 115200 baud.
+ */
+#ifndef deferredlogBUFFER_SIZE
+    #define deferredlogBUFFER_SIZE      ( 2048U )
+#endif
+
+/**
+ * @brief Priority of the log task, the log is only transmitted while nothing else runs.
+ */
+#ifndef deferredlogTASK_PRIORITY
+    #define deferredlogTASK_PRIORITY    ( tskIDLE_PRIORITY )
+#endif
+
+/**
+ * @brief Stack size of the log task, in words.
+ */
+#ifndef deferredlogTASK_STACK_SIZE
+    #define deferredlogTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 3 )
+#endif
+
+/**
+ * @brief Record header, a word in front of the record data.
+ */
+#define deferredlogHEADER_SIZE           ( sizeof( uint32_t ) )
+#define deferredlogHEADER_COMMITTED      ( 0x80000000UL ) /**< The record is complete. */
+#define deferredlogHEADER_PADDING        ( 0x40000000UL ) /**< The record skips the end of the ring. */
+#define deferredlogHEADER_LENGTH_MASK    ( 0x0000FFFFUL ) /**< Data length, or padding length. */
+
+#if ( ( deferredlogBUFFER_SIZE & ( deferredlogBUFFER_SIZE - 1U ) ) != 0U )
+    #error "deferredlogBUFFER_SIZE must be a power of two."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The record ring, word aligned as each record starts with its header.
+ */
+static uint32_t ulLogRing[ deferredlogBUFFER_SIZE / sizeof( uint32_t ) ];
+
+/**
+ * @brief Bytes reserved and bytes released since boot, their difference is the ring usage.
+ */
+static volatile uint32_t ulHead = 0;
+static volatile uint32_t ulTail = 0;
+
+/**
+ * @brief Records dropped since boot.
+ */
+static volatile uint32_t ulDropped = 0;
+
+/**
+ * @brief The log task, notified for each committed record.
+ */
+static TaskHandle_t xLogTask = NULL;
+
+/**
+ * @brief pdTRUE once the log task runs and the log is deferred.
+ */
+static volatile BaseType_t xDeferring = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Atomically increments a counter, usable from any task or interrupt.
+ */
+static void prvIncrement( volatile uint32_t * pulCounter )
+{
+    uint32_t ulValue;
+
+    do
+    {
+        ulValue = __LDREXW( pulCounter ) + 1U;
+    } while( __STREXW( ulValue, pulCounter ) != 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Deferred send function of the debug console, copies the formatted log into a record.
+ */
+static int prvDeferredSend( uint8_t * pucData,
+                            size_t xSize )
+{
+    const uint32_t ulRecordSize = deferredlogHEADER_SIZE + ( ( ( uint32_t ) xSize + 3U ) & ~3U );
+    uint32_t ulReserved;
+    uint32_t ulOffset;
+    uint32_t ulSize;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if( xSize == 0U )
+    {
+        return 0;
+    }
+
+    /* Reserve the record, at the start of the ring when it would not fit before the end. */
+    do
+    {
+        ulReserved = __LDREXW( &ulHead );
+        ulOffset = ulReserved % deferredlogBUFFER_SIZE;
+        ulSize = ulRecordSize;
+
+        if( ( ulOffset + ulRecordSize ) > deferredlogBUFFER_SIZE )
+        {
+            ulSize += deferredlogBUFFER_SIZE - ulOffset;
+        }
+
+        if( ( ( ulReserved + ulSize ) - ulTail ) > deferredlogBUFFER_SIZE )
+        {
+            __CLREX();
+            prvIncrement( &ulDropped );
+
+            return -1;
+        }
+    } while( __STREXW( ulReserved + ulSize, &ulHead ) != 0U );
+
+    if( ulSize != ulRecordSize )
+    {
+        ulLogRing[ ulOffset / sizeof( uint32_t ) ] = deferredlogHEADER_COMMITTED | deferredlogHEADER_PADDING |
+                                                    ( deferredlogBUFFER_SIZE - ulOffset );
+        ulOffset = 0U;
+    }
+
+    ( void ) memcpy( &ulLogRing[ ( ulOffset / sizeof( uint32_t ) ) + 1U ], pucData, xSize );
+
+    /* The log task must not see the header before the data. */
+    __DMB();
+    ulLogRing[ ulOffset / sizeof( uint32_t ) ] = deferredlogHEADER_COMMITTED | ( uint32_t ) xSize;
+
+    if( __get_IPSR() != 0U )
+    {
+        vTaskNotifyGiveFromISR( xLogTask, &xHigherPriorityTaskWoken );
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+    else
+    {
+        ( void ) xTaskNotifyGive( xLogTask );
+    }
+
+    return ( int ) xSize;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDeferredLogTask( void * pvParameters )
+{
+    uint32_t ulHeader;
+    uint32_t ulOffset;
+    uint32_t ulSize;
+    uint32_t ulReportedDropped = 0;
+
+    ( void ) pvParameters;
+
+    /* The log written before the scheduler started has been transmitted by its callers. */
+    DbgConsole_SetDeferredSend( prvDeferredSend );
+    xDeferring = pdTRUE;
+
+    for( ; ; )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        while( ulTail != ulHead )
+        {
+            ulOffset = ulTail % deferredlogBUFFER_SIZE;
+            ulHeader = ulLogRing[ ulOffset / sizeof( uint32_t ) ];
+
+            /* A writer is still filling the oldest record, it notifies once committed. */
+            if( ( ulHeader & deferredlogHEADER_COMMITTED ) == 0U )
+            {
+                break;
+            }
+
+            __DMB();
+            ulSize = ulHeader & deferredlogHEADER_LENGTH_MASK;
+
+            if( ( ulHeader & deferredlogHEADER_PADDING ) == 0U )
+            {
+                ( void ) DbgConsole_SendDeferredLog( ( uint8_t * ) &ulLogRing[ ( ulOffset / sizeof( uint32_t ) ) + 1U ],
+                                                     ulSize );
+                ulSize = deferredlogHEADER_SIZE + ( ( ulSize + 3U ) & ~3U );
+            }
+
+            /* Zero the record, a later header may fall anywhere in it. */
+            ( void ) memset( &ulLogRing[ ulOffset / sizeof( uint32_t ) ], 0, ulSize );
+            __DMB();
+            ulTail += ulSize;
+        }
+
+        if( ulDropped != ulReportedDropped )
+        {
+            ulReportedDropped = ulDropped;
+            ( void ) DbgConsole_BlockingPrintf( "[LOG] %u log records dropped.\r\n", ( unsigned ) ulReportedDropped );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DeferredLog_Init( void )
+{
+    BaseType_t result;
+
+    result = xTaskCreate( prvDeferredLogTask,
+                          "Log_task",
+                          deferredlogTASK_STACK_SIZE,
+                          NULL,
+                          deferredlogTASK_PRIORITY | portPRIVILEGE_BIT,
+                          &xLogTask );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create log task, the log is transmitted by its callers.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t DeferredLog_GetDropped( void )
+{
+    return ulDropped;
+}
+
+/*-----------------------------------------------------------*/
+
+int DeferredLog_Write( uint8_t * pucData,
+                       size_t xSize )
+{
+    int result;
+
+    if( xDeferring == pdTRUE )
+    {
+        result = prvDeferredSend( pucData, xSize );
+    }
+    else
+    {
+        result = DbgConsole_SendDeferredLog( pucData, xSize );
+    }
+
+    return result;
+}
@@ -0,0 +1,67 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file deferred_log.h
+ * @brief Deferred console log, moving the UART transmission out of the logging tasks.
+ */
+
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Creates the log task. Once it runs, PRINTF() and the LogError()/LogInfo() family only
+ * copy the formatted log into a buffer, which the log task transmits over the debug UART.
+ * Until then the log is transmitted by the caller.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t DeferredLog_Init( void );
+
+/**
+ * @brief Gets the number of log records dropped because the buffer was full.
+ *
+ * @return The number of dropped records since boot.
+ */
+uint32_t DeferredLog_GetDropped( void );
+
+/**
+ * @brief Queues raw log data as one record, transmitted without being split by other log.
+ * Before the log task runs the data is transmitted by the caller.
+ *
+ * @param[in] pucData The log data.
+ * @param[in] xSize The log data length.
+ *
+ * @return The length queued, or a negative value if the record is dropped.
+ */
+int DeferredLog_Write( uint8_t * pucData,
+                       size_t xSize );
+
+#endif /* DEFERRED_LOG_H */
@@ -0,0 +1,247 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file deferred_work.c
+ * @brief Bottom half of the interrupt handlers.
+ * An interrupt handler acknowledges its peripheral and posts the rest of the work, which the
+ * bottom-half task runs with the interrupts enabled, so that a long driver callback no longer
+ * delays the other interrupts. The work is posted into a ring shared by all interrupts without a
+ * lock: a handler reserves its slot by moving the head with an exclusive store, fills it and
+ * commits it by writing the function last. The task runs the committed slots in order.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_debug_console.h"
+
+#include "deferred_work.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Number of slots of the ring, a power of two.
+ */
+#ifndef deferredworkRING_SIZE
+    #define deferredworkRING_SIZE    ( 16U )
+#endif
+
+/**
+ * @brief Priority of the bottom-half task, above the IP task so that the work of an interrupt runs
+ * before the tasks it wakes up.
+ */
+#ifndef deferredworkTASK_PRIORITY
+    #define deferredworkTASK_PRIORITY    ( configMAX_PRIORITIES - 1 )
+#endif
+
+/**
+ * @brief Stack size of the bottom-half task, in words, the driver callbacks run on it.
+ */
+#ifndef deferredworkTASK_STACK_SIZE
+    #define deferredworkTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+#if ( ( deferredworkRING_SIZE & ( deferredworkRING_SIZE - 1U ) ) != 0U )
+    #error "deferredworkRING_SIZE must be a power of two."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A posted function and its parameters, committed once xFunction is set.
+ */
+typedef struct DeferredWorkItem
+{
+    PendedFunction_t xFunction;
+    void * pvParameter1;
+    uint32_t ulParameter2;
+} DeferredWorkItem_t;
+
+/*-----------------------------------------------------------*/
+
+static DeferredWorkItem_t xRing[ deferredworkRING_SIZE ];
+
+/**
+ * @brief Slots reserved and slots released since boot, their difference is the ring usage.
+ */
+static volatile uint32_t ulHead = 0;
+static volatile uint32_t ulTail = 0;
+
+/**
+ * @brief Work items dropped since boot.
+ */
+static volatile uint32_t ulDropped = 0;
+
+/**
+ * @brief The bottom-half task, notified for each committed slot.
+ */
+static TaskHandle_t xWorkTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Atomically increments a counter, usable from any task or interrupt.
+ */
+static void prvIncrement( volatile uint32_t * pulCounter )
+{
+    uint32_t ulValue;
+
+    do
+    {
+        ulValue = __LDREXW( pulCounter ) + 1U;
+    } while( __STREXW( ulValue, pulCounter ) != 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reserves, fills and commits a slot.
+ *
+ * @return pdFAIL if the ring is full.
+ */
+static BaseType_t prvPost( PendedFunction_t xFunction,
+                           void * pvParameter1,
+                           uint32_t ulParameter2 )
+{
+    DeferredWorkItem_t * pxItem;
+    uint32_t ulReserved;
+
+    do
+    {
+        ulReserved = __LDREXW( &ulHead );
+
+        if( ( ulReserved - ulTail ) >= deferredworkRING_SIZE )
+        {
+            __CLREX();
+
+            return pdFAIL;
+        }
+    } while( __STREXW( ulReserved + 1U, &ulHead ) != 0U );
+
+    pxItem = &xRing[ ulReserved % deferredworkRING_SIZE ];
+    pxItem->pvParameter1 = pvParameter1;
+    pxItem->ulParameter2 = ulParameter2;
+
+    /* The task must not see the function before its parameters. */
+    __DMB();
+    pxItem->xFunction = xFunction;
+
+    return pdPASS;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DeferredWork_PostFromISR( PendedFunction_t xFunction,
+                                     void * pvParameter1,
+                                     uint32_t ulParameter2,
+                                     BaseType_t * pxHigherPriorityTaskWoken )
+{
+    if( ( xWorkTask != NULL ) && ( prvPost( xFunction, pvParameter1, ulParameter2 ) == pdPASS ) )
+    {
+        vTaskNotifyGiveFromISR( xWorkTask, pxHigherPriorityTaskWoken );
+
+        return pdPASS;
+    }
+
+    if( xTimerPendFunctionCallFromISR( xFunction, pvParameter1, ulParameter2, pxHigherPriorityTaskWoken ) == pdPASS )
+    {
+        return pdPASS;
+    }
+
+    prvIncrement( &ulDropped );
+
+    return pdFAIL;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t DeferredWork_GetDropped( void )
+{
+    return ulDropped;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDeferredWorkTask( void * pvParameters )
+{
+    DeferredWorkItem_t * pxItem;
+    PendedFunction_t xFunction;
+    void * pvParameter1;
+    uint32_t ulParameter2;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        while( ulTail != ulHead )
+        {
+            pxItem = &xRing[ ulTail % deferredworkRING_SIZE ];
+            xFunction = pxItem->xFunction;
+
+            /* An interrupt is still filling the oldest slot, it notifies once committed. */
+            if( xFunction == NULL )
+            {
+                break;
+            }
+
+            __DMB();
+            pvParameter1 = pxItem->pvParameter1;
+            ulParameter2 = pxItem->ulParameter2;
+
+            /* Released before the call, so that the function may post again. */
+            pxItem->xFunction = NULL;
+            __DMB();
+            ulTail++;
+
+            xFunction( pvParameter1, ulParameter2 );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DeferredWork_Init( void )
+{
+    BaseType_t result;
+
+    result = xTaskCreate( prvDeferredWorkTask,
+                          "Work_task",
+                          deferredworkTASK_STACK_SIZE,
+                          NULL,
+                          deferredworkTASK_PRIORITY | portPRIVILEGE_BIT,
+                          &xWorkTask );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create deferred work task.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
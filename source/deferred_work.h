@@ -0,0 +1,74 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file deferred_work.h
+ * @brief Bottom half of the interrupt handlers, running the work they post in a task.
+ */
+
+#ifndef DEFERRED_WORK_H
+#define DEFERRED_WORK_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "timers.h"
+
+/**
+ * @brief Creates the bottom-half task. Must be called before the drivers post work, the work posted
+ * before is handed to the timer task.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t DeferredWork_Init( void );
+
+/**
+ * @brief Posts a function to be called from the bottom-half task, which runs at
+ * deferredworkTASK_PRIORITY and calls the posted functions in order. Takes the same functions as
+ * xTimerPendFunctionCallFromISR(), which is used instead when the ring is full or the task is not
+ * running yet. A function called from the task may still use the FromISR APIs.
+ * Usable from any interrupt at or below configMAX_SYSCALL_INTERRUPT_PRIORITY, without a lock.
+ *
+ * @param[in] xFunction The function to call.
+ * @param[in] pvParameter1 First parameter of the function.
+ * @param[in] ulParameter2 Second parameter of the function.
+ * @param[out] pxHigherPriorityTaskWoken Set to pdTRUE when the caller must yield on exit of the
+ * interrupt, as for the other FromISR APIs.
+ *
+ * @return pdPASS if the function will be called, pdFAIL if it was dropped.
+ */
+BaseType_t DeferredWork_PostFromISR( PendedFunction_t xFunction,
+                                     void * pvParameter1,
+                                     uint32_t ulParameter2,
+                                     BaseType_t * pxHigherPriorityTaskWoken );
+
+/**
+ * @brief Gets the number of work items dropped because the ring and the timer queue were full.
+ *
+ * @return The number of dropped work items since boot.
+ */
+uint32_t DeferredWork_GetDropped( void );
+
+#endif /* DEFERRED_WORK_H */
@@ -0,0 +1,786 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file dhcp_lease.c
+ * @brief DHCP lease persistence and INIT-REBOOT, bringing the network up on the last lease at boot.
+ *
+ * FreeRTOS+TCP runs the full DHCP exchanges and renews the leases it obtained. The lease task only
+ * saves their addresses, and runs the REQUESTs of the leases FreeRTOS+TCP did not obtain itself:
+ * the INIT-REBOOT of the stored lease, then its renewals at T1 and its rebindings at T2. The socket
+ * of the task is only bound to the DHCP client port during an exchange, while the DHCP socket of
+ * FreeRTOS+TCP is closed.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+#include "FreeRTOS_DHCP.h"
+
+#include "fsl_debug_console.h"
+
+#include "mflash_file.h"
+
+#include "dhcp_lease.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief mflash file of the lease, registered in the file table of the PKCS #11 PAL.
+ */
+#define dhcpleaseFILE                      "dhcp_lease.dat"
+
+/**
+ * @brief Identifies the lease record.
+ */
+#define dhcpleaseMAGIC                     ( 0x4C534531UL )
+
+/**
+ * @brief UDP ports of the DHCP server and client.
+ */
+#define dhcpleaseSERVER_PORT               ( 67U )
+#define dhcpleaseCLIENT_PORT               ( 68U )
+
+/**
+ * @brief Fields of the BOOTP header, and its size up to the options.
+ */
+#define dhcpleaseOP_REQUEST                ( 1U )
+#define dhcpleaseOP_REPLY                  ( 2U )
+#define dhcpleaseHTYPE_ETHERNET            ( 1U )
+#define dhcpleaseFLAG_BROADCAST            ( 0x8000U )
+#define dhcpleaseOFFSET_OP                 ( 0U )
+#define dhcpleaseOFFSET_XID                ( 4U )
+#define dhcpleaseOFFSET_FLAGS              ( 10U )
+#define dhcpleaseOFFSET_CIADDR             ( 12U )
+#define dhcpleaseOFFSET_YIADDR             ( 16U )
+#define dhcpleaseOFFSET_CHADDR             ( 28U )
+#define dhcpleaseOFFSET_COOKIE             ( 236U )
+#define dhcpleaseOFFSET_OPTIONS            ( 240U )
+#define dhcpleaseCOOKIE                    ( 0x63825363UL )
+
+/**
+ * @brief Smallest BOOTP message, and largest message a client must accept.
+ */
+#define dhcpleaseMIN_MESSAGE_SIZE          ( 300U )
+#define dhcpleaseMAX_MESSAGE_SIZE          ( 548U )
+
+/**
+ * @brief Options used in the REQUESTs and the answers.
+ */
+#define dhcpleaseOPTION_PAD                ( 0U )
+#define dhcpleaseOPTION_NET_MASK           ( 1U )
+#define dhcpleaseOPTION_ROUTER             ( 3U )
+#define dhcpleaseOPTION_DNS                ( 6U )
+#define dhcpleaseOPTION_REQUESTED_IP       ( 50U )
+#define dhcpleaseOPTION_LEASE_TIME         ( 51U )
+#define dhcpleaseOPTION_MESSAGE_TYPE       ( 53U )
+#define dhcpleaseOPTION_SERVER_ID          ( 54U )
+#define dhcpleaseOPTION_PARAMETERS         ( 55U )
+#define dhcpleaseOPTION_END                ( 255U )
+
+/**
+ * @brief DHCP message types.
+ */
+#define dhcpleaseTYPE_REQUEST              ( 3U )
+#define dhcpleaseTYPE_ACK                  ( 5U )
+#define dhcpleaseTYPE_NAK                  ( 6U )
+
+/**
+ * @brief Notifications of the lease task.
+ */
+#define dhcpleaseEVENT_VERIFY              ( 1UL << 0 )
+#define dhcpleaseEVENT_SAVE                ( 1UL << 1 )
+#define dhcpleaseEVENT_DOWN                ( 1UL << 2 )
+
+/**
+ * @brief Longest lease followed, so that its times fit in the tick count differences.
+ */
+#define dhcpleaseMAX_LEASE_SECONDS         ( 0x7FFFFFFFUL / configTICK_RATE_HZ )
+
+/**
+ * @brief Shortest delay between two renewal or rebinding REQUESTs, from RFC 2131.
+ */
+#define dhcpleaseMIN_RETRY_SECONDS         ( 60U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The stored lease, addresses in network byte order.
+ */
+typedef struct DhcpLeaseRecord
+{
+    uint32_t ulMagic;
+    uint32_t ulIPAddress;
+    uint32_t ulNetMask;
+    uint32_t ulGatewayAddress;
+    uint32_t ulDNSServerAddress;
+    uint32_t ulServerAddress; /**< Server identifier, 0 if the lease was obtained by FreeRTOS+TCP. */
+    uint32_t ulLeaseSeconds;  /**< Duration of the lease, 0 if the lease was obtained by FreeRTOS+TCP. */
+} DhcpLeaseRecord_t;
+
+/**
+ * @brief Answer to a REQUEST.
+ */
+typedef enum DhcpLeaseAnswer
+{
+    DHCP_LEASE_NO_ANSWER = 0,
+    DHCP_LEASE_ACK,
+    DHCP_LEASE_NAK
+} DhcpLeaseAnswer_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The stored lease, in RAM as mflash_save_file() cannot program from the flash.
+ */
+static DhcpLeaseRecord_t xLease;
+
+/**
+ * @brief Set while a lease is stored and usable for an INIT-REBOOT.
+ */
+static volatile BaseType_t xLeaseStored = pdFALSE;
+
+/**
+ * @brief Set from the DHCP hook skipping the DISCOVER until the server answers the INIT-REBOOT.
+ */
+static volatile BaseType_t xVerifyPending = pdFALSE;
+
+/**
+ * @brief Set while the lease task renews the lease, from the ACK to the next network down.
+ */
+static BaseType_t xRenewing = pdFALSE;
+
+/**
+ * @brief Tick count of the last ACK, the start of the lease times.
+ */
+static TickType_t xLeaseStart = 0;
+
+/**
+ * @brief Tick count of the next renewal or rebinding REQUEST.
+ */
+static TickType_t xNextRequest = 0;
+
+/**
+ * @brief Transaction identifier of the last REQUEST.
+ */
+static uint32_t ulTransactionId = 0;
+
+/**
+ * @brief Message sent and received by the lease task.
+ */
+static uint8_t ucMessage[ dhcpleaseMAX_MESSAGE_SIZE ];
+
+static TaskHandle_t xLeaseTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+static void prvWrite32( uint8_t * pucData,
+                        uint32_t ulValue )
+{
+    pucData[ 0 ] = ( uint8_t ) ( ulValue >> 24 );
+    pucData[ 1 ] = ( uint8_t ) ( ulValue >> 16 );
+    pucData[ 2 ] = ( uint8_t ) ( ulValue >> 8 );
+    pucData[ 3 ] = ( uint8_t ) ulValue;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvRead32( const uint8_t * pucData )
+{
+    return ( ( uint32_t ) pucData[ 0 ] << 24 ) | ( ( uint32_t ) pucData[ 1 ] << 16 ) |
+           ( ( uint32_t ) pucData[ 2 ] << 8 ) | ( uint32_t ) pucData[ 3 ];
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Converts seconds of a lease to ticks, pdMS_TO_TICKS() would overflow.
+ */
+static TickType_t prvSecondsToTicks( uint32_t ulSeconds )
+{
+    return ( TickType_t ) ulSeconds * ( TickType_t ) configTICK_RATE_HZ;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Saves the lease, or erases the stored lease if pxRecord is NULL.
+ */
+static void prvStore( const DhcpLeaseRecord_t * pxRecord )
+{
+    BaseType_t xResult;
+
+    if( pxRecord == NULL )
+    {
+        xLeaseStored = pdFALSE;
+        xResult = mflash_save_file( dhcpleaseFILE, ( uint8_t * ) &xLease, 0U );
+    }
+    else
+    {
+        xLease = *pxRecord;
+        xLease.ulMagic = dhcpleaseMAGIC;
+        xResult = mflash_save_file( dhcpleaseFILE, ( uint8_t * ) &xLease, sizeof( xLease ) );
+        xLeaseStored = xResult;
+    }
+
+    if( xResult != pdTRUE )
+    {
+        PRINTF( "DHCP lease not saved.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Saves the addresses in use if they differ from the stored lease, the server identifier and
+ * the lease time are kept for a lease renewed by the lease task.
+ */
+static void prvSaveAddresses( uint32_t ulServerAddress,
+                              uint32_t ulLeaseSeconds )
+{
+    DhcpLeaseRecord_t xRecord = { 0 };
+
+    FreeRTOS_GetAddressConfiguration( &xRecord.ulIPAddress, &xRecord.ulNetMask,
+                                      &xRecord.ulGatewayAddress, &xRecord.ulDNSServerAddress );
+    xRecord.ulServerAddress = ulServerAddress;
+    xRecord.ulLeaseSeconds = ulLeaseSeconds;
+
+    /* A renewal only changes the addresses when the server does, the flash is not written for
+     * each one. */
+    if( ( xLeaseStored == pdFALSE ) ||
+        ( xRecord.ulIPAddress != xLease.ulIPAddress ) ||
+        ( xRecord.ulNetMask != xLease.ulNetMask ) ||
+        ( xRecord.ulGatewayAddress != xLease.ulGatewayAddress ) ||
+        ( xRecord.ulDNSServerAddress != xLease.ulDNSServerAddress ) ||
+        ( xRecord.ulServerAddress != xLease.ulServerAddress ) ||
+        ( xRecord.ulLeaseSeconds != xLease.ulLeaseSeconds ) )
+    {
+        prvStore( &xRecord );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes a REQUEST into ucMessage.
+ *
+ * @param[in] ulClientAddress ciaddr, 0 for an INIT-REBOOT.
+ * @param[in] ulRequestedAddress Requested IP address option, 0 to leave it out.
+ *
+ * @return Length of the message.
+ */
+static size_t prvBuildRequest( uint32_t ulClientAddress,
+                               uint32_t ulRequestedAddress )
+{
+    static const uint8_t ucParameters[] = { dhcpleaseOPTION_NET_MASK, dhcpleaseOPTION_ROUTER,
+                                            dhcpleaseOPTION_DNS, dhcpleaseOPTION_LEASE_TIME };
+    size_t xLength = dhcpleaseOFFSET_OPTIONS;
+
+    memset( ucMessage, 0x00, sizeof( ucMessage ) );
+    ulTransactionId = ipconfigRAND32();
+
+    ucMessage[ dhcpleaseOFFSET_OP ] = dhcpleaseOP_REQUEST;
+    ucMessage[ dhcpleaseOFFSET_OP + 1U ] = dhcpleaseHTYPE_ETHERNET;
+    ucMessage[ dhcpleaseOFFSET_OP + 2U ] = ipMAC_ADDRESS_LENGTH_BYTES;
+    prvWrite32( &ucMessage[ dhcpleaseOFFSET_XID ], ulTransactionId );
+
+    /* Without an address to answer to, the server broadcasts the answer. */
+    if( ulClientAddress == 0U )
+    {
+        ucMessage[ dhcpleaseOFFSET_FLAGS ] = ( uint8_t ) ( dhcpleaseFLAG_BROADCAST >> 8 );
+    }
+
+    ( void ) memcpy( &ucMessage[ dhcpleaseOFFSET_CIADDR ], &ulClientAddress, sizeof( ulClientAddress ) );
+    ( void ) memcpy( &ucMessage[ dhcpleaseOFFSET_CHADDR ], FreeRTOS_GetMACAddress(), ipMAC_ADDRESS_LENGTH_BYTES );
+    prvWrite32( &ucMessage[ dhcpleaseOFFSET_COOKIE ], dhcpleaseCOOKIE );
+
+    ucMessage[ xLength++ ] = dhcpleaseOPTION_MESSAGE_TYPE;
+    ucMessage[ xLength++ ] = 1U;
+    ucMessage[ xLength++ ] = dhcpleaseTYPE_REQUEST;
+
+    if( ulRequestedAddress != 0U )
+    {
+        ucMessage[ xLength++ ] = dhcpleaseOPTION_REQUESTED_IP;
+        ucMessage[ xLength++ ] = sizeof( ulRequestedAddress );
+        ( void ) memcpy( &ucMessage[ xLength ], &ulRequestedAddress, sizeof( ulRequestedAddress ) );
+        xLength += sizeof( ulRequestedAddress );
+    }
+
+    ucMessage[ xLength++ ] = dhcpleaseOPTION_PARAMETERS;
+    ucMessage[ xLength++ ] = sizeof( ucParameters );
+    ( void ) memcpy( &ucMessage[ xLength ], ucParameters, sizeof( ucParameters ) );
+    xLength += sizeof( ucParameters );
+
+    ucMessage[ xLength++ ] = dhcpleaseOPTION_END;
+
+    return ( xLength < dhcpleaseMIN_MESSAGE_SIZE ) ? dhcpleaseMIN_MESSAGE_SIZE : xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Parses an answer in ucMessage to the last REQUEST.
+ *
+ * @param[in] xLength Length of the answer.
+ * @param[out] pxRecord Addresses, server identifier and lease time of an ACK.
+ *
+ * @return The type of the answer, DHCP_LEASE_NO_ANSWER if it is not an answer to the REQUEST.
+ */
+static DhcpLeaseAnswer_t prvParseAnswer( size_t xLength,
+                                         DhcpLeaseRecord_t * pxRecord )
+{
+    DhcpLeaseAnswer_t xAnswer = DHCP_LEASE_NO_ANSWER;
+    size_t xOffset = dhcpleaseOFFSET_OPTIONS;
+    uint8_t ucOption, ucLength;
+    uint8_t ucType = 0;
+
+    if( ( xLength > dhcpleaseOFFSET_OPTIONS ) &&
+        ( ucMessage[ dhcpleaseOFFSET_OP ] == dhcpleaseOP_REPLY ) &&
+        ( prvRead32( &ucMessage[ dhcpleaseOFFSET_XID ] ) == ulTransactionId ) &&
+        ( memcmp( &ucMessage[ dhcpleaseOFFSET_CHADDR ], FreeRTOS_GetMACAddress(), ipMAC_ADDRESS_LENGTH_BYTES ) == 0 ) &&
+        ( prvRead32( &ucMessage[ dhcpleaseOFFSET_COOKIE ] ) == dhcpleaseCOOKIE ) )
+    {
+        ( void ) memcpy( &pxRecord->ulIPAddress, &ucMessage[ dhcpleaseOFFSET_YIADDR ], sizeof( uint32_t ) );
+
+        while( xOffset < xLength )
+        {
+            ucOption = ucMessage[ xOffset++ ];
+
+            if( ucOption == dhcpleaseOPTION_PAD )
+            {
+                continue;
+            }
+
+            if( ( ucOption == dhcpleaseOPTION_END ) || ( xOffset >= xLength ) )
+            {
+                break;
+            }
+
+            ucLength = ucMessage[ xOffset++ ];
+
+            if( ( xOffset + ucLength ) > xLength )
+            {
+                break;
+            }
+
+            /* The lists of routers and DNS servers start with the preferred one. */
+            if( ( ucOption == dhcpleaseOPTION_MESSAGE_TYPE ) && ( ucLength == 1U ) )
+            {
+                ucType = ucMessage[ xOffset ];
+            }
+            else if( ucLength >= sizeof( uint32_t ) )
+            {
+                switch( ucOption )
+                {
+                    case dhcpleaseOPTION_NET_MASK:
+                        ( void ) memcpy( &pxRecord->ulNetMask, &ucMessage[ xOffset ], sizeof( uint32_t ) );
+                        break;
+
+                    case dhcpleaseOPTION_ROUTER:
+                        ( void ) memcpy( &pxRecord->ulGatewayAddress, &ucMessage[ xOffset ], sizeof( uint32_t ) );
+                        break;
+
+                    case dhcpleaseOPTION_DNS:
+                        ( void ) memcpy( &pxRecord->ulDNSServerAddress, &ucMessage[ xOffset ], sizeof( uint32_t ) );
+                        break;
+
+                    case dhcpleaseOPTION_SERVER_ID:
+                        ( void ) memcpy( &pxRecord->ulServerAddress, &ucMessage[ xOffset ], sizeof( uint32_t ) );
+                        break;
+
+                    case dhcpleaseOPTION_LEASE_TIME:
+                        pxRecord->ulLeaseSeconds = prvRead32( &ucMessage[ xOffset ] );
+                        break;
+
+                    default:
+                        /* Not used. */
+                        break;
+                }
+            }
+            else
+            {
+                /* Not used. */
+            }
+
+            xOffset += ucLength;
+        }
+
+        if( ucType == dhcpleaseTYPE_ACK )
+        {
+            xAnswer = DHCP_LEASE_ACK;
+        }
+        else if( ucType == dhcpleaseTYPE_NAK )
+        {
+            xAnswer = DHCP_LEASE_NAK;
+        }
+        else
+        {
+            /* An OFFER or another message to this client. */
+        }
+    }
+
+    return xAnswer;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends a REQUEST and waits for its answer.
+ *
+ * @param[in] ulClientAddress ciaddr, 0 for an INIT-REBOOT.
+ * @param[in] ulRequestedAddress Requested IP address option, 0 to leave it out.
+ * @param[in] ulServerAddress Address the REQUEST is sent to, 0 to broadcast it.
+ * @param[out] pxRecord Addresses, server identifier and lease time of an ACK.
+ *
+ * @return The answer.
+ */
+static DhcpLeaseAnswer_t prvExchange( uint32_t ulClientAddress,
+                                      uint32_t ulRequestedAddress,
+                                      uint32_t ulServerAddress,
+                                      DhcpLeaseRecord_t * pxRecord )
+{
+    DhcpLeaseAnswer_t xAnswer = DHCP_LEASE_NO_ANSWER;
+    struct freertos_sockaddr xAddress = { 0 };
+    uint32_t ulAddressLength = sizeof( xAddress );
+    TickType_t xTimeout = pdMS_TO_TICKS( dhcpleaseANSWER_TIMEOUT_MS );
+    TickType_t xStart;
+    Socket_t xSocket;
+    int32_t lReceived;
+    size_t xLength;
+
+    xSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+    xAddress.sin_port = FreeRTOS_htons( dhcpleaseCLIENT_PORT );
+
+    if( ( xSocket != FREERTOS_INVALID_SOCKET ) && ( FreeRTOS_bind( xSocket, &xAddress, sizeof( xAddress ) ) == 0 ) )
+    {
+        ( void ) FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) );
+
+        xLength = prvBuildRequest( ulClientAddress, ulRequestedAddress );
+        xAddress.sin_addr = ( ulServerAddress != 0U ) ? ulServerAddress : FreeRTOS_htonl( 0xFFFFFFFFUL );
+        xAddress.sin_port = FreeRTOS_htons( dhcpleaseSERVER_PORT );
+
+        if( FreeRTOS_sendto( xSocket, ucMessage, xLength, 0, &xAddress, sizeof( xAddress ) ) > 0 )
+        {
+            xStart = xTaskGetTickCount();
+
+            /* Other clients' answers are broadcast to the same port, they are skipped. */
+            while( ( xAnswer == DHCP_LEASE_NO_ANSWER ) &&
+                   ( ( xTaskGetTickCount() - xStart ) < pdMS_TO_TICKS( dhcpleaseANSWER_TIMEOUT_MS ) ) )
+            {
+                lReceived = FreeRTOS_recvfrom( xSocket, ucMessage, sizeof( ucMessage ), 0, &xAddress, &ulAddressLength );
+
+                if( lReceived > 0 )
+                {
+                    xAnswer = prvParseAnswer( ( size_t ) lReceived, pxRecord );
+                }
+            }
+        }
+    }
+
+    if( xSocket != FREERTOS_INVALID_SOCKET )
+    {
+        ( void ) FreeRTOS_closesocket( xSocket );
+    }
+
+    return xAnswer;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Follows the lease from an ACK: applies the addresses it carries, saves them and schedules
+ * the renewal at T1, half the lease time.
+ */
+static void prvAcknowledged( DhcpLeaseRecord_t * pxRecord )
+{
+    uint32_t ulIPAddress, ulNetMask, ulGatewayAddress, ulDNSServerAddress;
+
+    FreeRTOS_GetAddressConfiguration( &ulIPAddress, &ulNetMask, &ulGatewayAddress, &ulDNSServerAddress );
+
+    /* Options the server left out keep their current value. */
+    pxRecord->ulIPAddress = ulIPAddress;
+    pxRecord->ulNetMask = ( pxRecord->ulNetMask != 0U ) ? pxRecord->ulNetMask : ulNetMask;
+    pxRecord->ulGatewayAddress = ( pxRecord->ulGatewayAddress != 0U ) ? pxRecord->ulGatewayAddress : ulGatewayAddress;
+    pxRecord->ulDNSServerAddress = ( pxRecord->ulDNSServerAddress != 0U ) ? pxRecord->ulDNSServerAddress : ulDNSServerAddress;
+
+    if( ( pxRecord->ulNetMask != ulNetMask ) || ( pxRecord->ulGatewayAddress != ulGatewayAddress ) ||
+        ( pxRecord->ulDNSServerAddress != ulDNSServerAddress ) )
+    {
+        FreeRTOS_SetAddressConfiguration( &pxRecord->ulIPAddress, &pxRecord->ulNetMask,
+                                          &pxRecord->ulGatewayAddress, &pxRecord->ulDNSServerAddress );
+    }
+
+    if( ( pxRecord->ulLeaseSeconds == 0U ) || ( pxRecord->ulLeaseSeconds > dhcpleaseMAX_LEASE_SECONDS ) )
+    {
+        pxRecord->ulLeaseSeconds = dhcpleaseMAX_LEASE_SECONDS;
+    }
+
+    prvSaveAddresses( pxRecord->ulServerAddress, pxRecord->ulLeaseSeconds );
+
+    xLeaseStart = xTaskGetTickCount();
+    xNextRequest = xLeaseStart + prvSecondsToTicks( pxRecord->ulLeaseSeconds / 2U );
+    xRenewing = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Gives up the stored lease and takes the network down for a full DISCOVER.
+ */
+static void prvFallBack( void )
+{
+    xRenewing = pdFALSE;
+    prvStore( NULL );
+    xVerifyPending = pdFALSE;
+    FreeRTOS_NetworkDown();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Asks the server to confirm the stored addresses, in use since the network up.
+ */
+static void prvInitReboot( void )
+{
+    DhcpLeaseRecord_t xRecord = { 0 };
+    DhcpLeaseAnswer_t xAnswer = DHCP_LEASE_NO_ANSWER;
+    uint32_t ulAttempt;
+
+    for( ulAttempt = 0; ( ulAttempt < dhcpleaseINIT_REBOOT_ATTEMPTS ) && ( xAnswer == DHCP_LEASE_NO_ANSWER ); ulAttempt++ )
+    {
+        /* RFC 2131 wants the INIT-REBOOT from 0.0.0.0, FreeRTOS+TCP sends from the address in use,
+         * which the servers do not check: the client is identified by chaddr. */
+        xAnswer = prvExchange( 0U, xLease.ulIPAddress, 0U, &xRecord );
+    }
+
+    if( ( xAnswer == DHCP_LEASE_ACK ) && ( xRecord.ulIPAddress == xLease.ulIPAddress ) )
+    {
+        PRINTF( "DHCP lease confirmed by INIT-REBOOT.\r\n" );
+        prvAcknowledged( &xRecord );
+        xVerifyPending = pdFALSE;
+    }
+    else
+    {
+        PRINTF( "DHCP lease %s, falling back to DISCOVER.\r\n", ( xAnswer == DHCP_LEASE_NAK ) ? "refused" : "not confirmed" );
+        prvFallBack();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Renews the lease at T1, unicast to its server, or rebinds it at T2, broadcast to any server.
+ * Failed REQUESTs are retried after half the time left to T2 or to the end of the lease.
+ */
+static void prvRenew( void )
+{
+    DhcpLeaseRecord_t xRecord = { 0 };
+    TickType_t xElapsed = xTaskGetTickCount() - xLeaseStart;
+    TickType_t xT2 = prvSecondsToTicks( ( xLease.ulLeaseSeconds / 8U ) * 7U );
+    TickType_t xEnd = prvSecondsToTicks( xLease.ulLeaseSeconds );
+    TickType_t xDeadline, xRetry;
+    DhcpLeaseAnswer_t xAnswer;
+
+    if( xElapsed >= xEnd )
+    {
+        PRINTF( "DHCP lease expired, falling back to DISCOVER.\r\n" );
+        prvFallBack();
+    }
+    else
+    {
+        xAnswer = prvExchange( xLease.ulIPAddress, 0U, ( xElapsed < xT2 ) ? xLease.ulServerAddress : 0U, &xRecord );
+
+        if( xAnswer == DHCP_LEASE_ACK )
+        {
+            prvAcknowledged( &xRecord );
+        }
+        else if( xAnswer == DHCP_LEASE_NAK )
+        {
+            PRINTF( "DHCP lease renewal refused, falling back to DISCOVER.\r\n" );
+            prvFallBack();
+        }
+        else
+        {
+            xDeadline = ( xElapsed < xT2 ) ? xT2 : xEnd;
+            xRetry = ( xDeadline - xElapsed ) / 2U;
+
+            if( xRetry < prvSecondsToTicks( dhcpleaseMIN_RETRY_SECONDS ) )
+            {
+                xRetry = prvSecondsToTicks( dhcpleaseMIN_RETRY_SECONDS );
+            }
+
+            if( xRetry > ( xDeadline - xElapsed ) )
+            {
+                xRetry = xDeadline - xElapsed;
+            }
+
+            xNextRequest = xLeaseStart + xElapsed + xRetry;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLeaseTask( void * pvParameters )
+{
+    uint32_t ulEvents = 0;
+    TickType_t xWait;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        xWait = portMAX_DELAY;
+
+        if( xRenewing == pdTRUE )
+        {
+            xWait = xNextRequest - xTaskGetTickCount();
+
+            /* Past due. */
+            if( xWait > ( portMAX_DELAY / 2U ) )
+            {
+                xWait = 0;
+            }
+        }
+
+        ( void ) xTaskNotifyWait( 0U, UINT32_MAX, &ulEvents, xWait );
+
+        if( ( ulEvents & dhcpleaseEVENT_DOWN ) != 0U )
+        {
+            /* The next network up starts with a DISCOVER or an INIT-REBOOT, which set the lease again. */
+            xRenewing = pdFALSE;
+        }
+
+        if( ( ulEvents & dhcpleaseEVENT_VERIFY ) != 0U )
+        {
+            prvInitReboot();
+        }
+        else if( ( ulEvents & dhcpleaseEVENT_SAVE ) != 0U )
+        {
+            /* Renewed by FreeRTOS+TCP from now on. */
+            prvSaveAddresses( 0U, 0U );
+        }
+        else if( ( ulEvents == 0U ) && ( xRenewing == pdTRUE ) )
+        {
+            prvRenew();
+        }
+        else
+        {
+            /* Nothing else to do. */
+        }
+
+        ulEvents = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+eDHCPCallbackAnswer_t xApplicationDHCPHook( eDHCPCallbackPhase_t eDHCPPhase,
+                                            uint32_t ulIPAddress )
+{
+    eDHCPCallbackAnswer_t eAnswer = eDHCPContinue;
+
+    ( void ) ulIPAddress;
+
+    /* The defaults given to FreeRTOS_IPInit() are the stored addresses, see DhcpLease_Init(). */
+    if( ( eDHCPPhase == eDHCPPhasePreDiscover ) && ( xLeaseStored == pdTRUE ) && ( xLeaseTask != NULL ) )
+    {
+        xVerifyPending = pdTRUE;
+        eAnswer = eDHCPUseDefaults;
+    }
+
+    return eAnswer;
+}
+
+/*-----------------------------------------------------------*/
+
+void DhcpLease_NetworkEvent( eIPCallbackEvent_t eNetworkEvent )
+{
+    uint32_t ulEvent = dhcpleaseEVENT_DOWN;
+
+    if( eNetworkEvent == eNetworkUp )
+    {
+        ulEvent = ( xVerifyPending == pdTRUE ) ? dhcpleaseEVENT_VERIFY : dhcpleaseEVENT_SAVE;
+    }
+
+    if( xLeaseTask != NULL )
+    {
+        ( void ) xTaskNotify( xLeaseTask, ulEvent, eSetBits );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DhcpLease_IsConfirmed( void )
+{
+    return ( xVerifyPending == pdTRUE ) ? pdFALSE : pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DhcpLease_Init( uint8_t pucIPAddress[ ipIP_ADDRESS_LENGTH_BYTES ],
+                           uint8_t pucNetMask[ ipIP_ADDRESS_LENGTH_BYTES ],
+                           uint8_t pucGatewayAddress[ ipIP_ADDRESS_LENGTH_BYTES ],
+                           uint8_t pucDNSServerAddress[ ipIP_ADDRESS_LENGTH_BYTES ] )
+{
+    const DhcpLeaseRecord_t * pxRecord;
+    uint8_t * pucData;
+    uint32_t ulSize;
+    char cBuffer[ 16 ];
+
+    if( mflash_is_initialized() &&
+        ( mflash_read_file( dhcpleaseFILE, &pucData, &ulSize ) == pdTRUE ) &&
+        ( ulSize == sizeof( DhcpLeaseRecord_t ) ) )
+    {
+        pxRecord = ( const DhcpLeaseRecord_t * ) pucData;
+
+        if( ( pxRecord->ulMagic == dhcpleaseMAGIC ) && ( pxRecord->ulIPAddress != 0U ) )
+        {
+            xLease = *pxRecord;
+            xLeaseStored = pdTRUE;
+
+            ( void ) memcpy( pucIPAddress, &xLease.ulIPAddress, ipIP_ADDRESS_LENGTH_BYTES );
+            ( void ) memcpy( pucNetMask, &xLease.ulNetMask, ipIP_ADDRESS_LENGTH_BYTES );
+            ( void ) memcpy( pucGatewayAddress, &xLease.ulGatewayAddress, ipIP_ADDRESS_LENGTH_BYTES );
+            ( void ) memcpy( pucDNSServerAddress, &xLease.ulDNSServerAddress, ipIP_ADDRESS_LENGTH_BYTES );
+
+            FreeRTOS_inet_ntoa( xLease.ulIPAddress, cBuffer );
+            PRINTF( "DHCP lease of %s stored, trying INIT-REBOOT.\r\n", cBuffer );
+        }
+    }
+
+    if( xTaskCreate( prvLeaseTask, "DhcpLease_task", dhcpleaseTASK_STACK_SIZE, NULL,
+                     dhcpleaseTASK_PRIORITY | portPRIVILEGE_BIT, &xLeaseTask ) != pdPASS )
+    {
+        PRINTF( "DHCP lease task creation failed.\r\n" );
+        xLeaseTask = NULL;
+    }
+
+    return ( xLeaseTask != NULL ) ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,103 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file dhcp_lease.h
+ * @brief DHCP lease persistence and INIT-REBOOT, bringing the network up on the last lease at boot.
+ *
+ * The address configuration of each DHCP lease is kept in the "dhcp_lease.dat" mflash file. At the
+ * next start of DHCP, FreeRTOS+TCP is told through xApplicationDHCPHook() to skip the DISCOVER and
+ * use the stored addresses, given to FreeRTOS_IPInit() as its defaults, and the lease task asks the
+ * server to confirm them with the INIT-REBOOT REQUEST of RFC 2131. An ACK keeps the addresses, and
+ * the lease task renews the lease from then on; a NAK or no answer erases the stored lease and takes
+ * the network down, so FreeRTOS+TCP starts over with a full DISCOVER.
+ */
+
+#ifndef DHCP_LEASE_H
+#define DHCP_LEASE_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "FreeRTOS_IP.h"
+
+/**
+ * @brief Time the server is given to answer an INIT-REBOOT, renewal or rebinding REQUEST.
+ */
+#ifndef dhcpleaseANSWER_TIMEOUT_MS
+    #define dhcpleaseANSWER_TIMEOUT_MS    ( 2000U )
+#endif
+
+/**
+ * @brief Number of INIT-REBOOT REQUESTs sent before falling back to a full DISCOVER.
+ */
+#ifndef dhcpleaseINIT_REBOOT_ATTEMPTS
+    #define dhcpleaseINIT_REBOOT_ATTEMPTS    ( 2U )
+#endif
+
+/**
+ * @brief Priority and stack size, in words, of the lease task.
+ */
+#ifndef dhcpleaseTASK_PRIORITY
+    #define dhcpleaseTASK_PRIORITY    ( tskIDLE_PRIORITY + 2 )
+#endif
+
+#ifndef dhcpleaseTASK_STACK_SIZE
+    #define dhcpleaseTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 3 )
+#endif
+
+/**
+ * @brief Reads the stored lease into the default addresses given to FreeRTOS_IPInit(), and creates
+ * the lease task. Must be called before FreeRTOS_IPInit(), once the mflash files are initialized.
+ * The addresses are left as they are if no lease is stored.
+ *
+ * @param[in,out] pucIPAddress The default IP address.
+ * @param[in,out] pucNetMask The default net mask.
+ * @param[in,out] pucGatewayAddress The default gateway address.
+ * @param[in,out] pucDNSServerAddress The default DNS server address.
+ *
+ * @return pdTRUE if the lease task is created.
+ */
+BaseType_t DhcpLease_Init( uint8_t pucIPAddress[ ipIP_ADDRESS_LENGTH_BYTES ],
+                           uint8_t pucNetMask[ ipIP_ADDRESS_LENGTH_BYTES ],
+                           uint8_t pucGatewayAddress[ ipIP_ADDRESS_LENGTH_BYTES ],
+                           uint8_t pucDNSServerAddress[ ipIP_ADDRESS_LENGTH_BYTES ] );
+
+/**
+ * @brief Reports a network event, to be called from vApplicationIPNetworkEventHook().
+ *
+ * @param[in] eNetworkEvent The event.
+ */
+void DhcpLease_NetworkEvent( eIPCallbackEvent_t eNetworkEvent );
+
+/**
+ * @brief Tells whether the addresses in use are confirmed: obtained by a full DHCP exchange, or
+ * stored and acknowledged by the server. The connections should wait for it after a network up.
+ *
+ * @return pdFALSE while an INIT-REBOOT REQUEST is waiting for its answer.
+ */
+BaseType_t DhcpLease_IsConfirmed( void );
+
+#endif /* DHCP_LEASE_H */
@@ -0,0 +1,497 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file dma_copy.c
+ * @brief Large memory copies and fills on the DMA controller.
+ * A 4 KB copy keeps the CPU for tens of microseconds, a 16 KB fill of a TLS record buffer for four
+ * times as long. The DMA moves the data while the caller is blocked and the other tasks run, on
+ * channels of the lowest priority so that the peripheral channels keep their latency.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_clock.h"
+#include "uart.h"
+
+#include "dma_copy.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Task notification index the callers of DmaCopy_Memcpy() and DmaCopy_Memset() wait on.
+ */
+#ifndef dmacopyNOTIFY_INDEX
+    #define dmacopyNOTIFY_INDEX    ( 3U )
+#endif
+
+/**
+ * @brief Priority of the copy channels, 7 is the lowest.
+ */
+#ifndef dmacopyDMA_PRIORITY
+    #define dmacopyDMA_PRIORITY    ( 7U )
+#endif
+
+#if ( dmacopyNOTIFY_INDEX >= configTASK_NOTIFICATION_ARRAY_ENTRIES )
+    #error "dmacopyNOTIFY_INDEX requires a larger configTASK_NOTIFICATION_ARRAY_ENTRIES."
+#endif
+
+#if ( ( dmacopyCHANNELS == 0U ) || ( ( dmacopyCHANNEL_FIRST + dmacopyCHANNELS ) > FSL_FEATURE_DMA_NUMBER_OF_CHANNELS ) )
+    #error "dmacopyCHANNEL_FIRST and dmacopyCHANNELS must select channels of DMA0."
+#endif
+
+/* The words of a copy are never less than one once the head and tail bytes are taken out. */
+#if ( dmacopyMIN_LENGTH < 16U )
+    #error "dmacopyMIN_LENGTH must be at least 16."
+#endif
+
+/**
+ * @brief Words of a single transfer, the XFERCOUNT limit.
+ */
+#define dmacopyMAX_WORDS       ( 1024U )
+
+/**
+ * @brief Bits of the copy channels in the DMA common registers.
+ */
+#define dmacopyCHANNEL_MASK    ( ( ( 1UL << dmacopyCHANNELS ) - 1UL ) << dmacopyCHANNEL_FIRST )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief DMA channel descriptor, layout defined by the DMA controller.
+ */
+typedef struct DmaCopyDescriptor
+{
+    uint32_t ulXferCfg;
+    const void * pvSrcEnd;
+    void * pvDstEnd;
+    void * pvNext;
+} DmaCopyDescriptor_t;
+
+/**
+ * @brief A copy or a fill running on a channel. A copy of DmaCopy_Memcpy() or DmaCopy_Memset() has no
+ * callback, its result is written to the stack of the waiting task, which is notified.
+ */
+typedef struct DmaCopyJob
+{
+    uint8_t * pucDst;       /**< Destination of the next transfer. */
+    const uint8_t * pucSrc; /**< Source of the next transfer, NULL for a fill. */
+    size_t xWords;          /**< Words left after the running transfer. */
+    uint32_t ulFill;        /**< The word read by each transfer of a fill. */
+    DmaCopyDone_t xDone;
+    void * pvContext;
+    TaskHandle_t xWaiter;
+    BaseType_t * pxResult;
+} DmaCopyJob_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Channel descriptor table of DMA0, not used if another driver already set one.
+ */
+SDK_ALIGN( static DmaCopyDescriptor_t xDescriptorTable[ FSL_FEATURE_DMA_NUMBER_OF_CHANNELS ], 512 );
+
+/**
+ * @brief The copy of each channel.
+ */
+static DmaCopyJob_t xJobs[ dmacopyCHANNELS ];
+
+/**
+ * @brief Bits of the channels without a copy, by index from dmacopyCHANNEL_FIRST.
+ */
+static volatile uint32_t ulFreeChannels = 0;
+
+/**
+ * @brief Set by DmaCopy_Init().
+ */
+static BaseType_t xInitialized = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns pdTRUE if the caller may hand its buffers to the DMA and wait for it.
+ */
+static BaseType_t prvDmaAllowed( void )
+{
+    BaseType_t xAllowed = pdFALSE;
+
+    /* The DMA would copy the buffers an unprivileged task passes even outside its MPU regions. */
+    if( ( xInitialized != pdFALSE ) &&
+        ( __get_IPSR() == 0U ) &&
+        ( ( __get_CONTROL() & CONTROL_nPRIV_Msk ) == 0U ) &&
+        ( __get_PRIMASK() == 0U ) &&
+        ( __get_BASEPRI() == 0U ) &&
+        ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) )
+    {
+        xAllowed = pdTRUE;
+    }
+
+    return xAllowed;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Takes a free channel, returns its index, dmacopyCHANNELS if none is free.
+ */
+static UBaseType_t prvTakeChannel( void )
+{
+    UBaseType_t uxIndex;
+
+    taskENTER_CRITICAL();
+    {
+        for( uxIndex = 0; uxIndex < dmacopyCHANNELS; uxIndex++ )
+        {
+            if( ( ulFreeChannels & ( 1UL << uxIndex ) ) != 0U )
+            {
+                ulFreeChannels &= ~( 1UL << uxIndex );
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return uxIndex;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Starts the next transfer of the copy of a channel, from a task or from the DMA interrupt.
+ */
+static void prvStartTransfer( UBaseType_t uxIndex )
+{
+    DmaCopyJob_t * pxJob = &xJobs[ uxIndex ];
+    uint32_t ulChannel = dmacopyCHANNEL_FIRST + uxIndex;
+    DmaCopyDescriptor_t * pxTable = ( DmaCopyDescriptor_t * ) DMA0->SRAMBASE;
+    size_t xWords = ( pxJob->xWords < dmacopyMAX_WORDS ) ? pxJob->xWords : dmacopyMAX_WORDS;
+    uint32_t ulSrcInc = 0U;
+
+    pxTable[ ulChannel ].pvDstEnd = &pxJob->pucDst[ ( xWords - 1U ) * sizeof( uint32_t ) ];
+    pxTable[ ulChannel ].pvNext = NULL;
+
+    if( pxJob->pucSrc != NULL )
+    {
+        pxTable[ ulChannel ].pvSrcEnd = &pxJob->pucSrc[ ( xWords - 1U ) * sizeof( uint32_t ) ];
+        pxJob->pucSrc += xWords * sizeof( uint32_t );
+        ulSrcInc = 1U;
+    }
+    else
+    {
+        /* A fill reads the same word for each transfer. */
+        pxTable[ ulChannel ].pvSrcEnd = &pxJob->ulFill;
+    }
+
+    pxJob->pucDst += xWords * sizeof( uint32_t );
+    pxJob->xWords -= xWords;
+
+    DMA0->CHANNEL[ ulChannel ].XFERCFG = DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_SWTRIG_MASK |
+                                         DMA_CHANNEL_XFERCFG_CLRTRIG_MASK | DMA_CHANNEL_XFERCFG_SETINTA_MASK |
+                                         DMA_CHANNEL_XFERCFG_WIDTH( 2U ) | DMA_CHANNEL_XFERCFG_SRCINC( ulSrcInc ) |
+                                         DMA_CHANNEL_XFERCFG_DSTINC( 1U ) | DMA_CHANNEL_XFERCFG_XFERCOUNT( xWords - 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Ends the copy of a channel and frees the channel, from the DMA interrupt.
+ */
+static void prvFinish( UBaseType_t uxIndex,
+                       BaseType_t xResult,
+                       BaseType_t * pxHigherPriorityTaskWoken )
+{
+    DmaCopyJob_t * pxJob = &xJobs[ uxIndex ];
+    DmaCopyDone_t xDone = pxJob->xDone;
+    void * pvContext = pxJob->pvContext;
+    TaskHandle_t xWaiter = pxJob->xWaiter;
+
+    if( xWaiter != NULL )
+    {
+        *pxJob->pxResult = xResult;
+    }
+
+    /* The tasks take the channels in a critical section, which masks this interrupt. */
+    ulFreeChannels |= 1UL << uxIndex;
+
+    if( xWaiter != NULL )
+    {
+        vTaskNotifyGiveIndexedFromISR( xWaiter, dmacopyNOTIFY_INDEX, pxHigherPriorityTaskWoken );
+    }
+    else if( xDone != NULL )
+    {
+        xDone( pvContext, xResult );
+    }
+    else
+    {
+        /* No one waits for the copy. */
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Starts a copy, or a fill if pucSrc is NULL, on the DMA if it can take it.
+ *
+ * @return pdTRUE if the DMA runs it, pdFALSE if the caller must move the data.
+ */
+static BaseType_t prvStart( uint8_t * pucDst,
+                            const uint8_t * pucSrc,
+                            uint8_t ucFill,
+                            size_t xLength,
+                            DmaCopyDone_t xDone,
+                            void * pvContext,
+                            BaseType_t * pxResult )
+{
+    DmaCopyJob_t * pxJob;
+    UBaseType_t uxIndex;
+    size_t xHead = ( 0U - ( uintptr_t ) pucDst ) & 3U;
+    size_t xTail = ( xLength - xHead ) & 3U;
+
+    if( ( xLength < dmacopyMIN_LENGTH ) ||
+        ( ( pucSrc != NULL ) && ( ( ( ( uintptr_t ) pucSrc ^ ( uintptr_t ) pucDst ) & 3U ) != 0U ) ) ||
+        ( prvDmaAllowed() == pdFALSE ) )
+    {
+        return pdFALSE;
+    }
+
+    uxIndex = prvTakeChannel();
+
+    if( uxIndex == dmacopyCHANNELS )
+    {
+        return pdFALSE;
+    }
+
+    pxJob = &xJobs[ uxIndex ];
+
+    /* The head and the tail bytes are outside the words of the DMA, the CPU moves them first. */
+    if( pucSrc != NULL )
+    {
+        ( void ) memcpy( pucDst, pucSrc, xHead );
+        ( void ) memcpy( &pucDst[ xLength - xTail ], &pucSrc[ xLength - xTail ], xTail );
+        pxJob->pucSrc = &pucSrc[ xHead ];
+    }
+    else
+    {
+        ( void ) memset( pucDst, ucFill, xHead );
+        ( void ) memset( &pucDst[ xLength - xTail ], ucFill, xTail );
+        pxJob->pucSrc = NULL;
+        pxJob->ulFill = ( uint32_t ) ucFill * 0x01010101UL;
+    }
+
+    pxJob->pucDst = &pucDst[ xHead ];
+    pxJob->xWords = ( xLength - xHead - xTail ) / sizeof( uint32_t );
+    pxJob->xDone = xDone;
+    pxJob->pvContext = pvContext;
+    pxJob->pxResult = pxResult;
+    pxJob->xWaiter = NULL;
+
+    if( pxResult != NULL )
+    {
+        pxJob->xWaiter = xTaskGetCurrentTaskHandle();
+
+        /* A notification left by an earlier copy is not expected, clear it anyway. */
+        ( void ) ulTaskNotifyValueClearIndexed( NULL, dmacopyNOTIFY_INDEX, UINT32_MAX );
+    }
+
+    prvStartTransfer( uxIndex );
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Runs a copy, or a fill if pucSrc is NULL, on the DMA and waits for it.
+ *
+ * @return pdPASS if the DMA moved the data, pdFAIL if the caller must move it.
+ */
+static BaseType_t prvRun( uint8_t * pucDst,
+                          const uint8_t * pucSrc,
+                          uint8_t ucFill,
+                          size_t xLength )
+{
+    BaseType_t xResult = pdFAIL;
+
+    if( prvStart( pucDst, pucSrc, ucFill, xLength, NULL, NULL, &xResult ) == pdTRUE )
+    {
+        ( void ) ulTaskNotifyTakeIndexed( dmacopyNOTIFY_INDEX, pdTRUE, portMAX_DELAY );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void DmaCopy_IRQHandler( BaseType_t * pxHigherPriorityTaskWoken )
+{
+    uint32_t ulDone = DMA0->COMMON[ 0 ].INTA & dmacopyCHANNEL_MASK;
+    uint32_t ulErrors = DMA0->COMMON[ 0 ].ERRINT & dmacopyCHANNEL_MASK;
+    uint32_t ulMask;
+    UBaseType_t uxIndex;
+
+    DMA0->COMMON[ 0 ].INTA = ulDone;
+    DMA0->COMMON[ 0 ].ERRINT = ulErrors;
+
+    for( uxIndex = 0; uxIndex < dmacopyCHANNELS; uxIndex++ )
+    {
+        ulMask = 1UL << ( dmacopyCHANNEL_FIRST + uxIndex );
+
+        if( ( ulErrors & ulMask ) != 0U )
+        {
+            /* A bus error stops the channel, which must be aborted before its next copy. */
+            DMA0->COMMON[ 0 ].ENABLECLR = ulMask;
+
+            while( ( DMA0->COMMON[ 0 ].BUSY & ulMask ) != 0U )
+            {
+            }
+
+            DMA0->COMMON[ 0 ].ABORT = ulMask;
+            DMA0->COMMON[ 0 ].ENABLESET = ulMask;
+            prvFinish( uxIndex, pdFAIL, pxHigherPriorityTaskWoken );
+        }
+        else if( ( ulDone & ulMask ) != 0U )
+        {
+            if( xJobs[ uxIndex ].xWords > 0U )
+            {
+                prvStartTransfer( uxIndex );
+            }
+            else
+            {
+                prvFinish( uxIndex, pdPASS, pxHigherPriorityTaskWoken );
+            }
+        }
+        else
+        {
+            /* The transfer of the channel goes on. */
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void * DmaCopy_Memcpy( void * pvDst,
+                       const void * pvSrc,
+                       size_t xLength )
+{
+    if( prvRun( ( uint8_t * ) pvDst, ( const uint8_t * ) pvSrc, 0U, xLength ) != pdPASS )
+    {
+        ( void ) memcpy( pvDst, pvSrc, xLength );
+    }
+
+    return pvDst;
+}
+
+/*-----------------------------------------------------------*/
+
+void * DmaCopy_Memset( void * pvDst,
+                       int lValue,
+                       size_t xLength )
+{
+    if( prvRun( ( uint8_t * ) pvDst, NULL, ( uint8_t ) lValue, xLength ) != pdPASS )
+    {
+        ( void ) memset( pvDst, lValue, xLength );
+    }
+
+    return pvDst;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DmaCopy_MemcpyAsync( void * pvDst,
+                                const void * pvSrc,
+                                size_t xLength,
+                                DmaCopyDone_t xDone,
+                                void * pvContext )
+{
+    BaseType_t xStarted = prvStart( ( uint8_t * ) pvDst, ( const uint8_t * ) pvSrc, 0U, xLength, xDone, pvContext, NULL );
+
+    if( xStarted == pdFALSE )
+    {
+        ( void ) memcpy( pvDst, pvSrc, xLength );
+    }
+
+    return xStarted;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DmaCopy_MemsetAsync( void * pvDst,
+                                int lValue,
+                                size_t xLength,
+                                DmaCopyDone_t xDone,
+                                void * pvContext )
+{
+    BaseType_t xStarted = prvStart( ( uint8_t * ) pvDst, NULL, ( uint8_t ) lValue, xLength, xDone, pvContext, NULL );
+
+    if( xStarted == pdFALSE )
+    {
+        ( void ) memset( pvDst, lValue, xLength );
+    }
+
+    return xStarted;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t DmaCopy_Init( void )
+{
+    UBaseType_t uxIndex;
+
+    if( xInitialized == pdFALSE )
+    {
+        CLOCK_EnableClock( kCLOCK_Dma );
+
+        if( DMA0->SRAMBASE == 0U )
+        {
+            DMA0->SRAMBASE = ( uint32_t ) xDescriptorTable;
+        }
+
+        DMA0->CTRL = DMA_CTRL_ENABLE_MASK;
+
+        /* Started by software, below the channels of the peripherals. */
+        for( uxIndex = 0; uxIndex < dmacopyCHANNELS; uxIndex++ )
+        {
+            DMA0->CHANNEL[ dmacopyCHANNEL_FIRST + uxIndex ].CFG = DMA_CHANNEL_CFG_CHPRIORITY( dmacopyDMA_PRIORITY );
+        }
+
+        DMA0->COMMON[ 0 ].INTENSET = dmacopyCHANNEL_MASK;
+        DMA0->COMMON[ 0 ].ENABLESET = dmacopyCHANNEL_MASK;
+
+        /* The USART adapter already set HAL_UART_ISR_PRIORITY, at which FreeRTOS API calls are allowed too. */
+        #if ( HAL_UART_DMA_USED == 0U )
+            NVIC_SetPriority( DMA0_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1 );
+        #endif
+        EnableIRQ( DMA0_IRQn );
+
+        ulFreeChannels = ( 1UL << dmacopyCHANNELS ) - 1UL;
+        xInitialized = pdTRUE;
+    }
+
+    return xInitialized;
+}
@@ -0,0 +1,163 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file dma_copy.h
+ * @brief Large memory copies and fills on the DMA controller, while the CPU runs the other tasks.
+ *
+ * A copy or a fill of at least dmacopyMIN_LENGTH bytes is moved by a memory to memory channel of DMA0,
+ * in words, up to 1024 words per transfer, the DMA interrupt starting the next transfer. The unaligned
+ * head and tail bytes are moved by the CPU. The CPU moves it all, as memcpy() and memset() would, when
+ * the DMA cannot be used:
+ * - below dmacopyMIN_LENGTH, where setting up the channel and the interrupt cost more than the copy;
+ * - for a copy between addresses of different alignments within a word;
+ * - from an interrupt, with the scheduler not running or from within a critical section;
+ * - from an unprivileged task, as the DMA would not be bound by the MPU regions of the task;
+ * - when all the dmacopyCHANNELS channels are busy.
+ */
+
+#ifndef DMA_COPY_H
+#define DMA_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief First DMA channel of the copies, their peripheral requests unused. The first channels are
+ * wired to the Flexcomm interfaces, the flash driver and the GPIO capture take channels 18, 28 and 29.
+ */
+#ifndef dmacopyCHANNEL_FIRST
+    #define dmacopyCHANNEL_FIRST    ( 26U )
+#endif
+
+/**
+ * @brief Number of channels from dmacopyCHANNEL_FIRST, the number of copies running at once.
+ */
+#ifndef dmacopyCHANNELS
+    #define dmacopyCHANNELS    ( 2U )
+#endif
+
+/**
+ * @brief Shorter copies and fills are done by the CPU.
+ */
+#ifndef dmacopyMIN_LENGTH
+    #define dmacopyMIN_LENGTH    ( 1024U )
+#endif
+
+/**
+ * @brief Completion callback of DmaCopy_MemcpyAsync() and DmaCopy_MemsetAsync(), called from the DMA
+ * interrupt.
+ *
+ * @param[in] pvContext The context passed with the copy.
+ * @param[in] xResult pdPASS once the data is moved, pdFAIL if the DMA hit a bus error.
+ */
+typedef void ( * DmaCopyDone_t )( void * pvContext,
+                                  BaseType_t xResult );
+
+/**
+ * @brief Enables the DMA controller and the channels of the copies. Must be called once, from a
+ * privileged task or before the scheduler is started. The copies are done by the CPU before.
+ *
+ * @return pdTRUE if the DMA copies are enabled.
+ */
+BaseType_t DmaCopy_Init( void );
+
+/**
+ * @brief Copies xLength bytes, as memcpy(). The caller blocks until the DMA is done, waiting on task
+ * notification index dmacopyNOTIFY_INDEX.
+ *
+ * @param[out] pvDst Destination, not overlapping the source.
+ * @param[in] pvSrc Source.
+ * @param[in] xLength Number of bytes.
+ *
+ * @return pvDst.
+ */
+void * DmaCopy_Memcpy( void * pvDst,
+                       const void * pvSrc,
+                       size_t xLength );
+
+/**
+ * @brief Fills xLength bytes with the byte lValue, as memset(). The caller blocks until the DMA is
+ * done, waiting on task notification index dmacopyNOTIFY_INDEX.
+ *
+ * @param[out] pvDst Destination.
+ * @param[in] lValue The byte written.
+ * @param[in] xLength Number of bytes.
+ *
+ * @return pvDst.
+ */
+void * DmaCopy_Memset( void * pvDst,
+                       int lValue,
+                       size_t xLength );
+
+/**
+ * @brief Starts a copy of xLength bytes and returns at once if the DMA takes it, xDone is called from
+ * the DMA interrupt once it is done. The buffers must not be accessed until then.
+ *
+ * @param[out] pvDst Destination, not overlapping the source.
+ * @param[in] pvSrc Source.
+ * @param[in] xLength Number of bytes.
+ * @param[in] xDone Completion callback, NULL if none.
+ * @param[in] pvContext Context passed to the callback.
+ *
+ * @return pdTRUE if the DMA runs the copy, pdFALSE if the CPU did it before returning, without calling
+ * xDone.
+ */
+BaseType_t DmaCopy_MemcpyAsync( void * pvDst,
+                                const void * pvSrc,
+                                size_t xLength,
+                                DmaCopyDone_t xDone,
+                                void * pvContext );
+
+/**
+ * @brief Starts a fill of xLength bytes with the byte lValue, as DmaCopy_MemcpyAsync().
+ *
+ * @param[out] pvDst Destination.
+ * @param[in] lValue The byte written.
+ * @param[in] xLength Number of bytes.
+ * @param[in] xDone Completion callback, NULL if none.
+ * @param[in] pvContext Context passed to the callback.
+ *
+ * @return pdTRUE if the DMA runs the fill, pdFALSE if the CPU did it before returning, without calling
+ * xDone.
+ */
+BaseType_t DmaCopy_MemsetAsync( void * pvDst,
+                                int lValue,
+                                size_t xLength,
+                                DmaCopyDone_t xDone,
+                                void * pvContext );
+
+/**
+ * @brief Handles the interrupts of the copy channels, called from DMA0_IRQHandler(), which is shared
+ * with the other users of DMA0.
+ *
+ * @param[in,out] pxHigherPriorityTaskWoken Set to pdTRUE if a task woken has a higher priority than
+ * the interrupted one.
+ */
+void DmaCopy_IRQHandler( BaseType_t * pxHigherPriorityTaskWoken );
+
+#endif /* DMA_COPY_H */
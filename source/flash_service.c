@@ -0,0 +1,401 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file flash_service.c
+ * @brief Low priority task running the background flash jobs in the idle time of the flash and the
+ * network.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "flash_service.h"
+
+#if ( flashserviceENABLED == 1 )
+
+    #include "FreeRTOS_IP.h"
+    #include "NetworkBufferManagement.h"
+
+    #include "mflash_drv.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Queued jobs, in the order of their submission. Changed within critical sections.
+ */
+    static FlashServiceJob_t * pxJobs = NULL;
+
+/**
+ * @brief Held while a step runs, so that FlashService_Cancel() and FlashService_RunNow() wait for it.
+ */
+    static SemaphoreHandle_t xStepMutex = NULL;
+    static StaticSemaphore_t xStepMutexBuffer;
+
+    static TaskHandle_t xServiceTask = NULL;
+
+/**
+ * @brief Number of FlashService_Pause() requests not released.
+ */
+    static volatile UBaseType_t uxPauses = 0;
+
+/**
+ * @brief Tick count of the last FlashService_NoteForeground(), valid once xForegroundSeen is set.
+ */
+    static volatile TickType_t xForegroundTick;
+    static volatile BaseType_t xForegroundSeen = pdFALSE;
+
+    static FlashServiceStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Removes a job from the queue. Called within a critical section.
+ *
+ * @return pdTRUE if the job was queued.
+ */
+    static BaseType_t prvUnlink( FlashServiceJob_t * pxJob )
+    {
+        FlashServiceJob_t ** ppxLink;
+
+        for( ppxLink = &pxJobs; *ppxLink != NULL; ppxLink = &( *ppxLink )->pxNext )
+        {
+            if( *ppxLink == pxJob )
+            {
+                *ppxLink = pxJob->pxNext;
+                pxJob->pxNext = NULL;
+                pxJob->xQueued = pdFALSE;
+
+                return pdTRUE;
+            }
+        }
+
+        return pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Picks the job to run next: the overdue jobs first, then the highest priority, the earliest
+ * submitted among equals.
+ *
+ * @param[in] xNow The tick count.
+ * @param[out] pxOverdue Set if the job is past its deadline.
+ *
+ * @return The job, NULL if none is queued.
+ */
+    static FlashServiceJob_t * prvPickJob( TickType_t xNow,
+                                           BaseType_t * pxOverdue )
+    {
+        FlashServiceJob_t * pxJob;
+        FlashServiceJob_t * pxBest = NULL;
+        BaseType_t xOverdue;
+
+        *pxOverdue = pdFALSE;
+
+        taskENTER_CRITICAL();
+        {
+            for( pxJob = pxJobs; pxJob != NULL; pxJob = pxJob->pxNext )
+            {
+                xOverdue = ( ( pxJob->xDeadline != portMAX_DELAY ) &&
+                             ( ( TickType_t ) ( xNow - pxJob->xSubmitted ) >= pxJob->xDeadline ) ) ? pdTRUE : pdFALSE;
+
+                if( ( pxBest == NULL ) ||
+                    ( xOverdue > *pxOverdue ) ||
+                    ( ( xOverdue == *pxOverdue ) && ( pxJob->uxPriority > pxBest->uxPriority ) ) )
+                {
+                    pxBest = pxJob;
+                    *pxOverdue = xOverdue;
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        return pxBest;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns pdTRUE while the foreground uses the flash or the network is in a burst.
+ */
+    static BaseType_t prvForegroundBusy( TickType_t xNow )
+    {
+        BaseType_t xBusy = pdFALSE;
+
+        if( mflash_drv_is_busy() )
+        {
+            xBusy = pdTRUE;
+        }
+        else if( ( xForegroundSeen == pdTRUE ) &&
+                 ( ( TickType_t ) ( xNow - xForegroundTick ) < pdMS_TO_TICKS( flashserviceQUIET_MS ) ) )
+        {
+            xBusy = pdTRUE;
+        }
+        else if( ( ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS - uxGetNumberOfFreeNetworkBuffers() ) > flashserviceNET_BUSY_BUFFERS )
+        {
+            xBusy = pdTRUE;
+        }
+        else
+        {
+            /* Quiet. */
+        }
+
+        return xBusy;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Runs a step of a job, which is dequeued once complete. Called with xStepMutex held.
+ */
+    static void prvRunStep( FlashServiceJob_t * pxJob )
+    {
+        if( pxJob->xStep( pxJob->pvContext ) == pdFALSE )
+        {
+            taskENTER_CRITICAL();
+            {
+                if( prvUnlink( pxJob ) == pdTRUE )
+                {
+                    xStats.ulJobsCompleted++;
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvServiceTask( void * pvParameters )
+    {
+        FlashServiceJob_t * pxJob;
+        BaseType_t xOverdue;
+        TickType_t xNow;
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            xNow = xTaskGetTickCount();
+            pxJob = prvPickJob( xNow, &xOverdue );
+
+            if( pxJob == NULL )
+            {
+                ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+            }
+            else if( ( uxPauses > 0U ) || ( ( xOverdue == pdFALSE ) && ( prvForegroundBusy( xNow ) == pdTRUE ) ) )
+            {
+                xStats.ulDeferrals++;
+                ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( flashserviceRETRY_MS ) );
+            }
+            else
+            {
+                ( void ) xSemaphoreTake( xStepMutex, portMAX_DELAY );
+
+                /* The job may have been cancelled or completed by FlashService_RunNow() meanwhile. */
+                if( pxJob->xQueued == pdTRUE )
+                {
+                    if( ( xOverdue == pdTRUE ) && ( prvForegroundBusy( xNow ) == pdTRUE ) )
+                    {
+                        xStats.ulOverdueSteps++;
+                    }
+
+                    xStats.ulSteps++;
+                    prvRunStep( pxJob );
+                }
+
+                ( void ) xSemaphoreGive( xStepMutex );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t FlashService_Init( void )
+    {
+        BaseType_t xResult = pdFALSE;
+
+        xStepMutex = xSemaphoreCreateMutexStatic( &xStepMutexBuffer );
+
+        if( ( xStepMutex != NULL ) &&
+            ( xTaskCreate( prvServiceTask,
+                           "FlashSvc",
+                           flashserviceTASK_STACK_SIZE,
+                           NULL,
+                           flashserviceTASK_PRIORITY | portPRIVILEGE_BIT,
+                           &xServiceTask ) == pdPASS ) )
+        {
+            xResult = pdTRUE;
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t FlashService_Submit( FlashServiceJob_t * pxJob,
+                                    FlashServiceStep_t xStep,
+                                    void * pvContext,
+                                    UBaseType_t uxPriority,
+                                    TickType_t xDeadline )
+    {
+        FlashServiceJob_t ** ppxLink;
+        BaseType_t xResult = pdFALSE;
+
+        configASSERT( ( xStep != NULL ) && ( xServiceTask != NULL ) );
+
+        taskENTER_CRITICAL();
+        {
+            if( pxJob->xQueued == pdFALSE )
+            {
+                pxJob->xStep = xStep;
+                pxJob->pvContext = pvContext;
+                pxJob->uxPriority = uxPriority;
+                pxJob->xDeadline = xDeadline;
+                pxJob->xSubmitted = xTaskGetTickCount();
+                pxJob->pxNext = NULL;
+                pxJob->xQueued = pdTRUE;
+
+                for( ppxLink = &pxJobs; *ppxLink != NULL; ppxLink = &( *ppxLink )->pxNext )
+                {
+                }
+
+                *ppxLink = pxJob;
+                xResult = pdTRUE;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( xResult == pdTRUE )
+        {
+            ( void ) xTaskNotifyGive( xServiceTask );
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t FlashService_Cancel( FlashServiceJob_t * pxJob )
+    {
+        BaseType_t xResult;
+
+        configASSERT( xTaskGetCurrentTaskHandle() != xServiceTask );
+
+        taskENTER_CRITICAL();
+        {
+            xResult = prvUnlink( pxJob );
+
+            if( xResult == pdTRUE )
+            {
+                xStats.ulJobsCancelled++;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        /* A step of the job may be running, the owner reuses its context on return. */
+        ( void ) xSemaphoreTake( xStepMutex, portMAX_DELAY );
+        ( void ) xSemaphoreGive( xStepMutex );
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void FlashService_RunNow( FlashServiceJob_t * pxJob )
+    {
+        configASSERT( xTaskGetCurrentTaskHandle() != xServiceTask );
+
+        ( void ) xSemaphoreTake( xStepMutex, portMAX_DELAY );
+
+        while( pxJob->xQueued == pdTRUE )
+        {
+            prvRunStep( pxJob );
+        }
+
+        ( void ) xSemaphoreGive( xStepMutex );
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t FlashService_IsQueued( const FlashServiceJob_t * pxJob )
+    {
+        return pxJob->xQueued;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void FlashService_Pause( void )
+    {
+        taskENTER_CRITICAL();
+        {
+            uxPauses++;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void FlashService_Resume( void )
+    {
+        BaseType_t xWake = pdFALSE;
+
+        taskENTER_CRITICAL();
+        {
+            configASSERT( uxPauses > 0U );
+            uxPauses--;
+            xWake = ( uxPauses == 0U ) ? pdTRUE : pdFALSE;
+        }
+        taskEXIT_CRITICAL();
+
+        if( ( xWake == pdTRUE ) && ( xServiceTask != NULL ) )
+        {
+            ( void ) xTaskNotifyGive( xServiceTask );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void FlashService_NoteForeground( void )
+    {
+        xForegroundTick = xTaskGetTickCount();
+        xForegroundSeen = pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void FlashService_GetStats( FlashServiceStats_t * pxStats )
+    {
+        taskENTER_CRITICAL();
+        {
+            *pxStats = xStats;
+        }
+        taskEXIT_CRITICAL();
+
+        pxStats->uxStackLeft = ( xServiceTask != NULL ) ? uxTaskGetStackHighWaterMark( xServiceTask ) : 0U;
+    }
+
+#endif /* if ( flashserviceENABLED == 1 ) */
@@ -0,0 +1,206 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file flash_service.h
+ * @brief Background flash jobs run one step at a time in a single low priority task, while the flash
+ * and the network are quiet. Compiled out unless flashserviceENABLED is 1.
+ *
+ * A job is a step function called repeatedly until it returns pdFALSE, each call doing a bounded
+ * amount of flash work such as a sector erase or copy. The highest priority job runs first, a job
+ * past its deadline runs ahead of the others and no longer waits for the flash and the network to
+ * be quiet. The flash is busy while mflash_drv has asynchronous requests queued and for
+ * flashserviceQUIET_MS after FlashService_NoteForeground(), the network while more than
+ * flashserviceNET_BUSY_BUFFERS network buffers are in use. FlashService_Pause() holds off every
+ * job, overdue or not, until the matching FlashService_Resume().
+ */
+
+#ifndef FLASH_SERVICE_H
+#define FLASH_SERVICE_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Set to 1 to build the flash service.
+ */
+#ifndef flashserviceENABLED
+    #define flashserviceENABLED    ( 0 )
+#endif
+
+/**
+ * @brief Time the flash is left to the foreground after FlashService_NoteForeground(), in milliseconds.
+ */
+#ifndef flashserviceQUIET_MS
+    #define flashserviceQUIET_MS    ( 200U )
+#endif
+
+/**
+ * @brief Number of network buffers in use above which the network is in a burst.
+ */
+#ifndef flashserviceNET_BUSY_BUFFERS
+    #define flashserviceNET_BUSY_BUFFERS    ( 4U )
+#endif
+
+/**
+ * @brief Period at which a job held off by the foreground is tried again, in milliseconds.
+ */
+#ifndef flashserviceRETRY_MS
+    #define flashserviceRETRY_MS    ( 50U )
+#endif
+
+/**
+ * @brief Stack size of the service task, in words, shared by the step functions.
+ */
+#ifndef flashserviceTASK_STACK_SIZE
+    #define flashserviceTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 2 )
+#endif
+
+/**
+ * @brief Priority of the service task, below the network and application tasks.
+ */
+#ifndef flashserviceTASK_PRIORITY
+    #define flashserviceTASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+#if ( flashserviceENABLED == 1 )
+
+/**
+ * @brief Step of a job, called from the service task or from FlashService_RunNow().
+ *
+ * @param[in] pvContext Context given when the job was submitted.
+ *
+ * @return pdTRUE if the job has more steps, pdFALSE once it is complete.
+ */
+    typedef BaseType_t ( * FlashServiceStep_t )( void * pvContext );
+
+/**
+ * @brief A job, owned by its submitter and left untouched while it is queued.
+ */
+    typedef struct FlashServiceJob
+    {
+        FlashServiceStep_t xStep;
+        void * pvContext;
+        UBaseType_t uxPriority;          /**< Higher runs first. */
+        TickType_t xDeadline;            /**< Ticks from the submission, portMAX_DELAY for none. */
+        TickType_t xSubmitted;           /**< Tick count at the submission. */
+        struct FlashServiceJob * pxNext; /**< Next queued job. */
+        BaseType_t xQueued;              /**< Set from the submission until the job completes or is cancelled. */
+    } FlashServiceJob_t;
+
+/**
+ * @brief Runtime statistics of the service.
+ */
+    typedef struct FlashServiceStats
+    {
+        uint32_t ulSteps;         /**< Steps run by the service task. */
+        uint32_t ulOverdueSteps;  /**< Steps run while the flash or the network was busy, for an overdue job. */
+        uint32_t ulDeferrals;     /**< Times a job was held off by the foreground or a pause. */
+        uint32_t ulJobsCompleted; /**< Jobs run to completion, by the task or FlashService_RunNow(). */
+        uint32_t ulJobsCancelled; /**< Jobs removed by FlashService_Cancel(). */
+        UBaseType_t uxStackLeft;  /**< Least stack left to the service task, in words. */
+    } FlashServiceStats_t;
+
+/**
+ * @brief Creates the service task. Must be called once, before any job is submitted.
+ *
+ * @return pdTRUE if the service is running.
+ */
+    BaseType_t FlashService_Init( void );
+
+/**
+ * @brief Queues a job. Callable from any task.
+ *
+ * @param[in] pxJob The job, not queued.
+ * @param[in] xStep Step function of the job.
+ * @param[in] pvContext Context passed to the step function.
+ * @param[in] uxPriority Priority among the jobs, higher runs first.
+ * @param[in] xDeadline Ticks after which the job runs regardless of the foreground, portMAX_DELAY for none.
+ *
+ * @return pdTRUE if queued, pdFALSE if the job is already queued.
+ */
+    BaseType_t FlashService_Submit( FlashServiceJob_t * pxJob,
+                                    FlashServiceStep_t xStep,
+                                    void * pvContext,
+                                    UBaseType_t uxPriority,
+                                    TickType_t xDeadline );
+
+/**
+ * @brief Removes a job, waiting for its running step to return. Not callable from a step function.
+ *
+ * @param[in] pxJob The job.
+ *
+ * @return pdTRUE if the job was queued, pdFALSE if it had completed.
+ */
+    BaseType_t FlashService_Cancel( FlashServiceJob_t * pxJob );
+
+/**
+ * @brief Runs the remaining steps of a job in the calling task, ignoring the foreground and the
+ * pauses, for a caller which needs the job complete. Not callable from a step function.
+ *
+ * @param[in] pxJob The job, which has completed on return.
+ */
+    void FlashService_RunNow( FlashServiceJob_t * pxJob );
+
+/**
+ * @brief Returns pdTRUE while a job is queued.
+ *
+ * @param[in] pxJob The job.
+ */
+    BaseType_t FlashService_IsQueued( const FlashServiceJob_t * pxJob );
+
+/**
+ * @brief Holds off the jobs until the matching FlashService_Resume(), for latency sensitive work.
+ * Requests nest. A running step completes first, it is bounded to a sector of flash.
+ */
+    void FlashService_Pause( void );
+
+/**
+ * @brief Releases a request of FlashService_Pause().
+ */
+    void FlashService_Resume( void );
+
+/**
+ * @brief Records a foreground flash write, which holds off the jobs for flashserviceQUIET_MS.
+ */
+    void FlashService_NoteForeground( void );
+
+/**
+ * @brief Gets the statistics of the service.
+ *
+ * @param[out] pxStats The statistics.
+ */
+    void FlashService_GetStats( FlashServiceStats_t * pxStats );
+
+#else /* if ( flashserviceENABLED == 1 ) */
+
+    #define FlashService_Pause()
+    #define FlashService_Resume()
+    #define FlashService_NoteForeground()
+
+#endif /* if ( flashserviceENABLED == 1 ) */
+
+#endif /* FLASH_SERVICE_H */
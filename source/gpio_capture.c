@@ -0,0 +1,457 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file gpio_capture.c
+ * @brief Hardware timestamped GPIO edges, collected in blocks by the SCTimer and the DMA.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_clock.h"
+#include "fsl_reset.h"
+#include "fsl_inputmux.h"
+#include "uart.h"
+
+#include "gpio_capture.h"
+#include "dma_copy.h"
+
+/* The UART adapter takes the DMA interrupt when it sends with DMA. */
+#if ( ( gpiocaptureBLOCK_EVENTS & ( gpiocaptureBLOCK_EVENTS - 1U ) ) != 0U ) || ( gpiocaptureBLOCK_EVENTS > 1024U )
+    #error "gpiocaptureBLOCK_EVENTS must be a power of 2 up to 1024."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Timestamps in the ring, two blocks.
+ */
+#define gpiocaptureRING_EVENTS      ( 2U * gpiocaptureBLOCK_EVENTS )
+
+/**
+ * @brief Bit of the channel in the DMA common registers.
+ */
+#define gpiocaptureDMA_MASK         ( 1UL << gpiocaptureDMA_CHANNEL )
+
+/**
+ * @brief XFERCOUNT of a channel once its transfer is complete.
+ */
+#define gpiocaptureXFERCOUNT_DONE   ( DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK >> DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT )
+
+/**
+ * @brief SCTimer events capturing the rising and the falling edges.
+ */
+#define gpiocaptureEVENT_RISE       ( 0U )
+#define gpiocaptureEVENT_FALL       ( 1U )
+
+/**
+ * @brief IOCOND values of the SCTimer events, and COMBMODE of an event on the input alone.
+ */
+#define gpiocaptureIOCOND_RISE      ( 1U )
+#define gpiocaptureIOCOND_FALL      ( 2U )
+#define gpiocaptureCOMBMODE_IO      ( 2U )
+
+/**
+ * @brief SCTimer register the edges are captured in.
+ */
+#define gpiocaptureCAPTURE_REG      ( 0U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief DMA channel descriptor, layout defined by the DMA controller.
+ */
+typedef struct GpioCaptureDescriptor
+{
+    uint32_t ulXferCfg;
+    const volatile void * pvSrcEnd;
+    void * pvDstEnd;
+    void * pvNext;
+} GpioCaptureDescriptor_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Channel descriptor table of DMA0, not used if another driver already set one.
+ */
+SDK_ALIGN( static GpioCaptureDescriptor_t xDescriptorTable[ FSL_FEATURE_DMA_NUMBER_OF_CHANNELS ], 512 );
+
+/**
+ * @brief Descriptors of the two blocks, each reloading the other.
+ */
+SDK_ALIGN( static GpioCaptureDescriptor_t xBlockDescriptors[ 2 ], 16 );
+
+/**
+ * @brief The ring the DMA writes the captures to.
+ */
+static uint32_t ulRing[ gpiocaptureRING_EVENTS ];
+
+/**
+ * @brief Blocks completed, counted by the DMA interrupt.
+ */
+static volatile uint32_t ulBlocksCompleted = 0;
+
+/**
+ * @brief Edges read by the consumer since the start, modulo 2^32 like the write position.
+ */
+static uint32_t ulReadPosition = 0;
+
+/**
+ * @brief Edges overwritten before they were read.
+ */
+static uint32_t ulDropped = 0;
+
+/**
+ * @brief The task in GpioCapture_Receive(), notified at the end of each block.
+ */
+static TaskHandle_t xConsumer = NULL;
+
+/**
+ * @brief Set once the capture is started.
+ */
+static BaseType_t xRunning = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+#if ( HAL_UART_DMA_USED > 0U )
+
+/* The DMA channels of the debug console, handled by the USART adapter. */
+    extern void DMA0_DriverIRQHandler( void );
+#endif
+
+void DMA0_IRQHandler( void )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if( ( DMA0->COMMON[ 0 ].INTA & gpiocaptureDMA_MASK ) != 0U )
+    {
+        DMA0->COMMON[ 0 ].INTA = gpiocaptureDMA_MASK;
+        ulBlocksCompleted++;
+
+        if( xConsumer != NULL )
+        {
+            vTaskNotifyGiveFromISR( xConsumer, &xHigherPriorityTaskWoken );
+        }
+    }
+
+    /* Not expected with the fixed addresses of the ring, the reload goes on. */
+    if( ( DMA0->COMMON[ 0 ].ERRINT & gpiocaptureDMA_MASK ) != 0U )
+    {
+        DMA0->COMMON[ 0 ].ERRINT = gpiocaptureDMA_MASK;
+    }
+
+    /* The channels of the large memory copies. */
+    DmaCopy_IRQHandler( &xHigherPriorityTaskWoken );
+
+    #if ( HAL_UART_DMA_USED > 0U )
+        DMA0_DriverIRQHandler();
+    #endif
+
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the prescaler giving a 1 MHz SCTimer count from the bus clock.
+ */
+static uint32_t prvPrescaler( void )
+{
+    uint32_t ulMhz = CLOCK_GetFreq( kCLOCK_BusClk ) / 1000000U;
+
+    return ( ulMhz > 0U ) ? ( ulMhz - 1U ) : 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the number of edges written to the ring since the start, modulo 2^32.
+ * The pending interrupt is read before the count of the channel, so that a block completing in
+ * between gives a position short of a block, which the caller ignores, and never one past the edges
+ * written.
+ */
+static uint32_t prvWritePosition( void )
+{
+    uint32_t ulBlocks;
+    uint32_t ulCount;
+    uint32_t ulWritten;
+
+    taskENTER_CRITICAL();
+    {
+        ulBlocks = ulBlocksCompleted;
+
+        if( ( DMA0->COMMON[ 0 ].INTA & gpiocaptureDMA_MASK ) != 0U )
+        {
+            ulBlocks++;
+        }
+
+        ulCount = ( DMA0->CHANNEL[ gpiocaptureDMA_CHANNEL ].XFERCFG & DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK ) >>
+                  DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT;
+    }
+    taskEXIT_CRITICAL();
+
+    /* XFERCOUNT is the number of transfers left minus 1, all ones at the end of the block. */
+    ulWritten = ( ulCount == gpiocaptureXFERCOUNT_DONE ) ? 0U : ( gpiocaptureBLOCK_EVENTS - 1U - ulCount );
+
+    return ( ulBlocks * gpiocaptureBLOCK_EVENTS ) + ulWritten;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the oldest position still in the ring: the start of the block before the one the DMA
+ * writes to.
+ */
+static uint32_t prvOldestPosition( uint32_t ulPosition )
+{
+    return ( ulPosition & ~( gpiocaptureBLOCK_EVENTS - 1U ) ) - gpiocaptureBLOCK_EVENTS;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSctInit( void )
+{
+    uint32_t ulEvents = 0;
+
+    CLOCK_EnableClock( kCLOCK_Sct0 );
+    RESET_PeripheralReset( kSCT0_RST_SHIFT_RSTn );
+
+    /* A single 32 bit counter counting up from 0 to 2^32 - 1 and wrapping, as no event limits it. */
+    SCT0->CONFIG = SCT_CONFIG_UNIFY( 1U ) | SCT_CONFIG_CLKMODE( 0U ) | SCT_CONFIG_INSYNC( 1UL << gpiocaptureSCT_INPUT );
+    SCT0->CTRL = SCT_CTRL_HALT_L_MASK | SCT_CTRL_CLRCTR_L_MASK | SCT_CTRL_PRE_L( prvPrescaler() );
+    SCT0->REGMODE = 1UL << gpiocaptureCAPTURE_REG;
+
+    #if ( ( gpiocaptureEDGES & 1U ) != 0U )
+        SCT0->EV[ gpiocaptureEVENT_RISE ].STATE = 1U;
+        SCT0->EV[ gpiocaptureEVENT_RISE ].CTRL = SCT_EV_CTRL_IOSEL( gpiocaptureSCT_INPUT ) |
+                                                 SCT_EV_CTRL_IOCOND( gpiocaptureIOCOND_RISE ) |
+                                                 SCT_EV_CTRL_COMBMODE( gpiocaptureCOMBMODE_IO );
+        ulEvents |= 1UL << gpiocaptureEVENT_RISE;
+    #endif
+
+    #if ( ( gpiocaptureEDGES & 2U ) != 0U )
+        SCT0->EV[ gpiocaptureEVENT_FALL ].STATE = 1U;
+        SCT0->EV[ gpiocaptureEVENT_FALL ].CTRL = SCT_EV_CTRL_IOSEL( gpiocaptureSCT_INPUT ) |
+                                                 SCT_EV_CTRL_IOCOND( gpiocaptureIOCOND_FALL ) |
+                                                 SCT_EV_CTRL_COMBMODE( gpiocaptureCOMBMODE_IO );
+        ulEvents |= 1UL << gpiocaptureEVENT_FALL;
+    #endif
+
+    /* Each edge captures the counter and requests the DMA, which clears the request. */
+    SCT0->CAPCTRL[ gpiocaptureCAPTURE_REG ] = ulEvents;
+    SCT0->DMAREQ0 = ulEvents;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDmaInit( void )
+{
+    GpioCaptureDescriptor_t * pxTable;
+    const uint32_t ulXferCfg = DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_RELOAD_MASK |
+                               DMA_CHANNEL_XFERCFG_SETINTA_MASK | DMA_CHANNEL_XFERCFG_WIDTH( 2U ) |
+                               DMA_CHANNEL_XFERCFG_SRCINC( 0U ) | DMA_CHANNEL_XFERCFG_DSTINC( 1U ) |
+                               DMA_CHANNEL_XFERCFG_XFERCOUNT( gpiocaptureBLOCK_EVENTS - 1U );
+
+    CLOCK_EnableClock( kCLOCK_Dma );
+
+    if( DMA0->SRAMBASE == 0U )
+    {
+        DMA0->SRAMBASE = ( uint32_t ) xDescriptorTable;
+    }
+
+    DMA0->CTRL = DMA_CTRL_ENABLE_MASK;
+
+    xBlockDescriptors[ 0 ].ulXferCfg = ulXferCfg;
+    xBlockDescriptors[ 0 ].pvSrcEnd = &SCT0->CAP[ gpiocaptureCAPTURE_REG ];
+    xBlockDescriptors[ 0 ].pvDstEnd = &ulRing[ gpiocaptureBLOCK_EVENTS - 1U ];
+    xBlockDescriptors[ 0 ].pvNext = &xBlockDescriptors[ 1 ];
+
+    xBlockDescriptors[ 1 ].ulXferCfg = ulXferCfg;
+    xBlockDescriptors[ 1 ].pvSrcEnd = &SCT0->CAP[ gpiocaptureCAPTURE_REG ];
+    xBlockDescriptors[ 1 ].pvDstEnd = &ulRing[ gpiocaptureRING_EVENTS - 1U ];
+    xBlockDescriptors[ 1 ].pvNext = &xBlockDescriptors[ 0 ];
+
+    pxTable = ( GpioCaptureDescriptor_t * ) DMA0->SRAMBASE;
+    pxTable[ gpiocaptureDMA_CHANNEL ] = xBlockDescriptors[ 0 ];
+
+    /* The SCTimer request is routed to the hardware trigger of the channel, each rising edge of it
+     * moves one timestamp. */
+    INPUTMUX_AttachSignal( INPUTMUX, gpiocaptureDMA_CHANNEL, kINPUTMUX_Sct0DmaReq0ToDma );
+
+    DMA0->CHANNEL[ gpiocaptureDMA_CHANNEL ].CFG = DMA_CHANNEL_CFG_HWTRIGEN( 1U ) | DMA_CHANNEL_CFG_TRIGPOL( 1U ) |
+                                                  DMA_CHANNEL_CFG_TRIGTYPE( 0U ) | DMA_CHANNEL_CFG_TRIGBURST( 1U ) |
+                                                  DMA_CHANNEL_CFG_BURSTPOWER( 0U );
+    DMA0->CHANNEL[ gpiocaptureDMA_CHANNEL ].XFERCFG = ulXferCfg;
+    DMA0->COMMON[ 0 ].INTENSET = gpiocaptureDMA_MASK;
+    DMA0->COMMON[ 0 ].ENABLESET = gpiocaptureDMA_MASK;
+
+    /* The USART adapter already set HAL_UART_ISR_PRIORITY, at which FreeRTOS API calls are allowed too. */
+    #if ( HAL_UART_DMA_USED == 0U )
+        NVIC_SetPriority( DMA0_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1 );
+    #endif
+    EnableIRQ( DMA0_IRQn );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t GpioCapture_Init( void )
+{
+    if( xRunning == pdFALSE )
+    {
+        INPUTMUX_Init( INPUTMUX );
+        INPUTMUX_AttachSignal( INPUTMUX, gpiocaptureSCT_INPUT, gpiocaptureSCT_SIGNAL );
+
+        prvSctInit();
+        prvDmaInit();
+
+        INPUTMUX_Deinit( INPUTMUX );
+
+        /* Start counting, edges are captured from now on. */
+        SCT0->CTRL &= ~SCT_CTRL_HALT_L_MASK;
+        xRunning = pdTRUE;
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t GpioCapture_Receive( uint32_t * pulTimestamps,
+                            size_t xMaxEvents,
+                            TickType_t xTicksToWait )
+{
+    uint32_t ulPosition;
+    uint32_t ulOldest;
+    uint32_t ulStart;
+    size_t xCount;
+    size_t xOverwritten;
+    size_t i;
+
+    configASSERT( xRunning == pdTRUE );
+
+    xConsumer = xTaskGetCurrentTaskHandle();
+
+    /* Clear the notifications of the blocks read by the previous call. */
+    ( void ) ulTaskNotifyTake( pdTRUE, 0 );
+
+    ulPosition = prvWritePosition();
+
+    if( ( int32_t ) ( ulPosition - ulReadPosition ) < ( int32_t ) gpiocaptureBLOCK_EVENTS )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, xTicksToWait );
+        ulPosition = prvWritePosition();
+    }
+
+    if( ( int32_t ) ( ulPosition - ulReadPosition ) < 0 )
+    {
+        /* A block completed while the position was read. */
+        ulPosition = ulReadPosition;
+    }
+
+    ulOldest = prvOldestPosition( ulPosition );
+
+    if( ( int32_t ) ( ulOldest - ulReadPosition ) > 0 )
+    {
+        ulDropped += ulOldest - ulReadPosition;
+        ulReadPosition = ulOldest;
+    }
+
+    xCount = ulPosition - ulReadPosition;
+
+    if( xCount > xMaxEvents )
+    {
+        xCount = xMaxEvents;
+    }
+
+    ulStart = ulReadPosition;
+
+    for( i = 0; i < xCount; i++ )
+    {
+        pulTimestamps[ i ] = ulRing[ ( ulStart + i ) & ( gpiocaptureRING_EVENTS - 1U ) ];
+    }
+
+    /* The DMA may have gone past a block while the timestamps were copied, the ones it overwrote are
+     * dropped. */
+    ulOldest = prvOldestPosition( prvWritePosition() );
+    xOverwritten = 0;
+
+    if( ( int32_t ) ( ulOldest - ulStart ) > 0 )
+    {
+        xOverwritten = ulOldest - ulStart;
+
+        if( xOverwritten > xCount )
+        {
+            xOverwritten = xCount;
+        }
+
+        memmove( pulTimestamps, &pulTimestamps[ xOverwritten ], ( xCount - xOverwritten ) * sizeof( uint32_t ) );
+        ulDropped += xOverwritten;
+    }
+
+    ulReadPosition = ulStart + xCount;
+
+    return xCount - xOverwritten;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t GpioCapture_GetTimeUs( void )
+{
+    return SCT0->COUNT;
+}
+
+/*-----------------------------------------------------------*/
+
+void GpioCapture_CoreClockChanged( void )
+{
+    if( xRunning == pdTRUE )
+    {
+        /* PRE_L is only written while the counter is halted, which loses a few microseconds. */
+        SCT0->CTRL |= SCT_CTRL_HALT_L_MASK;
+        SCT0->CTRL = ( SCT0->CTRL & ~SCT_CTRL_PRE_L_MASK ) | SCT_CTRL_PRE_L( prvPrescaler() );
+        SCT0->CTRL &= ~SCT_CTRL_HALT_L_MASK;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t GpioCapture_IsRunning( void )
+{
+    return xRunning;
+}
+
+/*-----------------------------------------------------------*/
+
+void GpioCapture_GetStats( GpioCaptureStats_t * pxStats )
+{
+    pxStats->ulEvents = ( xRunning == pdTRUE ) ? prvWritePosition() : 0U;
+    pxStats->ulBlocks = ulBlocksCompleted;
+    pxStats->ulDropped = ulDropped;
+}
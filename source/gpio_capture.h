@@ -0,0 +1,140 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file gpio_capture.h
+ * @brief Hardware timestamped GPIO edges, collected in blocks without an interrupt per edge.
+ *
+ * The edges are routed by INPUTMUX from an SCT0_GPI pin, muxed by the board pin_mux.c, to an SCTimer
+ * input. The SCTimer counts microseconds and captures its counter on each selected edge, and the
+ * capture raises a DMA request: a DMA channel copies the capture into a ring of two blocks of
+ * gpiocaptureBLOCK_EVENTS timestamps, linked to each other. The only interrupt is the DMA one at the
+ * end of each block, which wakes the consumer.
+ */
+
+#ifndef GPIO_CAPTURE_H
+#define GPIO_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief SCTimer input the edges are captured from, 0 to 7.
+ */
+#ifndef gpiocaptureSCT_INPUT
+    #define gpiocaptureSCT_INPUT     ( 0U )
+#endif
+
+/**
+ * @brief INPUTMUX signal routed to gpiocaptureSCT_INPUT, an inputmux_connection_t.
+ */
+#ifndef gpiocaptureSCT_SIGNAL
+    #define gpiocaptureSCT_SIGNAL    kINPUTMUX_SctGpi0ToSct0
+#endif
+
+/**
+ * @brief Edges captured: 1 for rising edges, 2 for falling edges, 3 for both.
+ */
+#ifndef gpiocaptureEDGES
+    #define gpiocaptureEDGES    ( 1U )
+#endif
+
+/**
+ * @brief DMA channel copying the captures, its peripheral request unused. The first channels are
+ * wired to the Flexcomm interfaces.
+ */
+#ifndef gpiocaptureDMA_CHANNEL
+    #define gpiocaptureDMA_CHANNEL    ( 28U )
+#endif
+
+/**
+ * @brief Timestamps in a block, a power of 2 up to 1024, the longest DMA transfer.
+ * The consumer must read a block within the time the edges take to fill the next one.
+ */
+#ifndef gpiocaptureBLOCK_EVENTS
+    #define gpiocaptureBLOCK_EVENTS    ( 256U )
+#endif
+
+/**
+ * @brief Counters of the capture.
+ */
+typedef struct GpioCaptureStats
+{
+    uint32_t ulEvents;  /**< Edges captured. */
+    uint32_t ulBlocks;  /**< Blocks completed, and DMA interrupts. */
+    uint32_t ulDropped; /**< Edges overwritten before the consumer read them. */
+} GpioCaptureStats_t;
+
+/**
+ * @brief Sets up the capture and starts it. Must be called once, from a privileged task.
+ *
+ * @return pdTRUE if the capture is started.
+ */
+BaseType_t GpioCapture_Init( void );
+
+/**
+ * @brief Waits for a block of edges and reads them, oldest first. Returns at once when a block is
+ * complete, or after xTicksToWait with the edges captured so far. Only one task may read.
+ *
+ * @param[out] pulTimestamps The timestamps of the edges, in microseconds of GpioCapture_GetTimeUs().
+ * @param[in] xMaxEvents Number of timestamps pulTimestamps holds, best gpiocaptureBLOCK_EVENTS.
+ * @param[in] xTicksToWait Longest wait for a complete block.
+ *
+ * @return The number of timestamps read.
+ */
+size_t GpioCapture_Receive( uint32_t * pulTimestamps,
+                            size_t xMaxEvents,
+                            TickType_t xTicksToWait );
+
+/**
+ * @brief Gets the time base of the timestamps, to relate them to the other clocks.
+ *
+ * @return The counter of the SCTimer, in microseconds, modulo 2^32.
+ */
+uint32_t GpioCapture_GetTimeUs( void );
+
+/**
+ * @brief Sets the SCTimer prescaler again for the new bus clock, called by clock_scaling.c.
+ */
+void GpioCapture_CoreClockChanged( void );
+
+/**
+ * @brief Tells whether the capture runs, deep sleep stops the SCTimer and the DMA.
+ *
+ * @return pdTRUE once GpioCapture_Init() succeeded.
+ */
+BaseType_t GpioCapture_IsRunning( void );
+
+/**
+ * @brief Copies the counters of the capture.
+ *
+ * @param[out] pxStats The counters.
+ */
+void GpioCapture_GetStats( GpioCaptureStats_t * pxStats );
+
+#endif /* GPIO_CAPTURE_H */
@@ -0,0 +1,754 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file heap_monitor.c
+ * @brief Periodic heap_4 statistics, exhaustion and fragmentation alerts, and optional attribution
+ * of the allocations to their call sites.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_debug_console.h"
+
+#include "connection_manager.h"
+
+#include "heap_monitor.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Topics the stats and the alerts are published on, formatted with the thing name.
+ */
+#define heapmonitorTOPIC_FORMAT          "device/%.*s/heap"
+#define heapmonitorALERT_TOPIC_FORMAT    "device/%.*s/heap/alert"
+
+/**
+ * @brief Size of the buffer holding the topic.
+ */
+#define heapmonitorTOPIC_MAX_SIZE        ( 160U )
+
+/**
+ * @brief Number of call sites in the stats, the ones holding the most bytes.
+ */
+#define heapmonitorREPORTED_SITES        ( 4U )
+
+/**
+ * @brief Size of the JSON payload buffer.
+ */
+#define heapmonitorPAYLOAD_MAX_SIZE      ( 224U + ( heapmonitorREPORTED_SITES * 48U ) )
+
+/**
+ * @brief Period at which the heap is sampled and the alerts are checked.
+ */
+#ifndef heapmonitorSAMPLE_PERIOD_MS
+    #define heapmonitorSAMPLE_PERIOD_MS    ( 10000U )
+#endif
+
+/**
+ * @brief Period at which the stats are published.
+ */
+#ifndef heapmonitorPUBLISH_PERIOD_MS
+    #define heapmonitorPUBLISH_PERIOD_MS    ( 300000U )
+#endif
+
+/**
+ * @brief The low_free alert is raised below this many free bytes, and cleared once the free bytes
+ * are back above it by heapmonitorHYSTERESIS_BYTES.
+ */
+#ifndef heapmonitorLOW_FREE_BYTES
+    #define heapmonitorLOW_FREE_BYTES    ( 16U * 1024U )
+#endif
+
+/**
+ * @brief The small_block alert is raised when the largest free block is below this size. The default
+ * leaves room for the mbed TLS input buffer of a new connection, MBEDTLS_SSL_IN_CONTENT_LEN plus the
+ * record overhead.
+ */
+#ifndef heapmonitorMIN_LARGEST_BLOCK_BYTES
+    #define heapmonitorMIN_LARGEST_BLOCK_BYTES    ( 8U * 1024U )
+#endif
+
+#ifndef heapmonitorHYSTERESIS_BYTES
+    #define heapmonitorHYSTERESIS_BYTES    ( 2U * 1024U )
+#endif
+
+/**
+ * @brief The fragmenting alert is raised when the smallest largest free block of a window is lower
+ * than the one of the previous window for heapmonitorTREND_WINDOWS windows in a row.
+ */
+#ifndef heapmonitorTREND_WINDOW_MS
+    #define heapmonitorTREND_WINDOW_MS    ( 3600000U )
+#endif
+
+#ifndef heapmonitorTREND_WINDOWS
+    #define heapmonitorTREND_WINDOWS    ( 6U )
+#endif
+
+/**
+ * @brief Number of call sites and of outstanding allocations tracked with heapmonitorTRACK_CALLERS.
+ */
+#ifndef heapmonitorMAX_SITES
+    #define heapmonitorMAX_SITES    ( 32U )
+#endif
+
+#ifndef heapmonitorMAX_BLOCKS
+    #define heapmonitorMAX_BLOCKS    ( 192U )
+#endif
+
+/**
+ * @brief Priority of the monitor task, just above idle like the task stats.
+ */
+#ifndef heapmonitorTASK_PRIORITY
+    #define heapmonitorTASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Stack size of the monitor task, in words, snprintf needs most of it.
+ */
+#ifndef heapmonitorTASK_STACK_SIZE
+    #define heapmonitorTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+#if ( heapmonitorSAMPLE_PERIOD_MS > heapmonitorPUBLISH_PERIOD_MS )
+    #error "heapmonitorSAMPLE_PERIOD_MS must not be longer than heapmonitorPUBLISH_PERIOD_MS."
+#endif
+
+/**
+ * @brief Alert bits.
+ */
+#define heapmonitorALERT_LOW_FREE       ( 1UL << 0 )
+#define heapmonitorALERT_SMALL_BLOCK    ( 1UL << 1 )
+#define heapmonitorALERT_FRAGMENTING    ( 1UL << 2 )
+#define heapmonitorALERT_ALLOC_FAILED   ( 1UL << 3 )
+#define heapmonitorALERT_COUNT          ( 4U )
+
+/*-----------------------------------------------------------*/
+
+#if ( heapmonitorTRACK_CALLERS == 1 )
+
+/**
+ * @brief Bytes held by the allocations of a call site.
+ */
+    typedef struct HeapMonitorSite
+    {
+        const void * pvCaller; /**< Return address of pvPortMalloc(), NULL for the sites beyond the table. */
+        uint32_t ulBytes;      /**< Bytes currently allocated. */
+        uint32_t ulBlocks;     /**< Blocks currently allocated. */
+        uint32_t ulPeakBytes;  /**< Most bytes allocated at the same time. */
+    } HeapMonitorSite_t;
+
+/**
+ * @brief Outstanding allocation, to find its call site when it is freed.
+ */
+    typedef struct HeapMonitorBlock
+    {
+        const void * pvAddress; /**< NULL for a free entry. */
+        uint32_t ulSize;
+        uint32_t ulSite;
+    } HeapMonitorBlock_t;
+
+#endif /* if ( heapmonitorTRACK_CALLERS == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+static const char * const pcAlertNames[ heapmonitorALERT_COUNT ] =
+{
+    "low_free",
+    "small_block",
+    "fragmenting",
+    "alloc_failed"
+};
+
+/**
+ * @brief Thing name used in the topics, not copied.
+ */
+static const char * pcHeapThingName;
+static uint32_t ulHeapThingNameLength;
+
+/**
+ * @brief Failed allocations, counted by the malloc failed hook.
+ */
+static volatile uint32_t ulAllocFailures = 0;
+
+/**
+ * @brief Publish period, changed at run time by HeapMonitor_SetPublishPeriod().
+ */
+static volatile uint32_t ulPublishPeriodMs = heapmonitorPUBLISH_PERIOD_MS;
+
+/**
+ * @brief Smallest largest free block seen since boot, and in the current trend window.
+ */
+static size_t xMinLargestBlock = SIZE_MAX;
+static size_t xWindowMinLargestBlock = SIZE_MAX;
+
+/**
+ * @brief Alerts currently raised, and alerts raised but not yet published.
+ */
+static uint32_t ulAlertsRaised = 0;
+static uint32_t ulAlertsToSend = 0;
+
+/**
+ * @brief Publish owned by the agent until it is sent, shared by the stats and the alerts.
+ */
+static ConnectionPublish_t xPublish;
+static char cTopic[ heapmonitorTOPIC_MAX_SIZE ];
+static char cPayload[ heapmonitorPAYLOAD_MAX_SIZE ];
+
+#if ( heapmonitorTRACK_CALLERS == 1 )
+    static HeapMonitorSite_t xSites[ heapmonitorMAX_SITES ];
+    static uint32_t ulSiteCount = 0;
+    static HeapMonitorBlock_t xBlocks[ heapmonitorMAX_BLOCKS ];
+    static uint32_t ulUntrackedBlocks = 0;
+    static size_t xLastFailedSize = 0;
+    static const void * pvLastFailedCaller = NULL;
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if ( heapmonitorTRACK_CALLERS == 1 )
+
+    void HeapMonitor_TraceMalloc( const void * pvAddress,
+                                  size_t xSize,
+                                  const void * pvCaller )
+    {
+        HeapMonitorSite_t * pxSite;
+        uint32_t ulSite;
+        uint32_t i;
+
+        if( pvAddress == NULL )
+        {
+            xLastFailedSize = xSize;
+            pvLastFailedCaller = pvCaller;
+            return;
+        }
+
+        for( ulSite = 0; ( ulSite < ulSiteCount ) && ( xSites[ ulSite ].pvCaller != pvCaller ); ulSite++ )
+        {
+        }
+
+        if( ulSite == ulSiteCount )
+        {
+            if( ulSiteCount < heapmonitorMAX_SITES )
+            {
+                ulSiteCount++;
+                xSites[ ulSite ].pvCaller = pvCaller;
+            }
+            else
+            {
+                /* The last entry collects the sites beyond the table. */
+                ulSite = heapmonitorMAX_SITES - 1U;
+                xSites[ ulSite ].pvCaller = NULL;
+            }
+        }
+
+        for( i = 0; ( i < heapmonitorMAX_BLOCKS ) && ( xBlocks[ i ].pvAddress != NULL ); i++ )
+        {
+        }
+
+        if( i < heapmonitorMAX_BLOCKS )
+        {
+            pxSite = &xSites[ ulSite ];
+            pxSite->ulBytes += ( uint32_t ) xSize;
+            pxSite->ulBlocks++;
+
+            if( pxSite->ulBytes > pxSite->ulPeakBytes )
+            {
+                pxSite->ulPeakBytes = pxSite->ulBytes;
+            }
+
+            xBlocks[ i ].pvAddress = pvAddress;
+            xBlocks[ i ].ulSize = ( uint32_t ) xSize;
+            xBlocks[ i ].ulSite = ulSite;
+        }
+        else
+        {
+            ulUntrackedBlocks++;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void HeapMonitor_TraceFree( const void * pvAddress )
+    {
+        HeapMonitorSite_t * pxSite;
+        uint32_t i;
+
+        for( i = 0; ( i < heapmonitorMAX_BLOCKS ) && ( xBlocks[ i ].pvAddress != pvAddress ); i++ )
+        {
+        }
+
+        if( ( pvAddress != NULL ) && ( i < heapmonitorMAX_BLOCKS ) )
+        {
+            pxSite = &xSites[ xBlocks[ i ].ulSite ];
+            pxSite->ulBytes -= xBlocks[ i ].ulSize;
+            pxSite->ulBlocks--;
+            xBlocks[ i ].pvAddress = NULL;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copies the call sites holding the most bytes, largest first.
+ *
+ * @return The number of sites copied.
+ */
+    static uint32_t prvGetTopSites( HeapMonitorSite_t * pxTop,
+                                    uint32_t ulMaxSites )
+    {
+        uint32_t ulCount = 0;
+        uint32_t i, j;
+
+        /* The table is written with the scheduler suspended. */
+        vTaskSuspendAll();
+        {
+            for( i = 0; i < ulSiteCount; i++ )
+            {
+                if( xSites[ i ].ulBytes == 0U )
+                {
+                    continue;
+                }
+
+                for( j = ulCount; ( j > 0U ) && ( pxTop[ j - 1U ].ulBytes < xSites[ i ].ulBytes ); j-- )
+                {
+                    if( j < ulMaxSites )
+                    {
+                        pxTop[ j ] = pxTop[ j - 1U ];
+                    }
+                }
+
+                if( j < ulMaxSites )
+                {
+                    pxTop[ j ] = xSites[ i ];
+                    ulCount = ( ulCount < ulMaxSites ) ? ( ulCount + 1U ) : ulCount;
+                }
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        return ulCount;
+    }
+
+#endif /* if ( heapmonitorTRACK_CALLERS == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+void HeapMonitor_MallocFailed( void )
+{
+    ulAllocFailures++;
+}
+
+/*-----------------------------------------------------------*/
+
+void HeapMonitor_Dump( void )
+{
+    HeapStats_t xStats;
+
+    vPortGetHeapStats( &xStats );
+
+    PRINTF( "Heap: free %u, min free %u, largest block %u, free blocks %u, failed allocations %lu.\r\n",
+            ( unsigned ) xStats.xAvailableHeapSpaceInBytes, ( unsigned ) xStats.xMinimumEverFreeBytesRemaining,
+            ( unsigned ) xStats.xSizeOfLargestFreeBlockInBytes, ( unsigned ) xStats.xNumberOfFreeBlocks,
+            ( unsigned long ) ulAllocFailures );
+
+    #if ( heapmonitorTRACK_CALLERS == 1 )
+    {
+        HeapMonitorSite_t xSite;
+        uint32_t i;
+
+        PRINTF( "HEAP_SITE,caller,bytes,blocks,peak_bytes\r\n" );
+
+        for( i = 0; i < ulSiteCount; i++ )
+        {
+            vTaskSuspendAll();
+            {
+                xSite = xSites[ i ];
+            }
+            ( void ) xTaskResumeAll();
+
+            PRINTF( "HEAP_SITE,%p,%lu,%lu,%lu\r\n", xSite.pvCaller, ( unsigned long ) xSite.ulBytes,
+                    ( unsigned long ) xSite.ulBlocks, ( unsigned long ) xSite.ulPeakBytes );
+        }
+
+        if( ulUntrackedBlocks > 0U )
+        {
+            PRINTF( "%lu allocations not tracked, heapmonitorMAX_BLOCKS is too small.\r\n",
+                    ( unsigned long ) ulUntrackedBlocks );
+        }
+
+        if( pvLastFailedCaller != NULL )
+        {
+            PRINTF( "Last failed allocation: %u bytes from %p.\r\n", ( unsigned ) xLastFailedSize, pvLastFailedCaller );
+        }
+    }
+    #endif /* if ( heapmonitorTRACK_CALLERS == 1 ) */
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes the payload with QoS0 from the static buffers.
+ *
+ * @param[in] pcTopicFormat Format of the topic, with the thing name.
+ * @param[in] xLength Length of the payload in cPayload.
+ *
+ * @return pdTRUE if the publish is queued.
+ */
+static BaseType_t prvPublish( const char * pcTopicFormat,
+                              size_t xLength )
+{
+    int lLength;
+
+    lLength = snprintf( cTopic, sizeof( cTopic ), pcTopicFormat, ( int ) ulHeapThingNameLength, pcHeapThingName );
+
+    /* Bounded so a stalled agent never delays the next sample. */
+    return ConnectionManager_Publish( &xPublish, cTopic, ( uint16_t ) lLength, MQTTQoS0, cPayload, xLength,
+                                      NULL, NULL, pdMS_TO_TICKS( heapmonitorSAMPLE_PERIOD_MS ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Percentage of the free bytes outside the largest free block.
+ */
+static uint32_t prvFragmentation( const HeapStats_t * pxStats )
+{
+    uint32_t ulFragmentation = 0;
+
+    if( pxStats->xAvailableHeapSpaceInBytes > 0U )
+    {
+        ulFragmentation = ( uint32_t ) ( 100U - ( ( ( uint64_t ) pxStats->xSizeOfLargestFreeBlockInBytes * 100U ) /
+                                                  pxStats->xAvailableHeapSpaceInBytes ) );
+    }
+
+    return ulFragmentation;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Raises and clears the alerts from a sample of the heap.
+ */
+static void prvCheckAlerts( const HeapStats_t * pxStats )
+{
+    static uint32_t ulLastFailures = 0;
+    uint32_t ulFailures = ulAllocFailures;
+    uint32_t ulRaised = ulAlertsRaised;
+
+    if( pxStats->xAvailableHeapSpaceInBytes < heapmonitorLOW_FREE_BYTES )
+    {
+        ulRaised |= heapmonitorALERT_LOW_FREE;
+    }
+    else if( pxStats->xAvailableHeapSpaceInBytes >= ( heapmonitorLOW_FREE_BYTES + heapmonitorHYSTERESIS_BYTES ) )
+    {
+        ulRaised &= ~heapmonitorALERT_LOW_FREE;
+    }
+    else
+    {
+        /* Within the hysteresis, the alert is kept as it is. */
+    }
+
+    if( pxStats->xSizeOfLargestFreeBlockInBytes < heapmonitorMIN_LARGEST_BLOCK_BYTES )
+    {
+        ulRaised |= heapmonitorALERT_SMALL_BLOCK;
+    }
+    else if( pxStats->xSizeOfLargestFreeBlockInBytes >= ( heapmonitorMIN_LARGEST_BLOCK_BYTES + heapmonitorHYSTERESIS_BYTES ) )
+    {
+        ulRaised &= ~heapmonitorALERT_SMALL_BLOCK;
+    }
+    else
+    {
+        /* Within the hysteresis, the alert is kept as it is. */
+    }
+
+    if( ( ulRaised & ~ulAlertsRaised ) != 0U )
+    {
+        ulAlertsToSend |= ulRaised & ~ulAlertsRaised;
+        HeapMonitor_Dump();
+    }
+
+    /* Failures are not a condition that clears, every new one is reported. */
+    if( ulFailures != ulLastFailures )
+    {
+        ulLastFailures = ulFailures;
+        ulAlertsToSend |= heapmonitorALERT_ALLOC_FAILED;
+        HeapMonitor_Dump();
+    }
+
+    ulAlertsRaised = ulRaised;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Closes a trend window, raises the fragmenting alert after heapmonitorTREND_WINDOWS windows
+ * in a row with a lower largest free block.
+ */
+static void prvCheckTrend( void )
+{
+    static size_t xPreviousWindowMin = SIZE_MAX;
+    static uint32_t ulFallingWindows = 0;
+
+    if( xWindowMinLargestBlock < xPreviousWindowMin )
+    {
+        ulFallingWindows++;
+    }
+    else
+    {
+        ulFallingWindows = 0;
+        ulAlertsRaised &= ~heapmonitorALERT_FRAGMENTING;
+    }
+
+    /* The first window only sets the reference. */
+    if( xPreviousWindowMin == SIZE_MAX )
+    {
+        ulFallingWindows = 0;
+    }
+
+    if( ( ulFallingWindows >= heapmonitorTREND_WINDOWS ) && ( ( ulAlertsRaised & heapmonitorALERT_FRAGMENTING ) == 0U ) )
+    {
+        ulAlertsRaised |= heapmonitorALERT_FRAGMENTING;
+        ulAlertsToSend |= heapmonitorALERT_FRAGMENTING;
+    }
+
+    xPreviousWindowMin = xWindowMinLargestBlock;
+    xWindowMinLargestBlock = SIZE_MAX;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes the alerts waiting to be sent, they are kept for the next sample if the publish
+ * is not queued.
+ */
+static void prvPublishAlerts( const HeapStats_t * pxStats )
+{
+    size_t xLength;
+    int lWritten;
+    uint32_t i;
+
+    lWritten = snprintf( cPayload, sizeof( cPayload ), "{\"alerts\":[" );
+    xLength = ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+    for( i = 0; i < heapmonitorALERT_COUNT; i++ )
+    {
+        if( ( ulAlertsToSend & ( 1UL << i ) ) != 0U )
+        {
+            lWritten = snprintf( &cPayload[ xLength ], sizeof( cPayload ) - xLength, "%s\"%s\"",
+                                 ( cPayload[ xLength - 1U ] == '[' ) ? "" : ",", pcAlertNames[ i ] );
+            xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+        }
+    }
+
+    lWritten = snprintf( &cPayload[ xLength ], sizeof( cPayload ) - xLength,
+                         "],\"free\":%u,\"largest\":%u,\"min_free\":%u}",
+                         ( unsigned ) pxStats->xAvailableHeapSpaceInBytes,
+                         ( unsigned ) pxStats->xSizeOfLargestFreeBlockInBytes,
+                         ( unsigned ) pxStats->xMinimumEverFreeBytesRemaining );
+    xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+    PRINTF( "Heap alert: %.*s\r\n", ( int ) xLength, cPayload );
+
+    if( prvPublish( heapmonitorALERT_TOPIC_FORMAT, xLength ) == pdTRUE )
+    {
+        ulAlertsToSend = 0;
+    }
+    else
+    {
+        PRINTF( "Heap alert not queued.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes the heap statistics.
+ */
+static void prvPublishStats( const HeapStats_t * pxStats )
+{
+    size_t xLength;
+    int lWritten;
+
+    lWritten = snprintf( cPayload, sizeof( cPayload ),
+                         "{\"free\":%u,\"min_free\":%u,\"largest\":%u,\"min_largest\":%u,\"blocks\":%u,\"frag\":%lu,"
+                         "\"allocs\":%u,\"frees\":%u,\"failed\":%lu",
+                         ( unsigned ) pxStats->xAvailableHeapSpaceInBytes,
+                         ( unsigned ) pxStats->xMinimumEverFreeBytesRemaining,
+                         ( unsigned ) pxStats->xSizeOfLargestFreeBlockInBytes,
+                         ( unsigned ) xMinLargestBlock,
+                         ( unsigned ) pxStats->xNumberOfFreeBlocks,
+                         ( unsigned long ) prvFragmentation( pxStats ),
+                         ( unsigned ) pxStats->xNumberOfSuccessfulAllocations,
+                         ( unsigned ) pxStats->xNumberOfSuccessfulFrees,
+                         ( unsigned long ) ulAllocFailures );
+    xLength = ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+    #if ( heapmonitorTRACK_CALLERS == 1 )
+    {
+        HeapMonitorSite_t xTop[ heapmonitorREPORTED_SITES ];
+        uint32_t ulCount;
+        uint32_t i;
+
+        ulCount = prvGetTopSites( xTop, heapmonitorREPORTED_SITES );
+
+        lWritten = snprintf( &cPayload[ xLength ], sizeof( cPayload ) - xLength, ",\"sites\":[" );
+        xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+        for( i = 0; ( i < ulCount ) && ( xLength < sizeof( cPayload ) ); i++ )
+        {
+            lWritten = snprintf( &cPayload[ xLength ], sizeof( cPayload ) - xLength,
+                                 "%s{\"pc\":\"%p\",\"bytes\":%lu,\"blocks\":%lu}",
+                                 ( i == 0U ) ? "" : ",", xTop[ i ].pvCaller,
+                                 ( unsigned long ) xTop[ i ].ulBytes, ( unsigned long ) xTop[ i ].ulBlocks );
+            xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+        }
+
+        if( xLength < sizeof( cPayload ) )
+        {
+            cPayload[ xLength++ ] = ']';
+        }
+    }
+    #endif /* if ( heapmonitorTRACK_CALLERS == 1 ) */
+
+    if( xLength < ( sizeof( cPayload ) - 1U ) )
+    {
+        cPayload[ xLength++ ] = '}';
+        ( void ) prvPublish( heapmonitorTOPIC_FORMAT, xLength );
+    }
+    else
+    {
+        PRINTF( "Heap stats do not fit in the buffer.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t HeapMonitor_SetPublishPeriod( uint32_t ulPeriodMs )
+{
+    if( ulPeriodMs < heapmonitorSAMPLE_PERIOD_MS )
+    {
+        return pdFALSE;
+    }
+
+    ulPublishPeriodMs = ulPeriodMs;
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvHeapMonitorTask( void * pvParameters )
+{
+    HeapStats_t xStats;
+    TickType_t xLastWakeTime;
+    TickType_t xLastPublish;
+    TickType_t xWindowStart;
+    BaseType_t xStatsDue = pdFALSE;
+
+    ( void ) pvParameters;
+
+    xLastWakeTime = xTaskGetTickCount();
+    xLastPublish = xLastWakeTime;
+    xWindowStart = xLastWakeTime;
+
+    for( ; ; )
+    {
+        vPortGetHeapStats( &xStats );
+
+        if( xStats.xSizeOfLargestFreeBlockInBytes < xMinLargestBlock )
+        {
+            xMinLargestBlock = xStats.xSizeOfLargestFreeBlockInBytes;
+        }
+
+        if( xStats.xSizeOfLargestFreeBlockInBytes < xWindowMinLargestBlock )
+        {
+            xWindowMinLargestBlock = xStats.xSizeOfLargestFreeBlockInBytes;
+        }
+
+        prvCheckAlerts( &xStats );
+
+        if( ( xLastWakeTime - xWindowStart ) >= pdMS_TO_TICKS( heapmonitorTREND_WINDOW_MS ) )
+        {
+            xWindowStart = xLastWakeTime;
+            prvCheckTrend();
+        }
+
+        if( ( xLastWakeTime - xLastPublish ) >= pdMS_TO_TICKS( ulPublishPeriodMs ) )
+        {
+            xLastPublish = xLastWakeTime;
+            xStatsDue = pdTRUE;
+        }
+
+        /* One publish at a time, the alerts go first and the rest waits for the next sample. */
+        if( ConnectionManager_PublishPending( &xPublish ) == pdFALSE )
+        {
+            if( ulAlertsToSend != 0U )
+            {
+                prvPublishAlerts( &xStats );
+            }
+            else if( xStatsDue == pdTRUE )
+            {
+                xStatsDue = pdFALSE;
+                prvPublishStats( &xStats );
+            }
+            else
+            {
+                /* Nothing to publish. */
+            }
+        }
+
+        vTaskDelayUntil( &xLastWakeTime, pdMS_TO_TICKS( heapmonitorSAMPLE_PERIOD_MS ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t HeapMonitor_Init( const char * pcThingName,
+                             uint32_t ulThingNameLength )
+{
+    BaseType_t result;
+
+    pcHeapThingName = pcThingName;
+    ulHeapThingNameLength = ulThingNameLength;
+
+    result = xTaskCreate( prvHeapMonitorTask,
+                          "HeapMon_task",
+                          heapmonitorTASK_STACK_SIZE,
+                          NULL,
+                          heapmonitorTASK_PRIORITY | portPRIVILEGE_BIT,
+                          NULL );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create heap monitor task.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
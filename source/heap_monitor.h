@@ -0,0 +1,113 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file heap_monitor.h
+ * @brief Periodic heap_4 statistics, exhaustion and fragmentation alerts, and optional attribution
+ * of the allocations to their call sites.
+ */
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Set to 1 to attribute the allocations to the functions calling pvPortMalloc(), through the
+ * traceMALLOC() and traceFREE() hooks defined in FreeRTOSConfig.h. Meant for debug builds: it takes
+ * about 3 KB of RAM and replaces the Tracealyzer memory events. Allocations made through a wrapper,
+ * such as mbedtls_platform_calloc(), are attributed to the wrapper.
+ */
+#ifndef heapmonitorTRACK_CALLERS
+    #define heapmonitorTRACK_CALLERS    ( 0 )
+#endif
+
+/**
+ * @brief Creates the task sampling the heap statistics every heapmonitorSAMPLE_PERIOD_MS and
+ * publishing them as JSON on "device/<thing name>/heap" every heapmonitorPUBLISH_PERIOD_MS, e.g.
+ * {"free":31200,"min_free":18016,"largest":24576,"min_largest":9216,"blocks":5,"frag":21,
+ * "allocs":10522,"frees":10480,"failed":0}
+ * where "frag" is the percentage of the free bytes outside the largest free block. With
+ * heapmonitorTRACK_CALLERS, "sites" lists the callers holding the most bytes.
+ * Alerts are published on "device/<thing name>/heap/alert" as soon as they are raised, e.g.
+ * {"alerts":["low_free","fragmenting"],"free":14000,"largest":6144,"min_free":12288}
+ * Must be called once the MQTT agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t HeapMonitor_Init( const char * pcThingName,
+                             uint32_t ulThingNameLength );
+
+/**
+ * @brief Records a failed allocation, called by vApplicationMallocFailedHook(). The alert is
+ * published by the monitor task at its next sample. Can be called before HeapMonitor_Init().
+ */
+void HeapMonitor_MallocFailed( void );
+
+/**
+ * @brief Prints the heap statistics and, with heapmonitorTRACK_CALLERS, the outstanding bytes of each
+ * call site on the debug console: HEAP_SITE,caller,bytes,blocks,peak_bytes
+ */
+void HeapMonitor_Dump( void );
+
+/**
+ * @brief Changes the period at which the stats are published, from the next sample on. The alerts are
+ * still published as soon as they are raised.
+ *
+ * @param[in] ulPeriodMs The new period, not shorter than heapmonitorSAMPLE_PERIOD_MS.
+ *
+ * @return pdTRUE if the period is valid.
+ */
+BaseType_t HeapMonitor_SetPublishPeriod( uint32_t ulPeriodMs );
+
+#if ( heapmonitorTRACK_CALLERS == 1 )
+
+/**
+ * @brief Called by traceMALLOC() with the scheduler suspended.
+ *
+ * @param[in] pvAddress The allocated block, NULL if the allocation failed.
+ * @param[in] xSize The size of the allocation.
+ * @param[in] pvCaller Return address of pvPortMalloc().
+ */
+    void HeapMonitor_TraceMalloc( const void * pvAddress,
+                                  size_t xSize,
+                                  const void * pvCaller );
+
+/**
+ * @brief Called by traceFREE() with the scheduler suspended.
+ *
+ * @param[in] pvAddress The freed block.
+ */
+    void HeapMonitor_TraceFree( const void * pvAddress );
+
+#endif /* if ( heapmonitorTRACK_CALLERS == 1 ) */
+
+#endif /* HEAP_MONITOR_H */
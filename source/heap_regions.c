@@ -0,0 +1,203 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file heap_regions.c
+ * @brief Placement of the heap and of the large static buffers across the RAM banks.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "fsl_common.h"
+#include "fsl_debug_console.h"
+
+#include "heap_regions.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Enables the clock of USB_RAM, called by SystemInit() before the startup code
+ * initializes the data and bss sections. USB_RAM is clocked by the USB1 RAM gate, which is off
+ * at reset.
+ */
+void SystemInitHook( void )
+{
+    SYSCON->AHBCLKCTRLSET[ 2 ] = SYSCON_AHBCLKCTRL_USB1RAM_MASK;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( BOARD_SDRAM_ENABLED == 1 )
+
+/**
+ * @brief Bounds of the variables placed in the SDRAM, defined by Demo.ld.
+ */
+    extern uint8_t __start_bss_SDRAM[];
+    extern uint8_t __end_bss_SDRAM[];
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t HeapRegions_InitSdram( void )
+    {
+        BaseType_t xResult = pdFALSE;
+
+        BOARD_InitSDRAMPins();
+        BOARD_InitSDRAM();
+
+        if( BOARD_CheckSDRAM() == kStatus_Success )
+        {
+            ( void ) memset( __start_bss_SDRAM, 0, ( size_t ) ( __end_bss_SDRAM - __start_bss_SDRAM ) );
+            xResult = pdTRUE;
+        }
+
+        return xResult;
+    }
+
+#endif /* BOARD_SDRAM_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+#if ( configFRTOS_MEMORY_SCHEME == 5 )
+
+/**
+ * @brief Bounds of the free RAM of each bank, defined by Demo.ld.
+ */
+    extern uint8_t __heap_SRAMX_start__[];
+    extern uint8_t __heap_SRAMX_end__[];
+    extern uint8_t __heap_FASTCODE_start__[];
+    extern uint8_t __heap_FASTCODE_end__[];
+    extern uint8_t __heap_SRAM_0_1_2_3_start__[];
+    extern uint8_t __heap_SRAM_0_1_2_3_end__[];
+    extern uint8_t __heap_SRAM3_start__[];
+    extern uint8_t __heap_SRAM3_end__[];
+    extern uint8_t __heap_USB_RAM_start__[];
+    extern uint8_t __heap_USB_RAM_end__[];
+    #if ( BOARD_SDRAM_ENABLED == 1 )
+        extern uint8_t __heap_SDRAM_start__[];
+        extern uint8_t __heap_SDRAM_end__[];
+    #endif
+
+/**
+ * @brief Number of banks the heap can span.
+ */
+    #if ( BOARD_SDRAM_ENABLED == 1 )
+        #define heapregionsNUM_BANKS    ( 6U )
+    #else
+        #define heapregionsNUM_BANKS    ( 5U )
+    #endif
+
+/**
+ * @brief A bank and its free RAM.
+ */
+    typedef struct BankRegion
+    {
+        const char * pcName;
+        uint8_t * pucStart;
+        uint8_t * pucEnd;
+    } BankRegion_t;
+
+/**
+ * @brief The banks in increasing address order, as required by vPortDefineHeapRegions().
+ */
+    static const BankRegion_t xBanks[ heapregionsNUM_BANKS ] =
+    {
+        { "SRAMX",               __heap_SRAMX_start__,        __heap_SRAMX_end__        },
+        { "SRAMX_FASTCODE",      __heap_FASTCODE_start__,     __heap_FASTCODE_end__     },
+        { "SRAM_0_1_2_3",        __heap_SRAM_0_1_2_3_start__, __heap_SRAM_0_1_2_3_end__ },
+        { "SRAM_0_1_2_3_UNUSED", __heap_SRAM3_start__,        __heap_SRAM3_end__        },
+        { "USB_RAM",             __heap_USB_RAM_start__,      __heap_USB_RAM_end__      },
+        #if ( BOARD_SDRAM_ENABLED == 1 )
+            { "SDRAM",               __heap_SDRAM_start__,        __heap_SDRAM_end__        },
+        #endif
+    };
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the size of the heap region of a bank, 0 when the bank is too small to be used.
+ */
+    static size_t prvRegionSize( const BankRegion_t * pxBank )
+    {
+        size_t xSize = 0U;
+
+        if( pxBank->pucEnd > pxBank->pucStart )
+        {
+            xSize = ( size_t ) ( pxBank->pucEnd - pxBank->pucStart );
+        }
+
+        return ( xSize >= heapregionsMIN_REGION_SIZE ) ? xSize : 0U;
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t HeapRegions_Init( void )
+    {
+        /* Terminated by a NULL entry, only read by vPortDefineHeapRegions(). */
+        HeapRegion_t xHeapRegions[ heapregionsNUM_BANKS + 1U ];
+        size_t xTotalSize = 0U;
+        uint32_t ulRegion = 0U;
+        uint32_t ulBank;
+
+        for( ulBank = 0U; ulBank < heapregionsNUM_BANKS; ulBank++ )
+        {
+            size_t xSize = prvRegionSize( &xBanks[ ulBank ] );
+
+            if( xSize > 0U )
+            {
+                xHeapRegions[ ulRegion ].pucStartAddress = xBanks[ ulBank ].pucStart;
+                xHeapRegions[ ulRegion ].xSizeInBytes = xSize;
+                ulRegion++;
+                xTotalSize += xSize;
+            }
+        }
+
+        xHeapRegions[ ulRegion ].pucStartAddress = NULL;
+        xHeapRegions[ ulRegion ].xSizeInBytes = 0U;
+
+        configASSERT( ulRegion > 0U );
+        vPortDefineHeapRegions( xHeapRegions );
+
+        return xTotalSize;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void HeapRegions_Print( void )
+    {
+        uint32_t ulBank;
+
+        for( ulBank = 0U; ulBank < heapregionsNUM_BANKS; ulBank++ )
+        {
+            PRINTF( "Heap region %-19s 0x%08x %6u bytes\r\n",
+                    xBanks[ ulBank ].pcName,
+                    ( unsigned int ) xBanks[ ulBank ].pucStart,
+                    ( unsigned int ) prvRegionSize( &xBanks[ ulBank ] ) );
+        }
+    }
+
+#endif /* configFRTOS_MEMORY_SCHEME == 5 */
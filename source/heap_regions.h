@@ -0,0 +1,126 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file heap_regions.h
+ * @brief Placement of the heap and of the large static buffers across the RAM banks.
+ */
+
+#ifndef HEAP_REGIONS_H
+#define HEAP_REGIONS_H
+
+#include "FreeRTOS.h"
+
+#include "board.h"
+
+/**
+ * @brief Places a zero initialized variable in USB_RAM, the 8 KB bank at 0x40100000, instead of
+ * SRAM_0_1_2_3. Meant for the large buffers only accessed by privileged tasks, the MPU regions of
+ * the unprivileged tasks do not cover USB_RAM.
+ */
+#define heapregionsUSB_RAM_BSS    __attribute__( ( section( ".bss.$RAM3" ) ) )
+
+/**
+ * @brief Places a zero initialized variable in the external SDRAM on the carrier boards built with
+ * BOARD_SDRAM_ENABLED, in SRAM_0_1_2_3 otherwise. Meant for the large buffers that are not time
+ * critical: an SDRAM access takes several EMC clock cycles and the SDRAM is only usable once
+ * HeapRegions_InitSdram() has run.
+ */
+#if ( BOARD_SDRAM_ENABLED == 1 )
+    #define heapregionsSDRAM_BSS    __attribute__( ( section( ".bss.$SDRAM" ) ) )
+#else
+    #define heapregionsSDRAM_BSS
+#endif
+
+/**
+ * @brief Places a large buffer in the SDRAM on the carrier boards that have one, in USB_RAM
+ * otherwise, for the buffers that fit the 8 KB of USB_RAM.
+ */
+#if ( BOARD_SDRAM_ENABLED == 1 )
+    #define heapregionsBULK_BSS    heapregionsSDRAM_BSS
+#else
+    #define heapregionsBULK_BSS    heapregionsUSB_RAM_BSS
+#endif
+
+/**
+ * @brief Places a buffer that is always written before it is read in USB_RAM without clearing it
+ * at startup, see heapregionsUSB_RAM_BSS. ResetISR() neither copies nor clears the .noinit
+ * sections, which saves the startup time of zeroing large buffers.
+ */
+#define heapregionsUSB_RAM_NOINIT    __attribute__( ( section( ".noinit.$RAM3" ) ) )
+
+/**
+ * @brief heapregionsBULK_BSS for the buffers that need no zeroing. The SDRAM is cleared by
+ * HeapRegions_InitSdram() in any case, so the buffer stays in .bss.$SDRAM there.
+ */
+#if ( BOARD_SDRAM_ENABLED == 1 )
+    #define heapregionsBULK_NOINIT    heapregionsSDRAM_BSS
+#else
+    #define heapregionsBULK_NOINIT    heapregionsUSB_RAM_NOINIT
+#endif
+
+/**
+ * @brief Minimum size of a heap region, the banks with less free RAM are not added to the heap.
+ */
+#ifndef heapregionsMIN_REGION_SIZE
+    #define heapregionsMIN_REGION_SIZE    ( 256U )
+#endif
+
+#if ( BOARD_SDRAM_ENABLED == 1 )
+
+/**
+ * @brief Starts the external SDRAM: pins, EMC and SDRAM mode through BOARD_InitSDRAM(), then
+ * checks its data and address lines and clears the variables placed in it. Must be called once
+ * the clocks are final, before HeapRegions_Init().
+ *
+ * @return pdTRUE if the SDRAM passed the check.
+ */
+    BaseType_t HeapRegions_InitSdram( void );
+
+#endif /* BOARD_SDRAM_ENABLED == 1 */
+
+#if ( configFRTOS_MEMORY_SCHEME == 5 )
+
+/**
+ * @brief Defines the heap_5 regions from the RAM left free at the end of SRAMX, SRAMX_FASTCODE,
+ * SRAM_0_1_2_3, SRAM_0_1_2_3_UNUSED, USB_RAM and, with BOARD_SDRAM_ENABLED, the SDRAM, in that
+ * order. Must be called before anything allocates from the heap.
+ *
+ * All the tasks are privileged and reach every bank. A task created unprivileged only has an MPU
+ * region over SRAM_0_1_2_3, so it must not be given a stack or buffers allocated from this heap.
+ *
+ * @return The total size of the heap in bytes.
+ */
+    size_t HeapRegions_Init( void );
+
+/**
+ * @brief Prints the address and the size of the heap region of each bank on the debug console,
+ * 0 for the banks left out of the heap.
+ */
+    void HeapRegions_Print( void );
+
+#endif /* configFRTOS_MEMORY_SCHEME == 5 */
+
+#endif /* HEAP_REGIONS_H */
@@ -0,0 +1,1130 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iperf.c
+ * @brief iperf 2 compatible TCP and UDP throughput tests, and a TLS echo test, run from a task of
+ * their own on request of the shell.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "iperf.h"
+
+#if ( iperfENABLED == 1 )
+
+    #include "FreeRTOS_IP.h"
+    #include "FreeRTOS_Sockets.h"
+    #include "NetworkBufferManagement.h"
+
+    #include "fsl_debug_console.h"
+    #include "fsl_enet.h"
+
+    #include "freertos_sockets_wrapper.h"
+    #include "monotonic_clock.h"
+    #include "task_stats.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Priority of the test task, just above idle so that the idle time measures the CPU left.
+ */
+    #ifndef iperfTASK_PRIORITY
+        #define iperfTASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+    #endif
+
+/**
+ * @brief Stack size of the test task, in words, the TLS handshake needs most of it.
+ */
+    #ifndef iperfTASK_STACK_SIZE
+        #define iperfTASK_STACK_SIZE    ( 2048 )
+    #endif
+
+/**
+ * @brief Size of the send and receive buffers, the largest -l accepted.
+ */
+    #ifndef iperfBUFFER_SIZE
+        #define iperfBUFFER_SIZE    ( 2048U )
+    #endif
+
+/**
+ * @brief Bytes sent and not yet echoed back in the TLS echo test.
+ */
+    #ifndef iperfTLS_ECHO_WINDOW
+        #define iperfTLS_ECHO_WINDOW    ( 4096U )
+    #endif
+
+/**
+ * @brief Trust anchor of the TLS echo server, the one of the broker connection if not defined.
+ */
+    #ifdef iperfconfigTLS_ROOT_CA_PEM
+        #define iperfTLS_ROOT_CA_PEM    iperfconfigTLS_ROOT_CA_PEM
+    #endif
+
+/**
+ * @brief Period of the interval lines.
+ */
+    #define iperfREPORT_INTERVAL_US    ( 1000000U )
+
+/**
+ * @brief Receive and send timeout of the sockets, the longest Iperf_Stop() waits for.
+ */
+    #define iperfTIMEOUT_MS            ( 1000U )
+
+/**
+ * @brief Timeout of the TLS handshake.
+ */
+    #define iperfTLS_CONNECT_TIMEOUT_MS    ( 10000U )
+
+/**
+ * @brief Default size of the TLS sends.
+ */
+    #define iperfTLS_LENGTH                ( 1024U )
+
+/**
+ * @brief Largest UDP datagram, FreeRTOS+TCP does not fragment outgoing datagrams.
+ */
+    #define iperfUDP_MAX_LENGTH            ( ipconfigNETWORK_MTU - 28U )
+
+/**
+ * @brief The iperf 2 UDP header, a 32-bit sequence number and the send time in seconds and
+ * microseconds, followed by the client header, all zero as no test parameter is exchanged.
+ */
+    #define iperfUDP_HEADER_SIZE           ( 12U )
+    #define iperfCLIENT_HEADER_SIZE        ( 24U )
+
+/**
+ * @brief The report of the iperf 2 UDP server, after the UDP header of the last datagram: flags,
+ * bytes received in two words, duration in seconds and microseconds, datagrams lost, out of order and
+ * received, and the jitter in seconds and microseconds.
+ */
+    #define iperfSERVER_HEADER_SIZE        ( 40U )
+    #define iperfSERVER_HEADER_VERSION1    ( 0x80000000U )
+
+/**
+ * @brief Number of times the last datagram of a UDP client is sent while waiting for the report.
+ */
+    #define iperfUDP_FIN_RETRIES           ( 10U )
+
+/**
+ * @brief Time a UDP client waits for the report after each last datagram.
+ */
+    #define iperfUDP_FIN_TIMEOUT_MS        ( 250U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief ENET counters of the summary, summed over the DMA channels.
+ */
+    typedef struct IperfEnetCounters
+    {
+        uint32_t ulTxFrames;   /**< Frames sent. */
+        uint32_t ulRxFrames;   /**< Frames received. */
+        uint32_t ulRxNoDesc;   /**< Receive buffer unavailable events of the DMA. */
+        uint32_t ulTxBusy;     /**< Sends rejected with all the transmit descriptors in use. */
+    } IperfEnetCounters_t;
+
+/**
+ * @brief State of the running test.
+ */
+    typedef struct IperfRun
+    {
+        const IperfTest_t * pxTest;
+        uint64_t ullStartUs;            /**< Start of the test. */
+        uint64_t ullEndUs;              /**< End of the test, the last data received by a server. */
+        uint64_t ullReportUs;           /**< Start of the current interval. */
+        uint64_t ullReportBytes;        /**< Bytes at the start of the current interval. */
+        uint64_t ullReportCycles;       /**< Run time counter at the start of the current interval. */
+        uint64_t ullReportIdle;         /**< Idle run time at the start of the current interval. */
+        uint64_t ullStartCycles;        /**< Run time counter at the start of the test. */
+        uint64_t ullStartIdle;          /**< Idle run time at the start of the test. */
+        uint64_t ullBytes;              /**< Bytes sent by a client, received by a server. */
+        uint32_t ulLost;                /**< Datagrams lost, seen by a UDP server. */
+        uint32_t ulOutOfOrder;          /**< Datagrams out of order, seen by a UDP server. */
+        uint32_t ulJitter16;            /**< Interarrival jitter of RFC 3550 in 1/16 us, UDP server. */
+        uint32_t ulNoBuffer;            /**< Datagrams without a network buffer at once, UDP client. */
+        IperfEnetCounters_t xStartEnet; /**< ENET counters at the start of the test. */
+    } IperfRun_t;
+
+/*-----------------------------------------------------------*/
+
+    static const char * const pcProtocolNames[] = { "tcp", "udp", "tls" };
+
+/**
+ * @brief Credentials of the TLS echo test.
+ */
+    static const NetworkCredentials_t * pxIperfCredentials = NULL;
+
+/**
+ * @brief The test requested, owned by the test task while xBusy is set.
+ */
+    static IperfTest_t xRequest;
+    static volatile BaseType_t xBusy = pdFALSE;
+    static volatile BaseType_t xStopRequested = pdFALSE;
+    static TaskHandle_t xIperfTask = NULL;
+
+/**
+ * @brief Buffers of the sends and receives, too large for the stack.
+ */
+    static uint8_t ucBuffer[ iperfBUFFER_SIZE ];
+    static uint8_t ucEchoBuffer[ iperfBUFFER_SIZE ];
+    static enet_stats_t xEnetStats;
+    static NetworkContext_t xTlsContext;
+
+/*-----------------------------------------------------------*/
+
+    static void prvPut32( uint8_t * pucBuffer,
+                          uint32_t ulValue )
+    {
+        pucBuffer[ 0 ] = ( uint8_t ) ( ulValue >> 24 );
+        pucBuffer[ 1 ] = ( uint8_t ) ( ulValue >> 16 );
+        pucBuffer[ 2 ] = ( uint8_t ) ( ulValue >> 8 );
+        pucBuffer[ 3 ] = ( uint8_t ) ulValue;
+    }
+
+    static uint32_t prvGet32( const uint8_t * pucBuffer )
+    {
+        return ( ( uint32_t ) pucBuffer[ 0 ] << 24 ) | ( ( uint32_t ) pucBuffer[ 1 ] << 16 ) |
+               ( ( uint32_t ) pucBuffer[ 2 ] << 8 ) | ( uint32_t ) pucBuffer[ 3 ];
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvGetEnetCounters( IperfEnetCounters_t * pxCounters )
+    {
+        enet_handle_t * pxHandle = ENET_GetHandle( ENET );
+        uint32_t ulChannel;
+
+        memset( pxCounters, 0x00, sizeof( *pxCounters ) );
+
+        if( pxHandle != NULL )
+        {
+            ENET_GetStatistics( pxHandle, &xEnetStats );
+
+            for( ulChannel = 0; ulChannel < ENET_RING_NUM_MAX; ulChannel++ )
+            {
+                pxCounters->ulTxFrames += xEnetStats.channel[ ulChannel ].txFrames;
+                pxCounters->ulRxFrames += xEnetStats.channel[ ulChannel ].rxFrames;
+                pxCounters->ulRxNoDesc += xEnetStats.channel[ ulChannel ].rxBuffUnavailable;
+                pxCounters->ulTxBusy += xEnetStats.channel[ ulChannel ].txBusyRejects;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Share of the cycles the idle task did not run, in percent.
+ */
+    static uint32_t prvCpuPercent( uint64_t ullCycles,
+                                   uint64_t ullIdle )
+    {
+        return ( ( ullCycles > 0U ) && ( ullIdle <= ullCycles ) ) ? ( uint32_t ) ( 100U - ( ullIdle * 100U ) / ullCycles ) : 0U;
+    }
+
+    static uint32_t prvKbps( uint64_t ullBytes,
+                             uint64_t ullUs )
+    {
+        return ( ullUs > 0U ) ? ( uint32_t ) ( ( ullBytes * 8000U ) / ullUs ) : 0U;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvRunBegin( IperfRun_t * pxRun,
+                             const IperfTest_t * pxTest )
+    {
+        memset( pxRun, 0x00, sizeof( *pxRun ) );
+        pxRun->pxTest = pxTest;
+        prvGetEnetCounters( &pxRun->xStartEnet );
+        pxRun->ullStartCycles = TaskStats_GetRunTimeCounter();
+        pxRun->ullStartIdle = ( uint64_t ) ulTaskGetIdleRunTimeCounter();
+        pxRun->ullStartUs = MonotonicClock_GetUs();
+        pxRun->ullEndUs = pxRun->ullStartUs;
+        pxRun->ullReportUs = pxRun->ullStartUs;
+        pxRun->ullReportCycles = pxRun->ullStartCycles;
+        pxRun->ullReportIdle = pxRun->ullStartIdle;
+    }
+
+/**
+ * @brief Prints the interval line once a second, with the rate and the CPU use of the interval.
+ */
+    static void prvRunTick( IperfRun_t * pxRun,
+                            uint64_t ullNowUs )
+    {
+        uint64_t ullCycles, ullIdle;
+
+        if( ( ullNowUs - pxRun->ullReportUs ) >= iperfREPORT_INTERVAL_US )
+        {
+            ullCycles = TaskStats_GetRunTimeCounter();
+            ullIdle = ( uint64_t ) ulTaskGetIdleRunTimeCounter();
+
+            PRINTF( "IPERF,%s,%s,%lu,%lu,%lu,%lu,%lu\r\n", pcProtocolNames[ pxRun->pxTest->xProtocol ],
+                    ( pxRun->pxTest->xServer == pdTRUE ) ? "server" : "client",
+                    ( unsigned long ) ( ( pxRun->ullReportUs - pxRun->ullStartUs ) / 1000U ),
+                    ( unsigned long ) ( ( ullNowUs - pxRun->ullStartUs ) / 1000U ),
+                    ( unsigned long ) ( pxRun->ullBytes - pxRun->ullReportBytes ),
+                    ( unsigned long ) prvKbps( pxRun->ullBytes - pxRun->ullReportBytes, ullNowUs - pxRun->ullReportUs ),
+                    ( unsigned long ) prvCpuPercent( ullCycles - pxRun->ullReportCycles, ullIdle - pxRun->ullReportIdle ) );
+
+            pxRun->ullReportUs = ullNowUs;
+            pxRun->ullReportBytes = pxRun->ullBytes;
+            pxRun->ullReportCycles = ullCycles;
+            pxRun->ullReportIdle = ullIdle;
+        }
+    }
+
+/**
+ * @brief Prints the summary of the test, from its start to ullEndUs.
+ */
+    static void prvRunEnd( IperfRun_t * pxRun )
+    {
+        const IperfTest_t * pxTest = pxRun->pxTest;
+        IperfEnetCounters_t xEnet;
+        uint64_t ullCycles = TaskStats_GetRunTimeCounter() - pxRun->ullStartCycles;
+        uint64_t ullIdle = ( uint64_t ) ulTaskGetIdleRunTimeCounter() - pxRun->ullStartIdle;
+        uint64_t ullUs = pxRun->ullEndUs - pxRun->ullStartUs;
+        uint32_t ulSegments, ulRetransmits = 0U;
+
+        prvGetEnetCounters( &xEnet );
+        xEnet.ulTxFrames -= pxRun->xStartEnet.ulTxFrames;
+        xEnet.ulRxFrames -= pxRun->xStartEnet.ulRxFrames;
+        xEnet.ulRxNoDesc -= pxRun->xStartEnet.ulRxNoDesc;
+        xEnet.ulTxBusy -= pxRun->xStartEnet.ulTxBusy;
+
+        /* The stack does not count its retransmissions, a sender sends one frame per segment of
+         * data plus the handshake and the retransmissions, a receiver only sends ACKs. */
+        if( ( pxTest->xProtocol == IPERF_TCP ) && ( pxTest->xServer == pdFALSE ) )
+        {
+            ulSegments = ( uint32_t ) ( ( pxRun->ullBytes + ipconfigTCP_MSS - 1U ) / ipconfigTCP_MSS ) + 3U;
+            ulRetransmits = ( xEnet.ulTxFrames > ulSegments ) ? ( xEnet.ulTxFrames - ulSegments ) : 0U;
+        }
+
+        PRINTF( "IPERF_SUM,%s,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+                pcProtocolNames[ pxTest->xProtocol ], ( pxTest->xServer == pdTRUE ) ? "server" : "client",
+                ( unsigned long ) ( ullUs / 1000U ), ( unsigned long ) pxRun->ullBytes,
+                ( unsigned long ) prvKbps( pxRun->ullBytes, ullUs ),
+                ( unsigned long ) prvCpuPercent( ullCycles, ullIdle ),
+                ( unsigned long ) ulRetransmits, ( unsigned long ) pxRun->ulLost,
+                ( unsigned long ) pxRun->ulOutOfOrder, ( unsigned long ) ( pxRun->ulJitter16 >> 4 ),
+                ( unsigned long ) pxRun->ulNoBuffer,
+                ( unsigned long ) xEnet.ulTxFrames, ( unsigned long ) xEnet.ulRxFrames,
+                ( unsigned long ) xEnet.ulRxNoDesc, ( unsigned long ) xEnet.ulTxBusy,
+                ( unsigned long ) uxGetMinimumFreeNetworkBufferDescriptors() );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static BaseType_t prvDurationOver( const IperfRun_t * pxRun,
+                                       uint64_t ullNowUs )
+    {
+        return ( ( xStopRequested == pdTRUE ) ||
+                 ( ( ullNowUs - pxRun->ullStartUs ) >= ( ( uint64_t ) pxRun->pxTest->ulSeconds * 1000000U ) ) ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvTcpClient( const IperfTest_t * pxTest )
+    {
+        IperfRun_t xRun;
+        Socket_t xSocket;
+        uint32_t ulLength = ( pxTest->ulLength > 0U ) ? pxTest->ulLength : iperfBUFFER_SIZE;
+        uint64_t ullNowUs;
+        BaseType_t xSent;
+
+        if( Sockets_ConnectWithProfile( &xSocket, pxTest->cHost, pxTest->usPort, iperfTIMEOUT_MS,
+                                        iperfTIMEOUT_MS, SOCKETS_PROFILE_BULK ) != 0 )
+        {
+            PRINTF( "iperf: cannot connect to %s:%u.\r\n", pxTest->cHost, ( unsigned ) pxTest->usPort );
+            return;
+        }
+
+        /* All zero, the iperf 2 client header at the start of the stream then requests no test back. */
+        memset( ucBuffer, 0x00, sizeof( ucBuffer ) );
+        prvRunBegin( &xRun, pxTest );
+        ullNowUs = xRun.ullStartUs;
+
+        while( prvDurationOver( &xRun, ullNowUs ) == pdFALSE )
+        {
+            xSent = FreeRTOS_send( xSocket, ucBuffer, ulLength, 0 );
+
+            if( xSent < 0 )
+            {
+                PRINTF( "iperf: connection closed, error %ld.\r\n", ( long ) xSent );
+                break;
+            }
+
+            xRun.ullBytes += ( uint64_t ) xSent;
+            ullNowUs = MonotonicClock_GetUs();
+            prvRunTick( &xRun, ullNowUs );
+        }
+
+        xRun.ullEndUs = MonotonicClock_GetUs();
+        prvRunEnd( &xRun );
+        Sockets_Disconnect( xSocket );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Creates a socket bound to the port of the test, with the receive timeout of the test.
+ */
+    static Socket_t prvServerSocket( const IperfTest_t * pxTest )
+    {
+        struct freertos_sockaddr xAddress = { 0 };
+        TickType_t xTimeout = pdMS_TO_TICKS( iperfTIMEOUT_MS );
+        WinProperties_t xWinProperties = { 0 };
+        Socket_t xSocket;
+
+        if( pxTest->xProtocol == IPERF_TCP )
+        {
+            xSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP );
+        }
+        else
+        {
+            xSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+        }
+
+        if( xSocket == FREERTOS_INVALID_SOCKET )
+        {
+            PRINTF( "iperf: socket not created.\r\n" );
+            return FREERTOS_INVALID_SOCKET;
+        }
+
+        ( void ) FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) );
+
+        if( pxTest->xProtocol == IPERF_TCP )
+        {
+            /* The window of the bulk connections, inherited by the accepted socket. */
+            xWinProperties.lRxWinSize = socketsconfigBULK_RX_SEGMENTS;
+            xWinProperties.lTxWinSize = socketsconfigBULK_TX_SEGMENTS;
+            xWinProperties.lRxBufSize = xWinProperties.lRxWinSize * ( int32_t ) ipconfigTCP_MSS;
+            xWinProperties.lTxBufSize = xWinProperties.lTxWinSize * ( int32_t ) ipconfigTCP_MSS;
+            ( void ) FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_WIN_PROPERTIES, &xWinProperties, sizeof( xWinProperties ) );
+        }
+
+        xAddress.sin_port = FreeRTOS_htons( pxTest->usPort );
+
+        if( ( FreeRTOS_bind( xSocket, &xAddress, sizeof( xAddress ) ) != 0 ) ||
+            ( ( pxTest->xProtocol == IPERF_TCP ) && ( FreeRTOS_listen( xSocket, 1 ) != 0 ) ) )
+        {
+            PRINTF( "iperf: port %u not available.\r\n", ( unsigned ) pxTest->usPort );
+            ( void ) FreeRTOS_closesocket( xSocket );
+            return FREERTOS_INVALID_SOCKET;
+        }
+
+        PRINTF( "iperf: %s server listening on port %u.\r\n", pcProtocolNames[ pxTest->xProtocol ], ( unsigned ) pxTest->usPort );
+
+        return xSocket;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvTcpServer( const IperfTest_t * pxTest )
+    {
+        IperfRun_t xRun;
+        struct freertos_sockaddr xClientAddress;
+        socklen_t xAddressLength = sizeof( xClientAddress );
+        Socket_t xListenSocket, xSocket = NULL;
+        BaseType_t xReceived;
+
+        xListenSocket = prvServerSocket( pxTest );
+
+        if( xListenSocket == FREERTOS_INVALID_SOCKET )
+        {
+            return;
+        }
+
+        /* Accept returns NULL on timeout, which leaves a chance to stop. */
+        while( ( xSocket == NULL ) && ( xStopRequested == pdFALSE ) )
+        {
+            xSocket = FreeRTOS_accept( xListenSocket, &xClientAddress, &xAddressLength );
+        }
+
+        if( ( xSocket != NULL ) && ( xSocket != FREERTOS_INVALID_SOCKET ) )
+        {
+            prvRunBegin( &xRun, pxTest );
+
+            for( ; ; )
+            {
+                xReceived = FreeRTOS_recv( xSocket, ucBuffer, sizeof( ucBuffer ), 0 );
+
+                if( xReceived > 0 )
+                {
+                    xRun.ullBytes += ( uint64_t ) xReceived;
+                    xRun.ullEndUs = MonotonicClock_GetUs();
+                    prvRunTick( &xRun, xRun.ullEndUs );
+                }
+                else if( ( xReceived < 0 ) || ( xStopRequested == pdTRUE ) )
+                {
+                    /* Closed by the client at the end of the test. */
+                    break;
+                }
+            }
+
+            prvRunEnd( &xRun );
+            ( void ) FreeRTOS_closesocket( xSocket );
+        }
+
+        ( void ) FreeRTOS_closesocket( xListenSocket );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends the report of the UDP server in reply to a last datagram of the client, which
+ * holds the UDP header echoed at the start of the report.
+ */
+    static void prvUdpServerReport( Socket_t xSocket,
+                                    const struct freertos_sockaddr * pxClientAddress,
+                                    const uint8_t * pucFin,
+                                    const IperfRun_t * pxRun,
+                                    uint32_t ulDatagrams )
+    {
+        uint64_t ullUs = pxRun->ullEndUs - pxRun->ullStartUs;
+        uint32_t ulJitterUs = pxRun->ulJitter16 >> 4;
+        size_t xLength = iperfUDP_HEADER_SIZE + iperfSERVER_HEADER_SIZE;
+        uint8_t * pucDatagram;
+
+        pucDatagram = ( uint8_t * ) FreeRTOS_GetUDPPayloadBuffer( xLength, pdMS_TO_TICKS( iperfTIMEOUT_MS ) );
+
+        if( pucDatagram != NULL )
+        {
+            memcpy( pucDatagram, pucFin, iperfUDP_HEADER_SIZE );
+            prvPut32( &pucDatagram[ 12 ], iperfSERVER_HEADER_VERSION1 );
+            prvPut32( &pucDatagram[ 16 ], ( uint32_t ) ( pxRun->ullBytes >> 32 ) );
+            prvPut32( &pucDatagram[ 20 ], ( uint32_t ) pxRun->ullBytes );
+            prvPut32( &pucDatagram[ 24 ], ( uint32_t ) ( ullUs / 1000000U ) );
+            prvPut32( &pucDatagram[ 28 ], ( uint32_t ) ( ullUs % 1000000U ) );
+            prvPut32( &pucDatagram[ 32 ], pxRun->ulLost );
+            prvPut32( &pucDatagram[ 36 ], pxRun->ulOutOfOrder );
+            prvPut32( &pucDatagram[ 40 ], ulDatagrams );
+            prvPut32( &pucDatagram[ 44 ], ulJitterUs / 1000000U );
+            prvPut32( &pucDatagram[ 48 ], ulJitterUs % 1000000U );
+
+            if( FreeRTOS_sendto( xSocket, pucDatagram, xLength, FREERTOS_ZERO_COPY,
+                                 pxClientAddress, sizeof( *pxClientAddress ) ) == 0 )
+            {
+                FreeRTOS_ReleaseUDPPayloadBuffer( pucDatagram );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvUdpServer( const IperfTest_t * pxTest )
+    {
+        IperfRun_t xRun;
+        struct freertos_sockaddr xClientAddress;
+        socklen_t xAddressLength;
+        Socket_t xSocket;
+        uint8_t * pucDatagram;
+        uint8_t ucFin[ iperfUDP_HEADER_SIZE ];
+        int32_t lReceived, lId, lNextId = 0;
+        uint64_t ullNowUs, ullSentUs;
+        int64_t llTransit, llLastTransit = 0, llDelta;
+        BaseType_t xStarted = pdFALSE, xFinished = pdFALSE, xHaveTransit = pdFALSE;
+
+        xSocket = prvServerSocket( pxTest );
+
+        if( xSocket == FREERTOS_INVALID_SOCKET )
+        {
+            return;
+        }
+
+        for( ; ; )
+        {
+            xAddressLength = sizeof( xClientAddress );
+            lReceived = FreeRTOS_recvfrom( xSocket, &pucDatagram, 0, FREERTOS_ZERO_COPY, &xClientAddress, &xAddressLength );
+
+            if( lReceived <= 0 )
+            {
+                /* Once done, the repeats of the last datagram have stopped. */
+                if( ( xFinished == pdTRUE ) || ( xStopRequested == pdTRUE ) )
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            ullNowUs = MonotonicClock_GetUs();
+
+            if( lReceived >= ( int32_t ) iperfUDP_HEADER_SIZE )
+            {
+                lId = ( int32_t ) prvGet32( pucDatagram );
+
+                if( xStarted == pdFALSE )
+                {
+                    prvRunBegin( &xRun, pxTest );
+                    xStarted = pdTRUE;
+                }
+
+                if( lId < 0 )
+                {
+                    /* The last datagram, repeated by the client until it gets the report. */
+                    if( xFinished == pdFALSE )
+                    {
+                        xRun.ullEndUs = ullNowUs;
+                        xFinished = pdTRUE;
+                    }
+
+                    memcpy( ucFin, pucDatagram, sizeof( ucFin ) );
+                }
+                else if( xFinished == pdFALSE )
+                {
+                    xRun.ullBytes += ( uint64_t ) lReceived;
+
+                    if( lId > lNextId )
+                    {
+                        xRun.ulLost += ( uint32_t ) ( lId - lNextId );
+                    }
+                    else if( lId < lNextId )
+                    {
+                        xRun.ulOutOfOrder++;
+                    }
+
+                    lNextId = ( lId >= lNextId ) ? ( lId + 1 ) : lNextId;
+
+                    /* Only the changes of the transit time matter, the clocks need not agree. */
+                    ullSentUs = ( ( uint64_t ) prvGet32( &pucDatagram[ 4 ] ) * 1000000U ) + prvGet32( &pucDatagram[ 8 ] );
+                    llTransit = ( int64_t ) ( ullNowUs - ullSentUs );
+
+                    if( xHaveTransit == pdTRUE )
+                    {
+                        llDelta = llTransit - llLastTransit;
+                        llDelta = ( llDelta < 0 ) ? -llDelta : llDelta;
+                        llDelta = ( llDelta > ( int64_t ) UINT32_MAX / 2 ) ? ( int64_t ) UINT32_MAX / 2 : llDelta;
+                        xRun.ulJitter16 = xRun.ulJitter16 + ( uint32_t ) llDelta - ( xRun.ulJitter16 >> 4 );
+                    }
+
+                    llLastTransit = llTransit;
+                    xHaveTransit = pdTRUE;
+                    prvRunTick( &xRun, ullNowUs );
+                }
+            }
+
+            FreeRTOS_ReleaseUDPPayloadBuffer( pucDatagram );
+
+            if( xFinished == pdTRUE )
+            {
+                prvUdpServerReport( xSocket, &xClientAddress, ucFin, &xRun, ( uint32_t ) lNextId );
+            }
+        }
+
+        if( xStarted == pdTRUE )
+        {
+            if( xFinished == pdFALSE )
+            {
+                xRun.ullEndUs = MonotonicClock_GetUs();
+            }
+
+            prvRunEnd( &xRun );
+        }
+
+        ( void ) FreeRTOS_closesocket( xSocket );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends one datagram of a UDP client, the sequence number is negative for the last ones.
+ *
+ * @return pdTRUE if the datagram is handed to the IP task.
+ */
+    static BaseType_t prvUdpSend( Socket_t xSocket,
+                                  const struct freertos_sockaddr * pxServerAddress,
+                                  IperfRun_t * pxRun,
+                                  int32_t lId,
+                                  uint32_t ulLength )
+    {
+        uint64_t ullNowUs = MonotonicClock_GetUs();
+        uint8_t * pucDatagram;
+        BaseType_t xResult = pdFALSE;
+
+        pucDatagram = ( uint8_t * ) FreeRTOS_GetUDPPayloadBuffer( ulLength, 0 );
+
+        if( pucDatagram == NULL )
+        {
+            pxRun->ulNoBuffer++;
+            pucDatagram = ( uint8_t * ) FreeRTOS_GetUDPPayloadBuffer( ulLength, pdMS_TO_TICKS( iperfTIMEOUT_MS ) );
+        }
+
+        if( pucDatagram != NULL )
+        {
+            /* Also clears the previous content of the network buffer. */
+            memset( pucDatagram, 0x00, ulLength );
+            prvPut32( &pucDatagram[ 0 ], ( uint32_t ) lId );
+            prvPut32( &pucDatagram[ 4 ], ( uint32_t ) ( ullNowUs / 1000000U ) );
+            prvPut32( &pucDatagram[ 8 ], ( uint32_t ) ( ullNowUs % 1000000U ) );
+
+            if( FreeRTOS_sendto( xSocket, pucDatagram, ulLength, FREERTOS_ZERO_COPY,
+                                 pxServerAddress, sizeof( *pxServerAddress ) ) == 0 )
+            {
+                FreeRTOS_ReleaseUDPPayloadBuffer( pucDatagram );
+                pxRun->ulNoBuffer++;
+            }
+            else
+            {
+                xResult = pdTRUE;
+            }
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvUdpClient( const IperfTest_t * pxTest )
+    {
+        IperfRun_t xRun;
+        struct freertos_sockaddr xServerAddress = { 0 };
+        socklen_t xAddressLength;
+        TickType_t xTimeout = pdMS_TO_TICKS( iperfUDP_FIN_TIMEOUT_MS );
+        TickType_t xDelay;
+        Socket_t xSocket;
+        uint32_t ulLength = ( pxTest->ulLength > 0U ) ? pxTest->ulLength : iperfUDP_MAX_LENGTH;
+        uint64_t ullIntervalUs, ullDueUs, ullNowUs;
+        uint8_t * pucReport;
+        int32_t lId = 0, lReceived = 0;
+        uint32_t i;
+
+        xServerAddress.sin_addr = FreeRTOS_gethostbyname( pxTest->cHost );
+        xServerAddress.sin_port = FreeRTOS_htons( pxTest->usPort );
+
+        if( xServerAddress.sin_addr == 0U )
+        {
+            PRINTF( "iperf: cannot resolve %s.\r\n", pxTest->cHost );
+            return;
+        }
+
+        xSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+
+        if( xSocket == FREERTOS_INVALID_SOCKET )
+        {
+            PRINTF( "iperf: socket not created.\r\n" );
+            return;
+        }
+
+        ( void ) FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) );
+
+        ulLength = ( ulLength > iperfUDP_MAX_LENGTH ) ? iperfUDP_MAX_LENGTH : ulLength;
+        ulLength = ( ulLength < ( iperfUDP_HEADER_SIZE + iperfCLIENT_HEADER_SIZE ) ) ? ( iperfUDP_HEADER_SIZE + iperfCLIENT_HEADER_SIZE ) : ulLength;
+        ullIntervalUs = ( ( uint64_t ) ulLength * 8000U ) / pxTest->ulKbps;
+
+        prvRunBegin( &xRun, pxTest );
+        ullDueUs = xRun.ullStartUs;
+        ullNowUs = xRun.ullStartUs;
+
+        while( prvDurationOver( &xRun, ullNowUs ) == pdFALSE )
+        {
+            if( ullNowUs < ullDueUs )
+            {
+                /* Sleeps at least a tick, the datagrams due meanwhile are then sent in a burst. */
+                xDelay = pdMS_TO_TICKS( ( uint32_t ) ( ( ullDueUs - ullNowUs ) / 1000U ) );
+                vTaskDelay( ( xDelay > 0U ) ? xDelay : 1U );
+            }
+            else
+            {
+                if( prvUdpSend( xSocket, &xServerAddress, &xRun, lId, ulLength ) == pdTRUE )
+                {
+                    xRun.ullBytes += ulLength;
+                    lId++;
+                }
+
+                ullDueUs += ullIntervalUs;
+                prvRunTick( &xRun, ullNowUs );
+            }
+
+            ullNowUs = MonotonicClock_GetUs();
+        }
+
+        xRun.ullEndUs = ullNowUs;
+        prvRunEnd( &xRun );
+
+        for( i = 0; ( i < iperfUDP_FIN_RETRIES ) && ( lReceived <= 0 ); i++ )
+        {
+            ( void ) prvUdpSend( xSocket, &xServerAddress, &xRun, -lId, iperfUDP_HEADER_SIZE + iperfCLIENT_HEADER_SIZE );
+            xAddressLength = sizeof( xServerAddress );
+            lReceived = FreeRTOS_recvfrom( xSocket, &pucReport, 0, FREERTOS_ZERO_COPY, &xServerAddress, &xAddressLength );
+        }
+
+        if( lReceived <= 0 )
+        {
+            PRINTF( "iperf: no report from the server.\r\n" );
+        }
+        else
+        {
+            if( ( lReceived >= ( int32_t ) ( iperfUDP_HEADER_SIZE + iperfSERVER_HEADER_SIZE ) ) &&
+                ( ( prvGet32( &pucReport[ 12 ] ) & iperfSERVER_HEADER_VERSION1 ) != 0U ) )
+            {
+                PRINTF( "IPERF_SERVER,bytes,ms,lost,out_of_order,datagrams,jitter_us\r\n" );
+                PRINTF( "IPERF_SERVER,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+                        ( unsigned long ) prvGet32( &pucReport[ 20 ] ),
+                        ( unsigned long ) ( prvGet32( &pucReport[ 24 ] ) * 1000U + prvGet32( &pucReport[ 28 ] ) / 1000U ),
+                        ( unsigned long ) prvGet32( &pucReport[ 32 ] ), ( unsigned long ) prvGet32( &pucReport[ 36 ] ),
+                        ( unsigned long ) prvGet32( &pucReport[ 40 ] ),
+                        ( unsigned long ) ( prvGet32( &pucReport[ 44 ] ) * 1000000U + prvGet32( &pucReport[ 48 ] ) ) );
+            }
+
+            FreeRTOS_ReleaseUDPPayloadBuffer( pucReport );
+        }
+
+        ( void ) FreeRTOS_closesocket( xSocket );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends to a TLS echo server and counts the bytes echoed back, keeping iperfTLS_ECHO_WINDOW
+ * bytes in flight. Measures the TLS record processing on top of the TCP throughput.
+ */
+    static void prvTlsEcho( const IperfTest_t * pxTest )
+    {
+        IperfRun_t xRun;
+        NetworkCredentials_t xCredentials;
+        uint32_t ulLength = ( pxTest->ulLength > 0U ) ? pxTest->ulLength : iperfTLS_LENGTH;
+        uint64_t ullSent = 0U, ullNowUs;
+        int32_t lResult = 0;
+
+        if( pxIperfCredentials == NULL )
+        {
+            PRINTF( "iperf: no TLS credentials.\r\n" );
+            return;
+        }
+
+        xCredentials = *pxIperfCredentials;
+        xCredentials.pAlpnProtos = NULL;
+        xCredentials.socketProfile = SOCKETS_PROFILE_BULK;
+
+        #ifdef iperfTLS_ROOT_CA_PEM
+            xCredentials.pRootCa = ( const unsigned char * ) iperfTLS_ROOT_CA_PEM;
+            xCredentials.rootCaSize = sizeof( iperfTLS_ROOT_CA_PEM );
+        #endif
+
+        if( TLS_FreeRTOS_Connect( &xTlsContext, pxTest->cHost, pxTest->usPort, &xCredentials,
+                                  iperfTLS_CONNECT_TIMEOUT_MS, iperfTIMEOUT_MS ) != TLS_TRANSPORT_SUCCESS )
+        {
+            PRINTF( "iperf: TLS connection to %s:%u failed.\r\n", pxTest->cHost, ( unsigned ) pxTest->usPort );
+            return;
+        }
+
+        TLS_FreeRTOS_SetRecvTimeout( &xTlsContext, iperfTIMEOUT_MS );
+        memset( ucBuffer, 'I', sizeof( ucBuffer ) );
+        prvRunBegin( &xRun, pxTest );
+        ullNowUs = xRun.ullStartUs;
+
+        while( ( lResult >= 0 ) && ( prvDurationOver( &xRun, ullNowUs ) == pdFALSE ) )
+        {
+            if( ( ullSent - xRun.ullBytes ) < iperfTLS_ECHO_WINDOW )
+            {
+                lResult = TLS_FreeRTOS_send( &xTlsContext, ucBuffer, ulLength );
+                ullSent += ( lResult > 0 ) ? ( uint64_t ) lResult : 0U;
+            }
+            else
+            {
+                /* Writes out the buffered records first. */
+                lResult = TLS_FreeRTOS_recv( &xTlsContext, ucEchoBuffer, sizeof( ucEchoBuffer ) );
+                xRun.ullBytes += ( lResult > 0 ) ? ( uint64_t ) lResult : 0U;
+            }
+
+            ullNowUs = MonotonicClock_GetUs();
+            prvRunTick( &xRun, ullNowUs );
+        }
+
+        /* The bytes in flight, until the server stops echoing. */
+        while( ( lResult >= 0 ) && ( xRun.ullBytes < ullSent ) )
+        {
+            lResult = TLS_FreeRTOS_recv( &xTlsContext, ucEchoBuffer, sizeof( ucEchoBuffer ) );
+
+            if( lResult == 0 )
+            {
+                break;
+            }
+
+            xRun.ullBytes += ( lResult > 0 ) ? ( uint64_t ) lResult : 0U;
+        }
+
+        if( lResult < 0 )
+        {
+            PRINTF( "iperf: TLS connection closed, error %ld.\r\n", ( long ) lResult );
+        }
+
+        xRun.ullEndUs = MonotonicClock_GetUs();
+        prvRunEnd( &xRun );
+        TLS_FreeRTOS_Disconnect( &xTlsContext );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvIperfTask( void * pvParameters )
+    {
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+            PRINTF( "IPERF,proto,role,start_ms,end_ms,bytes,kbit_s,cpu_pct\r\n" );
+            PRINTF( "IPERF_SUM,proto,role,ms,bytes,kbit_s,cpu_pct,retx_est,lost,out_of_order,jitter_us,no_buffer,"
+                    "tx_frames,rx_frames,rx_no_desc,tx_busy,net_buffers_min\r\n" );
+
+            if( xRequest.xProtocol == IPERF_TLS )
+            {
+                prvTlsEcho( &xRequest );
+            }
+            else if( xRequest.xServer == pdTRUE )
+            {
+                if( xRequest.xProtocol == IPERF_TCP )
+                {
+                    prvTcpServer( &xRequest );
+                }
+                else
+                {
+                    prvUdpServer( &xRequest );
+                }
+            }
+            else if( xRequest.xProtocol == IPERF_TCP )
+            {
+                prvTcpClient( &xRequest );
+            }
+            else
+            {
+                prvUdpClient( &xRequest );
+            }
+
+            PRINTF( "iperf: done.\r\n" );
+            xStopRequested = pdFALSE;
+            xBusy = pdFALSE;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t Iperf_Init( const NetworkCredentials_t * pxCredentials )
+    {
+        BaseType_t result;
+
+        pxIperfCredentials = pxCredentials;
+
+        result = xTaskCreate( prvIperfTask,
+                              "Iperf_task",
+                              iperfTASK_STACK_SIZE,
+                              NULL,
+                              iperfTASK_PRIORITY | portPRIVILEGE_BIT,
+                              &xIperfTask );
+
+        if( result != pdPASS )
+        {
+            PRINTF( "Failed to create iperf task.\r\n" );
+        }
+
+        return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the next word of the arguments and moves past it, NULL at the end.
+ */
+    static char * prvNextArg( char ** ppcArgs )
+    {
+        char * pcArg = *ppcArgs;
+
+        while( *pcArg == ' ' )
+        {
+            pcArg++;
+        }
+
+        if( *pcArg == '\0' )
+        {
+            return NULL;
+        }
+
+        *ppcArgs = strchr( pcArg, ' ' );
+
+        if( *ppcArgs == NULL )
+        {
+            *ppcArgs = &pcArg[ strlen( pcArg ) ];
+        }
+        else
+        {
+            *( *ppcArgs )++ = '\0';
+        }
+
+        return pcArg;
+    }
+
+/**
+ * @brief Parses a number of the arguments, with an optional K or M suffix for -b.
+ */
+    static BaseType_t prvParseNumber( char ** ppcArgs,
+                                      uint32_t * pulValue,
+                                      BaseType_t xKilo )
+    {
+        char * pcArg = prvNextArg( ppcArgs );
+        char * pcEnd = NULL;
+
+        if( pcArg != NULL )
+        {
+            *pulValue = ( uint32_t ) strtoul( pcArg, &pcEnd, 10 );
+
+            if( ( xKilo == pdTRUE ) && ( ( *pcEnd == 'M' ) || ( *pcEnd == 'm' ) ) )
+            {
+                *pulValue *= 1000U;
+                pcEnd++;
+            }
+            else if( ( xKilo == pdTRUE ) && ( ( *pcEnd == 'K' ) || ( *pcEnd == 'k' ) ) )
+            {
+                pcEnd++;
+            }
+        }
+
+        return ( ( pcEnd != NULL ) && ( pcEnd != pcArg ) && ( *pcEnd == '\0' ) ) ? pdTRUE : pdFALSE;
+    }
+
+    BaseType_t Iperf_ParseArgs( char * pcArgs,
+                                IperfTest_t * pxTest )
+    {
+        BaseType_t xValid = pdTRUE;
+        BaseType_t xClient = pdFALSE;
+        uint32_t ulPort = 0U;
+        char * pcArg;
+        char * pcHost;
+
+        memset( pxTest, 0x00, sizeof( *pxTest ) );
+        pxTest->xProtocol = IPERF_TCP;
+        pxTest->ulSeconds = iperfDEFAULT_SECONDS;
+        pxTest->ulKbps = iperfDEFAULT_UDP_KBPS;
+
+        while( ( xValid == pdTRUE ) && ( ( pcArg = prvNextArg( &pcArgs ) ) != NULL ) )
+        {
+            if( strcmp( pcArg, "-u" ) == 0 )
+            {
+                pxTest->xProtocol = IPERF_UDP;
+            }
+            else if( strcmp( pcArg, "--tls" ) == 0 )
+            {
+                pxTest->xProtocol = IPERF_TLS;
+            }
+            else if( strcmp( pcArg, "-s" ) == 0 )
+            {
+                pxTest->xServer = pdTRUE;
+            }
+            else if( strcmp( pcArg, "-c" ) == 0 )
+            {
+                pcHost = prvNextArg( &pcArgs );
+                xValid = ( ( pcHost != NULL ) && ( strlen( pcHost ) < sizeof( pxTest->cHost ) ) ) ? pdTRUE : pdFALSE;
+
+                if( xValid == pdTRUE )
+                {
+                    ( void ) memcpy( pxTest->cHost, pcHost, strlen( pcHost ) + 1U );
+                    xClient = pdTRUE;
+                }
+            }
+            else if( strcmp( pcArg, "-p" ) == 0 )
+            {
+                xValid = prvParseNumber( &pcArgs, &ulPort, pdFALSE );
+            }
+            else if( strcmp( pcArg, "-t" ) == 0 )
+            {
+                xValid = prvParseNumber( &pcArgs, &pxTest->ulSeconds, pdFALSE );
+            }
+            else if( strcmp( pcArg, "-b" ) == 0 )
+            {
+                xValid = prvParseNumber( &pcArgs, &pxTest->ulKbps, pdTRUE );
+            }
+            else if( strcmp( pcArg, "-l" ) == 0 )
+            {
+                xValid = prvParseNumber( &pcArgs, &pxTest->ulLength, pdFALSE );
+            }
+            else
+            {
+                xValid = pdFALSE;
+            }
+        }
+
+        if( ulPort == 0U )
+        {
+            ulPort = ( pxTest->xProtocol == IPERF_TLS ) ? iperfDEFAULT_TLS_PORT : iperfDEFAULT_PORT;
+        }
+
+        pxTest->usPort = ( uint16_t ) ulPort;
+
+        /* The TLS transport only connects to servers. */
+        if( ( xClient == pxTest->xServer ) || ( ulPort > UINT16_MAX ) || ( pxTest->ulSeconds == 0U ) ||
+            ( pxTest->ulKbps == 0U ) || ( pxTest->ulLength > iperfBUFFER_SIZE ) ||
+            ( ( pxTest->xProtocol == IPERF_TLS ) && ( pxTest->xServer == pdTRUE ) ) )
+        {
+            xValid = pdFALSE;
+        }
+
+        return xValid;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t Iperf_Start( const IperfTest_t * pxTest )
+    {
+        BaseType_t xResult = pdFALSE;
+
+        if( xIperfTask != NULL )
+        {
+            taskENTER_CRITICAL();
+            {
+                if( xBusy == pdFALSE )
+                {
+                    xBusy = pdTRUE;
+                    xResult = pdTRUE;
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+
+        if( xResult == pdTRUE )
+        {
+            xRequest = *pxTest;
+            xStopRequested = pdFALSE;
+            ( void ) xTaskNotifyGive( xIperfTask );
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void Iperf_Stop( void )
+    {
+        if( xBusy == pdTRUE )
+        {
+            xStopRequested = pdTRUE;
+        }
+    }
+
+#endif /* if ( iperfENABLED == 1 ) */
@@ -0,0 +1,158 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iperf.h
+ * @brief iperf 2 compatible throughput tests over FreeRTOS+TCP, plus a TLS echo test, compiled out
+ * unless iperfENABLED is 1.
+ *
+ * The TCP and UDP tests interoperate with iperf 2 on a host:
+ * - "iperf -s" on the device is met by "iperf -c <device> -t 10" on the host, and "iperf -u -s"
+ *   by "iperf -u -c <device> -b 10M". The UDP server sends its report back to the iperf client.
+ * - "iperf -c <host>" on the device sends to "iperf -s" on the host, and "iperf -u -c <host> -b 10000"
+ *   to "iperf -u -s", the report of the UDP server is printed.
+ * The TLS echo test goes through TLS_FreeRTOS_send() and TLS_FreeRTOS_recv() to a server echoing
+ * the data back, e.g. "socat OPENSSL-LISTEN:4433,cert=server.pem,verify=0,fork EXEC:cat". It uses
+ * the credentials passed to Iperf_Init(), with the trust anchor iperfconfigTLS_ROOT_CA_PEM if defined.
+ *
+ * One test runs at a time, from its own task. It prints one line per second and a summary:
+ * IPERF,proto,role,start_ms,end_ms,bytes,kbit_s,cpu_pct
+ * IPERF_SUM,proto,role,ms,bytes,kbit_s,cpu_pct,retx_est,lost,out_of_order,jitter_us,no_buffer,
+ *     tx_frames,rx_frames,rx_no_desc,tx_busy,net_buffers_min
+ * where cpu_pct is the time the idle task did not run. Together with the ENET frame counters and
+ * the network buffers left, it tells whether the MAC, the buffer pool, the TCP window or the crypto
+ * limits the throughput: retx_est is the number of frames a TCP client sent beyond one per
+ * ipconfigTCP_MSS of data, which includes the little other traffic of the device, and no_buffer the
+ * number of UDP datagrams that found no free network buffer or were not queued to the IP task.
+ */
+
+#ifndef IPERF_H
+#define IPERF_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Set to 1 to build the test service and the iperf shell command.
+ */
+#ifndef iperfENABLED
+    #define iperfENABLED    ( 0 )
+#endif
+
+/**
+ * @brief Port of the TCP and UDP tests, the iperf 2 default.
+ */
+#ifndef iperfDEFAULT_PORT
+    #define iperfDEFAULT_PORT    ( 5001U )
+#endif
+
+/**
+ * @brief Port of the TLS echo server.
+ */
+#ifndef iperfDEFAULT_TLS_PORT
+    #define iperfDEFAULT_TLS_PORT    ( 4433U )
+#endif
+
+/**
+ * @brief Duration of a client test, the iperf 2 default.
+ */
+#ifndef iperfDEFAULT_SECONDS
+    #define iperfDEFAULT_SECONDS    ( 10U )
+#endif
+
+/**
+ * @brief Rate of a UDP client, the iperf 2 default.
+ */
+#ifndef iperfDEFAULT_UDP_KBPS
+    #define iperfDEFAULT_UDP_KBPS    ( 1000U )
+#endif
+
+#if ( iperfENABLED == 1 )
+
+    #include "tls_freertos_pkcs11.h"
+
+/**
+ * @brief Transport of a test.
+ */
+    typedef enum IperfProtocol
+    {
+        IPERF_TCP = 0, /**< iperf 2 TCP, "tcp". */
+        IPERF_UDP,     /**< iperf 2 UDP, "udp". */
+        IPERF_TLS      /**< TLS echo, client only, "tls". */
+    } IperfProtocol_t;
+
+/**
+ * @brief Parameters of a test.
+ */
+    typedef struct IperfTest
+    {
+        IperfProtocol_t xProtocol; /**< Transport. */
+        BaseType_t xServer;        /**< pdTRUE to wait for a client, pdFALSE to connect to cHost. */
+        char cHost[ 64 ];          /**< Server of a client test, name or dotted decimal. */
+        uint16_t usPort;           /**< Port to listen on or connect to. */
+        uint32_t ulSeconds;        /**< Duration of a client test. */
+        uint32_t ulKbps;           /**< Rate of a UDP client, in kbit/s. */
+        uint32_t ulLength;         /**< Size of the sends, 0 for the default of the protocol. */
+    } IperfTest_t;
+
+/**
+ * @brief Creates the test task. Must be called once, with the network up.
+ *
+ * @param[in] pxCredentials Credentials of the TLS echo test, not copied, or NULL to disable it.
+ *
+ * @return pdTRUE if the task is created.
+ */
+    BaseType_t Iperf_Init( const NetworkCredentials_t * pxCredentials );
+
+/**
+ * @brief Parses the arguments of the shell command, in the iperf 2 syntax:
+ * [-u|--tls] (-s | -c <host>) [-p <port>] [-t <seconds>] [-b <kbit/s>] [-l <bytes>]
+ *
+ * @param[in] pcArgs The arguments, modified.
+ * @param[out] pxTest The test.
+ *
+ * @return pdTRUE if the arguments are valid.
+ */
+    BaseType_t Iperf_ParseArgs( char * pcArgs,
+                                IperfTest_t * pxTest );
+
+/**
+ * @brief Starts a test, the parameters are copied.
+ *
+ * @param[in] pxTest The test.
+ *
+ * @return pdTRUE if started, pdFALSE if a test is running.
+ */
+    BaseType_t Iperf_Start( const IperfTest_t * pxTest );
+
+/**
+ * @brief Ends the running test within a second, a server stops waiting for its client.
+ */
+    void Iperf_Stop( void );
+
+#endif /* if ( iperfENABLED == 1 ) */
+
+#endif /* IPERF_H */
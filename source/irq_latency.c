@@ -0,0 +1,297 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file irq_latency.c
+ * @brief Probe timer, tick hook and statistics of the interrupt latency instrumentation.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "irq_latency.h"
+
+#if ( irqlatencyENABLED == 1 )
+
+    #include "fsl_clock.h"
+    #include "fsl_reset.h"
+    #include "fsl_debug_console.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Value of lIrqLatencyPendingIrq when no interrupt is pended.
+ */
+    #define irqlatencyNO_IRQ        ( -1 )
+
+/**
+ * @brief Largest interval of the MRT, 24 bits.
+ */
+    #define irqlatencyMRT_MAX       ( MRT_CHANNEL_INTVAL_IVALUE_MASK )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Names of the interrupts in the print and the JSON, indexed by IrqLatencySource_t.
+ */
+    static const char * const pcSourceNames[ IRQLATENCY_SOURCES ] =
+    {
+        "systick",
+        "enet",
+        "flexcomm"
+    };
+
+    IrqLatencyMask_t xIrqLatencyMask;
+
+    volatile int32_t lIrqLatencyPendingIrq = irqlatencyNO_IRQ;
+
+    static IrqLatencyEntryStats_t xEntryStats[ IRQLATENCY_SOURCES ];
+
+/**
+ * @brief The interrupt pended last, and the DWT cycle count at the expiry that pended it.
+ */
+    static IrqLatencySource_t xPendingSource = IRQLATENCY_ENET;
+    static uint32_t ulPendingSince;
+
+/**
+ * @brief Interval loaded at the next expiry of the probe timer.
+ */
+    static uint32_t ulNextInterval;
+
+/**
+ * @brief State of the generator jittering the interval.
+ */
+    static uint32_t ulJitterState = 1U;
+
+/*-----------------------------------------------------------*/
+
+    static void prvRecord( IrqLatencySource_t xSource,
+                           uint32_t ulCycles )
+    {
+        IrqLatencyEntryStats_t * pxStats = &xEntryStats[ xSource ];
+
+        /* Each source is recorded by the handler of its own interrupt only. */
+        if( ( pxStats->ulSamples == 0U ) || ( ulCycles < pxStats->ulMinCycles ) )
+        {
+            pxStats->ulMinCycles = ulCycles;
+        }
+
+        pxStats->ulSamples++;
+        pxStats->ullSumCycles += ulCycles;
+
+        if( ulCycles > pxStats->ulMaxCycles )
+        {
+            pxStats->ulMaxCycles = ulCycles;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns the next interval of the probe timer, uniform between half and one and a half of the
+ * mean period, so that the expiries do not lock to a periodic activity.
+ */
+    static uint32_t prvNextInterval( void )
+    {
+        uint32_t ulPeriod = ( SystemCoreClock / 1000000U ) * irqlatencyPROBE_PERIOD_US;
+
+        ulJitterState = ( ulJitterState * 1664525U ) + 1013904223U;
+        ulPeriod = ( ulPeriod / 2U ) + ( uint32_t ) ( ( ( uint64_t ) ( ulJitterState >> 8 ) * ulPeriod ) >> 24 );
+
+        return ( ulPeriod > irqlatencyMRT_MAX ) ? irqlatencyMRT_MAX : ulPeriod;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void IrqLatency_RecordEntry( void )
+    {
+        prvRecord( xPendingSource, DWT->CYCCNT - ulPendingSince );
+        lIrqLatencyPendingIrq = irqlatencyNO_IRQ;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Probe timer expiry, above the kernel priorities as it calls no FreeRTOS API.
+ * The MRT and the DWT both count the core clock, as the bus clock is not divided.
+ */
+    void MRT0_IRQHandler( void )
+    {
+        uint32_t ulNow = DWT->CYCCNT;
+        uint32_t ulElapsed = ulNextInterval - ( MRT0->CHANNEL[ irqlatencyMRT_CHANNEL ].TIMER & MRT_CHANNEL_TIMER_VALUE_MASK );
+        IrqLatencySource_t xSource = ( xPendingSource == IRQLATENCY_ENET ) ? IRQLATENCY_FLEXCOMM : IRQLATENCY_ENET;
+        IRQn_Type xIrq = ( xSource == IRQLATENCY_ENET ) ? ETHERNET_IRQn : irqlatencyFLEXCOMM_IRQ;
+
+        MRT0->CHANNEL[ irqlatencyMRT_CHANNEL ].STAT = MRT_CHANNEL_STAT_INTFLAG_MASK;
+
+        /* Loaded at the next expiry. */
+        ulNextInterval = prvNextInterval();
+        MRT0->CHANNEL[ irqlatencyMRT_CHANNEL ].INTVAL = MRT_CHANNEL_INTVAL_IVALUE( ulNextInterval );
+
+        if( lIrqLatencyPendingIrq != irqlatencyNO_IRQ )
+        {
+            /* The last sample is not taken yet. */
+        }
+        else if( NVIC_GetEnableIRQ( xIrq ) == 0U )
+        {
+            /* Masked by a deferral or never enabled, the handler would not run. */
+            xEntryStats[ xSource ].ulSkipped++;
+            xPendingSource = xSource;
+        }
+        else
+        {
+            xPendingSource = xSource;
+            ulPendingSince = ulNow - ulElapsed;
+            lIrqLatencyPendingIrq = ( int32_t ) xIrq;
+            NVIC_SetPendingIRQ( xIrq );
+        }
+
+        SDK_ISR_EXIT_BARRIER;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Called by the kernel in the SysTick handler. The counter is reloaded at the interrupt
+ * request and counts down the core clock, so the cycles it counted are the entry latency, plus the
+ * constant path of the port to the hook.
+ */
+    void vApplicationTickHook( void )
+    {
+        prvRecord( IRQLATENCY_SYSTICK, SysTick->LOAD - SysTick->VAL );
+    }
+
+/*-----------------------------------------------------------*/
+
+    void IrqLatency_GetStats( IrqLatencyStats_t * pxStats )
+    {
+        taskENTER_CRITICAL();
+        {
+            pxStats->ulMaskWindows = xIrqLatencyMask.ulWindows;
+            pxStats->ulMaskMaxCycles = xIrqLatencyMask.ulMaxCycles;
+            pxStats->pcMaskMaxFunction = xIrqLatencyMask.pcMaxFunction;
+            pxStats->ulMaskMaxLine = xIrqLatencyMask.ulMaxLine;
+            memcpy( pxStats->xEntry, xEntryStats, sizeof( xEntryStats ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void IrqLatency_Reset( void )
+    {
+        /* The window open since the caller masked the interrupts stays open. */
+        taskENTER_CRITICAL();
+        {
+            xIrqLatencyMask.ulWindows = 0U;
+            xIrqLatencyMask.ulMaxCycles = 0U;
+            xIrqLatencyMask.pcMaxFunction = NULL;
+            xIrqLatencyMask.ulMaxLine = 0U;
+            memset( xEntryStats, 0x00, sizeof( xEntryStats ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void IrqLatency_Print( void )
+    {
+        /* Static as it is large for the task stack. */
+        static IrqLatencyStats_t xStats;
+        const IrqLatencyEntryStats_t * pxEntry;
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+        uint32_t i;
+
+        IrqLatency_GetStats( &xStats );
+
+        PRINTF( "IRQOFF,windows,max_cycles,max_us,site\r\n" );
+        PRINTF( "IRQOFF,%lu,%lu,%lu,%s:%lu\r\n", ( unsigned long ) xStats.ulMaskWindows,
+                ( unsigned long ) xStats.ulMaskMaxCycles,
+                ( unsigned long ) ( ( ulCyclesPerUs > 0U ) ? ( xStats.ulMaskMaxCycles / ulCyclesPerUs ) : 0U ),
+                ( xStats.pcMaskMaxFunction != NULL ) ? xStats.pcMaskMaxFunction : "none",
+                ( unsigned long ) xStats.ulMaskMaxLine );
+
+        PRINTF( "IRQ,name,samples,min_cycles,avg_cycles,max_cycles,skipped\r\n" );
+
+        for( i = 0; i < IRQLATENCY_SOURCES; i++ )
+        {
+            pxEntry = &xStats.xEntry[ i ];
+
+            PRINTF( "IRQ,%s,%lu,%lu,%lu,%lu,%lu\r\n", pcSourceNames[ i ], ( unsigned long ) pxEntry->ulSamples,
+                    ( unsigned long ) pxEntry->ulMinCycles,
+                    ( unsigned long ) ( ( pxEntry->ulSamples > 0U ) ? ( pxEntry->ullSumCycles / pxEntry->ulSamples ) : 0U ),
+                    ( unsigned long ) pxEntry->ulMaxCycles, ( unsigned long ) pxEntry->ulSkipped );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    size_t IrqLatency_FormatJson( char * pcBuffer,
+                                  size_t xSize )
+    {
+        IrqLatencyStats_t xStats;
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+        int lWritten;
+
+        IrqLatency_GetStats( &xStats );
+
+        lWritten = snprintf( pcBuffer, xSize,
+                             "\"irq\":{\"off_us\":%lu,\"off_at\":\"%s:%lu\",\"%s\":%lu,\"%s\":%lu,\"%s\":%lu}",
+                             ( unsigned long ) ( ( ulCyclesPerUs > 0U ) ? ( xStats.ulMaskMaxCycles / ulCyclesPerUs ) : 0U ),
+                             ( xStats.pcMaskMaxFunction != NULL ) ? xStats.pcMaskMaxFunction : "none",
+                             ( unsigned long ) xStats.ulMaskMaxLine,
+                             pcSourceNames[ IRQLATENCY_SYSTICK ], ( unsigned long ) xStats.xEntry[ IRQLATENCY_SYSTICK ].ulMaxCycles,
+                             pcSourceNames[ IRQLATENCY_ENET ], ( unsigned long ) xStats.xEntry[ IRQLATENCY_ENET ].ulMaxCycles,
+                             pcSourceNames[ IRQLATENCY_FLEXCOMM ], ( unsigned long ) xStats.xEntry[ IRQLATENCY_FLEXCOMM ].ulMaxCycles );
+
+        return ( ( lWritten > 0 ) && ( ( size_t ) lWritten < xSize ) ) ? ( size_t ) lWritten : 0U;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t IrqLatency_Init( void )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+        CLOCK_EnableClock( kCLOCK_Mrt );
+        RESET_PeripheralReset( kMRT_RST_SHIFT_RSTn );
+
+        /* Repeat mode, the next interval is written at each expiry and loaded at the one after. */
+        MRT0->CHANNEL[ irqlatencyMRT_CHANNEL ].CTRL = MRT_CHANNEL_CTRL_INTEN_MASK | MRT_CHANNEL_CTRL_MODE( 0U );
+        ulNextInterval = prvNextInterval();
+        MRT0->CHANNEL[ irqlatencyMRT_CHANNEL ].INTVAL = MRT_CHANNEL_INTVAL_IVALUE( ulNextInterval ) | MRT_CHANNEL_INTVAL_LOAD_MASK;
+
+        /* Above the masking of the kernel critical sections, which the samples go through. */
+        NVIC_SetPriority( MRT0_IRQn, 0U );
+        EnableIRQ( MRT0_IRQn );
+
+        return pdTRUE;
+    }
+
+#endif /* if ( irqlatencyENABLED == 1 ) */
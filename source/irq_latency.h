@@ -0,0 +1,255 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file irq_latency.h
+ * @brief Interrupt masking windows and interrupt entry latency, compiled out unless irqlatencyENABLED
+ * is 1.
+ *
+ * The code masking the interrupts marks its windows with IRQMASK_BEGIN() right after masking and
+ * IRQMASK_END() right before unmasking. The longest window is kept with the function and the line of
+ * its IRQMASK_BEGIN(). A window runs from the first IRQMASK_BEGIN() to the next IRQMASK_END(), so the
+ * IRQMASK_END() of a nested window, which does not unmask, must be left out.
+ *
+ * The entry latency of SysTick is read from the SysTick counter in the tick hook. The entry latency of
+ * the ENET and the FLEXCOMM interrupts is sampled by a probe timer, MRT0 at the highest priority, with
+ * a period jittered around irqlatencyPROBE_PERIOD_US. Each expiry pends one of the two interrupts in
+ * turn, and IRQLATENCY_ENTRY() at the start of its handler measures the DWT cycles since the expiry:
+ * the latency of an interrupt raised at a random time, through the masking windows and the handlers
+ * of a higher or the same priority. The handlers run once without an event, which they ignore.
+ */
+
+#ifndef IRQ_LATENCY_H
+#define IRQ_LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Set to 1 to build the instrumentation, the macros compile to nothing otherwise.
+ */
+#ifndef irqlatencyENABLED
+    #define irqlatencyENABLED    ( 0 )
+#endif
+
+/**
+ * @brief Mean period of the probe timer. Each sample of the ENET and the FLEXCOMM latency takes
+ * two periods, and a spurious run of their handler.
+ */
+#ifndef irqlatencyPROBE_PERIOD_US
+    #define irqlatencyPROBE_PERIOD_US    ( 5000U )
+#endif
+
+/**
+ * @brief MRT0 channel of the probe timer.
+ */
+#ifndef irqlatencyMRT_CHANNEL
+    #define irqlatencyMRT_CHANNEL    ( 0U )
+#endif
+
+/**
+ * @brief FLEXCOMM interrupt sampled, the debug console USART by default.
+ */
+#ifndef irqlatencyFLEXCOMM_IRQ
+    #define irqlatencyFLEXCOMM_IRQ    ( FLEXCOMM0_IRQn )
+#endif
+
+/**
+ * @brief The interrupts whose entry latency is sampled.
+ */
+typedef enum IrqLatencySource
+{
+    IRQLATENCY_SYSTICK = 0, /**< The kernel tick, "systick". */
+    IRQLATENCY_ENET,        /**< The ENET DMA interrupt, "enet". */
+    IRQLATENCY_FLEXCOMM,    /**< irqlatencyFLEXCOMM_IRQ, "flexcomm". */
+    IRQLATENCY_SOURCES
+} IrqLatencySource_t;
+
+/**
+ * @brief Entry latency of an interrupt, in core clock cycles.
+ */
+typedef struct IrqLatencyEntryStats
+{
+    uint32_t ulSamples;    /**< Number of samples. */
+    uint32_t ulMinCycles;  /**< Shortest latency, valid once there are samples. */
+    uint32_t ulMaxCycles;  /**< Longest latency. */
+    uint64_t ullSumCycles; /**< Sum of the latencies, for the average. */
+    uint32_t ulSkipped;    /**< Expiries of the probe timer not sampled, the interrupt being disabled. */
+} IrqLatencyEntryStats_t;
+
+/**
+ * @brief Masking windows and entry latencies since the last reset.
+ */
+typedef struct IrqLatencyStats
+{
+    uint32_t ulMaskWindows;                               /**< Number of masking windows. */
+    uint32_t ulMaskMaxCycles;                             /**< Longest window, in core clock cycles. */
+    const char * pcMaskMaxFunction;                       /**< Function masking the interrupts for the longest window, NULL if none. */
+    uint32_t ulMaskMaxLine;                               /**< Line of its IRQMASK_BEGIN(). */
+    IrqLatencyEntryStats_t xEntry[ IRQLATENCY_SOURCES ]; /**< Entry latency of each interrupt. */
+} IrqLatencyStats_t;
+
+#if ( irqlatencyENABLED == 1 )
+
+    #include "fsl_device_registers.h"
+
+/**
+ * @brief State of the masking windows, written by the inline functions so that the code running from
+ * RAM while the flash is busy can mark its windows.
+ */
+    typedef struct IrqLatencyMask
+    {
+        uint32_t ulOpen;                /**< Set between IRQMASK_BEGIN() and IRQMASK_END(). */
+        uint32_t ulStart;               /**< DWT cycle count at the start of the open window. */
+        const char * pcFunction;        /**< Function of the open window. */
+        uint32_t ulLine;                /**< Line of the open window. */
+        uint32_t ulWindows;             /**< Windows closed. */
+        uint32_t ulMaxCycles;           /**< Longest window. */
+        const char * pcMaxFunction;     /**< Function of the longest window. */
+        uint32_t ulMaxLine;             /**< Line of the longest window. */
+    } IrqLatencyMask_t;
+
+    extern IrqLatencyMask_t xIrqLatencyMask;
+
+/**
+ * @brief Interrupt pended by the probe timer and not entered yet, -1 if none.
+ */
+    extern volatile int32_t lIrqLatencyPendingIrq;
+
+/**
+ * @brief Opens a masking window unless one is open, with interrupts masked.
+ */
+    static inline void IrqLatency_MaskBegin( const char * pcFunction,
+                                             uint32_t ulLine )
+    {
+        if( xIrqLatencyMask.ulOpen == 0U )
+        {
+            xIrqLatencyMask.ulStart = DWT->CYCCNT;
+            xIrqLatencyMask.pcFunction = pcFunction;
+            xIrqLatencyMask.ulLine = ulLine;
+            xIrqLatencyMask.ulOpen = 1U;
+        }
+    }
+
+/**
+ * @brief Closes the open masking window, with interrupts still masked.
+ */
+    static inline void IrqLatency_MaskEnd( void )
+    {
+        uint32_t ulCycles;
+
+        if( xIrqLatencyMask.ulOpen != 0U )
+        {
+            ulCycles = DWT->CYCCNT - xIrqLatencyMask.ulStart;
+            xIrqLatencyMask.ulOpen = 0U;
+            xIrqLatencyMask.ulWindows++;
+
+            if( ulCycles > xIrqLatencyMask.ulMaxCycles )
+            {
+                xIrqLatencyMask.ulMaxCycles = ulCycles;
+                xIrqLatencyMask.pcMaxFunction = xIrqLatencyMask.pcFunction;
+                xIrqLatencyMask.ulMaxLine = xIrqLatencyMask.ulLine;
+            }
+        }
+    }
+
+/**
+ * @brief Records a sample of the interrupt pended by the probe timer, called by IRQLATENCY_ENTRY().
+ */
+    void IrqLatency_RecordEntry( void );
+
+/**
+ * @brief Marks the start of a masking window, right after the interrupts are masked.
+ */
+    #define IRQMASK_BEGIN()            IrqLatency_MaskBegin( __func__, __LINE__ )
+
+/**
+ * @brief Marks the end of a masking window, right before the interrupts are unmasked.
+ */
+    #define IRQMASK_END()              IrqLatency_MaskEnd()
+
+/**
+ * @brief Marks the entry of the handler of an interrupt, which may be pended by the probe timer.
+ */
+    #define IRQLATENCY_ENTRY( irq )                                \
+    do                                                             \
+    {                                                              \
+        if( lIrqLatencyPendingIrq == ( int32_t ) ( irq ) )         \
+        {                                                          \
+            IrqLatency_RecordEntry();                              \
+        }                                                          \
+    } while( 0 )
+
+/**
+ * @brief Enables the DWT cycle counter and starts the probe timer. Must be called once, from a
+ * privileged task or before the scheduler is started.
+ *
+ * @return pdTRUE if the probe timer is started.
+ */
+    BaseType_t IrqLatency_Init( void );
+
+/**
+ * @brief Takes a copy of the statistics.
+ *
+ * @param[out] pxStats The statistics.
+ */
+    void IrqLatency_GetStats( IrqLatencyStats_t * pxStats );
+
+/**
+ * @brief Clears the statistics.
+ */
+    void IrqLatency_Reset( void );
+
+/**
+ * @brief Prints the longest masking window and one line per interrupt:
+ * IRQOFF,windows,max_cycles,max_us,site
+ * IRQ,name,samples,min_cycles,avg_cycles,max_cycles,skipped
+ */
+    void IrqLatency_Print( void );
+
+/**
+ * @brief Formats the statistics as the JSON member
+ * "irq":{"off_us":120,"off_at":"mflash_drv_block_erase:761","systick":90,"enet":140,"flexcomm":150}
+ * with the longest window in microseconds and the longest entry latencies in cycles.
+ *
+ * @param[out] pcBuffer Buffer the member is written to.
+ * @param[in] xSize Size of the buffer.
+ *
+ * @return The length written, 0 if the member does not fit.
+ */
+    size_t IrqLatency_FormatJson( char * pcBuffer,
+                                  size_t xSize );
+
+#else /* if ( irqlatencyENABLED == 1 ) */
+
+    #define IRQMASK_BEGIN()
+    #define IRQMASK_END()
+    #define IRQLATENCY_ENTRY( irq )
+
+#endif /* if ( irqlatencyENABLED == 1 ) */
+
+#endif /* IRQ_LATENCY_H */
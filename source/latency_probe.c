@@ -0,0 +1,333 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file latency_probe.c
+ * @brief Storage, console dump and MQTT report of the latency probes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "latency_probe.h"
+
+#if ( latencyprobeENABLED == 1 )
+
+    #include "fsl_debug_console.h"
+
+    #include "core_mqtt_agent.h"
+    #include "connection_manager.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Topic the commands are received on, formatted with the thing name.
+ */
+    #define latencyprobeCOMMAND_TOPIC_FORMAT    "device/%.*s/probes/cmd"
+
+/**
+ * @brief Topic the report is published on, formatted with the thing name.
+ */
+    #define latencyprobeREPORT_TOPIC_FORMAT     "device/%.*s/probes"
+
+/**
+ * @brief Size of the buffers holding the topics.
+ */
+    #define latencyprobeTOPIC_MAX_SIZE          ( 160U )
+
+/**
+ * @brief Size of the report buffer, about 60 bytes per probe.
+ */
+    #define latencyprobeREPORT_MAX_SIZE         ( 16U + ( PROBE_COUNT * 64U ) )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Measurements of a probe since the last reset.
+ */
+    typedef struct LatencyProbeSlot
+    {
+        uint32_t ulCount;     /**< Number of measurements. */
+        uint32_t ulMinCycles; /**< Shortest measurement, valid once the count is not 0. */
+        uint32_t ulMaxCycles; /**< Longest measurement. */
+        uint64_t ullSumCycles; /**< Sum of the measurements, for the average. */
+    } LatencyProbeSlot_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Names of the probes in the dump and the report, indexed by LatencyProbeId_t.
+ */
+    static const char * const pcProbeNames[ PROBE_COUNT ] =
+    {
+        "agent_rx",
+        "ota_data",
+        "ota_decode",
+        "ota_write",
+        "flash_write",
+        "flash_erase",
+        "tls_send",
+        "tls_recv"
+    };
+
+    static LatencyProbeSlot_t xSlots[ PROBE_COUNT ];
+
+/**
+ * @brief Thing name used in the report topic, not copied.
+ */
+    static const char * pcProbeThingName;
+    static uint32_t ulProbeThingNameLength;
+
+/**
+ * @brief Topic filter, registered with the agent and so kept for its lifetime.
+ */
+    static char cCommandTopic[ latencyprobeTOPIC_MAX_SIZE ];
+
+/**
+ * @brief Subscription to the command topic, sent again when the session is not resumed.
+ */
+    static ConnectionSubscription_t xSubscription;
+
+/**
+ * @brief Report publish, owned by the agent until it is sent as it is larger than an arena slab.
+ */
+    static ConnectionPublish_t xReport;
+    static char cReportTopic[ latencyprobeTOPIC_MAX_SIZE ];
+    static char cReport[ latencyprobeREPORT_MAX_SIZE ];
+
+/*-----------------------------------------------------------*/
+
+    void LatencyProbe_Record( LatencyProbeId_t xId,
+                              uint32_t ulCycles )
+    {
+        LatencyProbeSlot_t * pxSlot = &xSlots[ xId ];
+        UBaseType_t uxSavedInterruptStatus;
+
+        uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+        {
+            if( ( pxSlot->ulCount == 0U ) || ( ulCycles < pxSlot->ulMinCycles ) )
+            {
+                pxSlot->ulMinCycles = ulCycles;
+            }
+
+            pxSlot->ulCount++;
+            pxSlot->ullSumCycles += ulCycles;
+
+            if( ulCycles > pxSlot->ulMaxCycles )
+            {
+                pxSlot->ulMaxCycles = ulCycles;
+            }
+        }
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Takes a consistent copy of a slot, converted to microseconds.
+ *
+ * @return pdTRUE if the probe has measurements.
+ */
+    static BaseType_t prvReadSlot( LatencyProbeId_t xId,
+                                   uint32_t * pulCount,
+                                   uint32_t * pulMinUs,
+                                   uint32_t * pulAvgUs,
+                                   uint32_t * pulMaxUs )
+    {
+        LatencyProbeSlot_t xSlot;
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000U;
+
+        taskENTER_CRITICAL();
+        {
+            xSlot = xSlots[ xId ];
+        }
+        taskEXIT_CRITICAL();
+
+        if( ( xSlot.ulCount == 0U ) || ( ulCyclesPerUs == 0U ) )
+        {
+            return pdFALSE;
+        }
+
+        *pulCount = xSlot.ulCount;
+        *pulMinUs = xSlot.ulMinCycles / ulCyclesPerUs;
+        *pulAvgUs = ( uint32_t ) ( xSlot.ullSumCycles / xSlot.ulCount / ulCyclesPerUs );
+        *pulMaxUs = xSlot.ulMaxCycles / ulCyclesPerUs;
+
+        return pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void LatencyProbe_Dump( void )
+    {
+        uint32_t ulCount, ulMinUs, ulAvgUs, ulMaxUs;
+        uint32_t i;
+
+        PRINTF( "PROBE,name,count,min_us,avg_us,max_us\r\n" );
+
+        for( i = 0; i < PROBE_COUNT; i++ )
+        {
+            if( prvReadSlot( ( LatencyProbeId_t ) i, &ulCount, &ulMinUs, &ulAvgUs, &ulMaxUs ) == pdTRUE )
+            {
+                PRINTF( "PROBE,%s,%lu,%lu,%lu,%lu\r\n", pcProbeNames[ i ],
+                        ( unsigned long ) ulCount, ( unsigned long ) ulMinUs,
+                        ( unsigned long ) ulAvgUs, ( unsigned long ) ulMaxUs );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    void LatencyProbe_Reset( void )
+    {
+        taskENTER_CRITICAL();
+        {
+            memset( xSlots, 0x00, sizeof( xSlots ) );
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes the probes with QoS0 without blocking, as it runs in the agent task.
+ */
+    static void prvReport( void )
+    {
+        uint32_t ulCount, ulMinUs, ulAvgUs, ulMaxUs;
+        size_t xLength = 1U;
+        int lWritten;
+        uint32_t i;
+
+        if( ConnectionManager_PublishPending( &xReport ) == pdTRUE )
+        {
+            PRINTF( "Probe report already queued.\r\n" );
+            return;
+        }
+
+        cReport[ 0 ] = '{';
+
+        for( i = 0; ( i < PROBE_COUNT ) && ( xLength < sizeof( cReport ) ); i++ )
+        {
+            if( prvReadSlot( ( LatencyProbeId_t ) i, &ulCount, &ulMinUs, &ulAvgUs, &ulMaxUs ) == pdTRUE )
+            {
+                lWritten = snprintf( &cReport[ xLength ], sizeof( cReport ) - xLength,
+                                     "%s\"%s\":{\"n\":%lu,\"min\":%lu,\"avg\":%lu,\"max\":%lu}",
+                                     ( xLength == 1U ) ? "" : ",", pcProbeNames[ i ],
+                                     ( unsigned long ) ulCount, ( unsigned long ) ulMinUs,
+                                     ( unsigned long ) ulAvgUs, ( unsigned long ) ulMaxUs );
+                xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+            }
+        }
+
+        if( xLength < ( sizeof( cReport ) - 1U ) )
+        {
+            cReport[ xLength++ ] = '}';
+
+            lWritten = snprintf( cReportTopic, sizeof( cReportTopic ), latencyprobeREPORT_TOPIC_FORMAT,
+                                 ( int ) ulProbeThingNameLength, pcProbeThingName );
+
+            if( ConnectionManager_Publish( &xReport, cReportTopic, ( uint16_t ) lWritten, MQTTQoS0, cReport, xLength,
+                                           NULL, NULL, 0 ) != pdTRUE )
+            {
+                PRINTF( "Probe report not queued.\r\n" );
+            }
+        }
+        else
+        {
+            PRINTF( "Probe report does not fit in the buffer.\r\n" );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvCommandCallback( void * pCallbackContext,
+                                    MQTTPublishInfo_t * pPublishInfo )
+    {
+        const char * pcPayload = ( const char * ) pPublishInfo->pPayload;
+        size_t xRemaining = pPublishInfo->payloadLength;
+        const char * pcComma;
+        size_t xCommandLength;
+
+        ( void ) pCallbackContext;
+
+        while( xRemaining > 0U )
+        {
+            pcComma = memchr( pcPayload, ',', xRemaining );
+            xCommandLength = ( pcComma != NULL ) ? ( size_t ) ( pcComma - pcPayload ) : xRemaining;
+
+            if( ( xCommandLength == 4U ) && ( strncmp( pcPayload, "dump", 4U ) == 0 ) )
+            {
+                LatencyProbe_Dump();
+            }
+            else if( ( xCommandLength == 6U ) && ( strncmp( pcPayload, "report", 6U ) == 0 ) )
+            {
+                prvReport();
+            }
+            else if( ( xCommandLength == 5U ) && ( strncmp( pcPayload, "reset", 5U ) == 0 ) )
+            {
+                LatencyProbe_Reset();
+            }
+            else if( xCommandLength > 0U )
+            {
+                PRINTF( "Ignored probe command %.*s.\r\n", ( int ) xCommandLength, pcPayload );
+            }
+            else
+            {
+                /* Empty entry. */
+            }
+
+            xCommandLength = ( pcComma != NULL ) ? ( xCommandLength + 1U ) : xCommandLength;
+            pcPayload += xCommandLength;
+            xRemaining -= xCommandLength;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t LatencyProbe_Init( const char * pcThingName,
+                                  uint32_t ulThingNameLength )
+    {
+        int lLength;
+
+        pcProbeThingName = pcThingName;
+        ulProbeThingNameLength = ulThingNameLength;
+
+        lLength = snprintf( cCommandTopic, sizeof( cCommandTopic ), latencyprobeCOMMAND_TOPIC_FORMAT,
+                            ( int ) ulThingNameLength, pcThingName );
+
+        if( ( lLength <= 0 ) || ( ( size_t ) lLength >= sizeof( cCommandTopic ) ) )
+        {
+            return pdFALSE;
+        }
+
+        return ConnectionManager_Subscribe( &xSubscription, cCommandTopic, ( uint16_t ) lLength, MQTTQoS1,
+                                            prvCommandCallback, NULL, NULL );
+    }
+
+#endif /* if ( latencyprobeENABLED == 1 ) */
@@ -0,0 +1,131 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file latency_probe.h
+ * @brief Cycle accurate latency probes on the hot paths, compiled out unless latencyprobeENABLED is 1.
+ */
+
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Set to 1 to build the probes, they compile to nothing otherwise.
+ */
+#ifndef latencyprobeENABLED
+    #define latencyprobeENABLED    ( 0 )
+#endif
+
+/**
+ * @brief The probed stages, in the order a firmware block goes through them.
+ */
+typedef enum LatencyProbeId
+{
+    PROBE_AGENT_RECEIVE = 0, /**< One MQTT_ProcessLoop() call of the agent, receive and dispatch, "agent_rx". */
+    PROBE_OTA_DATA,          /**< Copy of a file block publish to an OTA event buffer, "ota_data". */
+    PROBE_OTA_DECODE,        /**< OTA agent from taking a block event to writing the block, "ota_decode". */
+    PROBE_OTA_WRITE,         /**< xOtaPalWriteBlock(), "ota_write". */
+    PROBE_FLASH_WRITE,       /**< mflash driver write of one request, "flash_write". */
+    PROBE_FLASH_ERASE,       /**< mflash driver erase of one request, "flash_erase". */
+    PROBE_TLS_SEND,          /**< mbedtls_ssl_write() of one record, "tls_send". */
+    PROBE_TLS_RECV,          /**< mbedtls_ssl_read() call, "tls_recv". */
+    PROBE_COUNT
+} LatencyProbeId_t;
+
+#if ( latencyprobeENABLED == 1 )
+
+    #include "fsl_device_registers.h"
+
+/**
+ * @brief Returns the DWT cycle count, the start of a span measured with PROBE_SINCE().
+ */
+    #define PROBE_TIMESTAMP()          ( DWT->CYCCNT )
+
+/**
+ * @brief Starts timing a stage, in the same scope as the matching PROBE_END().
+ */
+    #define PROBE_BEGIN( id )          const uint32_t ulProbeStart_##id = DWT->CYCCNT
+
+/**
+ * @brief Records the cycles since the matching PROBE_BEGIN().
+ */
+    #define PROBE_END( id )            LatencyProbe_Record( ( id ), DWT->CYCCNT - ulProbeStart_##id )
+
+/**
+ * @brief Records the cycles since a PROBE_TIMESTAMP(), for a span across functions.
+ */
+    #define PROBE_SINCE( id, start )    LatencyProbe_Record( ( id ), DWT->CYCCNT - ( start ) )
+
+/**
+ * @brief Adds a measurement to the min, max, sum and count of a probe.
+ * Safe to call from any task and from interrupts.
+ *
+ * @param[in] xId The probe.
+ * @param[in] ulCycles The duration of the stage in core clock cycles.
+ */
+    void LatencyProbe_Record( LatencyProbeId_t xId,
+                              uint32_t ulCycles );
+
+/**
+ * @brief Prints one line per probe measured since the last reset:
+ * PROBE,name,count,min_us,avg_us,max_us
+ */
+    void LatencyProbe_Dump( void );
+
+/**
+ * @brief Clears the measurements of all the probes.
+ */
+    void LatencyProbe_Reset( void );
+
+/**
+ * @brief Subscribes to the probe command topic of the thing, "device/<thing name>/probes/cmd".
+ * Each publish on the topic is a list of commands separated by commas, run in order:
+ * "dump" prints the probes on the console, "report" publishes them as JSON on "device/<thing name>/probes",
+ * e.g. {"agent_rx":{"n":120,"min":35,"avg":210,"max":9800},...} in microseconds, and "reset" clears them.
+ * The subscription is sent again when the broker does not resume the session.
+ * Must be called once the MQTT agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if the subscribe is queued.
+ */
+    BaseType_t LatencyProbe_Init( const char * pcThingName,
+                                  uint32_t ulThingNameLength );
+
+#else /* if ( latencyprobeENABLED == 1 ) */
+
+    #define PROBE_TIMESTAMP()           ( 0U )
+    #define PROBE_BEGIN( id )
+    #define PROBE_END( id )
+    #define PROBE_SINCE( id, start )
+
+#endif /* if ( latencyprobeENABLED == 1 ) */
+
+#endif /* LATENCY_PROBE_H */
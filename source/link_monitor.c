@@ -0,0 +1,291 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file link_monitor.c
+ * @brief Ethernet link monitor.
+ * The LAN8720A asserts nINT on link down and on auto-negotiation complete. The pin interrupt notifies
+ * the monitor task, which clears the PHY interrupt, reads the link state over MDIO and reports it to
+ * FreeRTOS+TCP: a link down takes the network down at once, a link up while the network is down makes
+ * the IP task initialise the interface again right away instead of at its next retry.
+ */
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "FreeRTOS_IP.h"
+
+#include "fsl_debug_console.h"
+
+#include "board.h"
+#include "fsl_enet.h"
+#include "fsl_enet_mdio.h"
+#include "fsl_phylan8720a.h"
+
+#if defined( linkmonitorPHY_INT_GPIO_PORT ) && defined( linkmonitorPHY_INT_GPIO_PIN )
+    #include "fsl_gpio.h"
+    #include "fsl_inputmux.h"
+#endif
+
+#include "watchdog.h"
+
+#include "link_monitor.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief GPIO wired to the PHY nINT pin, port 0 or 1 as only those reach the pin interrupts.
+ * Leave undefined on boards where the pin is strapped as REFCLKO or not routed, the PHY is polled then.
+ */
+#if defined( linkmonitorPHY_INT_GPIO_PORT ) && defined( linkmonitorPHY_INT_GPIO_PIN )
+    #define linkmonitorUSE_PHY_INT    1
+#else
+    #define linkmonitorUSE_PHY_INT    0
+#endif
+
+/**
+ * @brief Pin interrupt slice used for nINT, PIN_INT0 is taken by the board buttons.
+ */
+#ifndef linkmonitorPININT_INDEX
+    #define linkmonitorPININT_INDEX          ( 1U )
+    #define linkmonitorPININT_IRQ            PIN_INT1_IRQn
+    #define linkmonitorPININT_IRQ_HANDLER    PIN_INT1_IRQHandler
+#endif
+
+/**
+ * @brief Period at which the PHY is read without nINT, and the longest wait with it, which catches a
+ * missed edge.
+ */
+#ifndef linkmonitorPOLL_PERIOD_MS
+    #if ( linkmonitorUSE_PHY_INT == 1 )
+        #define linkmonitorPOLL_PERIOD_MS    ( 60000U )
+    #else
+        #define linkmonitorPOLL_PERIOD_MS    ( 1000U )
+    #endif
+#endif
+
+/**
+ * @brief Priority of the monitor task, above the IP task so a link change is reported without delay.
+ */
+#ifndef linkmonitorTASK_PRIORITY
+    #define linkmonitorTASK_PRIORITY      ( configMAX_PRIORITIES - 1 )
+#endif
+
+/**
+ * @brief Stack size of the monitor task, in words.
+ */
+#ifndef linkmonitorTASK_STACK_SIZE
+    #define linkmonitorTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 2 )
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief MDIO access to the PHY, shared with the network interface through the same ENET SMI registers.
+ */
+static mdio_handle_t xMdioHandle = { .resource.base = ENET, .ops = &lpc_enet_ops };
+
+/**
+ * @brief The PHY, initialised by the network interface.
+ */
+static phy_handle_t xPhyHandle =
+{
+    .phyAddr    = BOARD_ENET0_PHY_ADDRESS,
+    .mdioHandle = &xMdioHandle,
+    .ops        = &phylan8720a_ops
+};
+
+/**
+ * @brief The monitor task, notified by the pin interrupt.
+ */
+static TaskHandle_t xMonitorTask = NULL;
+
+/**
+ * @brief Last link state read from the PHY, assumed up until the first read.
+ */
+static volatile bool xLinkState = true;
+
+/*-----------------------------------------------------------*/
+
+#if ( linkmonitorUSE_PHY_INT == 1 )
+
+    void linkmonitorPININT_IRQ_HANDLER( void )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+        /* Clear the falling edge, nINT stays low until the task reads the PHY interrupt source. */
+        PINT->IST = 1UL << linkmonitorPININT_INDEX;
+
+        if( xMonitorTask != NULL )
+        {
+            vTaskNotifyGiveFromISR( xMonitorTask, &xHigherPriorityTaskWoken );
+        }
+
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvPinIntInit( void )
+    {
+        const gpio_pin_config_t xPinConfig = { kGPIO_DigitalInput, 0 };
+        const uint32_t ulPinIndex = linkmonitorPHY_INT_GPIO_PORT * 32U + linkmonitorPHY_INT_GPIO_PIN;
+
+        GPIO_PortInit( GPIO, linkmonitorPHY_INT_GPIO_PORT );
+        GPIO_PinInit( GPIO, linkmonitorPHY_INT_GPIO_PORT, linkmonitorPHY_INT_GPIO_PIN, &xPinConfig );
+
+        INPUTMUX_Init( INPUTMUX );
+        INPUTMUX_AttachSignal( INPUTMUX,
+                               linkmonitorPININT_INDEX,
+                               ( inputmux_connection_t ) ( ulPinIndex + ( PINTSEL_PMUX_ID << PMUX_SHIFT ) ) );
+        INPUTMUX_Deinit( INPUTMUX );
+
+        /* nINT is active low, interrupt on its falling edge. */
+        CLOCK_EnableClock( kCLOCK_Pint );
+        PINT->ISEL &= ~( 1UL << linkmonitorPININT_INDEX );
+        PINT->CIENR = 1UL << linkmonitorPININT_INDEX;
+        PINT->SIENF = 1UL << linkmonitorPININT_INDEX;
+        PINT->IST = 1UL << linkmonitorPININT_INDEX;
+
+        /* A link coming up also wakes the MCU from deep sleep, see low_power.c. */
+        NVIC_SetPriority( linkmonitorPININT_IRQ, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1 );
+        EnableDeepSleepIRQ( linkmonitorPININT_IRQ );
+    }
+
+#endif /* if ( linkmonitorUSE_PHY_INT == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Clears the PHY interrupt and reads the link state.
+ */
+static status_t prvReadLink( bool * pxLinkUp )
+{
+    uint32_t ulSource = 0;
+    status_t xStatus;
+
+    /* The network interface reads the PHY from its own task, keep the SMI transfers from interleaving. */
+    vTaskSuspendAll();
+    xStatus = PHY_LAN8720A_GetInterruptStatus( &xPhyHandle, &ulSource );
+
+    if( xStatus == kStatus_Success )
+    {
+        xStatus = PHY_LAN8720A_GetLinkStatus( &xPhyHandle, pxLinkUp );
+    }
+
+    ( void ) xTaskResumeAll();
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLinkMonitorTask( void * pvParameters )
+{
+    bool xLinkUp = true;
+    bool xWasUp = true;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        if( prvReadLink( &xLinkUp ) == kStatus_Success )
+        {
+            if( xLinkUp != xWasUp )
+            {
+                PRINTF( "Ethernet link %s.\r\n", xLinkUp ? "up" : "down" );
+            }
+
+            if( ( xLinkUp == false ) && ( xWasUp == true ) )
+            {
+                FreeRTOS_NetworkDown();
+            }
+            else if( ( xLinkUp == true ) && ( FreeRTOS_IsNetworkUp() == pdFALSE ) )
+            {
+                /* A down event while the network is down makes the IP task initialise the interface now. */
+                FreeRTOS_NetworkDown();
+            }
+            else
+            {
+                /* No change to report. */
+            }
+
+            xWasUp = xLinkUp;
+            xLinkState = xLinkUp;
+        }
+
+        /* Share the wake up of the watchdog supervisor. */
+        ( void ) ulTaskNotifyTake( pdTRUE, Watchdog_AlignWakeup( pdMS_TO_TICKS( linkmonitorPOLL_PERIOD_MS ) ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t LinkMonitor_Init( void )
+{
+    BaseType_t result;
+    status_t xStatus;
+
+    xMdioHandle.resource.csrClock_Hz = CLOCK_GetCoreSysClkFreq();
+
+    result = xTaskCreate( prvLinkMonitorTask,
+                          "LinkMonitor_task",
+                          linkmonitorTASK_STACK_SIZE,
+                          NULL,
+                          linkmonitorTASK_PRIORITY | portPRIVILEGE_BIT,
+                          &xMonitorTask );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create link monitor task.\r\n" );
+    }
+    else
+    {
+        #if ( linkmonitorUSE_PHY_INT == 1 )
+            prvPinIntInit();
+        #endif
+
+        vTaskSuspendAll();
+        xStatus = PHY_LAN8720A_EnableInterrupts( &xPhyHandle,
+                                                 kPHY_LAN8720A_LinkDownInt | kPHY_LAN8720A_AutoNegCompleteInt );
+        ( void ) xTaskResumeAll();
+
+        if( xStatus != kStatus_Success )
+        {
+            PRINTF( "Failed to enable the PHY link interrupt: %d.\r\n", ( int ) xStatus );
+        }
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t LinkMonitor_IsLinkUp( void )
+{
+    return ( xLinkState == true ) ? pdTRUE : pdFALSE;
+}
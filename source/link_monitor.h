@@ -0,0 +1,54 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file link_monitor.h
+ * @brief Ethernet link monitor delivering PHY link changes to FreeRTOS+TCP.
+ */
+
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Creates the link monitor task and enables the PHY link change interrupt.
+ * With linkmonitorPHY_INT_GPIO_PORT and linkmonitorPHY_INT_GPIO_PIN defined, the PHY nINT pin wakes
+ * the task, which reads the PHY only then. Otherwise the task reads the PHY every
+ * linkmonitorPOLL_PERIOD_MS. Must be called once the network interface has initialised the PHY.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t LinkMonitor_Init( void );
+
+/**
+ * @brief Returns the link state of the last PHY read, without accessing the PHY.
+ * Safe to call with interrupts disabled, for example from the tickless idle hook.
+ *
+ * @return pdTRUE if the link was up, or if the PHY has not been read yet.
+ */
+BaseType_t LinkMonitor_IsLinkUp( void );
+
+#endif /* LINK_MONITOR_H */
@@ -0,0 +1,151 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file link_power.c
+ * @brief Ethernet link power management.
+ * The LAN8720A is put into energy detect power-down, so it draws little power while the cable is
+ * unplugged and wakes up by itself on link energy. While the link is up but the kernel is about to
+ * sleep for long enough, the MAC is put into power down mode and woken by a magic packet or by any
+ * unicast frame for our MAC address, which raises the ENET interrupt and ends the sleep.
+ */
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_debug_console.h"
+
+#include "board.h"
+#include "fsl_enet.h"
+#include "fsl_enet_mdio.h"
+#include "fsl_phylan8720a.h"
+
+#include "link_power.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Shortest expected sleep for which the MAC is suspended.
+ * Frames other than the wake up frame are lost while suspended, so short sleeps keep the MAC running.
+ * Must be shorter than watchdogCHECK_PERIOD_MS, which bounds how long the kernel sleeps.
+ */
+#ifndef linkpowerSUSPEND_MIN_IDLE_MS
+    #define linkpowerSUSPEND_MIN_IDLE_MS    ( 500U )
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief MDIO access to the PHY, shared with the network interface through the same ENET SMI registers.
+ */
+static mdio_handle_t xMdioHandle = { .resource.base = ENET, .ops = &lpc_enet_ops };
+
+/**
+ * @brief The PHY, only used for its extended registers, it is initialised by the network interface.
+ */
+static phy_handle_t xPhyHandle =
+{
+    .phyAddr    = BOARD_ENET0_PHY_ADDRESS,
+    .mdioHandle = &xMdioHandle,
+    .ops        = &phylan8720a_ops
+};
+
+/**
+ * @brief True once LinkPower_Init() has run, the MAC is never suspended before.
+ */
+static bool xInitialised = false;
+
+/**
+ * @brief True while the MAC is in power down mode.
+ */
+static volatile bool xSuspended = false;
+
+/*-----------------------------------------------------------*/
+
+BaseType_t LinkPower_Init( void )
+{
+    status_t xStatus;
+
+    xMdioHandle.resource.csrClock_Hz = CLOCK_GetCoreSysClkFreq();
+
+    /* The network interface polls the PHY from the IP task, keep the SMI transfers from interleaving. */
+    vTaskSuspendAll();
+    xStatus = PHY_LAN8720A_EnableEnergyDetectPowerDown( &xPhyHandle, true );
+    ( void ) xTaskResumeAll();
+
+    if( xStatus != kStatus_Success )
+    {
+        PRINTF( "Failed to enable the PHY energy detect power-down: %d.\r\n", ( int ) xStatus );
+    }
+
+    /* The PMT interrupt ends the tickless sleep when a wake up frame arrives. */
+    ENET_EnableInterrupts( ENET, kENET_MacPmt );
+    xInitialised = true;
+
+    return ( xStatus == kStatus_Success ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void LinkPower_Suspend( void )
+{
+    if( ( xInitialised == true ) && ( xSuspended == false ) )
+    {
+        ENET_EnterPowerDownWakeup( ENET, NULL, kENET_WakeupMagicPacket | kENET_WakeupGlobalUnicast );
+        xSuspended = true;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void LinkPower_Resume( void )
+{
+    if( xSuspended == true )
+    {
+        ENET_ExitPowerDown( ENET );
+        xSuspended = false;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void LinkPower_PreSleepProcessing( uint32_t ulExpectedIdleTime )
+{
+    if( ulExpectedIdleTime >= pdMS_TO_TICKS( linkpowerSUSPEND_MIN_IDLE_MS ) )
+    {
+        LinkPower_Suspend();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void LinkPower_PostSleepProcessing( uint32_t ulExpectedIdleTime )
+{
+    ( void ) ulExpectedIdleTime;
+
+    LinkPower_Resume();
+}
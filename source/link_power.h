@@ -0,0 +1,74 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file link_power.h
+ * @brief Ethernet link power management: PHY energy detect power-down and MAC power down with wake-on-LAN.
+ */
+
+#ifndef LINK_POWER_H
+#define LINK_POWER_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Enables the PHY energy detect power-down and the MAC wake up interrupt.
+ * The PHY then powers down on its own while no cable or link partner is present. Must be called once
+ * the network interface has initialised the ENET and the PHY.
+ *
+ * @return pdTRUE if the PHY accepted the power-down mode.
+ */
+BaseType_t LinkPower_Init( void );
+
+/**
+ * @brief Puts the MAC into power down mode.
+ * Receiving stops until a magic packet or a unicast frame for our MAC address arrives, the frame which
+ * wakes the MAC is dropped and has to be retransmitted by the peer.
+ */
+void LinkPower_Suspend( void );
+
+/**
+ * @brief Takes the MAC out of power down mode, does nothing if it is not suspended.
+ */
+void LinkPower_Resume( void );
+
+/**
+ * @brief Tickless idle hook called by configPRE_SLEEP_PROCESSING(), with interrupts disabled.
+ * Suspends the MAC when the kernel expects to sleep for at least linkpowerSUSPEND_MIN_IDLE_MS.
+ *
+ * @param[in] ulExpectedIdleTime Expected idle time in ticks.
+ */
+void LinkPower_PreSleepProcessing( uint32_t ulExpectedIdleTime );
+
+/**
+ * @brief Tickless idle hook called by configPOST_SLEEP_PROCESSING(), resumes the MAC after any wake up.
+ *
+ * @param[in] ulExpectedIdleTime Expected idle time in ticks.
+ */
+void LinkPower_PostSleepProcessing( uint32_t ulExpectedIdleTime );
+
+#endif /* LINK_POWER_H */
@@ -0,0 +1,263 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file log_level.c
+ * @brief Register of the runtime log levels and the MQTT topic setting them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "core_mqtt_agent.h"
+#include "connection_manager.h"
+
+#include "log_level.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Topic the levels are set on, formatted with the thing name.
+ */
+#define loglevelTOPIC_FORMAT      "$aws/things/%.*s/log/level"
+
+/**
+ * @brief Size of the buffer holding the topic filter.
+ */
+#define loglevelTOPIC_MAX_SIZE    ( 160U )
+
+/*-----------------------------------------------------------*/
+
+uint8_t ucLogLevels[ LOG_MODULE_COUNT ] =
+{
+    loglevelDEFAULT,
+    loglevelDEFAULT,
+    loglevelDEFAULT
+};
+
+/**
+ * @brief Names of the modules in the MQTT payload, indexed by LogModule_t.
+ */
+static const char * const pcModuleNames[ LOG_MODULE_COUNT ] =
+{
+    "main",
+    "ota",
+    "ota_pal"
+};
+
+/**
+ * @brief Names of the levels in the MQTT payload, indexed by level.
+ */
+static const char * const pcLevelNames[ LOG_DEBUG + 1 ] =
+{
+    "none",
+    "error",
+    "warn",
+    "info",
+    "debug"
+};
+
+/**
+ * @brief Topic filter, registered with the agent and so kept for its lifetime.
+ */
+static char cTopicFilter[ loglevelTOPIC_MAX_SIZE ];
+
+/**
+ * @brief Subscription to the topic filter, sent again when the session is not resumed.
+ */
+static ConnectionSubscription_t xSubscription;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Looks up a name in a table of names.
+ *
+ * @return The index of the name, or -1 if it is not in the table.
+ */
+static int32_t prvFindName( const char * const * ppcNames,
+                            size_t xCount,
+                            const char * pcName,
+                            size_t xNameLength )
+{
+    size_t i;
+
+    for( i = 0; i < xCount; i++ )
+    {
+        if( ( strlen( ppcNames[ i ] ) == xNameLength ) && ( strncmp( ppcNames[ i ], pcName, xNameLength ) == 0 ) )
+        {
+            return ( int32_t ) i;
+        }
+    }
+
+    return -1;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Applies one "<module>=<level>" entry of a list.
+ *
+ * @return pdTRUE if the entry is applied.
+ */
+static BaseType_t prvApplyEntry( const char * pcEntry,
+                                 size_t xEntryLength )
+{
+    const char * pcEqual = memchr( pcEntry, '=', xEntryLength );
+    const char * pcLevel;
+    size_t xLevelLength;
+    int32_t lLevel = -1;
+
+    if( pcEqual != NULL )
+    {
+        pcLevel = pcEqual + 1;
+        xLevelLength = xEntryLength - ( size_t ) ( pcLevel - pcEntry );
+
+        if( ( xLevelLength == 1U ) && ( *pcLevel >= '0' ) && ( *pcLevel <= ( '0' + LOG_DEBUG ) ) )
+        {
+            lLevel = *pcLevel - '0';
+        }
+        else
+        {
+            lLevel = prvFindName( pcLevelNames, LOG_DEBUG + 1, pcLevel, xLevelLength );
+        }
+    }
+
+    if( ( lLevel < 0 ) ||
+        ( LogLevel_Set( pcEntry, ( size_t ) ( pcEqual - pcEntry ), ( uint8_t ) lLevel ) != pdTRUE ) )
+    {
+        PRINTF( "Ignored log level setting %.*s.\r\n", ( int ) xEntryLength, pcEntry );
+
+        return pdFALSE;
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogLevelCallback( void * pCallbackContext,
+                                 MQTTPublishInfo_t * pPublishInfo )
+{
+    ( void ) pCallbackContext;
+
+    ( void ) LogLevel_Apply( ( const char * ) pPublishInfo->pPayload, pPublishInfo->payloadLength );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t LogLevel_Set( const char * pcModule,
+                         size_t xModuleLength,
+                         uint8_t ucLevel )
+{
+    int32_t lModule;
+    size_t i;
+
+    if( ucLevel > LOG_DEBUG )
+    {
+        return pdFALSE;
+    }
+
+    if( ( xModuleLength == 1U ) && ( pcModule[ 0 ] == '*' ) )
+    {
+        for( i = 0; i < LOG_MODULE_COUNT; i++ )
+        {
+            ucLogLevels[ i ] = ucLevel;
+        }
+
+        return pdTRUE;
+    }
+
+    lModule = prvFindName( pcModuleNames, LOG_MODULE_COUNT, pcModule, xModuleLength );
+
+    if( lModule < 0 )
+    {
+        return pdFALSE;
+    }
+
+    ucLogLevels[ lModule ] = ucLevel;
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t LogLevel_Apply( const char * pcList,
+                           size_t xListLength )
+{
+    const char * pcComma;
+    size_t xEntryLength;
+    BaseType_t xResult = pdTRUE;
+
+    while( xListLength > 0U )
+    {
+        pcComma = memchr( pcList, ',', xListLength );
+        xEntryLength = ( pcComma != NULL ) ? ( size_t ) ( pcComma - pcList ) : xListLength;
+
+        if( ( xEntryLength > 0U ) && ( prvApplyEntry( pcList, xEntryLength ) != pdTRUE ) )
+        {
+            xResult = pdFALSE;
+        }
+
+        xEntryLength = ( pcComma != NULL ) ? ( xEntryLength + 1U ) : xEntryLength;
+        pcList += xEntryLength;
+        xListLength -= xEntryLength;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void LogLevel_Print( void )
+{
+    size_t i;
+
+    for( i = 0; i < LOG_MODULE_COUNT; i++ )
+    {
+        PRINTF( "%s=%s\r\n", pcModuleNames[ i ], pcLevelNames[ ucLogLevels[ i ] ] );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t LogLevel_Init( const char * pcThingName,
+                          uint32_t ulThingNameLength )
+{
+    int lLength;
+
+    lLength = snprintf( cTopicFilter, sizeof( cTopicFilter ), loglevelTOPIC_FORMAT,
+                        ( int ) ulThingNameLength, pcThingName );
+
+    if( ( lLength <= 0 ) || ( ( size_t ) lLength >= sizeof( cTopicFilter ) ) )
+    {
+        return pdFALSE;
+    }
+
+    return ConnectionManager_Subscribe( &xSubscription, cTopicFilter, ( uint16_t ) lLength, MQTTQoS1,
+                                        prvLogLevelCallback, NULL, NULL );
+}
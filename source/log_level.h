@@ -0,0 +1,135 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file log_level.h
+ * @brief Runtime log levels of the application modules, settable over MQTT.
+ */
+
+#ifndef LOG_LEVEL_H
+#define LOG_LEVEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "fsl_debug_console.h"
+#include "logging_levels.h"
+
+/**
+ * @brief Highest level compiled in, the messages above it are removed by the compiler.
+ */
+#ifndef loglevelCOMPILE_MAX
+    #define loglevelCOMPILE_MAX    LOG_DEBUG
+#endif
+
+/**
+ * @brief Level of all the modules at boot.
+ */
+#ifndef loglevelDEFAULT
+    #define loglevelDEFAULT    LOG_INFO
+#endif
+
+/**
+ * @brief Application modules with a runtime log level.
+ */
+typedef enum LogModule
+{
+    LOG_MODULE_MAIN = 0, /**< Demo tasks and network events, "main". */
+    LOG_MODULE_OTA,      /**< OTA agent glue in ota_update.c, "ota". */
+    LOG_MODULE_OTA_PAL,  /**< OTA flash and image handling in ota_pal.c, "ota_pal". */
+    LOG_MODULE_COUNT
+} LogModule_t;
+
+/**
+ * @brief Current level of each module, one of LOG_NONE to LOG_DEBUG.
+ */
+extern uint8_t ucLogLevels[ LOG_MODULE_COUNT ];
+
+/**
+ * @brief Prints the message if the level is enabled for the module.
+ * The arguments of the message are only evaluated when the message is printed, a disabled level costs
+ * a load and a compare, and nothing above loglevelCOMPILE_MAX.
+ *
+ * @param[in] module The LogModule_t of the caller.
+ * @param[in] level The level of the message, LOG_ERROR to LOG_DEBUG.
+ * @param[in] message The parenthesized PRINTF arguments, e.g. ( "Value %d\r\n", x ).
+ */
+#define LogModule( module, level, message )                                                         \
+    do                                                                                              \
+    {                                                                                               \
+        if( ( ( level ) <= loglevelCOMPILE_MAX ) && ( ( level ) <= ucLogLevels[ ( module ) ] ) )    \
+        {                                                                                           \
+            PRINTF message;                                                                         \
+        }                                                                                           \
+    } while( 0 )
+
+/**
+ * @brief Sets the level of a module.
+ *
+ * @param[in] pcModule Name of the module, or "*" for all the modules.
+ * @param[in] xModuleLength Length of the name.
+ * @param[in] ucLevel The new level, LOG_NONE to LOG_DEBUG.
+ *
+ * @return pdTRUE if the module exists and the level is valid.
+ */
+BaseType_t LogLevel_Set( const char * pcModule,
+                         size_t xModuleLength,
+                         uint8_t ucLevel );
+
+/**
+ * @brief Applies a list of "<module>=<level>" entries separated by commas, in the format of the log
+ * level topic below. The entries which are not valid are printed and skipped.
+ *
+ * @param[in] pcList The list, not NUL terminated.
+ * @param[in] xListLength Length of the list.
+ *
+ * @return pdTRUE if every entry is applied.
+ */
+BaseType_t LogLevel_Apply( const char * pcList,
+                           size_t xListLength );
+
+/**
+ * @brief Prints the current level of each module on the debug console as "<module>=<level name>".
+ */
+void LogLevel_Print( void );
+
+/**
+ * @brief Subscribes to the log level topic of the thing, "$aws/things/<thing name>/log/level".
+ * Each publish on the topic is a list of "<module>=<level>" separated by commas, where the level is a
+ * digit or one of "none", "error", "warn", "info" and "debug", e.g. "ota=debug,ota_pal=4".
+ * The subscription is sent again when the broker does not resume the session.
+ * Must be called once the MQTT agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if the subscribe is queued.
+ */
+BaseType_t LogLevel_Init( const char * pcThingName,
+                          uint32_t ulThingNameLength );
+
+#endif /* LOG_LEVEL_H */
@@ -0,0 +1,428 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file low_power.c
+ * @brief Tickless idle for the LPC54018.
+ * The idle task normally sleeps with WFI while the SysTick is reprogrammed to fire when the next
+ * task is due, which is limited by the 24 bit SysTick to about 90 ms at 180 MHz. Everything keeps
+ * running, so the ENET DMA still receives frames and a suspended flash erase/program is still
+ * resumed by its owner on time.
+ *
+ * With lowpowerUSE_DEEP_SLEEP, longer idle periods enter deep sleep instead, timed by the 1 kHz RTC
+ * wake up timer, which needs the 32.768 kHz crystal. Deep sleep stops the PLL, the SPIFI and the ENET
+ * clocks, so it is only entered while no flash update is pending or suspended, the Ethernet link is
+ * down, the transmit DMA is idle and no GPIO capture runs. The main clock is moved to the FRO 12 MHz
+ * before, and the clocks of the current clock_scaling.c level are set up again after the wake up.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_clock.h"
+#include "fsl_power.h"
+
+#include "mflash_drv.h"
+#include "link_monitor.h"
+#include "gpio_capture.h"
+#include "clock_scaling.h"
+#include "monotonic_clock.h"
+
+#include "low_power.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Use the RTC timed deep sleep for long idle periods, requires the RTC crystal to be fitted.
+ */
+#ifndef lowpowerUSE_DEEP_SLEEP
+    #define lowpowerUSE_DEEP_SLEEP    ( 0 )
+#endif
+
+/**
+ * @brief Shortest expected idle time for which deep sleep is entered.
+ * Relocking the PLL and restoring the clocks takes about a millisecond, shorter idle periods sleep on the SysTick.
+ */
+#ifndef lowpowerDEEP_SLEEP_MIN_IDLE_MS
+    #define lowpowerDEEP_SLEEP_MIN_IDLE_MS    ( 50U )
+#endif
+
+/**
+ * @brief Blocks kept powered during deep sleep, as the PDRUNCFG0 bits of POWER_EnterDeepSleep().
+ * All RAM banks keep their content and the watchdog oscillator keeps the WWDT counting.
+ */
+#ifndef lowpowerDEEP_SLEEP_KEEP_POWERED
+    #define lowpowerDEEP_SLEEP_KEEP_POWERED                                            \
+    ( SYSCON_PDRUNCFG_PDEN_SRAMX_MASK | SYSCON_PDRUNCFG_PDEN_SRAM0_MASK |              \
+      SYSCON_PDRUNCFG_PDEN_SRAM1_2_3_MASK | SYSCON_PDRUNCFG_PDEN_USB_RAM_MASK |        \
+      SYSCON_PDRUNCFG_PDEN_WDT_OSC_MASK )
+#endif
+
+/**
+ * @brief SysTick input clock, as in the port.
+ */
+#ifndef configSYSTICK_CLOCK_HZ
+    #define configSYSTICK_CLOCK_HZ    configCPU_CLOCK_HZ
+#endif
+
+/**
+ * @brief SysTick counts lost while the timer is stopped to be reprogrammed, as in the port.
+ */
+#define lowpowerMISSED_COUNTS_FACTOR    ( 45UL )
+
+/**
+ * @brief SysTick bits written while the timer is stopped, the ENABLE bit restarts it.
+ */
+#define lowpowerSYSTICK_STOPPED         ( SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk )
+
+/**
+ * @brief Transmit DMA states of DMA_DBG_STAT in which no frame is being read from RAM.
+ */
+#define lowpowerENET_TPS_STOPPED        ( 0U )
+#define lowpowerENET_TPS_SUSPENDED      ( 6U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief SysTick counts per tick and the longest sleep it can time, set up on each sleep as
+ * SystemCoreClock follows the level of clock_scaling.c.
+ */
+static uint32_t ulTimerCountsForOneTick = 0;
+static uint32_t ulMaximumSuppressedTicks = 0;
+static uint32_t ulStoppedTimerCompensation = 0;
+
+/**
+ * @brief Sleep counters.
+ */
+static LowPowerStats_t xStats;
+
+#if ( lowpowerUSE_DEEP_SLEEP == 1 )
+
+/**
+ * @brief Milliseconds slept in deep sleep not yet accounted as a whole tick.
+ */
+    static uint32_t ulDeepSleepRemainderMs = 0;
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void prvSysTickSleep( TickType_t xExpectedIdleTime )
+{
+    uint32_t ulReloadValue;
+    uint32_t ulCompleteTickPeriods;
+    uint32_t ulCompletedSysTickDecrements;
+    uint32_t ulSleepStartCycles;
+    uint32_t ulAwakeCycles;
+    uint32_t ulSleptDecrements;
+    TickType_t xModifiableIdleTime;
+
+    if( xExpectedIdleTime > ulMaximumSuppressedTicks )
+    {
+        xExpectedIdleTime = ulMaximumSuppressedTicks;
+    }
+
+    /* Stop the SysTick momentarily, the time it is stopped is accounted for as far as possible. */
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+    ulReloadValue = SysTick->VAL + ( ulTimerCountsForOneTick * ( xExpectedIdleTime - 1UL ) );
+
+    if( ulReloadValue > ulStoppedTimerCompensation )
+    {
+        ulReloadValue -= ulStoppedTimerCompensation;
+    }
+
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    if( eTaskConfirmSleepModeStatus() == eAbortSleep )
+    {
+        /* Restart from whatever is left in the count register to complete this tick period. */
+        SysTick->LOAD = SysTick->VAL;
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        SysTick->LOAD = ulTimerCountsForOneTick - 1UL;
+        xStats.ulAborts++;
+        __enable_irq();
+
+        return;
+    }
+
+    SysTick->LOAD = ulReloadValue;
+    SysTick->VAL = 0UL;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    ulSleepStartCycles = DWT->CYCCNT;
+
+    /* The hook may suspend the Ethernet MAC, or set the time to 0 to skip the sleep. */
+    xModifiableIdleTime = xExpectedIdleTime;
+    configPRE_SLEEP_PROCESSING( xModifiableIdleTime );
+
+    if( xModifiableIdleTime > 0 )
+    {
+        __DSB();
+        __WFI();
+        __ISB();
+    }
+
+    configPOST_SLEEP_PROCESSING( xExpectedIdleTime );
+    xStats.ulSleeps++;
+
+    /* Let the interrupt which ended the sleep run, then stop the SysTick to read how long it was. */
+    __enable_irq();
+    __DSB();
+    __ISB();
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    SysTick->CTRL = lowpowerSYSTICK_STOPPED;
+
+    /* The DWT only counted the cycles the core was awake since the SysTick was started. */
+    ulAwakeCycles = DWT->CYCCNT - ulSleepStartCycles;
+
+    if( ( SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk ) != 0UL )
+    {
+        uint32_t ulCalculatedLoadValue;
+
+        ulSleptDecrements = ( ulReloadValue + 1UL ) + ( ulReloadValue - SysTick->VAL );
+
+        /* The SysTick expired, its interrupt has already stepped one tick. */
+        ulCalculatedLoadValue = ( ulTimerCountsForOneTick - 1UL ) - ( ulReloadValue - SysTick->VAL );
+
+        if( ( ulCalculatedLoadValue < ulStoppedTimerCompensation ) || ( ulCalculatedLoadValue > ulTimerCountsForOneTick ) )
+        {
+            ulCalculatedLoadValue = ulTimerCountsForOneTick - 1UL;
+        }
+
+        SysTick->LOAD = ulCalculatedLoadValue;
+        ulCompleteTickPeriods = xExpectedIdleTime - 1UL;
+    }
+    else
+    {
+        /* Another interrupt ended the sleep, account for the complete ticks and finish the current one. */
+        ulSleptDecrements = ulReloadValue - SysTick->VAL;
+        ulCompletedSysTickDecrements = ( xExpectedIdleTime * ulTimerCountsForOneTick ) - SysTick->VAL;
+        ulCompleteTickPeriods = ulCompletedSysTickDecrements / ulTimerCountsForOneTick;
+        SysTick->LOAD = ( ( ulCompleteTickPeriods + 1UL ) * ulTimerCountsForOneTick ) - ulCompletedSysTickDecrements;
+    }
+
+    SysTick->VAL = 0UL;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    vTaskStepTick( ulCompleteTickPeriods );
+    SysTick->LOAD = ulTimerCountsForOneTick - 1UL;
+
+    ulSleptDecrements *= configCPU_CLOCK_HZ / configSYSTICK_CLOCK_HZ;
+
+    if( ulSleptDecrements > ulAwakeCycles )
+    {
+        MonotonicClock_AddSleptCycles( ulSleptDecrements - ulAwakeCycles );
+    }
+
+    __enable_irq();
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( lowpowerUSE_DEEP_SLEEP == 1 )
+
+    static void prvClearWakeFlag( void )
+    {
+        /* The wake up flag is cleared by writing 1, the alarm is not used. */
+        RTC->CTRL = ( RTC->CTRL & ~RTC_CTRL_ALARM1HZ_MASK ) | RTC_CTRL_WAKE1KHZ_MASK;
+        __DSB();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void RTC_IRQHandler( void )
+    {
+        prvClearWakeFlag();
+    }
+
+/*-----------------------------------------------------------*/
+
+    static bool prvDeepSleepAllowed( TickType_t xExpectedIdleTime )
+    {
+        uint32_t ulTransmitState;
+        bool xAllowed = false;
+
+        if( xExpectedIdleTime < pdMS_TO_TICKS( lowpowerDEEP_SLEEP_MIN_IDLE_MS ) )
+        {
+            /* Not worth relocking the PLL. */
+        }
+        else if( mflash_drv_is_busy() )
+        {
+            /* A suspended erase/program must be resumed before the SPIFI clock stops. */
+            xStats.ulBlockedFlash++;
+        }
+        else if( GpioCapture_IsRunning() == pdTRUE )
+        {
+            /* The SCTimer and the DMA stop, edges would be lost. */
+            xStats.ulBlockedCapture++;
+        }
+        else
+        {
+            ulTransmitState = ( ENET->DMA_DBG_STAT & ENET_DMA_DBG_STAT_TPS0_MASK ) >> ENET_DMA_DBG_STAT_TPS0_SHIFT;
+
+            /* Frames would be lost while the ENET clock is stopped. */
+            if( ( LinkMonitor_IsLinkUp() == pdFALSE ) &&
+                ( ( ulTransmitState == lowpowerENET_TPS_STOPPED ) || ( ulTransmitState == lowpowerENET_TPS_SUSPENDED ) ) )
+            {
+                xAllowed = true;
+            }
+            else
+            {
+                xStats.ulBlockedEnet++;
+            }
+        }
+
+        return xAllowed;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvDeepSleep( TickType_t xExpectedIdleTime )
+    {
+        uint32_t ulSleepMs;
+        uint32_t ulSleptMs;
+        TickType_t xModifiableIdleTime;
+        TickType_t xCompleteTicks;
+
+        /* Wake up one tick early, the clocks are restored during that tick. */
+        ulSleepMs = ( uint32_t ) ( xExpectedIdleTime - 1UL ) * portTICK_PERIOD_MS;
+
+        if( ulSleepMs > RTC_WAKE_VAL_MASK )
+        {
+            ulSleepMs = RTC_WAKE_VAL_MASK;
+        }
+
+        __disable_irq();
+        __DSB();
+        __ISB();
+
+        if( eTaskConfirmSleepModeStatus() == eAbortSleep )
+        {
+            xStats.ulAborts++;
+            __enable_irq();
+
+            return;
+        }
+
+        xModifiableIdleTime = xExpectedIdleTime;
+        configPRE_SLEEP_PROCESSING( xModifiableIdleTime );
+
+        if( xModifiableIdleTime > 0 )
+        {
+            /* The count register keeps what is left of the current tick, it completes after the wake up. */
+            SysTick->CTRL = lowpowerSYSTICK_STOPPED;
+
+            /* Start the wake up timer, it counts down on the 1 kHz clock and raises RTC_IRQn at 0. */
+            prvClearWakeFlag();
+            NVIC_ClearPendingIRQ( RTC_IRQn );
+            RTC->WAKE = ulSleepMs;
+
+            /* The PLL stops in deep sleep, run from the FRO until it is locked again. */
+            CLOCK_AttachClk( kFRO12M_to_MAIN_CLK );
+            POWER_EnterDeepSleep( lowpowerDEEP_SLEEP_KEEP_POWERED );
+            ClockScaling_RestoreAfterDeepSleep();
+
+            /* The timer stopped at 0 if it woke us, otherwise it holds the time left. */
+            ulSleptMs = ulSleepMs - ( RTC->WAKE & RTC_WAKE_VAL_MASK );
+            RTC->CTRL = RTC->CTRL & ~( RTC_CTRL_ALARM1HZ_MASK | RTC_CTRL_WAKE1KHZ_MASK | RTC_CTRL_RTC1KHZ_EN_MASK );
+            RTC->CTRL = ( RTC->CTRL & ~( RTC_CTRL_ALARM1HZ_MASK | RTC_CTRL_WAKE1KHZ_MASK ) ) | RTC_CTRL_RTC1KHZ_EN_MASK;
+
+            MonotonicClock_AddSleptMs( ulSleptMs );
+
+            ulDeepSleepRemainderMs += ulSleptMs;
+            xCompleteTicks = ( TickType_t ) ( ulDeepSleepRemainderMs / portTICK_PERIOD_MS );
+            ulDeepSleepRemainderMs -= ( uint32_t ) xCompleteTicks * portTICK_PERIOD_MS;
+
+            if( xCompleteTicks >= xExpectedIdleTime )
+            {
+                xCompleteTicks = xExpectedIdleTime - 1UL;
+            }
+
+            /* Finish the interrupted tick period, the part of a tick slept is kept in the remainder. */
+            SysTick->CTRL = lowpowerSYSTICK_STOPPED | SysTick_CTRL_ENABLE_Msk;
+            vTaskStepTick( xCompleteTicks );
+            xStats.ulDeepSleeps++;
+        }
+
+        configPOST_SLEEP_PROCESSING( xExpectedIdleTime );
+
+        /* The RTC interrupt, or the one which woke us, runs now. */
+        __enable_irq();
+    }
+
+#endif /* if ( lowpowerUSE_DEEP_SLEEP == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+void LowPower_Init( void )
+{
+    #if ( lowpowerUSE_DEEP_SLEEP == 1 )
+        CLOCK_EnableClock( kCLOCK_Rtc );
+
+        /* Release the RTC from reset with its oscillator on and only the 1 kHz timer running. */
+        RTC->CTRL &= ~RTC_CTRL_SWRESET_MASK;
+        RTC->CTRL = ( RTC->CTRL & ~( RTC_CTRL_RTC_OSC_PD_MASK | RTC_CTRL_ALARM1HZ_MASK ) ) |
+                    RTC_CTRL_RTC_EN_MASK | RTC_CTRL_RTC1KHZ_EN_MASK | RTC_CTRL_WAKE1KHZ_MASK;
+
+        NVIC_SetPriority( RTC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1 );
+        EnableDeepSleepIRQ( RTC_IRQn );
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+void LowPower_SuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+{
+    ulTimerCountsForOneTick = configSYSTICK_CLOCK_HZ / configTICK_RATE_HZ;
+    ulMaximumSuppressedTicks = SysTick_LOAD_RELOAD_Msk / ulTimerCountsForOneTick;
+    ulStoppedTimerCompensation = lowpowerMISSED_COUNTS_FACTOR / ( configCPU_CLOCK_HZ / configSYSTICK_CLOCK_HZ );
+
+    #if ( lowpowerUSE_DEEP_SLEEP == 1 )
+        if( prvDeepSleepAllowed( xExpectedIdleTime ) )
+        {
+            prvDeepSleep( xExpectedIdleTime );
+
+            return;
+        }
+    #endif
+
+    prvSysTickSleep( xExpectedIdleTime );
+}
+
+/*-----------------------------------------------------------*/
+
+void LowPower_GetStats( LowPowerStats_t * pxStats )
+{
+    taskENTER_CRITICAL();
+    ( void ) memcpy( pxStats, &xStats, sizeof( xStats ) );
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,72 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file low_power.h
+ * @brief Tickless idle for the LPC54018: SysTick sleep, or RTC timed deep sleep while nothing needs clocks.
+ */
+
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Prepares the RTC wake up timer used for deep sleep, does nothing when deep sleep is disabled.
+ * Must be called once the clocks are set up and before the scheduler starts.
+ */
+void LowPower_Init( void );
+
+/**
+ * @brief Tickless idle implementation called by portSUPPRESS_TICKS_AND_SLEEP() from the idle task,
+ * with the scheduler suspended.
+ *
+ * @param[in] xExpectedIdleTime Number of ticks until the next task is due to run.
+ */
+void LowPower_SuppressTicksAndSleep( TickType_t xExpectedIdleTime );
+
+/**
+ * @brief Counts of the sleeps taken since boot.
+ */
+typedef struct LowPowerStats
+{
+    uint32_t ulSleeps;         /**< Sleeps on the SysTick. */
+    uint32_t ulDeepSleeps;     /**< Deep sleeps on the RTC wake up timer. */
+    uint32_t ulAborts;         /**< Sleeps abandoned because a task became ready. */
+    uint32_t ulBlockedFlash;   /**< Deep sleeps refused because a flash update was in progress. */
+    uint32_t ulBlockedEnet;    /**< Deep sleeps refused because the Ethernet link or DMA was active. */
+    uint32_t ulBlockedCapture; /**< Deep sleeps refused because the GPIO capture was running. */
+} LowPowerStats_t;
+
+/**
+ * @brief Copies the sleep counters.
+ *
+ * @param[out] pxStats Where the counters are written.
+ */
+void LowPower_GetStats( LowPowerStats_t * pxStats );
+
+#endif /* LOW_POWER_H */
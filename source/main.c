@@ -54,6 +54,8 @@
 #include "board.h"
 
 #include "pin_mux.h"
+#include "mflash_drv.h"
+#include "spifi_boot.h"
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -62,9 +64,12 @@
 #include "FreeRTOS_IP.h"
 #include "FreeRTOS_Sockets.h"
 #include "NetworkInterface.h"
+#include "NetworkBufferManagement.h"
+#include "fsl_enet.h"
 
 #include "core_mqtt.h"
 #include "tls_freertos_pkcs11.h"
+#include "freertos_sockets_wrapper.h"
 
 #include "provision_interface.h"
 
@@ -73,32 +78,61 @@
 
 #include "user/demo-restrictions.h"
 #include "ota_update.h"
+#include "ota_http.h"
 #include "core_mqtt_agent.h"
+#include "watchdog.h"
+#include "retry_utils.h"
+#include "entropy_pool.h"
+#include "connection_manager.h"
+#include "link_power.h"
+#include "link_monitor.h"
+#include "low_power.h"
+#include "clock_scaling.h"
+#include "monotonic_clock.h"
+#include "deferred_log.h"
+#include "deferred_work.h"
+#include "crypto_worker.h"
+#include "dma_copy.h"
+#include "log_level.h"
+#include "task_stats.h"
+#include "heap_monitor.h"
+#include "crash_report.h"
+#include "heap_regions.h"
+#include "latency_probe.h"
+#include "irq_latency.h"
+#include "iperf.h"
+#include "app_module.h"
+#include "net_reactor.h"
+#include "flash_service.h"
+#include "benchmark.h"
+#include "telemetry.h"
+#include "telemetry_qos.h"
+#include "store_forward.h"
+#include "shadow.h"
+#include "dhcp_lease.h"
+#include "arp_refresh.h"
+#include "console_shell.h"
+#include "time_sync.h"
 
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
 
-/**
- * @brief Milliseconds per second macro used to convert ticks to milliseconds.
- */
-#define MILLISECONDS_PER_SECOND    ( 1000U )
-
-/**
- * @brief Milliseconds per FreeRTOS tick macro used to get the current tick in
- * milliseconds for MQTT library.
- *
- */
-#define MILLISECONDS_PER_TICK      ( MILLISECONDS_PER_SECOND / configTICK_RATE_HZ )
-
 
 /**
  * @brief MQTT incoming buffer size.
  * This is the buffer size to hold an incoming packet from MQTT connection. The
  * buffer size should be set to maximum expected size as required by all MQTT applications including OTA.
+ * OTA data blocks are 4KB ( otaconfigLOG2_FILE_BLOCK_SIZE ), with the topic and CBOR framing on top.
+ * With MQTT_AGENT_STREAM_RECEIVE, the OTA job documents and data blocks are streamed by the agent
+ * into the OTA event buffers, and the buffer only holds their fixed header and topic, so it is sized
+ * for the shadow documents and the other small publishes instead.
  */
-
-#define MQTT_INCOMING_BUFFER_SIZE    ( 2048 )
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+    #define MQTT_INCOMING_BUFFER_SIZE    ( 2048 )
+#else
+    #define MQTT_INCOMING_BUFFER_SIZE    ( 4096 + 512 )
+#endif
 
 /**
  * @brief ROOT CA used for mutual authentication of TLS connection with AWS IoT MQTT broker.
@@ -128,12 +162,154 @@
     "rqXRfboQnoZsG4q5WTP468SQvvG5\n"                                     \
     "-----END CERTIFICATE-----\n"
 
+/**
+ * @brief Set to 1 to only offer ECDHE-ECDSA-AES128-GCM-SHA256 on secp256r1 to the MQTT broker.
+ * This avoids the RSA verification of the server certificate chain in the handshake, but needs
+ * an ECC device key and Amazon Root CA 3 appended to democonfigROOT_CA_PEM. The OTA file servers
+ * are still offered all the suites.
+ */
+#define democonfigTLS_ECC_ONLY                  ( 0 )
+
+/**
+ * @brief Set to 1 to authenticate to the MQTT broker with the TLS pre-shared key provisioned with
+ * the --psk option of tools/provision.py, for brokers on a plant network. The handshake then
+ * neither parses nor verifies certificates nor signs. Needs mbedtlsconfigTLS_PSK, or
+ * wolfsslconfigTLS_PSK with tlsconfigUSE_WOLFSSL. The OTA file servers are still authenticated
+ * with certificates.
+ */
+#define democonfigTLS_PSK                       ( 0 )
+
+#if ( democonfigTLS_PSK == 1 ) && ( tlsconfigUSE_WOLFSSL == 0 ) && ( mbedtlsconfigTLS_PSK == 0 )
+    #error "democonfigTLS_PSK requires mbedtlsconfigTLS_PSK in aws_mbedtls_config.h."
+#endif
+
+#if ( democonfigTLS_PSK == 1 ) && ( tlsconfigUSE_WOLFSSL == 1 ) && defined( NO_PSK )
+    #error "democonfigTLS_PSK requires wolfsslconfigTLS_PSK in user_settings.h."
+#endif
+
+/**
+ * @brief Interval at which the hello world task publishes the MQTT agent statistics.
+ * Set to 0 to disable the metrics publish. AWS IoT Core rejects publishes to reserved
+ * $aws topics it does not define, so change the topic format when enabling it there.
+ */
+#define democonfigAGENT_METRICS_INTERVAL_MS     ( 0U )
+
+/**
+ * @brief Format of the topic used to publish the MQTT agent statistics, the argument is the thing name.
+ */
+#define democonfigAGENT_METRICS_TOPIC_FORMAT    "$aws/things/%.*s/metrics"
+
+/**
+ * @brief Set to 1 to publish the boot phase timestamps once per boot, after the first MQTT connection.
+ */
+#define democonfigBOOT_TIMING_PUBLISH          ( 1 )
+
+/**
+ * @brief Format of the topic used to publish the boot phase timestamps, the argument is the thing name.
+ */
+#define democonfigBOOT_TIMING_TOPIC_FORMAT     "device/%.*s/boot"
+
+/**
+ * @brief MQTT keep alive interval. The agent only sends a PINGREQ once nothing else was sent for this
+ * long, and TCP keep alive is disabled, so it is the only keep alive traffic of an idle connection.
+ */
+#define democonfigMQTT_KEEP_ALIVE_SECONDS      ( 60U )
+
+/**
+ * @brief Maximum TLS fragment length requested from the servers, MBEDTLS_SSL_MAX_FRAG_LEN_NONE to not negotiate.
+ */
+#define democonfigTLS_MAX_FRAGMENT_LENGTH      MBEDTLS_SSL_MAX_FRAG_LEN_NONE
+
+/**
+ * @brief Timeout for a transport receive call to return when no data is available.
+ * The MQTT agent reads only when data is pending in event driven mode, so the timeout only bounds the wait
+ * for the rest of a partially received packet. In polling mode it bounds how fast the agent can react to
+ * queued operations, so it should not exceed the agent minimum polling interval by much.
+ */
+#define democonfigTRANSPORT_RECV_TIMEOUT_MS    ( 100U )
+
+/**
+ * @brief Set to 1 to send the hello world counter as CBOR samples batched by telemetry.c on
+ * "device/<thing name>/telemetry" instead of a text publish on "Test/Hello" every 5 s.
+ */
+#define democonfigTELEMETRY_CBOR               ( 0 )
+
+/**
+ * @brief Set to 1 to keep the text publishes made while the broker is unreachable in the store and
+ * forward ring of store_forward.c, which sends them once the connection is back. 0 hands them to the
+ * MQTT agent, which blocks the hello world task while its queue is full.
+ */
+#define democonfigSTORE_AND_FORWARD            ( 1 )
+
+/**
+ * @brief Set to 1 to report the hello world counter in the device shadow of the thing, and take the
+ * period of the hello world publishes from its "hello_interval_ms" desired property. The broker policy
+ * must allow the shadow topics of the thing.
+ */
+#define democonfigDEVICE_SHADOW                ( 0 )
+
+/**
+ * @brief Set to 1 to download the OTA jobs and images over a second MQTT connection served by its own
+ * MQTT agent task, so that the telemetry publishes do not queue behind the image blocks. The connection
+ * takes another TLS session, MQTT receive buffer and agent task, and the broker policy must allow the
+ * thing name followed by democonfigOTA_CLIENT_ID_SUFFIX as client identifier. Needs
+ * MQTT_AGENT_MAX_INSTANCES of 2.
+ */
+#define democonfigOTA_DEDICATED_CONNECTION     ( 0 )
+
+/**
+ * @brief Appended to the thing name to form the client identifier of the OTA connection.
+ */
+#define democonfigOTA_CLIENT_ID_SUFFIX         "-ota"
+
+/**
+ * @brief Set to 1 to run the command shell of console_shell.c on the debug console, which prints the
+ * runtime statistics and changes the log levels and the statistics intervals.
+ */
+#define democonfigCONSOLE_SHELL                ( 1 )
+
+#if ( democonfigOTA_DEDICATED_CONNECTION == 1 ) && ( MQTT_AGENT_MAX_INSTANCES < 2 )
+    #error "democonfigOTA_DEDICATED_CONNECTION requires MQTT_AGENT_MAX_INSTANCES of 2."
+#endif
+
+/* The ENET driver receives a frame into a single buffer of ENET_FRAME_MAX_FRAMELEN bytes,
+ * a larger MTU would have full size frames dropped by the MAC. */
+#if ( ( ipconfigNETWORK_MTU + ipSIZE_OF_ETH_HEADER + 4 ) > ENET_FRAME_MAX_FRAMELEN )
+    #error "ipconfigNETWORK_MTU does not fit the ENET receive buffers."
+#endif
+
+/* Each received frame is copied to a network buffer, keep enough of them for a full
+ * receive ring in flight plus as many for transmission. */
+#if ( ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS < ( 2 * ENET_RXBUFFSTORE_NUM ) )
+    #error "ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS is too small for the ENET receive ring."
+#endif
+
+/* The server may send a whole receive window back to back. The segments of a window larger than the
+ * network buffers left over by the ENET receive ring are dropped and stall the download until they
+ * are retransmitted. */
+#if ( socketsconfigBULK_RX_SEGMENTS > ( ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS - ENET_RXBUFFSTORE_NUM ) )
+    #error "socketsconfigBULK_RX_SEGMENTS does not fit the network buffers."
+#endif
+
+/* A negotiated fragment length lets the servers send records of that size, mbed TLS rejects the
+ * records that do not fit its input buffer. */
+#if ( ( democonfigTLS_MAX_FRAGMENT_LENGTH != MBEDTLS_SSL_MAX_FRAG_LEN_NONE ) && \
+    ( ( 256 << democonfigTLS_MAX_FRAGMENT_LENGTH ) > MBEDTLS_SSL_IN_CONTENT_LEN ) )
+    #error "MBEDTLS_SSL_IN_CONTENT_LEN is smaller than democonfigTLS_MAX_FRAGMENT_LENGTH."
+#endif
 
 /**
  * @brief Task priority of the MQTT Hello World task.
  */
 #define hello_task_PRIORITY    ( configMAX_PRIORITIES - 1 )
 
+/**
+ * @brief Stack size of the MQTT Hello World task, in words, see tools/stack_usage.py.
+ */
+#ifndef hello_task_STACK_SIZE
+    #define hello_task_STACK_SIZE    ( 2048 )
+#endif
+
 
 /**
  * @brief MQTT hello world demo task.
@@ -156,6 +332,29 @@ static void hello_task( void * pvParameters );
 
 static uint32_t getTimeStampMs( void );
 
+/**
+ * @brief Defer function of the ENET interrupt, posts ENET_DeferredIRQHandler() to the bottom-half task.
+ *
+ * @param[in] pxBase The ENET peripheral.
+ *
+ * @return true if the handler is posted.
+ */
+static bool prvDeferEnetIRQ( ENET_Type * pxBase );
+
+/**
+ * @brief Receive filter of the ENET driver, keeping democonfigNETWORK_CONTROL_BUFFERS network buffers
+ * for the control traffic. Once no more buffers than the reserve are free, only ARP, ICMP, UDP and the
+ * TCP segments without payload are admitted, so that ACKs, ARP replies and DHCP renewals still get a
+ * buffer while a download fills the others. The dropped TCP data is sent again by the peer.
+ *
+ * @param[in] pucFrame The Ethernet frame.
+ * @param[in] ulLength Length of the frame.
+ *
+ * @return true if the frame is admitted.
+ */
+static bool prvAdmitEnetFrame( const uint8_t * pucFrame,
+                               uint32_t ulLength );
+
 /**
  * @brief Callback executed when an MQTT packet is received by the library.
  * This application defined callback is registered with MQTT library and invoked
@@ -185,6 +384,65 @@ static void eventCallback( MQTTContext_t * pContext,
 static void publishCompleteCallback( struct MQTTOperation * pOperation,
                                      MQTTStatus_t status );
 
+#if ( democonfigAGENT_METRICS_INTERVAL_MS > 0 )
+
+/**
+ * @brief Publishes a JSON summary of the MQTT agent statistics with QoS0 and waits for the publish to be sent.
+ *
+ * @param[in] pcThingName The thing name used in the metrics topic.
+ * @param[in] ulThingNameLength Length of the thing name.
+ */
+    static void prvPublishAgentMetrics( const char * pcThingName,
+                                        uint32_t ulThingNameLength );
+#endif
+
+#if ( democonfigBOOT_TIMING_PUBLISH == 1 )
+
+/**
+ * @brief Publishes the cycle count of each boot phase recorded by the bootloader and the application with QoS0.
+ *
+ * @param[in] pcThingName The thing name used in the boot timing topic.
+ * @param[in] ulThingNameLength Length of the thing name.
+ */
+    static void prvPublishBootTiming( const char * pcThingName,
+                                      uint32_t ulThingNameLength );
+#endif
+
+#if ( democonfigTELEMETRY_CBOR == 1 )
+
+/**
+ * @brief Writes the hello world sample: the counter and the heap levels.
+ *
+ * @param[in] pxEncoder The encoder of the batch.
+ * @param[in] pvContext The counter.
+ */
+    static void prvEncodeHelloSample( TelemetryEncoder_t * pxEncoder,
+                                      void * pvContext );
+#endif
+
+#if ( democonfigOTA_DEDICATED_CONNECTION == 1 )
+
+/**
+ * @brief Connects the dedicated OTA connection and starts its MQTT agent.
+ *
+ * @param[in] pcThingName The thing name, prefix of the client identifier.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return The handle of the OTA agent, NULL to serve OTA from the telemetry connection.
+ */
+    static MQTTAgentHandle_t prvStartOtaConnection( const char * pcThingName,
+                                                    uint32_t ulThingNameLength );
+#endif
+
+/**
+ * @brief Logs the changes of the broker connection state.
+ *
+ * @param[in] xState The new state.
+ * @param[in] bSessionPresent Whether the broker resumed the session.
+ */
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool bSessionPresent );
+
 /**
  * @brief Vendor provided function to initializes the cryptographic module.
  */
@@ -204,11 +462,24 @@ extern void printRegions( void );
  */
 static uint8_t ucBuffer[ MQTT_INCOMING_BUFFER_SIZE ];
 
+#if ( TRC_CFG_RECORDER_BUFFER_ALLOCATION == TRC_RECORDER_BUFFER_ALLOCATION_CUSTOM ) && ( TRC_CFG_FIELD_PROFILE == 0 )
+
+/**
+ * @brief The trace recorder buffer, in the SDRAM of the carrier boards that have one.
+ * The field profile takes its buffer from crash_report.c.
+ */
+    #if ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_SNAPSHOT )
+        static RecorderDataType xTraceBuffer heapregionsSDRAM_BSS;
+    #else
+        static char xTraceBuffer[ ( TRC_CFG_PAGED_EVENT_BUFFER_PAGE_COUNT ) * ( TRC_CFG_PAGED_EVENT_BUFFER_PAGE_SIZE ) ] heapregionsSDRAM_BSS;
+    #endif
+#endif
+
 
-static const uint8_t ucIPAddress[ 4 ] = { 192, 168, 1, 43 };
-static const uint8_t ucNetMask[ 4 ] = { 255, 255, 255, 0 };
-static const uint8_t ucGatewayAddress[ 4 ] = { 192, 168, 1, 1 };
-static const uint8_t ucDNSServerAddress[ 4 ] = { 192, 168, 1, 1 };
+static uint8_t ucIPAddress[ 4 ] = { 192, 168, 1, 43 };
+static uint8_t ucNetMask[ 4 ] = { 255, 255, 255, 0 };
+static uint8_t ucGatewayAddress[ 4 ] = { 192, 168, 1, 1 };
+static uint8_t ucDNSServerAddress[ 4 ] = { 192, 168, 1, 1 };
 static const uint8_t ucMACAddress[ 6 ] = { 0xDE, 0xAD, 0x00, 0xBE, 0xEF, 0x01 };
 
 /**
@@ -224,6 +495,111 @@ static uint32_t ulGlobalEntryTimeMs;
  */
 static SemaphoreHandle_t xPublishCompleteSemaphore;
 
+#if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+
+/**
+ * @brief Storage of the publish complete semaphore and of the hello task.
+ */
+    static StaticSemaphore_t xPublishCompleteSemaphoreBuffer;
+    static StaticTask_t xHelloTaskBuffer;
+    static StackType_t uxHelloTaskStack[ hello_task_STACK_SIZE ];
+#endif
+
+/**
+ * @brief MQTT connect parameters, kept to reconnect with the broker from the MQTT agent.
+ */
+static MQTTConnectInfo_t xMQTTConnectInfo = { 0 };
+
+/**
+ * @brief TLS credentials, kept to reconnect with the broker from the MQTT agent.
+ */
+static NetworkCredentials_t xNetworkCredentials = { 0 };
+
+/**
+ * @brief Broker connection parameters, the endpoint is read from the provisioned data.
+ */
+static ConnectionManagerConfig_t xConnectionConfig =
+{
+    .pHostName          = NULL,
+    .port               = 8883,
+    .pCredentials       = &xNetworkCredentials,
+    .pConnectInfo       = &xMQTTConnectInfo,
+    .handshakeTimeoutMs = 4000,
+    .sendTimeoutMs      = 36000,
+    .recvTimeoutMs      = democonfigTRANSPORT_RECV_TIMEOUT_MS,
+    .connackTimeoutMs   = 100
+};
+
+/**
+ * @brief TLS credentials of the OTA file servers.
+ */
+static NetworkCredentials_t xOtaNetworkCredentials = { 0 };
+
+#if ( democonfigOTA_DEDICATED_CONNECTION == 1 )
+
+/**
+ * @brief MQTT context of the dedicated OTA connection.
+ */
+    static MQTTContext_t xOtaMQTTContext = { 0 };
+
+/**
+ * @brief Receive buffer of the dedicated OTA connection, sized for the image blocks.
+ */
+    static uint8_t ucOtaBuffer[ MQTT_INCOMING_BUFFER_SIZE ];
+
+/**
+ * @brief Client identifier of the OTA connection, AWS IoT Core accepts up to 128 characters.
+ */
+    static char cOtaClientIdentifier[ 128 ];
+
+/**
+ * @brief MQTT connect parameters of the OTA connection.
+ */
+    static MQTTConnectInfo_t xOtaMQTTConnectInfo = { 0 };
+
+/**
+ * @brief TLS credentials of the OTA connection, with the large receive window of the downloads.
+ */
+    static NetworkCredentials_t xOtaMQTTCredentials = { 0 };
+
+/**
+ * @brief Connection parameters of the OTA connection, a copy of those of the broker connection.
+ */
+    static ConnectionManagerConfig_t xOtaConnectionConfig = { 0 };
+#endif
+
+#if ( democonfigTLS_ECC_ONLY == 1 )
+
+/**
+ * @brief Cipher suite and curve offered to the MQTT broker.
+ */
+    static const int xEccCipherSuites[] = { MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0 };
+    static const mbedtls_ecp_group_id xEccCurves[] = { MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE };
+#endif
+
+#if ( democonfigDEVICE_SHADOW == 1 )
+
+/**
+ * @brief Period of the hello world publishes and counter, mirrored in the device shadow.
+ */
+    static int32_t lShadowHelloIntervalMs = 5000;
+    static int32_t lShadowHelloCount = 0;
+
+/**
+ * @brief Properties of the device shadow, Shadow_SetInt() takes their index.
+ */
+    static ShadowProperty_t xShadowProperties[] =
+    {
+        { "hello_interval_ms", SHADOW_TYPE_INT, &lShadowHelloIntervalMs, 0, NULL },
+        { "hello_count",       SHADOW_TYPE_INT, &lShadowHelloCount,      0, NULL }
+    };
+#endif
+
+/**
+ * @brief Broker endpoint read from the provisioned data.
+ */
+static char * pcEndpoint = NULL;
+
 
 /*******************************************************************************
  * Code
@@ -235,29 +611,154 @@ static SemaphoreHandle_t xPublishCompleteSemaphore;
  */
 int main( void )
 {
+    boot_timing_mark( BOOT_PHASE_MAIN );
+
     /* Init board hardware. */
     CLOCK_EnableClock( kCLOCK_InputMux );
 
-    vTraceEnable( TRC_START );
-
     /* attach 12 MHz clock to FLEXCOMM0 (debug console) */
     CLOCK_AttachClk( BOARD_DEBUG_UART_CLK_ATTACH );
 
     BOARD_InitBootPins();
     BOARD_InitBootClocks();
     BOARD_InitDebugConsole();
+
+    #if ( BOARD_SDRAM_ENABLED == 1 )
+        /* The SDRAM timing is derived from the EMC clock, so the clocks must be final. Buffers
+         * are placed in the SDRAM, there is no running without it. */
+        if( HeapRegions_InitSdram() != pdTRUE )
+        {
+            PRINTF( "SDRAM check failed.\r\n" );
+
+            while( 1 )
+            {
+            }
+        }
+    #endif
+
+    #if ( configFRTOS_MEMORY_SCHEME == 5 )
+        /* Before the first allocation, the trace recorder and the drivers may allocate. */
+        ( void ) HeapRegions_Init();
+    #endif
+
+    #if ( TRC_CFG_FIELD_PROFILE == 1 )
+        vTraceSetRecorderDataBuffer( CrashReport_GetTraceBuffer() );
+    #elif ( TRC_CFG_RECORDER_BUFFER_ALLOCATION == TRC_RECORDER_BUFFER_ALLOCATION_CUSTOM )
+        vTraceSetRecorderDataBuffer( &xTraceBuffer );
+    #endif
+
+    #if ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING ) && ( TRC_CFG_STREAM_PORT == TRC_STREAM_PORT_ARM_ITM )
+        #if ( TRC_CFG_ITM_START_AT_BOOT == 1 )
+            /* SWO is one-way, the Tracealyzer recording must be running before the reset. */
+            vTraceEnable( TRC_START );
+        #else
+            /* Recording starts with vTraceEnable( TRC_START ) or a debugger macro. */
+            vTraceEnable( TRC_INIT );
+        #endif
+    #elif ( TRC_CFG_RECORDER_MODE == TRC_RECORDER_MODE_STREAMING )
+        /* Recording starts when Tracealyzer connects over TCP. */
+        vTraceEnable( TRC_INIT );
+    #else
+        vTraceEnable( TRC_START );
+    #endif
+
+    #if ( TRC_CFG_FIELD_PROFILE == 1 )
+        /* Only the objects created within TRC_FIELD_OBJECTS_BEGIN() and TRC_FIELD_OBJECTS_END() are traced. */
+        vTraceSetFilterMask( TRC_FIELD_GROUP_TRACED );
+        vTraceSetFilterGroup( TRC_FIELD_GROUP_FILTERED );
+    #endif
+
     CRYPTO_InitHardware();
+
+    /* Start the microsecond clock at the boot clock, before the first level change. */
+    MonotonicClock_Init();
+
+    /* Drops the core clock while no TLS handshake or OTA download needs the PLL. */
+    ClockScaling_Init();
+
+    #if ( configUSE_TICKLESS_IDLE == 2 )
+        LowPower_Init();
+    #endif
+
+    #if ( irqlatencyENABLED == 1 )
+        /* Sample the interrupt entry latency from the first masking window of the flash driver. */
+        if( IrqLatency_Init() != pdTRUE )
+        {
+            LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Interrupt latency is not sampled.\r\n" ) );
+        }
+    #endif
+
+    /* Move the large copies and fills with the DMA while the other tasks run. */
+    ( void ) DmaCopy_Init();
+
+    /* Enable quad I/O and the flash write task before anything writes to flash. */
+    mflash_drv_init();
     printRegions();
 
-    /* Provision certificates over UART. */
-    vUartProvision();
+    #if ( configFRTOS_MEMORY_SCHEME == 5 )
+        HeapRegions_Print();
+    #endif
+
+    /* Provision certificates over UART, a provisioned device carries on at once. */
+    vUartProvisionAtBoot();
 
+    /* The last DHCP lease, if any, replaces the static defaults and is confirmed by an INIT-REBOOT. */
+    ( void ) DhcpLease_Init( ucIPAddress, ucNetMask, ucGatewayAddress, ucDNSServerAddress );
+
+    TRC_FIELD_OBJECTS_BEGIN();
     FreeRTOS_IPInit( ucIPAddress, ucNetMask, ucGatewayAddress, ucDNSServerAddress, ucMACAddress );
+    TRC_FIELD_OBJECTS_END();
+
+    Watchdog_Register( WATCHDOG_CLIENT_IP_TASK );
+
+    if( Watchdog_Init() != pdTRUE )
+    {
+        while( 1 )
+        {
+        }
+    }
+
+    /* Keep the UART transmission of the log out of the OTA and MQTT paths. */
+    ( void ) DeferredLog_Init();
+
+    /* Keep the ENET descriptor handling and its callbacks out of the interrupt. */
+    if( DeferredWork_Init() == pdTRUE )
+    {
+        ENET_SetIRQDeferral( prvDeferEnetIRQ );
+    }
+
+    /* Keep network buffers for the control traffic under bulk load. */
+    ENET_SetRxFilter( prvAdmitEnetFrame );
+
+    /* Run the signature verifications and the handshakes below the periodic work. */
+    if( CryptoWorker_Init() != pdTRUE )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Crypto worker task creation failed, crypto runs on its callers.\r\n" ) );
+    }
+
+    /* Offer to remove the credentials while DHCP and the broker connection run. */
+    if( xUartProvisionStartWindow() != pdTRUE )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Provisioning window task creation failed.\r\n" ) );
+    }
+
+    #if ( democonfigCONSOLE_SHELL == 1 )
+        /* Reads the console once the provisioning window is over. */
+        if( ConsoleShell_Init() != pdTRUE )
+        {
+            LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Console shell task creation failed.\r\n" ) );
+        }
+    #endif
 
-    if( xTaskCreate( hello_task, "Hello_task", 2048, NULL, hello_task_PRIORITY | portPRIVILEGE_BIT, NULL ) !=
-        pdPASS )
+    #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+        if( xTaskCreateStatic( hello_task, "Hello_task", hello_task_STACK_SIZE, NULL, hello_task_PRIORITY | portPRIVILEGE_BIT,
+                               uxHelloTaskStack, &xHelloTaskBuffer ) == NULL )
+    #else
+        if( xTaskCreate( hello_task, "Hello_task", hello_task_STACK_SIZE, NULL, hello_task_PRIORITY | portPRIVILEGE_BIT, NULL ) !=
+            pdPASS )
+    #endif
     {
-        PRINTF( "Hello Task creation failed!.\n" );
+        LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Hello Task creation failed!.\n" ) );
 
         while( 1 )
         {
@@ -277,14 +778,10 @@ int main( void )
 
 static uint32_t getTimeStampMs( void )
 {
-    TickType_t xTickCount = 0;
     uint32_t ulTimeMs = 0UL;
 
-    /* Get the current tick count. */
-    xTickCount = xTaskGetTickCount();
-
-    /* Convert the ticks to milliseconds. */
-    ulTimeMs = ( uint32_t ) xTickCount * MILLISECONDS_PER_TICK;
+    /* Read the monotonic clock, the tick count only has the 5 ms resolution of configTICK_RATE_HZ. */
+    ulTimeMs = MonotonicClock_GetMs();
 
     /* Reduce ulGlobalEntryTimeMs from obtained time so as to always return the
      * elapsed time in the application. */
@@ -293,22 +790,69 @@ static uint32_t getTimeStampMs( void )
     return ulTimeMs;
 }
 
+/**
+ * @brief Bottom half of the ENET interrupt.
+ */
+static void prvEnetBottomHalf( void * pvParameter1,
+                               uint32_t ulParameter2 )
+{
+    ( void ) ulParameter2;
+
+    ENET_DeferredIRQHandler( ( ENET_Type * ) pvParameter1 );
+}
+
+static bool prvDeferEnetIRQ( ENET_Type * pxBase )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    BaseType_t xResult;
+
+    xResult = DeferredWork_PostFromISR( prvEnetBottomHalf, pxBase, 0, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+
+    return ( xResult == pdPASS );
+}
+
+static bool prvAdmitEnetFrame( const uint8_t * pucFrame,
+                               uint32_t ulLength )
+{
+    uint16_t usFrameType;
+    uint32_t ulIpHeaderLength, ulIpLength, ulTcpHeaderLength;
+    bool xAdmit = true;
+
+    if( uxGetNumberOfFreeNetworkBuffers() <= democonfigNETWORK_CONTROL_BUFFERS )
+    {
+        usFrameType = ( uint16_t ) ( ( pucFrame[ 12 ] << 8 ) | pucFrame[ 13 ] );
+
+        /* IPv4 TCP, anything else is control traffic. */
+        if( ( usFrameType == 0x0800U ) && ( ulLength >= ( 14U + 20U + 20U ) ) && ( pucFrame[ 23 ] == 6U ) )
+        {
+            ulIpHeaderLength = ( uint32_t ) ( pucFrame[ 14 ] & 0x0FU ) * 4U;
+            ulIpLength = ( ( uint32_t ) pucFrame[ 16 ] << 8 ) | pucFrame[ 17 ];
+
+            if( ( 14U + ulIpHeaderLength + 20U ) <= ulLength )
+            {
+                ulTcpHeaderLength = ( uint32_t ) ( pucFrame[ 14U + ulIpHeaderLength + 12U ] >> 4 ) * 4U;
+
+                /* Segments carrying data are bulk traffic. */
+                xAdmit = ( ulIpLength <= ( ulIpHeaderLength + ulTcpHeaderLength ) );
+            }
+        }
+    }
+
+    return xAdmit;
+}
+
 static void eventCallback( MQTTContext_t * pContext,
                            MQTTPacketInfo_t * pPacketInfo,
                            MQTTDeserializedInfo_t * pDeserializedInfo )
 {
     BaseType_t xResult;
 
+    /* Handles the ACKs and the incoming publishes for the topic filters registered with the agent. */
     xResult = MQTTAgent_ProcessEvent( pContext, pPacketInfo, pDeserializedInfo );
 
-    #if ( OTA_UPDATE_ENABLED == 1 )
-        if( xResult == pdFALSE )
-        {
-            xResult = xOTAProcessMQTTEvent( pContext, pPacketInfo, pDeserializedInfo );
-        }
-    #endif
-
     /* Process any application callback here. */
+    ( void ) xResult;
 }
 
 static void publishCompleteCallback( struct MQTTOperation * pOperation,
@@ -317,34 +861,220 @@ static void publishCompleteCallback( struct MQTTOperation * pOperation,
     xSemaphoreGive( xPublishCompleteSemaphore );
 }
 
+#if ( democonfigAGENT_METRICS_INTERVAL_MS > 0 )
+
+    static void prvPublishAgentMetrics( const char * pcThingName,
+                                        uint32_t ulThingNameLength )
+    {
+        static char cTopic[ 160 ];
+        static char cMetrics[ 512 ];
+        static MQTTAgentStats_t xStats;
+        const MQTTAgentOperationStats_t * pxOpStats;
+        MQTTPublishInfo_t xPublishInfo = { 0 };
+        MQTTOperation_t xPublishOperation = { 0 };
+        size_t xLength;
+        int lWritten;
+        uint32_t ulType;
+
+        MQTTAgent_GetStats( NULL, &xStats );
+
+        lWritten = snprintf( cMetrics, sizeof( cMetrics ), "{\"queue\":%u,\"maxQueue\":%u,\"pending\":%u,\"maxPending\":%u,\"refused\":%lu,\"rxPauses\":%lu,\"ops\":[",
+                             ( unsigned ) xStats.queueDepth, ( unsigned ) xStats.maxQueueDepth,
+                             ( unsigned ) xStats.pendingAcks, ( unsigned ) xStats.maxPendingAcks,
+                             ( unsigned long ) xStats.refused, ( unsigned long ) xStats.receivePauses );
+        xLength = ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+        for( ulType = 0; ( ulType < MQTT_AGENT_STATS_OPERATION_TYPES ) && ( xLength < sizeof( cMetrics ) ); ulType++ )
+        {
+            pxOpStats = &xStats.operations[ ulType ];
+            lWritten = snprintf( &cMetrics[ xLength ], sizeof( cMetrics ) - xLength,
+                                 "%s{\"enq\":%lu,\"ok\":%lu,\"fail\":%lu,\"maxQueueMs\":%lu,\"maxAckMs\":%lu}",
+                                 ( ulType == 0U ) ? "" : ",",
+                                 ( unsigned long ) pxOpStats->enqueued, ( unsigned long ) pxOpStats->completed,
+                                 ( unsigned long ) pxOpStats->failed, ( unsigned long ) pxOpStats->maxQueueTimeMs,
+                                 ( unsigned long ) pxOpStats->maxAckTimeMs );
+            xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+        }
+
+        if( xLength < ( sizeof( cMetrics ) - 2U ) )
+        {
+            cMetrics[ xLength++ ] = ']';
+            cMetrics[ xLength++ ] = '}';
+
+            xPublishInfo.qos = MQTTQoS0;
+            xPublishInfo.pTopicName = cTopic;
+            xPublishInfo.topicNameLength = ( uint16_t ) snprintf( cTopic, sizeof( cTopic ), democonfigAGENT_METRICS_TOPIC_FORMAT,
+                                                                  ( int ) ulThingNameLength, pcThingName );
+            xPublishInfo.pPayload = cMetrics;
+            xPublishInfo.payloadLength = xLength;
+
+            xPublishOperation.type = MQTT_OP_PUBLISH;
+            xPublishOperation.info.pPublishInfo = &xPublishInfo;
+            xPublishOperation.callback = publishCompleteCallback;
+
+            if( MQTTAgent_Enqueue( NULL, &xPublishOperation, portMAX_DELAY ) == pdTRUE )
+            {
+                xSemaphoreTake( xPublishCompleteSemaphore, portMAX_DELAY );
+            }
+        }
+        else
+        {
+            LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "MQTT agent metrics do not fit in the buffer.\r\n" ) );
+        }
+    }
+
+#endif /* if ( democonfigAGENT_METRICS_INTERVAL_MS > 0 ) */
+
+#if ( democonfigBOOT_TIMING_PUBLISH == 1 )
+
+    static void prvPublishBootTiming( const char * pcThingName,
+                                      uint32_t ulThingNameLength )
+    {
+        static char cTopic[ 160 ];
+        static char cTiming[ 160 ];
+        const volatile struct boot_timing * pxTiming = BOOT_TIMING;
+        MQTTPublishInfo_t xPublishInfo = { 0 };
+        int lWritten;
+
+        /* Unset phases are reported as -1. */
+        lWritten = snprintf( cTiming, sizeof( cTiming ),
+                             "{\"clock\":%lu,\"boot\":%ld,\"exec\":%ld,\"main\":%ld,\"net\":%ld,\"tls\":%ld,\"mqtt\":%ld}",
+                             ( unsigned long ) SystemCoreClock,
+                             ( long ) ( int32_t ) pxTiming->cycles[ BOOT_PHASE_BOOTLOADER ],
+                             ( long ) ( int32_t ) pxTiming->cycles[ BOOT_PHASE_APP_EXEC ],
+                             ( long ) ( int32_t ) pxTiming->cycles[ BOOT_PHASE_MAIN ],
+                             ( long ) ( int32_t ) pxTiming->cycles[ BOOT_PHASE_NETWORK_UP ],
+                             ( long ) ( int32_t ) pxTiming->cycles[ BOOT_PHASE_TLS_CONNECTED ],
+                             ( long ) ( int32_t ) pxTiming->cycles[ BOOT_PHASE_MQTT_CONNECTED ] );
+
+        if( ( lWritten > 0 ) && ( ( size_t ) lWritten < sizeof( cTiming ) ) )
+        {
+            xPublishInfo.qos = MQTTQoS0;
+            xPublishInfo.pTopicName = cTopic;
+            xPublishInfo.topicNameLength = ( uint16_t ) snprintf( cTopic, sizeof( cTopic ), democonfigBOOT_TIMING_TOPIC_FORMAT,
+                                                                  ( int ) ulThingNameLength, pcThingName );
+            xPublishInfo.pPayload = cTiming;
+            xPublishInfo.payloadLength = ( size_t ) lWritten;
+
+            if( MQTTAgent_PublishCopy( NULL, &xPublishInfo, NULL, MQTT_AGENT_PRIORITY_BULK, portMAX_DELAY ) == pdTRUE )
+            {
+                LogModule( LOG_MODULE_MAIN, LOG_DEBUG, ( "Queued boot timing.\r\n" ) );
+            }
+        }
+    }
+
+#endif /* if ( democonfigBOOT_TIMING_PUBLISH == 1 ) */
+
+#if ( democonfigTELEMETRY_CBOR == 1 )
+
+    static void prvEncodeHelloSample( TelemetryEncoder_t * pxEncoder,
+                                      void * pvContext )
+    {
+        Telemetry_EncodeMap( pxEncoder, 3 );
+        Telemetry_EncodeText( pxEncoder, "n", 1 );
+        Telemetry_EncodeInt( pxEncoder, *( ( const int32_t * ) pvContext ) );
+        Telemetry_EncodeText( pxEncoder, "free", 4 );
+        Telemetry_EncodeUint( pxEncoder, xPortGetFreeHeapSize() );
+        Telemetry_EncodeText( pxEncoder, "min_free", 8 );
+        Telemetry_EncodeUint( pxEncoder, xPortGetMinimumEverFreeHeapSize() );
+    }
+
+#endif /* if ( democonfigTELEMETRY_CBOR == 1 ) */
+
+#if ( democonfigOTA_DEDICATED_CONNECTION == 1 )
+
+    static MQTTAgentHandle_t prvStartOtaConnection( const char * pcThingName,
+                                                    uint32_t ulThingNameLength )
+    {
+        TransportInterface_t xTransport = { 0 };
+        MQTTFixedBuffer_t xFixedBuffer = { 0 };
+        MQTTAgentHandle_t xAgent = NULL;
+        bool bSessionPresent = false;
+        int lLength;
+
+        lLength = snprintf( cOtaClientIdentifier, sizeof( cOtaClientIdentifier ), "%.*s%s",
+                            ( int ) ulThingNameLength, pcThingName, democonfigOTA_CLIENT_ID_SUFFIX );
+
+        if( ( lLength > 0 ) && ( ( size_t ) lLength < sizeof( cOtaClientIdentifier ) ) )
+        {
+            xOtaMQTTConnectInfo = xMQTTConnectInfo;
+            xOtaMQTTConnectInfo.pClientIdentifier = cOtaClientIdentifier;
+            xOtaMQTTConnectInfo.clientIdentifierLength = ( uint16_t ) lLength;
+
+            xOtaMQTTCredentials = xNetworkCredentials;
+            xOtaMQTTCredentials.socketProfile = SOCKETS_PROFILE_BULK;
+
+            xOtaConnectionConfig = xConnectionConfig;
+            xOtaConnectionConfig.pCredentials = &xOtaMQTTCredentials;
+            xOtaConnectionConfig.pConnectInfo = &xOtaMQTTConnectInfo;
+
+            ConnectionManager_Init( &xOtaConnectionConfig, &xTransport );
+
+            xFixedBuffer.pBuffer = ucOtaBuffer;
+            xFixedBuffer.size = MQTT_INCOMING_BUFFER_SIZE;
+
+            if( ( MQTT_Init( &xOtaMQTTContext, &xTransport, getTimeStampMs, eventCallback, &xFixedBuffer ) == MQTTSuccess ) &&
+                ( ConnectionManager_Start( &xOtaMQTTContext, &bSessionPresent ) == pdTRUE ) )
+            {
+                xAgent = MQTTAgent_GetHandle( &xOtaMQTTContext );
+                LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "OTA connection established as %s.\r\n", cOtaClientIdentifier ) );
+            }
+        }
+
+        if( xAgent == NULL )
+        {
+            LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "OTA shares the telemetry connection.\r\n" ) );
+        }
+
+        return xAgent;
+    }
+
+#endif /* if ( democonfigOTA_DEDICATED_CONNECTION == 1 ) */
+
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool bSessionPresent )
+{
+    if( xState == CONNECTION_STATE_CONNECTED )
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Connected to the broker, session %s.\r\n",
+                                                bSessionPresent ? "resumed" : "new" ) );
+    }
+    else
+    {
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Disconnected from the broker.\r\n" ) );
+    }
+}
+
 static void hello_task( void * pvParameters )
 {
-    MQTTContext_t xMQTTContext = { 0 };
+    /* Static as the publish state records make the context too large for the task stack. */
+    static MQTTContext_t xMQTTContext = { 0 };
     TransportInterface_t xTransport = { 0 };
     MQTTFixedBuffer_t xFixedBuffer = { 0 };
-    MQTTPublishInfo_t xPublishInfo = { 0 };
-    MQTTOperation_t xPublishOperation = { 0 };
-    bool bSessionPresent = true;
-    MQTTConnectInfo_t xMQTTConnectInfo = { 0 };
+    bool bSessionPresent = false;
     MQTTStatus_t xMQTTStatus = MQTTSuccess;
 
 
-    NetworkCredentials_t xNetworkCredentials = { 0 };
-    TlsTransportStatus_t xTransportStatus = TLS_TRANSPORT_SUCCESS;
-    NetworkContext_t xNetworkContext = { 0 };
-
-    HeapStats_t xHeapStats;
-
-
     CK_ULONG ulTemp = 0;
-    char * pcEndpoint = NULL;
     char * pcThingName = NULL;
     uint32_t ulThingNameLength;
     CK_RV xPKCS11Result = CKR_OK;
 
     int32_t lCounter = 0;
-    char cPayload[ 32 ] = { 0 };
-    size_t xPayloadLength;
+
+    #if ( democonfigTELEMETRY_CBOR == 0 )
+        MQTTPublishInfo_t xPublishInfo = { 0 };
+        char cPayload[ 32 ] = { 0 };
+        size_t xPayloadLength;
+    #endif
+
+    #if ( democonfigAGENT_METRICS_INTERVAL_MS > 0 )
+        TickType_t xLastMetricsTime = 0;
+    #endif
+
+    #if ( democonfigDEVICE_SHADOW == 1 )
+        int32_t lIntervalMs;
+    #endif
 
     BaseType_t xStatus;
 
@@ -352,21 +1082,34 @@ static void hello_task( void * pvParameters )
 
     xNetworkCredentials.pRootCa = ( const unsigned char * ) democonfigROOT_CA_PEM;
     xNetworkCredentials.rootCaSize = sizeof( democonfigROOT_CA_PEM );
+    xNetworkCredentials.maxFragmentLength = democonfigTLS_MAX_FRAGMENT_LENGTH;
+
+    /* Downloads get a large receive window, the broker connection only carries
+     * control traffic. */
+    xOtaNetworkCredentials = xNetworkCredentials;
+    xOtaNetworkCredentials.socketProfile = SOCKETS_PROFILE_BULK;
+    xNetworkCredentials.socketProfile = SOCKETS_PROFILE_LEAN;
+    xNetworkCredentials.usePsk = ( democonfigTLS_PSK == 1 ) ? pdTRUE : pdFALSE;
+
+    #if ( democonfigTLS_ECC_ONLY == 1 )
+        /* The file servers may only have RSA certificates, keep the default lists for them. */
+        xNetworkCredentials.pCipherSuites = xEccCipherSuites;
+        xNetworkCredentials.pCurves = xEccCurves;
+    #endif
 
     /* Configure MQTT Context */
     /* Clear context. */
     memset( ( void * ) &xMQTTContext, 0x00, sizeof( MQTTContext_t ) );
 
-    while( FreeRTOS_IsNetworkUp() == pdFALSE )
+    /* A stored DHCP lease is only used once the server confirms it. */
+    while( ( FreeRTOS_IsNetworkUp() == pdFALSE ) || ( DhcpLease_IsConfirmed() == pdFALSE ) )
     {
-        PRINTF( "No Network yet\r\n" );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "No Network yet\r\n" ) );
         vTaskDelay( pdMS_TO_TICKS( 500 ) );
     }
 
-    /* Set transport interface members. */
-    xTransport.pNetworkContext = &xNetworkContext;
-    xTransport.send = TLS_FreeRTOS_send;
-    xTransport.recv = TLS_FreeRTOS_recv;
+    /* The connection manager owns the network context of the transport. */
+    ConnectionManager_Init( &xConnectionConfig, &xTransport );
 
     ulGlobalEntryTimeMs = getTimeStampMs();
 
@@ -380,18 +1123,25 @@ static void hello_task( void * pvParameters )
     xPKCS11Result = ulGetThingName( &pcThingName, &ulThingNameLength );
     xPKCS11Result = ulGetThingEndpoint( &pcEndpoint, &ulTemp );
 
+    if( xPKCS11Result == CKR_OK )
+    {
+        /* Resolve the endpoint while the rest of the connection is prepared. */
+        Sockets_ResolveAsync( pcEndpoint );
+    }
+
     if( ( xMQTTStatus == MQTTSuccess ) && ( xPKCS11Result == CKR_OK ) )
     {
         xMQTTConnectInfo.pClientIdentifier = pcThingName;
 
         xMQTTConnectInfo.clientIdentifierLength = ulThingNameLength;
 
-        /* True for creating a new session with broker, false if we want to resume an old one. */
-        xMQTTConnectInfo.cleanSession = true;
+        /* True for creating a new session with broker, false if we want to resume an old one.
+         * A persistent session keeps the subscriptions and the QoS1 messages across reconnects. */
+        xMQTTConnectInfo.cleanSession = false;
 
         /* The following fields are optional. */
         /* Value for keep alive. */
-        xMQTTConnectInfo.keepAliveSeconds = 60;
+        xMQTTConnectInfo.keepAliveSeconds = democonfigMQTT_KEEP_ALIVE_SECONDS;
 
         /* Optional username and password. */
         xMQTTConnectInfo.pUserName = "";
@@ -399,35 +1149,131 @@ static void hello_task( void * pvParameters )
         xMQTTConnectInfo.pPassword = "";
         xMQTTConnectInfo.passwordLength = strlen( xMQTTConnectInfo.pPassword );
 
-        FreeRTOS_debug_printf( ( "Attempting a connection\n" ) );
-        xTransportStatus = TLS_FreeRTOS_Connect( xMQTTContext.transportInterface.pNetworkContext, pcEndpoint, 8883, &xNetworkCredentials, 4000, 36000 );
+        xConnectionConfig.pHostName = pcEndpoint;
+        ( void ) ConnectionManager_AddListener( prvConnectionStateCallback );
 
-        if( TLS_TRANSPORT_SUCCESS == xTransportStatus )
+        /* Retries with backoff until the broker is reachable, then starts the agent. */
+        if( ConnectionManager_Start( &xMQTTContext, &bSessionPresent ) == pdTRUE )
         {
-            /* Send the connect packet. Use 100 ms as the timeout to wait for the CONNACK packet. */
-            xMQTTStatus = MQTT_Connect( &xMQTTContext, &xMQTTConnectInfo, NULL, 100, &bSessionPresent );
+            #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+                xPublishCompleteSemaphore = xSemaphoreCreateBinaryStatic( &xPublishCompleteSemaphoreBuffer );
+            #else
+                xPublishCompleteSemaphore = xSemaphoreCreateBinary();
+            #endif
+            configASSERT( xPublishCompleteSemaphore != NULL );
 
-            TLS_FreeRTOS_SetRecvTimeout( xMQTTContext.transportInterface.pNetworkContext, 500 );
+            if( LogLevel_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+            {
+                LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Log levels cannot be set over MQTT.\r\n" ) );
+            }
 
-            if( xMQTTStatus == MQTTSuccess )
+            if( CrashReport_Init( pcThingName, ulThingNameLength ) != pdTRUE )
             {
-                xStatus = MQTTAgent_Init( &xMQTTContext );
-                configASSERT( xStatus == pdTRUE );
+                LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Crash snapshot of the previous boot not published.\r\n" ) );
+            }
 
-                xPublishCompleteSemaphore = xSemaphoreCreateBinary();
-                configASSERT( xPublishCompleteSemaphore != NULL );
+            if( xRestrictedTasksSubscribe( pcThingName, ulThingNameLength ) != pdTRUE )
+            {
+                LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Restricted tasks receive no MQTT payloads.\r\n" ) );
+            }
 
-                #if ( OTA_UPDATE_ENABLED == 1 )
-                    xStatus = xStartOTAUpdateDemo();
-                    configASSERT( xStatus == pdTRUE );
-                #endif
+            #if ( configGENERATE_RUN_TIME_STATS == 1 )
+                ( void ) TaskStats_Init( pcThingName, ulThingNameLength );
+            #endif
+
+            if( HeapMonitor_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+            {
+                LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Heap statistics are not published.\r\n" ) );
+            }
+
+            #if ( iperfENABLED == 1 )
+                /* The TLS echo test uses the credentials of the broker connection. */
+                if( Iperf_Init( xConnectionConfig.pCredentials ) != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Throughput tests are not available.\r\n" ) );
+                }
+            #endif
+
+            #if ( latencyprobeENABLED == 1 )
+                if( LatencyProbe_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Latency probes cannot be read over MQTT.\r\n" ) );
+                }
+            #endif
+
+            #if ( democonfigBOOT_TIMING_PUBLISH == 1 )
+                prvPublishBootTiming( pcThingName, ulThingNameLength );
+            #endif
+
+            #if ( democonfigTELEMETRY_CBOR == 1 )
+                if( Telemetry_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Telemetry is not published.\r\n" ) );
+                }
+            #elif ( democonfigSTORE_AND_FORWARD == 1 )
+                if( StoreForward_Init() != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Publishes made offline are not stored.\r\n" ) );
+                }
+            #endif
+
+            #if ( telemetryqosENABLED == 1 )
+                if( TelemetryQos_Init() != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Telemetry does not adapt to congestion.\r\n" ) );
+                }
+            #endif
+
+            #if ( democonfigDEVICE_SHADOW == 1 )
+                if( Shadow_Init( pcThingName, ulThingNameLength, xShadowProperties,
+                                 sizeof( xShadowProperties ) / sizeof( xShadowProperties[ 0 ] ) ) != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Device shadow is not synchronized.\r\n" ) );
+                }
+            #endif
+
+            #if ( appmoduleENABLED == 1 )
+                /* Before the OTA agent, which commits or rejects a module on trial. */
+                if( AppModule_Init( pcThingName, ulThingNameLength ) != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_WARN, ( "Application module is not running.\r\n" ) );
+                }
+            #endif
+
+            #if ( BENCHMARK_BUILD == 1 )
+                /* The benchmark build measures the data path once instead of running the demo. */
+                Benchmark_Run( &xConnectionConfig, pcThingName, ulThingNameLength );
 
                 for( ; ; )
                 {
-                    xPayloadLength = snprintf( cPayload, sizeof( cPayload ), "Hello %ld", lCounter++ );
+                    vTaskDelay( portMAX_DELAY );
+                }
+            #endif
+
+            #if ( OTA_UPDATE_ENABLED == 1 )
+                /* The file servers used for OTA data over HTTP chain to the same root CA. */
+                vOtaHttpSetCredentials( &xOtaNetworkCredentials );
+
+                #if ( democonfigOTA_DEDICATED_CONNECTION == 1 )
+                    xStatus = xStartOTAUpdateDemo( prvStartOtaConnection( pcThingName, ulThingNameLength ) );
+                #else
+                    xStatus = xStartOTAUpdateDemo( NULL );
+                #endif
+                configASSERT( xStatus == pdTRUE );
+            #endif
 
-                    /* Since we requested a clean session, this must be false */
-                    assert( bSessionPresent == false );
+            for( ; ; )
+            {
+                #if ( democonfigTELEMETRY_CBOR == 1 )
+                    /* The sample is published with the next ones, in a single message. */
+                    if( Telemetry_Add( prvEncodeHelloSample, &lCounter, pdMS_TO_TICKS( 1000 ) ) == pdTRUE )
+                    {
+                        LogModule( LOG_MODULE_MAIN, LOG_DEBUG, ( "Batched helloworld.\r\n" ) );
+                    }
+
+                    lCounter++;
+                #else
+                    xPayloadLength = snprintf( cPayload, sizeof( cPayload ), "Hello %ld", lCounter++ );
 
                     /* Do something with the connection. Publish some data. */
                     xPublishInfo.qos = MQTTQoS0;
@@ -438,47 +1284,49 @@ static void hello_task( void * pvParameters )
                     xPublishInfo.pPayload = cPayload;
                     xPublishInfo.payloadLength = xPayloadLength;
 
-                    xPublishOperation.type = MQTT_OP_PUBLISH;
-                    xPublishOperation.info.pPublishInfo = &xPublishInfo;
-                    xPublishOperation.callback = publishCompleteCallback;
-
-                    MQTTAgent_Enqueue( &xPublishOperation, portMAX_DELAY );
-
-                    xSemaphoreTake( xPublishCompleteSemaphore, portMAX_DELAY );
-
-                    PRINTF( "Published helloworld.\r\n" );
+                    #if ( democonfigSTORE_AND_FORWARD == 1 )
+                        /* Sent now when connected, stored in flash until the connection is back otherwise. */
+                        if( StoreForward_Publish( &xPublishInfo, pdMS_TO_TICKS( 1000 ) ) == pdTRUE )
+                        {
+                            LogModule( LOG_MODULE_MAIN, LOG_DEBUG, ( "Queued helloworld.\r\n" ) );
+                        }
+                    #else
+                        /* The agent copies the message, so there is no need to wait for the publish to complete. */
+                        if( MQTTAgent_PublishCopy( NULL, &xPublishInfo, NULL, MQTT_AGENT_PRIORITY_BULK, portMAX_DELAY ) == pdTRUE )
+                        {
+                            LogModule( LOG_MODULE_MAIN, LOG_DEBUG, ( "Queued helloworld.\r\n" ) );
+                        }
+                    #endif
+                #endif /* if ( democonfigTELEMETRY_CBOR == 1 ) */
+
+                #if ( democonfigAGENT_METRICS_INTERVAL_MS > 0 )
+                    if( ( xTaskGetTickCount() - xLastMetricsTime ) >= pdMS_TO_TICKS( democonfigAGENT_METRICS_INTERVAL_MS ) )
+                    {
+                        xLastMetricsTime = xTaskGetTickCount();
+                        prvPublishAgentMetrics( pcThingName, ulThingNameLength );
+                    }
+                #endif
 
-                    vTaskDelay( pdMS_TO_TICKS( 5000 ) );
-                }
+                #if ( democonfigDEVICE_SHADOW == 1 )
+                    /* Reported with the other changes of the update interval. */
+                    ( void ) Shadow_SetInt( 1, lCounter );
 
-                vPortGetHeapStats( &xHeapStats );
-                FreeRTOS_debug_printf( ( "Available heap space              %d\n", xHeapStats.xAvailableHeapSpaceInBytes ) );
-                FreeRTOS_debug_printf( ( "Largest Free Block                %d\n", xHeapStats.xSizeOfLargestFreeBlockInBytes ) );
-                FreeRTOS_debug_printf( ( "Smallest Free Block               %d\n", xHeapStats.xSizeOfSmallestFreeBlockInBytes ) );
-                FreeRTOS_debug_printf( ( "Number of Free Blocks             %d\n", xHeapStats.xNumberOfFreeBlocks ) );
-                FreeRTOS_debug_printf( ( "Minimum Ever Free Bytes Remaining %d\n", xHeapStats.xMinimumEverFreeBytesRemaining ) );
-                FreeRTOS_debug_printf( ( "Number of Successful Allocations  %d\n", xHeapStats.xNumberOfSuccessfulAllocations ) );
-                FreeRTOS_debug_printf( ( "Number of Successful Frees        %d\n", xHeapStats.xNumberOfSuccessfulFrees ) );
+                    /* Set in place by the deltas, a 32 bit read needs no lock. Bounded so that a bad
+                     * desired value cannot flood the broker or stop the publishes. */
+                    lIntervalMs = lShadowHelloIntervalMs;
 
+                    if( ( lIntervalMs < 1000 ) || ( lIntervalMs > 3600000 ) )
+                    {
+                        lIntervalMs = 5000;
+                    }
 
-                /* Disconnect */
-                MQTT_Disconnect( &xMQTTContext );
+                    /* Share the wake up of the watchdog supervisor, sampling less often on a congested link. */
+                    vTaskDelay( Watchdog_AlignWakeup( pdMS_TO_TICKS( TelemetryQos_ScaleInterval( ( uint32_t ) lIntervalMs ) ) ) );
+                #else
+                    /* Share the wake up of the watchdog supervisor, sampling less often on a congested link. */
+                    vTaskDelay( Watchdog_AlignWakeup( pdMS_TO_TICKS( TelemetryQos_ScaleInterval( 5000U ) ) ) );
+                #endif
             }
-
-            TLS_FreeRTOS_Disconnect( xMQTTContext.transportInterface.pNetworkContext );
-        }
-
-        else if( TLS_TRANSPORT_INVALID_PARAMETER == xTransportStatus )
-        {
-            FreeRTOS_debug_printf( ( "Error Connecting to server : bad parameter\n" ) );
-        }
-        else if( TLS_TRANSPORT_CONNECT_FAILURE == xTransportStatus )
-        {
-            FreeRTOS_debug_printf( ( "Error Connecting to server : connect failure\n" ) );
-        }
-        else
-        {
-            FreeRTOS_debug_printf( ( "Error Connecting to server : unknown\n" ) );
         }
     }
 
@@ -499,17 +1347,51 @@ void vApplicationIPNetworkEventHook( eIPCallbackEvent_t eNetworkEvent )
     char cBuffer[ 16 ];
     static BaseType_t xTasksAlreadyCreated = pdFALSE;
 
+    /* Saves a new DHCP lease, or confirms the stored one the network came up with. */
+    DhcpLease_NetworkEvent( eNetworkEvent );
+
+    /* Resolves the gateway before the first connect needs it. */
+    ArpRefresh_NetworkEvent( eNetworkEvent );
+
     /* If the network has just come up...*/
     if( eNetworkEvent == eNetworkUp )
     {
+        boot_timing_mark( BOOT_PHASE_NETWORK_UP );
+
         /* Create the tasks that use the IP stack if they have not already been
          * created. */
         if( xTasksAlreadyCreated == pdFALSE )
         {
             /* Demos that use the network are created after the network is
              * up. */
-            PRINTF( ( "---------STARTING DEMO---------\r\n" ) );
+            LogModule( LOG_MODULE_MAIN, LOG_INFO, ( ( "---------STARTING DEMO---------\r\n" ) ) );
             /* vStartSimpleMQTTDemo(); */
+
+            /* The ENET and the PHY are initialised by the network interface
+             * by now, so their power-down modes and the link interrupt can
+             * be configured. */
+            ( void ) LinkPower_Init();
+            ( void ) LinkMonitor_Init();
+
+            /* Stamps the telemetry with UTC times once synchronized. */
+            ( void ) TimeSync_Init();
+
+            #if ( netreactorENABLED == 1 )
+                /* Shared by the network services built as socket and timer handlers. */
+                if( NetReactor_Init() != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Network reactor not started.\r\n" ) );
+                }
+            #endif
+
+            #if ( flashserviceENABLED == 1 )
+                /* Before the OTA agent, which queues the backup of the running image. */
+                if( FlashService_Init() != pdTRUE )
+                {
+                    LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "Flash service not started.\r\n" ) );
+                }
+            #endif
+
             xTasksAlreadyCreated = pdTRUE;
         }
 
@@ -517,16 +1399,20 @@ void vApplicationIPNetworkEventHook( eIPCallbackEvent_t eNetworkEvent )
          * server. */
         FreeRTOS_GetAddressConfiguration( &ulIPAddress, &ulNetMask, &ulGatewayAddress, &ulDNSServerAddress );
         FreeRTOS_inet_ntoa( ulIPAddress, cBuffer );
-        PRINTF( "\r\n\r\nIP Address: %s\r\n", cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "\r\n\r\nIP Address: %s\r\n", cBuffer ) );
 
         FreeRTOS_inet_ntoa( ulNetMask, cBuffer );
-        PRINTF( "Subnet Mask: %s\r\n", cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Subnet Mask: %s\r\n", cBuffer ) );
 
         FreeRTOS_inet_ntoa( ulGatewayAddress, cBuffer );
-        PRINTF( "Gateway Address: %s\r\n", cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "Gateway Address: %s\r\n", cBuffer ) );
 
         FreeRTOS_inet_ntoa( ulDNSServerAddress, cBuffer );
-        PRINTF( "DNS Server Address: %s\r\n\r\n\r\n", cBuffer );
+        LogModule( LOG_MODULE_MAIN, LOG_INFO, ( "DNS Server Address: %s\r\n\r\n\r\n", cBuffer ) );
+
+        /* Tasks waiting to reconnect after a link flap should not wait out
+         * the rest of their backoff. */
+        RetryUtils_AbortSleep();
     }
 }
 
@@ -534,60 +1420,28 @@ void vApplicationIPNetworkEventHook( eIPCallbackEvent_t eNetworkEvent )
  * @brief Application defined random number generation function.
  *
  * The function is used by TCP/IP stack to generate initial sequence number or DHCP
- * transaction number. The implementation uses mbedTLS port of PKCS11 to generate the random
- * numbers.
+ * transaction number, and by the retry utilities for the backoff jitter. The numbers
+ * come from the entropy pool, a DRBG seeded from the hardware RNG, which is also the
+ * hardware entropy source of mbed TLS.
  */
 uint32_t uxRand( void )
 {
-    static CK_SESSION_HANDLE xSession = CK_INVALID_HANDLE;
-    CK_RV xResult = CKR_OK;
-    CK_BYTE ulBytes[ sizeof( uint32_t ) ] = { 0 };
     uint32_t ulNumber = 0;
-    uint32_t i = 0;
-    BaseType_t xReturn = pdFALSE;
-
-    if( xSession == CK_INVALID_HANDLE )
-    {
-        xResult = xInitializePkcs11Session( &xSession );
-        configASSERT( xSession != CK_INVALID_HANDLE );
-        configASSERT( xResult == CKR_OK );
-    }
-
-    CK_FUNCTION_LIST_PTR pxP11FunctionList;
-
-    xResult = C_GetFunctionList( &pxP11FunctionList );
-    configASSERT( xResult == CKR_OK );
-
-    xResult = pxP11FunctionList->C_GenerateRandom( xSession, ulBytes, sizeof( uint32_t ) );
-
-    if( xResult != CKR_OK )
-    {
-        LogError( ( "Failed to generate a random number in RNG callback. "
-                    "C_GenerateRandom failed with %0x.", xResult ) );
-    }
-    else
-    {
-        for( i = 0; i < sizeof( uint32_t ); i++ )
-        {
-            ulNumber = ( ulNumber | ( ulBytes[ i ] ) ) << i;
-        }
-    }
 
-    if( xResult == CKR_OK )
+    if( xEntropyPoolGetBytes( ( uint8_t * ) &ulNumber, sizeof( ulNumber ) ) != pdTRUE )
     {
-        xReturn = pdTRUE;
+        LogError( ( "Failed to generate a random number from the entropy pool." ) );
     }
 
-    return xReturn;
+    return ulNumber;
 }
 
 
 
 /*
  * Callback that provides the inputs necessary to generate a randomized TCP
- * Initial Sequence Number per RFC 6528.  THIS IS ONLY A DUMMY IMPLEMENTATION
- * THAT RETURNS A PSEUDO RANDOM NUMBER SO IS NOT INTENDED FOR USE IN PRODUCTION
- * SYSTEMS.
+ * Initial Sequence Number per RFC 6528.  The connection identifiers are not
+ * hashed in, the number is drawn from the entropy pool DRBG instead.
  */
 extern uint32_t ulApplicationGetNextSequenceNumber( uint32_t ulSourceAddress,
                                                     uint16_t usSourcePort,
@@ -607,15 +1461,11 @@ extern uint32_t ulApplicationGetNextSequenceNumber( uint32_t ulSourceAddress,
  * generator is broken, it shall return pdFALSE.
  * The macros ipconfigRAND32() and configRAND32() are not in use
  * anymore in FreeRTOS+TCP.
- *
- * THIS IS ONLY A DUMMY IMPLEMENTATION THAT RETURNS A PSEUDO RANDOM NUMBER SO IS
- * NOT INTENDED FOR USE IN PRODUCTION SYSTEMS.
  */
 
 BaseType_t xApplicationGetRandomNumber( uint32_t * pulNumber )
 {
-    *pulNumber = uxRand();
-    return pdTRUE;
+    return xEntropyPoolGetBytes( ( uint8_t * ) pulNumber, sizeof( uint32_t ) );
 }
 
 
@@ -627,14 +1477,33 @@ BaseType_t xApplicationGetRandomNumber( uint32_t * pulNumber )
  * timers, and semaphores.  The size of the FreeRTOS heap is set by the
  * configTOTAL_HEAP_SIZE configuration constant in FreeRTOSConfig.h.
  *
+ * The callers handle the NULL return, the failure is counted and alerted by the heap
+ * monitor so that exhaustion and fragmentation are seen in the field before they hang
+ * the device, the watchdog still resets a task that cannot recover.
  */
 void vApplicationMallocFailedHook( void )
 {
-    PRINTF( "\n\nMALLOC FAIL\n\n" );
+    LogModule( LOG_MODULE_MAIN, LOG_ERROR, ( "\n\nMALLOC FAIL\n\n" ) );
 
-    for( ; ; )
-    {
-    }
+    HeapMonitor_MallocFailed();
+}
+
+
+/**
+ * @brief Called by the kernel on a context switch when configCHECK_FOR_STACK_OVERFLOW finds the
+ * pattern at the end of the stack of the task overwritten.
+ *
+ * The kernel calls it from PendSV, where the deferred log cannot be transmitted, and the memory past
+ * the stack may already be corrupted, so the device resets at once. The crash report records the
+ * task, still the current one, and publishes it on the next boot.
+ */
+void vApplicationStackOverflowHook( TaskHandle_t xTask,
+                                    char * pcTaskName )
+{
+    ( void ) xTask;
+    ( void ) pcTaskName;
+
+    CrashReport_Reset( CRASH_FAULT_STACK_OVERFLOW, NULL, 0 );
 }
 
 
@@ -32,7 +32,7 @@
 /**
  * @brief Memory fault handler invoked by the MPU unit for illegal access to a previleged memory.
  * This overrides the default platform MemManage_Handler and calls the demo defined hard fault
- * handler in user/demo_restrictions.c file.
+ * handler in user/demo_restrictions.c file with the stacked frame and EXC_RETURN.
  */
 void MemManage_Handler( void ) __attribute__( ( naked ) );
 /*-----------------------------------------------------------*/
@@ -45,8 +45,9 @@ void MemManage_Handler( void )
         " ite eq											\n"
         " mrseq r0, msp										\n"
         " mrsne r0, psp										\n"
-        " ldr r1, handler_address_const						\n"
-        " bx r1												\n"
+        " mov r1, lr										\n"
+        " ldr r2, handler_address_const						\n"
+        " bx r2												\n"
         "													\n"
         " handler_address_const: .word vHandleMemoryFault	\n"
     );
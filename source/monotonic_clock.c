@@ -0,0 +1,183 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file monotonic_clock.c
+ * @brief 64 bit monotonic microsecond clock on the DWT cycle counter.
+ * The cycle counter, extended to 64 bits by TaskStats_GetRunTimeCounter(), is converted with a
+ * 32.32 fixed point rate from a base time. The base moves whenever the rate changes, on each
+ * clock_scaling.c level change, and every 2^31 cycles so that the conversion stays a single
+ * 32x32 multiplication. The counter stops while the core sleeps, low_power.c adds the time slept.
+ * Each move of the base drops less than a microsecond, below 0.1 ppm at 180 MHz.
+ */
+
+#include "FreeRTOS.h"
+
+#include "fsl_device_registers.h"
+
+#include "task_stats.h"
+#include "monotonic_clock.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Cycles after which the base is moved.
+ */
+#define monotonicclockREBASE_CYCLES    ( 1ULL << 31 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Time and cycle count of the base, and the microseconds per cycle as a 32.32 fixed point
+ * value, below 1 for any core clock above 1 MHz.
+ */
+static uint64_t ullBaseUs = 0;
+static uint64_t ullBaseCycles = 0;
+static uint32_t ulUsPerCycle = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Converts the cycles since the base to microseconds, called with interrupts masked.
+ */
+static uint64_t prvElapsedUs( uint64_t ullCycles )
+{
+    uint64_t ullElapsed = ullCycles - ullBaseCycles;
+
+    return ( ( ullElapsed >> 32 ) * ulUsPerCycle ) +
+           ( ( ( ullElapsed & 0xFFFFFFFFULL ) * ulUsPerCycle ) >> 32 );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Moves the base to a cycle count, called with interrupts masked.
+ */
+static void prvRebase( uint64_t ullCycles )
+{
+    ullBaseUs += prvElapsedUs( ullCycles );
+    ullBaseCycles = ullCycles;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sets the rate from SystemCoreClock.
+ */
+static void prvSetRate( void )
+{
+    configASSERT( SystemCoreClock > 1000000U );
+
+    ulUsPerCycle = ( uint32_t ) ( ( 1000000ULL << 32 ) / SystemCoreClock );
+}
+
+/*-----------------------------------------------------------*/
+
+void MonotonicClock_Init( void )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    TaskStats_ConfigureTimer();
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        prvSetRate();
+        ullBaseUs = 0;
+        ullBaseCycles = TaskStats_GetRunTimeCounter();
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t MonotonicClock_GetUs( void )
+{
+    UBaseType_t uxSavedInterruptStatus;
+    uint64_t ullCycles;
+    uint64_t ullUs;
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        ullCycles = TaskStats_GetRunTimeCounter();
+
+        if( ( ullCycles - ullBaseCycles ) >= monotonicclockREBASE_CYCLES )
+        {
+            prvRebase( ullCycles );
+        }
+
+        ullUs = ullBaseUs + prvElapsedUs( ullCycles );
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+
+    return ullUs;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t MonotonicClock_GetMs( void )
+{
+    return ( uint32_t ) ( MonotonicClock_GetUs() / 1000U );
+}
+
+/*-----------------------------------------------------------*/
+
+void MonotonicClock_CoreClockChanged( void )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        prvRebase( TaskStats_GetRunTimeCounter() );
+        prvSetRate();
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void MonotonicClock_AddSleptCycles( uint32_t ulCycles )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        /* Counted as if the DWT had run, at the current rate. */
+        ullBaseCycles -= ulCycles;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void MonotonicClock_AddSleptMs( uint32_t ulMs )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        ullBaseUs += ( uint64_t ) ulMs * 1000U;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
@@ -0,0 +1,85 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file monotonic_clock.h
+ * @brief 64 bit monotonic microsecond clock on the DWT cycle counter.
+ */
+
+#ifndef MONOTONIC_CLOCK_H
+#define MONOTONIC_CLOCK_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Enables the DWT cycle counter and starts the clock at 0. Must be called before the other
+ * functions, when SystemCoreClock holds the clock the core runs from.
+ */
+void MonotonicClock_Init( void );
+
+/**
+ * @brief Returns the time since MonotonicClock_Init(), in microseconds.
+ * Usable from the privileged tasks and from the interrupts at or below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY, the DWT is not accessible to the restricted tasks.
+ * Like TaskStats_GetRunTimeCounter(), which extends the cycle counter, it must be called at
+ * least once per 2^32 cycles, which the kernel does on every context switch.
+ *
+ * @return The number of microseconds since MonotonicClock_Init().
+ */
+uint64_t MonotonicClock_GetUs( void );
+
+/**
+ * @brief Returns the time since MonotonicClock_Init(), in milliseconds, for coreMQTT.
+ * Wraps after about 49 days, as coreMQTT expects from its MQTTGetCurrentTimeFunc_t.
+ *
+ * @return The number of milliseconds since MonotonicClock_Init(), modulo 2^32.
+ */
+uint32_t MonotonicClock_GetMs( void );
+
+/**
+ * @brief Accounts for a change of SystemCoreClock, called by clock_scaling.c right after the
+ * switch with interrupts masked. The cycles counted so far are converted at the previous rate.
+ */
+void MonotonicClock_CoreClockChanged( void );
+
+/**
+ * @brief Adds the cycles the DWT did not count while the core slept, the counter stops with the
+ * core clock in WFI. Called by the tickless idle of low_power.c with interrupts masked.
+ *
+ * @param[in] ulCycles The core clock cycles slept, at the current SystemCoreClock.
+ */
+void MonotonicClock_AddSleptCycles( uint32_t ulCycles );
+
+/**
+ * @brief Adds the time spent in deep sleep, timed by the RTC. Called by low_power.c with
+ * interrupts masked, once the clocks are restored.
+ *
+ * @param[in] ulMs The milliseconds slept.
+ */
+void MonotonicClock_AddSleptMs( uint32_t ulMs );
+
+#endif /* MONOTONIC_CLOCK_H */
@@ -0,0 +1,225 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file mpu_lending.c
+ * @brief Lends privileged buffers to restricted tasks through a spare MPU region.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "mpu_lending.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A registered restricted task and the regions it was created with.
+ */
+typedef struct Borrower
+{
+    TaskHandle_t xTask;
+    MemoryRegion_t xRegions[ portNUM_CONFIGURABLE_REGIONS ];
+    uint32_t ulSpareRegion; /**< Index of the region the buffers are lent through. */
+    void * pvLent;          /**< Buffer currently lent, NULL if none. */
+} Borrower_t;
+
+/**
+ * @brief The borrowers, in the privileged data so the restricted tasks cannot alter them.
+ */
+static Borrower_t xBorrowers[ mpulendingMAX_BORROWERS ] PRIVILEGED_DATA;
+
+/*-----------------------------------------------------------*/
+
+static Borrower_t * prvFindBorrower( TaskHandle_t xTask )
+{
+    uint32_t i;
+
+    for( i = 0; i < mpulendingMAX_BORROWERS; i++ )
+    {
+        if( ( xTask != NULL ) && ( xBorrowers[ i ].xTask == xTask ) )
+        {
+            return &( xBorrowers[ i ] );
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Checks that the MPU region of the buffer covers it exactly. The port rounds the size of a
+ * region up to a power of two and the MPU ignores the low bits of the base address, so a buffer not
+ * meeting these constraints would expose the memory around it.
+ */
+static BaseType_t prvIsLendable( const void * pvBuffer,
+                                 uint32_t ulLength )
+{
+    uint32_t ulAddress = ( uint32_t ) pvBuffer;
+
+    return ( ( pvBuffer != NULL ) &&
+             ( ulLength >= mpulendingMIN_BUFFER_SIZE ) &&
+             ( ( ulLength & ( ulLength - 1U ) ) == 0U ) &&
+             ( ( ulAddress & ( ulLength - 1U ) ) == 0U ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MpuLending_RegisterTask( TaskHandle_t xTask,
+                                    const MemoryRegion_t * pxRegions )
+{
+    BaseType_t xResult = pdFALSE;
+    Borrower_t * pxBorrower;
+    uint32_t ulSpare = portNUM_CONFIGURABLE_REGIONS;
+    uint32_t i;
+
+    configASSERT( ( xTask != NULL ) && ( pxRegions != NULL ) );
+
+    for( i = 0; ( ulSpare == portNUM_CONFIGURABLE_REGIONS ) && ( i < portNUM_CONFIGURABLE_REGIONS ); i++ )
+    {
+        if( pxRegions[ i ].ulLengthInBytes == 0U )
+        {
+            ulSpare = i;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    {
+        pxBorrower = prvFindBorrower( xTask );
+
+        if( pxBorrower == NULL )
+        {
+            for( i = 0; ( pxBorrower == NULL ) && ( i < mpulendingMAX_BORROWERS ); i++ )
+            {
+                if( xBorrowers[ i ].xTask == NULL )
+                {
+                    pxBorrower = &( xBorrowers[ i ] );
+                }
+            }
+        }
+
+        if( ( pxBorrower != NULL ) && ( pxBorrower->pvLent == NULL ) && ( ulSpare < portNUM_CONFIGURABLE_REGIONS ) )
+        {
+            pxBorrower->xTask = xTask;
+            memcpy( pxBorrower->xRegions, pxRegions, sizeof( pxBorrower->xRegions ) );
+            pxBorrower->ulSpareRegion = ulSpare;
+            xResult = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MpuLending_Grant( TaskHandle_t xTask,
+                             void * pvBuffer,
+                             uint32_t ulLength,
+                             BaseType_t xWritable )
+{
+    MemoryRegion_t xRegions[ portNUM_CONFIGURABLE_REGIONS ];
+    Borrower_t * pxBorrower;
+    BaseType_t xResult = pdFALSE;
+
+    /* The settings of the running task would only be loaded at its next switch in. */
+    configASSERT( xTask != xTaskGetCurrentTaskHandle() );
+
+    if( prvIsLendable( pvBuffer, ulLength ) != pdTRUE )
+    {
+        return pdFALSE;
+    }
+
+    vTaskSuspendAll();
+    {
+        pxBorrower = prvFindBorrower( xTask );
+
+        if( ( pxBorrower != NULL ) && ( pxBorrower->pvLent == NULL ) )
+        {
+            memcpy( xRegions, pxBorrower->xRegions, sizeof( xRegions ) );
+            xRegions[ pxBorrower->ulSpareRegion ].pvBaseAddress = pvBuffer;
+            xRegions[ pxBorrower->ulSpareRegion ].ulLengthInBytes = ulLength;
+            xRegions[ pxBorrower->ulSpareRegion ].ulParameters =
+                ( ( xWritable == pdTRUE ) ? portMPU_REGION_READ_WRITE : portMPU_REGION_READ_ONLY ) |
+                portMPU_REGION_EXECUTE_NEVER;
+
+            vTaskAllocateMPURegions( xTask, xRegions );
+            pxBorrower->pvLent = pvBuffer;
+            xResult = pdTRUE;
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t MpuLending_Revoke( TaskHandle_t xTask )
+{
+    Borrower_t * pxBorrower;
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( xTask != xTaskGetCurrentTaskHandle() );
+
+    vTaskSuspendAll();
+    {
+        pxBorrower = prvFindBorrower( xTask );
+
+        if( ( pxBorrower != NULL ) && ( pxBorrower->pvLent != NULL ) )
+        {
+            vTaskAllocateMPURegions( xTask, pxBorrower->xRegions );
+            pxBorrower->pvLent = NULL;
+            xResult = pdTRUE;
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void * MpuLending_GetLent( TaskHandle_t xTask )
+{
+    Borrower_t * pxBorrower;
+    void * pvLent = NULL;
+
+    vTaskSuspendAll();
+    {
+        pxBorrower = prvFindBorrower( xTask );
+
+        if( pxBorrower != NULL )
+        {
+            pvLent = pxBorrower->pvLent;
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    return pvLent;
+}
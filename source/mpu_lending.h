@@ -0,0 +1,114 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file mpu_lending.h
+ * @brief Lends privileged buffers to restricted tasks through a spare MPU region.
+ *
+ * A restricted task created with xTaskCreateRestricted() keeps one of its configurable MPU regions
+ * unused. A privileged task registers the restricted task with the regions it was created with,
+ * then grants it access to a buffer by programming that spare region over the buffer, and revokes
+ * the access again once the restricted task is done with it. The restricted task reads or writes
+ * the buffer in place, no copy is made through a privileged intermediary.
+ *
+ * The buffers must satisfy the ARMv7-M MPU constraints: a power of two size of at least 32 bytes,
+ * with a start address aligned to the size, see mpulendingBUFFER_ALIGN(). Only privileged tasks may
+ * call the API.
+ */
+
+#ifndef MPU_LENDING_H
+#define MPU_LENDING_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**
+ * @brief Number of restricted tasks that can be registered as borrowers.
+ */
+#ifndef mpulendingMAX_BORROWERS
+    #define mpulendingMAX_BORROWERS    ( 2U )
+#endif
+
+/**
+ * @brief Smallest buffer the MPU can protect.
+ */
+#define mpulendingMIN_BUFFER_SIZE      ( 32U )
+
+/**
+ * @brief Aligns a buffer of size bytes as required for lending it.
+ */
+#define mpulendingBUFFER_ALIGN( size )    __attribute__( ( aligned( size ) ) )
+
+/**
+ * @brief Registers a restricted task as a borrower.
+ *
+ * @param[in] xTask The restricted task.
+ * @param[in] pxRegions Its portNUM_CONFIGURABLE_REGIONS regions as passed to xTaskCreateRestricted(),
+ * copied. At least one of them must be unused, with a length of 0.
+ *
+ * @return pdTRUE if the task is registered, pdFALSE if it has no spare region or there is no space left.
+ */
+BaseType_t MpuLending_RegisterTask( TaskHandle_t xTask,
+                                    const MemoryRegion_t * pxRegions );
+
+/**
+ * @brief Grants a registered task access to a buffer. The access takes effect when the task is next
+ * switched in. A task borrows one buffer at a time.
+ *
+ * @param[in] xTask The registered task, not the calling task.
+ * @param[in] pvBuffer The buffer, aligned to its size.
+ * @param[in] ulLength The size of the buffer, a power of two of at least mpulendingMIN_BUFFER_SIZE.
+ * @param[in] xWritable pdTRUE to let the task write the buffer, pdFALSE for read only access.
+ *
+ * @return pdTRUE if access is granted, pdFALSE if the task is not registered, already borrows a
+ * buffer or the buffer cannot be covered exactly by an MPU region.
+ */
+BaseType_t MpuLending_Grant( TaskHandle_t xTask,
+                             void * pvBuffer,
+                             uint32_t ulLength,
+                             BaseType_t xWritable );
+
+/**
+ * @brief Revokes the access granted by MpuLending_Grant(). The task is not running while the caller
+ * runs, so it cannot reach the buffer once the call returns and the buffer can be reused.
+ *
+ * @param[in] xTask The registered task.
+ *
+ * @return pdTRUE if a buffer was lent to the task.
+ */
+BaseType_t MpuLending_Revoke( TaskHandle_t xTask );
+
+/**
+ * @brief Returns the buffer currently lent to a registered task.
+ *
+ * @param[in] xTask The registered task.
+ *
+ * @return The buffer, or NULL if none is lent.
+ */
+void * MpuLending_GetLent( TaskHandle_t xTask );
+
+#endif /* MPU_LENDING_H */
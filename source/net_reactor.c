@@ -0,0 +1,519 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file net_reactor.c
+ * @brief Single task event loop over FreeRTOS_select() for the sockets and timers of the network
+ * services.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "net_reactor.h"
+
+#if ( netreactorENABLED == 1 )
+
+    #if ( ipconfigSUPPORT_SELECT_FUNCTION != 1 ) || ( ipconfigSUPPORT_SIGNALS != 1 )
+        #error "The network reactor needs ipconfigSUPPORT_SELECT_FUNCTION and ipconfigSUPPORT_SIGNALS"
+    #endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A socket waited on.
+ */
+    typedef struct NetReactorSocket
+    {
+        Socket_t xSocket; /**< NULL when the entry is free, set last by NetReactor_AddSocket(). */
+        EventBits_t xEvents;
+        NetReactorSocketHandler_t xHandler;
+        void * pvContext;
+        BaseType_t xInSet; /**< Set by the reactor task once the socket is in the socket set. */
+    } NetReactorSocket_t;
+
+/**
+ * @brief A timer, expiring when the tick count reaches xExpiry.
+ */
+    typedef struct NetReactorTimerEntry
+    {
+        NetReactorFunction_t xFunction; /**< NULL when the entry is free, set last by NetReactor_AddTimer(). */
+        void * pvContext;
+        TickType_t xPeriod;
+        TickType_t xExpiry;
+        BaseType_t xAutoReload;
+        BaseType_t xRunning;
+    } NetReactorTimerEntry_t;
+
+/**
+ * @brief A request of NetReactor_Call().
+ */
+    typedef struct NetReactorCall
+    {
+        NetReactorFunction_t xFunction;
+        void * pvContext;
+    } NetReactorCall_t;
+
+/*-----------------------------------------------------------*/
+
+    static NetReactorSocket_t xSockets[ netreactorMAX_SOCKETS ];
+    static NetReactorTimerEntry_t xTimers[ netreactorMAX_TIMERS ];
+
+    static SocketSet_t xSocketSet = NULL;
+
+/**
+ * @brief Socket only in the set to be signalled, which makes FreeRTOS_select() return.
+ */
+    static Socket_t xWakeSocket = FREERTOS_INVALID_SOCKET;
+
+    static QueueHandle_t xCallQueue = NULL;
+    static TaskHandle_t xReactorTask = NULL;
+    static NetReactorStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Makes the reactor task take a new turn.
+ */
+    static void prvWake( void )
+    {
+        if( ( xReactorTask != NULL ) && ( xTaskGetCurrentTaskHandle() != xReactorTask ) )
+        {
+            ( void ) FreeRTOS_SignalSocket( xWakeSocket );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static NetReactorSocket_t * prvFindSocket( Socket_t xSocket )
+    {
+        UBaseType_t uxIndex;
+
+        for( uxIndex = 0; uxIndex < netreactorMAX_SOCKETS; uxIndex++ )
+        {
+            if( xSockets[ uxIndex ].xSocket == xSocket )
+            {
+                return &xSockets[ uxIndex ];
+            }
+        }
+
+        return NULL;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Puts the sockets added since the last turn in the socket set.
+ */
+    static void prvAddPendingSockets( void )
+    {
+        NetReactorSocket_t * pxEntry;
+        UBaseType_t uxIndex;
+
+        for( uxIndex = 0; uxIndex < netreactorMAX_SOCKETS; uxIndex++ )
+        {
+            pxEntry = &xSockets[ uxIndex ];
+
+            if( ( pxEntry->xSocket != NULL ) && ( pxEntry->xInSet == pdFALSE ) )
+            {
+                FreeRTOS_FD_SET( pxEntry->xSocket, xSocketSet, pxEntry->xEvents | eSELECT_EXCEPT );
+                pxEntry->xInSet = pdTRUE;
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvDispatchSockets( void )
+    {
+        NetReactorSocket_t * pxEntry;
+        EventBits_t xEvents;
+        UBaseType_t uxIndex;
+
+        for( uxIndex = 0; uxIndex < netreactorMAX_SOCKETS; uxIndex++ )
+        {
+            pxEntry = &xSockets[ uxIndex ];
+
+            /* A socket removed by an earlier handler is skipped, as well as one added since. */
+            if( ( pxEntry->xSocket == NULL ) || ( pxEntry->xInSet == pdFALSE ) )
+            {
+                continue;
+            }
+
+            xEvents = FreeRTOS_FD_ISSET( pxEntry->xSocket, xSocketSet ) & ( pxEntry->xEvents | eSELECT_EXCEPT );
+
+            if( xEvents != 0U )
+            {
+                xStats.ulSocketEvents++;
+                pxEntry->xHandler( pxEntry->xSocket, xEvents, pxEntry->pvContext );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvRunCalls( void )
+    {
+        NetReactorCall_t xCall;
+
+        while( xQueueReceive( xCallQueue, &xCall, 0 ) == pdTRUE )
+        {
+            xStats.ulCalls++;
+            xCall.xFunction( xCall.pvContext );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Runs the handlers of the expired timers.
+ *
+ * @return Ticks to the next expiry, portMAX_DELAY if no timer runs.
+ */
+    static TickType_t prvRunTimers( void )
+    {
+        NetReactorTimerEntry_t * pxTimer;
+        TickType_t xNow, xLeft, xWait = portMAX_DELAY;
+        UBaseType_t uxIndex;
+
+        for( uxIndex = 0; uxIndex < netreactorMAX_TIMERS; uxIndex++ )
+        {
+            pxTimer = &xTimers[ uxIndex ];
+
+            if( ( pxTimer->xFunction == NULL ) || ( pxTimer->xRunning == pdFALSE ) )
+            {
+                continue;
+            }
+
+            xNow = xTaskGetTickCount();
+
+            if( ( int32_t ) ( xNow - pxTimer->xExpiry ) >= 0 )
+            {
+                if( pxTimer->xAutoReload == pdTRUE )
+                {
+                    pxTimer->xExpiry += pxTimer->xPeriod;
+
+                    /* Expiries missed while the handlers were busy are not made up for. */
+                    if( ( int32_t ) ( xNow - pxTimer->xExpiry ) >= 0 )
+                    {
+                        pxTimer->xExpiry = xNow + pxTimer->xPeriod;
+                    }
+                }
+                else
+                {
+                    pxTimer->xRunning = pdFALSE;
+                }
+
+                xStats.ulTimerEvents++;
+                pxTimer->xFunction( pxTimer->pvContext );
+            }
+
+            /* The handler may have stopped, restarted or removed its timer. */
+            if( ( pxTimer->xFunction != NULL ) && ( pxTimer->xRunning == pdTRUE ) )
+            {
+                xLeft = pxTimer->xExpiry - xTaskGetTickCount();
+
+                if( ( int32_t ) xLeft < 0 )
+                {
+                    xLeft = 0;
+                }
+
+                if( xLeft < xWait )
+                {
+                    xWait = xLeft;
+                }
+            }
+        }
+
+        return xWait;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvReactorTask( void * pvParameters )
+    {
+        TickType_t xWait;
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            prvAddPendingSockets();
+            xWait = prvRunTimers();
+
+            if( uxQueueMessagesWaiting( xCallQueue ) > 0U )
+            {
+                /* Queued by a handler, which does not signal the wake up socket. */
+                xWait = 0;
+            }
+
+            ( void ) FreeRTOS_select( xSocketSet, xWait );
+            xStats.ulWakeups++;
+
+            prvRunCalls();
+            prvDispatchSockets();
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t NetReactor_Init( void )
+    {
+        configASSERT( xReactorTask == NULL );
+
+        xSocketSet = FreeRTOS_CreateSocketSet();
+        xWakeSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+        xCallQueue = xQueueCreate( netreactorCALL_QUEUE_LENGTH, sizeof( NetReactorCall_t ) );
+
+        if( ( xSocketSet == NULL ) || ( xWakeSocket == FREERTOS_INVALID_SOCKET ) || ( xCallQueue == NULL ) )
+        {
+            return pdFALSE;
+        }
+
+        /* The wake up socket never receives, it is in the set to be signalled. */
+        FreeRTOS_FD_SET( xWakeSocket, xSocketSet, eSELECT_READ );
+
+        return ( xTaskCreate( prvReactorTask, "NetReactor", netreactorTASK_STACK_SIZE, NULL,
+                              netreactorTASK_PRIORITY | portPRIVILEGE_BIT, &xReactorTask ) == pdPASS ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t NetReactor_AddSocket( Socket_t xSocket,
+                                     EventBits_t xEvents,
+                                     NetReactorSocketHandler_t xHandler,
+                                     void * pvContext )
+    {
+        NetReactorSocket_t * pxEntry;
+
+        configASSERT( ( xSocket != NULL ) && ( xSocket != FREERTOS_INVALID_SOCKET ) && ( xHandler != NULL ) );
+
+        taskENTER_CRITICAL();
+        {
+            pxEntry = prvFindSocket( NULL );
+
+            if( pxEntry != NULL )
+            {
+                pxEntry->xEvents = xEvents & ( eSELECT_READ | eSELECT_WRITE );
+                pxEntry->xHandler = xHandler;
+                pxEntry->pvContext = pvContext;
+                pxEntry->xInSet = pdFALSE;
+                pxEntry->xSocket = xSocket;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( pxEntry == NULL )
+        {
+            return pdFALSE;
+        }
+
+        prvWake();
+
+        return pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t NetReactor_SetEvents( Socket_t xSocket,
+                                     EventBits_t xEvents )
+    {
+        NetReactorSocket_t * pxEntry = prvFindSocket( xSocket );
+        EventBits_t xCleared;
+
+        configASSERT( NetReactor_InReactor() == pdTRUE );
+
+        if( ( xSocket == NULL ) || ( pxEntry == NULL ) )
+        {
+            return pdFALSE;
+        }
+
+        xEvents &= ( eSELECT_READ | eSELECT_WRITE );
+
+        if( pxEntry->xInSet == pdTRUE )
+        {
+            xCleared = pxEntry->xEvents & ~xEvents;
+
+            if( xCleared != 0U )
+            {
+                FreeRTOS_FD_CLR( xSocket, xSocketSet, xCleared );
+            }
+
+            FreeRTOS_FD_SET( xSocket, xSocketSet, xEvents | eSELECT_EXCEPT );
+        }
+
+        pxEntry->xEvents = xEvents;
+
+        return pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t NetReactor_RemoveSocket( Socket_t xSocket )
+    {
+        NetReactorSocket_t * pxEntry = prvFindSocket( xSocket );
+
+        configASSERT( NetReactor_InReactor() == pdTRUE );
+
+        if( ( xSocket == NULL ) || ( pxEntry == NULL ) )
+        {
+            return pdFALSE;
+        }
+
+        if( pxEntry->xInSet == pdTRUE )
+        {
+            FreeRTOS_FD_CLR( xSocket, xSocketSet, eSELECT_ALL );
+        }
+
+        taskENTER_CRITICAL();
+        {
+            pxEntry->xSocket = NULL;
+            pxEntry->xInSet = pdFALSE;
+        }
+        taskEXIT_CRITICAL();
+
+        return pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    NetReactorTimer_t NetReactor_AddTimer( NetReactorFunction_t xFunction,
+                                           void * pvContext,
+                                           TickType_t xPeriod,
+                                           BaseType_t xAutoReload )
+    {
+        NetReactorTimer_t xTimer = -1;
+        UBaseType_t uxIndex;
+
+        configASSERT( ( xFunction != NULL ) && ( xPeriod > 0U ) );
+
+        taskENTER_CRITICAL();
+        {
+            for( uxIndex = 0; uxIndex < netreactorMAX_TIMERS; uxIndex++ )
+            {
+                if( xTimers[ uxIndex ].xFunction == NULL )
+                {
+                    xTimers[ uxIndex ].pvContext = pvContext;
+                    xTimers[ uxIndex ].xPeriod = xPeriod;
+                    xTimers[ uxIndex ].xExpiry = xTaskGetTickCount() + xPeriod;
+                    xTimers[ uxIndex ].xAutoReload = xAutoReload;
+                    xTimers[ uxIndex ].xRunning = pdTRUE;
+                    xTimers[ uxIndex ].xFunction = xFunction;
+                    xTimer = ( NetReactorTimer_t ) uxIndex;
+                    break;
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( xTimer >= 0 )
+        {
+            prvWake();
+        }
+
+        return xTimer;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void NetReactor_StartTimer( NetReactorTimer_t xTimer,
+                                TickType_t xPeriod )
+    {
+        configASSERT( ( xTimer >= 0 ) && ( xTimer < ( NetReactorTimer_t ) netreactorMAX_TIMERS ) );
+        configASSERT( NetReactor_InReactor() == pdTRUE );
+
+        if( xPeriod > 0U )
+        {
+            xTimers[ xTimer ].xPeriod = xPeriod;
+        }
+
+        xTimers[ xTimer ].xExpiry = xTaskGetTickCount() + xTimers[ xTimer ].xPeriod;
+        xTimers[ xTimer ].xRunning = pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void NetReactor_StopTimer( NetReactorTimer_t xTimer )
+    {
+        configASSERT( ( xTimer >= 0 ) && ( xTimer < ( NetReactorTimer_t ) netreactorMAX_TIMERS ) );
+        configASSERT( NetReactor_InReactor() == pdTRUE );
+
+        xTimers[ xTimer ].xRunning = pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void NetReactor_RemoveTimer( NetReactorTimer_t xTimer )
+    {
+        configASSERT( ( xTimer >= 0 ) && ( xTimer < ( NetReactorTimer_t ) netreactorMAX_TIMERS ) );
+        configASSERT( NetReactor_InReactor() == pdTRUE );
+
+        taskENTER_CRITICAL();
+        {
+            xTimers[ xTimer ].xRunning = pdFALSE;
+            xTimers[ xTimer ].xFunction = NULL;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t NetReactor_Call( NetReactorFunction_t xFunction,
+                                void * pvContext )
+    {
+        NetReactorCall_t xCall = { xFunction, pvContext };
+
+        configASSERT( xFunction != NULL );
+
+        if( ( xCallQueue == NULL ) || ( xQueueSend( xCallQueue, &xCall, 0 ) != pdTRUE ) )
+        {
+            xStats.ulCallsRefused++;
+            return pdFALSE;
+        }
+
+        prvWake();
+
+        return pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t NetReactor_InReactor( void )
+    {
+        return ( ( xReactorTask != NULL ) && ( xTaskGetCurrentTaskHandle() == xReactorTask ) ) ? pdTRUE : pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void NetReactor_GetStats( NetReactorStats_t * pxStats )
+    {
+        *pxStats = xStats;
+        pxStats->uxStackLeft = ( xReactorTask != NULL ) ? uxTaskGetStackHighWaterMark( xReactorTask ) : 0U;
+    }
+
+#endif /* if ( netreactorENABLED == 1 ) */
@@ -0,0 +1,239 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file net_reactor.h
+ * @brief Event loop multiplexing sockets and timers in a single task with FreeRTOS_select(), so that
+ * a network service is a set of handlers instead of a task and a stack of its own. Compiled out
+ * unless netreactorENABLED is 1.
+ *
+ * The handlers run one at a time in the reactor task, with its stack, and must not block: sockets
+ * are read and written with a zero timeout, a service waiting for room in a TCP socket asks for
+ * eSELECT_WRITE with NetReactor_SetEvents() until its data is sent. Sockets and timers are added
+ * from any task, they are changed and removed only from the reactor task, i.e. from a handler or a
+ * function passed to NetReactor_Call(). A socket is closed by its service after it is removed.
+ */
+
+#ifndef NET_REACTOR_H
+#define NET_REACTOR_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "event_groups.h"
+
+/**
+ * @brief Set to 1 to build the reactor.
+ */
+#ifndef netreactorENABLED
+    #define netreactorENABLED    ( 0 )
+#endif
+
+/**
+ * @brief Number of sockets the reactor waits on, besides its own wake up socket.
+ */
+#ifndef netreactorMAX_SOCKETS
+    #define netreactorMAX_SOCKETS    ( 8U )
+#endif
+
+/**
+ * @brief Number of timers.
+ */
+#ifndef netreactorMAX_TIMERS
+    #define netreactorMAX_TIMERS    ( 8U )
+#endif
+
+/**
+ * @brief Number of NetReactor_Call() requests waiting for the reactor task.
+ */
+#ifndef netreactorCALL_QUEUE_LENGTH
+    #define netreactorCALL_QUEUE_LENGTH    ( 8U )
+#endif
+
+/**
+ * @brief Stack size of the reactor task, in words, shared by all the handlers.
+ */
+#ifndef netreactorTASK_STACK_SIZE
+    #define netreactorTASK_STACK_SIZE    ( 1024 )
+#endif
+
+/**
+ * @brief Priority of the reactor task.
+ */
+#ifndef netreactorTASK_PRIORITY
+    #define netreactorTASK_PRIORITY    ( tskIDLE_PRIORITY + 2 )
+#endif
+
+#if ( netreactorENABLED == 1 )
+
+    #include "FreeRTOS_IP.h"
+    #include "FreeRTOS_Sockets.h"
+
+/**
+ * @brief Handler of the events of a socket, called from the reactor task.
+ *
+ * @param[in] xSocket The socket.
+ * @param[in] xEvents The eSELECT_READ, eSELECT_WRITE and eSELECT_EXCEPT events that occurred
+ * among the ones asked for. eSELECT_EXCEPT is always reported, a TCP socket is then closed by
+ * its peer or in error.
+ * @param[in] pvContext Context given when the socket was added.
+ */
+    typedef void ( * NetReactorSocketHandler_t )( Socket_t xSocket,
+                                                  EventBits_t xEvents,
+                                                  void * pvContext );
+
+/**
+ * @brief Handler of a timer, or function passed to NetReactor_Call(), called from the reactor task.
+ *
+ * @param[in] pvContext Context given when the timer was added or the call requested.
+ */
+    typedef void ( * NetReactorFunction_t )( void * pvContext );
+
+/**
+ * @brief Identifier of a timer, -1 for none.
+ */
+    typedef int32_t NetReactorTimer_t;
+
+/**
+ * @brief Runtime statistics of the reactor.
+ */
+    typedef struct NetReactorStats
+    {
+        uint32_t ulWakeups;        /**< Returns of FreeRTOS_select(). */
+        uint32_t ulSocketEvents;   /**< Calls of the socket handlers. */
+        uint32_t ulTimerEvents;    /**< Calls of the timer handlers. */
+        uint32_t ulCalls;          /**< Functions run for NetReactor_Call(). */
+        uint32_t ulCallsRefused;   /**< NetReactor_Call() refused with a full queue. */
+        UBaseType_t uxStackLeft;   /**< Least stack left to the reactor task, in words. */
+    } NetReactorStats_t;
+
+/**
+ * @brief Creates the socket set and the reactor task. Must be called once, after FreeRTOS_IPInit().
+ *
+ * @return pdTRUE if the reactor is running.
+ */
+    BaseType_t NetReactor_Init( void );
+
+/**
+ * @brief Adds a socket, waited on from the next turn of the reactor. Callable from any task.
+ *
+ * @param[in] xSocket The socket, not yet in a socket set.
+ * @param[in] xEvents eSELECT_READ and/or eSELECT_WRITE.
+ * @param[in] xHandler Handler of the events.
+ * @param[in] pvContext Context passed to the handler.
+ *
+ * @return pdTRUE if added, pdFALSE if netreactorMAX_SOCKETS are already waited on.
+ */
+    BaseType_t NetReactor_AddSocket( Socket_t xSocket,
+                                     EventBits_t xEvents,
+                                     NetReactorSocketHandler_t xHandler,
+                                     void * pvContext );
+
+/**
+ * @brief Changes the events waited on for a socket. Only from the reactor task.
+ *
+ * @param[in] xSocket The socket.
+ * @param[in] xEvents eSELECT_READ and/or eSELECT_WRITE, 0 for eSELECT_EXCEPT only.
+ *
+ * @return pdTRUE if the socket was added.
+ */
+    BaseType_t NetReactor_SetEvents( Socket_t xSocket,
+                                     EventBits_t xEvents );
+
+/**
+ * @brief Removes a socket, its handler is not called again. Only from the reactor task.
+ *
+ * @param[in] xSocket The socket, which can be closed on return.
+ *
+ * @return pdTRUE if the socket was added.
+ */
+    BaseType_t NetReactor_RemoveSocket( Socket_t xSocket );
+
+/**
+ * @brief Adds a timer, started. Callable from any task.
+ *
+ * @param[in] xFunction Handler of the timer.
+ * @param[in] pvContext Context passed to the handler.
+ * @param[in] xPeriod Ticks to the first expiry and between the expiries, at least 1.
+ * @param[in] xAutoReload pdTRUE to run the handler every period, pdFALSE to run it once and stop
+ * the timer, which stays allocated.
+ *
+ * @return The timer, -1 if netreactorMAX_TIMERS are already allocated.
+ */
+    NetReactorTimer_t NetReactor_AddTimer( NetReactorFunction_t xFunction,
+                                           void * pvContext,
+                                           TickType_t xPeriod,
+                                           BaseType_t xAutoReload );
+
+/**
+ * @brief Starts or restarts a timer. Only from the reactor task.
+ *
+ * @param[in] xTimer The timer.
+ * @param[in] xPeriod New period, 0 to keep the current one.
+ */
+    void NetReactor_StartTimer( NetReactorTimer_t xTimer,
+                                TickType_t xPeriod );
+
+/**
+ * @brief Stops a timer, its handler is not called until it is started again. Only from the reactor task.
+ *
+ * @param[in] xTimer The timer.
+ */
+    void NetReactor_StopTimer( NetReactorTimer_t xTimer );
+
+/**
+ * @brief Stops and frees a timer. Only from the reactor task.
+ *
+ * @param[in] xTimer The timer.
+ */
+    void NetReactor_RemoveTimer( NetReactorTimer_t xTimer );
+
+/**
+ * @brief Runs a function in the reactor task, after the handlers of the current turn. Callable
+ * from any task, without blocking.
+ *
+ * @param[in] xFunction The function.
+ * @param[in] pvContext Context passed to the function.
+ *
+ * @return pdTRUE if queued, pdFALSE if netreactorCALL_QUEUE_LENGTH calls are already waiting.
+ */
+    BaseType_t NetReactor_Call( NetReactorFunction_t xFunction,
+                                void * pvContext );
+
+/**
+ * @brief Returns pdTRUE when called from the reactor task.
+ */
+    BaseType_t NetReactor_InReactor( void );
+
+/**
+ * @brief Gets the statistics of the reactor.
+ *
+ * @param[out] pxStats The statistics.
+ */
+    void NetReactor_GetStats( NetReactorStats_t * pxStats );
+
+#endif /* if ( netreactorENABLED == 1 ) */
+
+#endif /* NET_REACTOR_H */
@@ -0,0 +1,360 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file ota_cbor_block.c
+ * @brief Decoder of the data block messages of the OTA stream.
+ * The streaming service always sends the same map: the file id, block id and block size as
+ * unsigned integers, the block as a byte string and optionally the client token. The decoder
+ * walks this layout directly instead of iterating the message with the generic parser of the OTA
+ * library, and replaces the decode of the library through the linker option
+ * --wrap=OTA_CBOR_Decode_GetStreamResponseMessage. Messages with any other layout are passed to the
+ * generic parser unchanged.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "ota_cbor_block.h"
+
+/* OTA library include, for the prototype of the replaced decode. */
+#include "ota_cbor_private.h"
+
+/**
+ * @brief CBOR major types of the message.
+ */
+#define OTA_CBOR_MAJOR_UNSIGNED       ( 0U )
+#define OTA_CBOR_MAJOR_BYTE_STRING    ( 2U )
+#define OTA_CBOR_MAJOR_TEXT_STRING    ( 3U )
+#define OTA_CBOR_MAJOR_MAP            ( 5U )
+
+/**
+ * @brief Additional information values followed by an argument of 1, 2 and 4 bytes. Larger
+ * arguments and indefinite lengths are not used by the streaming service.
+ */
+#define OTA_CBOR_ARGUMENT_1_BYTE      ( 24U )
+#define OTA_CBOR_ARGUMENT_2_BYTES     ( 25U )
+#define OTA_CBOR_ARGUMENT_4_BYTES     ( 26U )
+
+/**
+ * @brief Maximum number of pairs of the map, the four fields and the client token.
+ */
+#define OTA_CBOR_MAX_PAIRS            ( 5U )
+
+/**
+ * @brief Bits of the fields found in the map.
+ */
+#define OTA_CBOR_FOUND_FILE_ID        ( 1U << 0 )
+#define OTA_CBOR_FOUND_BLOCK_ID       ( 1U << 1 )
+#define OTA_CBOR_FOUND_BLOCK_SIZE     ( 1U << 2 )
+#define OTA_CBOR_FOUND_PAYLOAD        ( 1U << 3 )
+#define OTA_CBOR_FOUND_CLIENT_TOKEN   ( 1U << 4 )
+#define OTA_CBOR_FOUND_REQUIRED       ( OTA_CBOR_FOUND_FILE_ID | OTA_CBOR_FOUND_BLOCK_ID | OTA_CBOR_FOUND_BLOCK_SIZE | OTA_CBOR_FOUND_PAYLOAD )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Generic decode of the OTA library, called for the messages not matching the layout.
+ */
+bool __real_OTA_CBOR_Decode_GetStreamResponseMessage( const uint8_t * pMessageBuffer,
+                                                      size_t messageSize,
+                                                      int32_t * pFileId,
+                                                      int32_t * pBlockId,
+                                                      int32_t * pBlockSize,
+                                                      uint8_t * const * pPayload,
+                                                      size_t * pPayloadSize );
+
+/**
+ * @brief Decode called by the OTA library in place of the generic decode.
+ */
+bool __wrap_OTA_CBOR_Decode_GetStreamResponseMessage( const uint8_t * pMessageBuffer,
+                                                      size_t messageSize,
+                                                      int32_t * pFileId,
+                                                      int32_t * pBlockId,
+                                                      int32_t * pBlockSize,
+                                                      uint8_t * const * pPayload,
+                                                      size_t * pPayloadSize );
+
+/**
+ * @brief Reads the head of a data item: its major type and its argument.
+ *
+ * @param[in,out] ppCursor Position of the head, moved past it.
+ * @param[in] pEnd End of the message.
+ * @param[out] pMajor Major type.
+ * @param[out] pArgument Argument: the value of an integer, the length of a string or the number
+ * of pairs of a map.
+ * @return pdTRUE if the head fits the message and has a definite argument of up to 4 bytes.
+ */
+static BaseType_t prvReadHead( const uint8_t ** ppCursor,
+                               const uint8_t * pEnd,
+                               uint8_t * pMajor,
+                               uint32_t * pArgument );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Messages decoded with the fixed layout and passed to the generic parser. Only updated
+ * by the OTA agent task.
+ */
+static uint32_t fastDecodes = 0;
+static uint32_t genericDecodes = 0;
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvReadHead( const uint8_t ** ppCursor,
+                               const uint8_t * pEnd,
+                               uint8_t * pMajor,
+                               uint32_t * pArgument )
+{
+    const uint8_t * pCursor = *ppCursor;
+    uint8_t additional;
+    size_t argumentSize;
+    BaseType_t result = pdFALSE;
+
+    if( pCursor < pEnd )
+    {
+        *pMajor = ( uint8_t ) ( *pCursor >> 5 );
+        additional = ( uint8_t ) ( *pCursor & 0x1FU );
+        pCursor++;
+
+        if( additional < OTA_CBOR_ARGUMENT_1_BYTE )
+        {
+            *pArgument = additional;
+            result = pdTRUE;
+        }
+        else if( additional <= OTA_CBOR_ARGUMENT_4_BYTES )
+        {
+            argumentSize = ( size_t ) 1U << ( additional - OTA_CBOR_ARGUMENT_1_BYTE );
+
+            if( ( size_t ) ( pEnd - pCursor ) >= argumentSize )
+            {
+                /* Arguments are big endian. */
+                *pArgument = 0;
+
+                while( argumentSize > 0U )
+                {
+                    *pArgument = ( *pArgument << 8 ) | *pCursor;
+                    pCursor++;
+                    argumentSize--;
+                }
+
+                result = pdTRUE;
+            }
+        }
+        else
+        {
+            /* 8 byte arguments, reserved values and indefinite lengths. */
+        }
+    }
+
+    *ppCursor = pCursor;
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOtaCborDecodeBlock( const uint8_t * pMessage,
+                                size_t messageSize,
+                                OtaCborBlock_t * pBlock )
+{
+    const uint8_t * pCursor = pMessage;
+    const uint8_t * pEnd = pMessage + messageSize;
+    uint32_t pairs = 0, found = 0, bit, argument;
+    uint8_t major, key;
+    int32_t * pField;
+    BaseType_t valid;
+
+    valid = prvReadHead( &pCursor, pEnd, &major, &pairs );
+
+    if( ( valid == pdTRUE ) && ( ( major != OTA_CBOR_MAJOR_MAP ) || ( pairs > OTA_CBOR_MAX_PAIRS ) ) )
+    {
+        valid = pdFALSE;
+    }
+
+    while( ( valid == pdTRUE ) && ( pairs > 0U ) )
+    {
+        pairs--;
+
+        /* Every key is a text string of one character. */
+        valid = prvReadHead( &pCursor, pEnd, &major, &argument );
+
+        if( ( valid != pdTRUE ) || ( major != OTA_CBOR_MAJOR_TEXT_STRING ) ||
+            ( argument != 1U ) || ( pCursor >= pEnd ) )
+        {
+            valid = pdFALSE;
+            break;
+        }
+
+        key = *pCursor;
+        pCursor++;
+        pField = NULL;
+
+        switch( key )
+        {
+            case 'f':
+                bit = OTA_CBOR_FOUND_FILE_ID;
+                pField = &pBlock->fileId;
+                break;
+
+            case 'i':
+                bit = OTA_CBOR_FOUND_BLOCK_ID;
+                pField = &pBlock->blockId;
+                break;
+
+            case 'l':
+                bit = OTA_CBOR_FOUND_BLOCK_SIZE;
+                pField = &pBlock->blockSize;
+                break;
+
+            case 'p':
+                bit = OTA_CBOR_FOUND_PAYLOAD;
+                break;
+
+            case 'c':
+                bit = OTA_CBOR_FOUND_CLIENT_TOKEN;
+                break;
+
+            default:
+                bit = 0;
+                break;
+        }
+
+        /* Unknown and repeated keys are left to the generic parser. */
+        if( ( bit == 0U ) || ( ( found & bit ) != 0U ) )
+        {
+            valid = pdFALSE;
+            break;
+        }
+
+        found |= bit;
+        valid = prvReadHead( &pCursor, pEnd, &major, &argument );
+
+        if( valid != pdTRUE )
+        {
+            break;
+        }
+
+        if( pField != NULL )
+        {
+            if( ( major != OTA_CBOR_MAJOR_UNSIGNED ) || ( argument > ( uint32_t ) INT32_MAX ) )
+            {
+                valid = pdFALSE;
+            }
+            else
+            {
+                *pField = ( int32_t ) argument;
+            }
+        }
+        else if( ( size_t ) ( pEnd - pCursor ) < argument )
+        {
+            valid = pdFALSE;
+        }
+        else if( bit == OTA_CBOR_FOUND_PAYLOAD )
+        {
+            if( major != OTA_CBOR_MAJOR_BYTE_STRING )
+            {
+                valid = pdFALSE;
+            }
+            else
+            {
+                pBlock->pPayload = pCursor;
+                pBlock->payloadSize = argument;
+                pCursor += argument;
+            }
+        }
+        else
+        {
+            /* The client token is not used. */
+            if( major != OTA_CBOR_MAJOR_TEXT_STRING )
+            {
+                valid = pdFALSE;
+            }
+            else
+            {
+                pCursor += argument;
+            }
+        }
+    }
+
+    if( ( valid == pdTRUE ) &&
+        ( ( ( found & OTA_CBOR_FOUND_REQUIRED ) != OTA_CBOR_FOUND_REQUIRED ) || ( pCursor != pEnd ) ) )
+    {
+        valid = pdFALSE;
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
+bool __wrap_OTA_CBOR_Decode_GetStreamResponseMessage( const uint8_t * pMessageBuffer,
+                                                      size_t messageSize,
+                                                      int32_t * pFileId,
+                                                      int32_t * pBlockId,
+                                                      int32_t * pBlockSize,
+                                                      uint8_t * const * pPayload,
+                                                      size_t * pPayloadSize )
+{
+    OtaCborBlock_t block;
+    bool result;
+
+    if( ( pMessageBuffer != NULL ) && ( pFileId != NULL ) && ( pBlockId != NULL ) &&
+        ( pBlockSize != NULL ) && ( pPayload != NULL ) && ( *pPayload != NULL ) && ( pPayloadSize != NULL ) &&
+        ( xOtaCborDecodeBlock( pMessageBuffer, messageSize, &block ) == pdTRUE ) &&
+        ( block.payloadSize <= *pPayloadSize ) )
+    {
+        /* The library decodes into its own buffer, which it passes to the write block callback,
+         * so the payload is copied once from the event buffer. */
+        *pFileId = block.fileId;
+        *pBlockId = block.blockId;
+        *pBlockSize = block.blockSize;
+        ( void ) memcpy( *pPayload, block.pPayload, block.payloadSize );
+        *pPayloadSize = block.payloadSize;
+        fastDecodes++;
+        result = true;
+    }
+    else
+    {
+        genericDecodes++;
+        result = __real_OTA_CBOR_Decode_GetStreamResponseMessage( pMessageBuffer, messageSize,
+                                                                  pFileId, pBlockId, pBlockSize,
+                                                                  pPayload, pPayloadSize );
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaCborGetStats( uint32_t * pFast,
+                       uint32_t * pGeneric )
+{
+    *pFast = fastDecodes;
+    *pGeneric = genericDecodes;
+}
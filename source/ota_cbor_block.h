@@ -0,0 +1,77 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file ota_cbor_block.h
+ * @brief Decoder of the data block messages of the OTA stream, specialized for the fixed map
+ * the streaming service sends on $aws/things/+/streams/+/data/cbor.
+ */
+
+#ifndef OTA_CBOR_BLOCK_H
+#define OTA_CBOR_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Fields of a data block message.
+ */
+typedef struct OtaCborBlock
+{
+    int32_t fileId;           /**< @brief Value of the "f" key. */
+    int32_t blockId;          /**< @brief Value of the "i" key. */
+    int32_t blockSize;        /**< @brief Value of the "l" key. */
+    const uint8_t * pPayload; /**< @brief Byte string of the "p" key, inside the message. */
+    size_t payloadSize;       /**< @brief Length of the byte string of the "p" key. */
+} OtaCborBlock_t;
+
+/**
+ * @brief Decodes a data block message without copying the payload.
+ * The message must be a definite length map holding unsigned integers under "f", "i" and "l",
+ * a definite length byte string under "p" and optionally a text string under "c", the client
+ * token. Any other layout is left to the generic CBOR parser of the OTA library.
+ *
+ * @param[in] pMessage The CBOR encoded message.
+ * @param[in] messageSize Length of the message.
+ * @param[out] pBlock Fields of the message, the payload points into pMessage.
+ * @return pdTRUE if the message has the expected layout.
+ */
+BaseType_t xOtaCborDecodeBlock( const uint8_t * pMessage,
+                                size_t messageSize,
+                                OtaCborBlock_t * pBlock );
+
+/**
+ * @brief Gets the number of messages decoded by xOtaCborDecodeBlock() and passed to the
+ * generic parser since boot.
+ *
+ * @param[out] pFast Number of messages decoded with the fixed layout.
+ * @param[out] pGeneric Number of messages left to the generic parser.
+ */
+void vOtaCborGetStats( uint32_t * pFast,
+                       uint32_t * pGeneric );
+
+#endif /* ifndef OTA_CBOR_BLOCK_H */
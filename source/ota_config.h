@@ -57,6 +57,9 @@
 
 #include "logging_stack.h"
 
+/* Buffer sizes of the selected performance profile. */
+#include "perf_profile.h"
+
 /**
  * @brief The number of words allocated to the stack for the OTA agent.
  */
@@ -70,9 +73,12 @@
 /**
  * @brief Log base 2 of the size of the file data block message (excluding the header).
  *
- * 10 bits yields a data block size of 1KB.
+ * 12 bits yields a data block size of 4KB, which matches the SPIFI flash sector size so that each
+ * block is written to flash with a single sector erase and program. The block size must divide
+ * MFLASH_SECTOR_SIZE, and the MQTT incoming buffer in main.c must hold a block with its CBOR framing,
+ * unless the MQTT agent streams the blocks with MQTT_AGENT_STREAM_RECEIVE.
  */
-#define otaconfigLOG2_FILE_BLOCK_SIZE          10UL
+#define otaconfigLOG2_FILE_BLOCK_SIZE          12UL
 
 /**
  * @brief Milliseconds to wait for the self test phase to succeed before we force reset.
@@ -112,9 +118,13 @@
  *  request is 128/1 = 128 blocks. Configure this parameter to this maximum limit or lower based on
  *  how many data blocks response is expected for each data requests.
  *  Please note that this must be set larger than zero.
+ *  The window is sized to the number of data buffers, so that a whole window of blocks is
+ *  buffered while OTA agent writes the previous blocks to flash.
  *
  */
-#define otaconfigMAX_NUM_BLOCKS_REQUEST        4U
+#ifndef otaconfigMAX_NUM_BLOCKS_REQUEST
+    #define otaconfigMAX_NUM_BLOCKS_REQUEST    otaconfigMAX_NUM_OTA_DATA_BUFFERS
+#endif
 
 /**
  * @brief The maximum number of requests allowed to send without a response before we abort.
@@ -129,9 +139,17 @@
  * @brief The number of data buffers reserved by the OTA agent.
  *
  * This configurations parameter sets the maximum number of static data buffers used by
- * the OTA agent for job and file data blocks received.
+ * the OTA agent for job and file data blocks received. The default comes from democonfigPERF_PROFILE.
  */
-#define otaconfigMAX_NUM_OTA_DATA_BUFFERS      4U
+#ifndef otaconfigMAX_NUM_OTA_DATA_BUFFERS
+    #define otaconfigMAX_NUM_OTA_DATA_BUFFERS    perfprofileOTA_DATA_BUFFERS
+#endif
+
+/* The blocks of a window arrive back to back, a block finding no free data buffer is dropped and
+ * only requested again once the window times out after otaconfigFILE_REQUEST_WAIT_MS. */
+#if ( otaconfigMAX_NUM_BLOCKS_REQUEST > otaconfigMAX_NUM_OTA_DATA_BUFFERS )
+    #error "otaconfigMAX_NUM_BLOCKS_REQUEST must not exceed otaconfigMAX_NUM_OTA_DATA_BUFFERS."
+#endif
 
 /**
  * @brief The protocol selected for OTA control operations.
@@ -154,8 +172,11 @@
  * Enable data over MQTT - ( OTA_DATA_OVER_MQTT )
  * Enable data over HTTP - ( OTA_DATA_OVER_HTTP)
  * Enable data over both MQTT & HTTP ( OTA_DATA_OVER_MQTT | OTA_DATA_OVER_HTTP )
+ *
+ * Data over HTTP downloads the blocks with ranged GET requests to the pre-signed S3 URL of the job,
+ * on a second TLS connection managed by ota_http.c, leaving the MQTT connection to control traffic.
  */
-#define configENABLED_DATA_PROTOCOLS           ( OTA_DATA_OVER_MQTT )
+#define configENABLED_DATA_PROTOCOLS           ( OTA_DATA_OVER_MQTT | OTA_DATA_OVER_HTTP )
 
 /**
  * @brief The preferred protocol selected for OTA data operations.
@@ -166,7 +187,7 @@
  *
  * Note - use OTA_DATA_OVER_HTTP for HTTP as primary data protocol.
  */
-#define configOTA_PRIMARY_DATA_PROTOCOL        ( OTA_DATA_OVER_MQTT )
+#define configOTA_PRIMARY_DATA_PROTOCOL        ( OTA_DATA_OVER_HTTP )
 
 
 /**
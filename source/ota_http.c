@@ -0,0 +1,507 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file ota_http.c
+ * @brief Minimal HTTPS client used by the OTA agent to download firmware blocks.
+ * The client sends HTTP/1.1 ranged GET requests over the TLS transport used for MQTT and reads the
+ * response body directly into the buffer of the caller. Only the subset of HTTP used with pre-signed
+ * S3 URLs is supported: a Content-Length delimited body on a keep alive connection.
+ */
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_debug_console.h"
+
+#include "ota_http.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Port of the HTTPS server.
+ */
+#define OTA_HTTP_PORT                  ( 443U )
+
+/**
+ * @brief Maximum length of the host name in the URL, including the NULL terminator.
+ */
+#define OTA_HTTP_MAX_HOST_LENGTH       ( 128U )
+
+/**
+ * @brief Size of the buffer used to send the request and receive the response headers.
+ * Pre-signed S3 URLs are over a kilobyte long.
+ */
+#define OTA_HTTP_BUFFER_SIZE           ( 2048U )
+
+/**
+ * @brief Timeouts for the TLS transport. The receive timeout bounds the wait for the response.
+ */
+#define OTA_HTTP_RECV_TIMEOUT_MS       ( 5000U )
+#define OTA_HTTP_SEND_TIMEOUT_MS       ( 5000U )
+
+/**
+ * @brief Prefix of the URLs supported by the client.
+ */
+#define OTA_HTTP_URL_PREFIX            "https://"
+#define OTA_HTTP_URL_PREFIX_LENGTH     ( sizeof( OTA_HTTP_URL_PREFIX ) - 1U )
+
+/**
+ * @brief Terminator of the response headers.
+ */
+#define OTA_HTTP_HEADERS_END           "\r\n\r\n"
+#define OTA_HTTP_HEADERS_END_LENGTH    ( sizeof( OTA_HTTP_HEADERS_END ) - 1U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Connects to the host of the URL.
+ *
+ * @return pdTRUE if the TLS connection is established.
+ */
+static BaseType_t prvConnect( void );
+
+/**
+ * @brief Closes the TLS connection if it is open.
+ */
+static void prvDisconnect( void );
+
+/**
+ * @brief Sends the whole buffer over the TLS connection.
+ *
+ * @param[in] pData Data to send.
+ * @param[in] length Length of the data.
+ * @return pdTRUE if all the data was sent.
+ */
+static BaseType_t prvSendAll( const uint8_t * pData,
+                              size_t length );
+
+/**
+ * @brief Receives exactly the requested number of bytes from the TLS connection.
+ *
+ * @param[out] pData Buffer receiving the data.
+ * @param[in] length Number of bytes to receive.
+ * @return pdTRUE if all the bytes were received before the receive timeout.
+ */
+static BaseType_t prvRecvAll( uint8_t * pData,
+                              size_t length );
+
+/**
+ * @brief Finds the value of a response header, the header name is compared case insensitively.
+ *
+ * @param[in] pHeaders NULL terminated response headers, after the status line.
+ * @param[in] pName Name of the header, without the colon.
+ * @return Pointer to the value of the header, or NULL if the header is not present.
+ */
+static const char * prvFindHeader( const char * pHeaders,
+                                   const char * pName );
+
+/**
+ * @brief Sends one ranged GET request and receives the response on the current connection.
+ *
+ * @param[in] rangeStart Offset of the first byte requested.
+ * @param[in] rangeEnd Offset of the last byte requested, inclusive.
+ * @param[out] pBuffer Buffer receiving the response body.
+ * @param[in] bufferSize Size of the buffer.
+ * @param[out] pReceived Number of bytes received in the buffer.
+ * @return pdTRUE if the range was received.
+ */
+static BaseType_t prvGetRange( uint32_t rangeStart,
+                               uint32_t rangeEnd,
+                               uint8_t * pBuffer,
+                               size_t bufferSize,
+                               size_t * pReceived );
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Credentials used for the TLS connection.
+ */
+static const NetworkCredentials_t * pCredentials = NULL;
+
+/**
+ * @brief TLS connection to the HTTP server.
+ */
+static NetworkContext_t networkContext = { 0 };
+
+/**
+ * @brief Whether the TLS connection is open.
+ */
+static bool isConnected = false;
+
+/**
+ * @brief Host name of the URL being downloaded.
+ */
+static char host[ OTA_HTTP_MAX_HOST_LENGTH ];
+
+/**
+ * @brief Path and query of the URL being downloaded, points into the URL passed to xOtaHttpInit().
+ */
+static const char * pPath = NULL;
+
+/**
+ * @brief Buffer holding the request, then the response headers.
+ */
+static char httpBuffer[ OTA_HTTP_BUFFER_SIZE + 1U ];
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvConnect( void )
+{
+    TlsTransportStatus_t tlsStatus;
+
+    configASSERT( pCredentials != NULL );
+
+    tlsStatus = TLS_FreeRTOS_Connect( &networkContext,
+                                      host,
+                                      OTA_HTTP_PORT,
+                                      pCredentials,
+                                      OTA_HTTP_RECV_TIMEOUT_MS,
+                                      OTA_HTTP_SEND_TIMEOUT_MS );
+
+    if( tlsStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        isConnected = true;
+    }
+    else
+    {
+        PRINTF( "[OTA-HTTP] Failed to connect to %s, status %d.\r\n", host, ( int ) tlsStatus );
+    }
+
+    return ( isConnected == true ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDisconnect( void )
+{
+    if( isConnected == true )
+    {
+        TLS_FreeRTOS_Disconnect( &networkContext );
+        isConnected = false;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSendAll( const uint8_t * pData,
+                              size_t length )
+{
+    size_t sent = 0;
+    int32_t result = 1;
+
+    while( ( sent < length ) && ( result > 0 ) )
+    {
+        result = TLS_FreeRTOS_send( &networkContext, &pData[ sent ], length - sent );
+
+        if( result > 0 )
+        {
+            sent += ( size_t ) result;
+        }
+    }
+
+    return ( sent == length ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvRecvAll( uint8_t * pData,
+                              size_t length )
+{
+    size_t received = 0;
+    int32_t result = 1;
+
+    /* Zero is returned on timeout or when the server closed the connection. */
+    while( ( received < length ) && ( result > 0 ) )
+    {
+        result = TLS_FreeRTOS_recv( &networkContext, &pData[ received ], length - received );
+
+        if( result > 0 )
+        {
+            received += ( size_t ) result;
+        }
+    }
+
+    return ( received == length ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static const char * prvFindHeader( const char * pHeaders,
+                                   const char * pName )
+{
+    const char * pLine = pHeaders;
+    const char * pValue = NULL;
+    size_t nameLength = strlen( pName );
+    size_t index;
+
+    while( ( pValue == NULL ) && ( pLine != NULL ) && ( *pLine != '\0' ) )
+    {
+        for( index = 0; index < nameLength; index++ )
+        {
+            if( ( ( unsigned char ) pLine[ index ] | 0x20U ) != ( ( unsigned char ) pName[ index ] | 0x20U ) )
+            {
+                break;
+            }
+        }
+
+        if( ( index == nameLength ) && ( pLine[ nameLength ] == ':' ) )
+        {
+            pValue = &pLine[ nameLength + 1U ];
+
+            while( *pValue == ' ' )
+            {
+                pValue++;
+            }
+        }
+        else
+        {
+            pLine = strstr( pLine, "\r\n" );
+
+            if( pLine != NULL )
+            {
+                pLine += 2;
+            }
+        }
+    }
+
+    return pValue;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvGetRange( uint32_t rangeStart,
+                               uint32_t rangeEnd,
+                               uint8_t * pBuffer,
+                               size_t bufferSize,
+                               size_t * pReceived )
+{
+    BaseType_t status = pdTRUE;
+    int requestLength;
+    size_t received = 0, headersLength = 0, bodyInBuffer, contentLength = 0;
+    int32_t result;
+    const char * pHeadersEnd = NULL;
+    const char * pValue;
+    unsigned long statusCode = 0;
+
+    requestLength = snprintf( httpBuffer,
+                              sizeof( httpBuffer ),
+                              "GET %s HTTP/1.1\r\n"
+                              "Host: %s\r\n"
+                              "Range: bytes=%lu-%lu\r\n"
+                              "\r\n",
+                              pPath,
+                              host,
+                              ( unsigned long ) rangeStart,
+                              ( unsigned long ) rangeEnd );
+
+    if( ( requestLength <= 0 ) || ( ( size_t ) requestLength >= sizeof( httpBuffer ) ) )
+    {
+        PRINTF( "[OTA-HTTP] Request does not fit the buffer.\r\n" );
+        status = pdFALSE;
+    }
+    else
+    {
+        status = prvSendAll( ( const uint8_t * ) httpBuffer, ( size_t ) requestLength );
+    }
+
+    /* Receive until the end of the headers, part of the body may be received with them. */
+    while( ( status == pdTRUE ) && ( pHeadersEnd == NULL ) )
+    {
+        if( received == OTA_HTTP_BUFFER_SIZE )
+        {
+            PRINTF( "[OTA-HTTP] Response headers do not fit the buffer.\r\n" );
+            status = pdFALSE;
+        }
+        else
+        {
+            result = TLS_FreeRTOS_recv( &networkContext,
+                                        ( uint8_t * ) &httpBuffer[ received ],
+                                        OTA_HTTP_BUFFER_SIZE - received );
+
+            if( result > 0 )
+            {
+                received += ( size_t ) result;
+                httpBuffer[ received ] = '\0';
+                pHeadersEnd = strstr( httpBuffer, OTA_HTTP_HEADERS_END );
+            }
+            else
+            {
+                status = pdFALSE;
+            }
+        }
+    }
+
+    if( status == pdTRUE )
+    {
+        headersLength = ( size_t ) ( pHeadersEnd - httpBuffer ) + OTA_HTTP_HEADERS_END_LENGTH;
+        bodyInBuffer = received - headersLength;
+
+        /* Terminate the headers so that the header lookup does not run into the body. */
+        httpBuffer[ headersLength - 2U ] = '\0';
+
+        if( strncmp( httpBuffer, "HTTP/1.", 7 ) == 0 )
+        {
+            statusCode = strtoul( &httpBuffer[ 8 ], NULL, 10 );
+        }
+
+        pValue = prvFindHeader( httpBuffer, "Content-Length" );
+
+        if( pValue != NULL )
+        {
+            contentLength = ( size_t ) strtoul( pValue, NULL, 10 );
+        }
+
+        if( ( statusCode != 206UL ) && ( statusCode != 200UL ) )
+        {
+            PRINTF( "[OTA-HTTP] Unexpected HTTP status %lu.\r\n", statusCode );
+            status = pdFALSE;
+        }
+        else if( ( pValue == NULL ) || ( contentLength > bufferSize ) || ( bodyInBuffer > contentLength ) )
+        {
+            PRINTF( "[OTA-HTTP] Unsupported response body of %u bytes.\r\n", ( unsigned int ) contentLength );
+            status = pdFALSE;
+        }
+        else
+        {
+            /* Receive the rest of the body directly into the buffer of the caller. */
+            memcpy( pBuffer, &httpBuffer[ headersLength ], bodyInBuffer );
+            status = prvRecvAll( &pBuffer[ bodyInBuffer ], contentLength - bodyInBuffer );
+        }
+
+        if( status == pdTRUE )
+        {
+            *pReceived = contentLength;
+            pValue = prvFindHeader( httpBuffer, "Connection" );
+
+            if( ( pValue != NULL ) && ( ( pValue[ 0 ] | 0x20 ) == 'c' ) )
+            {
+                /* Server closes the connection after the response, reconnect on the next request. */
+                prvDisconnect();
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaHttpSetCredentials( const NetworkCredentials_t * pNetworkCredentials )
+{
+    pCredentials = pNetworkCredentials;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOtaHttpInit( const char * pUrl )
+{
+    BaseType_t status = pdFALSE;
+    const char * pHost;
+    size_t hostLength;
+
+    prvDisconnect();
+
+    if( ( pUrl != NULL ) && ( strncmp( pUrl, OTA_HTTP_URL_PREFIX, OTA_HTTP_URL_PREFIX_LENGTH ) == 0 ) )
+    {
+        pHost = &pUrl[ OTA_HTTP_URL_PREFIX_LENGTH ];
+        pPath = strchr( pHost, '/' );
+        hostLength = ( pPath != NULL ) ? ( size_t ) ( pPath - pHost ) : strlen( pHost );
+
+        if( ( hostLength > 0U ) && ( hostLength < OTA_HTTP_MAX_HOST_LENGTH ) )
+        {
+            memcpy( host, pHost, hostLength );
+            host[ hostLength ] = '\0';
+
+            if( pPath == NULL )
+            {
+                pPath = "/";
+            }
+
+            status = prvConnect();
+        }
+    }
+
+    if( status != pdTRUE )
+    {
+        PRINTF( "[OTA-HTTP] Failed to initialize the download.\r\n" );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOtaHttpGetRange( uint32_t rangeStart,
+                             uint32_t rangeEnd,
+                             uint8_t * pBuffer,
+                             size_t bufferSize,
+                             size_t * pReceived )
+{
+    BaseType_t status = pdFALSE;
+    bool wasConnected;
+    uint32_t attempt;
+
+    configASSERT( pPath != NULL );
+
+    /* A kept alive connection may have been closed by the server, retry once on a new connection. */
+    for( attempt = 0; ( attempt < 2U ) && ( status != pdTRUE ); attempt++ )
+    {
+        wasConnected = isConnected;
+
+        if( ( isConnected == true ) || ( prvConnect() == pdTRUE ) )
+        {
+            status = prvGetRange( rangeStart, rangeEnd, pBuffer, bufferSize, pReceived );
+        }
+
+        if( status != pdTRUE )
+        {
+            prvDisconnect();
+
+            if( wasConnected == false )
+            {
+                break;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+void vOtaHttpDeinit( void )
+{
+    prvDisconnect();
+    pPath = NULL;
+}
+
+/*-----------------------------------------------------------*/
@@ -0,0 +1,82 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file ota_http.h
+ * @brief Minimal HTTPS client used by the OTA agent to download firmware blocks with ranged GET
+ * requests from the pre-signed URL received in the OTA job document.
+ */
+
+#ifndef OTA_HTTP_H
+#define OTA_HTTP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+
+#include "tls_freertos_pkcs11.h"
+
+/**
+ * @brief Sets the credentials used for the TLS connection to the HTTP server.
+ * The credentials are not copied and must remain valid while OTA agent is running.
+ *
+ * @param[in] pNetworkCredentials Credentials with the root CA of the HTTP server.
+ */
+void vOtaHttpSetCredentials( const NetworkCredentials_t * pNetworkCredentials );
+
+/**
+ * @brief Connects to the server of the pre-signed URL.
+ * The URL is not copied and must remain valid until vOtaHttpDeinit() is called.
+ *
+ * @param[in] pUrl NULL terminated HTTPS URL of the file to download.
+ * @return pdTRUE if the connection to the server is established.
+ */
+BaseType_t xOtaHttpInit( const char * pUrl );
+
+/**
+ * @brief Downloads a range of the file with a GET request, reading the response body directly
+ * into the buffer passed in. The connection is kept alive across requests and reestablished if the
+ * server closed it.
+ *
+ * @param[in] rangeStart Offset of the first byte requested.
+ * @param[in] rangeEnd Offset of the last byte requested, inclusive.
+ * @param[out] pBuffer Buffer receiving the response body.
+ * @param[in] bufferSize Size of the buffer.
+ * @param[out] pReceived Number of bytes received in the buffer.
+ * @return pdTRUE if the range was received.
+ */
+BaseType_t xOtaHttpGetRange( uint32_t rangeStart,
+                             uint32_t rangeEnd,
+                             uint8_t * pBuffer,
+                             size_t bufferSize,
+                             size_t * pReceived );
+
+/**
+ * @brief Closes the connection to the server.
+ */
+void vOtaHttpDeinit( void );
+
+#endif /* ifndef OTA_HTTP_H */
@@ -27,10 +27,29 @@
  * @brief File contains OTA platform layer abstraction implementations using NXP SDK.
  */
 
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "ota_pal.h"
 #include "fsl_debug_console.h"
+#include "log_level.h"
 #include "spifi_boot.h"
 #include "mflash_drv.h"
+#include "fsl_crc32.h"
+#include "mflash_file.h"
+#include "clock_scaling.h"
+#include "dma_copy.h"
+#include "app_module.h"
+#include "flash_service.h"
+#include "mbedtls/sha256.h"
+#include "fsl_sha.h"
+
+#if ( ( MFLASH_SECTOR_SIZE % ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE ) ) != 0 )
+    #error "OTA file block size must divide the flash sector size."
+#endif
 
 /**
  * @brief The maximum size of each image slots.
@@ -56,15 +75,182 @@
 
 /**
  * @brief Pointer representation of the new firmware image in flash
+ * With A/B booting the new image is written to whichever slot is not running.
+ */
+#if ( BOOT_AB_MODE )
+    #define OTA_UPDATE_IMAGE_PTR    ( boot_update_slot() )
+#else
+    #define OTA_UPDATE_IMAGE_PTR    ( ( void * ) OTA_UPDATE_IMAGE_ADDR )
+#endif
+
+/**
+ * @brief Pointer representation of the running firmware image in flash
  */
-#define OTA_UPDATE_IMAGE_PTR     ( ( void * ) OTA_UPDATE_IMAGE_ADDR )
+#define OTA_ACTIVE_IMAGE_PTR     ( boot_active_image() )
 
 /**
  * @brief Pointer representation of the backup firmware image in flash
  */
 #define OTA_BACKUP_IMAGE_PTR     ( ( void * ) OTA_BACKUP_IMAGE_ADDR )
 
+/**
+ * @brief Magic number at the start of a delta image, "DLT1" in little endian.
+ *
+ * A delta image rebuilds the new image from the running image at OTA_ACTIVE_IMAGE_PTR. It starts with
+ * a header of three little endian 32 bit words: the magic number, the size of the new image and the
+ * size of the running image it applies to. The header is followed by a list of records, each starting
+ * with an opcode byte:
+ *  - OTA_DELTA_OP_COPY, a 32 bit offset in the running image and a 32 bit length, copies bytes from
+ *    the running image to the new image.
+ *  - OTA_DELTA_OP_INSERT, a 32 bit length followed by that many bytes, appends the bytes to the new image.
+ * The signature of the job is the signature of the new image.
+ */
+#define OTA_DELTA_MAGIC          ( 0x31544C44UL )
+
+/**
+ * @brief Size of the delta image header.
+ */
+#define OTA_DELTA_HEADER_SIZE    ( 12U )
+
+/**
+ * @brief Delta record copying bytes from the running image.
+ */
+#define OTA_DELTA_OP_COPY        ( 0U )
+
+/**
+ * @brief Delta record inserting literal bytes.
+ */
+#define OTA_DELTA_OP_INSERT      ( 1U )
+
+/**
+ * @brief Size of the file blocks written by OTA agent.
+ */
+#define OTA_FILE_BLOCK_SIZE      ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE )
+
+/**
+ * @brief Number of partially received flash sectors buffered in RAM before they are programmed.
+ * Blocks smaller than a sector are gathered in the sector cache so that each sector is programmed once,
+ * instead of a read-modify-write of the whole sector for every block. The least recently used sector is
+ * programmed when a block of another sector arrives, to handle blocks received out of order.
+ * The cache is not needed when blocks are whole sectors.
+ */
+#ifndef OTA_PAL_SECTOR_CACHE_ENTRIES
+    #if ( OTA_FILE_BLOCK_SIZE < MFLASH_SECTOR_SIZE )
+        #define OTA_PAL_SECTOR_CACHE_ENTRIES    ( 2U )
+    #else
+        #define OTA_PAL_SECTOR_CACHE_ENTRIES    ( 0U )
+    #endif
+#endif
+
+/**
+ * @brief Number of file blocks in a flash sector, tracked in a 32 bit mask by the sector cache.
+ */
+#define OTA_PAL_BLOCKS_PER_SECTOR    ( MFLASH_SECTOR_SIZE / OTA_FILE_BLOCK_SIZE )
+
+#if ( ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 ) && ( OTA_PAL_BLOCKS_PER_SECTOR > 32 ) )
+    #error "The sector cache tracks at most 32 blocks per sector."
+#endif
+
+/**
+ * @brief Set to 1 to compute the digest of the image with the SHA engine instead of mbedTLS.
+ * The engine holds the state of a single hash, this is the only user and one file is received at a time.
+ */
+#ifndef OTA_PAL_HW_SHA256
+    #if defined( FSL_FEATURE_SOC_SHA_COUNT ) && ( FSL_FEATURE_SOC_SHA_COUNT > 0 )
+        #define OTA_PAL_HW_SHA256    ( 1 )
+    #else
+        #define OTA_PAL_HW_SHA256    ( 0 )
+    #endif
+#endif
+
+#if ( OTA_PAL_HW_SHA256 == 1 )
+    typedef sha_ctx_t PAL_Digest_t;
+#else
+    typedef mbedtls_sha256_context PAL_Digest_t;
+#endif
+
+/**
+ * @brief Delta and compressed images are moved to the rollback slot while the new image is rebuilt in
+ * the update slot. The backup of the running image is then taken by the bootloader, once the new image
+ * is activated.
+ */
+#define OTA_STAGING_IMAGE_PTR    OTA_BACKUP_IMAGE_PTR
+
+/**
+ * @brief Set to 1 to copy the running image to the rollback slot in a low priority task while the new
+ * image is downloaded, so that activating it only writes the UCB. Only the copy mode of the bootloader
+ * takes a backup, the swap and A/B modes keep the previous image in place.
+ * A staged delta or compressed image overwrites the backup, the bootloader then copies the image again.
+ */
+#ifndef OTA_PAL_BACKGROUND_BACKUP
+    #if ( !BOOT_AB_MODE && !BOOT_SWAP_MODE )
+        #define OTA_PAL_BACKGROUND_BACKUP    ( 1 )
+    #else
+        #define OTA_PAL_BACKGROUND_BACKUP    ( 0 )
+    #endif
+#endif
+
+#if ( OTA_PAL_BACKGROUND_BACKUP == 1 )
+    #if ( BOOT_AB_MODE || BOOT_SWAP_MODE )
+        #error "OTA_PAL_BACKGROUND_BACKUP needs the copy mode of the bootloader."
+    #endif
+
+    #if ( flashserviceENABLED == 1 )
+
+/**
+ * @brief Priority of the backup among the jobs of the flash service, which runs it in idle time.
+ */
+        #ifndef OTA_PAL_BACKUP_JOB_PRIORITY
+            #define OTA_PAL_BACKUP_JOB_PRIORITY    ( 0U )
+        #endif
+    #else
+
+/**
+ * @brief Priority of the backup task, below the OTA and network tasks so that it only uses idle time.
+ */
+        #ifndef OTA_PAL_BACKUP_TASK_PRIORITY
+            #define OTA_PAL_BACKUP_TASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+        #endif
+
+        #ifndef OTA_PAL_BACKUP_TASK_STACK_SIZE
+            #define OTA_PAL_BACKUP_TASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 2 )
+        #endif
+    #endif /* if ( flashserviceENABLED == 1 ) */
+#endif /* if ( OTA_PAL_BACKGROUND_BACKUP == 1 ) */
+
+/**
+ * @brief Number of blocks written between two checkpoints of a download, 0 disables resuming downloads.
+ * A checkpoint flushes the sector cache and saves the bitmap of the received blocks in the file store,
+ * so that a download interrupted by a reset or a lost job restarts with the missing blocks only. At most
+ * this many blocks are received again, each checkpoint appends a record of about 200 bytes to the log.
+ */
+#ifndef OTA_PAL_CHECKPOINT_BLOCKS
+    #define OTA_PAL_CHECKPOINT_BLOCKS    ( 32U )
+#endif
+
+/**
+ * @brief File of the download checkpoint, also listed in the file table of the PKCS #11 PAL.
+ */
+#define OTA_PAL_CHECKPOINT_FILE     "ota_checkpoint.dat"
+
+/**
+ * @brief Magic number of a download checkpoint, "OCP1" in little endian.
+ */
+#define OTA_PAL_CHECKPOINT_MAGIC    ( 0x3150434FUL )
 
+#if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+
+/* download checkpoint, saved while the image is received in the update slot */
+    typedef struct
+    {
+        uint32_t Magic;
+        uint32_t ImageAddr;    /* update slot the image is received in */
+        uint32_t FileSize;
+        uint32_t ServerFileID;
+        uint8_t Identity[ 32 ]; /* SHA-256 of the job name, stream name and signature of the image */
+        uint8_t Bitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ]; /* bitmap of the OTA agent, a set bit is a missing block */
+    } PAL_Checkpoint_t;
+#endif
 
 /* low level file context structure */
 typedef struct
@@ -72,6 +258,11 @@ typedef struct
     const OtaFileContext_t * FileXRef;
     uint8_t * BaseAddr;
     uint32_t Size;
+    PAL_Digest_t Digest;   /* running SHA-256 of the image, updated as blocks are written in order */
+    uint32_t DigestOffset; /* number of bytes from the start of the image included in Digest */
+    bool Boosted;          /* the core clock is boosted until the file is closed or aborted */
+    uint32_t CheckpointBlocks; /* number of blocks written since the last checkpoint */
+    bool Module;           /* the file is an application module, installed to its slot on activation */
 } LL_FileContext_t;
 
 /**
@@ -86,6 +277,232 @@ const char OTA_JsonFileSignatureKey[ OTA_FILE_SIG_KEY_STR_MAX_LENGTH ] = "sig-sh
 
 static LL_FileContext_t prvPAL_CurrentFileContext;
 
+/* RAM copy of one flash sector, flash cannot be programmed from data located in XIP */
+static uint8_t prvPAL_SectorBuffer[ MFLASH_SECTOR_SIZE ];
+
+#if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+
+/* flash sector being gathered from file blocks */
+    typedef struct
+    {
+        uint32_t SectorAddr; /* address of the sector, 0 if the entry is free */
+        uint32_t BlockMask;  /* one bit for each block of the sector received */
+        uint32_t LastUse;    /* value of the use counter when the entry was last written */
+        uint8_t Data[ MFLASH_SECTOR_SIZE ];
+    } PAL_SectorCacheEntry_t;
+
+    static PAL_SectorCacheEntry_t prvPAL_SectorCache[ OTA_PAL_SECTOR_CACHE_ENTRIES ];
+    static uint32_t prvPAL_SectorCacheUse;
+
+/**
+ * @brief Program a cached sector and free its entry.
+ *
+ * @return 0 on success.
+ */
+    static int32_t prvPAL_CacheProgram( PAL_SectorCacheEntry_t * Entry );
+
+/**
+ * @brief Write a file block through the sector cache.
+ * Programs the sector once all its blocks are received.
+ *
+ * @return 0 on success.
+ */
+    static int32_t prvPAL_CacheWrite( uint8_t * pAddr,
+                                      const uint8_t * pData,
+                                      uint32_t size );
+
+/**
+ * @brief Program all the sectors in the cache.
+ *
+ * @return 0 on success.
+ */
+    static int32_t prvPAL_CacheFlush( void );
+
+/**
+ * @brief Drop all the sectors in the cache without programming them.
+ */
+    static void prvPAL_CacheDiscard( void );
+#endif /* if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 ) */
+
+/**
+ * @brief Start the SHA-256 of an image, previous state is dropped.
+ */
+static void prvPAL_DigestStart( PAL_Digest_t * Digest );
+
+/**
+ * @brief Add data to the SHA-256 of an image.
+ */
+static void prvPAL_DigestUpdate( PAL_Digest_t * Digest,
+                                 const uint8_t * pData,
+                                 uint32_t size );
+
+/**
+ * @brief Finish the SHA-256 of an image.
+ */
+static void prvPAL_DigestFinish( PAL_Digest_t * Digest,
+                                 uint8_t * pDigest );
+
+/**
+ * @brief Read a little endian 32 bit word from a byte buffer.
+ */
+static uint32_t prvPAL_ReadU32( const uint8_t * p );
+
+/**
+ * @brief Release the clock boost taken for the download, if any.
+ *
+ * @param[in] FileContext The low level file context.
+ */
+static void prvPAL_EndBoost( LL_FileContext_t * FileContext );
+
+/**
+ * @brief Copy a memory mapped flash area to another flash area, one sector at a time.
+ *
+ * @return 0 on success.
+ */
+static int32_t prvPAL_CopyFlash( uint8_t * pDest,
+                                 const uint8_t * pSrc,
+                                 uint32_t size );
+
+#if ( OTA_PAL_BACKGROUND_BACKUP == 1 )
+
+/* RAM copy of the sector being backed up, the sector buffer belongs to the download */
+    static uint8_t prvPAL_BackupBuffer[ MFLASH_SECTOR_SIZE ];
+
+/* progress of the backup, the offset of the next sector to copy and the length of the running image */
+    static uint32_t prvPAL_BackupOffset;
+    static uint32_t prvPAL_BackupSize;
+    static int32_t prvPAL_BackupResult;
+
+    #if ( flashserviceENABLED == 1 )
+/* backup job, queued while the copy runs */
+        static FlashServiceJob_t prvPAL_BackupJob;
+    #else
+/* backup task, NULL when no backup is running */
+        static TaskHandle_t volatile prvPAL_BackupTaskHandle;
+
+/* set to stop the running backup before the rollback slot is used for staging */
+        static volatile bool prvPAL_BackupStop;
+
+/**
+ * @brief Run the backup steps until the copy completes or is stopped.
+ */
+        static void prvPAL_BackupTask( void * pvParameters );
+    #endif
+
+/**
+ * @brief Copy the next sector of the running image to the rollback slot, and record the backup in the
+ * UCB after the last one. Sectors already holding the image, left by an earlier backup, are not
+ * programmed again.
+ *
+ * @return pdTRUE while sectors remain to be copied.
+ */
+    static BaseType_t prvPAL_BackupStep( void * pvContext );
+
+/**
+ * @brief Start the backup task, unless it is running or the rollback slot already holds the backup.
+ */
+    static void prvPAL_BackupStart( void );
+
+/**
+ * @brief Wait until the backup task has exited.
+ *
+ * @param[in] stop Stop the copy at the next sector instead of waiting for its completion.
+ */
+    static void prvPAL_BackupWait( bool stop );
+#endif /* if ( OTA_PAL_BACKGROUND_BACKUP == 1 ) */
+
+#if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+
+/**
+ * @brief Compute the identity of a download, the job and the image it receives.
+ */
+    static void prvPAL_CheckpointIdentity( const OtaFileContext_t * pFileContext,
+                                           uint8_t * pIdentity );
+
+/**
+ * @brief Restore the bitmap of the OTA agent from the checkpoint of the same download, if any.
+ *
+ * @param[in] pFileContext OTA file context, the agent has already marked all the blocks as missing.
+ * @param[in] BaseAddr Update slot the image is received in.
+ * @return true if the download resumes, the blocks already received stay in the update slot.
+ */
+    static bool prvPAL_CheckpointLoad( OtaFileContext_t * const pFileContext,
+                                       const uint8_t * BaseAddr );
+
+/**
+ * @brief Program the cached sectors and save the bitmap of the OTA agent.
+ * The block being written is not in the bitmap yet, it is received again after a reset.
+ *
+ * @return 0 on success.
+ */
+    static int32_t prvPAL_CheckpointSave( const OtaFileContext_t * pFileContext,
+                                          const LL_FileContext_t * FileContext );
+
+/**
+ * @brief Drop the checkpoint once the download is closed or aborted.
+ */
+    static void prvPAL_CheckpointClear( void );
+#endif /* if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 ) */
+
+/**
+ * @brief Move the received image to the staging slot and restart the image in the update slot, so that
+ * the new image can be rebuilt from it.
+ *
+ * @param[in] FileContext Low level file context of the received image.
+ * @return 0 on success.
+ */
+static int32_t prvPAL_StageImage( LL_FileContext_t * FileContext );
+
+/**
+ * @brief Append bytes to the image rebuilt in the update slot, programming the flash a whole sector at a time.
+ * The bytes may come from the sector buffer itself, as long as they are before the bytes pending in it.
+ *
+ * @param[in] FileContext Low level file context of the image, Size is the length of the image programmed so far.
+ * @param[in,out] pFill Number of bytes pending in the sector buffer.
+ * @param[in] pSrc Bytes to append.
+ * @param[in] length Number of bytes to append.
+ * @param[in] flush Program the partially filled sector at the end of the image.
+ * @return 0 on success.
+ */
+static int32_t prvPAL_ImageEmit( LL_FileContext_t * FileContext,
+                                 uint32_t * pFill,
+                                 const uint8_t * pSrc,
+                                 uint32_t length,
+                                 bool flush );
+
+/**
+ * @brief Rebuild the new image in the update slot from the delta image received there.
+ *
+ * @param[in] FileContext Low level file context of the received delta image.
+ * @return 0 on success.
+ */
+static int32_t prvPAL_ApplyDelta( LL_FileContext_t * FileContext );
+
+/**
+ * @brief Rebuild the new image in the update slot from the compressed image received there, see struct
+ * boot_lz4_header. The bootloader installs compressed images from the update slot as received, this is
+ * only needed in A/B mode, which executes the update slot in place.
+ *
+ * The signature of the job covers the compressed image, which is hashed before it is staged. The new
+ * image is checked against the length and CRC32 of the header. The decoder of the bootloader only needs
+ * the sector buffer, earlier output is read back from the memory mapped flash.
+ *
+ * @param[in] FileContext Low level file context of the received compressed image.
+ * @return 0 on success.
+ */
+static int32_t prvPAL_Decompress( LL_FileContext_t * FileContext );
+
+#if ( appmoduleENABLED == 1 )
+
+/**
+ * @brief Copies the application module staged in the update slot to the module slot not running and
+ * records it to run on trial after the reset.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+    static int32_t prvPAL_InstallModule( LL_FileContext_t * FileContext );
+#endif
+
 static LL_FileContext_t * prvPAL_GetLLFileContext( OtaFileContext_t * const C )
 {
     LL_FileContext_t * FileContext;
@@ -110,7 +527,15 @@ OtaPalImageState_t xOtaPalGetPlatformImageState( OtaFileContext_t * const pFileC
 {
     struct boot_ucb ucb;
 
-    PRINTF( "[OTA-NXP] GetPlatformImageState\r\n" );
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] GetPlatformImageState\r\n" ) );
+
+    #if ( appmoduleENABLED == 1 )
+        /* a module on trial is tested and committed as a new image, the base image is left as is */
+        if( AppModule_IsPendingCommit() == pdTRUE )
+        {
+            return OtaPalImageStatePendingCommit;
+        }
+    #endif
 
     boot_ucb_read( &ucb );
 
@@ -135,7 +560,21 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
     OtaPalStatus_t result = OtaPalSuccess;
     struct boot_ucb ucb;
 
-    PRINTF( "[OTA-NXP] SetPlatformImageState %d\r\n", eState );
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] SetPlatformImageState %d\r\n", eState ) );
+
+    #if ( appmoduleENABLED == 1 )
+        if( ( ( eState == OtaImageStateAccepted ) || ( eState == OtaImageStateRejected ) || ( eState == OtaImageStateAborted ) ) &&
+            ( AppModule_IsPendingCommit() == pdTRUE ) )
+        {
+            if( AppModule_EndTrial( ( eState == OtaImageStateAccepted ) ? pdTRUE : pdFALSE ) != pdTRUE )
+            {
+                LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during module commit\r\n" ) );
+                result = OTA_PAL_COMBINE_ERR( ( eState == OtaImageStateAccepted ) ? OtaPalCommitFailed : OtaPalRejectFailed, 0 );
+            }
+
+            return result;
+        }
+    #endif
 
     boot_ucb_read( &ucb );
 
@@ -145,35 +584,36 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
             if( ucb.state == BOOT_STATE_PENDING_COMMIT )
             {
+                /* disable watchdog before the commit, the watchdog supervisor re-arms it once the state is void */
+                boot_wdtdis();
+
                 ucb.state = BOOT_STATE_VOID;
 
                 if( 0 != boot_ucb_write( &ucb ) )
                 {
-                    PRINTF( "[OTA-NXP] FLASH operation failed during commit\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during commit\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalCommitFailed, 0 );
                 }
 
-                boot_wdtdis(); /* disable watchdog */
-
                 if( 0 != boot_overwrite_rollback() )
                 {
                     /* rollback image may be partially overwritten - do not return error as that would initiate a rollback */
-                    PRINTF( "[OTA-NXP] FLASH operation failed during overwrite\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during overwrite\r\n" ) );
                     ucb.rollback_img = NULL;
 
                     if( 0 != boot_ucb_write( &ucb ) )
                     {
-                        PRINTF( "[OTA-NXP] FLASH operation failed during commit\r\n" );
+                        LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during commit\r\n" ) );
                     }
                     else
                     {
-                        PRINTF( "[OTA-NXP] rollback disabled\r\n" );
+                        LogModule( LOG_MODULE_OTA_PAL, LOG_WARN, ( "[OTA-NXP] rollback disabled\r\n" ) );
                     }
                 }
             }
             else
             {
-                PRINTF( "[OTA-NXP] Image is not in pending commit state\r\n" );
+                LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Image is not in pending commit state\r\n" ) );
                 result = OTA_PAL_COMBINE_ERR( OtaPalCommitFailed, 0 );
             }
 
@@ -185,7 +625,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
             {
                 if( ucb.rollback_img == NULL )
                 {
-                    PRINTF( "[OTA-NXP] Attempt to reject image without possibility for rollback\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Attempt to reject image without possibility for rollback\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalRejectFailed, 0 );
                 }
 
@@ -193,7 +633,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
                 if( 0 != boot_ucb_write( &ucb ) )
                 {
-                    PRINTF( "[OTA-NXP] FLASH operation failed during reject\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during reject\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalRejectFailed, 0 );
                 }
             }
@@ -203,7 +643,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
                 if( 0 != boot_ucb_write( &ucb ) )
                 {
-                    PRINTF( "[OTA-NXP] FLASH operation failed during reject\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during reject\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalRejectFailed, 0 );
                 }
             }
@@ -216,7 +656,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
             {
                 if( ucb.rollback_img == NULL )
                 {
-                    PRINTF( "[OTA-NXP] Attempt to abort without possibility for rollback\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Attempt to abort without possibility for rollback\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalAbortFailed, 0 );
                 }
 
@@ -224,7 +664,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
                 if( 0 != boot_ucb_write( &ucb ) )
                 {
-                    PRINTF( "[OTA-NXP] FLASH operation failed during abort\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during abort\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalAbortFailed, 0 );
                 }
             }
@@ -234,7 +674,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
                 if( 0 != boot_ucb_write( &ucb ) )
                 {
-                    PRINTF( "[OTA-NXP] FLASH operation failed during abort\r\n" );
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] FLASH operation failed during abort\r\n" ) );
                     result = OTA_PAL_COMBINE_ERR( OtaPalAbortFailed, 0 );
                 }
             }
@@ -254,14 +694,33 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
 OtaPalStatus_t xOtaPalResetDevice( OtaFileContext_t * const pFileContext )
 {
-    PRINTF( "[OTA-NXP] ResetDevice\r\n" );
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] ResetDevice\r\n" ) );
     boot_cpureset();
     return OtaPalSuccess;
 }
 
 OtaPalStatus_t xOtaPalActivateNewImage( OtaFileContext_t * const pFileContext )
 {
-    PRINTF( "[OTA-NXP] ActivateNewImage\r\n" );
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] ActivateNewImage\r\n" ) );
+
+    #if ( appmoduleENABLED == 1 )
+        if( prvPAL_CurrentFileContext.Module )
+        {
+            if( prvPAL_InstallModule( &prvPAL_CurrentFileContext ) != 0 )
+            {
+                return OTA_PAL_COMBINE_ERR( OtaPalActivateFailed, 0 );
+            }
+
+            DbgConsole_Flush();
+            xOtaPalResetDevice( pFileContext );
+            return OtaPalSuccess;
+        }
+    #endif
+
+    #if ( OTA_PAL_BACKGROUND_BACKUP == 1 )
+        /* a finished backup reduces the request to a UCB write, otherwise the bootloader copies the image */
+        prvPAL_BackupWait( false );
+    #endif
 
     if( 0 != boot_update_request( OTA_UPDATE_IMAGE_PTR, OTA_BACKUP_IMAGE_PTR ) )
     {
@@ -281,7 +740,7 @@ int16_t xOtaPalWriteBlock( OtaFileContext_t * const pFileContext,
     int32_t result;
     LL_FileContext_t * FileContext;
 
-    PRINTF( "[OTA-NXP] WriteBlock %x : %x\r\n", offset, blockSize );
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] WriteBlock %x : %x\r\n", offset, blockSize ) );
 
     FileContext = prvPAL_GetLLFileContext( pFileContext );
 
@@ -290,7 +749,14 @@ int16_t xOtaPalWriteBlock( OtaFileContext_t * const pFileContext,
         return -1;
     }
 
-    result = mflash_drv_write( ( void * ) ( FileContext->BaseAddr + offset ), pData, blockSize );
+    #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+        result = prvPAL_CacheWrite( FileContext->BaseAddr + offset, pData, blockSize );
+    #else
+        result = mflash_drv_write( ( void * ) ( FileContext->BaseAddr + offset ), pData, blockSize );
+    #endif
+
+    /* the download holds off the background flash jobs */
+    FlashService_NoteForeground();
 
     if( result == 0 )
     {
@@ -302,89 +768,863 @@ int16_t xOtaPalWriteBlock( OtaFileContext_t * const pFileContext,
             /* extend file size according to highest offset */
             FileContext->Size = offset + blockSize;
         }
-    }
-
-    return result;
-}
-OtaPalStatus_t xOtaPalCloseFile( OtaFileContext_t * const pFileContext )
-{
-    OtaPalStatus_t result = OtaPalSuccess;
-    LL_FileContext_t * FileContext;
 
-    PRINTF( "[OTA-NXP] CloseFile\r\n" );
+        if( offset == FileContext->DigestOffset )
+        {
+            /* hash the block while it is still in RAM, out of order blocks are hashed from flash when the digest is read */
+            prvPAL_DigestUpdate( &FileContext->Digest, pData, blockSize );
+            FileContext->DigestOffset += blockSize;
+        }
 
-    FileContext = prvPAL_GetLLFileContext( pFileContext );
+        #if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+            if( ++FileContext->CheckpointBlocks >= OTA_PAL_CHECKPOINT_BLOCKS )
+            {
+                FileContext->CheckpointBlocks = 0;
 
-    if( FileContext == NULL )
-    {
-        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+                if( prvPAL_CheckpointSave( pFileContext, FileContext ) != 0 )
+                {
+                    LogModule( LOG_MODULE_OTA_PAL, LOG_WARN, ( "[OTA-NXP] Download checkpoint not saved\r\n" ) );
+                }
+            }
+        #endif
     }
 
-    pFileContext->pFile = NULL;
-    FileContext->FileXRef = NULL;
     return result;
 }
+#if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
 
-OtaPalStatus_t xOtaPalCreateFileForRx( OtaFileContext_t * const pFileContext )
-{
-    LL_FileContext_t * FileContext = &prvPAL_CurrentFileContext;
+    static int32_t prvPAL_CacheProgram( PAL_SectorCacheEntry_t * Entry )
+    {
+        int32_t result = mflash_drv_write( ( void * ) Entry->SectorAddr, Entry->Data, MFLASH_SECTOR_SIZE );
 
-    PRINTF( "[OTA-NXP] CreateFileForRx\r\n" );
+        Entry->SectorAddr = 0;
+        return result;
+    }
 
-    if( pFileContext->fileSize > OTA_MAX_IMAGE_SIZE )
+    static int32_t prvPAL_CacheWrite( uint8_t * pAddr,
+                                      const uint8_t * pData,
+                                      uint32_t size )
     {
-        return OTA_PAL_COMBINE_ERR( OtaPalRxFileTooLarge, 0 );
-    }
+        PAL_SectorCacheEntry_t * Entry = NULL;
+        uint32_t sector = ( uint32_t ) pAddr & ~( MFLASH_SECTOR_SIZE - 1U );
+        uint32_t offset = ( uint32_t ) pAddr - sector;
+        uint32_t i, firstBlock, lastBlock;
+        int32_t result = 0;
 
-    FileContext->FileXRef = pFileContext; /* cross reference for integrity check */
-    FileContext->BaseAddr = OTA_UPDATE_IMAGE_PTR;
-    FileContext->Size = 0;
+        for( i = 0; i < OTA_PAL_SECTOR_CACHE_ENTRIES; i++ )
+        {
+            if( prvPAL_SectorCache[ i ].SectorAddr == sector )
+            {
+                Entry = &prvPAL_SectorCache[ i ];
+                break;
+            }
+        }
 
-    pFileContext->pFile = ( uint8_t * ) FileContext;
+        if( ( ( offset % OTA_FILE_BLOCK_SIZE ) != 0 ) || ( ( offset + size ) > MFLASH_SECTOR_SIZE ) )
+        {
+            /* not a block within a single sector, program it directly after the cached part of the sector */
+            if( Entry != NULL )
+            {
+                result = prvPAL_CacheProgram( Entry );
+            }
 
-    return OtaPalSuccess;
-}
+            return ( result == 0 ) ? mflash_drv_write( pAddr, pData, size ) : result;
+        }
 
+        if( Entry == NULL )
+        {
+            /* use a free entry, or program the least recently used sector */
+            Entry = &prvPAL_SectorCache[ 0 ];
 
+            for( i = 0; ( i < OTA_PAL_SECTOR_CACHE_ENTRIES ) && ( Entry->SectorAddr != 0 ); i++ )
+            {
+                if( ( prvPAL_SectorCache[ i ].SectorAddr == 0 ) || ( prvPAL_SectorCache[ i ].LastUse < Entry->LastUse ) )
+                {
+                    Entry = &prvPAL_SectorCache[ i ];
+                }
+            }
 
-OtaPalStatus_t xOtaPalAbort( OtaFileContext_t * const pFileContext )
-{
-    OtaPalStatus_t result = OtaPalSuccess;
+            if( Entry->SectorAddr != 0 )
+            {
+                result = prvPAL_CacheProgram( Entry );
+            }
 
-    PRINTF( "[OTA-NXP] Abort\r\n" );
+            /* start from the current flash content, the blocks not received keep it */
+            ( void ) mflash_drv_read( ( void * ) sector, Entry->Data, MFLASH_SECTOR_SIZE );
+            Entry->SectorAddr = sector;
+            Entry->BlockMask = 0;
+        }
 
-    pFileContext->pFile = NULL;
-    return result;
-}
+        ( void ) DmaCopy_Memcpy( &Entry->Data[ offset ], pData, size );
+        Entry->LastUse = ++prvPAL_SectorCacheUse;
 
-OtaPalStatus_t xOtaPalOpenFileForRead( OtaFileContext_t * const pContext )
-{
-    LL_FileContext_t * FileContext = &prvPAL_CurrentFileContext;
+        if( size > 0 )
+        {
+            firstBlock = offset / OTA_FILE_BLOCK_SIZE;
+            lastBlock = ( offset + size - 1U ) / OTA_FILE_BLOCK_SIZE;
 
+            for( i = firstBlock; i <= lastBlock; i++ )
+            {
+                Entry->BlockMask |= ( 1UL << i );
+            }
+        }
 
-    FileContext->FileXRef = pContext; /* cross reference for integrity check */
-    pContext->pFile = ( uint8_t * ) FileContext;
-    pContext->fileSize = FileContext->Size;
+        if( ( result == 0 ) && ( Entry->BlockMask == ( uint32_t ) ( ( 1ULL << OTA_PAL_BLOCKS_PER_SECTOR ) - 1U ) ) )
+        {
+            result = prvPAL_CacheProgram( Entry );
+        }
 
-    return OtaPalSuccess;
-}
+        return result;
+    }
 
+    static int32_t prvPAL_CacheFlush( void )
+    {
+        int32_t result = 0;
+        uint32_t i;
 
-int32_t xOtaPalReadBlock( OtaFileContext_t * const pContext,
-                          uint32_t offset,
-                          uint8_t * pData,
-                          uint16_t blockSize )
-{
-    uint16_t bytesToRead = blockSize;
-    LL_FileContext_t * FileContext;
+        for( i = 0; i < OTA_PAL_SECTOR_CACHE_ENTRIES; i++ )
+        {
+            if( ( prvPAL_SectorCache[ i ].SectorAddr != 0 ) && ( prvPAL_CacheProgram( &prvPAL_SectorCache[ i ] ) != 0 ) )
+            {
+                result = -1;
+            }
+        }
 
-    FileContext = prvPAL_GetLLFileContext( pContext );
+        return result;
+    }
+
+    static void prvPAL_CacheDiscard( void )
+    {
+        uint32_t i;
+
+        for( i = 0; i < OTA_PAL_SECTOR_CACHE_ENTRIES; i++ )
+        {
+            prvPAL_SectorCache[ i ].SectorAddr = 0;
+        }
+    }
+
+#endif /* if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 ) */
+
+static void prvPAL_DigestStart( PAL_Digest_t * Digest )
+{
+    #if ( OTA_PAL_HW_SHA256 == 1 )
+        ( void ) SHA_Init( SHA0, Digest, kSHA_Sha256 );
+    #else
+        mbedtls_sha256_free( Digest );
+        mbedtls_sha256_init( Digest );
+        ( void ) mbedtls_sha256_starts_ret( Digest, 0 );
+    #endif
+}
+
+static void prvPAL_DigestUpdate( PAL_Digest_t * Digest,
+                                 const uint8_t * pData,
+                                 uint32_t size )
+{
+    #if ( OTA_PAL_HW_SHA256 == 1 )
+        ( void ) SHA_Update( SHA0, Digest, pData, size );
+    #else
+        ( void ) mbedtls_sha256_update_ret( Digest, pData, size );
+    #endif
+}
+
+static void prvPAL_DigestFinish( PAL_Digest_t * Digest,
+                                 uint8_t * pDigest )
+{
+    #if ( OTA_PAL_HW_SHA256 == 1 )
+        size_t digestSize = 32U;
+
+        ( void ) SHA_Finish( SHA0, Digest, pDigest, &digestSize );
+    #else
+        ( void ) mbedtls_sha256_finish_ret( Digest, pDigest );
+        mbedtls_sha256_free( Digest );
+    #endif
+}
+
+static uint32_t prvPAL_ReadU32( const uint8_t * p )
+{
+    return ( uint32_t ) p[ 0 ] | ( ( uint32_t ) p[ 1 ] << 8 ) | ( ( uint32_t ) p[ 2 ] << 16 ) | ( ( uint32_t ) p[ 3 ] << 24 );
+}
+
+static void prvPAL_EndBoost( LL_FileContext_t * FileContext )
+{
+    if( FileContext->Boosted )
+    {
+        FileContext->Boosted = false;
+        ClockScaling_Release();
+    }
+}
+
+static int32_t prvPAL_CopyFlash( uint8_t * pDest,
+                                 const uint8_t * pSrc,
+                                 uint32_t size )
+{
+    int32_t result = 0;
+    uint32_t offset, chunk;
+
+    for( offset = 0; ( offset < size ) && ( result == 0 ); offset += chunk )
+    {
+        chunk = ( ( size - offset ) > MFLASH_SECTOR_SIZE ) ? MFLASH_SECTOR_SIZE : ( size - offset );
+        result = mflash_drv_read( pSrc + offset, prvPAL_SectorBuffer, chunk );
+        result = ( result == 0 ) ? mflash_drv_write( pDest + offset, prvPAL_SectorBuffer, chunk ) : result;
+    }
+
+    return result;
+}
+
+#if ( OTA_PAL_BACKGROUND_BACKUP == 1 )
+
+    static BaseType_t prvPAL_BackupStep( void * pvContext )
+    {
+        const uint8_t * pSrc = ( const uint8_t * ) BOOT_EXEC_IMAGE_ADDR;
+        uint8_t * pDest = ( uint8_t * ) OTA_BACKUP_IMAGE_PTR;
+        uint32_t offset = prvPAL_BackupOffset;
+        uint32_t chunk;
+
+        ( void ) pvContext;
+
+        if( ( prvPAL_BackupResult == 0 ) && ( offset < prvPAL_BackupSize ) )
+        {
+            chunk = ( ( prvPAL_BackupSize - offset ) > MFLASH_SECTOR_SIZE ) ? MFLASH_SECTOR_SIZE : ( prvPAL_BackupSize - offset );
+
+            if( memcmp( pDest + offset, pSrc + offset, chunk ) != 0 )
+            {
+                prvPAL_BackupResult = mflash_drv_read( pSrc + offset, prvPAL_BackupBuffer, chunk );
+                prvPAL_BackupResult = ( prvPAL_BackupResult == 0 ) ? mflash_drv_write( pDest + offset, prvPAL_BackupBuffer, chunk ) : prvPAL_BackupResult;
+            }
+
+            prvPAL_BackupOffset = offset + chunk;
+        }
+
+        if( ( prvPAL_BackupResult == 0 ) && ( prvPAL_BackupOffset < prvPAL_BackupSize ) )
+        {
+            return pdTRUE;
+        }
+
+        if( ( prvPAL_BackupResult == 0 ) && ( boot_backup_record( pDest ) == 0 ) )
+        {
+            LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Running image backed up, %u bytes\r\n", ( unsigned ) prvPAL_BackupSize ) );
+        }
+        else
+        {
+            LogModule( LOG_MODULE_OTA_PAL, LOG_WARN, ( "[OTA-NXP] Backup of the running image failed, the bootloader takes it\r\n" ) );
+        }
+
+        return pdFALSE;
+    }
+
+    #if ( flashserviceENABLED == 0 )
+        static void prvPAL_BackupTask( void * pvParameters )
+        {
+            BaseType_t more = pdTRUE;
+
+            ( void ) pvParameters;
+
+            while( ( more == pdTRUE ) && !prvPAL_BackupStop )
+            {
+                more = prvPAL_BackupStep( NULL );
+            }
+
+            if( more == pdTRUE )
+            {
+                LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Backup of the running image stopped\r\n" ) );
+            }
+
+            prvPAL_BackupTaskHandle = NULL;
+            vTaskDelete( NULL );
+        }
+    #endif
+
+    static void prvPAL_BackupStart( void )
+    {
+        #if ( flashserviceENABLED == 1 )
+            if( ( FlashService_IsQueued( &prvPAL_BackupJob ) == pdTRUE ) || boot_backup_ready( OTA_BACKUP_IMAGE_PTR ) )
+            {
+                return;
+            }
+        #else
+            TaskHandle_t handle;
+
+            if( ( prvPAL_BackupTaskHandle != NULL ) || boot_backup_ready( OTA_BACKUP_IMAGE_PTR ) )
+            {
+                return;
+            }
+        #endif
+
+        prvPAL_BackupOffset = 0;
+        prvPAL_BackupSize = boot_image_length( ( const void * ) BOOT_EXEC_IMAGE_ADDR );
+        prvPAL_BackupResult = ( ( prvPAL_BackupSize > 0U ) && ( prvPAL_BackupSize <= OTA_IMAGE_SLOT_SIZE ) ) ? 0 : -1;
+
+        #if ( flashserviceENABLED == 1 )
+            ( void ) FlashService_Submit( &prvPAL_BackupJob, prvPAL_BackupStep, NULL, OTA_PAL_BACKUP_JOB_PRIORITY, portMAX_DELAY );
+        #else
+            prvPAL_BackupStop = false;
+
+            if( xTaskCreate( prvPAL_BackupTask,
+                             "OTA_backup",
+                             OTA_PAL_BACKUP_TASK_STACK_SIZE,
+                             NULL,
+                             OTA_PAL_BACKUP_TASK_PRIORITY | portPRIVILEGE_BIT,
+                             &handle ) == pdPASS )
+            {
+                /* the task has a lower priority, it cannot have cleared the handle yet */
+                prvPAL_BackupTaskHandle = handle;
+            }
+            else
+            {
+                LogModule( LOG_MODULE_OTA_PAL, LOG_WARN, ( "[OTA-NXP] Backup task not created\r\n" ) );
+            }
+        #endif
+    }
+
+    static void prvPAL_BackupWait( bool stop )
+    {
+        #if ( flashserviceENABLED == 1 )
+            if( !stop )
+            {
+                /* the remaining sectors are copied at once, the activation waits for them anyway */
+                FlashService_RunNow( &prvPAL_BackupJob );
+            }
+            else if( FlashService_Cancel( &prvPAL_BackupJob ) == pdTRUE )
+            {
+                LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Backup of the running image stopped\r\n" ) );
+            }
+            else
+            {
+                /* no backup running */
+            }
+        #else
+            prvPAL_BackupStop = stop;
+
+            /* polling lets the lower priority backup task run */
+            while( prvPAL_BackupTaskHandle != NULL )
+            {
+                vTaskDelay( pdMS_TO_TICKS( 10 ) );
+            }
+        #endif
+    }
+#endif /* if ( OTA_PAL_BACKGROUND_BACKUP == 1 ) */
+
+#if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+
+    static void prvPAL_CheckpointIdentity( const OtaFileContext_t * pFileContext,
+                                           uint8_t * pIdentity )
+    {
+        mbedtls_sha256_context ctx;
+
+        /* the job name and the signature tell a new job or a new image apart, the engine is busy with the image */
+        mbedtls_sha256_init( &ctx );
+        ( void ) mbedtls_sha256_starts_ret( &ctx, 0 );
+
+        if( pFileContext->pJobName != NULL )
+        {
+            ( void ) mbedtls_sha256_update_ret( &ctx, pFileContext->pJobName, strlen( ( const char * ) pFileContext->pJobName ) + 1U );
+        }
+
+        if( pFileContext->pStreamName != NULL )
+        {
+            ( void ) mbedtls_sha256_update_ret( &ctx, pFileContext->pStreamName, strlen( ( const char * ) pFileContext->pStreamName ) + 1U );
+        }
+
+        if( pFileContext->pSignature != NULL )
+        {
+            ( void ) mbedtls_sha256_update_ret( &ctx, pFileContext->pSignature->data, pFileContext->pSignature->size );
+        }
+
+        ( void ) mbedtls_sha256_finish_ret( &ctx, pIdentity );
+        mbedtls_sha256_free( &ctx );
+    }
+
+    static bool prvPAL_CheckpointLoad( OtaFileContext_t * const pFileContext,
+                                       const uint8_t * BaseAddr )
+    {
+        const PAL_Checkpoint_t * pRecord;
+        uint8_t * pData;
+        uint32_t size, i, remaining = 0;
+        uint32_t bitmapSize = ( ( ( pFileContext->fileSize + OTA_FILE_BLOCK_SIZE - 1U ) / OTA_FILE_BLOCK_SIZE ) + 7U ) / 8U;
+        uint8_t identity[ 32 ];
+        uint8_t bits;
+
+        if( !mflash_is_initialized() ||
+            ( pdTRUE != mflash_read_file( OTA_PAL_CHECKPOINT_FILE, &pData, &size ) ) ||
+            ( size != sizeof( PAL_Checkpoint_t ) ) ||
+            ( bitmapSize > OTA_MAX_BLOCK_BITMAP_SIZE ) ||
+            ( pFileContext->pRxBlockBitmap == NULL ) )
+        {
+            return false;
+        }
+
+        pRecord = ( const PAL_Checkpoint_t * ) pData;
+        prvPAL_CheckpointIdentity( pFileContext, identity );
+
+        if( ( pRecord->Magic != OTA_PAL_CHECKPOINT_MAGIC ) ||
+            ( pRecord->ImageAddr != ( uint32_t ) BaseAddr ) ||
+            ( pRecord->FileSize != pFileContext->fileSize ) ||
+            ( pRecord->ServerFileID != pFileContext->serverFileID ) ||
+            ( memcmp( pRecord->Identity, identity, sizeof( identity ) ) != 0 ) )
+        {
+            return false;
+        }
+
+        for( i = 0; i < bitmapSize; i++ )
+        {
+            for( bits = pRecord->Bitmap[ i ]; bits != 0U; bits &= ( uint8_t ) ( bits - 1U ) )
+            {
+                remaining++;
+            }
+        }
+
+        /* a download without missing blocks would never be closed, receive it again */
+        if( remaining == 0U )
+        {
+            return false;
+        }
+
+        memcpy( pFileContext->pRxBlockBitmap, pRecord->Bitmap, bitmapSize );
+        pFileContext->blocksRemaining = remaining;
+
+        LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Download resumed, %u blocks missing\r\n", ( unsigned ) remaining ) );
+        return true;
+    }
+
+    static int32_t prvPAL_CheckpointSave( const OtaFileContext_t * pFileContext,
+                                          const LL_FileContext_t * FileContext )
+    {
+        /* the file store cannot save data located in XIP, nor from the stack of the OTA agent */
+        static PAL_Checkpoint_t record;
+        uint32_t bitmapSize = ( ( ( pFileContext->fileSize + OTA_FILE_BLOCK_SIZE - 1U ) / OTA_FILE_BLOCK_SIZE ) + 7U ) / 8U;
+
+        if( !mflash_is_initialized() || ( bitmapSize > OTA_MAX_BLOCK_BITMAP_SIZE ) || ( pFileContext->pRxBlockBitmap == NULL ) )
+        {
+            return -1;
+        }
+
+        /* the bitmap may only list blocks programmed in flash */
+        #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+            if( prvPAL_CacheFlush() != 0 )
+            {
+                return -1;
+            }
+        #endif
+
+        memset( &record, 0x00, sizeof( record ) );
+        record.Magic = OTA_PAL_CHECKPOINT_MAGIC;
+        record.ImageAddr = ( uint32_t ) FileContext->BaseAddr;
+        record.FileSize = pFileContext->fileSize;
+        record.ServerFileID = pFileContext->serverFileID;
+        prvPAL_CheckpointIdentity( pFileContext, record.Identity );
+        memcpy( record.Bitmap, pFileContext->pRxBlockBitmap, bitmapSize );
+
+        return ( pdTRUE == mflash_save_file( OTA_PAL_CHECKPOINT_FILE, ( uint8_t * ) &record, sizeof( record ) ) ) ? 0 : -1;
+    }
+
+    static void prvPAL_CheckpointClear( void )
+    {
+        uint8_t * pData;
+        uint32_t size;
+
+        /* an empty record replaces the checkpoint, nothing is appended when there is none */
+        if( mflash_is_initialized() &&
+            ( pdTRUE == mflash_read_file( OTA_PAL_CHECKPOINT_FILE, &pData, &size ) ) &&
+            ( size != 0U ) )
+        {
+            ( void ) mflash_save_file( OTA_PAL_CHECKPOINT_FILE, pData, 0U );
+        }
+    }
+#endif /* if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 ) */
+
+static int32_t prvPAL_StageImage( LL_FileContext_t * FileContext )
+{
+    int32_t result;
+
+    #if ( OTA_PAL_BACKGROUND_BACKUP == 1 )
+        /* the staged image replaces the backup */
+        prvPAL_BackupWait( true );
+    #endif
+
+    /* move the received image out of the update slot, where the new image is rebuilt */
+    result = prvPAL_CopyFlash( ( uint8_t * ) OTA_STAGING_IMAGE_PTR, FileContext->BaseAddr, FileContext->Size );
+
+    if( result == 0 )
+    {
+        FileContext->Size = 0;
+    }
+
+    return result;
+}
+
+static int32_t prvPAL_ImageEmit( LL_FileContext_t * FileContext,
+                                 uint32_t * pFill,
+                                 const uint8_t * pSrc,
+                                 uint32_t length,
+                                 bool flush )
+{
+    int32_t result = 0;
+    uint32_t chunk;
+
+    while( ( result == 0 ) && ( ( length > 0 ) || ( flush && ( *pFill > 0 ) ) ) )
+    {
+        chunk = ( ( MFLASH_SECTOR_SIZE - *pFill ) < length ) ? ( MFLASH_SECTOR_SIZE - *pFill ) : length;
+
+        if( chunk > 0 )
+        {
+            ( void ) DmaCopy_Memcpy( &prvPAL_SectorBuffer[ *pFill ], pSrc, chunk );
+            *pFill += chunk;
+            pSrc += chunk;
+            length -= chunk;
+        }
+
+        if( ( *pFill == MFLASH_SECTOR_SIZE ) || ( flush && ( length == 0 ) ) )
+        {
+            if( ( FileContext->Size + *pFill ) > OTA_MAX_IMAGE_SIZE )
+            {
+                return -1;
+            }
+
+            /* hash the new image as it is programmed, for the signature check */
+            prvPAL_DigestUpdate( &FileContext->Digest, prvPAL_SectorBuffer, *pFill );
+            result = mflash_drv_write( FileContext->BaseAddr + FileContext->Size, prvPAL_SectorBuffer, *pFill );
+            FileContext->Size += *pFill;
+            FileContext->DigestOffset = FileContext->Size;
+            *pFill = 0;
+        }
+    }
+
+    return result;
+}
+
+static int32_t prvPAL_ApplyDelta( LL_FileContext_t * FileContext )
+{
+    const uint8_t * pPatch = ( const uint8_t * ) OTA_STAGING_IMAGE_PTR;
+    const uint8_t * pSource = ( const uint8_t * ) OTA_ACTIVE_IMAGE_PTR;
+    uint32_t patchSize = FileContext->Size;
+    uint32_t pos = OTA_DELTA_HEADER_SIZE;
+    uint32_t targetSize, sourceSize, offset, length, fill = 0;
+    uint8_t op;
+    int32_t result;
+
+    LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Applying delta image of %x bytes\r\n", patchSize ) );
+
+    result = prvPAL_StageImage( FileContext );
+
+    if( result != 0 )
+    {
+        return result;
+    }
+
+    /* the signature of a delta image covers the new image */
+    prvPAL_DigestStart( &FileContext->Digest );
+    FileContext->DigestOffset = 0;
+
+    targetSize = prvPAL_ReadU32( &pPatch[ 4 ] );
+    sourceSize = prvPAL_ReadU32( &pPatch[ 8 ] );
+
+    if( ( targetSize > OTA_MAX_IMAGE_SIZE ) || ( sourceSize > OTA_IMAGE_SLOT_SIZE ) )
+    {
+        return -1;
+    }
+
+    while( ( result == 0 ) && ( pos < patchSize ) )
+    {
+        op = pPatch[ pos++ ];
+
+        if( ( op == OTA_DELTA_OP_COPY ) && ( ( patchSize - pos ) >= 8U ) )
+        {
+            offset = prvPAL_ReadU32( &pPatch[ pos ] );
+            length = prvPAL_ReadU32( &pPatch[ pos + 4U ] );
+            pos += 8U;
+
+            if( ( offset > sourceSize ) || ( length > ( sourceSize - offset ) ) )
+            {
+                result = -1;
+            }
+            else
+            {
+                result = prvPAL_ImageEmit( FileContext, &fill, &pSource[ offset ], length, false );
+            }
+        }
+        else if( ( op == OTA_DELTA_OP_INSERT ) && ( ( patchSize - pos ) >= 4U ) )
+        {
+            length = prvPAL_ReadU32( &pPatch[ pos ] );
+            pos += 4U;
+
+            if( length > ( patchSize - pos ) )
+            {
+                result = -1;
+            }
+            else
+            {
+                result = prvPAL_ImageEmit( FileContext, &fill, &pPatch[ pos ], length, false );
+                pos += length;
+            }
+        }
+        else
+        {
+            result = -1;
+        }
+    }
+
+    if( result == 0 )
+    {
+        result = prvPAL_ImageEmit( FileContext, &fill, NULL, 0, true );
+    }
+
+    if( ( result == 0 ) && ( FileContext->Size != targetSize ) )
+    {
+        result = -1;
+    }
+
+    return result;
+}
+
+static int32_t prvPAL_Decompress( LL_FileContext_t * FileContext )
+{
+    const struct boot_lz4_header * pHeader = ( const struct boot_lz4_header * ) OTA_STAGING_IMAGE_PTR;
+    int32_t result;
+
+    LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Decompressing image of %x bytes\r\n", FileContext->Size ) );
+
+    /* the memory mapped window cannot be read while a sector is erased or programmed */
+    while( mflash_drv_is_busy() )
+    {
+        vTaskDelay( 1 );
+    }
+
+    /* blocks received out of order, hash the rest of the compressed image before it is moved */
+    prvPAL_DigestUpdate( &FileContext->Digest, FileContext->BaseAddr + FileContext->DigestOffset,
+                         FileContext->Size - FileContext->DigestOffset );
+
+    result = prvPAL_StageImage( FileContext );
+
+    if( result == 0 )
+    {
+        result = boot_lz4_decompress( FileContext->BaseAddr, OTA_MAX_IMAGE_SIZE, pHeader, prvPAL_SectorBuffer );
+    }
+
+    if( ( result <= 0 ) || ( CRC32_Update( 0, FileContext->BaseAddr, ( size_t ) result ) != pHeader->image_crc ) )
+    {
+        return -1;
+    }
+
+    /* the digest already covers the whole compressed image */
+    FileContext->Size = ( uint32_t ) result;
+    FileContext->DigestOffset = FileContext->Size;
+
+    return 0;
+}
+
+#if ( appmoduleENABLED == 1 )
+    static int32_t prvPAL_InstallModule( LL_FileContext_t * FileContext )
+    {
+        uint8_t * pSlot = ( uint8_t * ) AppModule_GetUpdateSlot();
+        const struct boot_module_header * pHeader;
+
+        pHeader = boot_module_validate( FileContext->BaseAddr, ( uint32_t ) pSlot );
+
+        if( ( pHeader == NULL ) ||
+            ( prvPAL_CopyFlash( pSlot, FileContext->BaseAddr, pHeader->length ) != 0 ) ||
+            ( boot_module_validate( pSlot, ( uint32_t ) pSlot ) == NULL ) ||
+            ( AppModule_Install() != pdTRUE ) )
+        {
+            LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Module not installed to 0x%08x\r\n", ( uint32_t ) pSlot ) );
+            return -1;
+        }
+
+        LogModule( LOG_MODULE_OTA_PAL, LOG_INFO, ( "[OTA-NXP] Module 0x%08x installed to 0x%08x\r\n", pHeader->version, ( uint32_t ) pSlot ) );
+
+        return 0;
+    }
+#endif /* if ( appmoduleENABLED == 1 ) */
+
+OtaPalStatus_t xOtaPalCloseFile( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t result = OtaPalSuccess;
+    LL_FileContext_t * FileContext;
+
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] CloseFile\r\n" ) );
+
+    FileContext = prvPAL_GetLLFileContext( pFileContext );
+
+    if( FileContext == NULL )
+    {
+        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+        if( prvPAL_CacheFlush() != 0 )
+        {
+            prvPAL_EndBoost( FileContext );
+            return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+        }
+    #endif
+
+    if( ( FileContext->Size >= OTA_DELTA_HEADER_SIZE ) && ( prvPAL_ReadU32( FileContext->BaseAddr ) == OTA_DELTA_MAGIC ) )
+    {
+        if( prvPAL_ApplyDelta( FileContext ) != 0 )
+        {
+            LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Invalid delta image\r\n" ) );
+            result = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+        }
+    }
+    #if ( appmoduleENABLED == 1 )
+        else if( ( FileContext->Size >= sizeof( struct boot_module_header ) ) && ( prvPAL_ReadU32( FileContext->BaseAddr ) == BOOT_MODULE_MARKER ) )
+        {
+            /* staged in the update slot and copied to the module slot on activation */
+            FileContext->Module = true;
+
+            if( boot_module_validate( FileContext->BaseAddr, AppModule_GetUpdateSlot() ) == NULL )
+            {
+                LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Module not valid or not built for slot 0x%08x\r\n",
+                                                            AppModule_GetUpdateSlot() ) );
+                result = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+            }
+        }
+    #endif
+    else if( ( FileContext->Size >= sizeof( struct boot_lz4_header ) ) && ( prvPAL_ReadU32( FileContext->BaseAddr ) == BOOT_LZ4_MARKER ) )
+    {
+        /* installed by the bootloader, except in A/B mode where the update slot is executed in place */
+        if( ( boot_lz4_length( FileContext->BaseAddr ) != FileContext->Size ) ||
+            ( BOOT_AB_MODE && ( prvPAL_Decompress( FileContext ) != 0 ) ) )
+        {
+            LogModule( LOG_MODULE_OTA_PAL, LOG_ERROR, ( "[OTA-NXP] Invalid compressed image\r\n" ) );
+            result = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+        }
+    }
+
+    #if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+        prvPAL_CheckpointClear();
+    #endif
+
+    prvPAL_EndBoost( FileContext );
+    pFileContext->pFile = NULL;
+    FileContext->FileXRef = NULL;
+    return result;
+}
+
+OtaPalStatus_t xOtaPalCreateFileForRx( OtaFileContext_t * const pFileContext )
+{
+    LL_FileContext_t * FileContext = &prvPAL_CurrentFileContext;
+    bool resumed = false;
+
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] CreateFileForRx\r\n" ) );
+
+    if( pFileContext->fileSize > OTA_MAX_IMAGE_SIZE )
+    {
+        return OTA_PAL_COMBINE_ERR( OtaPalRxFileTooLarge, 0 );
+    }
+
+    FileContext->FileXRef = pFileContext; /* cross reference for integrity check */
+    FileContext->BaseAddr = OTA_UPDATE_IMAGE_PTR;
+    FileContext->Size = 0;
+    FileContext->CheckpointBlocks = 0;
+    FileContext->Module = false;
+
+    #if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+        resumed = prvPAL_CheckpointLoad( pFileContext, FileContext->BaseAddr );
+
+        if( resumed )
+        {
+            /* the blocks already received are hashed from flash when the digest is read */
+            FileContext->Size = pFileContext->fileSize;
+        }
+        else
+        {
+            prvPAL_CheckpointClear();
+        }
+    #endif
+
+    /* Hashing, flash writes and the final decompression run at full speed until the file is closed */
+    if( !FileContext->Boosted )
+    {
+        ClockScaling_Boost();
+        FileContext->Boosted = true;
+    }
+
+    #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+        prvPAL_CacheDiscard();
+    #endif
+
+    #if ( MFLASH_ASYNC_MODE )
+
+        /* pre-erase the update slot in the background, block writes wait until it is done,
+         * a resumed download keeps the blocks already received */
+        if( !resumed &&
+            ( 0 != mflash_drv_erase_async( FileContext->BaseAddr,
+                                           ( pFileContext->fileSize + MFLASH_SECTOR_SIZE - 1U ) & ~( MFLASH_SECTOR_SIZE - 1U ),
+                                           NULL, NULL ) ) )
+        {
+            LogModule( LOG_MODULE_OTA_PAL, LOG_WARN, ( "[OTA-NXP] Pre-erase of the update slot not queued\r\n" ) );
+        }
+    #endif
+
+    #if ( OTA_PAL_BACKGROUND_BACKUP == 1 )
+        prvPAL_BackupStart();
+    #endif
+
+    prvPAL_DigestStart( &FileContext->Digest );
+    FileContext->DigestOffset = 0;
+
+    pFileContext->pFile = ( uint8_t * ) FileContext;
+
+    return OtaPalSuccess;
+}
+
+
+
+OtaPalStatus_t xOtaPalAbort( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t result = OtaPalSuccess;
+
+    LogModule( LOG_MODULE_OTA_PAL, LOG_DEBUG, ( "[OTA-NXP] Abort\r\n" ) );
+
+    #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+        prvPAL_CacheDiscard();
+    #endif
+
+    #if ( OTA_PAL_CHECKPOINT_BLOCKS > 0 )
+        prvPAL_CheckpointClear();
+    #endif
+
+    prvPAL_EndBoost( &prvPAL_CurrentFileContext );
+    pFileContext->pFile = NULL;
+    return result;
+}
+
+OtaPalStatus_t xOtaPalOpenFileForRead( OtaFileContext_t * const pContext )
+{
+    LL_FileContext_t * FileContext = &prvPAL_CurrentFileContext;
+
+
+    FileContext->FileXRef = pContext; /* cross reference for integrity check */
+    pContext->pFile = ( uint8_t * ) FileContext;
+    pContext->fileSize = FileContext->Size;
+
+    return OtaPalSuccess;
+}
+
+
+int32_t xOtaPalReadBlock( OtaFileContext_t * const pContext,
+                          uint32_t offset,
+                          uint8_t * pData,
+                          uint16_t blockSize )
+{
+    uint16_t bytesToRead = blockSize;
+    LL_FileContext_t * FileContext;
+
+    FileContext = prvPAL_GetLLFileContext( pContext );
 
     if( FileContext == NULL )
     {
         return -1;
     }
 
+    #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+        /* the flash must hold all the blocks written so far */
+        if( prvPAL_CacheFlush() != 0 )
+        {
+            return -1;
+        }
+    #endif
+
     if( ( offset + bytesToRead ) > FileContext->Size )
     {
         bytesToRead = ( FileContext->Size - offset );
@@ -392,8 +1632,85 @@ int32_t xOtaPalReadBlock( OtaFileContext_t * const pContext,
 
     if( bytesToRead > 0 )
     {
-        memcpy( pData, ( void * ) ( FileContext->BaseAddr + offset ), bytesToRead );
+        ( void ) mflash_drv_read( ( void * ) ( FileContext->BaseAddr + offset ), pData, bytesToRead );
     }
 
     return ( int32_t ) ( bytesToRead );
 }
+
+int32_t xOtaPalMapBlock( OtaFileContext_t * const pContext,
+                         uint32_t offset,
+                         uint32_t blockSize,
+                         const uint8_t ** ppData )
+{
+    uint32_t bytesToMap = blockSize;
+    LL_FileContext_t * FileContext;
+
+    FileContext = prvPAL_GetLLFileContext( pContext );
+
+    if( ( FileContext == NULL ) || ( ppData == NULL ) )
+    {
+        return -1;
+    }
+
+    #if ( OTA_PAL_SECTOR_CACHE_ENTRIES > 0 )
+        /* the flash must hold all the blocks written so far */
+        if( prvPAL_CacheFlush() != 0 )
+        {
+            return -1;
+        }
+    #endif
+
+    /* the memory mapped window cannot be read while a sector is erased or programmed */
+    while( mflash_drv_is_busy() )
+    {
+        vTaskDelay( 1 );
+    }
+
+    if( offset >= FileContext->Size )
+    {
+        bytesToMap = 0;
+    }
+    else if( bytesToMap > ( FileContext->Size - offset ) )
+    {
+        bytesToMap = FileContext->Size - offset;
+    }
+
+    *ppData = FileContext->BaseAddr + offset;
+
+    return ( int32_t ) ( bytesToMap );
+}
+
+int32_t xOtaPalGetImageDigest( OtaFileContext_t * const pContext,
+                               uint8_t * pDigest )
+{
+    LL_FileContext_t * FileContext;
+    const uint8_t * pData;
+    int32_t mapped;
+
+    FileContext = prvPAL_GetLLFileContext( pContext );
+
+    if( FileContext == NULL )
+    {
+        return -1;
+    }
+
+    if( FileContext->DigestOffset < FileContext->Size )
+    {
+        /* blocks received out of order, hash the rest of the image in place */
+        mapped = xOtaPalMapBlock( pContext, FileContext->DigestOffset,
+                                  FileContext->Size - FileContext->DigestOffset, &pData );
+
+        if( mapped < 0 )
+        {
+            return -1;
+        }
+
+        prvPAL_DigestUpdate( &FileContext->Digest, pData, ( uint32_t ) mapped );
+        FileContext->DigestOffset = FileContext->Size;
+    }
+
+    prvPAL_DigestFinish( &FileContext->Digest, pDigest );
+
+    return 0;
+}
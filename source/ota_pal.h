@@ -131,4 +131,33 @@ int32_t xOtaPalReadBlock( OtaFileContext_t * const pContext,
                           uint8_t * pData,
                           uint16_t blockSize );
 
+/**
+ * @brief Maps a block of the firmware image without copying it.
+ * The flash is memory mapped, the block is read in place once the blocks written so far are
+ * programmed. The pointer is valid until the image is written or erased again.
+ *
+ * @param[in] pContext Pointer to a context containing firmware image details.
+ * @param[in] offset Offset in bytes of the block with in the whole firmware image.
+ * @param[in] blockSize Size of the block requested.
+ * @param[out] ppData Receives the address of the block in the memory mapped flash.
+ * @return Number of bytes of the block mapped, less than blockSize at the end of the image, or
+ * < 0 if there is an error.
+ */
+int32_t xOtaPalMapBlock( OtaFileContext_t * const pContext,
+                         uint32_t offset,
+                         uint32_t blockSize,
+                         const uint8_t ** ppData );
+
+/**
+ * @brief Gets the SHA-256 digest of the firmware image received.
+ * The digest is calculated while the blocks are written, only the blocks received out of order are
+ * read back from flash. The digest can be read once per received image.
+ *
+ * @param[in] pContext Pointer to a context containing firmware image details.
+ * @param[out] pDigest Buffer of 32 bytes receiving the digest.
+ * @return 0 if successful or < 0 if there is an error.
+ */
+int32_t xOtaPalGetImageDigest( OtaFileContext_t * const pContext,
+                               uint8_t * pDigest );
+
 #endif /* OTA_PAL_H */
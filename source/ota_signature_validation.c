@@ -22,14 +22,31 @@
  * http://aws.amazon.com/freertos
  * http://www.FreeRTOS.org
  */
+#include <string.h>
+
 #include "FreeRTOS.h"
 #include "task.h"
 
 #include "ota_update.h"
 #include "fsl_debug_console.h"
 #include "ota_pal.h"
+#include "core_pkcs11_config.h"
 #include "core_pkcs11.h"
 #include "core_pki_utils.h"
+#include "pkcs11_session_pool.h"
+#include "clock_scaling.h"
+#include "crypto_worker.h"
+
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+    #include "mbedtls/pk.h"
+
+    /* Implemented by the PKCS #11 PAL. */
+    extern BaseType_t PKCS11_PAL_PreloadCodeSignKey( void );
+    extern int PKCS11_PAL_VerifyWithCachedCodeSignKey( const uint8_t * pucHash,
+                                                       size_t xHashLen,
+                                                       const uint8_t * pucSignature,
+                                                       size_t xSignatureLen );
+#endif
 
 /**
  * @brief The crypto algorithm used for the digital signature.
@@ -41,28 +58,6 @@
  */
 #define SIGNATURE_METHOD          cryptoHASH_ALGORITHM_SHA256
 
-/**
- * @brief Length of block of firmware image to be read at once from flash
- * to calculate the signature.
- */
-#define OTA_IMAGE_BLOCK_LENGTH    ( 4096 )
-
-/**
- * @brief Opens a PKCS11 Session.
- *
- * @param[out] xSession Handle to the session opened.
- * @return CKR_OK if succesful.
- */
-static CK_RV prvOpenPKCS11Session( CK_SESSION_HANDLE_PTR pSession );
-
-/**
- * @brief Closes a PKCS11 Session.
- *
- * @param[out] xSession Session to be closed.
- * @return CKR_OK if succesful.
- */
-static CK_RV prvClosePKCS11Session( CK_SESSION_HANDLE xSession );
-
 /**
  * @brief Gets the handle for a certificate stored in a PKCS11 slot.
  *
@@ -75,11 +70,30 @@ static CK_RV prvPKCS11GetCertificateHandle( CK_SESSION_HANDLE xSession,
                                             const char * pcLabelName,
                                             CK_OBJECT_HANDLE_PTR pxCertHandle );
 
+/**
+ * @brief Parameters of xValidateImageSignature(), passed to the crypto worker.
+ */
+typedef struct ValidateImageJob
+{
+    uint8_t * pFilePath;
+    char * pCertificatePath;
+    uint8_t * pSignature;
+    size_t signatureLength;
+} ValidateImageJob_t;
+
+/**
+ * @brief Validates the image signature as xValidateImageSignature(), run by the crypto worker.
+ *
+ * @param[in] pvContext The ValidateImageJob_t of the image.
+ * @return pdTRUE if the signature is valid.
+ */
+static int32_t prvValidateImageSignatureJob( void * pvContext );
+
 
 /**
  * @brief Verifies the firmware image signature using PKCS11 APIs.
- * Uses PKCS11 SHA256 hash APIS to calculate running checksum of the image and  verify
- * the signature using the certificate handle stored in a PKCS11 slot.
+ * Uses the SHA256 digest of the image calculated by the OTA PAL while the image was written and
+ * verifies the signature using the certificate handle stored in a PKCS11 slot.
  *
  * @param[in] session PKCS11 session handle being opened.
  * @param[in] certificateHandle Certificate handle used for signature validation.
@@ -132,49 +146,6 @@ static CK_RV prvPKCS11GetCertificateHandle( CK_SESSION_HANDLE xSession,
     return xResult;
 }
 
-static CK_RV prvOpenPKCS11Session( CK_SESSION_HANDLE_PTR pSession )
-{
-    /* Find the certificate */
-    CK_RV xResult;
-    CK_FUNCTION_LIST_PTR xFunctionList;
-    CK_SLOT_ID xSlotId;
-    CK_ULONG xCount = 1;
-
-    xResult = C_GetFunctionList( &xFunctionList );
-
-    if( CKR_OK == xResult )
-    {
-        xResult = xFunctionList->C_Initialize( NULL );
-    }
-
-    if( ( CKR_OK == xResult ) || ( CKR_CRYPTOKI_ALREADY_INITIALIZED == xResult ) )
-    {
-        xResult = xFunctionList->C_GetSlotList( CK_TRUE, &xSlotId, &xCount );
-    }
-
-    if( CKR_OK == xResult )
-    {
-        xResult = xFunctionList->C_OpenSession( xSlotId, CKF_SERIAL_SESSION, NULL, NULL, pSession );
-    }
-
-    return xResult;
-}
-
-static CK_RV prvClosePKCS11Session( CK_SESSION_HANDLE xSession )
-{
-    CK_RV xResult = CKR_OK;
-    CK_FUNCTION_LIST_PTR xFunctionList;
-
-    xResult = C_GetFunctionList( &xFunctionList );
-
-    if( xResult == CKR_OK )
-    {
-        xResult = xFunctionList->C_CloseSession( xSession );
-    }
-
-    return xResult;
-}
-
 CK_RV xVerifyImageSignatureUsingPKCS11( CK_SESSION_HANDLE session,
                                         CK_OBJECT_HANDLE certificateHandle,
                                         OtaFileContext_t * pFile,
@@ -185,69 +156,23 @@ CK_RV xVerifyImageSignatureUsingPKCS11( CK_SESSION_HANDLE session,
     /* The ECDSA mechanism will be used to verify the message digest. */
     CK_MECHANISM mechanism = { CKM_ECDSA, NULL, 0 };
 
-    /* SHA 256  will be used to calculate the digest. */
-    CK_MECHANISM xDigestMechanism = { CKM_SHA256, NULL, 0 };
-
     /* The buffer used to hold the calculated SHA25 digest of the image. */
     CK_BYTE digestResult[ pkcs11SHA256_DIGEST_LENGTH ] = { 0 };
-    CK_ULONG digestLength = pkcs11SHA256_DIGEST_LENGTH;
 
     CK_RV result = CKR_OK;
 
     CK_FUNCTION_LIST_PTR functionList;
 
-    /* Buffer used to fetch blocks from image to calculate the digest. */
-    static uint8_t buffer[ OTA_IMAGE_BLOCK_LENGTH ] = { 0 };
-
-    size_t offset = 0, bufLength;
-
     result = C_GetFunctionList( &functionList );
 
-    /* Calculate the digest of the image. */
+    /* Get the digest of the image, calculated while the image was received. */
     if( result == CKR_OK )
     {
-        result = functionList->C_DigestInit( session,
-                                             &xDigestMechanism );
-    }
-
-    do
-    {
-        bufLength = xOtaPalReadBlock( pFile, offset, buffer, OTA_IMAGE_BLOCK_LENGTH );
-
-        if( bufLength > 0 )
+        if( xOtaPalGetImageDigest( pFile, digestResult ) < 0 )
         {
-            result = functionList->C_DigestUpdate( session, buffer, bufLength );
-
-            if( result != CKR_OK )
-            {
-                break;
-            }
-
-            offset += bufLength;
+            PRINTF( "Failed to get the digest of the image.\r\n" );
+            result = CKR_GENERAL_ERROR;
         }
-    } while( bufLength == OTA_IMAGE_BLOCK_LENGTH );
-
-    if( bufLength < 0 )
-    {
-        PRINTF( "Failed to read a block of data from the image.\r\n" );
-        result = CKR_GENERAL_ERROR;
-    }
-
-    if( result == CKR_OK )
-    {
-        result = functionList->C_DigestFinal( session,
-                                              NULL,
-                                              &digestLength );
-    }
-
-    /* Now that digestLength contains the required byte length, retrieve the
-     * digest buffer.
-     */
-    if( result == CKR_OK )
-    {
-        result = functionList->C_DigestFinal( session,
-                                              digestResult,
-                                              &digestLength );
     }
 
     if( result == CKR_OK )
@@ -269,19 +194,72 @@ CK_RV xVerifyImageSignatureUsingPKCS11( CK_SESSION_HANDLE session,
     return result;
 }
 
+#if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
 
-BaseType_t xValidateImageSignature( uint8_t * pFilePath,
-                                    char * pCertificatePath,
-                                    uint8_t * pSignature,
-                                    size_t signatureLength )
+/**
+ * @brief Verifies the firmware image signature with the code signing key preloaded by the
+ * PAL when the job started, only the ECDSA verification is left.
+ *
+ * @param[in] pFile File context for the fimrware image.
+ * @param[in] pSignature Signature as received from OTA library, DER encoded.
+ * @param[in] signatureLength Length of the signature.
+ * @return 0 if the firmware image is valid, MBEDTLS_ERR_PK_KEY_INVALID_FORMAT if the PAL has
+ * no usable code signing key.
+ */
+    static int prvVerifyImageSignatureUsingPreloadedKey( OtaFileContext_t * pFile,
+                                                         const uint8_t * pSignature,
+                                                         size_t signatureLength )
+    {
+        uint8_t digestResult[ pkcs11SHA256_DIGEST_LENGTH ] = { 0 };
+        int result = -1;
+
+        if( xOtaPalGetImageDigest( pFile, digestResult ) < 0 )
+        {
+            PRINTF( "Failed to get the digest of the image.\r\n" );
+        }
+        else
+        {
+            result = PKCS11_PAL_VerifyWithCachedCodeSignKey( digestResult, sizeof( digestResult ),
+                                                             pSignature, signatureLength );
+        }
+
+        return result;
+    }
+
+#endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 ) */
+
+BaseType_t xPreloadImageSignatureKey( char * pCertificatePath )
+{
+    BaseType_t result = pdFALSE;
+
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        if( strcmp( pCertificatePath, pkcs11configLABEL_CODE_VERIFICATION_KEY ) == 0 )
+        {
+            result = PKCS11_PAL_PreloadCodeSignKey();
+        }
+    #else
+        ( void ) pCertificatePath;
+    #endif
+
+    return result;
+}
+
+static int32_t prvValidateImageSignatureJob( void * pvContext )
 {
+    ValidateImageJob_t * pJob = ( ValidateImageJob_t * ) pvContext;
+    uint8_t * pFilePath = pJob->pFilePath;
+    char * pCertificatePath = pJob->pCertificatePath;
+    uint8_t * pSignature = pJob->pSignature;
+    size_t signatureLength = pJob->signatureLength;
     OtaPalStatus_t status;
     OtaFileContext_t fileContext = { 0 };
-    CK_SESSION_HANDLE session = CKR_SESSION_HANDLE_INVALID;
+    Pkcs11Lease_t lease;
     CK_RV xPKCS11Status = CKR_OK;
-    CK_OBJECT_HANDLE certHandle;
+    CK_OBJECT_HANDLE certHandle = CK_INVALID_HANDLE;
     BaseType_t result = pdTRUE;
     uint8_t pkcs11Signature[ pkcs11ECDSA_P256_SIGNATURE_LENGTH ] = { 0 };
+    TickType_t xVerifyStart = 0;
+    BaseType_t verifiedWithPreloadedKey = pdFALSE;
 
 
     PRINTF( "Validating the integrity of OTA image.\r\n" );
@@ -296,7 +274,36 @@ BaseType_t xValidateImageSignature( uint8_t * pFilePath,
         return pdFALSE;
     }
 
-    if( result == pdTRUE )
+    #if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 )
+        if( strcmp( pCertificatePath, pkcs11configLABEL_CODE_VERIFICATION_KEY ) == 0 )
+        {
+            int verifyResult;
+
+            ClockScaling_Boost();
+            xVerifyStart = xTaskGetTickCount();
+            verifyResult = prvVerifyImageSignatureUsingPreloadedKey( &fileContext, pSignature, signatureLength );
+            ClockScaling_Release();
+
+            /* Without a usable key in the PAL, PKCS #11 is asked and reports the error. */
+            if( verifyResult != MBEDTLS_ERR_PK_KEY_INVALID_FORMAT )
+            {
+                verifiedWithPreloadedKey = pdTRUE;
+
+                if( verifyResult != 0 )
+                {
+                    PRINTF( "Image verification failed with mbed TLS error -0x%04x.\r\n", ( unsigned int ) -verifyResult );
+                    result = pdFALSE;
+                }
+                else
+                {
+                    PRINTF( "Image verified in %lu ms.\r\n",
+                            ( unsigned long ) ( ( xTaskGetTickCount() - xVerifyStart ) * portTICK_PERIOD_MS ) );
+                }
+            }
+        }
+    #endif /* if ( pkcs11configPAL_CACHE_PARSED_OBJECTS == 1 ) */
+
+    if( ( result == pdTRUE ) && ( verifiedWithPreloadedKey == pdFALSE ) )
     {
         if( PKI_mbedTLSSignatureToPkcs11Signature( pkcs11Signature, pSignature ) != 0 )
         {
@@ -305,22 +312,36 @@ BaseType_t xValidateImageSignature( uint8_t * pFilePath,
         }
     }
 
-    if( result == pdTRUE )
+    if( ( result == pdTRUE ) && ( verifiedWithPreloadedKey == pdFALSE ) )
     {
-        xPKCS11Status = prvOpenPKCS11Session( &session );
+        xPKCS11Status = xPkcs11PoolAcquire( &lease, portMAX_DELAY );
 
         if( xPKCS11Status == CKR_OK )
         {
-            xPKCS11Status = prvPKCS11GetCertificateHandle( session, pCertificatePath, &certHandle );
-        }
+            /* The pool keeps the handle of the code signing key, other labels are looked up. */
+            if( strcmp( pCertificatePath, pkcs11configLABEL_CODE_VERIFICATION_KEY ) == 0 )
+            {
+                certHandle = lease.xObjects[ ePkcs11PoolCodeSignKey ];
+            }
 
-        if( xPKCS11Status == CKR_OK )
-        {
-            xPKCS11Status = xVerifyImageSignatureUsingPKCS11( session,
-                                                              certHandle,
-                                                              &fileContext,
-                                                              pkcs11Signature,
-                                                              pkcs11ECDSA_P256_SIGNATURE_LENGTH );
+            if( certHandle == CK_INVALID_HANDLE )
+            {
+                xPKCS11Status = prvPKCS11GetCertificateHandle( lease.xSession, pCertificatePath, &certHandle );
+            }
+
+            if( xPKCS11Status == CKR_OK )
+            {
+                ClockScaling_Boost();
+                xVerifyStart = xTaskGetTickCount();
+                xPKCS11Status = xVerifyImageSignatureUsingPKCS11( lease.xSession,
+                                                                  certHandle,
+                                                                  &fileContext,
+                                                                  pkcs11Signature,
+                                                                  pkcs11ECDSA_P256_SIGNATURE_LENGTH );
+                ClockScaling_Release();
+            }
+
+            vPkcs11PoolRelease( &lease, xPKCS11Status );
         }
 
         if( xPKCS11Status != CKR_OK )
@@ -328,14 +349,30 @@ BaseType_t xValidateImageSignature( uint8_t * pFilePath,
             PRINTF( "Image verification failed with PKCS11 status %d\r\n", xPKCS11Status );
             result = pdFALSE;
         }
+        else
+        {
+            PRINTF( "Image verified in %lu ms.\r\n",
+                    ( unsigned long ) ( ( xTaskGetTickCount() - xVerifyStart ) * portTICK_PERIOD_MS ) );
+        }
     }
 
     ( void ) xOtaPalCloseFile( &fileContext );
 
-    if( session != CKR_SESSION_HANDLE_INVALID )
-    {
-        ( void ) prvClosePKCS11Session( session );
-    }
-
     return result;
 }
+
+BaseType_t xValidateImageSignature( uint8_t * pFilePath,
+                                    char * pCertificatePath,
+                                    uint8_t * pSignature,
+                                    size_t signatureLength )
+{
+    ValidateImageJob_t job;
+
+    job.pFilePath = pFilePath;
+    job.pCertificatePath = pCertificatePath;
+    job.pSignature = pSignature;
+    job.signatureLength = signatureLength;
+
+    /* The OTA task keeps its priority for the transfer, the verification runs below the periodic work. */
+    return ( BaseType_t ) CryptoWorker_Run( prvValidateImageSignatureJob, &job );
+}
@@ -34,18 +34,48 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <string.h>
+#include <stdio.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
 #include "timers.h"
+#include "event_groups.h"
 
 #include "fsl_debug_console.h"
 
+/* CMSIS core include, for the exclusive access intrinsics. */
+#include "fsl_device_registers.h"
+
 #include "aws_application_version.h"
 
 #include "ota_update.h"
 
+/* Watchdog supervisor include, the OTA agent checks in before waiting for each event. */
+#include "watchdog.h"
+
+/* Runtime log level of the module. */
+#include "log_level.h"
+
+/* Self-test include, runs the checks of a new image before it is accepted. */
+#include "self_test.h"
+
+/* Latency probes include, times the stages of a file block. */
+#include "latency_probe.h"
+
+/* Bank placement of the large buffers. */
+#include "heap_regions.h"
+
+/* Fixed size block pools. */
+#include "block_pool.h"
+
+/* Decoder of the data block messages. */
+#include "ota_cbor_block.h"
+
+/* DMA copy include, moves the payloads into the event buffers. */
+#include "dma_copy.h"
+
 /* MQTT include. */
 #include "core_mqtt_agent.h"
 
@@ -57,9 +87,13 @@
 /* OTA Library Interface include. */
 #include "ota_os_freertos.h"
 #include "ota_mqtt_interface.h"
+#include "ota_http_interface.h"
 
 #include "ota_pal.h"
 
+/* HTTP client used for the OTA data over HTTP. */
+#include "ota_http.h"
+
 /* Include for getting provisioned thing name. */
 #include "provision_interface.h"
 
@@ -72,8 +106,20 @@
 #define OTA_STATISTICS_INTERVAL_MS              ( 5000U )
 
 /**
- * @brief Delay between polling OTA agent, waiting for OTA agent to reach
- * the desired state.
+ * @brief Interval for publishing the OTA metrics to #OTA_METRICS_TOPIC_FORMAT, as a multiple of
+ * OTA_STATISTICS_INTERVAL_MS. Set to 0 to only print the metrics.
+ */
+#define OTA_METRICS_PUBLISH_INTERVAL_MS         ( 30000U )
+
+/**
+ * @brief Topic the OTA metrics are published to, formatted with the thing name.
+ * Topic and metrics are copied into an MQTT agent slab, so they must fit MQTT_AGENT_ARENA_SLAB_SIZE.
+ */
+#define OTA_METRICS_TOPIC_FORMAT                "$aws/things/%.*s/ota/metrics"
+
+/**
+ * @brief Maximum delay between checks of the OTA agent state, waiting for OTA agent to reach
+ * the desired state. Waiting tasks are woken up as soon as OTA agent has processed an event.
  */
 #define OTA_POLLING_DELAY_MS                    ( 1000U )
 
@@ -109,12 +155,55 @@
  */
 #define DATA_TOPIC_FILTER_LENGTH                ( ( uint16_t ) ( sizeof( DATA_TOPIC_FILTER ) - 1 ) )
 
+/**
+ * @brief Event group bit set by OTA agent task each time it has processed an event, and
+ * possibly changed state.
+ */
+#define OTA_STATE_EVENT_PROCESSED               ( 1U << 0 )
+
+/**
+ * @brief Maximum time the MQTT agent waits for an OTA event buffer to be released by OTA agent before
+ * dropping a received job document or data block.
+ */
+#define OTA_EVENT_BUFFER_WAIT_MS                ( 500U )
+
+
+/**
+ * @brief Maximum number of MQTT operations from OTA agent outstanding with the MQTT agent.
+ * Further operations block until one of the outstanding operations is complete.
+ */
+#define OTA_MQTT_MAX_PENDING_OPERATIONS         ( 4U )
+
+/**
+ * @brief Size of the buffer holding the topic of an outstanding MQTT operation.
+ * OTA topics contain the thing name and stream name.
+ */
+#define OTA_MQTT_TOPIC_MAX_SIZE                 ( 256U )
+
+/**
+ * @brief Size of the buffer holding the payload of an outstanding MQTT publish.
+ */
+#define OTA_MQTT_PAYLOAD_MAX_SIZE               ( 256U )
+
+/**
+ * @brief An MQTT operation enqueued by OTA agent, along with the copy of the topic and payload
+ * since OTA agent reuses its buffers once the MQTT interface function returns.
+ */
+typedef struct OtaMqttOperation
+{
+    MQTTOperation_t operation; /**< Operation enqueued with MQTT agent, must be the first member. */
+    MQTTPublishInfo_t publishInfo;
+    MQTTSubscribeInfo_t subscribeInfo;
+    char topic[ OTA_MQTT_TOPIC_MAX_SIZE ];
+    uint8_t payload[ OTA_MQTT_PAYLOAD_MAX_SIZE ];
+} OtaMqttOperation_t;
+
 
 /**
  * @brief Function used by OTA agent to publish control packets with the MQTT broker.
  * Function is registered as a callback which OTA agent and is invoked by OTA agent to request for new job
- * or to update the status of the current job. Implementation enqueues
- * an MQTT operation with the MQTT agent and the waits for publish operation to be complete.
+ * or to update the status of the current job. Implementation copies the publish into an operation from
+ * the pool and enqueues it with the MQTT agent without waiting for the publish to be complete.
  *
  * @param[in] pcTopic Topic filter which needs to be subscribed with MQTT broker.
  * @param[in] topicLen Length of the topic filter.
@@ -133,7 +222,8 @@ static OtaMqttStatus_t mqttPublish( const char * const pcTopic,
 /**
  * @brief Function used by OTA agent to subscribe to a topic filter with MQTT broker.
  * Function is registered as a callback and is invoked by OTA agent at startup. Implementation enqueues
- * an MQTT operation with the MQTT agent and the waits for subscribes operation to be complete.
+ * an MQTT operation with the MQTT agent without waiting for the subscribe operation to be complete.
+ * Operations are processed in order by the MQTT agent, so the subscribe is sent before any later publish.
  *
  * @param[in] pTopicFilter Topic filter which needs to be subscribed with MQTT broker.
  * @param[in] topicFilterLength Length of the topic filter.
@@ -148,8 +238,8 @@ static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
 /**
  * @brief Function used by OTA agent to unsubscribe a topic filter from MQTT broker.
  * Function is registered as a callback and is invoked by OTA agent invokes before
- * shutting down. Implementation enqueues an MQTT operation with the MQTT agent and the waits
- * for unsubscribe operation to be complete.
+ * shutting down. Implementation enqueues an MQTT operation with the MQTT agent without waiting
+ * for the unsubscribe operation to be complete.
  *
  * @param[in] pTopicFilter Topic filter which needs to be unsubscribed from MQTT broker.
  * @param[in] topicFilterLength Length of the topic filter.
@@ -161,6 +251,89 @@ static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
                                         uint16_t topicFilterLength,
                                         uint8_t qos );
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+/**
+ * @brief Initializes the download of a file over HTTP, implementing the OTA HTTP interface.
+ *
+ * @param[in] pUrl Pre-signed URL of the file, from the job document.
+ * @return OtaHttpSuccess if the connection to the server is established, else OtaHttpInitFailed.
+ */
+    static OtaHttpStatus_t httpInit( char * pUrl );
+
+/**
+ * @brief Downloads one file block over HTTP and signals it to OTA agent as a received file block.
+ * The response body is read directly into an OTA event buffer.
+ *
+ * @param[in] rangeStart Offset of the first byte of the block.
+ * @param[in] rangeEnd Offset of the last byte of the block, inclusive.
+ * @return OtaHttpSuccess if the block was received, else OtaHttpRequestFailed.
+ */
+    static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
+                                        uint32_t rangeEnd );
+
+/**
+ * @brief Closes the HTTP connection once the download is complete or aborted.
+ *
+ * @return OtaHttpSuccess.
+ */
+    static OtaHttpStatus_t httpDeinit( void );
+#endif
+
+/**
+ * @brief Gets a free operation from the MQTT operations pool, blocking until one is available.
+ *
+ * @return Pointer to the operation, initialized for the control lane of the MQTT agent.
+ */
+static OtaMqttOperation_t * mqttOperationGet( void );
+
+/**
+ * @brief Returns an operation to the MQTT operations pool.
+ *
+ * @param[in] pOtaOperation Pointer to the operation from mqttOperationGet().
+ */
+static void mqttOperationFree( OtaMqttOperation_t * pOtaOperation );
+
+/**
+ * @brief Callback invoked by MQTT agent when an OTA MQTT operation is complete.
+ * Logs the failed operations and returns the operation to the pool.
+ *
+ * @param[in] pOperation Pointer to the completed operation.
+ * @param[in] status Status of the MQTT operation.
+ */
+static void mqttOperationCallback( struct MQTTOperation * pOperation,
+                                   MQTTStatus_t status );
+
+/**
+ * @brief Receives the next event for OTA agent, wrapping the FreeRTOS OS interface.
+ * OTA agent calls it once it has processed the previous event, so the tasks waiting for a state
+ * change are woken up before OTA agent blocks for the next event.
+ *
+ * @param[in] pEventCtx Event context of OTA agent.
+ * @param[out] pEventMsg Event received.
+ * @param[in] timeout Unused by the FreeRTOS OS interface.
+ * @return OtaOsSuccess if an event was received.
+ */
+static OtaOsStatus_t otaReceiveEvent( OtaEventContext_t * pEventCtx,
+                                      void * pEventMsg,
+                                      uint32_t timeout );
+
+/**
+ * @brief Waits until OTA agent is, or is no longer, in a given state.
+ *
+ * @param[in] state State of OTA agent.
+ * @param[in] inState pdTRUE to wait until OTA agent is in the state, pdFALSE to wait until it leaves it.
+ */
+static void otaWaitForState( OtaState_t state,
+                             BaseType_t inState );
+
+/**
+ * @brief Receives the result of the self-test of a new image and accepts or rejects the image.
+ *
+ * @param[in] xResult pdPASS if all the self-test checks passed.
+ */
+static void otaSelfTestCallback( BaseType_t xResult );
+
 /**
  * @brief User application callback registerd with OTA agent to receive OTA notifications
  * Application callback can be extended to perform additional self test validations if needed
@@ -172,23 +345,85 @@ static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
 static void otaAppCallback( OtaJobEvent_t event,
                             const void * pData );
 
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+
+/**
+ * @brief Copies a chunk of the payload of an incoming OTA publish streamed by the MQTT agent to an event
+ * buffer, taken with the first chunk, and signals the buffer to OTA agent with the last chunk. The payload
+ * is never held in the MQTT network buffer, so that it can be smaller than a job document or file block.
+ *
+ * @param[in] eventId OTA agent event to signal.
+ * @param[in] pPublishInfo The publish, without its payload.
+ * @param[in] offset Offset of the chunk in the payload.
+ * @param[in] pChunk The chunk, NULL if the publish is dropped.
+ * @param[in] chunkLength Length of the chunk.
+ */
+    static void otaStreamPublishEvent( OtaEventId_t eventId,
+                                       const MQTTPublishInfo_t * pPublishInfo,
+                                       size_t offset,
+                                       const uint8_t * pChunk,
+                                       size_t chunkLength );
+#else
+
+/**
+ * @brief Copies the payload of an incoming OTA publish to an event buffer and signals it to OTA agent.
+ * The buffer is returned to the pool by OTA agent with OtaJobEventProcessed.
+ *
+ * @param[in] eventId OTA agent event to signal.
+ * @param[in] pPublishInfo MQTT publish structure that contains the job document or file block as payload.
+ */
+    static void otaSignalPublishEvent( OtaEventId_t eventId,
+                                       const MQTTPublishInfo_t * pPublishInfo );
+#endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
+
+/**
+ * @brief Lets the MQTT agent read the next packet only while an OTA event buffer is free, so that the
+ * blocks sent by the broker wait in the socket and the TCP window instead of being dropped and requested
+ * again after otaconfigFILE_REQUEST_WAIT_MS. The agent is woken up when a buffer is released.
+ *
+ * @return pdTRUE if an event buffer is free.
+ */
+static BaseType_t otaReceiveReady( void );
+
 /**
  * @brief Function used to submit a job document received event  to OTA agent.
  * Function allocates an event buffer from the pool and enqueues it with OTA agent task for processing.
- * Function is invoked from the main OTA MQTT packet handler function after matching the respective topic filter.
+ * Function is invoked by the MQTT agent for incoming publishes matching the registered topic filter.
  *
+ * @param[in] pCallbackContext Unused.
  * @param[in] pPublishInfo MQTT publish structure that contains the job document as payload.
+ * With MQTT_AGENT_STREAM_RECEIVE, the payload is streamed instead, see otaStreamPublishEvent().
  */
-static void mqttJobCallback( MQTTPublishInfo_t * pPublishInfo );
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+    static void mqttJobCallback( void * pCallbackContext,
+                                 const MQTTPublishInfo_t * pPublishInfo,
+                                 size_t offset,
+                                 const uint8_t * pChunk,
+                                 size_t chunkLength );
+#else
+    static void mqttJobCallback( void * pCallbackContext,
+                                 MQTTPublishInfo_t * pPublishInfo );
+#endif
 
 /**
  * @brief Function used to submit firmware block received event to OTA agent.
  * Function allocates an event from the buffer pool and enqueues it with OTA agent task for processing.
- * Function is invoked from the main OTA MQTT packet handler function after matching the respective topic filter.
+ * Function is invoked by the MQTT agent for incoming publishes matching the registered topic filter.
  *
+ * @param[in] pCallbackContext Unused.
  * @param[in] pPublishInfo MQTT publish structure that contains the firmware block as payload.
+ * With MQTT_AGENT_STREAM_RECEIVE, the payload is streamed instead, see otaStreamPublishEvent().
  */
-static void mqttDataCallback( MQTTPublishInfo_t * pPublishInfo );
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+    static void mqttDataCallback( void * pCallbackContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  size_t offset,
+                                  const uint8_t * pChunk,
+                                  size_t chunkLength );
+#else
+    static void mqttDataCallback( void * pCallbackContext,
+                                  MQTTPublishInfo_t * pPublishInfo );
+#endif
 
 /**
  * @brief Application defined callback registered with OTA agent invoked when closing an firmware image.
@@ -199,6 +434,39 @@ static void mqttDataCallback( MQTTPublishInfo_t * pPublishInfo );
  */
 static OtaPalStatus_t appCloseFileCallback( OtaFileContext_t * const pFileContext );
 
+/**
+ * @brief Application defined callback registered with OTA agent invoked when creating a firmware image.
+ * Callback creates the file and resets the OTA metrics for the new download.
+ *
+ * @param[in] pFileContext  Context containing firmware image details.
+ * @return OtaPalSuccess if the file was created, appropirate failure code otherwise.
+ */
+static OtaPalStatus_t appCreateFileCallback( OtaFileContext_t * const pFileContext );
+
+/**
+ * @brief Application defined callback registered with OTA agent invoked to write a firmware block.
+ * Callback writes the block and records the bytes written and the flash write time in the OTA metrics.
+ *
+ * @param[in] pFileContext  Context containing firmware image details.
+ * @param[in] offset Offset of the block in the image.
+ * @param[in] pData Block data.
+ * @param[in] blockSize Size of the block.
+ * @return Number of bytes written, or < 0 if there is an error.
+ */
+static int16_t appWriteBlockCallback( OtaFileContext_t * const pFileContext,
+                                      uint32_t offset,
+                                      uint8_t * const pData,
+                                      uint32_t blockSize );
+
+/**
+ * @brief Publishes the OTA metrics without blocking the timer service task.
+ *
+ * @param[in] pPayload Metrics in JSON format.
+ * @param[in] payloadLength Length of the metrics.
+ */
+static void prvPublishOTAMetrics( const char * pPayload,
+                                  size_t payloadLength );
+
 
 /**
  * @brief Structure used to encode OTA application firmware version.
@@ -217,19 +485,88 @@ const AppVersion32_t appFirmwareVersion =
 static TimerHandle_t otaStatsTimer = NULL;
 
 /**
- * @brief Mutex used to handle thread safety while fetching and freeing OTA event buffers.
+ * @brief Period of the statistics timer, changed at run time by xOTASetStatisticsInterval().
+ */
+static volatile uint32_t otaStatisticsIntervalMs = OTA_STATISTICS_INTERVAL_MS;
+
+/**
+ * @brief Progress of the current download, updated by OTA agent task as blocks are written to flash
+ * and read by the statistics timer.
+ */
+typedef struct OtaMetrics
+{
+    uint32_t fileSize;         /**< Size of the image being downloaded. */
+    uint32_t bytesWritten;     /**< Bytes of the image written to flash. */
+    uint32_t blocksWritten;    /**< Blocks written to flash. */
+    uint32_t writeTicksTotal;  /**< Total time spent writing blocks to flash, in ticks. */
+    uint32_t writeTicksMax;    /**< Longest block write to flash, in ticks. */
+    TickType_t startTime;      /**< Tick count when the image was created. */
+    TickType_t lastReportTime; /**< Tick count of the previous report, for the instantaneous rate. */
+    uint32_t lastReportBytes;  /**< Bytes written at the previous report. */
+} OtaMetrics_t;
+
+/**
+ * @brief OTA metrics of the current download.
+ */
+static OtaMetrics_t otaMetrics;
+
+#if ( latencyprobeENABLED == 1 )
+
+/**
+ * @brief Cycle count when the OTA agent took its last event, the start of the decode probe.
  */
-static SemaphoreHandle_t bufferMutex;
+    static uint32_t otaEventTakenCycles = 0;
+#endif
 
 /**
- * @breif Semaphore used to wait for completion of an MQTT operation by the MQTT aagent.
+ * @brief Thing name used in the OTA metrics topic.
  */
-static SemaphoreHandle_t opSemaphore;
+static const char * otaThingName = NULL;
 
 /**
- * @brief A global variable used to track the status of an MQTT operation.
+ * @brief Length of the thing name.
  */
-static MQTTStatus_t opStatus;
+static uint32_t otaThingNameLength = 0;
+
+/**
+ * @brief MQTT agent instance serving the OTA topics, NULL for the telemetry connection.
+ */
+static MQTTAgentHandle_t xOtaAgent = NULL;
+
+/**
+ * @brief Counting semaphore of the free OTA event buffers. A task waiting for a buffer is woken up
+ * when OTA agent releases one.
+ */
+static SemaphoreHandle_t bufferSemaphore;
+
+/**
+ * @brief Counting semaphore of the free operations in the MQTT operations pool.
+ */
+static SemaphoreHandle_t opPoolSemaphore;
+
+/**
+ * @brief Event group signalled when OTA agent has processed an event, used to wait for an OTA agent
+ * state change without polling.
+ */
+static EventGroupHandle_t otaStateEventGroup;
+
+#if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+
+/**
+ * @brief Storage of the synchronization objects, of the task and of the statistics timer of OTA.
+ */
+    static StaticSemaphore_t bufferSemaphoreBuffer;
+    static StaticSemaphore_t opPoolSemaphoreBuffer;
+    static StaticEventGroup_t otaStateEventGroupBuffer;
+    static StaticTask_t otaTaskBuffer;
+    static StackType_t otaTaskStack[ otaconfigSTACK_SIZE ];
+    static StaticTimer_t otaStatsTimerBuffer;
+#endif
+
+/**
+ * @brief Pool of MQTT operations used to keep several OTA MQTT operations outstanding with the MQTT agent.
+ */
+BLOCK_POOL_DEFINE( opPool, OtaMqttOperation_t, OTA_MQTT_MAX_PENDING_OPERATIONS );
 
 /**
  * @brief Application allocated buffer used to store the OTA firmware image file path.
@@ -251,8 +588,10 @@ static uint8_t streamName[ OTA_MAX_STREAM_NAME_SIZE ];
 
 /**
  * @brief Application allocated buffer used internally by OTA agent to decode a packet received from broker.
+ * Placed in the SDRAM or USB_RAM to leave SRAM_0_1_2_3 to the heap and the task stacks. Each
+ * packet is decoded into it before it is read, so it is not cleared at startup.
  */
-static uint8_t decodeMem[ ( 1U << otaconfigLOG2_FILE_BLOCK_SIZE ) ];
+static uint8_t decodeMem[ ( 1U << otaconfigLOG2_FILE_BLOCK_SIZE ) ] heapregionsBULK_NOINIT;
 
 /**
  * @brief Application allocated buffer used by OTA agent to record the bitmap of the firmware blocks received.
@@ -264,7 +603,7 @@ static uint8_t bitmap[ OTA_MAX_BLOCK_BITMAP_SIZE ];
  * The pool is statically allocated with a maximum size set to number of concurrent data blocks received in
  * one window of OTA stream.
  */
-static OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
+BLOCK_POOL_DEFINE( eventBufferPool, OtaEventData_t, otaconfigMAX_NUM_OTA_DATA_BUFFERS );
 
 /**
  * @brief structure used to pass application allocated buffers to OTA agent.
@@ -288,7 +627,7 @@ static OtaInterfaces_t otaInterface =
     /* Initialize OTA library OS Interface. */
     .os.event.init             = OtaInitEvent_FreeRTOS,
     .os.event.send             = OtaSendEvent_FreeRTOS,
-    .os.event.recv             = OtaReceiveEvent_FreeRTOS,
+    .os.event.recv             = otaReceiveEvent,
     .os.event.deinit           = OtaDeinitEvent_FreeRTOS,
     .os.timer.start            = OtaStartTimer_FreeRTOS,
     .os.timer.stop             = OtaStopTimer_FreeRTOS,
@@ -301,15 +640,22 @@ static OtaInterfaces_t otaInterface =
     .mqtt.publish              = mqttPublish,
     .mqtt.unsubscribe          = mqttUnsubscribe,
 
+    #if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+        /* Initialize the OTA library HTTP Interface.*/
+        .http.init                 = httpInit,
+        .http.request              = httpRequest,
+        .http.deinit               = httpDeinit,
+    #endif
+
     /* Initialize the OTA library PAL Interface.*/
     .pal.getPlatformImageState = xOtaPalGetPlatformImageState,
     .pal.setPlatformImageState = xOtaPalSetPlatformImageState,
-    .pal.writeBlock            = xOtaPalWriteBlock,
+    .pal.writeBlock            = appWriteBlockCallback,
     .pal.activate              = xOtaPalActivateNewImage,
     .pal.closeFile             = appCloseFileCallback,
     .pal.reset                 = xOtaPalResetDevice,
     .pal.abort                 = xOtaPalAbort,
-    .pal.createFile            = xOtaPalCreateFileForRx
+    .pal.createFile            = appCreateFileCallback
 };
 
 /*-----------------------------------------------------------*/
@@ -317,44 +663,97 @@ static OtaInterfaces_t otaInterface =
 
 static void otaEventBufferFree( OtaEventData_t * const pxBuffer )
 {
-    if( xSemaphoreTake( bufferMutex, portMAX_DELAY ) == pdTRUE )
-    {
-        pxBuffer->bufferUsed = false;
-        ( void ) xSemaphoreGive( bufferMutex );
-    }
-    else
+    BaseType_t xWasExhausted = ( uxSemaphoreGetCount( bufferSemaphore ) == 0U ) ? pdTRUE : pdFALSE;
+
+    pxBuffer->bufferUsed = false;
+    BlockPool_Free( &eventBufferPool, pxBuffer );
+
+    /* Wake up a task waiting for a free buffer. */
+    ( void ) xSemaphoreGive( bufferSemaphore );
+
+    /* The MQTT agent stopped reading the socket when the last buffer was taken. */
+    if( xWasExhausted == pdTRUE )
     {
-        PRINTF( "Failed to get buffer semaphore in free" );
+        MQTTAgent_Wakeup( xOtaAgent );
     }
 }
 
 /*-----------------------------------------------------------*/
 
+static BaseType_t otaReceiveReady( void )
+{
+    return ( uxSemaphoreGetCount( bufferSemaphore ) > 0U ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
 OtaEventData_t * otaEventBufferGet( void )
 {
-    uint32_t ulIndex = 0;
     OtaEventData_t * pFreeBuffer = NULL;
 
-    if( xSemaphoreTake( bufferMutex, portMAX_DELAY ) == pdTRUE )
+    /* A successful take guarantees that a buffer is free in the pool. */
+    if( xSemaphoreTake( bufferSemaphore, pdMS_TO_TICKS( OTA_EVENT_BUFFER_WAIT_MS ) ) == pdTRUE )
     {
-        for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
-        {
-            if( eventBuffer[ ulIndex ].bufferUsed == false )
-            {
-                eventBuffer[ ulIndex ].bufferUsed = true;
-                pFreeBuffer = &eventBuffer[ ulIndex ];
-                break;
-            }
-        }
-
-        ( void ) xSemaphoreGive( bufferMutex );
+        pFreeBuffer = ( OtaEventData_t * ) BlockPool_Alloc( &eventBufferPool );
+        configASSERT( pFreeBuffer != NULL );
+        pFreeBuffer->bufferUsed = true;
     }
-    else
+
+    return pFreeBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaOsStatus_t otaReceiveEvent( OtaEventContext_t * pEventCtx,
+                                      void * pEventMsg,
+                                      uint32_t timeout )
+{
+    OtaOsStatus_t status;
+
+    ( void ) xEventGroupSetBits( otaStateEventGroup, OTA_STATE_EVENT_PROCESSED );
+
+    Watchdog_CheckIn( WATCHDOG_CLIENT_OTA_AGENT );
+
+    status = OtaReceiveEvent_FreeRTOS( pEventCtx, pEventMsg, timeout );
+
+    #if ( latencyprobeENABLED == 1 )
+        /* The OTA library decodes a block between taking its event and calling appWriteBlockCallback(). */
+        otaEventTakenCycles = PROBE_TIMESTAMP();
+    #endif
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void otaWaitForState( OtaState_t state,
+                             BaseType_t inState )
+{
+    /* The bit is set after every event processed by OTA agent, re-check the state each time. The bit
+     * stays set until the wait returns, so a state change between the check and the wait is not missed. */
+    while( ( OTA_GetState() == state ) != ( inState == pdTRUE ) )
     {
-        PRINTF( "Failed to get buffer semaphore in get" );
+        ( void ) xEventGroupWaitBits( otaStateEventGroup,
+                                      OTA_STATE_EVENT_PROCESSED,
+                                      pdTRUE,
+                                      pdFALSE,
+                                      pdMS_TO_TICKS( OTA_POLLING_DELAY_MS ) );
     }
+}
 
-    return pFreeBuffer;
+/*-----------------------------------------------------------*/
+
+static void otaSelfTestCallback( BaseType_t xResult )
+{
+    OtaErr_t err;
+
+    err = OTA_SetImageState( ( xResult == pdPASS ) ? OtaImageStateAccepted : OtaImageStateRejected );
+
+    if( err != OtaErrNone )
+    {
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( " Failed to set image state as %s.\r\n",
+                                                ( xResult == pdPASS ) ? "accepted" : "rejected" ) );
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -362,12 +761,11 @@ OtaEventData_t * otaEventBufferGet( void )
 static void otaAppCallback( OtaJobEvent_t event,
                             const void * pData )
 {
-    OtaErr_t err = OtaErrUninitialized;
 
     /* OTA job is completed. so delete the MQTT and network connection. */
     if( event == OtaJobEventActivate )
     {
-        PRINTF( "Received OtaJobEventActivate callback from OTA Agent.\r\n" );
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( "Received OtaJobEventActivate callback from OTA Agent.\r\n" ) );
 
         /* OTA job is completed. so delete the network connection. */
         /*MQTT_Disconnect( &mqttContext ); */
@@ -376,7 +774,7 @@ static void otaAppCallback( OtaJobEvent_t event,
         OTA_ActivateNewImage();
 
         /* We should never get here as new image activation must reset the device.*/
-        PRINTF( "New image activation failed.\r\n" );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "New image activation failed.\r\n" ) );
 
         for( ; ; )
         {
@@ -384,25 +782,18 @@ static void otaAppCallback( OtaJobEvent_t event,
     }
     else if( event == OtaJobEventFail )
     {
-        PRINTF( "Received OtaJobEventFail callback from OTA Agent.\r\n" );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Received OtaJobEventFail callback from OTA Agent.\r\n" ) );
 
         /* Nothing special to do. The OTA agent handles it. */
     }
     else if( event == OtaJobEventStartTest )
     {
-        /* This demo just accepts the image since it was a good OTA update and networking
-         * and services are all working (or we would not have made it this far). If this
-         * were some custom device that wants to test other things before validating new
-         * image, this would be the place to kick off those tests before calling
-         * OTA_SetImageState() with the final result of either accepted or rejected. */
+        /* Networking and the OTA services work, or we would not have made it this far. The checks
+         * registered with SelfTest_Register() run concurrently and the image is accepted as soon as
+         * they all pass, or at once when there is none. */
 
-        PRINTF( "Received OtaJobEventStartTest callback from OTA Agent.\r\n" );
-        err = OTA_SetImageState( OtaImageStateAccepted );
-
-        if( err != OtaErrNone )
-        {
-            PRINTF( " Failed to set image state as accepted.\r\n" );
-        }
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( "Received OtaJobEventStartTest callback from OTA Agent.\r\n" ) );
+        ( void ) SelfTest_Start( otaSelfTestCallback );
     }
     else if( event == OtaJobEventProcessed )
     {
@@ -411,126 +802,298 @@ static void otaAppCallback( OtaJobEvent_t event,
             otaEventBufferFree( ( OtaEventData_t * ) pData );
         }
     }
+
+    /* Job events may come with an OTA agent state change. */
+    ( void ) xEventGroupSetBits( otaStateEventGroup, OTA_STATE_EVENT_PROCESSED );
 }
 
 /*-----------------------------------------------------------*/
 
-static void mqttJobCallback( MQTTPublishInfo_t * pPublishInfo )
-{
-    OtaEventData_t * pData;
-    OtaEventMsg_t eventMsg = { 0 };
+#if ( MQTT_AGENT_STREAM_RECEIVE == 0 )
+
+    static void otaSignalPublishEvent( OtaEventId_t eventId,
+                                       const MQTTPublishInfo_t * pPublishInfo )
+    {
+        OtaEventData_t * pData;
+        OtaEventMsg_t eventMsg = { 0 };
+
+        /* The OTA library decodes the blocks from the event buffer it owns, so the payload is copied once
+         * from the MQTT network buffer, which is reused for the next incoming packet. */
+        if( pPublishInfo->payloadLength > sizeof( pData->data ) )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_WARN, ( "OTA packet of %u bytes does not fit an event buffer, dropping the packet.\r\n",
+                                                   ( unsigned int ) pPublishInfo->payloadLength ) );
+        }
+        else
+        {
+            pData = otaEventBufferGet();
+
+            if( pData != NULL )
+            {
+                ( void ) DmaCopy_Memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+                pData->dataLength = pPublishInfo->payloadLength;
+                eventMsg.eventId = eventId;
+                eventMsg.pEventData = pData;
+
+                if( OTA_SignalEvent( &eventMsg ) != true )
+                {
+                    /* OTA agent does not own the buffer, return it to the pool. */
+                    LogModule( LOG_MODULE_OTA, LOG_WARN, ( "Failed to signal OTA event, dropping the packet.\r\n" ) );
+                    otaEventBufferFree( pData );
+                }
+            }
+            else
+            {
+                LogModule( LOG_MODULE_OTA, LOG_WARN, ( "No OTA data buffer released within %u ms, dropping the packet.\r\n",
+                                                       OTA_EVENT_BUFFER_WAIT_MS ) );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 0 ) */
 
-    pData = otaEventBufferGet();
+#if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
 
-    if( pData != NULL )
+    static void otaStreamPublishEvent( OtaEventId_t eventId,
+                                       const MQTTPublishInfo_t * pPublishInfo,
+                                       size_t offset,
+                                       const uint8_t * pChunk,
+                                       size_t chunkLength )
     {
-        memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
-        pData->dataLength = pPublishInfo->payloadLength;
-        eventMsg.eventId = OtaAgentEventReceivedJobDocument;
-        eventMsg.pEventData = pData;
+        /* The agent streams one publish at a time, from its own task. */
+        static OtaEventData_t * pData = NULL;
+        OtaEventMsg_t eventMsg = { 0 };
 
-        /* Send job document received event. */
-        OTA_SignalEvent( &eventMsg );
+        if( offset == 0U )
+        {
+            if( pPublishInfo->payloadLength > sizeof( pData->data ) )
+            {
+                LogModule( LOG_MODULE_OTA, LOG_WARN, ( "OTA packet of %u bytes does not fit an event buffer, dropping the packet.\r\n",
+                                                       ( unsigned int ) pPublishInfo->payloadLength ) );
+            }
+            else if( pChunk != NULL )
+            {
+                pData = otaEventBufferGet();
+
+                if( pData == NULL )
+                {
+                    LogModule( LOG_MODULE_OTA, LOG_WARN, ( "No OTA data buffer released within %u ms, dropping the packet.\r\n",
+                                                           OTA_EVENT_BUFFER_WAIT_MS ) );
+                }
+            }
+            else
+            {
+                /* Dropped before the first chunk. */
+            }
+        }
+
+        if( pData == NULL )
+        {
+            /* The packet is dropped, the rest of its payload is discarded. */
+        }
+        else if( pChunk == NULL )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_WARN, ( "OTA packet interrupted after %u bytes, dropping the packet.\r\n",
+                                                   ( unsigned int ) offset ) );
+            otaEventBufferFree( pData );
+            pData = NULL;
+        }
+        else
+        {
+            ( void ) DmaCopy_Memcpy( &pData->data[ offset ], pChunk, chunkLength );
+
+            if( ( offset + chunkLength ) == pPublishInfo->payloadLength )
+            {
+                pData->dataLength = pPublishInfo->payloadLength;
+                eventMsg.eventId = eventId;
+                eventMsg.pEventData = pData;
+
+                if( OTA_SignalEvent( &eventMsg ) != true )
+                {
+                    /* OTA agent does not own the buffer, return it to the pool. */
+                    LogModule( LOG_MODULE_OTA, LOG_WARN, ( "Failed to signal OTA event, dropping the packet.\r\n" ) );
+                    otaEventBufferFree( pData );
+                }
+
+                pData = NULL;
+            }
+        }
     }
-    else
+
+/*-----------------------------------------------------------*/
+
+    static void mqttJobCallback( void * pCallbackContext,
+                                 const MQTTPublishInfo_t * pPublishInfo,
+                                 size_t offset,
+                                 const uint8_t * pChunk,
+                                 size_t chunkLength )
     {
-        PRINTF( "No OTA data buffers available.\r\n" );
+        ( void ) pCallbackContext;
+
+        /* Send job document received event with the last chunk. */
+        otaStreamPublishEvent( OtaAgentEventReceivedJobDocument, pPublishInfo, offset, pChunk, chunkLength );
     }
-}
 
 /*-----------------------------------------------------------*/
 
-static void mqttDataCallback( MQTTPublishInfo_t * pPublishInfo )
-{
-    OtaEventData_t * pData;
-    OtaEventMsg_t eventMsg = { 0 };
+    static void mqttDataCallback( void * pCallbackContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  size_t offset,
+                                  const uint8_t * pChunk,
+                                  size_t chunkLength )
+    {
+        ( void ) pCallbackContext;
+
+        /* Send file block received event with the last chunk. */
+        PROBE_BEGIN( PROBE_OTA_DATA );
+        otaStreamPublishEvent( OtaAgentEventReceivedFileBlock, pPublishInfo, offset, pChunk, chunkLength );
+        PROBE_END( PROBE_OTA_DATA );
+    }
 
-    pData = otaEventBufferGet();
+#else /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
 
-    if( pData != NULL )
+    static void mqttJobCallback( void * pCallbackContext,
+                                 MQTTPublishInfo_t * pPublishInfo )
     {
-        memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
-        pData->dataLength = pPublishInfo->payloadLength;
-        eventMsg.eventId = OtaAgentEventReceivedFileBlock;
-        eventMsg.pEventData = pData;
+        ( void ) pCallbackContext;
 
         /* Send job document received event. */
-        OTA_SignalEvent( &eventMsg );
+        otaSignalPublishEvent( OtaAgentEventReceivedJobDocument, pPublishInfo );
     }
-    else
+
+/*-----------------------------------------------------------*/
+
+    static void mqttDataCallback( void * pCallbackContext,
+                                  MQTTPublishInfo_t * pPublishInfo )
     {
-        PRINTF( "No OTA data buffers available.\r\n" );
+        ( void ) pCallbackContext;
+
+        /* Send file block received event. */
+        PROBE_BEGIN( PROBE_OTA_DATA );
+        otaSignalPublishEvent( OtaAgentEventReceivedFileBlock, pPublishInfo );
+        PROBE_END( PROBE_OTA_DATA );
     }
-}
+
+#endif /* if ( MQTT_AGENT_STREAM_RECEIVE == 1 ) */
 
 /*-----------------------------------------------------------*/
 
-BaseType_t xOTAProcessMQTTEvent( MQTTContext_t * pMQTTContext,
-                                 struct MQTTPacketInfo * pPacketInfo,
-                                 struct MQTTDeserializedInfo * pDeserializedInfo )
-{
-    BaseType_t result = pdFALSE;
-    bool isMatched = false;
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
 
-    assert( pMQTTContext != NULL );
-    assert( pPacketInfo != NULL );
-    assert( pDeserializedInfo != NULL );
+    static OtaHttpStatus_t httpInit( char * pUrl )
+    {
+        return ( xOtaHttpInit( pUrl ) == pdTRUE ) ? OtaHttpSuccess : OtaHttpInitFailed;
+    }
 
-    /* Handle incoming publish. The lower 4 bits of the publish packet
-     * type is used for the dup, QoS, and retain flags. Hence masking
-     * out the lower bits to check if the packet is publish. */
-    if( ( pPacketInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+/*-----------------------------------------------------------*/
+
+    static OtaHttpStatus_t httpRequest( uint32_t rangeStart,
+                                        uint32_t rangeEnd )
     {
-        assert( pDeserializedInfo->pPublishInfo != NULL );
-        /* Handle incoming publish. */
-        MQTT_MatchTopic( pDeserializedInfo->pPublishInfo->pTopicName,
-                         pDeserializedInfo->pPublishInfo->topicNameLength,
-                         JOB_RESPONSE_TOPIC_FILTER,
-                         JOB_RESPONSE_TOPIC_FILTER_LENGTH, &isMatched );
+        OtaHttpStatus_t status = OtaHttpRequestFailed;
+        OtaEventData_t * pData;
+        OtaEventMsg_t eventMsg = { 0 };
+        size_t received = 0;
+
+        pData = otaEventBufferGet();
 
-        if( isMatched == true )
+        if( pData == NULL )
         {
-            mqttJobCallback( pDeserializedInfo->pPublishInfo );
-            result = pdTRUE;
+            LogModule( LOG_MODULE_OTA, LOG_WARN, ( "No OTA data buffer released within %u ms, HTTP request not sent.\r\n",
+                                                   OTA_EVENT_BUFFER_WAIT_MS ) );
         }
-
-        if( isMatched == false )
+        else if( xOtaHttpGetRange( rangeStart, rangeEnd, pData->data, sizeof( pData->data ), &received ) != pdTRUE )
         {
-            MQTT_MatchTopic( pDeserializedInfo->pPublishInfo->pTopicName,
-                             pDeserializedInfo->pPublishInfo->topicNameLength,
-                             JOB_NOTIFICATION_TOPIC_FILTER,
-                             JOB_NOTIFICATION_TOPIC_FILTER_LENGTH, &isMatched );
-
-            if( isMatched == true )
-            {
-                mqttJobCallback( pDeserializedInfo->pPublishInfo );
-                result = pdTRUE;
-            }
+            otaEventBufferFree( pData );
         }
-
-        if( isMatched == false )
+        else
         {
-            MQTT_MatchTopic( pDeserializedInfo->pPublishInfo->pTopicName,
-                             pDeserializedInfo->pPublishInfo->topicNameLength,
-                             DATA_TOPIC_FILTER,
-                             DATA_TOPIC_FILTER_LENGTH, &isMatched );
+            pData->dataLength = received;
+            eventMsg.eventId = OtaAgentEventReceivedFileBlock;
+            eventMsg.pEventData = pData;
 
-            if( isMatched == true )
+            if( OTA_SignalEvent( &eventMsg ) == true )
+            {
+                status = OtaHttpSuccess;
+            }
+            else
             {
-                mqttDataCallback( pDeserializedInfo->pPublishInfo );
-                result = pdTRUE;
+                otaEventBufferFree( pData );
             }
         }
+
+        return status;
     }
 
-    return result;
+/*-----------------------------------------------------------*/
+
+    static OtaHttpStatus_t httpDeinit( void )
+    {
+        vOtaHttpDeinit();
+
+        return OtaHttpSuccess;
+    }
+
+/*-----------------------------------------------------------*/
+
+#endif /* if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP ) */
+
+static OtaMqttOperation_t * mqttOperationGet( void )
+{
+    OtaMqttOperation_t * pOtaOperation;
+
+    /* Blocks until one of the outstanding operations is complete. */
+    ( void ) xSemaphoreTake( opPoolSemaphore, portMAX_DELAY );
+
+    pOtaOperation = ( OtaMqttOperation_t * ) BlockPool_Alloc( &opPool );
+    configASSERT( pOtaOperation != NULL );
+
+    memset( &pOtaOperation->operation, 0x00, sizeof( pOtaOperation->operation ) );
+    memset( &pOtaOperation->publishInfo, 0x00, sizeof( pOtaOperation->publishInfo ) );
+    memset( &pOtaOperation->subscribeInfo, 0x00, sizeof( pOtaOperation->subscribeInfo ) );
+    pOtaOperation->operation.callback = mqttOperationCallback;
+    pOtaOperation->operation.priority = MQTT_AGENT_PRIORITY_CONTROL;
+
+    return pOtaOperation;
+}
+
+static void mqttOperationFree( OtaMqttOperation_t * pOtaOperation )
+{
+    BlockPool_Free( &opPool, pOtaOperation );
+
+    ( void ) xSemaphoreGive( opPoolSemaphore );
 }
 
+/*-----------------------------------------------------------*/
+
 static void mqttOperationCallback( struct MQTTOperation * pOperation,
                                    MQTTStatus_t status )
 {
-    opStatus = status;
-    xSemaphoreGive( opSemaphore );
+    OtaMqttOperation_t * pOtaOperation = ( OtaMqttOperation_t * ) pOperation;
+
+    if( status != MQTTSuccess )
+    {
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "OTA MQTT operation %d on topic %s failed, error = %d.\r\n",
+                                                pOperation->type,
+                                                pOtaOperation->topic,
+                                                status ) );
+    }
+    else if( pOperation->type == MQTT_OP_SUBSCRIBE )
+    {
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( "Subscribed to topic %s.\r\n", pOtaOperation->topic ) );
+    }
+    else if( pOperation->type == MQTT_OP_UNSUBSCRIBE )
+    {
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( "Unsubscribed topic %s.\r\n", pOtaOperation->topic ) );
+    }
+    else
+    {
+        /* Publish completed. */
+    }
+
+    mqttOperationFree( pOtaOperation );
 }
 
 
@@ -541,51 +1104,39 @@ static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
                                       uint8_t qos )
 {
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
-
-    MQTTSubscribeInfo_t pSubscriptionList[ 1 ] = { 0 };
-    MQTTOperation_t operation = { 0 };
-    BaseType_t status;
+    OtaMqttOperation_t * pOtaOperation;
 
     assert( pTopicFilter != NULL );
     assert( topicFilterLength > 0 );
 
-    /* Start with everything at 0. */
-    ( void ) memset( ( void * ) pSubscriptionList, 0x00, sizeof( pSubscriptionList ) );
-
-    /* Set the QoS , topic and topic length. */
-    pSubscriptionList[ 0 ].qos = qos;
-    pSubscriptionList[ 0 ].pTopicFilter = pTopicFilter;
-    pSubscriptionList[ 0 ].topicFilterLength = topicFilterLength;
-
-    operation.type = MQTT_OP_SUBSCRIBE;
-    operation.info.subscriptionInfo.pSubscriptionList = pSubscriptionList;
-    operation.info.subscriptionInfo.numSubscriptions = 1;
-    operation.callback = mqttOperationCallback;
-
-    /* Send SUBSCRIBE packet. */
-    status = MQTTAgent_Enqueue( &operation, portMAX_DELAY );
-
-    if( status != pdTRUE )
+    if( topicFilterLength >= OTA_MQTT_TOPIC_MAX_SIZE )
     {
-        PRINTF( "Failed to enqueue subscribe operation. \r\n" );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Topic filter too long for OTA subscribe operation.\r\n" ) );
         otaRet = OtaMqttSubscribeFailed;
     }
     else
     {
-        xSemaphoreTake( opSemaphore, portMAX_DELAY );
+        pOtaOperation = mqttOperationGet();
+
+        memcpy( pOtaOperation->topic, pTopicFilter, topicFilterLength );
+        pOtaOperation->topic[ topicFilterLength ] = '\0';
+
+        /* Set the QoS , topic and topic length. */
+        pOtaOperation->subscribeInfo.qos = qos;
+        pOtaOperation->subscribeInfo.pTopicFilter = pOtaOperation->topic;
+        pOtaOperation->subscribeInfo.topicFilterLength = topicFilterLength;
+
+        pOtaOperation->operation.type = MQTT_OP_SUBSCRIBE;
+        pOtaOperation->operation.info.subscriptionInfo.pSubscriptionList = &pOtaOperation->subscribeInfo;
+        pOtaOperation->operation.info.subscriptionInfo.numSubscriptions = 1;
 
-        if( opStatus != MQTTSuccess )
+        /* Send SUBSCRIBE packet. */
+        if( MQTTAgent_Enqueue( xOtaAgent, &pOtaOperation->operation, portMAX_DELAY ) != pdTRUE )
         {
-            PRINTF( "Failed to subscribe to topic %s, error = %d.\r\n",
-                    pTopicFilter,
-                    opStatus );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to enqueue subscribe operation. \r\n" ) );
+            mqttOperationFree( pOtaOperation );
             otaRet = OtaMqttSubscribeFailed;
         }
-        else
-        {
-            PRINTF( "Subscribed to topic %s.\r\n",
-                    pTopicFilter );
-        }
     }
 
     return otaRet;
@@ -600,44 +1151,37 @@ static OtaMqttStatus_t mqttPublish( const char * const pacTopic,
                                     uint8_t qos )
 {
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
-    MQTTPublishInfo_t publishInfo = { 0 };
-    MQTTOperation_t operation = { 0 };
-    BaseType_t status;
-
-    /* Set the required publish parameters. */
-    publishInfo.pTopicName = pacTopic;
-    publishInfo.topicNameLength = topicLen;
-    publishInfo.qos = qos;
-    publishInfo.pPayload = pMsg;
-    publishInfo.payloadLength = msgSize;
-
-    operation.type = MQTT_OP_PUBLISH;
-    operation.info.pPublishInfo = &publishInfo;
-    operation.callback = mqttOperationCallback;
-
-    status = MQTTAgent_Enqueue( &operation, portMAX_DELAY );
+    OtaMqttOperation_t * pOtaOperation;
 
-    if( status != pdTRUE )
+    if( ( topicLen >= OTA_MQTT_TOPIC_MAX_SIZE ) || ( msgSize > OTA_MQTT_PAYLOAD_MAX_SIZE ) )
     {
-        PRINTF( "Failed to enqueue PUBLISH operation with the agent.\r\n" );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Topic or message too long for OTA publish operation.\r\n" ) );
         otaRet = OtaMqttPublishFailed;
     }
     else
     {
-        xSemaphoreTake( opSemaphore, portMAX_DELAY );
+        pOtaOperation = mqttOperationGet();
 
-        if( opStatus != MQTTSuccess )
+        memcpy( pOtaOperation->topic, pacTopic, topicLen );
+        pOtaOperation->topic[ topicLen ] = '\0';
+        memcpy( pOtaOperation->payload, pMsg, msgSize );
+
+        /* Set the required publish parameters. */
+        pOtaOperation->publishInfo.pTopicName = pOtaOperation->topic;
+        pOtaOperation->publishInfo.topicNameLength = topicLen;
+        pOtaOperation->publishInfo.qos = qos;
+        pOtaOperation->publishInfo.pPayload = pOtaOperation->payload;
+        pOtaOperation->publishInfo.payloadLength = msgSize;
+
+        pOtaOperation->operation.type = MQTT_OP_PUBLISH;
+        pOtaOperation->operation.info.pPublishInfo = &pOtaOperation->publishInfo;
+
+        if( MQTTAgent_Enqueue( xOtaAgent, &pOtaOperation->operation, portMAX_DELAY ) != pdTRUE )
         {
-            PRINTF( "Failed to publish to topic %s, error = %d.\r\n",
-                    pacTopic,
-                    opStatus );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to enqueue PUBLISH operation with the agent.\r\n" ) );
+            mqttOperationFree( pOtaOperation );
             otaRet = OtaMqttPublishFailed;
         }
-        else
-        {
-            PRINTF( "Published to topic %s.\r\n",
-                    pacTopic );
-        }
     }
 
     return otaRet;
@@ -650,69 +1194,292 @@ static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
                                         uint8_t qos )
 {
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
-    MQTTOperation_t operation = { 0 };
-    MQTTSubscribeInfo_t pSubscriptionList[ 1 ];
-    BaseType_t status;
-
-    /* Start with everything at 0. */
-    ( void ) memset( ( void * ) pSubscriptionList, 0x00, sizeof( pSubscriptionList ) );
+    OtaMqttOperation_t * pOtaOperation;
 
-    /* Set the QoS , topic and topic length. */
-    pSubscriptionList[ 0 ].qos = qos;
-    pSubscriptionList[ 0 ].pTopicFilter = pTopicFilter;
-    pSubscriptionList[ 0 ].topicFilterLength = topicFilterLength;
-
-    operation.type = MQTT_OP_UNSUBSCRIBE;
-    operation.info.subscriptionInfo.numSubscriptions = 1;
-    operation.info.subscriptionInfo.pSubscriptionList = pSubscriptionList;
-
-    /* Send UNSUBSCRIBE packet. */
-    status = MQTTAgent_Enqueue( &operation, portMAX_DELAY );
-
-    if( status != pdTRUE )
+    if( topicFilterLength >= OTA_MQTT_TOPIC_MAX_SIZE )
     {
-        PRINTF( "Failed to enqueue UNSUBSCRIBE operation with broker.\r\n" );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Topic filter too long for OTA unsubscribe operation.\r\n" ) );
         otaRet = OtaMqttUnsubscribeFailed;
     }
     else
     {
-        xSemaphoreTake( opSemaphore, portMAX_DELAY );
+        pOtaOperation = mqttOperationGet();
+
+        memcpy( pOtaOperation->topic, pTopicFilter, topicFilterLength );
+        pOtaOperation->topic[ topicFilterLength ] = '\0';
 
-        if( opStatus != MQTTSuccess )
+        /* Set the QoS , topic and topic length. */
+        pOtaOperation->subscribeInfo.qos = qos;
+        pOtaOperation->subscribeInfo.pTopicFilter = pOtaOperation->topic;
+        pOtaOperation->subscribeInfo.topicFilterLength = topicFilterLength;
+
+        pOtaOperation->operation.type = MQTT_OP_UNSUBSCRIBE;
+        pOtaOperation->operation.info.subscriptionInfo.numSubscriptions = 1;
+        pOtaOperation->operation.info.subscriptionInfo.pSubscriptionList = &pOtaOperation->subscribeInfo;
+
+        /* Send UNSUBSCRIBE packet. */
+        if( MQTTAgent_Enqueue( xOtaAgent, &pOtaOperation->operation, portMAX_DELAY ) != pdTRUE )
         {
-            PRINTF( "Failed to Unsubsribe topic %s to broker.\r\n",
-                    pTopicFilter );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to enqueue UNSUBSCRIBE operation with broker.\r\n" ) );
+            mqttOperationFree( pOtaOperation );
             otaRet = OtaMqttUnsubscribeFailed;
         }
-        else
-        {
-            PRINTF( "Unsubsribe topic %s to broker.\r\n",
-                    pTopicFilter );
-        }
     }
 
     return otaRet;
 }
 
 /*-----------------------------------------------------------*/
+static void prvPublishOTAMetrics( const char * pPayload,
+                                  size_t payloadLength )
+{
+    static char topic[ OTA_MQTT_TOPIC_MAX_SIZE ];
+    MQTTPublishInfo_t publishInfo = { 0 };
+    int topicLength;
+
+    topicLength = snprintf( topic, sizeof( topic ), OTA_METRICS_TOPIC_FORMAT,
+                            ( int ) otaThingNameLength, otaThingName );
+
+    if( ( topicLength > 0 ) && ( ( size_t ) topicLength < sizeof( topic ) ) )
+    {
+        publishInfo.qos = MQTTQoS0;
+        publishInfo.pTopicName = topic;
+        publishInfo.topicNameLength = ( uint16_t ) topicLength;
+        publishInfo.pPayload = pPayload;
+        publishInfo.payloadLength = payloadLength;
+
+        /* The publish is copied by the agent, so the timer task does not wait for it to be sent. */
+        if( MQTTAgent_PublishCopy( xOtaAgent, &publishInfo, NULL, MQTT_AGENT_PRIORITY_BULK, 0 ) != pdTRUE )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to publish OTA metrics.\r\n" ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvOTAStatsTimerCallback( TimerHandle_t xTimer )
 {
     /* OTA library packet statistics per job.*/
     OtaAgentStatistics_t otaStatistics = { 0 };
+    OtaMetrics_t metrics;
+    TickType_t now = xTaskGetTickCount();
+    uint32_t elapsedMs, intervalMs, rate, averageRate = 0, writeMs = 0, duplicates = 0, eta = 0;
+    uint32_t fastDecodes, genericDecodes;
+    BlockPoolStats_t bufferStats;
+    char payload[ 160 ];
+    int payloadLength;
+
+    static uint32_t reportCount = 0;
+
+    ( void ) xTimer;
 
     if( OTA_GetState() != OtaAgentStateStopped )
     {
         /* Get OTA statistics for currently executing job. */
         OTA_GetStatistics( &otaStatistics );
 
-        PRINTF( " Received: %u   Queued: %u   Processed: %u   Dropped: %u \r\n",
-                otaStatistics.otaPacketsReceived,
-                otaStatistics.otaPacketsQueued,
-                otaStatistics.otaPacketsProcessed,
-                otaStatistics.otaPacketsDropped );
+        taskENTER_CRITICAL();
+        {
+            metrics = otaMetrics;
+            otaMetrics.lastReportTime = now;
+            otaMetrics.lastReportBytes = otaMetrics.bytesWritten;
+        }
+        taskEXIT_CRITICAL();
+
+        BlockPool_GetStats( &eventBufferPool, &bufferStats );
+
+        elapsedMs = ( uint32_t ) ( ( now - metrics.startTime ) * portTICK_PERIOD_MS );
+        intervalMs = ( uint32_t ) ( ( now - metrics.lastReportTime ) * portTICK_PERIOD_MS );
+        rate = ( intervalMs > 0U ) ? ( uint32_t ) ( ( ( uint64_t ) ( metrics.bytesWritten - metrics.lastReportBytes ) * 1000U ) / intervalMs ) : 0U;
+
+        if( ( metrics.bytesWritten > 0U ) && ( elapsedMs > 0U ) )
+        {
+            averageRate = ( uint32_t ) ( ( ( uint64_t ) metrics.bytesWritten * 1000U ) / elapsedMs );
+        }
+
+        if( ( averageRate > 0U ) && ( metrics.fileSize > metrics.bytesWritten ) )
+        {
+            eta = ( metrics.fileSize - metrics.bytesWritten ) / averageRate;
+        }
+
+        if( metrics.blocksWritten > 0U )
+        {
+            writeMs = ( metrics.writeTicksTotal * portTICK_PERIOD_MS ) / metrics.blocksWritten;
+        }
+
+        /* Blocks processed by OTA agent but not written to flash were already received. */
+        if( otaStatistics.otaPacketsProcessed > metrics.blocksWritten )
+        {
+            duplicates = otaStatistics.otaPacketsProcessed - metrics.blocksWritten;
+        }
+
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( " Received: %u   Queued: %u   Processed: %u   Dropped: %u \r\n",
+                                               otaStatistics.otaPacketsReceived,
+                                               otaStatistics.otaPacketsQueued,
+                                               otaStatistics.otaPacketsProcessed,
+                                               otaStatistics.otaPacketsDropped ) );
+
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( " Bytes: %lu/%lu   Rate: %lu B/s   Average: %lu B/s   Buffers: %lu/%u   Write: %lu ms   ETA: %lu s \r\n",
+                                               ( unsigned long ) metrics.bytesWritten, ( unsigned long ) metrics.fileSize,
+                                               ( unsigned long ) rate, ( unsigned long ) averageRate,
+                                               ( unsigned long ) bufferStats.usUsed, ( unsigned ) otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+                                               ( unsigned long ) writeMs, ( unsigned long ) eta ) );
+
+        vOtaCborGetStats( &fastDecodes, &genericDecodes );
+        LogModule( LOG_MODULE_OTA, LOG_DEBUG, ( " Blocks decoded: %lu fixed layout, %lu generic parser \r\n",
+                                                ( unsigned long ) fastDecodes, ( unsigned long ) genericDecodes ) );
+
+        reportCount++;
+
+        if( ( OTA_METRICS_PUBLISH_INTERVAL_MS > 0U ) &&
+            ( ( reportCount * otaStatisticsIntervalMs ) >= OTA_METRICS_PUBLISH_INTERVAL_MS ) )
+        {
+            reportCount = 0;
+
+            payloadLength = snprintf( payload, sizeof( payload ),
+                                      "{\"bytes\":%lu,\"size\":%lu,\"rate\":%lu,\"avg\":%lu,\"buf\":%lu,"
+                                      "\"wrMs\":%lu,\"wrMax\":%lu,\"dup\":%lu,\"drop\":%lu,\"eta\":%lu}",
+                                      ( unsigned long ) metrics.bytesWritten, ( unsigned long ) metrics.fileSize,
+                                      ( unsigned long ) rate, ( unsigned long ) averageRate,
+                                      ( unsigned long ) bufferStats.usUsed, ( unsigned long ) writeMs,
+                                      ( unsigned long ) ( metrics.writeTicksMax * portTICK_PERIOD_MS ),
+                                      ( unsigned long ) duplicates,
+                                      ( unsigned long ) otaStatistics.otaPacketsDropped,
+                                      ( unsigned long ) eta );
+
+            if( ( payloadLength > 0 ) && ( ( size_t ) payloadLength < sizeof( payload ) ) )
+            {
+                prvPublishOTAMetrics( payload, ( size_t ) payloadLength );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vOTAPrintStatistics( void )
+{
+    OtaAgentStatistics_t otaStatistics = { 0 };
+    OtaMetrics_t metrics;
+    BlockPoolStats_t bufferStats;
+    uint32_t fastDecodes, genericDecodes;
+    uint32_t writeMs = 0;
+
+    OTA_GetStatistics( &otaStatistics );
+
+    taskENTER_CRITICAL();
+    {
+        metrics = otaMetrics;
+    }
+    taskEXIT_CRITICAL();
+
+    BlockPool_GetStats( &eventBufferPool, &bufferStats );
+    vOtaCborGetStats( &fastDecodes, &genericDecodes );
+
+    if( metrics.blocksWritten > 0U )
+    {
+        writeMs = ( metrics.writeTicksTotal * portTICK_PERIOD_MS ) / metrics.blocksWritten;
+    }
+
+    PRINTF( "OTA: state %d, received %u, queued %u, processed %u, dropped %u.\r\n",
+            ( int ) OTA_GetState(),
+            otaStatistics.otaPacketsReceived, otaStatistics.otaPacketsQueued,
+            otaStatistics.otaPacketsProcessed, otaStatistics.otaPacketsDropped );
+    PRINTF( "OTA: bytes %lu/%lu, blocks %lu, write %lu ms avg %lu ms max, buffers %lu/%u, decodes %lu fixed %lu generic.\r\n",
+            ( unsigned long ) metrics.bytesWritten, ( unsigned long ) metrics.fileSize,
+            ( unsigned long ) metrics.blocksWritten, ( unsigned long ) writeMs,
+            ( unsigned long ) ( metrics.writeTicksMax * portTICK_PERIOD_MS ),
+            ( unsigned long ) bufferStats.usUsed, ( unsigned ) otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+            ( unsigned long ) fastDecodes, ( unsigned long ) genericDecodes );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xOTASetStatisticsInterval( uint32_t intervalMs )
+{
+    if( ( intervalMs == 0U ) || ( pdMS_TO_TICKS( intervalMs ) == 0U ) )
+    {
+        return pdFALSE;
+    }
+
+    otaStatisticsIntervalMs = intervalMs;
+
+    /* Before the OTA demo starts, the timer is created with the new period. */
+    if( otaStatsTimer != NULL )
+    {
+        return ( xTimerChangePeriod( otaStatsTimer, pdMS_TO_TICKS( intervalMs ), 0 ) == pdPASS ) ? pdTRUE : pdFALSE;
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaPalStatus_t appCreateFileCallback( OtaFileContext_t * const pFileContext )
+{
+    OtaPalStatus_t status;
+
+    status = xOtaPalCreateFileForRx( pFileContext );
+
+    if( status == OtaPalSuccess )
+    {
+        /* The key is parsed while the blocks arrive instead of after the last one. */
+        if( xPreloadImageSignatureKey( ( char * ) pFileContext->pCertFilepath ) == pdTRUE )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_INFO, ( "Code signing key preloaded.\r\n" ) );
+        }
+
+        taskENTER_CRITICAL();
+        {
+            memset( &otaMetrics, 0x00, sizeof( otaMetrics ) );
+            otaMetrics.fileSize = pFileContext->fileSize;
+            otaMetrics.startTime = xTaskGetTickCount();
+            otaMetrics.lastReportTime = otaMetrics.startTime;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static int16_t appWriteBlockCallback( OtaFileContext_t * const pFileContext,
+                                      uint32_t offset,
+                                      uint8_t * const pData,
+                                      uint32_t blockSize )
+{
+    int16_t result;
+    TickType_t writeTicks = xTaskGetTickCount();
+
+    PROBE_SINCE( PROBE_OTA_DECODE, otaEventTakenCycles );
+    PROBE_BEGIN( PROBE_OTA_WRITE );
+    result = xOtaPalWriteBlock( pFileContext, offset, pData, blockSize );
+    PROBE_END( PROBE_OTA_WRITE );
+    writeTicks = xTaskGetTickCount() - writeTicks;
+
+    if( result > 0 )
+    {
+        taskENTER_CRITICAL();
+        {
+            otaMetrics.bytesWritten += ( uint32_t ) result;
+            otaMetrics.blocksWritten++;
+            otaMetrics.writeTicksTotal += ( uint32_t ) writeTicks;
+
+            if( ( uint32_t ) writeTicks > otaMetrics.writeTicksMax )
+            {
+                otaMetrics.writeTicksMax = ( uint32_t ) writeTicks;
+            }
+        }
+        taskEXIT_CRITICAL();
     }
+
+    return result;
 }
 
+/*-----------------------------------------------------------*/
+
 static OtaPalStatus_t appCloseFileCallback( OtaFileContext_t * const pFileContext )
 {
     OtaPalStatus_t status = OtaPalSuccess;
@@ -733,7 +1500,7 @@ static OtaPalStatus_t appCloseFileCallback( OtaFileContext_t * const pFileContex
         }
         else
         {
-            PRINTF( "**** OTA image signature is valid. ***** \r\n" );
+            LogModule( LOG_MODULE_OTA, LOG_INFO, ( "**** OTA image signature is valid. ***** \r\n" ) );
         }
     }
 
@@ -742,7 +1509,7 @@ static OtaPalStatus_t appCloseFileCallback( OtaFileContext_t * const pFileContex
 
 /*-----------------------------------------------------------*/
 
-BaseType_t xStartOTAUpdateDemo( void )
+BaseType_t xStartOTAUpdateDemo( MQTTAgentHandle_t xAgent )
 {
     BaseType_t result = pdTRUE;
 
@@ -759,17 +1526,49 @@ BaseType_t xStartOTAUpdateDemo( void )
 
     CK_RV pkcsllRet;
 
+    xOtaAgent = xAgent;
+
     if( ( pkcsllRet = ulGetThingName( &pThingName, &thingNameLength ) ) != CKR_OK )
     {
-        PRINTF( "Cannot get thing name for initializing OTA, pkcs11 error = %d.\r\n", pkcsllRet );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Cannot get thing name for initializing OTA, pkcs11 error = %d.\r\n",
+                                                pkcsllRet ) );
         result = pdFALSE;
     }
+    else
+    {
+        otaThingName = pThingName;
+        otaThingNameLength = thingNameLength;
+    }
+
+    /* The field trace profile records the OTA task and the objects it waits on. */
+    TRC_FIELD_OBJECTS_BEGIN();
 
     if( result == pdTRUE )
     {
-        opSemaphore = xSemaphoreCreateBinary();
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            otaStateEventGroup = xEventGroupCreateStatic( &otaStateEventGroupBuffer );
+        #else
+            otaStateEventGroup = xEventGroupCreate();
+        #endif
+
+        if( otaStateEventGroup == NULL )
+        {
+            result = pdFALSE;
+        }
+    }
 
-        if( opSemaphore == NULL )
+    if( result == pdTRUE )
+    {
+        BlockPool_Reset( &opPool );
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            opPoolSemaphore = xSemaphoreCreateCountingStatic( OTA_MQTT_MAX_PENDING_OPERATIONS,
+                                                              OTA_MQTT_MAX_PENDING_OPERATIONS,
+                                                              &opPoolSemaphoreBuffer );
+        #else
+            opPoolSemaphore = xSemaphoreCreateCounting( OTA_MQTT_MAX_PENDING_OPERATIONS, OTA_MQTT_MAX_PENDING_OPERATIONS );
+        #endif
+
+        if( opPoolSemaphore == NULL )
         {
             result = pdFALSE;
         }
@@ -777,12 +1576,54 @@ BaseType_t xStartOTAUpdateDemo( void )
 
     if( result == pdTRUE )
     {
-        bufferMutex = xSemaphoreCreateMutex();
+        BlockPool_Reset( &eventBufferPool );
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            bufferSemaphore = xSemaphoreCreateCountingStatic( otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+                                                              otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+                                                              &bufferSemaphoreBuffer );
+        #else
+            bufferSemaphore = xSemaphoreCreateCounting( otaconfigMAX_NUM_OTA_DATA_BUFFERS, otaconfigMAX_NUM_OTA_DATA_BUFFERS );
+        #endif
+
+        if( bufferSemaphore == NULL )
+        {
+            result = pdFALSE;
+        }
+    }
 
-        if( bufferMutex == NULL )
+    /* Route the incoming job and data publishes to OTA agent, streaming their payload into the
+     * event buffers when the agent supports it. */
+    #if ( MQTT_AGENT_STREAM_RECEIVE == 1 )
+        #define otaREGISTER_SUBSCRIPTION    MQTTAgent_RegisterStreamSubscription
+    #else
+        #define otaREGISTER_SUBSCRIPTION    MQTTAgent_RegisterSubscription
+    #endif
+
+    if( result == pdTRUE )
+    {
+        if( ( otaREGISTER_SUBSCRIPTION( xOtaAgent,
+                                        JOB_RESPONSE_TOPIC_FILTER,
+                                        JOB_RESPONSE_TOPIC_FILTER_LENGTH,
+                                        mqttJobCallback,
+                                        NULL ) != pdTRUE ) ||
+            ( otaREGISTER_SUBSCRIPTION( xOtaAgent,
+                                        JOB_NOTIFICATION_TOPIC_FILTER,
+                                        JOB_NOTIFICATION_TOPIC_FILTER_LENGTH,
+                                        mqttJobCallback,
+                                        NULL ) != pdTRUE ) ||
+            ( otaREGISTER_SUBSCRIPTION( xOtaAgent,
+                                        DATA_TOPIC_FILTER,
+                                        DATA_TOPIC_FILTER_LENGTH,
+                                        mqttDataCallback,
+                                        NULL ) != pdTRUE ) )
         {
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to register OTA topic filters with the agent.\r\n" ) );
             result = pdFALSE;
         }
+        else
+        {
+            MQTTAgent_SetReceiveReadyCallback( xOtaAgent, otaReceiveReady );
+        }
     }
 
     /****************************** Init OTA Library. ******************************/
@@ -794,7 +1635,7 @@ BaseType_t xStartOTAUpdateDemo( void )
                                  ( const uint8_t * ) pThingName,
                                  otaAppCallback ) ) != OtaErrNone )
         {
-            PRINTF( "Failed to initialize OTA, error = %u.", otaRet );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to initialize OTA, error = %u.", otaRet ) );
             result = pdFALSE;
         }
     }
@@ -803,26 +1644,51 @@ BaseType_t xStartOTAUpdateDemo( void )
 
     if( result == pdTRUE )
     {
-        if( ( result = xTaskCreate( otaAgentTask,
-                                    "OTA_task",
-                                    otaconfigSTACK_SIZE,
-                                    NULL,
-                                    otaconfigTASK_PRIORITY | portPRIVILEGE_BIT,
-                                    NULL ) ) != pdTRUE )
+        Watchdog_Register( WATCHDOG_CLIENT_OTA_AGENT );
+
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            result = ( xTaskCreateStatic( otaAgentTask,
+                                          "OTA_task",
+                                          otaconfigSTACK_SIZE,
+                                          NULL,
+                                          otaconfigTASK_PRIORITY | portPRIVILEGE_BIT,
+                                          otaTaskStack,
+                                          &otaTaskBuffer ) != NULL ) ? pdTRUE : pdFALSE;
+        #else
+            result = xTaskCreate( otaAgentTask,
+                                  "OTA_task",
+                                  otaconfigSTACK_SIZE,
+                                  NULL,
+                                  otaconfigTASK_PRIORITY | portPRIVILEGE_BIT,
+                                  NULL );
+        #endif
+
+        if( result != pdTRUE )
         {
-            PRINTF( "Failed to create OTA Update task.\r\n" );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to create OTA Update task.\r\n" ) );
             result = pdFALSE;
         }
     }
 
+    TRC_FIELD_OBJECTS_END();
+
     /* Start a periodic timer to report the statistics of OTA. */
     if( result == pdTRUE )
     {
-        otaStatsTimer = xTimerCreate( "OTAStatsTimer",
-                                      pdMS_TO_TICKS( OTA_STATISTICS_INTERVAL_MS ),
-                                      pdTRUE,
-                                      NULL,
-                                      prvOTAStatsTimerCallback );
+        #if ( configAPPLICATION_STATIC_OBJECTS == 1 )
+            otaStatsTimer = xTimerCreateStatic( "OTAStatsTimer",
+                                                pdMS_TO_TICKS( otaStatisticsIntervalMs ),
+                                                pdTRUE,
+                                                NULL,
+                                                prvOTAStatsTimerCallback,
+                                                &otaStatsTimerBuffer );
+        #else
+            otaStatsTimer = xTimerCreate( "OTAStatsTimer",
+                                          pdMS_TO_TICKS( otaStatisticsIntervalMs ),
+                                          pdTRUE,
+                                          NULL,
+                                          prvOTAStatsTimerCallback );
+        #endif
 
         if( otaStatsTimer == NULL )
         {
@@ -841,7 +1707,7 @@ BaseType_t xStartOTAUpdateDemo( void )
 
         if( OTA_SignalEvent( &eventMsg ) != true )
         {
-            PRINTF( "Failed to start OTA agent.\r\n" );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to start OTA agent.\r\n" ) );
             result = pdFALSE;
         }
     }
@@ -852,21 +1718,19 @@ BaseType_t xStartOTAUpdateDemo( void )
 BaseType_t xSuspendOTAUpdate( void )
 {
     OtaErr_t otaRet;
-    BaseType_t result;
+    BaseType_t result = pdTRUE;
 
     /* Suspend OTA operations. */
+    ( void ) xEventGroupClearBits( otaStateEventGroup, OTA_STATE_EVENT_PROCESSED );
 
     if( ( otaRet = OTA_Suspend() ) == OtaErrNone )
     {
-        while( OTA_GetState() != OtaAgentStateSuspended )
-        {
-            /* Wait for OTA Library state to suspend */
-            vTaskDelay( pdMS_TO_TICKS( OTA_POLLING_DELAY_MS ) );
-        }
+        /* Wait for OTA Library state to suspend */
+        otaWaitForState( OtaAgentStateSuspended, pdTRUE );
     }
     else
     {
-        PRINTF( "OTA failed to suspend. StatusCode=%d.", otaRet );
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "OTA failed to suspend. StatusCode=%d.", otaRet ) );
         result = pdFALSE;
     }
 
@@ -882,17 +1746,16 @@ BaseType_t xResumeOTAUpdate( void )
 
     if( OTA_GetState() == OtaAgentStateSuspended )
     {
+        ( void ) xEventGroupClearBits( otaStateEventGroup, OTA_STATE_EVENT_PROCESSED );
+
         if( ( otaRet = OTA_Resume() ) == OtaErrNone )
         {
-            while( OTA_GetState() == OtaAgentStateSuspended )
-            {
-                /* Wait for OTA Library state to resume. */
-                vTaskDelay( pdMS_TO_TICKS( OTA_POLLING_DELAY_MS ) );
-            }
+            /* Wait for OTA Library state to resume. */
+            otaWaitForState( OtaAgentStateSuspended, pdFALSE );
         }
         else
         {
-            PRINTF( "OTA failed to resume. StatusCode=%d.", otaRet );
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "OTA failed to resume. StatusCode=%d.", otaRet ) );
             result = pdFALSE;
         }
     }
@@ -30,6 +30,7 @@
 #include "FreeRTOS.h"
 
 #include "core_mqtt.h"
+#include "core_mqtt_agent.h"
 
 /**
  * @brief Flag which enables or disables OTA update demo.
@@ -39,29 +40,41 @@
 
 /**
  * @brief Function to start an OTA update task in the background.
- * Prerequisite: A valid MQTT connection should be established with AWS IoT core and the context
- * passed in as the parameter.
+ * Prerequisite: A valid MQTT connection should be established with AWS IoT core and served by the
+ * MQTT agent passed in as the parameter.
  *
- * @pram[in] pMQTTContext The context for MQTT connection with AWS IoT core.
+ * @param[in] xAgent The MQTT agent instance of the connection used for the jobs and the image
+ * download, NULL for the first instance.
  * @return pdTRUE if the OTA update task was successfully created.
  */
-BaseType_t xStartOTAUpdateDemo( void );
+BaseType_t xStartOTAUpdateDemo( MQTTAgentHandle_t xAgent );
 
 /**
- * @brief Handles an MQTT packet for OTA.
- * Filters out  MQTT control and data packets for OTA and queues appropirate events for OTA agent to process them.
+ * @brief Prints the packet statistics of the OTA agent and the progress of the current download on
+ * the debug console, whatever the log level of the OTA module.
+ */
+void vOTAPrintStatistics( void );
+
+/**
+ * @brief Changes the interval at which the OTA statistics are reported. The metrics are still
+ * published every OTA_METRICS_PUBLISH_INTERVAL_MS, rounded up to a multiple of the interval.
  *
- * @param[in] pMQTTContext The MQTT context passed from library
- * @param[in] pPacketInfo  Pointer to the MQTT packet information
- * @param[in] pDeserializedInfo Pointer to the deserialized publish packet information.
- * @return pdTRUE if the packet was successfully processed.
+ * @param[in] intervalMs The new interval, at least one tick.
+ * @return pdTRUE if the interval is applied.
+ */
+BaseType_t xOTASetStatisticsInterval( uint32_t intervalMs );
+
+/**
+ * @brief Loads the key verifying the image signature when the job document arrives, so that
+ * closing the image only performs the final signature verification.
+ * @param[in] pCertificatePath The file path for the certificate, This can be certificate slot label name in PKCS11.
+ * @return pdTRUE if the key is preloaded, pdFALSE if it is only loaded by xValidateImageSignature().
  */
-BaseType_t xOTAProcessMQTTEvent( MQTTContext_t * pMQTTContext,
-                                 struct MQTTPacketInfo * pPacketInfo,
-                                 struct MQTTDeserializedInfo * pDeserializedInfo );
+BaseType_t xPreloadImageSignatureKey( char * pCertificatePath );
 
 /**
  * @brief Validate the integrity of the new image to be activated.
+ * The verification runs on the crypto worker task while the caller waits, see CryptoWorker_Run().
  * @param[in] pCertificatePath The file path for the certificate, This can be certificate slot label name in PKCS11.
  * @param[in] pSignature  The signature for the image, received from server.
  * @param[in] signatureLength Length of the signature.
@@ -0,0 +1,96 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file perf_profile.h
+ * @brief Named sets of the buffer, window and queue sizes that set the throughput of the demo.
+ *
+ * The sizes are spread over FreeRTOSIPConfig.h, ota_config.h, core_mqtt_config.h,
+ * aws_mbedtls_config.h, freertos_sockets_wrapper.h and core_mqtt_agent.c. Each of these takes its
+ * default from the profile selected by democonfigPERF_PROFILE, a setting defined explicitly in one
+ * of them still overrides the profile. The combinations known to drop OTA blocks or to stall on
+ * buffers are rejected at compile time where both sides of the check are visible: in ota_config.h,
+ * core_mqtt_agent.c and main.c.
+ *
+ * This header only defines constants, so that every configuration header can include it.
+ */
+
+#ifndef PERF_PROFILE_H
+#define PERF_PROFILE_H
+
+/**
+ * @brief Smallest RAM use: two OTA block buffers, a 3 segment download window
+ * and 16 operations in flight in the MQTT agent.
+ */
+#define PERF_PROFILE_LOW_RAM           ( 0 )
+
+/**
+ * @brief The sizes the demo is tuned for: four OTA block buffers, a 6 segment download window and
+ * 64 operations in flight in the MQTT agent.
+ */
+#define PERF_PROFILE_BALANCED          ( 1 )
+
+/**
+ * @brief Largest transfers: full size Ethernet frames in SRAM3, six OTA block buffers, an 8
+ * segment download window, 4 KB outgoing TLS records and more MQTTAgent_PublishCopy() slabs.
+ */
+#define PERF_PROFILE_MAX_THROUGHPUT    ( 2 )
+
+/**
+ * @brief The profile the configuration headers take their defaults from.
+ */
+#ifndef democonfigPERF_PROFILE
+    #define democonfigPERF_PROFILE    PERF_PROFILE_BALANCED
+#endif
+
+#if ( democonfigPERF_PROFILE == PERF_PROFILE_LOW_RAM )
+    #define perfprofileNETWORK_MTU_1500          ( 0 )
+    #define perfprofileBULK_RX_SEGMENTS          ( 3 )
+    #define perfprofileOTA_DATA_BUFFERS          ( 2U )
+    #define perfprofileTLS_OUT_CONTENT_LEN       ( 2048 )
+    #define perfprofileAGENT_OPERATIONS          ( 16 )
+    #define perfprofileAGENT_PENDING_TABLE       ( 32 )
+    #define perfprofileAGENT_ARENA_SLABS         ( 4U )
+#elif ( democonfigPERF_PROFILE == PERF_PROFILE_BALANCED )
+    #define perfprofileNETWORK_MTU_1500          ( 0 )
+    #define perfprofileBULK_RX_SEGMENTS          ( 6 )
+    #define perfprofileOTA_DATA_BUFFERS          ( 4U )
+    #define perfprofileTLS_OUT_CONTENT_LEN       ( 2048 )
+    #define perfprofileAGENT_OPERATIONS          ( 64 )
+    #define perfprofileAGENT_PENDING_TABLE       ( 128 )
+    #define perfprofileAGENT_ARENA_SLABS         ( 8U )
+#elif ( democonfigPERF_PROFILE == PERF_PROFILE_MAX_THROUGHPUT )
+    #define perfprofileNETWORK_MTU_1500          ( 1 )
+    #define perfprofileBULK_RX_SEGMENTS          ( 8 )
+    #define perfprofileOTA_DATA_BUFFERS          ( 6U )
+    #define perfprofileTLS_OUT_CONTENT_LEN       ( 4096 )
+    #define perfprofileAGENT_OPERATIONS          ( 64 )
+    #define perfprofileAGENT_PENDING_TABLE       ( 128 )
+    #define perfprofileAGENT_ARENA_SLABS         ( 16U )
+#else
+    #error "democonfigPERF_PROFILE must be PERF_PROFILE_LOW_RAM, PERF_PROFILE_BALANCED or PERF_PROFILE_MAX_THROUGHPUT."
+#endif
+
+#endif /* PERF_PROFILE_H */
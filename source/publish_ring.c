@@ -0,0 +1,389 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file publish_ring.c
+ * @brief MQTT publish path for the restricted tasks, through a ring in the memory of each task.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "core_mqtt_agent.h"
+
+#include "publish_ring.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Types of the records, a wrap record sends the reader back to the start of the records.
+ */
+#define publishringRECORD_DATA    ( 0xD1U )
+#define publishringRECORD_WRAP    ( 0x5AU )
+
+/**
+ * @brief Size of a record with its payload, the records are word aligned.
+ */
+#define publishringRECORD_SIZE( length )    ( sizeof( PublishRingRecord_t ) + ( ( ( uint32_t ) ( length ) + 3U ) & ~3U ) )
+
+/**
+ * @brief Header of a record, followed by the payload.
+ */
+typedef struct PublishRingRecord
+{
+    uint16_t usLength;
+    uint8_t ucTopic;
+    uint8_t ucType;
+} PublishRingRecord_t;
+
+/**
+ * @brief State of an attached ring, only used by the agent task once attached.
+ */
+typedef struct PublishRing
+{
+    PublishRingHeader_t * pxHeader;
+    uint8_t * pucRecords;
+    uint32_t ulCapacity;  /**< Capacity set by PublishRing_Init(), the header copy is not trusted. */
+    uint32_t ulTail;      /**< Offset of the oldest record not sent. */
+    uint32_t ulBatchEnd;  /**< Offset following the records of the batch being sent. */
+    BaseType_t xInFlight; /**< Set while the batch operation is owned by the agent. */
+    uint32_t ulErrors;    /**< Times the records were found corrupted and discarded. */
+    const PublishRingTopic_t * pxTopics;
+    uint8_t ucTopicCount;
+    MQTTOperation_t xOperation;
+    MQTTPublishInfo_t xPublishes[ publishringBATCH_MAX ];
+} PublishRing_t;
+
+/**
+ * @brief The attached rings, in the privileged data so the restricted tasks cannot alter them.
+ */
+static PublishRing_t xRings[ publishringMAX_RINGS ] PRIVILEGED_DATA;
+
+/**
+ * @brief Number of attached rings, only grows.
+ */
+static volatile UBaseType_t uxRingCount PRIVILEGED_DATA = 0;
+
+/**
+ * @brief Timer waking the agent after a write to an empty ring.
+ */
+static TimerHandle_t xDoorbellTimer PRIVILEGED_DATA = NULL;
+
+/*-----------------------------------------------------------*/
+
+static void prvDoorbellCallback( TimerHandle_t xTimer )
+{
+    ( void ) xTimer;
+
+    MQTTAgent_Wakeup( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBatchComplete( struct MQTTOperation * pOperation,
+                              MQTTStatus_t status )
+{
+    UBaseType_t i;
+
+    /* QoS0 publishes are not retried, the records are released either way. */
+    ( void ) status;
+
+    for( i = 0; i < uxRingCount; i++ )
+    {
+        if( pOperation == &( xRings[ i ].xOperation ) )
+        {
+            xRings[ i ].ulTail = xRings[ i ].ulBatchEnd;
+            xRings[ i ].pxHeader->ulTail = xRings[ i ].ulTail;
+            xRings[ i ].xInFlight = pdFALSE;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Collects the records written since the last batch and enqueues them as one batch operation.
+ * Every record is checked to lie within the records written by the task and to name a valid topic.
+ */
+static void prvDrainRing( PublishRing_t * pxRing )
+{
+    PublishRingRecord_t xRecord;
+    uint32_t ulHead = pxRing->pxHeader->ulHead;
+    uint32_t ulPosition = pxRing->ulTail;
+    uint32_t ulLimit;
+    uint16_t usCount = 0;
+    BaseType_t xCorrupted = pdFALSE;
+
+    if( ( ulHead >= pxRing->ulCapacity ) || ( ( ulHead & 3U ) != 0U ) )
+    {
+        xCorrupted = pdTRUE;
+    }
+
+    while( ( xCorrupted == pdFALSE ) && ( ulPosition != ulHead ) && ( usCount < publishringBATCH_MAX ) )
+    {
+        ulLimit = ( ulHead > ulPosition ) ? ulHead : pxRing->ulCapacity;
+
+        if( ( ulLimit - ulPosition ) < sizeof( xRecord ) )
+        {
+            xCorrupted = pdTRUE;
+            break;
+        }
+
+        /* Read the header once, the task may change it meanwhile. */
+        memcpy( &xRecord, &( pxRing->pucRecords[ ulPosition ] ), sizeof( xRecord ) );
+
+        if( ( xRecord.ucType == publishringRECORD_WRAP ) && ( ulHead < ulPosition ) )
+        {
+            ulPosition = 0U;
+        }
+        else if( ( xRecord.ucType != publishringRECORD_DATA ) ||
+                 ( xRecord.ucTopic >= pxRing->ucTopicCount ) ||
+                 ( publishringRECORD_SIZE( xRecord.usLength ) > ( ulLimit - ulPosition ) ) )
+        {
+            xCorrupted = pdTRUE;
+        }
+        else
+        {
+            memset( &( pxRing->xPublishes[ usCount ] ), 0x00, sizeof( MQTTPublishInfo_t ) );
+            pxRing->xPublishes[ usCount ].qos = MQTTQoS0;
+            pxRing->xPublishes[ usCount ].pTopicName = pxRing->pxTopics[ xRecord.ucTopic ].pcTopic;
+            pxRing->xPublishes[ usCount ].topicNameLength = pxRing->pxTopics[ xRecord.ucTopic ].usTopicLength;
+            pxRing->xPublishes[ usCount ].pPayload = &( pxRing->pucRecords[ ulPosition + sizeof( xRecord ) ] );
+            pxRing->xPublishes[ usCount ].payloadLength = xRecord.usLength;
+            usCount++;
+
+            ulPosition += publishringRECORD_SIZE( xRecord.usLength );
+
+            if( ulPosition == pxRing->ulCapacity )
+            {
+                ulPosition = 0U;
+            }
+        }
+    }
+
+    if( xCorrupted == pdTRUE )
+    {
+        /* Discard everything written, the task starts over from its current head. */
+        pxRing->ulErrors++;
+        pxRing->ulTail = ( ulHead < pxRing->ulCapacity ) ? ( ulHead & ~3U ) : 0U;
+        pxRing->pxHeader->ulHead = pxRing->ulTail;
+        pxRing->pxHeader->ulTail = pxRing->ulTail;
+        usCount = 0;
+    }
+
+    if( usCount > 0U )
+    {
+        memset( &( pxRing->xOperation ), 0x00, sizeof( pxRing->xOperation ) );
+        pxRing->xOperation.type = MQTT_OP_PUBLISH_BATCH;
+        pxRing->xOperation.info.publishBatchInfo.pPublishList = pxRing->xPublishes;
+        pxRing->xOperation.info.publishBatchInfo.pStatusList = NULL;
+        pxRing->xOperation.info.publishBatchInfo.numPublishes = usCount;
+        pxRing->xOperation.callback = prvBatchComplete;
+        pxRing->xOperation.priority = MQTT_AGENT_PRIORITY_BULK;
+        pxRing->ulBatchEnd = ulPosition;
+        pxRing->xInFlight = pdTRUE;
+
+        /* Retried on the next wake up if the queue is full. */
+        if( MQTTAgent_Enqueue( NULL, &( pxRing->xOperation ), 0 ) != pdTRUE )
+        {
+            pxRing->xInFlight = pdFALSE;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDrainRings( void )
+{
+    UBaseType_t uxCount = uxRingCount;
+    UBaseType_t i;
+
+    for( i = 0; i < uxCount; i++ )
+    {
+        if( xRings[ i ].xInFlight == pdFALSE )
+        {
+            prvDrainRing( &( xRings[ i ] ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishRing_Init( void * pvMemory,
+                             uint32_t ulSize )
+{
+    PublishRingHeader_t * pxHeader = ( PublishRingHeader_t * ) pvMemory;
+
+    if( ( pvMemory == NULL ) || ( ( ( uint32_t ) pvMemory & 3U ) != 0U ) ||
+        ( ulSize <= ( sizeof( PublishRingHeader_t ) + sizeof( PublishRingRecord_t ) ) ) )
+    {
+        return pdFALSE;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        if( xDoorbellTimer == NULL )
+        {
+            xDoorbellTimer = xTimerCreate( "PubRing", pdMS_TO_TICKS( publishringDRAIN_DELAY_MS ), pdFALSE, NULL,
+                                           prvDoorbellCallback );
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xDoorbellTimer == NULL )
+    {
+        return pdFALSE;
+    }
+
+    pxHeader->ulCapacity = ( ulSize - sizeof( PublishRingHeader_t ) ) & ~3U;
+    pxHeader->ulHead = 0U;
+    pxHeader->ulTail = 0U;
+    pxHeader->ulDropped = 0U;
+    pxHeader->xDoorbell = xDoorbellTimer;
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishRing_Attach( void * pvMemory,
+                               const PublishRingTopic_t * pxTopics,
+                               uint8_t ucTopicCount )
+{
+    PublishRingHeader_t * pxHeader = ( PublishRingHeader_t * ) pvMemory;
+    PublishRing_t * pxRing;
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( ( pvMemory != NULL ) && ( pxTopics != NULL ) && ( ucTopicCount > 0U ) );
+
+    vTaskSuspendAll();
+    {
+        if( uxRingCount < publishringMAX_RINGS )
+        {
+            pxRing = &( xRings[ uxRingCount ] );
+            memset( pxRing, 0x00, sizeof( PublishRing_t ) );
+            pxRing->pxHeader = pxHeader;
+            pxRing->pucRecords = ( uint8_t * ) pvMemory + sizeof( PublishRingHeader_t );
+            pxRing->ulCapacity = pxHeader->ulCapacity;
+            pxRing->ulTail = 0U;
+            pxRing->pxTopics = pxTopics;
+            pxRing->ucTopicCount = ucTopicCount;
+
+            /* Formatted by PublishRing_Init(), before the task could write it. */
+            configASSERT( pxHeader->ulTail == 0U );
+
+            uxRingCount++;
+            MQTTAgent_SetDrainCallback( NULL, prvDrainRings );
+            xResult = pdTRUE;
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    if( xResult == pdTRUE )
+    {
+        MQTTAgent_Wakeup( NULL );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t PublishRing_Write( void * pvMemory,
+                              uint8_t ucTopic,
+                              const void * pvPayload,
+                              uint16_t usLength )
+{
+    PublishRingHeader_t * pxHeader = ( PublishRingHeader_t * ) pvMemory;
+    uint8_t * pucRecords = ( uint8_t * ) pvMemory + sizeof( PublishRingHeader_t );
+    PublishRingRecord_t xRecord;
+    uint32_t ulHead = pxHeader->ulHead;
+    uint32_t ulTail = pxHeader->ulTail;
+    uint32_t ulCapacity = pxHeader->ulCapacity;
+    uint32_t ulSize = publishringRECORD_SIZE( usLength );
+    uint32_t ulPosition = ulHead;
+
+    /* Runs unprivileged, only the ring is accessed besides the payload. */
+    if( ( ulHead >= ulCapacity ) || ( ulTail >= ulCapacity ) )
+    {
+        pxHeader->ulDropped++;
+        return pdFALSE;
+    }
+
+    if( ulHead >= ulTail )
+    {
+        if( ( ulSize > ( ulCapacity - ulHead ) ) || ( ( ulSize == ( ulCapacity - ulHead ) ) && ( ulTail == 0U ) ) )
+        {
+            /* Does not fit before the end, wrap if it fits before the tail. One word stays free
+             * so that a full ring is told apart from an empty one. */
+            if( ulSize >= ulTail )
+            {
+                pxHeader->ulDropped++;
+                return pdFALSE;
+            }
+
+            ulPosition = 0U;
+        }
+    }
+    else if( ulSize >= ( ulTail - ulHead ) )
+    {
+        pxHeader->ulDropped++;
+        return pdFALSE;
+    }
+
+    xRecord.usLength = usLength;
+    xRecord.ucTopic = ucTopic;
+    xRecord.ucType = publishringRECORD_DATA;
+    memcpy( &( pucRecords[ ulPosition ] ), &xRecord, sizeof( xRecord ) );
+    memcpy( &( pucRecords[ ulPosition + sizeof( xRecord ) ] ), pvPayload, usLength );
+
+    if( ulPosition != ulHead )
+    {
+        xRecord.usLength = 0U;
+        xRecord.ucType = publishringRECORD_WRAP;
+        memcpy( &( pucRecords[ ulHead ] ), &xRecord, sizeof( xRecord ) );
+    }
+
+    ulPosition += ulSize;
+
+    if( ulPosition == ulCapacity )
+    {
+        ulPosition = 0U;
+    }
+
+    /* The record must be complete before the agent can see it. */
+    portMEMORY_BARRIER();
+    pxHeader->ulHead = ulPosition;
+
+    if( ulHead == ulTail )
+    {
+        ( void ) xTimerStart( pxHeader->xDoorbell, 0 );
+    }
+
+    return pdTRUE;
+}
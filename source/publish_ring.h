@@ -0,0 +1,134 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file publish_ring.h
+ * @brief MQTT publish path for the restricted tasks, through a ring in the memory of each task.
+ *
+ * A restricted task cannot call MQTTAgent_Enqueue(): the agent would dereference the pointers of the
+ * task and the task cannot reach the agent memory. Instead, each restricted task is given a ring in
+ * one of its MPU regions. The task writes its publishes into the ring with PublishRing_Write(),
+ * which only touches the ring, and the MQTT agent drains the rings in batches. The agent validates
+ * every record before sending it and keeps its own copy of the ring state, so a task corrupting its
+ * ring only loses its own publishes.
+ *
+ * Writing to an empty ring starts a one-shot timer which wakes the agent after
+ * publishringDRAIN_DELAY_MS, so the publishes written in the meantime are sent in one batch with one
+ * agent wake up. The publishes are QoS0, on topics chosen by the privileged side.
+ */
+
+#ifndef PUBLISH_RING_H
+#define PUBLISH_RING_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "timers.h"
+
+/**
+ * @brief Number of rings the agent drains.
+ */
+#ifndef publishringMAX_RINGS
+    #define publishringMAX_RINGS    ( 2U )
+#endif
+
+/**
+ * @brief Maximum number of publishes sent in one batch operation.
+ */
+#ifndef publishringBATCH_MAX
+    #define publishringBATCH_MAX    ( 8U )
+#endif
+
+/**
+ * @brief Time the agent is woken up after a write to an empty ring.
+ */
+#ifndef publishringDRAIN_DELAY_MS
+    #define publishringDRAIN_DELAY_MS    ( 20U )
+#endif
+
+/**
+ * @brief Header at the start of the ring memory, followed by the records. Written by the restricted
+ * task, so never trusted by the agent.
+ */
+typedef struct PublishRingHeader
+{
+    uint32_t ulCapacity;         /**< Bytes available for the records. */
+    volatile uint32_t ulHead;    /**< Offset of the next record, written by the task. */
+    volatile uint32_t ulTail;    /**< Offset of the oldest record not sent, written by the agent. */
+    volatile uint32_t ulDropped; /**< Publishes the task dropped because the ring was full. */
+    TimerHandle_t xDoorbell;     /**< Timer started by the task when it writes to an empty ring. */
+} PublishRingHeader_t;
+
+/**
+ * @brief A topic a ring publishes on. The topic must remain valid as long as the ring is attached.
+ */
+typedef struct PublishRingTopic
+{
+    const char * pcTopic;
+    uint16_t usTopicLength;
+} PublishRingTopic_t;
+
+/**
+ * @brief Formats the memory of a ring, before the task is given access to it.
+ *
+ * @param[in] pvMemory The ring memory, word aligned. It is typically the memory of one of the MPU
+ * regions of the task, a power of two aligned to its size.
+ * @param[in] ulSize Size of the memory, more than the size of the header.
+ *
+ * @return pdTRUE if the ring is formatted.
+ */
+BaseType_t PublishRing_Init( void * pvMemory,
+                             uint32_t ulSize );
+
+/**
+ * @brief Lets the agent drain a ring formatted by PublishRing_Init(). The records written before
+ * are sent once the agent next wakes up.
+ *
+ * @param[in] pvMemory The ring memory.
+ * @param[in] pxTopics The topics the records refer to by index, not copied.
+ * @param[in] ucTopicCount Number of topics.
+ *
+ * @return pdTRUE if the ring is attached, pdFALSE if there is no space left.
+ */
+BaseType_t PublishRing_Attach( void * pvMemory,
+                               const PublishRingTopic_t * pxTopics,
+                               uint8_t ucTopicCount );
+
+/**
+ * @brief Writes a publish into a ring. Called by the restricted task owning the ring, never blocks.
+ *
+ * @param[in] pvMemory The ring memory.
+ * @param[in] ucTopic Index of the topic in the table given to PublishRing_Attach().
+ * @param[in] pvPayload The payload, copied.
+ * @param[in] usLength Length of the payload.
+ *
+ * @return pdTRUE if the publish is written, pdFALSE if the ring is full.
+ */
+BaseType_t PublishRing_Write( void * pvMemory,
+                              uint8_t ucTopic,
+                              const void * pvPayload,
+                              uint16_t usLength );
+
+#endif /* PUBLISH_RING_H */
@@ -0,0 +1,285 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file self_test.c
+ * @brief Self-test of a new image.
+ * Each registered check runs in a task of its own so that the slowest check, not the sum of the checks,
+ * sets the duration of the self-test. The self-test task waits on an event group with one bit per
+ * passed check and one bit for a failure, and reports as soon as the result is known.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "log_level.h"
+
+#include "self_test.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Maximum number of registered checks, one event group bit each.
+ */
+#ifndef selftestMAX_CHECKS
+    #define selftestMAX_CHECKS           ( 8U )
+#endif
+
+/**
+ * @brief Time given to the checks to pass, shorter than otaconfigSELF_TEST_RESPONSE_WAIT_MS so that the
+ * result reaches the OTA agent before its self-test timer rejects the image.
+ */
+#ifndef selftestTIMEOUT_MS
+    #define selftestTIMEOUT_MS           ( 10000U )
+#endif
+
+/**
+ * @brief Priority of the self-test task and of the check tasks.
+ */
+#ifndef selftestTASK_PRIORITY
+    #define selftestTASK_PRIORITY        ( tskIDLE_PRIORITY + 2 )
+#endif
+
+/**
+ * @brief Stack size of the self-test task, in words.
+ */
+#ifndef selftestTASK_STACK_SIZE
+    #define selftestTASK_STACK_SIZE      ( configMINIMAL_STACK_SIZE * 2 )
+#endif
+
+/**
+ * @brief Stack size of each check task, in words.
+ */
+#ifndef selftestCHECK_STACK_SIZE
+    #define selftestCHECK_STACK_SIZE     ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+#if ( selftestMAX_CHECKS > 23U )
+    #error "selftestMAX_CHECKS must leave an event group bit for the failures."
+#endif
+
+/**
+ * @brief Event group bit set by a failed check.
+ */
+#define selftestFAIL_BIT    ( 1UL << selftestMAX_CHECKS )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A registered check.
+ */
+typedef struct SelfTestEntry
+{
+    const char * pcName;
+    SelfTestCheck_t xCheck;
+    void * pvContext;
+    TickType_t xDuration; /**< Ticks from the start of the self-test to the result of the check. */
+    volatile BaseType_t xResult; /**< pdPASS, pdFAIL, or -1 while the check runs. */
+} SelfTestEntry_t;
+
+/**
+ * @brief Registry of the checks.
+ */
+static SelfTestEntry_t xEntries[ selftestMAX_CHECKS ];
+
+/**
+ * @brief Number of registered checks.
+ */
+static UBaseType_t uxEntryCount = 0;
+
+/**
+ * @brief Results of the running self-test.
+ */
+static StaticEventGroup_t xResultsBuffer;
+static EventGroupHandle_t xResults = NULL;
+
+/**
+ * @brief Tick count when the checks started.
+ */
+static TickType_t xStartTime;
+
+/**
+ * @brief Receives the result of the running self-test.
+ */
+static SelfTestCallback_t xResultCallback = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Runs one check and sets its result in the event group.
+ */
+static void prvCheckTask( void * pvParameters )
+{
+    SelfTestEntry_t * pxEntry = ( SelfTestEntry_t * ) pvParameters;
+    BaseType_t xResult;
+
+    xResult = ( pxEntry->xCheck( pxEntry->pvContext ) == pdPASS ) ? pdPASS : pdFAIL;
+    pxEntry->xDuration = xTaskGetTickCount() - xStartTime;
+    pxEntry->xResult = xResult;
+
+    ( void ) xEventGroupSetBits( xResults,
+                                 ( xResult == pdPASS ) ? ( 1UL << ( pxEntry - xEntries ) ) : selftestFAIL_BIT );
+
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Waits for the results of the checks and reports the result of the self-test.
+ */
+static void prvSelfTestTask( void * pvParameters )
+{
+    const EventBits_t xAllPassed = ( 1UL << uxEntryCount ) - 1UL;
+    const TickType_t xTimeout = pdMS_TO_TICKS( selftestTIMEOUT_MS );
+    EventBits_t xBits = 0;
+    TickType_t xElapsed = 0;
+    BaseType_t xResult;
+    UBaseType_t i;
+
+    ( void ) pvParameters;
+
+    /* Wait for the checks not passed yet, so that each result wakes the task once and a failure ends
+     * the wait before the other checks complete. */
+    while( ( ( xBits & xAllPassed ) != xAllPassed ) && ( ( xBits & selftestFAIL_BIT ) == 0U ) && ( xElapsed < xTimeout ) )
+    {
+        xBits = xEventGroupWaitBits( xResults, ( xAllPassed & ~xBits ) | selftestFAIL_BIT, pdFALSE, pdFALSE, xTimeout - xElapsed );
+        xElapsed = xTaskGetTickCount() - xStartTime;
+    }
+
+    xResult = ( ( xBits & xAllPassed ) == xAllPassed ) ? pdPASS : pdFAIL;
+
+    for( i = 0; i < uxEntryCount; i++ )
+    {
+        if( ( xBits & ( 1UL << i ) ) != 0U )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_INFO, ( "Self-test check %s passed in %u ms.\r\n",
+                                                   xEntries[ i ].pcName, ( unsigned ) ( xEntries[ i ].xDuration * portTICK_PERIOD_MS ) ) );
+        }
+        else if( xEntries[ i ].xResult == pdFAIL )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Self-test check %s failed in %u ms.\r\n",
+                                                    xEntries[ i ].pcName, ( unsigned ) ( xEntries[ i ].xDuration * portTICK_PERIOD_MS ) ) );
+        }
+        else
+        {
+            LogModule( LOG_MODULE_OTA, LOG_WARN, ( "Self-test check %s did not complete.\r\n", xEntries[ i ].pcName ) );
+        }
+    }
+
+    LogModule( LOG_MODULE_OTA, ( xResult == pdPASS ) ? LOG_INFO : LOG_ERROR,
+               ( "Self-test %s after %u ms.\r\n", ( xResult == pdPASS ) ? "passed" : "failed", ( unsigned ) ( xElapsed * portTICK_PERIOD_MS ) ) );
+
+    /* Checks still running when the self-test failed keep their tasks until they return. */
+    xResultCallback( xResult );
+
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t SelfTest_Register( const char * pcName,
+                              SelfTestCheck_t xCheck,
+                              void * pvContext )
+{
+    BaseType_t xRegistered = pdFALSE;
+
+    configASSERT( xCheck != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( uxEntryCount < selftestMAX_CHECKS )
+        {
+            xEntries[ uxEntryCount ].pcName = pcName;
+            xEntries[ uxEntryCount ].xCheck = xCheck;
+            xEntries[ uxEntryCount ].pvContext = pvContext;
+            uxEntryCount++;
+            xRegistered = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return xRegistered;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t SelfTest_Start( SelfTestCallback_t xCallback )
+{
+    UBaseType_t i;
+
+    configASSERT( xCallback != NULL );
+
+    if( uxEntryCount == 0U )
+    {
+        LogModule( LOG_MODULE_OTA, LOG_INFO, ( "No self-test check registered.\r\n" ) );
+        xCallback( pdPASS );
+        return pdFALSE;
+    }
+
+    /* The self-test runs once per boot, the image is accepted or rejected afterwards. */
+    if( xResults != NULL )
+    {
+        return pdFALSE;
+    }
+
+    for( i = 0; i < uxEntryCount; i++ )
+    {
+        xEntries[ i ].xResult = -1;
+    }
+
+    xResults = xEventGroupCreateStatic( &xResultsBuffer );
+    xResultCallback = xCallback;
+    xStartTime = xTaskGetTickCount();
+
+    if( xTaskCreate( prvSelfTestTask,
+                     "SelfTest",
+                     selftestTASK_STACK_SIZE,
+                     NULL,
+                     selftestTASK_PRIORITY | portPRIVILEGE_BIT,
+                     NULL ) != pdPASS )
+    {
+        LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to create the self-test task.\r\n" ) );
+        xCallback( pdFAIL );
+        return pdFALSE;
+    }
+
+    for( i = 0; i < uxEntryCount; i++ )
+    {
+        if( xTaskCreate( prvCheckTask,
+                         xEntries[ i ].pcName,
+                         selftestCHECK_STACK_SIZE,
+                         &xEntries[ i ],
+                         selftestTASK_PRIORITY | portPRIVILEGE_BIT,
+                         NULL ) != pdPASS )
+        {
+            LogModule( LOG_MODULE_OTA, LOG_ERROR, ( "Failed to create the task of self-test check %s.\r\n", xEntries[ i ].pcName ) );
+            ( void ) xEventGroupSetBits( xResults, selftestFAIL_BIT );
+        }
+    }
+
+    return pdTRUE;
+}
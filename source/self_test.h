@@ -0,0 +1,81 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file self_test.h
+ * @brief Self-test of a new image, running the checks registered by the application concurrently.
+ */
+
+#ifndef SELF_TEST_H
+#define SELF_TEST_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief A check of the self-test, called from a task of its own.
+ * A check may block, for instance on a network round trip, and returns as soon as it has a result.
+ *
+ * @param[in] pvContext The context given to SelfTest_Register().
+ *
+ * @return pdPASS if the check passed, pdFAIL on a failure rejecting the image.
+ */
+typedef BaseType_t ( * SelfTestCheck_t )( void * pvContext );
+
+/**
+ * @brief Called once with the result of the self-test, from the self-test task.
+ *
+ * @param[in] xResult pdPASS when all the checks passed, pdFAIL on the first failure or when the
+ * checks did not all pass within selftestTIMEOUT_MS.
+ */
+typedef void ( * SelfTestCallback_t )( BaseType_t xResult );
+
+/**
+ * @brief Adds a check to the self-test. Must be called before SelfTest_Start(), typically while the
+ * application starts.
+ *
+ * @param[in] pcName Name of the check, logged with its result.
+ * @param[in] xCheck The check.
+ * @param[in] pvContext Passed to the check.
+ *
+ * @return pdTRUE if the check is registered, pdFALSE if selftestMAX_CHECKS are already registered.
+ */
+BaseType_t SelfTest_Register( const char * pcName,
+                              SelfTestCheck_t xCheck,
+                              void * pvContext );
+
+/**
+ * @brief Runs all the registered checks concurrently and reports the result as soon as it is known,
+ * instead of after the longest of the timeouts of the pending commit.
+ * The callback is called before returning when no check is registered or the self-test cannot start.
+ *
+ * @param[in] xCallback Receives the result.
+ *
+ * @return pdTRUE if the checks are started.
+ */
+BaseType_t SelfTest_Start( SelfTestCallback_t xCallback );
+
+#endif /* ifndef SELF_TEST_H */
@@ -77,8 +77,13 @@ void HardFault_Handler(void){
             "LDR    R3,=0xBEAB \n"
             "CMP     R2,R3 \n"
             "BEQ    _semihost_return \n"
-        // Wasn't semihosting instruction so enter infinite loop
-            "B . \n"
+        // Wasn't semihosting instruction so record the fault and reset,
+        // CrashReport_Reset(CRASH_FAULT_HARD, frame, EXC_RETURN)
+            "MOV    R2, LR \n"
+            "MOV    R1, R0 \n"
+            "MOVS   R0, #0 \n"
+            "LDR    R3,=CrashReport_Reset \n"
+            "BX     R3 \n"
         // Was semihosting instruction, so adjust location to
         // return to by 1 instruction (2 bytes), then exit function
         "_semihost_return: \n"
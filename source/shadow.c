@@ -0,0 +1,1151 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file shadow.c
+ * @brief Device Shadow client reporting the changed properties and applying the deltas in place.
+ *
+ * The dirty mask holds the properties whose value differs from the one last reported. It is set by
+ * Shadow_Set*() and by the deltas and cleared when an update is built, the properties of an update
+ * which fails are set dirty again. Values and masks are only accessed in short critical sections,
+ * as the updates are built in the timer task and the deltas are applied in the MQTT agent task,
+ * neither of which may block. One update is in flight at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "fsl_debug_console.h"
+
+#include "core_mqtt_agent.h"
+#include "connection_manager.h"
+
+#include "shadow.h"
+
+/*-----------------------------------------------------------*/
+
+#if ( shadowMAX_PROPERTIES > 32U )
+    #error "shadowMAX_PROPERTIES must fit in the 32 bits of the dirty mask."
+#endif
+
+/**
+ * @brief Topics of the classic shadow, formatted with the thing name.
+ */
+#define shadowTOPIC_DELTA_FORMAT           "$aws/things/%.*s/shadow/update/delta"
+#define shadowTOPIC_GET_ACCEPTED_FORMAT    "$aws/things/%.*s/shadow/get/accepted"
+#define shadowTOPIC_UPDATE_FORMAT          "$aws/things/%.*s/shadow/update"
+#define shadowTOPIC_GET_FORMAT             "$aws/things/%.*s/shadow/get"
+
+/**
+ * @brief Size of the buffers holding the topics.
+ */
+#define shadowTOPIC_MAX_SIZE               ( 160U )
+
+/**
+ * @brief Indexes of the subscriptions.
+ */
+#define shadowSUBSCRIPTION_DELTA           ( 0U )
+#define shadowSUBSCRIPTION_GET_ACCEPTED    ( 1U )
+#define shadowSUBSCRIPTIONS                ( 2U )
+
+/**
+ * @brief Longest number parsed, in characters.
+ */
+#define shadowNUMBER_MAX_LENGTH            ( 31U )
+
+/**
+ * @brief Delay before the timer retries an update the agent refused.
+ */
+#define shadowRETRY_MS                     ( 1000U )
+
+/**
+ * @brief Start of an update document, the properties follow.
+ */
+#define shadowUPDATE_PREFIX                "{\"state\":{\"reported\":{"
+
+/**
+ * @brief Space kept at the end of the update document for its closing braces.
+ */
+#define shadowDOCUMENT_TRAILER_SIZE        ( 2U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The property table given to Shadow_Init().
+ */
+static ShadowProperty_t * pxTable = NULL;
+static uint32_t ulTableSize = 0;
+
+/**
+ * @brief Properties to report, and properties of the update in flight.
+ */
+static uint32_t ulDirty = 0;
+static uint32_t ulInFlight = 0;
+
+/**
+ * @brief Set while the update operation is owned by the agent.
+ */
+static volatile BaseType_t xUpdatePending = pdFALSE;
+
+/**
+ * @brief Highest version of the shadow applied, 0 before the first document.
+ */
+static uint32_t ulVersion = 0;
+
+/**
+ * @brief Topics, registered with the agent or used by queued operations, so kept for their lifetime.
+ */
+static char cSubscriptionTopics[ shadowSUBSCRIPTIONS ][ shadowTOPIC_MAX_SIZE ];
+static char cUpdateTopic[ shadowTOPIC_MAX_SIZE ];
+static char cGetTopic[ shadowTOPIC_MAX_SIZE ];
+
+/**
+ * @brief Subscriptions, sent again when the session is not resumed.
+ */
+static ConnectionSubscription_t xSubscriptions[ shadowSUBSCRIPTIONS ];
+
+/**
+ * @brief Update publish and its document.
+ */
+static char cDocument[ shadowDOCUMENT_MAX_SIZE ];
+static MQTTPublishInfo_t xUpdateInfo;
+static MQTTOperation_t xUpdateOperation;
+
+/**
+ * @brief Desired string being decoded, only used by the MQTT agent task.
+ */
+static char cDesiredString[ shadowDOCUMENT_MAX_SIZE ];
+
+/**
+ * @brief One-shot timer collecting the changes of an update.
+ */
+static TimerHandle_t xUpdateTimer = NULL;
+static StaticTimer_t xUpdateTimerBuffer;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Skips the white space of a JSON document.
+ */
+static const char * prvSkipSpace( const char * pcJson,
+                                  const char * pcEnd )
+{
+    while( ( pcJson < pcEnd ) && ( ( *pcJson == ' ' ) || ( *pcJson == '\t' ) || ( *pcJson == '\r' ) || ( *pcJson == '\n' ) ) )
+    {
+        pcJson++;
+    }
+
+    return pcJson;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Skips a JSON string.
+ *
+ * @return The character after the closing quote, NULL if the string is not terminated.
+ */
+static const char * prvSkipString( const char * pcJson,
+                                   const char * pcEnd )
+{
+    const char * pcResult = NULL;
+
+    if( ( pcJson < pcEnd ) && ( *pcJson == '"' ) )
+    {
+        for( pcJson++; ( pcJson < pcEnd ) && ( pcResult == NULL ); pcJson++ )
+        {
+            if( *pcJson == '\\' )
+            {
+                pcJson++;
+            }
+            else if( *pcJson == '"' )
+            {
+                pcResult = pcJson + 1;
+            }
+            else
+            {
+                /* Part of the string. */
+            }
+        }
+    }
+
+    return pcResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Skips a JSON value of any type.
+ *
+ * @return The character after the value, NULL if the value is malformed.
+ */
+static const char * prvSkipValue( const char * pcJson,
+                                  const char * pcEnd )
+{
+    uint32_t ulDepth = 0;
+
+    do
+    {
+        if( pcJson >= pcEnd )
+        {
+            pcJson = NULL;
+        }
+        else if( *pcJson == '"' )
+        {
+            pcJson = prvSkipString( pcJson, pcEnd );
+        }
+        else if( ( *pcJson == '{' ) || ( *pcJson == '[' ) )
+        {
+            ulDepth++;
+            pcJson++;
+        }
+        else if( ( *pcJson == '}' ) || ( *pcJson == ']' ) )
+        {
+            /* Only reached inside an object or an array, the closing of the caller stops below. */
+            ulDepth--;
+            pcJson++;
+        }
+        else if( ulDepth > 0U )
+        {
+            /* Separators and scalars inside the value. */
+            pcJson++;
+        }
+        else
+        {
+            /* A scalar at the top, up to the next separator. */
+            while( ( pcJson < pcEnd ) && ( *pcJson != ',' ) && ( *pcJson != '}' ) && ( *pcJson != ']' ) &&
+                   ( *pcJson != ' ' ) && ( *pcJson != '\t' ) && ( *pcJson != '\r' ) && ( *pcJson != '\n' ) )
+            {
+                pcJson++;
+            }
+        }
+    } while( ( pcJson != NULL ) && ( ulDepth > 0U ) );
+
+    return pcJson;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Gets the next member of a JSON object.
+ *
+ * @param[in,out] ppcJson The member, on return the character after it and its separator.
+ * @param[in] pcEnd End of the document.
+ * @param[out] ppcKey The key, without its quotes and not unescaped.
+ * @param[out] pxKeyLength Length of the key.
+ * @param[out] ppcValue The value.
+ * @param[out] ppcValueEnd The character after the value.
+ *
+ * @return true if a member was read, false at the end of the object or if it is malformed.
+ */
+static bool prvNextMember( const char ** ppcJson,
+                           const char * pcEnd,
+                           const char ** ppcKey,
+                           size_t * pxKeyLength,
+                           const char ** ppcValue,
+                           const char ** ppcValueEnd )
+{
+    const char * pcJson = prvSkipSpace( *ppcJson, pcEnd );
+    const char * pcKeyEnd = prvSkipString( pcJson, pcEnd );
+    bool xFound = false;
+
+    if( pcKeyEnd != NULL )
+    {
+        *ppcKey = pcJson + 1;
+        *pxKeyLength = ( size_t ) ( pcKeyEnd - pcJson ) - 2U;
+        pcJson = prvSkipSpace( pcKeyEnd, pcEnd );
+
+        if( ( pcJson < pcEnd ) && ( *pcJson == ':' ) )
+        {
+            *ppcValue = prvSkipSpace( pcJson + 1, pcEnd );
+            *ppcValueEnd = prvSkipValue( *ppcValue, pcEnd );
+
+            if( *ppcValueEnd != NULL )
+            {
+                pcJson = prvSkipSpace( *ppcValueEnd, pcEnd );
+
+                if( ( pcJson < pcEnd ) && ( *pcJson == ',' ) )
+                {
+                    pcJson++;
+                }
+
+                *ppcJson = pcJson;
+                xFound = true;
+            }
+        }
+    }
+
+    return xFound;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Finds a member of a JSON object.
+ *
+ * @param[in] pcObject The object, from its opening brace.
+ * @param[in] pcEnd End of the document.
+ * @param[in] pcKey The key.
+ * @param[out] ppcValueEnd The character after the value.
+ *
+ * @return The value, NULL if the object has no such member.
+ */
+static const char * prvFindMember( const char * pcObject,
+                                   const char * pcEnd,
+                                   const char * pcKey,
+                                   const char ** ppcValueEnd )
+{
+    const char * pcMemberKey;
+    const char * pcValue = NULL;
+    const char * pcResult = NULL;
+    size_t xKeyLength;
+
+    pcObject = prvSkipSpace( pcObject, pcEnd );
+
+    if( ( pcObject < pcEnd ) && ( *pcObject == '{' ) )
+    {
+        pcObject++;
+
+        while( ( pcResult == NULL ) &&
+               ( prvNextMember( &pcObject, pcEnd, &pcMemberKey, &xKeyLength, &pcValue, ppcValueEnd ) == true ) )
+        {
+            if( ( xKeyLength == strlen( pcKey ) ) && ( strncmp( pcMemberKey, pcKey, xKeyLength ) == 0 ) )
+            {
+                pcResult = pcValue;
+            }
+        }
+    }
+
+    return pcResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copies a JSON number into a NUL terminated buffer.
+ *
+ * @return true if it fits.
+ */
+static bool prvCopyNumber( const char * pcValue,
+                           const char * pcValueEnd,
+                           char * pcNumber )
+{
+    size_t xLength = ( size_t ) ( pcValueEnd - pcValue );
+    bool xCopied = false;
+
+    if( ( xLength > 0U ) && ( xLength <= shadowNUMBER_MAX_LENGTH ) )
+    {
+        ( void ) memcpy( pcNumber, pcValue, xLength );
+        pcNumber[ xLength ] = '\0';
+        xCopied = true;
+    }
+
+    return xCopied;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Unescapes a JSON string, the escapes of characters beyond ASCII are refused.
+ *
+ * @return true if the string fits in the buffer with its NUL.
+ */
+static bool prvCopyString( const char * pcValue,
+                           const char * pcValueEnd,
+                           char * pcString,
+                           size_t xSize )
+{
+    const char * pcLast = pcValueEnd - 1;
+    size_t xLength = 0;
+    unsigned long ulCode;
+    char cHex[ 5 ];
+    bool xValid = ( pcValue < pcLast ) && ( *pcValue == '"' ) && ( *pcLast == '"' );
+
+    for( pcValue++; ( xValid == true ) && ( pcValue < pcLast ); pcValue++ )
+    {
+        char cChar = *pcValue;
+
+        if( cChar == '\\' )
+        {
+            pcValue++;
+
+            switch( *pcValue )
+            {
+                case 'n':
+                    cChar = '\n';
+                    break;
+
+                case 'r':
+                    cChar = '\r';
+                    break;
+
+                case 't':
+                    cChar = '\t';
+                    break;
+
+                case 'b':
+                    cChar = '\b';
+                    break;
+
+                case 'f':
+                    cChar = '\f';
+                    break;
+
+                case 'u':
+                    xValid = ( ( pcLast - pcValue ) > 4 );
+
+                    if( xValid == true )
+                    {
+                        ( void ) memcpy( cHex, pcValue + 1, 4 );
+                        cHex[ 4 ] = '\0';
+                        ulCode = strtoul( cHex, NULL, 16 );
+                        xValid = ( ulCode > 0U ) && ( ulCode < 0x80U );
+                        cChar = ( char ) ulCode;
+                        pcValue += 4;
+                    }
+
+                    break;
+
+                default:
+                    /* \" \\ \/ */
+                    cChar = *pcValue;
+                    break;
+            }
+        }
+
+        if( ( xValid == true ) && ( ( xLength + 1U ) < xSize ) )
+        {
+            pcString[ xLength ] = cChar;
+            xLength++;
+        }
+        else
+        {
+            xValid = false;
+        }
+    }
+
+    if( xValid == true )
+    {
+        pcString[ xLength ] = '\0';
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Marks a property to be reported, in a critical section. prvScheduleUpdate() is called after it.
+ */
+static void prvMarkDirty( uint32_t ulIndex )
+{
+    ulDirty |= ( 1UL << ulIndex );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Starts the timer of the next update if properties are dirty, without blocking.
+ */
+static void prvScheduleUpdate( void )
+{
+    if( ( ulDirty != 0U ) && ( xUpdateTimer != NULL ) && ( xTimerIsTimerActive( xUpdateTimer ) == pdFALSE ) )
+    {
+        ( void ) xTimerChangePeriod( xUpdateTimer, pdMS_TO_TICKS( shadowUPDATE_INTERVAL_MS ), 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Applies the desired value of a property.
+ *
+ * @return true if the value is valid for the property.
+ */
+static bool prvApplyValue( ShadowProperty_t * pxProperty,
+                           uint32_t ulIndex,
+                           const char * pcValue,
+                           const char * pcValueEnd )
+{
+    char cNumber[ shadowNUMBER_MAX_LENGTH + 1U ];
+    char * pcNumberEnd = NULL;
+    long lValue = 0;
+    float fValue = 0.0f;
+    bool bValue = false;
+    size_t xLength = ( size_t ) ( pcValueEnd - pcValue );
+    bool xValid = false;
+
+    switch( pxProperty->xType )
+    {
+        case SHADOW_TYPE_INT:
+
+            if( prvCopyNumber( pcValue, pcValueEnd, cNumber ) == true )
+            {
+                lValue = strtol( cNumber, &pcNumberEnd, 10 );
+                xValid = ( *pcNumberEnd == '\0' ) && ( lValue >= INT32_MIN ) && ( lValue <= INT32_MAX );
+            }
+
+            break;
+
+        case SHADOW_TYPE_FLOAT:
+
+            if( prvCopyNumber( pcValue, pcValueEnd, cNumber ) == true )
+            {
+                fValue = strtof( cNumber, &pcNumberEnd );
+                xValid = ( *pcNumberEnd == '\0' );
+            }
+
+            break;
+
+        case SHADOW_TYPE_BOOL:
+            bValue = ( xLength == 4U ) && ( strncmp( pcValue, "true", 4 ) == 0 );
+            xValid = ( bValue == true ) || ( ( xLength == 5U ) && ( strncmp( pcValue, "false", 5 ) == 0 ) );
+            break;
+
+        case SHADOW_TYPE_STRING:
+            /* Checked before the critical section, so a string too long leaves the value as it is. */
+            xValid = ( prvCopyString( pcValue, pcValueEnd, cDesiredString, sizeof( cDesiredString ) ) == true ) &&
+                     ( strlen( cDesiredString ) < pxProperty->xSize );
+            break;
+
+        default:
+            /* Unknown type. */
+            break;
+    }
+
+    if( xValid == true )
+    {
+        taskENTER_CRITICAL();
+        {
+            switch( pxProperty->xType )
+            {
+                case SHADOW_TYPE_INT:
+                    *( ( int32_t * ) pxProperty->pvValue ) = ( int32_t ) lValue;
+                    break;
+
+                case SHADOW_TYPE_FLOAT:
+                    *( ( float * ) pxProperty->pvValue ) = fValue;
+                    break;
+
+                case SHADOW_TYPE_BOOL:
+                    *( ( bool * ) pxProperty->pvValue ) = bValue;
+                    break;
+
+                default:
+                    ( void ) strcpy( ( char * ) pxProperty->pvValue, cDesiredString );
+                    break;
+            }
+
+            /* Reported back even if unchanged, so the broker clears the delta. */
+            prvMarkDirty( ulIndex );
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Applies the members of a state object to the properties of the same keys.
+ */
+static void prvApplyState( const char * pcState,
+                           const char * pcEnd )
+{
+    const char * pcKey;
+    const char * pcValue;
+    const char * pcValueEnd;
+    size_t xKeyLength;
+    uint32_t ulIndex;
+
+    pcState = prvSkipSpace( pcState, pcEnd );
+
+    if( ( pcState < pcEnd ) && ( *pcState == '{' ) )
+    {
+        pcState++;
+
+        while( prvNextMember( &pcState, pcEnd, &pcKey, &xKeyLength, &pcValue, &pcValueEnd ) == true )
+        {
+            for( ulIndex = 0; ulIndex < ulTableSize; ulIndex++ )
+            {
+                if( ( strlen( pxTable[ ulIndex ].pcKey ) == xKeyLength ) &&
+                    ( strncmp( pxTable[ ulIndex ].pcKey, pcKey, xKeyLength ) == 0 ) )
+                {
+                    break;
+                }
+            }
+
+            if( ulIndex == ulTableSize )
+            {
+                PRINTF( "Shadow has no property %.*s.\r\n", ( int ) xKeyLength, pcKey );
+            }
+            else if( prvApplyValue( &pxTable[ ulIndex ], ulIndex, pcValue, pcValueEnd ) == false )
+            {
+                PRINTF( "Shadow ignored the value of %.*s.\r\n", ( int ) xKeyLength, pcKey );
+            }
+            else if( pxTable[ ulIndex ].xCallback != NULL )
+            {
+                pxTable[ ulIndex ].xCallback( &pxTable[ ulIndex ] );
+            }
+            else
+            {
+                /* Set without notification. */
+            }
+        }
+    }
+
+    prvScheduleUpdate();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Handles a delta or a document read from the shadow, ignoring those older than the last one
+ * applied.
+ */
+static void prvIncomingCallback( void * pCallbackContext,
+                                 MQTTPublishInfo_t * pPublishInfo )
+{
+    const char * pcJson = ( const char * ) pPublishInfo->pPayload;
+    const char * pcEnd = pcJson + pPublishInfo->payloadLength;
+    const char * pcValue;
+    const char * pcValueEnd;
+    char cNumber[ shadowNUMBER_MAX_LENGTH + 1U ];
+    uint32_t ulDocumentVersion = 0;
+
+    pcValue = prvFindMember( pcJson, pcEnd, "version", &pcValueEnd );
+
+    if( ( pcValue != NULL ) && ( prvCopyNumber( pcValue, pcValueEnd, cNumber ) == true ) )
+    {
+        ulDocumentVersion = ( uint32_t ) strtoul( cNumber, NULL, 10 );
+    }
+
+    if( ulDocumentVersion <= ulVersion )
+    {
+        PRINTF( "Shadow ignored version %u, version %u is applied.\r\n", ( unsigned ) ulDocumentVersion, ( unsigned ) ulVersion );
+    }
+    else
+    {
+        ulVersion = ulDocumentVersion;
+        pcValue = prvFindMember( pcJson, pcEnd, "state", &pcValueEnd );
+
+        /* A document read from the shadow holds its delta in state.delta, if any. */
+        if( ( pcValue != NULL ) && ( ( uintptr_t ) pCallbackContext == shadowSUBSCRIPTION_GET_ACCEPTED ) )
+        {
+            pcValue = prvFindMember( pcValue, pcValueEnd, "delta", &pcValueEnd );
+        }
+
+        if( pcValue != NULL )
+        {
+            prvApplyState( pcValue, pcValueEnd );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Appends text to the update document, keeping the space of its closing braces.
+ *
+ * @return true if it fits.
+ */
+static bool prvAppend( size_t * pxLength,
+                       const char * pcText,
+                       size_t xTextLength )
+{
+    bool xFits = ( ( *pxLength + xTextLength + shadowDOCUMENT_TRAILER_SIZE ) <= sizeof( cDocument ) );
+
+    if( xFits == true )
+    {
+        ( void ) memcpy( &cDocument[ *pxLength ], pcText, xTextLength );
+        *pxLength += xTextLength;
+    }
+
+    return xFits;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Appends a property, its key and value followed by a comma, to the update document.
+ *
+ * @return true if it fits.
+ */
+static bool prvAppendProperty( size_t * pxLength,
+                               const ShadowProperty_t * pxProperty )
+{
+    char cValue[ shadowNUMBER_MAX_LENGTH + 1U ];
+    char cEscape[ 7 ];
+    const char * pcString;
+    size_t xStart = *pxLength;
+    uint32_t ulScale = 1, ulFraction, ulIndex;
+    int32_t lValue = 0;
+    float fValue = 0.0f;
+    bool bValue = false;
+    int lLength = 0;
+    bool xFits;
+
+    taskENTER_CRITICAL();
+    {
+        switch( pxProperty->xType )
+        {
+            case SHADOW_TYPE_INT:
+                lValue = *( ( const int32_t * ) pxProperty->pvValue );
+                break;
+
+            case SHADOW_TYPE_FLOAT:
+                fValue = *( ( const float * ) pxProperty->pvValue );
+                break;
+
+            case SHADOW_TYPE_BOOL:
+                bValue = *( ( const bool * ) pxProperty->pvValue );
+                break;
+
+            default:
+                /* Strings are only changed in critical sections, a copy is taken below. */
+                break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    xFits = prvAppend( pxLength, "\"", 1 ) &&
+            prvAppend( pxLength, pxProperty->pcKey, strlen( pxProperty->pcKey ) ) &&
+            prvAppend( pxLength, "\":", 2 );
+
+    switch( pxProperty->xType )
+    {
+        case SHADOW_TYPE_INT:
+            lLength = snprintf( cValue, sizeof( cValue ), "%ld", ( long ) lValue );
+            break;
+
+        case SHADOW_TYPE_FLOAT:
+
+            /* The C library has no float formatting, the value is written as fixed point. JSON has
+             * no representation of NaN and the infinities. */
+            for( ulIndex = 0; ulIndex < shadowFLOAT_DECIMALS; ulIndex++ )
+            {
+                ulScale *= 10U;
+            }
+
+            if( ( fValue != fValue ) || ( fValue > 2.0e9f ) || ( fValue < -2.0e9f ) )
+            {
+                lLength = snprintf( cValue, sizeof( cValue ), "null" );
+            }
+            else
+            {
+                lValue = ( int32_t ) fValue;
+                ulFraction = ( uint32_t ) ( ( ( fValue < 0.0f ) ? -( fValue - ( float ) lValue ) : ( fValue - ( float ) lValue ) ) * ( float ) ulScale + 0.5f );
+
+                if( ulFraction >= ulScale )
+                {
+                    ulFraction -= ulScale;
+                    lValue += ( fValue < 0.0f ) ? -1 : 1;
+                }
+
+                lLength = snprintf( cValue, sizeof( cValue ), "%s%ld.%0*lu",
+                                    ( ( fValue < 0.0f ) && ( lValue == 0 ) ) ? "-" : "",
+                                    ( long ) lValue, ( int ) shadowFLOAT_DECIMALS, ( unsigned long ) ulFraction );
+            }
+
+            break;
+
+        case SHADOW_TYPE_BOOL:
+            lLength = snprintf( cValue, sizeof( cValue ), "%s", ( bValue == true ) ? "true" : "false" );
+            break;
+
+        default:
+            break;
+    }
+
+    if( pxProperty->xType != SHADOW_TYPE_STRING )
+    {
+        xFits = xFits && prvAppend( pxLength, cValue, ( size_t ) lLength );
+    }
+    else
+    {
+        xFits = xFits && prvAppend( pxLength, "\"", 1 );
+
+        taskENTER_CRITICAL();
+        {
+            pcString = ( const char * ) pxProperty->pvValue;
+
+            for( ulIndex = 0; ( xFits == true ) && ( pcString[ ulIndex ] != '\0' ); ulIndex++ )
+            {
+                if( ( pcString[ ulIndex ] == '"' ) || ( pcString[ ulIndex ] == '\\' ) )
+                {
+                    cEscape[ 0 ] = '\\';
+                    cEscape[ 1 ] = pcString[ ulIndex ];
+                    xFits = prvAppend( pxLength, cEscape, 2 );
+                }
+                else if( ( unsigned char ) pcString[ ulIndex ] < 0x20U )
+                {
+                    ( void ) snprintf( cEscape, sizeof( cEscape ), "\\u%04x", ( unsigned ) pcString[ ulIndex ] );
+                    xFits = prvAppend( pxLength, cEscape, 6 );
+                }
+                else
+                {
+                    xFits = prvAppend( pxLength, &pcString[ ulIndex ], 1 );
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        xFits = xFits && prvAppend( pxLength, "\"", 1 );
+    }
+
+    xFits = xFits && prvAppend( pxLength, ",", 1 );
+
+    if( xFits == false )
+    {
+        *pxLength = xStart;
+    }
+
+    return xFits;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvUpdateCallback( struct MQTTOperation * pOperation,
+                               MQTTStatus_t status )
+{
+    ( void ) pOperation;
+
+    taskENTER_CRITICAL();
+    {
+        if( status != MQTTSuccess )
+        {
+            /* Reported again with the changes made meanwhile. */
+            ulDirty |= ulInFlight;
+        }
+
+        ulInFlight = 0;
+    }
+    taskEXIT_CRITICAL();
+
+    if( status != MQTTSuccess )
+    {
+        PRINTF( "Shadow update failed, error = %d.\r\n", status );
+    }
+
+    xUpdatePending = pdFALSE;
+    prvScheduleUpdate();
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Builds and queues an update of the dirty properties, from the timer task.
+ */
+static void prvUpdateTimerCallback( TimerHandle_t xTimer )
+{
+    uint32_t ulPending, ulSent = 0, ulIndex;
+    size_t xLength = 0;
+
+    ( void ) xTimer;
+
+    taskENTER_CRITICAL();
+    {
+        ulPending = ( xUpdatePending == pdFALSE ) ? ulDirty : 0U;
+    }
+    taskEXIT_CRITICAL();
+
+    /* While an update is in flight, its completion starts the timer again. */
+    if( ulPending != 0U )
+    {
+        ( void ) prvAppend( &xLength, shadowUPDATE_PREFIX, sizeof( shadowUPDATE_PREFIX ) - 1U );
+
+        for( ulIndex = 0; ulIndex < ulTableSize; ulIndex++ )
+        {
+            if( ( ( ulPending & ( 1UL << ulIndex ) ) != 0U ) && ( prvAppendProperty( &xLength, &pxTable[ ulIndex ] ) == true ) )
+            {
+                ulSent |= ( 1UL << ulIndex );
+            }
+        }
+
+        if( ulSent == 0U )
+        {
+            PRINTF( "Shadow property does not fit in an update, increase shadowDOCUMENT_MAX_SIZE.\r\n" );
+        }
+        else
+        {
+            /* Replaces the last comma, the closing braces fit in the space kept by prvAppend(). */
+            ( void ) memcpy( &cDocument[ xLength - 1U ], "}}}", 3 );
+            xLength += shadowDOCUMENT_TRAILER_SIZE;
+
+            taskENTER_CRITICAL();
+            {
+                /* A property set again while the document was built is still dirty since its value
+                 * may be newer than the one written, it is reported once more. */
+                ulDirty &= ~ulSent;
+                ulInFlight = ulSent;
+            }
+            taskEXIT_CRITICAL();
+
+            memset( &xUpdateInfo, 0x00, sizeof( xUpdateInfo ) );
+            xUpdateInfo.qos = MQTTQoS1;
+            xUpdateInfo.pTopicName = cUpdateTopic;
+            xUpdateInfo.topicNameLength = ( uint16_t ) strlen( cUpdateTopic );
+            xUpdateInfo.pPayload = cDocument;
+            xUpdateInfo.payloadLength = xLength;
+
+            memset( &xUpdateOperation, 0x00, sizeof( xUpdateOperation ) );
+            xUpdateOperation.type = MQTT_OP_PUBLISH;
+            xUpdateOperation.info.pPublishInfo = &xUpdateInfo;
+            xUpdateOperation.callback = prvUpdateCallback;
+            xUpdateOperation.priority = MQTT_AGENT_PRIORITY_BULK;
+            xUpdatePending = pdTRUE;
+
+            if( MQTTAgent_Enqueue( NULL, &xUpdateOperation, 0 ) != pdTRUE )
+            {
+                taskENTER_CRITICAL();
+                {
+                    ulDirty |= ulInFlight;
+                    ulInFlight = 0;
+                }
+                taskEXIT_CRITICAL();
+
+                xUpdatePending = pdFALSE;
+                ( void ) xTimerChangePeriod( xUpdateTimer, pdMS_TO_TICKS( shadowRETRY_MS ), 0 );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reads the shadow once get/accepted is subscribed, the document is received on it.
+ */
+static void prvSubscribedCallback( void * pContext,
+                                   MQTTStatus_t status )
+{
+    MQTTPublishInfo_t xGetInfo = { 0 };
+
+    ( void ) pContext;
+
+    if( status == MQTTSuccess )
+    {
+        xGetInfo.qos = MQTTQoS0;
+        xGetInfo.pTopicName = cGetTopic;
+        xGetInfo.topicNameLength = ( uint16_t ) strlen( cGetTopic );
+        xGetInfo.pPayload = "";
+        xGetInfo.payloadLength = 0;
+
+        if( MQTTAgent_PublishCopy( NULL, &xGetInfo, NULL, MQTT_AGENT_PRIORITY_CONTROL, 0 ) != pdTRUE )
+        {
+            PRINTF( "Shadow get not queued.\r\n" );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Checks the type and index of a property given to Shadow_Set*().
+ */
+static bool prvIsProperty( uint32_t ulIndex,
+                           ShadowType_t xType )
+{
+    return ( ulIndex < ulTableSize ) && ( pxTable[ ulIndex ].xType == xType );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Shadow_SetInt( uint32_t ulIndex,
+                          int32_t lValue )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( prvIsProperty( ulIndex, SHADOW_TYPE_INT ) == true )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( *( ( int32_t * ) pxTable[ ulIndex ].pvValue ) != lValue )
+            {
+                *( ( int32_t * ) pxTable[ ulIndex ].pvValue ) = lValue;
+                prvMarkDirty( ulIndex );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        prvScheduleUpdate();
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Shadow_SetFloat( uint32_t ulIndex,
+                            float fValue )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( prvIsProperty( ulIndex, SHADOW_TYPE_FLOAT ) == true )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( *( ( float * ) pxTable[ ulIndex ].pvValue ) != fValue )
+            {
+                *( ( float * ) pxTable[ ulIndex ].pvValue ) = fValue;
+                prvMarkDirty( ulIndex );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        prvScheduleUpdate();
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Shadow_SetBool( uint32_t ulIndex,
+                           bool bValue )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( prvIsProperty( ulIndex, SHADOW_TYPE_BOOL ) == true )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( *( ( bool * ) pxTable[ ulIndex ].pvValue ) != bValue )
+            {
+                *( ( bool * ) pxTable[ ulIndex ].pvValue ) = bValue;
+                prvMarkDirty( ulIndex );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        prvScheduleUpdate();
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Shadow_SetString( uint32_t ulIndex,
+                             const char * pcValue )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( prvIsProperty( ulIndex, SHADOW_TYPE_STRING ) == true ) && ( strlen( pcValue ) < pxTable[ ulIndex ].xSize ) )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( strcmp( ( char * ) pxTable[ ulIndex ].pvValue, pcValue ) != 0 )
+            {
+                ( void ) strcpy( ( char * ) pxTable[ ulIndex ].pvValue, pcValue );
+                prvMarkDirty( ulIndex );
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        prvScheduleUpdate();
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Shadow_Init( const char * pcThingName,
+                        uint32_t ulThingNameLength,
+                        ShadowProperty_t * pxProperties,
+                        uint32_t ulPropertyCount )
+{
+    const char * const pcFormats[ shadowSUBSCRIPTIONS ] = { shadowTOPIC_DELTA_FORMAT, shadowTOPIC_GET_ACCEPTED_FORMAT };
+    uint16_t usTopicLengths[ shadowSUBSCRIPTIONS ];
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulIndex;
+    int lLength;
+
+    if( ( pxProperties == NULL ) || ( ulPropertyCount == 0U ) || ( ulPropertyCount > shadowMAX_PROPERTIES ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    for( ulIndex = 0; ( xResult == pdTRUE ) && ( ulIndex < shadowSUBSCRIPTIONS ); ulIndex++ )
+    {
+        lLength = snprintf( cSubscriptionTopics[ ulIndex ], shadowTOPIC_MAX_SIZE, pcFormats[ ulIndex ],
+                            ( int ) ulThingNameLength, pcThingName );
+
+        if( ( lLength <= 0 ) || ( ( size_t ) lLength >= shadowTOPIC_MAX_SIZE ) )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            usTopicLengths[ ulIndex ] = ( uint16_t ) lLength;
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        ( void ) snprintf( cUpdateTopic, sizeof( cUpdateTopic ), shadowTOPIC_UPDATE_FORMAT, ( int ) ulThingNameLength, pcThingName );
+        ( void ) snprintf( cGetTopic, sizeof( cGetTopic ), shadowTOPIC_GET_FORMAT, ( int ) ulThingNameLength, pcThingName );
+
+        pxTable = pxProperties;
+        ulTableSize = ulPropertyCount;
+
+        /* The first update reports the whole table. */
+        ulDirty = ( ulPropertyCount == 32U ) ? 0xFFFFFFFFUL : ( ( 1UL << ulPropertyCount ) - 1U );
+
+        xUpdateTimer = xTimerCreateStatic( "Shadow",
+                                           pdMS_TO_TICKS( shadowUPDATE_INTERVAL_MS ),
+                                           pdFALSE,
+                                           NULL,
+                                           prvUpdateTimerCallback,
+                                           &xUpdateTimerBuffer );
+
+        prvScheduleUpdate();
+
+        /* The delta first, so that no change made after the read of the shadow is missed. */
+        for( ulIndex = 0; ulIndex < shadowSUBSCRIPTIONS; ulIndex++ )
+        {
+            if( ConnectionManager_Subscribe( &xSubscriptions[ ulIndex ], cSubscriptionTopics[ ulIndex ],
+                                             usTopicLengths[ ulIndex ], MQTTQoS1, prvIncomingCallback,
+                                             ( ulIndex == shadowSUBSCRIPTION_GET_ACCEPTED ) ? prvSubscribedCallback : NULL,
+                                             ( void * ) ( uintptr_t ) ulIndex ) != pdTRUE )
+            {
+                xResult = pdFALSE;
+            }
+        }
+    }
+
+    return xResult;
+}
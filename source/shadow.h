@@ -0,0 +1,173 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file shadow.h
+ * @brief Device Shadow client keeping a local copy of the top level properties of the classic shadow
+ * of the thing, reporting only the properties which changed and applying the desired ones.
+ *
+ * The application describes its properties in a table which holds their current values. After a
+ * Shadow_Set*() changes a value, the property is reported with the other properties changed within
+ * shadowUPDATE_INTERVAL_MS, in one update {"state":{"reported":{...}}} holding only those properties.
+ * The deltas published by the broker on "$aws/things/<thing name>/shadow/update/delta" are applied
+ * to the table in place, each property set is reported back so the broker clears its delta. At
+ * start, every property is reported once and the shadow is read to apply the deltas made while the
+ * device was off.
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Maximum number of properties.
+ */
+#ifndef shadowMAX_PROPERTIES
+    #define shadowMAX_PROPERTIES    ( 16U )
+#endif
+
+/**
+ * @brief Time the changes are collected before they are reported in one update.
+ */
+#ifndef shadowUPDATE_INTERVAL_MS
+    #define shadowUPDATE_INTERVAL_MS    ( 2000U )
+#endif
+
+/**
+ * @brief Size of an update document. The properties which do not fit are reported by the next update.
+ */
+#ifndef shadowDOCUMENT_MAX_SIZE
+    #define shadowDOCUMENT_MAX_SIZE    ( 512U )
+#endif
+
+/**
+ * @brief Number of decimals of the floats reported.
+ */
+#ifndef shadowFLOAT_DECIMALS
+    #define shadowFLOAT_DECIMALS    ( 3U )
+#endif
+
+/**
+ * @brief Type of a property.
+ */
+typedef enum ShadowType
+{
+    SHADOW_TYPE_INT = 0, /**< int32_t, a JSON number without fraction. */
+    SHADOW_TYPE_FLOAT,   /**< float, a JSON number. */
+    SHADOW_TYPE_BOOL,    /**< bool, true or false. */
+    SHADOW_TYPE_STRING   /**< NUL terminated char array of xSize bytes, a JSON string. */
+} ShadowType_t;
+
+struct ShadowProperty;
+
+/**
+ * @brief Called when a delta sets a property, once the new value is in the table. Runs in the MQTT
+ * agent task and must not block.
+ *
+ * @param[in] pxProperty The property.
+ */
+typedef void ( * ShadowDesiredCallback_t )( const struct ShadowProperty * pxProperty );
+
+/**
+ * @brief A top level property of the shadow. The table is kept by the module, the values must only
+ * be changed through Shadow_Set*() once it is initialized.
+ */
+typedef struct ShadowProperty
+{
+    const char * pcKey;                /**< Key in the reported and desired sections. */
+    ShadowType_t xType;                /**< Type of the value. */
+    void * pvValue;                    /**< The current value, of the C type of xType. */
+    size_t xSize;                      /**< Size of the array, for SHADOW_TYPE_STRING. */
+    ShadowDesiredCallback_t xCallback; /**< Optional, called when a delta sets the property. */
+} ShadowProperty_t;
+
+/**
+ * @brief Subscribes to the deltas of the shadow of the thing, then reports all the properties and
+ * reads the shadow. The subscriptions are sent again when the broker does not resume the session.
+ * Must be called once the MQTT agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ * @param[in] pxProperties The properties, kept by reference.
+ * @param[in] ulPropertyCount Number of properties, at most shadowMAX_PROPERTIES.
+ *
+ * @return pdTRUE if the subscribe is queued.
+ */
+BaseType_t Shadow_Init( const char * pcThingName,
+                        uint32_t ulThingNameLength,
+                        ShadowProperty_t * pxProperties,
+                        uint32_t ulPropertyCount );
+
+/**
+ * @brief Sets an integer property, reported if the value changed.
+ *
+ * @param[in] ulIndex Index of the property in the table.
+ * @param[in] lValue The value.
+ *
+ * @return pdTRUE if the property is an integer.
+ */
+BaseType_t Shadow_SetInt( uint32_t ulIndex,
+                          int32_t lValue );
+
+/**
+ * @brief Sets a float property, reported if the value changed.
+ *
+ * @param[in] ulIndex Index of the property in the table.
+ * @param[in] fValue The value.
+ *
+ * @return pdTRUE if the property is a float.
+ */
+BaseType_t Shadow_SetFloat( uint32_t ulIndex,
+                            float fValue );
+
+/**
+ * @brief Sets a boolean property, reported if the value changed.
+ *
+ * @param[in] ulIndex Index of the property in the table.
+ * @param[in] bValue The value.
+ *
+ * @return pdTRUE if the property is a boolean.
+ */
+BaseType_t Shadow_SetBool( uint32_t ulIndex,
+                           bool bValue );
+
+/**
+ * @brief Sets a string property, reported if the value changed.
+ *
+ * @param[in] ulIndex Index of the property in the table.
+ * @param[in] pcValue The value, NUL terminated.
+ *
+ * @return pdTRUE if the property is a string large enough for the value.
+ */
+BaseType_t Shadow_SetString( uint32_t ulIndex,
+                             const char * pcValue );
+
+#endif /* SHADOW_H */
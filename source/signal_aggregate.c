@@ -0,0 +1,462 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file signal_aggregate.c
+ * @brief Reduces a sampled signal to statistics and spectral features of fixed windows.
+ *
+ * The spectrum is the real FFT of the window weighted by a Hann window, in the packed layout of
+ * arm_rfft_fast_f32(): the real parts of DC and of the Nyquist bin in the first two floats, then the
+ * real and imaginary parts of bins 1 to N/2 - 1. Without CMSIS-DSP, it is computed as a complex FFT
+ * of N/2 points, whose even and odd inputs are the even and odd samples, followed by the split step
+ * separating the spectra of both halves.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "signal_aggregate.h"
+
+/*-----------------------------------------------------------*/
+
+#if ( ( aggregatorWINDOW_SIZE & ( aggregatorWINDOW_SIZE - 1U ) ) != 0 ) || ( aggregatorWINDOW_SIZE < 32U ) || ( aggregatorWINDOW_SIZE > 4096U )
+    #error "aggregatorWINDOW_SIZE must be a power of 2 from 32 to 4096."
+#endif
+
+#if ( aggregatorBANDS < 1U ) || ( aggregatorBANDS > ( aggregatorWINDOW_SIZE / 2U ) )
+    #error "aggregatorBANDS must be from 1 to aggregatorWINDOW_SIZE / 2."
+#endif
+
+/**
+ * @brief Number of bins of the spectrum from DC to the Nyquist frequency excluded, also the size of
+ * the complex FFT the real one is computed with.
+ */
+#define aggregatorHALF_SIZE    ( aggregatorWINDOW_SIZE / 2U )
+
+#define aggregatorPI           ( 3.14159265358979f )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Hann window, shared by the aggregators.
+ */
+static float fHann[ aggregatorWINDOW_SIZE ];
+
+#if ( aggregatorUSE_CMSIS_DSP == 0 )
+
+/**
+ * @brief cos( 2 * pi * k / N ) and sin( 2 * pi * k / N ) for k from 0 to N/2 - 1, the twiddles of
+ * both the complex FFT and the split step.
+ */
+    static float fCos[ aggregatorHALF_SIZE ];
+    static float fSin[ aggregatorHALF_SIZE ];
+#endif
+
+/**
+ * @brief Set once the shared tables are computed.
+ */
+static BaseType_t xTablesReady = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Computes the shared tables on the first call.
+ */
+static void prvInitTables( void );
+
+/**
+ * @brief Computes the statistics of the current window.
+ *
+ * @param[in] pxAggregator The aggregator.
+ * @param[out] pxFeatures Receives the statistics.
+ */
+static void prvComputeStatistics( const Aggregator_t * pxAggregator,
+                                  AggregatorFeatures_t * pxFeatures );
+
+/**
+ * @brief Computes the power of the bins of the current window, overwriting the samples.
+ *
+ * @param[in] pxAggregator The aggregator.
+ *
+ * @return The power of bins 0 to N/2, N/2 + 1 floats in one of the buffers of the aggregator.
+ */
+static float * prvComputePower( Aggregator_t * pxAggregator );
+
+/**
+ * @brief Computes the spectral features from the power of the bins.
+ *
+ * @param[in] pxAggregator The aggregator.
+ * @param[in] pfPower The power of bins 0 to N/2.
+ * @param[out] pxFeatures Receives the spectral features.
+ */
+static void prvComputeSpectralFeatures( const Aggregator_t * pxAggregator,
+                                        const float * pfPower,
+                                        AggregatorFeatures_t * pxFeatures );
+
+#if ( aggregatorUSE_CMSIS_DSP == 0 )
+
+/**
+ * @brief Computes the real FFT of aggregatorWINDOW_SIZE points in place, in the packed layout.
+ *
+ * @param[in,out] pfData The samples, then the spectrum.
+ */
+    static void prvRealFft( float * pfData );
+#endif
+
+/*-----------------------------------------------------------*/
+
+static void prvInitTables( void )
+{
+    uint32_t ulIndex;
+
+    vTaskSuspendAll();
+
+    if( xTablesReady == pdFALSE )
+    {
+        for( ulIndex = 0; ulIndex < aggregatorWINDOW_SIZE; ulIndex++ )
+        {
+            fHann[ ulIndex ] = 0.5f - ( 0.5f * cosf( ( 2.0f * aggregatorPI * ( float ) ulIndex ) / ( float ) aggregatorWINDOW_SIZE ) );
+        }
+
+        #if ( aggregatorUSE_CMSIS_DSP == 0 )
+            for( ulIndex = 0; ulIndex < aggregatorHALF_SIZE; ulIndex++ )
+            {
+                fCos[ ulIndex ] = cosf( ( 2.0f * aggregatorPI * ( float ) ulIndex ) / ( float ) aggregatorWINDOW_SIZE );
+                fSin[ ulIndex ] = sinf( ( 2.0f * aggregatorPI * ( float ) ulIndex ) / ( float ) aggregatorWINDOW_SIZE );
+            }
+        #endif
+
+        xTablesReady = pdTRUE;
+    }
+
+    ( void ) xTaskResumeAll();
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( aggregatorUSE_CMSIS_DSP == 0 )
+
+    static void prvRealFft( float * pfData )
+    {
+        uint32_t ulIndex, ulOther, ulBit, ulSpan, ulStart, ulStride;
+        float fRe, fIm, fWRe, fWIm, fSumRe, fSumIm, fDiffRe, fDiffIm;
+
+        /* The samples are read as N/2 complex points, even samples as the real parts. Reorder
+         * them in bit reversed order for the decimation in time. */
+        for( ulIndex = 1, ulOther = 0; ulIndex < aggregatorHALF_SIZE; ulIndex++ )
+        {
+            for( ulBit = aggregatorHALF_SIZE >> 1; ( ulOther & ulBit ) != 0U; ulBit >>= 1 )
+            {
+                ulOther ^= ulBit;
+            }
+
+            ulOther |= ulBit;
+
+            if( ulIndex < ulOther )
+            {
+                fRe = pfData[ 2U * ulIndex ];
+                fIm = pfData[ ( 2U * ulIndex ) + 1U ];
+                pfData[ 2U * ulIndex ] = pfData[ 2U * ulOther ];
+                pfData[ ( 2U * ulIndex ) + 1U ] = pfData[ ( 2U * ulOther ) + 1U ];
+                pfData[ 2U * ulOther ] = fRe;
+                pfData[ ( 2U * ulOther ) + 1U ] = fIm;
+            }
+        }
+
+        /* Radix 2 butterflies. The twiddle of point k of a span of S points is W_N^( k * N / S ). */
+        for( ulSpan = 2U; ulSpan <= aggregatorHALF_SIZE; ulSpan <<= 1 )
+        {
+            ulStride = aggregatorWINDOW_SIZE / ulSpan;
+
+            for( ulStart = 0; ulStart < aggregatorHALF_SIZE; ulStart += ulSpan )
+            {
+                for( ulIndex = 0; ulIndex < ( ulSpan / 2U ); ulIndex++ )
+                {
+                    uint32_t ulTop = 2U * ( ulStart + ulIndex );
+                    uint32_t ulBottom = ulTop + ulSpan;
+
+                    fWRe = fCos[ ulIndex * ulStride ];
+                    fWIm = -fSin[ ulIndex * ulStride ];
+                    fRe = ( pfData[ ulBottom ] * fWRe ) - ( pfData[ ulBottom + 1U ] * fWIm );
+                    fIm = ( pfData[ ulBottom ] * fWIm ) + ( pfData[ ulBottom + 1U ] * fWRe );
+                    pfData[ ulBottom ] = pfData[ ulTop ] - fRe;
+                    pfData[ ulBottom + 1U ] = pfData[ ulTop + 1U ] - fIm;
+                    pfData[ ulTop ] += fRe;
+                    pfData[ ulTop + 1U ] += fIm;
+                }
+            }
+        }
+
+        /* Split step: X[k] = ( Z[k] + conj( Z[N/2 - k] ) ) / 2 - j * W_N^k * ( Z[k] - conj( Z[N/2 - k] ) ) / 2,
+         * computed for k and N/2 - k together, whose twiddle is -conj( W_N^k ). */
+        fRe = pfData[ 0 ];
+        fIm = pfData[ 1 ];
+        pfData[ 0 ] = fRe + fIm;
+        pfData[ 1 ] = fRe - fIm;
+
+        for( ulIndex = 1; ulIndex <= ( aggregatorHALF_SIZE / 2U ); ulIndex++ )
+        {
+            ulOther = aggregatorHALF_SIZE - ulIndex;
+
+            fSumRe = 0.5f * ( pfData[ 2U * ulIndex ] + pfData[ 2U * ulOther ] );
+            fSumIm = 0.5f * ( pfData[ ( 2U * ulIndex ) + 1U ] - pfData[ ( 2U * ulOther ) + 1U ] );
+            fDiffRe = 0.5f * ( pfData[ 2U * ulIndex ] - pfData[ 2U * ulOther ] );
+            fDiffIm = 0.5f * ( pfData[ ( 2U * ulIndex ) + 1U ] + pfData[ ( 2U * ulOther ) + 1U ] );
+
+            /* -j * W * D with W = cos - j * sin: ( -j * cos - sin ) * D. */
+            fWRe = fCos[ ulIndex ];
+            fWIm = fSin[ ulIndex ];
+            fRe = ( fDiffIm * fWRe ) - ( fDiffRe * fWIm );
+            fIm = -( fDiffRe * fWRe ) - ( fDiffIm * fWIm );
+
+            pfData[ 2U * ulIndex ] = fSumRe + fRe;
+            pfData[ ( 2U * ulIndex ) + 1U ] = fSumIm + fIm;
+            pfData[ 2U * ulOther ] = fSumRe - fRe;
+            pfData[ ( 2U * ulOther ) + 1U ] = fIm - fSumIm;
+        }
+    }
+
+#endif /* if ( aggregatorUSE_CMSIS_DSP == 0 ) */
+
+/*-----------------------------------------------------------*/
+
+static void prvComputeStatistics( const Aggregator_t * pxAggregator,
+                                  AggregatorFeatures_t * pxFeatures )
+{
+    #if ( aggregatorUSE_CMSIS_DSP == 1 )
+        uint32_t ulIndex;
+
+        arm_mean_f32( ( float32_t * ) pxAggregator->fWindow, aggregatorWINDOW_SIZE, &pxFeatures->fMean );
+        arm_rms_f32( ( float32_t * ) pxAggregator->fWindow, aggregatorWINDOW_SIZE, &pxFeatures->fRms );
+        arm_std_f32( ( float32_t * ) pxAggregator->fWindow, aggregatorWINDOW_SIZE, &pxFeatures->fStd );
+        arm_min_f32( ( float32_t * ) pxAggregator->fWindow, aggregatorWINDOW_SIZE, &pxFeatures->fMin, &ulIndex );
+        arm_max_f32( ( float32_t * ) pxAggregator->fWindow, aggregatorWINDOW_SIZE, &pxFeatures->fMax, &ulIndex );
+    #else
+        uint32_t ulIndex;
+        float fSample, fSum = 0.0f, fSumOfSquares = 0.0f, fVariance;
+
+        pxFeatures->fMin = pxAggregator->fWindow[ 0 ];
+        pxFeatures->fMax = pxAggregator->fWindow[ 0 ];
+
+        for( ulIndex = 0; ulIndex < aggregatorWINDOW_SIZE; ulIndex++ )
+        {
+            fSample = pxAggregator->fWindow[ ulIndex ];
+            fSum += fSample;
+            fSumOfSquares += fSample * fSample;
+
+            if( fSample < pxFeatures->fMin )
+            {
+                pxFeatures->fMin = fSample;
+            }
+
+            if( fSample > pxFeatures->fMax )
+            {
+                pxFeatures->fMax = fSample;
+            }
+        }
+
+        /* Same definitions as arm_mean_f32(), arm_rms_f32() and arm_std_f32(), the deviation
+         * being that of a sample. */
+        pxFeatures->fMean = fSum / ( float ) aggregatorWINDOW_SIZE;
+        pxFeatures->fRms = sqrtf( fSumOfSquares / ( float ) aggregatorWINDOW_SIZE );
+        fVariance = ( fSumOfSquares - ( ( fSum * fSum ) / ( float ) aggregatorWINDOW_SIZE ) ) / ( float ) ( aggregatorWINDOW_SIZE - 1U );
+        pxFeatures->fStd = ( fVariance > 0.0f ) ? sqrtf( fVariance ) : 0.0f;
+    #endif /* if ( aggregatorUSE_CMSIS_DSP == 1 ) */
+}
+
+/*-----------------------------------------------------------*/
+
+static float * prvComputePower( Aggregator_t * pxAggregator )
+{
+    float * pfSpectrum;
+    float * pfPower;
+
+    #if ( aggregatorUSE_CMSIS_DSP == 1 )
+        /* arm_rfft_fast_f32() overwrites its input, the spectrum goes to the window. */
+        arm_mult_f32( pxAggregator->fWindow, fHann, pxAggregator->fScratch, aggregatorWINDOW_SIZE );
+        arm_rfft_fast_f32( &pxAggregator->xFft, pxAggregator->fScratch, pxAggregator->fWindow, 0 );
+        pfSpectrum = pxAggregator->fWindow;
+        pfPower = pxAggregator->fScratch;
+        arm_cmplx_mag_squared_f32( &pfSpectrum[ 2 ], &pfPower[ 1 ], aggregatorHALF_SIZE - 1U );
+    #else
+        uint32_t ulIndex;
+
+        for( ulIndex = 0; ulIndex < aggregatorWINDOW_SIZE; ulIndex++ )
+        {
+            pxAggregator->fScratch[ ulIndex ] = pxAggregator->fWindow[ ulIndex ] * fHann[ ulIndex ];
+        }
+
+        prvRealFft( pxAggregator->fScratch );
+        pfSpectrum = pxAggregator->fScratch;
+        pfPower = pxAggregator->fWindow;
+
+        for( ulIndex = 1; ulIndex < aggregatorHALF_SIZE; ulIndex++ )
+        {
+            pfPower[ ulIndex ] = ( pfSpectrum[ 2U * ulIndex ] * pfSpectrum[ 2U * ulIndex ] ) +
+                                 ( pfSpectrum[ ( 2U * ulIndex ) + 1U ] * pfSpectrum[ ( 2U * ulIndex ) + 1U ] );
+        }
+    #endif /* if ( aggregatorUSE_CMSIS_DSP == 1 ) */
+
+    /* The Nyquist bin is read before bin 0 overwrites the first float of the spectrum. */
+    pfPower[ aggregatorHALF_SIZE ] = pfSpectrum[ 1 ] * pfSpectrum[ 1 ];
+    pfPower[ 0 ] = pfSpectrum[ 0 ] * pfSpectrum[ 0 ];
+
+    return pfPower;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvComputeSpectralFeatures( const Aggregator_t * pxAggregator,
+                                        const float * pfPower,
+                                        AggregatorFeatures_t * pxFeatures )
+{
+    uint32_t ulBin, ulBand, ulPeakBin = 1U;
+    float fScale;
+
+    /* Single sided power, scaled by 2 / N^2 so a band holding a sine of amplitude A reports
+     * close to A^2 / 2 times the power gain of the Hann window, 3 / 8. */
+    fScale = 2.0f / ( ( float ) aggregatorWINDOW_SIZE * ( float ) aggregatorWINDOW_SIZE );
+    ( void ) memset( pxFeatures->fBandEnergy, 0, sizeof( pxFeatures->fBandEnergy ) );
+
+    for( ulBin = 1U; ulBin <= aggregatorHALF_SIZE; ulBin++ )
+    {
+        if( pfPower[ ulBin ] > pfPower[ ulPeakBin ] )
+        {
+            ulPeakBin = ulBin;
+        }
+
+        ulBand = ( ( ulBin - 1U ) * aggregatorBANDS ) / aggregatorHALF_SIZE;
+        pxFeatures->fBandEnergy[ ulBand ] += pfPower[ ulBin ] * fScale;
+    }
+
+    /* The coherent gain of the Hann window is 1 / 2, a sine of amplitude A centred on a bin
+     * gives |X| = A * N / 4. */
+    pxFeatures->fPeakHz = ( ( float ) ulPeakBin * pxAggregator->fSampleRateHz ) / ( float ) aggregatorWINDOW_SIZE;
+    pxFeatures->fPeakAmplitude = ( 4.0f * sqrtf( pfPower[ ulPeakBin ] ) ) / ( float ) aggregatorWINDOW_SIZE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Aggregator_Init( Aggregator_t * pxAggregator,
+                            float fSampleRateHz,
+                            AggregatorWindowCallback_t xCallback,
+                            void * pvContext )
+{
+    BaseType_t xReturn = pdFALSE;
+
+    if( ( pxAggregator != NULL ) && ( xCallback != NULL ) && ( fSampleRateHz > 0.0f ) )
+    {
+        ( void ) memset( pxAggregator, 0, sizeof( Aggregator_t ) );
+        pxAggregator->fSampleRateHz = fSampleRateHz;
+        pxAggregator->xCallback = xCallback;
+        pxAggregator->pvContext = pvContext;
+        prvInitTables();
+        xReturn = pdTRUE;
+
+        #if ( aggregatorUSE_CMSIS_DSP == 1 )
+            if( arm_rfft_fast_init_f32( &pxAggregator->xFft, ( uint16_t ) aggregatorWINDOW_SIZE ) != ARM_MATH_SUCCESS )
+            {
+                xReturn = pdFALSE;
+            }
+        #endif
+    }
+
+    return xReturn;
+}
+
+/*-----------------------------------------------------------*/
+
+void Aggregator_AddSamples( Aggregator_t * pxAggregator,
+                            const float * pfSamples,
+                            uint32_t ulCount )
+{
+    AggregatorFeatures_t xFeatures;
+    uint32_t ulCopy;
+    float * pfPower;
+
+    while( ulCount > 0U )
+    {
+        ulCopy = aggregatorWINDOW_SIZE - pxAggregator->ulFill;
+
+        if( ulCopy > ulCount )
+        {
+            ulCopy = ulCount;
+        }
+
+        ( void ) memcpy( &pxAggregator->fWindow[ pxAggregator->ulFill ], pfSamples, ulCopy * sizeof( float ) );
+        pxAggregator->ulFill += ulCopy;
+        pxAggregator->ulSamples += ulCopy;
+        pfSamples += ulCopy;
+        ulCount -= ulCopy;
+
+        if( pxAggregator->ulFill == aggregatorWINDOW_SIZE )
+        {
+            xFeatures.ulSamples = pxAggregator->ulSamples;
+            prvComputeStatistics( pxAggregator, &xFeatures );
+            pfPower = prvComputePower( pxAggregator );
+            prvComputeSpectralFeatures( pxAggregator, pfPower, &xFeatures );
+            pxAggregator->ulFill = 0U;
+
+            pxAggregator->xCallback( &xFeatures, pxAggregator->pvContext );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void Aggregator_EncodeFeatures( TelemetryEncoder_t * pxEncoder,
+                                void * pvFeatures )
+{
+    const AggregatorFeatures_t * pxFeatures = ( const AggregatorFeatures_t * ) pvFeatures;
+    uint32_t ulBand;
+
+    Telemetry_EncodeMap( pxEncoder, 9 );
+    Telemetry_EncodeText( pxEncoder, "n", 1 );
+    Telemetry_EncodeUint( pxEncoder, pxFeatures->ulSamples );
+    Telemetry_EncodeText( pxEncoder, "mean", 4 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fMean );
+    Telemetry_EncodeText( pxEncoder, "rms", 3 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fRms );
+    Telemetry_EncodeText( pxEncoder, "std", 3 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fStd );
+    Telemetry_EncodeText( pxEncoder, "min", 3 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fMin );
+    Telemetry_EncodeText( pxEncoder, "max", 3 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fMax );
+    Telemetry_EncodeText( pxEncoder, "pk_hz", 5 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fPeakHz );
+    Telemetry_EncodeText( pxEncoder, "pk", 2 );
+    Telemetry_EncodeFloat( pxEncoder, pxFeatures->fPeakAmplitude );
+    Telemetry_EncodeText( pxEncoder, "bands", 5 );
+    Telemetry_EncodeArray( pxEncoder, aggregatorBANDS );
+
+    for( ulBand = 0; ulBand < aggregatorBANDS; ulBand++ )
+    {
+        Telemetry_EncodeFloat( pxEncoder, pxFeatures->fBandEnergy[ ulBand ] );
+    }
+}
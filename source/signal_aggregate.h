@@ -0,0 +1,159 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file signal_aggregate.h
+ * @brief Reduces a sampled signal to statistics and spectral features of fixed windows, so a high
+ * rate sensor stream reaches the MQTT agent as one telemetry sample per window.
+ *
+ * A sensor task feeds its samples with Aggregator_AddSamples(). Each time a window is complete, the
+ * callback receives its features, typically to pass them on to the telemetry batcher:
+ *
+ *     static void prvOnWindow( const AggregatorFeatures_t * pxFeatures, void * pvContext )
+ *     {
+ *         ( void ) Telemetry_Add( Aggregator_EncodeFeatures, ( void * ) pxFeatures, 0U );
+ *     }
+ */
+
+#ifndef SIGNAL_AGGREGATE_H
+#define SIGNAL_AGGREGATE_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "telemetry.h"
+
+/**
+ * @brief Number of samples of a window, a power of 2 from 32 to 4096.
+ */
+#ifndef aggregatorWINDOW_SIZE
+    #define aggregatorWINDOW_SIZE    ( 256U )
+#endif
+
+/**
+ * @brief Number of bands of equal width the spectrum between the first bin and the Nyquist
+ * frequency is split into.
+ */
+#ifndef aggregatorBANDS
+    #define aggregatorBANDS    ( 4U )
+#endif
+
+/**
+ * @brief 1 computes the features with the CMSIS-DSP kernels of lib/nxp/CMSIS/arm_math.h.
+ * The tree only has the headers of CMSIS-DSP: add libarm_cortexM4lf_math.a to lib/nxp/libs and
+ * arm_cortexM4lf_math to the libraries of the linker before setting it. 0 uses the single precision
+ * loops and FFT of signal_aggregate.c, which the compiler also maps to the FPU of the Cortex-M4.
+ */
+#ifndef aggregatorUSE_CMSIS_DSP
+    #define aggregatorUSE_CMSIS_DSP    0
+#endif
+
+#if ( aggregatorUSE_CMSIS_DSP == 1 )
+    #include "arm_math.h"
+#endif
+
+/**
+ * @brief Features of one window.
+ */
+typedef struct AggregatorFeatures
+{
+    uint32_t ulSamples;                   /**< Samples aggregated so far, including this window. */
+    float fMean;                          /**< Mean of the samples. */
+    float fRms;                           /**< Root mean square of the samples. */
+    float fStd;                           /**< Standard deviation of the samples. */
+    float fMin;                           /**< Smallest sample. */
+    float fMax;                           /**< Largest sample. */
+    float fPeakHz;                        /**< Frequency of the strongest bin above DC. */
+    float fPeakAmplitude;                 /**< Amplitude of a sine at fPeakHz. */
+    float fBandEnergy[ aggregatorBANDS ]; /**< Energy of each band, the sum of the single sided power of its bins. */
+} AggregatorFeatures_t;
+
+/**
+ * @brief Receives the features of a window, in the context of Aggregator_AddSamples().
+ *
+ * @param[in] pxFeatures The features, only valid during the call.
+ * @param[in] pvContext The context passed to Aggregator_Init().
+ */
+typedef void ( * AggregatorWindowCallback_t )( const AggregatorFeatures_t * pxFeatures,
+                                               void * pvContext );
+
+/**
+ * @brief An aggregator. The buffers take 8 * aggregatorWINDOW_SIZE bytes, create it statically or
+ * in the heap rather than on a task stack.
+ */
+typedef struct Aggregator
+{
+    float fWindow[ aggregatorWINDOW_SIZE ];  /**< Samples of the current window. */
+    float fScratch[ aggregatorWINDOW_SIZE ]; /**< Windowed samples and spectrum. */
+    uint32_t ulFill;                         /**< Samples in fWindow. */
+    uint32_t ulSamples;                      /**< Samples aggregated so far. */
+    float fSampleRateHz;                     /**< Sample rate of the signal. */
+    AggregatorWindowCallback_t xCallback;    /**< Receives the features. */
+    void * pvContext;                        /**< Passed to xCallback. */
+    #if ( aggregatorUSE_CMSIS_DSP == 1 )
+        arm_rfft_fast_instance_f32 xFft;     /**< Real FFT of aggregatorWINDOW_SIZE points. */
+    #endif
+} Aggregator_t;
+
+/**
+ * @brief Sets up an aggregator.
+ *
+ * @param[out] pxAggregator The aggregator.
+ * @param[in] fSampleRateHz Sample rate of the signal.
+ * @param[in] xCallback Receives the features of each window.
+ * @param[in] pvContext Passed to the callback.
+ *
+ * @return pdTRUE if the aggregator is set up.
+ */
+BaseType_t Aggregator_Init( Aggregator_t * pxAggregator,
+                            float fSampleRateHz,
+                            AggregatorWindowCallback_t xCallback,
+                            void * pvContext );
+
+/**
+ * @brief Adds samples to the current window, calling the callback for each window they complete.
+ * An aggregator is fed by one task only.
+ *
+ * @param[in] pxAggregator The aggregator.
+ * @param[in] pfSamples The samples.
+ * @param[in] ulCount Number of samples.
+ */
+void Aggregator_AddSamples( Aggregator_t * pxAggregator,
+                            const float * pfSamples,
+                            uint32_t ulCount );
+
+/**
+ * @brief Writes features as a telemetry sample, the CBOR map {"n", "mean", "rms", "std", "min", "max",
+ * "pk_hz", "pk", "bands": [...]}. Matches TelemetrySampleCallback_t.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] pvFeatures The AggregatorFeatures_t to write.
+ */
+void Aggregator_EncodeFeatures( TelemetryEncoder_t * pxEncoder,
+                                void * pvFeatures );
+
+#endif /* SIGNAL_AGGREGATE_H */
@@ -0,0 +1,798 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file store_forward.c
+ * @brief Store and forward queue in a ring of SPIFI flash sectors.
+ *
+ * Each sector starts with a header holding its sequence number, which increases by one for each
+ * sector opened, so sequence S always lives in sector S % storeforwardSECTORS. The records follow,
+ * word aligned. The read position, the record after the last one acknowledged, and the head, where
+ * the next record is appended, are a sequence and an offset each. At boot they are found again from
+ * the sector headers and the records marked as sent.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include "fsl_crc32.h"
+#include "fsl_debug_console.h"
+
+#include "mflash_drv.h"
+#include "mflash_file.h"
+
+#include "connection_manager.h"
+#include "core_mqtt_agent.h"
+
+#include "store_forward.h"
+
+/*-----------------------------------------------------------*/
+
+#if ( ( storeforwardSECTORS & ( storeforwardSECTORS - 1U ) ) != 0 ) || ( storeforwardSECTORS < 2U )
+    #error "storeforwardSECTORS must be a power of 2 of at least 2."
+#endif
+
+#if ( ( storeforwardBASE_ADDR + ( storeforwardSECTORS * MFLASH_SECTOR_SIZE ) ) > ( FSL_FEATURE_SPIFI_START_ADDR + 0x1000000 ) )
+    #error "The store and forward ring does not fit in the 16 MB of the SPIFI flash."
+#endif
+
+#if ( storeforwardRECORD_MAX_SIZE > storeforwardBATCH_SIZE ) || ( storeforwardRECORD_MAX_SIZE > ( MFLASH_SECTOR_SIZE / 2U ) )
+    #error "storeforwardRECORD_MAX_SIZE must fit in storeforwardBATCH_SIZE and in half a sector."
+#endif
+
+/**
+ * @brief Magic numbers of the sector headers and of the records.
+ */
+#define storeforwardSECTOR_MAGIC        ( 0x31524653UL )
+#define storeforwardRECORD_MAGIC        ( 0x31434552UL )
+
+/**
+ * @brief Value of erased flash.
+ */
+#define storeforwardERASED              ( 0xFFFFFFFFUL )
+
+/**
+ * @brief Offset of the first record of a sector.
+ */
+#define storeforwardFIRST_RECORD        ( ( uint32_t ) sizeof( StoreForwardSector_t ) )
+
+/**
+ * @brief Priority of the drain task, below the MQTT agent and the application tasks.
+ */
+#ifndef storeforwardTASK_PRIORITY
+    #define storeforwardTASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Stack size of the drain task, in words.
+ */
+#ifndef storeforwardTASK_STACK_SIZE
+    #define storeforwardTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 3 )
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Header of a sector.
+ */
+typedef struct StoreForwardSector
+{
+    uint32_t ulMagic;
+    uint32_t ulSequence;
+} StoreForwardSector_t;
+
+/**
+ * @brief Header of a record, followed by the topic and the payload. The CRC covers both lengths,
+ * the topic and the payload. ulSent is programmed to 0 once the record and all the records before
+ * it are acknowledged, without erasing the sector.
+ */
+typedef struct StoreForwardRecord
+{
+    uint32_t ulMagic;
+    uint16_t usTopicLength;
+    uint16_t usPayloadLength;
+    uint32_t ulCrc;
+    uint32_t ulSent;
+} StoreForwardRecord_t;
+
+/**
+ * @brief A position in the ring.
+ */
+typedef struct StoreForwardPosition
+{
+    uint32_t ulSequence;
+    uint32_t ulOffset;
+} StoreForwardPosition_t;
+
+/**
+ * @brief Publish of a batch and the record it comes from.
+ */
+typedef struct StoreForwardEntry
+{
+    MQTTOperation_t xOperation;    /**< First member, the completion callback finds the entry from it. */
+    MQTTPublishInfo_t xPublishInfo;
+    StoreForwardPosition_t xRecord; /**< Position of the record. */
+    StoreForwardPosition_t xNext;   /**< Position of the record following it. */
+    volatile MQTTStatus_t xStatus;  /**< Completion status. */
+} StoreForwardEntry_t;
+
+/**
+ * @brief State of the queue, guarded by xMutex.
+ */
+typedef struct StoreForward
+{
+    SemaphoreHandle_t xMutex;
+    StaticSemaphore_t xMutexBuffer;
+    SemaphoreHandle_t xAcks;          /**< Given by each completion of the batch. */
+    StaticSemaphore_t xAcksBuffer;
+    TaskHandle_t xDrainTask;
+    StoreForwardPosition_t xHead;     /**< Where the next record is appended. */
+    StoreForwardPosition_t xRead;     /**< Oldest record not acknowledged. */
+    bool xBatchInFlight;              /**< Set while a batch waits for its acknowledgements. */
+    StoreForwardStats_t xStats;
+} StoreForward_t;
+
+/*-----------------------------------------------------------*/
+
+static StoreForward_t xStore;
+
+/**
+ * @brief The publishes of the batch in flight, topics and payloads in ucBatchBuffer.
+ */
+static StoreForwardEntry_t xBatch[ storeforwardBATCH_RECORDS ];
+static uint8_t ucBatchBuffer[ storeforwardBATCH_SIZE ];
+
+/**
+ * @brief A record being appended, in RAM as the flash driver cannot program data read from the
+ * flash itself, such as constant topics.
+ */
+static uint32_t ulRecordBuffer[ storeforwardRECORD_MAX_SIZE / sizeof( uint32_t ) ];
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Computes the CRC32 of a record, with the CRC engine when it is free.
+ */
+static uint32_t prvRecordCrc( const StoreForwardRecord_t * pxRecord,
+                              const uint8_t * pucData );
+
+/**
+ * @brief Gets the size a record takes in the ring.
+ */
+static uint32_t prvRecordSize( uint32_t ulDataLength );
+
+/**
+ * @brief Gets the address of a position.
+ */
+static uint32_t prvAddress( const StoreForwardPosition_t * pxPosition );
+
+/**
+ * @brief Checks the order of two positions.
+ *
+ * @return true if pxA is before pxB.
+ */
+static bool prvIsBefore( const StoreForwardPosition_t * pxA,
+                         const StoreForwardPosition_t * pxB );
+
+/**
+ * @brief Checks that a sector still holds the given sequence.
+ */
+static bool prvSectorHolds( uint32_t ulSequence );
+
+/**
+ * @brief Reads the header of the record at a position.
+ *
+ * @return true if a record fitting in the sector is there, false for erased or unreadable flash,
+ * in which case the rest of the sector holds no record.
+ */
+static bool prvReadRecord( const StoreForwardPosition_t * pxPosition,
+                           StoreForwardRecord_t * pxRecord );
+
+/**
+ * @brief Checks that the flash from an address to the end of its sector is erased.
+ */
+static bool prvIsBlank( uint32_t ulAddress );
+
+/**
+ * @brief Finds the head and the read position from the sectors of the ring.
+ */
+static void prvScan( void );
+
+/**
+ * @brief Erases the sector of the sequence after the head and makes it the head, dropping its
+ * records first when the ring is full.
+ *
+ * @return true if the sector is open.
+ */
+static bool prvOpenNextSector( void );
+
+/**
+ * @brief Appends a record at the head.
+ *
+ * @return true if the record is written.
+ */
+static bool prvAppend( const MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Copies the next records from the read position into the batch.
+ *
+ * @param[out] pulBytes Receives the size of the topics and payloads.
+ *
+ * @return Number of publishes in the batch.
+ */
+static uint32_t prvReadBatch( uint32_t * pulBytes );
+
+/**
+ * @brief Marks the records up to the last entry acknowledged as sent, the batch being complete.
+ *
+ * @param[in] ulCount Number of entries of the batch.
+ *
+ * @return Number of entries acknowledged in a row from the first one.
+ */
+static uint32_t prvCompleteBatch( uint32_t ulCount );
+
+/**
+ * @brief Completion callback of the batch publishes.
+ */
+static void prvPublishComplete( MQTTOperation_t * pxOperation,
+                                MQTTStatus_t xStatus );
+
+/**
+ * @brief Wakes the drain task once the broker is reachable again.
+ */
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool xSessionPresent );
+
+/**
+ * @brief Sends the stored records while connected.
+ */
+static void prvDrainTask( void * pvParameters );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvRecordCrc( const StoreForwardRecord_t * pxRecord,
+                              const uint8_t * pucData )
+{
+    uint32_t ulCrc;
+
+    ulCrc = CRC32_Update( 0, &pxRecord->usTopicLength, sizeof( pxRecord->usTopicLength ) );
+    ulCrc = CRC32_Update( ulCrc, &pxRecord->usPayloadLength, sizeof( pxRecord->usPayloadLength ) );
+
+    return CRC32_Update( ulCrc, pucData, ( size_t ) pxRecord->usTopicLength + pxRecord->usPayloadLength );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvRecordSize( uint32_t ulDataLength )
+{
+    return ( uint32_t ) sizeof( StoreForwardRecord_t ) + ( ( ulDataLength + 3U ) & ~3U );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvAddress( const StoreForwardPosition_t * pxPosition )
+{
+    return storeforwardBASE_ADDR + ( ( pxPosition->ulSequence % storeforwardSECTORS ) * MFLASH_SECTOR_SIZE ) +
+           pxPosition->ulOffset;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvIsBefore( const StoreForwardPosition_t * pxA,
+                         const StoreForwardPosition_t * pxB )
+{
+    return ( pxA->ulSequence < pxB->ulSequence ) ||
+           ( ( pxA->ulSequence == pxB->ulSequence ) && ( pxA->ulOffset < pxB->ulOffset ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvSectorHolds( uint32_t ulSequence )
+{
+    StoreForwardPosition_t xSector = { ulSequence, 0 };
+    StoreForwardSector_t xHeader;
+
+    ( void ) mflash_drv_read( ( const void * ) prvAddress( &xSector ), ( uint8_t * ) &xHeader, sizeof( xHeader ) );
+
+    return ( xHeader.ulMagic == storeforwardSECTOR_MAGIC ) && ( xHeader.ulSequence == ulSequence );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvReadRecord( const StoreForwardPosition_t * pxPosition,
+                           StoreForwardRecord_t * pxRecord )
+{
+    bool xValid = false;
+
+    if( ( pxPosition->ulOffset + sizeof( StoreForwardRecord_t ) ) <= MFLASH_SECTOR_SIZE )
+    {
+        ( void ) mflash_drv_read( ( const void * ) prvAddress( pxPosition ), ( uint8_t * ) pxRecord, sizeof( *pxRecord ) );
+
+        xValid = ( pxRecord->ulMagic == storeforwardRECORD_MAGIC ) &&
+                 ( ( pxPosition->ulOffset + prvRecordSize( ( uint32_t ) pxRecord->usTopicLength + pxRecord->usPayloadLength ) ) <= MFLASH_SECTOR_SIZE );
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvIsBlank( uint32_t ulAddress )
+{
+    const uint32_t * pulWord = ( const uint32_t * ) ulAddress;
+    const uint32_t * pulEnd = ( const uint32_t * ) ( ( ulAddress | ( MFLASH_SECTOR_SIZE - 1U ) ) + 1U );
+    bool xBlank = true;
+
+    /* The ring is memory mapped, the driver keeps the flash readable outside its own calls. */
+    while( ( pulWord < pulEnd ) && ( xBlank == true ) )
+    {
+        xBlank = ( *pulWord == storeforwardERASED );
+        pulWord++;
+    }
+
+    return xBlank;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvScan( void )
+{
+    StoreForwardPosition_t xPosition;
+    StoreForwardRecord_t xRecord;
+    StoreForwardSector_t xHeader;
+    uint32_t ulSector, ulOldest;
+    bool xFound = false;
+
+    for( ulSector = 0; ulSector < storeforwardSECTORS; ulSector++ )
+    {
+        ( void ) mflash_drv_read( ( const void * ) ( storeforwardBASE_ADDR + ( ulSector * MFLASH_SECTOR_SIZE ) ),
+                                  ( uint8_t * ) &xHeader, sizeof( xHeader ) );
+
+        if( ( xHeader.ulMagic == storeforwardSECTOR_MAGIC ) && ( xHeader.ulSequence != storeforwardERASED ) &&
+            ( ( xHeader.ulSequence % storeforwardSECTORS ) == ulSector ) &&
+            ( ( xFound == false ) || ( xHeader.ulSequence > xStore.xHead.ulSequence ) ) )
+        {
+            xStore.xHead.ulSequence = xHeader.ulSequence;
+            xFound = true;
+        }
+    }
+
+    if( xFound == false )
+    {
+        /* Empty ring, the first append opens the sector of sequence 1. */
+        xStore.xHead.ulSequence = 0;
+        xStore.xHead.ulOffset = MFLASH_SECTOR_SIZE;
+        xStore.xRead.ulSequence = 1;
+        xStore.xRead.ulOffset = storeforwardFIRST_RECORD;
+    }
+    else
+    {
+        /* The sectors of the ring are those with consecutive sequences up to the head. */
+        ulOldest = xStore.xHead.ulSequence;
+
+        while( ( ulOldest > 1U ) && ( ( xStore.xHead.ulSequence - ulOldest ) < ( storeforwardSECTORS - 1U ) ) &&
+               ( prvSectorHolds( ulOldest - 1U ) == true ) )
+        {
+            ulOldest--;
+        }
+
+        xStore.xRead.ulSequence = ulOldest;
+        xStore.xRead.ulOffset = storeforwardFIRST_RECORD;
+
+        /* The read position follows the last record marked as sent. */
+        for( xPosition.ulSequence = ulOldest; xPosition.ulSequence <= xStore.xHead.ulSequence; xPosition.ulSequence++ )
+        {
+            xPosition.ulOffset = storeforwardFIRST_RECORD;
+
+            while( prvReadRecord( &xPosition, &xRecord ) == true )
+            {
+                xPosition.ulOffset += prvRecordSize( ( uint32_t ) xRecord.usTopicLength + xRecord.usPayloadLength );
+
+                if( xRecord.ulSent != storeforwardERASED )
+                {
+                    xStore.xRead = xPosition;
+                }
+            }
+        }
+
+        /* Appending resumes after the last record, unless something was programmed after it, such as
+         * a record cut by a reset, in which case the next sector is opened. */
+        xStore.xHead.ulOffset = xPosition.ulOffset;
+        xPosition.ulSequence = xStore.xHead.ulSequence;
+
+        if( ( xPosition.ulOffset >= MFLASH_SECTOR_SIZE ) || ( prvIsBlank( prvAddress( &xPosition ) ) == false ) )
+        {
+            xStore.xHead.ulOffset = MFLASH_SECTOR_SIZE;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvOpenNextSector( void )
+{
+    StoreForwardSector_t xHeader = { storeforwardSECTOR_MAGIC, xStore.xHead.ulSequence + 1U };
+    StoreForwardPosition_t xPosition = { xHeader.ulSequence, 0 };
+    StoreForwardRecord_t xRecord;
+    bool xOpened = false;
+
+    /* The sector still holds the oldest sequence of a full ring. */
+    if( ( xHeader.ulSequence >= storeforwardSECTORS ) &&
+        ( xStore.xRead.ulSequence == ( xHeader.ulSequence - storeforwardSECTORS ) ) )
+    {
+        StoreForwardPosition_t xDropped = xStore.xRead;
+
+        while( prvReadRecord( &xDropped, &xRecord ) == true )
+        {
+            xDropped.ulOffset += prvRecordSize( ( uint32_t ) xRecord.usTopicLength + xRecord.usPayloadLength );
+            xStore.xStats.ulDropped++;
+        }
+
+        xStore.xRead.ulSequence = xHeader.ulSequence - storeforwardSECTORS + 1U;
+        xStore.xRead.ulOffset = storeforwardFIRST_RECORD;
+    }
+
+    if( ( mflash_drv_erase( ( void * ) prvAddress( &xPosition ), MFLASH_SECTOR_SIZE ) == 0 ) &&
+        ( mflash_drv_write( ( void * ) prvAddress( &xPosition ), ( const uint8_t * ) &xHeader, sizeof( xHeader ) ) == 0 ) )
+    {
+        xStore.xHead.ulSequence = xHeader.ulSequence;
+        xStore.xHead.ulOffset = storeforwardFIRST_RECORD;
+        xOpened = true;
+    }
+    else
+    {
+        PRINTF( "Store and forward failed to open the sector of sequence %u.\r\n", ( unsigned ) xHeader.ulSequence );
+    }
+
+    return xOpened;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvAppend( const MQTTPublishInfo_t * pxPublishInfo )
+{
+    StoreForwardRecord_t * pxRecord = ( StoreForwardRecord_t * ) ulRecordBuffer;
+    uint8_t * pucData = ( uint8_t * ) &pxRecord[ 1 ];
+    uint32_t ulDataLength = ( uint32_t ) pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength;
+    uint32_t ulSize = prvRecordSize( ulDataLength );
+    bool xWritten = false;
+
+    if( ( ulSize <= sizeof( ulRecordBuffer ) ) &&
+        ( ( ( xStore.xHead.ulOffset + ulSize ) <= MFLASH_SECTOR_SIZE ) || ( prvOpenNextSector() == true ) ) )
+    {
+        pxRecord->ulMagic = storeforwardRECORD_MAGIC;
+        pxRecord->usTopicLength = pxPublishInfo->topicNameLength;
+        pxRecord->usPayloadLength = ( uint16_t ) pxPublishInfo->payloadLength;
+        pxRecord->ulSent = storeforwardERASED;
+        ( void ) memcpy( pucData, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+        ( void ) memcpy( &pucData[ pxPublishInfo->topicNameLength ], pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+        ( void ) memset( &pucData[ ulDataLength ], 0xFF, ulSize - sizeof( StoreForwardRecord_t ) - ulDataLength );
+        pxRecord->ulCrc = prvRecordCrc( pxRecord, pucData );
+
+        if( mflash_drv_write( ( void * ) prvAddress( &xStore.xHead ), ( const uint8_t * ) ulRecordBuffer, ulSize ) == 0 )
+        {
+            xStore.xHead.ulOffset += ulSize;
+            xStore.xStats.ulStored++;
+            xWritten = true;
+        }
+        else
+        {
+            /* The record may be partly programmed, the next one goes to a new sector. */
+            xStore.xHead.ulOffset = MFLASH_SECTOR_SIZE;
+        }
+    }
+
+    return xWritten;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvReadBatch( uint32_t * pulBytes )
+{
+    StoreForwardPosition_t xPosition = xStore.xRead;
+    StoreForwardPosition_t xRecordPosition;
+    StoreForwardRecord_t xRecord;
+    StoreForwardEntry_t * pxEntry;
+    uint32_t ulCount = 0, ulUsed = 0, ulLength;
+    bool xFull = false;
+
+    while( ( ulCount < storeforwardBATCH_RECORDS ) && ( xFull == false ) && ( prvIsBefore( &xPosition, &xStore.xHead ) == true ) )
+    {
+        if( prvReadRecord( &xPosition, &xRecord ) == false )
+        {
+            /* Nothing more can be read from this sector. */
+            xPosition.ulSequence++;
+            xPosition.ulOffset = storeforwardFIRST_RECORD;
+        }
+        else
+        {
+            ulLength = ( uint32_t ) xRecord.usTopicLength + xRecord.usPayloadLength;
+
+            if( ( ulUsed + ulLength ) > sizeof( ucBatchBuffer ) )
+            {
+                xFull = true;
+            }
+            else
+            {
+                xRecordPosition = xPosition;
+                xPosition.ulOffset += prvRecordSize( ulLength );
+
+                ( void ) mflash_drv_read( ( const void * ) ( prvAddress( &xRecordPosition ) + sizeof( xRecord ) ), &ucBatchBuffer[ ulUsed ], ulLength );
+
+                if( xRecord.ulCrc != prvRecordCrc( &xRecord, &ucBatchBuffer[ ulUsed ] ) )
+                {
+                    xStore.xStats.ulCorrupted++;
+                }
+                else
+                {
+                    pxEntry = &xBatch[ ulCount ];
+                    ( void ) memset( pxEntry, 0, sizeof( *pxEntry ) );
+                    pxEntry->xRecord = xRecordPosition;
+                    pxEntry->xNext = xPosition;
+                    pxEntry->xPublishInfo.qos = MQTTQoS1;
+                    pxEntry->xPublishInfo.pTopicName = ( const char * ) &ucBatchBuffer[ ulUsed ];
+                    pxEntry->xPublishInfo.topicNameLength = xRecord.usTopicLength;
+                    pxEntry->xPublishInfo.pPayload = &ucBatchBuffer[ ulUsed + xRecord.usTopicLength ];
+                    pxEntry->xPublishInfo.payloadLength = xRecord.usPayloadLength;
+                    pxEntry->xOperation.type = MQTT_OP_PUBLISH;
+                    pxEntry->xOperation.info.pPublishInfo = &pxEntry->xPublishInfo;
+                    pxEntry->xOperation.callback = prvPublishComplete;
+                    pxEntry->xOperation.priority = MQTT_AGENT_PRIORITY_BULK;
+                    ulUsed += ulLength;
+                    ulCount++;
+                }
+            }
+        }
+
+        if( ulCount == 0U )
+        {
+            /* Only skipped records so far, they are not read again. */
+            xStore.xRead = xPosition;
+        }
+    }
+
+    *pulBytes = ulUsed;
+
+    return ulCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvCompleteBatch( uint32_t ulCount )
+{
+    StoreForwardEntry_t * pxLast;
+    uint32_t ulAcknowledged = 0;
+    uint32_t ulSent = 0;
+
+    while( ( ulAcknowledged < ulCount ) && ( xBatch[ ulAcknowledged ].xStatus == MQTTSuccess ) )
+    {
+        ulAcknowledged++;
+    }
+
+    if( ulAcknowledged > 0U )
+    {
+        pxLast = &xBatch[ ulAcknowledged - 1U ];
+
+        /* The record is only marked if a full ring did not drop its sector meanwhile. Programming
+         * the word to 0 needs no erase. */
+        if( ( prvIsBefore( &pxLast->xRecord, &xStore.xRead ) == false ) && ( prvSectorHolds( pxLast->xRecord.ulSequence ) == true ) )
+        {
+            ( void ) mflash_drv_write( ( void * ) ( prvAddress( &pxLast->xRecord ) + offsetof( StoreForwardRecord_t, ulSent ) ),
+                                       ( const uint8_t * ) &ulSent, sizeof( ulSent ) );
+            xStore.xRead = pxLast->xNext;
+        }
+
+        xStore.xStats.ulForwarded += ulAcknowledged;
+    }
+
+    return ulAcknowledged;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishComplete( MQTTOperation_t * pxOperation,
+                                MQTTStatus_t xStatus )
+{
+    StoreForwardEntry_t * pxEntry = ( StoreForwardEntry_t * ) pxOperation;
+
+    pxEntry->xStatus = xStatus;
+    ( void ) xSemaphoreGive( xStore.xAcks );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvConnectionStateCallback( ConnectionState_t xState,
+                                        bool xSessionPresent )
+{
+    ( void ) xSessionPresent;
+
+    if( xState == CONNECTION_STATE_CONNECTED )
+    {
+        xTaskNotifyGive( xStore.xDrainTask );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDrainTask( void * pvParameters )
+{
+    uint32_t ulCount, ulEnqueued, ulIndex, ulBytes;
+    TickType_t xStart, xBudget, xElapsed;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        ulCount = 0;
+
+        if( ConnectionManager_GetState() == CONNECTION_STATE_CONNECTED )
+        {
+            ( void ) xSemaphoreTake( xStore.xMutex, portMAX_DELAY );
+            ulCount = prvReadBatch( &ulBytes );
+            xStore.xBatchInFlight = ( ulCount > 0U );
+            ( void ) xSemaphoreGive( xStore.xMutex );
+        }
+
+        if( ulCount == 0U )
+        {
+            ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+        }
+        else
+        {
+            xStart = xTaskGetTickCount();
+
+            /* The agent sends the batch on one wake up. A publish it refuses ends the batch there. */
+            for( ulEnqueued = 0; ulEnqueued < ulCount; ulEnqueued++ )
+            {
+                if( MQTTAgent_Enqueue( NULL, &xBatch[ ulEnqueued ].xOperation, 0 ) != pdTRUE )
+                {
+                    break;
+                }
+            }
+
+            /* The agent keeps the publishes waiting for a PUBACK across reconnects, the batch is only
+             * released once each completes. */
+            for( ulIndex = 0; ulIndex < ulEnqueued; ulIndex++ )
+            {
+                ( void ) xSemaphoreTake( xStore.xAcks, portMAX_DELAY );
+            }
+
+            for( ulIndex = ulEnqueued; ulIndex < ulCount; ulIndex++ )
+            {
+                xBatch[ ulIndex ].xStatus = MQTTSendFailed;
+            }
+
+            ( void ) xSemaphoreTake( xStore.xMutex, portMAX_DELAY );
+            ulIndex = prvCompleteBatch( ulCount );
+            xStore.xBatchInFlight = false;
+            ( void ) xSemaphoreGive( xStore.xMutex );
+
+            if( ulIndex < ulCount )
+            {
+                vTaskDelay( pdMS_TO_TICKS( storeforwardRETRY_MS ) );
+            }
+            else
+            {
+                /* Rate limit of the catch up. */
+                xBudget = pdMS_TO_TICKS( ( ulBytes * 1000U ) / storeforwardDRAIN_BYTES_PER_SECOND );
+                xElapsed = xTaskGetTickCount() - xStart;
+
+                if( xBudget > xElapsed )
+                {
+                    vTaskDelay( xBudget - xElapsed );
+                }
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t StoreForward_Init( void )
+{
+    BaseType_t xResult = pdFALSE;
+
+    xStore.xMutex = xSemaphoreCreateMutexStatic( &xStore.xMutexBuffer );
+    xStore.xAcks = xSemaphoreCreateCountingStatic( storeforwardBATCH_RECORDS, 0, &xStore.xAcksBuffer );
+    prvScan();
+
+    if( xTaskCreate( prvDrainTask,
+                     "StoreForward_task",
+                     storeforwardTASK_STACK_SIZE,
+                     NULL,
+                     storeforwardTASK_PRIORITY | portPRIVILEGE_BIT,
+                     &xStore.xDrainTask ) != pdPASS )
+    {
+        PRINTF( "Failed to create store and forward task.\r\n" );
+    }
+    else if( ConnectionManager_AddListener( prvConnectionStateCallback ) != pdTRUE )
+    {
+        PRINTF( "Store and forward cannot listen to the connection state.\r\n" );
+    }
+    else
+    {
+        PRINTF( "Store and forward resumes at sequence %u offset %u, head at sequence %u offset %u.\r\n",
+                ( unsigned ) xStore.xRead.ulSequence, ( unsigned ) xStore.xRead.ulOffset,
+                ( unsigned ) xStore.xHead.ulSequence, ( unsigned ) xStore.xHead.ulOffset );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t StoreForward_Publish( const MQTTPublishInfo_t * pxPublishInfo,
+                                 TickType_t xTicksToWait )
+{
+    BaseType_t xResult = pdFALSE;
+    bool xLive = false;
+
+    if( xSemaphoreTake( xStore.xMutex, xTicksToWait ) == pdTRUE )
+    {
+        /* Publishing live while records wait would reorder them. */
+        if( ( ConnectionManager_GetState() == CONNECTION_STATE_CONNECTED ) && ( xStore.xBatchInFlight == false ) &&
+            ( prvIsBefore( &xStore.xRead, &xStore.xHead ) == false ) )
+        {
+            xLive = ( MQTTAgent_PublishCopy( NULL, pxPublishInfo, NULL, MQTT_AGENT_PRIORITY_BULK, 0 ) == pdTRUE );
+        }
+
+        if( xLive == true )
+        {
+            xResult = pdTRUE;
+        }
+        else if( prvAppend( pxPublishInfo ) == true )
+        {
+            xResult = pdTRUE;
+        }
+        else
+        {
+            xStore.xStats.ulRefused++;
+        }
+
+        ( void ) xSemaphoreGive( xStore.xMutex );
+    }
+
+    if( ( xResult == pdTRUE ) && ( xLive == false ) )
+    {
+        xTaskNotifyGive( xStore.xDrainTask );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void StoreForward_GetStats( StoreForwardStats_t * pxStats )
+{
+    ( void ) xSemaphoreTake( xStore.xMutex, portMAX_DELAY );
+    *pxStats = xStore.xStats;
+    ( void ) xSemaphoreGive( xStore.xMutex );
+}
@@ -0,0 +1,141 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file store_forward.h
+ * @brief Store and forward queue keeping the publishes made while the broker is unreachable in a
+ * ring of SPIFI flash sectors, and sending them once the connection is back.
+ *
+ * The records are appended to the ring with a CRC32 and survive a reset. A drain task sends them in
+ * order as QoS1 publishes on the bulk lane of the MQTT agent, up to storeforwardBATCH_RECORDS at a
+ * time, and marks the last record of a batch in flash once the broker acknowledged the whole batch.
+ * A record is sent again if its batch was not acknowledged before a reset, records are never lost
+ * unless the ring is full, in which case its oldest sector is dropped. Between batches, the drain
+ * task waits long enough to keep the catch up below storeforwardDRAIN_BYTES_PER_SECOND, leaving the
+ * connection to the live traffic.
+ */
+
+#ifndef STORE_FORWARD_H
+#define STORE_FORWARD_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "core_mqtt.h"
+
+/**
+ * @brief First address of the ring, sector aligned. The default follows the banks of the mflash
+ * file log, see mflash_file.h.
+ */
+#ifndef storeforwardBASE_ADDR
+    #define storeforwardBASE_ADDR    ( MFLASH_LOG_BASEADDR + ( 2 * MFLASH_LOG_BANK_SIZE ) )
+#endif
+
+/**
+ * @brief Number of flash sectors of the ring, a power of 2 of at least 2.
+ */
+#ifndef storeforwardSECTORS
+    #define storeforwardSECTORS    ( 64U )
+#endif
+
+/**
+ * @brief Largest record, its 16 bytes header, topic and payload.
+ */
+#ifndef storeforwardRECORD_MAX_SIZE
+    #define storeforwardRECORD_MAX_SIZE    ( 512U )
+#endif
+
+/**
+ * @brief Maximum number of records sent in a batch. They wait for their PUBACK together, so this
+ * must stay below the bulk share of MQTT_AGENT_MAX_CONCURRENT_OPERATIONS.
+ */
+#ifndef storeforwardBATCH_RECORDS
+    #define storeforwardBATCH_RECORDS    ( 8U )
+#endif
+
+/**
+ * @brief Size of the buffer holding the topics and payloads of a batch.
+ */
+#ifndef storeforwardBATCH_SIZE
+    #define storeforwardBATCH_SIZE    ( 2048U )
+#endif
+
+/**
+ * @brief Average rate at which the records are sent once the connection is back.
+ */
+#ifndef storeforwardDRAIN_BYTES_PER_SECOND
+    #define storeforwardDRAIN_BYTES_PER_SECOND    ( 8192U )
+#endif
+
+/**
+ * @brief Delay before sending again a batch the agent refused or the broker did not acknowledge.
+ */
+#ifndef storeforwardRETRY_MS
+    #define storeforwardRETRY_MS    ( 5000U )
+#endif
+
+/**
+ * @brief Counters of the queue since the boot.
+ */
+typedef struct StoreForwardStats
+{
+    uint32_t ulStored;    /**< Publishes appended to the ring. */
+    uint32_t ulForwarded; /**< Stored publishes acknowledged by the broker. */
+    uint32_t ulDropped;   /**< Stored publishes lost to a full ring. */
+    uint32_t ulCorrupted; /**< Records skipped for a bad CRC, such as one cut by a reset. */
+    uint32_t ulRefused;   /**< Publishes not stored, too large or the flash failed. */
+} StoreForwardStats_t;
+
+/**
+ * @brief Finds the records left in the ring by the previous boots and starts the drain task.
+ * Must be called once mflash_drv_init() and ConnectionManager_Init() are done.
+ *
+ * @return pdTRUE if the queue is ready.
+ */
+BaseType_t StoreForward_Init( void );
+
+/**
+ * @brief Publishes through the MQTT agent when connected with nothing stored, appends the publish to
+ * the ring otherwise, so the publishes reach the broker in order. The stored copy is sent as QoS1
+ * whatever the QoS of the publish.
+ *
+ * @param[in] pxPublishInfo The publish. Topic and payload are copied.
+ * @param[in] xTicksToWait Time to wait for the ring, the agent is never waited for.
+ *
+ * @return pdTRUE if the publish was handed to the agent or stored.
+ */
+BaseType_t StoreForward_Publish( const MQTTPublishInfo_t * pxPublishInfo,
+                                 TickType_t xTicksToWait );
+
+/**
+ * @brief Gets the counters of the queue.
+ *
+ * @param[out] pxStats Receives the counters.
+ */
+void StoreForward_GetStats( StoreForwardStats_t * pxStats );
+
+#endif /* STORE_FORWARD_H */
@@ -0,0 +1,511 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file task_stats.c
+ * @brief Run-time stats on the DWT cycle counter and the task publishing the CPU load of each task.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_device_registers.h"
+#include "fsl_debug_console.h"
+
+#include "connection_manager.h"
+
+#include "task_stats.h"
+#include "irq_latency.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Topic the stats are published on, formatted with the thing name.
+ */
+#define taskstatsTOPIC_FORMAT          "device/%.*s/tasks"
+
+/**
+ * @brief Size of the buffer holding the topic.
+ */
+#define taskstatsTOPIC_MAX_SIZE        ( 160U )
+
+/**
+ * @brief Period at which the stats are published.
+ */
+#ifndef taskstatsPUBLISH_PERIOD_MS
+    #define taskstatsPUBLISH_PERIOD_MS    ( 60000U )
+#endif
+
+/**
+ * @brief Period at which the run time of the tasks is sampled and added to the publish period.
+ * Kernels before V10.4.4 keep the run time of a task in 32 bits, so the per-task counters wrap after about 23 s
+ * of CPU time at 180 MHz. The differences between samples stay exact as long as the period is shorter than that,
+ * and the wake up of the task also bounds the time between two reads of the cycle counter.
+ */
+#ifndef taskstatsSAMPLE_PERIOD_MS
+    #define taskstatsSAMPLE_PERIOD_MS    ( 10000U )
+#endif
+
+/**
+ * @brief Largest number of tasks reported, the tasks beyond it are left out of the publish.
+ */
+#ifndef taskstatsMAX_TASKS
+    #define taskstatsMAX_TASKS    ( 16U )
+#endif
+
+/**
+ * @brief Size of the JSON payload buffer, about 48 bytes per task.
+ */
+#define taskstatsPAYLOAD_MAX_SIZE    ( 64U + ( taskstatsMAX_TASKS * 48U ) )
+
+/**
+ * @brief Priority of the stats task, just above idle so sampling never delays the application.
+ */
+#ifndef taskstatsTASK_PRIORITY
+    #define taskstatsTASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Stack size of the stats task, in words, snprintf needs most of it.
+ */
+#ifndef taskstatsTASK_STACK_SIZE
+    #define taskstatsTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 4 )
+#endif
+
+/**
+ * @brief High-water mark, in words, under which the stack of a task is reported as low.
+ * It covers the exception frame of an interrupt entered with the FPU context live.
+ */
+#ifndef taskstatsSTACK_WARN_WORDS
+    #define taskstatsSTACK_WARN_WORDS    ( 32U )
+#endif
+
+#if ( taskstatsSAMPLE_PERIOD_MS > taskstatsPUBLISH_PERIOD_MS )
+    #error "taskstatsSAMPLE_PERIOD_MS must not be longer than taskstatsPUBLISH_PERIOD_MS."
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Run time of a task over the current publish period.
+ */
+typedef struct TaskStatsEntry
+{
+    UBaseType_t uxTaskNumber; /**< Number assigned by the kernel, unique for the lifetime of the task. */
+    uint32_t ulLastCounter;   /**< Low 32 bits of the run time counter of the task at the last sample. */
+    uint64_t ullPeriodCycles; /**< Cycles run since the start of the publish period. */
+    BaseType_t xSeen;         /**< Set when the task is in the last sample, the other entries are freed. */
+    uint16_t usLowestFree;    /**< High-water mark last printed, in words. */
+} TaskStatsEntry_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Last cycle count read and the number of times the counter wrapped.
+ */
+static uint32_t ulLastCycleCount = 0;
+static uint32_t ulCycleCountWraps = 0;
+
+/**
+ * @brief Thing name used in the topic, not copied.
+ */
+static const char * pcStatsThingName;
+static uint32_t ulStatsThingNameLength;
+
+/**
+ * @brief State of the tasks, static as it is too large for the task stack.
+ */
+static TaskStatus_t xTaskStatus[ taskstatsMAX_TASKS ];
+static TaskStatsEntry_t xEntries[ taskstatsMAX_TASKS ];
+static UBaseType_t uxEntryCount = 0;
+
+/**
+ * @brief Publish period, changed at run time by TaskStats_SetPublishPeriod().
+ */
+static volatile uint32_t ulPublishPeriodMs = taskstatsPUBLISH_PERIOD_MS;
+
+/**
+ * @brief State of the tasks for TaskStats_Print(), apart from the one of the stats task.
+ */
+static TaskStatus_t xPrintStatus[ taskstatsMAX_TASKS ];
+static TaskStatsEntry_t xPrintEntries[ taskstatsMAX_TASKS ];
+
+/**
+ * @brief Publish owned by the agent until it is sent, the payload is larger than an arena slab.
+ */
+static ConnectionPublish_t xPublish;
+static char cTopic[ taskstatsTOPIC_MAX_SIZE ];
+static char cPayload[ taskstatsPAYLOAD_MAX_SIZE ];
+
+/*-----------------------------------------------------------*/
+
+void TaskStats_ConfigureTimer( void )
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    ulLastCycleCount = DWT->CYCCNT;
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t TaskStats_GetRunTimeCounter( void )
+{
+    UBaseType_t uxSavedInterruptStatus;
+    uint32_t ulCount;
+    uint64_t ullCounter;
+
+    /* Called by the kernel from PendSV and from the tasks, keep the two words consistent. */
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    ulCount = DWT->CYCCNT;
+
+    if( ulCount < ulLastCycleCount )
+    {
+        ulCycleCountWraps++;
+    }
+
+    ulLastCycleCount = ulCount;
+    ullCounter = ( ( uint64_t ) ulCycleCountWraps << 32 ) | ulCount;
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+
+    return ullCounter;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Finds the entry of a task, or takes a free one for a task created since the last sample.
+ *
+ * @return The entry, or NULL if the table is full.
+ */
+static TaskStatsEntry_t * prvGetEntry( UBaseType_t uxTaskNumber )
+{
+    TaskStatsEntry_t * pxEntry = NULL;
+    UBaseType_t i;
+
+    for( i = 0; ( i < uxEntryCount ) && ( pxEntry == NULL ); i++ )
+    {
+        if( xEntries[ i ].uxTaskNumber == uxTaskNumber )
+        {
+            pxEntry = &xEntries[ i ];
+        }
+    }
+
+    if( ( pxEntry == NULL ) && ( uxEntryCount < taskstatsMAX_TASKS ) )
+    {
+        /* A new task started with a run time of 0. */
+        pxEntry = &xEntries[ uxEntryCount++ ];
+        pxEntry->uxTaskNumber = uxTaskNumber;
+        pxEntry->ulLastCounter = 0;
+        pxEntry->ullPeriodCycles = 0;
+        pxEntry->usLowestFree = UINT16_MAX;
+    }
+
+    return pxEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Adds the run time of each task since the last sample to its entry, and frees the entries of the
+ * deleted tasks.
+ *
+ * @return The number of tasks in xTaskStatus.
+ */
+static UBaseType_t prvSample( void )
+{
+    TaskStatsEntry_t * pxEntry;
+    UBaseType_t uxTasks;
+    UBaseType_t i;
+    UBaseType_t uxKept = 0;
+
+    for( i = 0; i < uxEntryCount; i++ )
+    {
+        xEntries[ i ].xSeen = pdFALSE;
+    }
+
+    /* The total is taken from the cycle counter instead, its type differs between kernel versions. */
+    uxTasks = uxTaskGetSystemState( xTaskStatus, taskstatsMAX_TASKS, NULL );
+
+    for( i = 0; i < uxTasks; i++ )
+    {
+        pxEntry = prvGetEntry( xTaskStatus[ i ].xTaskNumber );
+
+        if( pxEntry != NULL )
+        {
+            /* Unsigned 32-bit differences are exact across one wrap of the counter. */
+            pxEntry->ullPeriodCycles += ( uint32_t ) ( ( uint32_t ) xTaskStatus[ i ].ulRunTimeCounter - pxEntry->ulLastCounter );
+            pxEntry->ulLastCounter = ( uint32_t ) xTaskStatus[ i ].ulRunTimeCounter;
+            pxEntry->xSeen = pdTRUE;
+
+            /* Only printed when it drops, tools/stack_usage.py reads the lowest one from the log. */
+            if( xTaskStatus[ i ].usStackHighWaterMark < pxEntry->usLowestFree )
+            {
+                pxEntry->usLowestFree = xTaskStatus[ i ].usStackHighWaterMark;
+                PRINTF( "STACK,%s,%u%s\r\n", xTaskStatus[ i ].pcTaskName, ( unsigned ) pxEntry->usLowestFree,
+                        ( pxEntry->usLowestFree < taskstatsSTACK_WARN_WORDS ) ? ",low" : "" );
+            }
+        }
+    }
+
+    for( i = 0; i < uxEntryCount; i++ )
+    {
+        if( xEntries[ i ].xSeen == pdTRUE )
+        {
+            xEntries[ uxKept++ ] = xEntries[ i ];
+        }
+    }
+
+    uxEntryCount = uxKept;
+
+    return uxTasks;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Publishes the load of each task over the period with QoS0 and starts a new period.
+ *
+ * @return pdFALSE if the previous publish is still owned by the agent, the period then goes on.
+ */
+static BaseType_t prvPublish( UBaseType_t uxTasks,
+                              uint64_t ullPeriodCycles,
+                              TickType_t xPeriodTicks )
+{
+    TaskStatsEntry_t * pxEntry;
+    uint32_t ulLoad;
+    size_t xLength;
+    int lWritten;
+    UBaseType_t i;
+
+    #if ( irqlatencyENABLED == 1 )
+        size_t xIrqLength;
+    #endif
+
+    if( ConnectionManager_PublishPending( &xPublish ) == pdTRUE )
+    {
+        return pdFALSE;
+    }
+
+    lWritten = snprintf( cPayload, sizeof( cPayload ), "{\"ms\":%lu,\"tasks\":[",
+                         ( unsigned long ) ( ( uint64_t ) xPeriodTicks * 1000U / configTICK_RATE_HZ ) );
+    xLength = ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+
+    for( i = 0; ( i < uxTasks ) && ( xLength < sizeof( cPayload ) ); i++ )
+    {
+        pxEntry = prvGetEntry( xTaskStatus[ i ].xTaskNumber );
+        ulLoad = 0;
+
+        if( pxEntry != NULL )
+        {
+            if( ullPeriodCycles > 0U )
+            {
+                ulLoad = ( uint32_t ) ( ( pxEntry->ullPeriodCycles * 1000U + ( ullPeriodCycles / 2U ) ) / ullPeriodCycles );
+            }
+
+            pxEntry->ullPeriodCycles = 0;
+        }
+
+        lWritten = snprintf( &cPayload[ xLength ], sizeof( cPayload ) - xLength,
+                             "%s{\"name\":\"%s\",\"cpu\":%lu,\"stack\":%u}",
+                             ( i == 0U ) ? "" : ",",
+                             xTaskStatus[ i ].pcTaskName,
+                             ( unsigned long ) ulLoad,
+                             ( unsigned ) xTaskStatus[ i ].usStackHighWaterMark );
+        xLength += ( lWritten > 0 ) ? ( size_t ) lWritten : 0U;
+    }
+
+    if( xLength < ( sizeof( cPayload ) - 2U ) )
+    {
+        cPayload[ xLength++ ] = ']';
+
+        #if ( irqlatencyENABLED == 1 )
+            /* Left out if it leaves no room for the closing brace. */
+            cPayload[ xLength ] = ',';
+            xIrqLength = IrqLatency_FormatJson( &cPayload[ xLength + 1U ], sizeof( cPayload ) - xLength - 2U );
+
+            if( xIrqLength > 0U )
+            {
+                xLength += xIrqLength + 1U;
+            }
+        #endif
+
+        cPayload[ xLength++ ] = '}';
+
+        lWritten = snprintf( cTopic, sizeof( cTopic ), taskstatsTOPIC_FORMAT,
+                             ( int ) ulStatsThingNameLength, pcStatsThingName );
+
+        /* Bounded so a stalled agent never delays the next sample. */
+        ( void ) ConnectionManager_Publish( &xPublish, cTopic, ( uint16_t ) lWritten, MQTTQoS0, cPayload, xLength,
+                                            NULL, NULL, pdMS_TO_TICKS( taskstatsSAMPLE_PERIOD_MS ) );
+    }
+    else
+    {
+        PRINTF( "Task stats do not fit in the buffer.\r\n" );
+    }
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTaskStatsTask( void * pvParameters )
+{
+    TickType_t xLastWakeTime;
+    TickType_t xPeriodStart;
+    uint64_t ullPeriodStartCycles;
+    uint64_t ullNow;
+    UBaseType_t uxTasks;
+    UBaseType_t i;
+
+    ( void ) pvParameters;
+
+    /* The first sample only takes the counters as the base of the first period. */
+    ( void ) prvSample();
+    ullPeriodStartCycles = TaskStats_GetRunTimeCounter();
+    xPeriodStart = xTaskGetTickCount();
+    xLastWakeTime = xPeriodStart;
+
+    for( i = 0; i < uxEntryCount; i++ )
+    {
+        xEntries[ i ].ullPeriodCycles = 0;
+    }
+
+    for( ; ; )
+    {
+        vTaskDelayUntil( &xLastWakeTime, pdMS_TO_TICKS( taskstatsSAMPLE_PERIOD_MS ) );
+
+        uxTasks = prvSample();
+
+        if( ( xLastWakeTime - xPeriodStart ) >= pdMS_TO_TICKS( ulPublishPeriodMs ) )
+        {
+            ullNow = TaskStats_GetRunTimeCounter();
+
+            if( prvPublish( uxTasks, ullNow - ullPeriodStartCycles, xLastWakeTime - xPeriodStart ) == pdTRUE )
+            {
+                ullPeriodStartCycles = ullNow;
+                xPeriodStart = xLastWakeTime;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void TaskStats_Print( uint32_t ulWindowMs )
+{
+    UBaseType_t uxBaseTasks;
+    UBaseType_t uxTasks;
+    UBaseType_t i;
+    UBaseType_t j;
+    uint64_t ullStart;
+    uint64_t ullWindowCycles;
+    uint32_t ulCycles;
+    uint32_t ulLoad;
+
+    /* Bounded so the 32-bit run time of a task cannot wrap within the window. */
+    ulWindowMs = ( ulWindowMs > taskstatsSAMPLE_PERIOD_MS ) ? taskstatsSAMPLE_PERIOD_MS : ulWindowMs;
+
+    uxBaseTasks = uxTaskGetSystemState( xPrintStatus, taskstatsMAX_TASKS, NULL );
+    ullStart = TaskStats_GetRunTimeCounter();
+
+    for( i = 0; i < uxBaseTasks; i++ )
+    {
+        xPrintEntries[ i ].uxTaskNumber = xPrintStatus[ i ].xTaskNumber;
+        xPrintEntries[ i ].ulLastCounter = ( uint32_t ) xPrintStatus[ i ].ulRunTimeCounter;
+    }
+
+    vTaskDelay( pdMS_TO_TICKS( ulWindowMs ) );
+
+    uxTasks = uxTaskGetSystemState( xPrintStatus, taskstatsMAX_TASKS, NULL );
+    ullWindowCycles = TaskStats_GetRunTimeCounter() - ullStart;
+
+    PRINTF( "TASK,name,cpu_permille,stack_words over %lu ms\r\n", ( unsigned long ) ulWindowMs );
+
+    for( i = 0; i < uxTasks; i++ )
+    {
+        /* A task created within the window started with a run time of 0. */
+        ulCycles = ( uint32_t ) xPrintStatus[ i ].ulRunTimeCounter;
+
+        for( j = 0; j < uxBaseTasks; j++ )
+        {
+            if( xPrintEntries[ j ].uxTaskNumber == xPrintStatus[ i ].xTaskNumber )
+            {
+                ulCycles -= xPrintEntries[ j ].ulLastCounter;
+                break;
+            }
+        }
+
+        ulLoad = ( ullWindowCycles > 0U ) ? ( uint32_t ) ( ( ( uint64_t ) ulCycles * 1000U ) / ullWindowCycles ) : 0U;
+
+        PRINTF( "TASK,%s,%lu,%u%s\r\n", xPrintStatus[ i ].pcTaskName, ( unsigned long ) ulLoad,
+                ( unsigned ) xPrintStatus[ i ].usStackHighWaterMark,
+                ( xPrintStatus[ i ].usStackHighWaterMark < taskstatsSTACK_WARN_WORDS ) ? ",low" : "" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TaskStats_SetPublishPeriod( uint32_t ulPeriodMs )
+{
+    if( ulPeriodMs < taskstatsSAMPLE_PERIOD_MS )
+    {
+        return pdFALSE;
+    }
+
+    ulPublishPeriodMs = ulPeriodMs;
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TaskStats_Init( const char * pcThingName,
+                           uint32_t ulThingNameLength )
+{
+    BaseType_t result;
+
+    pcStatsThingName = pcThingName;
+    ulStatsThingNameLength = ulThingNameLength;
+
+    result = xTaskCreate( prvTaskStatsTask,
+                          "TaskStats_task",
+                          taskstatsTASK_STACK_SIZE,
+                          NULL,
+                          taskstatsTASK_PRIORITY | portPRIVILEGE_BIT,
+                          NULL );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create task stats task.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,91 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file task_stats.h
+ * @brief Run-time stats on the DWT cycle counter and the task publishing the CPU load of each task.
+ */
+
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Enables the DWT cycle counter, called by the kernel through portCONFIGURE_TIMER_FOR_RUN_TIME_STATS().
+ * The counter is not reset, so the boot timing record keeps counting from the bootloader.
+ */
+void TaskStats_ConfigureTimer( void );
+
+/**
+ * @brief Returns the DWT cycle count extended to 64 bits, called by the kernel through
+ * portGET_RUN_TIME_COUNTER_VALUE() on every context switch.
+ * A wrap is detected when the count is lower than the one of the previous call, so the function must
+ * be called at least once per 2^32 cycles, about 23 s at 180 MHz. The stats task makes sure of it.
+ *
+ * @return The number of cycles since the cycle counter was last reset.
+ */
+uint64_t TaskStats_GetRunTimeCounter( void );
+
+/**
+ * @brief Creates the task publishing the CPU load and the stack high-water mark of each task as JSON on
+ * "device/<thing name>/tasks" every taskstatsPUBLISH_PERIOD_MS, e.g.
+ * {"ms":60000,"tasks":[{"name":"IP-task","cpu":12,"stack":210},...]}
+ * where "cpu" is in tenths of a percent of the period and "stack" is the high-water mark in words.
+ * With irqlatencyENABLED, the "irq" member of IrqLatency_FormatJson() follows "tasks".
+ * Each time the high-water mark of a task drops, it is also printed as "STACK,<task name>,<words>",
+ * followed by ",low" under taskstatsSTACK_WARN_WORDS, for tools/stack_usage.py.
+ * Must be called once the MQTT agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t TaskStats_Init( const char * pcThingName,
+                           uint32_t ulThingNameLength );
+
+/**
+ * @brief Prints the CPU load of each task over a window and its stack high-water mark on the debug
+ * console: TASK,name,cpu_permille,stack_words followed by ",low" under taskstatsSTACK_WARN_WORDS.
+ * The calling task is delayed for the window, which is bounded by taskstatsSAMPLE_PERIOD_MS.
+ * Independent of the stats task, but not reentrant.
+ *
+ * @param[in] ulWindowMs The window the load is measured over.
+ */
+void TaskStats_Print( uint32_t ulWindowMs );
+
+/**
+ * @brief Changes the period at which the stats are published, from the next sample on.
+ *
+ * @param[in] ulPeriodMs The new period, not shorter than taskstatsSAMPLE_PERIOD_MS.
+ *
+ * @return pdTRUE if the period is valid.
+ */
+BaseType_t TaskStats_SetPublishPeriod( uint32_t ulPeriodMs );
+
+#endif /* TASK_STATS_H */
@@ -0,0 +1,679 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file telemetry.c
+ * @brief Streaming CBOR encoder and batcher packing telemetry samples into batch publishes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "timers.h"
+
+#include "fsl_debug_console.h"
+
+#include "core_mqtt_agent.h"
+#include "monotonic_clock.h"
+#include "time_sync.h"
+
+#include "telemetry.h"
+#include "telemetry_qos.h"
+
+#if ( telemetryUDP_TRANSPORT == 1 )
+    #include "telemetry_udp.h"
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Topic the batches are published on, formatted with the thing name.
+ */
+#define telemetryTOPIC_FORMAT        "device/%.*s/telemetry"
+
+/**
+ * @brief Size of the buffer holding the topic.
+ */
+#define telemetryTOPIC_MAX_SIZE      ( 160U )
+
+/**
+ * @brief CBOR major types, in the 3 upper bits of the initial byte.
+ */
+#define telemetryMAJOR_UINT          ( 0U )
+#define telemetryMAJOR_NEGATIVE      ( 1U )
+#define telemetryMAJOR_BYTES         ( 2U )
+#define telemetryMAJOR_TEXT          ( 3U )
+#define telemetryMAJOR_ARRAY         ( 4U )
+#define telemetryMAJOR_MAP           ( 5U )
+
+/**
+ * @brief CBOR initial bytes of the simple values and floats, the indefinite length array and the break.
+ */
+#define telemetryCBOR_FALSE          ( 0xF4U )
+#define telemetryCBOR_TRUE           ( 0xF5U )
+#define telemetryCBOR_HALF           ( 0xF9U )
+#define telemetryCBOR_FLOAT          ( 0xFAU )
+#define telemetryCBOR_ARRAY_START    ( 0x9FU )
+#define telemetryCBOR_BREAK          ( 0xFFU )
+
+/**
+ * @brief Delay before the timer retries to publish an expired batch other tasks held locked.
+ */
+#define telemetryRETRY_MS            ( 100U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A message buffer with the publish queued to the MQTT agent.
+ */
+typedef struct TelemetryBuffer
+{
+    MQTTOperation_t xOperation;     /**< Publish operation, valid until its callback. */
+    MQTTPublishInfo_t xPublishInfo; /**< Publish of the message. */
+    volatile BaseType_t xInUse;     /**< Set from the start of the batch until the publish is complete. */
+    uint8_t ucData[ telemetryMESSAGE_MAX_SIZE ];
+} TelemetryBuffer_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The message buffers.
+ */
+static TelemetryBuffer_t xBuffers[ telemetryBUFFERS ];
+
+/**
+ * @brief Counts the buffers neither filled nor queued.
+ */
+static SemaphoreHandle_t xFreeBuffers = NULL;
+static StaticSemaphore_t xFreeBuffersBuffer;
+
+/**
+ * @brief Serialises the tasks adding samples and the timer publishing the expired batch.
+ */
+static SemaphoreHandle_t xBatchMutex = NULL;
+static StaticSemaphore_t xBatchMutexBuffer;
+
+/**
+ * @brief Publishes the batch telemetryMAX_BATCH_AGE_MS after its first sample.
+ */
+static TimerHandle_t xAgeTimer = NULL;
+static StaticTimer_t xAgeTimerBuffer;
+
+/**
+ * @brief Buffer of the batch being filled, NULL until the next sample.
+ */
+static TelemetryBuffer_t * pxActive = NULL;
+
+/**
+ * @brief Encoder of the batch being filled, one byte short of the buffer to keep room for the break.
+ */
+static TelemetryEncoder_t xBatchEncoder;
+
+/**
+ * @brief Number of samples in the batch and uptime of its first sample.
+ */
+static uint32_t ulBatchSamples = 0;
+static uint32_t ulBatchStartMs = 0;
+
+/**
+ * @brief Offset of the 8 byte UTC send time in the message, 0 if the time was not synchronized at
+ * the start of the batch.
+ */
+static size_t xBatchSendTimeOffset = 0;
+
+/**
+ * @brief Samples dropped because no buffer was free, they were too large or the agent refused the publish.
+ */
+static uint32_t ulDroppedSamples = 0;
+
+/**
+ * @brief Topic of the batches.
+ */
+static char cTopic[ telemetryTOPIC_MAX_SIZE ];
+static uint16_t usTopicLength = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes bytes, or sets the overflow flag if they do not fit.
+ */
+static void prvWrite( TelemetryEncoder_t * pxEncoder,
+                      const uint8_t * pucData,
+                      size_t xLength )
+{
+    if( ( pxEncoder->bOverflow == false ) && ( xLength <= ( pxEncoder->xSize - pxEncoder->xLength ) ) )
+    {
+        memcpy( &pxEncoder->pucBuffer[ pxEncoder->xLength ], pucData, xLength );
+        pxEncoder->xLength += xLength;
+    }
+    else
+    {
+        pxEncoder->bOverflow = true;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes the initial byte of an item and its argument, big endian on the fewest bytes.
+ */
+static void prvWriteHead( TelemetryEncoder_t * pxEncoder,
+                          uint8_t ucMajor,
+                          uint64_t ullArgument )
+{
+    uint8_t ucHead[ 9 ];
+    size_t xBytes;
+    size_t i;
+
+    if( ullArgument < 24U )
+    {
+        ucHead[ 0 ] = ( uint8_t ) ( ( ucMajor << 5 ) | ( uint8_t ) ullArgument );
+        xBytes = 0;
+    }
+    else if( ullArgument <= UINT8_MAX )
+    {
+        ucHead[ 0 ] = ( uint8_t ) ( ( ucMajor << 5 ) | 24U );
+        xBytes = 1;
+    }
+    else if( ullArgument <= UINT16_MAX )
+    {
+        ucHead[ 0 ] = ( uint8_t ) ( ( ucMajor << 5 ) | 25U );
+        xBytes = 2;
+    }
+    else if( ullArgument <= UINT32_MAX )
+    {
+        ucHead[ 0 ] = ( uint8_t ) ( ( ucMajor << 5 ) | 26U );
+        xBytes = 4;
+    }
+    else
+    {
+        ucHead[ 0 ] = ( uint8_t ) ( ( ucMajor << 5 ) | 27U );
+        xBytes = 8;
+    }
+
+    for( i = 0; i < xBytes; i++ )
+    {
+        ucHead[ 1U + i ] = ( uint8_t ) ( ullArgument >> ( 8U * ( xBytes - 1U - i ) ) );
+    }
+
+    prvWrite( pxEncoder, ucHead, 1U + xBytes );
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncoderInit( TelemetryEncoder_t * pxEncoder,
+                            uint8_t * pucBuffer,
+                            size_t xSize )
+{
+    configASSERT( pxEncoder != NULL );
+
+    pxEncoder->pucBuffer = pucBuffer;
+    pxEncoder->xSize = xSize;
+    pxEncoder->xLength = 0;
+    pxEncoder->bOverflow = false;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t Telemetry_EncodedLength( const TelemetryEncoder_t * pxEncoder )
+{
+    return ( pxEncoder->bOverflow == true ) ? 0U : pxEncoder->xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeUint( TelemetryEncoder_t * pxEncoder,
+                           uint64_t ullValue )
+{
+    prvWriteHead( pxEncoder, telemetryMAJOR_UINT, ullValue );
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeInt( TelemetryEncoder_t * pxEncoder,
+                          int64_t llValue )
+{
+    if( llValue >= 0 )
+    {
+        prvWriteHead( pxEncoder, telemetryMAJOR_UINT, ( uint64_t ) llValue );
+    }
+    else
+    {
+        /* A negative integer n is encoded as -1 - n. */
+        prvWriteHead( pxEncoder, telemetryMAJOR_NEGATIVE, ( uint64_t ) ( -( llValue + 1 ) ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeFloat( TelemetryEncoder_t * pxEncoder,
+                            float fValue )
+{
+    uint32_t ulBits;
+    uint32_t ulSign;
+    int32_t lExponent;
+    uint32_t ulMantissa;
+    uint16_t usHalf;
+    BaseType_t xExact = pdTRUE;
+    uint8_t ucItem[ 5 ];
+
+    memcpy( &ulBits, &fValue, sizeof( ulBits ) );
+    ulSign = ( ulBits >> 16 ) & 0x8000U;
+    lExponent = ( int32_t ) ( ( ulBits >> 23 ) & 0xFFU );
+    ulMantissa = ulBits & 0x7FFFFFU;
+
+    if( lExponent == 0xFF )
+    {
+        /* Infinities keep their sign, NaNs become the canonical half precision NaN. */
+        usHalf = ( uint16_t ) ( ( ulMantissa == 0U ) ? ( ulSign | 0x7C00U ) : 0x7E00U );
+    }
+    else if( ( lExponent == 0 ) && ( ulMantissa == 0U ) )
+    {
+        usHalf = ( uint16_t ) ulSign;
+    }
+    else if( ( ( lExponent - 127 ) >= -14 ) && ( ( lExponent - 127 ) <= 15 ) && ( ( ulMantissa & 0x1FFFU ) == 0U ) )
+    {
+        /* Normal half precision values, the subnormal ones are sent as single precision. */
+        usHalf = ( uint16_t ) ( ulSign | ( ( uint32_t ) ( lExponent - 127 + 15 ) << 10 ) | ( ulMantissa >> 13 ) );
+    }
+    else
+    {
+        usHalf = 0;
+        xExact = pdFALSE;
+    }
+
+    if( xExact == pdTRUE )
+    {
+        ucItem[ 0 ] = telemetryCBOR_HALF;
+        ucItem[ 1 ] = ( uint8_t ) ( usHalf >> 8 );
+        ucItem[ 2 ] = ( uint8_t ) usHalf;
+        prvWrite( pxEncoder, ucItem, 3U );
+    }
+    else
+    {
+        ucItem[ 0 ] = telemetryCBOR_FLOAT;
+        ucItem[ 1 ] = ( uint8_t ) ( ulBits >> 24 );
+        ucItem[ 2 ] = ( uint8_t ) ( ulBits >> 16 );
+        ucItem[ 3 ] = ( uint8_t ) ( ulBits >> 8 );
+        ucItem[ 4 ] = ( uint8_t ) ulBits;
+        prvWrite( pxEncoder, ucItem, 5U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeBool( TelemetryEncoder_t * pxEncoder,
+                           bool bValue )
+{
+    uint8_t ucItem = ( bValue == true ) ? telemetryCBOR_TRUE : telemetryCBOR_FALSE;
+
+    prvWrite( pxEncoder, &ucItem, 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeText( TelemetryEncoder_t * pxEncoder,
+                           const char * pcText,
+                           size_t xLength )
+{
+    prvWriteHead( pxEncoder, telemetryMAJOR_TEXT, xLength );
+    prvWrite( pxEncoder, ( const uint8_t * ) pcText, xLength );
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeBytes( TelemetryEncoder_t * pxEncoder,
+                            const uint8_t * pucData,
+                            size_t xLength )
+{
+    prvWriteHead( pxEncoder, telemetryMAJOR_BYTES, xLength );
+    prvWrite( pxEncoder, pucData, xLength );
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeArray( TelemetryEncoder_t * pxEncoder,
+                            size_t xItems )
+{
+    prvWriteHead( pxEncoder, telemetryMAJOR_ARRAY, xItems );
+}
+
+/*-----------------------------------------------------------*/
+
+void Telemetry_EncodeMap( TelemetryEncoder_t * pxEncoder,
+                          size_t xPairs )
+{
+    prvWriteHead( pxEncoder, telemetryMAJOR_MAP, xPairs );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCallback( struct MQTTOperation * pOperation,
+                                MQTTStatus_t status )
+{
+    size_t i;
+
+    ( void ) status;
+
+    for( i = 0; i < telemetryBUFFERS; i++ )
+    {
+        if( pOperation == &xBuffers[ i ].xOperation )
+        {
+            xBuffers[ i ].xInUse = pdFALSE;
+            ( void ) xSemaphoreGive( xFreeBuffers );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Takes a free buffer and writes the head of the message, the batch must be locked.
+ */
+static BaseType_t prvStartBatch( TickType_t xTicksToWait )
+{
+    BaseType_t xResult = pdFALSE;
+    size_t i;
+    uint8_t ucArrayStart = telemetryCBOR_ARRAY_START;
+    uint64_t ullUtcMs;
+
+    if( xSemaphoreTake( xFreeBuffers, xTicksToWait ) == pdTRUE )
+    {
+        for( i = 0; ( i < telemetryBUFFERS ) && ( pxActive == NULL ); i++ )
+        {
+            if( xBuffers[ i ].xInUse == pdFALSE )
+            {
+                pxActive = &xBuffers[ i ];
+            }
+        }
+
+        configASSERT( pxActive != NULL );
+        pxActive->xInUse = pdTRUE;
+
+        ulBatchSamples = 0;
+        ulBatchStartMs = MonotonicClock_GetMs();
+
+        Telemetry_EncoderInit( &xBatchEncoder, pxActive->ucData, sizeof( pxActive->ucData ) - 1U );
+
+        if( TimeSync_GetUtcMs( &ullUtcMs ) == pdTRUE )
+        {
+            Telemetry_EncodeMap( &xBatchEncoder, 4 );
+            Telemetry_EncodeText( &xBatchEncoder, "t", 1 );
+            Telemetry_EncodeUint( &xBatchEncoder, ulBatchStartMs );
+            Telemetry_EncodeText( &xBatchEncoder, "u", 1 );
+            Telemetry_EncodeUint( &xBatchEncoder, ullUtcMs );
+
+            /* Any UTC time in ms is above UINT32_MAX, so the send time is always the 8 byte
+             * argument written here and patched in place by prvPublishBatch(). */
+            Telemetry_EncodeText( &xBatchEncoder, "x", 1 );
+            Telemetry_EncodeUint( &xBatchEncoder, ullUtcMs );
+            xBatchSendTimeOffset = xBatchEncoder.xLength - 8U;
+        }
+        else
+        {
+            Telemetry_EncodeMap( &xBatchEncoder, 2 );
+            Telemetry_EncodeText( &xBatchEncoder, "t", 1 );
+            Telemetry_EncodeUint( &xBatchEncoder, ulBatchStartMs );
+            xBatchSendTimeOffset = 0;
+        }
+
+        Telemetry_EncodeText( &xBatchEncoder, "s", 1 );
+        prvWrite( &xBatchEncoder, &ucArrayStart, 1U );
+
+        ( void ) xTimerChangePeriod( xAgeTimer, pdMS_TO_TICKS( telemetryMAX_BATCH_AGE_MS ), 0 );
+
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Closes the array of samples and queues the message to the MQTT agent, the batch must be locked.
+ */
+static BaseType_t prvPublishBatch( void )
+{
+    BaseType_t xResult = pdTRUE;
+    TelemetryBuffer_t * pxBuffer = pxActive;
+    uint64_t ullUtcMs;
+    size_t i;
+
+    if( pxBuffer != NULL )
+    {
+        pxActive = NULL;
+        ( void ) xTimerStop( xAgeTimer, 0 );
+
+        /* The encoder keeps the last byte of the buffer for the break. */
+        pxBuffer->ucData[ xBatchEncoder.xLength ] = telemetryCBOR_BREAK;
+
+        /* Stamped last, right before the message is handed to the transport. */
+        if( ( xBatchSendTimeOffset != 0U ) && ( TimeSync_GetUtcMs( &ullUtcMs ) == pdTRUE ) )
+        {
+            for( i = 0; i < 8U; i++ )
+            {
+                pxBuffer->ucData[ xBatchSendTimeOffset + i ] = ( uint8_t ) ( ullUtcMs >> ( 56U - ( 8U * i ) ) );
+            }
+        }
+
+        memset( &pxBuffer->xPublishInfo, 0x00, sizeof( pxBuffer->xPublishInfo ) );
+        pxBuffer->xPublishInfo.qos = TelemetryQos_SelectQoS( telemetryQOS, pdFALSE );
+        pxBuffer->xPublishInfo.pTopicName = cTopic;
+        pxBuffer->xPublishInfo.topicNameLength = usTopicLength;
+        pxBuffer->xPublishInfo.pPayload = pxBuffer->ucData;
+        pxBuffer->xPublishInfo.payloadLength = xBatchEncoder.xLength + 1U;
+
+        memset( &pxBuffer->xOperation, 0x00, sizeof( pxBuffer->xOperation ) );
+        pxBuffer->xOperation.type = MQTT_OP_PUBLISH;
+        pxBuffer->xOperation.info.pPublishInfo = &pxBuffer->xPublishInfo;
+        pxBuffer->xOperation.callback = prvPublishCallback;
+        pxBuffer->xOperation.priority = MQTT_AGENT_PRIORITY_BULK;
+
+        /* Not waiting, the timer task publishes the expired batches too. A batch left empty by a
+         * sample too large for a message is not sent. */
+        #if ( telemetryUDP_TRANSPORT == 1 )
+            /* The datagram takes a copy of the message, the buffer is free again at once. */
+            if( ( ulBatchSamples > 0U ) && ( TelemetryUdp_Send( pxBuffer->ucData, xBatchEncoder.xLength + 1U ) != pdTRUE ) )
+            {
+                ulDroppedSamples += ulBatchSamples;
+                PRINTF( "Telemetry datagram of %u samples dropped, %u samples dropped so far.\r\n",
+                        ( unsigned ) ulBatchSamples, ( unsigned ) ulDroppedSamples );
+                xResult = pdFALSE;
+            }
+
+            pxBuffer->xInUse = pdFALSE;
+            ( void ) xSemaphoreGive( xFreeBuffers );
+        #else
+            if( ulBatchSamples == 0U )
+            {
+                pxBuffer->xInUse = pdFALSE;
+                ( void ) xSemaphoreGive( xFreeBuffers );
+            }
+            else if( MQTTAgent_Enqueue( NULL, &pxBuffer->xOperation, 0 ) != pdTRUE )
+            {
+                ulDroppedSamples += ulBatchSamples;
+                PRINTF( "Telemetry batch of %u samples dropped, %u samples dropped so far.\r\n",
+                        ( unsigned ) ulBatchSamples, ( unsigned ) ulDroppedSamples );
+
+                pxBuffer->xInUse = pdFALSE;
+                ( void ) xSemaphoreGive( xFreeBuffers );
+                xResult = pdFALSE;
+            }
+        #endif /* if ( telemetryUDP_TRANSPORT == 1 ) */
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Writes a sample at the end of the batch, removing it again if it does not fit.
+ */
+static BaseType_t prvEncodeSample( TelemetrySampleCallback_t xCallback,
+                                   void * pvContext )
+{
+    BaseType_t xResult = pdTRUE;
+    size_t xMark = xBatchEncoder.xLength;
+
+    Telemetry_EncodeArray( &xBatchEncoder, 2 );
+    Telemetry_EncodeUint( &xBatchEncoder, MonotonicClock_GetMs() - ulBatchStartMs );
+    xCallback( &xBatchEncoder, pvContext );
+
+    if( xBatchEncoder.bOverflow == true )
+    {
+        xBatchEncoder.xLength = xMark;
+        xBatchEncoder.bOverflow = false;
+        xResult = pdFALSE;
+    }
+    else
+    {
+        ulBatchSamples++;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvAgeTimerCallback( TimerHandle_t xTimer )
+{
+    /* The timer task must not block, retry shortly if a task is adding a sample. */
+    if( xSemaphoreTake( xBatchMutex, 0 ) == pdTRUE )
+    {
+        ( void ) prvPublishBatch();
+        ( void ) xSemaphoreGive( xBatchMutex );
+    }
+    else
+    {
+        ( void ) xTimerChangePeriod( xTimer, pdMS_TO_TICKS( telemetryRETRY_MS ), 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Telemetry_Init( const char * pcThingName,
+                           uint32_t ulThingNameLength )
+{
+    BaseType_t xResult = pdFALSE;
+    int lLength;
+
+    configASSERT( pcThingName != NULL );
+
+    lLength = snprintf( cTopic, sizeof( cTopic ), telemetryTOPIC_FORMAT, ( int ) ulThingNameLength, pcThingName );
+
+    #if ( telemetryUDP_TRANSPORT == 1 )
+        if( TelemetryUdp_Init() != pdTRUE )
+        {
+            lLength = 0;
+        }
+    #endif
+
+    if( ( lLength > 0 ) && ( ( size_t ) lLength < sizeof( cTopic ) ) && ( xBatchMutex == NULL ) )
+    {
+        usTopicLength = ( uint16_t ) lLength;
+
+        xFreeBuffers = xSemaphoreCreateCountingStatic( telemetryBUFFERS, telemetryBUFFERS, &xFreeBuffersBuffer );
+        xBatchMutex = xSemaphoreCreateMutexStatic( &xBatchMutexBuffer );
+        xAgeTimer = xTimerCreateStatic( "Telemetry",
+                                        pdMS_TO_TICKS( telemetryMAX_BATCH_AGE_MS ),
+                                        pdFALSE,
+                                        NULL,
+                                        prvAgeTimerCallback,
+                                        &xAgeTimerBuffer );
+        xResult = pdTRUE;
+    }
+    else
+    {
+        PRINTF( "Telemetry topic is too long or the batcher is already set up.\r\n" );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Telemetry_Add( TelemetrySampleCallback_t xCallback,
+                          void * pvContext,
+                          TickType_t xTicksToWait )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( xCallback != NULL );
+    configASSERT( xBatchMutex != NULL );
+
+    if( xSemaphoreTake( xBatchMutex, xTicksToWait ) == pdTRUE )
+    {
+        if( ( pxActive != NULL ) || ( prvStartBatch( xTicksToWait ) == pdTRUE ) )
+        {
+            xResult = prvEncodeSample( xCallback, pvContext );
+
+            /* The sample does not fit in the rest of the message, retry in a new one. */
+            if( ( xResult == pdFALSE ) && ( ulBatchSamples > 0U ) )
+            {
+                ( void ) prvPublishBatch();
+
+                if( prvStartBatch( xTicksToWait ) == pdTRUE )
+                {
+                    xResult = prvEncodeSample( xCallback, pvContext );
+                }
+            }
+
+            if( ( pxActive != NULL ) && ( ulBatchSamples >= telemetryMAX_SAMPLES ) )
+            {
+                ( void ) prvPublishBatch();
+            }
+        }
+
+        if( xResult == pdFALSE )
+        {
+            ulDroppedSamples++;
+        }
+
+        ( void ) xSemaphoreGive( xBatchMutex );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Telemetry_Flush( TickType_t xTicksToWait )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( xBatchMutex != NULL );
+
+    if( xSemaphoreTake( xBatchMutex, xTicksToWait ) == pdTRUE )
+    {
+        xResult = prvPublishBatch();
+        ( void ) xSemaphoreGive( xBatchMutex );
+    }
+
+    return xResult;
+}
@@ -0,0 +1,247 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file telemetry.h
+ * @brief Streaming CBOR encoder and batcher packing telemetry samples into batch publishes.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Size of a telemetry message, a batch is published before it would grow larger.
+ */
+#ifndef telemetryMESSAGE_MAX_SIZE
+    #define telemetryMESSAGE_MAX_SIZE    ( 1024U )
+#endif
+
+/**
+ * @brief Maximum number of samples in a message.
+ */
+#ifndef telemetryMAX_SAMPLES
+    #define telemetryMAX_SAMPLES    ( 32U )
+#endif
+
+/**
+ * @brief Maximum time between the first sample of a batch and its publish.
+ */
+#ifndef telemetryMAX_BATCH_AGE_MS
+    #define telemetryMAX_BATCH_AGE_MS    ( 60000U )
+#endif
+
+/**
+ * @brief Number of message buffers. One is filled while the others wait to be sent by the MQTT agent.
+ */
+#ifndef telemetryBUFFERS
+    #define telemetryBUFFERS    ( 2U )
+#endif
+
+/**
+ * @brief Set to 1 to send the batches as MQTT-SN datagrams to the gateway of telemetry_udp.h instead
+ * of QoS0 publishes over the MQTT connection, avoiding the TLS records and the head of line blocking
+ * of TCP for loss tolerant samples.
+ */
+#ifndef telemetryUDP_TRANSPORT
+    #define telemetryUDP_TRANSPORT    ( 0 )
+#endif
+
+/**
+ * @brief QoS of the batches published over the MQTT connection. A QoS1 batch is sent as QoS0 while
+ * telemetry_qos.h reports a congested link.
+ */
+#ifndef telemetryQOS
+    #define telemetryQOS    ( MQTTQoS0 )
+#endif
+
+/**
+ * @brief CBOR encoder writing into a caller buffer. An item that does not fit sets the overflow flag,
+ * which is kept until the encoder is initialized again, so the items can be written without checks.
+ */
+typedef struct TelemetryEncoder
+{
+    uint8_t * pucBuffer; /**< Buffer the items are written to. */
+    size_t xSize;        /**< Size of the buffer. */
+    size_t xLength;      /**< Bytes written so far. */
+    bool bOverflow;      /**< Set once an item did not fit. */
+} TelemetryEncoder_t;
+
+/**
+ * @brief Writes one sample: a single CBOR data item, typically a map of the fields, e.g.
+ * Telemetry_EncodeMap( pxEncoder, 2 ), then a Telemetry_EncodeText() key and a value for each field.
+ * Called with the batch locked, once more if the sample did not fit the current message.
+ *
+ * @param[in] pxEncoder The encoder to write the sample to.
+ * @param[in] pvContext The context passed to Telemetry_Add().
+ */
+typedef void ( * TelemetrySampleCallback_t )( TelemetryEncoder_t * pxEncoder,
+                                              void * pvContext );
+
+/**
+ * @brief Starts encoding into a buffer.
+ *
+ * @param[out] pxEncoder The encoder.
+ * @param[in] pucBuffer The buffer.
+ * @param[in] xSize Size of the buffer.
+ */
+void Telemetry_EncoderInit( TelemetryEncoder_t * pxEncoder,
+                            uint8_t * pucBuffer,
+                            size_t xSize );
+
+/**
+ * @brief Gets the length of the encoded items.
+ *
+ * @param[in] pxEncoder The encoder.
+ *
+ * @return The number of bytes written, 0 if an item did not fit.
+ */
+size_t Telemetry_EncodedLength( const TelemetryEncoder_t * pxEncoder );
+
+/**
+ * @brief Writes an unsigned integer in its shortest form.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] ullValue The value.
+ */
+void Telemetry_EncodeUint( TelemetryEncoder_t * pxEncoder,
+                           uint64_t ullValue );
+
+/**
+ * @brief Writes a signed integer in its shortest form.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] llValue The value.
+ */
+void Telemetry_EncodeInt( TelemetryEncoder_t * pxEncoder,
+                          int64_t llValue );
+
+/**
+ * @brief Writes a float as a half precision float when the conversion is exact, as a single
+ * precision float otherwise.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] fValue The value.
+ */
+void Telemetry_EncodeFloat( TelemetryEncoder_t * pxEncoder,
+                            float fValue );
+
+/**
+ * @brief Writes a boolean.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] bValue The value.
+ */
+void Telemetry_EncodeBool( TelemetryEncoder_t * pxEncoder,
+                           bool bValue );
+
+/**
+ * @brief Writes a UTF-8 text string, used for the keys of the maps too.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] pcText The string, not NUL terminated.
+ * @param[in] xLength Length of the string.
+ */
+void Telemetry_EncodeText( TelemetryEncoder_t * pxEncoder,
+                           const char * pcText,
+                           size_t xLength );
+
+/**
+ * @brief Writes a byte string.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] pucData The bytes.
+ * @param[in] xLength Number of bytes.
+ */
+void Telemetry_EncodeBytes( TelemetryEncoder_t * pxEncoder,
+                            const uint8_t * pucData,
+                            size_t xLength );
+
+/**
+ * @brief Starts an array, the next xItems data items are its elements.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] xItems Number of elements.
+ */
+void Telemetry_EncodeArray( TelemetryEncoder_t * pxEncoder,
+                            size_t xItems );
+
+/**
+ * @brief Starts a map, the next 2 * xPairs data items are its keys and values.
+ *
+ * @param[in] pxEncoder The encoder.
+ * @param[in] xPairs Number of pairs.
+ */
+void Telemetry_EncodeMap( TelemetryEncoder_t * pxEncoder,
+                          size_t xPairs );
+
+/**
+ * @brief Sets up the batcher publishing on "device/<thing name>/telemetry". A message is the CBOR map
+ * {"t": <uptime in ms of the first sample>, "s": [[<ms since t>, <sample>], ...]}. Once TimeSync_GetUtcMs()
+ * is synchronized, the map also holds "u": <UTC ms of the first sample> and "x": <UTC ms the message
+ * was handed to the transport>, so that the receiver measures the latency of each sample against its
+ * own clock, and the share of it spent in the network. A message is published once it
+ * holds telemetryMAX_SAMPLES samples, once the next sample would not fit in telemetryMESSAGE_MAX_SIZE
+ * bytes, or telemetryMAX_BATCH_AGE_MS after its first sample. With telemetryUDP_TRANSPORT, the
+ * message is sent to the MQTT-SN gateway instead, which maps it to the topic.
+ * Must be called once the MQTT agent is started.
+ *
+ * @param[in] pcThingName The thing name, not copied.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if the batcher is set up.
+ */
+BaseType_t Telemetry_Init( const char * pcThingName,
+                           uint32_t ulThingNameLength );
+
+/**
+ * @brief Adds a sample to the current batch.
+ *
+ * @param[in] xCallback Writes the sample.
+ * @param[in] pvContext Passed to the callback.
+ * @param[in] xTicksToWait Time to wait for the batch and a free message buffer.
+ *
+ * @return pdTRUE if the sample is added, pdFALSE if no buffer was free or the sample alone does not
+ * fit in a message.
+ */
+BaseType_t Telemetry_Add( TelemetrySampleCallback_t xCallback,
+                          void * pvContext,
+                          TickType_t xTicksToWait );
+
+/**
+ * @brief Publishes the current batch without waiting for its bounds.
+ *
+ * @param[in] xTicksToWait Time to wait for the batch.
+ *
+ * @return pdTRUE if the batch was empty or is queued to the MQTT agent.
+ */
+BaseType_t Telemetry_Flush( TickType_t xTicksToWait );
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,250 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file telemetry_qos.c
+ * @brief Congestion controller of the telemetry streams, run by a timer of the timer task.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "fsl_debug_console.h"
+
+#include "telemetry_qos.h"
+
+#if ( telemetryqosENABLED == 1 )
+
+    #include "tls_freertos_pkcs11.h"
+
+/*-----------------------------------------------------------*/
+
+    static TimerHandle_t xEvaluateTimer = NULL;
+    static StaticTimer_t xEvaluateTimerBuffer;
+
+    static volatile TelemetryQosLevel_t xLevel = TELEMETRYQOS_LEVEL_NORMAL;
+
+/**
+ * @brief Snapshot of the agent statistics, too large for the stack of the timer task.
+ */
+    static MQTTAgentStats_t xAgentStats;
+
+/**
+ * @brief Counters at the end of the previous period, the differences are the activity of the period.
+ */
+    static uint32_t ulLastAcked = 0;
+    static uint32_t ulLastAckTimeMs = 0;
+    static uint32_t ulLastRefused = 0;
+    static uint32_t ulLastSendTimeouts = 0;
+
+/**
+ * @brief Quiet periods in a row since the level was last changed or a period was congested.
+ */
+    static uint32_t ulQuietPeriods = 0;
+
+    static TelemetryQosStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Reads the agent statistics and the activity since the previous call.
+ *
+ * @param[out] pulMeanAckMs Mean time to PUBACK, 0 if no PUBACK was received.
+ * @param[out] pulRefused Enqueues refused by the agent.
+ * @param[out] pulSendTimeouts TLS sends which timed out.
+ */
+    static void prvReadCounters( uint32_t * pulMeanAckMs,
+                                 uint32_t * pulRefused,
+                                 uint32_t * pulSendTimeouts )
+    {
+        const MQTTAgentOperationStats_t * pxPublish = &xAgentStats.operations[ MQTT_OP_PUBLISH ];
+        uint32_t ulAcked = 0;
+        uint32_t ulSendTimeouts = TLS_FreeRTOS_GetSendTimeouts();
+        uint32_t i;
+
+        MQTTAgent_GetStats( NULL, &xAgentStats );
+
+        /* Only the QoS1 and QoS2 publishes are timed, they are the ones in the histogram. */
+        for( i = 0; i < MQTT_AGENT_STATS_HISTOGRAM_BUCKETS; i++ )
+        {
+            ulAcked += pxPublish->ackTimeHistogram[ i ];
+        }
+
+        *pulMeanAckMs = ( ulAcked != ulLastAcked ) ? ( ( pxPublish->totalAckTimeMs - ulLastAckTimeMs ) / ( ulAcked - ulLastAcked ) ) : 0U;
+        *pulRefused = xAgentStats.refused - ulLastRefused;
+        *pulSendTimeouts = ulSendTimeouts - ulLastSendTimeouts;
+
+        ulLastAcked = ulAcked;
+        ulLastAckTimeMs = pxPublish->totalAckTimeMs;
+        ulLastRefused = xAgentStats.refused;
+        ulLastSendTimeouts = ulSendTimeouts;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvEvaluateTimerCallback( TimerHandle_t xTimer )
+    {
+        TelemetryQosLevel_t xNewLevel = xLevel;
+        uint32_t ulMeanAckMs;
+        uint32_t ulRefused;
+        uint32_t ulSendTimeouts;
+        BaseType_t xCongested;
+
+        ( void ) xTimer;
+
+        prvReadCounters( &ulMeanAckMs, &ulRefused, &ulSendTimeouts );
+
+        xCongested = ( ( ulMeanAckMs > telemetryqosACK_HIGH_MS ) ||
+                       ( xAgentStats.queueDepth >= telemetryqosQUEUE_HIGH ) ||
+                       ( xAgentStats.pendingAcks >= telemetryqosPENDING_HIGH ) ||
+                       ( ulRefused > 0U ) ||
+                       ( ulSendTimeouts > 0U ) ) ? pdTRUE : pdFALSE;
+
+        if( xCongested == pdTRUE )
+        {
+            xStats.ulCongestedPeriods++;
+            ulQuietPeriods = 0;
+
+            if( xNewLevel < TELEMETRYQOS_LEVEL_SEVERE )
+            {
+                xNewLevel = ( TelemetryQosLevel_t ) ( xNewLevel + 1 );
+            }
+        }
+        else if( ulMeanAckMs <= telemetryqosACK_LOW_MS )
+        {
+            ulQuietPeriods++;
+
+            if( ( ulQuietPeriods >= telemetryqosRECOVERY_PERIODS ) && ( xNewLevel > TELEMETRYQOS_LEVEL_NORMAL ) )
+            {
+                xNewLevel = ( TelemetryQosLevel_t ) ( xNewLevel - 1 );
+                ulQuietPeriods = 0;
+            }
+        }
+        else
+        {
+            /* Between the thresholds, the level is kept. */
+            ulQuietPeriods = 0;
+        }
+
+        if( xNewLevel != xLevel )
+        {
+            PRINTF( "Telemetry congestion level %u, mean PUBACK %u ms, %u queued, %u pending, %u refused, %u send timeouts.\r\n",
+                    ( unsigned ) xNewLevel, ( unsigned ) ulMeanAckMs, ( unsigned ) xAgentStats.queueDepth,
+                    ( unsigned ) xAgentStats.pendingAcks, ( unsigned ) ulRefused, ( unsigned ) ulSendTimeouts );
+            xStats.ulLevelChanges++;
+            xLevel = xNewLevel;
+        }
+
+        xStats.ulMeanAckMs = ulMeanAckMs;
+    }
+
+/*-----------------------------------------------------------*/
+
+    BaseType_t TelemetryQos_Init( void )
+    {
+        BaseType_t xResult = pdFALSE;
+        uint32_t ulMeanAckMs;
+        uint32_t ulRefused;
+        uint32_t ulSendTimeouts;
+
+        if( xEvaluateTimer == NULL )
+        {
+            /* The counters so far are not the activity of the first period. */
+            prvReadCounters( &ulMeanAckMs, &ulRefused, &ulSendTimeouts );
+
+            xEvaluateTimer = xTimerCreateStatic( "TelemetryQos",
+                                                 pdMS_TO_TICKS( telemetryqosPERIOD_MS ),
+                                                 pdTRUE,
+                                                 NULL,
+                                                 prvEvaluateTimerCallback,
+                                                 &xEvaluateTimerBuffer );
+
+            if( ( xEvaluateTimer != NULL ) && ( xTimerStart( xEvaluateTimer, 0 ) == pdPASS ) )
+            {
+                xResult = pdTRUE;
+            }
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    TelemetryQosLevel_t TelemetryQos_GetLevel( void )
+    {
+        return xLevel;
+    }
+
+/*-----------------------------------------------------------*/
+
+    MQTTQoS_t TelemetryQos_SelectQoS( MQTTQoS_t xQoS,
+                                      BaseType_t xCritical )
+    {
+        MQTTQoS_t xSelected = xQoS;
+
+        if( ( xCritical == pdFALSE ) && ( xQoS != MQTTQoS0 ) && ( xLevel >= TELEMETRYQOS_LEVEL_CONGESTED ) )
+        {
+            xSelected = MQTTQoS0;
+
+            taskENTER_CRITICAL();
+            {
+                xStats.ulDowngrades++;
+            }
+            taskEXIT_CRITICAL();
+        }
+
+        return xSelected;
+    }
+
+/*-----------------------------------------------------------*/
+
+    uint32_t TelemetryQos_ScaleInterval( uint32_t ulIntervalMs )
+    {
+        uint32_t ulShift = ( uint32_t ) xLevel;
+        uint32_t ulScaledMs = ulIntervalMs;
+
+        if( ulIntervalMs < telemetryqosMAX_INTERVAL_MS )
+        {
+            ulScaledMs = ( ulIntervalMs > ( telemetryqosMAX_INTERVAL_MS >> ulShift ) ) ? telemetryqosMAX_INTERVAL_MS : ( ulIntervalMs << ulShift );
+        }
+
+        return ulScaledMs;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void TelemetryQos_GetStats( TelemetryQosStats_t * pxStats )
+    {
+        taskENTER_CRITICAL();
+        {
+            *pxStats = xStats;
+        }
+        taskEXIT_CRITICAL();
+
+        pxStats->xLevel = xLevel;
+    }
+
+#endif /* if ( telemetryqosENABLED == 1 ) */
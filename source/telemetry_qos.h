@@ -0,0 +1,179 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file telemetry_qos.h
+ * @brief Congestion controller adapting the rate and the QoS of the telemetry to the link, from the
+ * statistics of the MQTT agent and the send timeouts of the TLS transport. Compiled out unless
+ * telemetryqosENABLED is 1.
+ *
+ * Every telemetryqosPERIOD_MS the controller looks for signs of congestion: a mean time to PUBACK
+ * above telemetryqosACK_HIGH_MS, telemetryqosQUEUE_HIGH operations waiting in the agent queues,
+ * telemetryqosPENDING_HIGH operations waiting for an ACK, refused enqueues or TLS send timeouts.
+ * Each congested period raises the level by one. telemetryqosRECOVERY_PERIODS periods in a row
+ * without any sign and with a mean time to PUBACK below telemetryqosACK_LOW_MS lower it by one.
+ * From TELEMETRYQOS_LEVEL_CONGESTED the non critical streams are sent with QoS0, which frees the
+ * pending ACK slots for the critical ones, and the sampling intervals are doubled at each level.
+ */
+
+#ifndef TELEMETRY_QOS_H
+#define TELEMETRY_QOS_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "perf_profile.h"
+
+/**
+ * @brief Set to 1 to build the controller.
+ */
+#ifndef telemetryqosENABLED
+    #define telemetryqosENABLED    ( 0 )
+#endif
+
+/**
+ * @brief Period of the evaluation of the link, in milliseconds.
+ */
+#ifndef telemetryqosPERIOD_MS
+    #define telemetryqosPERIOD_MS    ( 5000U )
+#endif
+
+/**
+ * @brief Mean time to PUBACK over a period above which the link is congested, in milliseconds.
+ */
+#ifndef telemetryqosACK_HIGH_MS
+    #define telemetryqosACK_HIGH_MS    ( 2000U )
+#endif
+
+/**
+ * @brief Mean time to PUBACK over a period below which the link may recover, in milliseconds.
+ */
+#ifndef telemetryqosACK_LOW_MS
+    #define telemetryqosACK_LOW_MS    ( 500U )
+#endif
+
+/**
+ * @brief Number of operations waiting in the agent queues at which the link is congested.
+ */
+#ifndef telemetryqosQUEUE_HIGH
+    #define telemetryqosQUEUE_HIGH    ( perfprofileAGENT_OPERATIONS / 2U )
+#endif
+
+/**
+ * @brief Number of operations waiting for an ACK at which the link is congested.
+ */
+#ifndef telemetryqosPENDING_HIGH
+    #define telemetryqosPENDING_HIGH    ( ( perfprofileAGENT_OPERATIONS * 3U ) / 4U )
+#endif
+
+/**
+ * @brief Number of quiet periods in a row lowering the level by one.
+ */
+#ifndef telemetryqosRECOVERY_PERIODS
+    #define telemetryqosRECOVERY_PERIODS    ( 3U )
+#endif
+
+/**
+ * @brief Longest interval returned by TelemetryQos_ScaleInterval(), in milliseconds. Keeps the
+ * conversion to ticks from overflowing.
+ */
+#ifndef telemetryqosMAX_INTERVAL_MS
+    #define telemetryqosMAX_INTERVAL_MS    ( 3600000U )
+#endif
+
+#if ( telemetryqosENABLED == 1 )
+
+    #include "core_mqtt_agent.h"
+
+/**
+ * @brief Congestion levels, from a healthy link to a heavily congested one.
+ */
+    typedef enum TelemetryQosLevel
+    {
+        TELEMETRYQOS_LEVEL_NORMAL = 0, /**< Streams sent at their rate and QoS. */
+        TELEMETRYQOS_LEVEL_CONGESTED,  /**< Non critical streams with QoS0, sampling intervals doubled. */
+        TELEMETRYQOS_LEVEL_SEVERE      /**< As congested, sampling intervals multiplied by 4. */
+    } TelemetryQosLevel_t;
+
+/**
+ * @brief Runtime statistics of the controller.
+ */
+    typedef struct TelemetryQosStats
+    {
+        TelemetryQosLevel_t xLevel;   /**< Current level. */
+        uint32_t ulMeanAckMs;         /**< Mean time to PUBACK over the last period, 0 if no PUBACK. */
+        uint32_t ulCongestedPeriods;  /**< Periods with a sign of congestion. */
+        uint32_t ulLevelChanges;      /**< Times the level was raised or lowered. */
+        uint32_t ulDowngrades;        /**< Publishes of non critical streams sent with QoS0 instead. */
+    } TelemetryQosStats_t;
+
+/**
+ * @brief Starts the periodic evaluation of the link. Must be called once the MQTT agent is started.
+ *
+ * @return pdTRUE if the controller is running.
+ */
+    BaseType_t TelemetryQos_Init( void );
+
+/**
+ * @brief Returns the current congestion level.
+ */
+    TelemetryQosLevel_t TelemetryQos_GetLevel( void );
+
+/**
+ * @brief Selects the QoS of a publish of a stream.
+ *
+ * @param[in] xQoS QoS of the stream on a healthy link.
+ * @param[in] xCritical pdTRUE for a stream which keeps its QoS under congestion.
+ *
+ * @return The QoS to publish with.
+ */
+    MQTTQoS_t TelemetryQos_SelectQoS( MQTTQoS_t xQoS,
+                                      BaseType_t xCritical );
+
+/**
+ * @brief Scales the sampling interval of a non critical stream to the congestion level.
+ *
+ * @param[in] ulIntervalMs Interval on a healthy link, in milliseconds.
+ *
+ * @return The interval to wait, telemetryqosMAX_INTERVAL_MS at most unless ulIntervalMs is longer.
+ */
+    uint32_t TelemetryQos_ScaleInterval( uint32_t ulIntervalMs );
+
+/**
+ * @brief Gets the statistics of the controller.
+ *
+ * @param[out] pxStats The statistics.
+ */
+    void TelemetryQos_GetStats( TelemetryQosStats_t * pxStats );
+
+#else /* if ( telemetryqosENABLED == 1 ) */
+
+    #define TelemetryQos_SelectQoS( xQoS, xCritical )    ( xQoS )
+    #define TelemetryQos_ScaleInterval( ulIntervalMs )    ( ulIntervalMs )
+
+#endif /* if ( telemetryqosENABLED == 1 ) */
+
+#endif /* TELEMETRY_QOS_H */
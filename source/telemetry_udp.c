@@ -0,0 +1,176 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file telemetry_udp.c
+ * @brief UDP transport of the telemetry batches, sent as MQTT-SN publishes with QoS -1 to a gateway.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+
+#include "fsl_debug_console.h"
+
+#include "telemetry.h"
+#include "telemetry_udp.h"
+
+/*-----------------------------------------------------------*/
+
+/* FreeRTOS+TCP does not fragment outgoing datagrams, a message must fit in one frame with the
+ * IP and UDP headers. */
+#if ( ( telemetryMESSAGE_MAX_SIZE + telemetryudpHEADER_SIZE ) > ( ipconfigNETWORK_MTU - 28 ) )
+    #error "telemetryMESSAGE_MAX_SIZE does not fit in a datagram of ipconfigNETWORK_MTU."
+#endif
+
+/**
+ * @brief MQTT-SN message type of PUBLISH.
+ */
+#define telemetryudpMSG_TYPE_PUBLISH       ( 0x0CU )
+
+/**
+ * @brief PUBLISH flags: QoS -1 and a predefined topic identifier.
+ */
+#define telemetryudpFLAGS_QOS_MINUS_1      ( 0x60U )
+#define telemetryudpFLAGS_TOPIC_PREDEF     ( 0x01U )
+
+/**
+ * @brief First byte of the 3 byte length form, used by the messages longer than 255 bytes.
+ */
+#define telemetryudpLONG_LENGTH            ( 0x01U )
+
+/**
+ * @brief Longest message of the 1 byte length form, header included.
+ */
+#define telemetryudpSHORT_LENGTH_MAX       ( 255U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Socket sending to the gateway, bound to an ephemeral port by the first send.
+ */
+static Socket_t xSocket = FREERTOS_INVALID_SOCKET;
+
+/**
+ * @brief Address of the gateway.
+ */
+static struct freertos_sockaddr xGatewayAddress;
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TelemetryUdp_Init( void )
+{
+    BaseType_t xResult = pdFALSE;
+    TickType_t xSendTimeout = 0;
+
+    memset( &xGatewayAddress, 0x00, sizeof( xGatewayAddress ) );
+    xGatewayAddress.sin_addr = FreeRTOS_inet_addr( telemetryudpGATEWAY_ADDRESS );
+    xGatewayAddress.sin_port = FreeRTOS_htons( telemetryudpGATEWAY_PORT );
+
+    if( xGatewayAddress.sin_addr == 0U )
+    {
+        PRINTF( "Telemetry gateway address %s is invalid.\r\n", telemetryudpGATEWAY_ADDRESS );
+    }
+    else if( xSocket != FREERTOS_INVALID_SOCKET )
+    {
+        xResult = pdTRUE;
+    }
+    else
+    {
+        xSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+
+        if( xSocket == FREERTOS_INVALID_SOCKET )
+        {
+            PRINTF( "Telemetry UDP socket not created.\r\n" );
+        }
+        else
+        {
+            /* The batches are sent from the timer task too, which must not block. */
+            ( void ) FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_SNDTIMEO, &xSendTimeout, sizeof( xSendTimeout ) );
+            xResult = pdTRUE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TelemetryUdp_Send( const uint8_t * pucMessage,
+                              size_t xLength )
+{
+    BaseType_t xResult = pdFALSE;
+    size_t xHeaderLength = telemetryudpHEADER_SIZE - 2U;
+    size_t xTotalLength;
+    uint8_t * pucDatagram;
+    size_t i = 0;
+
+    configASSERT( xSocket != FREERTOS_INVALID_SOCKET );
+
+    if( ( xLength + xHeaderLength ) > telemetryudpSHORT_LENGTH_MAX )
+    {
+        xHeaderLength = telemetryudpHEADER_SIZE;
+    }
+
+    xTotalLength = xLength + xHeaderLength;
+
+    /* Zero copy: the message is written once, after the header, into the network buffer. */
+    pucDatagram = ( uint8_t * ) FreeRTOS_GetUDPPayloadBuffer( xTotalLength, 0 );
+
+    if( pucDatagram != NULL )
+    {
+        if( xHeaderLength == telemetryudpHEADER_SIZE )
+        {
+            pucDatagram[ i++ ] = telemetryudpLONG_LENGTH;
+            pucDatagram[ i++ ] = ( uint8_t ) ( xTotalLength >> 8 );
+        }
+
+        pucDatagram[ i++ ] = ( uint8_t ) xTotalLength;
+        pucDatagram[ i++ ] = telemetryudpMSG_TYPE_PUBLISH;
+        pucDatagram[ i++ ] = telemetryudpFLAGS_QOS_MINUS_1 | telemetryudpFLAGS_TOPIC_PREDEF;
+        pucDatagram[ i++ ] = ( uint8_t ) ( telemetryudpTOPIC_ID >> 8 );
+        pucDatagram[ i++ ] = ( uint8_t ) telemetryudpTOPIC_ID;
+        /* The message identifier is only relevant for QoS 1 and 2. */
+        pucDatagram[ i++ ] = 0U;
+        pucDatagram[ i++ ] = 0U;
+        ( void ) memcpy( &pucDatagram[ i ], pucMessage, xLength );
+
+        if( FreeRTOS_sendto( xSocket, pucDatagram, xTotalLength, FREERTOS_ZERO_COPY,
+                             &xGatewayAddress, sizeof( xGatewayAddress ) ) == 0 )
+        {
+            /* Not queued to the IP task, the buffer is still owned here. */
+            FreeRTOS_ReleaseUDPPayloadBuffer( pucDatagram );
+        }
+        else
+        {
+            xResult = pdTRUE;
+        }
+    }
+
+    return xResult;
+}
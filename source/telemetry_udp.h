@@ -0,0 +1,91 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file telemetry_udp.h
+ * @brief UDP transport of the telemetry batches, sent as MQTT-SN publishes with QoS -1 to a gateway.
+ *
+ * A QoS -1 publish needs no connection, registration or acknowledgement: each batch is a single
+ * datagram holding the MQTT-SN header and the CBOR message, which the gateway forwards to the broker
+ * on the topic it maps to telemetryudpTOPIC_ID. A lost datagram only loses its batch, the samples
+ * behind it are not delayed by retransmissions and no TLS record is built. The datagrams are not
+ * encrypted nor authenticated, so the device and the gateway must share a trusted network.
+ */
+
+#ifndef TELEMETRY_UDP_H
+#define TELEMETRY_UDP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief IPv4 address of the MQTT-SN gateway, dotted decimal.
+ */
+#ifndef telemetryudpGATEWAY_ADDRESS
+    #define telemetryudpGATEWAY_ADDRESS    "192.168.1.10"
+#endif
+
+/**
+ * @brief UDP port of the MQTT-SN gateway.
+ */
+#ifndef telemetryudpGATEWAY_PORT
+    #define telemetryudpGATEWAY_PORT    ( 1884U )
+#endif
+
+/**
+ * @brief Predefined topic identifier the gateway maps to the telemetry topic of this device.
+ */
+#ifndef telemetryudpTOPIC_ID
+    #define telemetryudpTOPIC_ID    ( 1U )
+#endif
+
+/**
+ * @brief Size of the MQTT-SN header written before the message: the 3 byte long length form, the
+ * message type, the flags, the topic identifier and the message identifier.
+ */
+#define telemetryudpHEADER_SIZE    ( 9U )
+
+/**
+ * @brief Creates the UDP socket sending to the gateway.
+ *
+ * @return pdTRUE if the socket is created and the gateway address is valid.
+ */
+BaseType_t TelemetryUdp_Init( void );
+
+/**
+ * @brief Sends a message as one MQTT-SN publish, without blocking. The message is copied into a
+ * network buffer, it can be reused on return.
+ *
+ * @param[in] pucMessage The message.
+ * @param[in] xLength Length of the message.
+ *
+ * @return pdTRUE if the datagram is handed to the IP task, pdFALSE if no network buffer was free.
+ */
+BaseType_t TelemetryUdp_Send( const uint8_t * pucMessage,
+                              size_t xLength );
+
+#endif /* TELEMETRY_UDP_H */
@@ -0,0 +1,499 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file time_sync.c
+ * @brief SNTP client disciplining the UTC time of the device.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_Sockets.h"
+#include "FreeRTOS_DNS.h"
+
+#include "fsl_debug_console.h"
+
+#include "monotonic_clock.h"
+#include "time_sync.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief UDP port of the SNTP servers.
+ */
+#define timesyncSNTP_PORT               ( 123U )
+
+/**
+ * @brief Size of an SNTP message without the optional authentication fields.
+ */
+#define timesyncMESSAGE_SIZE            ( 48U )
+
+/**
+ * @brief First byte of a request: no leap second warning, version 4, client mode.
+ */
+#define timesyncREQUEST_FLAGS           ( 0x23U )
+
+/**
+ * @brief Offsets of the fields of an SNTP message.
+ */
+#define timesyncOFFSET_STRATUM          ( 1U )
+#define timesyncOFFSET_ORIGINATE        ( 24U )
+#define timesyncOFFSET_RECEIVE          ( 32U )
+#define timesyncOFFSET_TRANSMIT         ( 40U )
+
+/**
+ * @brief Mode of a server response and leap indicator of an unsynchronized server.
+ */
+#define timesyncMODE_SERVER             ( 4U )
+#define timesyncLEAP_ALARM              ( 3U )
+
+/**
+ * @brief Seconds from the NTP epoch, 1900, to the Unix epoch, 1970.
+ */
+#define timesyncNTP_TO_UNIX_SECONDS     ( 2208988800ULL )
+
+/**
+ * @brief Time to wait for the response to a request, and between the requests of a burst.
+ */
+#define timesyncRESPONSE_TIMEOUT_MS     ( 2000U )
+#define timesyncBURST_SPACING_MS        ( 2000U )
+
+/**
+ * @brief Gain of the frequency correction, the frequency moves by 1 / timesyncFREQUENCY_GAIN of the
+ * rate implied by each offset error so the noise of a single sample is averaged out.
+ */
+#define timesyncFREQUENCY_GAIN          ( 4 )
+
+/**
+ * @brief Priority of the task, just above idle as a late poll only delays the correction.
+ */
+#ifndef timesyncTASK_PRIORITY
+    #define timesyncTASK_PRIORITY      ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/**
+ * @brief Stack size of the task, in words.
+ */
+#ifndef timesyncTASK_STACK_SIZE
+    #define timesyncTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 3 )
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief A sample of the offset of the UTC time over the monotonic clock.
+ */
+typedef struct TimeSyncSample
+{
+    uint64_t ullMonoUs;   /**< Monotonic time in the middle of the exchange. */
+    int64_t llOffsetUs;   /**< UTC time minus monotonic time, in microseconds. */
+    uint32_t ulRoundTripUs; /**< Round trip without the processing time of the server. */
+} TimeSyncSample_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief The UTC time is llRefOffsetUs + lFrequencyPpb * ( mono - ullRefMonoUs ) ahead of the
+ * monotonic time mono. Written by the task in critical sections, read by TimeSync_GetUtcMs().
+ */
+static uint64_t ullRefMonoUs = 0;
+static int64_t llRefOffsetUs = 0;
+static int32_t lFrequencyPpb = 0;
+static BaseType_t xSynced = pdFALSE;
+
+/**
+ * @brief Status returned by TimeSync_GetStatus().
+ */
+static TimeSyncStatus_t xStatus;
+
+/**
+ * @brief Set once the task is created.
+ */
+static TaskHandle_t xTimeSyncTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Offset predicted at a monotonic time from the reference, in a critical section.
+ */
+static int64_t prvPredictOffset( uint64_t ullMonoUs )
+{
+    int64_t llElapsedUs = ( int64_t ) ( ullMonoUs - ullRefMonoUs );
+
+    return llRefOffsetUs + ( ( llElapsedUs * lFrequencyPpb ) / 1000000000LL );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Converts an NTP timestamp to microseconds since the Unix epoch. The seconds below 2^31
+ * are taken in the era starting in 2036.
+ */
+static int64_t prvNtpToUnixUs( const uint8_t * pucTimestamp )
+{
+    uint64_t ullSeconds = ( ( uint32_t ) pucTimestamp[ 0 ] << 24 ) | ( ( uint32_t ) pucTimestamp[ 1 ] << 16 ) |
+                          ( ( uint32_t ) pucTimestamp[ 2 ] << 8 ) | ( uint32_t ) pucTimestamp[ 3 ];
+    uint64_t ullFraction = ( ( uint32_t ) pucTimestamp[ 4 ] << 24 ) | ( ( uint32_t ) pucTimestamp[ 5 ] << 16 ) |
+                           ( ( uint32_t ) pucTimestamp[ 6 ] << 8 ) | ( uint32_t ) pucTimestamp[ 7 ];
+
+    if( ullSeconds < 0x80000000ULL )
+    {
+        ullSeconds += 0x100000000ULL;
+    }
+
+    return ( int64_t ) ( ( ( ullSeconds - timesyncNTP_TO_UNIX_SECONDS ) * 1000000ULL ) + ( ( ullFraction * 1000000ULL ) >> 32 ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sends a request and waits for its response.
+ * The transmit timestamp of the request holds the monotonic send time, which the server returns as
+ * the originate timestamp, so that late responses to earlier requests are skipped.
+ *
+ * @return pdTRUE if a valid response arrived, the sample is then set.
+ */
+static BaseType_t prvExchange( Socket_t xSocket,
+                               const struct freertos_sockaddr * pxServer,
+                               TimeSyncSample_t * pxSample )
+{
+    uint8_t ucMessage[ timesyncMESSAGE_SIZE ];
+    uint8_t ucCookie[ 8 ];
+    struct freertos_sockaddr xFrom;
+    uint32_t ulFromLength = sizeof( xFrom );
+    uint64_t ullSentUs;
+    uint64_t ullReceivedUs;
+    int64_t llServerReceiveUs;
+    int64_t llServerTransmitUs;
+    int64_t llRoundTripUs;
+    TickType_t xStart;
+    int32_t lReceived;
+    BaseType_t xResult = pdFALSE;
+    size_t i;
+
+    memset( ucMessage, 0x00, sizeof( ucMessage ) );
+    ucMessage[ 0 ] = timesyncREQUEST_FLAGS;
+
+    ullSentUs = MonotonicClock_GetUs();
+
+    for( i = 0; i < sizeof( ucCookie ); i++ )
+    {
+        ucCookie[ i ] = ( uint8_t ) ( ullSentUs >> ( 56U - ( 8U * i ) ) );
+    }
+
+    memcpy( &ucMessage[ timesyncOFFSET_TRANSMIT ], ucCookie, sizeof( ucCookie ) );
+
+    if( FreeRTOS_sendto( xSocket, ucMessage, sizeof( ucMessage ), 0, pxServer, sizeof( *pxServer ) ) <= 0 )
+    {
+        return pdFALSE;
+    }
+
+    xStart = xTaskGetTickCount();
+
+    while( ( xResult == pdFALSE ) &&
+           ( ( xTaskGetTickCount() - xStart ) < pdMS_TO_TICKS( timesyncRESPONSE_TIMEOUT_MS ) ) )
+    {
+        lReceived = FreeRTOS_recvfrom( xSocket, ucMessage, sizeof( ucMessage ), 0, &xFrom, &ulFromLength );
+        ullReceivedUs = MonotonicClock_GetUs();
+
+        if( ( lReceived < ( int32_t ) timesyncMESSAGE_SIZE ) ||
+            ( xFrom.sin_addr != pxServer->sin_addr ) ||
+            ( ( ucMessage[ 0 ] & 0x07U ) != timesyncMODE_SERVER ) ||
+            ( ( ucMessage[ 0 ] >> 6 ) == timesyncLEAP_ALARM ) ||
+            ( ucMessage[ timesyncOFFSET_STRATUM ] == 0U ) ||
+            ( memcmp( &ucMessage[ timesyncOFFSET_ORIGINATE ], ucCookie, sizeof( ucCookie ) ) != 0 ) )
+        {
+            /* A timeout, a kiss-o'-death, an unsynchronized server or a late response. */
+            continue;
+        }
+
+        llServerReceiveUs = prvNtpToUnixUs( &ucMessage[ timesyncOFFSET_RECEIVE ] );
+        llServerTransmitUs = prvNtpToUnixUs( &ucMessage[ timesyncOFFSET_TRANSMIT ] );
+        llRoundTripUs = ( int64_t ) ( ullReceivedUs - ullSentUs ) - ( llServerTransmitUs - llServerReceiveUs );
+
+        pxSample->ullMonoUs = ullSentUs + ( ( ullReceivedUs - ullSentUs ) / 2U );
+        pxSample->llOffsetUs = ( ( llServerReceiveUs - ( int64_t ) ullSentUs ) + ( llServerTransmitUs - ( int64_t ) ullReceivedUs ) ) / 2;
+        pxSample->ulRoundTripUs = ( llRoundTripUs > 0 ) ? ( uint32_t ) llRoundTripUs : 0U;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Runs a burst of exchanges with the server.
+ *
+ * @return pdTRUE if at least one exchange succeeded, the sample with the shortest round trip is set.
+ */
+static BaseType_t prvPoll( TimeSyncSample_t * pxBest )
+{
+    struct freertos_sockaddr xServer = { 0 };
+    TimeSyncSample_t xSample;
+    TickType_t xTimeout = pdMS_TO_TICKS( timesyncRESPONSE_TIMEOUT_MS );
+    Socket_t xSocket;
+    BaseType_t xResult = pdFALSE;
+    uint32_t i;
+
+    xServer.sin_addr = FreeRTOS_gethostbyname( timesyncSNTP_SERVER );
+    xServer.sin_port = FreeRTOS_htons( timesyncSNTP_PORT );
+
+    if( xServer.sin_addr == 0U )
+    {
+        return pdFALSE;
+    }
+
+    xSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+
+    if( xSocket == FREERTOS_INVALID_SOCKET )
+    {
+        return pdFALSE;
+    }
+
+    ( void ) FreeRTOS_setsockopt( xSocket, 0, FREERTOS_SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) );
+
+    for( i = 0; i < timesyncBURST_REQUESTS; i++ )
+    {
+        if( i > 0U )
+        {
+            vTaskDelay( pdMS_TO_TICKS( timesyncBURST_SPACING_MS ) );
+        }
+
+        if( ( prvExchange( xSocket, &xServer, &xSample ) == pdTRUE ) &&
+            ( ( xResult == pdFALSE ) || ( xSample.ulRoundTripUs < pxBest->ulRoundTripUs ) ) )
+        {
+            *pxBest = xSample;
+            xResult = pdTRUE;
+        }
+    }
+
+    ( void ) FreeRTOS_closesocket( xSocket );
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Corrects the UTC time with the sample of a poll.
+ *
+ * @param[in] pxSample The sample.
+ * @param[in] pxPrevious The sample of the previous poll.
+ * @param[in] ulSamples Number of samples since the UTC time was last set, 0 to set it.
+ *
+ * @return pdTRUE if the UTC time was set instead of corrected.
+ */
+static BaseType_t prvDiscipline( const TimeSyncSample_t * pxSample,
+                                 const TimeSyncSample_t * pxPrevious,
+                                 uint32_t ulSamples )
+{
+    int64_t llErrorUs = 0;
+    int64_t llIntervalUs;
+    int64_t llFrequencyPpb = lFrequencyPpb;
+    BaseType_t xStep = pdFALSE;
+
+    if( ulSamples > 0U )
+    {
+        taskENTER_CRITICAL();
+        {
+            llErrorUs = pxSample->llOffsetUs - prvPredictOffset( pxSample->ullMonoUs );
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    if( ( ulSamples == 0U ) || ( llErrorUs > timesyncSTEP_THRESHOLD_US ) || ( llErrorUs < -timesyncSTEP_THRESHOLD_US ) )
+    {
+        xStep = ( ulSamples > 0U ) ? pdTRUE : pdFALSE;
+        llFrequencyPpb = 0;
+    }
+    else
+    {
+        llIntervalUs = ( int64_t ) ( pxSample->ullMonoUs - pxPrevious->ullMonoUs );
+
+        if( llIntervalUs > 0 )
+        {
+            /* The first interval after the UTC time is set gives the frequency outright, the next
+             * ones correct it. */
+            if( ulSamples == 1U )
+            {
+                llFrequencyPpb = ( ( pxSample->llOffsetUs - pxPrevious->llOffsetUs ) * 1000000000LL ) / llIntervalUs;
+            }
+            else
+            {
+                llFrequencyPpb += ( ( llErrorUs * 1000000000LL ) / llIntervalUs ) / timesyncFREQUENCY_GAIN;
+            }
+        }
+    }
+
+    /* Far beyond the tolerance of the FRO, the samples are not trusted. */
+    if( ( llFrequencyPpb > 20000000LL ) || ( llFrequencyPpb < -20000000LL ) )
+    {
+        llFrequencyPpb = 0;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        ullRefMonoUs = pxSample->ullMonoUs;
+        llRefOffsetUs = pxSample->llOffsetUs;
+        lFrequencyPpb = ( int32_t ) llFrequencyPpb;
+        xSynced = pdTRUE;
+    }
+    taskEXIT_CRITICAL();
+
+    xStatus.lLastErrorUs = ( int32_t ) ( ( llErrorUs > INT32_MAX ) ? INT32_MAX : ( ( llErrorUs < INT32_MIN ) ? INT32_MIN : llErrorUs ) );
+
+    return xStep;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTimeSyncTask( void * pvParameters )
+{
+    TimeSyncSample_t xSample;
+    TimeSyncSample_t xPrevious = { 0 };
+    uint32_t ulSamples = 0;
+    uint32_t ulFastPolls = timesyncFAST_POLLS;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        if( prvPoll( &xSample ) == pdTRUE )
+        {
+            if( prvDiscipline( &xSample, &xPrevious, ulSamples ) == pdTRUE )
+            {
+                /* Estimate the frequency again from the next polls. */
+                xStatus.ulSteps++;
+                ulSamples = 0;
+                ulFastPolls = timesyncFAST_POLLS;
+                PRINTF( "Time sync: stepped by %d us.\r\n", ( int ) xStatus.lLastErrorUs );
+            }
+            else if( xStatus.ulPolls == 0U )
+            {
+                PRINTF( "Time sync: synchronized to %s, round trip %u us.\r\n", timesyncSNTP_SERVER,
+                        ( unsigned int ) xSample.ulRoundTripUs );
+            }
+            else
+            {
+                /* Corrected. */
+            }
+
+            xPrevious = xSample;
+            ulSamples++;
+            xStatus.ulPolls++;
+            xStatus.ulRoundTripUs = xSample.ulRoundTripUs;
+        }
+        else
+        {
+            xStatus.ulFailedPolls++;
+        }
+
+        if( ulFastPolls > 0U )
+        {
+            ulFastPolls--;
+            vTaskDelay( pdMS_TO_TICKS( timesyncFAST_POLL_PERIOD_MS ) );
+        }
+        else
+        {
+            vTaskDelay( pdMS_TO_TICKS( timesyncPOLL_PERIOD_MS ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TimeSync_Init( void )
+{
+    BaseType_t result = pdPASS;
+
+    if( xTimeSyncTask == NULL )
+    {
+        result = xTaskCreate( prvTimeSyncTask,
+                              "TimeSync_task",
+                              timesyncTASK_STACK_SIZE,
+                              NULL,
+                              timesyncTASK_PRIORITY | portPRIVILEGE_BIT,
+                              &xTimeSyncTask );
+
+        if( result != pdPASS )
+        {
+            PRINTF( "Failed to create time sync task.\r\n" );
+        }
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TimeSync_GetUtcMs( uint64_t * pullUtcMs )
+{
+    BaseType_t xResult;
+    uint64_t ullMonoUs;
+    int64_t llOffsetUs = 0;
+
+    taskENTER_CRITICAL();
+    {
+        xResult = xSynced;
+
+        if( xResult == pdTRUE )
+        {
+            ullMonoUs = MonotonicClock_GetUs();
+            llOffsetUs = prvPredictOffset( ullMonoUs );
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xResult == pdTRUE )
+    {
+        *pullUtcMs = ( uint64_t ) ( ( int64_t ) ullMonoUs + llOffsetUs ) / 1000U;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void TimeSync_GetStatus( TimeSyncStatus_t * pxStatus )
+{
+    uint64_t ullRefUs;
+
+    taskENTER_CRITICAL();
+    {
+        *pxStatus = xStatus;
+        pxStatus->xSynced = xSynced;
+        pxStatus->lFrequencyPpb = lFrequencyPpb;
+        ullRefUs = ullRefMonoUs;
+    }
+    taskEXIT_CRITICAL();
+
+    pxStatus->ulLastSyncAgeMs = ( pxStatus->xSynced == pdTRUE ) ? ( uint32_t ) ( ( MonotonicClock_GetUs() - ullRefUs ) / 1000U ) : 0U;
+}
@@ -0,0 +1,128 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+
+/**
+ * @file time_sync.h
+ * @brief UTC time of the device, disciplined from an SNTP server, to stamp the telemetry with
+ * synchronized times.
+ *
+ * The device clock is the monotonic microsecond clock of monotonic_clock.h. Each poll exchanges a
+ * burst of SNTP requests and keeps the one with the shortest round trip, whose offset has the least
+ * queuing error. Its offset sets the phase of the UTC time, and the offset change since the previous
+ * poll corrects the frequency of the clock, so the UTC time holds between the polls even though the
+ * core clock runs from the FRO, only specified to 1 %. The error of a sample is at most half its
+ * round trip, the part of it due to an asymmetric path.
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Host name of the SNTP server, resolved again at each poll.
+ */
+#ifndef timesyncSNTP_SERVER
+    #define timesyncSNTP_SERVER    "pool.ntp.org"
+#endif
+
+/**
+ * @brief Period of the polls once the frequency is corrected.
+ */
+#ifndef timesyncPOLL_PERIOD_MS
+    #define timesyncPOLL_PERIOD_MS    ( 300000U )
+#endif
+
+/**
+ * @brief Period of the first timesyncFAST_POLLS polls, which estimate the frequency.
+ */
+#ifndef timesyncFAST_POLL_PERIOD_MS
+    #define timesyncFAST_POLL_PERIOD_MS    ( 16000U )
+#endif
+
+/**
+ * @brief Number of polls at timesyncFAST_POLL_PERIOD_MS after the first synchronization or a step.
+ */
+#ifndef timesyncFAST_POLLS
+    #define timesyncFAST_POLLS    ( 4U )
+#endif
+
+/**
+ * @brief Requests in the burst of a poll.
+ */
+#ifndef timesyncBURST_REQUESTS
+    #define timesyncBURST_REQUESTS    ( 4U )
+#endif
+
+/**
+ * @brief Offset error beyond which the UTC time is set again and the frequency estimated anew,
+ * instead of being corrected.
+ */
+#ifndef timesyncSTEP_THRESHOLD_US
+    #define timesyncSTEP_THRESHOLD_US    ( 128000 )
+#endif
+
+/**
+ * @brief State of the synchronization, for diagnostics.
+ */
+typedef struct TimeSyncStatus
+{
+    BaseType_t xSynced;         /**< pdTRUE once a poll succeeded, the UTC time is then valid. */
+    uint32_t ulPolls;           /**< Polls with at least one valid response. */
+    uint32_t ulFailedPolls;     /**< Polls without a valid response. */
+    uint32_t ulSteps;           /**< Times the UTC time was set instead of corrected. */
+    uint32_t ulRoundTripUs;     /**< Round trip of the sample kept by the last poll. */
+    int32_t lLastErrorUs;       /**< Offset error of the last poll against the UTC time predicted. */
+    int32_t lFrequencyPpb;      /**< Rate of the UTC time over the monotonic clock, minus 1, in ppb. */
+    uint32_t ulLastSyncAgeMs;   /**< Time since the last successful poll. */
+} TimeSyncStatus_t;
+
+/**
+ * @brief Creates the task polling the SNTP server. Must be called once the network is up.
+ *
+ * @return pdTRUE if the task is created or already running.
+ */
+BaseType_t TimeSync_Init( void );
+
+/**
+ * @brief Gets the UTC time. Usable from the privileged tasks, like MonotonicClock_GetUs().
+ *
+ * @param[out] pullUtcMs Milliseconds since 1970-01-01 00:00:00 UTC.
+ *
+ * @return pdTRUE if the time is synchronized, pdFALSE before the first successful poll.
+ */
+BaseType_t TimeSync_GetUtcMs( uint64_t * pullUtcMs );
+
+/**
+ * @brief Gets the state of the synchronization.
+ *
+ * @param[out] pxStatus The state.
+ */
+void TimeSync_GetStatus( TimeSyncStatus_t * pxStatus );
+
+#endif /* TIME_SYNC_H */
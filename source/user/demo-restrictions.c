@@ -34,17 +34,45 @@
  * hard fault by MPU. The hard fault handler implemented in this demo handles the exception gracefully by setting the global
  * flag back to zero and skipping to the next instruction in the task. The read only task verifies that flag is reset to zero to confirm
  * that the memory fault was raised and handled gracefully.
+ * A third restricted task consumes the payloads published on the "restricted" topic of the thing. The MQTT agent
+ * copies each payload into a buffer the task cannot otherwise reach and lends it to the task through a spare MPU
+ * region, see mpu_lending.h. The task returns the buffer through a queue and the access is revoked before the
+ * buffer is filled again.
+ * A fourth restricted task publishes a counter on the "restricted/telemetry" topic of the thing. It writes the
+ * publishes into a ring in its own memory, which the MQTT agent drains, see publish_ring.h.
  */
 
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
 /* FreeRTOS include. */
 #include "FreeRTOS.h"
 
 /* Task API include. */
 #include "task.h"
 
+/* Queue API include. */
+#include "queue.h"
+
 /* Contains PRINTF APIs. */
 #include "fsl_debug_console.h"
 
+/* MQTT agent and connection state includes. */
+#include "core_mqtt_agent.h"
+#include "connection_manager.h"
+
+/* Buffer lending include. */
+#include "mpu_lending.h"
+
+/* Restricted publish path include. */
+#include "publish_ring.h"
+
+/* Crash report include. */
+#include "crash_report.h"
+
+#include "demo-restrictions.h"
+
 /**
  * @brief Flag to enable or disable memory fault injection.
  * To enable, set the flag to 1. Enabling this will cause the read-only task to write to a shared memory region
@@ -67,6 +95,36 @@
  */
 #define RESTRICTED_TASK_STACK_SIZE    128
 
+/**
+ * @brief Size of the buffer lent to the payload task, a power of two. Longer payloads are truncated.
+ */
+#define LENT_PAYLOAD_SIZE             256
+
+/**
+ * @brief Topic the payloads for the payload task are published on, formatted with the thing name.
+ */
+#define LENT_PAYLOAD_TOPIC_FORMAT     "$aws/things/%.*s/restricted"
+
+/**
+ * @brief Size of the buffer holding the topic filter.
+ */
+#define LENT_PAYLOAD_TOPIC_MAX_SIZE   ( 160U )
+
+/**
+ * @brief Size of the publish ring of the publisher task, a power of two.
+ */
+#define PUBLISH_RING_SIZE             512
+
+/**
+ * @brief Topic the publisher task publishes on, formatted with the thing name.
+ */
+#define PUBLISH_TOPIC_FORMAT          "$aws/things/%.*s/restricted/telemetry"
+
+/**
+ * @brief Interval between the publishes of the publisher task.
+ */
+#define PUBLISH_INTERVAL_MS           ( 5000U )
+
 /*
  * @brief Macro to override printf funtion to run it in privileged mode.
  * NXP PRINTF code resides somewhere in RAM that could be provided as accessible region, but it's simpler to
@@ -133,6 +191,25 @@ static void prvRWAccessTask( void * pvParameters );
  */
 static void prvROAccessTask( void * pvParameters );
 
+/**
+ * @brief The payload task.
+ * Task waits for a payload lent by the MQTT agent, reads it in place and returns the buffer. It has no access to the
+ * buffer while no payload is lent.
+ *
+ * @param[in] pvParameters The queue returning the buffer. The task cannot read xLentPayloadReturnQueue, which is not
+ * in its regions.
+ */
+static void prvLentPayloadTask( void * pvParameters );
+
+/**
+ * @brief The publisher task.
+ * Task writes a counter into its publish ring at a fixed interval. The MQTT agent sends the records, the task never
+ * touches the agent memory.
+ *
+ * @param[in] pvParameters The publish ring of the task.
+ */
+static void prvPublisherTask( void * pvParameters );
+
 /**
  * @brief Memory regions used by the linker script.
  */
@@ -171,6 +248,58 @@ static volatile uint8_t ucROTaskFaultTracker[ MIN_REGION_SIZE ] __attribute__( (
  */
 static StackType_t xROAccessTaskStack[ RESTRICTED_TASK_STACK_SIZE ] __attribute__( ( aligned( RESTRICTED_TASK_STACK_SIZE * sizeof( StackType_t ) ) ) );
 
+/**
+ * @brief Statically allocated stack for the payload task.
+ */
+static StackType_t xLentPayloadTaskStack[ RESTRICTED_TASK_STACK_SIZE ] __attribute__( ( aligned( RESTRICTED_TASK_STACK_SIZE * sizeof( StackType_t ) ) ) );
+
+/**
+ * @brief Buffer the MQTT agent copies the payloads into and lends to the payload task.
+ */
+static uint8_t ucLentPayload[ LENT_PAYLOAD_SIZE ] mpulendingBUFFER_ALIGN( LENT_PAYLOAD_SIZE );
+
+/**
+ * @brief Handle of the payload task, the borrower of ucLentPayload.
+ */
+static TaskHandle_t xLentPayloadTask = NULL;
+
+/**
+ * @brief Queue the payload task returns the buffer through, holding the length it read.
+ */
+static QueueHandle_t xLentPayloadReturnQueue = NULL;
+
+/**
+ * @brief Payloads dropped because the previous one was still lent.
+ */
+static uint32_t ulLentPayloadsDropped = 0;
+
+/**
+ * @brief Statically allocated stack for the publisher task.
+ */
+static StackType_t xPublisherTaskStack[ RESTRICTED_TASK_STACK_SIZE ] __attribute__( ( aligned( RESTRICTED_TASK_STACK_SIZE * sizeof( StackType_t ) ) ) );
+
+/**
+ * @brief Publish ring of the publisher task, covered by one of its MPU regions.
+ */
+static uint8_t ucPublishRing[ PUBLISH_RING_SIZE ] __attribute__( ( aligned( PUBLISH_RING_SIZE ) ) );
+
+/**
+ * @brief Topic of the publisher task, set once the thing name is known.
+ */
+static char cPublishTopic[ LENT_PAYLOAD_TOPIC_MAX_SIZE ];
+static PublishRingTopic_t xPublishTopic;
+
+/**
+ * @brief Set once the publish ring is formatted, the publisher task is only created then.
+ */
+static BaseType_t xPublishRingReady = pdFALSE;
+
+/**
+ * @brief Topic filter and subscription, sent again when the session is not resumed.
+ */
+static char cLentPayloadTopic[ LENT_PAYLOAD_TOPIC_MAX_SIZE ];
+static ConnectionSubscription_t xLentPayloadSubscription;
+
 /* ------------------------------------------------------------------------------- */
 
 void printRegions( void )
@@ -253,6 +382,157 @@ static void prvROAccessTask( void * pvParameters )
     }
 }
 
+static void prvLentPayloadTask( void * pvParameters )
+{
+    QueueHandle_t xReturnQueue = ( QueueHandle_t ) pvParameters;
+    uint32_t ulLength;
+    uint32_t ulSum;
+    uint32_t i;
+
+    for( ; ; )
+    {
+        /* The notification value is the length of the payload lent. */
+        ulLength = ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        /* Read in place, the buffer is only reachable while it is lent. */
+        ulSum = 0;
+
+        for( i = 0; i < ulLength; i++ )
+        {
+            ulSum += ucLentPayload[ i ];
+        }
+
+        MPU_PRINTF( "Restricted task read a %u byte payload, sum %u.\r\n", ( unsigned int ) ulLength, ( unsigned int ) ulSum );
+
+        ( void ) xQueueSend( xReturnQueue, &ulLength, portMAX_DELAY );
+    }
+}
+
+/* ------------------------------------------------------------------------------- */
+
+static void prvPublisherTask( void * pvParameters )
+{
+    uint8_t * pucRing = ( uint8_t * ) pvParameters;
+    char cPayload[ 24 ] = "{\"count\":";
+    char cDigits[ 10 ];
+    uint32_t ulCount = 0;
+    uint32_t ulValue;
+    size_t xLength;
+    size_t xDigits;
+
+    for( ; ; )
+    {
+        vTaskDelay( pdMS_TO_TICKS( PUBLISH_INTERVAL_MS ) );
+        ulCount++;
+
+        /* Formatted by hand, the C library state is out of the regions of the task. */
+        xLength = strlen( "{\"count\":" );
+        xDigits = 0;
+        ulValue = ulCount;
+
+        do
+        {
+            cDigits[ xDigits++ ] = ( char ) ( '0' + ( ulValue % 10U ) );
+            ulValue /= 10U;
+        } while( ulValue > 0U );
+
+        while( xDigits > 0U )
+        {
+            cPayload[ xLength++ ] = cDigits[ --xDigits ];
+        }
+
+        cPayload[ xLength++ ] = '}';
+
+        /* A full ring counts the publish as dropped in the ring header. */
+        ( void ) PublishRing_Write( pucRing, 0, cPayload, ( uint16_t ) xLength );
+    }
+}
+
+/* ------------------------------------------------------------------------------- */
+
+/**
+ * @brief Called from the MQTT agent task for the payloads on the restricted topic. Revokes the buffer if the payload
+ * task returned it, then fills and lends it again. Never blocks.
+ */
+static void prvLentPayloadCallback( void * pCallbackContext,
+                                    MQTTPublishInfo_t * pPublishInfo )
+{
+    uint32_t ulReturned;
+    uint32_t ulLength;
+
+    ( void ) pCallbackContext;
+
+    if( xQueueReceive( xLentPayloadReturnQueue, &ulReturned, 0 ) == pdTRUE )
+    {
+        ( void ) MpuLending_Revoke( xLentPayloadTask );
+    }
+
+    if( MpuLending_GetLent( xLentPayloadTask ) != NULL )
+    {
+        ulLentPayloadsDropped++;
+        PRINTF( "Restricted payload dropped, %u dropped so far.\r\n", ( unsigned int ) ulLentPayloadsDropped );
+        return;
+    }
+
+    ulLength = ( pPublishInfo->payloadLength < LENT_PAYLOAD_SIZE ) ? ( uint32_t ) pPublishInfo->payloadLength : LENT_PAYLOAD_SIZE;
+
+    /* A notification value of 0 would not wake the payload task. */
+    if( ulLength == 0U )
+    {
+        return;
+    }
+
+    memcpy( ucLentPayload, pPublishInfo->pPayload, ulLength );
+
+    if( MpuLending_Grant( xLentPayloadTask, ucLentPayload, LENT_PAYLOAD_SIZE, pdFALSE ) == pdTRUE )
+    {
+        ( void ) xTaskNotify( xLentPayloadTask, ulLength, eSetValueWithOverwrite );
+    }
+}
+
+/* ------------------------------------------------------------------------------- */
+
+BaseType_t xRestrictedTasksSubscribe( const char * pcThingName,
+                                      uint32_t ulThingNameLength )
+{
+    int lLength;
+
+    if( xPublishRingReady == pdTRUE )
+    {
+        lLength = snprintf( cPublishTopic, sizeof( cPublishTopic ), PUBLISH_TOPIC_FORMAT,
+                            ( int ) ulThingNameLength, pcThingName );
+
+        if( ( lLength > 0 ) && ( ( size_t ) lLength < sizeof( cPublishTopic ) ) )
+        {
+            xPublishTopic.pcTopic = cPublishTopic;
+            xPublishTopic.usTopicLength = ( uint16_t ) lLength;
+
+            if( PublishRing_Attach( ucPublishRing, &xPublishTopic, 1 ) != pdTRUE )
+            {
+                PRINTF( "Restricted publish ring not attached.\r\n" );
+            }
+        }
+    }
+
+    if( ( xLentPayloadTask == NULL ) || ( xLentPayloadReturnQueue == NULL ) )
+    {
+        return pdFALSE;
+    }
+
+    lLength = snprintf( cLentPayloadTopic, sizeof( cLentPayloadTopic ), LENT_PAYLOAD_TOPIC_FORMAT,
+                        ( int ) ulThingNameLength, pcThingName );
+
+    if( ( lLength <= 0 ) || ( ( size_t ) lLength >= sizeof( cLentPayloadTopic ) ) )
+    {
+        return pdFALSE;
+    }
+
+    return ConnectionManager_Subscribe( &xLentPayloadSubscription, cLentPayloadTopic, ( uint16_t ) lLength, MQTTQoS0,
+                                        prvLentPayloadCallback, NULL, NULL );
+}
+
+/* ------------------------------------------------------------------------------- */
+
 void xCreateRestrictedTasks( BaseType_t xPriority )
 {
     /* Create restricted tasks */
@@ -291,6 +571,61 @@ void xCreateRestrictedTasks( BaseType_t xPriority )
         }
     };
     xTaskCreateRestricted( &( xROAccessTaskParameters ), NULL );
+
+    xLentPayloadReturnQueue = xQueueCreate( 1, sizeof( uint32_t ) );
+
+    /* The payload task starts without access to any buffer, its regions are
+     * left unused for the lent buffer. */
+    TaskParameters_t xLentPayloadTaskParameters =
+    {
+        .pvTaskCode     = prvLentPayloadTask,
+        .pcName         = "LentPayload",
+        .usStackDepth   = RESTRICTED_TASK_STACK_SIZE,
+        .pvParameters   = ( void * ) xLentPayloadReturnQueue,
+        .uxPriority     = xPriority,
+        .puxStackBuffer = xLentPayloadTaskStack,
+        .xRegions       =
+        {
+            { 0, 0, 0 },
+            { 0, 0, 0 },
+            { 0, 0, 0 },
+        }
+    };
+
+    if( ( xLentPayloadReturnQueue == NULL ) ||
+        ( xTaskCreateRestricted( &( xLentPayloadTaskParameters ), &xLentPayloadTask ) != pdPASS ) ||
+        ( MpuLending_RegisterTask( xLentPayloadTask, xLentPayloadTaskParameters.xRegions ) != pdTRUE ) )
+    {
+        PRINTF( "Restricted payload task creation failed.\r\n" );
+        xLentPayloadTask = NULL;
+    }
+
+    /* The publisher task only reaches its ring, formatted before it runs. */
+    TaskParameters_t xPublisherTaskParameters =
+    {
+        .pvTaskCode     = prvPublisherTask,
+        .pcName         = "Publisher",
+        .usStackDepth   = RESTRICTED_TASK_STACK_SIZE,
+        .pvParameters   = ( void * ) ucPublishRing,
+        .uxPriority     = xPriority,
+        .puxStackBuffer = xPublisherTaskStack,
+        .xRegions       =
+        {
+            { ucPublishRing, PUBLISH_RING_SIZE, portMPU_REGION_READ_WRITE | portMPU_REGION_EXECUTE_NEVER },
+            { 0,             0,                 0                                                        },
+            { 0,             0,                 0                                                        },
+        }
+    };
+
+    if( ( PublishRing_Init( ucPublishRing, PUBLISH_RING_SIZE ) != pdTRUE ) ||
+        ( xTaskCreateRestricted( &( xPublisherTaskParameters ), NULL ) != pdPASS ) )
+    {
+        PRINTF( "Restricted publisher task creation failed.\r\n" );
+    }
+    else
+    {
+        xPublishRingReady = pdTRUE;
+    }
 }
 
 
@@ -300,9 +635,10 @@ void xCreateRestrictedTasks( BaseType_t xPriority )
  * @brief The hard fault handler defined by the demo.
  * Function takes in hardfaulted stack address, finds out the next instructions to skip to,
  * resets the shared flag to zero for read-only task and then skips the stack pointer to the next
- * instruction to be executed.
+ * instruction to be executed. Any other fault is recorded by the crash report and resets the device.
  */
-portDONT_DISCARD void vHandleMemoryFault( uint32_t * pulFaultStackAddress )
+portDONT_DISCARD void vHandleMemoryFault( uint32_t * pulFaultStackAddress,
+                                          uint32_t ulExcReturn )
 {
     uint32_t ulPC;
     uint16_t usOffendingInstruction;
@@ -353,10 +689,6 @@ portDONT_DISCARD void vHandleMemoryFault( uint32_t * pulFaultStackAddress )
     }
     else
     {
-        PRINTF( "Memory Access Violation. Inst @ %x\r\n", ulPC );
-
-        while( 1 )
-        {
-        }
+        CrashReport_Reset( CRASH_FAULT_MEMMANAGE, pulFaultStackAddress, ulExcReturn );
     }
 }
@@ -32,6 +32,10 @@
 #ifndef USER_DEMO_RESTRICTIONS_H_
 #define USER_DEMO_RESTRICTIONS_H_
 
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
 /**
  * @brief Demo function to create restricted tasks given priority.
  * Function creates a read-only task and read-write task to demonstrate the MPU
@@ -41,4 +45,17 @@
  */
 void xCreateRestrictedTasks( BaseType_t xPriority );
 
+/**
+ * @brief Subscribes to the topic whose payloads are lent to the restricted payload task, and
+ * subscribes again whenever the session is not resumed. Also attaches the publish ring of the
+ * restricted publisher task to the agent. Must be called once the MQTT agent runs.
+ *
+ * @param[in] pcThingName The thing name, used in the topic.
+ * @param[in] ulThingNameLength Length of the thing name.
+ *
+ * @return pdTRUE if the subscription is registered and the subscribe operation queued.
+ */
+BaseType_t xRestrictedTasksSubscribe( const char * pcThingName,
+                                      uint32_t ulThingNameLength );
+
 #endif /* USER_DEMO_RESTRICTIONS_H_ */
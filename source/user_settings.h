@@ -0,0 +1,145 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file user_settings.h
+ * @brief Configures wolfSSL for the TLS transport of tls_freertos_wolfssl.c, included by
+ * wolfssl/wolfcrypt/settings.h when WOLFSSL_USER_SETTINGS is defined.
+ *
+ * Experimental: no build configuration compiles wolfSSL, which takes WOLFSSL_USER_SETTINGS,
+ * lib/wolfssl and tlsconfigUSE_WOLFSSL set to 1, and this configuration has not been built
+ * against lib/wolfssl. The features follow aws_mbedtls_config.h, so that the two back ends negotiate the
+ * same handshakes with the servers: TLS 1.2 client only, ECDHE-RSA and ECDHE-ECDSA with
+ * AES-GCM on P-256, the SNI, ALPN, maximum fragment length, session ticket and extended master
+ * secret extensions, and no check of the certificate validity dates, as mbed TLS is built
+ * without MBEDTLS_HAVE_TIME.
+ */
+
+#ifndef USER_SETTINGS_H
+#define USER_SETTINGS_H
+
+/* FreeRTOS include. */
+#include "FreeRTOS.h"
+
+/* FreeRTOS mutexes and tick count. FREERTOS_TCP is left out: it selects the insecure
+ * WOLFSSL_GENSEED_FORTEST seed, the transport gives its own I/O callbacks instead. */
+#define FREERTOS
+#define WOLFSSL_USER_IO
+#define NO_WRITEV
+#define NO_FILESYSTEM
+#define NO_WOLFSSL_DIR
+#define NO_MAIN_DRIVER
+
+/* TLS 1.2 client only. */
+#define NO_WOLFSSL_SERVER
+#define NO_OLD_TLS
+#define WOLFSSL_NO_TLS13
+
+/* The device key stays in PKCS #11, the transport signs the certificate verify in the
+ * callbacks of wolfSSL_CTX_SetEccSignCb() and wolfSSL_CTX_SetRsaSignCb(). */
+#define HAVE_PK_CALLBACKS
+
+/* TLS extensions offered by the mbed TLS transport. */
+#define HAVE_TLS_EXTENSIONS
+#define HAVE_SNI
+#define HAVE_ALPN
+#define HAVE_MAX_FRAGMENT
+#define HAVE_SUPPORTED_CURVES
+#define HAVE_EXTENDED_MASTER
+#define HAVE_ENCRYPT_THEN_MAC
+#define HAVE_SESSION_TICKET
+
+/* Small internal session cache, the transport keeps its own copy of the session of each server,
+ * see tlsconfigSESSION_CACHE_ENTRIES. */
+#define SMALL_SESSION_CACHE
+
+/* Ciphers: AES-GCM and the CBC suites of ECDHE-PSK, SHA-256 and SHA-1 for the certificates,
+ * and P-256 only, as MBEDTLS_ECP_DP_SECP256R1_ENABLED. */
+#define HAVE_AESGCM
+#define GCM_TABLE_4BIT
+#define HAVE_ECC
+#define ECC_TIMING_RESISTANT
+#define ECC_USER_CURVES
+#define WC_RSA_BLINDING
+#define NO_RC4
+#define NO_MD4
+#define NO_DES3
+#define NO_DSA
+#define NO_DH
+#define NO_HC128
+#define NO_RABBIT
+#define NO_PWDBASED
+#define NO_SHA512
+
+/* The certificate validity is not checked, there is no calendar time before the time sync. */
+#define NO_ASN_TIME
+
+/* Big number code for the P-256 and RSA-2048 operations of the handshake.
+ * 1 uses the single precision code of wolfSSL, fixed to P-256 and RSA-2048 with the
+ * Cortex-M assembly, the counterpart of mbedtlsconfigP256_M4. Servers with other key sizes
+ * then fail the handshake. If the compiler refuses the assembly because r7 holds the frame
+ * pointer of the Debug build, as it does for bn_mul.h of mbed TLS, set 0.
+ * 0 uses the generic fast math code, for any key up to 4096 bits.
+ * Compare the tls_handshake records of the benchmark with both values. */
+#ifndef wolfsslconfigSP_MATH
+    #define wolfsslconfigSP_MATH    1
+#endif
+
+#if ( wolfsslconfigSP_MATH == 1 )
+    #define WOLFSSL_SP_MATH
+    #define WOLFSSL_HAVE_SP_RSA
+    #define WOLFSSL_HAVE_SP_ECC
+    #define WOLFSSL_SP_NO_3072
+    #define WOLFSSL_SP_ARM_CORTEX_M_ASM
+#else
+    #define USE_FAST_MATH
+    #define TFM_TIMING_RESISTANT
+    #define FP_MAX_BITS    8192
+#endif
+
+/* 1 adds the PSK and ECDHE-PSK suites, the counterpart of mbedtlsconfigTLS_PSK in
+ * aws_mbedtls_config.h, see democonfigTLS_PSK in main.c. */
+#ifndef wolfsslconfigTLS_PSK
+    #define wolfsslconfigTLS_PSK    0
+#endif
+
+#if ( wolfsslconfigTLS_PSK == 0 )
+    #define NO_PSK
+#endif
+
+/* The task stacks are sized for mbed TLS, the large temporaries of wolfSSL are allocated. */
+#define WOLFSSL_SMALL_STACK
+
+/* Allocations go to the mbed TLS pool, see XMALLOC() in tls_freertos_wolfssl.c, so that the
+ * pool statistics of the benchmark count both back ends alike. */
+#define XMALLOC_USER
+
+/* Random bytes of the entropy pool, the DRBG shared with mbed TLS and the IP stack. */
+int wolfssl_platform_random_block( unsigned char * output,
+                                   unsigned int sz );
+#define CUSTOM_RAND_GENERATE_BLOCK    wolfssl_platform_random_block
+#define NO_DEV_RANDOM
+
+#endif /* USER_SETTINGS_H */
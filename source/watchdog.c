@@ -0,0 +1,245 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file watchdog.c
+ * @brief Watchdog supervisor task.
+ * The supervised tasks set their bit in a check in mask with a single exclusive store. The supervisor task
+ * wakes up periodically and feeds the WWDT only when every registered task has checked in since the
+ * previous feed, so a stuck task resets the device within watchdogFEED_TIMEOUT_MS.
+ */
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "fsl_debug_console.h"
+
+/* CMSIS core include, for the exclusive access intrinsics. */
+#include "fsl_device_registers.h"
+
+#include "mflash_drv.h"
+#include "spifi_boot.h"
+
+#include "watchdog.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief WWDT timeout, longer than the longest interval between two check ins of any supervised task.
+ * The IP task and the MQTT agent block for up to 10 s when idle.
+ */
+#ifndef watchdogFEED_TIMEOUT_MS
+    #define watchdogFEED_TIMEOUT_MS    ( 15000U )
+#endif
+
+/**
+ * @brief Interval at which the supervisor checks the check in mask.
+ */
+#ifndef watchdogCHECK_PERIOD_MS
+    #define watchdogCHECK_PERIOD_MS    ( 1000U )
+#endif
+
+/**
+ * @brief Priority of the supervisor task, above the supervised tasks so a busy task cannot delay the feed.
+ */
+#ifndef watchdogTASK_PRIORITY
+    #define watchdogTASK_PRIORITY      ( configMAX_PRIORITIES - 1 )
+#endif
+
+/**
+ * @brief Stack size of the supervisor task, in words.
+ */
+#ifndef watchdogTASK_STACK_SIZE
+    #define watchdogTASK_STACK_SIZE    ( configMINIMAL_STACK_SIZE * 2 )
+#endif
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Mask of the registered tasks.
+ */
+static volatile uint32_t ulRegisteredMask = 0;
+
+/**
+ * @brief Mask of the tasks which checked in since the last feed.
+ */
+static volatile uint32_t ulCheckInMask = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Atomically sets bits of a mask, usable from any task without a critical section.
+ */
+static void prvSetBits( volatile uint32_t * pulMask,
+                        uint32_t ulBits )
+{
+    uint32_t ulValue;
+
+    do
+    {
+        ulValue = __LDREXW( pulMask ) | ulBits;
+    } while( __STREXW( ulValue, pulMask ) != 0U );
+}
+
+/**
+ * @brief Atomically clears bits of a mask.
+ */
+static void prvClearBits( volatile uint32_t * pulMask,
+                          uint32_t ulBits )
+{
+    uint32_t ulValue;
+
+    do
+    {
+        ulValue = __LDREXW( pulMask ) & ~ulBits;
+    } while( __STREXW( ulValue, pulMask ) != 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Checks whether the running image still waits to be committed, in which case the bootloader
+ * armed the watchdog to roll back an image which does not commit in time.
+ */
+static bool prvIsPendingCommit( void )
+{
+    struct boot_ucb ucb;
+
+    boot_ucb_read( &ucb );
+
+    return ucb.state == BOOT_STATE_PENDING_COMMIT;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWatchdogTask( void * pvParameters )
+{
+    TickType_t xLastWakeTime;
+    uint32_t ulRegistered;
+
+    ( void ) pvParameters;
+
+    /* Feeding the watchdog of a pending commit would defeat the rollback. */
+    while( prvIsPendingCommit() )
+    {
+        vTaskDelay( pdMS_TO_TICKS( watchdogCHECK_PERIOD_MS ) );
+    }
+
+    boot_wdtinit( watchdogFEED_TIMEOUT_MS );
+    PRINTF( "Watchdog armed, timeout %u ms.\r\n", ( unsigned ) watchdogFEED_TIMEOUT_MS );
+
+    /* Check on multiples of the period, the wake ups aligned by Watchdog_AlignWakeup() coincide. */
+    xLastWakeTime = xTaskGetTickCount();
+    xLastWakeTime -= xLastWakeTime % pdMS_TO_TICKS( watchdogCHECK_PERIOD_MS );
+
+    for( ; ; )
+    {
+        vTaskDelayUntil( &xLastWakeTime, pdMS_TO_TICKS( watchdogCHECK_PERIOD_MS ) );
+
+        ulRegistered = ulRegisteredMask;
+
+        if( ( ulCheckInMask & ulRegistered ) == ulRegistered )
+        {
+            /* Only clear the bits consumed by this feed. */
+            prvClearBits( &ulCheckInMask, ulRegistered );
+
+            boot_wdtfeed();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t Watchdog_Init( void )
+{
+    BaseType_t result;
+
+    result = xTaskCreate( prvWatchdogTask,
+                          "Watchdog_task",
+                          watchdogTASK_STACK_SIZE,
+                          NULL,
+                          watchdogTASK_PRIORITY | portPRIVILEGE_BIT,
+                          NULL );
+
+    if( result != pdPASS )
+    {
+        PRINTF( "Failed to create watchdog task.\r\n" );
+    }
+
+    return ( result == pdPASS ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void Watchdog_Register( WatchdogClient_t client )
+{
+    configASSERT( client < WATCHDOG_CLIENT_COUNT );
+
+    /* The first feed after registering does not wait for the new task to check in. */
+    prvSetBits( &ulCheckInMask, 1UL << client );
+    prvSetBits( &ulRegisteredMask, 1UL << client );
+}
+
+/*-----------------------------------------------------------*/
+
+void Watchdog_Unregister( WatchdogClient_t client )
+{
+    configASSERT( client < WATCHDOG_CLIENT_COUNT );
+
+    prvClearBits( &ulRegisteredMask, 1UL << client );
+}
+
+/*-----------------------------------------------------------*/
+
+void Watchdog_CheckIn( WatchdogClient_t client )
+{
+    prvSetBits( &ulCheckInMask, 1UL << client );
+}
+
+/*-----------------------------------------------------------*/
+
+TickType_t Watchdog_AlignWakeup( TickType_t xTicksToWait )
+{
+    const TickType_t xPeriod = pdMS_TO_TICKS( watchdogCHECK_PERIOD_MS );
+    TickType_t xWakeTime;
+    TickType_t xNow;
+
+    if( xTicksToWait != portMAX_DELAY )
+    {
+        xNow = xTaskGetTickCount();
+        xWakeTime = xNow + xTicksToWait;
+        xWakeTime -= xWakeTime % xPeriod;
+
+        /* Only when a check falls within the wait. */
+        if( ( TickType_t ) ( xWakeTime - xNow ) - 1U < xTicksToWait )
+        {
+            xTicksToWait = xWakeTime - xNow;
+        }
+    }
+
+    return xTicksToWait;
+}
@@ -0,0 +1,95 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file watchdog.h
+ * @brief Watchdog supervisor feeding the WWDT only while all registered tasks check in.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Tasks supervised by the watchdog.
+ * A client is only supervised once registered, so tasks started late do not block the feed before they run.
+ */
+typedef enum WatchdogClient
+{
+    WATCHDOG_CLIENT_IP_TASK = 0,    /**< FreeRTOS+TCP IP task, checks in through ipconfigWATCHDOG_TIMER(). */
+    WATCHDOG_CLIENT_MQTT_AGENT,     /**< MQTT agent task. */
+    WATCHDOG_CLIENT_MQTT_AGENT_OTA, /**< MQTT agent task of the dedicated OTA connection, must follow WATCHDOG_CLIENT_MQTT_AGENT. */
+    WATCHDOG_CLIENT_OTA_AGENT,      /**< OTA agent task. */
+    WATCHDOG_CLIENT_COUNT
+} WatchdogClient_t;
+
+/**
+ * @brief Creates the supervisor task.
+ * The WWDT is armed once the running image is committed, until then the watchdog armed by the
+ * bootloader for the pending commit is left alone.
+ *
+ * @return pdTRUE if the task is created.
+ */
+BaseType_t Watchdog_Init( void );
+
+/**
+ * @brief Adds a task to the set of tasks required to check in before each feed of the WWDT.
+ *
+ * @param[in] client The task to supervise.
+ */
+void Watchdog_Register( WatchdogClient_t client );
+
+/**
+ * @brief Removes a task from the supervised set, for a task about to block longer than the
+ * watchdog timeout on purpose.
+ *
+ * @param[in] client The task to stop supervising.
+ */
+void Watchdog_Unregister( WatchdogClient_t client );
+
+/**
+ * @brief Records that a supervised task is alive. Cheap enough to be called from every iteration of
+ * the task loop, the task must check in at least once per watchdogFEED_TIMEOUT_MS.
+ *
+ * @param[in] client The task checking in.
+ */
+void Watchdog_CheckIn( WatchdogClient_t client );
+
+/**
+ * @brief Shortens a wait so that it ends on a check of the supervisor, which wakes up every
+ * watchdogCHECK_PERIOD_MS on multiples of that period. Tasks waking up periodically then share
+ * the wake ups of the supervisor instead of adding their own.
+ *
+ * @param[in] xTicksToWait The longest acceptable wait.
+ *
+ * @return The wait ending on the last check before the deadline, or xTicksToWait when no check
+ * falls before it or for portMAX_DELAY.
+ */
+TickType_t Watchdog_AlignWakeup( TickType_t xTicksToWait );
+
+#endif /* ifndef WATCHDOG_H */
@@ -0,0 +1,236 @@
+import argparse
+import os
+import re
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+DEFAULT_LINKER_SCRIPT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "source", "Demo.ld")
+DEFAULT_OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "source", "fastcode.ld")
+
+# Sections holding the code that can be moved: the code executing in place from the SPIFI flash and
+# the code already moved by an earlier run, so that a profile of a tuned image keeps its placement.
+CANDIDATE_SECTIONS = (".text", ".fastcode")
+
+# Functions run by the restricted tasks of source/user/demo-restrictions.c. The MPU regions of a
+# restricted task cover the flash but not SRAMX, so these must keep executing in place.
+RESTRICTED_FUNCTIONS = [
+    "prvRWAccessTask",
+    "prvROAccessTask",
+    "prvLentPayloadTask",
+    "prvPublisherTask",
+    "PublishRing_Write",
+    "memcpy",
+    "memset",
+    "strlen",
+]
+
+
+class FastcodeError(Exception):
+    pass
+
+
+def region_length(linker_script, region):
+    """
+    Read the length of a memory region from the MEMORY block of the linker script.
+    """
+    with open(linker_script) as script:
+        match = re.search(rf"^\s*{region}\s*\([a-z]*\)\s*:.*LENGTH\s*=\s*(0x[0-9a-fA-F]+|\d+)", script.read(), re.M)
+    if match is None:
+        raise FastcodeError(f"No {region} region in {linker_script}.")
+    return int(match.group(1), 0)
+
+
+def load_functions(path):
+    """
+    Read the functions of the firmware ELF file.
+    Returns the list of (address, size, name, section name) sorted by address.
+    """
+    functions = []
+
+    with open(path, "rb") as elf_file:
+        elf = ELFFile(elf_file)
+        symbols = elf.get_section_by_name(".symtab")
+        if symbols is None:
+            raise FastcodeError(f"{path} has no symbol table.")
+
+        # The system calls are linked at the start of .text but must stay in their own range.
+        syscalls = [symbols.get_symbol_by_name(name) for name in ("__syscalls_flash_start__", "__syscalls_flash_end__")]
+        syscalls = [symbol[0]["st_value"] for symbol in syscalls if symbol] if all(syscalls) else [0, 0]
+
+        sections = [elf.get_section(i) for i in range(elf.num_sections())]
+        for symbol in symbols.iter_symbols():
+            if symbol["st_info"]["type"] != "STT_FUNC" or symbol["st_size"] == 0:
+                continue
+            if not isinstance(symbol["st_shndx"], int):
+                continue
+            address = symbol["st_value"] & ~1
+            section = sections[symbol["st_shndx"]].name
+            if syscalls[0] <= address < syscalls[1]:
+                section = "freertos_system_calls"
+            functions.append((address, symbol["st_size"], symbol.name, section))
+
+    return sorted(functions)
+
+
+def load_samples(paths, functions):
+    """
+    Read the profile, one sample per line: a program counter value or a function name, optionally
+    followed by a count, such as the PC samples recorded over SWO. Lines starting with # are skipped.
+    Returns the number of samples per function name.
+    """
+    addresses = [function[0] for function in functions]
+    names = {function[2] for function in functions}
+    samples = {}
+    unknown = 0
+
+    for path in paths:
+        with open(path) as sample_file:
+            for line in sample_file:
+                fields = line.replace(",", " ").split()
+                if not fields or fields[0].startswith("#"):
+                    continue
+                count = int(fields[1]) if len(fields) > 1 else 1
+
+                name = fields[0] if fields[0] in names else None
+                if name is None:
+                    try:
+                        pc = int(fields[0], 16) & ~1
+                    except ValueError:
+                        unknown += count
+                        continue
+                    name = function_at(functions, addresses, pc)
+                if name is None:
+                    unknown += count
+                    continue
+                samples[name] = samples.get(name, 0) + count
+
+    return samples, unknown
+
+
+def function_at(functions, addresses, pc):
+    low, high = 0, len(addresses)
+    while low < high:
+        middle = (low + high) // 2
+        if addresses[middle] <= pc:
+            low = middle + 1
+        else:
+            high = middle
+    if low == 0:
+        return None
+    address, size, name, _ = functions[low - 1]
+    return name if pc < address + size else None
+
+
+def select(functions, samples, budget, min_samples, excluded):
+    """
+    Pick the movable functions with the most samples per byte until the budget is used.
+    Static functions sharing a name are all matched by the same pattern, so their sizes add up.
+    Returns the selected (name, samples, size) and the sampled functions that are not movable.
+    """
+    sizes = {}
+    fixed = set()
+    for _, size, name, section in functions:
+        if section in CANDIDATE_SECTIONS:
+            sizes[name] = sizes.get(name, 0) + (size + 3) // 4 * 4
+        else:
+            fixed.add(name)
+
+    candidates = [
+        (name, count, sizes[name])
+        for name, count in samples.items()
+        if name in sizes and name not in fixed and name not in excluded and count >= min_samples
+    ]
+    candidates.sort(key=lambda candidate: (-candidate[1] / candidate[2], candidate[0]))
+
+    selected = []
+    used = 0
+    for name, count, size in candidates:
+        if used + size <= budget:
+            selected.append((name, count, size))
+            used += size
+
+    not_movable = sorted((name for name in samples if name not in sizes or name in fixed), key=lambda name: -samples[name])
+    return selected, not_movable
+
+
+def write_list(path, selected, total_samples, budget):
+    used = sum(size for _, _, size in selected)
+    covered = sum(count for _, count, _ in selected)
+
+    with open(path, "w") as output:
+        output.write("/*\n")
+        output.write(" * Hot functions placed in SRAMX_FASTCODE, generated by tools/fastcode.py.\n")
+        output.write(f" * {len(selected)} functions, {used} of {budget} bytes, ")
+        output.write(f"{covered} of {total_samples} samples.\n")
+        output.write(" */\n")
+        for name, count, size in sorted(selected, key=lambda function: -function[1]):
+            output.write(f"*(.text.{name}) /* {count} samples, {size} bytes */\n")
+
+
+def main(args):
+    functions = load_functions(args.elf)
+    samples, unknown = load_samples(args.samples, functions)
+    total_samples = sum(samples.values()) + unknown
+    if total_samples == 0:
+        raise FastcodeError("The profile holds no samples.")
+
+    budget = args.budget
+    if budget is None:
+        budget = region_length(args.linker_script, "SRAMX_FASTCODE") - args.reserve
+
+    selected, not_movable = select(functions, samples, budget, args.min_samples, set(args.exclude))
+
+    print(f"{total_samples} samples, {unknown} outside of any function.")
+    print(f"{'function':40} {'samples':>8} {'bytes':>6}")
+    for name, count, size in sorted(selected, key=lambda function: -function[1]):
+        print(f"{name:40} {count:>8} {size:>6}")
+    for name in not_movable[:10]:
+        print(f"{name:40} {samples[name]:>8}  not movable, privileged or already in RAM")
+
+    write_list(args.output, selected, total_samples, budget)
+    print(f"{len(selected)} functions written to {args.output}, rebuild the image to place them.")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="""
+        Generates the list of hot functions linked into SRAMX_FASTCODE from a profile of the
+        running firmware and the ELF file the profile was taken on.
+        """
+    )
+    parser.add_argument("--elf", help="ELF file of the profiled firmware.", required=True)
+    parser.add_argument(
+        "--samples",
+        nargs="+",
+        help="Profile files, one program counter or function name per line, optionally followed by a count.",
+        required=True,
+    )
+    parser.add_argument("--output", default=DEFAULT_OUTPUT, help="Generated list, default source/fastcode.ld.")
+    parser.add_argument(
+        "--linker-script",
+        default=DEFAULT_LINKER_SCRIPT,
+        help="Linker script holding the SRAMX_FASTCODE region, default source/Demo.ld.",
+    )
+    parser.add_argument("--budget", type=int, help="Bytes of code to place, default the size of SRAMX_FASTCODE.")
+    parser.add_argument(
+        "--reserve",
+        type=int,
+        default=0,
+        help="Bytes of SRAMX_FASTCODE kept for the functions placed in a .fastcode section in the code.",
+    )
+    parser.add_argument("--min-samples", type=int, default=2, help="Samples a function needs to be placed.")
+    parser.add_argument(
+        "--exclude",
+        nargs="*",
+        default=RESTRICTED_FUNCTIONS,
+        help="Functions never placed, default the functions run by the restricted tasks.",
+    )
+    args = parser.parse_args()
+
+    try:
+        sys.exit(main(args))
+    except (FastcodeError, OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
@@ -0,0 +1,147 @@
+# Copyright 2019 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+# Licensed under the Apache License, Version 2.0 (the "License").
+# You may not use this file except in compliance with the License.
+# A copy of the License is located at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# or in the "license" file accompanying this file. This file is distributed 
+# on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either 
+# express or implied. See the License for the specific language governing 
+# permissions and limitations under the License.
+#
+# Binary Log Decoder
+# Turns the binary log records of a LOG_BINARY_ENABLE build back into text.
+# Important Note: Requires Python 3
+
+import re
+import sys, argparse
+import serial
+from elftools.elf.elffile import ELFFile
+import mbedtls_error_decode
+
+RECORD_MARKER = 0xFE
+CONVERSION = re.compile(r'%([-+ #0]*)(\*|\d*)(?:\.(\*|\d*))?(?:hh|h|ll|l)?([diouxXcspfF%])')
+
+parser = argparse.ArgumentParser(description='Script to decode the binary log')
+parser.add_argument("--elf", help="ELF file of the running firmware", required=True)
+parser.add_argument("--port", help="Serial port of the device", required=False)
+parser.add_argument("--baud", help="Baud rate of the serial port", default=115200, type=int, required=False)
+parser.add_argument("--input", help="File holding a captured log, instead of the serial port", required=False)
+parser.add_argument("--mbedtls-include", help="Directory of the mbed TLS headers, to decode the mbedTLSError codes",
+                    default=mbedtls_error_decode.MBEDTLS_INCLUDE, required=False)
+args = parser.parse_args()
+
+def load_firmware(path):
+    with open(path, 'rb') as f:
+        elf = ELFFile(f)
+        symbols = elf.get_section_by_name('.symtab')
+        log_fmt = elf.get_section_by_name('.log_fmt')
+        if log_fmt is None:
+            sys.exit("No .log_fmt section, build with LOG_BINARY_ENABLE set to 1.")
+        flash_start = symbols.get_symbol_by_name('__FLASH_segment_start__')[0]['st_value']
+        flash = {}
+        for section in elf.iter_sections():
+            if section['sh_type'] == 'SHT_PROGBITS' and section['sh_flags'] & 0x2:
+                flash[section['sh_addr']] = section.data()
+        return log_fmt['sh_addr'], log_fmt.data(), flash_start, flash
+
+fmt_start, fmt_data, flash_start, flash = load_firmware(args.elf)
+
+# The codes of a MBEDTLS_ERROR_COMPACT build are only printed as numbers without the mbed TLS headers.
+try:
+    mbedtls_errors = mbedtls_error_decode.load_table(args.mbedtls_include)
+except (OSError, ValueError) as e:
+    sys.stderr.write("mbed TLS errors not decoded: %s\n" % e)
+    mbedtls_errors = None
+
+def read_cstring(address):
+    for start, data in flash.items():
+        if start <= address < start + len(data):
+            end = data.find(b'\0', address - start)
+            return data[address - start:end].decode('ascii', 'replace')
+    return '<0x%08x>' % address
+
+class Record:
+    def __init__(self, stream):
+        self.stream = stream
+
+    def byte(self):
+        b = self.stream.read(1)
+        if not b:
+            raise EOFError
+        return b[0]
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if b < 0x80:
+                return value
+
+    def string(self):
+        offset = self.varint()
+        if offset != 0:
+            return read_cstring(flash_start + offset - 1)
+        chars = bytearray()
+        while True:
+            b = self.byte()
+            if b == 0:
+                return chars.decode('ascii', 'replace')
+            chars.append(b)
+
+def decode(record):
+    offset = record.varint()
+    end = fmt_data.find(b'\0', offset)
+    fmt = fmt_data[offset:end].decode('ascii', 'replace')
+
+    def convert(match):
+        flags, width, precision, kind = match.groups()
+        if kind == '%':
+            return '%'
+        if width == '*':
+            width = str(record.varint())
+        if precision == '*':
+            precision = str(record.varint())
+        spec = '%' + flags + width + ('.' + precision if precision is not None else '')
+        if kind == 's':
+            return (spec + 's') % record.string()
+        value = record.varint()
+        if kind in 'di':
+            return (spec + 'd') % ((value >> 1) ^ -(value & 1))
+        if kind == 'c':
+            return (spec + 'c') % chr(value & 0xFF)
+        if kind == 'p':
+            return '0x%08x' % value
+        if kind in 'fF':
+            return '<float>'
+        return (spec + ('d' if kind == 'u' else kind)) % value
+
+    text = CONVERSION.sub(convert, fmt)
+    if mbedtls_errors is not None:
+        text = mbedtls_error_decode.annotate(mbedtls_errors, text)
+    return text
+
+def main():
+    if args.input:
+        stream = open(args.input, 'rb')
+    elif args.port:
+        stream = serial.Serial(args.port, args.baud)
+    else:
+        sys.exit("Either --port or --input is required.")
+
+    # The text written before the log task starts and by the blocking print passes through unchanged.
+    record = Record(stream)
+    try:
+        while True:
+            b = record.byte()
+            if b == RECORD_MARKER:
+                sys.stdout.write(decode(record))
+            else:
+                sys.stdout.write(chr(b))
+            sys.stdout.flush()
+    except (EOFError, KeyboardInterrupt):
+        pass
+
+if __name__ == "__main__":
+    main()
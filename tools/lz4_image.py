@@ -0,0 +1,112 @@
+import argparse
+import struct
+import sys
+import zlib
+
+# Compressed update image decompressed by boot_lz4_decompress(), see struct boot_lz4_header in lib/bootloader/spifi_boot.h.
+# The header is followed by the image compressed as a single LZ4 block.
+LZ4_MARKER = 0x42345A4C  # "LZ4B"
+LZ4_HEADER = struct.Struct("<IIII")  # marker, compressed data length, image length, image CRC32
+
+BOOT_IMAGE_MARKER = 0xEDDC94BD
+BOOT_HEADER_MARKER = 0xFEEDA5A5
+BOOT_HEADER_MAX_OFFSET = 0x19C
+
+MIN_MATCH = 4
+MAX_OFFSET = 0xFFFF
+# The last match starts at least 12 bytes before the end of the block and is followed by at least 5 literals
+MF_LIMIT = 12
+LAST_LITERALS = 5
+
+
+def boot_image_length(image):
+    """Returns the length copied by the bootloader, from the image header up to its checksum"""
+    if len(image) < 0x2C:
+        raise ValueError("Image too short")
+    image_marker, header_offset = struct.unpack_from("<II", image, 0x24)
+    if image_marker != BOOT_IMAGE_MARKER or header_offset > BOOT_HEADER_MAX_OFFSET:
+        raise ValueError("No boot image marker")
+    header_marker, _, _, image_length = struct.unpack_from("<IIII", image, header_offset)
+    if header_marker != BOOT_HEADER_MARKER:
+        raise ValueError("No boot image header")
+    if image_length == 0 or image_length + 4 > len(image):
+        raise ValueError("Invalid image length 0x%x" % image_length)
+    return image_length + 4
+
+
+def _length_ext(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def _sequence(out, literals, offset=0, match=0):
+    match_code = match - MIN_MATCH if offset else 0
+    out.append((min(len(literals), 15) << 4) | min(match_code, 15))
+    if len(literals) >= 15:
+        _length_ext(out, len(literals) - 15)
+    out += literals
+    if offset:
+        out += struct.pack("<H", offset)
+        if match_code >= 15:
+            _length_ext(out, match_code - 15)
+
+
+def compress_block(data):
+    """Greedy LZ4 block compressor, the last position of each 4 byte sequence is looked up in a dictionary"""
+    out = bytearray()
+    table = {}
+    anchor = pos = 0
+    match_start_limit = len(data) - MF_LIMIT
+    match_end_limit = len(data) - LAST_LITERALS
+
+    while pos < match_start_limit:
+        key = data[pos:pos + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = pos
+        if candidate is None or pos - candidate > MAX_OFFSET:
+            pos += 1
+            continue
+
+        end = pos + MIN_MATCH
+        while end < match_end_limit and data[end] == data[candidate + end - pos]:
+            end += 1
+
+        _sequence(out, data[anchor:pos], pos - candidate, end - pos)
+        for i in range(pos + 1, min(end, match_start_limit)):
+            table[data[i:i + MIN_MATCH]] = i
+        anchor = pos = end
+
+    _sequence(out, data[anchor:])
+    return bytes(out)
+
+
+def compress_image(image):
+    """Returns the compressed update image of a boot image"""
+    image = image[:boot_image_length(image)]
+    data = compress_block(image)
+    return LZ4_HEADER.pack(LZ4_MARKER, len(data), len(image), zlib.crc32(image) & 0xFFFFFFFF) + data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compresses a firmware image for the bootloader to decompress "
+                                     "while installing it")
+    parser.add_argument("image", help="Binary image, e.g. Debug/lpc54018iotmodule_freertos_sesip.bin")
+    parser.add_argument("output", help="Compressed image to download")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    try:
+        compressed = compress_image(image)
+    except ValueError as e:
+        sys.exit("%s: %s" % (args.image, e))
+    with open(args.output, "wb") as f:
+        f.write(compressed)
+
+    print("Compressed %s from %d to %d bytes" % (args.image, len(image), len(compressed)))
+
+
+if __name__ == "__main__":
+    main()
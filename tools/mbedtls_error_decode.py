@@ -0,0 +1,77 @@
+import argparse
+import glob
+import os
+import re
+import sys
+
+REPO_ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+# The codes are read from the mbed TLS headers and the strings from the text mode of the firmware,
+# so the table follows the mbed TLS version and configuration of the build.
+MBEDTLS_INCLUDE = os.path.join(REPO_ROOT, "lib", "mbedtls", "include", "mbedtls")
+MBEDTLS_ERROR_C = os.path.join(REPO_ROOT, "lib", "FreeRTOS", "platform", "freertos", "mbedtls", "mbedtls_error.c")
+
+HIGH_LEVEL_MASK = 0xFF80
+LOW_LEVEL_MASK = 0x007F
+
+# Logged by the transport with MBEDTLS_ERROR_COMPACT set to 1.
+LOGGED_CODE = re.compile(r"mbedTLSError= -0x([0-9a-fA-F]+)")
+
+DEFINE = re.compile(r"#define\s+(MBEDTLS_ERR_\w+)\s+-0x([0-9a-fA-F]+)")
+CASE = re.compile(r"case\s+-\(\s*(MBEDTLS_ERR_\w+)\s*\):\s*rc\s*=\s*\"([^\"]*)\";")
+
+
+def load_table(include_dir=MBEDTLS_INCLUDE, error_c=MBEDTLS_ERROR_C):
+    values = {}
+    for header in glob.glob(os.path.join(include_dir, "*.h")):
+        with open(header, encoding="utf-8", errors="replace") as f:
+            for name, value in DEFINE.findall(f.read()):
+                values[name] = int(value, 16)
+    if not values:
+        raise FileNotFoundError("No mbed TLS error codes in %s, is the lib/mbedtls submodule checked out?" % include_dir)
+
+    with open(error_c, encoding="utf-8") as f:
+        source = f.read()
+    split = source.index("mbedtls_strerror_lowlevel( int32_t errnum )\n{")
+    table = ({}, {})
+    for level, part in enumerate((source[:split], source[split:])):
+        for name, text in CASE.findall(part):
+            if name in values:
+                table[level][values[name]] = text
+    return table
+
+
+def describe(table, code):
+    code = abs(code)
+    high = table[0].get(code & HIGH_LEVEL_MASK, "<No-High-Level-Error-Code>")
+    low = table[1].get(code & LOW_LEVEL_MASK, "<No-Low-Level-Error-Code>")
+    return "%s : %s" % (high, low)
+
+
+def annotate(table, line):
+    return LOGGED_CODE.sub(lambda m: "%s (%s)" % (m.group(0), describe(table, int(m.group(1), 16))), line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decodes the mbed TLS error codes of a MBEDTLS_ERROR_COMPACT build")
+    parser.add_argument("codes", nargs="*", help="Codes to decode, e.g. -0x7780. Without codes, the log read on "
+                        "stdin is copied to stdout with the logged codes decoded")
+    parser.add_argument("--mbedtls-include", default=MBEDTLS_INCLUDE, help="Directory of the mbed TLS headers")
+    args = parser.parse_args()
+
+    try:
+        table = load_table(args.mbedtls_include)
+    except (OSError, ValueError) as e:
+        sys.exit(str(e))
+
+    if args.codes:
+        for code in args.codes:
+            print("%s: %s" % (code, describe(table, int(code, 16))))
+        return
+
+    for line in sys.stdin:
+        sys.stdout.write(annotate(table, line))
+
+
+if __name__ == "__main__":
+    main()
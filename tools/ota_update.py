@@ -21,15 +21,26 @@ from botocore.exceptions import ClientError
 import sys, argparse
 import subprocess
 import json
+import hashlib
+from concurrent.futures import ThreadPoolExecutor
+import lz4_image
 
 parser = argparse.ArgumentParser(description='Script to start OTA update')
-parser.add_argument("--thing-name", help="Name of thing",required=True)
+parser.add_argument("--thing-name", help="Name of thing", required=False)
+parser.add_argument("--thing-names", help="Names of the things to update", nargs="+", default=[], required=False)
+parser.add_argument("--thing-group", help="Name of the thing group to update", required=False)
+parser.add_argument("--job-per-target", help="Create one OTA job per thing or group, in parallel, instead of a single job", action="store_true")
+parser.add_argument("--content-addressed", help="Upload the image under a key derived from its SHA-256 and skip the upload if that key already exists", action="store_true")
 parser.add_argument("--s3bucket", help="S3 bucket to store firmware updates", required=True)
 parser.add_argument("--otasigningprofile", help="Signing profile to be created or used", required=True)
 parser.add_argument("--signingcertificateid", help="certificate id (not arn) to be used", required=True)
+parser.add_argument("--compress", help="Upload the image compressed, decompressed on the device while installing it", action="store_true")
 parser.add_argument("--codelocation", help="base folder location (can be relative)",default="../", required=False)
 args=parser.parse_args()
 
+if args.thing_name is None and len(args.thing_names) == 0 and args.thing_group is None:
+    parser.error("one of --thing-name, --thing-names or --thing-group is required")
+
 
 ota_update_role_name = "FreeRTOSOTAUpdate-2"
 
@@ -147,6 +158,48 @@ class AWS_IoT_OTA:
         
         print("Prepared BIN file at %s" % str(self.IMAGE_PATH))
 
+    # Replace the image by its compressed form, decompressed by the bootloader, or by the device in A/B mode
+    def CompressBinFile(self):
+        with open(self.IMAGE_PATH, "rb") as image:
+            data = image.read()
+        try:
+            compressed = lz4_image.compress_image(data)
+        except ValueError as e:
+            print("Error compressing bin file %s: %s" % (str(self.IMAGE_PATH), e))
+            sys.exit()
+
+        self.IMAGE_NAME = Path(self.IMAGE_NAME).stem + "-lz4" + Path(self.IMAGE_NAME).suffix
+        self.IMAGE_PATH = self.BUILD_PATH / Path(self.IMAGE_NAME)
+        self.IMAGE_KEY = self.IMAGE_NAME
+        with open(self.IMAGE_PATH, "wb") as image:
+            image.write(compressed)
+
+        print("Compressed BIN file at %s, %d bytes instead of %d" % (str(self.IMAGE_PATH), len(compressed), len(data)))
+
+
+    # Name the image after its content so an image that is already in the bucket is not uploaded again
+    def SetContentAddressedImageKey(self):
+        sha256 = hashlib.sha256()
+        with open(self.IMAGE_PATH, "rb") as image:
+            for chunk in iter(lambda: image.read(65536), b""):
+                sha256.update(chunk)
+        self.IMAGE_DIGEST = sha256.hexdigest()
+        self.IMAGE_KEY = Path(self.IMAGE_NAME).stem + "-" + self.IMAGE_DIGEST + Path(self.IMAGE_NAME).suffix
+        print("Content addressed image key: %s" % self.IMAGE_KEY)
+
+    # Use the image already in the bucket under the same key, if any
+    def FindFirmwareFileInS3(self):
+        try:
+            head = boto3.client('s3').head_object(Bucket=args.s3bucket, Key=self.IMAGE_KEY)
+            if head.get('VersionId') is not None:
+                self.latestVersionId = head['VersionId']
+                print("Image %s is already in bucket %s, skipping the upload." % (self.IMAGE_KEY, args.s3bucket))
+                return True
+        except ClientError as error:
+            if error.response['Error']['Code'] not in ('404', 'NoSuchKey', 'NoSuchBucket'):
+                print("Error looking up image in s3: %s" % error)
+                sys.exit()
+        return False
 
     # Copy the file to the s3 bucket
     def CopyFirmwareFileToS3(self):
@@ -165,7 +218,7 @@ class AWS_IoT_OTA:
                 VersioningConfiguration={
                     'MFADelete': 'Disabled',
                     'Status': 'Enabled'})
-            self.s3.meta.client.upload_file(str(self.IMAGE_PATH), args.s3bucket, self.IMAGE_NAME)
+            self.s3.meta.client.upload_file(str(self.IMAGE_PATH), args.s3bucket, self.IMAGE_KEY)
         except Exception as e:
             print("Error uploading file to s3: %s", e)
             sys.exit()
@@ -174,8 +227,8 @@ class AWS_IoT_OTA:
     # Get the latest version
     def GetLatestS3FileVersion(self):
         try: 
-            versions=self.s3.meta.client.list_object_versions(Bucket=args.s3bucket, Prefix=self.IMAGE_NAME)['Versions']
-            latestversion = [x for x in versions if x['IsLatest']==True]
+            versions=self.s3.meta.client.list_object_versions(Bucket=args.s3bucket, Prefix=self.IMAGE_KEY)['Versions']
+            latestversion = [x for x in versions if x['IsLatest']==True and x['Key']==self.IMAGE_KEY]
             self.latestVersionId=latestversion[0]['VersionId']
             #print("Using version %s" % self.latestVersionId)
         except Exception as e:
@@ -273,12 +326,20 @@ class AWS_IoT_OTA:
             sys.exit()
 
 
-    def CreateOTAJob(self):
+    # Targets of the update, as thing and thing group ARNs
+    def GetTargets(self):
+        thing_names = ([args.thing_name] if args.thing_name is not None else []) + args.thing_names
+        targets = ["arn:aws:iot:"+args.region+":"+args.account+":"+args.devicetype+"/"+name for name in thing_names]
+        if args.thing_group is not None:
+            targets.append("arn:aws:iot:"+args.region+":"+args.account+":thinggroup/"+args.thing_group)
+        return targets
+
+    def CreateOTAJob(self, targets):
         
         # Create OTA job
         try:
-            iot = boto3.client('iot')
-            randomValue=random.randint(1, 65535)
+            iot = self.iot_client
+            randomValue=random.getrandbits(32)
             #Initialize the template to use
             files=[{
                 'fileName': self.IMAGE_NAME,
@@ -286,7 +347,7 @@ class AWS_IoT_OTA:
                     'fileLocation': {
                         's3Location': {
                             'bucket': args.s3bucket,
-                            'key': self.IMAGE_NAME,
+                            'key': self.IMAGE_KEY,
                             'version': self.latestVersionId
                         }
                     },
@@ -302,7 +363,6 @@ class AWS_IoT_OTA:
                     }    
                 }] 
 
-            target="arn:aws:iot:"+args.region+":"+args.account+":"+args.devicetype+"/"+args.thing_name
             updateId="nxp-"+str(randomValue)
 
             print ("Files for update: %s" % files)
@@ -312,15 +372,17 @@ class AWS_IoT_OTA:
                 targetSelection='SNAPSHOT',
                 files=files,
                 protocols=['MQTT', 'HTTP'],
-                targets=[target],
+                targets=targets,
                 roleArn=self.role_arn
             )
 
-            print ("######################################################")
-            print("OTA Update Job Status: %s" % ota_update['otaUpdateStatus'])
-            print("OTA Update Job ID: %s" % "AFR_OTA-"['otaUpdateId'])
-            print("OTA Update Job ARN: %s" % ota_update['otaUpdateArn'])
-            print("########################################################")
+            # One print per job keeps the output of parallel jobs apart
+            print("######################################################\n" +
+                  "OTA Update Job Targets: %s\n" % targets +
+                  "OTA Update Job Status: %s\n" % ota_update['otaUpdateStatus'] +
+                  "OTA Update Job ID: %s\n" % ("AFR_OTA-" + ota_update['otaUpdateId']) +
+                  "OTA Update Job ARN: %s\n" % ota_update['otaUpdateArn'] +
+                  "########################################################")
 
 
         except Exception as e:
@@ -346,15 +408,31 @@ class AWS_IoT_OTA:
         self.BUILD_PATH = Path(args.codelocation) / Path("Debug/")
         self.IMAGE_NAME = "lpc54018iotmodule_freertos_sesip.bin"
         self.IMAGE_PATH = self.BUILD_PATH / Path(self.IMAGE_NAME)
+        self.IMAGE_KEY = self.IMAGE_NAME
+        self.iot_client = boto3.client('iot')
     
 
+    # Create a single job for all the targets, or one job per target in parallel
+    def CreateOTAJobs(self):
+        targets = self.GetTargets()
+        if args.job_per_target and len(targets) > 1:
+            with ThreadPoolExecutor(max_workers=min(len(targets), 8)) as pool:
+                list(pool.map(lambda target: self.CreateOTAJob([target]), targets))
+        else:
+            self.CreateOTAJob(targets)
+
     def DoUpdate(self):
         self.PrepareBinFile()
-        self.CopyFirmwareFileToS3()
-        self.GetLatestS3FileVersion()
+        if args.compress:
+            self.CompressBinFile()
+        if args.content_addressed:
+            self.SetContentAddressedImageKey()
+        if not (args.content_addressed and self.FindFirmwareFileInS3()):
+            self.CopyFirmwareFileToS3()
+            self.GetLatestS3FileVersion()
         self.CreateRole()
         self.CreateSigningProfile()
-        self.CreateOTAJob()
+        self.CreateOTAJobs()
 
 
 def main(argv):
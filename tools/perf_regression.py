@@ -0,0 +1,275 @@
+import argparse
+import json
+import shlex
+import subprocess
+import sys
+import time
+
+from provision import UartInterface
+
+# Metrics compared for each kind of result line, with True when a higher value is better.
+BENCH_METRICS = {"avg_us": False, "per_s": True}
+MFLASH_METRICS = {"us_per_op": False, "KB_per_s": True}
+TLS_RAM_METRICS = {"context_bytes": False, "connected_bytes": False, "pool_peak_bytes": False}
+
+DEFAULT_THRESHOLD_PCT = 10.0
+DONE_MARKER = "Benchmarks done."
+
+
+class BenchmarkError(Exception):
+    pass
+
+
+def flash_image(flash_command, image):
+    """
+    Flash and start the benchmark image with a debugger command line.
+    {image} in the command is replaced by the path of the image.
+    """
+    command = [part.replace("{image}", image) for part in shlex.split(flash_command)]
+    print(f"Flashing: {' '.join(command)}")
+    result = subprocess.run(command)
+    if result.returncode != 0:
+        raise BenchmarkError(f"Flash command failed with exit code {result.returncode}.")
+
+
+def collect_output(uart, timeout):
+    """
+    Read the device output until the benchmarks are done.
+    Returns the lines printed by the device.
+    """
+    output = ""
+    deadline = time.monotonic() + timeout
+    uart.serial.timeout = 1
+
+    while DONE_MARKER not in output:
+        if time.monotonic() > deadline:
+            raise BenchmarkError(f"The benchmarks did not complete within {timeout} s.")
+        data = uart.serial.read(max(1, uart.serial.in_waiting))
+        text = data.decode("ascii", errors="replace")
+        uart.echo(text)
+        output += text
+
+    return output.splitlines()
+
+
+def parse_results(lines):
+    """
+    Parse the BENCH, MFLASH_BENCH and TLS_RAM lines of the benchmark image into a dictionary
+    of metrics keyed by test and variant, the header lines are skipped.
+    """
+    results = {}
+
+    for line in lines:
+        fields = line.strip().split(",")
+        if fields[0] == "BENCH" and len(fields) == 9 and fields[1] != "test":
+            # BENCH,test,variant,count,bytes,min_us,avg_us,max_us,per_s
+            if fields[3] == "0":
+                continue
+            results[f"{fields[1]}/{fields[2]}"] = {
+                "avg_us": int(fields[6]),
+                "per_s": int(fields[8]),
+            }
+        elif fields[0] == "MFLASH_BENCH" and len(fields) == 7 and fields[1] != "op":
+            # MFLASH_BENCH,op,mode,count,bytes,us_per_op,KB_per_s
+            results[f"mflash/{fields[1]}/{fields[2]}"] = {
+                "us_per_op": int(fields[5]),
+                "KB_per_s": int(fields[6]),
+            }
+        elif fields[0] == "TLS_RAM" and len(fields) == 6 and fields[1] != "backend":
+            # TLS_RAM,backend,variant,context_bytes,connected_bytes,pool_peak_bytes
+            results[f"tls_ram/{fields[1]}/{fields[2]}"] = {
+                "context_bytes": int(fields[3]),
+                "connected_bytes": int(fields[4]),
+                "pool_peak_bytes": int(fields[5]),
+            }
+
+    return results
+
+
+def metric_directions(key):
+    if key.startswith("tls_ram/"):
+        return TLS_RAM_METRICS
+    return MFLASH_METRICS if key.startswith("mflash/") else BENCH_METRICS
+
+
+def compare(results, baseline, default_threshold, allow_missing):
+    """
+    Compare the results against the baseline.
+    A baseline entry may hold "threshold_pct" to override the default threshold, and metrics
+    set to null are not compared. Returns the list of regressions.
+    """
+    regressions = []
+
+    for key, expected in sorted(baseline["results"].items()):
+        threshold = expected.get("threshold_pct", default_threshold)
+        measured = results.get(key)
+
+        if measured is None:
+            if not allow_missing:
+                regressions.append(f"{key}: no result")
+            print(f"{key:40} missing")
+            continue
+
+        for metric, higher_is_better in metric_directions(key).items():
+            reference = expected.get(metric)
+            if reference is None or reference == 0:
+                continue
+
+            value = measured[metric]
+            change_pct = 100.0 * (value - reference) / reference
+            regressed = -change_pct > threshold if higher_is_better else change_pct > threshold
+            status = "REGRESSION" if regressed else "ok"
+            print(
+                f"{key:40} {metric:10} {reference:>10} -> {value:>10} ({change_pct:+6.1f}%, limit {threshold}%) {status}"
+            )
+            if regressed:
+                regressions.append(f"{key} {metric}: {reference} -> {value} ({change_pct:+.1f}%)")
+
+    for key in sorted(set(results) - set(baseline["results"])):
+        print(f"{key:40} new, not in the baseline")
+
+    return regressions
+
+
+def backend_key(key):
+    """
+    Key of a result with the TLS back end left out, so that the TLS_RAM lines of two builds
+    with different back ends are matched.
+    """
+    fields = key.split("/")
+    if fields[0] == "tls_ram" and len(fields) == 3:
+        return f"tls_ram/{fields[2]}"
+    return key
+
+
+def compare_backends(results, other):
+    """
+    Print the results side by side with those of a build with the other TLS back end,
+    written with --output. The change is given relative to the other build.
+    """
+    results = {backend_key(key): value for key, value in results.items()}
+    other = {backend_key(key): value for key, value in other.items()}
+
+    for key in sorted(set(results) | set(other)):
+        if key not in results or key not in other:
+            print(f"{key:40} only in the {'other' if key in other else 'current'} build")
+            continue
+
+        for metric in metric_directions(key):
+            reference = other[key][metric]
+            value = results[key][metric]
+            change = f"{100.0 * (value - reference) / reference:+6.1f}%" if reference else "   n/a"
+            print(f"{key:40} {metric:15} {reference:>10} -> {value:>10} ({change})")
+
+
+def write_baseline(path, results, default_threshold):
+    baseline = {"threshold_pct": default_threshold, "results": results}
+    with open(path, "w") as baseline_file:
+        json.dump(baseline, baseline_file, indent=4, sort_keys=True)
+    print(f"Baseline written to {path}.")
+
+
+def main(args):
+    uart = UartInterface(args.uart_serial_port, prefix="[device] ")
+    uart.serial.reset_input_buffer()
+
+    # The port is opened first, so the output printed right after the reset is not lost.
+    if args.flash_command:
+        flash_image(args.flash_command, args.image)
+
+    results = parse_results(collect_output(uart, args.timeout))
+    if not results:
+        raise BenchmarkError("The device printed no benchmark results.")
+
+    if args.output:
+        with open(args.output, "w") as output_file:
+            json.dump(results, output_file, indent=4, sort_keys=True)
+
+    if args.compare:
+        with open(args.compare) as compare_file:
+            compare_backends(results, json.load(compare_file))
+        return 0
+
+    if args.update_baseline:
+        write_baseline(args.baseline, results, args.threshold or DEFAULT_THRESHOLD_PCT)
+        return 0
+
+    with open(args.baseline) as baseline_file:
+        baseline = json.load(baseline_file)
+
+    default_threshold = args.threshold or baseline.get("threshold_pct", DEFAULT_THRESHOLD_PCT)
+    regressions = compare(results, baseline, default_threshold, args.allow_missing)
+
+    if regressions:
+        print(f"======================\n{len(regressions)} regressions:")
+        for regression in regressions:
+            print(f"  {regression}")
+        return 1
+
+    print("======================\nNo regressions.")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="""
+        Flashes the benchmark image, collects the results printed on the serial port and
+        compares them against a baseline. Exits with 1 on regressions and 2 on errors.
+        """
+    )
+    parser.add_argument(
+        "--uart-serial-port", help="Serial port of the device.", required=True
+    )
+    parser.add_argument(
+        "--baseline",
+        help="JSON file holding the reference results and thresholds.",
+    )
+    parser.add_argument(
+        "--image", help="Benchmark image, built with the Benchmark configuration."
+    )
+    parser.add_argument(
+        "--flash-command",
+        help="Command flashing and starting the image, {image} is replaced by --image. "
+        "Without it the device is expected to be reset by hand.",
+    )
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        help=f"Allowed change in percent for the metrics without their own threshold, "
+        f"default from the baseline or {DEFAULT_THRESHOLD_PCT}.",
+    )
+    parser.add_argument(
+        "--timeout",
+        type=int,
+        default=600,
+        help="Time in seconds for the benchmarks to complete.",
+    )
+    parser.add_argument(
+        "--allow-missing",
+        action="store_true",
+        help="Do not fail when a result of the baseline is missing, for example the optional TLS bulk test.",
+    )
+    parser.add_argument(
+        "--update-baseline",
+        action="store_true",
+        help="Write the results as the new baseline instead of comparing them.",
+    )
+    parser.add_argument("--output", help="Also write the results to this JSON file.")
+    parser.add_argument(
+        "--compare",
+        help="Results written with --output by a build with the other TLS back end, printed "
+        "side by side with this run instead of checking a baseline.",
+    )
+    args = parser.parse_args()
+
+    if not args.baseline and not args.compare:
+        parser.error("--baseline is required unless --compare is given.")
+
+    if args.flash_command and not args.image:
+        parser.error("--flash-command requires --image.")
+
+    try:
+        sys.exit(main(args))
+    except (BenchmarkError, OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(2)
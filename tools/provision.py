@@ -7,6 +7,13 @@ import boto3
 import json
 from pathlib import Path
 import subprocess
+import struct
+import binascii
+import base64
+import time
+import threading
+import os
+from concurrent.futures import ThreadPoolExecutor
 
 
 class IoTAgent:
@@ -57,10 +64,13 @@ class IoTAgent:
 
 
 class UartInterface:
-    def __init__(self, port):
+    def __init__(self, port, prefix=""):
         """
         Initialize the serial port used to communicate with the device.
+        The prefix is printed before every line of device output.
         """
+        self.prefix = prefix
+        self.log_line = ""
         self.serial = serial.Serial(
             port=port,
             baudrate=115200,
@@ -119,13 +129,155 @@ class UartInterface:
 
             read_length += 1
             if c == b"\n":
-                print(read_line)
+                print(f"{self.prefix}{read_line}", end="")
                 read_line = ""
 
         # We still want to see the message we are terminating the read on.
-        print(read_line)
+        print(f"{self.prefix}{read_line}")
         return read_string
 
+    def echo(self, text):
+        """
+        Print device output that arrives in arbitrary chunks, line by line.
+        """
+        lines = (self.log_line + text).split("\n")
+        self.log_line = lines.pop()
+        for line in lines:
+            print(f"{self.prefix}{line}")
+
+
+class FrameError(Exception):
+    pass
+
+
+class FrameInterface:
+    """
+    Binary provisioning protocol. A frame is a start byte, a type, a 16-bit
+    little endian payload length, the payload and a CRC-16/CCITT over the
+    type, length and payload. Must match nxp_provision_interface.c.
+    """
+
+    START = 0xA5
+    MAX_PAYLOAD = 5000
+
+    HELLO = 0x01
+    PING = 0x02
+    THING_NAME = 0x10
+    ENDPOINT = 0x11
+    OTA_KEY = 0x12
+    CSR_REQUEST = 0x13
+    CSR = 0x14
+    CERTIFICATE = 0x15
+    DONE = 0x16
+    KEY_PAIR = 0x17
+    TLS_PSK = 0x18
+    ACK = 0x7E
+    NAK = 0x7F
+
+    def __init__(self, uart):
+        self.uart = uart
+        self.serial = uart.serial
+        self.buffer = bytearray()
+        self.default_baudrate = self.serial.baudrate
+        self.default_timeout = self.serial.timeout
+
+    @staticmethod
+    def crc(data):
+        return binascii.crc_hqx(data, 0xFFFF)
+
+    def send(self, frame_type, payload=b""):
+        body = struct.pack("<BH", frame_type, len(payload)) + payload
+        self.serial.write(
+            bytes([self.START]) + body + struct.pack("<H", self.crc(body))
+        )
+        self.serial.flush()
+
+    def receive(self, timeout):
+        """
+        Return the next valid (type, payload) frame. Bytes outside of frames
+        are the device log and are printed.
+        """
+        deadline = time.monotonic() + timeout
+        while True:
+            start = self.buffer.find(bytes([self.START]))
+            if start < 0:
+                self.print_log(self.buffer)
+                del self.buffer[:]
+            else:
+                self.print_log(self.buffer[:start])
+                del self.buffer[:start]
+                if len(self.buffer) >= 4:
+                    frame_type, length = struct.unpack_from("<BH", self.buffer, 1)
+                    if length > self.MAX_PAYLOAD:
+                        del self.buffer[:1]
+                        continue
+                    if len(self.buffer) >= 6 + length:
+                        body = bytes(self.buffer[1 : 4 + length])
+                        (crc,) = struct.unpack_from("<H", self.buffer, 4 + length)
+                        if crc == self.crc(body):
+                            del self.buffer[: 6 + length]
+                            return frame_type, body[3:]
+                        # Not a frame after all, resynchronize on the next start byte.
+                        self.print_log(self.buffer[:1])
+                        del self.buffer[:1]
+                        continue
+
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise FrameError("Timed out waiting for a frame from the device.")
+            self.serial.timeout = remaining
+            self.buffer += self.serial.read(max(1, self.serial.in_waiting))
+
+    def print_log(self, data):
+        if data:
+            self.uart.echo(bytes(data).decode("ascii", errors="replace"))
+
+    def request(self, frame_type, payload=b"", response=ACK, timeout=20, retries=3):
+        """
+        Send a frame and wait for its answer, resending it on a NAK for a
+        corrupted frame or on a timeout.
+        """
+        for _ in range(retries):
+            self.send(frame_type, payload)
+            try:
+                answer, answer_payload = self.receive(timeout)
+            except FrameError:
+                continue
+            if answer == response and (
+                response != self.ACK or answer_payload[:1] == bytes([frame_type])
+            ):
+                return answer_payload
+            if answer == self.NAK and answer_payload[1:2] != b"\x01":
+                raise FrameError(
+                    f"Device rejected frame {frame_type:#04x}: {answer_payload.hex()}"
+                )
+        raise FrameError(f"No answer from the device for frame {frame_type:#04x}.")
+
+    def set_baudrate(self, baudrate):
+        """
+        Ask the device to switch baud rate, follow it and check the new rate.
+        """
+        self.request(self.HELLO, struct.pack("<I", baudrate))
+        self.serial.baudrate = baudrate
+        self.buffer.clear()
+        self.request(self.PING, timeout=0.5, retries=10)
+
+    def done(self):
+        self.request(self.DONE)
+        self.serial.baudrate = self.default_baudrate
+        self.serial.timeout = self.default_timeout
+
+
+def pem_to_der(pem):
+    lines = [line for line in pem.strip().splitlines() if not line.startswith("-----")]
+    return base64.b64decode("".join(lines))
+
+
+def der_to_pem(der, label):
+    body = base64.b64encode(der).decode("ascii")
+    lines = [body[i : i + 64] for i in range(0, len(body), 64)]
+    return "\n".join([f"-----BEGIN {label}-----"] + lines + [f"-----END {label}-----"]) + "\n"
+
 
 class OpenSSLAgent:
     def __init__(self):
@@ -184,15 +336,52 @@ class ACMAgent:
                 )
 
 
-def provision_to_iot_core(csr, thing_name):
+class ProvisioningContext:
     """
-    Given CSR and thing name, create a fully authenticated thing in AWS IoT Core.
+    AWS resources shared by every device provisioned in one run. The
+    endpoint, the policy and the OTA verification key are looked up or
+    created once, and the clients are shared by the provisioning workers.
     """
-    client = boto3.client("iot")
-    agent = IoTAgent(client)
 
-    policy_name = "DemoPolicy"
-    policiy_info = agent.create_policy(policy_name, json.dumps(agent.policy))
+    def __init__(self, policy_name="DemoPolicy"):
+        self.iot = IoTAgent(boto3.client("iot"))
+        self.policy_name = policy_name
+        self.lock = threading.Lock()
+        self.endpoint = None
+        self.policy_created = False
+        self.ota_public_key = None
+
+    def get_endpoint(self):
+        with self.lock:
+            if self.endpoint is None:
+                self.endpoint = self.iot.get_endpoint()
+            return self.endpoint
+
+    def get_policy(self):
+        with self.lock:
+            if not self.policy_created:
+                self.iot.create_policy(self.policy_name, json.dumps(self.iot.policy))
+                self.policy_created = True
+            return self.policy_name
+
+    def get_ota_public_key(self):
+        """
+        One OTA signing key is imported to ACM for the whole run, since ACM
+        limits the number of imported certificates.
+        """
+        with self.lock:
+            if self.ota_public_key is None:
+                self.ota_public_key = create_ota_public_key()
+            return self.ota_public_key
+
+
+def provision_to_iot_core(csr, thing_name, context):
+    """
+    Given CSR and thing name, create a fully authenticated thing in AWS IoT Core.
+    Returns the certificate description from AWS IoT Core.
+    """
+    agent = context.iot
+    policy_name = context.get_policy()
 
     agent.create_thing(thing_name)
 
@@ -202,7 +391,7 @@ def provision_to_iot_core(csr, thing_name):
     agent.attach_policies(policy_name, data["certificateArn"])
     agent.attach_cert_to_thing(thing_name, data["certificateArn"])
 
-    return data["certificatePem"]
+    return data
 
 
 def provision_thing_name(thing_name, stream_interface):
@@ -210,15 +399,12 @@ def provision_thing_name(thing_name, stream_interface):
     stream_interface.write(thing_name)
 
 
-def provision_thing_endpoint(stream_interface):
-    iot = boto3.client("iot")
-    iot_agent = IoTAgent(iot)
+def provision_thing_endpoint(stream_interface, context):
     device_output = stream_interface.read("read thing endpoint", -1)
-    stream_interface.write(iot_agent.get_endpoint())
+    stream_interface.write(context.get_endpoint())
 
 
-def provision_ota(stream_interface):
-    device_output = stream_interface.read("read OTA verification key", -1)
+def create_ota_public_key():
     acm = boto3.client("acm")
     acm_agent = ACMAgent(acm)
     ssl = OpenSSLAgent()
@@ -227,12 +413,19 @@ def provision_ota(stream_interface):
         ssl.get_signer_cert_path(), ssl.get_signer_key_path()
     )
     with open(ssl.get_signer_public_key_path(), "r") as ota_pub_key:
-        stream_interface.write(ota_pub_key.read())
+        public_key = ota_pub_key.read()
     ssl.cleanup()
+    return public_key
 
 
-def provision_csr(stream_interface, thing_name):
+def provision_ota(stream_interface, context):
+    device_output = stream_interface.read("read OTA verification key", -1)
+    stream_interface.write(context.get_ota_public_key())
+
+
+def provision_csr(stream_interface, thing_name, context):
     csr = ""
+    certificate = None
     device_output = stream_interface.read("Finished outputting CSR", -1)
     csr = re.search(
         r"(-----BEGIN CERTIFICATE REQUEST-----((?:.*\n)+)-----END CERTIFICATE REQUEST-----)",
@@ -240,40 +433,149 @@ def provision_csr(stream_interface, thing_name):
     ).group(0)
     device_output = stream_interface.read("Ready to read device certificate", -1)
     if "Ready to read device certificate" in device_output and csr != "":
-        pem = provision_to_iot_core(csr, thing_name)
+        certificate = provision_to_iot_core(csr, thing_name, context)
         print("Writing x509 device certificate PEM to device.")
         sleep(1)
-        stream_interface.write(pem.strip())
+        stream_interface.write(certificate["certificatePem"].strip())
         print("Finished writing certificate to device.")
+    return certificate
+
+
+def provision_binary(stream_interface, thing_name, baudrate, context, psk=None):
+    """
+    Provision the device with the binary protocol. The credentials are sent
+    as DER and every frame is acknowledged by the device. psk is an optional
+    (identity, key) pair for the TLS-PSK connections to on-premises brokers.
+    """
+    frames = FrameInterface(stream_interface)
+    frames.set_baudrate(baudrate)
+
+    # The device generates its key pair while the AWS lookups below run.
+    frames.request(FrameInterface.KEY_PAIR)
+    endpoint = context.get_endpoint()
+    ota_public_key = context.get_ota_public_key()
+
+    frames.request(FrameInterface.THING_NAME, thing_name.encode("ascii"), timeout=60)
+
+    frames.request(FrameInterface.ENDPOINT, endpoint.encode("ascii"))
+
+    frames.request(FrameInterface.OTA_KEY, pem_to_der(ota_public_key))
+
+    if psk is not None:
+        identity, key = psk
+        frames.request(FrameInterface.TLS_PSK, bytes([len(identity)]) + identity + key)
 
+    csr = frames.request(
+        FrameInterface.CSR_REQUEST, response=FrameInterface.CSR, timeout=60
+    )
+    certificate = provision_to_iot_core(
+        der_to_pem(csr, "CERTIFICATE REQUEST"), thing_name, context
+    )
+    print("Writing x509 device certificate DER to device.")
+    frames.request(FrameInterface.CERTIFICATE, pem_to_der(certificate["certificatePem"]))
+    print("Finished writing certificate to device.")
+
+    frames.done()
+    return certificate
 
-def provision(stream_interface, thing_name):
+
+def provision(stream_interface, thing_name, context, baudrate=None, follow=True, psk=None):
     """
     Coordinate the provisioning process given a streaming interface and
-    a thing name.
+    a thing name. Returns the certificate description from AWS IoT Core,
+    or None if the device was not provisioned.
     """
+    certificate = None
     print("Beginning provisioning script...")
 
     device_output = stream_interface.read("y/n", -1)
     if "Device was already provisioned" in device_output:
         stream_interface.write("y")
         device_output = stream_interface.read("y/n", -1)
-    if "Do you want to provision the device" in device_output:
+    if "Do you want to provision the device" in device_output and baudrate:
+        certificate = provision_binary(stream_interface, thing_name, baudrate, context, psk)
+    elif "Do you want to provision the device" in device_output:
         stream_interface.write("y")
         provision_thing_name(thing_name, stream_interface)
-        provision_thing_endpoint(stream_interface)
-        provision_ota(stream_interface)
-        provision_csr(stream_interface, thing_name)
+        provision_thing_endpoint(stream_interface, context)
+        provision_ota(stream_interface, context)
+        certificate = provision_csr(stream_interface, thing_name, context)
+    if follow:
+        print(
+            "======================\nProvisioning script has ended. The script will continue to read the serial port, but you can now end the python program by entering `ctrl+c`\n======================"
+        )
+        # Just sit here and read until the user exits
+        device_output = stream_interface.read("!!!!!!!!!!!!!!", -1)
+    return certificate
+
+
+def provision_device(port, thing_name, context, baudrate):
+    """
+    Provision the board on one serial port for a batch run and return its
+    manifest entry. Failures are recorded instead of stopping the batch.
+    """
+    result = {"port": port, "thing_name": thing_name, "status": "failed"}
+    start = time.monotonic()
+    try:
+        uart = UartInterface(port, prefix=f"[{os.path.basename(port)}] ")
+        certificate = provision(uart, thing_name, context, baudrate, follow=False)
+        if certificate is not None:
+            result["status"] = "provisioned"
+            result["certificate_arn"] = certificate["certificateArn"]
+            result["certificate_id"] = certificate["certificateId"]
+        else:
+            result["error"] = "The device did not ask to be provisioned."
+    except Exception as e:
+        result["error"] = str(e)
+    result["duration_s"] = round(time.monotonic() - start, 1)
+    return result
+
+
+def provision_batch(ports, thing_name_prefix, context, baudrate, workers, manifest):
+    """
+    Provision the boards on all the serial ports with a pool of workers and
+    write the per-device results to the manifest.
+    """
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        results = list(
+            pool.map(
+                lambda port: provision_device(
+                    port, f"{thing_name_prefix}-{uuid.uuid4().hex[:8]}", context, baudrate
+                ),
+                ports,
+            )
+        )
+
+    with open(manifest, "w") as manifest_file:
+        json.dump(results, manifest_file, indent=4)
+
+    provisioned = sum(1 for result in results if result["status"] == "provisioned")
     print(
-        "======================\nProvisioning script has ended. The script will continue to read the serial port, but you can now end the python program by entering `ctrl+c`\n======================"
+        f"======================\nProvisioned {provisioned} of {len(results)} devices. Results written to {manifest}.\n======================"
     )
-    # Just sit here and read until the user exits
-    device_output = stream_interface.read("!!!!!!!!!!!!!!", -1)
+    for result in results:
+        if result["status"] != "provisioned":
+            print(f"{result['port']}: {result['error']}")
 
 
 def main(args):
-    uart = UartInterface(args.uart_serial_port)
-    provision(uart, args.thing_name)
+    baudrate = None if args.text_protocol else args.baud_rate
+    context = ProvisioningContext()
+    if args.batch_serial_ports:
+        provision_batch(
+            args.batch_serial_ports,
+            args.thing_name_prefix,
+            context,
+            baudrate,
+            args.workers or len(args.batch_serial_ports),
+            args.manifest,
+        )
+    else:
+        psk = None
+        if args.psk:
+            psk = (args.psk_identity.encode("ascii"), bytes.fromhex(args.psk))
+        uart = UartInterface(args.uart_serial_port)
+        provision(uart, args.thing_name, context, baudrate, psk=psk)
 
 
 if __name__ == "__main__":
@@ -295,5 +597,61 @@ if __name__ == "__main__":
         help="Name of the UART serial port to write over. If defined will attempt to write credentials over the UART interface.",
     )
 
+    parser.add_argument(
+        "--batch-serial-ports",
+        type=str,
+        nargs="+",
+        help="Names of the UART serial ports of the boards to provision in one batch. Replaces --uart-serial-port and --thing-name.",
+    )
+    parser.add_argument(
+        "--thing-name-prefix",
+        type=str,
+        help="Prefix of the IoT thing names created in batch mode. The device stores at most 31 characters of the name.",
+        default="generated-thing",
+    )
+    parser.add_argument(
+        "--workers",
+        type=int,
+        help="Number of boards provisioned at once in batch mode. Defaults to one per serial port.",
+    )
+    parser.add_argument(
+        "--manifest",
+        type=str,
+        help="File the per-device results of a batch are written to.",
+        default="provision_manifest.json",
+    )
+    parser.add_argument(
+        "--baud-rate",
+        type=int,
+        choices=[230400, 460800, 921600],
+        help="Baud rate negotiated with the device for the binary provisioning protocol.",
+        default=921600,
+    )
+    parser.add_argument(
+        "--text-protocol",
+        action="store_true",
+        help="Provision with the PEM text protocol, for devices without binary provisioning.",
+    )
+    parser.add_argument(
+        "--psk",
+        type=str,
+        help="TLS pre-shared key in hexadecimal, at most 32 bytes, for on-premises brokers. Needs --psk-identity.",
+    )
+    parser.add_argument(
+        "--psk-identity",
+        type=str,
+        help="Identity of the TLS pre-shared key, at most 255 characters.",
+    )
+
     args = parser.parse_args()
+    if args.psk:
+        if not args.psk_identity or len(args.psk_identity) > 255:
+            parser.error("--psk requires a --psk-identity of 1 to 255 characters.")
+        if args.batch_serial_ports or args.text_protocol:
+            parser.error("--psk is only sent to a single device with the binary protocol.")
+        try:
+            if not 0 < len(bytes.fromhex(args.psk)) <= 32:
+                parser.error("--psk must be 1 to 32 bytes.")
+        except ValueError:
+            parser.error("--psk must be hexadecimal.")
     main(args)
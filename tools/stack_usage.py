@@ -0,0 +1,417 @@
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+REPO_ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+# Tasks of the firmware: name given to the kernel, entry function and macro of the stack size in words.
+# The macros are read from the sources, so the table follows the configuration.
+TASKS = [
+    ("Hello_task", "hello_task", "hello_task_STACK_SIZE"),
+    ("MQTT_Agent_task", "prvMQTTAgentLoop", "MQTT_AGENT_TASK_STACK_SIZE"),
+    ("OTA_task", "otaAgentTask", "otaconfigSTACK_SIZE"),
+    ("IP-task", "prvIPTask", "ipconfigIP_TASK_STACK_SIZE_WORDS"),
+    ("Tmr Svc", "prvTimerTask", "configTIMER_TASK_STACK_DEPTH"),
+    ("IDLE", "prvIdleTask", "configMINIMAL_STACK_SIZE"),
+    ("Watchdog_task", "prvWatchdogTask", "watchdogTASK_STACK_SIZE"),
+    ("Log_task", "prvDeferredLogTask", "deferredlogTASK_STACK_SIZE"),
+    ("Work_task", "prvDeferredWorkTask", "deferredworkTASK_STACK_SIZE"),
+    ("LinkMonitor_task", "prvLinkMonitorTask", "linkmonitorTASK_STACK_SIZE"),
+    ("HeapMon_task", "prvHeapMonitorTask", "heapmonitorTASK_STACK_SIZE"),
+    ("TaskStats_task", "prvTaskStatsTask", "taskstatsTASK_STACK_SIZE"),
+    ("Provision_window", "prvReprovisionWindowTask", "provisionWINDOW_TASK_STACK_SIZE"),
+    ("mflash", "mflash_drv_task", "MFLASH_ASYNC_TASK_STACK_SIZE"),
+    ("RWAccess", "prvRWAccessTask", "RESTRICTED_TASK_STACK_SIZE"),
+    ("ROAccess", "prvROAccessTask", "RESTRICTED_TASK_STACK_SIZE"),
+    ("LentPayload", "prvLentPayloadTask", "RESTRICTED_TASK_STACK_SIZE"),
+    ("Publisher", "prvPublisherTask", "RESTRICTED_TASK_STACK_SIZE"),
+]
+
+# Stacked on the task stack by an interrupt and the context switch of the ARM_CM4_MPU port with a live
+# FPU context: 26 words of exception frame, 1 of alignment, r3 (CONTROL) to r11 and r14, s16 to s31.
+CONTEXT_BYTES = (26 + 1 + 10 + 16) * 4
+
+# End of the stack checked by configCHECK_FOR_STACK_OVERFLOW 2, any use of it is reported as an overflow.
+OVERFLOW_PATTERN_BYTES = 16
+
+DEFAULT_MARGIN_PCT = 25
+DEFAULT_UNKNOWN_BYTES = 64
+ROUND_WORDS = 8
+
+FUNCTION_LINE = re.compile(r"^([0-9a-f]+) <(.+)>:$")
+BRANCH_LINE = re.compile(r"^\s*[0-9a-f]+:\s+(blx?|b[a-z]{0,2}(?:\.[nw])?|cbn?z)\s+(?:r\d+,\s*)?[0-9a-f]+ <([^>+]+)(\+0x[0-9a-f]+)?>")
+# Calls and jumps through a register. Loading pc from the stack is a return.
+INDIRECT_LINE = re.compile(
+    r"^\s*[0-9a-f]+:\s+(?:blx\s+r\d+|bx\s+r(?:[0-9]|1[0-2])\b|ldr(?:\.w)?\s+pc,\s*\[(?!sp)|mov\s+pc,|ldm\S*\s+(?!sp)\w+!?,\s*{[^}]*pc})"
+)
+DEFINE_LINE = re.compile(r"^\s*#\s*define\s+(\w+)\s+(.+?)\s*(?:/\*.*)?$")
+CAST = re.compile(r"\(\s*(?:unsigned|signed|short|int|long|char|u?int\d+_t|size_t|UBaseType_t|\s)+\)")
+SUFFIX = re.compile(r"\b(0x[0-9a-fA-F]+|\d+)[uUlL]+\b")
+
+
+class StackUsageError(Exception):
+    pass
+
+
+def load_stack_usage(build_dir):
+    """
+    Read the .su files written next to the objects by -fstack-usage.
+    Static functions sharing a name are merged, keeping the largest frame.
+    Returns the frame size in bytes and whether it is dynamic, per function name.
+    """
+    frames = {}
+
+    for root, _, files in os.walk(build_dir):
+        for name in files:
+            if not name.endswith(".su"):
+                continue
+            with open(os.path.join(root, name)) as su_file:
+                for line in su_file:
+                    fields = line.rstrip("\n").split("\t")
+                    if len(fields) < 3:
+                        continue
+                    function = fields[0].rsplit(":", 1)[-1]
+                    size = int(fields[1])
+                    # "dynamic,bounded" is included in the size, "dynamic" alone is alloca or a VLA.
+                    dynamic = fields[2] == "dynamic"
+                    previous = frames.get(function, (0, False))
+                    frames[function] = (max(previous[0], size), previous[1] or dynamic)
+
+    if not frames:
+        raise StackUsageError(f"No .su files in {build_dir}, build with -fstack-usage.")
+    return frames
+
+
+def function_name(symbol):
+    # Long calls between the flash and the RAM code go through a linker veneer.
+    match = re.match(r"^__(.+)_veneer$", symbol)
+    return match.group(1) if match else symbol
+
+
+def load_call_graph(elf, objdump):
+    """
+    Disassemble the firmware and collect the direct calls and tail calls of each function, and the
+    functions calling through a pointer.
+    Returns the callees per function name and the set of functions with indirect calls.
+    """
+    try:
+        result = subprocess.run([objdump, "-d", "--no-show-raw-insn", elf], stdout=subprocess.PIPE, universal_newlines=True)
+    except FileNotFoundError:
+        raise StackUsageError(f"{objdump} not found, pass the toolchain objdump with --objdump.")
+    if result.returncode != 0:
+        raise StackUsageError(f"{objdump} failed with exit code {result.returncode}.")
+
+    calls = {}
+    indirect = set()
+    current = None
+
+    for line in result.stdout.splitlines():
+        match = FUNCTION_LINE.match(line)
+        if match:
+            # The body of a veneer is a jump to the function it stands for, not a call.
+            current = None if function_name(match.group(2)) != match.group(2) else match.group(2)
+            if current is not None:
+                calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+
+        match = BRANCH_LINE.match(line)
+        if match:
+            target = function_name(match.group(2))
+            # Branches inside the function are its own control flow, the others are calls or tail calls.
+            if target != current or match.group(1) in ("bl", "blx"):
+                calls[current].add(target)
+            continue
+
+        if INDIRECT_LINE.match(line):
+            indirect.add(current)
+
+    return calls, indirect
+
+
+def load_defines(directories):
+    """
+    Read the #define of the sources, the first definition of a name wins so the defaults in #ifndef
+    blocks are only used when nothing else defines the name.
+    """
+    defines = {}
+
+    for directory in directories:
+        for root, _, files in os.walk(directory):
+            for name in sorted(files):
+                if not name.endswith((".h", ".c")):
+                    continue
+                with open(os.path.join(root, name), errors="replace") as source:
+                    for line in source:
+                        match = DEFINE_LINE.match(line)
+                        if match and match.group(1) not in defines:
+                            defines[match.group(1)] = match.group(2)
+
+    return defines
+
+
+def resolve(name, defines, depth=0):
+    if depth > 16 or name not in defines:
+        raise StackUsageError(f"Cannot resolve {name} from the sources, pass the size with --task.")
+
+    expression = SUFFIX.sub(r"\1", CAST.sub("", defines[name]))
+    expression = re.sub(r"\b[A-Za-z_]\w*\b", lambda word: str(resolve(word.group(0), defines, depth + 1)), expression)
+    if not re.fullmatch(r"[0-9xa-fA-F\s()+\-*/]+", expression):
+        raise StackUsageError(f"{name} is not a constant: {defines[name]}")
+    return int(eval(expression.replace("/", "//")))
+
+
+class Analysis:
+    def __init__(self, frames, calls, indirect, extra_calls, unknown_bytes):
+        self.frames = frames
+        self.calls = calls
+        self.indirect = indirect
+        self.extra_calls = extra_calls
+        self.unknown_bytes = unknown_bytes
+        self.memo = {}
+
+    def callees(self, function):
+        return self.calls.get(function, set()) | self.extra_calls.get(function, set())
+
+    def worst(self, function, active=()):
+        """
+        Worst-case stack in bytes from the entry of the function, with the call path and what makes
+        the bound unsafe: recursion, indirect calls, dynamic frames and functions without a frame size.
+        """
+        if function in self.memo:
+            return self.memo[function]
+        if function in active:
+            return 0, [function], {"recursion": {function}}
+
+        frame, dynamic = self.frames.get(function, (None, False))
+        issues = {}
+        if frame is None:
+            frame = self.unknown_bytes
+            issues["unknown"] = {function}
+        if dynamic:
+            issues["dynamic"] = {function}
+        if function in self.indirect and function not in self.extra_calls:
+            issues["indirect"] = {function}
+
+        deepest, path = 0, []
+        for callee in sorted(self.callees(function)):
+            depth, callee_path, callee_issues = self.worst(callee, active + (function,))
+            for kind, functions in callee_issues.items():
+                issues.setdefault(kind, set()).update(functions)
+            if depth > deepest:
+                deepest, path = depth, callee_path
+
+        result = (frame + deepest, [function] + path, issues)
+        # A result found while walking a cycle depends on the entry point of the walk.
+        if "recursion" not in issues:
+            self.memo[function] = result
+        return result
+
+
+def load_runtime(paths):
+    """
+    Read the lowest stack high-water mark of each task, in words, from captured logs holding the
+    STACK,<task>,<words> lines of task_stats.c, or from the JSON published on device/<thing>/tasks.
+    """
+    lowest = {}
+
+    def record(task, words):
+        lowest[task] = min(words, lowest.get(task, words))
+
+    for path in paths:
+        with open(path, errors="replace") as runtime_file:
+            for line in runtime_file:
+                match = re.search(r"STACK,([^,\r\n]+),(\d+)", line)
+                if match:
+                    record(match.group(1), int(match.group(2)))
+                    continue
+                start = line.find("{")
+                if start < 0:
+                    continue
+                try:
+                    message = json.loads(line[start:])
+                except ValueError:
+                    continue
+                for task in message.get("tasks", []) if isinstance(message, dict) else []:
+                    if "name" in task and "stack" in task:
+                        record(task["name"], int(task["stack"]))
+
+    return lowest
+
+
+def recommend(required_bytes, margin_pct):
+    words = (required_bytes * (100 + margin_pct) + 399) // 400
+    return (words + ROUND_WORDS - 1) // ROUND_WORDS * ROUND_WORDS
+
+
+def analyze(tasks, analysis, runtime, margin_pct):
+    reports = []
+
+    for name, entry, words in tasks:
+        depth, path, issues = analysis.worst(entry)
+        missing = entry not in analysis.frames and entry not in analysis.calls
+        if missing:
+            issues = {"missing": {entry}}
+        static_bytes = depth + CONTEXT_BYTES + OVERFLOW_PATTERN_BYTES
+        bounded = not issues
+
+        free_words = runtime.get(name)
+        runtime_bytes = None
+        if free_words is not None:
+            runtime_bytes = (words - free_words) * 4 + OVERFLOW_PATTERN_BYTES
+
+        # An unsafe static bound is still a lower bound, the measurement may only raise it.
+        required = max(static_bytes, runtime_bytes or 0)
+        recommended = recommend(required, margin_pct)
+        if missing and runtime_bytes is None:
+            # Not built into this image, nothing is known about the task.
+            recommended = words
+
+        reports.append(
+            {
+                "task": name,
+                "entry": entry,
+                "configured_words": words,
+                "static_bytes": static_bytes,
+                "static_bounded": bounded,
+                "worst_path": path,
+                "issues": {kind: sorted(functions) for kind, functions in sorted(issues.items())},
+                "runtime_free_words": free_words,
+                "runtime_bytes": runtime_bytes,
+                "required_bytes": required,
+                "recommended_words": recommended,
+                "too_small": (required > words * 4) and not (missing and runtime_bytes is None),
+            }
+        )
+
+    return reports
+
+
+def print_reports(reports, verbose):
+    print(f"{'task':18} {'entry':26} {'config':>6} {'static':>7} {'runtime':>7} {'recommended':>11}  notes")
+    for report in reports:
+        runtime = "-" if report["runtime_bytes"] is None else report["runtime_bytes"]
+        notes = []
+        if report["too_small"]:
+            notes.append("TOO SMALL")
+        if "missing" in report["issues"]:
+            notes.append("entry not in the image")
+        elif not report["static_bounded"]:
+            notes.append("static bound unsafe: " + ", ".join(report["issues"]))
+            if report["runtime_bytes"] is None:
+                notes.append("no runtime data")
+        print(
+            f"{report['task']:18} {report['entry']:26} {report['configured_words']:>6} "
+            f"{report['static_bytes']:>7} {runtime:>7} {report['recommended_words']:>11}  {'; '.join(notes)}"
+        )
+        if verbose:
+            print(f"    worst path: {' > '.join(report['worst_path'])}")
+            for kind, functions in report["issues"].items():
+                print(f"    {kind}: {' '.join(functions[:8])}{' ...' if len(functions) > 8 else ''}")
+
+    configured = sum(report["configured_words"] for report in reports)
+    recommended = sum(report["recommended_words"] for report in reports)
+    print(
+        f"Sizes in words, static and runtime in bytes. {configured} words configured, {recommended} recommended, "
+        f"{(configured - recommended) * 4} bytes to reclaim."
+    )
+
+
+def parse_tasks(args, defines):
+    tasks = []
+    overrides = {}
+    for task in args.task:
+        match = re.fullmatch(r"([^=]+)=(\w+)(?::(\d+))?", task)
+        if match is None:
+            raise StackUsageError(f"--task {task} is not NAME=ENTRY[:WORDS].")
+        overrides[match.group(1)] = (match.group(2), match.group(3))
+
+    for name, entry, macro in TASKS:
+        entry, words = overrides.pop(name, (entry, None))
+        tasks.append((name, entry, int(words) if words else resolve(macro, defines)))
+    for name, (entry, words) in overrides.items():
+        if words is None:
+            raise StackUsageError(f"--task {name} is not in the table, give its size as NAME=ENTRY:WORDS.")
+        tasks.append((name, entry, int(words)))
+
+    return [task for task in tasks if task[0] not in args.skip]
+
+
+def parse_calls(calls):
+    extra_calls = {}
+    for call in calls:
+        match = re.fullmatch(r"(\w+)=(\w+(?:,\w+)*)", call)
+        if match is None:
+            raise StackUsageError(f"--call {call} is not CALLER=CALLEE[,CALLEE...].")
+        extra_calls.setdefault(match.group(1), set()).update(match.group(2).split(","))
+    return extra_calls
+
+
+def main(args):
+    frames = load_stack_usage(args.build_dir)
+    calls, indirect = load_call_graph(args.elf, args.objdump)
+    tasks = parse_tasks(args, load_defines([os.path.join(REPO_ROOT, "source"), os.path.join(REPO_ROOT, "lib")]))
+    runtime = load_runtime(args.runtime)
+
+    analysis = Analysis(frames, calls, indirect, parse_calls(args.call), args.unknown_bytes)
+    reports = analyze(tasks, analysis, runtime, args.margin)
+    print_reports(reports, args.verbose)
+
+    if args.output:
+        with open(args.output, "w") as output_file:
+            json.dump({"margin_pct": args.margin, "tasks": reports}, output_file, indent=4)
+
+    if args.check and any(report["too_small"] for report in reports):
+        print("Stacks smaller than the measured or static worst case.")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="""
+        Computes the worst-case stack of each task from the -fstack-usage output and the call graph of
+        the firmware, combines it with the high-water marks measured on the device and recommends a
+        stack size per task.
+        """
+    )
+    parser.add_argument("--elf", help="ELF file of the firmware.", required=True)
+    parser.add_argument("--build-dir", default=".", help="Build directory holding the .su files, default the current one.")
+    parser.add_argument("--objdump", default="arm-none-eabi-objdump", help="objdump of the toolchain.")
+    parser.add_argument(
+        "--runtime",
+        nargs="*",
+        default=[],
+        help="Captured device logs or device/<thing>/tasks messages holding the stack high-water marks.",
+    )
+    parser.add_argument(
+        "--margin", type=int, default=DEFAULT_MARGIN_PCT, help=f"Margin in percent, default {DEFAULT_MARGIN_PCT}."
+    )
+    parser.add_argument(
+        "--unknown-bytes",
+        type=int,
+        default=DEFAULT_UNKNOWN_BYTES,
+        help=f"Frame assumed for the functions without a .su entry, such as the C library, default {DEFAULT_UNKNOWN_BYTES}.",
+    )
+    parser.add_argument(
+        "--call",
+        nargs="*",
+        default=[],
+        help="Targets of the calls through pointers, as CALLER=CALLEE[,CALLEE...].",
+    )
+    parser.add_argument("--task", nargs="*", default=[], help="Task to add or override, as NAME=ENTRY[:WORDS].")
+    parser.add_argument("--skip", nargs="*", default=[], help="Tasks of the table not in the image.")
+    parser.add_argument("--output", help="Also write the report to this JSON file.")
+    parser.add_argument("--check", action="store_true", help="Exit with 1 when a stack is smaller than required.")
+    parser.add_argument("--verbose", action="store_true", help="Print the worst path of each task.")
+    args = parser.parse_args()
+
+    try:
+        sys.exit(main(args))
+    except (StackUsageError, OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(2)